@@ -22,6 +22,7 @@
 #include <sys/klog.h>
 #include <unistd.h>
 
+#include <array>
 #include <chrono>
 #include <cmath>
 #include <cstddef>
@@ -46,6 +47,7 @@
 #include <android/log.h>
 #include <cutils/android_reboot.h>
 #include <cutils/properties.h>
+#include <Histogram.h>
 #include <statslog.h>
 
 #include "boot_event_record_store.h"
@@ -581,12 +583,22 @@ bool readPstoreConsole(std::string& console) {
 // the data stream being inspected.
 class pstoreConsole {
  private:
-  const size_t kBitErrorRate = 8;  // number of bits per error
+  static constexpr size_t kBitErrorRate = 8;  // number of bits per error
   const std::string& console;
+  // Results of rfind() so far, keyed by needle.
+  mutable std::unordered_map<std::string, size_t> rfindResults;
+
+  // Number of bits set in each byte value, the compiler does not always
+  // have a popcount instruction to hand and this is the inner loop.
+  static constexpr std::array<uint8_t, 256> kBitCount = [] {
+    std::array<uint8_t, 256> count{};
+    for (size_t i = 1; i < count.size(); ++i) count[i] = (i & 1) + count[i / 2];
+    return count;
+  }();
 
   // Number of bits that differ between the two arguments l and r.
   // Returns zero if the values for l and r are identical.
-  size_t numError(uint8_t l, uint8_t r) const { return std::bitset<8>(l ^ r).count(); }
+  static size_t numError(uint8_t l, uint8_t r) { return kBitCount[l ^ r]; }
 
   // A string comparison function, reports the number of errors discovered
   // in the match to a maximum of the bitLength / kBitErrorRate, at that
@@ -604,6 +616,12 @@ class pstoreConsole {
     size_t n = _r.length();
     const uint8_t* le = reinterpret_cast<const uint8_t*>(l) + n;
     const uint8_t* re = reinterpret_cast<const uint8_t*>(r) + n;
+    // Most positions fail within the first three characters, at a branch
+    // that is hard to predict; sum them up front and reject in one go.
+    if ((n >= 3) && ((numError(le[-1], re[-1]) + numError(le[-2], re[-2]) +
+                      numError(le[-3], re[-3])) > 3)) {
+      return std::string::npos;
+    }
     size_t count = 0;
     n = 0;
     do {
@@ -626,22 +644,50 @@ class pstoreConsole {
   explicit pstoreConsole(const std::string&& console) = delete;
   explicit pstoreConsole(std::string&& console) = delete;
 
+  // Runs rfind() for all the needles in one pass over the console, so that
+  // later rfind() calls for them are lookups. The exact and the fuzzy match
+  // are looked for in the same pass, the exact match still wins wherever it
+  // is.
+  void index(const std::vector<std::string>& needles) const {
+    struct candidate {
+      const std::string* needle;
+      size_t fuzzy;
+    };
+    std::vector<candidate> candidates;
+    for (const auto& needle : needles) {
+      if (rfindResults.count(needle)) continue;
+      rfindResults[needle] = std::string::npos;
+      // Check to make sure needle fits in console string.
+      if (needle.empty() || (needle.length() > console.length())) continue;
+      candidates.push_back({&needle, std::string::npos});
+    }
+    for (size_t end = console.length(); !candidates.empty() && (end > 0); --end) {
+      for (auto it = candidates.begin(); it != candidates.end();) {
+        if (it->needle->length() <= end) {
+          const size_t pos = end - it->needle->length();
+          const size_t num = numError(pos, *it->needle);
+          if (num == 0) {  // exact match?
+            rfindResults[*it->needle] = pos;
+            it = candidates.erase(it);
+            continue;
+          }
+          // fuzzy match to maximum kBitErrorRate
+          if ((num != std::string::npos) && (it->fuzzy == std::string::npos)) it->fuzzy = pos;
+        }
+        ++it;
+      }
+    }
+    for (const auto& c : candidates) rfindResults[*c.needle] = c.fuzzy;
+  }
+
   // Our implementation of rfind, use exact match first, then resort to fuzzy.
   size_t rfind(const std::string& needle) const {
-    size_t pos = console.rfind(needle);  // exact match?
-    if (pos != std::string::npos) return pos;
-
-    // Check to make sure needle fits in console string.
-    pos = console.length();
-    if (needle.length() > pos) return std::string::npos;
-    pos -= needle.length();
-    // fuzzy match to maximum kBitErrorRate
-    for (;;) {
-      if (numError(pos, needle) != std::string::npos) return pos;
-      if (pos == 0) break;
-      --pos;
+    auto it = rfindResults.find(needle);
+    if (it == rfindResults.end()) {
+      index({needle});
+      it = rfindResults.find(needle);
     }
-    return std::string::npos;
+    return it->second;
   }
 
   // Our implementation of find, use only fuzzy match.
@@ -1047,6 +1093,9 @@ std::string BootReasonStrToReason(const std::string& boot_reason) {
     std::string content;
     if (readPstoreConsole(content)) {
       const pstoreConsole console(content);
+      static const char cmd[] = "reboot: Restarting system with command '";
+      console.index({"reboot: Power down", cmd});
+
       // The toybox reboot command used directly (unlikely)? But also
       // catches init's response to Android's more controlled reboot command.
       if (console.rfind("reboot: Power down") != std::string::npos) {
@@ -1057,7 +1106,6 @@ std::string BootReasonStrToReason(const std::string& boot_reason) {
         //       that could be missing in last_reboot_reason_property.
       }
 
-      static const char cmd[] = "reboot: Restarting system with command '";
       size_t pos = console.rfind(cmd);
       if (pos != std::string::npos) {
         std::string subReason(getSubreason(content, pos + strlen(cmd), /* quoted */ true));
@@ -1255,6 +1303,40 @@ void LogBootInfoToStatsd(std::chrono::milliseconds end_time,
                              (int64_t)time_since_last_boot_sec * 1000);
 }
 
+// Logs the duration of each boot phase, and the time to boot_complete, to
+// expresslog histograms so that regressions in their distribution across
+// devices can be tracked.
+void LogBootPhaseHistograms(std::chrono::milliseconds uptime) {
+  using android::expresslog::Histogram;
+
+  static constexpr int kBinCount = 50;
+  static const struct {
+    const char* metric;
+    const char* property;  // nullptr for the time to boot_complete
+    int64_t units_per_ms;
+    float max_ms;
+  } kPhases[] = {
+      {"boot.value_init_first_stage_latency", "ro.boottime.init.first_stage", 1000000, 5000},
+      {"boot.value_init_selinux_latency", "ro.boottime.init.selinux", 1000000, 2000},
+      {"boot.value_init_cold_boot_wait_latency", "ro.boottime.init.cold_boot_wait", 1, 2000},
+      {"boot.value_boot_complete_latency", nullptr, 1, 120000},
+  };
+
+  for (const auto& phase : kPhases) {
+    int64_t value_ms = uptime.count();
+    if (phase.property) {
+      int64_t value;
+      if (!android::base::ParseInt(android::base::GetProperty(phase.property, ""), &value)) {
+        continue;
+      }
+      value_ms = value / phase.units_per_ms;
+    }
+    Histogram histogram(phase.metric,
+                        Histogram::UniformOptions::create(kBinCount, 0, phase.max_ms));
+    histogram.logSample(value_ms);
+  }
+}
+
 void SetSystemBootReason() {
   const auto bootloader_boot_reason =
       android::base::GetProperty(bootloader_reboot_reason_property, "");
@@ -1342,6 +1424,7 @@ void RecordBootComplete() {
   RecordInitBootTimeProp(&boot_event_store, "ro.boottime.init");
   RecordInitBootTimeProp(&boot_event_store, "ro.boottime.init.first_stage");
   RecordInitBootTimeProp(&boot_event_store, "ro.boottime.init.selinux");
+  RecordInitBootTimeProp(&boot_event_store, "ro.boottime.init.selinux_compile");
   RecordInitBootTimeProp(&boot_event_store, "ro.boottime.init.cold_boot_wait");
 
   const BootloaderTimingMap bootloader_timings = GetBootLoaderTimings();
@@ -1357,6 +1440,7 @@ void RecordBootComplete() {
 
   LogBootInfoToStatsd(boot_end_time, absolute_boot_time, bootloader_boot_duration,
                       time_since_last_boot);
+  LogBootPhaseHistograms(uptime_ms);
 }
 
 // Records the boot_reason metric by querying the ro.boot.bootreason system
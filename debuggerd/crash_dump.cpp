@@ -53,10 +53,12 @@
 #include <utils/Trace.h>
 
 #include <unwindstack/AndroidUnwinder.h>
+#include <unwindstack/Elf.h>
 #include <unwindstack/Error.h>
 #include <unwindstack/MachineArm.h>
 #include <unwindstack/MachineArm64.h>
 #include <unwindstack/MachineRiscv64.h>
+#include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
 #include <unwindstack/RegsArm.h>
 #include <unwindstack/RegsArm64.h>
@@ -149,16 +151,6 @@ static bool wait_for_stop(pid_t tid, int* received_signal) {
   }
 }
 
-// Interrupt a process and wait for it to be interrupted.
-static bool ptrace_interrupt(pid_t tid, int* received_signal) {
-  if (ptrace(PTRACE_INTERRUPT, tid, 0, 0) == 0) {
-    return wait_for_stop(tid, received_signal);
-  }
-
-  PLOG(ERROR) << "failed to interrupt " << tid << " to detach";
-  return false;
-}
-
 static bool activity_manager_notify(pid_t pid, int signal, const std::string& amfd_data,
                                     bool recoverable_crash) {
   ATRACE_CALL();
@@ -614,8 +606,29 @@ int main(int argc, char** argv) {
   std::string error;
   bool recoverable_crash = false;
 
+  // Everything that can be read while the threads are still running is read up front: every
+  // thread stays stopped from when it's interrupted until the snapshot has been forked, so the
+  // time spent per thread below adds up to the pause of the first threads.
+  std::string selinux_label;
+  std::map<pid_t, std::string> thread_names;
+  {
+    ATRACE_NAME("thread info");
+    unique_fd attr_fd(openat(target_proc_fd, "attr/current", O_RDONLY | O_CLOEXEC));
+    if (!android::base::ReadFdToString(attr_fd, &selinux_label)) {
+      PLOG(WARNING) << "failed to read selinux label";
+    }
+    for (pid_t thread : threads) {
+      if (thread != pseudothread_tid) {
+        thread_names[thread] = get_thread_name(thread);
+      }
+    }
+  }
+
   {
     ATRACE_NAME("ptrace");
+    // Attach to every thread before stopping any of them, and then ask them all to stop before
+    // waiting for the first, so that they stop concurrently rather than one after another.
+    std::vector<pid_t> seized_threads;
     for (pid_t thread : threads) {
       // Trace the pseudothread separately, so we can use different options.
       if (thread == pseudothread_tid) {
@@ -625,21 +638,31 @@ int main(int argc, char** argv) {
       if (!ptrace_seize_thread(target_proc_fd, thread, &error)) {
         bool fatal = thread == g_target_thread;
         LOG(fatal ? FATAL : WARNING) << error;
+        continue;
+      }
+      seized_threads.push_back(thread);
+    }
+
+    std::vector<pid_t> interrupted_threads;
+    for (pid_t thread : seized_threads) {
+      if (ptrace(PTRACE_INTERRUPT, thread, 0, 0) != 0) {
+        PLOG(WARNING) << "failed to ptrace interrupt thread " << thread;
+        ptrace(PTRACE_DETACH, thread, 0, 0);
+        continue;
       }
+      interrupted_threads.push_back(thread);
+    }
 
+    for (pid_t thread : interrupted_threads) {
       ThreadInfo info;
       info.pid = target_process;
       info.tid = thread;
       info.uid = getuid();
-      info.thread_name = get_thread_name(thread);
-
-      unique_fd attr_fd(openat(target_proc_fd, "attr/current", O_RDONLY | O_CLOEXEC));
-      if (!android::base::ReadFdToString(attr_fd, &info.selinux_label)) {
-        PLOG(WARNING) << "failed to read selinux label";
-      }
+      info.thread_name = thread_names[thread];
+      info.selinux_label = selinux_label;
 
-      if (!ptrace_interrupt(thread, &info.signo)) {
-        PLOG(WARNING) << "failed to ptrace interrupt thread " << thread;
+      if (!wait_for_stop(thread, &info.signo)) {
+        PLOG(WARNING) << "failed to wait for thread " << thread << " to stop";
         ptrace(PTRACE_DETACH, thread, 0, 0);
         continue;
       }
@@ -767,7 +790,15 @@ int main(int argc, char** argv) {
 
   // TODO: Use seccomp to lock ourselves down.
 
-  unwindstack::AndroidRemoteUnwinder unwinder(vm_pid, unwindstack::Regs::CurrentArch());
+  // The guest unwinder reads its own copy of the maps, so let both unwinders share the ELF objects
+  // (and their decoded unwind tables) for the files they have in common.
+  unwindstack::Elf::SetCachingEnabled(true);
+
+  // engrave_tombstone unwinds the threads of large processes in parallel, so use a memory object
+  // that keeps a cache per thread rather than one shared cache.
+  std::shared_ptr<unwindstack::Memory> process_memory =
+      unwindstack::Memory::CreateProcessMemoryThreadCached(vm_pid);
+  unwindstack::AndroidRemoteUnwinder unwinder(vm_pid, process_memory);
   unwindstack::ErrorData error_data;
   if (!unwinder.Initialize(error_data)) {
     LOG(FATAL) << "Failed to initialize unwinder object: "
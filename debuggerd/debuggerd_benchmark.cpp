@@ -22,7 +22,10 @@
 #include <unistd.h>
 
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include <benchmark/benchmark.h>
 #include <debuggerd/client.h>
@@ -122,7 +125,43 @@ static void BM_maximum_pause_debuggerd(benchmark::State& state) {
   BM_maximum_pause_impl(state, []() { PerformDump(); });
 }
 
+// Every thread of the process is stopped while crash_dump collects their registers, so the pause
+// grows with the number of threads, as in system_server.
+static void BM_maximum_pause_debuggerd_threads(benchmark::State& state) {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool done = false;
+  std::vector<std::thread> idle_threads;
+  for (int64_t i = 0; i < state.range(0); ++i) {
+    idle_threads.emplace_back([&]() {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&]() { return done; });
+    });
+  }
+
+  BM_maximum_pause_impl(state, []() { PerformDump(); });
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+  }
+  cv.notify_all();
+  for (auto& thread : idle_threads) {
+    thread.join();
+  }
+}
+
+// Wall time of a whole native backtrace request, which is what a flood of ANR traces pays per
+// process. Most of it is crash_dump reading the ELF files and unwind tables of the target.
+static void BM_dump_latency_debuggerd(benchmark::State& state) {
+  for (auto _ : state) {
+    PerformDump();
+  }
+}
+
 BENCHMARK(BM_maximum_pause_noop)->Iterations(128)->UseManualTime();
 BENCHMARK(BM_maximum_pause_debuggerd)->Iterations(128)->UseManualTime();
+BENCHMARK(BM_maximum_pause_debuggerd_threads)->Arg(64)->Arg(320)->Iterations(32)->UseManualTime();
+BENCHMARK(BM_dump_latency_debuggerd)->Iterations(32)->UseRealTime()->Unit(benchmark::kMillisecond);
 
 BENCHMARK_MAIN();
@@ -18,6 +18,7 @@
 #include <dlfcn.h>
 #include <err.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <linux/prctl.h>
 #include <malloc.h>
 #include <pthread.h>
@@ -2564,6 +2565,56 @@ TEST(tombstoned, proto) {
   ASSERT_EQ(proto_fd_st.st_ino, proto_file_st.st_ino);
 }
 
+TEST(tombstoned, deduplicate) {
+  if (!android::base::GetBoolProperty("tombstoned.deduplicate_tombstones", true)) {
+    GTEST_SKIP() << "tombstone deduplication is disabled";
+  }
+
+  // Make the signature unique to this run, so that earlier runs aren't duplicates.
+  const pid_t self = getpid();
+  std::string tombstone = android::base::StringPrintf(
+      "Cmdline: tombstoned_deduplicate %d %" PRId64 "\n"
+      "signal 11 (SIGSEGV), code 1 (SEGV_MAPERR), fault addr 0x1234\n"
+      "backtrace:\n"
+      "      #00 pc 0000000000001234  /system/bin/tombstoned_deduplicate (crash+4)\n",
+      self, static_cast<int64_t>(time(nullptr)));
+
+  auto write_tombstone = [&](struct stat* text_st) {
+    unique_fd tombstoned_socket, text_fd;
+    ASSERT_TRUE(tombstoned_connect(self, &tombstoned_socket, &text_fd, kDebuggerdTombstone));
+    ASSERT_TRUE(android::base::WriteStringToFd(tombstone, text_fd.get()));
+    ASSERT_EQ(0, fstat(text_fd.get(), text_st));
+    tombstoned_notify_completion(tombstoned_socket.get());
+  };
+
+  const auto max_wait_time = std::chrono::seconds(5) * android::base::HwTimeoutMultiplier();
+  struct stat first_st;
+  write_tombstone(&first_st);
+  std::optional<std::string> first_file;
+  for (auto start = std::chrono::high_resolution_clock::now();
+       !first_file && std::chrono::high_resolution_clock::now() - start < max_wait_time;) {
+    std::this_thread::sleep_for(100ms);
+    CheckForTombstone(first_st, first_file);
+  }
+  ASSERT_TRUE(first_file) << "Timed out trying to find tombstone file.";
+
+  struct stat second_st;
+  write_tombstone(&second_st);
+  std::string expected = android::base::Basename(*first_file) + " 1\n";
+  std::string counts;
+  for (auto start = std::chrono::high_resolution_clock::now();
+       std::chrono::high_resolution_clock::now() - start < max_wait_time;) {
+    std::this_thread::sleep_for(100ms);
+    android::base::ReadFileToString("/data/tombstones/duplicate_counts", &counts);
+    if (counts.find(expected) != std::string::npos) break;
+  }
+  ASSERT_NE(std::string::npos, counts.find(expected)) << counts;
+
+  std::optional<std::string> second_file;
+  CheckForTombstone(second_st, second_file);
+  ASSERT_FALSE(second_file) << "duplicate written to " << *second_file;
+}
+
 TEST(tombstoned, proto_intercept) {
   const pid_t self = getpid();
   unique_fd intercept_fd, output_fd;
@@ -3092,6 +3143,57 @@ TEST_F(CrasherTest, verify_thread_header) {
   ASSERT_MATCH(result, match_str);
 }
 
+// Verify that every thread of a process with enough threads to be unwound in parallel is dumped.
+TEST_F(CrasherTest, verify_thread_header_many_threads) {
+  constexpr size_t kThreadCount = 64;
+  void* shared_map = mmap(nullptr, kThreadCount * sizeof(pid_t), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(MAP_FAILED, shared_map);
+  memset(shared_map, 0, kThreadCount * sizeof(pid_t));
+
+  StartProcess([&shared_map]() {
+    std::atomic_size_t tids_written = 0;
+    for (size_t i = 0; i < kThreadCount; i++) {
+      std::thread thread([i, &tids_written, &shared_map]() {
+        pid_t tid = gettid();
+        memcpy(static_cast<pid_t*>(shared_map) + i, &tid, sizeof(pid_t));
+        tids_written++;
+        volatile bool done = false;
+        while (!done)
+          ;
+      });
+      thread.detach();
+    }
+    while (tids_written.load(std::memory_order_acquire) != kThreadCount)
+      ;
+    abort();
+  });
+
+  pid_t primary_pid = crasher_pid;
+
+  unique_fd output_fd;
+  StartIntercept(&output_fd);
+  FinishCrasher();
+  AssertDeath(SIGABRT);
+  int intercept_result;
+  FinishIntercept(&intercept_result);
+  ASSERT_EQ(1, intercept_result) << "tombstoned reported failure";
+
+  std::vector<pid_t> tids(kThreadCount);
+  memcpy(tids.data(), shared_map, kThreadCount * sizeof(pid_t));
+  ASSERT_EQ(0, munmap(shared_map, kThreadCount * sizeof(pid_t)));
+
+  std::string result;
+  ConsumeFd(std::move(output_fd), &result);
+
+  for (pid_t tid : tids) {
+    ASSERT_NE(0, tid);
+    std::string match_str =
+        android::base::StringPrintf("pid: %d, tid: %d, name: .*  >>> .* <<<\\n", primary_pid, tid);
+    ASSERT_MATCH(result, match_str);
+  }
+}
+
 // Verify that there is a BuildID present in the map section and set properly.
 TEST_F(CrasherTest, verify_build_id) {
   StartProcess([]() { abort(); });
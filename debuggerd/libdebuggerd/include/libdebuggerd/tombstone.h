@@ -50,7 +50,10 @@ constexpr size_t kMaxFrames = 256;
  */
 int open_tombstone(std::string* path);
 
-/* Creates a tombstone file and writes the crash dump to it. */
+/* Creates a tombstone file and writes the crash dump to it.
+ * Processes with many threads are unwound from several threads at once, which the unwinder's
+ * process memory must support.
+ */
 void engrave_tombstone(android::base::unique_fd output_fd, android::base::unique_fd proto_fd,
                        unwindstack::AndroidUnwinder* unwinder,
                        const std::map<pid_t, ThreadInfo>& thread_info, pid_t target_thread,
@@ -71,6 +74,11 @@ bool tombstone_proto_to_text(
     const Tombstone& tombstone,
     std::function<void(const std::string& line, bool should_log)> callback);
 
+/* Writes the text form of tombstone to fd, buffered into large writes.
+ * Returns false if the tombstone was malformed or a write failed.
+ */
+bool tombstone_proto_to_text(const Tombstone& tombstone, int fd);
+
 void fill_in_backtrace_frame(BacktraceFrame* f, const unwindstack::FrameData& frame);
 void set_human_readable_cause(Cause* cause, uint64_t fault_addr);
 
@@ -19,6 +19,7 @@
 
 #include <string>
 
+#include <android-base/file.h>
 #include <android-base/test_utils.h>
 
 #include "libdebuggerd/tombstone.h"
@@ -134,3 +135,40 @@ TEST_F(TombstoneProtoToTextTest, crash_detail_bytes) {
   ProtoToString();
   EXPECT_MATCH(text_, R"(CRASH_DETAIL_NAME: 'helloworld\\1\\255\\3')");
 }
+
+TEST_F(TombstoneProtoToTextTest, log_buffer_truncated) {
+  LogBuffer* buffer = tombstone_->add_log_buffers();
+  buffer->set_name("main");
+  LogMessage* msg = buffer->add_logs();
+  msg->set_tag("TAG");
+  msg->set_message("message");
+  ProtoToString();
+  EXPECT_NOT_MATCH(text_, "some messages not dumped");
+
+  buffer->set_truncated(true);
+  ProtoToString();
+  EXPECT_MATCH(text_, "--------- log main\\n--------- some messages not dumped: over the logcat "
+                      "budget\\n.* TAG     : message\\n");
+}
+
+TEST_F(TombstoneProtoToTextTest, memory_dump_truncated) {
+  MemoryDump* dump = main_thread_->add_memory_dump();
+  dump->set_register_name("x0");
+  dump->set_memory(std::string(16, '\0'));
+  main_thread_->set_memory_dump_truncated(true);
+  ProtoToString();
+  EXPECT_MATCH(text_, "memory near x0:\\n.*\\n\\nmemory near the remaining registers not dumped");
+}
+
+TEST_F(TombstoneProtoToTextTest, fd_output_matches_callback) {
+  std::string expected;
+  tombstone_proto_to_text(*tombstone_, [&expected](const std::string& line, bool) {
+    expected += line + '\n';
+  });
+
+  TemporaryFile tf;
+  ASSERT_TRUE(tombstone_proto_to_text(*tombstone_, tf.fd));
+  std::string actual;
+  ASSERT_TRUE(android::base::ReadFileToString(tf.path, &actual));
+  EXPECT_EQ(expected, actual);
+}
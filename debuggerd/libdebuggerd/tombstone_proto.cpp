@@ -33,10 +33,15 @@
 #include <sys/sysinfo.h>
 #include <time.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <optional>
 #include <set>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <async_safe/log.h>
 
@@ -75,6 +80,57 @@ using android::base::StringPrintf;
 // The maximum number of messages to save in the protobuf per file.
 static constexpr size_t kMaxLogMessages = 500;
 
+// Times a section of the tombstone and limits how long it can take and how many bytes it can add,
+// with the limits read from debug.debuggerd.<property>_max_ms and _max_bytes (0 means no limit).
+// A section that runs out of budget stops early and is marked as truncated. The timing of every
+// section is recorded in the tombstone to show what makes a dump slow.
+class SectionBudget {
+ public:
+  explicit SectionBudget(std::string name, const char* property = nullptr,
+                         uint64_t default_max_ms = 0, uint64_t default_max_bytes = 0)
+      : name_(std::move(name)), start_(std::chrono::steady_clock::now()) {
+    if (property != nullptr) {
+      std::string prefix = StringPrintf("debug.debuggerd.%s", property);
+      max_ms_ = android::base::GetUintProperty<uint64_t>(prefix + "_max_ms", default_max_ms);
+      max_bytes_ =
+          android::base::GetUintProperty<uint64_t>(prefix + "_max_bytes", default_max_bytes);
+    }
+  }
+
+  bool HasTimeLeft() const { return max_ms_ == 0 || ElapsedUs() <= max_ms_ * 1000; }
+  bool IsOverSize() const { return max_bytes_ != 0 && bytes_ > max_bytes_; }
+  bool CanAdd(size_t bytes) const {
+    return HasTimeLeft() && (max_bytes_ == 0 || bytes_ + bytes <= max_bytes_);
+  }
+
+  void Add(size_t bytes) { bytes_ += bytes; }
+  void Remove(size_t bytes) { bytes_ -= bytes; }
+
+  void SetTruncated() { truncated_ = true; }
+  bool truncated() const { return truncated_; }
+
+  void Record(Tombstone* tombstone) const {
+    SectionTiming* timing = tombstone->add_section_timings();
+    timing->set_name(name_);
+    timing->set_duration_us(ElapsedUs());
+    timing->set_bytes(bytes_);
+    timing->set_truncated(truncated_);
+  }
+
+ private:
+  uint64_t ElapsedUs() const {
+    auto elapsed = std::chrono::steady_clock::now() - start_;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+  }
+
+  std::string name_;
+  std::chrono::steady_clock::time_point start_;
+  uint64_t max_ms_ = 0;
+  uint64_t max_bytes_ = 0;
+  uint64_t bytes_ = 0;
+  bool truncated_ = false;
+};
+
 // Use the demangler from libc++.
 extern "C" char* __cxa_demangle(const char*, char*, size_t*, int* status);
 
@@ -403,7 +459,7 @@ void fill_in_backtrace_frame(BacktraceFrame* f, const unwindstack::FrameData& fr
 
 static void dump_registers(unwindstack::AndroidUnwinder* unwinder,
                            const std::unique_ptr<unwindstack::Regs>& regs, Thread& thread,
-                           bool memory_dump) {
+                           SectionBudget* memory_dump) {
   if (regs == nullptr) {
     return;
   }
@@ -418,6 +474,13 @@ static void dump_registers(unwindstack::AndroidUnwinder* unwinder,
     *thread.add_registers() = r;
 
     if (memory_dump) {
+      constexpr size_t kNumBytesAroundRegister = 256;
+      if (!memory_dump->CanAdd(kNumBytesAroundRegister)) {
+        memory_dump->SetTruncated();
+        thread.set_memory_dump_truncated(true);
+        return;
+      }
+
       MemoryDump dump;
 
       dump.set_register_name(name);
@@ -426,7 +489,6 @@ static void dump_registers(unwindstack::AndroidUnwinder* unwinder,
         dump.set_mapping_name(map_info->name());
       }
 
-      constexpr size_t kNumBytesAroundRegister = 256;
       constexpr size_t kNumTagsAroundRegister = kNumBytesAroundRegister / kTagGranuleSize;
       char buf[kNumBytesAroundRegister];
       uint8_t tags[kNumTagsAroundRegister];
@@ -436,6 +498,7 @@ static void dump_registers(unwindstack::AndroidUnwinder* unwinder,
       }
       dump.set_begin_address(value);
       dump.set_memory(buf, bytes);
+      memory_dump->Add(bytes);
 
       bool has_tags = false;
 #if defined(__aarch64__)
@@ -481,9 +544,8 @@ static void dump_thread_backtrace(std::vector<unwindstack::FrameData>& frames, T
   }
 }
 
-static void dump_thread(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwinder,
-                        const ThreadInfo& thread_info, bool memory_dump = false,
-                        unwindstack::AndroidUnwinder* guest_unwinder = nullptr) {
+static Thread unwind_thread(unwindstack::AndroidUnwinder* unwinder, const ThreadInfo& thread_info,
+                            SectionBudget* memory_dump) {
   Thread thread;
 
   thread.set_id(thread_info.tid);
@@ -507,29 +569,102 @@ static void dump_thread(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwi
     dump_thread_backtrace(data.frames, thread);
   }
   dump_registers(unwinder, *data.saved_initial_regs, thread, memory_dump);
+  return thread;
+}
+
+static void dump_guest_thread(Tombstone* tombstone, unwindstack::AndroidUnwinder* guest_unwinder,
+                              const ThreadInfo& thread_info, SectionBudget* memory_dump) {
+  if (!thread_info.guest_registers) {
+    async_safe_format_log(ANDROID_LOG_INFO, LOG_TAG,
+                          "No guest state registers information for tid %d", thread_info.tid);
+    return;
+  }
+  Thread guest_thread;
+  unwindstack::AndroidUnwinderData guest_data;
+  guest_data.saved_initial_regs = std::make_optional<std::unique_ptr<unwindstack::Regs>>();
+  if (guest_unwinder->Unwind(thread_info.guest_registers.get(), guest_data)) {
+    dump_thread_backtrace(guest_data.frames, guest_thread);
+  } else {
+    async_safe_format_log(ANDROID_LOG_ERROR, LOG_TAG,
+                          "Unwind guest state registers failed for tid %d: Error %s",
+                          thread_info.tid, guest_data.GetErrorString().c_str());
+  }
+  dump_registers(guest_unwinder, *guest_data.saved_initial_regs, guest_thread, memory_dump);
+  auto& guest_threads = *tombstone->mutable_guest_threads();
+  guest_threads[thread_info.tid] = guest_thread;
+}
 
+static void dump_thread(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwinder,
+                        const ThreadInfo& thread_info, SectionBudget* memory_dump = nullptr,
+                        unwindstack::AndroidUnwinder* guest_unwinder = nullptr) {
   auto& threads = *tombstone->mutable_threads();
-  threads[thread_info.tid] = thread;
+  threads[thread_info.tid] = unwind_thread(unwinder, thread_info, memory_dump);
 
   if (guest_unwinder) {
-    if (!thread_info.guest_registers) {
-      async_safe_format_log(ANDROID_LOG_INFO, LOG_TAG,
-                            "No guest state registers information for tid %d", thread_info.tid);
-      return;
+    dump_guest_thread(tombstone, guest_unwinder, thread_info, memory_dump);
+  }
+}
+
+// Unwinding the other threads is most of the time spent on a tombstone for processes with many
+// threads, so spread them over a few workers once there are enough of them to pay for starting
+// the workers. The workers share the unwinder, and with it the maps and the ELF objects that have
+// already been read for the target thread, so its process memory must be safe to read from several
+// threads at once (see Memory::CreateProcessMemoryThreadCached).
+static constexpr size_t kMaxUnwindWorkers = 4;
+static constexpr size_t kMinThreadsPerUnwindWorker = 8;
+
+static size_t unwind_worker_count(const std::vector<const ThreadInfo*>& threads) {
+  for (const ThreadInfo* thread_info : threads) {
+    // Unwinding from a tid reads the registers with ptrace, which only works on this thread.
+    if (thread_info->registers == nullptr) return 1;
+  }
+  size_t workers = std::min<size_t>(kMaxUnwindWorkers, std::thread::hardware_concurrency());
+  workers = std::min(workers, threads.size() / kMinThreadsPerUnwindWorker);
+  return std::max<size_t>(workers, 1);
+}
+
+static void dump_other_threads(Tombstone* tombstone, unwindstack::AndroidUnwinder* unwinder,
+                               const std::map<pid_t, ThreadInfo>& threads, pid_t target_tid,
+                               unwindstack::AndroidUnwinder* guest_unwinder) {
+  std::vector<const ThreadInfo*> others;
+  for (const auto& [tid, thread_info] : threads) {
+    if (tid != target_tid) {
+      others.push_back(&thread_info);
     }
-    Thread guest_thread;
-    unwindstack::AndroidUnwinderData guest_data;
-    guest_data.saved_initial_regs = std::make_optional<std::unique_ptr<unwindstack::Regs>>();
-    if (guest_unwinder->Unwind(thread_info.guest_registers.get(), guest_data)) {
-      dump_thread_backtrace(guest_data.frames, guest_thread);
-    } else {
-      async_safe_format_log(ANDROID_LOG_ERROR, LOG_TAG,
-                            "Unwind guest state registers failed for tid %d: Error %s",
-                            thread_info.tid, guest_data.GetErrorString().c_str());
+  }
+
+  size_t worker_count = unwind_worker_count(others);
+  if (worker_count == 1) {
+    for (const ThreadInfo* thread_info : others) {
+      dump_thread(tombstone, unwinder, *thread_info, /* memory_dump */ nullptr, guest_unwinder);
+    }
+    return;
+  }
+
+  std::vector<Thread> results(others.size());
+  std::atomic<size_t> next_index = 0;
+  auto worker = [&]() {
+    for (size_t i = next_index++; i < others.size(); i = next_index++) {
+      results[i] = unwind_thread(unwinder, *others[i], /* memory_dump */ nullptr);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < worker_count; i++) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : workers) {
+    t.join();
+  }
+
+  // Add the results in tid order so the tombstone doesn't depend on which worker finished first.
+  // The guest unwinder has its own memory cache, so guest threads are still unwound here.
+  auto& tombstone_threads = *tombstone->mutable_threads();
+  for (size_t i = 0; i < others.size(); i++) {
+    tombstone_threads[others[i]->tid] = std::move(results[i]);
+    if (guest_unwinder) {
+      dump_guest_thread(tombstone, guest_unwinder, *others[i], /* memory_dump */ nullptr);
     }
-    dump_registers(guest_unwinder, *guest_data.saved_initial_regs, guest_thread, memory_dump);
-    auto& guest_threads = *tombstone->mutable_guest_threads();
-    guest_threads[thread_info.tid] = guest_thread;
   }
 }
 
@@ -582,15 +717,23 @@ static void add_error_log_msg(Tombstone* tombstone, const std::string&& error_ms
 }
 
 static void dump_log_file(Tombstone* tombstone, const char* logger, pid_t pid) {
+  SectionBudget budget(StringPrintf("logcat %s", logger), "logcat", 1000, 256 * 1024);
   logger_list* logger_list = android_logger_list_open(android_name_to_log_id(logger),
                                                       ANDROID_LOG_NONBLOCK, kMaxLogMessages, pid);
   if (logger_list == nullptr) {
     add_error_log_msg(tombstone, android::base::StringPrintf("Cannot open log file %s", logger));
+    budget.Record(tombstone);
     return;
   }
 
   LogBuffer buffer;
+  // The messages come oldest first, so running out of time drops the newest ones, but running out
+  // of space drops the oldest ones below.
   while (true) {
+    if (!budget.HasTimeLeft()) {
+      budget.SetTruncated();
+      break;
+    }
     log_msg log_entry;
     ssize_t actual = android_logger_list_read(logger_list, &log_entry);
     if (actual < 0) {
@@ -648,14 +791,26 @@ static void dump_log_file(Tombstone* tombstone, const char* logger, pid_t pid) {
       log_msg->set_priority(prio);
       log_msg->set_tag(tag);
       log_msg->set_message(msg);
+      budget.Add(log_msg->ByteSizeLong());
     } while ((msg = nl));
   }
   android_logger_list_free(logger_list);
 
+  int dropped = 0;
+  while (dropped < buffer.logs_size() && budget.IsOverSize()) {
+    budget.Remove(buffer.logs(dropped++).ByteSizeLong());
+  }
+  if (dropped != 0) {
+    buffer.mutable_logs()->DeleteSubrange(0, dropped);
+    budget.SetTruncated();
+  }
+
   if (!buffer.logs().empty()) {
     buffer.set_name(logger);
+    buffer.set_truncated(budget.truncated());
     *tombstone->add_log_buffers() = std::move(buffer);
   }
+  budget.Record(tombstone);
 }
 
 static void dump_logcat(Tombstone* tombstone, pid_t pid) {
@@ -779,18 +934,23 @@ void engrave_tombstone_proto(Tombstone* tombstone, unwindstack::AndroidUnwinder*
 
   dump_abort_message(&result, unwinder->GetProcessMemory(), process_info);
   dump_crash_details(&result, unwinder->GetProcessMemory(), process_info);
-  // Dump the target thread, but save the memory around the registers.
-  dump_thread(&result, unwinder, target_thread, /* memory_dump */ true, guest_unwinder);
+  // Dump the target thread, but save the memory around the registers. The time budget for the
+  // memory dump includes unwinding the target thread.
+  SectionBudget target_thread_budget("target thread", "memory_dump", 500, 16 * 1024);
+  dump_thread(&result, unwinder, target_thread, &target_thread_budget, guest_unwinder);
+  target_thread_budget.Record(&result);
 
-  for (const auto& [tid, thread_info] : threads) {
-    if (tid != target_tid) {
-      dump_thread(&result, unwinder, thread_info, /* memory_dump */ false, guest_unwinder);
-    }
-  }
+  SectionBudget other_threads_timing("other threads");
+  dump_other_threads(&result, unwinder, threads, target_tid, guest_unwinder);
+  other_threads_timing.Record(&result);
 
+  SectionBudget probable_cause_timing("probable cause");
   dump_probable_cause(&result, unwinder, process_info, target_thread);
+  probable_cause_timing.Record(&result);
 
+  SectionBudget mappings_timing("memory mappings");
   dump_mappings(&result, unwinder->GetMaps(), unwinder->GetProcessMemory());
+  mappings_timing.Record(&result);
 
   // Only dump logs on debuggable devices.
   if (android::base::GetBoolProperty("ro.debuggable", false)) {
@@ -804,7 +964,9 @@ void engrave_tombstone_proto(Tombstone* tombstone, unwindstack::AndroidUnwinder*
     }
   }
 
+  SectionBudget open_fds_timing("open files");
   dump_open_fds(&result, open_files);
+  open_fds_timing.Record(&result);
 
   *tombstone = std::move(result);
 }
@@ -17,6 +17,7 @@
 #include <libdebuggerd/tombstone.h>
 
 #include <inttypes.h>
+#include <stdarg.h>
 
 #include <charconv>
 #include <functional>
@@ -27,6 +28,7 @@
 #include <utility>
 #include <vector>
 
+#include <android-base/file.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
@@ -38,7 +40,20 @@
 using android::base::StringAppendF;
 using android::base::StringPrintf;
 
-#define CB(log, ...) callback(StringPrintf(__VA_ARGS__), log)
+// Lines are formatted into one buffer per thread that keeps its capacity, rather than into a new
+// string for each of the many thousands of lines in a large tombstone.
+__attribute__((__format__(__printf__, 1, 2))) static const std::string& format_line(
+    const char* fmt, ...) {
+  static thread_local std::string line;
+  line.clear();
+  va_list ap;
+  va_start(ap, fmt);
+  android::base::StringAppendV(&line, fmt, ap);
+  va_end(ap);
+  return line;
+}
+
+#define CB(log, ...) callback(format_line(__VA_ARGS__), log)
 #define CBL(...) CB(true, __VA_ARGS__)
 #define CBS(...) CB(false, __VA_ARGS__)
 using CallbackType = std::function<void(const std::string& line, bool should_log)>;
@@ -96,6 +111,19 @@ static const char* abi_string(const Architecture& arch) {
   }
 }
 
+// Appends value as at least width lowercase hex digits, like "%0*" PRIx64. Most of the text of a
+// large tombstone is hex, and printf is most of the cost of rendering it.
+static void append_hex(std::string* out, uint64_t value, int width) {
+  char digits[16];
+  int count = 0;
+  do {
+    digits[count++] = "0123456789abcdef"[value & 0xf];
+    value >>= 4;
+  } while (value != 0);
+  if (width > count) out->append(width - count, '0');
+  while (count > 0) out->push_back(digits[--count]);
+}
+
 static int pointer_width(const Tombstone& tombstone) {
   switch (tombstone.arch()) {
     case Architecture::ARM32:
@@ -113,7 +141,7 @@ static int pointer_width(const Tombstone& tombstone) {
   }
 }
 
-static void print_thread_header(CallbackType callback, const Tombstone& tombstone,
+static void print_thread_header(const CallbackType& callback, const Tombstone& tombstone,
                                 const Thread& thread, bool should_log) {
   const char* process_name = "<unknown>";
   if (!tombstone.command_line().empty()) {
@@ -135,44 +163,52 @@ static void print_thread_header(CallbackType callback, const Tombstone& tombston
   }
 }
 
-static void print_register_row(CallbackType callback, int word_size,
-                               std::vector<std::pair<std::string, uint64_t>> row, bool should_log) {
+static void print_register_row(const CallbackType& callback, int word_size,
+                               const std::vector<std::pair<std::string, uint64_t>>& row,
+                               bool should_log) {
   std::string output = "  ";
   for (const auto& [name, value] : row) {
-    output += android::base::StringPrintf("  %-3s %0*" PRIx64, name.c_str(), 2 * word_size,
-                                          static_cast<uint64_t>(value));
+    // "  %-3s %0*" PRIx64
+    output += "  ";
+    output += name;
+    if (name.size() < 3) output.append(3 - name.size(), ' ');
+    output += ' ';
+    append_hex(&output, value, 2 * word_size);
   }
   callback(output, should_log);
 }
 
-static void print_thread_registers(CallbackType callback, const Tombstone& tombstone,
+static void print_thread_registers(const CallbackType& callback, const Tombstone& tombstone,
                                    const Thread& thread, bool should_log) {
   static constexpr size_t column_count = 4;
   std::vector<std::pair<std::string, uint64_t>> current_row;
   std::vector<std::pair<std::string, uint64_t>> special_row;
-  std::unordered_set<std::string> special_registers;
+  // These are looked up for every thread, so they're only built once.
+  static const std::unordered_set<std::string> kArmSpecialRegisters = {"ip", "lr", "sp", "pc",
+                                                                       "pst"};
+  static const std::unordered_set<std::string> kRiscv64SpecialRegisters = {"ra", "sp", "pc"};
+  static const std::unordered_set<std::string> kX86SpecialRegisters = {"ebp", "esp", "eip"};
+  static const std::unordered_set<std::string> kX86_64SpecialRegisters = {"rbp", "rsp", "rip"};
+  const std::unordered_set<std::string>* special_registers;
 
   int word_size = pointer_width(tombstone);
 
   switch (tombstone.arch()) {
     case Architecture::ARM32:
-      special_registers = {"ip", "lr", "sp", "pc", "pst"};
-      break;
-
     case Architecture::ARM64:
-      special_registers = {"ip", "lr", "sp", "pc", "pst"};
+      special_registers = &kArmSpecialRegisters;
       break;
 
     case Architecture::RISCV64:
-      special_registers = {"ra", "sp", "pc"};
+      special_registers = &kRiscv64SpecialRegisters;
       break;
 
     case Architecture::X86:
-      special_registers = {"ebp", "esp", "eip"};
+      special_registers = &kX86SpecialRegisters;
       break;
 
     case Architecture::X86_64:
-      special_registers = {"rbp", "rsp", "rip"};
+      special_registers = &kX86_64SpecialRegisters;
       break;
 
     default:
@@ -182,7 +218,7 @@ static void print_thread_registers(CallbackType callback, const Tombstone& tombs
 
   for (const auto& reg : thread.registers()) {
     auto row = &current_row;
-    if (special_registers.count(reg.name()) == 1) {
+    if (special_registers->count(reg.name()) == 1) {
       row = &special_row;
     }
 
@@ -200,35 +236,43 @@ static void print_thread_registers(CallbackType callback, const Tombstone& tombs
   print_register_row(callback, word_size, special_row, should_log);
 }
 
-static void print_backtrace(CallbackType callback, const Tombstone& tombstone,
+static void print_backtrace(const CallbackType& callback, const Tombstone& tombstone,
                             const google::protobuf::RepeatedPtrField<BacktraceFrame>& backtrace,
                             bool should_log) {
   int index = 0;
+  int width = pointer_width(tombstone) * 2;
+  std::string line;
   for (const auto& frame : backtrace) {
-    std::string function;
-
+    // "      #%02d pc %0*" PRIx64 "  %s (offset 0x%" PRIx64 ") (%s+%" PRId64 ") (BuildId: %s)"
+    line = "      #";
+    if (index < 10) line += '0';
+    line += std::to_string(index++);
+    line += " pc ";
+    append_hex(&line, frame.rel_pc(), width);
+    line += "  ";
+    line += frame.file_name();
+    if (frame.file_map_offset() != 0) {
+      line += " (offset 0x";
+      append_hex(&line, frame.file_map_offset(), 0);
+      line += ')';
+    }
     if (!frame.function_name().empty()) {
-      function =
-          StringPrintf(" (%s+%" PRId64 ")", frame.function_name().c_str(), frame.function_offset());
+      line += " (";
+      line += frame.function_name();
+      line += '+';
+      line += std::to_string(static_cast<int64_t>(frame.function_offset()));
+      line += ')';
     }
-
-    std::string build_id;
     if (!frame.build_id().empty()) {
-      build_id = StringPrintf(" (BuildId: %s)", frame.build_id().c_str());
-    }
-
-    std::string line =
-        StringPrintf("      #%02d pc %0*" PRIx64 "  %s", index++, pointer_width(tombstone) * 2,
-                     frame.rel_pc(), frame.file_name().c_str());
-    if (frame.file_map_offset() != 0) {
-      line += StringPrintf(" (offset 0x%" PRIx64 ")", frame.file_map_offset());
+      line += " (BuildId: ";
+      line += frame.build_id();
+      line += ')';
     }
-    line += function + build_id;
-    CB(should_log, "%s", line.c_str());
+    callback(line, should_log);
   }
 }
 
-static void print_thread_backtrace(CallbackType callback, const Tombstone& tombstone,
+static void print_thread_backtrace(const CallbackType& callback, const Tombstone& tombstone,
                                    const Thread& thread, bool should_log) {
   CBS("");
   CB(should_log, "%d total frames", thread.current_backtrace().size());
@@ -240,11 +284,12 @@ static void print_thread_backtrace(CallbackType callback, const Tombstone& tombs
   print_backtrace(callback, tombstone, thread.current_backtrace(), should_log);
 }
 
-static void print_thread_memory_dump(CallbackType callback, const Tombstone& tombstone,
+static void print_thread_memory_dump(const CallbackType& callback, const Tombstone& tombstone,
                                      const Thread& thread) {
   static constexpr size_t bytes_per_line = 16;
   static_assert(bytes_per_line == kTagGranuleSize);
   int word_size = pointer_width(tombstone);
+  std::string line;
   for (const auto& mem : thread.memory_dump()) {
     CBS("");
     if (mem.mapping_name().empty()) {
@@ -261,7 +306,8 @@ static void print_thread_memory_dump(CallbackType callback, const Tombstone& tom
             static_cast<uint64_t>(mem.arm_mte_metadata().memory_tags()[offset / kTagGranuleSize])
             << 56;
       }
-      std::string line = StringPrintf("    %0*" PRIx64, word_size * 2, tagged_addr + offset);
+      line = "    ";
+      append_hex(&line, tagged_addr + offset, word_size * 2);
 
       size_t bytes = std::min(bytes_per_line, mem.memory().size() - offset);
       for (size_t i = 0; i < bytes; i += word_size) {
@@ -270,7 +316,8 @@ static void print_thread_memory_dump(CallbackType callback, const Tombstone& tom
         // Assumes little-endian, but what doesn't?
         memcpy(&word, mem.memory().data() + offset + i, word_size);
 
-        StringAppendF(&line, " %0*" PRIx64, word_size * 2, word);
+        line += ' ';
+        append_hex(&line, word, word_size * 2);
       }
 
       char ascii[bytes_per_line + 1];
@@ -285,19 +332,26 @@ static void print_thread_memory_dump(CallbackType callback, const Tombstone& tom
         }
       }
 
-      CBS("%s  %s", line.c_str(), ascii);
+      line += "  ";
+      line += ascii;
+      callback(line, false);
     }
   }
+  if (thread.memory_dump_truncated()) {
+    CBS("");
+    CBS("memory near the remaining registers not dumped: over the memory dump budget");
+  }
 }
 
-static void print_thread(CallbackType callback, const Tombstone& tombstone, const Thread& thread) {
+static void print_thread(const CallbackType& callback, const Tombstone& tombstone,
+                         const Thread& thread) {
   print_thread_header(callback, tombstone, thread, false);
   print_thread_registers(callback, tombstone, thread, false);
   print_thread_backtrace(callback, tombstone, thread, false);
   print_thread_memory_dump(callback, tombstone, thread);
 }
 
-static void print_tag_dump(CallbackType callback, const Tombstone& tombstone) {
+static void print_tag_dump(const CallbackType& callback, const Tombstone& tombstone) {
   if (!tombstone.has_signal_info()) return;
 
   const Signal& signal = tombstone.signal_info();
@@ -351,16 +405,21 @@ static void print_tag_dump(CallbackType callback, const Tombstone& tombstone) {
   }
 }
 
-static void print_memory_maps(CallbackType callback, const Tombstone& tombstone) {
+static void print_memory_maps(const CallbackType& callback, const Tombstone& tombstone) {
   int word_size = pointer_width(tombstone);
-  const auto format_pointer = [word_size](uint64_t ptr) -> std::string {
+  const auto append_pointer = [word_size](std::string* out, uint64_t ptr) {
     if (word_size == 8) {
-      uint64_t top = ptr >> 32;
-      uint64_t bottom = ptr & 0xFFFFFFFF;
-      return StringPrintf("%08" PRIx64 "'%08" PRIx64, top, bottom);
+      append_hex(out, ptr >> 32, 8);
+      out->push_back('\'');
+      append_hex(out, ptr & 0xFFFFFFFF, 8);
+    } else {
+      append_hex(out, ptr, word_size * 2);
     }
-
-    return StringPrintf("%0*" PRIx64, word_size * 2, ptr);
+  };
+  const auto format_pointer = [&append_pointer](uint64_t ptr) {
+    std::string result;
+    append_pointer(&result, ptr);
+    return result;
   };
 
   std::string memory_map_header =
@@ -372,6 +431,7 @@ static void print_memory_maps(CallbackType callback, const Tombstone& tombstone)
   uint64_t fault_address = untag_address(signal_info.fault_address());
   bool preamble_printed = false;
   bool printed_fault_address_marker = false;
+  std::string line;
   for (const auto& map : tombstone.memory_mappings()) {
     if (!preamble_printed) {
       preamble_printed = true;
@@ -388,7 +448,7 @@ static void print_memory_maps(CallbackType callback, const Tombstone& tombstone)
       CBS("%s", memory_map_header.c_str());
     }
 
-    std::string line = "    ";
+    line = "    ";
     if (has_fault_address && !printed_fault_address_marker) {
       if (fault_address < map.begin_address()) {
         printed_fault_address_marker = true;
@@ -399,18 +459,24 @@ static void print_memory_maps(CallbackType callback, const Tombstone& tombstone)
         line = "--->";
       }
     }
-    StringAppendF(&line, "%s-%s", format_pointer(map.begin_address()).c_str(),
-                  format_pointer(map.end_address() - 1).c_str());
-    StringAppendF(&line, " %s%s%s", map.read() ? "r" : "-", map.write() ? "w" : "-",
-                  map.execute() ? "x" : "-");
+    append_pointer(&line, map.begin_address());
+    line += '-';
+    append_pointer(&line, map.end_address() - 1);
+    line += ' ';
+    line += map.read() ? 'r' : '-';
+    line += map.write() ? 'w' : '-';
+    line += map.execute() ? 'x' : '-';
     StringAppendF(&line, "  %8" PRIx64 "  %8" PRIx64, map.offset(),
                   map.end_address() - map.begin_address());
 
     if (!map.mapping_name().empty()) {
-      StringAppendF(&line, "  %s", map.mapping_name().c_str());
+      line += "  ";
+      line += map.mapping_name();
 
       if (!map.build_id().empty()) {
-        StringAppendF(&line, " (BuildId: %s)", map.build_id().c_str());
+        line += " (BuildId: ";
+        line += map.build_id();
+        line += ')';
       }
 
       if (map.load_bias() != 0) {
@@ -418,7 +484,7 @@ static void print_memory_maps(CallbackType callback, const Tombstone& tombstone)
       }
     }
 
-    CBS("%s", line.c_str());
+    callback(line, false);
   }
 
   if (has_fault_address && !printed_fault_address_marker) {
@@ -448,7 +514,7 @@ static std::string oct_encode(const std::string& data) {
   return oct_encoded;
 }
 
-static void print_main_thread(CallbackType callback, const Tombstone& tombstone,
+static void print_main_thread(const CallbackType& callback, const Tombstone& tombstone,
                               const Thread& thread) {
   print_thread_header(callback, tombstone, thread, true);
 
@@ -554,13 +620,16 @@ static void print_main_thread(CallbackType callback, const Tombstone& tombstone,
   }
 }
 
-void print_logs(CallbackType callback, const Tombstone& tombstone, int tail) {
+void print_logs(const CallbackType& callback, const Tombstone& tombstone, int tail) {
   for (const auto& buffer : tombstone.log_buffers()) {
     if (tail) {
       CBS("--------- tail end of log %s", buffer.name().c_str());
     } else {
       CBS("--------- log %s", buffer.name().c_str());
     }
+    if (buffer.truncated()) {
+      CBS("--------- some messages not dumped: over the logcat budget");
+    }
 
     int begin = 0;
     if (tail != 0) {
@@ -578,7 +647,7 @@ void print_logs(CallbackType callback, const Tombstone& tombstone, int tail) {
   }
 }
 
-static void print_guest_thread(CallbackType callback, const Tombstone& tombstone,
+static void print_guest_thread(const CallbackType& callback, const Tombstone& tombstone,
                                const Thread& guest_thread, pid_t tid, bool should_log) {
   CBS("--- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---");
   CBS("Guest thread information for tid: %d", tid);
@@ -665,3 +734,27 @@ bool tombstone_proto_to_text(const Tombstone& tombstone, CallbackType callback)
 
   return true;
 }
+
+bool tombstone_proto_to_text(const Tombstone& tombstone, int fd) {
+  // Write in large chunks rather than a line at a time.
+  static constexpr size_t kBufferSize = 64 * 1024;
+  std::string buffer;
+  buffer.reserve(kBufferSize + 1024);
+  bool write_failed = false;
+  auto flush = [&]() {
+    if (!write_failed && !android::base::WriteFully(fd, buffer.data(), buffer.size())) {
+      write_failed = true;
+    }
+    buffer.clear();
+  };
+
+  bool result = tombstone_proto_to_text(tombstone, [&](const std::string& line, bool) {
+    buffer += line;
+    buffer += '\n';
+    if (buffer.size() >= kBufferSize) {
+      flush();
+    }
+  });
+  flush();
+  return result && !write_failed;
+}
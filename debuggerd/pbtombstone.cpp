@@ -51,11 +51,8 @@ int main(int argc, const char* argv[]) {
     err(1, "failed to parse tombstone");
   }
 
-  bool result = tombstone_proto_to_text(
-      tombstone, [](const std::string& line, bool) { printf("%s\n", line.c_str()); });
-
-  if (!result) {
-    errx(1, "tombstone was malformed");
+  if (!tombstone_proto_to_text(tombstone, STDOUT_FILENO)) {
+    errx(1, "tombstone was malformed or couldn't be written");
   }
 
   return 0;
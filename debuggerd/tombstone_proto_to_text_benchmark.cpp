@@ -0,0 +1,169 @@
+/*
+ * Copyright 2026, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <libdebuggerd/tombstone.h>
+
+#include "tombstone.pb.h"
+
+using android::base::StringPrintf;
+using android::base::unique_fd;
+
+// A tombstone shaped like one from a large app: thread_count threads with deep backtraces, memory
+// dumps for the crashing thread, and full maps and logs.
+static Tombstone MakeTombstone(int thread_count) {
+  Tombstone tombstone;
+  tombstone.set_arch(Architecture::ARM64);
+  tombstone.set_guest_arch(Architecture::NONE);
+  tombstone.set_build_fingerprint("fingerprint");
+  tombstone.set_timestamp("1970-01-01 00:00:00");
+  tombstone.set_pid(1000);
+  tombstone.set_tid(1000);
+  tombstone.set_page_size(4096);
+  *tombstone.add_command_line() = "com.example.app";
+
+  Signal* signal = tombstone.mutable_signal_info();
+  signal->set_number(11);
+  signal->set_name("SIGSEGV");
+  signal->set_code_name("SEGV_MAPERR");
+  signal->set_has_fault_address(true);
+  signal->set_fault_address(0xdead);
+
+  for (int i = 0; i < thread_count; i++) {
+    Thread& thread = (*tombstone.mutable_threads())[1000 + i];
+    thread.set_id(1000 + i);
+    thread.set_name(StringPrintf("worker %d", i));
+    for (int r = 0; r < 33; r++) {
+      Register* reg = thread.add_registers();
+      reg->set_name(StringPrintf("x%d", r));
+      reg->set_u64(0x7000000000 + r * 0x1000);
+    }
+    for (int f = 0; f < 32; f++) {
+      BacktraceFrame* frame = thread.add_current_backtrace();
+      frame->set_rel_pc(0x1000 + f * 0x10);
+      frame->set_pc(0x7000001000 + f * 0x10);
+      frame->set_file_name("/system/lib64/libexample.so");
+      frame->set_function_name(StringPrintf("example::Function%d()", f));
+      frame->set_function_offset(f * 4);
+      frame->set_build_id("0123456789abcdef0123456789abcdef");
+    }
+    if (i == 0) {
+      for (int r = 0; r < 33; r++) {
+        MemoryDump* dump = thread.add_memory_dump();
+        dump->set_register_name(StringPrintf("x%d", r));
+        dump->set_mapping_name("[anon:scudo:primary]");
+        dump->set_begin_address(0x7000000000 + r * 0x1000);
+        dump->set_memory(std::string(256, 'a' + r % 26));
+      }
+    }
+  }
+
+  for (int i = 0; i < 2000; i++) {
+    MemoryMapping* map = tombstone.add_memory_mappings();
+    map->set_begin_address(0x7000000000 + i * 0x10000);
+    map->set_end_address(0x7000000000 + i * 0x10000 + 0x8000);
+    map->set_read(true);
+    map->set_mapping_name(StringPrintf("/system/lib64/lib%d.so", i));
+    map->set_build_id("0123456789abcdef0123456789abcdef");
+  }
+
+  LogBuffer* buffer = tombstone.add_log_buffers();
+  buffer->set_name("main");
+  for (int i = 0; i < 500; i++) {
+    LogMessage* msg = buffer->add_logs();
+    msg->set_timestamp("01-01 00:00:00.000");
+    msg->set_pid(1000);
+    msg->set_tid(1000);
+    msg->set_priority(4);
+    msg->set_tag("Example");
+    msg->set_message(StringPrintf("log message number %d", i));
+  }
+  return tombstone;
+}
+
+static void BM_proto_to_text_callback(benchmark::State& state) {
+  Tombstone tombstone = MakeTombstone(state.range(0));
+  for (auto _ : state) {
+    std::string text;
+    tombstone_proto_to_text(tombstone, [&text](const std::string& line, bool) {
+      text += line;
+      text += '\n';
+    });
+    benchmark::DoNotOptimize(text);
+  }
+}
+BENCHMARK(BM_proto_to_text_callback)->Arg(10)->Arg(100)->Arg(1000);
+
+static void BM_proto_to_text_fd(benchmark::State& state) {
+  Tombstone tombstone = MakeTombstone(state.range(0));
+  unique_fd fd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+  for (auto _ : state) {
+    tombstone_proto_to_text(tombstone, fd.get());
+  }
+}
+BENCHMARK(BM_proto_to_text_fd)->Arg(10)->Arg(100)->Arg(1000);
+
+// Parses and renders a real tombstone, as pbtombstone does.
+static void BM_corpus(benchmark::State& state, const std::string& contents) {
+  unique_fd fd(open("/dev/null", O_WRONLY | O_CLOEXEC));
+  for (auto _ : state) {
+    Tombstone tombstone;
+    if (!tombstone.ParseFromString(contents)) {
+      state.SkipWithError("failed to parse tombstone");
+      return;
+    }
+    tombstone_proto_to_text(tombstone, fd.get());
+  }
+  state.SetBytesProcessed(state.iterations() * contents.size());
+}
+
+// Registers a benchmark for each .pb file in the directory named by $TOMBSTONE_CORPUS, or in
+// /data/tombstones.
+static void RegisterCorpus() {
+  const char* dir = getenv("TOMBSTONE_CORPUS");
+  if (dir == nullptr) dir = "/data/tombstones";
+
+  std::unique_ptr<DIR, decltype(&closedir)> dir_h(opendir(dir), closedir);
+  if (dir_h == nullptr) return;
+  while (dirent* entry = readdir(dir_h.get())) {
+    if (!android::base::EndsWith(entry->d_name, ".pb")) continue;
+    std::string contents;
+    if (!android::base::ReadFileToString(StringPrintf("%s/%s", dir, entry->d_name), &contents)) {
+      continue;
+    }
+    benchmark::RegisterBenchmark(StringPrintf("BM_corpus/%s", entry->d_name).c_str(), BM_corpus,
+                                 contents);
+  }
+}
+
+int main(int argc, char** argv) {
+  RegisterCorpus();
+  benchmark::Initialize(&argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
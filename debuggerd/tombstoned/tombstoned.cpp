@@ -23,18 +23,24 @@
 
 #include <array>
 #include <deque>
+#include <map>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <event2/event.h>
 #include <event2/listener.h>
 #include <event2/thread.h>
 
 #include <android-base/cmsg.h>
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <cutils/sockets.h>
 
@@ -45,6 +51,7 @@
 
 #include "intercept_manager.h"
 
+using android::base::GetBoolProperty;
 using android::base::GetIntProperty;
 using android::base::SendFileDescriptors;
 using android::base::StringPrintf;
@@ -54,6 +61,8 @@ using android::base::unique_fd;
 
 static InterceptManager* intercept_manager;
 
+static bool rename_tombstone_fd(borrowed_fd fd, borrowed_fd dirfd, const std::string& path);
+
 enum CrashStatus {
   kCrashStatusRunning,
   kCrashStatusQueued,
@@ -70,6 +79,7 @@ struct CrashArtifact {
 };
 
 struct CrashArtifactPaths {
+  size_t index;
   std::string text;
   std::optional<std::string> proto;
 };
@@ -93,10 +103,50 @@ struct Crash {
   DebuggerdDumpType crash_type;
 };
 
+// Crashes with the same signature are duplicates: the same build, command line and signal, and the
+// same frames at the top of the crashing thread. Only the start of the tombstone is read, since the
+// crashing thread's backtrace comes before the other threads and the memory dumps.
+static std::optional<std::string> read_crash_signature(borrowed_fd fd) {
+  constexpr size_t kSignatureReadSize = 64 * 1024;
+  constexpr size_t kSignatureFrames = 16;
+
+  std::string buf(kSignatureReadSize, '\0');
+  ssize_t rc = TEMP_FAILURE_RETRY(pread(fd.get(), buf.data(), buf.size(), 0));
+  if (rc <= 0) {
+    return {};
+  }
+  buf.resize(rc);
+
+  std::string signature;
+  bool in_backtrace = false;
+  size_t frames = 0;
+  for (const std::string& line : android::base::Split(buf, "\n")) {
+    if (in_backtrace) {
+      if (!android::base::StartsWith(line, "      #")) break;
+      signature += line + "\n";
+      if (++frames == kSignatureFrames) break;
+    } else if (android::base::StartsWith(line, "Build fingerprint: ") ||
+               android::base::StartsWith(line, "Cmdline: ")) {
+      signature += line + "\n";
+    } else if (android::base::StartsWith(line, "signal ")) {
+      // The fault address moves with ASLR.
+      signature += line.substr(0, line.find(", fault addr")) + "\n";
+    } else if (line == "backtrace:") {
+      in_backtrace = true;
+    }
+  }
+
+  if (frames == 0) {
+    return {};
+  }
+  return signature;
+}
+
 class CrashQueue {
  public:
   CrashQueue(const std::string& dir_path, const std::string& file_name_prefix, size_t max_artifacts,
-             size_t max_concurrent_dumps, bool supports_proto, bool world_readable)
+             size_t max_concurrent_dumps, bool supports_proto, bool world_readable,
+             bool deduplicate = false)
       : file_name_prefix_(file_name_prefix),
         dir_path_(dir_path),
         dir_fd_(open(dir_path.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)),
@@ -105,7 +155,8 @@ class CrashQueue {
         max_concurrent_dumps_(max_concurrent_dumps),
         num_concurrent_dumps_(0),
         supports_proto_(supports_proto),
-        world_readable_(world_readable) {
+        world_readable_(world_readable),
+        deduplicate_(deduplicate) {
     if (dir_fd_ == -1) {
       PLOG(FATAL) << "failed to open directory: " << dir_path;
     }
@@ -115,6 +166,9 @@ class CrashQueue {
     CHECK(max_artifacts_ > max_concurrent_dumps_);
 
     find_oldest_artifact();
+    if (deduplicate_) {
+      load_signatures();
+    }
   }
 
   static CrashQueue* for_crash(const Crash* crash) {
@@ -129,7 +183,8 @@ class CrashQueue {
     static CrashQueue queue("/data/tombstones", "tombstone_" /* file_name_prefix */,
                             GetIntProperty("tombstoned.max_tombstone_count", 32),
                             1 /* max_concurrent_dumps */, true /* supports_proto */,
-                            true /* world_readable */);
+                            true /* world_readable */,
+                            GetBoolProperty("tombstoned.deduplicate_tombstones", true));
     return &queue;
   }
 
@@ -195,7 +250,8 @@ class CrashQueue {
 
   CrashArtifactPaths get_next_artifact_paths() {
     CrashArtifactPaths result;
-    result.text = StringPrintf("%s%02d", file_name_prefix_.c_str(), next_artifact_);
+    result.index = next_artifact_;
+    result.text = artifact_name(next_artifact_);
 
     if (supports_proto_) {
       result.proto = StringPrintf("%s%02d.pb", file_name_prefix_.c_str(), next_artifact_);
@@ -227,7 +283,100 @@ class CrashQueue {
 
   void on_crash_completed() { --num_concurrent_dumps_; }
 
+  bool deduplicate() const { return deduplicate_; }
+
+  // If an artifact that is still on disk has the same signature, counts another occurrence of it
+  // and returns its name. The caller then drops the new output instead of rotating it in.
+  std::optional<std::string> record_duplicate(const std::string& signature) {
+    auto it = signatures_.find(signature);
+    if (it == signatures_.end()) {
+      return {};
+    }
+    ++duplicate_counts_[it->second];
+    write_duplicate_counts();
+    return artifact_name(it->second);
+  }
+
+  // Called once the artifact at paths.index has been replaced with a crash that has signature.
+  void on_artifact_written(size_t index, std::optional<std::string> signature) {
+    forget_artifact(index);
+    if (signature) {
+      signatures_[*signature] = index;
+      artifact_signatures_[index] = std::move(*signature);
+    }
+  }
+
  private:
+  static constexpr const char* kDuplicateCountsFileName = "duplicate_counts";
+
+  std::string artifact_name(size_t index) const {
+    return StringPrintf("%s%02zu", file_name_prefix_.c_str(), index);
+  }
+
+  void forget_artifact(size_t index) {
+    auto it = artifact_signatures_.find(index);
+    if (it != artifact_signatures_.end()) {
+      auto sig = signatures_.find(it->second);
+      if (sig != signatures_.end() && sig->second == index) {
+        signatures_.erase(sig);
+      }
+      artifact_signatures_.erase(it);
+    }
+    if (duplicate_counts_.erase(index) != 0) {
+      write_duplicate_counts();
+    }
+  }
+
+  // Rebuilds the index from the artifacts already on disk, so that deduplication and the counts
+  // survive a restart of tombstoned.
+  void load_signatures() {
+    for (size_t i = 0; i < max_artifacts_; ++i) {
+      unique_fd fd(openat(dir_fd_, artifact_name(i).c_str(), O_RDONLY | O_CLOEXEC));
+      if (fd == -1) {
+        continue;
+      }
+      if (std::optional<std::string> signature = read_crash_signature(fd); signature) {
+        // Artifacts written before deduplication was enabled can share a signature, and any of
+        // them will do as the original.
+        signatures_[*signature] = i;
+        artifact_signatures_[i] = std::move(*signature);
+      }
+    }
+
+    std::string counts;
+    std::string path = dir_path_ + "/" + kDuplicateCountsFileName;
+    if (!android::base::ReadFileToString(path, &counts)) {
+      return;
+    }
+    for (const std::string& line : android::base::Split(counts, "\n")) {
+      std::vector<std::string> fields = android::base::Split(line, " ");
+      size_t count;
+      if (fields.size() != 2 || !android::base::ParseUint(fields[1], &count)) {
+        continue;
+      }
+      for (size_t i = 0; i < max_artifacts_; ++i) {
+        if (fields[0] == artifact_name(i) && artifact_signatures_.count(i) != 0) {
+          duplicate_counts_[i] = count;
+        }
+      }
+    }
+  }
+
+  // Writes "<artifact> <count>" for every artifact that duplicates were dropped for.
+  void write_duplicate_counts() {
+    std::string contents;
+    for (const auto& [index, count] : duplicate_counts_) {
+      contents += StringPrintf("%s %zu\n", artifact_name(index).c_str(), count);
+    }
+
+    CrashArtifact file = create_temporary_file();
+    if (!android::base::WriteStringToFd(contents, file.fd)) {
+      PLOG(ERROR) << "failed to write " << kDuplicateCountsFileName;
+      return;
+    }
+    rename_tombstone_fd(file.fd, dir_fd_, kDuplicateCountsFileName);
+  }
+
   void find_oldest_artifact() {
     size_t oldest_tombstone = 0;
     time_t oldest_time = std::numeric_limits<time_t>::max();
@@ -269,6 +418,12 @@ class CrashQueue {
   bool supports_proto_;
   bool world_readable_;
 
+  const bool deduplicate_;
+  // Signatures of the artifacts on disk, and how many duplicates of each were dropped.
+  std::unordered_map<std::string, size_t> signatures_;
+  std::map<size_t, std::string> artifact_signatures_;
+  std::map<size_t, size_t> duplicate_counts_;
+
   std::deque<std::unique_ptr<Crash>> queued_requests_;
 
   DISALLOW_COPY_AND_ASSIGN(CrashQueue);
@@ -454,7 +609,27 @@ static void crash_completed(borrowed_fd sockfd, std::unique_ptr<Crash> crash) {
     return;
   }
 
+  std::optional<std::string> signature;
+  if (queue->deduplicate()) {
+    // The output fd is write-only, so read it back through /proc.
+    std::string fd_path = StringPrintf("/proc/self/fd/%d", crash->output.text.fd.get());
+    unique_fd text_fd(open(fd_path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (text_fd != -1) {
+      signature = read_crash_signature(text_fd);
+    }
+    if (signature) {
+      if (std::optional<std::string> original = queue->record_duplicate(*signature); original) {
+        LOG(ERROR) << "Tombstone for pid " << crash->crash_pid << " is a duplicate of "
+                   << original.value() << ", not writing it";
+        return;
+      }
+    }
+  }
+
   CrashArtifactPaths paths = queue->get_next_artifact_paths();
+  if (queue->deduplicate()) {
+    queue->on_artifact_written(paths.index, std::move(signature));
+  }
 
   if (crash->output.proto && crash->output.proto->fd != -1) {
     if (!paths.proto) {
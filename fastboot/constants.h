@@ -36,6 +36,10 @@
 #define FB_CMD_GSI "gsi"
 #define FB_CMD_SNAPSHOT_UPDATE "snapshot-update"
 #define FB_CMD_FETCH "fetch"
+#define FB_CMD_STREAM_FLASH "stream-flash"
+#define FB_CMD_DOWNLOAD_COMPRESSED "download-compressed"
+#define FB_CMD_PARTITION_DIGEST "partition-digest"
+#define FB_CMD_FETCH_COMPRESSED "fetch-compressed"
 
 #define RESPONSE_OKAY "OKAY"
 #define RESPONSE_FAIL "FAIL"
@@ -84,3 +88,19 @@
 #define FB_VAR_DMESG "dmesg"
 #define FB_VAR_BATTERY_SERIAL_NUMBER "battery-serial-number"
 #define FB_VAR_BATTERY_PART_STATUS "battery-part-status"
+#define FB_VAR_STREAM_FLASH "stream-flash"
+#define FB_VAR_DOWNLOAD_COMPRESSION "download-compression"
+#define FB_VAR_PARTITION_DIGEST "partition-digest"
+#define FB_VAR_FETCH_COMPRESSION "fetch-compression"
+#define FB_VAR_DOWNLOAD_THROUGHPUT "download-throughput"
+
+// Compressed downloads and fetches are a sequence of blocks, each made of a
+// little endian uint32_t uncompressed size, a little endian uint32_t compressed
+// size and the compressed data. Blocks decompress to at most
+// FB_COMPRESSED_BLOCK_SIZE bytes.
+#define FB_COMPRESSION_LZ4 "lz4"
+#define FB_COMPRESSED_BLOCK_SIZE (1024 * 1024)
+
+// partition-digest returns one SHA-256 digest per block of the partition.
+#define FB_DIGEST_SHA256 "sha256"
+#define FB_DIGEST_SIZE 32
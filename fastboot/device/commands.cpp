@@ -16,10 +16,13 @@
 
 #include "commands.h"
 
+#include <endian.h>
 #include <inttypes.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#include <future>
 #include <unordered_set>
 
 #include <android-base/logging.h>
@@ -37,6 +40,8 @@
 #include <liblp/builder.h>
 #include <liblp/liblp.h>
 #include <libsnapshot/snapshot.h>
+#include <lz4.h>
+#include <openssl/sha.h>
 #include <storage_literals/storage_literals.h>
 #include <uuid/uuid.h>
 
@@ -149,6 +154,11 @@ const std::unordered_map<std::string, VariableHandlers> kVariableMap = {
         {FB_VAR_MAX_FETCH_SIZE, {GetMaxFetchSize, nullptr}},
         {FB_VAR_BATTERY_SERIAL_NUMBER, {GetBatterySerialNumber, nullptr}},
         {FB_VAR_BATTERY_PART_STATUS, {GetBatteryPartStatus, nullptr}},
+        {FB_VAR_STREAM_FLASH, {GetStreamFlash, nullptr}},
+        {FB_VAR_DOWNLOAD_COMPRESSION, {GetDownloadCompression, nullptr}},
+        {FB_VAR_PARTITION_DIGEST, {GetPartitionDigest, nullptr}},
+        {FB_VAR_FETCH_COMPRESSION, {GetFetchCompression, nullptr}},
+        {FB_VAR_DOWNLOAD_THROUGHPUT, {GetDownloadThroughput, nullptr}},
 };
 
 static bool GetVarAll(FastbootDevice* device) {
@@ -304,12 +314,15 @@ bool DownloadHandler(FastbootDevice* device, const std::vector<std::string>& arg
     if (size == 0) {
         return device->WriteStatus(FastbootResult::FAIL, "Invalid size (0)");
     }
-    device->download_data().resize(size);
+    DownloadBuffer& data = device->download_data();
+    if (!data.resize(size)) {
+        return device->WriteStatus(FastbootResult::FAIL, "Couldn't allocate download buffer");
+    }
     if (!device->WriteStatus(FastbootResult::DATA, android::base::StringPrintf("%08x", size))) {
         return false;
     }
 
-    if (device->HandleData(true, &device->download_data())) {
+    if (device->HandleData(true, data.data(), data.size())) {
         return device->WriteStatus(FastbootResult::OKAY, "");
     }
 
@@ -317,6 +330,115 @@ bool DownloadHandler(FastbootDevice* device, const std::vector<std::string>& arg
     return device->WriteStatus(FastbootResult::FAIL, "Couldn't download data");
 }
 
+// Receives |wire_size| bytes of compressed download data and decompresses them
+// into download_data(), which must already have the uncompressed size. Returns
+// 0, -EIO if the transport failed or -EINVAL if the data could not be decoded.
+// Data that does not decode is still read in full, so the host gets to see the
+// failure.
+static int ReadCompressedData(FastbootDevice* device, uint32_t wire_size) {
+    constexpr size_t kHeaderSize = 2 * sizeof(uint32_t);
+    const size_t max_compressed = LZ4_compressBound(FB_COMPRESSED_BLOCK_SIZE);
+
+    DownloadBuffer& out = device->download_data();
+    std::vector<char> pending;
+    pending.reserve(kHeaderSize + max_compressed + FB_COMPRESSED_BLOCK_SIZE);
+    uint64_t out_offset = 0;
+    bool failed = false;
+
+    uint32_t received = 0;
+    while (received < wire_size) {
+        size_t len = std::min<size_t>(wire_size - received, FB_COMPRESSED_BLOCK_SIZE);
+        size_t old_size = pending.size();
+        pending.resize(old_size + len);
+        if (!device->HandleData(true, pending.data() + old_size, len)) {
+            return -EIO;
+        }
+        received += len;
+        if (failed) {
+            pending.clear();
+            continue;
+        }
+
+        size_t pos = 0;
+        while (pending.size() - pos >= kHeaderSize) {
+            uint32_t raw_len, compressed_len;
+            memcpy(&raw_len, pending.data() + pos, sizeof(raw_len));
+            memcpy(&compressed_len, pending.data() + pos + sizeof(raw_len), sizeof(compressed_len));
+            raw_len = le32toh(raw_len);
+            compressed_len = le32toh(compressed_len);
+            if (raw_len > FB_COMPRESSED_BLOCK_SIZE || compressed_len > max_compressed ||
+                raw_len > out.size() - out_offset) {
+                LOG(ERROR) << "Invalid compressed block at " << out_offset;
+                failed = true;
+                break;
+            }
+            if (pending.size() - pos - kHeaderSize < compressed_len) {
+                break;
+            }
+            int ret = LZ4_decompress_safe(pending.data() + pos + kHeaderSize,
+                                          out.data() + out_offset, compressed_len, raw_len);
+            if (ret != static_cast<int>(raw_len)) {
+                LOG(ERROR) << "Failed to decompress block at " << out_offset;
+                failed = true;
+                break;
+            }
+            out_offset += raw_len;
+            pos += kHeaderSize + compressed_len;
+        }
+        pending.erase(pending.begin(), pending.begin() + (failed ? pending.size() : pos));
+    }
+
+    if (failed || !pending.empty() || out_offset != out.size()) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+bool DownloadCompressedHandler(FastbootDevice* device, const std::vector<std::string>& args) {
+    if (args.size() < 4) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid arguments");
+    }
+
+    if (GetDeviceLockStatus()) {
+        return device->WriteStatus(FastbootResult::FAIL,
+                                   "Download is not allowed on locked devices");
+    }
+
+    // args[1] is the compression, args[2] the size of the data once
+    // decompressed, args[3] the size of the compressed data.
+    if (args[1] != FB_COMPRESSION_LZ4) {
+        return device->WriteStatus(FastbootResult::FAIL, "Unsupported compression");
+    }
+    unsigned int size, wire_size;
+    if (args[2].length() != 8 || args[3].length() != 8 ||
+        !android::base::ParseUint("0x" + args[2], &size, kMaxDownloadSizeDefault) ||
+        !android::base::ParseUint("0x" + args[3], &wire_size)) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid size");
+    }
+    if (size == 0 || wire_size == 0) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid size (0)");
+    }
+    if (!device->download_data().resize(size)) {
+        return device->WriteStatus(FastbootResult::FAIL, "Couldn't allocate download buffer");
+    }
+    if (!device->WriteStatus(FastbootResult::DATA,
+                             android::base::StringPrintf("%08x", wire_size))) {
+        return false;
+    }
+
+    int ret = ReadCompressedData(device, wire_size);
+    if (ret == 0) {
+        return device->WriteStatus(FastbootResult::OKAY, "");
+    }
+
+    device->download_data().clear();
+    if (ret == -EIO) {
+        PLOG(ERROR) << "Couldn't download data";
+        return device->WriteStatus(FastbootResult::FAIL, "Couldn't download data");
+    }
+    return device->WriteStatus(FastbootResult::FAIL, "Couldn't decompress data");
+}
+
 bool SetActiveHandler(FastbootDevice* device, const std::vector<std::string>& args) {
     if (args.size() < 2) {
         return device->WriteStatus(FastbootResult::FAIL, "Missing slot argument");
@@ -629,6 +751,44 @@ bool FlashHandler(FastbootDevice* device, const std::vector<std::string>& args)
     return device->WriteStatus(FastbootResult::OKAY, "Flashing succeeded");
 }
 
+bool StreamFlashHandler(FastbootDevice* device, const std::vector<std::string>& args) {
+    if (args.size() < 3) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid arguments");
+    }
+
+    if (GetDeviceLockStatus()) {
+        return device->WriteStatus(FastbootResult::FAIL,
+                                   "Flashing is not allowed on locked devices");
+    }
+
+    // Nothing is buffered in RAM, so unlike download the size is only limited
+    // by the partition.
+    const auto& partition_name = args[1];
+    unsigned int size;
+    if (args[2].length() != 8 || !android::base::ParseUint("0x" + args[2], &size) || size == 0) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid size");
+    }
+
+    if (IsProtectedPartitionDuringMerge(device, partition_name)) {
+        auto message = "Cannot flash " + partition_name + " while a snapshot update is in progress";
+        return device->WriteFail(message);
+    }
+
+    if (LogicalPartitionExists(device, partition_name)) {
+        CancelPartitionSnapshot(device, partition_name);
+    }
+
+    int ret = StreamFlash(device, partition_name, size);
+    if (ret < 0) {
+        return device->WriteStatus(FastbootResult::FAIL, strerror(-ret));
+    }
+    if (partition_name == "userdata") {
+        PostWipeData();
+    }
+
+    return device->WriteStatus(FastbootResult::OKAY, "Flashing succeeded");
+}
+
 bool UpdateSuperHandler(FastbootDevice* device, const std::vector<std::string>& args) {
     if (args.size() < 2) {
         return device->WriteFail("Invalid arguments");
@@ -749,7 +909,9 @@ namespace {
 // Helper of FetchHandler.
 class PartitionFetcher {
   public:
-    static bool Fetch(FastbootDevice* device, const std::vector<std::string>& args) {
+    // If |compressed|, the data is sent in the FB_COMPRESSION_LZ4 format.
+    static bool Fetch(FastbootDevice* device, const std::vector<std::string>& args,
+                      bool compressed = false) {
         if constexpr (!kEnableFetch) {
             return device->WriteFail("Fetch is not allowed on user build");
         }
@@ -758,7 +920,7 @@ class PartitionFetcher {
             return device->WriteFail("Fetch is not allowed on locked devices");
         }
 
-        PartitionFetcher fetcher(device, args);
+        PartitionFetcher fetcher(device, args, compressed);
         if (fetcher.Open()) {
             fetcher.Fetch();
         }
@@ -767,8 +929,9 @@ class PartitionFetcher {
     }
 
   private:
-    PartitionFetcher(FastbootDevice* device, const std::vector<std::string>& args)
-        : device_(device), args_(&args) {}
+    PartitionFetcher(FastbootDevice* device, const std::vector<std::string>& args,
+                     bool compressed)
+        : device_(device), args_(&args), compressed_(compressed) {}
     // Return whether the partition is successfully opened.
     // If successfully opened, ret_ is left untouched. Otherwise, ret_ is set to the value
     // that FetchHandler should return.
@@ -859,34 +1022,56 @@ class PartitionFetcher {
             return;
         }
 
+        if (compressed_) {
+            FetchCompressed();
+            return;
+        }
+
         if (!device_->WriteStatus(FastbootResult::DATA,
                                   android::base::StringPrintf(
                                           "%08x", static_cast<uint32_t>(total_size_to_read_)))) {
             ret_ = false;
             return;
         }
+        // The next piece is read from the partition while the current one is
+        // sent, so that the storage and the transport are busy at the same time.
+        auto read = [this](char* data, uint64_t offset, uint64_t size) {
+            if (!android::base::ReadFully(handle_.fd(), data, size)) {
+                PLOG(ERROR) << std::hex << "Unable to read 0x" << size << " bytes from "
+                            << partition_name_ << " @ offset 0x" << offset;
+                return false;
+            }
+            return true;
+        };
         uint64_t end_offset = start_offset_ + total_size_to_read_;
-        std::vector<char> buf(1_MiB);
+        std::vector<char> bufs[2] = {std::vector<char>(1_MiB), std::vector<char>(1_MiB)};
         uint64_t current_offset = start_offset_;
-        while (current_offset < end_offset) {
+        uint64_t chunk_size = std::min<uint64_t>(1_MiB, end_offset - current_offset);
+        std::future<bool> pending =
+                std::async(std::launch::async, read, bufs[0].data(), current_offset, chunk_size);
+        for (size_t i = 0; current_offset < end_offset; i++) {
             // On any error, exit. We can't return a status message to the driver because
             // we are in the middle of writing data, so just let the driver guess what's wrong
             // by ending the data stream prematurely.
-            uint64_t remaining = end_offset - current_offset;
-            uint64_t chunk_size = std::min<uint64_t>(buf.size(), remaining);
-            if (!android::base::ReadFully(handle_.fd(), buf.data(), chunk_size)) {
-                PLOG(ERROR) << std::hex << "Unable to read 0x" << chunk_size << " bytes from "
-                            << partition_name_ << " @ offset 0x" << current_offset;
+            if (!pending.get()) {
                 ret_ = false;
                 return;
             }
-            if (!device_->HandleData(false /* is read */, buf.data(), chunk_size)) {
+            uint64_t next_offset = current_offset + chunk_size;
+            uint64_t next_size = std::min<uint64_t>(1_MiB, end_offset - next_offset);
+            if (next_size > 0) {
+                pending = std::async(std::launch::async, read, bufs[(i + 1) % 2].data(),
+                                     next_offset, next_size);
+            }
+            if (!device_->HandleData(false /* is read */, bufs[i % 2].data(), chunk_size)) {
                 PLOG(ERROR) << std::hex << "Unable to send 0x" << chunk_size << " bytes of "
                             << partition_name_ << " @ offset 0x" << current_offset;
+                if (pending.valid()) pending.wait();
                 ret_ = false;
                 return;
             }
-            current_offset += chunk_size;
+            current_offset = next_offset;
+            chunk_size = next_size;
         }
 
         ret_ = device_->WriteOkay(android::base::StringPrintf(
@@ -894,6 +1079,53 @@ class PartitionFetcher {
                 start_offset_, total_size_to_read_));
     }
 
+    // Sends the data in the compressed format described in constants.h. The
+    // size on the wire has to be known up front, so all of it is compressed
+    // before it is sent. Until then, errors can still be reported.
+    void FetchCompressed() {
+        constexpr size_t kHeaderSize = 2 * sizeof(uint32_t);
+        const int bound = LZ4_compressBound(FB_COMPRESSED_BLOCK_SIZE);
+        std::vector<char> buf(FB_COMPRESSED_BLOCK_SIZE);
+        std::vector<char> wire;
+        uint64_t end_offset = start_offset_ + total_size_to_read_;
+        for (uint64_t offset = start_offset_; offset < end_offset;) {
+            size_t len = std::min<uint64_t>(buf.size(), end_offset - offset);
+            if (!android::base::ReadFully(handle_.fd(), buf.data(), len)) {
+                PLOG(ERROR) << std::hex << "Unable to read 0x" << len << " bytes from "
+                            << partition_name_ << " @ offset 0x" << offset;
+                ret_ = device_->WriteFail("Unable to read " + partition_name_);
+                return;
+            }
+            size_t pos = wire.size();
+            wire.resize(pos + kHeaderSize + bound);
+            int compressed_len =
+                    LZ4_compress_default(buf.data(), wire.data() + pos + kHeaderSize, len, bound);
+            if (compressed_len <= 0) {
+                ret_ = device_->WriteFail("Unable to compress " + partition_name_);
+                return;
+            }
+            uint32_t header[2] = {htole32(static_cast<uint32_t>(len)),
+                                  htole32(static_cast<uint32_t>(compressed_len))};
+            memcpy(wire.data() + pos, header, sizeof(header));
+            wire.resize(pos + kHeaderSize + compressed_len);
+            offset += len;
+        }
+
+        if (!device_->WriteStatus(FastbootResult::DATA,
+                                  android::base::StringPrintf("%08zx", wire.size()))) {
+            ret_ = false;
+            return;
+        }
+        if (!device_->HandleData(false /* is read */, wire.data(), wire.size())) {
+            PLOG(ERROR) << "Unable to send compressed data of " << partition_name_;
+            ret_ = false;
+            return;
+        }
+        ret_ = device_->WriteOkay(android::base::StringPrintf(
+                "Fetched %s (offset=0x%" PRIx64 ", size=0x%" PRIx64 ", compressed=0x%zx)",
+                partition_name_.c_str(), start_offset_, total_size_to_read_, wire.size()));
+    }
+
     static constexpr std::array<const char*, 3> kAllowedPartitions{
             "vendor_boot",
             "vendor_boot_a",
@@ -902,6 +1134,7 @@ class PartitionFetcher {
 
     FastbootDevice* device_;
     const std::vector<std::string>* args_ = nullptr;
+    bool compressed_ = false;
     std::string partition_name_;
     PartitionHandle handle_;
     uint64_t partition_size_ = 0;
@@ -916,3 +1149,81 @@ class PartitionFetcher {
 bool FetchHandler(FastbootDevice* device, const std::vector<std::string>& args) {
     return PartitionFetcher::Fetch(device, args);
 }
+
+// fetch-compressed:<compression>:<partition>[:<offset>[:<size>]]
+bool FetchCompressedHandler(FastbootDevice* device, const std::vector<std::string>& args) {
+    if (args.size() < 2 || args[1] != FB_COMPRESSION_LZ4) {
+        return device->WriteFail("Unsupported compression");
+    }
+    std::vector<std::string> fetch_args(args);
+    fetch_args.erase(fetch_args.begin() + 1);
+    return PartitionFetcher::Fetch(device, fetch_args, true /* compressed */);
+}
+
+// partition-digest:<partition>:<block size>[:<size>]
+//
+// Sends one SHA-256 digest for every |block size| bytes of the first |size|
+// bytes of the partition (all of it by default), the last one covering
+// whatever is left, so the host can tell which parts of an image are already
+// on the device. The digests are computed before any data goes out so a read
+// error can still be reported.
+bool PartitionDigestHandler(FastbootDevice* device, const std::vector<std::string>& args) {
+    if (args.size() < 3) {
+        return device->WriteFail("Invalid arguments");
+    }
+    if (GetDeviceLockStatus()) {
+        return device->WriteFail("Digests are not allowed on locked devices");
+    }
+    uint32_t block_size;
+    if (!android::base::ParseUint(args[2], &block_size) || block_size == 0 ||
+        block_size % 4096 != 0) {
+        return device->WriteFail("Invalid block size");
+    }
+
+    PartitionHandle handle;
+    if (!OpenPartition(device, args[1], &handle, O_RDONLY)) {
+        return device->WriteFail(android::base::StringPrintf("Cannot open %s", args[1].c_str()));
+    }
+    uint64_t size = get_block_device_size(handle.fd());
+    if (args.size() >= 4) {
+        uint64_t requested;
+        if (!android::base::ParseUint(args[3], &requested)) {
+            return device->WriteFail("Invalid size, must be integer");
+        }
+        size = std::min(size, requested);
+    }
+    uint64_t num_blocks = (size + block_size - 1) / block_size;
+    if (num_blocks == 0 || num_blocks > kMaxFetchSizeDefault / FB_DIGEST_SIZE) {
+        return device->WriteFail("Block size does not fit partition " + args[1]);
+    }
+
+    std::vector<char> digests(num_blocks * FB_DIGEST_SIZE);
+    std::vector<char> buf(std::min<uint64_t>(block_size, 1_MiB));
+    uint64_t offset = 0;
+    for (uint64_t i = 0; i < num_blocks; i++) {
+        uint64_t end = std::min<uint64_t>(offset + block_size, size);
+        SHA256_CTX ctx;
+        SHA256_Init(&ctx);
+        while (offset < end) {
+            size_t len = std::min<uint64_t>(buf.size(), end - offset);
+            if (!android::base::ReadFully(handle.fd(), buf.data(), len)) {
+                PLOG(ERROR) << "Unable to read " << args[1] << " @ offset " << offset;
+                return device->WriteFail("Unable to read " + args[1]);
+            }
+            SHA256_Update(&ctx, buf.data(), len);
+            offset += len;
+        }
+        SHA256_Final(reinterpret_cast<uint8_t*>(&digests[i * FB_DIGEST_SIZE]), &ctx);
+    }
+
+    if (!device->WriteStatus(FastbootResult::DATA,
+                             android::base::StringPrintf("%08zx", digests.size()))) {
+        return false;
+    }
+    if (!device->HandleData(false /* is read */, digests.data(), digests.size())) {
+        PLOG(ERROR) << "Unable to send digests of " << args[1];
+        return false;
+    }
+    return device->WriteOkay(android::base::StringPrintf(
+            "%" PRIu64 " blocks of 0x%x bytes", num_blocks, block_size));
+}
@@ -35,6 +35,7 @@ enum class FastbootResult {
 using CommandHandler = std::function<bool(FastbootDevice*, const std::vector<std::string>&)>;
 
 bool DownloadHandler(FastbootDevice* device, const std::vector<std::string>& args);
+bool DownloadCompressedHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool SetActiveHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool ShutDownHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool RebootHandler(FastbootDevice* device, const std::vector<std::string>& args);
@@ -44,6 +45,7 @@ bool RebootRecoveryHandler(FastbootDevice* device, const std::vector<std::string
 bool GetVarHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool EraseHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool FlashHandler(FastbootDevice* device, const std::vector<std::string>& args);
+bool StreamFlashHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool CreatePartitionHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool DeletePartitionHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool ResizePartitionHandler(FastbootDevice* device, const std::vector<std::string>& args);
@@ -52,3 +54,5 @@ bool OemCmdHandler(FastbootDevice* device, const std::vector<std::string>& args)
 bool GsiHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool SnapshotUpdateHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool FetchHandler(FastbootDevice* device, const std::vector<std::string>& args);
+bool FetchCompressedHandler(FastbootDevice* device, const std::vector<std::string>& args);
+bool PartitionDigestHandler(FastbootDevice* device, const std::vector<std::string>& args);
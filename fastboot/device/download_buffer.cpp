@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "download_buffer.h"
+
+#include <sys/mman.h>
+
+#include <android-base/logging.h>
+
+DownloadBuffer::~DownloadBuffer() {
+    if (data_) {
+        munmap(data_, capacity_);
+    }
+}
+
+bool DownloadBuffer::resize(size_t size) {
+    if (size > capacity_) {
+        LOG(ERROR) << "Download of " << size << " bytes exceeds " << capacity_;
+        return false;
+    }
+    if (!data_) {
+        // Only address space until a download touches it.
+        void* p = mmap(nullptr, capacity_, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            PLOG(ERROR) << "Failed to map download buffer";
+            return false;
+        }
+        // Fewer faults and TLB misses for large downloads, where the kernel
+        // has transparent hugepages enabled.
+        if (madvise(p, capacity_, MADV_HUGEPAGE)) {
+            PLOG(VERBOSE) << "No hugepages for download buffer";
+        }
+        data_ = static_cast<char*>(p);
+    }
+    size_ = size;
+    return true;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <stddef.h>
+
+// Holds the last download. The memory is mapped once, for the largest download
+// allowed, and stays mapped: a download never reallocates or copies, and only
+// faults in the pages that no earlier download has touched.
+class DownloadBuffer {
+  public:
+    explicit DownloadBuffer(size_t capacity) : capacity_(capacity) {}
+    ~DownloadBuffer();
+
+    DownloadBuffer(const DownloadBuffer&) = delete;
+    DownloadBuffer& operator=(const DownloadBuffer&) = delete;
+
+    // Makes room for |size| bytes. The contents are left undefined.
+    bool resize(size_t size);
+    void clear() { size_ = 0; }
+
+    char* data() { return data_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+  private:
+    const size_t capacity_;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+};
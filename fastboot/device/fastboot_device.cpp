@@ -17,6 +17,7 @@
 #include "fastboot_device.h"
 
 #include <algorithm>
+#include <chrono>
 
 #include <BootControlClient.h>
 #include <android-base/logging.h>
@@ -93,6 +94,7 @@ FastbootDevice::FastbootDevice()
     : kCommandMap({
               {FB_CMD_SET_ACTIVE, SetActiveHandler},
               {FB_CMD_DOWNLOAD, DownloadHandler},
+              {FB_CMD_DOWNLOAD_COMPRESSED, DownloadCompressedHandler},
               {FB_CMD_GETVAR, GetVarHandler},
               {FB_CMD_SHUTDOWN, ShutDownHandler},
               {FB_CMD_REBOOT, RebootHandler},
@@ -109,10 +111,14 @@ FastbootDevice::FastbootDevice()
               {FB_CMD_GSI, GsiHandler},
               {FB_CMD_SNAPSHOT_UPDATE, SnapshotUpdateHandler},
               {FB_CMD_FETCH, FetchHandler},
+              {FB_CMD_FETCH_COMPRESSED, FetchCompressedHandler},
+              {FB_CMD_PARTITION_DIGEST, PartitionDigestHandler},
+              {FB_CMD_STREAM_FLASH, StreamFlashHandler},
       }),
       boot_control_hal_(BootControlClient::WaitForService()),
       health_hal_(get_health_service()),
       fastboot_hal_(get_fastboot_service()),
+      download_data_(kMaxDownloadSizeDefault),
       active_slot_("") {
     if (android::base::GetProperty("fastbootd.protocol", "usb") == "tcp") {
         transport_ = std::make_unique<ClientTcpTransport>();
@@ -182,6 +188,9 @@ bool FastbootDevice::WriteStatus(FastbootResult result, const std::string& messa
         PLOG(ERROR) << "Failed to write " << message;
         return false;
     }
+    if (result == FastbootResult::DATA) {
+        data_phase_started_ = true;
+    }
 
     return true;
 }
@@ -191,8 +200,20 @@ bool FastbootDevice::HandleData(bool read, std::vector<char>* data) {
 }
 
 bool FastbootDevice::HandleData(bool read, char* data, uint64_t size) {
+    if (read && data_phase_started_) {
+        data_phase_started_ = false;
+        download_bytes_ = 0;
+        download_ns_ = 0;
+    }
+    auto start = std::chrono::steady_clock::now();
     auto read_write_data_size = read ? this->get_transport()->Read(data, size)
                                      : this->get_transport()->Write(data, size);
+    if (read && read_write_data_size > 0) {
+        download_bytes_ += read_write_data_size;
+        download_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+    }
     if (read_write_data_size == -1) {
         LOG(ERROR) << (read ? "read from" : "write to") << " transport failed";
         return false;
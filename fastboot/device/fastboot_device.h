@@ -27,6 +27,7 @@
 #include <aidl/android/hardware/health/IHealth.h>
 
 #include "commands.h"
+#include "download_buffer.h"
 #include "transport.h"
 #include "variables.h"
 
@@ -48,7 +49,7 @@ class FastbootDevice {
     bool WriteFail(const std::string& message);
     bool WriteInfo(const std::string& message);
 
-    std::vector<char>& download_data() { return download_data_; }
+    DownloadBuffer& download_data() { return download_data_; }
     Transport* get_transport() { return transport_.get(); }
     BootControlClient* boot_control_hal() const { return boot_control_hal_.get(); }
     BootControlClient* boot1_1() const;
@@ -59,6 +60,11 @@ class FastbootDevice {
 
     void set_active_slot(const std::string& active_slot) { active_slot_ = active_slot; }
 
+    // Bytes received in the most recent DATA phase and the time spent reading them from the
+    // transport, for download-throughput.
+    uint64_t last_download_bytes() const { return download_bytes_; }
+    uint64_t last_download_ns() const { return download_ns_; }
+
   private:
     const std::unordered_map<std::string, CommandHandler> kCommandMap;
 
@@ -66,6 +72,10 @@ class FastbootDevice {
     std::unique_ptr<BootControlClient> boot_control_hal_;
     std::shared_ptr<aidl::android::hardware::health::IHealth> health_hal_;
     std::shared_ptr<aidl::android::hardware::fastboot::IFastboot> fastboot_hal_;
-    std::vector<char> download_data_;
+    DownloadBuffer download_data_;
     std::string active_slot_;
+    uint64_t download_bytes_ = 0;
+    uint64_t download_ns_ = 0;
+    // Set when a DATA response is sent; the next read starts a new download.
+    bool data_phase_started_ = false;
 };
@@ -21,6 +21,7 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <future>
 #include <memory>
 #include <optional>
 #include <set>
@@ -29,6 +30,8 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android-base/scopeguard.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <ext4_utils/ext4_utils.h>
 #include <fs_mgr_overlayfs.h>
@@ -49,6 +52,35 @@ namespace {
 
 constexpr uint32_t SPARSE_HEADER_MAGIC = 0xed26ff3a;
 
+// Sparse image format, see libsparse/sparse_format.h.
+constexpr uint16_t CHUNK_TYPE_RAW = 0xCAC1;
+constexpr uint16_t CHUNK_TYPE_FILL = 0xCAC2;
+constexpr uint16_t CHUNK_TYPE_DONT_CARE = 0xCAC3;
+constexpr uint16_t CHUNK_TYPE_CRC32 = 0xCAC4;
+
+struct SparseHeader {
+    uint32_t magic;
+    uint16_t major_version;
+    uint16_t minor_version;
+    uint16_t file_hdr_sz;
+    uint16_t chunk_hdr_sz;
+    uint32_t blk_sz;
+    uint32_t total_blks;
+    uint32_t total_chunks;
+    uint32_t image_checksum;
+};
+
+struct SparseChunkHeader {
+    uint16_t chunk_type;
+    uint16_t reserved1;
+    uint32_t chunk_sz;
+    uint32_t total_sz;
+};
+
+// Size of each of the two buffers used by stream-flash. One is being filled
+// from the transport while the other one is written to the partition.
+constexpr size_t kStreamBufferSize = 4 * 1024 * 1024;
+
 void WipeOverlayfsForPartition(FastbootDevice* device, const std::string& partition_name) {
     // May be called, in the case of sparse data, multiple times so cache/skip.
     static std::set<std::string> wiped;
@@ -110,7 +142,7 @@ int FlashRawDataChunk(PartitionHandle* handle, const char* data, size_t len) {
     return 0;
 }
 
-int FlashRawData(PartitionHandle* handle, const std::vector<char>& downloaded_data) {
+int FlashRawData(PartitionHandle* handle, const DownloadBuffer& downloaded_data) {
     int ret = FlashRawDataChunk(handle, downloaded_data.data(), downloaded_data.size());
     if (ret < 0) {
         return -errno;
@@ -131,7 +163,7 @@ int WriteCallback(void* priv, const void* data, size_t len) {
     return FlashRawDataChunk(handle, reinterpret_cast<const char*>(data), len);
 }
 
-int FlashSparseData(PartitionHandle* handle, std::vector<char>& downloaded_data) {
+int FlashSparseData(PartitionHandle* handle, DownloadBuffer& downloaded_data) {
     struct sparse_file* file = sparse_file_import_buf(downloaded_data.data(),
                                                       downloaded_data.size(), true, false);
     if (!file) {
@@ -142,35 +174,381 @@ int FlashSparseData(PartitionHandle* handle, std::vector<char>& downloaded_data)
     return sparse_file_callback(file, false, false, WriteCallback, reinterpret_cast<void*>(handle));
 }
 
-int FlashBlockDevice(PartitionHandle* handle, std::vector<char>& downloaded_data) {
+static bool IsSparseData(const DownloadBuffer& data) {
+    return data.size() >= sizeof(SPARSE_HEADER_MAGIC) &&
+           *reinterpret_cast<const uint32_t*>(data.data()) == SPARSE_HEADER_MAGIC;
+}
+
+int FlashBlockDevice(PartitionHandle* handle, DownloadBuffer& downloaded_data) {
     lseek64(handle->fd(), 0, SEEK_SET);
-    if (downloaded_data.size() >= sizeof(SPARSE_HEADER_MAGIC) &&
-        *reinterpret_cast<uint32_t*>(downloaded_data.data()) == SPARSE_HEADER_MAGIC) {
+    if (IsSparseData(downloaded_data)) {
         return FlashSparseData(handle, downloaded_data);
     } else {
         return FlashRawData(handle, downloaded_data);
     }
 }
 
-static void CopyAVBFooter(std::vector<char>* data, const uint64_t block_device_size) {
-    if (data->size() < AVB_FOOTER_SIZE) {
-        return;
+// |footer| holds the last AVB_FOOTER_SIZE bytes of a raw image of |written| bytes,
+// which |handle| is positioned right after. If it is an AVB footer, zero up to the
+// end of the block device and put the footer in its last bytes, as if the image
+// had been padded to the size of the block device.
+static int CopyAVBFooter(PartitionHandle* handle, const char* footer, uint64_t written,
+                         uint64_t block_device_size) {
+    if (written < AVB_FOOTER_SIZE || written >= block_device_size ||
+        memcmp(footer, AVB_FOOTER_MAGIC, AVB_FOOTER_MAGIC_LEN) != 0) {
+        return 0;
+    }
+
+    uint64_t footer_offset = block_device_size - AVB_FOOTER_SIZE;
+    uint64_t len = written < footer_offset ? footer_offset - written : 0;
+    std::vector<char> zeros(std::min<uint64_t>(len, 1048576));
+    while (len) {
+        size_t this_len = std::min<uint64_t>(len, zeros.size());
+        if (FlashRawDataChunk(handle, zeros.data(), this_len) < 0) {
+            return -errno;
+        }
+        len -= this_len;
+    }
+    if (lseek64(handle->fd(), footer_offset, SEEK_SET) < 0) {
+        int rv = -errno;
+        PLOG(ERROR) << "lseek failed";
+        return rv;
+    }
+    if (FlashRawDataChunk(handle, footer, AVB_FOOTER_SIZE) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+static bool HasAVBFooterCopy(const std::string& partition_name) {
+    return partition_name == "boot" || partition_name == "boot_a" || partition_name == "boot_b" ||
+           partition_name == "init_boot" || partition_name == "init_boot_a" ||
+           partition_name == "init_boot_b";
+}
+
+namespace {
+
+// Writes a raw or sparse image to a partition piece by piece, as it comes in
+// over the transport, instead of from a fully downloaded buffer. Write() is
+// always called in order, but may be called from different threads.
+class StreamFlasher {
+  public:
+    StreamFlasher(PartitionHandle* handle, uint64_t block_device_size, bool copy_avb_footer)
+        : handle_(handle),
+          block_device_size_(block_device_size),
+          copy_avb_footer_(copy_avb_footer) {}
+
+    int Write(const char* data, size_t len);
+    int Finish();
+
+  private:
+    enum class State {
+        kFileHeader,
+        kChunkHeader,
+        kRawData,
+        kFillValue,
+        kSkip,
+    };
+
+    int WriteRaw(const char* data, size_t len);
+    int WriteSparse(const char* data, size_t len);
+    int ParseFileHeader();
+    int ParseChunkHeader();
+    int WriteFill(uint32_t fill_val);
+    int WriteAVBFooter();
+
+    PartitionHandle* handle_;
+    uint64_t block_device_size_;
+    bool copy_avb_footer_;
+    std::optional<bool> sparse_;
+    uint64_t written_ = 0;
+    // Last AVB_FOOTER_SIZE bytes of a raw image.
+    std::string tail_;
+
+    State state_ = State::kFileHeader;
+    // Accumulates file and chunk headers, which may straddle two Write() calls.
+    std::string header_buf_;
+    size_t header_needed_ = sizeof(SparseHeader);
+    SparseHeader header_ = {};
+    SparseChunkHeader chunk_ = {};
+    uint32_t chunks_left_ = 0;
+    uint64_t blocks_left_ = 0;
+    // Payload bytes left in the current raw chunk, or bytes left to skip.
+    uint64_t remaining_ = 0;
+};
+
+int StreamFlasher::Write(const char* data, size_t len) {
+    if (!sparse_) {
+        sparse_ = len >= sizeof(SPARSE_HEADER_MAGIC) &&
+                  *reinterpret_cast<const uint32_t*>(data) == SPARSE_HEADER_MAGIC;
+    }
+    return *sparse_ ? WriteSparse(data, len) : WriteRaw(data, len);
+}
+
+int StreamFlasher::WriteRaw(const char* data, size_t len) {
+    if (FlashRawDataChunk(handle_, data, len) < 0) {
+        return -errno;
+    }
+    written_ += len;
+
+    if (copy_avb_footer_) {
+        if (len >= AVB_FOOTER_SIZE) {
+            tail_.assign(data + len - AVB_FOOTER_SIZE, AVB_FOOTER_SIZE);
+        } else {
+            tail_.append(data, len);
+            if (tail_.size() > AVB_FOOTER_SIZE) {
+                tail_.erase(0, tail_.size() - AVB_FOOTER_SIZE);
+            }
+        }
+    }
+    return 0;
+}
+
+int StreamFlasher::WriteSparse(const char* data, size_t len) {
+    while (len) {
+        size_t n = 0;
+        int ret = 0;
+        switch (state_) {
+            case State::kFileHeader:
+            case State::kChunkHeader:
+            case State::kFillValue:
+                n = std::min(len, header_needed_ - header_buf_.size());
+                header_buf_.append(data, n);
+                if (header_buf_.size() < header_needed_) {
+                    break;
+                }
+                if (state_ == State::kFileHeader) {
+                    ret = ParseFileHeader();
+                } else if (state_ == State::kChunkHeader) {
+                    ret = ParseChunkHeader();
+                } else {
+                    uint32_t fill_val;
+                    memcpy(&fill_val, header_buf_.data(), sizeof(fill_val));
+                    ret = WriteFill(fill_val);
+                }
+                break;
+            case State::kRawData:
+            case State::kSkip:
+                n = std::min<uint64_t>(len, remaining_);
+                if (state_ == State::kRawData && FlashRawDataChunk(handle_, data, n) < 0) {
+                    return -errno;
+                }
+                remaining_ -= n;
+                if (!remaining_) {
+                    state_ = State::kChunkHeader;
+                    header_needed_ = header_.chunk_hdr_sz;
+                }
+                break;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int StreamFlasher::ParseFileHeader() {
+    // The header may be larger than the part we understand; wait for all of it.
+    if (header_buf_.size() == sizeof(header_)) {
+        memcpy(&header_, header_buf_.data(), sizeof(header_));
+        if (header_.major_version != 1 || header_.file_hdr_sz < sizeof(SparseHeader) ||
+            header_.chunk_hdr_sz < sizeof(SparseChunkHeader) || !header_.blk_sz ||
+            header_.blk_sz % 4) {
+            LOG(ERROR) << "Unable to open sparse data for flashing";
+            return -EINVAL;
+        }
+        if (uint64_t(header_.total_blks) * header_.blk_sz > block_device_size_) {
+            LOG(ERROR) << "Cannot flash sparse image of " << header_.total_blks << " blocks to "
+                       << "block device of size " << block_device_size_;
+            return -EOVERFLOW;
+        }
+        chunks_left_ = header_.total_chunks;
+        blocks_left_ = header_.total_blks;
+        header_needed_ = header_.file_hdr_sz;
+        if (header_buf_.size() < header_needed_) {
+            return 0;
+        }
+    }
+
+    header_buf_.clear();
+    state_ = State::kChunkHeader;
+    header_needed_ = header_.chunk_hdr_sz;
+    return 0;
+}
+
+int StreamFlasher::ParseChunkHeader() {
+    memcpy(&chunk_, header_buf_.data(), sizeof(chunk_));
+    header_buf_.clear();
+
+    if (!chunks_left_) {
+        LOG(ERROR) << "Sparse data continues past its last chunk";
+        return -EINVAL;
+    }
+    chunks_left_--;
+
+    if (chunk_.total_sz < header_.chunk_hdr_sz || chunk_.chunk_sz > blocks_left_) {
+        LOG(ERROR) << "Invalid sparse chunk";
+        return -EINVAL;
+    }
+    uint64_t payload = chunk_.total_sz - header_.chunk_hdr_sz;
+    uint64_t len = uint64_t(chunk_.chunk_sz) * header_.blk_sz;
+
+    switch (chunk_.chunk_type) {
+        case CHUNK_TYPE_RAW:
+            if (payload != len) {
+                LOG(ERROR) << "Invalid sparse raw chunk";
+                return -EINVAL;
+            }
+            state_ = State::kRawData;
+            remaining_ = payload;
+            break;
+        case CHUNK_TYPE_FILL:
+            if (payload != sizeof(uint32_t)) {
+                LOG(ERROR) << "Invalid sparse fill chunk";
+                return -EINVAL;
+            }
+            state_ = State::kFillValue;
+            header_needed_ = sizeof(uint32_t);
+            return 0;
+        case CHUNK_TYPE_DONT_CARE:
+            if (lseek64(handle_->fd(), len, SEEK_CUR) < 0) {
+                int rv = -errno;
+                PLOG(ERROR) << "lseek failed";
+                return rv;
+            }
+            state_ = State::kSkip;
+            remaining_ = payload;
+            break;
+        case CHUNK_TYPE_CRC32:
+            // Nothing to write. The host does not send a checksum with images
+            // it flashes, and verifying one would need the whole image.
+            if (chunk_.chunk_sz) {
+                LOG(ERROR) << "Invalid sparse crc chunk";
+                return -EINVAL;
+            }
+            state_ = State::kSkip;
+            remaining_ = payload;
+            break;
+        default:
+            LOG(ERROR) << "Unknown sparse chunk type " << chunk_.chunk_type;
+            return -EINVAL;
+    }
+    blocks_left_ -= chunk_.chunk_sz;
+
+    if (!remaining_) {
+        state_ = State::kChunkHeader;
+        header_needed_ = header_.chunk_hdr_sz;
+    }
+    return 0;
+}
+
+int StreamFlasher::WriteFill(uint32_t fill_val) {
+    header_buf_.clear();
+
+    uint64_t len = uint64_t(chunk_.chunk_sz) * header_.blk_sz;
+    std::vector<uint32_t> fill(std::min<uint64_t>(len, 1048576) / sizeof(uint32_t), fill_val);
+    while (len) {
+        size_t this_len = std::min<uint64_t>(len, fill.size() * sizeof(uint32_t));
+        if (FlashRawDataChunk(handle_, reinterpret_cast<const char*>(fill.data()), this_len) < 0) {
+            return -errno;
+        }
+        len -= this_len;
+    }
+    blocks_left_ -= chunk_.chunk_sz;
+
+    state_ = State::kChunkHeader;
+    header_needed_ = header_.chunk_hdr_sz;
+    return 0;
+}
+
+int StreamFlasher::WriteAVBFooter() {
+    if (tail_.size() < AVB_FOOTER_SIZE) {
+        return 0;
     }
-    std::string footer;
-    uint64_t footer_offset = data->size() - AVB_FOOTER_SIZE;
-    for (int idx = 0; idx < AVB_FOOTER_MAGIC_LEN; idx++) {
-        footer.push_back(data->at(footer_offset + idx));
+    return CopyAVBFooter(handle_, tail_.data(), written_, block_device_size_);
+}
+
+int StreamFlasher::Finish() {
+    if (!sparse_.value_or(false)) {
+        return copy_avb_footer_ ? WriteAVBFooter() : 0;
     }
-    if (0 != footer.compare(AVB_FOOTER_MAGIC)) {
-        return;
+    if (state_ != State::kChunkHeader || !header_buf_.empty() || chunks_left_) {
+        LOG(ERROR) << "Sparse data ended in the middle of an image";
+        return -EINVAL;
     }
+    return 0;
+}
+
+}  // namespace
 
-    // copy AVB footer from end of data to end of block device
-    uint64_t original_data_size = data->size();
-    data->resize(block_device_size, 0);
-    for (int idx = 0; idx < AVB_FOOTER_SIZE; idx++) {
-        data->at(block_device_size - 1 - idx) = data->at(original_data_size - 1 - idx);
+int StreamFlash(FastbootDevice* device, const std::string& partition_name, uint32_t size) {
+    PartitionHandle handle;
+    if (!OpenPartition(device, partition_name, &handle, O_WRONLY | O_DIRECT)) {
+        return -ENOENT;
     }
+
+    uint64_t block_device_size = get_block_device_size(handle.fd());
+    if (size > block_device_size) {
+        LOG(ERROR) << "Cannot flash " << size << " bytes to block device of size "
+                   << block_device_size;
+        return -EOVERFLOW;
+    }
+    if (android::base::GetProperty("ro.system.build.type", "") != "user") {
+        WipeOverlayfsForPartition(device, partition_name);
+    }
+
+    size_t buffer_size = std::min<size_t>(size, kStreamBufferSize);
+    std::unique_ptr<void, decltype(&free)> buffers[2] = {{nullptr, free}, {nullptr, free}};
+    for (auto& buffer : buffers) {
+        void* p;
+        if (posix_memalign(&p, 4096, buffer_size)) {
+            PLOG(ERROR) << "Failed to allocate stream buffer";
+            return -ENOMEM;
+        }
+        buffer.reset(p);
+    }
+
+    lseek64(handle.fd(), 0, SEEK_SET);
+    if (!device->WriteStatus(FastbootResult::DATA, android::base::StringPrintf("%08x", size))) {
+        return -EIO;
+    }
+
+    // While one buffer is written to the partition, receive into the other.
+    // After an error the rest of the data is still read, so that the host
+    // gets to see the failure instead of a stalled transfer.
+    StreamFlasher flasher(&handle, block_device_size, HasAVBFooterCopy(partition_name));
+    std::future<int> pending;
+    int result = 0;
+    for (uint32_t received = 0, i = 0; received < size; i++) {
+        char* data = reinterpret_cast<char*>(buffers[i % 2].get());
+        size_t len = std::min<size_t>(size - received, buffer_size);
+        if (!device->HandleData(true, data, len)) {
+            if (pending.valid()) pending.wait();
+            return -EIO;
+        }
+        received += len;
+
+        if (pending.valid()) {
+            int ret = pending.get();
+            if (!result) result = ret;
+        }
+        if (result < 0) {
+            continue;
+        }
+        pending = std::async(std::launch::async,
+                             [&flasher, data, len] { return flasher.Write(data, len); });
+    }
+    if (pending.valid()) {
+        int ret = pending.get();
+        if (!result) result = ret;
+    }
+    if (!result) {
+        result = flasher.Finish();
+    }
+    sync();
+    return result;
 }
 
 int Flash(FastbootDevice* device, const std::string& partition_name) {
@@ -179,7 +557,9 @@ int Flash(FastbootDevice* device, const std::string& partition_name) {
         return -ENOENT;
     }
 
-    std::vector<char> data = std::move(device->download_data());
+    // The data is used up by flashing, whether that works or not.
+    DownloadBuffer& data = device->download_data();
+    auto clear_data = android::base::make_scope_guard([&data] { data.clear(); });
     if (data.size() == 0) {
         LOG(ERROR) << "Cannot flash empty data vector";
         return -EINVAL;
@@ -189,16 +569,18 @@ int Flash(FastbootDevice* device, const std::string& partition_name) {
         LOG(ERROR) << "Cannot flash " << data.size() << " bytes to block device of size "
                    << block_device_size;
         return -EOVERFLOW;
-    } else if (data.size() < block_device_size &&
-               (partition_name == "boot" || partition_name == "boot_a" ||
-                partition_name == "boot_b" || partition_name == "init_boot" ||
-                partition_name == "init_boot_a" || partition_name == "init_boot_b")) {
-        CopyAVBFooter(&data, block_device_size);
     }
     if (android::base::GetProperty("ro.system.build.type", "") != "user") {
         WipeOverlayfsForPartition(device, partition_name);
     }
     int result = FlashBlockDevice(&handle, data);
+    // A sparse image can end in raw data that looks like a footer, e.g. when
+    // only the tail of the partition is sent.
+    if (result == 0 && HasAVBFooterCopy(partition_name) && !IsSparseData(data) &&
+        data.size() >= AVB_FOOTER_SIZE) {
+        result = CopyAVBFooter(&handle, data.data() + data.size() - AVB_FOOTER_SIZE, data.size(),
+                               block_device_size);
+    }
     sync();
     return result;
 }
@@ -209,7 +591,8 @@ static void RemoveScratchPartition() {
 }
 
 bool UpdateSuper(FastbootDevice* device, const std::string& super_name, bool wipe) {
-    std::vector<char> data = std::move(device->download_data());
+    DownloadBuffer& data = device->download_data();
+    auto clear_data = android::base::make_scope_guard([&data] { data.clear(); });
     if (data.empty()) {
         return device->WriteFail("No data available");
     }
@@ -28,6 +28,9 @@ static constexpr int kDefaultPort = 5554;
 static constexpr int kProtocolVersion = 1;
 static constexpr int kHandshakeTimeoutMs = 2000;
 static constexpr size_t kHandshakeLength = 4;
+// Large enough to keep a gigabit link busy across the round trip to the host; the kernel clamps
+// it to net.core.rmem_max.
+static constexpr int kReceiveBufferSize = 8 * 1024 * 1024;
 
 // Extract the big-endian 8-byte message length into a 64-bit number.
 static uint64_t ExtractMessageLength(const void* buffer) {
@@ -47,6 +50,9 @@ static void EncodeMessageLength(uint64_t length, void* buffer) {
 
 ClientTcpTransport::ClientTcpTransport() {
     service_ = Socket::NewServer(Socket::Protocol::kTcp, kDefaultPort);
+    if (service_ && !service_->SetReceiveBufferSize(kReceiveBufferSize)) {
+        PLOG(WARNING) << "Failed to set receive buffer size to " << kReceiveBufferSize;
+    }
 
     // A workaround to notify recovery to continue its work.
     android::base::SetProperty("sys.usb.ffs.ready", "1");
@@ -61,6 +61,10 @@ struct usb_handle {
     struct aio_block write_aiob;
 
     io_uring ring;
+    // Endpoint descriptors currently registered as fixed files with |ring|.
+    int ring_fds[2] = {-1, -1};
+    bool ring_files_registered = false;
+    bool ring_use_fixed_files = false;
     size_t io_size;
     AIOType aio_type;
 };
@@ -19,7 +19,12 @@
 #include "liburing/io_uring.h"
 #include "usb.h"
 
-static int prep_async_read(struct io_uring* ring, int fd, void* data, size_t len, int64_t offset) {
+// Registered file slots for the two bulk endpoints, see RegisterEndpointFiles().
+static constexpr int kReadFileIndex = 0;
+static constexpr int kWriteFileIndex = 1;
+
+static int prep_async_read(struct io_uring* ring, int fd, void* data, size_t len, int64_t offset,
+                           unsigned flags) {
     if (io_uring_sq_space_left(ring) <= 0) {
         LOG(ERROR) << "Submission queue run out of space.";
         return -1;
@@ -28,13 +33,13 @@ static int prep_async_read(struct io_uring* ring, int fd, void* data, size_t len
     if (sqe == nullptr) {
         return -1;
     }
-    io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK | IOSQE_ASYNC);
+    io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK | IOSQE_ASYNC | flags);
     io_uring_prep_read(sqe, fd, data, len, offset);
     return 0;
 }
 
 static int prep_async_write(struct io_uring* ring, int fd, const void* data, size_t len,
-                            int64_t offset) {
+                            int64_t offset, unsigned flags) {
     if (io_uring_sq_space_left(ring) <= 0) {
         LOG(ERROR) << "Submission queue run out of space.";
         return -1;
@@ -43,17 +48,18 @@ static int prep_async_write(struct io_uring* ring, int fd, const void* data, siz
     if (sqe == nullptr) {
         return -1;
     }
-    io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK | IOSQE_ASYNC);
+    io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK | IOSQE_ASYNC | flags);
     io_uring_prep_write(sqe, fd, data, len, offset);
     return 0;
 }
 
 template <bool read, typename T>
-int prep_async_io(struct io_uring* ring, int fd, T* data, size_t len, int64_t offset) {
+int prep_async_io(struct io_uring* ring, int fd, T* data, size_t len, int64_t offset,
+                  unsigned flags) {
     if constexpr (read) {
-        return prep_async_read(ring, fd, data, len, offset);
+        return prep_async_read(ring, fd, data, len, offset, flags);
     } else {
-        return prep_async_write(ring, fd, data, len, offset);
+        return prep_async_write(ring, fd, data, len, offset, flags);
     }
 }
 
@@ -64,16 +70,51 @@ static constexpr T DivRoundup(T x, T y) {
 
 extern int getMaxPacketSize(int ffs_fd);
 
+// The endpoint files are reopened on every new connection, so the registered
+// table is refreshed whenever the descriptors change. Fixed files spare the
+// kernel an fget/fput per request; if registration is not possible the plain
+// descriptors are used instead.
+static void RegisterEndpointFiles(usb_handle* h) {
+    int fds[2] = {h->read_aiob.fd, h->write_aiob.fd};
+    if (fds[0] == h->ring_fds[0] && fds[1] == h->ring_fds[1]) {
+        return;
+    }
+    int ret;
+    if (h->ring_files_registered) {
+        ret = io_uring_register_files_update(&h->ring, 0, fds, 2);
+        ret = ret == 2 ? 0 : ret;
+    } else {
+        ret = io_uring_register_files(&h->ring, fds, 2);
+    }
+    if (ret < 0) {
+        LOG(WARNING) << "Failed to register usb ffs endpoints with io_uring: " << strerror(-ret);
+        if (h->ring_files_registered) {
+            io_uring_unregister_files(&h->ring);
+            h->ring_files_registered = false;
+        }
+        h->ring_fds[0] = h->ring_fds[1] = -1;
+        h->ring_use_fixed_files = false;
+        return;
+    }
+    h->ring_files_registered = true;
+    h->ring_use_fixed_files = true;
+    h->ring_fds[0] = fds[0];
+    h->ring_fds[1] = fds[1];
+}
+
 template <bool read, typename T>
 static int usb_ffs_do_aio(usb_handle* h, T* const data, const int len) {
     const aio_block* aiob = read ? &h->read_aiob : &h->write_aiob;
     const int num_requests = DivRoundup<int>(len, h->io_size);
     auto cur_data = data;
-    const auto packet_size = getMaxPacketSize(aiob->fd);
+
+    RegisterEndpointFiles(h);
+    const int fd = h->ring_use_fixed_files ? (read ? kReadFileIndex : kWriteFileIndex) : aiob->fd;
+    const unsigned flags = h->ring_use_fixed_files ? IOSQE_FIXED_FILE : 0;
 
     for (int bytes_remain = len; bytes_remain > 0;) {
         const int buf_len = std::min(bytes_remain, static_cast<int>(h->io_size));
-        const auto ret = prep_async_io<read>(&h->ring, aiob->fd, cur_data, buf_len, 0);
+        const auto ret = prep_async_io<read>(&h->ring, fd, cur_data, buf_len, 0, flags);
         if (ret < 0) {
             PLOG(ERROR) << "Failed to queue io_uring request";
             return -1;
@@ -82,13 +123,17 @@ static int usb_ffs_do_aio(usb_handle* h, T* const data, const int len) {
         bytes_remain -= buf_len;
         cur_data = reinterpret_cast<T*>(reinterpret_cast<size_t>(cur_data) + buf_len);
     }
-    const int ret = io_uring_submit(&h->ring);
+    // Submit the whole chain and wait for all of it in a single io_uring_enter.
+    const int ret = io_uring_submit_and_wait(&h->ring, num_requests);
     if (ret <= 0 || ret != num_requests) {
         PLOG(ERROR) << "io_uring: failed to submit SQE entries to kernel";
         return -1;
     }
     int res = 0;
     bool success = true;
+    // A short transfer breaks the link; the requests after it complete with
+    // -ECANCELED and just mean there was no more data to move.
+    bool short_transfer = false;
     for (int i = 0; i < num_requests; ++i) {
         struct io_uring_cqe* cqe{};
         const auto ret = TEMP_FAILURE_RETRY(io_uring_wait_cqe(&h->ring, &cqe));
@@ -97,13 +142,18 @@ static int usb_ffs_do_aio(usb_handle* h, T* const data, const int len) {
             success = false;
             continue;
         }
-        res += cqe->res;
-        if (cqe->res < 0) {
+        if (cqe->res >= 0) {
+            res += cqe->res;
+            const int expected = std::min(len - i * static_cast<int>(h->io_size),
+                                          static_cast<int>(h->io_size));
+            short_transfer |= cqe->res < expected;
+        } else if (!(short_transfer && cqe->res == -ECANCELED)) {
             LOG(ERROR) << "io_uring request failed:, i = " << i
                        << ", num_requests = " << num_requests << ", res = " << cqe->res << ": "
-                       << strerror(cqe->res) << (read ? " read" : " write")
+                       << strerror(-cqe->res) << (read ? " read" : " write")
                        << " request size: " << len << ", io_size: " << h->io_size
-                       << " max packet size: " << packet_size << ", fd: " << aiob->fd;
+                       << " max packet size: " << getMaxPacketSize(aiob->fd)
+                       << ", fd: " << aiob->fd;
             success = false;
             errno = -cqe->res;
         }
@@ -125,15 +175,21 @@ static int usb_ffs_io_uring_write(usb_handle* h, const void* data, int len) {
 
 void exit_io_uring_ffs(usb_handle* h) {
     io_uring_queue_exit(&h->ring);
+    h->ring_files_registered = false;
+    h->ring_use_fixed_files = false;
+    h->ring_fds[0] = h->ring_fds[1] = -1;
 }
 
 bool init_io_uring_ffs(usb_handle* h, size_t queue_depth) {
     const auto err = io_uring_queue_init(queue_depth, &h->ring, 0);
     if (err) {
         LOG(ERROR) << "Failed to initialize io_uring of depth " << queue_depth << ": "
-                   << strerror(err);
+                   << strerror(-err);
         return false;
     }
+    h->ring_files_registered = false;
+    h->ring_use_fixed_files = false;
+    h->ring_fds[0] = h->ring_fds[1] = -1;
     h->write = usb_ffs_io_uring_write;
     h->read = usb_ffs_io_uring_read;
     return true;
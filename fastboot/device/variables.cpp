@@ -30,6 +30,7 @@
 #include <liblp/liblp.h>
 
 #include "BootControlClient.h"
+#include "constants.h"
 #include "fastboot_device.h"
 #include "flashing.h"
 #include "utility.h"
@@ -405,6 +406,45 @@ bool GetIsUserspace(FastbootDevice* /* device */, const std::vector<std::string>
     return true;
 }
 
+bool GetStreamFlash(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
+                    std::string* message) {
+    *message = "yes";
+    return true;
+}
+
+bool GetDownloadCompression(FastbootDevice* /* device */,
+                            const std::vector<std::string>& /* args */, std::string* message) {
+    *message = FB_COMPRESSION_LZ4;
+    return true;
+}
+
+bool GetPartitionDigest(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
+                        std::string* message) {
+    *message = FB_DIGEST_SHA256;
+    return true;
+}
+
+bool GetFetchCompression(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
+                         std::string* message) {
+    *message = FB_COMPRESSION_LZ4;
+    return true;
+}
+
+// Only the time spent waiting on the transport is counted, so flashing in
+// parallel with a streamed download does not lower the figure.
+bool GetDownloadThroughput(FastbootDevice* device, const std::vector<std::string>& /* args */,
+                           std::string* message) {
+    uint64_t bytes = device->last_download_bytes();
+    uint64_t ns = device->last_download_ns();
+    if (bytes == 0 || ns == 0) {
+        *message = "No download yet";
+        return false;
+    }
+    *message = android::base::StringPrintf("%" PRIu64 " bytes in %" PRIu64 " ms, %.1f MB/s", bytes,
+                                           ns / 1000000, bytes * 1e3 / ns);
+    return true;
+}
+
 bool GetIsForceDebuggable(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
                           std::string* message) {
     *message = android::base::GetBoolProperty("ro.force.debuggable", false) ? "yes" : "no";
@@ -54,6 +54,16 @@ bool GetPartitionIsLogical(FastbootDevice* device, const std::vector<std::string
                            std::string* message);
 bool GetIsUserspace(FastbootDevice* device, const std::vector<std::string>& args,
                     std::string* message);
+bool GetStreamFlash(FastbootDevice* device, const std::vector<std::string>& args,
+                    std::string* message);
+bool GetDownloadCompression(FastbootDevice* device, const std::vector<std::string>& args,
+                            std::string* message);
+bool GetPartitionDigest(FastbootDevice* device, const std::vector<std::string>& args,
+                        std::string* message);
+bool GetFetchCompression(FastbootDevice* device, const std::vector<std::string>& args,
+                         std::string* message);
+bool GetDownloadThroughput(FastbootDevice* device, const std::vector<std::string>& args,
+                           std::string* message);
 bool GetIsForceDebuggable(FastbootDevice* device, const std::vector<std::string>& args,
                           std::string* message);
 bool GetHardwareRevision(FastbootDevice* device, const std::vector<std::string>& args,
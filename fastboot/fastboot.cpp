@@ -44,6 +44,7 @@
 
 #include <chrono>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <regex>
@@ -65,6 +66,7 @@
 #include <libavb/libavb.h>
 #include <liblp/liblp.h>
 #include <liblp/super_layout_builder.h>
+#include <openssl/sha.h>
 #include <platform_tools_version.h>
 #include <sparse/sparse.h>
 #include <ziparchive/zip_archive.h>
@@ -109,6 +111,7 @@ static std::string g_dtb_path;
 
 static bool g_disable_verity = false;
 static bool g_disable_verification = false;
+static bool g_compress_downloads = false;
 
 fastboot::FastBootDriver* fb = nullptr;
 
@@ -630,6 +633,10 @@ static int show_help() {
             " --skip-reboot              Don't reboot device after flashing.\n"
             " --disable-verity           Sets disable-verity when flashing vbmeta.\n"
             " --disable-verification     Sets disable-verification when flashing vbmeta.\n"
+            " --compress                 Compress downloads and fetches if the device\n"
+            "                            supports it.\n"
+            " --delta                    Only send the parts of images that differ from what\n"
+            "                            is on the device.\n"
             " --disable-super-optimization\n"
             "                            Disables optimizations on flashing super partition.\n"
             " --disable-fastboot-info    Will collects tasks from image list rather than $OUT/fastboot-info.txt.\n"
@@ -778,18 +785,24 @@ static int make_temporary_fd(const char* what) {
 
 #endif
 
+// Set on threads that load images in the background, so that their progress
+// messages don't end up in the middle of the status line of the current command.
+static thread_local bool quiet_extract = false;
+
 static unique_fd UnzipToFile(ZipArchiveHandle zip, const char* entry_name) {
     unique_fd fd(make_temporary_fd(entry_name));
 
     ZipEntry64 zip_entry;
     if (FindEntry(zip, entry_name, &zip_entry) != 0) {
-        fprintf(stderr, "archive does not contain '%s'\n", entry_name);
+        if (!quiet_extract) fprintf(stderr, "archive does not contain '%s'\n", entry_name);
         errno = ENOENT;
         return unique_fd();
     }
 
-    fprintf(stderr, "extracting %s (%" PRIu64 " MB) to disk...", entry_name,
-            zip_entry.uncompressed_length / 1024 / 1024);
+    if (!quiet_extract) {
+        fprintf(stderr, "extracting %s (%" PRIu64 " MB) to disk...", entry_name,
+                zip_entry.uncompressed_length / 1024 / 1024);
+    }
     double start = now();
     int error = ExtractEntryToFile(zip, &zip_entry, fd.get());
     if (error != 0) {
@@ -800,7 +813,9 @@ static unique_fd UnzipToFile(ZipArchiveHandle zip, const char* entry_name) {
         die("\nlseek on extracted file '%s' failed: %s", entry_name, strerror(errno));
     }
 
-    fprintf(stderr, " took %.3fs\n", now() - start);
+    if (!quiet_extract) {
+        fprintf(stderr, " took %.3fs\n", now() - start);
+    }
 
     return fd;
 }
@@ -1257,8 +1272,181 @@ void flash_partition_files(const std::string& partition, const std::vector<Spars
     }
 }
 
-static void flash_buf(const ImageSource* source, const std::string& partition,
+// Granularity at which --delta compares the image with the partition.
+static constexpr uint32_t kDeltaBlockSize = 64 * 1024;
+
+namespace {
+// Builds a sparse image from the callback output of another one that only has
+// data for the kDeltaBlockSize regions whose digest doesn't match |digests|.
+// Everything else becomes DONT_CARE.
+class DeltaImageBuilder {
+  public:
+    DeltaImageBuilder(sparse_file* out, const std::vector<char>& digests, int fd)
+        : out_(out),
+          block_size_(sparse_file_block_size(out)),
+          digests_(digests),
+          fd_(fd),
+          region_(kDeltaBlockSize),
+          present_(kDeltaBlockSize / block_size_) {}
+
+    static int Write(void* priv, const void* data, size_t len) {
+        return reinterpret_cast<DeltaImageBuilder*>(priv)->Append(data, len);
+    }
+
+    int Finish() { return region_len_ ? FlushRegion() : 0; }
+
+    uint64_t changed_bytes() const { return changed_bytes_; }
+
+  private:
+    int Append(const void* data, size_t len) {
+        const char* p = reinterpret_cast<const char*>(data);
+        while (len > 0) {
+            size_t n = std::min<size_t>(len, region_.size() - region_len_);
+            if (p) {
+                memcpy(region_.data() + region_len_, p, n);
+                for (size_t b = region_len_ / block_size_; b <= (region_len_ + n - 1) / block_size_;
+                     b++) {
+                    present_[b] = true;
+                }
+                p += n;
+            } else {
+                has_hole_ = true;
+            }
+            region_len_ += n;
+            len -= n;
+            if (region_len_ == region_.size()) {
+                int ret = FlushRegion();
+                if (ret < 0) return ret;
+            }
+        }
+        return 0;
+    }
+
+    // Adds the data of the current region to |out_| unless the device has the
+    // same. Regions with DONT_CARE blocks can't be compared, so they are always
+    // sent, without the holes.
+    int FlushRegion() {
+        bool changed = true;
+        const size_t digest_offset = region_index_ * FB_DIGEST_SIZE;
+        if (!has_hole_ && digest_offset + FB_DIGEST_SIZE <= digests_.size()) {
+            uint8_t digest[SHA256_DIGEST_LENGTH];
+            SHA256(reinterpret_cast<const uint8_t*>(region_.data()), region_len_, digest);
+            changed = memcmp(digest, &digests_[digest_offset], FB_DIGEST_SIZE) != 0;
+        }
+
+        const size_t num_blocks = (region_len_ + block_size_ - 1) / block_size_;
+        for (size_t b = 0; changed && b < num_blocks;) {
+            if (!present_[b]) {
+                b++;
+                continue;
+            }
+            size_t end = b;
+            while (end < num_blocks && present_[end]) end++;
+
+            size_t offset = b * block_size_;
+            size_t len = std::min(end * block_size_, region_len_) - offset;
+            if (!android::base::WriteFully(fd_, region_.data() + offset, len)) {
+                return -errno;
+            }
+            int ret = sparse_file_add_fd(out_, fd_, fd_offset_, len,
+                                         region_index_ * (kDeltaBlockSize / block_size_) + b);
+            if (ret < 0) return ret;
+            fd_offset_ += len;
+            changed_bytes_ += len;
+            b = end;
+        }
+
+        region_index_++;
+        region_len_ = 0;
+        has_hole_ = false;
+        std::fill(present_.begin(), present_.end(), false);
+        return 0;
+    }
+
+    sparse_file* out_;
+    const unsigned int block_size_;
+    const std::vector<char>& digests_;
+    const int fd_;
+    std::vector<char> region_;
+    std::vector<bool> present_;
+    size_t region_len_ = 0;
+    bool has_hole_ = false;
+    uint64_t region_index_ = 0;
+    int64_t fd_offset_ = 0;
+    uint64_t changed_bytes_ = 0;
+};
+}  // namespace
+
+// fastbootd copies the AVB footer of raw images that are smaller than these
+// partitions to their end, which it can't do for the sparse image that --delta
+// sends.
+static bool is_avb_footer_copy_partition(const std::string& partition) {
+    std::string name = partition;
+    if (android::base::EndsWith(name, "_a") || android::base::EndsWith(name, "_b")) {
+        name.resize(name.size() - 2);
+    }
+    return name == "boot" || name == "init_boot";
+}
+
+// Replaces |buf| with a sparse image that only has the data that isn't on the
+// device yet. Returns false if nothing needs to be flashed at all.
+static bool load_delta_buf(const FlashingPlan* fp, const std::string& partition,
+                           struct fastboot_buffer* buf) {
+    std::string algorithm;
+    if (fb->GetVar(FB_VAR_PARTITION_DIGEST, &algorithm) != fastboot::SUCCESS ||
+        algorithm != FB_DIGEST_SHA256) {
+        verbose("target doesn't support partition digests, flashing all of %s",
+                partition.c_str());
+        return true;
+    }
+    if (is_avb_footer_copy_partition(partition)) {
+        return true;
+    }
+
+    lseek(buf->fd.get(), 0, SEEK_SET);
+    SparsePtr in(sparse_file_import_auto(buf->fd.get(), false, false), sparse_file_destroy);
+    if (!in) die("cannot sparse read file for %s", partition.c_str());
+    int64_t len = sparse_file_len(in.get(), false, false);
+    if (len <= 0) die("Could not compute length of sparse image for %s", partition.c_str());
+    const unsigned int block_size = sparse_file_block_size(in.get());
+    if (kDeltaBlockSize % block_size != 0 || len % block_size != 0) {
+        lseek(buf->fd.get(), 0, SEEK_SET);
+        return true;
+    }
+
+    std::vector<char> digests;
+    fb->PartitionDigest(partition, kDeltaBlockSize, len, &digests);
+
+    unique_fd fd(make_temporary_fd("delta image"));
+    SparsePtr out(sparse_file_new(block_size, len), sparse_file_destroy);
+    if (!out) die("Failed to create sparse file for %s", partition.c_str());
+    DeltaImageBuilder builder(out.get(), digests, fd.get());
+    if (sparse_file_callback(in.get(), false, false, DeltaImageBuilder::Write, &builder) < 0 ||
+        builder.Finish() < 0) {
+        die("Failed to build delta image for %s", partition.c_str());
+    }
+    fprintf(stderr, "Delta for '%s': %" PRIu64 " of %" PRId64 " bytes changed\n",
+            partition.c_str(), builder.changed_bytes(), len);
+    if (builder.changed_bytes() == 0) {
+        return false;
+    }
+
+    int64_t sparse_len = sparse_file_len(out.get(), true, false);
+    if (sparse_len < 0) die("Could not compute length of sparse image for %s", partition.c_str());
+    buf->files.clear();
+    if (int64_t limit = get_sparse_limit(sparse_len, fp)) {
+        buf->files = resparse_file(out.get(), limit);
+    } else {
+        buf->files.push_back(std::move(out));
+    }
+    buf->fd = std::move(fd);
+    buf->type = FB_BUFFER_SPARSE;
+    return true;
+}
+
+static void flash_buf(const FlashingPlan* fp, const std::string& partition,
                       struct fastboot_buffer* buf, const bool apply_vbmeta) {
+    const ImageSource* source = fp->source.get();
     copy_avb_footer(source, partition, buf);
 
     // Rewrite vbmeta if that's what we're flashing and modification has been requested.
@@ -1273,6 +1461,11 @@ static void flash_buf(const ImageSource* source, const std::string& partition,
         }
     }
 
+    if (fp->delta_flash && !load_delta_buf(fp, partition, buf)) {
+        fprintf(stderr, "Skipping '%s', it is unchanged\n", partition.c_str());
+        return;
+    }
+
     switch (buf->type) {
         case FB_BUFFER_SPARSE: {
             flash_partition_files(partition, buf->files);
@@ -1482,31 +1675,59 @@ static std::string repack_ramdisk(const char* pname, struct fastboot_buffer* buf
 
     unique_fd vendor_boot(make_temporary_fd("vendor boot repack"));
     uint64_t vendor_boot_size = fetch_partition(partition, vendor_boot, fb);
+    unique_fd new_vendor_boot(make_temporary_fd("vendor boot repack"));
     auto repack_res = replace_vendor_ramdisk(vendor_boot, vendor_boot_size, ramdisk, buf->fd,
-                                             static_cast<uint64_t>(buf->sz));
+                                             static_cast<uint64_t>(buf->sz), new_vendor_boot);
     if (!repack_res.ok()) {
         die("%s", repack_res.error().message().c_str());
     }
 
-    buf->fd = std::move(vendor_boot);
+    lseek(new_vendor_boot.get(), 0, SEEK_SET);
+    buf->fd = std::move(new_vendor_boot);
     buf->sz = vendor_boot_size;
     buf->image_size = vendor_boot_size;
     return partition;
 }
 
+static bool load_flash_buf(const char* fname, struct fastboot_buffer* buf, const FlashingPlan* fp) {
+    if (fp->source) {
+        unique_fd fd = fp->source->OpenFile(fname);
+        return fd >= 0 && load_buf_fd(std::move(fd), buf, fp);
+    }
+    return load_buf(fname, buf, fp);
+}
+
+std::future<std::unique_ptr<fastboot_buffer>> prepare_flash_buf(const std::string& fname,
+                                                                const FlashingPlan* fp) {
+    // Ask for max-download-size now, the loader thread must not talk to the device.
+    get_sparse_limit(0, fp);
+
+    return std::async(std::launch::async, [fname, fp]() -> std::unique_ptr<fastboot_buffer> {
+        quiet_extract = true;
+        auto buf = std::make_unique<fastboot_buffer>();
+        if (!load_flash_buf(fname.c_str(), buf.get(), fp)) {
+            // do_flash() will try again, and report the error.
+            return nullptr;
+        }
+        return buf;
+    });
+}
+
 void do_flash(const char* pname, const char* fname, const bool apply_vbmeta,
-              const FlashingPlan* fp) {
+              const FlashingPlan* fp, struct fastboot_buffer* prepared) {
     if (!fp) {
         die("do flash was called without a valid flashing plan");
     }
     verbose("Do flash %s %s", pname, fname);
     struct fastboot_buffer buf;
 
+    if (prepared) {
+        buf = std::move(*prepared);
+    } else if (!load_flash_buf(fname, &buf, fp)) {
+        die("%s '%s': %s", fp->source ? "could not load" : "cannot load", fname, strerror(errno));
+    }
+
     if (fp->source) {
-        unique_fd fd = fp->source->OpenFile(fname);
-        if (fd < 0 || !load_buf_fd(std::move(fd), &buf, fp)) {
-            die("could not load '%s': %s", fname, strerror(errno));
-        }
         std::vector<char> signature_data;
         std::string file_string(fname);
         if (fp->source->ReadFile(file_string.substr(0, file_string.find('.')) + ".sig",
@@ -1514,15 +1735,13 @@ void do_flash(const char* pname, const char* fname, const bool apply_vbmeta,
             fb->Download("signature", signature_data);
             fb->RawCommand("signature", "installing signature");
         }
-    } else if (!load_buf(fname, &buf, fp)) {
-        die("cannot load '%s': %s", fname, strerror(errno));
     }
 
     if (is_logical(pname)) {
         fb->ResizePartition(pname, std::to_string(buf.image_size));
     }
     std::string flash_pname = repack_ramdisk(pname, &buf, fp->fb);
-    flash_buf(fp->source.get(), flash_pname, &buf, apply_vbmeta);
+    flash_buf(fp, flash_pname, &buf, apply_vbmeta);
 }
 
 // Sets slot_override as the active slot. If slot_override is blank,
@@ -1795,10 +2014,57 @@ void FlashAllTool::Flash() {
 
     tasks_ = CollectTasks();
 
-    for (auto& task : tasks_) {
-        task->Run();
+    run_tasks(tasks_, [](Task* task, double elapsed) {
+        if (FlashTask* flash_task = task->AsFlashTask()) {
+            fprintf(stderr, "Flashed '%s' in %.3fs\n", flash_task->GetPartition().c_str(),
+                    elapsed);
+        }
+    });
+}
+
+// Images loaded ahead of the one being flashed are bounded both in number,
+// since each is loaded on its own thread, and in total size, since they are
+// extracted to temporary files (or memory) until flashed.
+static constexpr size_t kMaxPrefetchedImages = 4;
+static constexpr int64_t kPrefetchBudget = 2LL * 1024 * 1024 * 1024;
+
+void run_tasks(const std::vector<std::unique_ptr<Task>>& tasks,
+               const std::function<void(Task*, double)>& on_task_done) {
+    // Tasks before |prefetched_end| have been prepared.
+    size_t prefetched_end = 0;
+    for (size_t i = 0; i < tasks.size(); i++) {
+        // While an image is being sent, load the next ones on the host. Only
+        // do so between flashes: other tasks may reboot the device, which
+        // changes its max-download-size. The next image is always loaded
+        // ahead; the ones after it only while they fit in the budget.
+        if (tasks[i]->AsFlashTask()) {
+            prefetched_end = std::max(prefetched_end, i + 1);
+            int64_t budget_used = 0;
+            for (size_t j = i + 1; j < prefetched_end; j++) {
+                budget_used += std::max<int64_t>(0, tasks[j]->AsFlashTask()->GetImageSize());
+            }
+            while (prefetched_end < tasks.size() &&
+                   prefetched_end < i + 1 + kMaxPrefetchedImages) {
+                FlashTask* next = tasks[prefetched_end]->AsFlashTask();
+                if (!next) {
+                    break;
+                }
+                int64_t size = next->GetImageSize();
+                if (prefetched_end > i + 1 && (size < 0 || budget_used + size > kPrefetchBudget)) {
+                    break;
+                }
+                next->Prepare();
+                budget_used += std::max<int64_t>(0, size);
+                prefetched_end++;
+            }
+        }
+
+        double start = now();
+        tasks[i]->Run();
+        if (on_task_done) {
+            on_task_done(tasks[i].get(), now() - start);
+        }
     }
-    return;
 }
 
 std::vector<std::unique_ptr<Task>> FlashAllTool::CollectTasks() {
@@ -1934,6 +2200,14 @@ unique_fd ZipImageSource::OpenFile(const std::string& name) const {
     return UnzipToFile(zip_, name.c_str());
 }
 
+int64_t ZipImageSource::GetFileSize(const std::string& name) const {
+    ZipEntry64 zip_entry;
+    if (FindEntry(zip_, name, &zip_entry) != 0) {
+        return -1;
+    }
+    return zip_entry.uncompressed_length;
+}
+
 static void do_update(const char* filename, FlashingPlan* fp) {
     ZipArchiveHandle zip;
     int error = OpenArchive(filename, &zip);
@@ -1960,6 +2234,15 @@ unique_fd LocalImageSource::OpenFile(const std::string& name) const {
     return unique_fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_BINARY)));
 }
 
+int64_t LocalImageSource::GetFileSize(const std::string& name) const {
+    auto path = find_item_given_name(name);
+    struct stat st;
+    if (path.empty() || stat(path.c_str(), &st) != 0) {
+        return -1;
+    }
+    return st.st_size;
+}
+
 static void do_flashall(FlashingPlan* fp) {
     fp->source.reset(new LocalImageSource());
     FlashAllTool tool(fp);
@@ -2078,7 +2361,7 @@ void fb_perform_format(const std::string& partition, int skip_if_not_supported,
         die("Cannot read image: %s", strerror(errno));
     }
 
-    flash_buf(fp->source.get(), partition, &buf, is_vbmeta_partition(partition));
+    flash_buf(fp, partition, &buf, is_vbmeta_partition(partition));
     return;
 
 failed:
@@ -2221,6 +2504,8 @@ int FastBootTool::Main(int argc, char* argv[]) {
 
     const struct option longopts[] = {{"base", required_argument, 0, 0},
                                       {"cmdline", required_argument, 0, 0},
+                                      {"compress", no_argument, 0, 0},
+                                      {"delta", no_argument, 0, 0},
                                       {"disable-verification", no_argument, 0, 0},
                                       {"disable-verity", no_argument, 0, 0},
                                       {"disable-super-optimization", no_argument, 0, 0},
@@ -2262,6 +2547,10 @@ int FastBootTool::Main(int argc, char* argv[]) {
                 g_cmdline = optarg;
             } else if (name == "disable-verification") {
                 g_disable_verification = true;
+            } else if (name == "compress") {
+                g_compress_downloads = true;
+            } else if (name == "delta") {
+                fp->delta_flash = true;
             } else if (name == "disable-verity") {
                 g_disable_verity = true;
             } else if (name == "disable-super-optimization") {
@@ -2382,6 +2671,8 @@ int FastBootTool::Main(int argc, char* argv[]) {
     };
 
     fastboot::FastBootDriver fastboot_driver(std::move(transport), driver_callbacks, false);
+    fastboot_driver.set_compress_downloads(g_compress_downloads);
+    fastboot_driver.set_compress_fetches(g_compress_downloads);
     fb = &fastboot_driver;
     fp->fb = &fastboot_driver;
 
@@ -28,6 +28,7 @@
 #pragma once
 
 #include <functional>
+#include <future>
 #include <memory>
 #include <string>
 #include "fastboot_driver_interface.h"
@@ -100,6 +101,8 @@ struct FlashingPlan {
     bool should_optimize_flash_super = true;
     bool should_use_fastboot_info = true;
     bool exclude_dynamic_partitions = false;
+    // Only send the parts of images that differ from the partition, see --delta.
+    bool delta_flash = false;
     uint64_t sparse_limit = 0;
 
     std::string slot_override;
@@ -138,6 +141,7 @@ class ZipImageSource final : public ImageSource {
     explicit ZipImageSource(ZipArchiveHandle zip) : zip_(zip) {}
     bool ReadFile(const std::string& name, std::vector<char>* out) const override;
     unique_fd OpenFile(const std::string& name) const override;
+    int64_t GetFileSize(const std::string& name) const override;
 
   private:
     ZipArchiveHandle zip_;
@@ -147,13 +151,22 @@ class LocalImageSource final : public ImageSource {
   public:
     bool ReadFile(const std::string& name, std::vector<char>* out) const override;
     unique_fd OpenFile(const std::string& name) const override;
+    int64_t GetFileSize(const std::string& name) const override;
 };
 
 char* get_android_product_out();
 bool should_flash_in_userspace(const ImageSource* source, const std::string& partition_name);
 bool is_userspace_fastboot();
 void do_flash(const char* pname, const char* fname, const bool apply_vbmeta,
-              const FlashingPlan* fp);
+              const FlashingPlan* fp, struct fastboot_buffer* prepared = nullptr);
+// Loads |fname| the way do_flash() does, on a background thread, so that it can
+// be prepared while the previous image is still being sent.
+std::future<std::unique_ptr<fastboot_buffer>> prepare_flash_buf(const std::string& fname,
+                                                                const FlashingPlan* fp);
+// Runs |tasks| in order, loading the next image while the current one is sent.
+// |on_task_done|, if set, is called after each task with its duration in seconds.
+void run_tasks(const std::vector<std::unique_ptr<Task>>& tasks,
+               const std::function<void(Task*, double)>& on_task_done = nullptr);
 void do_for_partitions(const std::string& part, const std::string& slot,
                        const std::function<void(const std::string&)>& func, bool force_slot);
 std::string find_item(const std::string& item);
@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Flashes a fastboot-info.txt task graph into a simulated device, to compare
+// changes to the task scheduler, the driver or the transport. The device sits
+// behind a link of a given bandwidth and latency and writes at a given speed.
+// It sleeps rather than keeping a virtual clock, so that host side work that
+// overlaps a transfer (see run_tasks()) shows up as such.
+//
+// Each task reports where its wall time went, in seconds per iteration:
+//   <task>/host_prep     host side work, e.g. loading and resparsing images
+//   <task>/transfer      sending download data over the link
+//   <task>/device_write  waiting for the device to write what it was sent
+//   <task>/idle          waiting on command round trips
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <sparse/sparse.h>
+#include <storage_literals/storage_literals.h>
+
+#include "constants.h"
+#include "fastboot.h"
+#include "fastboot_driver.h"
+#include "mock_transport.h"
+#include "task.h"
+
+using android::base::StringPrintf;
+using android::base::unique_fd;
+using namespace android::storage_literals;
+using Clock = std::chrono::steady_clock;
+using Seconds = std::chrono::duration<double>;
+
+extern fastboot::FastBootDriver* fb;
+
+namespace {
+
+constexpr uint64_t kMaxDownloadSize = 64_MiB;
+
+struct TimeBreakdown {
+    double host_prep = 0;
+    double transfer = 0;
+    double device_write = 0;
+    double idle = 0;
+
+    TimeBreakdown& operator+=(const TimeBreakdown& other) {
+        host_prep += other.host_prep;
+        transfer += other.transfer;
+        device_write += other.device_write;
+        idle += other.idle;
+        return *this;
+    }
+};
+
+struct LinkConfig {
+    double bandwidth;    // bytes per second
+    double latency;      // seconds per command round trip
+    double write_speed;  // bytes per second
+};
+
+struct PartitionInfo {
+    uint64_t size;
+    bool logical;
+};
+
+// A bootloader that answers just enough of the protocol to flash images, and
+// spends the time a real one would on the link and its storage.
+class SimulatedDevice {
+  public:
+    SimulatedDevice(const LinkConfig& link, const std::map<std::string, PartitionInfo>& partitions)
+        : link_(link), partitions_(partitions) {}
+
+    ssize_t Read(void* data, size_t len) {
+        if (responses_.empty()) {
+            return -1;
+        }
+        if (pending_write_ > 0) {
+            Wait(pending_write_, &time_.device_write);
+            pending_write_ = 0;
+        }
+        Wait(link_.latency, &time_.idle);
+
+        std::string response = std::move(responses_.front());
+        responses_.pop_front();
+        len = std::min(len, response.size());
+        memcpy(data, response.data(), len);
+        return len;
+    }
+
+    ssize_t Write(const void* data, size_t len) {
+        if (data_remaining_ > 0) {
+            if (len > data_remaining_) {
+                return -1;
+            }
+            Wait(len / link_.bandwidth, &time_.transfer);
+            data_remaining_ -= len;
+            if (data_remaining_ == 0) {
+                responses_.emplace_back("OKAY");
+            }
+            return len;
+        }
+        HandleCommand(std::string(static_cast<const char*>(data), len));
+        return len;
+    }
+
+    // Returns the time spent talking to the device since the last call.
+    TimeBreakdown TakeTime() { return std::exchange(time_, {}); }
+
+  private:
+    void HandleCommand(const std::string& cmd) {
+        std::string_view arg = cmd;
+        if (android::base::ConsumePrefix(&arg, FB_CMD_GETVAR ":")) {
+            responses_.emplace_back(GetVar(std::string(arg)));
+        } else if (android::base::ConsumePrefix(&arg, FB_CMD_DOWNLOAD ":")) {
+            uint64_t size;
+            if (!android::base::ParseUint("0x" + std::string(arg), &size) || size == 0 ||
+                size > kMaxDownloadSize) {
+                responses_.emplace_back("FAILbad download size");
+                return;
+            }
+            data_remaining_ = size;
+            downloaded_ = size;
+            responses_.emplace_back(StringPrintf("DATA%08" PRIx64, size));
+        } else if (android::base::ConsumePrefix(&arg, FB_CMD_FLASH ":")) {
+            pending_write_ = downloaded_ / link_.write_speed;
+            responses_.emplace_back("OKAY");
+        } else {
+            responses_.emplace_back("OKAY");
+        }
+    }
+
+    std::string GetVar(const std::string& var) {
+        std::string_view arg = var;
+        if (var == FB_VAR_MAX_DOWNLOAD_SIZE) {
+            return StringPrintf("OKAY0x%" PRIx64, kMaxDownloadSize);
+        } else if (var == FB_VAR_IS_USERSPACE) {
+            return "OKAYyes";
+        } else if (android::base::ConsumePrefix(&arg, FB_VAR_HAS_SLOT ":")) {
+            return "OKAYno";
+        } else if (android::base::ConsumePrefix(&arg, FB_VAR_IS_LOGICAL ":")) {
+            auto iter = partitions_.find(std::string(arg));
+            return iter != partitions_.end() && iter->second.logical ? "OKAYyes" : "OKAYno";
+        } else if (android::base::ConsumePrefix(&arg, FB_VAR_PARTITION_SIZE ":")) {
+            auto iter = partitions_.find(std::string(arg));
+            if (iter != partitions_.end()) {
+                return StringPrintf("OKAY0x%016" PRIx64, iter->second.size);
+            }
+        }
+        return "FAILunknown variable";
+    }
+
+    // The link is busy with one thing at a time, so pace against when it would
+    // be free rather than sleeping for |seconds| from now; sleep_until()
+    // overshooting then doesn't add up over many small writes.
+    void Wait(double seconds, double* bucket) {
+        auto start = Clock::now();
+        link_free_ = std::max(link_free_, start) +
+                     std::chrono::duration_cast<Clock::duration>(Seconds(seconds));
+        std::this_thread::sleep_until(link_free_);
+        *bucket += Seconds(Clock::now() - start).count();
+    }
+
+    const LinkConfig link_;
+    const std::map<std::string, PartitionInfo> partitions_;
+    std::deque<std::string> responses_;
+    uint64_t data_remaining_ = 0;
+    uint64_t downloaded_ = 0;
+    double pending_write_ = 0;
+    Clock::time_point link_free_;
+    TimeBreakdown time_;
+};
+
+class DirImageSource final : public ImageSource {
+  public:
+    explicit DirImageSource(const std::string& dir) : dir_(dir) {}
+
+    bool ReadFile(const std::string& name, std::vector<char>* out) const override {
+        std::string data;
+        if (!android::base::ReadFileToString(dir_ + "/" + name, &data)) {
+            return false;
+        }
+        out->assign(data.begin(), data.end());
+        return true;
+    }
+    unique_fd OpenFile(const std::string& name) const override {
+        return unique_fd(open((dir_ + "/" + name).c_str(), O_RDONLY | O_CLOEXEC));
+    }
+
+  private:
+    std::string dir_;
+};
+
+static std::vector<char> MakeData(size_t size, uint32_t seed) {
+    // Random enough that nothing along the way gets to compress it.
+    std::vector<char> data(size);
+    uint32_t x = seed | 1;
+    for (size_t i = 0; i + sizeof(x) <= size; i += sizeof(x)) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        memcpy(&data[i], &x, sizeof(x));
+    }
+    return data;
+}
+
+static bool WriteRawImage(const std::string& path, size_t size) {
+    auto data = MakeData(size, size);
+    return android::base::WriteStringToFile(std::string(data.data(), data.size()), path);
+}
+
+// A filesystem-like sparse image: |data_size| bytes of data spread over |size|
+// in 1MiB extents, each followed by a zero fill.
+static bool WriteSparseImage(const std::string& path, uint64_t size, size_t data_size) {
+    constexpr unsigned kBlockSize = 4096;
+    constexpr size_t kExtent = 1_MiB;
+    auto data = MakeData(data_size, size);
+
+    std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)> s(
+            sparse_file_new(kBlockSize, size), sparse_file_destroy);
+    if (!s) {
+        return false;
+    }
+    size_t extents = data_size / kExtent;
+    uint64_t stride = size / extents;
+    for (size_t i = 0; i < extents; i++) {
+        unsigned block = i * stride / kBlockSize;
+        if (sparse_file_add_data(s.get(), &data[i * kExtent], kExtent, block) ||
+            sparse_file_add_fill(s.get(), 0, kExtent, block + kExtent / kBlockSize)) {
+            return false;
+        }
+    }
+
+    unique_fd fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    return fd >= 0 && sparse_file_write(s.get(), fd.get(), false, true, false) == 0;
+}
+
+struct Images {
+    TemporaryDir dir;
+    std::map<std::string, PartitionInfo> partitions;
+    std::vector<std::string> fastboot_info;
+    uint64_t total_size = 0;
+    bool ok = true;
+};
+
+// A device build in miniature: a few raw images, and large sparse images for
+// the logical partitions, with system bigger than max-download-size so that
+// it gets resparsed.
+static const Images& GetImages() {
+    static Images* images = [] {
+        auto images = new Images;
+        images->fastboot_info.emplace_back("version 1");
+        auto add = [&](const std::string& name, uint64_t size, size_t data_size, bool logical) {
+            std::string path = images->dir.path + ("/" + name + ".img");
+            bool written = logical ? WriteSparseImage(path, size, data_size)
+                                   : WriteRawImage(path, size);
+            images->ok &= written;
+            images->partitions[name] = {size, logical};
+            images->fastboot_info.emplace_back("flash " + name);
+            images->total_size += data_size;
+        };
+        add("boot", 16_MiB, 16_MiB, false);
+        add("vendor_boot", 8_MiB, 8_MiB, false);
+        add("dtbo", 4_MiB, 4_MiB, false);
+        add("vbmeta", 64_KiB, 64_KiB, false);
+        add("system", 512_MiB, 96_MiB, true);
+        add("vendor", 128_MiB, 16_MiB, true);
+        return images;
+    }();
+    return *images;
+}
+
+static std::string TaskName(Task* task) {
+    if (FlashTask* flash_task = task->AsFlashTask()) {
+        return flash_task->GetPartition();
+    }
+    return task->ToString();
+}
+
+static void ReportTime(benchmark::State& state, const std::string& prefix,
+                       const TimeBreakdown& time) {
+    auto avg = [](double value) {
+        return benchmark::Counter(value, benchmark::Counter::kAvgIterations);
+    };
+    state.counters[prefix + "host_prep"] = avg(time.host_prep);
+    state.counters[prefix + "transfer"] = avg(time.transfer);
+    state.counters[prefix + "device_write"] = avg(time.device_write);
+    state.counters[prefix + "idle"] = avg(time.idle);
+}
+
+// Args: link bandwidth in MiB/s, round trip latency in us, device write speed in MiB/s.
+static void BM_FlashAll(benchmark::State& state) {
+    const Images& images = GetImages();
+    if (!images.ok) {
+        state.SkipWithError("could not create images");
+        return;
+    }
+
+    LinkConfig link = {
+            .bandwidth = static_cast<double>(state.range(0) * 1_MiB),
+            .latency = state.range(1) / 1e6,
+            .write_speed = static_cast<double>(state.range(2) * 1_MiB),
+    };
+    SimulatedDevice device(link, images.partitions);
+    auto transport = std::make_unique<testing::NiceMock<MockTransport>>();
+    ON_CALL(*transport, Read(testing::_, testing::_))
+            .WillByDefault(testing::Invoke(&device, &SimulatedDevice::Read));
+    ON_CALL(*transport, Write(testing::_, testing::_))
+            .WillByDefault(testing::Invoke(&device, &SimulatedDevice::Write));
+    fastboot::FastBootDriver driver(std::move(transport), {}, true);
+    fb = &driver;
+
+    FlashingPlan fp;
+    fp.source = std::make_unique<DirImageSource>(images.dir.path);
+    fp.fb = &driver;
+    auto tasks = ParseFastbootInfo(&fp, images.fastboot_info);
+    if (tasks.empty()) {
+        state.SkipWithError("could not parse fastboot-info.txt");
+        fb = nullptr;
+        return;
+    }
+
+    std::map<std::string, TimeBreakdown> task_times;
+    TimeBreakdown total;
+    for (auto _ : state) {
+        device.TakeTime();
+        run_tasks(tasks, [&](Task* task, double elapsed) {
+            TimeBreakdown time = device.TakeTime();
+            time.host_prep =
+                    std::max(0.0, elapsed - time.transfer - time.device_write - time.idle);
+            task_times[TaskName(task)] += time;
+            total += time;
+        });
+    }
+    fb = nullptr;
+
+    for (const auto& [name, time] : task_times) {
+        ReportTime(state, name + "/", time);
+    }
+    ReportTime(state, "", total);
+    state.SetBytesProcessed(state.iterations() * images.total_size);
+}
+
+}  // namespace
+
+BENCHMARK(BM_FlashAll)
+        ->ArgNames({"MiBps", "latency_us", "write_MiBps"})
+        // USB 2.0, bound by the link.
+        ->Args({40, 250, 200})
+        // USB 3.0, bound by the device's storage.
+        ->Args({350, 125, 150})
+        // USB 3.0 to fast storage, where host side work is most visible.
+        ->Args({350, 125, 1000})
+        // Networked device, bound by round trips.
+        ->Args({100, 2000, 200})
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -37,6 +37,7 @@
 #include <algorithm>
 #include <chrono>
 #include <fstream>
+#include <future>
 #include <memory>
 #include <regex>
 #include <vector>
@@ -47,6 +48,7 @@
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
+#include <lz4.h>
 #include <storage_literals/storage_literals.h>
 
 #include "constants.h"
@@ -57,6 +59,120 @@ using namespace android::storage_literals;
 
 namespace fastboot {
 
+namespace {
+
+constexpr uint32_t MAX_MAP_SIZE = 512 * 1024 * 1024;
+
+// See SparseWriteCallback().
+constexpr size_t SPARSE_DIRECT_SIZE = 64 * 1024;
+constexpr size_t SPARSE_COALESCE_SIZE = 1024 * 1024;
+
+// Turns a stream of data into the compressed download format described in
+// constants.h.
+class DownloadCompressor {
+  public:
+    void Write(const char* data, size_t len) {
+        if (!block_.empty()) {
+            size_t n = std::min(len, FB_COMPRESSED_BLOCK_SIZE - block_.size());
+            block_.insert(block_.end(), data, data + n);
+            data += n;
+            len -= n;
+            if (block_.size() < FB_COMPRESSED_BLOCK_SIZE) {
+                return;
+            }
+            CompressBlock(block_.data(), block_.size());
+            block_.clear();
+        }
+        while (len >= FB_COMPRESSED_BLOCK_SIZE) {
+            CompressBlock(data, FB_COMPRESSED_BLOCK_SIZE);
+            data += FB_COMPRESSED_BLOCK_SIZE;
+            len -= FB_COMPRESSED_BLOCK_SIZE;
+        }
+        block_.assign(data, data + len);
+    }
+
+    std::vector<char> Finish() {
+        if (!block_.empty()) {
+            CompressBlock(block_.data(), block_.size());
+            block_.clear();
+        }
+        return std::move(out_);
+    }
+
+  private:
+    void CompressBlock(const char* data, size_t len) {
+        constexpr size_t kHeaderSize = 2 * sizeof(uint32_t);
+        size_t offset = out_.size();
+        int bound = LZ4_compressBound(len);
+        out_.resize(offset + kHeaderSize + bound);
+        // Cannot fail, the output buffer is large enough for any input.
+        int compressed_len = LZ4_compress_default(data, out_.data() + offset + kHeaderSize, len,
+                                                  bound);
+        out_.resize(offset + kHeaderSize + compressed_len);
+
+        uint32_t header[2] = {htole32(static_cast<uint32_t>(len)),
+                              htole32(static_cast<uint32_t>(compressed_len))};
+        memcpy(out_.data() + offset, header, sizeof(header));
+    }
+
+    std::vector<char> block_;
+    std::vector<char> out_;
+};
+
+// Decodes the compressed format described in constants.h as it arrives.
+class FetchDecompressor {
+  public:
+    template <typename WriteFn>
+    RetCode Write(const char* data, size_t len, const WriteFn& write_fn, std::string* error) {
+        constexpr size_t kHeaderSize = 2 * sizeof(uint32_t);
+        const size_t max_compressed = LZ4_compressBound(FB_COMPRESSED_BLOCK_SIZE);
+
+        pending_.insert(pending_.end(), data, data + len);
+        size_t pos = 0;
+        while (pending_.size() - pos >= kHeaderSize) {
+            uint32_t raw_len, compressed_len;
+            memcpy(&raw_len, pending_.data() + pos, sizeof(raw_len));
+            memcpy(&compressed_len, pending_.data() + pos + sizeof(raw_len),
+                   sizeof(compressed_len));
+            raw_len = le32toh(raw_len);
+            compressed_len = le32toh(compressed_len);
+            if (raw_len > FB_COMPRESSED_BLOCK_SIZE || compressed_len > max_compressed) {
+                *error = "Invalid compressed block from device";
+                return BAD_DEV_RESP;
+            }
+            if (pending_.size() - pos - kHeaderSize < compressed_len) {
+                break;
+            }
+            int ret = LZ4_decompress_safe(pending_.data() + pos + kHeaderSize, block_.data(),
+                                          compressed_len, raw_len);
+            if (ret != static_cast<int>(raw_len)) {
+                *error = "Failed to decompress data from device";
+                return BAD_DEV_RESP;
+            }
+            if (RetCode rc = write_fn(block_.data(), raw_len); rc != SUCCESS) {
+                return rc;
+            }
+            pos += kHeaderSize + compressed_len;
+        }
+        pending_.erase(pending_.begin(), pending_.begin() + pos);
+        return SUCCESS;
+    }
+
+    bool Finish(std::string* error) {
+        if (!pending_.empty()) {
+            *error = "Truncated compressed data from device";
+            return false;
+        }
+        return true;
+    }
+
+  private:
+    std::vector<char> pending_;
+    std::vector<char> block_ = std::vector<char>(FB_COMPRESSED_BLOCK_SIZE);
+};
+
+}  // namespace
+
 /*************************** PUBLIC *******************************/
 FastBootDriver::FastBootDriver(std::unique_ptr<Transport> transport,
                                DriverCallbacks driver_callbacks,
@@ -204,6 +320,24 @@ RetCode FastBootDriver::Download(android::base::borrowed_fd fd, size_t size, std
     }
 
     uint32_t u32size = static_cast<uint32_t>(size);
+    if (CanCompressDownloads()) {
+        DownloadCompressor compressor;
+        for (uint64_t offset = 0; offset < size; offset += MAX_MAP_SIZE) {
+            size_t len = std::min<uint64_t>(size - offset, MAX_MAP_SIZE);
+            auto mapping{android::base::MappedFile::FromFd(fd, offset, len, PROT_READ)};
+            if (!mapping) {
+                error_ = "Creating filemap failed";
+                return IO_ERROR;
+            }
+            compressor.Write(mapping->data(), mapping->size());
+        }
+        std::vector<char> compressed = compressor.Finish();
+        // Not worth it for data that doesn't compress; send it as is.
+        if (compressed.size() < size) {
+            return DownloadCompressed(u32size, compressed, response, info);
+        }
+    }
+
     if ((ret = DownloadCommand(u32size, response, info))) {
         return ret;
     }
@@ -268,6 +402,22 @@ RetCode FastBootDriver::Download(sparse_file* s, bool use_crc, std::string* resp
 
     RetCode ret;
     uint32_t u32size = static_cast<uint32_t>(size);
+    if (CanCompressDownloads()) {
+        DownloadCompressor compressor;
+        auto compress_cb = [](void* priv, const void* buf, size_t len) -> int {
+            static_cast<DownloadCompressor*>(priv)->Write(static_cast<const char*>(buf), len);
+            return 0;
+        };
+        if (sparse_file_callback(s, true, use_crc, compress_cb, &compressor) < 0) {
+            error_ = "Error reading sparse file";
+            return IO_ERROR;
+        }
+        std::vector<char> compressed = compressor.Finish();
+        if (compressed.size() < u32size) {
+            return DownloadCompressed(u32size, compressed, response, info);
+        }
+    }
+
     if ((ret = DownloadCommand(u32size, response, info))) {
         return ret;
     }
@@ -277,6 +427,7 @@ RetCode FastBootDriver::Download(sparse_file* s, bool use_crc, std::string* resp
         std::vector<char> tpbuf;
     } cb_priv;
     cb_priv.self = this;
+    cb_priv.tpbuf.reserve(SPARSE_COALESCE_SIZE + SPARSE_DIRECT_SIZE);
 
     auto cb = [](void* priv, const void* buf, size_t len) -> int {
         SparseCBPrivate* data = static_cast<SparseCBPrivate*>(priv);
@@ -324,20 +475,46 @@ RetCode FastBootDriver::RunAndReadBuffer(
         return BAD_DEV_RESP;
     }
 
+    // The next piece is read from the transport on another thread while
+    // write_fn() handles the current one. Only the transport is used there;
+    // errors are turned into error_ here.
+    struct ReadResult {
+        ssize_t size;
+        int error;
+    };
+    auto read = [this](char* data, size_t size) {
+        ssize_t n = transport_->Read(data, size);
+        return ReadResult{n, errno};
+    };
     const uint64_t total_size = dsize;
     const uint64_t buf_size = std::min<uint64_t>(total_size, 1_MiB);
-    std::vector<char> data(buf_size);
+    std::vector<char> bufs[2] = {std::vector<char>(buf_size), std::vector<char>(buf_size)};
     uint64_t current_offset = 0;
-    while (current_offset < total_size) {
-        uint64_t remaining = total_size - current_offset;
-        uint64_t chunk_size = std::min(buf_size, remaining);
-        if ((ret = ReadBuffer(data.data(), chunk_size)) != SUCCESS) {
-            return ret;
+    uint64_t chunk_size = buf_size;
+    std::future<ReadResult> pending =
+            std::async(std::launch::async, read, bufs[0].data(), chunk_size);
+    for (size_t i = 0; current_offset < total_size; i++) {
+        ReadResult result = pending.get();
+        if (result.size < 0) {
+            errno = result.error;
+            error_ = ErrnoStr("Read from device failed in ReadBuffer()");
+            return IO_ERROR;
+        } else if (static_cast<uint64_t>(result.size) != chunk_size) {
+            error_ = android::base::StringPrintf("Failed to read all %" PRIu64 " bytes",
+                                                 chunk_size);
+            return IO_ERROR;
         }
-        if ((ret = write_fn(data.data(), chunk_size)) != SUCCESS) {
+        uint64_t next_offset = current_offset + chunk_size;
+        uint64_t next_size = std::min(buf_size, total_size - next_offset);
+        if (next_size > 0) {
+            pending = std::async(std::launch::async, read, bufs[(i + 1) % 2].data(), next_size);
+        }
+        if ((ret = write_fn(bufs[i % 2].data(), chunk_size)) != SUCCESS) {
+            if (pending.valid()) pending.wait();
             return ret;
         }
-        current_offset += chunk_size;
+        current_offset = next_offset;
+        chunk_size = next_size;
     }
     return HandleResponse(response, info);
 }
@@ -368,20 +545,54 @@ RetCode FastBootDriver::FetchToFd(const std::string& partition, android::base::b
                                   std::vector<std::string>* info) {
     prolog_(android::base::StringPrintf("Fetching %s (offset=%" PRIx64 ", size=%" PRIx64 ")",
                                         partition.c_str(), offset, size));
-    std::string cmd = FB_CMD_FETCH ":" + partition;
+    const bool compressed = CanCompressFetches();
+    std::string cmd = compressed ? FB_CMD_FETCH_COMPRESSED ":" FB_COMPRESSION_LZ4 ":" + partition
+                                 : FB_CMD_FETCH ":" + partition;
     if (offset >= 0) {
         cmd += android::base::StringPrintf(":0x%08" PRIx64, offset);
         if (size >= 0) {
             cmd += android::base::StringPrintf(":0x%08" PRIx64, size);
         }
     }
-    RetCode ret = RunAndReadBuffer(cmd, response, info, [&](const char* data, uint64_t size) {
+    auto write = [&](const char* data, uint64_t size) {
         if (!android::base::WriteFully(fd, data, size)) {
             error_ = android::base::StringPrintf("Cannot write: %s", strerror(errno));
             return IO_ERROR;
         }
         return SUCCESS;
+    };
+    RetCode ret;
+    if (compressed) {
+        FetchDecompressor decompressor;
+        ret = RunAndReadBuffer(cmd, response, info, [&](const char* data, uint64_t size) {
+            return decompressor.Write(data, size, write, &error_);
+        });
+        if (ret == SUCCESS && !decompressor.Finish(&error_)) {
+            ret = BAD_DEV_RESP;
+        }
+    } else {
+        ret = RunAndReadBuffer(cmd, response, info, write);
+    }
+    epilog_(ret);
+    return ret;
+}
+
+RetCode FastBootDriver::PartitionDigest(const std::string& partition, uint32_t block_size,
+                                        uint64_t size, std::vector<char>* digests,
+                                        std::string* response, std::vector<std::string>* info) {
+    std::string cmd = android::base::StringPrintf(FB_CMD_PARTITION_DIGEST ":%s:0x%08x:0x%08" PRIx64,
+                                                  partition.c_str(), block_size, size);
+    prolog_(android::base::StringPrintf("Reading digests of '%s'", partition.c_str()));
+    digests->clear();
+    RetCode ret = RunAndReadBuffer(cmd, response, info, [&](const char* data, uint64_t len) {
+        digests->insert(digests->end(), data, data + len);
+        return SUCCESS;
     });
+    if (ret == SUCCESS && digests->size() % FB_DIGEST_SIZE != 0) {
+        error_ = android::base::StringPrintf("%s returned %zu bytes", cmd.c_str(),
+                                             digests->size());
+        ret = BAD_DEV_RESP;
+    }
     epilog_(ret);
     return ret;
 }
@@ -421,6 +632,8 @@ std::string FastBootDriver::Error() {
 }
 
 RetCode FastBootDriver::WaitForDisconnect() {
+    device_compression_.reset();
+    device_fetch_compression_.reset();
     return transport_->WaitForDisconnect() ? IO_ERROR : SUCCESS;
 }
 
@@ -461,6 +674,24 @@ RetCode FastBootDriver::DownloadCommand(uint32_t size, std::string* response,
     return SUCCESS;
 }
 
+RetCode FastBootDriver::DownloadCompressed(uint32_t size, const std::vector<char>& data,
+                                           std::string* response,
+                                           std::vector<std::string>* info) {
+    std::string cmd(android::base::StringPrintf("%s:%s:%08" PRIx32 ":%08zx",
+                                                FB_CMD_DOWNLOAD_COMPRESSED, FB_COMPRESSION_LZ4,
+                                                size, data.size()));
+    RetCode ret;
+    if ((ret = RawCommand(cmd, response, info))) {
+        return ret;
+    }
+
+    if ((ret = SendBuffer(data))) {
+        return ret;
+    }
+
+    return HandleResponse(response, info);
+}
+
 RetCode FastBootDriver::HandleResponse(std::string* response, std::vector<std::string>* info,
                                        int* dsize) {
     char status[FB_RESPONSE_SZ + 1];
@@ -530,7 +761,6 @@ std::string FastBootDriver::ErrnoStr(const std::string& msg) {
 
 /******************************* PRIVATE **************************************/
 RetCode FastBootDriver::SendBuffer(android::base::borrowed_fd fd, size_t size) {
-    static constexpr uint32_t MAX_MAP_SIZE = 512 * 1024 * 1024;
     off64_t offset = 0;
     uint32_t remaining = size;
     RetCode ret;
@@ -595,22 +825,37 @@ RetCode FastBootDriver::ReadBuffer(void* buf, size_t size) {
     return SUCCESS;
 }
 
+// Every write but the last one is a multiple of TRANSPORT_CHUNK_SIZE. Pieces
+// smaller than SPARSE_DIRECT_SIZE, which are mostly chunk headers and fill
+// values, are gathered in |tpbuf| and go out together once there are
+// SPARSE_COALESCE_SIZE bytes. Larger pieces are sent straight from the
+// caller's buffer, after topping |tpbuf| up to a chunk boundary with their
+// first bytes.
 int FastBootDriver::SparseWriteCallback(std::vector<char>& tpbuf, const char* data, size_t len) {
-    size_t total = 0;
-    size_t to_write = std::min(TRANSPORT_CHUNK_SIZE - tpbuf.size(), len);
-
-    // Handle the residual
-    tpbuf.insert(tpbuf.end(), data, data + to_write);
-    if (tpbuf.size() < TRANSPORT_CHUNK_SIZE) {  // Nothing enough to send rn
+    if (len < SPARSE_DIRECT_SIZE) {
+        tpbuf.insert(tpbuf.end(), data, data + len);
+        if (tpbuf.size() < SPARSE_COALESCE_SIZE) {
+            return 0;
+        }
+        size_t nbytes = tpbuf.size() - tpbuf.size() % TRANSPORT_CHUNK_SIZE;
+        if (SendBuffer(tpbuf.data(), nbytes)) {
+            error_ = ErrnoStr("Send failed in SparseWriteCallback()");
+            return -1;
+        }
+        tpbuf.erase(tpbuf.begin(), tpbuf.begin() + nbytes);
         return 0;
     }
 
-    if (SendBuffer(tpbuf)) {
-        error_ = ErrnoStr("Send failed in SparseWriteCallback()");
-        return -1;
+    size_t total = 0;
+    if (!tpbuf.empty()) {
+        total = (TRANSPORT_CHUNK_SIZE - tpbuf.size() % TRANSPORT_CHUNK_SIZE) % TRANSPORT_CHUNK_SIZE;
+        tpbuf.insert(tpbuf.end(), data, data + total);
+        if (SendBuffer(tpbuf)) {
+            error_ = ErrnoStr("Send failed in SparseWriteCallback()");
+            return -1;
+        }
+        tpbuf.clear();
     }
-    tpbuf.clear();
-    total += to_write;
 
     // Now we need to send a multiple of chunk size
     size_t nchunks = (len - total) / TRANSPORT_CHUNK_SIZE;
@@ -628,8 +873,46 @@ int FastBootDriver::SparseWriteCallback(std::vector<char>& tpbuf, const char* da
     return 0;
 }
 
+bool FastBootDriver::CanCompressDownloads() {
+    if (!compress_downloads_) {
+        return false;
+    }
+    if (!device_compression_) {
+        std::string value;
+        device_compression_ = false;
+        if (GetVar(FB_VAR_DOWNLOAD_COMPRESSION, &value) == SUCCESS) {
+            auto algorithms = android::base::Split(value, ",");
+            device_compression_ = std::find(algorithms.begin(), algorithms.end(),
+                                            FB_COMPRESSION_LZ4) != algorithms.end();
+        }
+        // Devices that don't know the variable simply fail it.
+        error_ = "";
+    }
+    return *device_compression_;
+}
+
+bool FastBootDriver::CanCompressFetches() {
+    if (!compress_fetches_) {
+        return false;
+    }
+    if (!device_fetch_compression_) {
+        std::string value;
+        device_fetch_compression_ = false;
+        if (GetVar(FB_VAR_FETCH_COMPRESSION, &value) == SUCCESS) {
+            auto algorithms = android::base::Split(value, ",");
+            device_fetch_compression_ = std::find(algorithms.begin(), algorithms.end(),
+                                                  FB_COMPRESSION_LZ4) != algorithms.end();
+        }
+        error_ = "";
+    }
+    return *device_fetch_compression_;
+}
+
 void FastBootDriver::set_transport(std::unique_ptr<Transport> transport) {
     transport_ = std::move(transport);
+    // This may well be a different device, or the same one in another mode.
+    device_compression_.reset();
+    device_fetch_compression_.reset();
 }
 
 }  // End namespace fastboot
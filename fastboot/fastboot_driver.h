@@ -30,6 +30,7 @@
 #include <functional>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -104,6 +105,11 @@ class FastBootDriver : public IFastBootDriver {
     RetCode FetchToFd(const std::string& partition, android::base::borrowed_fd fd,
                       int64_t offset = -1, int64_t size = -1, std::string* response = nullptr,
                       std::vector<std::string>* info = nullptr) override;
+    // Reads one FB_DIGEST_SIZE digest for every |block_size| bytes of the first
+    // |size| bytes of |partition| into |digests|.
+    RetCode PartitionDigest(const std::string& partition, uint32_t block_size, uint64_t size,
+                            std::vector<char>* digests, std::string* response = nullptr,
+                            std::vector<std::string>* info = nullptr);
 
     /* HIGHER LEVEL COMMANDS -- Composed of the commands above */
     RetCode FlashPartition(const std::string& partition, const std::vector<char>& data);
@@ -123,6 +129,10 @@ class FastBootDriver : public IFastBootDriver {
     RetCode WaitForDisconnect() override;
 
     void set_transport(std::unique_ptr<Transport> transport);
+    // Compress fd and sparse downloads on the wire when the device supports it.
+    void set_compress_downloads(bool compress) { compress_downloads_ = compress; }
+    // Have the device compress fetched data when it supports it.
+    void set_compress_fetches(bool compress) { compress_fetches_ = compress; }
 
     RetCode RawCommand(const std::string& cmd, const std::string& message,
                        std::string* response = nullptr, std::vector<std::string>* info = nullptr,
@@ -136,6 +146,9 @@ class FastBootDriver : public IFastBootDriver {
                             std::vector<std::string>* info = nullptr);
     RetCode HandleResponse(std::string* response = nullptr,
                            std::vector<std::string>* info = nullptr, int* dsize = nullptr);
+    RetCode DownloadCompressed(uint32_t size, const std::vector<char>& data,
+                               std::string* response = nullptr,
+                               std::vector<std::string>* info = nullptr);
 
     std::string ErrnoStr(const std::string& msg);
 
@@ -155,6 +168,8 @@ class FastBootDriver : public IFastBootDriver {
                              const std::function<RetCode(const char*, uint64_t)>& write_fn);
 
     int SparseWriteCallback(std::vector<char>& tpbuf, const char* data, size_t len);
+    bool CanCompressDownloads();
+    bool CanCompressFetches();
 
     std::string error_;
     std::function<void(const std::string&)> prolog_;
@@ -162,6 +177,12 @@ class FastBootDriver : public IFastBootDriver {
     std::function<void(const std::string&)> info_;
     std::function<void(const std::string&)> text_;
     bool disable_checks_;
+    bool compress_downloads_ = false;
+    // Whether the device takes compressed downloads, once asked.
+    std::optional<bool> device_compression_;
+    bool compress_fetches_ = false;
+    // Whether the device compresses fetched data, once asked.
+    std::optional<bool> device_fetch_compression_;
 };
 
 }  // namespace fastboot
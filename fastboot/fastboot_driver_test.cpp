@@ -19,7 +19,12 @@
 #include <memory>
 #include <optional>
 
+#include <android-base/endian.h>
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <gtest/gtest.h>
+#include <lz4.h>
+#include <sparse/sparse.h>
 #include "mock_transport.h"
 
 using namespace ::testing;
@@ -97,3 +102,165 @@ TEST_F(DriverTest, TextMessage) {
               " Indeed we can do that now with a TEXT message whenever we feel like it."
               " Isn't that truly super cool?");
 }
+
+TEST_F(DriverTest, CompressedDownload) {
+    std::unique_ptr<MockTransport> transport_pointer = std::make_unique<MockTransport>();
+    MockTransport* transport = transport_pointer.get();
+    FastBootDriver driver(std::move(transport_pointer));
+    driver.set_compress_downloads(true);
+
+    std::string data;
+    for (int i = 0; data.size() < 256 * 1024; i++) {
+        data += "block " + std::to_string(i % 16) + "\n";
+    }
+    TemporaryFile tf;
+    ASSERT_TRUE(android::base::WriteStringToFd(data, tf.fd));
+
+    std::string compressed(LZ4_compressBound(data.size()), '\0');
+    int compressed_len = LZ4_compress_default(data.data(), compressed.data(), data.size(),
+                                              compressed.size());
+    ASSERT_GT(compressed_len, 0);
+    compressed.resize(compressed_len);
+    uint32_t header[2] = {htole32(static_cast<uint32_t>(data.size())),
+                          htole32(static_cast<uint32_t>(compressed_len))};
+    std::string wire = std::string(reinterpret_cast<char*>(header), sizeof(header)) + compressed;
+
+    std::string command = android::base::StringPrintf("download-compressed:lz4:%08zx:%08zx",
+                                                      data.size(), wire.size());
+    std::string reply = android::base::StringPrintf("DATA%08zx", wire.size());
+
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("getvar:download-compression")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAYlz4")));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData(command.c_str())))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData(reply.c_str())));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData(std::string_view(wire))))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAY")));
+
+    ASSERT_EQ(driver.Download(tf.fd, data.size()), SUCCESS) << driver.Error();
+}
+
+TEST_F(DriverTest, CompressedDownloadUnsupported) {
+    std::unique_ptr<MockTransport> transport_pointer = std::make_unique<MockTransport>();
+    MockTransport* transport = transport_pointer.get();
+    FastBootDriver driver(std::move(transport_pointer));
+    driver.set_compress_downloads(true);
+
+    std::string data(64 * 1024, 'x');
+    TemporaryFile tf;
+    ASSERT_TRUE(android::base::WriteStringToFd(data, tf.fd));
+
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("getvar:download-compression")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("FAILUnknown variable")));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("download:00010000")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("DATA00010000")));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData(std::string_view(data))))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAY")));
+
+    ASSERT_EQ(driver.Download(tf.fd, data.size()), SUCCESS) << driver.Error();
+}
+
+TEST_F(DriverTest, PartitionDigest) {
+    std::unique_ptr<MockTransport> transport_pointer = std::make_unique<MockTransport>();
+    MockTransport* transport = transport_pointer.get();
+    FastBootDriver driver(std::move(transport_pointer));
+
+    const std::string digests = std::string(32, 'a') + std::string(32, 'b');
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("partition-digest:system:0x00010000:0x00020000")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("DATA00000040")));
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData(digests.c_str())));
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAY")));
+
+    std::vector<char> output;
+    ASSERT_EQ(driver.PartitionDigest("system", 0x10000, 0x20000, &output), SUCCESS)
+            << driver.Error();
+    ASSERT_EQ(std::string(output.begin(), output.end()), digests);
+}
+
+TEST_F(DriverTest, SparseDownloadCoalescesSmallChunks) {
+    std::unique_ptr<MockTransport> transport_pointer = std::make_unique<MockTransport>();
+    MockTransport* transport = transport_pointer.get();
+    FastBootDriver driver(std::move(transport_pointer));
+
+    // Alternating fill and data chunks, all small enough to be sent in one go.
+    constexpr unsigned int kBlockSize = 4096;
+    std::unique_ptr<sparse_file, decltype(&sparse_file_destroy)> s(
+            sparse_file_new(kBlockSize, 16 * kBlockSize), sparse_file_destroy);
+    ASSERT_NE(s, nullptr);
+    std::string block(kBlockSize, 'x');
+    for (unsigned int i = 0; i < 16; i += 2) {
+        ASSERT_EQ(sparse_file_add_fill(s.get(), 0xdeadbeef, kBlockSize, i), 0);
+        ASSERT_EQ(sparse_file_add_data(s.get(), block.data(), kBlockSize, i + 1), 0);
+    }
+    std::string image;
+    auto append = [](void* priv, const void* data, size_t len) -> int {
+        static_cast<std::string*>(priv)->append(static_cast<const char*>(data), len);
+        return 0;
+    };
+    ASSERT_EQ(sparse_file_callback(s.get(), true, false, append, &image), 0);
+
+    std::string command = android::base::StringPrintf("download:%08zx", image.size());
+    std::string reply = android::base::StringPrintf("DATA%08zx", image.size());
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData(command.c_str())))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData(reply.c_str())));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData(std::string_view(image))))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAY")));
+
+    ASSERT_EQ(driver.Download(s.get()), SUCCESS) << driver.Error();
+}
+
+TEST_F(DriverTest, CompressedFetch) {
+    std::unique_ptr<MockTransport> transport_pointer = std::make_unique<MockTransport>();
+    MockTransport* transport = transport_pointer.get();
+    FastBootDriver driver(std::move(transport_pointer));
+    driver.set_compress_fetches(true);
+
+    std::string data(64 * 1024, 'y');
+    std::string compressed(LZ4_compressBound(data.size()), '\0');
+    int compressed_len = LZ4_compress_default(data.data(), compressed.data(), data.size(),
+                                              compressed.size());
+    ASSERT_GT(compressed_len, 0);
+    compressed.resize(compressed_len);
+    uint32_t header[2] = {htole32(static_cast<uint32_t>(data.size())),
+                          htole32(static_cast<uint32_t>(compressed_len))};
+    std::string wire = std::string(reinterpret_cast<char*>(header), sizeof(header)) + compressed;
+    std::string reply = android::base::StringPrintf("DATA%08zx", wire.size());
+
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("getvar:fetch-compression")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAYlz4")));
+    EXPECT_CALL(*transport, Write(_, _))
+            .With(AllArgs(RawData("fetch-compressed:lz4:vendor_boot:0x00000000:0x00010000")))
+            .WillOnce(ReturnArg<1>());
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData(reply.c_str())));
+    EXPECT_CALL(*transport, Read(_, wire.size()))
+            .WillOnce(Invoke([&wire](void* buffer, size_t size) -> ssize_t {
+                memcpy(buffer, wire.data(), size);
+                return size;
+            }));
+    EXPECT_CALL(*transport, Read(_, _)).WillOnce(Invoke(CopyData("OKAY")));
+
+    TemporaryFile tf;
+    ASSERT_EQ(driver.FetchToFd("vendor_boot", tf.fd, 0, data.size()), SUCCESS) << driver.Error();
+    std::string fetched;
+    ASSERT_TRUE(android::base::ReadFileToString(tf.path, &fetched));
+    ASSERT_EQ(fetched, data);
+}
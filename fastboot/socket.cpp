@@ -72,6 +72,11 @@ ssize_t Socket::ReceiveAll(void* data, size_t length, int timeout_ms) {
     return total;
 }
 
+bool Socket::SetReceiveBufferSize(int size) {
+    return setsockopt(sock_, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&size),
+                      sizeof(size)) == 0;
+}
+
 int Socket::GetLocalPort() {
     return socket_get_local_port(sock_);
 }
@@ -178,6 +183,7 @@ class TcpSocket : public Socket {
     bool Send(const void* data, size_t length) override;
     bool Send(std::vector<cutils_socket_buffer_t> buffers) override;
     ssize_t Receive(void* data, size_t length, int timeout_ms) override;
+    ssize_t ReceiveAll(void* data, size_t length, int timeout_ms) override;
 
     std::unique_ptr<Socket> Accept() override;
 
@@ -241,6 +247,30 @@ ssize_t TcpSocket::Receive(void* data, size_t length, int timeout_ms) {
     return TEMP_FAILURE_RETRY(recv(sock_, reinterpret_cast<char*>(data), length, 0));
 }
 
+ssize_t TcpSocket::ReceiveAll(void* data, size_t length, int timeout_ms) {
+    // Without a timeout let the kernel fill the whole buffer, rather than waking up for every
+    // segment that arrives.
+    if (timeout_ms > 0) {
+        return Socket::ReceiveAll(data, length, timeout_ms);
+    }
+    receive_timed_out_ = false;
+
+    size_t total = 0;
+    while (total < length) {
+        ssize_t bytes = TEMP_FAILURE_RETRY(
+                recv(sock_, reinterpret_cast<char*>(data) + total, length - total, MSG_WAITALL));
+        if (bytes <= 0) {
+            if (total == 0) {
+                return -1;
+            }
+            break;
+        }
+        total += bytes;
+    }
+
+    return total;
+}
+
 std::unique_ptr<Socket> TcpSocket::Accept() {
     cutils_socket_t handler = accept(sock_, nullptr, nullptr);
     if (handler == INVALID_SOCKET) {
@@ -87,6 +87,11 @@ class Socket {
     // Calls Receive() until exactly |length| bytes have been received or an error occurs.
     virtual ssize_t ReceiveAll(void* data, size_t length, int timeout_ms);
 
+    // Asks the kernel for a |size| byte receive buffer. For TCP this must happen before the
+    // connection is established for the larger window to be advertised; accepted sockets inherit
+    // the size of the listening socket. Returns true on success.
+    bool SetReceiveBufferSize(int size);
+
     // Returns true if the last Receive() call timed out normally and can be retried; fatal errors
     // or successful reads will return false.
     bool ReceiveTimedOut() { return receive_timed_out_; }
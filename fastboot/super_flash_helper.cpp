@@ -70,21 +70,53 @@ bool SuperFlashHelper::AddPartition(const std::string& partition, const std::str
     return true;
 }
 
-SparsePtr SuperFlashHelper::GetSparseLayout() {
-    // Cache extents since the sparse ptr depends on data pointers.
-    if (extents_.empty()) {
-        extents_ = builder_.GetImageLayout();
-        if (extents_.empty()) {
+bool SuperFlashHelper::CacheLayouts() {
+    // Cache extents since the sparse ptrs depend on data pointers.
+    if (layouts_.empty()) {
+        layouts_ = builder_.GetBlockDeviceLayouts();
+        if (layouts_.empty() || layouts_[0].empty()) {
             LOG(VERBOSE) << "device does not support optimized super flashing";
-            return {nullptr, nullptr};
+            layouts_.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+SparsePtr SuperFlashHelper::GetSparseLayout() {
+    if (!CacheLayouts()) {
+        return {nullptr, nullptr};
+    }
+    return BuildSparseLayout(layouts_[0]);
+}
+
+std::vector<std::pair<std::string, SparsePtr>> SuperFlashHelper::GetSparseLayouts() {
+    if (!CacheLayouts()) {
+        return {};
+    }
+
+    std::vector<std::pair<std::string, SparsePtr>> files;
+    for (size_t i = 0; i < layouts_.size(); i++) {
+        if (layouts_[i].empty()) {
+            continue;
         }
+        SparsePtr s = BuildSparseLayout(layouts_[i]);
+        if (!s) {
+            return {};
+        }
+        auto partition =
+                android::fs_mgr::GetBlockDevicePartitionName(base_metadata_->block_devices[i]);
+        files.emplace_back(std::move(partition), std::move(s));
     }
+    return files;
+}
 
+SparsePtr SuperFlashHelper::BuildSparseLayout(const std::vector<SuperImageExtent>& extents) {
     unsigned int block_size = base_metadata_->geometry.logical_block_size;
-    int64_t flashed_size = extents_.back().offset + extents_.back().size;
+    int64_t flashed_size = extents.back().offset + extents.back().size;
     SparsePtr s(sparse_file_new(block_size, flashed_size), sparse_file_destroy);
 
-    for (const auto& extent : extents_) {
+    for (const auto& extent : extents) {
         if (extent.offset / block_size > UINT_MAX) {
             // Super image is too big to send via sparse files (>8TB).
             LOG(VERBOSE) << "super image is too big to flash";
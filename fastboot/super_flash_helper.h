@@ -20,6 +20,8 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 #include <liblp/liblp.h>
@@ -39,15 +41,23 @@ class SuperFlashHelper final {
     // it depends on open fds and data pointers.
     SparsePtr GetSparseLayout();
 
+    // Like GetSparseLayout(), but one layout for each block device of super that
+    // has something to write, along with the name of the partition backing it.
+    // The first one is for super itself. Empty on failure.
+    std::vector<std::pair<std::string, SparsePtr>> GetSparseLayouts();
+
     bool WillFlash(const std::string& partition) const {
         return will_flash_.find(partition) != will_flash_.end();
     }
 
   private:
+    SparsePtr BuildSparseLayout(const std::vector<android::fs_mgr::SuperImageExtent>& extents);
+    bool CacheLayouts();
+
     const ImageSource& source_;
     android::fs_mgr::SuperLayoutBuilder builder_;
     std::unique_ptr<android::fs_mgr::LpMetadata> base_metadata_;
-    std::vector<android::fs_mgr::SuperImageExtent> extents_;
+    std::vector<std::vector<android::fs_mgr::SuperImageExtent>> layouts_;
 
     // Cache open image fds. This keeps them alive while we flash the sparse
     // file.
@@ -86,3 +86,25 @@ TEST(SuperFlashHelper, ImageEquality) {
         ASSERT_EQ(expected[i], 0) << "byte mismatch at position " << i;
     }
 }
+
+TEST(SuperFlashHelper, BlockDeviceLayouts) {
+    auto super_empty_fd = OpenTestFile("super_empty.img", O_RDONLY);
+    ASSERT_GE(super_empty_fd, 0);
+
+    TestImageSource source;
+    SuperFlashHelper helper(source);
+    ASSERT_TRUE(helper.Open(super_empty_fd));
+    ASSERT_TRUE(helper.AddPartition("system_a", "system.img", false));
+
+    // super_empty.img only has one block device, so this is the same as
+    // GetSparseLayout().
+    auto layouts = helper.GetSparseLayouts();
+    ASSERT_EQ(layouts.size(), 1);
+    EXPECT_EQ(layouts[0].first, "super");
+    ASSERT_NE(layouts[0].second, nullptr);
+
+    auto sparse_file = helper.GetSparseLayout();
+    ASSERT_NE(sparse_file, nullptr);
+    EXPECT_EQ(sparse_file_len(layouts[0].second.get(), false, false),
+              sparse_file_len(sparse_file.get(), false, false));
+}
@@ -39,7 +39,25 @@ bool FlashTask::IsDynamicPartition(const ImageSource* source, const FlashTask* t
     return should_flash_in_userspace(*metadata.get(), task->GetPartitionAndSlot());
 }
 
+void FlashTask::Prepare() {
+    if (!prepared_.valid()) {
+        prepared_ = prepare_flash_buf(fname_, fp_);
+    }
+}
+
+int64_t FlashTask::GetImageSize() const {
+    if (!fp_->source) {
+        return -1;
+    }
+    return fp_->source->GetFileSize(fname_);
+}
+
 void FlashTask::Run() {
+    std::unique_ptr<fastboot_buffer> prepared;
+    if (prepared_.valid()) {
+        prepared = prepared_.get();
+    }
+
     auto flash = [&](const std::string& partition) {
         if (should_flash_in_userspace(fp_->source.get(), partition) && !is_userspace_fastboot() &&
             !fp_->force_flash) {
@@ -51,7 +69,10 @@ void FlashTask::Run() {
                 "And try again. If you are intentionally trying to "
                 "overwrite a fixed partition, use --force.");
         }
-        do_flash(partition.c_str(), fname_.c_str(), apply_vbmeta_, fp_);
+        // The prepared image is only good for one partition, the others are
+        // loaded again.
+        do_flash(partition.c_str(), fname_.c_str(), apply_vbmeta_, fp_, prepared.get());
+        prepared.reset();
     };
     do_for_partitions(pname_, slot_, flash, true);
 }
@@ -106,29 +127,26 @@ std::string RebootTask::ToString() const {
     return "reboot " + reboot_target_;
 }
 
-OptimizedFlashSuperTask::OptimizedFlashSuperTask(const std::string& super_name,
-                                                 std::unique_ptr<SuperFlashHelper> helper,
-                                                 SparsePtr sparse_layout, uint64_t super_size,
+OptimizedFlashSuperTask::OptimizedFlashSuperTask(std::unique_ptr<SuperFlashHelper> helper,
+                                                 std::vector<BlockDeviceImage> images,
                                                  const FlashingPlan* fp)
-    : super_name_(super_name),
-      helper_(std::move(helper)),
-      sparse_layout_(std::move(sparse_layout)),
-      super_size_(super_size),
-      fp_(fp) {}
+    : helper_(std::move(helper)), images_(std::move(images)), fp_(fp) {}
 
 void OptimizedFlashSuperTask::Run() {
-    // Use the reported super partition size as the upper limit, rather than
-    // sparse_file_len, which (1) can fail and (2) is kind of expensive, since
-    // it will map in all of the embedded fds.
-    std::vector<SparsePtr> files;
-    if (int limit = get_sparse_limit(super_size_, fp_)) {
-        files = resparse_file(sparse_layout_.get(), limit);
-    } else {
-        files.emplace_back(std::move(sparse_layout_));
-    }
+    for (auto& image : images_) {
+        // Use the reported partition size as the upper limit, rather than
+        // sparse_file_len, which (1) can fail and (2) is kind of expensive,
+        // since it will map in all of the embedded fds.
+        std::vector<SparsePtr> files;
+        if (int limit = get_sparse_limit(image.partition_size, fp_)) {
+            files = resparse_file(image.sparse_layout.get(), limit);
+        } else {
+            files.emplace_back(std::move(image.sparse_layout));
+        }
 
-    // Send the data to the device.
-    flash_partition_files(super_name_, files);
+        // Send the data to the device.
+        flash_partition_files(image.partition, files);
+    }
 }
 
 std::string OptimizedFlashSuperTask::ToString() const {
@@ -186,20 +204,28 @@ std::unique_ptr<OptimizedFlashSuperTask> OptimizedFlashSuperTask::Initialize(
         return nullptr;
     }
 
+    auto get_partition_size = [fp](const std::string& partition, uint64_t* size) -> bool {
+        std::string size_str;
+        if (fp->fb->GetVar("partition-size:" + partition, &size_str) != fastboot::SUCCESS) {
+            LOG(VERBOSE) << "Cannot optimize super flashing: could not determine " << partition
+                         << " partition";
+            return false;
+        }
+        size_str = fb_fix_numeric_var(size_str);
+        if (!android::base::ParseUint(size_str, size)) {
+            LOG(VERBOSE) << "Could not parse " << partition << " size: " << size_str;
+            return false;
+        }
+        return true;
+    };
+
     std::string super_name;
     // Try to find whether there is a super partition.
     if (fp->fb->GetVar("super-partition-name", &super_name) != fastboot::SUCCESS) {
         super_name = "super";
     }
     uint64_t partition_size;
-    std::string partition_size_str;
-    if (fp->fb->GetVar("partition-size:" + super_name, &partition_size_str) != fastboot::SUCCESS) {
-        LOG(VERBOSE) << "Cannot optimize super flashing: could not determine super partition";
-        return nullptr;
-    }
-    partition_size_str = fb_fix_numeric_var(partition_size_str);
-    if (!android::base::ParseUint(partition_size_str, &partition_size)) {
-        LOG(VERBOSE) << "Could not parse " << super_name << " size: " << partition_size_str;
+    if (!get_partition_size(super_name, &partition_size)) {
         return nullptr;
     }
 
@@ -217,8 +243,24 @@ std::unique_ptr<OptimizedFlashSuperTask> OptimizedFlashSuperTask::Initialize(
         }
     }
 
-    auto s = helper->GetSparseLayout();
-    if (!s) return nullptr;
+    // If super spans several block devices, each one gets its own image.
+    auto layouts = helper->GetSparseLayouts();
+    if (layouts.empty()) return nullptr;
+
+    std::vector<BlockDeviceImage> images;
+    for (auto& [partition, sparse_layout] : layouts) {
+        if (images.empty()) {
+            // The first one is super itself, which the device may know by
+            // another name.
+            images.push_back({super_name, std::move(sparse_layout), partition_size});
+            continue;
+        }
+        uint64_t size;
+        if (!get_partition_size(partition, &size)) {
+            return nullptr;
+        }
+        images.push_back({partition, std::move(sparse_layout), size});
+    }
 
     // Remove tasks that are concatenated into this optimized task
     auto remove_if_callback = [&](const auto& task) -> bool {
@@ -236,8 +278,7 @@ std::unique_ptr<OptimizedFlashSuperTask> OptimizedFlashSuperTask::Initialize(
 
     tasks.erase(std::remove_if(tasks.begin(), tasks.end(), remove_if_callback), tasks.end());
 
-    return std::make_unique<OptimizedFlashSuperTask>(super_name, std::move(helper), std::move(s),
-                                                     partition_size, fp);
+    return std::make_unique<OptimizedFlashSuperTask>(std::move(helper), std::move(images), fp);
 }
 
 UpdateSuperTask::UpdateSuperTask(const FlashingPlan* fp) : fp_(fp) {}
@@ -15,13 +15,17 @@
 //
 #pragma once
 
+#include <future>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "super_flash_helper.h"
 #include "util.h"
 
 struct FlashingPlan;
 struct Image;
+struct fastboot_buffer;
 using ImageEntry = std::pair<const Image*, std::string>;
 
 class FlashTask;
@@ -53,6 +57,10 @@ class FlashTask : public Task {
     virtual FlashTask* AsFlashTask() override { return this; }
 
     static bool IsDynamicPartition(const ImageSource* source, const FlashTask* task);
+    // Starts loading the image on a background thread; Run() picks it up.
+    void Prepare();
+    // Returns the size of the image to load, or -1 if unknown.
+    int64_t GetImageSize() const;
     void Run() override;
     std::string ToString() const override;
     std::string GetPartition() const { return pname_; }
@@ -66,6 +74,7 @@ class FlashTask : public Task {
     const std::string slot_;
     const bool apply_vbmeta_;
     const FlashingPlan* fp_;
+    std::future<std::unique_ptr<fastboot_buffer>> prepared_;
 };
 
 class RebootTask : public Task {
@@ -84,8 +93,15 @@ class RebootTask : public Task {
 
 class OptimizedFlashSuperTask : public Task {
   public:
-    OptimizedFlashSuperTask(const std::string& super_name, std::unique_ptr<SuperFlashHelper> helper,
-                            SparsePtr sparse_layout, uint64_t super_size, const FlashingPlan* fp);
+    // What to flash to one of the block devices that super spans.
+    struct BlockDeviceImage {
+        std::string partition;
+        SparsePtr sparse_layout;
+        uint64_t partition_size;
+    };
+
+    OptimizedFlashSuperTask(std::unique_ptr<SuperFlashHelper> helper,
+                            std::vector<BlockDeviceImage> images, const FlashingPlan* fp);
     virtual OptimizedFlashSuperTask* AsOptimizedFlashSuperTask() override { return this; }
 
     static std::unique_ptr<OptimizedFlashSuperTask> Initialize(
@@ -97,10 +113,8 @@ class OptimizedFlashSuperTask : public Task {
     std::string ToString() const override;
 
   private:
-    const std::string super_name_;
     std::unique_ptr<SuperFlashHelper> helper_;
-    SparsePtr sparse_layout_;
-    uint64_t super_size_;
+    std::vector<BlockDeviceImage> images_;
     const FlashingPlan* fp_;
 };
 
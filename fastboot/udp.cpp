@@ -33,6 +33,7 @@
 #include <errno.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <list>
 #include <memory>
 #include <vector>
@@ -125,6 +126,13 @@ class UdpTransport : public Transport {
     ssize_t SendData(Id id, const uint8_t* tx_data, size_t tx_length, uint8_t* rx_data,
                      size_t rx_length, int attempts, std::string* error);
 
+    // Sends |tx_length| bytes from |tx_data| as a series of packets, keeping up to |window_size_|
+    // of them unacknowledged at once and retransmitting only the ones that were not acknowledged.
+    // Only used for writes, where the device responds to each packet with an empty ACK. Returns
+    // true on success, or false and fills |error| on failure.
+    bool SendWindowedData(Id id, const uint8_t* tx_data, size_t tx_length, int attempts,
+                          std::string* error);
+
     // Helper for SendData(); sends a single packet and handles the response. |header| specifies
     // the initial outgoing packet information but may be modified by this function.
     ssize_t SendSinglePacketHelper(Header* header, const uint8_t* tx_data, size_t tx_length,
@@ -134,6 +142,7 @@ class UdpTransport : public Transport {
     std::unique_ptr<Socket> socket_;
     int sequence_ = -1;
     size_t max_data_length_ = kMinPacketSize - kHeaderSize;
+    size_t window_size_ = 1;
     std::vector<uint8_t> rx_packet_;
 
     DISALLOW_COPY_AND_ASSIGN(UdpTransport);
@@ -151,7 +160,7 @@ std::unique_ptr<UdpTransport> UdpTransport::NewTransport(std::unique_ptr<Socket>
 }
 
 bool UdpTransport::InitializeProtocol(std::string* error) {
-    uint8_t rx_data[4];
+    uint8_t rx_data[6];
 
     sequence_ = 0;
     rx_packet_.resize(kMinPacketSize);
@@ -169,9 +178,10 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     // The first two bytes contain the next expected sequence number.
     sequence_ = ExtractUint16(rx_data);
 
-    // Now send the initialization packet with our version and maximum packet size.
-    uint8_t init_data[] = {kProtocolVersion >> 8, kProtocolVersion & 0xFF,
-                           kHostMaxPacketSize >> 8, kHostMaxPacketSize & 0xFF};
+    // Now send the initialization packet with our version, maximum packet size and window size.
+    uint8_t init_data[] = {kProtocolVersion >> 8,   kProtocolVersion & 0xFF,
+                           kHostMaxPacketSize >> 8, kHostMaxPacketSize & 0xFF,
+                           kHostMaxWindowSize >> 8, kHostMaxWindowSize & 0xFF};
     rx_bytes = SendData(kIdInitialization, init_data, sizeof(init_data), rx_data, sizeof(rx_data),
                         kMaxTransmissionAttempts, error);
     if (rx_bytes == -1) {
@@ -182,9 +192,10 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     }
 
     // The first two data bytes contain the version, the second two bytes contain the target max
-    // supported packet size, which must be at least 512 bytes.
+    // supported packet size, which must be at least 512 bytes. From version 2, the next two bytes
+    // may contain the target window size.
     uint16_t version = ExtractUint16(rx_data);
-    if (version < kProtocolVersion) {
+    if (version < kMinProtocolVersion) {
         *error = android::base::StringPrintf("target reported invalid protocol version %d",
                                              version);
         return false;
@@ -199,6 +210,12 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     max_data_length_ = packet_size - kHeaderSize;
     rx_packet_.resize(packet_size);
 
+    window_size_ = 1;
+    if (std::min(version, kProtocolVersion) >= 2 && rx_bytes >= 6) {
+        uint16_t window_size = ExtractUint16(rx_data + 4);
+        window_size_ = std::max<size_t>(1, std::min(kHostMaxWindowSize, window_size));
+    }
+
     return true;
 }
 
@@ -250,6 +267,96 @@ ssize_t UdpTransport::SendData(Id id, const uint8_t* tx_data, size_t tx_length,
     return ret;
 }
 
+bool UdpTransport::SendWindowedData(Id id, const uint8_t* tx_data, size_t tx_length,
+                                    int attempts, std::string* error) {
+    if (socket_ == nullptr) {
+        *error = "socket is closed";
+        return false;
+    }
+    error->clear();
+
+    const size_t num_packets = (tx_length + max_data_length_ - 1) / max_data_length_;
+    std::vector<bool> acked(num_packets, false);
+
+    // Sends packet |index|, which has sequence number |sequence_| + |index|.
+    auto send_packet = [&](size_t index) -> bool {
+        size_t offset = index * max_data_length_;
+        size_t length = std::min(max_data_length_, tx_length - offset);
+        Header header;
+        header.Set(id, static_cast<uint16_t>(sequence_ + index),
+                   index + 1 < num_packets ? kFlagContinuation : kFlagNone);
+        if (!socket_->Send({{header.bytes(), kHeaderSize}, {tx_data + offset, length}})) {
+            *error = Socket::GetErrorMessage();
+            return false;
+        }
+        return true;
+    };
+
+    // Packets before |base| are all acknowledged; packets before |next| have been sent.
+    size_t base = 0;
+    size_t next = 0;
+    int attempts_left = attempts;
+    while (base < num_packets) {
+        for (; next < num_packets && next < base + window_size_; ++next) {
+            if (!send_packet(next)) {
+                return false;
+            }
+        }
+
+        ssize_t bytes = socket_->Receive(rx_packet_.data(), rx_packet_.size(), kResponseTimeoutMs);
+        if (bytes == -1) {
+            if (!socket_->ReceiveTimedOut()) {
+                *error = Socket::GetErrorMessage();
+                return false;
+            }
+            if (--attempts_left <= 0) {
+                *error = "no response from target";
+                return false;
+            }
+            // Selective retransmission: only resend what hasn't been acknowledged.
+            for (size_t i = base; i < next; ++i) {
+                if (!acked[i] && !send_packet(i)) {
+                    return false;
+                }
+            }
+            continue;
+        } else if (bytes < static_cast<ssize_t>(kHeaderSize)) {
+            *error = "protocol error: incomplete header";
+            return false;
+        }
+
+        // Ignore responses that aren't for an outstanding packet, e.g. duplicate ACKs.
+        // Sequence numbers wrap at 16 bits, so work out the index relative to |base|.
+        uint16_t rx_sequence = ExtractUint16(rx_packet_.data() + kIndexSeqH);
+        size_t index = base + static_cast<uint16_t>(rx_sequence - (sequence_ + base));
+        if (index < base || index >= next || acked[index]) {
+            continue;
+        }
+        if (rx_packet_[kIndexId] == kIdError) {
+            error->assign(rx_packet_.data() + kHeaderSize, rx_packet_.data() + bytes);
+            *error = "target reported error: " + *error;
+            return false;
+        }
+        if (rx_packet_[kIndexId] != id) {
+            continue;
+        }
+        if (bytes > static_cast<ssize_t>(kHeaderSize) ||
+            (rx_packet_[kIndexFlags] & kFlagContinuation)) {
+            *error = "target sent fastboot data out-of-turn";
+            return false;
+        }
+
+        acked[index] = true;
+        attempts_left = attempts;
+        while (base < num_packets && acked[base]) {
+            ++base;
+        }
+    }
+
+    sequence_ += num_packets;
+    return true;
+}
+
 ssize_t UdpTransport::SendSinglePacketHelper(
         Header* header, const uint8_t* tx_data, size_t tx_length, uint8_t* rx_data,
         size_t rx_length, const int attempts, std::string* error) {
@@ -346,6 +453,17 @@ ssize_t UdpTransport::Read(void* data, size_t length) {
 
 ssize_t UdpTransport::Write(const void* data, size_t length) {
     std::string error;
+
+    // Large writes, e.g. image downloads, keep several packets in flight if the device allows it.
+    if (window_size_ > 1 && length > max_data_length_) {
+        if (!SendWindowedData(kIdFastboot, reinterpret_cast<const uint8_t*>(data), length,
+                              kMaxTransmissionAttempts, &error)) {
+            fprintf(stderr, "UDP error: %s\n", error.c_str());
+            return -1;
+        }
+        return length;
+    }
+
     ssize_t bytes = SendData(kIdFastboot, reinterpret_cast<const uint8_t*>(data), length, nullptr,
                              0, kMaxTransmissionAttempts, &error);
 
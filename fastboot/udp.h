@@ -45,11 +45,17 @@ std::unique_ptr<Transport> Connect(const std::string& hostname, int port, std::s
 // Internal namespace for test use only.
 namespace internal {
 
-constexpr uint16_t kProtocolVersion = 1;
+// Version 2 adds a window of unacknowledged Fastboot packets, negotiated in the Init packet.
+constexpr uint16_t kProtocolVersion = 2;
+constexpr uint16_t kMinProtocolVersion = 1;
 
 // This will be negotiated with the device so may end up being smaller.
 constexpr uint16_t kHostMaxPacketSize = 8192;
 
+// Maximum number of unacknowledged packets in flight while writing. This will be negotiated with
+// the device so may end up being smaller; devices speaking protocol version 1 get a window of 1.
+constexpr uint16_t kHostMaxWindowSize = 32;
+
 // Retransmission constants. Retransmission timeout must be at least 500ms, and the host must
 // attempt to send packets for at least 1 minute once the device has connected. See
 // fastboot_protocol.txt for more information.
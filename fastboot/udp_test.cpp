@@ -56,6 +56,12 @@ static std::string InitPacket(uint16_t sequence, uint16_t version, uint16_t max_
            PacketValue(version) + PacketValue(max_packet_size);
 }
 
+// Returns the Init packet the host sends, with its version, max packet size and window size.
+static std::string HostInitPacket(uint16_t sequence) {
+    return InitPacket(sequence, kProtocolVersion, kHostMaxPacketSize) +
+           PacketValue(kHostMaxWindowSize);
+}
+
 // Returns a Fastboot packet with |data|.
 static std::string FastbootPacket(uint16_t sequence, const std::string& data = "",
                                   char flags = kFlagNone) {
@@ -89,7 +95,7 @@ TEST_F(UdpConnectTest, InitializationSuccess) {
     for (uint16_t seq : kTestSequenceNumbers) {
         mock_socket_->ExpectSend(QueryPacket(0));
         mock_socket_->AddReceive(QueryPacket(0, seq));
-        mock_socket_->ExpectSend(InitPacket(seq, kProtocolVersion, kHostMaxPacketSize));
+        mock_socket_->ExpectSend(HostInitPacket(seq));
         mock_socket_->AddReceive(InitPacket(seq, kProtocolVersion, 1024));
 
         EXPECT_TRUE(UdpConnect());
@@ -103,7 +109,7 @@ TEST_F(UdpConnectTest, InitializationContinuationSuccess) {
     mock_socket_->ExpectSend(std::string{kIdDeviceQuery, kFlagNone, 0, 1});
     mock_socket_->AddReceive(std::string{kIdDeviceQuery, kFlagNone, 0, 1, 0x55});
 
-    mock_socket_->ExpectSend(InitPacket(0x4455, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0x4455));
     mock_socket_->AddReceive(std::string{kIdInitialization, kFlagContinuation, 0x44, 0x55, 0});
     mock_socket_->ExpectSend(std::string{kIdInitialization, kFlagNone, 0x44, 0x56});
     mock_socket_->AddReceive(std::string{kIdInitialization, kFlagContinuation, 0x44, 0x56, 1});
@@ -121,14 +127,14 @@ TEST_F(UdpConnectTest, InitializationContinuationSuccess) {
 TEST_F(UdpConnectTest, InitializationVersionMismatch) {
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, 2, 1024));
 
     EXPECT_TRUE(UdpConnect());
 
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, 0, 1024));
 
     EXPECT_FALSE(UdpConnect());
@@ -154,7 +160,7 @@ TEST_F(UdpConnectTest, InitResponseTimeoutFailure) {
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
     for (int i = 0; i < kMaxTransmissionAttempts; ++i) {
-        mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+        mock_socket_->ExpectSend(HostInitPacket(0));
         mock_socket_->AddReceiveTimeout();
     }
 
@@ -164,7 +170,7 @@ TEST_F(UdpConnectTest, InitResponseTimeoutFailure) {
 TEST_F(UdpConnectTest, InitResponseReceiveFailure) {
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceiveFailure();
 
     EXPECT_FALSE(UdpConnect());
@@ -182,10 +188,10 @@ TEST_F(UdpConnectTest, ResponseRecovery) {
 
     // Subsequent packets try up to (kMaxTransmissionAttempts - 1) times.
     for (int i = 0; i < kMaxTransmissionAttempts - 1; ++i) {
-        mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+        mock_socket_->ExpectSend(HostInitPacket(0));
         mock_socket_->AddReceiveTimeout();
     }
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 1024));
 
     EXPECT_TRUE(UdpConnect());
@@ -195,7 +201,7 @@ TEST_F(UdpConnectTest, ResponseRecovery) {
 TEST_F(UdpConnectTest, ExtraResponseDataSuccess) {
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0) + "foo");
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 1024) + "bar");
 
     EXPECT_TRUE(UdpConnect());
@@ -208,7 +214,7 @@ TEST_F(UdpConnectTest, WrongSequenceRecovery) {
     mock_socket_->AddReceive(QueryPacket(1, 0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
 
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(1, kProtocolVersion, 1024));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 1024));
 
@@ -221,7 +227,7 @@ TEST_F(UdpConnectTest, WrongIdRecovery) {
     mock_socket_->AddReceive(FastbootPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
 
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(FastbootPacket(0));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 1024));
 
@@ -251,7 +257,7 @@ TEST_F(UdpConnectTest, InvalidInitResponseFailure) {
 
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, kProtocolVersion, 511));
 
     EXPECT_FALSE(UdpConnect(&error));
@@ -259,7 +265,7 @@ TEST_F(UdpConnectTest, InvalidInitResponseFailure) {
 
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(InitPacket(0, 0, 1024));
 
     EXPECT_FALSE(UdpConnect(&error));
@@ -277,7 +283,7 @@ TEST_F(UdpConnectTest, ErrorResponseFailure) {
 
     mock_socket_->ExpectSend(QueryPacket(0));
     mock_socket_->AddReceive(QueryPacket(0, 0));
-    mock_socket_->ExpectSend(InitPacket(0, kProtocolVersion, kHostMaxPacketSize));
+    mock_socket_->ExpectSend(HostInitPacket(0));
     mock_socket_->AddReceive(ErrorPacket(0, "error2"));
 
     EXPECT_FALSE(UdpConnect(&error));
@@ -309,15 +315,17 @@ class UdpTest : public ::testing::Test {
     }
 
     // Sets up |mock_socket_| to correctly initialize the protocol and creates |transport_|. This
-    // can be called multiple times in a test if needed.
-    bool InitializeTransport(uint16_t starting_sequence, int device_max_packet_size = 512) {
+    // can be called multiple times in a test if needed. A |device_window_size| of 0 leaves the
+    // window size out of the device's Init response.
+    bool InitializeTransport(uint16_t starting_sequence, int device_max_packet_size = 512,
+                             uint16_t device_window_size = 0) {
         mock_socket_ = new SocketMock;
         mock_socket_->ExpectSend(QueryPacket(0));
         mock_socket_->AddReceive(QueryPacket(0, starting_sequence));
-        mock_socket_->ExpectSend(
-                InitPacket(starting_sequence, kProtocolVersion, kHostMaxPacketSize));
+        mock_socket_->ExpectSend(HostInitPacket(starting_sequence));
         mock_socket_->AddReceive(
-                InitPacket(starting_sequence, kProtocolVersion, device_max_packet_size));
+                InitPacket(starting_sequence, kProtocolVersion, device_max_packet_size) +
+                (device_window_size ? PacketValue(device_window_size) : ""));
 
         std::string error;
         transport_ = Connect(std::unique_ptr<Socket>(mock_socket_), &error);
@@ -454,6 +462,53 @@ TEST_F(UdpTest, ContinuationPackets) {
     }
 }
 
+// Tests that writes keep up to the negotiated window of packets in flight, and that only the
+// unacknowledged packets are retransmitted after a timeout.
+TEST_F(UdpTest, WindowedWrite) {
+    ASSERT_TRUE(InitializeTransport(0, 512, 2));
+
+    size_t max_data_size = 512 - 4;
+    std::string data(max_data_size * 3, '\0');
+    for (size_t i = 0; i < data.length(); ++i) {
+        data[i] = i;
+    }
+    std::string chunks[] = {data.substr(0, max_data_size),
+                            data.substr(max_data_size, max_data_size),
+                            data.substr(max_data_size * 2, max_data_size)};
+
+    mock_socket_->ExpectSend(FastbootPacket(1, chunks[0], kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(2, chunks[1], kFlagContinuation));
+    // The ACK for packet 1 is lost; only packet 1 is sent again.
+    mock_socket_->AddReceive(FastbootPacket(2));
+    mock_socket_->AddReceiveTimeout();
+    mock_socket_->ExpectSend(FastbootPacket(1, chunks[0], kFlagContinuation));
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->ExpectSend(FastbootPacket(3, chunks[2]));
+    // Duplicate ACKs are ignored.
+    mock_socket_->AddReceive(FastbootPacket(2));
+    mock_socket_->AddReceive(FastbootPacket(3));
+    EXPECT_TRUE(Write(data));
+
+    // Reads and small writes are unchanged.
+    mock_socket_->ExpectSend(FastbootPacket(4, "foo"));
+    mock_socket_->AddReceive(FastbootPacket(4));
+    mock_socket_->ExpectSend(FastbootPacket(5));
+    mock_socket_->AddReceive(FastbootPacket(5, "bar"));
+    EXPECT_TRUE(Write("foo"));
+    EXPECT_TRUE(Read("bar"));
+}
+
+// Tests an error response in the middle of a windowed write.
+TEST_F(UdpTest, WindowedWriteError) {
+    ASSERT_TRUE(InitializeTransport(0, 512, 4));
+
+    std::string data(508 * 2, 'x');
+    mock_socket_->ExpectSend(FastbootPacket(1, data.substr(0, 508), kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(2, data.substr(508)));
+    mock_socket_->AddReceive(ErrorPacket(1, "busy"));
+    EXPECT_FALSE(Write(data));
+}
+
 // Tests that the continuation bit is respected even if the packet isn't max size.
 TEST_F(UdpTest, SmallContinuationPackets) {
     mock_socket_->ExpectSend(FastbootPacket(1));
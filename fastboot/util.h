@@ -37,4 +37,6 @@ class ImageSource {
     virtual ~ImageSource(){};
     virtual bool ReadFile(const std::string& name, std::vector<char>* out) const = 0;
     virtual android::base::unique_fd OpenFile(const std::string& name) const = 0;
+    // Returns the size |name| will have once opened, or -1 if it isn't known without loading it.
+    virtual int64_t GetFileSize(const std::string& /*name*/) const { return -1; }
 };
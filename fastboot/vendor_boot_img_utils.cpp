@@ -17,6 +17,14 @@
 #include "vendor_boot_img_utils.h"
 
 #include <string.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/result.h>
@@ -25,105 +33,170 @@
 
 namespace {
 
+using android::base::borrowed_fd;
 using android::base::Result;
 
-// Updates a given buffer by creating a new one.
+// Largest buffer used to copy data when the kernel cannot copy it for us.
+constexpr uint64_t kCopyBufferSize = 1024 * 1024;
+
+// Copy |num_bytes| at |offset| of |in_fd| to the current position of |out_fd|.
+[[nodiscard]] Result<void> copy_fd_range(borrowed_fd in_fd, uint64_t offset, borrowed_fd out_fd,
+                                         uint64_t num_bytes) {
+#if defined(__linux__) && defined(__NR_copy_file_range)
+    // Let the kernel copy (or share) the data if both files support it, and fall back to
+    // reading and writing otherwise.
+    while (num_bytes > 0) {
+        loff_t in_off = offset;
+        ssize_t ret = syscall(__NR_copy_file_range, in_fd.get(), &in_off, out_fd.get(), nullptr,
+                              num_bytes, 0);
+        if (ret < 0 && (errno == EXDEV || errno == EINVAL || errno == ENOSYS ||
+                        errno == EOPNOTSUPP || errno == EBADF)) {
+            break;
+        }
+        if (ret < 0) return ErrnoErrorf("copy_file_range failed");
+        if (ret == 0) return Errorf("Unexpected end of file at 0x{:x}", offset);
+        offset += ret;
+        num_bytes -= ret;
+    }
+#endif
+    std::vector<char> buffer(std::min(num_bytes, kCopyBufferSize));
+    while (num_bytes > 0) {
+        size_t chunk = std::min<uint64_t>(num_bytes, buffer.size());
+        if (!android::base::ReadFullyAtOffset(in_fd, buffer.data(), chunk, offset)) {
+            return ErrnoErrorf("Cannot read 0x{:x} bytes at 0x{:x}", chunk, offset);
+        }
+        if (!android::base::WriteFully(out_fd, buffer.data(), chunk)) {
+            return ErrnoErrorf("Cannot write 0x{:x} bytes", chunk);
+        }
+        offset += chunk;
+        num_bytes -= chunk;
+    }
+    return {};
+}
+
+// Writes an updated copy of a file to another file. The old file is only read
+// where data is copied, and unchanged data is copied fd to fd, so only headers
+// and tables that are changed are ever held in memory. Parts of the new file
+// which are skipped read back as zeroes.
 class DataUpdater {
   public:
-    DataUpdater(const std::string& old_data) : old_data_(&old_data) {
-        old_data_ptr_ = old_data_->data();
-        new_data_.resize(old_data_->size(), '\0');
-        new_data_ptr_ = new_data_.data();
+    DataUpdater(borrowed_fd old_fd, uint64_t old_size, borrowed_fd new_fd)
+        : old_fd_(old_fd), old_size_(old_size), new_fd_(new_fd) {}
+
+    // Start writing the new file from its beginning.
+    [[nodiscard]] Result<void> Start() {
+        if (lseek(new_fd_.get(), 0, SEEK_SET) != 0) {
+            return ErrnoErrorf("Cannot seek to beginning of new image");
+        }
+        if (TEMP_FAILURE_RETRY(ftruncate(new_fd_.get(), 0)) == -1) {
+            return ErrnoErrorf("Cannot truncate new image");
+        }
+        return {};
+    }
+    // Read |num_bytes| from src at |offset| without advancing.
+    [[nodiscard]] Result<std::string> Read(uint64_t offset, uint32_t num_bytes) {
+        if (offset > size() || num_bytes > size() - offset) {
+            return Errorf("{}: Boundary overflow: 0x{:x} + 0x{:x} > 0x{:x}", __FUNCTION__, offset,
+                          num_bytes, size());
+        }
+        std::string data(num_bytes, '\0');
+        if (!android::base::ReadFullyAtOffset(old_fd_, data.data(), data.size(), offset)) {
+            return ErrnoErrorf("Cannot read 0x{:x} bytes at 0x{:x}", num_bytes, offset);
+        }
+        return data;
     }
     // Copy |num_bytes| from src to dst.
     [[nodiscard]] Result<void> Copy(uint32_t num_bytes) {
         if (num_bytes == 0) return {};
-        if (auto res = CheckAdvance(old_data_ptr_, old_end(), num_bytes, __FUNCTION__); !res.ok())
-            return res;
-        if (auto res = CheckAdvance(new_data_ptr_, new_end(), num_bytes, __FUNCTION__); !res.ok())
-            return res;
-        memcpy(new_data_ptr_, old_data_ptr_, num_bytes);
-        old_data_ptr_ += num_bytes;
-        new_data_ptr_ += num_bytes;
+        if (auto res = CheckAdvance(old_pos_, num_bytes, __FUNCTION__); !res.ok()) return res;
+        if (auto res = CheckAdvance(new_pos_, num_bytes, __FUNCTION__); !res.ok()) return res;
+        if (auto res = copy_fd_range(old_fd_, old_pos_, new_fd_, num_bytes); !res.ok()) return res;
+        old_pos_ += num_bytes;
+        new_pos_ += num_bytes;
         return {};
     }
     // Replace |old_num_bytes| from src with new data.
     [[nodiscard]] Result<void> Replace(uint32_t old_num_bytes, const std::string& new_data) {
-        return Replace(old_num_bytes, new_data.data(), new_data.size());
+        if (auto res = CheckAdvance(old_pos_, old_num_bytes, __FUNCTION__); !res.ok()) return res;
+        old_pos_ += old_num_bytes;
+
+        if (new_data.empty()) return {};
+        if (auto res = CheckAdvance(new_pos_, new_data.size(), __FUNCTION__); !res.ok())
+            return res;
+        if (!android::base::WriteFully(new_fd_, new_data.data(), new_data.size())) {
+            return ErrnoErrorf("Cannot write 0x{:x} bytes", new_data.size());
+        }
+        new_pos_ += new_data.size();
+        return {};
     }
-    [[nodiscard]] Result<void> Replace(uint32_t old_num_bytes, const void* new_data,
+    // Replace |old_num_bytes| from src with the first |new_data_size| bytes of |new_data_fd|.
+    [[nodiscard]] Result<void> Replace(uint32_t old_num_bytes, borrowed_fd new_data_fd,
                                        uint32_t new_data_size) {
-        if (auto res = CheckAdvance(old_data_ptr_, old_end(), old_num_bytes, __FUNCTION__);
-            !res.ok())
-            return res;
-        old_data_ptr_ += old_num_bytes;
+        if (auto res = CheckAdvance(old_pos_, old_num_bytes, __FUNCTION__); !res.ok()) return res;
+        old_pos_ += old_num_bytes;
 
         if (new_data_size == 0) return {};
-        if (auto res = CheckAdvance(new_data_ptr_, new_end(), new_data_size, __FUNCTION__);
-            !res.ok())
+        if (auto res = CheckAdvance(new_pos_, new_data_size, __FUNCTION__); !res.ok()) return res;
+        if (auto res = copy_fd_range(new_data_fd, 0, new_fd_, new_data_size); !res.ok())
             return res;
-        memcpy(new_data_ptr_, new_data, new_data_size);
-        new_data_ptr_ += new_data_size;
+        new_pos_ += new_data_size;
         return {};
     }
     // Skip |old_skip| from src and |new_skip| from dst, respectively.
     [[nodiscard]] Result<void> Skip(uint32_t old_skip, uint32_t new_skip) {
-        if (auto res = CheckAdvance(old_data_ptr_, old_end(), old_skip, __FUNCTION__); !res.ok())
-            return res;
-        old_data_ptr_ += old_skip;
-        if (auto res = CheckAdvance(new_data_ptr_, new_end(), new_skip, __FUNCTION__); !res.ok())
-            return res;
-        new_data_ptr_ += new_skip;
-        return {};
+        if (auto res = CheckAdvance(old_pos_, old_skip, __FUNCTION__); !res.ok()) return res;
+        old_pos_ += old_skip;
+        if (auto res = CheckAdvance(new_pos_, new_skip, __FUNCTION__); !res.ok()) return res;
+        return SeekNew(new_pos_ + new_skip);
     }
 
     [[nodiscard]] Result<void> Seek(uint32_t offset) {
         if (offset > size()) return Errorf("Cannot seek 0x{:x}, size is 0x{:x}", offset, size());
-        old_data_ptr_ = old_begin() + offset;
-        new_data_ptr_ = new_begin() + offset;
-        return {};
+        old_pos_ = offset;
+        return SeekNew(offset);
     }
 
-    std::string Finish() {
-        new_data_ptr_ = nullptr;
-        return std::move(new_data_);
+    // The new file has the same size as the old one.
+    [[nodiscard]] Result<void> Finish() {
+        if (TEMP_FAILURE_RETRY(ftruncate(new_fd_.get(), size())) == -1) {
+            return ErrnoErrorf("Truncating new vendor boot image to 0x{:x} fails", size());
+        }
+        return {};
     }
 
     [[nodiscard]] Result<void> CheckOffset(uint32_t old_offset, uint32_t new_offset) {
-        if (old_begin() + old_offset != old_cur())
+        if (old_offset != old_pos_)
             return Errorf("Old offset mismatch: expected: 0x{:x}, actual: 0x{:x}", old_offset,
-                          old_cur() - old_begin());
-        if (new_begin() + new_offset != new_cur())
+                          old_pos_);
+        if (new_offset != new_pos_)
             return Errorf("New offset mismatch: expected: 0x{:x}, actual: 0x{:x}", new_offset,
-                          new_cur() - new_begin());
+                          new_pos_);
         return {};
     }
 
-    uint64_t size() const { return old_data_->size(); }
-    const char* old_begin() const { return old_data_->data(); }
-    const char* old_cur() { return old_data_ptr_; }
-    const char* old_end() const { return old_data_->data() + old_data_->size(); }
-    char* new_begin() { return new_data_.data(); }
-    char* new_cur() { return new_data_ptr_; }
-    char* new_end() { return new_data_.data() + new_data_.size(); }
+    uint64_t size() const { return old_size_; }
+    uint64_t old_cur() const { return old_pos_; }
 
   private:
     // Check if it is okay to advance |num_bytes| from |current|.
-    [[nodiscard]] Result<void> CheckAdvance(const char* current, const char* end,
-                                            uint32_t num_bytes, const char* op) {
-        auto new_end = current + num_bytes;
-        if (new_end < current /* add overflow */)
-            return Errorf("{}: Addition overflow: 0x{} + 0x{:x} < 0x{}", op, fmt::ptr(current),
-                          num_bytes, fmt::ptr(current));
-        if (new_end > end)
-            return Errorf("{}: Boundary overflow: 0x{} + 0x{:x} > 0x{}", op, fmt::ptr(current),
-                          num_bytes, fmt::ptr(end));
+    [[nodiscard]] Result<void> CheckAdvance(uint64_t current, uint64_t num_bytes, const char* op) {
+        if (current + num_bytes > size())
+            return Errorf("{}: Boundary overflow: 0x{:x} + 0x{:x} > 0x{:x}", op, current,
+                          num_bytes, size());
         return {};
     }
-    const std::string* old_data_;
-    std::string new_data_;
-    const char* old_data_ptr_;
-    char* new_data_ptr_;
+    [[nodiscard]] Result<void> SeekNew(uint64_t offset) {
+        if (lseek(new_fd_.get(), offset, SEEK_SET) != static_cast<off_t>(offset)) {
+            return ErrnoErrorf("Cannot seek to 0x{:x} of new image", offset);
+        }
+        new_pos_ = offset;
+        return {};
+    }
+    borrowed_fd old_fd_;
+    uint64_t old_size_;
+    borrowed_fd new_fd_;
+    uint64_t old_pos_ = 0;
+    uint64_t new_pos_ = 0;
 };
 
 // Get the size of vendor boot header.
@@ -161,43 +234,32 @@ class DataUpdater {
     return {};
 }
 
-// Wrapper of ReadFdToString. Seek to the beginning and read the whole file to string.
-[[nodiscard]] Result<std::string> load_file(android::base::borrowed_fd fd, uint64_t expected_size,
-                                            const char* what) {
-    if (lseek(fd.get(), 0, SEEK_SET) != 0) {
-        return ErrnoErrorf("Can't seek to the beginning of {} image", what);
-    }
-    std::string content;
-    if (!android::base::ReadFdToString(fd, &content)) {
-        return ErrnoErrorf("Cannot read {} to string", what);
+// Check that the file behind |fd| is |expected_size| bytes, without reading it.
+[[nodiscard]] Result<void> check_file_size(borrowed_fd fd, uint64_t expected_size,
+                                           const char* what) {
+    off_t size = lseek(fd.get(), 0, SEEK_END);
+    if (size < 0) {
+        return ErrnoErrorf("Can't seek to the end of {} image", what);
     }
-    if (content.size() != expected_size) {
+    if (static_cast<uint64_t>(size) != expected_size) {
         return Errorf("Size of {} does not match, expected 0x{:x}, read 0x{:x}", what,
-                      expected_size, content.size());
+                      expected_size, size);
     }
-    return content;
+    return {};
 }
 
-// Wrapper of WriteStringToFd. Seek to the beginning and write the whole file to string.
-[[nodiscard]] Result<void> store_file(android::base::borrowed_fd fd, const std::string& data,
-                                      const char* what) {
-    if (lseek(fd.get(), 0, SEEK_SET) != 0) {
-        return ErrnoErrorf("Cannot seek to beginning of {} before writing", what);
-    }
-    if (!android::base::WriteStringToFd(data, fd)) {
-        return ErrnoErrorf("Cannot write new content to {}", what);
-    }
-    if (TEMP_FAILURE_RETRY(ftruncate(fd.get(), data.size())) == -1) {
-        return ErrnoErrorf("Truncating new vendor boot image to 0x{:x} fails", data.size());
-    }
-    return {};
+// Read enough of the start of the vendor boot image to hold any version of its header.
+[[nodiscard]] Result<std::string> read_vendor_boot_hdr(DataUpdater* updater) {
+    return updater->Read(0, std::min<uint64_t>(updater->size(), sizeof(vendor_boot_img_hdr_v4)));
 }
 
-// Copy AVB footer if it exists in the old buffer.
+// Copy AVB footer if it exists in the old image.
 [[nodiscard]] Result<void> copy_avb_footer(DataUpdater* updater) {
     if (updater->size() < AVB_FOOTER_SIZE) return {};
     if (auto res = updater->Seek(updater->size() - AVB_FOOTER_SIZE); !res.ok()) return res;
-    if (memcmp(updater->old_cur(), AVB_FOOTER_MAGIC, AVB_FOOTER_MAGIC_LEN) != 0) return {};
+    auto magic = updater->Read(updater->old_cur(), AVB_FOOTER_MAGIC_LEN);
+    if (!magic.ok()) return magic.error();
+    if (memcmp(magic->data(), AVB_FOOTER_MAGIC, AVB_FOOTER_MAGIC_LEN) != 0) return {};
     return updater->Copy(AVB_FOOTER_SIZE);
 }
 
@@ -208,10 +270,13 @@ inline uint32_t round_up(uint32_t value, uint32_t page_size) {
 }
 
 // Replace the vendor ramdisk as a whole.
-[[nodiscard]] Result<std::string> replace_default_vendor_ramdisk(const std::string& vendor_boot,
-                                                                 const std::string& new_ramdisk) {
-    if (auto res = check_vendor_boot_hdr(vendor_boot, 3); !res.ok()) return res.error();
-    auto hdr = reinterpret_cast<const vendor_boot_img_hdr_v3*>(vendor_boot.data());
+[[nodiscard]] Result<void> replace_default_vendor_ramdisk(DataUpdater* updater,
+                                                          borrowed_fd new_ramdisk_fd,
+                                                          uint32_t new_ramdisk_size) {
+    auto hdr_content = read_vendor_boot_hdr(updater);
+    if (!hdr_content.ok()) return hdr_content.error();
+    if (auto res = check_vendor_boot_hdr(*hdr_content, 3); !res.ok()) return res.error();
+    auto hdr = reinterpret_cast<const vendor_boot_img_hdr_v3*>(hdr_content->data());
     auto hdr_size = get_vendor_boot_header_size(hdr);
     if (!hdr_size.ok()) return hdr_size.error();
     // Refer to bootimg.h for details. Numbers are in bytes.
@@ -219,12 +284,11 @@ inline uint32_t round_up(uint32_t value, uint32_t page_size) {
     const uint32_t p = round_up(hdr->vendor_ramdisk_size, hdr->page_size);
     const uint32_t q = round_up(hdr->dtb_size, hdr->page_size);
 
-    DataUpdater updater(vendor_boot);
-
-    // Copy header (O bytes), then update fields in header.
-    if (auto res = updater.Copy(o); !res.ok()) return res.error();
-    auto new_hdr = reinterpret_cast<vendor_boot_img_hdr_v3*>(updater.new_begin());
-    new_hdr->vendor_ramdisk_size = new_ramdisk.size();
+    // Copy header (O bytes), with fields in header updated.
+    auto new_hdr_content = updater->Read(0, o);
+    if (!new_hdr_content.ok()) return new_hdr_content.error();
+    auto new_hdr = reinterpret_cast<vendor_boot_img_hdr_v3*>(new_hdr_content->data());
+    new_hdr->vendor_ramdisk_size = new_ramdisk_size;
     // Because it is unknown how the new ramdisk is fragmented, the whole table is replaced
     // with a single entry representing the full ramdisk.
     if (new_hdr->header_version >= 4) {
@@ -234,44 +298,50 @@ inline uint32_t round_up(uint32_t value, uint32_t page_size) {
         new_hdr_v4->vendor_ramdisk_table_size = new_hdr_v4->vendor_ramdisk_table_entry_num *
                                                 new_hdr_v4->vendor_ramdisk_table_entry_size;
     }
+    const uint32_t new_p = round_up(new_hdr->vendor_ramdisk_size, new_hdr->page_size);
+    const uint32_t new_r =
+            new_hdr->header_version >= 4
+                    ? round_up(static_cast<vendor_boot_img_hdr_v4*>(new_hdr)
+                                       ->vendor_ramdisk_table_size,
+                               new_hdr->page_size)
+                    : 0;
+    if (auto res = updater->Replace(o, *new_hdr_content); !res.ok()) return res.error();
 
     // Copy the new ramdisk.
-    if (auto res = updater.Replace(hdr->vendor_ramdisk_size, new_ramdisk); !res.ok())
+    if (auto res = updater->Replace(hdr->vendor_ramdisk_size, new_ramdisk_fd, new_ramdisk_size);
+        !res.ok())
         return res.error();
-    const uint32_t new_p = round_up(new_hdr->vendor_ramdisk_size, new_hdr->page_size);
-    if (auto res = updater.Skip(p - hdr->vendor_ramdisk_size, new_p - new_hdr->vendor_ramdisk_size);
+    if (auto res = updater->Skip(p - hdr->vendor_ramdisk_size, new_p - new_ramdisk_size);
         !res.ok())
         return res.error();
-    if (auto res = updater.CheckOffset(o + p, o + new_p); !res.ok()) return res.error();
+    if (auto res = updater->CheckOffset(o + p, o + new_p); !res.ok()) return res.error();
 
     // Copy DTB (Q bytes).
-    if (auto res = updater.Copy(q); !res.ok()) return res.error();
+    if (auto res = updater->Copy(q); !res.ok()) return res.error();
 
-    if (new_hdr->header_version >= 4) {
+    if (hdr->header_version >= 4) {
         auto hdr_v4 = static_cast<const vendor_boot_img_hdr_v4*>(hdr);
         const uint32_t r = round_up(hdr_v4->vendor_ramdisk_table_size, hdr_v4->page_size);
         const uint32_t s = round_up(hdr_v4->bootconfig_size, hdr_v4->page_size);
 
-        auto new_entry = reinterpret_cast<vendor_ramdisk_table_entry_v4*>(updater.new_cur());
-        auto new_hdr_v4 = static_cast<const vendor_boot_img_hdr_v4*>(new_hdr);
-        auto new_r = round_up(new_hdr_v4->vendor_ramdisk_table_size, new_hdr->page_size);
-        if (auto res = updater.Skip(r, new_r); !res.ok()) return res.error();
-        if (auto res = updater.CheckOffset(o + p + q + r, o + new_p + q + new_r); !res.ok())
-            return res.error();
-
         // Replace table with single entry representing the full ramdisk.
-        new_entry->ramdisk_size = new_hdr->vendor_ramdisk_size;
+        if (new_r < sizeof(vendor_ramdisk_table_entry_v4)) {
+            return Errorf("Vendor ramdisk table does not fit a single entry");
+        }
+        std::string new_table(new_r, '\0');
+        auto new_entry = reinterpret_cast<vendor_ramdisk_table_entry_v4*>(new_table.data());
+        new_entry->ramdisk_size = new_ramdisk_size;
         new_entry->ramdisk_offset = 0;
         new_entry->ramdisk_type = VENDOR_RAMDISK_TYPE_NONE;
-        memset(new_entry->ramdisk_name, '\0', VENDOR_RAMDISK_NAME_SIZE);
-        memset(new_entry->board_id, '\0', VENDOR_RAMDISK_TABLE_ENTRY_BOARD_ID_SIZE);
+        if (auto res = updater->Replace(r, new_table); !res.ok()) return res.error();
+        if (auto res = updater->CheckOffset(o + p + q + r, o + new_p + q + new_r); !res.ok())
+            return res.error();
 
         // Copy bootconfig (S bytes).
-        if (auto res = updater.Copy(s); !res.ok()) return res.error();
+        if (auto res = updater->Copy(s); !res.ok()) return res.error();
     }
 
-    if (auto res = copy_avb_footer(&updater); !res.ok()) return res.error();
-    return updater.Finish();
+    return copy_avb_footer(updater);
 }
 
 // Find a ramdisk fragment with a unique name. Abort if none or multiple fragments are found.
@@ -299,13 +369,16 @@ inline uint32_t round_up(uint32_t value, uint32_t page_size) {
     return ret;
 }
 
-// Find the vendor ramdisk fragment with |ramdisk_name| within the content of |vendor_boot|, and
-// replace it with the content of |new_ramdisk|.
-[[nodiscard]] Result<std::string> replace_vendor_ramdisk_fragment(const std::string& ramdisk_name,
-                                                                  const std::string& vendor_boot,
-                                                                  const std::string& new_ramdisk) {
-    if (auto res = check_vendor_boot_hdr(vendor_boot, 4); !res.ok()) return res.error();
-    auto hdr = reinterpret_cast<const vendor_boot_img_hdr_v4*>(vendor_boot.data());
+// Find the vendor ramdisk fragment with |ramdisk_name| within the vendor boot image, and
+// replace it with the content of |new_ramdisk_fd|.
+[[nodiscard]] Result<void> replace_vendor_ramdisk_fragment(DataUpdater* updater,
+                                                           const std::string& ramdisk_name,
+                                                           borrowed_fd new_ramdisk_fd,
+                                                           uint32_t new_ramdisk_size) {
+    auto hdr_content = read_vendor_boot_hdr(updater);
+    if (!hdr_content.ok()) return hdr_content.error();
+    if (auto res = check_vendor_boot_hdr(*hdr_content, 4); !res.ok()) return res.error();
+    auto hdr = reinterpret_cast<const vendor_boot_img_hdr_v4*>(hdr_content->data());
     auto hdr_size = get_vendor_boot_header_size(hdr);
     if (!hdr_size.ok()) return hdr_size.error();
     // Refer to bootimg.h for details. Numbers are in bytes.
@@ -316,7 +389,7 @@ inline uint32_t round_up(uint32_t value, uint32_t page_size) {
     const uint32_t s = round_up(hdr->bootconfig_size, hdr->page_size);
 
     uint64_t total_size = (uint64_t)o + p + q + r + s;
-    if (total_size > vendor_boot.size()) {
+    if (total_size > updater->size()) {
         return Errorf("Vendor boot image size is too small, overflow");
     }
 
@@ -324,10 +397,18 @@ inline uint32_t round_up(uint32_t value, uint32_t page_size) {
         (uint64_t)o + p + q + r) {
         return Errorf("Too many vendor ramdisk entries in table, overflow");
     }
+    if (hdr->vendor_ramdisk_table_entry_num > 0 &&
+        hdr->vendor_ramdisk_table_entry_size < sizeof(vendor_ramdisk_table_entry_v4)) {
+        return Errorf("Vendor ramdisk table entry size 0x{:x} is too small",
+                      hdr->vendor_ramdisk_table_entry_size);
+    }
 
-    // Find entry with name |ramdisk_name|.
-    auto old_table_start =
-            reinterpret_cast<const vendor_ramdisk_table_entry_v4*>(vendor_boot.data() + o + p + q);
+    // Find entry with name |ramdisk_name|. Only the table is read; the ramdisks themselves are
+    // copied fd to fd below.
+    auto old_table = updater->Read(
+            o + p + q, hdr->vendor_ramdisk_table_entry_num * sizeof(vendor_ramdisk_table_entry_v4));
+    if (!old_table.ok()) return old_table.error();
+    auto old_table_start = reinterpret_cast<const vendor_ramdisk_table_entry_v4*>(old_table->data());
     auto find_res =
             find_unique_ramdisk(ramdisk_name, old_table_start, hdr->vendor_ramdisk_table_entry_num);
     if (!find_res.ok()) return find_res.error();
@@ -335,71 +416,83 @@ inline uint32_t round_up(uint32_t value, uint32_t page_size) {
     uint32_t replace_idx = replace_entry - old_table_start;
 
     // Now reconstruct.
-    DataUpdater updater(vendor_boot);
 
-    // Copy header (O bytes), then update fields in header.
-    if (auto res = updater.Copy(o); !res.ok()) return res.error();
-    auto new_hdr = reinterpret_cast<vendor_boot_img_hdr_v4*>(updater.new_begin());
+    // Copy header (O bytes), with fields in header updated.
+    auto new_hdr_content = updater->Read(0, o);
+    if (!new_hdr_content.ok()) return new_hdr_content.error();
+    auto new_hdr = reinterpret_cast<vendor_boot_img_hdr_v4*>(new_hdr_content->data());
+    {
+        auto old_ramdisk_entry = old_table_start;
+        uint32_t new_total_ramdisk_size = 0;
+        for (uint32_t idx = 0; idx < hdr->vendor_ramdisk_table_entry_num;
+             idx++, old_ramdisk_entry++) {
+            new_total_ramdisk_size +=
+                    idx == replace_idx ? new_ramdisk_size : old_ramdisk_entry->ramdisk_size;
+        }
+        new_hdr->vendor_ramdisk_size = new_total_ramdisk_size;
+    }
+    if (auto res = updater->Replace(o, *new_hdr_content); !res.ok()) return res.error();
 
     // Copy ramdisk fragments, replace for the matching index.
     {
-        auto old_ramdisk_entry = reinterpret_cast<const vendor_ramdisk_table_entry_v4*>(
-                vendor_boot.data() + o + p + q);
-        uint32_t new_total_ramdisk_size = 0;
+        auto old_ramdisk_entry = old_table_start;
         for (uint32_t new_ramdisk_idx = 0; new_ramdisk_idx < hdr->vendor_ramdisk_table_entry_num;
              new_ramdisk_idx++, old_ramdisk_entry++) {
             if (new_ramdisk_idx == replace_idx) {
-                if (auto res = updater.Replace(replace_entry->ramdisk_size, new_ramdisk); !res.ok())
+                if (auto res = updater->Replace(replace_entry->ramdisk_size, new_ramdisk_fd,
+                                                new_ramdisk_size);
+                    !res.ok())
                     return res.error();
-                new_total_ramdisk_size += new_ramdisk.size();
             } else {
-                if (auto res = updater.Copy(old_ramdisk_entry->ramdisk_size); !res.ok())
+                if (auto res = updater->Copy(old_ramdisk_entry->ramdisk_size); !res.ok())
                     return res.error();
-                new_total_ramdisk_size += old_ramdisk_entry->ramdisk_size;
             }
         }
-        new_hdr->vendor_ramdisk_size = new_total_ramdisk_size;
     }
 
     // Pad ramdisk to page boundary.
     const uint32_t new_p = round_up(new_hdr->vendor_ramdisk_size, new_hdr->page_size);
-    if (auto res = updater.Skip(p - hdr->vendor_ramdisk_size, new_p - new_hdr->vendor_ramdisk_size);
+    if (auto res =
+                updater->Skip(p - hdr->vendor_ramdisk_size, new_p - new_hdr->vendor_ramdisk_size);
         !res.ok())
         return res.error();
-    if (auto res = updater.CheckOffset(o + p, o + new_p); !res.ok()) return res.error();
+    if (auto res = updater->CheckOffset(o + p, o + new_p); !res.ok()) return res.error();
 
     // Copy DTB (Q bytes).
-    if (auto res = updater.Copy(q); !res.ok()) return res.error();
+    if (auto res = updater->Copy(q); !res.ok()) return res.error();
 
     // Copy table, but with corresponding entries modified, including:
     // - ramdisk_size of the entry replaced
     // - ramdisk_offset of subsequent entries.
+    if ((uint64_t)hdr->vendor_ramdisk_table_entry_num * hdr->vendor_ramdisk_table_entry_size > r) {
+        return Errorf("Vendor ramdisk table does not fit in its section, overflow");
+    }
+    const uint32_t table_size =
+            hdr->vendor_ramdisk_table_entry_num * hdr->vendor_ramdisk_table_entry_size;
+    auto new_table = updater->Read(updater->old_cur(), table_size);
+    if (!new_table.ok()) return new_table.error();
     for (uint32_t new_total_ramdisk_size = 0, new_entry_idx = 0;
          new_entry_idx < hdr->vendor_ramdisk_table_entry_num; new_entry_idx++) {
-        auto new_entry = reinterpret_cast<vendor_ramdisk_table_entry_v4*>(updater.new_cur());
-        if (auto res = updater.Copy(hdr->vendor_ramdisk_table_entry_size); !res.ok())
-            return res.error();
+        auto new_entry = reinterpret_cast<vendor_ramdisk_table_entry_v4*>(
+                new_table->data() + new_entry_idx * hdr->vendor_ramdisk_table_entry_size);
         new_entry->ramdisk_offset = new_total_ramdisk_size;
 
         if (new_entry_idx == replace_idx) {
-            new_entry->ramdisk_size = new_ramdisk.size();
+            new_entry->ramdisk_size = new_ramdisk_size;
         }
         new_total_ramdisk_size += new_entry->ramdisk_size;
     }
+    if (auto res = updater->Replace(table_size, *new_table); !res.ok()) return res.error();
 
     // Copy padding of R pages; this is okay because table size is not changed.
-    if (auto res = updater.Copy(r - hdr->vendor_ramdisk_table_entry_num *
-                                            hdr->vendor_ramdisk_table_entry_size);
-        !res.ok())
-        return res.error();
-    if (auto res = updater.CheckOffset(o + p + q + r, o + new_p + q + r); !res.ok())
+    if (auto res = updater->Copy(r - table_size); !res.ok()) return res.error();
+    if (auto res = updater->CheckOffset(o + p + q + r, o + new_p + q + r); !res.ok())
         return res.error();
 
     // Copy bootconfig (S bytes).
-    if (auto res = updater.Copy(s); !res.ok()) return res.error();
+    if (auto res = updater->Copy(s); !res.ok()) return res.error();
 
-    if (auto res = copy_avb_footer(&updater); !res.ok()) return res.error();
-    return updater.Finish();
+    return copy_avb_footer(updater);
 }
 
 }  // namespace
@@ -408,25 +501,52 @@ inline uint32_t round_up(uint32_t value, uint32_t page_size) {
                                                   uint64_t vendor_boot_size,
                                                   const std::string& ramdisk_name,
                                                   android::base::borrowed_fd new_ramdisk_fd,
-                                                  uint64_t new_ramdisk_size) {
+                                                  uint64_t new_ramdisk_size,
+                                                  android::base::borrowed_fd output_fd) {
     if (new_ramdisk_size > std::numeric_limits<uint32_t>::max()) {
         return Errorf("New vendor ramdisk is too big");
     }
 
-    auto vendor_boot = load_file(vendor_boot_fd, vendor_boot_size, "vendor boot");
-    if (!vendor_boot.ok()) return vendor_boot.error();
-    auto new_ramdisk = load_file(new_ramdisk_fd, new_ramdisk_size, "new vendor ramdisk");
-    if (!new_ramdisk.ok()) return new_ramdisk.error();
+    if (auto res = check_file_size(vendor_boot_fd, vendor_boot_size, "vendor boot"); !res.ok())
+        return res.error();
+    if (auto res = check_file_size(new_ramdisk_fd, new_ramdisk_size, "new vendor ramdisk");
+        !res.ok())
+        return res.error();
 
-    Result<std::string> new_vendor_boot;
+    DataUpdater updater(vendor_boot_fd, vendor_boot_size, output_fd);
+    if (auto res = updater.Start(); !res.ok()) return res.error();
+    Result<void> res;
     if (ramdisk_name == "default") {
-        new_vendor_boot = replace_default_vendor_ramdisk(*vendor_boot, *new_ramdisk);
+        res = replace_default_vendor_ramdisk(&updater, new_ramdisk_fd, new_ramdisk_size);
     } else {
-        new_vendor_boot = replace_vendor_ramdisk_fragment(ramdisk_name, *vendor_boot, *new_ramdisk);
+        res = replace_vendor_ramdisk_fragment(&updater, ramdisk_name, new_ramdisk_fd,
+                                              new_ramdisk_size);
     }
-    if (!new_vendor_boot.ok()) return new_vendor_boot.error();
-    if (auto res = store_file(vendor_boot_fd, *new_vendor_boot, "new vendor boot image"); !res.ok())
+    if (!res.ok()) return res.error();
+    return updater.Finish();
+}
+
+[[nodiscard]] Result<void> replace_vendor_ramdisk(android::base::borrowed_fd vendor_boot_fd,
+                                                  uint64_t vendor_boot_size,
+                                                  const std::string& ramdisk_name,
+                                                  android::base::borrowed_fd new_ramdisk_fd,
+                                                  uint64_t new_ramdisk_size) {
+    TemporaryFile new_vendor_boot;
+    if (new_vendor_boot.fd == -1) {
+        return ErrnoErrorf("Cannot create temporary file for new vendor boot image");
+    }
+    if (auto res = replace_vendor_ramdisk(vendor_boot_fd, vendor_boot_size, ramdisk_name,
+                                          new_ramdisk_fd, new_ramdisk_size, new_vendor_boot.fd);
+        !res.ok())
         return res.error();
 
+    // Write the new image back over the old one; it has the same size.
+    if (lseek(vendor_boot_fd.get(), 0, SEEK_SET) != 0) {
+        return ErrnoErrorf("Cannot seek to beginning of new vendor boot image before writing");
+    }
+    if (auto res = copy_fd_range(new_vendor_boot.fd, 0, vendor_boot_fd, vendor_boot_size);
+        !res.ok())
+        return Errorf("Cannot write new content to new vendor boot image: {}",
+                      res.error().message());
     return {};
 }
@@ -32,3 +32,11 @@
         android::base::borrowed_fd vendor_boot_fd, uint64_t vendor_boot_size,
         const std::string& ramdisk_name, android::base::borrowed_fd new_ramdisk_fd,
         uint64_t new_ramdisk_size);
+
+// Same as above, but write the new vendor boot image to |output_fd| and leave |vendor_boot_fd|
+// unchanged. Unchanged parts of the image and the new ramdisk are copied from file to file, so
+// only the header and the ramdisk table are ever held in memory.
+[[nodiscard]] android::base::Result<void> replace_vendor_ramdisk(
+        android::base::borrowed_fd vendor_boot_fd, uint64_t vendor_boot_size,
+        const std::string& ramdisk_name, android::base::borrowed_fd new_ramdisk_fd,
+        uint64_t new_ramdisk_size, android::base::borrowed_fd output_fd);
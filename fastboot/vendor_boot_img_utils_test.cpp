@@ -319,6 +319,30 @@ TEST_P(RepackVendorBootImgTest, ReplaceDefault) {
     EXPECT_THAT(new_content, HasSameAvbFooter(*old_content));
 }
 
+TEST_P(RepackVendorBootImgTest, ReplaceDefaultToOutputFd) {
+    auto old_content = vboot->Read();
+    ASSERT_RESULT_OK(old_content);
+
+    TemporaryFile output;
+    ASSERT_NE(output.fd, -1);
+    ASSERT_RESULT_OK(replace_vendor_ramdisk(vboot->fd(), vboot->size(), "default",
+                                            env->replace->fd(), env->replace->size(), output.fd));
+    auto output_content = ReadStartOfFdToString(output.fd, output.path);
+    ASSERT_RESULT_OK(output_content);
+    EXPECT_EQ(output_content->size(), vboot->size());
+
+    // The input is left alone, and the output matches what an in-place repack produces.
+    auto unchanged_content = vboot->Read();
+    ASSERT_RESULT_OK(unchanged_content);
+    EXPECT_THAT(*unchanged_content, MemEq(*old_content));
+
+    ASSERT_RESULT_OK(replace_vendor_ramdisk(vboot->fd(), vboot->size(), "default",
+                                            env->replace->fd(), env->replace->size()));
+    auto new_content = vboot->Read();
+    ASSERT_RESULT_OK(new_content);
+    EXPECT_THAT(*output_content, MemEq(*new_content));
+}
+
 INSTANTIATE_TEST_SUITE_P(
         RepackVendorBootImgTest, RepackVendorBootImgTest,
         ::testing::Values(RepackVendorBootImgTestParam{"vendor_boot_v3.img", 3},
@@ -35,12 +35,16 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <functional>
+#include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <numeric>
+#include <set>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -49,12 +53,14 @@
 
 #include <android-base/chrono_utils.h>
 #include <android-base/file.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <cutils/android_filesystem_config.h>
 #include <cutils/android_reboot.h>
+#include <cutils/iosched_policy.h>
 #include <cutils/partition_utils.h>
 #include <cutils/properties.h>
 #include <ext4_utils/ext4.h>
@@ -727,6 +733,82 @@ static bool check_if_preventative_fsck_needed(const FstabEntry& entry) {
     return true;
 }
 
+// Clean shutdown records for entries with the "check" flag, one file per mount point. Each boot
+// rewrites the record as "dirty <n>" before mounting, and init rewrites it as "clean <n>" right
+// before it unmounts everything at shutdown, where <n> is how many boots in a row have skipped
+// fsck. A record only says clean if the previous shutdown got that far.
+static constexpr const char* kFsckRecordDir = "/metadata/fsck";
+
+static std::string fsck_record_path(const std::string& mount_point) {
+    std::string name = mount_point.substr(mount_point.find_first_not_of('/'));
+    std::replace(name.begin(), name.end(), '/', '_');
+    return std::string(kFsckRecordDir) + "/" + name;
+}
+
+static bool read_fsck_record(const std::string& path, bool* clean, unsigned int* skips) {
+    std::string record;
+    if (!android::base::ReadFileToString(path, &record)) {
+        return false;
+    }
+    auto fields = android::base::Split(android::base::Trim(record), " ");
+    if (fields.size() != 2 || !android::base::ParseUint(fields[1], skips)) {
+        LERROR << "Malformed fsck record " << path;
+        return false;
+    }
+    *clean = fields[0] == "clean";
+    return true;
+}
+
+// Decides whether an entry with the "check" flag can do without fsck on this boot: its last
+// unmount was recorded as clean, the superblock agrees, and it hasn't skipped fsck on
+// ro.fs_mgr.fsck_max_skips boots in a row already. Only ext4 is considered, since that is where
+// the superblock tells us whether the unmount really completed.
+static bool can_skip_fsck(const FstabEntry& entry, int fs_stat) {
+    if (!is_extfs(entry.fs_type) || entry.mount_point.find_first_not_of('/') == std::string::npos) {
+        return false;
+    }
+    auto path = fsck_record_path(entry.mount_point);
+    bool clean = false;
+    unsigned int skips = 0;
+    read_fsck_record(path, &clean, &skips);
+
+    auto max_skips = GetUintProperty("ro.fs_mgr.fsck_max_skips", 10u);
+    bool skip = clean && skips < max_skips &&
+                !(fs_stat & (FS_STAT_UNCLEAN_SHUTDOWN | FS_STAT_QUOTA_ENABLED));
+    skips = skip ? skips + 1 : 0;
+
+    // If the record can't be rewritten, a crash on this boot would go unnoticed; check instead.
+    mkdir(kFsckRecordDir, 0700);
+    if (!android::base::WriteStringToFile(StringPrintf("dirty %u\n", skips), path)) {
+        if (skip) PERROR << "Failed to write file " << path;
+        return false;
+    }
+    if (skip) {
+        LINFO << "Skipping fsck on " << entry.mount_point << ", it was unmounted cleanly ("
+              << skips << "/" << max_skips << ")";
+    }
+    return skip;
+}
+
+bool fs_mgr_set_clean_shutdown(const std::string& mount_point, bool clean) {
+    if (mount_point.find_first_not_of('/') == std::string::npos) {
+        return false;
+    }
+    auto path = fsck_record_path(mount_point);
+    bool was_clean;
+    unsigned int skips;
+    if (!read_fsck_record(path, &was_clean, &skips)) {
+        // Nothing is checked on this mount point at boot.
+        return false;
+    }
+    auto record = StringPrintf("%s %u\n", clean ? "clean" : "dirty", skips);
+    if (!android::base::WriteStringToFile(record, path)) {
+        PERROR << "Failed to write file " << path;
+        return false;
+    }
+    return true;
+}
+
 //
 // Prepare the filesystem on the given block device to be mounted.
 //
@@ -777,7 +859,8 @@ static int prepare_fs_for_mount(const std::string& blk_device, const FstabEntry&
         }
     }
 
-    if (check_if_preventative_fsck_needed(entry) || entry.fs_mgr_flags.check ||
+    if (check_if_preventative_fsck_needed(entry) ||
+        (entry.fs_mgr_flags.check && !can_skip_fsck(entry, fs_stat)) ||
         (fs_stat & (FS_STAT_UNCLEAN_SHUTDOWN | FS_STAT_QUOTA_ENABLED))) {
         check_fs(blk_device, entry.fs_type, mount_point, &fs_stat);
     }
@@ -963,7 +1046,10 @@ static bool mount_with_alternatives(Fstab& fstab, int start_idx, int* end_idx, i
             fstab[i].blk_device = fstab[start_idx].blk_device;
         }
 
+        Timer prepare_timer;
         int fs_stat = prepare_fs_for_mount(fstab[i].blk_device, fstab[i]);
+        SetProperty("ro.boottime.init.prepare." + Basename(fstab[i].mount_point),
+                    std::to_string(prepare_timer.duration().count()));
         if (fs_stat & FS_STAT_INVALID_MAGIC) {
             LERROR << __FUNCTION__
                    << "(): skipping mount due to invalid magic, mountpoint=" << fstab[i].mount_point
@@ -1422,9 +1508,142 @@ static bool IsMountPointMounted(const std::string& mount_point) {
     return GetEntryForMountPoint(&fstab, mount_point) != nullptr;
 }
 
+// Makes dm-verity load the hashtree of |device_name| into its buffer cache, so that the first
+// reads from the mounted file system don't stall on hash block misses. Reading one data block
+// for every hash block at the bottom of the tree is enough to pull in every level above it.
+// O_DIRECT keeps the data blocks themselves out of the page cache.
+static void PrewarmHashtree(const std::string& device_name) {
+    DeviceMapper& dm = DeviceMapper::Instance();
+    std::vector<DeviceMapper::TargetInfo> table;
+    std::string path;
+    if (!dm.GetTableInfo(device_name, &table) || table.size() != 1 ||
+        strcmp(table[0].spec.target_type, "verity") != 0 ||
+        !dm.GetDmDevicePathByName(device_name, &path)) {
+        LERROR << "Not prewarming " << device_name << ": not a verity device";
+        return;
+    }
+
+    // <version> <dev> <hash_dev> <data_block_size> <hash_block_size> <num_data_blocks>
+    // <hash_start_block> <algorithm> <digest> <salt> [<#opt_params> <opt_params>]
+    auto tokens = android::base::Split(table[0].data, " ");
+    uint32_t data_block_size, hash_block_size;
+    uint64_t num_data_blocks;
+    if (tokens.size() < 10 || !android::base::ParseUint(tokens[3], &data_block_size) ||
+        !android::base::ParseUint(tokens[4], &hash_block_size) ||
+        !android::base::ParseUint(tokens[5], &num_data_blocks) || tokens[8].size() < 2 ||
+        data_block_size == 0) {
+        LERROR << "Not prewarming " << device_name << ": unexpected table " << table[0].data;
+        return;
+    }
+    // dm-verity packs a power of two hashes into each hash block.
+    const uint64_t digest_size = tokens[8].size() / 2;
+    uint64_t hashes_per_block = 1;
+    while (hashes_per_block * 2 * digest_size <= hash_block_size) {
+        hashes_per_block *= 2;
+    }
+
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC)));
+    if (fd < 0) {
+        PERROR << "Failed to open " << path;
+        return;
+    }
+    std::unique_ptr<void, decltype(&free)> buffer(aligned_alloc(data_block_size, data_block_size),
+                                                  free);
+    if (!buffer) {
+        LERROR << "Failed to allocate " << data_block_size << " bytes";
+        return;
+    }
+
+    Timer t;
+    for (uint64_t block = 0; block < num_data_blocks; block += hashes_per_block) {
+        off64_t offset = block * data_block_size;
+        if (TEMP_FAILURE_RETRY(pread64(fd, buffer.get(), data_block_size, offset)) !=
+            static_cast<ssize_t>(data_block_size)) {
+            PERROR << "Failed to read " << path << " at " << offset;
+            return;
+        }
+    }
+    LINFO << "Prewarmed hashtree of " << device_name << " in " << t;
+}
+
+// Warms the hashtree of every mounted entry with the hashtree_prewarm flag, one device after
+// another on a background thread at idle I/O priority. mount_all runs more than once during
+// boot, so each device is only picked up the first time.
+static void StartHashtreePrewarm(const Fstab& fstab) {
+    static std::mutex started_lock;
+    static std::set<std::string> started;
+
+    DeviceMapper& dm = DeviceMapper::Instance();
+    std::vector<std::string> device_names;
+    {
+        std::lock_guard<std::mutex> lock(started_lock);
+        for (const auto& entry : fstab) {
+            if (!entry.fs_mgr_flags.hashtree_prewarm ||
+                (!entry.fs_mgr_flags.avb && entry.avb_keys.empty())) {
+                continue;
+            }
+            auto device_name = GetVerityDeviceName(entry);
+            if (dm.GetState(device_name) == DmDeviceState::INVALID ||
+                !started.emplace(device_name).second) {
+                continue;
+            }
+            device_names.emplace_back(std::move(device_name));
+        }
+    }
+    if (device_names.empty()) {
+        return;
+    }
+
+    std::thread([device_names = std::move(device_names)]() {
+        android_set_ioprio(0, IoSchedClass_IDLE, 7);
+        for (const auto& device_name : device_names) {
+            PrewarmHashtree(device_name);
+        }
+    }).detach();
+}
+
+// Returns true if |a| and |b| are the same mount point or one of them is below the other.
+static bool MountPointsNested(const std::string& a, const std::string& b) {
+    const auto& outer = a.size() <= b.size() ? a : b;
+    const auto& inner = a.size() <= b.size() ? b : a;
+    if (!StartsWith(inner, outer)) {
+        return false;
+    }
+    return inner.size() == outer.size() || outer.back() == '/' || inner[outer.size()] == '/';
+}
+
+// Whether fs_mgr_mount_all() may prepare and mount |entry| on a worker thread while it goes on
+// setting up the entries after it. Entries that involve vold, formatting or checkpointing, or
+// whose source may live on another mount point, are mounted inline once everything before them
+// is done.
+static bool CanMountInParallel(const FstabEntry& entry) {
+    if (entry.mount_point == "/data" || entry.fs_mgr_flags.formattable ||
+        entry.fs_mgr_flags.checkpoint_blk || entry.fs_mgr_flags.checkpoint_fs ||
+        should_use_metadata_encryption(entry) || !entry.avb_keys.empty()) {
+        return false;
+    }
+    return entry.fs_mgr_flags.logical || StartsWith(entry.blk_device, "/dev/") ||
+           StartsWith(entry.blk_device, "LABEL=");
+}
+
+struct ParallelMountResult {
+    bool mounted;
+    int attempted_idx;
+    int mount_errno;
+};
+
+struct ParallelMount {
+    int top_idx;
+    std::shared_future<ParallelMountResult> result;
+};
+
 // When multiple fstab records share the same mount_point, it will try to mount each
 // one in turn, and ignore any duplicates after a first successful mount.
 // Returns -1 on error, and  FS_MGR_MNTALL_* otherwise.
+//
+// Entries allowed by CanMountInParallel() are prepared and mounted on worker threads. Each one
+// waits for the earlier entries on the same block device or on a parent or child mount point,
+// and their results are handled in fstab order before the next entry that must be mounted inline.
 MountAllResult fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
     int encryptable = FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE;
     int error_count = 0;
@@ -1438,6 +1657,48 @@ MountAllResult fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
     }
 
     bool scratch_can_be_mounted = true;
+    std::mutex overlayfs_lock;
+
+    const bool parallel_mount = GetBoolProperty("ro.fs_mgr.mount_all.parallel", true);
+    std::vector<ParallelMount> parallel_mounts;
+
+    // Waits for every pending worker and handles its result as the inline path below would.
+    // Entries that get here are never formattable or metadata encrypted.
+    auto finish_parallel_mounts = [&]() {
+        for (const auto& job : parallel_mounts) {
+            const auto& result = job.result.get();
+            auto& current_entry = (*fstab)[job.top_idx];
+            auto& attempted_entry = (*fstab)[result.attempted_idx];
+            if (result.mounted) {
+                int status = handle_encryptable(attempted_entry);
+                if (status != FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE) {
+                    if (encryptable != FS_MGR_MNTALL_DEV_NOT_ENCRYPTABLE) {
+                        LERROR << "Only one encryptable/encrypted partition supported";
+                    }
+                    encryptable = status;
+                }
+                continue;
+            }
+
+            wiped = partition_wiped(current_entry.blk_device.c_str());
+            errno = result.mount_errno;
+            if (attempted_entry.fs_mgr_flags.no_fail) {
+                PERROR << android::base::StringPrintf(
+                        "Ignoring failure to mount an un-encryptable or wiped "
+                        "partition on %s at %s options: %s",
+                        attempted_entry.blk_device.c_str(), attempted_entry.mount_point.c_str(),
+                        attempted_entry.fs_options.c_str());
+            } else {
+                PERROR << android::base::StringPrintf(
+                        "Failed to mount an un-encryptable or wiped partition "
+                        "on %s at %s options: %s",
+                        attempted_entry.blk_device.c_str(), attempted_entry.mount_point.c_str(),
+                        attempted_entry.fs_options.c_str());
+                ++error_count;
+            }
+        }
+        parallel_mounts.clear();
+    };
 
     // Keep i int to prevent unsigned integer overflow from (i = top_idx - 1),
     // where top_idx is 0. It will give SIGABRT
@@ -1481,6 +1742,11 @@ MountAllResult fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
             continue;
         }
 
+        const bool mount_in_parallel = parallel_mount && CanMountInParallel(current_entry);
+        if (!mount_in_parallel) {
+            finish_parallel_mounts();
+        }
+
         // Translate LABEL= file system labels into block devices.
         if (is_extfs(current_entry.fs_type)) {
             if (!TranslateExtLabels(&current_entry)) {
@@ -1532,6 +1798,53 @@ MountAllResult fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
             }
         }
 
+        if (mount_in_parallel) {
+            int top_idx = i;
+            // Skip the alternatives for this mount point; the worker tries them in turn.
+            while (i + 1 < static_cast<int>(fstab->size()) &&
+                   (*fstab)[i + 1].mount_point == current_entry.mount_point) {
+                i++;
+            }
+
+            std::vector<std::shared_future<ParallelMountResult>> deps;
+            for (const auto& job : parallel_mounts) {
+                const auto& entry = (*fstab)[job.top_idx];
+                if (entry.blk_device == current_entry.blk_device ||
+                    MountPointsNested(entry.mount_point, current_entry.mount_point)) {
+                    deps.emplace_back(job.result);
+                }
+            }
+
+            auto worker = [fstab, top_idx, deps = std::move(deps), &overlayfs_lock,
+                           &scratch_can_be_mounted]() {
+                Timer wait_timer;
+                for (const auto& dep : deps) {
+                    dep.wait();
+                }
+                if (!deps.empty()) {
+                    LINFO << "Mounting " << (*fstab)[top_idx].mount_point << " waited "
+                          << wait_timer.duration().count() << "ms for " << deps.size()
+                          << " earlier mount(s)";
+                }
+
+                ParallelMountResult result = {};
+                int last_idx_inspected;
+                result.mounted = mount_with_alternatives(*fstab, top_idx, &last_idx_inspected,
+                                                         &result.attempted_idx);
+                result.mount_errno = errno;
+                if (result.mounted) {
+                    // Mount points below this one wait for us, so that they end up on top of
+                    // the overlay rather than underneath it.
+                    std::lock_guard<std::mutex> lock(overlayfs_lock);
+                    MountOverlayfs((*fstab)[result.attempted_idx], &scratch_can_be_mounted);
+                }
+                return result;
+            };
+            parallel_mounts.push_back(
+                    {top_idx, std::async(std::launch::async, std::move(worker)).share()});
+            continue;
+        }
+
         int last_idx_inspected;
         int top_idx = i;
         int attempted_idx = -1;
@@ -1662,6 +1975,9 @@ MountAllResult fs_mgr_mount_all(Fstab* fstab, int mount_mode) {
             continue;
         }
     }
+    finish_parallel_mounts();
+    StartHashtreePrewarm(*fstab);
+
     if (userdata_mounted) {
         Fstab mounted_fstab;
         if (!ReadFstabFromFile("/proc/mounts", &mounted_fstab)) {
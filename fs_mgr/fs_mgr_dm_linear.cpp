@@ -159,6 +159,9 @@ bool CreateLogicalPartitions(const LpMetadata& metadata, const std::string& supe
             .force_writable = true,
 #endif
     };
+    // Build every table first, so that all the devices can be created in one
+    // batch.
+    std::vector<std::pair<std::string, DmTable>> devices;
     for (const auto& partition : metadata.partitions) {
         if (!partition.num_extents) {
             LINFO << "Skipping zero-length logical partition: " << GetPartitionName(partition);
@@ -169,13 +172,26 @@ bool CreateLogicalPartitions(const LpMetadata& metadata, const std::string& supe
             continue;
         }
 
-        params.partition = &partition;
+        CreateLogicalPartitionParams partition_params = params;
+        partition_params.partition = &partition;
 
-        std::string ignore_path;
-        if (!CreateLogicalPartition(params, &ignore_path)) {
+        CreateLogicalPartitionParams::OwnedData owned_data;
+        DmTable table;
+        if (!partition_params.InitDefaults(&owned_data) ||
+            !CreateDmTableInternal(partition_params, &table)) {
             LERROR << "Could not create logical partition: " << GetPartitionName(partition);
             return false;
         }
+        devices.emplace_back(partition_params.device_name, std::move(table));
+    }
+
+    std::vector<std::string> paths;
+    if (!DeviceMapper::Instance().CreateDevices(devices, &paths, params.timeout_ms)) {
+        LERROR << "Could not create logical partitions on " << super_device;
+        return false;
+    }
+    for (size_t i = 0; i < devices.size(); i++) {
+        LINFO << "Created logical partition " << devices[i].first << " on device " << paths[i];
     }
     return true;
 }
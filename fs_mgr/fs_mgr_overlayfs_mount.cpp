@@ -397,7 +397,68 @@ static std::vector<mount_info> ReadMountinfoFromFile(const std::string& path) {
     return info;
 }
 
-static bool fs_mgr_overlayfs_mount_one(const FstabEntry& fstab_entry) {
+static bool OverlayfsAlreadyMounted(const Fstab& mounts, const std::string& mount_point,
+                                    bool overlay_only = true) {
+    const auto lowerdir = kLowerdirOption + mount_point;
+    for (const auto& entry : mounts) {
+        if (entry.mount_point != mount_point) {
+            continue;
+        }
+        if (!overlay_only) {
+            return true;
+        }
+        if (entry.fs_type != "overlay" && entry.fs_type != "overlayfs") {
+            continue;
+        }
+        const auto options = android::base::Split(entry.fs_options, ",");
+        for (const auto& opt : options) {
+            if (opt == lowerdir) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Mount table shared by one fs_mgr_overlayfs_mount_all() pass. It is parsed once up front and
+// then kept in sync with the mounts the pass itself makes, so checking and mounting many
+// partitions doesn't reparse /proc/mounts and /proc/self/mountinfo for each of them.
+struct MountSnapshot {
+    Fstab mounts;
+    std::vector<mount_info> mountinfo;
+
+    bool Load() {
+        mounts.clear();
+        if (!ReadFstabFromProcMounts(&mounts)) {
+            PLOG(ERROR) << "Failed to read /proc/mounts";
+            mountinfo.clear();
+            return false;
+        }
+        mountinfo = ReadMountinfoFromFile("/proc/self/mountinfo");
+        return true;
+    }
+
+    void AddMount(const std::string& source, const std::string& mount_point,
+                  const std::string& fs_type, const std::string& fs_options, bool shared_flag) {
+        FstabEntry entry;
+        entry.blk_device = source;
+        entry.mount_point = mount_point;
+        entry.fs_type = fs_type;
+        entry.fs_options = fs_options;
+        mounts.push_back(std::move(entry));
+        mountinfo.push_back({mount_point, shared_flag});
+    }
+
+    // Record a propagation change of the topmost mount at |mount_point|.
+    void SetShared(const std::string& mount_point, bool shared_flag) {
+        auto it = std::find_if(mountinfo.rbegin(), mountinfo.rend(), [&](const auto& entry) {
+            return entry.mount_point == mount_point;
+        });
+        if (it != mountinfo.rend()) it->shared_flag = shared_flag;
+    }
+};
+
+static bool fs_mgr_overlayfs_mount_one(const FstabEntry& fstab_entry, MountSnapshot* snapshot) {
     const auto mount_point = fs_mgr_mount_point(fstab_entry.mount_point);
     const auto options = fs_mgr_get_overlayfs_options(fstab_entry);
     if (options.empty()) return false;
@@ -420,7 +481,7 @@ static bool fs_mgr_overlayfs_mount_one(const FstabEntry& fstab_entry) {
     // Only move mount the last entry in an over mount group, because the other entries are
     // overshadowed and only the filesystem mounted with the last entry participates in file
     // pathname resolution.
-    auto mountinfo = ReadMountinfoFromFile("/proc/self/mountinfo");
+    auto mountinfo = snapshot->mountinfo;
     std::stable_sort(mountinfo.begin(), mountinfo.end(), [](const auto& lhs, const auto& rhs) {
         return lhs.mount_point < rhs.mount_point;
     });
@@ -511,7 +572,8 @@ static bool fs_mgr_overlayfs_mount_one(const FstabEntry& fstab_entry) {
         moved_mounts.push_back(std::move(new_entry));
     }
 
-    retval &= fs_mgr_overlayfs_mount(mount_point, options);
+    const bool mounted = fs_mgr_overlayfs_mount(mount_point, options);
+    retval &= mounted;
 
     // Move submounts back.
     for (const auto& entry : moved_mounts) {
@@ -531,6 +593,24 @@ static bool fs_mgr_overlayfs_mount_one(const FstabEntry& fstab_entry) {
         fs_mgr_overlayfs_set_shared_mount("/", true);
     }
 
+    if (!retval) {
+        // Some step went wrong and the mount table may now differ from what we'd predict,
+        // e.g. a submount left behind in kMoveMountTempDir. Start over from the kernel's view.
+        snapshot->Load();
+    } else if (mounted) {
+        // The overlay now stacks on |mount_point| and every moved submount stacks back on top
+        // of it, in that order, just as the kernel lists them.
+        snapshot->AddMount("overlay", mount_point, "overlay", options, parent_shared);
+        for (const auto& entry : moved_mounts) {
+            auto it = std::find_if(
+                    snapshot->mounts.rbegin(), snapshot->mounts.rend(),
+                    [&](const auto& mount) { return mount.mount_point == entry.mount_point; });
+            if (it == snapshot->mounts.rend()) continue;
+            const auto moved = *it;
+            snapshot->AddMount(moved.blk_device, moved.mount_point, moved.fs_type,
+                               moved.fs_options, entry.shared_flag);
+        }
+    }
     return retval;
 }
 
@@ -644,26 +724,20 @@ bool fs_mgr_wants_overlayfs(FstabEntry* entry) {
     return true;
 }
 
-Fstab fs_mgr_overlayfs_candidate_list(const Fstab& fstab) {
-    android::fs_mgr::Fstab mounts;
-    if (!android::fs_mgr::ReadFstabFromFile("/proc/mounts", &mounts)) {
-        PLOG(ERROR) << "Failed to read /proc/mounts";
-        return {};
-    }
-
+static Fstab OverlayfsCandidateList(const Fstab& fstab, const Fstab& mounts) {
     Fstab candidates;
     for (const auto& entry : fstab) {
         // Filter out partitions whose type doesn't match what's mounted.
         // This avoids spammy behavior on devices which can mount different
         // filesystems for each partition.
         auto proc_mount_point = (entry.mount_point == "/system") ? "/" : entry.mount_point;
-        auto mounted = GetEntryForMountPoint(&mounts, proc_mount_point);
+        const auto mounted = GetEntryForMountPoint(&mounts, proc_mount_point);
         if (!mounted || mounted->fs_type != entry.fs_type) {
             continue;
         }
 
         FstabEntry new_entry = entry;
-        if (!fs_mgr_overlayfs_already_mounted(entry.mount_point) &&
+        if (!OverlayfsAlreadyMounted(mounts, entry.mount_point) &&
             !fs_mgr_wants_overlayfs(&new_entry)) {
             continue;
         }
@@ -678,6 +752,15 @@ Fstab fs_mgr_overlayfs_candidate_list(const Fstab& fstab) {
     return candidates;
 }
 
+Fstab fs_mgr_overlayfs_candidate_list(const Fstab& fstab) {
+    Fstab mounts;
+    if (!ReadFstabFromProcMounts(&mounts)) {
+        PLOG(ERROR) << "Failed to read /proc/mounts";
+        return {};
+    }
+    return OverlayfsCandidateList(fstab, mounts);
+}
+
 static void TryMountScratch() {
     // Note we get the boot scratch device here, which means if scratch was
     // just created through ImageManager, this could fail. In practice this
@@ -711,33 +794,43 @@ bool fs_mgr_overlayfs_mount_all(Fstab* fstab) {
     // to itself and set to MS_PRIVATE.
     // Otherwise mounts moved in to it would have their propagation type changed unintentionally.
     // Section 5d, https://www.kernel.org/doc/Documentation/filesystems/sharedsubtree.txt
-    if (!fs_mgr_overlayfs_already_mounted(kMoveMountTempDir, false)) {
+    MountSnapshot snapshot;
+    snapshot.Load();
+    if (!OverlayfsAlreadyMounted(snapshot.mounts, kMoveMountTempDir, false)) {
         if (mkdir(kMoveMountTempDir, 0755) && errno != EEXIST) {
             PERROR << "mkdir " << kMoveMountTempDir;
         }
         if (mount(kMoveMountTempDir, kMoveMountTempDir, nullptr, MS_BIND, nullptr)) {
             PERROR << "bind mount " << kMoveMountTempDir;
+        } else {
+            snapshot.AddMount(kMoveMountTempDir, kMoveMountTempDir, "", "", true);
         }
     }
-    fs_mgr_overlayfs_set_shared_mount(kMoveMountTempDir, false);
+    if (fs_mgr_overlayfs_set_shared_mount(kMoveMountTempDir, false)) {
+        snapshot.SetShared(kMoveMountTempDir, false);
+    }
     android::base::ScopeGuard umountDir([]() {
         umount(kMoveMountTempDir);
         rmdir(kMoveMountTempDir);
     });
 
     auto ret = true;
-    auto scratch_can_be_mounted = !fs_mgr_overlayfs_already_mounted(kScratchMountPoint, false);
-    for (const auto& entry : fs_mgr_overlayfs_candidate_list(*fstab)) {
+    auto scratch_can_be_mounted =
+            !OverlayfsAlreadyMounted(snapshot.mounts, kScratchMountPoint, false);
+    for (const auto& entry : OverlayfsCandidateList(*fstab, snapshot.mounts)) {
         if (fs_mgr_is_verity_enabled(entry)) continue;
         auto mount_point = fs_mgr_mount_point(entry.mount_point);
-        if (fs_mgr_overlayfs_already_mounted(mount_point)) {
+        if (OverlayfsAlreadyMounted(snapshot.mounts, mount_point)) {
             continue;
         }
         if (scratch_can_be_mounted) {
             scratch_can_be_mounted = false;
             TryMountScratch();
+            // Scratch may have been mounted, possibly twice; its propagation depends on the
+            // parent mount, so reread rather than guess. This happens at most once per pass.
+            snapshot.Load();
         }
-        ret &= fs_mgr_overlayfs_mount_one(entry);
+        ret &= fs_mgr_overlayfs_mount_one(entry, &snapshot);
     }
     return ret;
 }
@@ -746,39 +839,28 @@ bool fs_mgr_overlayfs_is_setup() {
     if (!OverlayfsSetupAllowed()) {
         return false;
     }
-    if (fs_mgr_overlayfs_already_mounted(kScratchMountPoint, false)) return true;
+    Fstab mounts;
+    if (!ReadFstabFromProcMounts(&mounts)) {
+        return false;
+    }
+    if (OverlayfsAlreadyMounted(mounts, kScratchMountPoint, false)) return true;
     Fstab fstab;
     if (!ReadDefaultFstab(&fstab)) {
         return false;
     }
-    for (const auto& entry : fs_mgr_overlayfs_candidate_list(fstab)) {
+    for (const auto& entry : OverlayfsCandidateList(fstab, mounts)) {
         if (fs_mgr_is_verity_enabled(entry)) continue;
-        if (fs_mgr_overlayfs_already_mounted(fs_mgr_mount_point(entry.mount_point))) return true;
+        if (OverlayfsAlreadyMounted(mounts, fs_mgr_mount_point(entry.mount_point))) return true;
     }
     return false;
 }
 
 bool fs_mgr_overlayfs_already_mounted(const std::string& mount_point, bool overlay_only) {
-    Fstab fstab;
-    if (!ReadFstabFromProcMounts(&fstab)) {
+    Fstab mounts;
+    if (!ReadFstabFromProcMounts(&mounts)) {
         return false;
     }
-    const auto lowerdir = kLowerdirOption + mount_point;
-    for (const auto& entry : GetEntriesForMountPoint(&fstab, mount_point)) {
-        if (!overlay_only) {
-            return true;
-        }
-        if (entry->fs_type != "overlay" && entry->fs_type != "overlayfs") {
-            continue;
-        }
-        const auto options = android::base::Split(entry->fs_options, ",");
-        for (const auto& opt : options) {
-            if (opt == lowerdir) {
-                return true;
-            }
-        }
-    }
-    return false;
+    return OverlayfsAlreadyMounted(mounts, mount_point, overlay_only);
 }
 
 namespace android {
@@ -788,7 +870,12 @@ void MountOverlayfs(const FstabEntry& fstab_entry, bool* scratch_can_be_mounted)
     if (!OverlayfsSetupAllowed()) {
         return;
     }
-    const auto candidates = fs_mgr_overlayfs_candidate_list({fstab_entry});
+    Fstab mounts;
+    if (!ReadFstabFromProcMounts(&mounts)) {
+        PLOG(ERROR) << "Failed to read /proc/mounts";
+        return;
+    }
+    const auto candidates = OverlayfsCandidateList({fstab_entry}, mounts);
     if (candidates.empty()) {
         return;
     }
@@ -797,12 +884,12 @@ void MountOverlayfs(const FstabEntry& fstab_entry, bool* scratch_can_be_mounted)
         return;
     }
     const auto mount_point = fs_mgr_mount_point(entry.mount_point);
-    if (fs_mgr_overlayfs_already_mounted(mount_point)) {
+    if (OverlayfsAlreadyMounted(mounts, mount_point)) {
         return;
     }
     if (*scratch_can_be_mounted) {
         *scratch_can_be_mounted = false;
-        if (!fs_mgr_overlayfs_already_mounted(kScratchMountPoint, false)) {
+        if (!OverlayfsAlreadyMounted(mounts, kScratchMountPoint, false)) {
             TryMountScratch();
         }
     }
@@ -123,6 +123,13 @@ enum FsMgrUmountStatus : int {
     ERROR_VERITY = 1 << 2,
     ERROR_DEVICE_MAPPER = 1 << 3,
 };
+// Marks the last unmount of |mount_point| as clean or not. init calls this with |clean| set right
+// before it unmounts the file systems at shutdown, and again without it if the unmount fails. The
+// next boot may skip the fsck that the "check" fstab flag asks for on an ext4 file system if the
+// record says clean and the superblock agrees, but not on more than ro.fs_mgr.fsck_max_skips
+// (default 10) boots in a row. Returns false if |mount_point| has no record.
+bool fs_mgr_set_clean_shutdown(const std::string& mount_point, bool clean);
+
 // fs_mgr_umount_all() is the reverse of fs_mgr_mount_all. In particular,
 // it destroys verity devices from device mapper after the device is unmounted.
 int fs_mgr_umount_all(android::fs_mgr::Fstab* fstab);
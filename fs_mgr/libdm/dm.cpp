@@ -22,6 +22,7 @@
 #include <sys/types.h>
 #include <sys/utsname.h>
 
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <string_view>
@@ -185,13 +186,34 @@ bool DeviceMapper::CreateEmptyDevice(const std::string& name) {
 
 bool DeviceMapper::WaitForDevice(const std::string& name,
                                  const std::chrono::milliseconds& timeout_ms, std::string* path) {
+    std::vector<std::string> paths;
+    if (!WaitForDevices({name}, timeout_ms, &paths)) {
+        return false;
+    }
+    *path = paths[0];
+    return true;
+}
+
+bool DeviceMapper::WaitForDevices(const std::vector<std::string>& names,
+                                  const std::chrono::milliseconds& timeout_ms,
+                                  std::vector<std::string>* paths) {
+    auto delete_all = [&]() {
+        for (const auto& name : names) {
+            DeleteDevice(name);
+        }
+    };
+
     // We use the unique path for testing whether the device is ready. After
     // that, it's safe to use the dm-N path which is compatible with callers
     // that expect it to be formatted as such.
-    std::string unique_path;
-    if (!GetDeviceUniquePath(name, &unique_path) || !GetDmDevicePathByName(name, path)) {
-        DeleteDevice(name);
-        return false;
+    std::vector<std::string> unique_paths(names.size());
+    paths->assign(names.size(), {});
+    for (size_t i = 0; i < names.size(); i++) {
+        if (!GetDeviceUniquePath(names[i], &unique_paths[i]) ||
+            !GetDmDevicePathByName(names[i], &(*paths)[i])) {
+            delete_all();
+            return false;
+        }
     }
 
     if (timeout_ms <= std::chrono::milliseconds::zero()) {
@@ -203,35 +225,67 @@ bool DeviceMapper::WaitForDevice(const std::string& name,
         int sdk = android::base::GetIntProperty("ro.build.version.sdk", 0);
         if (non_ab_device && sdk && sdk <= 29) {
             LOG(INFO) << "Detected ueventd incompatibility, reverting to legacy libdm behavior.";
-            unique_path = *path;
+            unique_paths = *paths;
         }
     }
 
-    if (!WaitForFile(unique_path, timeout_ms)) {
-        LOG(ERROR) << "Failed waiting for device path: " << unique_path;
-        DeleteDevice(name);
+    auto start_time = std::chrono::steady_clock::now();
+    bool ok = WaitForFiles(unique_paths, timeout_ms);
+    RecordWait(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start_time));
+    if (!ok) {
+        for (const auto& path : unique_paths) {
+            if (access(path.c_str(), F_OK) != 0) {
+                LOG(ERROR) << "Failed waiting for device path: " << path;
+            }
+        }
+        delete_all();
         return false;
     }
     return true;
 }
 
-bool DeviceMapper::CreateDevice(const std::string& name, const DmTable& table, std::string* path,
-                                const std::chrono::milliseconds& timeout_ms) {
-    if (!CreateEmptyDevice(name)) {
-        return false;
+void DeviceMapper::RecordWait(std::chrono::milliseconds duration) {
+    std::lock_guard<std::mutex> lock(wait_stats_lock_);
+    size_t bucket = 0;
+    while (bucket + 1 < wait_stats_.buckets.size() && (1 << bucket) <= duration.count()) {
+        bucket++;
     }
+    wait_stats_.buckets[bucket]++;
+    wait_stats_.count++;
+    wait_stats_.total += duration;
+    wait_stats_.max = std::max(wait_stats_.max, duration);
+}
 
-    if (!LoadTableAndActivate(name, table)) {
-        DeleteDevice(name);
-        return false;
-    }
+DeviceMapper::WaitStats DeviceMapper::GetWaitStats() const {
+    std::lock_guard<std::mutex> lock(wait_stats_lock_);
+    return wait_stats_;
+}
 
-    if (!WaitForDevice(name, timeout_ms, path)) {
-        DeleteDevice(name);
-        return false;
+bool DeviceMapper::CreateDevices(const std::vector<std::pair<std::string, DmTable>>& devices,
+                                 std::vector<std::string>* paths,
+                                 const std::chrono::milliseconds& timeout_ms) {
+    std::vector<std::string> names;
+    auto delete_all = [&]() {
+        for (const auto& name : names) {
+            DeleteDevice(name);
+        }
+    };
+
+    for (const auto& [name, table] : devices) {
+        if (!CreateEmptyDevice(name)) {
+            delete_all();
+            return false;
+        }
+        names.emplace_back(name);
+        if (!LoadTableAndActivate(name, table)) {
+            delete_all();
+            return false;
+        }
     }
 
-    return true;
+    // WaitForDevices deletes the devices itself if it fails.
+    return WaitForDevices(names, timeout_ms, paths);
 }
 
 bool DeviceMapper::GetDeviceUniquePath(const std::string& name, std::string* path) {
@@ -18,6 +18,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
 #include <time.h>
@@ -763,6 +764,74 @@ TEST_F(DmTest, UeventAfterLoadTable) {
     ASSERT_TRUE(dm.DeleteDevice(test_name_));
 }
 
+TEST_F(DmTest, CreateDevices) {
+    DeviceMapper& dm = DeviceMapper::Instance();
+
+    std::vector<std::pair<std::string, DmTable>> devices;
+    for (int i = 0; i < 4; i++) {
+        DmTable table;
+        ASSERT_TRUE(table.Emplace<DmTargetZero>(0, 8));
+        devices.emplace_back(test_name_ + std::to_string(i), std::move(table));
+    }
+    auto guard = make_scope_guard([&]() {
+        for (const auto& [name, table] : devices) {
+            dm.DeleteDeviceIfExists(name, 5s);
+        }
+    });
+
+    std::vector<std::string> paths;
+    ASSERT_TRUE(dm.CreateDevices(devices, &paths, 5s));
+    ASSERT_EQ(paths.size(), devices.size());
+    for (size_t i = 0; i < devices.size(); i++) {
+        EXPECT_EQ(dm.GetState(devices[i].first), DmDeviceState::ACTIVE);
+
+        std::string path;
+        ASSERT_TRUE(dm.GetDmDevicePathByName(devices[i].first, &path));
+        EXPECT_EQ(path, paths[i]);
+        EXPECT_EQ(access(paths[i].c_str(), F_OK), 0);
+    }
+}
+
+TEST_F(DmTest, CreateDevicesFailure) {
+    DeviceMapper& dm = DeviceMapper::Instance();
+
+    // The second device has the same name as the first, so creating it fails
+    // and the first must be deleted again.
+    std::vector<std::pair<std::string, DmTable>> devices;
+    for (int i = 0; i < 2; i++) {
+        DmTable table;
+        ASSERT_TRUE(table.Emplace<DmTargetZero>(0, 8));
+        devices.emplace_back(test_name_, std::move(table));
+    }
+
+    std::vector<std::string> paths;
+    ASSERT_FALSE(dm.CreateDevices(devices, &paths, 5s));
+    EXPECT_EQ(dm.GetState(test_name_), DmDeviceState::INVALID);
+}
+
+TEST(DmUtilityTest, WaitForFiles) {
+    TemporaryDir dir;
+    std::string nested = dir.path + "/nested"s;
+    std::vector<std::string> paths = {dir.path + "/a"s, nested + "/b", nested + "/c"};
+
+    // One file's directory doesn't exist yet when the wait starts.
+    std::thread creator([&]() {
+        std::this_thread::sleep_for(50ms);
+        ASSERT_TRUE(android::base::WriteStringToFile("", paths[0]));
+        ASSERT_EQ(mkdir(nested.c_str(), 0755), 0);
+        ASSERT_TRUE(android::base::WriteStringToFile("", paths[1]));
+        ASSERT_TRUE(android::base::WriteStringToFile("", paths[2]));
+    });
+    auto start = std::chrono::steady_clock::now();
+    bool ok = WaitForFiles(paths, 5s);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    creator.join();
+    ASSERT_TRUE(ok);
+    EXPECT_LT(elapsed, 1s);
+
+    EXPECT_FALSE(WaitForFiles({dir.path + "/missing"s}, 50ms));
+}
+
 TEST_F(DmTest, GetNameAndUuid) {
     auto& dm = DeviceMapper::Instance();
     ASSERT_TRUE(dm.CreatePlaceholderDevice(test_name_));
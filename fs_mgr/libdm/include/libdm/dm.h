@@ -27,9 +27,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <array>
 #include <chrono>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <utility>
@@ -163,6 +165,25 @@ class DeviceMapper final : public IDeviceMapper {
     bool WaitForDevice(const std::string& name, const std::chrono::milliseconds& timeout_ms,
                        std::string* path);
 
+    // Same as WaitForDevice, but waits for all of |names| together, for at most |timeout_ms|
+    // in total. |paths| receives the path of each device, in the same order. If any device
+    // fails, all of them are deleted.
+    bool WaitForDevices(const std::vector<std::string>& names,
+                        const std::chrono::milliseconds& timeout_ms,
+                        std::vector<std::string>* paths);
+
+    // Time this process has spent in WaitForDevice and WaitForDevices, so that
+    // callers like first stage init can report it.
+    struct WaitStats {
+        // buckets[0] counts waits under 1ms, and buckets[i] waits of
+        // [2^(i-1), 2^i) ms. The last bucket also counts all longer waits.
+        std::array<uint32_t, 12> buckets = {};
+        uint32_t count = 0;
+        std::chrono::milliseconds total = {};
+        std::chrono::milliseconds max = {};
+    };
+    WaitStats GetWaitStats() const;
+
     // Creates a device, loads the given table, and activates it. If the device
     // is not able to be activated, it is destroyed, and false is returned.
     // After creation, |path| contains the result of calling
@@ -194,6 +215,16 @@ class DeviceMapper final : public IDeviceMapper {
     // use the timeout variant above.
     bool CreateDevice(const std::string& name, const DmTable& table);
 
+    // Same as calling CreateDevice for each (name, table) pair in |devices|,
+    // except that all devices are created and activated before waiting for
+    // any of their paths. ueventd then handles the first devices while the
+    // rest are being set up, and the wait is at most |timeout_ms| in total.
+    // |paths| receives the path of each device, in the same order. If any
+    // device fails, all the devices created by this call are deleted.
+    bool CreateDevices(const std::vector<std::pair<std::string, DmTable>>& devices,
+                       std::vector<std::string>* paths,
+                       const std::chrono::milliseconds& timeout_ms);
+
     // Loads the device mapper table from parameter into the underlying device
     // mapper device with given name and activate / resumes the device in the
     // process. A device with the given name must already exist.
@@ -325,10 +356,13 @@ class DeviceMapper final : public IDeviceMapper {
     bool CreateDevice(const std::string& name, const std::string& uuid = {});
     bool GetTable(const std::string& name, uint32_t flags, std::vector<TargetInfo>* table);
     void InitIo(struct dm_ioctl* io, const std::string& name = std::string()) const;
+    void RecordWait(std::chrono::milliseconds duration);
 
     DeviceMapper();
 
     int fd_;
+    mutable std::mutex wait_stats_lock_;
+    WaitStats wait_stats_;
     // Non-copyable & Non-movable
     DeviceMapper(const DeviceMapper&) = delete;
     DeviceMapper& operator=(const DeviceMapper&) = delete;
@@ -17,14 +17,25 @@
 #ifndef _LIBDM_LOOP_CONTROL_H_
 #define _LIBDM_LOOP_CONTROL_H_
 
+#include <stdint.h>
+
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 
 namespace android {
 namespace dm {
 
+// Settings applied to a loop device when it is attached.
+struct LoopConfig {
+    // Logical block size of the loop device, or 0 to keep the default.
+    uint32_t block_size = 0;
+    // Bypass the page cache for the backing file.
+    bool direct_io = false;
+};
+
 class LoopControl final {
   public:
     LoopControl();
@@ -40,6 +51,18 @@ class LoopControl final {
     bool Attach(int file_fd, const std::chrono::milliseconds& timeout_ms,
                 std::string* loopdev) const;
 
+    // Same as above, but also applies |config|. On kernels with
+    // LOOP_CONFIGURE (5.8+) the device is bound and configured with a single
+    // ioctl; otherwise the settings are applied after LOOP_SET_FD.
+    bool Attach(int file_fd, const std::chrono::milliseconds& timeout_ms, const LoopConfig& config,
+                std::string* loopdev) const;
+
+    // Attaches each file in |file_fds| to its own loop device, in parallel.
+    // On success, |loopdevs| holds the device for each file, in order. On
+    // failure, any devices that were attached are detached again.
+    bool AttachMany(const std::vector<int>& file_fds, const std::chrono::milliseconds& timeout_ms,
+                    const LoopConfig& config, std::vector<std::string>* loopdevs) const;
+
     // Detach the loop device given by 'loopdev' from the attached backing file.
     bool Detach(const std::string& loopdev) const;
 
@@ -23,6 +23,10 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <memory>
+#include <thread>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 #include <android-base/unique_fd.h>
@@ -39,8 +43,98 @@ LoopControl::LoopControl() : control_fd_(-1) {
     }
 }
 
+#if !defined(LOOP_CONFIGURE)
+static constexpr int LOOP_CONFIGURE = 0x4C0A;
+#endif
+
+// Layout of struct loop_config, which older kernel headers do not have.
+struct LoopConfigureArgs {
+    uint32_t fd;
+    uint32_t block_size;
+    struct loop_info64 info;
+    uint64_t reserved[8];
+};
+
+// Set once LOOP_CONFIGURE is known to be missing, so that later attaches go
+// straight to LOOP_SET_FD.
+static std::atomic<bool> sLoopConfigureUnsupported = false;
+
+// Applies |config| to a loop device which already has a backing file.
+static bool ApplyConfig(int loop_fd, const LoopConfig& config) {
+#if !defined(LOOP_SET_BLOCK_SIZE)
+    static constexpr int LOOP_SET_BLOCK_SIZE = 0x4C09;
+#endif
+#if !defined(LOOP_SET_DIRECT_IO)
+    static constexpr int LOOP_SET_DIRECT_IO = 0x4C08;
+#endif
+
+    if (config.block_size && ioctl(loop_fd, LOOP_SET_BLOCK_SIZE, config.block_size)) {
+        PLOG(ERROR) << "Could not set loop device block size";
+        return false;
+    }
+    if (config.direct_io && ioctl(loop_fd, LOOP_SET_DIRECT_IO, 1)) {
+        PLOG(ERROR) << "Could not set loop direct IO";
+        return false;
+    }
+    return true;
+}
+
+// Binds |file_fd| to the loop device |loop_fd| and applies |config|.
+static WaitResult BindLoopDevice(int loop_fd, int file_fd, const LoopConfig& config) {
+    if (!sLoopConfigureUnsupported) {
+        LoopConfigureArgs args = {};
+        args.fd = file_fd;
+        args.block_size = config.block_size;
+        if (config.direct_io) {
+            args.info.lo_flags |= LO_FLAGS_DIRECT_IO;
+        }
+        if (ioctl(loop_fd, LOOP_CONFIGURE, &args) == 0) {
+            // The kernel silently falls back to buffered I/O if the backing
+            // file cannot do direct I/O, so check that it took effect.
+            struct loop_info64 info = {};
+            if (config.direct_io &&
+                (ioctl(loop_fd, LOOP_GET_STATUS64, &info) || !(info.lo_flags & LO_FLAGS_DIRECT_IO))) {
+                // This fails with the real reason.
+                if (!ApplyConfig(loop_fd, {.direct_io = true})) {
+                    ioctl(loop_fd, LOOP_CLR_FD, 0);
+                    return WaitResult::Fail;
+                }
+            }
+            return WaitResult::Done;
+        }
+        if (errno == EBUSY) {
+            return WaitResult::Wait;
+        }
+        if (errno != EINVAL && errno != ENOTTY) {
+            PLOG(ERROR) << "Failed LOOP_CONFIGURE";
+            return WaitResult::Fail;
+        }
+        // Either the kernel predates LOOP_CONFIGURE, or |config| is invalid.
+        // The fallback below tells the two apart.
+    }
+
+    if (ioctl(loop_fd, LOOP_SET_FD, file_fd)) {
+        if (errno == EBUSY) {
+            return WaitResult::Wait;
+        }
+        PLOG(ERROR) << "Failed LOOP_SET_FD";
+        return WaitResult::Fail;
+    }
+    if (!ApplyConfig(loop_fd, config)) {
+        ioctl(loop_fd, LOOP_CLR_FD, 0);
+        return WaitResult::Fail;
+    }
+    sLoopConfigureUnsupported = true;
+    return WaitResult::Done;
+}
+
 bool LoopControl::Attach(int file_fd, const std::chrono::milliseconds& timeout_ms,
                          std::string* loopdev) const {
+    return Attach(file_fd, timeout_ms, {}, loopdev);
+}
+
+bool LoopControl::Attach(int file_fd, const std::chrono::milliseconds& timeout_ms,
+                         const LoopConfig& config, std::string* loopdev) const {
     auto start_time = std::chrono::steady_clock::now();
     auto condition = [&]() -> WaitResult {
         if (!FindFreeLoopDevice(loopdev)) {
@@ -61,15 +155,7 @@ bool LoopControl::Attach(int file_fd, const std::chrono::milliseconds& timeout_m
             PLOG(ERROR) << "Failed to open: " << *loopdev;
             return WaitResult::Fail;
         }
-
-        if (int rc = ioctl(loop_fd, LOOP_SET_FD, file_fd); rc == 0) {
-            return WaitResult::Done;
-        }
-        if (errno != EBUSY) {
-            PLOG(ERROR) << "Failed LOOP_SET_FD";
-            return WaitResult::Fail;
-        }
-        return WaitResult::Wait;
+        return BindLoopDevice(loop_fd.get(), file_fd, config);
     };
     if (!WaitForCondition(condition, timeout_ms)) {
         LOG(ERROR) << "Timed out trying to acquire a loop device";
@@ -78,6 +164,43 @@ bool LoopControl::Attach(int file_fd, const std::chrono::milliseconds& timeout_m
     return true;
 }
 
+bool LoopControl::AttachMany(const std::vector<int>& file_fds,
+                             const std::chrono::milliseconds& timeout_ms, const LoopConfig& config,
+                             std::vector<std::string>* loopdevs) const {
+    std::vector<std::string> devices(file_fds.size());
+    // std::vector<bool> is not safe to write from several threads.
+    std::unique_ptr<bool[]> ok(new bool[file_fds.size()]());
+
+    // Threads racing for the same free device is handled by Attach(), which
+    // retries when LOOP_CONFIGURE or LOOP_SET_FD returns EBUSY.
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < file_fds.size(); i++) {
+        threads.emplace_back(
+                [&, i]() { ok[i] = Attach(file_fds[i], timeout_ms, config, &devices[i]); });
+    }
+    if (!file_fds.empty()) {
+        ok[0] = Attach(file_fds[0], timeout_ms, config, &devices[0]);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < file_fds.size(); i++) {
+        success &= ok[i];
+    }
+    if (!success) {
+        for (size_t i = 0; i < file_fds.size(); i++) {
+            if (ok[i]) {
+                Detach(devices[i]);
+            }
+        }
+        return false;
+    }
+    *loopdevs = std::move(devices);
+    return true;
+}
+
 bool LoopControl::Detach(const std::string& loopdev) const {
     if (loopdev.empty()) {
         LOG(ERROR) << "Must provide a loop device";
@@ -113,24 +236,9 @@ bool LoopControl::FindFreeLoopDevice(std::string* loopdev) const {
 }
 
 bool LoopControl::EnableDirectIo(int fd) {
-#if !defined(LOOP_SET_BLOCK_SIZE)
-    static constexpr int LOOP_SET_BLOCK_SIZE = 0x4C09;
-#endif
-#if !defined(LOOP_SET_DIRECT_IO)
-    static constexpr int LOOP_SET_DIRECT_IO = 0x4C08;
-#endif
-
     // Note: the block size has to be >= the logical block size of the underlying
     // block device, *not* the filesystem block size.
-    if (ioctl(fd, LOOP_SET_BLOCK_SIZE, 4096)) {
-        PLOG(ERROR) << "Could not set loop device block size";
-        return false;
-    }
-    if (ioctl(fd, LOOP_SET_DIRECT_IO, 1)) {
-        PLOG(ERROR) << "Could not set loop direct IO";
-        return false;
-    }
-    return true;
+    return ApplyConfig(fd, {.block_size = 4096, .direct_io = true});
 }
 
 bool LoopControl::SetAutoClearStatus(int fd) {
@@ -62,3 +62,29 @@ TEST(libdm, LoopControl) {
     ASSERT_TRUE(android::base::ReadFully(loop_fd, buffer, sizeof(buffer)));
     ASSERT_EQ(memcmp(buffer, "Hello", 6), 0);
 }
+
+TEST(libdm, LoopControlAttachMany) {
+    std::vector<unique_fd> files;
+    std::vector<int> fds;
+    for (size_t i = 0; i < 4; i++) {
+        files.emplace_back(TempFile());
+        ASSERT_GE(files.back(), 0);
+        fds.emplace_back(files.back().get());
+    }
+
+    LoopControl control;
+    std::vector<std::string> devices;
+    ASSERT_TRUE(control.AttachMany(fds, 10s, {.block_size = 512}, &devices));
+    ASSERT_EQ(devices.size(), fds.size());
+
+    for (const auto& device : devices) {
+        char buffer[6];
+        unique_fd loop_fd(open(device.c_str(), O_RDWR));
+        ASSERT_GE(loop_fd, 0);
+        ASSERT_TRUE(android::base::ReadFully(loop_fd, buffer, sizeof(buffer)));
+        ASSERT_EQ(memcmp(buffer, "Hello", 6), 0);
+    }
+    for (const auto& device : devices) {
+        ASSERT_TRUE(control.Detach(device));
+    }
+}
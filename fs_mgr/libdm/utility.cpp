@@ -15,11 +15,18 @@
 #include "utility.h"
 
 #include <errno.h>
+#include <limits.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
+#include <algorithm>
 #include <thread>
 
 #include <android-base/logging.h>
+#include <android-base/unique_fd.h>
 
 using namespace std::literals;
 
@@ -43,19 +50,96 @@ bool WaitForCondition(const std::function<WaitResult()>& condition,
 }
 
 bool WaitForFile(const std::string& path, const std::chrono::milliseconds& timeout_ms) {
+    return WaitForFiles({path}, timeout_ms);
+}
+
+#if defined(__linux__)
+static std::string ParentDirectory(const std::string& path) {
+    auto pos = path.find_last_of('/');
+    if (pos == std::string::npos) return ".";
+    if (pos == 0) return "/";
+    return path.substr(0, pos);
+}
+
+// Watches the deepest existing directory above |path| for new entries. The
+// directories below it, like /dev/block/mapper/by-uuid before the first dm
+// device, are watched once they appear.
+static bool WatchForCreate(int inotify_fd, const std::string& path) {
+    std::string dir = path;
+    do {
+        dir = ParentDirectory(dir);
+        if (inotify_add_watch(inotify_fd, dir.c_str(), IN_CREATE | IN_MOVED_TO) >= 0) {
+            return true;
+        }
+    } while (errno == ENOENT && dir != "/" && dir != ".");
+    PLOG(ERROR) << "inotify_add_watch failed for " << dir;
+    return false;
+}
+#endif
+
+bool WaitForFiles(const std::vector<std::string>& paths,
+                  const std::chrono::milliseconds& timeout_ms) {
+    std::vector<std::string> pending = paths;
     auto condition = [&]() -> WaitResult {
-        // If the file exists but returns EPERM or something, we consider the
-        // condition met.
-        if (access(path.c_str(), F_OK) != 0) {
-            if (errno == ENOENT) {
-                return WaitResult::Wait;
+        for (auto iter = pending.begin(); iter != pending.end();) {
+            // If the file exists but returns EPERM or something, we consider
+            // the condition met.
+            if (access(iter->c_str(), F_OK) == 0) {
+                iter = pending.erase(iter);
+            } else if (errno == ENOENT) {
+                iter++;
+            } else {
+                PLOG(ERROR) << "access failed: " << *iter;
+                return WaitResult::Fail;
             }
-            PLOG(ERROR) << "access failed: " << path;
-            return WaitResult::Fail;
         }
-        return WaitResult::Done;
+        return pending.empty() ? WaitResult::Done : WaitResult::Wait;
     };
+
+#if defined(__linux__)
+    auto start_time = std::chrono::steady_clock::now();
+    android::base::unique_fd inotify_fd(inotify_init1(IN_CLOEXEC | IN_NONBLOCK));
+    if (inotify_fd < 0) {
+        PLOG(ERROR) << "inotify_init1 failed";
+        return WaitForCondition(condition, timeout_ms);
+    }
+    while (true) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start_time);
+
+        // Check after adding the watches, so that a path created in between
+        // is not missed.
+        for (const auto& path : pending) {
+            if (!WatchForCreate(inotify_fd, path)) {
+                return WaitForCondition(condition, timeout_ms - elapsed);
+            }
+        }
+        auto result = condition();
+        if (result == WaitResult::Done) return true;
+        if (result == WaitResult::Fail) return false;
+        if (elapsed > timeout_ms) return false;
+        auto remaining = std::min<int64_t>((timeout_ms - elapsed).count() + 1, INT_MAX);
+
+        struct pollfd event = {
+                .fd = inotify_fd,
+                .events = POLLIN,
+                .revents = 0,
+        };
+        int rv = poll(&event, 1, static_cast<int>(remaining));
+        if (rv < 0 && errno != EINTR) {
+            PLOG(ERROR) << "poll for inotify failed";
+            return WaitForCondition(condition, timeout_ms - elapsed);
+        }
+
+        // The events themselves don't matter, since checking the paths again
+        // is cheap.
+        char buffer[sizeof(struct inotify_event) + NAME_MAX + 1];
+        while (TEMP_FAILURE_RETRY(read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        }
+    }
+#else
     return WaitForCondition(condition, timeout_ms);
+#endif
 }
 
 bool WaitForFileDeleted(const std::string& path, const std::chrono::milliseconds& timeout_ms) {
@@ -16,6 +16,8 @@
 
 #include <chrono>
 #include <functional>
+#include <string>
+#include <vector>
 
 namespace android {
 namespace dm {
@@ -23,6 +25,10 @@ namespace dm {
 enum class WaitResult { Wait, Done, Fail };
 
 bool WaitForFile(const std::string& path, const std::chrono::milliseconds& timeout_ms);
+// Waits for all of |paths| to exist, for at most |timeout_ms| in total. This wakes up as soon as
+// a path is created, through inotify, and falls back to polling if inotify is unavailable.
+bool WaitForFiles(const std::vector<std::string>& paths,
+                  const std::chrono::milliseconds& timeout_ms);
 bool WaitForFileDeleted(const std::string& path, const std::chrono::milliseconds& timeout_ms);
 bool WaitForCondition(const std::function<WaitResult()>& condition,
                       const std::chrono::milliseconds& timeout_ms);
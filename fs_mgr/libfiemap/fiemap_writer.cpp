@@ -27,11 +27,13 @@
 #include <sys/vfs.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <limits>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
@@ -385,7 +387,11 @@ static bool PinFile(int file_fd, const std::string& file_path, uint32_t fs_type)
 static FiemapStatus WriteZeroes(int file_fd, const std::string& file_path, size_t blocksz,
                                 uint64_t file_size,
                                 const std::function<bool(uint64_t, uint64_t)>& on_progress) {
-    auto buffer = std::unique_ptr<void, decltype(&free)>(calloc(1, blocksz), free);
+    // Writing one block at a time means a syscall per block. Write a larger chunk instead, but
+    // keep it a multiple of the block size.
+    static constexpr size_t kMaxChunkSize = 1024 * 1024;
+    const size_t chunksz = std::max(blocksz, kMaxChunkSize / blocksz * blocksz);
+    auto buffer = std::unique_ptr<void, decltype(&free)>(calloc(1, chunksz), free);
     if (buffer == nullptr) {
         LOG(ERROR) << "failed to allocate memory for writing file";
         return FiemapStatus::Error();
@@ -399,13 +405,15 @@ static FiemapStatus WriteZeroes(int file_fd, const std::string& file_path, size_
 
     int permille = -1;
     while (offset < file_size) {
-        if (!::android::base::WriteFully(file_fd, buffer.get(), blocksz)) {
-            PLOG(ERROR) << "Failed to write" << blocksz << " bytes at offset" << offset
+        // file_size is a multiple of blocksz, so this never writes past it.
+        size_t to_write = std::min(static_cast<uint64_t>(chunksz), file_size - offset);
+        if (!::android::base::WriteFully(file_fd, buffer.get(), to_write)) {
+            PLOG(ERROR) << "Failed to write" << to_write << " bytes at offset" << offset
                         << " in file " << file_path;
             return FiemapStatus::FromErrno(errno);
         }
 
-        offset += blocksz;
+        offset += to_write;
 
         // Don't invoke the callback every iteration - wait until a significant
         // chunk (here, 1/1000th) of the data has been processed.
@@ -432,6 +440,7 @@ static FiemapStatus WriteZeroes(int file_fd, const std::string& file_path, size_
 static FiemapStatus AllocateFile(int file_fd, const std::string& file_path, uint64_t blocksz,
                                  uint64_t file_size, unsigned int fs_type,
                                  std::function<bool(uint64_t, uint64_t)> on_progress) {
+    android::base::Timer timer;
     bool need_explicit_writes = true;
     switch (fs_type) {
         case EXT4_SUPER_MAGIC:
@@ -501,6 +510,11 @@ static FiemapStatus AllocateFile(int file_fd, const std::string& file_path, uint
         return FiemapStatus::FromErrno(errno);
     }
 
+    auto ms = std::max<int64_t>(timer.duration().count(), 1);
+    LOG(INFO) << "Allocated " << file_size << " bytes for " << file_path << " in " << ms << "ms ("
+              << (file_size / 1024 * 1000 / 1024 / ms) << " MiB/s"
+              << (need_explicit_writes ? ", zeroes written" : "") << ")";
+
     // Send one last progress notification.
     if (on_progress && !on_progress(file_size, file_size)) {
         return FiemapStatus::Error();
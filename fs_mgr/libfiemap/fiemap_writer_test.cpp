@@ -27,6 +27,7 @@
 #include <sys/vfs.h>
 #include <unistd.h>
 
+#include <chrono>
 #include <cstring>
 #include <string>
 #include <utility>
@@ -433,6 +434,67 @@ TEST_F(SplitFiemapTest, WritePastEnd) {
     ASSERT_FALSE(ptr->Write(buffer.get(), kSize));
 }
 
+TEST_F(SplitFiemapTest, WriteUnalignedBuffer) {
+    static constexpr size_t kChunkSize = 32768;
+    static constexpr size_t kSize = kChunkSize * 3;
+    auto ptr = SplitFiemap::Create(testfile, kSize, kChunkSize);
+    ASSERT_NE(ptr, nullptr);
+
+    // Offset the source by one byte so that block-aligned writes have to go
+    // through the O_DIRECT bounce buffer.
+    std::string buffer(kSize + 1, '\0');
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = static_cast<char>(i * 7);
+    }
+    ASSERT_TRUE(ptr->Write(buffer.data() + 1, 100));
+    ASSERT_TRUE(ptr->Write(buffer.data() + 101, kSize - 100));
+
+    auto actual = ReadSplitFiles(testfile, 3);
+    ASSERT_EQ(actual.size(), kSize);
+    EXPECT_EQ(memcmp(buffer.data() + 1, actual.data(), actual.size()), 0);
+}
+
+// Compares SplitFiemap::Write against buffered writes to a pinned file of the
+// same size. This only logs throughput; it does not fail on a slow device.
+TEST_F(SplitFiemapTest, WriteThroughput) {
+    static constexpr size_t kSize = 64_MiB;
+    static constexpr size_t kWriteSize = 1_MiB;
+    std::string buffer(kWriteSize, 'a');
+
+    auto to_mib_per_sec = [](std::chrono::steady_clock::duration elapsed) -> double {
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+        return ms ? (kSize / 1_MiB) * 1000.0 / ms : 0.0;
+    };
+
+    std::string buffered_file = testfile + ".buffered";
+    {
+        FiemapUniquePtr fptr = FiemapWriter::Open(buffered_file, kSize);
+        ASSERT_NE(fptr, nullptr);
+        unique_fd fd(open(buffered_file.c_str(), O_WRONLY | O_CLOEXEC));
+        ASSERT_GE(fd, 0);
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < kSize; i += kWriteSize) {
+            ASSERT_TRUE(android::base::WriteFully(fd, buffer.data(), buffer.size()));
+        }
+        ASSERT_EQ(fsync(fd), 0);
+        LOG(INFO) << "Buffered write: "
+                  << to_mib_per_sec(std::chrono::steady_clock::now() - start) << " MiB/s";
+    }
+    unlink(buffered_file.c_str());
+
+    auto ptr = SplitFiemap::Create(testfile, kSize, 0);
+    ASSERT_NE(ptr, nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < kSize; i += kWriteSize) {
+        ASSERT_TRUE(ptr->Write(buffer.data(), buffer.size()));
+    }
+    ASSERT_TRUE(ptr->Flush());
+    LOG(INFO) << "SplitFiemap::Write: "
+              << to_mib_per_sec(std::chrono::steady_clock::now() - start) << " MiB/s";
+}
+
 // Get max file size and free space.
 std::pair<uint64_t, uint64_t> GetBigFileLimit(const std::string& mount_point) {
     struct statvfs fs;
@@ -16,8 +16,13 @@
 
 #include <libfiemap/image_manager.h>
 
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+
+#include <algorithm>
 #include <optional>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
@@ -43,6 +48,7 @@ using android::dm::DeviceMapper;
 using android::dm::DmDeviceState;
 using android::dm::DmTable;
 using android::dm::DmTargetLinear;
+using android::dm::LoopConfig;
 using android::dm::LoopControl;
 using android::fs_mgr::CreateLogicalPartition;
 using android::fs_mgr::CreateLogicalPartitionParams;
@@ -240,9 +246,6 @@ FiemapStatus ImageManager::ZeroFillNewImage(const std::string& name, uint64_t by
         return FiemapStatus::Error();
     }
 
-    static constexpr size_t kChunkSize = 4096;
-    std::string zeroes(kChunkSize, '\0');
-
     uint64_t remaining;
     if (bytes) {
         remaining = bytes;
@@ -253,6 +256,25 @@ FiemapStatus ImageManager::ZeroFillNewImage(const std::string& name, uint64_t by
             return FiemapStatus::FromErrno(errno);
         }
     }
+
+    // The device maps the image's extents directly, so the block layer can zero them without
+    // any data going through here. Whatever BLKZEROOUT can't handle (a partial sector at the
+    // end, or a device that doesn't support it) is written out below.
+    android::base::Timer timer;
+    const uint64_t total = remaining;
+    uint64_t range[2] = {0, remaining & ~uint64_t(511)};
+    if (range[1] && ioctl(device->fd(), BLKZEROOUT, range) == 0) {
+        remaining -= range[1];
+        if (lseek64(device->fd(), range[1], SEEK_SET) < 0) {
+            PLOG(ERROR) << "lseek failed: " << device->path();
+            return FiemapStatus::FromErrno(errno);
+        }
+    } else if (range[1]) {
+        PLOG(INFO) << "BLKZEROOUT failed on " << device->path() << ", writing zeroes instead";
+    }
+
+    static constexpr size_t kChunkSize = 1024 * 1024;
+    std::string zeroes(kChunkSize, '\0');
     while (remaining) {
         uint64_t to_write = std::min(static_cast<uint64_t>(zeroes.size()), remaining);
         if (!android::base::WriteFully(device->fd(), zeroes.data(),
@@ -262,6 +284,10 @@ FiemapStatus ImageManager::ZeroFillNewImage(const std::string& name, uint64_t by
         }
         remaining -= to_write;
     }
+
+    auto ms = std::max<int64_t>(timer.duration().count(), 1);
+    LOG(INFO) << "Zero-filled " << total << " bytes of " << name << " in " << ms << "ms ("
+              << (total / 1024 * 1000 / 1024 / ms) << " MiB/s)";
     return FiemapStatus::Ok();
 }
 
@@ -329,23 +355,6 @@ bool ImageManager::MapWithDmLinear(const IPartitionOpener& opener, const std::st
     return true;
 }
 
-// Helper to create a loop device for a file.
-static bool CreateLoopDevice(LoopControl& control, const std::string& file,
-                             const std::chrono::milliseconds& timeout_ms, std::string* path) {
-    static constexpr int kOpenFlags = O_RDWR | O_NOFOLLOW | O_CLOEXEC;
-    android::base::unique_fd file_fd(open(file.c_str(), kOpenFlags));
-    if (file_fd < 0) {
-        PLOG(ERROR) << "Could not open file: " << file;
-        return false;
-    }
-    if (!control.Attach(file_fd, timeout_ms, path)) {
-        LOG(ERROR) << "Could not create loop device for: " << file;
-        return false;
-    }
-    LOG(INFO) << "Created loop device " << *path << " for file " << file;
-    return true;
-}
-
 class AutoDetachLoopDevices final {
   public:
     AutoDetachLoopDevices(LoopControl& control, const std::vector<std::string>& devices)
@@ -440,20 +449,6 @@ bool ImageManager::MapWithLoopDeviceList(const std::vector<std::string>& device_
     return true;
 }
 
-static bool OptimizeLoopDevices(const std::vector<std::string>& device_list) {
-    for (const auto& device : device_list) {
-        unique_fd fd(open(device.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW));
-        if (fd < 0) {
-            PLOG(ERROR) << "Open failed: " << device;
-            return false;
-        }
-        if (!LoopControl::EnableDirectIo(fd)) {
-            return false;
-        }
-    }
-    return true;
-}
-
 // Helper to use one or more loop devices around image files.
 bool ImageManager::MapWithLoopDevice(const std::string& name,
                                      const std::chrono::milliseconds& timeout_ms,
@@ -466,31 +461,36 @@ bool ImageManager::MapWithLoopDevice(const std::string& name,
         return false;
     }
 
-    // Map each image file as a loopback device.
-    LoopControl control;
-    std::vector<std::string> loop_devices;
-    AutoDetachLoopDevices auto_detach(control, loop_devices);
-
-    auto start_time = std::chrono::steady_clock::now();
+    // Map each image file as a loopback device. The devices are attached in
+    // parallel, with direct I/O and the block size set as part of attaching;
+    // without direct I/O, we'd use double the memory.
+    static constexpr int kOpenFlags = O_RDWR | O_NOFOLLOW | O_CLOEXEC;
+    std::vector<unique_fd> file_fds;
+    std::vector<int> raw_fds;
     for (const auto& file : file_list) {
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time);
-
-        std::string loop_device;
-        if (!CreateLoopDevice(control, file, timeout_ms - elapsed, &loop_device)) {
-            break;
+        unique_fd fd(open(file.c_str(), kOpenFlags));
+        if (fd < 0) {
+            PLOG(ERROR) << "Could not open file: " << file;
+            return false;
         }
-        loop_devices.emplace_back(loop_device);
-    }
-    if (loop_devices.size() != file_list.size()) {
-        // The number of devices will mismatch if CreateLoopDevice() failed.
-        return false;
+        raw_fds.emplace_back(fd.get());
+        file_fds.emplace_back(std::move(fd));
     }
 
-    // If OptimizeLoopDevices fails, we'd use double the memory.
-    if (!OptimizeLoopDevices(loop_devices)) {
+    // Note: the block size has to be >= the logical block size of the
+    // underlying block device, *not* the filesystem block size.
+    LoopConfig config = {.block_size = 4096, .direct_io = true};
+
+    LoopControl control;
+    std::vector<std::string> loop_devices;
+    if (!control.AttachMany(raw_fds, timeout_ms, config, &loop_devices)) {
+        LOG(ERROR) << "Could not create loop devices for image: " << name;
         return false;
     }
+    AutoDetachLoopDevices auto_detach(control, loop_devices);
+    for (size_t i = 0; i < file_list.size(); i++) {
+        LOG(INFO) << "Created loop device " << loop_devices[i] << " for file " << file_list[i];
+    }
 
     // If there's only one loop device (by far the most common case, splits
     // will normally only happen on sdcards with FAT32), then just return that
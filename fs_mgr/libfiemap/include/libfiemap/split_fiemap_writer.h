@@ -17,6 +17,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdlib.h>
 
 #include <functional>
 #include <memory>
@@ -65,6 +66,8 @@ class SplitFiemap final {
 
     // Helper method for writing data that spans files. Note there is no seek
     // method (yet); this starts at 0 and increments the position by |bytes|.
+    // Block-aligned runs are written with O_DIRECT, so that large images do
+    // not pass through the page cache.
     bool Write(const void* data, uint64_t bytes);
 
     // Flush all writes to all split files.
@@ -84,6 +87,7 @@ class SplitFiemap final {
   private:
     SplitFiemap() = default;
     void AddFile(FiemapUniquePtr&& file);
+    bool WriteAtCursor(FiemapWriter* file, const uint8_t* data, uint64_t bytes);
 
     bool creating_ = false;
     std::string list_file_;
@@ -95,6 +99,10 @@ class SplitFiemap final {
     size_t cursor_index_ = 0;
     uint64_t cursor_file_pos_ = 0;
     android::base::unique_fd cursor_fd_;
+    android::base::unique_fd cursor_direct_fd_;
+
+    // Aligned bounce buffer for O_DIRECT writes of unaligned caller data.
+    std::unique_ptr<void, decltype(&free)> direct_buffer_{nullptr, &free};
 };
 
 }  // namespace fiemap
@@ -18,10 +18,13 @@
 
 #include <fcntl.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -42,6 +45,9 @@ using android::base::unique_fd;
 // We use a four-digit suffix at the end of filenames.
 static const size_t kMaxFilePieces = 500;
 
+// Size of the bounce buffer used for O_DIRECT writes.
+static constexpr uint64_t kDirectBufferSize = 1024 * 1024;
+
 std::unique_ptr<SplitFiemap> SplitFiemap::Create(const std::string& file_path, uint64_t file_size,
                                                  uint64_t max_piece_size,
                                                  ProgressCallback progress) {
@@ -240,6 +246,7 @@ bool SplitFiemap::Write(const void* data, uint64_t bytes) {
             // No space left in the current file, but we have more files to
             // use, so prep the next one.
             cursor_fd_ = {};
+            cursor_direct_fd_ = {};
             cursor_file_pos_ = 0;
             file = files_[++cursor_index_].get();
             file_bytes_left = file->size();
@@ -252,6 +259,13 @@ bool SplitFiemap::Write(const void* data, uint64_t bytes) {
                 PLOG(ERROR) << "open failed: " << file->file_path();
                 return false;
             }
+            // Not every filesystem supports O_DIRECT; without it, everything
+            // goes through |cursor_fd_|.
+            cursor_direct_fd_.reset(
+                    open(file->file_path().c_str(), O_CLOEXEC | O_WRONLY | O_DIRECT));
+            if (cursor_direct_fd_ < 0) {
+                PLOG(WARNING) << "open with O_DIRECT failed: " << file->file_path();
+            }
             CHECK(cursor_file_pos_ == 0);
         }
 
@@ -261,18 +275,68 @@ bool SplitFiemap::Write(const void* data, uint64_t bytes) {
         }
 
         uint64_t bytes_to_write = std::min(file_bytes_left, bytes_remaining);
-        if (!android::base::WriteFully(cursor_fd_, data_ptr, bytes_to_write)) {
-            PLOG(ERROR) << "write failed: " << file->file_path();
+        if (!WriteAtCursor(file, data_ptr, bytes_to_write)) {
             return false;
         }
         data_ptr += bytes_to_write;
         bytes_remaining -= bytes_to_write;
-        cursor_file_pos_ += bytes_to_write;
     }
 
     // If we've reached the end of the current file, close it.
     if (cursor_file_pos_ == file->size()) {
         cursor_fd_ = {};
+        cursor_direct_fd_ = {};
+    }
+    return true;
+}
+
+// Write |bytes| at the cursor of |file|, advancing the cursor. Whole blocks
+// at block-aligned offsets go through |cursor_direct_fd_|; the unaligned head
+// and tail of a write go through the page cache.
+bool SplitFiemap::WriteAtCursor(FiemapWriter* file, const uint8_t* data, uint64_t bytes) {
+    const uint64_t block_size = file->block_size();
+    while (bytes) {
+        uint64_t misalignment = cursor_file_pos_ % block_size;
+        if (cursor_direct_fd_ < 0 || misalignment || bytes < block_size) {
+            uint64_t to_write = bytes;
+            if (cursor_direct_fd_ >= 0 && misalignment) {
+                to_write = std::min(bytes, block_size - misalignment);
+            }
+            if (!android::base::WriteFullyAtOffset(cursor_fd_, data, to_write, cursor_file_pos_)) {
+                PLOG(ERROR) << "write failed: " << file->file_path();
+                return false;
+            }
+            data += to_write;
+            bytes -= to_write;
+            cursor_file_pos_ += to_write;
+            continue;
+        }
+
+        // O_DIRECT needs an aligned buffer as well as an aligned offset, so
+        // copy through the bounce buffer unless the caller's data already is.
+        uint64_t to_write = bytes - (bytes % block_size);
+        const void* buffer = data;
+        if (reinterpret_cast<uintptr_t>(data) % block_size) {
+            if (!direct_buffer_) {
+                void* ptr = nullptr;
+                if (posix_memalign(&ptr, block_size, kDirectBufferSize)) {
+                    LOG(ERROR) << "could not allocate O_DIRECT buffer";
+                    return false;
+                }
+                direct_buffer_.reset(ptr);
+            }
+            to_write = std::min(to_write, kDirectBufferSize);
+            memcpy(direct_buffer_.get(), data, to_write);
+            buffer = direct_buffer_.get();
+        }
+        if (!android::base::WriteFullyAtOffset(cursor_direct_fd_, buffer, to_write,
+                                               cursor_file_pos_)) {
+            PLOG(ERROR) << "direct write failed: " << file->file_path();
+            return false;
+        }
+        data += to_write;
+        bytes -= to_write;
+        cursor_file_pos_ += to_write;
     }
     return true;
 }
@@ -187,16 +187,31 @@ std::string FsManagerAvbOps::GetPartitionPath(const char* partition) {
     return path;
 }
 
+// avb_slot_verify() asks for the size, the footer and the vbmeta of each partition separately,
+// so the device is looked up and opened once and then kept open until we are done.
+AvbIOResult FsManagerAvbOps::OpenPartition(const char* partition, int* out_fd) {
+    auto it = partition_fds_.find(partition);
+    if (it == partition_fds_.end()) {
+        const auto path = GetPartitionPath(partition);
+        if (path.empty()) {
+            return AVB_IO_RESULT_ERROR_NO_SUCH_PARTITION;
+        }
+        android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+        if (fd < 0) {
+            PERROR << "Failed to open " << path;
+            return AVB_IO_RESULT_ERROR_IO;
+        }
+        it = partition_fds_.emplace(partition, std::move(fd)).first;
+    }
+    *out_fd = it->second.get();
+    return AVB_IO_RESULT_OK;
+}
+
 AvbIOResult FsManagerAvbOps::GetSizeOfPartition(const char* partition,
                                                 uint64_t* out_size_num_byte) {
-    const auto path = GetPartitionPath(partition);
-    if (path.empty()) {
-        return AVB_IO_RESULT_ERROR_NO_SUCH_PARTITION;
-    }
-    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
-    if (fd < 0) {
-        PERROR << "Failed to open " << path;
-        return AVB_IO_RESULT_ERROR_IO;
+    int fd;
+    if (auto result = OpenPartition(partition, &fd); result != AVB_IO_RESULT_OK) {
+        return result;
     }
     int err = ioctl(fd, BLKGETSIZE64, out_size_num_byte);
     if (err) {
@@ -209,15 +224,9 @@ AvbIOResult FsManagerAvbOps::GetSizeOfPartition(const char* partition,
 AvbIOResult FsManagerAvbOps::ReadFromPartition(const char* partition, int64_t offset,
                                                size_t num_bytes, void* buffer,
                                                size_t* out_num_read) {
-    std::string path = GetPartitionPath(partition);
-    if (path.empty()) {
-        return AVB_IO_RESULT_ERROR_NO_SUCH_PARTITION;
-    }
-
-    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
-    if (fd < 0) {
-        PERROR << "Failed to open " << path;
-        return AVB_IO_RESULT_ERROR_IO;
+    int fd;
+    if (auto result = OpenPartition(partition, &fd); result != AVB_IO_RESULT_OK) {
+        return result;
     }
 
     // If offset is negative, interprets its absolute value as the
@@ -240,7 +249,8 @@ AvbIOResult FsManagerAvbOps::ReadFromPartition(const char* partition, int64_t of
     // for EOF).
     ssize_t num_read = TEMP_FAILURE_RETRY(pread64(fd, buffer, num_bytes, offset));
     if (num_read < 0 || (size_t)num_read != num_bytes) {
-        PERROR << "Failed to read " << num_bytes << " bytes from " << path << " offset " << offset;
+        PERROR << "Failed to read " << num_bytes << " bytes from " << partition << " offset "
+               << offset;
         return AVB_IO_RESULT_ERROR_IO;
     }
 
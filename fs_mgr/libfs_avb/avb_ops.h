@@ -24,9 +24,11 @@
 
 #pragma once
 
+#include <map>
 #include <string>
 #include <vector>
 
+#include <android-base/unique_fd.h>
 #include <fs_avb/types.h>
 #include <fstab/fstab.h>
 #include <libavb/libavb.h>
@@ -64,9 +66,11 @@ class FsManagerAvbOps {
   private:
     std::string GetLogicalPath(const std::string& partition_name);
     std::string GetPartitionPath(const char* partition_name);
+    AvbIOResult OpenPartition(const char* partition, int* out_fd);
     AvbOps avb_ops_;
     Fstab fstab_;
     std::string slot_suffix_;
+    std::map<std::string, android::base::unique_fd> partition_fds_;
 };
 
 }  // namespace fs_mgr
@@ -19,6 +19,8 @@
 #include <unistd.h>
 
 #include <array>
+#include <future>
+#include <iterator>
 #include <sstream>
 
 #include <android-base/file.h>
@@ -575,12 +577,30 @@ VBMetaVerifyResult LoadAndVerifyVbmetaByPartition(
         if (fatal_error) {
             return VBMetaVerifyResult::kError;
         }
-        for (auto& chain : chain_partitions) {
-            auto sub_ret = LoadAndVerifyVbmetaByPartition(
-                chain.partition_name, ab_suffix, ab_other_suffix, chain.public_key_blob,
-                allow_verification_error, load_chained_vbmeta, rollback_protection,
-                device_path_constructor, true, /* is_chained_vbmeta */
-                out_vbmeta_images);
+        // Chained partitions don't depend on each other, so they are loaded and verified
+        // concurrently. Their images are still appended in descriptor order, and the results
+        // are handled in that order too, as if they had been loaded one after another.
+        struct ChainResult {
+            VBMetaVerifyResult verify_result;
+            std::vector<VBMetaData> vbmeta_images;
+        };
+        std::vector<std::future<ChainResult>> chain_results;
+        for (const auto& chain : chain_partitions) {
+            chain_results.emplace_back(std::async(std::launch::async, [&, chain]() {
+                ChainResult result;
+                result.verify_result = LoadAndVerifyVbmetaByPartition(
+                        chain.partition_name, ab_suffix, ab_other_suffix, chain.public_key_blob,
+                        allow_verification_error, load_chained_vbmeta, rollback_protection,
+                        device_path_constructor, true, /* is_chained_vbmeta */
+                        &result.vbmeta_images);
+                return result;
+            }));
+        }
+        for (auto& chain_result : chain_results) {
+            auto result = chain_result.get();
+            auto sub_ret = result.verify_result;
+            std::move(result.vbmeta_images.begin(), result.vbmeta_images.end(),
+                      std::back_inserter(*out_vbmeta_images));
             if (sub_ret != VBMetaVerifyResult::kSuccess) {
                 verify_result = sub_ret;  // might be 'ERROR' or 'ERROR VERIFICATION'.
                 if (verify_result == VBMetaVerifyResult::kError) {
@@ -26,6 +26,8 @@
 
 #include <algorithm>
 #include <array>
+#include <map>
+#include <mutex>
 #include <utility>
 #include <vector>
 
@@ -207,6 +209,7 @@ bool ParseFsMgrFlags(const std::string& flags, FstabEntry* entry) {
         CheckFlag("fscompress", fs_compress);
         CheckFlag("overlayfs_remove_missing_lowerdir", overlayfs_remove_missing_lowerdir);
         CheckFlag("wrappedkey", wrapped_key);
+        CheckFlag("hashtree_prewarm", hashtree_prewarm);
 
 #undef CheckFlag
 
@@ -519,6 +522,17 @@ std::vector<FstabPtrEntryType*> GetEntriesByPred(FstabPtr fstab, const Pred& pre
     return entries;
 }
 
+// Same as GetEntriesByPred(), but stops at the first match instead of collecting all of them.
+template <typename FstabPtr, typename FstabPtrEntryType = typename FstabPtrEntry<FstabPtr>::type,
+          typename Pred>
+FstabPtrEntryType* GetFirstEntryByPred(FstabPtr fstab, const Pred& pred) {
+    if (fstab == nullptr) {
+        return nullptr;
+    }
+    auto it = std::find_if(fstab->begin(), fstab->end(), pred);
+    return it == fstab->end() ? nullptr : &*it;
+}
+
 }  // namespace
 
 // Return the path to the fstab file.  There may be multiple fstab files; the
@@ -607,6 +621,37 @@ bool ParseFstabFromString(const std::string& fstab_str, bool proc_mounts, Fstab*
     return true;
 }
 
+// ReadDefaultFstab() and friends get called many times in each process during boot, and every
+// call used to parse the same text again. Parsing only depends on the text and on the slot
+// suffix, which doesn't change within a boot, so parsed fstabs are kept by their contents and
+// copied out. Only a handful of distinct fstabs (device tree, default, recovery) are ever read.
+static bool ParseFstabFromStringCached(const std::string& fstab_str, Fstab* fstab_out) {
+    static constexpr size_t kMaxCachedFstabs = 4;
+    static std::mutex cache_lock;
+    static auto& cache = *new std::map<std::string, Fstab>();
+
+    {
+        std::lock_guard<std::mutex> lock(cache_lock);
+        if (auto it = cache.find(fstab_str); it != cache.end()) {
+            *fstab_out = it->second;
+            return true;
+        }
+    }
+
+    Fstab fstab;
+    if (!ParseFstabFromString(fstab_str, /* proc_mounts = */ false, &fstab)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(cache_lock);
+    if (cache.size() >= kMaxCachedFstabs) {
+        cache.clear();
+    }
+    cache.emplace(fstab_str, fstab);
+    *fstab_out = std::move(fstab);
+    return true;
+}
+
 void TransformFstabForDsu(Fstab* fstab, const std::string& dsu_slot,
                           const std::vector<std::string>& dsu_partitions) {
     static constexpr char kDsuKeysDir[] = "/avb";
@@ -719,8 +764,12 @@ static bool ReadFstabFromFileCommon(const std::string& path, Fstab* fstab_out) {
         return false;
     }
 
+    // /proc/mounts changes all the time, so there is no point in caching it.
     Fstab fstab;
-    if (!ParseFstabFromString(fstab_str, path == kProcMountsPath, &fstab)) {
+    bool parsed = path == kProcMountsPath
+                          ? ParseFstabFromString(fstab_str, /* proc_mounts = */ true, &fstab)
+                          : ParseFstabFromStringCached(fstab_str, &fstab);
+    if (!parsed) {
         LERROR << __FUNCTION__ << "(): failed to load fstab from : '" << path << "'";
         return false;
     }
@@ -772,7 +821,7 @@ bool ReadFstabFromDt(Fstab* fstab, bool verbose) {
         return false;
     }
 
-    if (!ParseFstabFromString(fstab_buf, /* proc_mounts = */ false, fstab)) {
+    if (!ParseFstabFromStringCached(fstab_buf, fstab)) {
         if (verbose) {
             LERROR << __FUNCTION__ << "(): failed to load fstab from kernel:" << std::endl
                    << fstab_buf;
@@ -866,10 +915,9 @@ std::vector<FstabEntry*> GetEntriesForMountPoint(Fstab* fstab, const std::string
 
 FstabEntry* GetEntryForMountPoint(Fstab* fstab, const std::string_view path,
                                   const std::string_view fstype) {
-    auto&& vec = GetEntriesByPred(fstab, [&path, fstype](const FstabEntry& entry) {
+    return GetFirstEntryByPred(fstab, [&path, fstype](const FstabEntry& entry) {
         return entry.mount_point == path && entry.fs_type == fstype;
     });
-    return vec.empty() ? nullptr : vec.front();
 }
 
 std::vector<const FstabEntry*> GetEntriesForMountPoint(const Fstab* fstab,
@@ -879,13 +927,13 @@ std::vector<const FstabEntry*> GetEntriesForMountPoint(const Fstab* fstab,
 }
 
 FstabEntry* GetEntryForMountPoint(Fstab* fstab, const std::string& path) {
-    std::vector<FstabEntry*> entries = GetEntriesForMountPoint(fstab, path);
-    return entries.empty() ? nullptr : entries.front();
+    return GetFirstEntryByPred(
+            fstab, [&path](const FstabEntry& entry) { return entry.mount_point == path; });
 }
 
 const FstabEntry* GetEntryForMountPoint(const Fstab* fstab, const std::string& path) {
-    std::vector<const FstabEntry*> entries = GetEntriesForMountPoint(fstab, path);
-    return entries.empty() ? nullptr : entries.front();
+    return GetFirstEntryByPred(
+            fstab, [&path](const FstabEntry& entry) { return entry.mount_point == path; });
 }
 
 std::set<std::string> GetBootDevices() {
@@ -87,6 +87,7 @@ struct FstabEntry {
         bool overlayfs_remove_missing_lowerdir : 1;
         bool is_zoned : 1;
         bool wrapped_key : 1;
+        bool hashtree_prewarm : 1;
     } fs_mgr_flags = {};
 
     bool is_encryptable() const { return fs_mgr_flags.crypt; }
@@ -116,11 +116,13 @@ void Partition::AddExtent(std::unique_ptr<Extent>&& extent) {
         }
     }
     extents_.push_back(std::move(extent));
+    ExtentsChanged();
 }
 
 void Partition::RemoveExtents() {
     size_ = 0;
     extents_.clear();
+    ExtentsChanged();
 }
 
 void Partition::ShrinkTo(uint64_t aligned_size) {
@@ -128,6 +130,7 @@ void Partition::ShrinkTo(uint64_t aligned_size) {
         RemoveExtents();
         return;
     }
+    ExtentsChanged();
 
     // Remove or shrink extents of any kind until the total partition size is
     // equal to the requested size.
@@ -541,6 +544,7 @@ Partition* MetadataBuilder::AddPartition(std::string_view name, std::string_view
         return nullptr;
     }
     partitions_.push_back(std::make_unique<Partition>(name, group_name, attributes));
+    partitions_.back()->layout_generation_ = &layout_generation_;
     return partitions_.back().get();
 }
 
@@ -577,6 +581,7 @@ void MetadataBuilder::RemovePartition(std::string_view name) {
     for (auto iter = partitions_.begin(); iter != partitions_.end(); iter++) {
         if ((*iter)->name() == name) {
             partitions_.erase(iter);
+            layout_generation_++;
             return;
         }
     }
@@ -611,6 +616,16 @@ void MetadataBuilder::ExtentsToFreeList(const std::vector<Interval>& extents,
 
 auto MetadataBuilder::GetFreeRegions() const -> std::vector<Interval> {
     std::vector<Interval> free_regions;
+    for (const auto& regions : FreeSpace()) {
+        free_regions.insert(free_regions.end(), regions.begin(), regions.end());
+    }
+    return free_regions;
+}
+
+auto MetadataBuilder::FreeSpace() const -> const std::vector<std::set<Interval>>& {
+    if (free_space_generation_ == layout_generation_) {
+        return free_space_;
+    }
 
     // Collect all extents in the partition table, per-device, then sort them
     // by starting sector.
@@ -630,6 +645,7 @@ auto MetadataBuilder::GetFreeRegions() const -> std::vector<Interval> {
 
     // Add 0-length intervals for the first and last sectors. This will cause
     // ExtentToFreeList() to treat the space in between as available.
+    free_space_.resize(block_devices_.size());
     for (size_t i = 0; i < device_extents.size(); i++) {
         auto& extents = device_extents[i];
         const auto& block_device = block_devices_[i];
@@ -640,9 +656,46 @@ auto MetadataBuilder::GetFreeRegions() const -> std::vector<Interval> {
         extents.emplace_back(i, last_sector, last_sector);
 
         std::sort(extents.begin(), extents.end());
+
+        std::vector<Interval> free_regions;
         ExtentsToFreeList(extents, &free_regions);
+        free_space_[i] = std::set<Interval>(free_regions.begin(), free_regions.end());
     }
-    return free_regions;
+    free_space_generation_ = layout_generation_;
+    return free_space_;
+}
+
+// Remove |extent| from the free space map, as if the map had been rebuilt after adding it to a
+// partition. Returns false if |extent| does not lie within a single free region.
+bool MetadataBuilder::ReserveFreeSpace(const LinearExtent& extent) {
+    auto& regions = free_space_[extent.device_index()];
+    uint64_t start = extent.physical_sector();
+    uint64_t end = extent.end_sector();
+
+    auto iter = regions.upper_bound(
+            Interval(extent.device_index(), start, std::numeric_limits<uint64_t>::max()));
+    if (iter == regions.begin()) {
+        return false;
+    }
+    Interval region = *--iter;
+    if (region.end < end) {
+        return false;
+    }
+    regions.erase(iter);
+
+    // The space before the extent stays free as is. The space after it starts at the next
+    // aligned sector, as in ExtentsToFreeList().
+    if (region.start < start) {
+        regions.emplace(region.device_index, region.start, start);
+    }
+    uint64_t aligned;
+    if (!AlignSector(block_devices_[region.device_index], end, &aligned)) {
+        return false;
+    }
+    if (aligned < region.end) {
+        regions.emplace(region.device_index, aligned, region.end);
+    }
+    return true;
 }
 
 bool MetadataBuilder::ValidatePartitionSizeChange(Partition* partition, uint64_t old_size,
@@ -724,9 +777,11 @@ bool MetadataBuilder::GrowPartition(Partition* partition, uint64_t aligned_size,
     // If the last extent in the partition has a size < alignment, then the
     // difference is unallocatable due to being misaligned. We peek for that
     // case here to avoid wasting space.
+    size_t first_free_extent = 0;
     if (auto extent = ExtendFinalExtent(partition, free_regions, sectors_needed)) {
         sectors_needed -= extent->num_sectors();
         new_extents.emplace_back(std::move(extent));
+        first_free_extent = 1;
     }
 
     for (auto& region : free_regions) {
@@ -764,10 +819,19 @@ bool MetadataBuilder::GrowPartition(Partition* partition, uint64_t aligned_size,
         return false;
     }
 
-    // Everything succeeded, so commit the new extents.
+    // Everything succeeded, so commit the new extents. The free space map is
+    // updated in place rather than rebuilt by the next allocation. The
+    // extended final extent came from misaligned space that is not in it.
+    bool reserved = true;
+    for (size_t i = first_free_extent; i < new_extents.size(); i++) {
+        reserved = reserved && ReserveFreeSpace(*new_extents[i].get());
+    }
     for (auto& extent : new_extents) {
         partition->AddExtent(std::move(extent));
     }
+    if (reserved) {
+        free_space_generation_ = layout_generation_;
+    }
     return true;
 }
 
@@ -1063,6 +1127,7 @@ bool MetadataBuilder::UpdateBlockDeviceInfo(size_t index, const BlockDeviceInfo&
     if (device_info.alignment_offset) {
         block_device.alignment_offset = device_info.alignment_offset;
     }
+    layout_generation_++;
     return true;
 }
 
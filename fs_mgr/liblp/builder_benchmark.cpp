@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <liblp/builder.h>
+#include <storage_literals/storage_literals.h>
+
+using namespace android::fs_mgr;
+using namespace android::storage_literals;
+using android::base::StringPrintf;
+
+// A super partition holding |count| partitions, with every other partition removed so that the
+// free space is split into |count| / 2 holes.
+static std::unique_ptr<MetadataBuilder> NewFragmentedBuilder(int count) {
+    BlockDeviceInfo super("super", 64_GiB, 1_MiB, 0, 4096);
+    auto builder = MetadataBuilder::New({super}, "super", 64_KiB, 2);
+    if (!builder) return nullptr;
+    for (int i = 0; i < count; i++) {
+        Partition* partition = builder->AddPartition(StringPrintf("p%d", i), 0);
+        if (!partition || !builder->ResizePartition(partition, 4_MiB)) return nullptr;
+    }
+    for (int i = 0; i < count; i += 2) {
+        builder->RemovePartition(StringPrintf("p%d", i));
+    }
+    return builder;
+}
+
+// Grows each remaining partition a block at a time, so that every allocation both fills a
+// misaligned tail and takes a new extent from a hole.
+static void BM_GrowFragmented(benchmark::State& state) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto builder = NewFragmentedBuilder(state.range(0));
+        if (!builder) {
+            state.SkipWithError("failed to create builder");
+            return;
+        }
+        state.ResumeTiming();
+        for (int step = 1; step <= 4; step++) {
+            for (int i = 1; i < state.range(0); i += 2) {
+                Partition* partition = builder->FindPartition(StringPrintf("p%d", i));
+                builder->ResizePartition(partition, 4_MiB + step * 260_KiB);
+            }
+        }
+    }
+}
+BENCHMARK(BM_GrowFragmented)->Arg(100)->Arg(300)->Arg(1000);
+
+// Adds and sizes a new set of partitions on top of a fragmented layout, as an update does for
+// the target slot.
+static void BM_AddPartitions(benchmark::State& state) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto builder = NewFragmentedBuilder(state.range(0));
+        if (!builder || !builder->AddGroup("target", 0)) {
+            state.SkipWithError("failed to create builder");
+            return;
+        }
+        state.ResumeTiming();
+        for (int i = 0; i < state.range(0); i++) {
+            Partition* partition = builder->AddPartition(StringPrintf("t%d", i), "target", 0);
+            builder->ResizePartition(partition, 6_MiB);
+        }
+        benchmark::DoNotOptimize(builder->Export());
+    }
+}
+BENCHMARK(BM_AddPartitions)->Arg(100)->Arg(300)->Arg(1000);
+
+BENCHMARK_MAIN();
@@ -1051,6 +1051,40 @@ TEST_F(BuilderTest, AlignFreeRegion) {
     EXPECT_EQ(e2->end_sector(), 4197368);
 }
 
+TEST_F(BuilderTest, FreeRegionsAfterResize) {
+    BlockDeviceInfo super("super", 8_GiB, 1_MiB, 0, 4096);
+    unique_ptr<MetadataBuilder> builder = MetadataBuilder::New({super}, "super", 65536, 2);
+    ASSERT_NE(builder, nullptr);
+
+    for (int i = 0; i < 8; i++) {
+        Partition* p = builder->AddPartition("p" + std::to_string(i), 0);
+        ASSERT_NE(p, nullptr);
+        ASSERT_TRUE(builder->ResizePartition(p, 3_MiB + 12_KiB));
+    }
+    builder->RemovePartition("p2");
+    builder->RemovePartition("p5");
+    ASSERT_TRUE(builder->ResizePartition(builder->FindPartition("p3"), 1_MiB));
+    ASSERT_TRUE(builder->ResizePartition(builder->FindPartition("p0"), 5_MiB + 8_KiB));
+    ASSERT_TRUE(builder->ResizePartition(builder->FindPartition("p7"), 9_MiB));
+    ASSERT_TRUE(builder->ResizePartition(builder->FindPartition("p1"), 4_MiB));
+
+    // The free regions kept up to date across allocations must match the ones
+    // computed from scratch by a new builder.
+    unique_ptr<LpMetadata> exported = builder->Export();
+    ASSERT_NE(exported, nullptr);
+    unique_ptr<MetadataBuilder> imported = MetadataBuilder::New(*exported.get());
+    ASSERT_NE(imported, nullptr);
+
+    auto free_regions = builder->GetFreeRegions();
+    auto expected = imported->GetFreeRegions();
+    ASSERT_EQ(free_regions.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(free_regions[i].device_index, expected[i].device_index);
+        EXPECT_EQ(free_regions[i].start, expected[i].start);
+        EXPECT_EQ(free_regions[i].end, expected[i].end);
+    }
+}
+
 TEST_F(BuilderTest, ResizeOverflow) {
     BlockDeviceInfo super("super", 8_GiB, 786432, 229376, 4096);
     std::vector<BlockDeviceInfo> block_devices = {super};
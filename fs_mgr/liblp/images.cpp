@@ -19,6 +19,9 @@
 #include <limits.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <future>
+
 #include <android-base/file.h>
 
 #include "reader.h"
@@ -236,7 +239,9 @@ bool ImageBuilder::Export(const std::string& file) {
 }
 
 bool ImageBuilder::ExportFiles(const std::string& output_dir) {
-    for (size_t i = 0; i < device_images_.size(); i++) {
+    // The images share nothing but the (read-only) partition images they
+    // reference, so write them concurrently.
+    auto export_file = [this, &output_dir](size_t i) -> bool {
         std::string name = GetBlockDevicePartitionName(metadata_.block_devices[i]);
         std::string file_name = "super_" + name + ".img";
         std::string file_path = output_dir + "/" + file_name;
@@ -254,8 +259,18 @@ bool ImageBuilder::ExportFiles(const std::string& output_dir) {
             LERROR << "sparse_file_write failed (error code " << ret << ")";
             return false;
         }
+        return true;
+    };
+
+    std::vector<std::future<bool>> exports;
+    for (size_t i = 0; i < device_images_.size(); i++) {
+        exports.emplace_back(std::async(std::launch::async, export_file, i));
     }
-    return true;
+    bool ok = true;
+    for (auto& result : exports) {
+        ok &= result.get();
+    }
+    return ok;
 }
 
 bool ImageBuilder::AddData(sparse_file* file, const std::string& blob, uint64_t sector) {
@@ -316,14 +331,13 @@ bool ImageBuilder::Build() {
         return false;
     }
 
+    std::vector<std::pair<const LpMetadataPartition*, std::string>> jobs;
     for (const auto& partition : metadata_.partitions) {
         auto iter = images_.find(GetPartitionName(partition));
         if (iter == images_.end()) {
             continue;
         }
-        if (!AddPartitionImage(partition, iter->second)) {
-            return false;
-        }
+        jobs.emplace_back(&partition, iter->second);
         images_.erase(iter);
     }
 
@@ -331,7 +345,36 @@ bool ImageBuilder::Build() {
         LERROR << "Partition image was specified but no partition was found.";
         return false;
     }
-    return true;
+
+    // Sparse images are described by their chunk headers alone. Raw images
+    // have to be read in full to find fill blocks, which is what dominates
+    // for large super images, so they are scanned concurrently. The chunks
+    // are then added to the sparse files in partition order.
+    std::vector<std::vector<ImageChunk>> chunks(jobs.size());
+    std::vector<std::future<bool>> scans(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        bool indexed;
+        int fd = OpenImageFile(jobs[i].second, &chunks[i], &indexed);
+        if (fd < 0) {
+            LERROR << "Could not open image for partition: " << GetPartitionName(*jobs[i].first);
+            return false;
+        }
+        if (!indexed) {
+            scans[i] = std::async(std::launch::async, &ImageBuilder::ScanImageFile, this, fd,
+                                  &chunks[i]);
+        }
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (scans[i].valid() && !scans[i].get()) {
+            ok = false;
+        }
+        if (ok && !AddPartitionImage(*jobs[i].first, chunks[i])) {
+            ok = false;
+        }
+    }
+    return ok;
 }
 
 static inline bool HasFillValue(uint32_t* buffer, size_t count) {
@@ -344,8 +387,52 @@ static inline bool HasFillValue(uint32_t* buffer, size_t count) {
     return true;
 }
 
+bool ImageBuilder::ScanImageFile(int fd, std::vector<ImageChunk>* chunks) const {
+    uint64_t file_length;
+    if (!GetDescriptorSize(fd, &file_length)) {
+        LERROR << "Could not compute image size";
+        return false;
+    }
+
+    // Read in large batches, but classify block by block: a block whose
+    // words all match is a fill, anything else (including a partial last
+    // block) stays data in the image file. Adjacent blocks of the same kind
+    // are merged into one chunk.
+    static constexpr size_t kScanBufferSize = 1024 * 1024;
+    size_t buffer_size = std::max<size_t>(1, kScanBufferSize / block_size_) * block_size_;
+    std::vector<uint32_t> buffer(buffer_size / sizeof(uint32_t));
+
+    uint64_t pos = 0;
+    while (pos < file_length) {
+        size_t read_size = std::min<uint64_t>(buffer_size, file_length - pos);
+        if (!android::base::ReadFullyAtOffset(fd, buffer.data(), read_size, pos)) {
+            PERROR << "read failed";
+            return false;
+        }
+        for (size_t offset = 0; offset < read_size; offset += block_size_) {
+            size_t length = std::min<size_t>(block_size_, read_size - offset);
+            uint32_t* block = &buffer[offset / sizeof(uint32_t)];
+            bool fill = length == block_size_ && HasFillValue(block, length / sizeof(uint32_t));
+
+            ImageChunk* last = chunks->empty() ? nullptr : &chunks->back();
+            if (last && (last->fd < 0) == fill && (!fill || last->fill_value == block[0])) {
+                last->length += length;
+                continue;
+            }
+            uint64_t image_offset = pos + offset;
+            if (fill) {
+                chunks->push_back({image_offset, length, -1, -1, block[0]});
+            } else {
+                chunks->push_back({image_offset, length, fd, int64_t(image_offset), 0});
+            }
+        }
+        pos += read_size;
+    }
+    return true;
+}
+
 bool ImageBuilder::AddPartitionImage(const LpMetadataPartition& partition,
-                                     const std::string& file) {
+                                     const std::vector<ImageChunk>& chunks) {
     if (partition.num_extents == 0) {
         LERROR << "Partition size is zero: " << GetPartitionName(partition);
         return false;
@@ -360,18 +447,8 @@ bool ImageBuilder::AddPartitionImage(const LpMetadataPartition& partition,
         return false;
     }
 
-    int fd = OpenImageFile(file);
-    if (fd < 0) {
-        LERROR << "Could not open image for partition: " << GetPartitionName(partition);
-        return false;
-    }
-
     // Make sure the image does not exceed the partition size.
-    uint64_t file_length;
-    if (!GetDescriptorSize(fd, &file_length)) {
-        LERROR << "Could not compute image size";
-        return false;
-    }
+    uint64_t file_length = chunks.empty() ? 0 : chunks.back().offset + chunks.back().length;
     uint64_t partition_size = ComputePartitionSize(partition);
     if (file_length > partition_size) {
         LERROR << "Image for partition '" << GetPartitionName(partition)
@@ -379,67 +456,62 @@ bool ImageBuilder::AddPartitionImage(const LpMetadataPartition& partition,
                << ")";
         return false;
     }
-    if (SeekFile64(fd, 0, SEEK_SET)) {
-        PERROR << "lseek failed";
-        return false;
-    }
 
-    // We track the current logical sector and the position the current extent
-    // ends at.
-    uint64_t output_sector = 0;
-    uint64_t extent_last_sector = extent.num_sectors;
-
-    // We also track the output device and the current output block within that
-    // device.
-    uint32_t output_block;
-    if (!SectorToBlock(extent.target_data, &output_block)) {
+    // We track the byte range of the partition covered by the current extent,
+    // and where that extent starts on its output device.
+    uint64_t extent_start = 0;
+    uint64_t extent_end = extent.num_sectors * LP_SECTOR_SIZE;
+    uint32_t extent_block;
+    if (!SectorToBlock(extent.target_data, &extent_block)) {
         return false;
     }
     sparse_file* output_device = device_images_[extent.target_source].get();
 
-    // Proceed to read the file and build sparse images.
-    uint64_t pos = 0;
-    uint64_t remaining = file_length;
-    while (remaining) {
-        // Check if we need to advance to the next extent.
-        if (output_sector == extent_last_sector) {
-            extent_index++;
-            if (extent_index >= partition.first_extent_index + partition.num_extents) {
-                LERROR << "image is larger than extent table";
-                return false;
+    // Chunks are in order, and split wherever they cross an extent boundary.
+    for (const auto& chunk : chunks) {
+        uint64_t offset = chunk.offset;
+        int64_t data_offset = chunk.data_offset;
+        uint64_t remaining = chunk.length;
+        while (remaining) {
+            // Check if we need to advance to the next extent.
+            if (offset >= extent_end) {
+                extent_index++;
+                if (extent_index >= partition.first_extent_index + partition.num_extents) {
+                    LERROR << "image is larger than extent table";
+                    return false;
+                }
+
+                const LpMetadataExtent& extent = metadata_.extents[extent_index];
+                extent_start = extent_end;
+                extent_end += extent.num_sectors * LP_SECTOR_SIZE;
+                output_device = device_images_[extent.target_source].get();
+                if (!SectorToBlock(extent.target_data, &extent_block)) {
+                    return false;
+                }
+                continue;
             }
 
-            const LpMetadataExtent& extent = metadata_.extents[extent_index];
-            extent_last_sector += extent.num_sectors;
-            output_device = device_images_[extent.target_source].get();
-            if (!SectorToBlock(extent.target_data, &output_block)) {
-                return false;
-            }
-        }
-
-        uint32_t buffer[block_size_ / sizeof(uint32_t)];
-        size_t read_size = remaining >= sizeof(buffer) ? sizeof(buffer) : size_t(remaining);
-        if (!android::base::ReadFully(fd, buffer, sizeof(buffer))) {
-            PERROR << "read failed";
-            return false;
-        }
-        if (read_size != sizeof(buffer) || !HasFillValue(buffer, read_size / sizeof(uint32_t))) {
-            int rv = sparse_file_add_fd(output_device, fd, pos, read_size, output_block);
-            if (rv) {
-                LERROR << "sparse_file_add_fd failed with code: " << rv;
-                return false;
-            }
-        } else {
-            int rv = sparse_file_add_fill(output_device, buffer[0], read_size, output_block);
-            if (rv) {
-                LERROR << "sparse_file_add_fill failed with code: " << rv;
-                return false;
+            uint64_t length = std::min(remaining, extent_end - offset);
+            uint32_t output_block = extent_block + (offset - extent_start) / block_size_;
+            if (chunk.fd < 0) {
+                int rv = sparse_file_add_fill(output_device, chunk.fill_value, length,
+                                              output_block);
+                if (rv) {
+                    LERROR << "sparse_file_add_fill failed with code: " << rv;
+                    return false;
+                }
+            } else {
+                int rv = sparse_file_add_fd(output_device, chunk.fd, data_offset, length,
+                                            output_block);
+                if (rv) {
+                    LERROR << "sparse_file_add_fd failed with code: " << rv;
+                    return false;
+                }
             }
+            offset += length;
+            data_offset += length;
+            remaining -= length;
         }
-        pos += read_size;
-        remaining -= read_size;
-        output_sector += block_size_ / LP_SECTOR_SIZE;
-        output_block++;
     }
 
     return true;
@@ -481,13 +553,54 @@ bool ImageBuilder::CheckExtentOrdering() {
     return true;
 }
 
-int ImageBuilder::OpenImageFile(const std::string& file) {
+// Describe a sparse image by its chunk headers. Raw chunks are referenced
+// in place. "Don't care" chunks become zero fills, as they would when the
+// image is expanded. Fails if the chunks do not line up with our blocks.
+bool ImageBuilder::IndexSparseImage(int fd, std::vector<ImageChunk>* chunks) {
+    std::unique_ptr<sparse_index, decltype(&sparse_index_destroy)> index(sparse_index_build(fd),
+                                                                         sparse_index_destroy);
+    if (!index) {
+        return false;
+    }
+
+    int64_t length = sparse_index_len(index.get());
+    for (int64_t offset = 0; offset < length;) {
+        sparse_index_entry entry;
+        if (sparse_index_lookup(index.get(), offset, &entry) < 0) {
+            return false;
+        }
+        if (entry.offset % block_size_ != 0 || entry.len % block_size_ != 0) {
+            return false;
+        }
+        ImageChunk chunk = {uint64_t(entry.offset), uint64_t(entry.len), -1, -1, 0};
+        if (entry.type == SPARSE_INDEX_RAW) {
+            chunk.fd = fd;
+            chunk.data_offset = entry.data_offset;
+        } else if (entry.type == SPARSE_INDEX_FILL) {
+            chunk.fill_value = entry.fill_val;
+        }
+        chunks->push_back(chunk);
+        offset = entry.offset + entry.len;
+    }
+    return true;
+}
+
+int ImageBuilder::OpenImageFile(const std::string& file, std::vector<ImageChunk>* chunks,
+                                bool* indexed) {
     unique_fd source_fd = GetControlFileOrOpen(file.c_str(), O_RDONLY | O_CLOEXEC | O_BINARY);
     if (source_fd < 0) {
         PERROR << "open image file failed: " << file;
         return -1;
     }
 
+    *indexed = IndexSparseImage(source_fd.get(), chunks);
+    if (*indexed) {
+        int fd = source_fd.get();
+        temp_fds_.push_back(std::move(source_fd));
+        return fd;
+    }
+    chunks->clear();
+
     SparsePtr source(sparse_file_import(source_fd, true, true), sparse_file_destroy);
     if (!source) {
         int fd = source_fd.get();
@@ -501,7 +614,8 @@ int ImageBuilder::OpenImageFile(const std::string& file) {
         return -1;
     }
 
-    // We temporarily unsparse the file, rather than try to merge its chunks.
+    // The sparse image's blocks do not line up with ours, so unsparse it
+    // rather than try to split its chunks.
     int rv = sparse_file_write(source.get(), tf.fd, false, false, false);
     if (rv) {
         LERROR << "sparse_file_write failed with code: " << rv;
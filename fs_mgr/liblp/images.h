@@ -18,6 +18,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 #include <liblp/liblp.h>
@@ -47,9 +48,22 @@ class ImageBuilder {
     const std::vector<SparsePtr>& device_images() const { return device_images_; }
 
   private:
+    // A run of a partition image: either data at |data_offset| in |fd|, or
+    // a fill (|fd| < 0). Offsets and lengths are in bytes of the partition.
+    struct ImageChunk {
+        uint64_t offset;
+        uint64_t length;
+        int fd;
+        int64_t data_offset;
+        uint32_t fill_value;
+    };
+
     bool AddData(sparse_file* file, const std::string& blob, uint64_t sector);
-    bool AddPartitionImage(const LpMetadataPartition& partition, const std::string& file);
-    int OpenImageFile(const std::string& file);
+    bool AddPartitionImage(const LpMetadataPartition& partition,
+                           const std::vector<ImageChunk>& chunks);
+    int OpenImageFile(const std::string& file, std::vector<ImageChunk>* chunks, bool* indexed);
+    bool IndexSparseImage(int fd, std::vector<ImageChunk>* chunks);
+    bool ScanImageFile(int fd, std::vector<ImageChunk>* chunks) const;
     bool SectorToBlock(uint64_t sector, uint32_t* block);
     uint64_t BlockToSector(uint64_t block) const;
     bool CheckExtentOrdering();
@@ -155,12 +155,17 @@ class Partition final {
   private:
     void ShrinkTo(uint64_t aligned_size);
     void set_group_name(std::string_view group_name) { group_name_ = group_name; }
+    void ExtentsChanged() {
+        if (layout_generation_) (*layout_generation_)++;
+    }
 
     std::string name_;
     std::string group_name_;
     std::vector<std::unique_ptr<Extent>> extents_;
     uint32_t attributes_;
     uint64_t size_;
+    // Set by the MetadataBuilder owning this partition, and bumped whenever extents_ changes.
+    uint64_t* layout_generation_ = nullptr;
 };
 
 // An interval in the metadata. This is similar to a LinearExtent with one difference.
@@ -411,6 +416,8 @@ class MetadataBuilder {
     void ExtentsToFreeList(const std::vector<Interval>& extents,
                            std::vector<Interval>* free_regions) const;
     std::vector<Interval> PrioritizeSecondHalfOfSuper(const std::vector<Interval>& free_list);
+    const std::vector<std::set<Interval>>& FreeSpace() const;
+    bool ReserveFreeSpace(const LinearExtent& extent);
     std::unique_ptr<LinearExtent> ExtendFinalExtent(Partition* partition,
                                                     const std::vector<Interval>& free_list,
                                                     uint64_t sectors_needed) const;
@@ -424,6 +431,13 @@ class MetadataBuilder {
     std::vector<std::unique_ptr<PartitionGroup>> groups_;
     std::vector<LpMetadataBlockDevice> block_devices_;
     bool auto_slot_suffixing_;
+
+    // Free regions of each block device. GrowPartition carves its new extents out of these, and
+    // any other change to the layout bumps layout_generation_ so that they are rebuilt from the
+    // partition table on next use.
+    mutable std::vector<std::set<Interval>> free_space_;
+    mutable uint64_t free_space_generation_ = 0;
+    uint64_t layout_generation_ = 1;
 };
 
 // Read BlockDeviceInfo for a given block device. This always returns false
@@ -22,6 +22,7 @@
 #include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 #include <liblp/builder.h>
@@ -87,9 +88,17 @@ class SuperLayoutBuilder final {
                       uint64_t partition_size);
 
     // Return the list of extents describing the super image. If this list is
-    // empty, then there was an unrecoverable error in building the list.
+    // empty, then there was an unrecoverable error in building the list. When
+    // super spans several block devices, this only describes the first one.
     std::vector<SuperImageExtent> GetImageLayout();
 
+    // Return the lists of extents describing each block device of super, in
+    // the order of the metadata's block devices. Only the first one holds the
+    // geometry and metadata, and the others are empty if no partition has data
+    // on them. If the outer list is empty, then there was an unrecoverable
+    // error in building the lists.
+    std::vector<std::vector<SuperImageExtent>> GetBlockDeviceLayouts();
+
     // Return the current metadata.
     std::unique_ptr<LpMetadata> Export() const { return builder_->Export(); }
 
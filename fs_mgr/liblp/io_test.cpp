@@ -627,6 +627,72 @@ TEST_F(LiblpTest, FlashSparseImage) {
     ASSERT_NE(ReadBackupMetadata(fd.get(), geometry, 0), nullptr);
 }
 
+// Test that raw and sparse partition images end up at their extents.
+TEST_F(LiblpTest, FlashSparseImageWithPartitionImages) {
+    unique_fd fd = CreateFakeDisk();
+    ASSERT_GE(fd, 0);
+
+    BlockDeviceInfo device_info("super", kDiskSize, 0, 0, 512);
+    unique_ptr<MetadataBuilder> builder =
+            MetadataBuilder::New(device_info, kMetadataSize, kMetadataSlots);
+    ASSERT_NE(builder, nullptr);
+    ASSERT_TRUE(AddDefaultPartitions(builder.get()));
+    Partition* vendor = builder->AddPartition("vendor", LP_PARTITION_ATTR_NONE);
+    ASSERT_NE(vendor, nullptr);
+    ASSERT_TRUE(builder->ResizePartition(vendor, 8 * 1024));
+
+    unique_ptr<LpMetadata> exported = builder->Export();
+    ASSERT_NE(exported, nullptr);
+
+    // A raw image with data, zeroes, a fill and a partial last block.
+    std::string system_data(24 * 1024 - 100, '\0');
+    for (size_t i = 0; i < system_data.size(); i++) {
+        if (i < 4096 || i >= 16384) {
+            system_data[i] = static_cast<char>(i * 7 + 1);
+        } else if (i >= 12288) {
+            system_data[i] = static_cast<char>(0xab);
+        }
+    }
+    TemporaryFile system_file;
+    ASSERT_TRUE(android::base::WriteStringToFd(system_data, system_file.fd));
+
+    // A sparse image with data, a fill and a "don't care" tail.
+    std::string vendor_data(8 * 1024, '\0');
+    for (size_t i = 0; i < 4096; i++) {
+        vendor_data[i] = i < 2048 ? static_cast<char>(i * 3 + 5) : 0x11;
+    }
+    TemporaryFile vendor_file;
+    ImageBuilder::SparsePtr vendor_sparse(sparse_file_new(512, vendor_data.size()),
+                                          sparse_file_destroy);
+    ASSERT_NE(vendor_sparse, nullptr);
+    ASSERT_EQ(sparse_file_add_data(vendor_sparse.get(), vendor_data.data(), 2048, 0), 0);
+    ASSERT_EQ(sparse_file_add_fill(vendor_sparse.get(), 0x11111111, 2048, 4), 0);
+    ASSERT_EQ(sparse_file_write(vendor_sparse.get(), vendor_file.fd, false, true, false), 0);
+
+    ImageBuilder sparse(*exported.get(), 512,
+                        {{"system", system_file.path}, {"vendor", vendor_file.path}},
+                        true /* sparsify */);
+    ASSERT_TRUE(sparse.IsValid());
+    ASSERT_TRUE(sparse.Build());
+
+    const auto& images = sparse.device_images();
+    ASSERT_EQ(images.size(), static_cast<size_t>(1));
+    ASSERT_NE(lseek(fd.get(), 0, SEEK_SET), -1);
+    ASSERT_EQ(sparse_file_write(images[0].get(), fd.get(), false, false, false), 0);
+
+    std::map<std::string, std::string> expected = {{"system", system_data},
+                                                   {"vendor", vendor_data}};
+    for (const auto& partition : exported->partitions) {
+        const auto& data = expected[GetPartitionName(partition)];
+        ASSERT_EQ(partition.num_extents, 1u);
+        const auto& extent = exported->extents[partition.first_extent_index];
+        std::string contents(data.size(), '\0');
+        ASSERT_TRUE(android::base::ReadFullyAtOffset(fd.get(), contents.data(), contents.size(),
+                                                     extent.target_data * LP_SECTOR_SIZE));
+        EXPECT_EQ(contents, data) << GetPartitionName(partition);
+    }
+}
+
 TEST_F(LiblpTest, AutoSlotSuffixing) {
     unique_ptr<MetadataBuilder> builder = CreateDefaultBuilder();
     ASSERT_NE(builder, nullptr);
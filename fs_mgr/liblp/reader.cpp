@@ -39,6 +39,9 @@ class Reader {
   public:
     virtual ~Reader(){};
     virtual bool ReadFully(void* buffer, size_t length) = 0;
+    // Return the next |length| bytes in place and skip past them, or nullptr if
+    // they have to be read with ReadFully().
+    virtual const uint8_t* ReadInPlace(size_t) { return nullptr; }
 };
 
 class FileReader final : public Reader {
@@ -65,6 +68,15 @@ class MemoryReader final : public Reader {
         pos_ += length;
         return true;
     }
+    const uint8_t* ReadInPlace(size_t length) override {
+        if (size_ - pos_ < length) {
+            errno = EINVAL;
+            return nullptr;
+        }
+        const uint8_t* data = buffer_ + pos_;
+        pos_ += length;
+        return data;
+    }
 
   private:
     const uint8_t* buffer_;
@@ -261,20 +273,25 @@ static std::unique_ptr<LpMetadata> ParseMetadata(const LpMetadataGeometry& geome
         return nullptr;
     }
 
-    // Read the metadata payload. Allocation is fallible since the table size
-    // could be large.
-    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[header.tables_size]);
-    if (!buffer) {
-        LERROR << "Out of memory reading logical partition tables.";
-        return nullptr;
-    }
-    if (!reader->ReadFully(buffer.get(), header.tables_size)) {
-        PERROR << __PRETTY_FUNCTION__ << " read " << header.tables_size << "bytes failed";
-        return nullptr;
+    // Read the metadata payload, in place if the reader holds it in memory.
+    // Otherwise allocation is fallible since the table size could be large.
+    const uint8_t* tables = reader->ReadInPlace(header.tables_size);
+    std::unique_ptr<uint8_t[]> buffer;
+    if (!tables) {
+        buffer.reset(new (std::nothrow) uint8_t[header.tables_size]);
+        if (!buffer) {
+            LERROR << "Out of memory reading logical partition tables.";
+            return nullptr;
+        }
+        if (!reader->ReadFully(buffer.get(), header.tables_size)) {
+            PERROR << __PRETTY_FUNCTION__ << " read " << header.tables_size << "bytes failed";
+            return nullptr;
+        }
+        tables = buffer.get();
     }
 
     uint8_t checksum[32];
-    SHA256(buffer.get(), header.tables_size, checksum);
+    SHA256(tables, header.tables_size, checksum);
     if (memcmp(checksum, header.tables_checksum, sizeof(checksum)) != 0) {
         LERROR << "Logical partition metadata has invalid table checksum.";
         return nullptr;
@@ -287,7 +304,8 @@ static std::unique_ptr<LpMetadata> ParseMetadata(const LpMetadataGeometry& geome
 
     // ValidateTableSize ensured that |cursor| is valid for the number of
     // entries in the table.
-    uint8_t* cursor = buffer.get() + header.partitions.offset;
+    const uint8_t* cursor = tables + header.partitions.offset;
+    metadata->partitions.reserve(header.partitions.num_entries);
     for (size_t i = 0; i < header.partitions.num_entries; i++) {
         LpMetadataPartition partition;
         memcpy(&partition, cursor, sizeof(partition));
@@ -313,7 +331,8 @@ static std::unique_ptr<LpMetadata> ParseMetadata(const LpMetadataGeometry& geome
         metadata->partitions.push_back(partition);
     }
 
-    cursor = buffer.get() + header.extents.offset;
+    cursor = tables + header.extents.offset;
+    metadata->extents.reserve(header.extents.num_entries);
     for (size_t i = 0; i < header.extents.num_entries; i++) {
         LpMetadataExtent extent;
         memcpy(&extent, cursor, sizeof(extent));
@@ -328,7 +347,8 @@ static std::unique_ptr<LpMetadata> ParseMetadata(const LpMetadataGeometry& geome
         metadata->extents.push_back(extent);
     }
 
-    cursor = buffer.get() + header.groups.offset;
+    cursor = tables + header.groups.offset;
+    metadata->groups.reserve(header.groups.num_entries);
     for (size_t i = 0; i < header.groups.num_entries; i++) {
         LpMetadataPartitionGroup group = {};
         memcpy(&group, cursor, sizeof(group));
@@ -337,7 +357,8 @@ static std::unique_ptr<LpMetadata> ParseMetadata(const LpMetadataGeometry& geome
         metadata->groups.push_back(group);
     }
 
-    cursor = buffer.get() + header.block_devices.offset;
+    cursor = tables + header.block_devices.offset;
+    metadata->block_devices.reserve(header.block_devices.num_entries);
     for (size_t i = 0; i < header.block_devices.num_entries; i++) {
         LpMetadataBlockDevice device = {};
         memcpy(&device, cursor, sizeof(device));
@@ -373,24 +394,31 @@ std::unique_ptr<LpMetadata> ParseMetadata(const LpMetadataGeometry& geometry, in
     return ParseMetadata(geometry, &reader);
 }
 
-std::unique_ptr<LpMetadata> ReadPrimaryMetadata(int fd, const LpMetadataGeometry& geometry,
-                                                uint32_t slot_number) {
-    int64_t offset = GetPrimaryMetadataOffset(geometry, slot_number);
-    if (SeekFile64(fd, offset, SEEK_SET) < 0) {
-        PERROR << __PRETTY_FUNCTION__ << " lseek failed: offset " << offset;
+// Read the whole metadata slot at |offset| with a single read, and parse it
+// in place.
+static std::unique_ptr<LpMetadata> ReadMetadataAt(int fd, const LpMetadataGeometry& geometry,
+                                                  int64_t offset) {
+    std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[geometry.metadata_max_size]);
+    if (!buffer) {
+        LERROR << "Out of memory reading logical partition metadata.";
         return nullptr;
     }
-    return ParseMetadata(geometry, fd);
+    if (!android::base::ReadFullyAtOffset(fd, buffer.get(), geometry.metadata_max_size, offset)) {
+        PERROR << __PRETTY_FUNCTION__ << " read " << geometry.metadata_max_size
+               << " bytes failed: offset " << offset;
+        return nullptr;
+    }
+    return ParseMetadata(geometry, buffer.get(), geometry.metadata_max_size);
+}
+
+std::unique_ptr<LpMetadata> ReadPrimaryMetadata(int fd, const LpMetadataGeometry& geometry,
+                                                uint32_t slot_number) {
+    return ReadMetadataAt(fd, geometry, GetPrimaryMetadataOffset(geometry, slot_number));
 }
 
 std::unique_ptr<LpMetadata> ReadBackupMetadata(int fd, const LpMetadataGeometry& geometry,
                                                uint32_t slot_number) {
-    int64_t offset = GetBackupMetadataOffset(geometry, slot_number);
-    if (SeekFile64(fd, offset, SEEK_SET) < 0) {
-        PERROR << __PRETTY_FUNCTION__ << " lseek failed: offset " << offset;
-        return nullptr;
-    }
-    return ParseMetadata(geometry, fd);
+    return ReadMetadataAt(fd, geometry, GetBackupMetadataOffset(geometry, slot_number));
 }
 
 namespace {
@@ -460,11 +488,7 @@ std::unique_ptr<LpMetadata> ReadMetadata(const IPartitionOpener& opener,
     std::unique_ptr<LpMetadata> metadata;
 
     for (const auto& offset : offsets) {
-        if (SeekFile64(fd, offset, SEEK_SET) < 0) {
-            PERROR << __PRETTY_FUNCTION__ << " lseek failed, offset " << offset;
-            continue;
-        }
-        if ((metadata = ParseMetadata(geometry, fd)) != nullptr) {
+        if ((metadata = ReadMetadataAt(fd, geometry, offset)) != nullptr) {
             break;
         }
     }
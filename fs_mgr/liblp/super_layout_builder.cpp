@@ -61,11 +61,6 @@ bool SuperLayoutBuilder::Open(const LpMetadata& metadata) {
         // should never be true of super_empty.img.
         return false;
     }
-    if (metadata.block_devices.size() != 1) {
-        LOG(ERROR) << "Only one 'super' is supported";
-        return false;
-    }
-
     builder_ = MetadataBuilder::New(metadata);
     return !!builder_;
 }
@@ -112,12 +107,21 @@ static bool AddGapExtents(std::vector<SuperImageExtent>* extents, SuperImageExte
 }
 
 std::vector<SuperImageExtent> SuperLayoutBuilder::GetImageLayout() {
+    auto layouts = GetBlockDeviceLayouts();
+    if (layouts.empty()) {
+        return {};
+    }
+    return std::move(layouts[0]);
+}
+
+std::vector<std::vector<SuperImageExtent>> SuperLayoutBuilder::GetBlockDeviceLayouts() {
     auto metadata = builder_->Export();
-    if (!metadata) {
+    if (!metadata || metadata->block_devices.empty()) {
         return {};
     }
 
-    std::vector<SuperImageExtent> extents;
+    std::vector<std::vector<SuperImageExtent>> layouts(metadata->block_devices.size());
+    auto& extents = layouts[0];
 
     // Write the primary and backup copies of geometry.
     std::string geometry_bytes = SerializeGeometry(metadata->geometry);
@@ -159,7 +163,8 @@ std::vector<SuperImageExtent> SuperLayoutBuilder::GetImageLayout() {
         extents.emplace_back(metadata_backup, blob);
     }
 
-    // Add extents for each partition.
+    // Add extents for each partition, to the layout of the block device they
+    // are on.
     for (const auto& partition : metadata->partitions) {
         auto partition_name = GetPartitionName(partition);
         auto image_name_iter = image_map_.find(partition_name);
@@ -183,19 +188,26 @@ std::vector<SuperImageExtent> SuperLayoutBuilder::GetImageLayout() {
                 LOG(INFO) << "Unknown extent type from liblp: " << e.target_type;
                 return {};
             }
+            if (e.target_source >= layouts.size()) {
+                LOG(ERROR) << "Extent of " << partition_name << " is on unknown block device "
+                           << e.target_source;
+                return {};
+            }
 
             size_t size = e.num_sectors * LP_SECTOR_SIZE;
-            uint64_t super_offset = e.target_data * LP_SECTOR_SIZE;
-            extents.emplace_back(super_offset, size, image_name, image_offset);
+            uint64_t device_offset = e.target_data * LP_SECTOR_SIZE;
+            layouts[e.target_source].emplace_back(device_offset, size, image_name, image_offset);
 
             image_offset += size;
         }
     }
 
-    if (!AddGapExtents(&extents, SuperImageExtent::Type::DONTCARE)) {
-        return {};
+    for (auto& layout : layouts) {
+        if (!AddGapExtents(&layout, SuperImageExtent::Type::DONTCARE)) {
+            return {};
+        }
     }
-    return extents;
+    return layouts;
 }
 
 bool SuperImageExtent::operator==(const SuperImageExtent& other) const {
@@ -79,8 +79,12 @@ TEST(SuperImageTool, NoWritablePartitions) {
     ASSERT_FALSE(tool.Open(*metadata.get()));
 }
 
-TEST(SuperImageTool, NoRetrofit) {
-    auto builder = MetadataBuilder::New(4_MiB, 8_KiB, 2);
+TEST(SuperImageTool, MultipleBlockDevices) {
+    std::vector<BlockDeviceInfo> block_devices = {
+            BlockDeviceInfo("super", 4_MiB, 0, 0, 4096),
+            BlockDeviceInfo("super_ext", 4_MiB, 0, 0, 4096),
+    };
+    auto builder = MetadataBuilder::New(block_devices, "super", 8_KiB, 2);
     ASSERT_NE(builder, nullptr);
 
     Partition* p = builder->AddPartition("system_a", LP_PARTITION_ATTR_READONLY);
@@ -89,11 +93,41 @@ TEST(SuperImageTool, NoRetrofit) {
     auto metadata = builder->Export();
     ASSERT_NE(metadata, nullptr);
 
-    // Add an extra block device.
-    metadata->block_devices.emplace_back(metadata->block_devices[0]);
-
     SuperLayoutBuilder tool;
-    ASSERT_FALSE(tool.Open(*metadata.get()));
+    ASSERT_TRUE(tool.Open(*metadata.get()));
+    // More than fits on the first block device.
+    ASSERT_TRUE(tool.AddPartition("system_a", "system.img", 6_MiB));
+
+    // Get a copy of the metadata we'd expect if flashing.
+    ASSERT_TRUE(builder->ResizePartition(p, 6_MiB));
+    metadata = builder->Export();
+    ASSERT_NE(metadata, nullptr);
+    ASSERT_EQ(metadata->extents.size(), 2);
+    const auto& first = metadata->extents[0];
+    const auto& second = metadata->extents[1];
+    ASSERT_EQ(first.target_source, 0);
+    ASSERT_EQ(second.target_source, 1);
+
+    auto layouts = tool.GetBlockDeviceLayouts();
+    ASSERT_EQ(layouts.size(), 2);
+
+    // The first block device has the geometry and metadata, followed by the
+    // start of system.
+    ASSERT_FALSE(layouts[0].empty());
+    EXPECT_EQ(layouts[0].back(),
+              SuperImageExtent(first.target_data * LP_SECTOR_SIZE,
+                               first.num_sectors * LP_SECTOR_SIZE, "system.img", 0));
+    EXPECT_EQ(tool.GetImageLayout(), layouts[0]);
+
+    // The second one only has the rest of system.
+    uint64_t offset = second.target_data * LP_SECTOR_SIZE;
+    ASSERT_EQ(layouts[1].size(), offset ? 2 : 1);
+    if (offset) {
+        EXPECT_EQ(layouts[1][0], SuperImageExtent(0, offset, SuperImageExtent::Type::DONTCARE));
+    }
+    EXPECT_EQ(layouts[1].back(),
+              SuperImageExtent(offset, second.num_sectors * LP_SECTOR_SIZE, "system.img",
+                               first.num_sectors * LP_SECTOR_SIZE));
 }
 
 TEST(SuperImageTool, NoRetrofit2) {
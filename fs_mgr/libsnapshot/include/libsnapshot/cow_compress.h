@@ -17,6 +17,7 @@
 #pragma once
 
 #include <memory>
+#include <span>
 #include <vector>
 
 #include "libsnapshot/cow_format.h"
@@ -35,13 +36,18 @@ class ICompressor {
                                            const uint32_t block_size);
     static std::unique_ptr<ICompressor> Brotli(const int32_t compression_level,
                                                const uint32_t block_size);
+    // |dictionary| is copied; lz4 and zstd are the only algorithms that
+    // support one.
     static std::unique_ptr<ICompressor> Lz4(const int32_t compression_level,
-                                            const uint32_t block_size);
+                                            const uint32_t block_size,
+                                            std::span<const uint8_t> dictionary = {});
     static std::unique_ptr<ICompressor> Zstd(const int32_t compression_level,
-                                             const uint32_t block_size);
+                                             const uint32_t block_size,
+                                             std::span<const uint8_t> dictionary = {});
 
     static std::unique_ptr<ICompressor> Create(CowCompression compression,
-                                               const uint32_t block_size);
+                                               const uint32_t block_size,
+                                               std::span<const uint8_t> dictionary = {});
 
     int32_t GetCompressionLevel() const { return compression_level_; }
     uint32_t GetBlockSize() const { return block_size_; }
@@ -51,5 +57,11 @@ class ICompressor {
     const int32_t compression_level_;
     const uint32_t block_size_;
 };
+
+// Train a dictionary of at most |dictionary_size| bytes from |samples|, which
+// holds consecutive samples of |sample_size| bytes each (typically blocks of
+// the target partition). Returns an empty vector on failure.
+std::vector<uint8_t> TrainCompressionDictionary(std::span<const uint8_t> samples,
+                                                size_t sample_size, size_t dictionary_size);
 }  // namespace snapshot
 }  // namespace android
@@ -115,8 +115,14 @@ struct CowHeaderV3 : public CowHeader {
     uint32_t compression_algorithm;
     // Max compression size supported
     uint32_t max_compression_size;
+    // Size of the compression dictionary, 0 if blocks are compressed without
+    // one. The dictionary is stored between the resume buffer and the ops.
+    uint32_t dictionary_size;
 } __attribute__((packed));
 
+// Largest dictionary supported; this is the LZ4 window size.
+static constexpr uint32_t kCowMaxDictionarySize = 64 * 1024;
+
 enum class CowOperationType : uint8_t {
     kCowCopyOp = 1,
     kCowReplaceOp = 2,
@@ -302,8 +308,12 @@ static constexpr off_t GetResumeOffset(const CowHeaderV3& header) {
     return GetSequenceOffset(header) + (header.sequence_data_count * sizeof(uint32_t));
 }
 
+static constexpr off_t GetDictionaryOffset(const CowHeaderV3& header) {
+    return GetResumeOffset(header) + (header.resume_point_max * sizeof(ResumePoint));
+}
+
 static constexpr off_t GetOpOffset(uint32_t op_index, const CowHeaderV3& header) {
-    return GetResumeOffset(header) + (header.resume_point_max * sizeof(ResumePoint)) +
+    return GetDictionaryOffset(header) + header.dictionary_size +
            (op_index * sizeof(CowOperationV3));
 }
 
@@ -18,6 +18,9 @@
 
 #include <memory>
 #include <optional>
+#include <span>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -31,6 +34,8 @@ class FileDescriptor;
 namespace android {
 namespace snapshot {
 
+class CowDictionary;
+class CowOpsMapping;
 class ICowOpIter;
 
 // Interface for reading from a snapuserd COW.
@@ -118,7 +123,10 @@ class CowReader final : public ICowReader {
         USERSPACE_MERGE = 1,
     };
 
-    CowReader(ReaderFlags reader_flag = ReaderFlags::DEFAULT, bool is_merge = false);
+    // If |mmap_ops| is set, v3 COW operations are accessed through a
+    // read-only mapping of the file instead of being copied into memory.
+    CowReader(ReaderFlags reader_flag = ReaderFlags::DEFAULT, bool is_merge = false,
+              bool mmap_ops = false);
     ~CowReader() { owned_fd_ = {}; }
 
     // Parse the COW, optionally, up to the given label. If no label is
@@ -144,6 +152,13 @@ class CowReader final : public ICowReader {
     ssize_t ReadData(const CowOperation* op, void* buffer, size_t buffer_size,
                      size_t ignore_bytes = 0) override;
 
+    // Same as ReadData(), but |dest| may be larger than the |to_write| bytes
+    // requested. If |dest| can hold the operation's full decompressed size,
+    // the data is decoded directly into it with no intermediate copy. Only
+    // the first |to_write| bytes of |dest| are meaningful on return.
+    ssize_t ReadData(const CowOperation* op, std::span<uint8_t> dest, size_t to_write,
+                     size_t ignore_bytes = 0);
+
     CowHeader& GetHeader() override { return header_; }
     const CowHeaderV3& header_v3() const { return header_; }
 
@@ -168,6 +183,31 @@ class CowReader final : public ICowReader {
 
     void UpdateMergeOpsCompleted(int num_merge_ops) { header_.num_merge_ops += num_merge_ops; }
 
+    // Returns the operation which writes |new_block|, or nullptr if there is
+    // none. Only available if the reader was created with |mmap_ops| and
+    // parsed a v3 COW.
+    const CowOperation* FindOp(uint64_t new_block);
+
+    // Returns true if operations are mapped from the COW rather than copied.
+    bool ops_mapped() const { return mapped_ops_ != nullptr; }
+
+    // Position of |op| within the operation list, and the reverse. |op| must
+    // derive from ICowOpIter::Get(). Positions, unlike pointers, remain
+    // valid in a reader restored through ImportState().
+    size_t GetOpIndex(const CowOperation* op);
+    const CowOperation* GetOpAt(size_t index);
+
+    // Serialize everything Parse() derived from the COW, so that another
+    // process can take over the reader without parsing again. Only valid
+    // after a successful Parse() with no label.
+    bool ExportState(std::string* out);
+
+    // Restore a reader from ExportState() output. |fd| must be the same
+    // COW; if its header no longer matches, this fails and the caller
+    // should Parse() instead. The reader must have been created with the
+    // same flags as the exporting one.
+    bool ImportState(android::base::borrowed_fd fd, std::string_view state);
+
   private:
     bool ParseV2(android::base::borrowed_fd fd, std::optional<uint64_t> label);
     bool PrepMergeOps();
@@ -179,6 +219,9 @@ class CowReader final : public ICowReader {
                          std::unordered_map<uint32_t, int>* block_map);
     uint64_t FindNumCopyops();
     uint8_t GetCompressionType();
+    bool ReadDictionary();
+    std::span<const CowOperation> GetOps();
+    std::shared_ptr<const void> GetOpsOwner();
 
     android::base::unique_fd owned_fd_;
     android::base::borrowed_fd fd_;
@@ -187,14 +230,23 @@ class CowReader final : public ICowReader {
     uint64_t fd_size_;
     std::optional<uint64_t> last_label_;
     std::shared_ptr<std::vector<CowOperation>> ops_;
+    std::shared_ptr<CowOpsMapping> mapped_ops_;
+    // Op positions sorted by new_block, for mapped ops only.
+    std::shared_ptr<std::vector<uint32_t>> block_index_;
     uint64_t merge_op_start_{};
     std::shared_ptr<std::vector<int>> block_pos_index_;
     uint64_t num_total_data_ops_{};
     uint64_t num_ordered_ops_to_merge_{};
     bool has_seq_ops_{};
     std::shared_ptr<std::unordered_map<uint64_t, uint64_t>> xor_data_loc_;
+    std::shared_ptr<CowDictionary> dictionary_;
     ReaderFlags reader_flag_;
     bool is_merge_{};
+    bool mmap_ops_{};
+    // Last multi-block unit decoded for a partial read, keyed by its data
+    // offset. Not shared with clones.
+    std::vector<uint8_t> unit_cache_;
+    std::optional<uint64_t> unit_cache_offset_;
 };
 
 // Though this function takes in a CowHeaderV3, the struct could be populated as a v1/v2 CowHeader.
@@ -25,6 +25,7 @@
 #include <optional>
 #include <queue>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <android-base/unique_fd.h>
@@ -34,8 +35,19 @@
 namespace android {
 namespace snapshot {
 struct CowSizeInfo {
-    uint64_t cow_size;
-    uint64_t op_count_max;
+    uint64_t cow_size = 0;
+    uint64_t op_count_max = 0;
+
+    // Bytes of replace and xor block data added so far, before and after
+    // compression. Comparing estimators with different CowOptions::compression
+    // gives the per-algorithm cost of the same op stream.
+    uint64_t uncompressed_data_size = 0;
+    uint64_t compressed_data_size = 0;
+
+    // Upper bound on |cow_size| once every block below CowOptions::max_blocks
+    // has been written, assuming the blocks not yet seen do not compress and no
+    // block is written twice. Only set by v3 writers with |max_blocks|.
+    std::optional<uint64_t> max_cow_size;
 };
 struct CowOptions {
     uint32_t block_size = 4096;
@@ -63,6 +75,18 @@ struct CowOptions {
 
     // Compression factor
     uint64_t compression_factor = 4096;
+
+    // Optional dictionary for lz4 or zstd compression, stored in the COW so
+    // that the reader can decompress with it; used in v3 only. See
+    // TrainCompressionDictionary().
+    std::vector<uint8_t> compression_dictionary;
+
+    // Ranges of new blocks, as (first block, block count), that are read at
+    // random rather than sequentially, e.g. database files. These are always
+    // written with single-block compression units so that a 4K read does not
+    // decode a whole |compression_factor| unit; the rest of the device still
+    // uses large units. Used in v3 only.
+    std::vector<std::pair<uint64_t, uint64_t>> random_access_ranges;
 };
 
 // Interface for writing to a snapuserd COW. All operations are ordered; merges
@@ -99,7 +123,9 @@ class ICowWriter {
     virtual bool Finalize() = 0;
 
     // Return number of bytes the cow image occupies on disk + the size of sequence && ops buffer
-    // The latter two fields are used in v3 cow format and left as 0 for v2 cow format
+    // The latter two fields are used in v3 cow format and left as 0 for v2 cow format. For v3,
+    // this includes ops and data that are still cached, so an estimator can be queried at any
+    // point in the op stream.
     virtual CowSizeInfo GetCowSizeInfo() const = 0;
 
     virtual uint32_t GetBlockSize() const = 0;
@@ -409,6 +409,7 @@ class SnapshotManager final : public ISnapshotManager {
     // Add new public entries above this line.
 
   private:
+    FRIEND_TEST(SnapshotTest, CachedSnapshotStatus);
     FRIEND_TEST(SnapshotTest, CleanFirstStageMount);
     FRIEND_TEST(SnapshotTest, CreateSnapshot);
     FRIEND_TEST(SnapshotTest, FirstStageMountAfterRollback);
@@ -477,9 +478,16 @@ class SnapshotManager final : public ISnapshotManager {
         int lock_mode() const { return lock_mode_; }
 
       private:
+        friend class SnapshotManager;
+
         std::string path_;
         android::base::unique_fd fd_;
         int lock_mode_;
+
+        // Status files read or written while this lock is held. Writers need
+        // an exclusive lock, so no other process can change them underneath.
+        std::map<std::string, SnapshotStatus> snapshot_status_cache_;
+        std::optional<SnapshotUpdateStatus> update_status_cache_;
     };
     static std::unique_ptr<LockedFile> OpenFile(const std::string& file, int lock_flags);
 
@@ -523,6 +531,11 @@ class SnapshotManager final : public ISnapshotManager {
                       const std::string& base_device, const std::string& base_path_merge,
                       const std::chrono::milliseconds& timeout_ms, std::string* path);
 
+    // While |deferred_dm_user_cows_| is set, MapDmUserCow queues the daemon
+    // half of userspace snapshots there instead of calling snapuserd. This
+    // creates and attaches all queued handlers with one batched request.
+    bool InitDeferredDmUserCows();
+
     // Map the source device used for dm-user.
     bool MapSourceDevice(LockedFile* lock, const std::string& name,
                          const std::chrono::milliseconds& timeout_ms, std::string* path);
@@ -852,6 +865,7 @@ class SnapshotManager final : public ISnapshotManager {
     std::unique_ptr<LpMetadata> old_partition_metadata_;
     std::optional<bool> is_snapshot_userspace_;
     std::optional<bool> is_legacy_snapuserd_;
+    std::optional<std::vector<SnapuserdClient::DmUserCowParams>> deferred_dm_user_cows_;
 };
 
 }  // namespace snapshot
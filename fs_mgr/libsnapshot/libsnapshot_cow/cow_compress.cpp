@@ -34,6 +34,7 @@
 #include <libsnapshot/cow_reader.h>
 #include <libsnapshot/cow_writer.h>
 #include <lz4.h>
+#include <zdict.h>
 #include <zlib.h>
 #include <zstd.h>
 
@@ -58,16 +59,23 @@ std::optional<CowCompressionAlgorithm> CompressionAlgorithmFromString(std::strin
 }
 
 std::unique_ptr<ICompressor> ICompressor::Create(CowCompression compression,
-                                                 const uint32_t block_size) {
+                                                 const uint32_t block_size,
+                                                 std::span<const uint8_t> dictionary) {
+    if (!dictionary.empty() && compression.algorithm != kCowCompressLz4 &&
+        compression.algorithm != kCowCompressZstd) {
+        LOG(ERROR) << "Compression dictionary not supported for algorithm: "
+                   << compression.algorithm;
+        return nullptr;
+    }
     switch (compression.algorithm) {
         case kCowCompressLz4:
-            return ICompressor::Lz4(compression.compression_level, block_size);
+            return ICompressor::Lz4(compression.compression_level, block_size, dictionary);
         case kCowCompressBrotli:
             return ICompressor::Brotli(compression.compression_level, block_size);
         case kCowCompressGz:
             return ICompressor::Gz(compression.compression_level, block_size);
         case kCowCompressZstd:
-            return ICompressor::Zstd(compression.compression_level, block_size);
+            return ICompressor::Zstd(compression.compression_level, block_size, dictionary);
         case kCowCompressNone:
             return nullptr;
     }
@@ -123,8 +131,20 @@ class GzCompressor final : public ICompressor {
 
 class Lz4Compressor final : public ICompressor {
   public:
-    Lz4Compressor(int32_t compression_level, const uint32_t block_size)
-        : ICompressor(compression_level, block_size){};
+    Lz4Compressor(int32_t compression_level, const uint32_t block_size,
+                  std::span<const uint8_t> dictionary)
+        : ICompressor(compression_level, block_size),
+          dictionary_(dictionary.begin(), dictionary.end()) {
+        if (!dictionary_.empty()) {
+            // Hash the dictionary once; each block then starts from a copy
+            // of this stream state.
+            dict_stream_ = std::make_unique<LZ4_stream_t>();
+            stream_ = std::make_unique<LZ4_stream_t>();
+            LZ4_initStream(dict_stream_.get(), sizeof(LZ4_stream_t));
+            LZ4_loadDict(dict_stream_.get(), reinterpret_cast<const char*>(dictionary_.data()),
+                         dictionary_.size());
+        }
+    };
 
     std::vector<uint8_t> Compress(const void* data, size_t length) const override {
         const auto bound = LZ4_compressBound(length);
@@ -134,9 +154,17 @@ class Lz4Compressor final : public ICompressor {
         }
         std::vector<uint8_t> buffer(bound, '\0');
 
-        const auto compressed_size =
-                LZ4_compress_default(static_cast<const char*>(data),
-                                     reinterpret_cast<char*>(buffer.data()), length, buffer.size());
+        int compressed_size;
+        if (dict_stream_) {
+            memcpy(stream_.get(), dict_stream_.get(), sizeof(LZ4_stream_t));
+            compressed_size = LZ4_compress_fast_continue(
+                    stream_.get(), static_cast<const char*>(data),
+                    reinterpret_cast<char*>(buffer.data()), length, buffer.size(), 1);
+        } else {
+            compressed_size = LZ4_compress_default(static_cast<const char*>(data),
+                                                   reinterpret_cast<char*>(buffer.data()),
+                                                   length, buffer.size());
+        }
         if (compressed_size <= 0) {
             LOG(ERROR) << "LZ4_compress_default failed, input size: " << length
                        << ", compression bound: " << bound << ", ret: " << compressed_size;
@@ -151,6 +179,11 @@ class Lz4Compressor final : public ICompressor {
         }
         return buffer;
     };
+
+  private:
+    std::vector<uint8_t> dictionary_;
+    std::unique_ptr<LZ4_stream_t> dict_stream_;
+    std::unique_ptr<LZ4_stream_t> stream_;
 };
 
 class BrotliCompressor final : public ICompressor {
@@ -181,11 +214,20 @@ class BrotliCompressor final : public ICompressor {
 
 class ZstdCompressor final : public ICompressor {
   public:
-    ZstdCompressor(int32_t compression_level, const uint32_t block_size)
+    ZstdCompressor(int32_t compression_level, const uint32_t block_size,
+                   std::span<const uint8_t> dictionary)
         : ICompressor(compression_level, block_size),
-          zstd_context_(ZSTD_createCCtx(), ZSTD_freeCCtx) {
+          zstd_context_(ZSTD_createCCtx(), ZSTD_freeCCtx),
+          zstd_dict_(nullptr, ZSTD_freeCDict) {
         ZSTD_CCtx_setParameter(zstd_context_.get(), ZSTD_c_compressionLevel, compression_level);
         ZSTD_CCtx_setParameter(zstd_context_.get(), ZSTD_c_windowLog, log2(GetBlockSize()));
+        if (!dictionary.empty()) {
+            zstd_dict_.reset(
+                    ZSTD_createCDict(dictionary.data(), dictionary.size(), compression_level));
+            // The dictionary is referenced, not copied, by the context and
+            // stays attached for every subsequent frame.
+            ZSTD_CCtx_refCDict(zstd_context_.get(), zstd_dict_.get());
+        }
     };
 
     std::vector<uint8_t> Compress(const void* data, size_t length) const override {
@@ -208,8 +250,29 @@ class ZstdCompressor final : public ICompressor {
 
   private:
     std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> zstd_context_;
+    std::unique_ptr<ZSTD_CDict, decltype(&ZSTD_freeCDict)> zstd_dict_;
 };
 
+std::vector<uint8_t> TrainCompressionDictionary(std::span<const uint8_t> samples,
+                                                size_t sample_size, size_t dictionary_size) {
+    if (!sample_size || samples.size() < sample_size) {
+        LOG(ERROR) << "Not enough samples to train a dictionary: " << samples.size();
+        return {};
+    }
+    dictionary_size = std::min<size_t>(dictionary_size, kCowMaxDictionarySize);
+
+    std::vector<size_t> sample_sizes(samples.size() / sample_size, sample_size);
+    std::vector<uint8_t> dictionary(dictionary_size);
+    size_t rv = ZDICT_trainFromBuffer(dictionary.data(), dictionary.size(), samples.data(),
+                                      sample_sizes.data(), sample_sizes.size());
+    if (ZDICT_isError(rv)) {
+        LOG(ERROR) << "Failed to train dictionary: " << ZDICT_getErrorName(rv);
+        return {};
+    }
+    dictionary.resize(rv);
+    return dictionary;
+}
+
 bool CompressWorker::CompressBlocks(const void* buffer, size_t num_blocks, size_t block_size,
                                     std::vector<std::vector<uint8_t>>* compressed_data) {
     return CompressBlocks(compressor_.get(), block_size, buffer, num_blocks, compressed_data);
@@ -330,13 +393,15 @@ std::unique_ptr<ICompressor> ICompressor::Gz(const int32_t compression_level,
 }
 
 std::unique_ptr<ICompressor> ICompressor::Lz4(const int32_t compression_level,
-                                              const uint32_t block_size) {
-    return std::make_unique<Lz4Compressor>(compression_level, block_size);
+                                              const uint32_t block_size,
+                                              std::span<const uint8_t> dictionary) {
+    return std::make_unique<Lz4Compressor>(compression_level, block_size, dictionary);
 }
 
 std::unique_ptr<ICompressor> ICompressor::Zstd(const int32_t compression_level,
-                                               const uint32_t block_size) {
-    return std::make_unique<ZstdCompressor>(compression_level, block_size);
+                                               const uint32_t block_size,
+                                               std::span<const uint8_t> dictionary) {
+    return std::make_unique<ZstdCompressor>(compression_level, block_size, dictionary);
 }
 
 void CompressWorker::Finalize() {
@@ -31,6 +31,14 @@
 namespace android {
 namespace snapshot {
 
+CowDictionary::CowDictionary(std::vector<uint8_t>&& data) : data_(std::move(data)) {
+    zstd_dict_ = ZSTD_createDDict(data_.data(), data_.size());
+}
+
+CowDictionary::~CowDictionary() {
+    ZSTD_freeDDict(zstd_dict_);
+}
+
 ssize_t IByteStream::ReadFully(void* buffer, size_t buffer_size) {
     size_t stream_remaining = Size();
 
@@ -276,8 +284,23 @@ bool BrotliDecompressor::PartialDecompress(const uint8_t* data, size_t length) {
 
 class Lz4Decompressor final : public IDecompressor {
   public:
+    explicit Lz4Decompressor(const CowDictionary* dictionary) : dictionary_(dictionary) {}
     ~Lz4Decompressor() override = default;
 
+    ssize_t DecompressInto(std::span<uint8_t> dest, size_t to_write, size_t decompressed_size,
+                           size_t ignore_bytes) override {
+        if (dest.size() < decompressed_size) {
+            return Decompress(dest.data(), std::min(to_write, dest.size()), decompressed_size,
+                              ignore_bytes);
+        }
+        // |dest| holds the whole block, so decode in place.
+        ssize_t rv = Decompress(dest.data(), dest.size(), decompressed_size, ignore_bytes);
+        if (rv < 0) {
+            return rv;
+        }
+        return std::min<size_t>(rv, to_write);
+    }
+
     ssize_t Decompress(void* buffer, size_t buffer_size, size_t decompressed_size,
                        size_t ignore_bytes) override {
         std::string input_buffer(stream_->Size(), '\0');
@@ -299,8 +322,16 @@ class Lz4Decompressor final : public IDecompressor {
             decode_buffer_size = temp.size();
         }
 
-        const int bytes_decompressed = LZ4_decompress_safe(input_buffer.data(), decode_buffer,
-                                                           input_buffer.size(), decode_buffer_size);
+        int bytes_decompressed;
+        if (dictionary_) {
+            auto dict = dictionary_->data();
+            bytes_decompressed = LZ4_decompress_safe_usingDict(
+                    input_buffer.data(), decode_buffer, input_buffer.size(), decode_buffer_size,
+                    reinterpret_cast<const char*>(dict.data()), dict.size());
+        } else {
+            bytes_decompressed = LZ4_decompress_safe(input_buffer.data(), decode_buffer,
+                                                     input_buffer.size(), decode_buffer_size);
+        }
         if (bytes_decompressed < 0) {
             LOG(ERROR) << "Failed to decompress LZ4 block, code: " << bytes_decompressed;
             return -1;
@@ -332,10 +363,36 @@ class Lz4Decompressor final : public IDecompressor {
         memcpy(buffer, temp.data() + ignore_bytes, max_copy);
         return max_copy;
     }
+
+  private:
+    const CowDictionary* dictionary_;
 };
 
 class ZstdDecompressor final : public IDecompressor {
   public:
+    explicit ZstdDecompressor(const CowDictionary* dictionary) : dictionary_(dictionary) {}
+
+    ssize_t DecompressInto(std::span<uint8_t> dest, size_t to_write, size_t decompressed_size,
+                           size_t ignore_bytes) override {
+        if (dest.size() < decompressed_size) {
+            return Decompress(dest.data(), std::min(to_write, dest.size()), decompressed_size,
+                              ignore_bytes);
+        }
+        // |dest| holds the whole block, so decode in place and drop the
+        // leading |ignore_bytes| instead of going through a scratch buffer.
+        if (ignore_bytes > decompressed_size) {
+            LOG(ERROR) << "Ignoring more bytes than exist in stream (ignoring " << ignore_bytes
+                       << ", got " << decompressed_size << ")";
+            return -1;
+        }
+        if (!Decompress(dest.data(), decompressed_size)) {
+            return -1;
+        }
+        if (ignore_bytes) {
+            memmove(dest.data(), dest.data() + ignore_bytes, decompressed_size - ignore_bytes);
+        }
+        return std::min(decompressed_size - ignore_bytes, to_write);
+    }
     ssize_t Decompress(void* buffer, size_t buffer_size, size_t decompressed_size,
                        size_t ignore_bytes = 0) override {
         if (buffer_size < decompressed_size - ignore_bytes) {
@@ -366,8 +423,17 @@ class ZstdDecompressor final : public IDecompressor {
                        << " actual: " << bytes_read;
             return false;
         }
-        const auto bytes_decompressed = ZSTD_decompress(output_buffer, output_size,
-                                                        input_buffer.data(), input_buffer.size());
+        size_t bytes_decompressed;
+        if (dictionary_ && dictionary_->zstd_dict()) {
+            std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> dctx(ZSTD_createDCtx(),
+                                                                     ZSTD_freeDCtx);
+            bytes_decompressed = ZSTD_decompress_usingDDict(
+                    dctx.get(), output_buffer, output_size, input_buffer.data(),
+                    input_buffer.size(), dictionary_->zstd_dict());
+        } else {
+            bytes_decompressed = ZSTD_decompress(output_buffer, output_size, input_buffer.data(),
+                                                 input_buffer.size());
+        }
         if (bytes_decompressed != output_size) {
             LOG(ERROR) << "Failed to decompress ZSTD block, expected output size: " << output_size
                        << ", actual: " << bytes_decompressed;
@@ -375,6 +441,9 @@ class ZstdDecompressor final : public IDecompressor {
         }
         return true;
     }
+
+  private:
+    const CowDictionary* dictionary_;
 };
 
 std::unique_ptr<IDecompressor> IDecompressor::Brotli() {
@@ -385,12 +454,12 @@ std::unique_ptr<IDecompressor> IDecompressor::Gz() {
     return std::make_unique<GzDecompressor>();
 }
 
-std::unique_ptr<IDecompressor> IDecompressor::Lz4() {
-    return std::make_unique<Lz4Decompressor>();
+std::unique_ptr<IDecompressor> IDecompressor::Lz4(const CowDictionary* dictionary) {
+    return std::make_unique<Lz4Decompressor>(dictionary);
 }
 
-std::unique_ptr<IDecompressor> IDecompressor::Zstd() {
-    return std::make_unique<ZstdDecompressor>();
+std::unique_ptr<IDecompressor> IDecompressor::Zstd(const CowDictionary* dictionary) {
+    return std::make_unique<ZstdDecompressor>(dictionary);
 }
 
 }  // namespace snapshot
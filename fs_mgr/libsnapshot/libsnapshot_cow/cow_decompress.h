@@ -16,11 +16,32 @@
 
 #pragma once
 
+#include <algorithm>
+#include <span>
+#include <vector>
+
 #include <libsnapshot/cow_reader.h>
 
+struct ZSTD_DDict_s;
+
 namespace android {
 namespace snapshot {
 
+// Dictionary stored in a COW, shared by every decompressor created for it.
+// Digested forms are prepared once and are safe to use from multiple threads.
+class CowDictionary {
+  public:
+    explicit CowDictionary(std::vector<uint8_t>&& data);
+    ~CowDictionary();
+
+    std::span<const uint8_t> data() const { return data_; }
+    const ZSTD_DDict_s* zstd_dict() const { return zstd_dict_; }
+
+  private:
+    std::vector<uint8_t> data_;
+    ZSTD_DDict_s* zstd_dict_ = nullptr;
+};
+
 class IByteStream {
   public:
     virtual ~IByteStream() {}
@@ -46,8 +67,8 @@ class IDecompressor {
     static std::unique_ptr<IDecompressor> Uncompressed();
     static std::unique_ptr<IDecompressor> Gz();
     static std::unique_ptr<IDecompressor> Brotli();
-    static std::unique_ptr<IDecompressor> Lz4();
-    static std::unique_ptr<IDecompressor> Zstd();
+    static std::unique_ptr<IDecompressor> Lz4(const CowDictionary* dictionary = nullptr);
+    static std::unique_ptr<IDecompressor> Zstd(const CowDictionary* dictionary = nullptr);
 
     static std::unique_ptr<IDecompressor> FromString(std::string_view compressor);
 
@@ -61,6 +82,20 @@ class IDecompressor {
     virtual ssize_t Decompress(void* buffer, size_t buffer_size, size_t decompressed_size,
                                size_t ignore_bytes = 0) = 0;
 
+    // Like Decompress(), but |dest| may be larger than the |to_write| bytes
+    // the caller wants. When |dest| can hold the whole decoded stream,
+    // decompressors decode straight into it rather than staging the data in
+    // a temporary buffer, so callers that own a large enough output buffer
+    // (such as a dm-user response buffer) avoid an intermediate copy.
+    //
+    // Returns the number of bytes written to the front of |dest|, or -1 on
+    // error.
+    virtual ssize_t DecompressInto(std::span<uint8_t> dest, size_t to_write,
+                                   size_t decompressed_size, size_t ignore_bytes = 0) {
+        return Decompress(dest.data(), std::min(to_write, dest.size()), decompressed_size,
+                          ignore_bytes);
+    }
+
     void set_stream(IByteStream* stream) { stream_ = stream; }
 
   protected:
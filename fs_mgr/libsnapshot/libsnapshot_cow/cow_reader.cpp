@@ -14,10 +14,13 @@
 // limitations under the License.
 //
 
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <optional>
+#include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -67,13 +70,14 @@ bool ReadCowHeader(android::base::borrowed_fd fd, CowHeaderV3* header) {
     return android::base::ReadFully(fd, header, header->prefix.header_size);
 }
 
-CowReader::CowReader(ReaderFlags reader_flag, bool is_merge)
+CowReader::CowReader(ReaderFlags reader_flag, bool is_merge, bool mmap_ops)
     : fd_(-1),
       header_(),
       fd_size_(0),
       block_pos_index_(std::make_shared<std::vector<int>>()),
       reader_flag_(reader_flag),
-      is_merge_(is_merge) {}
+      is_merge_(is_merge),
+      mmap_ops_(mmap_ops) {}
 
 std::unique_ptr<CowReader> CowReader::CloneCowReader() {
     auto cow = std::make_unique<CowReader>();
@@ -83,10 +87,13 @@ std::unique_ptr<CowReader> CowReader::CloneCowReader() {
     cow->fd_size_ = fd_size_;
     cow->last_label_ = last_label_;
     cow->ops_ = ops_;
+    cow->mapped_ops_ = mapped_ops_;
+    cow->block_index_ = block_index_;
     cow->merge_op_start_ = merge_op_start_;
     cow->num_total_data_ops_ = num_total_data_ops_;
     cow->num_ordered_ops_to_merge_ = num_ordered_ops_to_merge_;
     cow->xor_data_loc_ = xor_data_loc_;
+    cow->dictionary_ = dictionary_;
     cow->block_pos_index_ = block_pos_index_;
     cow->is_merge_ = is_merge_;
     return cow;
@@ -137,7 +144,7 @@ bool CowReader::Parse(android::base::borrowed_fd fd, std::optional<uint64_t> lab
             parser = std::make_unique<CowParserV2>();
             break;
         case 3:
-            parser = std::make_unique<CowParserV3>();
+            parser = std::make_unique<CowParserV3>(mmap_ops_);
             break;
         default:
             LOG(ERROR) << "Unknown version: " << header_.prefix.major_version;
@@ -154,16 +161,37 @@ bool CowReader::Parse(android::base::borrowed_fd fd, std::optional<uint64_t> lab
 
     header_ = ops_info.header;
     ops_ = std::move(ops_info.ops);
+    mapped_ops_ = std::move(ops_info.mapped_ops);
     footer_ = parser->footer();
     fd_size_ = parser->fd_size();
     last_label_ = parser->last_label();
     xor_data_loc_ = parser->xor_data_loc();
 
+    if (!ReadDictionary()) {
+        return false;
+    }
+
     // If we're resuming a write, we're not ready to merge
     if (label.has_value()) return true;
     return PrepMergeOps();
 }
 
+bool CowReader::ReadDictionary() {
+    dictionary_ = nullptr;
+    if (header_.prefix.major_version < 3 || !header_.dictionary_size) {
+        return true;
+    }
+
+    std::vector<uint8_t> data(header_.dictionary_size);
+    if (!android::base::ReadFullyAtOffset(fd_, data.data(), data.size(),
+                                          GetDictionaryOffset(header_))) {
+        PLOG(ERROR) << "Failed to read compression dictionary, size: " << data.size();
+        return false;
+    }
+    dictionary_ = std::make_shared<CowDictionary>(std::move(data));
+    return true;
+}
+
 uint32_t CowReader::GetMaxCompressionSize() {
     switch (header_.prefix.major_version) {
         case 1:
@@ -331,7 +359,7 @@ bool CowReader::PrepMergeOps() {
         merge_op_start_ = header_.num_merge_ops;
     }
 
-    if (is_merge_) {
+    if (is_merge_ && !mapped_ops_) {
         // Metadata ops are not required for merge. Thus, just re-arrange
         // the ops vector as required for merge operations.
         auto merge_ops_buffer = std::make_shared<std::vector<CowOperation>>();
@@ -348,6 +376,21 @@ bool CowReader::PrepMergeOps() {
         }
     }
 
+    // Mapped ops are looked up through an index of op positions sorted by
+    // new_block, rather than a copy of the ops themselves.
+    if (mapped_ops_) {
+        auto ops = mapped_ops_->ops();
+        auto block_index = std::make_shared<std::vector<uint32_t>>();
+        block_index->reserve(block_map.size());
+        for (const auto& [block, pos] : block_map) {
+            block_index->push_back(pos);
+        }
+        std::sort(block_index->begin(), block_index->end(), [&](uint32_t a, uint32_t b) {
+            return ops[a].new_block < ops[b].new_block;
+        });
+        block_index_ = std::move(block_index);
+    }
+
     block_map.clear();
     merge_op_blocks.clear();
 
@@ -411,8 +454,9 @@ bool CowReader::GetSequenceData(std::vector<uint32_t>* merge_op_blocks, std::vec
         seq_ops_set.insert(i);
     }
     // read ordered op data
-    for (size_t i = 0; i < ops_->size(); i++) {
-        auto& current_op = ops_->data()[i];
+    auto ops = GetOps();
+    for (size_t i = 0; i < ops.size(); i++) {
+        auto& current_op = ops[i];
         // Sequence ops must be the first ops in the stream.
         if (seq_ops_set.empty()) {
             merge_op_blocks->emplace_back(current_op.new_block);
@@ -483,6 +527,220 @@ bool CowReader::VerifyMergeOps() {
     return true;
 }
 
+std::span<const CowOperation> CowReader::GetOps() {
+    if (mapped_ops_) {
+        return mapped_ops_->ops();
+    }
+    return *ops_;
+}
+
+const CowOperation* CowReader::FindOp(uint64_t new_block) {
+    if (!block_index_) {
+        return nullptr;
+    }
+    auto ops = mapped_ops_->ops();
+    auto iter = std::lower_bound(
+            block_index_->begin(), block_index_->end(), new_block,
+            [&](uint32_t pos, uint64_t block) { return ops[pos].new_block < block; });
+    if (iter == block_index_->end() || ops[*iter].new_block != new_block) {
+        return nullptr;
+    }
+    return &ops[*iter];
+}
+
+size_t CowReader::GetOpIndex(const CowOperation* op) {
+    return op - GetOps().data();
+}
+
+const CowOperation* CowReader::GetOpAt(size_t index) {
+    auto ops = GetOps();
+    if (index >= ops.size()) {
+        return nullptr;
+    }
+    return &ops[index];
+}
+
+static constexpr uint32_t kCowReaderStateMagic = 0x53574f43;  // "COWS"
+static constexpr uint32_t kCowReaderStateVersion = 1;
+
+// Fixed-size part of the ExportState() output. It is followed by the op
+// array (unless the ops are mapped), the merge-order positions, the sorted
+// block index and the XOR data locations, in that order.
+struct CowReaderState {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t reader_flag;
+    uint8_t is_merge;
+    uint8_t mapped;
+    uint8_t has_footer;
+    uint8_t has_label;
+    uint8_t has_seq_ops;
+    uint8_t unused[2];
+    // Header as found on disk, used to check that the COW has not changed.
+    CowHeaderV3 disk_header;
+    // Header after translation by the parser.
+    CowHeaderV3 header;
+    CowFooter footer;
+    uint64_t fd_size;
+    uint64_t last_label;
+    uint64_t merge_op_start;
+    uint64_t num_total_data_ops;
+    uint64_t num_ordered_ops_to_merge;
+    uint64_t num_ops;
+    uint64_t num_block_pos;
+    uint64_t num_block_index;
+    uint64_t num_xor_locs;
+} __attribute__((packed));
+
+template <typename T>
+static void AppendArray(std::string* out, const T* data, size_t count) {
+    out->append(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+template <typename T>
+static bool ConsumeArray(std::string_view* in, T* data, size_t count) {
+    if (count > in->size() / sizeof(T)) {
+        return false;
+    }
+    memcpy(data, in->data(), count * sizeof(T));
+    in->remove_prefix(count * sizeof(T));
+    return true;
+}
+
+bool CowReader::ExportState(std::string* out) {
+    CowReaderState state = {};
+    state.magic = kCowReaderStateMagic;
+    state.version = kCowReaderStateVersion;
+    if (!ReadCowHeader(fd_, &state.disk_header)) {
+        return false;
+    }
+    state.reader_flag = static_cast<uint8_t>(reader_flag_);
+    state.is_merge = is_merge_;
+    state.mapped = mapped_ops_ != nullptr;
+    state.has_footer = footer_.has_value();
+    state.has_label = last_label_.has_value();
+    state.has_seq_ops = has_seq_ops_;
+    state.header = header_;
+    if (footer_) {
+        state.footer = footer_.value();
+    }
+    state.fd_size = fd_size_;
+    state.last_label = last_label_.value_or(0);
+    state.merge_op_start = merge_op_start_;
+    state.num_total_data_ops = num_total_data_ops_;
+    state.num_ordered_ops_to_merge = num_ordered_ops_to_merge_;
+    state.num_ops = GetOps().size();
+    state.num_block_pos = block_pos_index_->size();
+    state.num_block_index = block_index_ ? block_index_->size() : 0;
+    state.num_xor_locs = xor_data_loc_ ? xor_data_loc_->size() : 0;
+
+    out->clear();
+    AppendArray(out, &state, 1);
+    if (!mapped_ops_) {
+        AppendArray(out, ops_->data(), ops_->size());
+    }
+    AppendArray(out, block_pos_index_->data(), block_pos_index_->size());
+    if (block_index_) {
+        AppendArray(out, block_index_->data(), block_index_->size());
+    }
+    if (xor_data_loc_) {
+        for (const auto& [block, offset] : *xor_data_loc_) {
+            const uint64_t entry[2] = {block, offset};
+            AppendArray(out, entry, 2);
+        }
+    }
+    return true;
+}
+
+bool CowReader::ImportState(android::base::borrowed_fd fd, std::string_view state_data) {
+    CowReaderState state;
+    if (!ConsumeArray(&state_data, &state, 1) || state.magic != kCowReaderStateMagic ||
+        state.version != kCowReaderStateVersion) {
+        LOG(ERROR) << "Invalid COW reader state";
+        return false;
+    }
+    if (state.reader_flag != static_cast<uint8_t>(reader_flag_) || state.is_merge != is_merge_ ||
+        (state.mapped && !mmap_ops_)) {
+        LOG(ERROR) << "COW reader state was exported with different reader flags";
+        return false;
+    }
+
+    CowHeaderV3 disk_header;
+    if (!ReadCowHeader(fd, &disk_header)) {
+        return false;
+    }
+    if (memcmp(&disk_header, &state.disk_header, sizeof(disk_header)) != 0) {
+        LOG(INFO) << "COW header changed since the reader state was exported";
+        return false;
+    }
+
+    std::shared_ptr<std::vector<CowOperation>> ops;
+    std::shared_ptr<CowOpsMapping> mapped_ops;
+    if (state.mapped) {
+        mapped_ops = CowOpsMapping::Map(fd, GetOpOffset(0, state.header), state.num_ops);
+        if (!mapped_ops) {
+            return false;
+        }
+    } else {
+        ops = std::make_shared<std::vector<CowOperation>>(state.num_ops);
+        if (!ConsumeArray(&state_data, ops->data(), ops->size())) {
+            LOG(ERROR) << "Truncated COW reader state";
+            return false;
+        }
+    }
+
+    auto block_pos_index = std::make_shared<std::vector<int>>(state.num_block_pos);
+    std::shared_ptr<std::vector<uint32_t>> block_index;
+    if (state.num_block_index) {
+        block_index = std::make_shared<std::vector<uint32_t>>(state.num_block_index);
+    }
+    if (!ConsumeArray(&state_data, block_pos_index->data(), block_pos_index->size()) ||
+        (block_index &&
+         !ConsumeArray(&state_data, block_index->data(), block_index->size()))) {
+        LOG(ERROR) << "Truncated COW reader state";
+        return false;
+    }
+    for (auto pos : *block_pos_index) {
+        if (pos < 0 || static_cast<uint64_t>(pos) >= state.num_ops) {
+            LOG(ERROR) << "Invalid op position in COW reader state: " << pos;
+            return false;
+        }
+    }
+
+    auto xor_data_loc = std::make_shared<std::unordered_map<uint64_t, uint64_t>>();
+    xor_data_loc->reserve(state.num_xor_locs);
+    for (uint64_t i = 0; i < state.num_xor_locs; i++) {
+        uint64_t entry[2];
+        if (!ConsumeArray(&state_data, entry, 2)) {
+            LOG(ERROR) << "Truncated COW reader state";
+            return false;
+        }
+        xor_data_loc->emplace(entry[0], entry[1]);
+    }
+
+    fd_ = fd;
+    header_ = state.header;
+    footer_.reset();
+    if (state.has_footer) {
+        footer_ = state.footer;
+    }
+    last_label_.reset();
+    if (state.has_label) {
+        last_label_ = state.last_label;
+    }
+    fd_size_ = state.fd_size;
+    ops_ = std::move(ops);
+    mapped_ops_ = std::move(mapped_ops);
+    block_index_ = std::move(block_index);
+    block_pos_index_ = std::move(block_pos_index);
+    merge_op_start_ = state.merge_op_start;
+    num_total_data_ops_ = state.num_total_data_ops;
+    num_ordered_ops_to_merge_ = state.num_ordered_ops_to_merge;
+    has_seq_ops_ = state.has_seq_ops;
+    xor_data_loc_ = std::move(xor_data_loc);
+    return ReadDictionary();
+}
+
 bool CowReader::GetFooter(CowFooter* footer) {
     if (!footer_) return false;
     *footer = footer_.value();
@@ -495,9 +753,13 @@ bool CowReader::GetLastLabel(uint64_t* label) {
     return true;
 }
 
+// Iterators share ownership of the op storage, which is either a vector or a
+// mapping of the COW file.
+using CowOpsOwner = std::shared_ptr<const void>;
+
 class CowOpIter final : public ICowOpIter {
   public:
-    CowOpIter(std::shared_ptr<std::vector<CowOperation>>& ops, uint64_t start);
+    CowOpIter(CowOpsOwner owner, std::span<const CowOperation> ops, uint64_t start);
 
     bool AtEnd() override;
     const CowOperation* Get() override;
@@ -507,41 +769,43 @@ class CowOpIter final : public ICowOpIter {
     bool AtBegin() override;
 
   private:
-    std::shared_ptr<std::vector<CowOperation>> ops_;
-    std::vector<CowOperation>::iterator op_iter_;
+    CowOpsOwner owner_;
+    std::span<const CowOperation> ops_;
+    size_t pos_;
 };
 
-CowOpIter::CowOpIter(std::shared_ptr<std::vector<CowOperation>>& ops, uint64_t start) {
+CowOpIter::CowOpIter(CowOpsOwner owner, std::span<const CowOperation> ops, uint64_t start) {
+    owner_ = std::move(owner);
     ops_ = ops;
-    op_iter_ = ops_->begin() + start;
+    pos_ = start;
 }
 
 bool CowOpIter::AtBegin() {
-    return op_iter_ == ops_->begin();
+    return pos_ == 0;
 }
 
 void CowOpIter::Prev() {
     CHECK(!AtBegin());
-    op_iter_--;
+    pos_--;
 }
 
 bool CowOpIter::AtEnd() {
-    return op_iter_ == ops_->end();
+    return pos_ == ops_.size();
 }
 
 void CowOpIter::Next() {
     CHECK(!AtEnd());
-    op_iter_++;
+    pos_++;
 }
 
 const CowOperation* CowOpIter::Get() {
     CHECK(!AtEnd());
-    return &(*op_iter_);
+    return &ops_[pos_];
 }
 
 class CowRevMergeOpIter final : public ICowOpIter {
   public:
-    explicit CowRevMergeOpIter(std::shared_ptr<std::vector<CowOperation>> ops,
+    explicit CowRevMergeOpIter(CowOpsOwner owner, std::span<const CowOperation> ops,
                                std::shared_ptr<std::vector<int>> block_pos_index, uint64_t start);
 
     bool AtEnd() override;
@@ -552,7 +816,8 @@ class CowRevMergeOpIter final : public ICowOpIter {
     bool AtBegin() override;
 
   private:
-    std::shared_ptr<std::vector<CowOperation>> ops_;
+    CowOpsOwner owner_;
+    std::span<const CowOperation> ops_;
     std::vector<int>::reverse_iterator block_riter_;
     std::shared_ptr<std::vector<int>> cow_op_index_vec_;
     uint64_t start_;
@@ -560,7 +825,7 @@ class CowRevMergeOpIter final : public ICowOpIter {
 
 class CowMergeOpIter final : public ICowOpIter {
   public:
-    explicit CowMergeOpIter(std::shared_ptr<std::vector<CowOperation>> ops,
+    explicit CowMergeOpIter(CowOpsOwner owner, std::span<const CowOperation> ops,
                             std::shared_ptr<std::vector<int>> block_pos_index, uint64_t start);
 
     bool AtEnd() override;
@@ -571,14 +836,16 @@ class CowMergeOpIter final : public ICowOpIter {
     bool AtBegin() override;
 
   private:
-    std::shared_ptr<std::vector<CowOperation>> ops_;
+    CowOpsOwner owner_;
+    std::span<const CowOperation> ops_;
     std::vector<int>::iterator block_iter_;
     std::shared_ptr<std::vector<int>> cow_op_index_vec_;
     uint64_t start_;
 };
 
-CowMergeOpIter::CowMergeOpIter(std::shared_ptr<std::vector<CowOperation>> ops,
+CowMergeOpIter::CowMergeOpIter(CowOpsOwner owner, std::span<const CowOperation> ops,
                                std::shared_ptr<std::vector<int>> block_pos_index, uint64_t start) {
+    owner_ = std::move(owner);
     ops_ = ops;
     start_ = start;
     cow_op_index_vec_ = block_pos_index;
@@ -605,12 +872,13 @@ void CowMergeOpIter::Next() {
 
 const CowOperation* CowMergeOpIter::Get() {
     CHECK(!AtEnd());
-    return &ops_->data()[*block_iter_];
+    return &ops_[*block_iter_];
 }
 
-CowRevMergeOpIter::CowRevMergeOpIter(std::shared_ptr<std::vector<CowOperation>> ops,
+CowRevMergeOpIter::CowRevMergeOpIter(CowOpsOwner owner, std::span<const CowOperation> ops,
                                      std::shared_ptr<std::vector<int>> block_pos_index,
                                      uint64_t start) {
+    owner_ = std::move(owner);
     ops_ = ops;
     start_ = start;
     cow_op_index_vec_ = block_pos_index;
@@ -637,20 +905,33 @@ void CowRevMergeOpIter::Next() {
 
 const CowOperation* CowRevMergeOpIter::Get() {
     CHECK(!AtEnd());
-    return &ops_->data()[*block_riter_];
+    return &ops_[*block_riter_];
+}
+
+std::shared_ptr<const void> CowReader::GetOpsOwner() {
+    if (mapped_ops_) {
+        return mapped_ops_;
+    }
+    return ops_;
 }
 
 std::unique_ptr<ICowOpIter> CowReader::GetOpIter(bool merge_progress) {
-    return std::make_unique<CowOpIter>(ops_, merge_progress ? merge_op_start_ : 0);
+    uint64_t start = merge_progress ? merge_op_start_ : 0;
+    // Mapped ops are never re-arranged, so merge order comes from the
+    // position index instead.
+    if (mapped_ops_ && is_merge_) {
+        return std::make_unique<CowMergeOpIter>(GetOpsOwner(), GetOps(), block_pos_index_, start);
+    }
+    return std::make_unique<CowOpIter>(GetOpsOwner(), GetOps(), start);
 }
 
 std::unique_ptr<ICowOpIter> CowReader::GetRevMergeOpIter(bool ignore_progress) {
-    return std::make_unique<CowRevMergeOpIter>(ops_, block_pos_index_,
+    return std::make_unique<CowRevMergeOpIter>(GetOpsOwner(), GetOps(), block_pos_index_,
                                                ignore_progress ? 0 : merge_op_start_);
 }
 
 std::unique_ptr<ICowOpIter> CowReader::GetMergeOpIter(bool ignore_progress) {
-    return std::make_unique<CowMergeOpIter>(ops_, block_pos_index_,
+    return std::make_unique<CowMergeOpIter>(GetOpsOwner(), GetOps(), block_pos_index_,
                                             ignore_progress ? 0 : merge_op_start_);
 }
 
@@ -722,7 +1003,14 @@ uint8_t CowReader::GetCompressionType() {
 
 ssize_t CowReader::ReadData(const CowOperation* op, void* buffer, size_t buffer_size,
                             size_t ignore_bytes) {
+    return ReadData(op, {reinterpret_cast<uint8_t*>(buffer), buffer_size}, buffer_size,
+                    ignore_bytes);
+}
+
+ssize_t CowReader::ReadData(const CowOperation* op, std::span<uint8_t> dest, size_t to_write,
+                            size_t ignore_bytes) {
     std::unique_ptr<IDecompressor> decompressor;
+    to_write = std::min(to_write, dest.size());
     const size_t op_buf_size = CowOpCompressionSize(op, header_.block_size);
     if (!op_buf_size) {
         LOG(ERROR) << "Compression size is zero. op: " << *op;
@@ -739,12 +1027,12 @@ ssize_t CowReader::ReadData(const CowOperation* op, void* buffer, size_t buffer_
             break;
         case kCowCompressZstd:
             if (op_buf_size != op->data_length) {
-                decompressor = IDecompressor::Zstd();
+                decompressor = IDecompressor::Zstd(dictionary_.get());
             }
             break;
         case kCowCompressLz4:
             if (op_buf_size != op->data_length) {
-                decompressor = IDecompressor::Lz4();
+                decompressor = IDecompressor::Lz4(dictionary_.get());
             }
             break;
         default:
@@ -761,12 +1049,37 @@ ssize_t CowReader::ReadData(const CowOperation* op, void* buffer, size_t buffer_
     if (!decompressor ||
         ((op->data_length == op_buf_size) && (header_.prefix.major_version == 3))) {
         CowDataStream stream(this, offset + ignore_bytes, op->data_length - ignore_bytes);
-        return stream.ReadFully(buffer, buffer_size);
+        return stream.ReadFully(dest.data(), to_write);
     }
 
     CowDataStream stream(this, offset, op->data_length);
     decompressor->set_stream(&stream);
-    return decompressor->Decompress(buffer, buffer_size, op_buf_size, ignore_bytes);
+    if (op_buf_size <= header_.block_size || dest.size() >= op_buf_size) {
+        return decompressor->DecompressInto(dest, to_write, op_buf_size, ignore_bytes);
+    }
+
+    // Partial read of a multi-block unit. Reads of a large unit tend to walk
+    // through it block by block, so decode it once and serve the remaining
+    // blocks from the cached copy.
+    if (ignore_bytes >= op_buf_size) {
+        LOG(ERROR) << "Ignoring " << ignore_bytes << " bytes of a " << op_buf_size
+                   << " byte unit. op: " << *op;
+        return -1;
+    }
+    if (!unit_cache_offset_ || *unit_cache_offset_ != offset ||
+        unit_cache_.size() != op_buf_size) {
+        unit_cache_offset_.reset();
+        unit_cache_.resize(op_buf_size);
+        ssize_t rv = decompressor->DecompressInto(unit_cache_, op_buf_size, op_buf_size, 0);
+        if (rv != static_cast<ssize_t>(op_buf_size)) {
+            LOG(ERROR) << "Failed to decompress unit of " << op_buf_size << " bytes, got " << rv;
+            return -1;
+        }
+        unit_cache_offset_ = offset;
+    }
+    to_write = std::min(to_write, op_buf_size - ignore_bytes);
+    std::memcpy(dest.data(), unit_cache_.data() + ignore_bytes, to_write);
+    return to_write;
 }
 
 bool CowReader::GetSourceOffset(const CowOperation* op, uint64_t* source_offset) {
@@ -6,6 +6,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <array>
 #include <condition_variable>
 #include <cstring>
 #include <future>
@@ -37,6 +38,9 @@ DEFINE_string(source, "", "Source partition image");
 DEFINE_string(target, "", "Target partition image");
 DEFINE_string(compression, "lz4",
               "Compression algorithm. Default is set to lz4. Available options: lz4, zstd, gz");
+DEFINE_bool(pipelined, false,
+            "Hash source and target images concurrently and compress with a thread pool");
+DEFINE_int32(threads, 0, "Worker threads for --pipelined. Default is the number of CPUs");
 
 namespace android {
 namespace snapshot {
@@ -51,7 +55,8 @@ using android::snapshot::ICowWriter;
 class CreateSnapshot {
   public:
     CreateSnapshot(const std::string& src_file, const std::string& target_file,
-                   const std::string& patch_file, const std::string& compression);
+                   const std::string& patch_file, const std::string& compression,
+                   bool pipelined = false, int num_threads = 0);
     bool CreateSnapshotPatch();
 
   private:
@@ -72,6 +77,19 @@ class CreateSnapshot {
     const int kNumThreads = 6;
     const size_t kBlockSizeToRead = 1_MiB;
     const size_t compression_factor_ = 64_KiB;
+    // Replace data handed to the writer per call in pipelined mode. This
+    // spans several writer batches so that they are compressed in parallel.
+    const size_t kPipelinedWriteSize = 8_MiB;
+
+    /*
+     * In pipelined mode, the source and target images are hashed at the same
+     * time. Target hashes are kept per block and diffed against the source
+     * once both passes are done.
+     */
+    bool pipelined_ = false;
+    int num_threads_ = kNumThreads;
+    std::vector<std::array<uint8_t, 32>> target_hashes_;
+    std::vector<uint8_t> target_zero_;
     size_t replace_ops_ = 0, copy_ops_ = 0, zero_ops_ = 0, in_place_ops_ = 0;
 
     std::unordered_map<std::string, int> source_block_hash_;
@@ -94,13 +112,21 @@ class CreateSnapshot {
     void SHA256(const void* data, size_t length, uint8_t out[32]);
     bool IsBlockAligned(uint64_t read_size) { return ((read_size & (BLOCK_SZ - 1)) == 0); }
     bool ReadBlocks(off_t offset, const int skip_blocks, const uint64_t dev_sz);
+    bool HashTargetBlocks(off_t offset, const int skip_blocks, const uint64_t dev_sz);
+
+    using BlockWorker = bool (CreateSnapshot::*)(off_t, const int, const uint64_t);
+    void StartWorkers(BlockWorker worker, uint64_t dev_sz,
+                      std::vector<std::future<bool>>* threads);
+    bool GetPartitionSize(const std::string& file, uint64_t* dev_sz);
     std::string ToHexString(const uint8_t* buf, size_t len);
 
     bool CreateSnapshotFile();
     bool FindSourceBlockHash();
     bool PrepareParse(std::string& parsing_file, const bool createSnapshot);
     bool ParsePartition();
+    bool CreateSnapshotPatchPipelined();
     void PrepareMergeBlock(const void* buffer, uint64_t block, std::string& block_hash);
+    void ClassifyBlock(uint64_t block, const std::string& block_hash);
     bool WriteV3Snapshots();
     size_t PrepareWrite(size_t* pending_ops, size_t start_index);
 
@@ -120,11 +146,18 @@ void CreateSnapshotLogger(android::base::LogId, android::base::LogSeverity sever
 }
 
 CreateSnapshot::CreateSnapshot(const std::string& src_file, const std::string& target_file,
-                               const std::string& patch_file, const std::string& compression)
-    : src_file_(src_file), target_file_(target_file), patch_file_(patch_file) {
+                               const std::string& patch_file, const std::string& compression,
+                               bool pipelined, int num_threads)
+    : src_file_(src_file), target_file_(target_file), patch_file_(patch_file),
+      pipelined_(pipelined) {
     if (!compression.empty()) {
         compression_ = compression;
     }
+    if (num_threads > 0) {
+        num_threads_ = num_threads;
+    } else if (pipelined_) {
+        num_threads_ = std::max(std::thread::hardware_concurrency(), 1u);
+    }
 }
 
 bool CreateSnapshot::PrepareParse(std::string& parsing_file, const bool createSnapshot) {
@@ -175,6 +208,9 @@ bool CreateSnapshot::CreateSnapshotFile() {
  * Creates snapshot patch file by comparing source.img and target.img
  */
 bool CreateSnapshot::CreateSnapshotPatch() {
+    if (pipelined_) {
+        return CreateSnapshotPatchPipelined();
+    }
     if (!FindSourceBlockHash()) {
         return false;
     }
@@ -206,7 +242,10 @@ void CreateSnapshot::PrepareMergeBlock(const void* buffer, uint64_t block,
         zero_blocks_.push_back(block);
         return;
     }
+    ClassifyBlock(block, block_hash);
+}
 
+void CreateSnapshot::ClassifyBlock(uint64_t block, const std::string& block_hash) {
     auto iter = source_block_hash_.find(block_hash);
     if (iter != source_block_hash_.end()) {
         std::lock_guard<std::mutex> lock(write_lock_);
@@ -242,7 +281,7 @@ bool CreateSnapshot::CreateSnapshotWriter() {
     uint64_t dev_sz = lseek(target_fd_.get(), 0, SEEK_END);
     CowOptions options;
     options.compression = compression_;
-    options.num_compress_threads = 2;
+    options.num_compress_threads = pipelined_ ? num_threads_ : 2;
     options.batch_write = true;
     options.cluster_ops = 600;
     options.compression_factor = compression_factor_;
@@ -258,30 +297,58 @@ bool CreateSnapshot::WriteNonOrderedSnapshots() {
             return false;
         }
     }
-    std::string buffer(compression_factor_, '\0');
+    const size_t max_run = (pipelined_ ? kPipelinedWriteSize : compression_factor_) / BLOCK_SZ;
 
+    // Split the replace blocks into runs of contiguous blocks: (index, count).
+    std::vector<std::pair<size_t, size_t>> runs;
     replace_ops_ = replace_blocks_.size();
     size_t blocks_to_compress = replace_blocks_.size();
     size_t num_ops = 0;
     size_t block_index = 0;
     while (blocks_to_compress) {
-        num_ops = std::min((compression_factor_ / BLOCK_SZ), blocks_to_compress);
+        num_ops = std::min(max_run, blocks_to_compress);
         auto linear_blocks = PrepareWrite(&num_ops, block_index);
-        if (!android::base::ReadFullyAtOffset(target_fd_.get(), buffer.data(),
+        runs.emplace_back(block_index, linear_blocks);
+        block_index += linear_blocks;
+        blocks_to_compress -= linear_blocks;
+    }
+
+    std::string buffers[2] = {std::string(max_run * BLOCK_SZ, '\0'),
+                              std::string(max_run * BLOCK_SZ, '\0')};
+    auto read_run = [&, this](size_t run) -> bool {
+        const auto& [index, linear_blocks] = runs[run];
+        if (!android::base::ReadFullyAtOffset(target_fd_.get(), buffers[run % 2].data(),
                                               (linear_blocks * BLOCK_SZ),
-                                              replace_blocks_[block_index] * BLOCK_SZ)) {
-            LOG(ERROR) << "Failed to read at offset: " << replace_blocks_[block_index] * BLOCK_SZ
+                                              replace_blocks_[index] * BLOCK_SZ)) {
+            LOG(ERROR) << "Failed to read at offset: " << replace_blocks_[index] * BLOCK_SZ
                        << " size: " << linear_blocks * BLOCK_SZ;
             return false;
         }
-        if (!writer_->AddRawBlocks(replace_blocks_[block_index], buffer.data(),
+        return true;
+    };
+
+    // In pipelined mode, the next run is read while the writer compresses
+    // the current one.
+    if (!runs.empty() && !read_run(0)) {
+        return false;
+    }
+    for (size_t run = 0; run < runs.size(); run++) {
+        const bool has_next = run + 1 < runs.size();
+        std::future<bool> next;
+        if (pipelined_ && has_next) {
+            next = std::async(std::launch::async, read_run, run + 1);
+        }
+
+        const auto& [index, linear_blocks] = runs[run];
+        if (!writer_->AddRawBlocks(replace_blocks_[index], buffers[run % 2].data(),
                                    linear_blocks * BLOCK_SZ)) {
             LOG(ERROR) << "AddRawBlocks failed";
             return false;
         }
 
-        block_index += linear_blocks;
-        blocks_to_compress -= linear_blocks;
+        if (has_next && !(next.valid() ? next.get() : read_run(run + 1))) {
+            return false;
+        }
     }
     if (!writer_->Finalize()) {
         return false;
@@ -415,39 +482,146 @@ bool CreateSnapshot::ReadBlocks(off_t offset, const int skip_blocks, const uint6
     return true;
 }
 
-bool CreateSnapshot::ParsePartition() {
-    unique_fd fd(TEMP_FAILURE_RETRY(open(parsing_file_.c_str(), O_RDONLY)));
+bool CreateSnapshot::HashTargetBlocks(off_t offset, const int skip_blocks,
+                                      const uint64_t dev_sz) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(target_file_.c_str(), O_RDONLY)));
     if (fd < 0) {
-        LOG(ERROR) << "open failed: " << parsing_file_;
+        LOG(ERROR) << "open failed: " << target_file_;
         return false;
     }
 
-    uint64_t dev_sz = lseek(fd.get(), 0, SEEK_END);
-    if (!dev_sz) {
-        LOG(ERROR) << "Could not determine block device size: " << parsing_file_;
-        return false;
-    }
+    loff_t file_offset = offset;
+    const uint64_t read_sz = kBlockSizeToRead;
+    std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(read_sz);
 
-    if (!IsBlockAligned(dev_sz)) {
-        LOG(ERROR) << "dev_sz: " << dev_sz << " is not block aligned";
-        return false;
+    while (true) {
+        size_t to_read = std::min((dev_sz - file_offset), read_sz);
+
+        if (!android::base::ReadFullyAtOffset(fd.get(), buffer.get(), to_read, file_offset)) {
+            LOG(ERROR) << "Failed to read block from block device: " << target_file_
+                       << " at offset: " << file_offset << " read-size: " << to_read
+                       << " block-size: " << dev_sz;
+            return false;
+        }
+
+        // Each worker owns distinct blocks, so the per-block results need no
+        // locking.
+        for (size_t i = 0; i < to_read / BLOCK_SZ; i++) {
+            const uint8_t* bufptr = buffer.get() + i * BLOCK_SZ;
+            uint64_t blkindex = file_offset / BLOCK_SZ + i;
+
+            if (std::memcmp(zblock_.get(), bufptr, BLOCK_SZ) == 0) {
+                target_zero_[blkindex] = 1;
+            } else {
+                SHA256(bufptr, BLOCK_SZ, target_hashes_[blkindex].data());
+            }
+        }
+
+        file_offset += (skip_blocks * to_read);
+        if (file_offset >= dev_sz) {
+            break;
+        }
     }
 
-    int num_threads = kNumThreads;
+    return true;
+}
 
-    std::vector<std::future<bool>> threads;
+void CreateSnapshot::StartWorkers(BlockWorker worker, uint64_t dev_sz,
+                                  std::vector<std::future<bool>>* threads) {
+    int num_threads = num_threads_;
     off_t start_offset = 0;
     const int skip_blocks = num_threads;
 
     while (num_threads) {
-        threads.emplace_back(std::async(std::launch::async, &CreateSnapshot::ReadBlocks, this,
-                                        start_offset, skip_blocks, dev_sz));
+        threads->emplace_back(
+                std::async(std::launch::async, worker, this, start_offset, skip_blocks, dev_sz));
         start_offset += kBlockSizeToRead;
         num_threads -= 1;
         if (start_offset >= dev_sz) {
             break;
         }
     }
+}
+
+bool CreateSnapshot::GetPartitionSize(const std::string& file, uint64_t* dev_sz) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(file.c_str(), O_RDONLY)));
+    if (fd < 0) {
+        LOG(ERROR) << "open failed: " << file;
+        return false;
+    }
+
+    *dev_sz = lseek(fd.get(), 0, SEEK_END);
+    if (!*dev_sz) {
+        LOG(ERROR) << "Could not determine block device size: " << file;
+        return false;
+    }
+
+    if (!IsBlockAligned(*dev_sz)) {
+        LOG(ERROR) << "dev_sz: " << *dev_sz << " is not block aligned";
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Hash source.img and target.img at the same time, then diff the target
+ * block hashes against the source and write the snapshot.
+ */
+bool CreateSnapshot::CreateSnapshotPatchPipelined() {
+    uint64_t src_sz, target_sz;
+    if (!GetPartitionSize(src_file_, &src_sz) || !GetPartitionSize(target_file_, &target_sz)) {
+        return false;
+    }
+
+    // This opens the COW and target.img for the write phase. ReadBlocks()
+    // then only hashes the source; HashTargetBlocks() handles the target.
+    if (!PrepareParse(target_file_, true)) {
+        return false;
+    }
+    parsing_file_ = src_file_;
+    create_snapshot_patch_ = false;
+
+    target_hashes_.resize(target_sz / BLOCK_SZ);
+    target_zero_.resize(target_sz / BLOCK_SZ);
+
+    std::vector<std::future<bool>> threads;
+    StartWorkers(&CreateSnapshot::ReadBlocks, src_sz, &threads);
+    StartWorkers(&CreateSnapshot::HashTargetBlocks, target_sz, &threads);
+
+    bool ret = true;
+    for (auto& t : threads) {
+        ret = t.get() && ret;
+    }
+    if (!ret) {
+        return false;
+    }
+
+    for (uint64_t block = 0; block < target_hashes_.size(); block++) {
+        if (target_zero_[block]) {
+            zero_blocks_.push_back(block);
+            continue;
+        }
+        const auto& hash = target_hashes_[block];
+        ClassifyBlock(block, ToHexString(hash.data(), hash.size()));
+    }
+    target_hashes_ = {};
+    target_zero_ = {};
+
+    if (!WriteV3Snapshots()) {
+        LOG(ERROR) << "Snapshot Write failed";
+        return false;
+    }
+    return true;
+}
+
+bool CreateSnapshot::ParsePartition() {
+    uint64_t dev_sz;
+    if (!GetPartitionSize(parsing_file_, &dev_sz)) {
+        return false;
+    }
+
+    std::vector<std::future<bool>> threads;
+    StartWorkers(&CreateSnapshot::ReadBlocks, dev_sz, &threads);
 
     bool ret = true;
     for (auto& t : threads) {
@@ -471,15 +645,18 @@ NAME
 
 SYNOPSIS
     create_snapshot --source=<source.img> --target=<target.img> --compression="<compression-algorithm"
+                    [--pipelined [--threads=<N>]]
 
     source.img -> Source partition image
     target.img -> Target partition image
     compressoin -> compression algorithm. Default set to lz4. Supported types are gz, lz4, zstd.
+    pipelined -> hash both images concurrently and compress with a pool of N threads.
 
 EXAMPLES
 
    $ create_snapshot $SOURCE_BUILD/system.img $TARGET_BUILD/system.img
    $ create_snapshot $SOURCE_BUILD/product.img $TARGET_BUILD/product.img --compression="zstd"
+   $ create_snapshot $SOURCE_BUILD/super.img $TARGET_BUILD/super.img --pipelined
 
 )";
 
@@ -497,7 +674,7 @@ int main(int argc, char* argv[]) {
     auto parts = android::base::Split(fname, ".");
     std::string snapshotfile = parts[0] + ".patch";
     android::snapshot::CreateSnapshot snapshot(FLAGS_source, FLAGS_target, snapshotfile,
-                                               FLAGS_compression);
+                                               FLAGS_compression, FLAGS_pipelined, FLAGS_threads);
 
     if (!snapshot.CreateSnapshotPatch()) {
         LOG(ERROR) << "Snapshot creation failed";
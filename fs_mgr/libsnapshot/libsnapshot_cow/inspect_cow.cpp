@@ -14,11 +14,13 @@
 // limitations under the License.
 //
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <chrono>
 #include <iomanip>
 #include <iostream>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -26,7 +28,10 @@
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
 #include <gflags/gflags.h>
+#include <libsnapshot/cow_compress.h>
 #include <libsnapshot/cow_reader.h>
+#include <libsnapshot/cow_writer.h>
+#include "cow_decompress.h"
 #include "parser_v2.h"
 
 DEFINE_bool(silent, false, "Run silently");
@@ -40,6 +45,10 @@ DEFINE_bool(verify_merge_sequence, false, "Verify merge order sequencing");
 DEFINE_bool(show_merge_sequence, false, "Show merge order sequence");
 DEFINE_bool(show_raw_ops, false, "Show raw ops directly from the underlying parser");
 DEFINE_string(extract_to, "", "Extract the COW contents to the given file");
+DEFINE_bool(bench, false,
+            "Measure decode throughput of the data ops, and of the same data re-encoded with "
+            "each compression algorithm");
+DEFINE_uint32(bench_mb, 256, "Maximum amount of decoded data to re-encode for -bench");
 
 namespace android {
 namespace snapshot {
@@ -107,6 +116,137 @@ static bool ShowRawOpStream(borrowed_fd fd) {
     }
 }
 
+class BufferStream final : public IByteStream {
+  public:
+    explicit BufferStream(std::span<const uint8_t> data) : data_(data) {}
+
+    ssize_t Read(void* buffer, size_t length) override {
+        size_t n = std::min(length, data_.size() - pos_);
+        memcpy(buffer, data_.data() + pos_, n);
+        pos_ += n;
+        return n;
+    }
+    size_t Size() const override { return data_.size(); }
+
+  private:
+    std::span<const uint8_t> data_;
+    size_t pos_ = 0;
+};
+
+static double Throughput(uint64_t bytes, std::chrono::duration<double> elapsed) {
+    if (elapsed.count() <= 0) {
+        return 0;
+    }
+    return (bytes / (1024.0 * 1024.0)) / elapsed.count();
+}
+
+// Re-encode |samples| one block at a time with |name|, the way the COW
+// writer does, and measure how fast it decodes again.
+static bool BenchAlgorithm(const std::string& name, const std::string& samples,
+                           uint32_t block_size) {
+    auto algorithm = CompressionAlgorithmFromString(name);
+    if (!algorithm) {
+        return false;
+    }
+    CowCompression compression;
+    compression.algorithm = algorithm.value();
+    compression.compression_level = CompressWorker::GetDefaultCompressionLevel(*algorithm);
+
+    auto compressor = ICompressor::Create(compression, block_size);
+    auto decompressor = IDecompressor::FromString(name);
+    if (!compressor || !decompressor) {
+        LOG(ERROR) << "Could not create " << name << " codec";
+        return false;
+    }
+
+    const size_t num_blocks = samples.size() / block_size;
+    std::vector<std::vector<uint8_t>> encoded(num_blocks);
+    uint64_t encoded_bytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_blocks; i++) {
+        encoded[i] = compressor->Compress(samples.data() + i * block_size, block_size);
+        // Blocks that do not compress are stored as-is.
+        if (encoded[i].empty() || encoded[i].size() >= block_size) {
+            encoded[i].clear();
+            encoded_bytes += block_size;
+        } else {
+            encoded_bytes += encoded[i].size();
+        }
+    }
+    std::chrono::duration<double> encode_time = std::chrono::steady_clock::now() - start;
+
+    std::string buffer(block_size, '\0');
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < num_blocks; i++) {
+        if (encoded[i].empty()) {
+            memcpy(buffer.data(), samples.data() + i * block_size, block_size);
+            continue;
+        }
+        BufferStream stream(encoded[i]);
+        decompressor->set_stream(&stream);
+        if (decompressor->Decompress(buffer.data(), block_size, block_size) !=
+            static_cast<ssize_t>(block_size)) {
+            LOG(ERROR) << name << ": failed to decode block " << i;
+            return false;
+        }
+    }
+    std::chrono::duration<double> decode_time = std::chrono::steady_clock::now() - start;
+
+    const uint64_t bytes = num_blocks * block_size;
+    std::cout << std::left << std::setw(8) << name << std::right << std::fixed
+              << std::setprecision(1) << " ratio: " << (encoded_bytes * 100.0 / bytes)
+              << "% encode: " << Throughput(bytes, encode_time)
+              << " MiB/s decode: " << Throughput(bytes, decode_time) << " MiB/s\n"
+              << std::defaultfloat << std::setprecision(6);
+    return true;
+}
+
+static bool Bench(CowReader& reader) {
+    const uint32_t block_size = reader.GetHeader().block_size;
+    const size_t max_samples = size_t(FLAGS_bench_mb) * 1024 * 1024;
+
+    std::string buffer(block_size, '\0');
+    std::string samples;
+    uint64_t data_ops = 0;
+    std::chrono::duration<double> decode_time{0};
+
+    for (auto iter = reader.GetOpIter(); !iter->AtEnd(); iter->Next()) {
+        const CowOperation* op = iter->Get();
+        if (op->type() != kCowReplaceOp && op->type() != kCowXorOp) {
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (reader.ReadData(op, buffer.data(), buffer.size()) < 0) {
+            std::cerr << "Failed to decompress for :" << *op << "\n";
+            return false;
+        }
+        decode_time += std::chrono::steady_clock::now() - start;
+
+        data_ops++;
+        if (samples.size() < max_samples) {
+            samples.append(buffer);
+        }
+    }
+
+    std::cout << "\nDecode benchmark:\n";
+    std::cout << "-----------------\n";
+    std::cout << "COW data ops: " << data_ops << " decode: "
+              << Throughput(data_ops * block_size, decode_time) << " MiB/s\n";
+    if (samples.empty()) {
+        return true;
+    }
+
+    std::cout << "Re-encoded " << (samples.size() / block_size) << " blocks:\n";
+    for (const auto& name : {"gz", "brotli", "lz4", "zstd"}) {
+        if (!BenchAlgorithm(name, samples, block_size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static bool Inspect(const std::string& path) {
     unique_fd fd(open(path.c_str(), O_RDONLY));
     if (fd < 0) {
@@ -145,6 +285,10 @@ static bool Inspect(const std::string& path) {
         std::cout << "Block size: " << header.block_size << "\n";
         std::cout << "Merge ops: " << header.num_merge_ops << "\n";
         std::cout << "Readahead buffer: " << header.buffer_size << " bytes\n";
+        if (header.prefix.major_version >= 3) {
+            std::cout << "Compression dictionary: " << reader.header_v3().dictionary_size
+                      << " bytes\n";
+        }
         if (has_footer) {
             std::cout << "Footer: ops usage: " << footer.op.ops_size << " bytes\n";
             std::cout << "Footer: op count: " << footer.op.num_ops << "\n";
@@ -258,6 +402,10 @@ static bool Inspect(const std::string& path) {
         std::cout << "Xor ops: " << xor_ops << "\n";
     }
 
+    if (FLAGS_bench && !Bench(reader)) {
+        return false;
+    }
+
     return success;
 }
 
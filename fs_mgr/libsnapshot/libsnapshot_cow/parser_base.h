@@ -16,7 +16,9 @@
 
 #pragma once
 
+#include <memory>
 #include <optional>
+#include <span>
 #include <unordered_map>
 
 #include <android-base/unique_fd.h>
@@ -25,9 +27,30 @@
 namespace android {
 namespace snapshot {
 
+// Read-only mapping of the operation section of a COW file. Operations are
+// accessed in place, so no heap copy of the op array is made.
+class CowOpsMapping {
+  public:
+    ~CowOpsMapping();
+
+    static std::shared_ptr<CowOpsMapping> Map(android::base::borrowed_fd fd, off_t offset,
+                                              size_t num_ops);
+
+    std::span<const CowOperationV3> ops() const { return ops_; }
+
+  private:
+    CowOpsMapping() = default;
+
+    void* addr_ = nullptr;
+    size_t length_ = 0;
+    std::span<const CowOperationV3> ops_;
+};
+
 struct TranslatedCowOps {
     CowHeaderV3 header;
     std::shared_ptr<std::vector<CowOperationV3>> ops;
+    // Set instead of |ops| if the parser mapped the op section.
+    std::shared_ptr<CowOpsMapping> mapped_ops;
 };
 
 class CowParserBase {
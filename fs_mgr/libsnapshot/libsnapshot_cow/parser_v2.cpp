@@ -15,6 +15,10 @@
 
 #include <unistd.h>
 
+#include <algorithm>
+#include <future>
+#include <limits>
+
 #include <android-base/file.h>
 #include <android-base/logging.h>
 
@@ -92,6 +96,18 @@ bool CowParserV2::ParseOps(borrowed_fd fd, std::optional<uint64_t> label) {
     }
 
     auto ops_buffer = std::make_shared<std::vector<CowOperationV2>>();
+
+    // A complete COW ends with a footer holding the op count. Reserve for that many ops up front
+    // rather than growing the buffer one cluster at a time; it is only a hint, the ops are still
+    // counted and checked against the footer below.
+    CowFooterOperation footer_op;
+    if (fd_size_ >= pos + sizeof(CowFooter) &&
+        android::base::ReadFullyAtOffset(fd, &footer_op, sizeof(footer_op),
+                                         fd_size_ - sizeof(CowFooter)) &&
+        footer_op.type == kCowFooterOp) {
+        ops_buffer->reserve(
+                std::min<uint64_t>(footer_op.num_ops, (fd_size_ - pos) / sizeof(CowOperationV2)));
+    }
     uint64_t current_op_num = 0;
     uint64_t cluster_ops = header_.cluster_ops ?: 1;
     bool done = false;
@@ -197,14 +213,12 @@ bool CowParserV2::ParseOps(borrowed_fd fd, std::optional<uint64_t> label) {
     return true;
 }
 
-bool CowParserV2::Translate(TranslatedCowOps* out) {
-    out->ops = std::make_shared<std::vector<CowOperationV3>>(v2_ops_->size());
-
-    // Translate the operation buffer from on disk to in memory
-    for (size_t i = 0; i < out->ops->size(); i++) {
-        const auto& v2_op = v2_ops_->at(i);
+bool CowParserV2::TranslateRange(size_t begin, size_t end, std::vector<CowOperationV3>* ops,
+                                 uint32_t* compression) {
+    for (size_t i = begin; i < end; i++) {
+        const auto& v2_op = (*v2_ops_)[i];
 
-        auto& new_op = out->ops->at(i);
+        auto& new_op = (*ops)[i];
         new_op.set_type(v2_op.type);
         // v2 ops always have 4k compression
         new_op.set_compression_bits(0);
@@ -225,17 +239,63 @@ bool CowParserV2::Translate(TranslatedCowOps* out) {
             }
         }
         if (v2_op.compression != kCowCompressNone) {
-            if (header_.compression_algorithm == kCowCompressNone) {
-                header_.compression_algorithm = v2_op.compression;
-            } else if (header_.compression_algorithm != v2_op.compression) {
+            if (*compression == kCowCompressNone) {
+                *compression = v2_op.compression;
+            } else if (*compression != v2_op.compression) {
                 LOG(ERROR) << "COW has mixed compression types which is not supported;"
-                           << " previously saw " << header_.compression_algorithm << ", got "
+                           << " previously saw " << *compression << ", got "
                            << v2_op.compression << ", op: " << v2_op;
                 return false;
             }
         }
         new_op.set_source(source_info);
     }
+    return true;
+}
+
+bool CowParserV2::Translate(TranslatedCowOps* out) {
+    out->ops = std::make_shared<std::vector<CowOperationV3>>(v2_ops_->size());
+
+    // Translate the operation buffer from on disk to in memory. Ops translate independently, so
+    // large COWs are split into fixed ranges which are translated concurrently; each range only
+    // reports the compression type it saw, and those are reconciled in order afterwards.
+    const size_t num_ops = out->ops->size();
+    const size_t num_ranges = (num_ops + kTranslateRangeOps - 1) / kTranslateRangeOps;
+    std::vector<uint32_t> compression(std::max<size_t>(num_ranges, 1),
+                                     header_.compression_algorithm);
+    if (num_ranges <= 1) {
+        if (!TranslateRange(0, num_ops, out->ops.get(), &compression[0])) {
+            return false;
+        }
+    } else {
+        std::vector<std::future<bool>> ranges;
+        for (size_t r = 0; r < num_ranges; r++) {
+            size_t begin = r * kTranslateRangeOps;
+            size_t end = std::min(num_ops, begin + kTranslateRangeOps);
+            ranges.emplace_back(std::async(std::launch::async, &CowParserV2::TranslateRange, this,
+                                           begin, end, out->ops.get(), &compression[r]));
+        }
+        bool ok = true;
+        for (auto& range : ranges) {
+            ok &= range.get();
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    for (const auto& type : compression) {
+        if (type == kCowCompressNone) {
+            continue;
+        }
+        if (header_.compression_algorithm == kCowCompressNone) {
+            header_.compression_algorithm = type;
+        } else if (header_.compression_algorithm != type) {
+            LOG(ERROR) << "COW has mixed compression types which is not supported;"
+                       << " previously saw " << header_.compression_algorithm << ", got " << type;
+            return false;
+        }
+    }
 
     out->header = header_;
     return true;
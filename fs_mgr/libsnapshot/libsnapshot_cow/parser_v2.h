@@ -38,6 +38,14 @@ class CowParserV2 final : public CowParserBase {
 
   private:
     bool ParseOps(android::base::borrowed_fd fd, std::optional<uint64_t> label);
+    // Translates v2 ops [begin, end) into |ops|, which is already sized. |compression| holds the
+    // compression type seen so far and is updated with the one used by the range.
+    bool TranslateRange(size_t begin, size_t end, std::vector<CowOperationV3>* ops,
+                        uint32_t* compression);
+
+    // Number of ops translated by one thread. COWs with fewer ops are translated inline.
+    static constexpr size_t kTranslateRangeOps = 256 * 1024;
+
     std::shared_ptr<std::vector<CowOperationV2>> v2_ops_;
     std::optional<CowFooter> footer_;
 };
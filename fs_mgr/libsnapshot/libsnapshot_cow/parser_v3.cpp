@@ -13,6 +13,9 @@
 // limitations under the License.
 #include "parser_v3.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
@@ -25,6 +28,35 @@ namespace snapshot {
 
 using android::base::borrowed_fd;
 
+CowOpsMapping::~CowOpsMapping() {
+    if (addr_ && munmap(addr_, length_) < 0) {
+        PLOG(ERROR) << "munmap cow ops failed";
+    }
+}
+
+std::shared_ptr<CowOpsMapping> CowOpsMapping::Map(borrowed_fd fd, off_t offset, size_t num_ops) {
+    std::shared_ptr<CowOpsMapping> mapping(new CowOpsMapping());
+    if (!num_ops) {
+        return mapping;
+    }
+
+    // mmap offsets must be page aligned; ops themselves are packed.
+    const off_t page_size = getpagesize();
+    const off_t aligned_offset = offset & ~(page_size - 1);
+    const size_t delta = offset - aligned_offset;
+
+    mapping->length_ = delta + num_ops * sizeof(CowOperationV3);
+    void* addr = mmap(nullptr, mapping->length_, PROT_READ, MAP_SHARED, fd.get(), aligned_offset);
+    if (addr == MAP_FAILED) {
+        PLOG(ERROR) << "mmap cow ops failed, offset: " << offset << " ops: " << num_ops;
+        return nullptr;
+    }
+    mapping->addr_ = addr;
+    mapping->ops_ = {reinterpret_cast<const CowOperationV3*>(static_cast<uint8_t*>(addr) + delta),
+                     num_ops};
+    return mapping;
+}
+
 bool CowParserV3::Parse(borrowed_fd fd, const CowHeaderV3& header, std::optional<uint64_t> label) {
     auto pos = lseek(fd.get(), 0, SEEK_END);
     if (pos < 0) {
@@ -49,6 +81,19 @@ bool CowParserV3::Parse(borrowed_fd fd, const CowHeaderV3& header, std::optional
         return false;
     }
 
+    if (header_.dictionary_size) {
+        if (header_.dictionary_size > kCowMaxDictionarySize) {
+            LOG(ERROR) << "Dictionary too large: " << header_.dictionary_size;
+            return false;
+        }
+        if (header_.compression_algorithm != kCowCompressLz4 &&
+            header_.compression_algorithm != kCowCompressZstd) {
+            LOG(ERROR) << "Dictionary not supported for compression algorithm: "
+                       << header_.compression_algorithm;
+            return false;
+        }
+    }
+
     if (header_.prefix.major_version != 3 || header_.prefix.minor_version != 0) {
         LOG(ERROR) << "Header version mismatch, "
                    << "major version: " << header_.prefix.major_version
@@ -71,6 +116,9 @@ bool CowParserV3::Parse(borrowed_fd fd, const CowHeaderV3& header, std::optional
         }
     }
 
+    if (mmap_ops_ && !label) {
+        return MapOps(fd, op_index.value());
+    }
     return ParseOps(fd, op_index.value());
 }
 
@@ -106,12 +154,39 @@ bool CowParserV3::ParseOps(borrowed_fd fd, const uint32_t op_index) {
         return false;
     }
 
+    if (!ValidateOps(*ops_)) {
+        return false;
+    }
+    // :TODO: sequence buffer & resume buffer follow
+    // Once we implement labels, we'll have to discard unused ops and adjust
+    // the header as needed.
+
+    ops_->shrink_to_fit();
+
+    return true;
+}
+
+bool CowParserV3::MapOps(borrowed_fd fd, const uint32_t op_index) {
+    const off_t offset = GetOpOffset(0, header_);
+    if (offset + uint64_t(op_index) * sizeof(CowOperationV3) > fd_size_) {
+        LOG(ERROR) << "Op section exceeds file size: " << fd_size_ << ", ops: " << op_index;
+        return false;
+    }
+
+    mapped_ops_ = CowOpsMapping::Map(fd, offset, op_index);
+    if (!mapped_ops_) {
+        return false;
+    }
+    return ValidateOps(mapped_ops_->ops());
+}
+
+bool CowParserV3::ValidateOps(std::span<const CowOperationV3> ops) {
     // fill out mapping of XOR op data location
     uint64_t data_pos = GetDataOffset(header_);
 
     xor_data_loc_ = std::make_shared<std::unordered_map<uint64_t, uint64_t>>();
 
-    for (auto op : *ops_) {
+    for (const auto& op : ops) {
         if (op.type() == kCowXorOp) {
             xor_data_loc_->insert({op.new_block, data_pos});
         } else if (op.type() == kCowReplaceOp) {
@@ -123,17 +198,12 @@ bool CowParserV3::ParseOps(borrowed_fd fd, const uint32_t op_index) {
         }
         data_pos += op.data_length;
     }
-    // :TODO: sequence buffer & resume buffer follow
-    // Once we implement labels, we'll have to discard unused ops and adjust
-    // the header as needed.
-
-    ops_->shrink_to_fit();
-
     return true;
 }
 
 bool CowParserV3::Translate(TranslatedCowOps* out) {
     out->ops = ops_;
+    out->mapped_ops = mapped_ops_;
     out->header = header_;
     return true;
 }
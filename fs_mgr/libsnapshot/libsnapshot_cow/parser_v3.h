@@ -42,6 +42,10 @@ namespace snapshot {
 
 class CowParserV3 final : public CowParserBase {
   public:
+    // If |mmap_ops| is set, the op section is mapped rather than read into
+    // memory. This is ignored when parsing up to a label.
+    explicit CowParserV3(bool mmap_ops = false) : mmap_ops_(mmap_ops) {}
+
     bool Parse(android::base::borrowed_fd fd, const CowHeaderV3& header,
                std::optional<uint64_t> label = {}) override;
     bool Translate(TranslatedCowOps* out) override;
@@ -49,11 +53,15 @@ class CowParserV3 final : public CowParserBase {
 
   private:
     bool ParseOps(android::base::borrowed_fd fd, const uint32_t op_index);
+    bool MapOps(android::base::borrowed_fd fd, const uint32_t op_index);
+    bool ValidateOps(std::span<const CowOperationV3> ops);
     std::optional<uint32_t> FindResumeOp(const uint64_t label);
     CowHeaderV3 header_ = {};
     std::shared_ptr<std::vector<CowOperationV3>> ops_;
     bool ReadResumeBuffer(android::base::borrowed_fd fd);
     std::shared_ptr<std::vector<ResumePoint>> resume_points_;
+    std::shared_ptr<CowOpsMapping> mapped_ops_;
+    bool mmap_ops_ = false;
 };
 
 }  // namespace snapshot
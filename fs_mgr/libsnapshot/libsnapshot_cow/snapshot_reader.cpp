@@ -24,6 +24,9 @@ namespace snapshot {
 
 using android::base::borrowed_fd;
 
+// Amount of data decoded ahead of sequential reads.
+static constexpr size_t kReadAheadSize = 512 * 1024;
+
 CompressedSnapshotReader::CompressedSnapshotReader(std::unique_ptr<ICowReader>&& cow,
                                                    const std::optional<std::string>& source_device,
                                                    std::optional<uint64_t> block_dev_size)
@@ -99,52 +102,133 @@ borrowed_fd CompressedSnapshotReader::GetSourceFd() {
 }
 
 ssize_t CompressedSnapshotReader::Read(void* buf, size_t count) {
-    // Find the start and end chunks, inclusive.
-    uint64_t start_chunk = offset_ / block_size_;
-    uint64_t end_chunk = (offset_ + count - 1) / block_size_;
-
-    // Chop off the first N bytes if the position is not block-aligned.
-    size_t start_offset = offset_ % block_size_;
-
     uint8_t* buf_pos = reinterpret_cast<uint8_t*>(buf);
     size_t buf_remaining = count;
 
-    size_t initial_bytes = std::min(block_size_ - start_offset, buf_remaining);
-    ssize_t rv = ReadBlock(start_chunk, start_offset, buf_pos, initial_bytes);
-    if (rv < 0) {
-        return -1;
-    }
-    offset_ += rv;
-    buf_pos += rv;
-    buf_remaining -= rv;
-
-    for (uint64_t chunk = start_chunk + 1; chunk < end_chunk; chunk++) {
-        ssize_t rv = ReadBlock(chunk, 0, buf_pos, buf_remaining);
-        if (rv < 0) {
-            return -1;
+    // update_engine reads the whole device front to back when verifying and
+    // writing. Once reads are found to be sequential, serve them from a
+    // read-ahead buffer, which is filled in large runs.
+    const bool sequential = (offset_ == last_read_end_) && block_device_size_ > 0;
+    while (buf_remaining) {
+        if (offset_ >= ra_offset_ && offset_ < ra_offset_ + off64_t(ra_buffer_.size())) {
+            size_t available = ra_offset_ + ra_buffer_.size() - offset_;
+            size_t to_copy = std::min(available, buf_remaining);
+            memcpy(buf_pos, ra_buffer_.data() + (offset_ - ra_offset_), to_copy);
+            offset_ += to_copy;
+            buf_pos += to_copy;
+            buf_remaining -= to_copy;
+            continue;
+        }
+        if (!sequential || !FillReadAhead(offset_)) {
+            break;
         }
-        offset_ += rv;
-        buf_pos += rv;
-        buf_remaining -= rv;
     }
 
     if (buf_remaining) {
-        ssize_t rv = ReadBlock(end_chunk, 0, buf_pos, buf_remaining);
-        if (rv < 0) {
+        if (!ReadRange(offset_, buf_pos, buf_remaining)) {
             return -1;
         }
-        offset_ += rv;
-        buf_pos += rv;
-        buf_remaining -= rv;
+        offset_ += buf_remaining;
     }
-
-    CHECK_EQ(buf_pos - reinterpret_cast<uint8_t*>(buf), count);
-    CHECK_EQ(buf_remaining, 0);
+    last_read_end_ = offset_;
 
     errno = 0;
     return count;
 }
 
+bool CompressedSnapshotReader::FillReadAhead(off64_t offset) {
+    off64_t start = offset - (offset % block_size_);
+    if (start >= static_cast<off64_t>(block_device_size_)) {
+        return false;
+    }
+    size_t size = std::min<uint64_t>(kReadAheadSize, block_device_size_ - start);
+
+    ra_buffer_.resize(size);
+    if (!ReadRange(start, ra_buffer_.data(), size)) {
+        ra_buffer_.clear();
+        return false;
+    }
+    ra_offset_ = start;
+    return true;
+}
+
+bool CompressedSnapshotReader::GetSourceChunk(uint64_t chunk, uint64_t* source_chunk) {
+    const CowOperation* op = chunk < ops_.size() ? ops_[chunk] : nullptr;
+    if (!op) {
+        *source_chunk = chunk;
+        return true;
+    }
+    if (op->type() != kCowCopyOp) {
+        return false;
+    }
+    uint64_t source_offset;
+    if (!cow_->GetSourceOffset(op, &source_offset)) {
+        return false;
+    }
+    *source_chunk = GetBlockFromOffset(cow_->GetHeader(), source_offset);
+    return true;
+}
+
+// Read |num_chunks| whole blocks of the source device, starting at
+// |source_chunk|.
+bool CompressedSnapshotReader::ReadSourceBlocks(uint64_t source_chunk, uint64_t num_chunks,
+                                                uint8_t* buffer) {
+    borrowed_fd fd = GetSourceFd();
+    if (fd < 0) {
+        // GetSourceFd sets errno.
+        return false;
+    }
+
+    if (!android::base::ReadFullyAtOffset(fd, buffer, num_chunks * block_size_,
+                                          source_chunk * block_size_)) {
+        PLOG(ERROR) << "read " << *source_device_;
+        // ReadFullyAtOffset sets errno.
+        return false;
+    }
+    return true;
+}
+
+bool CompressedSnapshotReader::ReadRange(off64_t offset, uint8_t* buffer, size_t count) {
+    while (count) {
+        uint64_t chunk = offset / block_size_;
+        size_t start_offset = offset % block_size_;
+
+        // Unchanged and copied blocks are read from the source device in as
+        // few reads as possible.
+        uint64_t source_chunk;
+        if (!start_offset && count >= block_size_ && GetSourceChunk(chunk, &source_chunk)) {
+            uint64_t num_chunks = 1;
+            uint64_t next_source;
+            while ((num_chunks + 1) * block_size_ <= count &&
+                   GetSourceChunk(chunk + num_chunks, &next_source) &&
+                   next_source == source_chunk + num_chunks) {
+                num_chunks++;
+            }
+            if (!ReadSourceBlocks(source_chunk, num_chunks, buffer)) {
+                return false;
+            }
+            offset += num_chunks * block_size_;
+            buffer += num_chunks * block_size_;
+            count -= num_chunks * block_size_;
+            continue;
+        }
+
+        size_t bytes = std::min(block_size_ - start_offset, count);
+        ssize_t rv = ReadBlock(chunk, start_offset, buffer, bytes);
+        if (rv < 0) {
+            return false;
+        }
+        if (static_cast<size_t>(rv) != bytes) {
+            errno = EIO;
+            return false;
+        }
+        offset += rv;
+        buffer += rv;
+        count -= rv;
+    }
+    return true;
+}
+
 ssize_t CompressedSnapshotReader::ReadBlock(uint64_t chunk, size_t start_offset, void* buffer,
                                             size_t buffer_size) {
     size_t bytes_to_read = std::min(static_cast<size_t>(block_size_), buffer_size);
@@ -183,20 +267,24 @@ ssize_t CompressedSnapshotReader::ReadBlock(uint64_t chunk, size_t start_offset,
     } else if (op->type() == kCowZeroOp) {
         memset(buffer, 0, bytes_to_read);
     } else if (op->type() == kCowReplaceOp) {
-        size_t buffer_size = CowOpCompressionSize(op, block_size_);
-        uint8_t temp_buffer[buffer_size];
-        if (cow_->ReadData(op, temp_buffer, buffer_size, 0) < buffer_size) {
-            LOG(ERROR) << "CompressedSnapshotReader failed to read replace op: buffer_size: "
-                       << buffer_size << "start_offset: " << start_offset;
-            errno = EIO;
-            return -1;
+        if (unit_op_ != op) {
+            size_t buffer_size = CowOpCompressionSize(op, block_size_);
+            unit_buffer_.resize(buffer_size);
+            unit_op_ = nullptr;
+            if (cow_->ReadData(op, unit_buffer_.data(), buffer_size, 0) < buffer_size) {
+                LOG(ERROR) << "CompressedSnapshotReader failed to read replace op: buffer_size: "
+                           << buffer_size << "start_offset: " << start_offset;
+                errno = EIO;
+                return -1;
+            }
+            unit_op_ = op;
         }
         off_t block_offset{};
         if (!GetBlockOffset(op, chunk, block_size_, &block_offset)) {
             LOG(ERROR) << "GetBlockOffset failed";
             return -1;
         }
-        std::memcpy(buffer, (char*)temp_buffer + block_offset + start_offset, bytes_to_read);
+        std::memcpy(buffer, unit_buffer_.data() + block_offset + start_offset, bytes_to_read);
     } else if (op->type() == kCowXorOp) {
         borrowed_fd fd = GetSourceFd();
         if (fd < 0) {
@@ -263,6 +351,9 @@ uint64_t CompressedSnapshotReader::BlockDevSize() {
 bool CompressedSnapshotReader::Close() {
     cow_ = nullptr;
     source_fd_ = {};
+    unit_op_ = nullptr;
+    unit_buffer_ = {};
+    ra_buffer_ = {};
     return true;
 }
 
@@ -46,6 +46,10 @@ class CompressedSnapshotReader : public chromeos_update_engine::FileDescriptor {
 
   private:
     ssize_t ReadBlock(uint64_t chunk, size_t start_offset, void* buffer, size_t size);
+    bool ReadRange(off64_t offset, uint8_t* buffer, size_t count);
+    bool ReadSourceBlocks(uint64_t source_chunk, uint64_t num_chunks, uint8_t* buffer);
+    bool GetSourceChunk(uint64_t chunk, uint64_t* source_chunk);
+    bool FillReadAhead(off64_t offset);
     android::base::borrowed_fd GetSourceFd();
 
     std::unique_ptr<ICowReader> cow_;
@@ -58,6 +62,18 @@ class CompressedSnapshotReader : public chromeos_update_engine::FileDescriptor {
     off64_t offset_ = 0;
 
     std::vector<const CowOperation*> ops_;
+
+    // Decompressed data of the last replace op read, so that reading the
+    // blocks of a multi-block compression unit one at a time decodes the
+    // unit once.
+    const CowOperation* unit_op_ = nullptr;
+    std::vector<uint8_t> unit_buffer_;
+
+    // Data following the last sequential read, starting at |ra_offset_|.
+    // Only filled when the device size is known.
+    std::vector<uint8_t> ra_buffer_;
+    off64_t ra_offset_ = 0;
+    off64_t last_read_end_ = 0;
 };
 
 }  // namespace snapshot
@@ -189,5 +189,55 @@ TEST_F(OfflineSnapshotTest, CompressedSnapshot) {
     ASSERT_NO_FATAL_FAILURE(TestReads(writer.get()));
 }
 
+TEST_F(OfflineSnapshotTest, SequentialReads) {
+    CowOptions options;
+    options.compression = "lz4";
+    options.compression_factor = 4 * kBlockSize;
+    options.max_blocks = {kBlockCount};
+    options.op_count_max = kBlockCount;
+
+    unique_fd cow_fd(dup(cow_->fd));
+    ASSERT_GE(cow_fd, 0);
+
+    auto writer = CreateCowWriter(3, options, std::move(cow_fd));
+    std::string new_blocks;
+    for (int i = 0; i < 4; i++) {
+        new_blocks += MakeNewBlockString();
+    }
+    ASSERT_TRUE(writer->AddRawBlocks(2, new_blocks.data(), new_blocks.size()));
+    ASSERT_TRUE(writer->AddCopy(6, 0));
+    ASSERT_TRUE(writer->Finalize());
+
+    std::string expected;
+    for (size_t i = 0; i < kBlockCount; i++) {
+        if (i >= 2 && i < 6) {
+            expected += MakeNewBlockString();
+        } else if (i == 6) {
+            expected += base_blocks_[0];
+        } else {
+            expected += base_blocks_[i];
+        }
+    }
+
+    auto reader = writer->OpenFileDescriptor(base_->path);
+    ASSERT_NE(reader, nullptr);
+
+    // Front to back, in reads which do not line up with blocks.
+    std::string got;
+    std::string chunk(1000, 0);
+    while (got.size() < expected.size()) {
+        size_t size = std::min(chunk.size(), expected.size() - got.size());
+        ASSERT_EQ(reader->Read(chunk.data(), size), size);
+        got.append(chunk.data(), size);
+    }
+    ASSERT_EQ(got, expected);
+
+    // A seek backwards is served correctly too.
+    std::string block(kBlockSize, 0);
+    ASSERT_EQ(reader->Seek(3 * kBlockSize, SEEK_SET), 3 * kBlockSize);
+    ASSERT_EQ(reader->Read(block.data(), block.size()), kBlockSize);
+    ASSERT_EQ(block, MakeNewBlockString());
+}
+
 }  // namespace snapshot
 }  // namespace android
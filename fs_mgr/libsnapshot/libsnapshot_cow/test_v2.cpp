@@ -1555,6 +1555,42 @@ TEST_F(CowTest, DecompressIncompressibleBlock) {
     }
 }
 
+TEST_F(CowTest, ParseOpsAcrossTranslateRanges) {
+    // Enough ops for the parser to translate them in several concurrent ranges.
+    constexpr uint64_t kNumOps = 600000;
+    constexpr uint64_t kSourceOffset = 1000000;
+
+    CowOptions options;
+    CowWriterV2 writer(options, GetCowFd());
+    ASSERT_TRUE(writer.Initialize());
+    ASSERT_TRUE(writer.AddCopy(0, kSourceOffset, kNumOps));
+    ASSERT_TRUE(writer.AddLabel(1));
+    ASSERT_TRUE(writer.Finalize());
+
+    ASSERT_EQ(lseek(cow_->fd, 0, SEEK_SET), 0);
+
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(cow_->fd));
+
+    auto iter = reader.GetOpIter();
+    ASSERT_NE(iter, nullptr);
+    uint64_t copies = 0;
+    for (; !iter->AtEnd(); iter->Next()) {
+        auto op = iter->Get();
+        if (op->type() == kCowClusterOp) {
+            continue;
+        }
+        if (op->type() == kCowLabelOp) {
+            ASSERT_EQ(op->source(), 1);
+            continue;
+        }
+        ASSERT_EQ(op->type(), kCowCopyOp);
+        ASSERT_EQ(op->source(), op->new_block + kSourceOffset);
+        copies++;
+    }
+    ASSERT_EQ(copies, kNumOps);
+}
+
 }  // namespace snapshot
 }  // namespace android
 
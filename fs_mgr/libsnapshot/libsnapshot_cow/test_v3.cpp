@@ -251,6 +251,52 @@ TEST_F(CowTestV3, BigReplaceOp) {
     }
 }
 
+TEST_F(CowTestV3, PipelinedThreadedCompression) {
+    CowOptions options;
+    options.op_count_max = 10000;
+    options.batch_write = true;
+    options.cluster_ops = 16;
+    options.compression = "lz4";
+    options.num_compress_threads = 4;
+
+    // Many batches in a single call, so that compression of the next batch
+    // overlaps with writing the current one.
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+    std::string data;
+    data.resize(options.block_size * 1000, '\0');
+    for (int i = 0; i < data.size(); i++) {
+        data[i] = static_cast<char>('A' + (i / options.block_size) % 26);
+    }
+    ASSERT_TRUE(writer->AddRawBlocks(5, data.data(), data.size()));
+    ASSERT_TRUE(writer->AddRawBlocks(2000, data.data(), options.block_size * 3));
+    ASSERT_TRUE(writer->Finalize());
+
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(cow_->fd));
+
+    const auto& header = reader.header_v3();
+    ASSERT_EQ(header.op_count, 1003);
+
+    auto iter = reader.GetOpIter();
+    ASSERT_NE(iter, nullptr);
+
+    size_t i = 0;
+    while (!iter->AtEnd()) {
+        auto op = iter->Get();
+        size_t index = (i < 1000) ? i : i - 1000;
+        std::string sink(options.block_size, '\0');
+        ASSERT_EQ(op->type(), kCowReplaceOp);
+        ASSERT_EQ(op->new_block, (i < 1000) ? 5 + i : 2000 + index);
+        ASSERT_TRUE(ReadData(reader, op, sink.data(), options.block_size));
+        ASSERT_EQ(std::string_view(sink),
+                  std::string_view(data).substr(index * options.block_size, options.block_size))
+                << " readback data for " << i << "th block does not match";
+        iter->Next();
+        i++;
+    }
+    ASSERT_EQ(i, 1003);
+}
+
 TEST_F(CowTestV3, ConsecutiveReplaceOp) {
     CowOptions options;
     options.op_count_max = 20;
@@ -631,6 +677,45 @@ TEST_F(CowTestV3, SequenceTest) {
     ASSERT_TRUE(iter->AtEnd());
 }
 
+TEST_F(CowTestV3, ExportImportState) {
+    CowOptions options;
+    options.op_count_max = 20;
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+    uint32_t sequence[] = {3, 2, 1};
+    ASSERT_TRUE(writer->AddSequenceData(3, sequence));
+    ASSERT_TRUE(writer->AddCopy(1, 10, 3));
+    ASSERT_TRUE(writer->AddZeroBlocks(5, 2));
+    std::vector<uint8_t> data(writer->GetBlockSize(), 0xab);
+    ASSERT_TRUE(writer->AddRawBlocks(8, data.data(), data.size()));
+    ASSERT_TRUE(writer->Finalize());
+
+    for (bool mmap_ops : {false, true}) {
+        CowReader reader(CowReader::ReaderFlags::USERSPACE_MERGE, true, mmap_ops);
+        ASSERT_TRUE(reader.Parse(cow_->fd));
+        std::string state;
+        ASSERT_TRUE(reader.ExportState(&state));
+
+        CowReader imported(CowReader::ReaderFlags::USERSPACE_MERGE, true, mmap_ops);
+        ASSERT_TRUE(imported.ImportState(cow_->fd, state));
+        ASSERT_EQ(imported.get_num_total_data_ops(), reader.get_num_total_data_ops());
+
+        auto iter = reader.GetMergeOpIter();
+        auto imported_iter = imported.GetMergeOpIter();
+        while (!iter->AtEnd()) {
+            ASSERT_FALSE(imported_iter->AtEnd());
+            ASSERT_EQ(iter->Get()->new_block, imported_iter->Get()->new_block);
+            ASSERT_EQ(reader.GetOpIndex(iter->Get()), imported.GetOpIndex(imported_iter->Get()));
+            iter->Next();
+            imported_iter->Next();
+        }
+        ASSERT_TRUE(imported_iter->AtEnd());
+
+        // Truncated state is rejected.
+        CowReader truncated(CowReader::ReaderFlags::USERSPACE_MERGE, true, mmap_ops);
+        ASSERT_FALSE(truncated.ImportState(cow_->fd, std::string_view(state).substr(0, 16)));
+    }
+}
+
 TEST_F(CowTestV3, MissingSeqOp) {
     CowOptions options;
     options.op_count_max = std::numeric_limits<uint32_t>::max();
@@ -749,6 +834,32 @@ TEST_F(CowTestV3, CowSizeEstimate) {
     ASSERT_LE(writer.GetCowSizeInfo().cow_size, cow_size);
 }
 
+TEST_F(CowTestV3, CowSizeEstimateBounds) {
+    static constexpr uint64_t kNumBlocks = 256;
+    CowOptions options{};
+    options.compression = "lz4";
+    options.max_blocks = kNumBlocks;
+    auto estimator = android::snapshot::CreateCowEstimator(3, options);
+    ASSERT_NE(estimator, nullptr);
+
+    auto info = estimator->GetCowSizeInfo();
+    ASSERT_TRUE(info.max_cow_size.has_value());
+    const uint64_t initial_bound = *info.max_cow_size;
+
+    // Highly compressible data, so the bound tightens as blocks are added.
+    std::string data(options.block_size * kNumBlocks / 2, 'x');
+    ASSERT_TRUE(estimator->AddRawBlocks(0, data.data(), data.size()));
+    info = estimator->GetCowSizeInfo();
+    ASSERT_EQ(info.uncompressed_data_size, data.size());
+    ASSERT_LT(info.compressed_data_size, info.uncompressed_data_size);
+    ASSERT_LT(*info.max_cow_size, initial_bound);
+    ASSERT_GE(*info.max_cow_size, info.cow_size);
+
+    ASSERT_TRUE(estimator->AddZeroBlocks(kNumBlocks / 2, kNumBlocks / 2));
+    info = estimator->GetCowSizeInfo();
+    ASSERT_EQ(*info.max_cow_size, info.cow_size);
+}
+
 TEST_F(CowTestV3, CopyOpMany) {
     CowOptions options;
     options.op_count_max = 100;
@@ -779,6 +890,227 @@ TEST_F(CowTestV3, CheckOpCount) {
     ASSERT_FALSE(writer->AddZeroBlocks(0, 19));
 }
 
+TEST_F(CowTestV3, ReadDataIntoLargerBuffer) {
+    CowOptions options;
+    options.op_count_max = 20;
+    options.compression = "lz4";
+    options.compression_factor = 4096 * 4;
+    options.batch_write = true;
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+
+    std::string data;
+    data.resize(options.block_size * 4);
+    for (int i = 0; i < data.size(); i++) {
+        data[i] = static_cast<char>('A' + i / options.block_size);
+    }
+    ASSERT_TRUE(writer->AddRawBlocks(5, data.data(), data.size()));
+    ASSERT_TRUE(writer->Finalize());
+
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(cow_->fd));
+
+    auto iter = reader.GetOpIter();
+    ASSERT_FALSE(iter->AtEnd());
+    auto op = iter->Get();
+    ASSERT_EQ(CowOpCompressionSize(op, options.block_size), data.size());
+
+    // The destination can hold the entire op, but only part of it (at an
+    // offset) is requested.
+    std::vector<uint8_t> dest(data.size());
+    const size_t skip = options.block_size + 512;
+    const size_t to_write = options.block_size;
+    ASSERT_EQ(reader.ReadData(op, dest, to_write, skip), to_write);
+    ASSERT_EQ(std::string_view(reinterpret_cast<char*>(dest.data()), to_write),
+              std::string_view(data).substr(skip, to_write));
+}
+
+TEST_F(CowTestV3, RandomAccessRanges) {
+    CowOptions options;
+    options.op_count_max = 40;
+    options.compression = "lz4";
+    options.compression_factor = 4096 * 8;
+    options.batch_write = true;
+    // Blocks 4-5 are read at random, the rest sequentially.
+    options.random_access_ranges = {{4, 2}};
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+
+    std::string data(options.block_size * 16, 'x');
+    ASSERT_TRUE(writer->AddRawBlocks(0, data.data(), data.size()));
+    ASSERT_TRUE(writer->Finalize());
+
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(cow_->fd));
+
+    // Expected (new_block, blocks per unit).
+    std::vector<std::pair<uint64_t, size_t>> expected = {{0, 4}, {4, 1}, {5, 1}, {6, 8}, {14, 2}};
+    auto iter = reader.GetOpIter();
+    for (const auto& [new_block, blocks] : expected) {
+        ASSERT_FALSE(iter->AtEnd());
+        auto op = iter->Get();
+        ASSERT_EQ(op->new_block, new_block);
+        ASSERT_EQ(CowOpCompressionSize(op, options.block_size), blocks * options.block_size);
+        iter->Next();
+    }
+    ASSERT_TRUE(iter->AtEnd());
+}
+
+TEST_F(CowTestV3, OverlappingRandomAccessRanges) {
+    CowOptions options;
+    options.op_count_max = 20;
+    options.random_access_ranges = {{10, 4}, {4, 7}};
+    ASSERT_EQ(CreateCowWriter(3, options, GetCowFd()), nullptr);
+}
+
+TEST_F(CowTestV3, ReadPartialUnits) {
+    CowOptions options;
+    options.op_count_max = 20;
+    options.compression = "lz4";
+    options.compression_factor = 4096 * 4;
+    options.batch_write = true;
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+
+    std::string data;
+    data.resize(options.block_size * 8);
+    for (int i = 0; i < data.size(); i++) {
+        data[i] = static_cast<char>('A' + i / options.block_size);
+    }
+    ASSERT_TRUE(writer->AddRawBlocks(0, data.data(), data.size()));
+    ASSERT_TRUE(writer->Finalize());
+
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(cow_->fd));
+
+    // Walk both units a block at a time, the way snapuserd reads them; all
+    // but the first block of each unit come from the cached decode.
+    std::vector<const CowOperation*> ops;
+    for (auto iter = reader.GetOpIter(); !iter->AtEnd(); iter->Next()) {
+        ops.emplace_back(iter->Get());
+    }
+    ASSERT_EQ(ops.size(), 2);
+    for (size_t block = 0; block < 8; block++) {
+        auto op = ops[block / 4];
+        std::string read_back(options.block_size, '\0');
+        ASSERT_EQ(reader.ReadData(op, read_back.data(), read_back.size(),
+                                  (block % 4) * options.block_size),
+                  read_back.size());
+        ASSERT_EQ(read_back, data.substr(block * options.block_size, options.block_size));
+    }
+
+    // A clone does not share the cache but reads the same data.
+    auto clone = reader.CloneCowReader();
+    ASSERT_TRUE(clone->InitForMerge(android::base::unique_fd(dup(cow_->fd))));
+    std::string read_back(options.block_size, '\0');
+    ASSERT_EQ(clone->ReadData(ops[1], read_back.data(), read_back.size(), options.block_size),
+              read_back.size());
+    ASSERT_EQ(read_back, data.substr(5 * options.block_size, options.block_size));
+}
+
+TEST_F(CowTestV3, MappedOps) {
+    CowOptions options;
+    options.op_count_max = 20;
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+
+    uint32_t sequence[] = {12, 11, 10};
+    ASSERT_TRUE(writer->AddSequenceData(3, sequence));
+    ASSERT_TRUE(writer->AddCopy(10, 20, 3));
+    ASSERT_TRUE(writer->AddZeroBlocks(2, 2));
+    std::string data(options.block_size, 'x');
+    ASSERT_TRUE(writer->AddRawBlocks(7, data.data(), data.size()));
+    ASSERT_TRUE(writer->Finalize());
+
+    CowReader copied(CowReader::ReaderFlags::USERSPACE_MERGE, true);
+    ASSERT_TRUE(copied.Parse(cow_->fd));
+    ASSERT_FALSE(copied.ops_mapped());
+
+    CowReader mapped(CowReader::ReaderFlags::USERSPACE_MERGE, true, true);
+    ASSERT_TRUE(mapped.Parse(cow_->fd));
+    ASSERT_TRUE(mapped.ops_mapped());
+
+    // Merge order must match the reader which re-arranges its op vector.
+    auto expected = copied.GetOpIter(true);
+    auto iter = mapped.GetOpIter(true);
+    while (!expected->AtEnd()) {
+        ASSERT_FALSE(iter->AtEnd());
+        ASSERT_EQ(iter->Get()->new_block, expected->Get()->new_block);
+        ASSERT_EQ(iter->Get()->type(), expected->Get()->type());
+        expected->Next();
+        iter->Next();
+    }
+    ASSERT_TRUE(iter->AtEnd());
+
+    auto op = mapped.FindOp(7);
+    ASSERT_NE(op, nullptr);
+    ASSERT_EQ(op->type(), kCowReplaceOp);
+    std::string read_back(options.block_size, '\0');
+    ASSERT_EQ(mapped.ReadData(op, read_back.data(), read_back.size()), read_back.size());
+    ASSERT_EQ(read_back, data);
+
+    op = mapped.FindOp(11);
+    ASSERT_NE(op, nullptr);
+    ASSERT_EQ(op->type(), kCowCopyOp);
+    ASSERT_EQ(op->source(), 21);
+    ASSERT_EQ(mapped.FindOp(5), nullptr);
+
+    // Clones share the mapping.
+    auto clone = mapped.CloneCowReader();
+    ASSERT_TRUE(clone->ops_mapped());
+    ASSERT_EQ(clone->FindOp(2)->type(), kCowZeroOp);
+}
+
+class CowDictionaryTest : public CowTestV3, public ::testing::WithParamInterface<const char*> {};
+
+TEST_P(CowDictionaryTest, ReadWrite) {
+    CowOptions options;
+    options.op_count_max = 20;
+    options.compression = GetParam();
+
+    // Blocks share most of their contents with the dictionary.
+    std::string base(options.block_size, '\0');
+    for (size_t i = 0; i < base.size(); i++) {
+        base[i] = static_cast<char>((i * 7) % 251);
+    }
+    options.compression_dictionary.assign(base.begin(), base.end());
+
+    std::string data = base + base;
+    data[10] = 'x';
+    data[options.block_size + 20] = 'y';
+
+    auto writer = CreateCowWriter(3, options, GetCowFd());
+    ASSERT_NE(writer, nullptr);
+    ASSERT_TRUE(writer->AddRawBlocks(5, data.data(), data.size()));
+    ASSERT_TRUE(writer->Finalize());
+
+    CowReader reader;
+    ASSERT_TRUE(reader.Parse(cow_->fd));
+    ASSERT_EQ(reader.header_v3().dictionary_size, options.compression_dictionary.size());
+
+    auto iter = reader.GetOpIter();
+    for (size_t i = 0; i < 2; i++) {
+        ASSERT_FALSE(iter->AtEnd());
+        auto op = iter->Get();
+        ASSERT_EQ(op->type(), kCowReplaceOp);
+        ASSERT_LT(op->data_length, options.block_size);
+
+        std::string read_back(options.block_size, '\0');
+        ASSERT_EQ(reader.ReadData(op, read_back.data(), read_back.size()), read_back.size());
+        ASSERT_EQ(read_back, data.substr(i * options.block_size, options.block_size));
+        iter->Next();
+    }
+    ASSERT_TRUE(iter->AtEnd());
+}
+
+INSTANTIATE_TEST_SUITE_P(CowTestV3, CowDictionaryTest, ::testing::Values("lz4", "zstd"));
+
+TEST_F(CowTestV3, DictionaryRequiresLz4OrZstd) {
+    CowOptions options;
+    options.op_count_max = 20;
+    options.compression = "gz";
+    options.compression_dictionary.assign(options.block_size, 1);
+
+    CowWriterV3 writer(options, GetCowFd());
+    ASSERT_FALSE(writer.Initialize());
+}
+
 struct TestParam {
     std::string compression;
     int block_size;
@@ -40,6 +40,8 @@
 #include <storage_literals/storage_literals.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
+#include <algorithm>
+#include <limits>
 #include <numeric>
 
 // The info messages here are spammy, but as useful for update_engine. Disable
@@ -73,20 +75,60 @@ void CowWriterV3::InitWorkers() {
         LOG_INFO << "Not creating new threads for compression.";
         return;
     }
-    compress_threads_.reserve(num_compress_threads_);
-    compress_threads_.clear();
+    pool_compressors_.reserve(num_compress_threads_);
+    pool_compressors_.clear();
     threads_.reserve(num_compress_threads_);
     threads_.clear();
     for (size_t i = 0; i < num_compress_threads_; i++) {
-        std::unique_ptr<ICompressor> compressor =
-                ICompressor::Create(compression_, header_.max_compression_size);
-        auto&& wt = compress_threads_.emplace_back(
-                std::make_unique<CompressWorker>(std::move(compressor)));
-        threads_.emplace_back(std::thread([wt = wt.get()]() { wt->RunThread(); }));
+        auto&& compressor = pool_compressors_.emplace_back(ICompressor::Create(
+                compression_, header_.max_compression_size, options_.compression_dictionary));
+        threads_.emplace_back(std::thread(
+                [this, compressor = compressor.get()]() { RunCompressThread(compressor); }));
     }
     LOG(INFO) << num_compress_threads_ << " thread used for compression";
 }
 
+void CowWriterV3::RunCompressThread(ICompressor* compressor) {
+    while (true) {
+        CompressJob job;
+        {
+            std::unique_lock<std::mutex> lock(compress_lock_);
+            compress_cv_.wait(lock, [this]() -> bool {
+                return compress_stopped_ || !compress_queue_.empty();
+            });
+            if (compress_stopped_) {
+                return;
+            }
+            job = std::move(compress_queue_.front());
+            compress_queue_.pop_front();
+        }
+
+        auto& buffer = job.batch->buffers[job.index];
+        const size_t length = buffer.compression_factor;
+        bool ok = (compressor != nullptr);
+        if (ok) {
+            buffer.compressed_data = compressor->Compress(job.data, length);
+            ok = !buffer.compressed_data.empty();
+        }
+        if (!ok) {
+            LOG(ERROR) << "CompressBlocks: Compression failed";
+        } else if (buffer.compressed_data.size() >= length) {
+            // Incompressible; store the data as-is.
+            buffer.compressed_data.resize(length);
+            std::memcpy(buffer.compressed_data.data(), job.data, length);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(compress_lock_);
+            if (!ok) {
+                job.batch->failed = true;
+            }
+            job.batch->pending--;
+        }
+        compress_done_cv_.notify_all();
+    }
+}
+
 void CowWriterV3::SetupHeaders() {
     header_ = {};
     header_.prefix.magic = kCowMagicNumber;
@@ -122,6 +164,22 @@ bool CowWriterV3::ParseOptions() {
     }
 
     num_compress_threads_ = std::max(int(options_.num_compress_threads), 1);
+
+    random_access_ranges_.clear();
+    for (const auto& [start, count] : options_.random_access_ranges) {
+        if (count) {
+            random_access_ranges_.emplace_back(start, count);
+        }
+    }
+    std::sort(random_access_ranges_.begin(), random_access_ranges_.end());
+    for (size_t i = 1; i < random_access_ranges_.size(); i++) {
+        auto& prev = random_access_ranges_[i - 1];
+        if (random_access_ranges_[i].first < prev.first + prev.second) {
+            LOG(ERROR) << "Overlapping random access ranges at block "
+                       << random_access_ranges_[i].first;
+            return false;
+        }
+    }
     auto parts = android::base::Split(options_.compression, ",");
     if (parts.size() > 2) {
         LOG(ERROR) << "failed to parse compression parameters: invalid argument count: "
@@ -159,8 +217,23 @@ bool CowWriterV3::ParseOptions() {
     }
 
     compression_.algorithm = *algorithm;
+    if (!options_.compression_dictionary.empty()) {
+        if (options_.compression_dictionary.size() > kCowMaxDictionarySize) {
+            LOG(ERROR) << "Compression dictionary too large: "
+                       << options_.compression_dictionary.size();
+            return false;
+        }
+        if (compression_.algorithm != kCowCompressLz4 &&
+            compression_.algorithm != kCowCompressZstd) {
+            LOG(ERROR) << "Compression dictionary requires lz4 or zstd, got: "
+                       << options_.compression;
+            return false;
+        }
+        header_.dictionary_size = options_.compression_dictionary.size();
+    }
     if (compression_.algorithm != kCowCompressNone) {
-        compressor_ = ICompressor::Create(compression_, header_.max_compression_size);
+        compressor_ = ICompressor::Create(compression_, header_.max_compression_size,
+                                          options_.compression_dictionary);
         if (compressor_ == nullptr) {
             LOG(ERROR) << "Failed to create compressor for " << compression_.algorithm;
             return false;
@@ -191,9 +264,11 @@ bool CowWriterV3::ParseOptions() {
 }
 
 CowWriterV3::~CowWriterV3() {
-    for (const auto& t : compress_threads_) {
-        t->Finalize();
+    {
+        std::lock_guard<std::mutex> lock(compress_lock_);
+        compress_stopped_ = true;
     }
+    compress_cv_.notify_all();
     for (auto& t : threads_) {
         if (t.joinable()) {
             t.join();
@@ -246,6 +321,13 @@ bool CowWriterV3::OpenForWrite() {
         }
     }
 
+    if (header_.dictionary_size &&
+        !android::base::WriteFullyAtOffset(fd_, options_.compression_dictionary.data(),
+                                           header_.dictionary_size, GetDictionaryOffset(header_))) {
+        PLOG(ERROR) << "writing compression dictionary failed";
+        return false;
+    }
+
     resume_points_ = std::make_shared<std::vector<ResumePoint>>();
 
     if (!Sync()) {
@@ -265,6 +347,18 @@ bool CowWriterV3::OpenForAppend(uint64_t label) {
 
     header_ = header_v3;
 
+    // Blocks appended must be compressed with the dictionary already stored.
+    std::vector<uint8_t> dictionary(header_.dictionary_size);
+    if (!android::base::ReadFullyAtOffset(fd_, dictionary.data(), dictionary.size(),
+                                          GetDictionaryOffset(header_))) {
+        PLOG(ERROR) << "Couldn't read compression dictionary";
+        return false;
+    }
+    if (dictionary != options_.compression_dictionary) {
+        LOG(ERROR) << "Compression dictionary does not match the existing COW";
+        return false;
+    }
+
     CHECK(label >= 0);
     CowParserV3 parser;
     if (!parser.Parse(fd_, header_, label)) {
@@ -319,6 +413,7 @@ bool CowWriterV3::EmitCopy(uint64_t new_block, uint64_t old_block, uint64_t num_
         op.new_block = new_block + i;
         op.set_source(old_block + i);
     }
+    blocks_added_ += num_blocks;
 
     if (NeedsFlush()) {
         if (!FlushCacheOps()) {
@@ -348,8 +443,15 @@ bool CowWriterV3::NeedsFlush() const {
 bool CowWriterV3::ConstructCowOpCompressedBuffers(uint64_t new_block_start, const void* data,
                                                   uint64_t old_block, uint16_t offset,
                                                   CowOperationType type, size_t blocks_to_write) {
+    return AddCompressedBlocks(new_block_start, old_block, offset, type, blocks_to_write,
+                               CompressBlocks(new_block_start, blocks_to_write, data, type));
+}
+
+bool CowWriterV3::AddCompressedBlocks(uint64_t new_block_start, uint64_t old_block,
+                                      uint16_t offset, CowOperationType type,
+                                      size_t blocks_to_write,
+                                      std::vector<CompressedBuffer>&& blocks) {
     size_t compressed_bytes = 0;
-    auto&& blocks = CompressBlocks(blocks_to_write, data, type);
     if (blocks.empty()) {
         LOG(ERROR) << "Failed to compress blocks " << new_block_start << ", " << blocks_to_write
                    << ", actual number of blocks received from compressor " << blocks.size();
@@ -385,6 +487,9 @@ bool CowWriterV3::ConstructCowOpCompressedBuffers(uint64_t new_block_start, cons
                    << " Expected: " << blocks_to_write;
         return false;
     }
+    blocks_added_ += blocks_written;
+    uncompressed_data_size_ += blocks_written * header_.block_size;
+    compressed_data_size_ += compressed_bytes;
     return true;
 }
 
@@ -397,6 +502,10 @@ bool CowWriterV3::EmitBlocks(uint64_t new_block_start, const void* data, size_t
     }
     const auto bytes = reinterpret_cast<const uint8_t*>(data);
     size_t num_blocks = (size / header_.block_size);
+    if (num_blocks > batch_size_ && UseCompressionPool(batch_size_)) {
+        return EmitBlocksPipelined(new_block_start, data, num_blocks, old_block, offset, type);
+    }
+
     size_t total_written = 0;
     while (total_written < num_blocks) {
         size_t chunk = std::min(num_blocks - total_written, batch_size_);
@@ -418,6 +527,51 @@ bool CowWriterV3::EmitBlocks(uint64_t new_block_start, const void* data, size_t
     return true;
 }
 
+// Split |num_blocks| into batches and keep one batch compressing in the pool
+// while the previous one is turned into ops and written out. The caller's
+// buffer must not be released while a batch is in flight, so every exit path
+// drains the outstanding batch first.
+bool CowWriterV3::EmitBlocksPipelined(uint64_t new_block_start, const void* data,
+                                      size_t num_blocks, uint64_t old_block, uint16_t offset,
+                                      CowOperationType type) {
+    const auto bytes = reinterpret_cast<const uint8_t*>(data);
+
+    size_t submitted = std::min(num_blocks, batch_size_);
+    auto in_flight = SubmitCompressBatch(new_block_start, submitted, bytes, type);
+
+    size_t total_written = 0;
+    while (total_written < num_blocks) {
+        size_t chunk = std::min(num_blocks - total_written, batch_size_);
+
+        std::shared_ptr<CompressBatch> next;
+        size_t next_chunk = std::min(num_blocks - submitted, batch_size_);
+        if (next_chunk) {
+            next = SubmitCompressBatch(new_block_start + submitted, next_chunk,
+                                       bytes + header_.block_size * submitted, type);
+            submitted += next_chunk;
+        }
+
+        auto blocks = WaitForCompressBatch(in_flight);
+        bool ok = AddCompressedBlocks(new_block_start + total_written, old_block + total_written,
+                                      offset, type, chunk, std::move(blocks));
+        if (ok && NeedsFlush() && !FlushCacheOps()) {
+            LOG(ERROR) << "EmitBlocks with compression: write failed. new block: "
+                       << new_block_start << " compression: " << compression_.algorithm
+                       << ", op type: " << type;
+            ok = false;
+        }
+        if (!ok) {
+            if (next) {
+                WaitForCompressBatch(next);
+            }
+            return false;
+        }
+        in_flight = std::move(next);
+        total_written += chunk;
+    }
+    return true;
+}
+
 bool CowWriterV3::EmitZeroBlocks(uint64_t new_block_start, const uint64_t num_blocks) {
     if (!CheckOpCount(num_blocks)) {
         return false;
@@ -427,6 +581,7 @@ bool CowWriterV3::EmitZeroBlocks(uint64_t new_block_start, const uint64_t num_bl
         op.set_type(kCowZeroOp);
         op.new_block = new_block_start + i;
     }
+    blocks_added_ += num_blocks;
     if (NeedsFlush()) {
         if (!FlushCacheOps()) {
             return false;
@@ -521,7 +676,23 @@ bool CowWriterV3::FlushCacheOps() {
     return true;
 }
 
-size_t CowWriterV3::GetCompressionFactor(const size_t blocks_to_compress,
+uint64_t CowWriterV3::BlocksUntilRandomAccess(uint64_t new_block) const {
+    auto it = std::upper_bound(
+            random_access_ranges_.begin(), random_access_ranges_.end(), new_block,
+            [](uint64_t block, const auto& range) -> bool { return block < range.first; });
+    if (it != random_access_ranges_.begin()) {
+        const auto& prev = *(it - 1);
+        if (new_block < prev.first + prev.second) {
+            return 0;
+        }
+    }
+    if (it == random_access_ranges_.end()) {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    return it->first - new_block;
+}
+
+size_t CowWriterV3::GetCompressionFactor(uint64_t new_block, size_t blocks_to_compress,
                                          CowOperationType type) const {
     // For XOR ops, we don't support bigger block size compression yet.
     // For bigger block size support, snapshot-merge also has to changed. We
@@ -531,6 +702,16 @@ size_t CowWriterV3::GetCompressionFactor(const size_t blocks_to_compress,
         return header_.block_size;
     }
 
+    // Random-access regions get 4K units; a large unit must also stop short of
+    // the next such region.
+    if (!random_access_ranges_.empty()) {
+        uint64_t sequential_blocks = BlocksUntilRandomAccess(new_block);
+        if (!sequential_blocks) {
+            return header_.block_size;
+        }
+        blocks_to_compress = std::min<uint64_t>(blocks_to_compress, sequential_blocks);
+    }
+
     size_t compression_factor = header_.max_compression_size;
     while (compression_factor > header_.block_size) {
         size_t num_blocks = compression_factor / header_.block_size;
@@ -543,15 +724,17 @@ size_t CowWriterV3::GetCompressionFactor(const size_t blocks_to_compress,
 }
 
 std::vector<CowWriterV3::CompressedBuffer> CowWriterV3::ProcessBlocksWithNoCompression(
-        const size_t num_blocks, const void* data, CowOperationType type) {
+        uint64_t new_block_start, const size_t num_blocks, const void* data,
+        CowOperationType type) {
     size_t blocks_to_compress = num_blocks;
+    uint64_t new_block = new_block_start;
     const uint8_t* iter = reinterpret_cast<const uint8_t*>(data);
     std::vector<CompressedBuffer> compressed_vec;
 
     while (blocks_to_compress) {
         CompressedBuffer buffer;
 
-        const size_t compression_factor = GetCompressionFactor(blocks_to_compress, type);
+        const size_t compression_factor = GetCompressionFactor(new_block, blocks_to_compress, type);
         size_t num_blocks = compression_factor / header_.block_size;
 
         buffer.compression_factor = compression_factor;
@@ -562,21 +745,24 @@ std::vector<CowWriterV3::CompressedBuffer> CowWriterV3::ProcessBlocksWithNoCompr
 
         compressed_vec.push_back(std::move(buffer));
         blocks_to_compress -= num_blocks;
+        new_block += num_blocks;
         iter += compression_factor;
     }
     return compressed_vec;
 }
 
 std::vector<CowWriterV3::CompressedBuffer> CowWriterV3::ProcessBlocksWithCompression(
-        const size_t num_blocks, const void* data, CowOperationType type) {
+        uint64_t new_block_start, const size_t num_blocks, const void* data,
+        CowOperationType type) {
     size_t blocks_to_compress = num_blocks;
+    uint64_t new_block = new_block_start;
     const uint8_t* iter = reinterpret_cast<const uint8_t*>(data);
     std::vector<CompressedBuffer> compressed_vec;
 
     while (blocks_to_compress) {
         CompressedBuffer buffer;
 
-        const size_t compression_factor = GetCompressionFactor(blocks_to_compress, type);
+        const size_t compression_factor = GetCompressionFactor(new_block, blocks_to_compress, type);
         size_t num_blocks = compression_factor / header_.block_size;
 
         buffer.compression_factor = compression_factor;
@@ -595,97 +781,80 @@ std::vector<CowWriterV3::CompressedBuffer> CowWriterV3::ProcessBlocksWithCompres
 
         compressed_vec.push_back(std::move(buffer));
         blocks_to_compress -= num_blocks;
+        new_block += num_blocks;
         iter += compression_factor;
     }
     return compressed_vec;
 }
 
-std::vector<CowWriterV3::CompressedBuffer> CowWriterV3::ProcessBlocksWithThreadedCompression(
-        const size_t num_blocks, const void* data, CowOperationType type) {
-    const size_t num_threads = num_compress_threads_;
+std::shared_ptr<CowWriterV3::CompressBatch> CowWriterV3::SubmitCompressBatch(
+        uint64_t new_block_start, const size_t num_blocks, const void* data,
+        CowOperationType type) {
     const uint8_t* iter = reinterpret_cast<const uint8_t*>(data);
+    auto batch = std::make_shared<CompressBatch>();
 
-    // We will alternate which thread to send compress work to. E.g. alternate between T1 and T2
-    // until all blocks are processed
-    std::vector<CompressedBuffer> compressed_vec;
-    int iteration = 0;
-    int blocks_to_compress = static_cast<int>(num_blocks);
+    std::vector<CompressJob> jobs;
+    size_t blocks_to_compress = num_blocks;
+    uint64_t new_block = new_block_start;
     while (blocks_to_compress) {
-        CompressedBuffer buffer;
-        CompressWorker* worker = compress_threads_[iteration % num_threads].get();
-
-        const size_t compression_factor = GetCompressionFactor(blocks_to_compress, type);
+        const size_t compression_factor = GetCompressionFactor(new_block, blocks_to_compress, type);
         size_t num_blocks = compression_factor / header_.block_size;
 
-        worker->EnqueueCompressBlocks(iter, compression_factor, 1);
-        buffer.compression_factor = compression_factor;
-        compressed_vec.push_back(std::move(buffer));
+        jobs.push_back({.data = iter, .index = batch->buffers.size(), .batch = batch});
+        batch->buffers.push_back({.compression_factor = compression_factor});
 
-        iteration++;
         iter += compression_factor;
         blocks_to_compress -= num_blocks;
+        new_block += num_blocks;
     }
+    batch->pending = jobs.size();
 
-    std::vector<std::vector<uint8_t>> compressed_buf;
-    std::vector<std::vector<std::vector<uint8_t>>> worker_buffers(num_threads);
-    compressed_buf.clear();
-    for (size_t i = 0; i < num_threads; i++) {
-        CompressWorker* worker = compress_threads_[i].get();
-        if (!worker->GetCompressedBuffers(&worker_buffers[i])) {
-            return {};
+    {
+        std::lock_guard<std::mutex> lock(compress_lock_);
+        for (auto& job : jobs) {
+            compress_queue_.emplace_back(std::move(job));
         }
     }
-    // compressed_vec | CB 1 | CB 2 | CB 3 | CB 4 | <-compressed buffers
-    //                   t1     t2     t1     t2    <- processed by these threads
-    // Ordering is important here. We need to retrieve the compressed data in the same order we
-    // processed it and assume that that we submit data beginning with the first thread and then
-    // round robin the consecutive data calls. We need to Fetch compressed buffers from the
-    // threads via the same ordering
-    for (size_t i = 0; i < compressed_vec.size(); i++) {
-        compressed_buf.emplace_back(worker_buffers[i % num_threads][i / num_threads]);
-    }
+    compress_cv_.notify_all();
+    return batch;
+}
 
-    if (compressed_vec.size() != compressed_buf.size()) {
-        LOG(ERROR) << "Compressed buffer size: " << compressed_buf.size()
-                   << " - Expected: " << compressed_vec.size();
+std::vector<CowWriterV3::CompressedBuffer> CowWriterV3::WaitForCompressBatch(
+        const std::shared_ptr<CompressBatch>& batch) {
+    std::unique_lock<std::mutex> lock(compress_lock_);
+    compress_done_cv_.wait(lock, [&]() -> bool { return batch->pending == 0; });
+    if (batch->failed) {
+        LOG(ERROR) << "Block compression failed";
         return {};
     }
+    return std::move(batch->buffers);
+}
 
-    iter = reinterpret_cast<const uint8_t*>(data);
-    // Walk through all the compressed buffers
-    for (size_t i = 0; i < compressed_buf.size(); i++) {
-        auto& buffer = compressed_vec[i];
-        auto& block = compressed_buf[i];
-        size_t block_size = buffer.compression_factor;
-        // Check if the blocks was indeed compressed
-        if (block.size() >= block_size) {
-            buffer.compressed_data.resize(block_size);
-            std::memcpy(buffer.compressed_data.data(), iter, block_size);
-        } else {
-            // Compressed block
-            buffer.compressed_data.resize(block.size());
-            std::memcpy(buffer.compressed_data.data(), block.data(), block.size());
-        }
-        iter += block_size;
-    }
-    return compressed_vec;
+std::vector<CowWriterV3::CompressedBuffer> CowWriterV3::ProcessBlocksWithThreadedCompression(
+        uint64_t new_block_start, const size_t num_blocks, const void* data,
+        CowOperationType type) {
+    return WaitForCompressBatch(SubmitCompressBatch(new_block_start, num_blocks, data, type));
+}
+
+bool CowWriterV3::UseCompressionPool(size_t num_blocks) const {
+    return compression_.algorithm != kCowCompressNone && num_blocks > 1 &&
+           num_compress_threads_ > 1 && !threads_.empty();
 }
 
-std::vector<CowWriterV3::CompressedBuffer> CowWriterV3::CompressBlocks(const size_t num_blocks,
+std::vector<CowWriterV3::CompressedBuffer> CowWriterV3::CompressBlocks(uint64_t new_block_start,
+                                                                       const size_t num_blocks,
                                                                        const void* data,
                                                                        CowOperationType type) {
     if (compression_.algorithm == kCowCompressNone) {
-        return ProcessBlocksWithNoCompression(num_blocks, data, type);
+        return ProcessBlocksWithNoCompression(new_block_start, num_blocks, data, type);
     }
 
-    const size_t num_threads = (num_blocks == 1) ? 1 : num_compress_threads_;
-
     // If no threads are required, just compress the blocks inline.
-    if (num_threads <= 1) {
-        return ProcessBlocksWithCompression(num_blocks, data, type);
+    if (!UseCompressionPool(num_blocks)) {
+        return ProcessBlocksWithCompression(new_block_start, num_blocks, data, type);
     }
 
-    return ProcessBlocksWithThreadedCompression(num_blocks, data, type);
+    return ProcessBlocksWithThreadedCompression(new_block_start, num_blocks, data, type);
 }
 
 bool CowWriterV3::WriteOperation(std::span<const CowOperationV3> ops,
@@ -759,8 +928,28 @@ bool CowWriterV3::Finalize() {
 
 CowSizeInfo CowWriterV3::GetCowSizeInfo() const {
     CowSizeInfo info;
-    info.cow_size = next_data_pos_;
+    info.cow_size = next_data_pos_ + CachedDataSize();
     info.op_count_max = header_.op_count_max;
+
+    // An estimator grows the op area as ops are flushed, which moves the data
+    // section; account for the cached ops the same way.
+    uint64_t op_count = header_.op_count + cached_ops_.size();
+    if (IsEstimating() && op_count > info.op_count_max) {
+        info.cow_size += (op_count - info.op_count_max) * sizeof(CowOperationV3);
+        info.op_count_max = op_count;
+    }
+
+    info.uncompressed_data_size = uncompressed_data_size_;
+    info.compressed_data_size = compressed_data_size_;
+
+    if (options_.max_blocks) {
+        uint64_t remaining = *options_.max_blocks - std::min(blocks_added_, *options_.max_blocks);
+        uint64_t max_cow_size = info.cow_size + remaining * header_.block_size;
+        if (IsEstimating() && op_count + remaining > info.op_count_max) {
+            max_cow_size += (op_count + remaining - info.op_count_max) * sizeof(CowOperationV3);
+        }
+        info.max_cow_size = max_cow_size;
+    }
     return info;
 }
 
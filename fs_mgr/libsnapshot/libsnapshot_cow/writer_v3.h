@@ -15,6 +15,10 @@
 #pragma once
 
 #include <android-base/logging.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <span>
 #include <string_view>
 #include <thread>
@@ -55,6 +59,20 @@ class CowWriterV3 : public CowWriterBase {
         size_t compression_factor;
         std::vector<uint8_t> compressed_data;
     };
+    // A set of compressed buffers submitted to the compression pool by a
+    // single call. |pending| drops to zero once every buffer is ready.
+    struct CompressBatch {
+        std::vector<CompressedBuffer> buffers;
+        size_t pending = 0;
+        bool failed = false;
+    };
+    // One compression unit. Workers pull these from a queue shared by all
+    // threads, so that one slow unit does not hold up the rest of the batch.
+    struct CompressJob {
+        const uint8_t* data;
+        size_t index;
+        std::shared_ptr<CompressBatch> batch;
+    };
     void SetupHeaders();
     bool NeedsFlush() const;
     bool ParseOptions();
@@ -66,21 +84,39 @@ class CowWriterV3 : public CowWriterBase {
     bool ConstructCowOpCompressedBuffers(uint64_t new_block_start, const void* data,
                                          uint64_t old_block, uint16_t offset, CowOperationType type,
                                          size_t blocks_to_write);
+    bool AddCompressedBlocks(uint64_t new_block_start, uint64_t old_block, uint16_t offset,
+                             CowOperationType type, size_t blocks_to_write,
+                             std::vector<CompressedBuffer>&& blocks);
+    bool EmitBlocksPipelined(uint64_t new_block_start, const void* data, size_t num_blocks,
+                             uint64_t old_block, uint16_t offset, CowOperationType type);
     bool CheckOpCount(size_t op_count);
 
   private:
-    std::vector<CompressedBuffer> ProcessBlocksWithNoCompression(const size_t num_blocks,
+    std::vector<CompressedBuffer> ProcessBlocksWithNoCompression(uint64_t new_block_start,
+                                                                 const size_t num_blocks,
                                                                  const void* data,
                                                                  CowOperationType type);
-    std::vector<CompressedBuffer> ProcessBlocksWithCompression(const size_t num_blocks,
+    std::vector<CompressedBuffer> ProcessBlocksWithCompression(uint64_t new_block_start,
+                                                               const size_t num_blocks,
                                                                const void* data,
                                                                CowOperationType type);
-    std::vector<CompressedBuffer> ProcessBlocksWithThreadedCompression(const size_t num_blocks,
+    std::vector<CompressedBuffer> ProcessBlocksWithThreadedCompression(uint64_t new_block_start,
+                                                                       const size_t num_blocks,
                                                                        const void* data,
                                                                        CowOperationType type);
-    std::vector<CompressedBuffer> CompressBlocks(const size_t num_blocks, const void* data,
-                                                 CowOperationType type);
-    size_t GetCompressionFactor(const size_t blocks_to_compress, CowOperationType type) const;
+    std::vector<CompressedBuffer> CompressBlocks(uint64_t new_block_start, const size_t num_blocks,
+                                                 const void* data, CowOperationType type);
+    std::shared_ptr<CompressBatch> SubmitCompressBatch(uint64_t new_block_start,
+                                                       const size_t num_blocks, const void* data,
+                                                       CowOperationType type);
+    std::vector<CompressedBuffer> WaitForCompressBatch(const std::shared_ptr<CompressBatch>& batch);
+    bool UseCompressionPool(size_t num_blocks) const;
+    void RunCompressThread(ICompressor* compressor);
+    size_t GetCompressionFactor(uint64_t new_block, const size_t blocks_to_compress,
+                                CowOperationType type) const;
+    // Number of blocks from |new_block| to the next random-access range; 0 if
+    // |new_block| is inside one.
+    uint64_t BlocksUntilRandomAccess(uint64_t new_block) const;
 
     constexpr bool IsBlockAligned(const size_t size) {
         // These are the only block size supported. Block size beyond 256k
@@ -103,16 +139,30 @@ class CowWriterV3 : public CowWriterBase {
     // in the case that we are using one thread for compression, we can store and re-use the same
     // compressor
     std::unique_ptr<ICompressor> compressor_;
-    std::vector<std::unique_ptr<CompressWorker>> compress_threads_;
+    // Persistent compression pool. Every thread owns one compressor and pulls
+    // jobs from |compress_queue_|.
+    std::vector<std::unique_ptr<ICompressor>> pool_compressors_;
+    std::deque<CompressJob> compress_queue_;
+    std::mutex compress_lock_;
+    std::condition_variable compress_cv_;
+    std::condition_variable compress_done_cv_;
+    bool compress_stopped_ = false;
     // Resume points contain a laebl + cow_op_index.
     std::shared_ptr<std::vector<ResumePoint>> resume_points_;
 
     uint64_t next_data_pos_ = 0;
 
+    // Totals for GetCowSizeInfo(), covering both written and cached ops.
+    uint64_t blocks_added_ = 0;
+    uint64_t uncompressed_data_size_ = 0;
+    uint64_t compressed_data_size_ = 0;
+
     // in the case that we are using one thread for compression, we can store and re-use the same
     // compressor
     int num_compress_threads_ = 1;
     size_t batch_size_ = 1;
+    // Sorted, non-overlapping copy of CowOptions::random_access_ranges.
+    std::vector<std::pair<uint64_t, uint64_t>> random_access_ranges_;
     std::vector<CowOperationV3> cached_ops_;
     std::vector<std::vector<uint8_t>> cached_data_;
     std::vector<struct iovec> data_vec_;
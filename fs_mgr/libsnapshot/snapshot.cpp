@@ -30,6 +30,7 @@
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
 #include <android-base/properties.h>
+#include <android-base/scopeguard.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
@@ -571,6 +572,11 @@ bool SnapshotManager::MapDmUserCow(LockedFile* lock, const std::string& name,
     }
 
     if (UpdateUsesUserSnapshots(lock)) {
+        if (deferred_dm_user_cows_) {
+            deferred_dm_user_cows_->push_back({misc_name, cow_file, base_device, base_path_merge});
+            return true;
+        }
+
         // Now that the dm-user device is created, initialize the daemon and
         // spin up the worker threads.
         if (!snapuserd_client_->InitDmUserCow(misc_name, cow_file, base_device, base_path_merge)) {
@@ -582,6 +588,33 @@ bool SnapshotManager::MapDmUserCow(LockedFile* lock, const std::string& name,
     return snapuserd_client_->AttachDmUser(misc_name);
 }
 
+bool SnapshotManager::InitDeferredDmUserCows() {
+    if (!deferred_dm_user_cows_) {
+        return true;
+    }
+    auto params = std::move(*deferred_dm_user_cows_);
+    deferred_dm_user_cows_.reset();
+    if (params.empty()) {
+        return true;
+    }
+
+    std::vector<uint64_t> num_sectors;
+    if (!snapuserd_client_->InitDmUserCows(params, &num_sectors)) {
+        return false;
+    }
+    for (size_t i = 0; i < params.size(); i++) {
+        if (!num_sectors[i]) {
+            LOG(ERROR) << "InitDmUserCow failed for " << params[i].misc_name;
+            return false;
+        }
+        if (!snapuserd_client_->AttachDmUser(params[i].misc_name)) {
+            return false;
+        }
+    }
+    LOG(INFO) << "Initialized " << params.size() << " snapuserd handlers";
+    return true;
+}
+
 bool SnapshotManager::MapSnapshot(LockedFile* lock, const std::string& name,
                                   const std::string& base_device, const std::string& cow_device,
                                   const std::chrono::milliseconds& timeout_ms,
@@ -776,6 +809,7 @@ bool SnapshotManager::DeleteSnapshot(LockedFile* lock, const std::string& name)
 
     std::string error;
     auto file_path = GetSnapshotStatusFilePath(name);
+    lock->snapshot_status_cache_.erase(name);
     if (!android::base::RemoveFileIfExists(file_path, &error)) {
         LOG(ERROR) << "Failed to remove status file " << file_path << ": " << error;
         return false;
@@ -2380,6 +2414,12 @@ bool SnapshotManager::MapAllPartitions(LockedFile* lock, const std::string& supe
         return false;
     }
 
+    // Create the snapuserd handlers for all partitions at once, after their
+    // dm-user devices exist, so that the daemon can read the COWs in parallel.
+    deferred_dm_user_cows_.emplace();
+    auto reset_deferred =
+            android::base::make_scope_guard([this] { deferred_dm_user_cows_.reset(); });
+
     for (const auto& partition : metadata->partitions) {
         if (GetPartitionGroupName(metadata->groups[partition.group_index]) == kCowGroupName) {
             LOG(INFO) << "Skip mapping partition " << GetPartitionName(partition) << " in group "
@@ -2399,6 +2439,10 @@ bool SnapshotManager::MapAllPartitions(LockedFile* lock, const std::string& supe
         }
     }
 
+    if (!InitDeferredDmUserCows()) {
+        return false;
+    }
+
     LOG(INFO) << "Created logical partitions with snapshot.";
     return true;
 }
@@ -2860,6 +2904,10 @@ bool SnapshotManager::MapAllSnapshots(const std::chrono::milliseconds& timeout_m
         return false;
     }
 
+    deferred_dm_user_cows_.emplace();
+    auto reset_deferred =
+            android::base::make_scope_guard([this] { deferred_dm_user_cows_.reset(); });
+
     for (const auto& snapshot : snapshots) {
         if (!UnmapPartitionWithSnapshot(lock.get(), snapshot)) {
             LOG(ERROR) << "MapAllSnapshots could not unmap snapshot: " << snapshot;
@@ -2880,6 +2928,11 @@ bool SnapshotManager::MapAllSnapshots(const std::chrono::milliseconds& timeout_m
         }
     }
 
+    if (!InitDeferredDmUserCows()) {
+        LOG(ERROR) << "MapAllSnapshots could not initialize snapuserd handlers";
+        return false;
+    }
+
     LOG(INFO) << "MapAllSnapshots succeeded.";
     return true;
 }
@@ -3033,6 +3086,10 @@ UpdateState SnapshotManager::ReadUpdateState(LockedFile* lock) {
 SnapshotUpdateStatus SnapshotManager::ReadSnapshotUpdateStatus(LockedFile* lock) {
     CHECK(lock);
 
+    if (lock->update_status_cache_) {
+        return *lock->update_status_cache_;
+    }
+
     SnapshotUpdateStatus status = {};
     std::string contents;
     if (!android::base::ReadFileToString(GetStateFilePath(), &contents)) {
@@ -3050,6 +3107,7 @@ SnapshotUpdateStatus SnapshotManager::ReadSnapshotUpdateStatus(LockedFile* lock)
         status.set_state(UpdateStateFromString(contents));
     }
 
+    lock->update_status_cache_ = status;
     return status;
 }
 
@@ -3097,6 +3155,12 @@ bool SnapshotManager::WriteSnapshotUpdateStatus(LockedFile* lock,
         return false;
     }
 
+    // Rewriting an unchanged state file costs an fsync of /metadata for
+    // nothing.
+    std::string cached;
+    bool unchanged = lock->update_status_cache_ &&
+                     lock->update_status_cache_->SerializeToString(&cached) && cached == contents;
+
 #ifdef LIBSNAPSHOT_USE_HAL
     auto merge_status = MergeStatus::UNKNOWN;
     switch (status.state()) {
@@ -3129,10 +3193,12 @@ bool SnapshotManager::WriteSnapshotUpdateStatus(LockedFile* lock,
     }
 #endif
 
-    if (!WriteStringToFileAtomic(contents, GetStateFilePath())) {
+    if (!unchanged && !WriteStringToFileAtomic(contents, GetStateFilePath())) {
         PLOG(ERROR) << "Could not write to state file";
+        lock->update_status_cache_.reset();
         return false;
     }
+    lock->update_status_cache_ = status;
 
 #ifdef LIBSNAPSHOT_USE_HAL
     if (!set_before_write && !device_->SetBootControlMergeStatus(merge_status)) {
@@ -3150,8 +3216,14 @@ std::string SnapshotManager::GetSnapshotStatusFilePath(const std::string& name)
 bool SnapshotManager::ReadSnapshotStatus(LockedFile* lock, const std::string& name,
                                          SnapshotStatus* status) {
     CHECK(lock);
-    auto path = GetSnapshotStatusFilePath(name);
 
+    if (auto iter = lock->snapshot_status_cache_.find(name);
+        iter != lock->snapshot_status_cache_.end()) {
+        *status = iter->second;
+        return true;
+    }
+
+    auto path = GetSnapshotStatusFilePath(name);
     unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
     if (fd < 0) {
         PLOG(ERROR) << "Open failed: " << path;
@@ -3168,6 +3240,7 @@ bool SnapshotManager::ReadSnapshotStatus(LockedFile* lock, const std::string& na
         status->set_name(name);
     }
 
+    lock->snapshot_status_cache_[name] = *status;
     return true;
 }
 
@@ -3185,11 +3258,21 @@ bool SnapshotManager::WriteSnapshotStatus(LockedFile* lock, const SnapshotStatus
         return false;
     }
 
+    auto& cache = lock->snapshot_status_cache_;
+    if (auto iter = cache.find(status.name()); iter != cache.end()) {
+        std::string cached;
+        if (iter->second.SerializeToString(&cached) && cached == content) {
+            return true;
+        }
+    }
+
     if (!WriteStringToFileAtomic(content, path)) {
         PLOG(ERROR) << "Unable to write SnapshotStatus to " << path;
+        cache.erase(status.name());
         return false;
     }
 
+    cache[status.name()] = status;
     return true;
 }
 
@@ -3920,6 +4003,9 @@ bool SnapshotManager::Dump(std::ostream& os) {
         ss << std::endl;
         ss << "Merge phase: " << update_status.merge_phase() << std::endl;
     }
+    // Per-snapshot merge progress is only tracked by userspace snapshots.
+    bool query_merge_stats = update_status.state() == UpdateState::Merging &&
+                             update_status.userspace_snapshots() && snapuserd_client_;
 
     bool ok = true;
     std::vector<std::string> snapshots;
@@ -3945,6 +4031,10 @@ bool SnapshotManager::Dump(std::ostream& os) {
         ss << "    compression: " << status.compression_algorithm() << std::endl;
         ss << "    compression factor: " << status.compression_factor() << std::endl;
         ss << "    merge phase: " << DecideMergePhase(status) << std::endl;
+        if (query_merge_stats && status.state() == SnapshotState::MERGING) {
+            auto stats = snapuserd_client_->GetMergeStats(name);
+            ss << "    merge stats: " << (stats.empty() ? "N/A" : stats) << std::endl;
+        }
     }
     os << ss.rdbuf();
     return ok;
@@ -574,6 +574,44 @@ TEST_F(SnapshotTest, CreateSnapshot) {
     ASSERT_TRUE(sm->DeleteSnapshot(lock_.get(), "test-snapshot"));
 }
 
+TEST_F(SnapshotTest, CachedSnapshotStatus) {
+    ASSERT_TRUE(AcquireLock());
+
+    PartitionCowCreator cow_creator;
+    cow_creator.compression_algorithm = "none";
+
+    static const uint64_t kDeviceSize = 1024 * 1024;
+    SnapshotStatus status;
+    status.set_name("test-snapshot");
+    status.set_device_size(kDeviceSize);
+    status.set_snapshot_size(kDeviceSize);
+    status.set_cow_file_size(kDeviceSize);
+    ASSERT_TRUE(sm->CreateSnapshot(lock_.get(), &cow_creator, &status));
+
+    auto path = sm->GetSnapshotStatusFilePath("test-snapshot");
+    struct stat before;
+    ASSERT_EQ(stat(path.c_str(), &before), 0);
+
+    // Writing the same status again must not replace the file.
+    SnapshotStatus read_status;
+    ASSERT_TRUE(sm->ReadSnapshotStatus(lock_.get(), "test-snapshot", &read_status));
+    ASSERT_TRUE(sm->WriteSnapshotStatus(lock_.get(), read_status));
+    struct stat after;
+    ASSERT_EQ(stat(path.c_str(), &after), 0);
+    ASSERT_EQ(before.st_ino, after.st_ino);
+
+    // A changed status is written through, and seen by a later lock.
+    read_status.set_state(SnapshotState::MERGING);
+    ASSERT_TRUE(sm->WriteSnapshotStatus(lock_.get(), read_status));
+    lock_ = nullptr;
+    ASSERT_TRUE(AcquireLock());
+    ASSERT_TRUE(sm->ReadSnapshotStatus(lock_.get(), "test-snapshot", &read_status));
+    ASSERT_EQ(read_status.state(), SnapshotState::MERGING);
+
+    ASSERT_TRUE(sm->DeleteSnapshot(lock_.get(), "test-snapshot"));
+    ASSERT_FALSE(sm->ReadSnapshotStatus(lock_.get(), "test-snapshot", &read_status));
+}
+
 TEST_F(SnapshotTest, MapSnapshot) {
     ASSERT_TRUE(AcquireLock());
 
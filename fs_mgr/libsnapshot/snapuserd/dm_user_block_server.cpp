@@ -27,7 +27,9 @@ using android::base::unique_fd;
 DmUserBlockServer::DmUserBlockServer(const std::string& misc_name, unique_fd&& ctrl_fd,
                                      Delegate* delegate, size_t buffer_size)
     : misc_name_(misc_name), ctrl_fd_(std::move(ctrl_fd)), delegate_(delegate) {
-    buffer_.Initialize(buffer_size);
+    // Leave room to hold back a small response while the next part of the
+    // same request is written after it, see SendBufferedIo().
+    buffer_.Initialize(buffer_size + kMaxHeldPayload);
 }
 
 bool DmUserBlockServer::ProcessRequests() {
@@ -53,6 +55,12 @@ bool DmUserBlockServer::ProcessRequests() {
         }
         return false;
     }
+
+    // Send whatever was held back; this also sends the header of requests
+    // which had no payload.
+    if (header_response_ || buffer_.GetPayloadBytesWritten()) {
+        return WriteDmUserPayload(buffer_.GetPayloadBytesWritten());
+    }
     return true;
 }
 
@@ -86,6 +94,15 @@ void* DmUserBlockServer::GetResponseBuffer(size_t size, size_t to_write) {
 }
 
 bool DmUserBlockServer::SendBufferedIo() {
+    // dm-user takes one message per write(), so the most we can do is send
+    // each request in as few writes as possible. Small parts, such as the
+    // unaligned head of a request, are held back and sent together with the
+    // next part, or once the request is done. A held-back part never takes
+    // more than the extra room allocated for it, so the next part still has
+    // the full buffer size.
+    if (buffer_.GetPayloadBytesWritten() <= kMaxHeldPayload) {
+        return true;
+    }
     return WriteDmUserPayload(buffer_.GetPayloadBytesWritten());
 }
 
@@ -101,6 +118,8 @@ void DmUserBlockServer::SendError() {
     // this back to dm-user.
     //
     // TODO: Fix the interface
+    //
+    // Responses which were only held back are dropped along with the header.
     CHECK(header_response_);
 
     WriteDmUserPayload(0);
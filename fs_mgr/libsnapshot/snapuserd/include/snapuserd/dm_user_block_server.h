@@ -38,6 +38,9 @@ class DmUserBlockServer : public IBlockServer {
     bool ProcessRequest(dm_user_header* header);
     bool WriteDmUserPayload(size_t size);
 
+    // Largest response which SendBufferedIo() holds back instead of writing.
+    static constexpr size_t kMaxHeldPayload = 64 * 1024;
+
     std::string misc_name_;
     android::base::unique_fd ctrl_fd_;
     Delegate* delegate_;
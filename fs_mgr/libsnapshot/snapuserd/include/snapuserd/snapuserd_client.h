@@ -18,6 +18,7 @@
 
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 
@@ -25,6 +26,8 @@ namespace android {
 namespace snapshot {
 
 static constexpr uint32_t PACKET_SIZE = 512;
+// Largest request the daemon accepts; only batched requests may exceed PACKET_SIZE.
+static constexpr uint32_t MAX_REQUEST_SIZE = 4096;
 
 static constexpr char kSnapuserdSocket[] = "snapuserd";
 static constexpr char kSnapuserdSocketProxy[] = "snapuserd_proxy";
@@ -73,6 +76,21 @@ class SnapuserdClient {
                            const std::string& base_path_merge = "");
     bool AttachDmUser(const std::string& misc_name);
 
+    struct DmUserCowParams {
+        std::string misc_name;
+        std::string cow_device;
+        std::string backing_device;
+        std::string base_path_merge;
+    };
+
+    // Batched form of InitDmUserCow, for userspace snapshots. The daemon
+    // reads the COWs in |params| concurrently. On success, |num_sectors| has
+    // one entry per element of |params|, which is zero if that handler could
+    // not be created. Falls back to one InitDmUserCow call per entry if the
+    // daemon does not support batching.
+    bool InitDmUserCows(const std::vector<DmUserCowParams>& params,
+                        std::vector<uint64_t>* num_sectors);
+
     // Wait for snapuserd to disassociate with a dm-user control device. This
     // must ONLY be called if the control device has already been deleted.
     bool WaitForDeviceDelete(const std::string& control_device);
@@ -85,6 +103,18 @@ class SnapuserdClient {
     // Returns true if the snapuserd instance supports bridging a socket to second-stage init.
     bool SupportsSecondStageSocketHandoff();
 
+    // Returns true if the snapuserd instance accepts "init_batch" messages.
+    bool SupportsBatchInit();
+
+    // Returns true if the snapuserd instance can export its parsed COW
+    // metadata.
+    bool SupportsMetadataHandover();
+
+    // Returns a memfd holding the parsed COW metadata of every snapshot
+    // handler. A snapuserd started with -metadata_fd pointing at it does not
+    // parse those COWs again. Returns an invalid fd on failure.
+    android::base::unique_fd ExportMetadata();
+
     // Returns true if the merge is started(or resumed from crash).
     bool InitiateMerge(const std::string& misc_name);
 
@@ -94,10 +124,25 @@ class SnapuserdClient {
     // Return the status of the snapshot
     std::string QuerySnapshotStatus(const std::string& misc_name);
 
+    // Return the read worker count, requests served and load of a snapshot
+    // handler, and the use of the daemon's shared spare worker pool. Returns
+    // empty on failure.
+    std::string GetWorkerStats(const std::string& misc_name);
+
+    // Return the merge progress of a snapshot: ops merged and left, merge
+    // rate and ETA, and time spent waiting on read-ahead, COW commits and
+    // throttling. Returns empty on failure.
+    std::string GetMergeStats(const std::string& misc_name);
+
     // Check the update verification status - invoked by update_verifier during
     // boot
     bool QueryUpdateVerification();
 
+    // Save the block-access profile recorded by each snapshot handler. On
+    // the next boot, those blocks are prefetched into the decompressed-block
+    // cache ahead of demand.
+    bool SaveAccessProfiles();
+
     // Check if Snapuser daemon is ready post selinux transition after OTA boot
     // This is invoked only by init as there is no sockets setup yet during
     // selinux transition
@@ -0,0 +1,221 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <random>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+#include <gflags/gflags.h>
+#include <libsnapshot/cow_writer.h>
+#include <storage_literals/storage_literals.h>
+#include "utility.h"
+#include "user-space-merge/benchmark.h"
+
+using namespace android::snapshot;
+using namespace android::storage_literals;
+using android::base::unique_fd;
+
+DEFINE_string(base, "", "Base device/image. Required together with -cow.");
+DEFINE_string(cow, "", "COW device/image, e.g. generated by create_cow.");
+DEFINE_string(trace, "", "Trace of \"<sector> <size>\" requests; synthesized if empty.");
+DEFINE_string(save_trace, "", "Write the replayed trace to this path.");
+DEFINE_string(configs, "sync,o_direct,io_uring", "Comma-separated configurations to replay.");
+DEFINE_string(compression, "lz4", "Compression for the synthetic COW.");
+DEFINE_uint32(synthetic_size_mb, 64, "Size of the synthetic base and COW device.");
+DEFINE_uint32(sequential_request_kb, 64, "Size of synthesized sequential requests.");
+DEFINE_uint32(random_requests, 4096, "Number of synthesized random 4K requests.");
+DEFINE_uint32(iterations, 3, "Number of times to replay the trace per configuration.");
+DEFINE_uint32(seed, 1, "Seed for the synthetic data and trace.");
+
+namespace {
+
+constexpr uint32_t kBlockSize = 4096;
+
+// Build a base image and a v3 COW over it with an even mix of copy, replace,
+// zero and xor operations.
+bool CreateSyntheticDevice(const std::string& base_path, const std::string& cow_path,
+                           std::mt19937_64* rng) {
+    const uint64_t size = FLAGS_synthetic_size_mb * 1_MiB;
+    const uint64_t num_blocks = size / kBlockSize;
+    const uint64_t quarter = num_blocks / 4;
+    if (!quarter) {
+        LOG(ERROR) << "Synthetic device too small.";
+        return false;
+    }
+
+    std::string data(size, '\0');
+    std::generate(data.begin(), data.end(), [&]() { return static_cast<char>((*rng)()); });
+    if (!android::base::WriteStringToFile(data, base_path)) {
+        PLOG(ERROR) << "Could not write base image: " << base_path;
+        return false;
+    }
+
+    unique_fd fd(open(cow_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0664));
+    if (fd < 0) {
+        PLOG(ERROR) << "Could not open COW: " << cow_path;
+        return false;
+    }
+
+    CowOptions options;
+    options.compression = FLAGS_compression;
+    options.op_count_max = num_blocks;
+    options.batch_write = true;
+    auto writer = CreateCowWriter(3, options, std::move(fd));
+    if (!writer) {
+        return false;
+    }
+
+    std::shuffle(data.begin(), data.end(), *rng);
+    const size_t region = quarter * kBlockSize;
+    if (!writer->AddCopy(0, quarter, quarter) ||
+        !writer->AddRawBlocks(quarter, data.data(), region) ||
+        !writer->AddZeroBlocks(quarter * 2, quarter) ||
+        !writer->AddXorBlocks(quarter * 3, data.data() + region, region, 1, kBlockSize / 2) ||
+        !writer->Finalize()) {
+        LOG(ERROR) << "Could not write synthetic COW: " << cow_path;
+        return false;
+    }
+    return true;
+}
+
+// One sequential pass over the device followed by random block reads.
+std::vector<TraceRequest> SynthesizeTrace(uint64_t num_sectors, std::mt19937_64* rng) {
+    std::vector<TraceRequest> trace;
+
+    const uint64_t device_size = num_sectors << SECTOR_SHIFT;
+    const uint64_t chunk = FLAGS_sequential_request_kb * 1_KiB;
+    for (uint64_t offset = 0; chunk && offset < device_size; offset += chunk) {
+        trace.push_back({offset >> SECTOR_SHIFT, std::min(chunk, device_size - offset)});
+    }
+
+    const uint64_t num_blocks = device_size / kBlockSize;
+    if (!num_blocks) {
+        return trace;
+    }
+    std::uniform_int_distribution<uint64_t> block(0, num_blocks - 1);
+    for (uint32_t i = 0; i < FLAGS_random_requests; i++) {
+        trace.push_back({(block(*rng) * kBlockSize) >> SECTOR_SHIFT, kBlockSize});
+    }
+    return trace;
+}
+
+bool ParseConfig(const std::string& name, ReplayConfig* config) {
+    config->name = name;
+    if (name == "sync") {
+        return true;
+    }
+    if (name == "o_direct") {
+        config->o_direct = true;
+        return true;
+    }
+    if (name == "io_uring") {
+        if (!KernelSupportsIoUring()) {
+            LOG(WARNING) << "Kernel does not support io_uring; skipping.";
+            return false;
+        }
+        config->use_iouring = true;
+        return true;
+    }
+    LOG(ERROR) << "Unknown configuration: " << name;
+    return false;
+}
+
+void Report(const ReplayConfig& config, ReplayResult* result) {
+    auto& latencies = result->latencies;
+    if (latencies.empty()) {
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    auto percentile = [&](double p) -> double {
+        size_t index = std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()));
+        return std::chrono::duration<double, std::micro>(latencies[index]).count();
+    };
+    double seconds = std::chrono::duration<double>(result->elapsed).count();
+    double mbps = seconds > 0 ? (result->bytes / (1.0 * 1_MiB)) / seconds : 0;
+
+    std::cout << android::base::StringPrintf(
+            "%-10s requests=%zu p50=%.1fus p90=%.1fus p99=%.1fus max=%.1fus throughput=%.1fMB/s\n",
+            config.name.c_str(), latencies.size(), percentile(0.50), percentile(0.90),
+            percentile(0.99), percentile(1.0), mbps);
+}
+
+}  // namespace
+
+int main([[maybe_unused]] int argc, char** argv) {
+    android::base::InitLogging(argv);
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    if (FLAGS_base.empty() != FLAGS_cow.empty()) {
+        LOG(ERROR) << "-base and -cow must be specified together.";
+        return 1;
+    }
+
+    std::mt19937_64 rng(FLAGS_seed);
+
+    std::string base_path = FLAGS_base;
+    std::string cow_path = FLAGS_cow;
+    std::unique_ptr<TemporaryFile> base_file, cow_file;
+    if (base_path.empty()) {
+        base_file = std::make_unique<TemporaryFile>();
+        cow_file = std::make_unique<TemporaryFile>();
+        base_path = base_file->path;
+        cow_path = cow_file->path;
+        if (!CreateSyntheticDevice(base_path, cow_path, &rng)) {
+            return 1;
+        }
+    }
+
+    std::vector<TraceRequest> trace;
+    if (!FLAGS_trace.empty() && !LoadTrace(FLAGS_trace, &trace)) {
+        return 1;
+    }
+
+    for (const auto& name : android::base::Split(FLAGS_configs, ",")) {
+        ReplayConfig config;
+        if (!ParseConfig(name, &config)) {
+            continue;
+        }
+
+        ReplayBenchmark benchmark(base_path, cow_path, config);
+        if (!benchmark.Init()) {
+            LOG(ERROR) << "Could not initialize configuration: " << name;
+            return 1;
+        }
+        if (trace.empty()) {
+            trace = SynthesizeTrace(benchmark.num_sectors(), &rng);
+            if (!FLAGS_save_trace.empty() && !SaveTrace(FLAGS_save_trace, trace)) {
+                return 1;
+            }
+        }
+
+        ReplayResult result;
+        for (uint32_t i = 0; i < FLAGS_iterations; i++) {
+            if (!benchmark.Replay(trace, &result)) {
+                return 1;
+            }
+        }
+        Report(config, &result);
+    }
+    return 0;
+}
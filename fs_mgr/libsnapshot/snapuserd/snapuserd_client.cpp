@@ -29,6 +29,7 @@
 #include <chrono>
 #include <thread>
 
+#include <android-base/cmsg.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
@@ -204,6 +205,48 @@ bool SnapuserdClient::SupportsSecondStageSocketHandoff() {
     return response == "success";
 }
 
+bool SnapuserdClient::SupportsBatchInit() {
+    std::string msg = "supports,init_batch";
+    if (!Sendmsg(msg)) {
+        LOG(ERROR) << "Failed to send message " << msg << " to snapuserd";
+        return false;
+    }
+    std::string response = Receivemsg();
+    return response == "success";
+}
+
+bool SnapuserdClient::SupportsMetadataHandover() {
+    std::string msg = "supports,metadata_handover";
+    if (!Sendmsg(msg)) {
+        LOG(ERROR) << "Failed to send message " << msg << " to snapuserd";
+        return false;
+    }
+    std::string response = Receivemsg();
+    return response == "success";
+}
+
+unique_fd SnapuserdClient::ExportMetadata() {
+    std::string msg = "export_metadata";
+    if (!Sendmsg(msg)) {
+        LOG(ERROR) << "Failed to send message " << msg << " to snapuserd";
+        return {};
+    }
+
+    char response[PACKET_SIZE];
+    unique_fd memfd;
+    ssize_t ret = android::base::ReceiveFileDescriptors(sockfd_, response, sizeof(response),
+                                                        &memfd);
+    if (ret < 0) {
+        PLOG(ERROR) << "Failed to receive snapuserd metadata";
+        return {};
+    }
+    if (std::string(response, ret) != "success" || memfd < 0) {
+        LOG(ERROR) << "Snapuserd failed to export metadata";
+        return {};
+    }
+    return memfd;
+}
+
 std::string SnapuserdClient::Receivemsg() {
     char msg[PACKET_SIZE];
     ssize_t ret = TEMP_FAILURE_RETRY(recv(sockfd_, msg, sizeof(msg), 0));
@@ -282,6 +325,72 @@ uint64_t SnapuserdClient::InitDmUserCow(const std::string& misc_name, const std:
     return num_sectors;
 }
 
+bool SnapuserdClient::InitDmUserCows(const std::vector<DmUserCowParams>& params,
+                                     std::vector<uint64_t>* num_sectors) {
+    num_sectors->clear();
+    if (params.empty()) {
+        return true;
+    }
+
+    if (!SupportsBatchInit()) {
+        for (const auto& p : params) {
+            num_sectors->emplace_back(InitDmUserCow(p.misc_name, p.cow_device, p.backing_device,
+                                                    p.base_path_merge));
+        }
+        return true;
+    }
+
+    // Message format:
+    // init_batch,<count>,<misc_name>,<cow_device>,<backing_device>,<base_path_merge>,...
+    //
+    // Requests are split so that none exceeds the daemon's receive buffer.
+    static constexpr size_t kMaxBatchEntries = 16;
+    size_t next = 0;
+    while (next < params.size()) {
+        std::vector<std::string> entries;
+        size_t msg_size = 0;
+        size_t end = next;
+        while (end < params.size() && end - next < kMaxBatchEntries) {
+            const auto& p = params[end];
+            std::string entry = android::base::Join(
+                    std::vector<std::string>{p.misc_name, p.cow_device, p.backing_device,
+                                             p.base_path_merge},
+                    ",");
+            if (end > next && msg_size + entry.size() + 32 > MAX_REQUEST_SIZE) {
+                break;
+            }
+            msg_size += entry.size() + 1;
+            entries.emplace_back(std::move(entry));
+            end++;
+        }
+
+        std::string msg = "init_batch," + std::to_string(entries.size()) + "," +
+                          android::base::Join(entries, ",");
+        if (!Sendmsg(msg)) {
+            LOG(ERROR) << "Failed to send batched init for " << entries.size()
+                       << " handlers to snapuserd daemon";
+            return false;
+        }
+
+        std::vector<std::string> input = android::base::Split(Receivemsg(), ",");
+        if (input.empty() || input[0] != "success" || input.size() != entries.size() + 1) {
+            LOG(ERROR) << "Failed to receive number of sectors for batched init from snapuserd "
+                          "daemon";
+            return false;
+        }
+        for (size_t i = 1; i < input.size(); i++) {
+            uint64_t sectors = 0;
+            if (!android::base::ParseUint(input[i], &sectors)) {
+                LOG(ERROR) << "Failed to parse input string to sectors: " << input[i];
+                sectors = 0;
+            }
+            num_sectors->emplace_back(sectors);
+        }
+        next = end;
+    }
+    return true;
+}
+
 bool SnapuserdClient::DetachSnapuserd() {
     if (!Sendmsg("detach")) {
         LOG(ERROR) << "Failed to detach snapuserd.";
@@ -332,6 +441,42 @@ bool SnapuserdClient::QueryUpdateVerification() {
     return response == "success";
 }
 
+std::string SnapuserdClient::GetWorkerStats(const std::string& misc_name) {
+    std::string msg = "worker_stats," + misc_name;
+    if (!Sendmsg(msg)) {
+        LOG(ERROR) << "Failed to send message " << msg << " to snapuserd";
+        return {};
+    }
+    std::string response = Receivemsg();
+    if (response == "fail") {
+        return {};
+    }
+    return response;
+}
+
+std::string SnapuserdClient::GetMergeStats(const std::string& misc_name) {
+    std::string msg = "merge_stats," + misc_name;
+    if (!Sendmsg(msg)) {
+        LOG(ERROR) << "Failed to send message " << msg << " to snapuserd";
+        return {};
+    }
+    std::string response = Receivemsg();
+    if (response == "fail") {
+        return {};
+    }
+    return response;
+}
+
+bool SnapuserdClient::SaveAccessProfiles() {
+    std::string msg = "save_profile";
+    if (!Sendmsg(msg)) {
+        LOG(ERROR) << "Failed to send message " << msg << " to snapuserd";
+        return false;
+    }
+    std::string response = Receivemsg();
+    return response == "success";
+}
+
 std::string SnapuserdClient::GetDaemonAliveIndicatorPath() {
     return "/metadata/ota/" + std::string(kDaemonAliveIndicator);
 }
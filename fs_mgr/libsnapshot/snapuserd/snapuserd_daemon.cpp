@@ -17,6 +17,7 @@
 #include <android-base/logging.h>
 #include <android-base/properties.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <gflags/gflags.h>
 #include <snapuserd/snapuserd_client.h>
 
@@ -30,6 +31,11 @@ DEFINE_bool(socket_handoff, false,
 DEFINE_bool(user_snapshot, false, "If true, user-space snapshots are used");
 DEFINE_bool(io_uring, false, "If true, io_uring feature is enabled");
 DEFINE_bool(o_direct, false, "If true, enable direct reads on source device");
+DEFINE_bool(merge_throttle, false,
+            "If true, throttle snapshot merge based on foreground I/O pressure");
+DEFINE_int32(metadata_fd, -1,
+             "Descriptor of COW metadata exported by the first-stage daemon, used with "
+             "-no_socket.");
 
 namespace android {
 namespace snapshot {
@@ -96,6 +102,11 @@ bool Daemon::StartServerForUserspaceSnapshots(int arg_start, int argc, char** ar
     if (FLAGS_io_uring) {
         user_server_.SetIouringEnabled();
     }
+    if (FLAGS_merge_throttle) {
+        MergeThrottleConfig config;
+        config.enabled = true;
+        user_server_.SetMergeThrottle(config);
+    }
 
     if (FLAGS_socket_handoff) {
         return user_server_.RunForSocketHandoff();
@@ -107,6 +118,13 @@ bool Daemon::StartServerForUserspaceSnapshots(int arg_start, int argc, char** ar
         return user_server_.Run();
     }
 
+    if (FLAGS_metadata_fd >= 0) {
+        android::base::unique_fd metadata_fd(FLAGS_metadata_fd);
+        if (!user_server_.SetHandoverMetadata(metadata_fd)) {
+            LOG(WARNING) << "Ignoring handover metadata, COWs will be parsed";
+        }
+    }
+
     for (int i = arg_start; i < argc; i++) {
         auto parts = android::base::Split(argv[i], ",");
 
@@ -0,0 +1,99 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "access_profile.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+namespace android {
+namespace snapshot {
+
+void AccessProfile::Record(uint64_t new_block) {
+    if (full_) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(lock_);
+    if (blocks_.size() >= max_blocks_) {
+        full_ = true;
+        return;
+    }
+    if (seen_.insert(new_block).second) {
+        blocks_.push_back(new_block);
+    }
+}
+
+std::vector<uint64_t> AccessProfile::GetBlocks() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return blocks_;
+}
+
+bool AccessProfile::Load(const std::string& path, size_t max_blocks,
+                         std::vector<uint64_t>* blocks) {
+    std::string contents;
+    if (!android::base::ReadFileToString(path, &contents)) {
+        if (errno != ENOENT) {
+            PLOG(ERROR) << "Failed to read access profile: " << path;
+        }
+        return false;
+    }
+
+    blocks->clear();
+    for (const auto& line : android::base::Split(contents, "\n")) {
+        if (line.empty()) {
+            continue;
+        }
+        uint64_t new_block;
+        if (!android::base::ParseUint(line, &new_block)) {
+            LOG(ERROR) << "Malformed access profile: " << path;
+            blocks->clear();
+            return false;
+        }
+        if (blocks->size() >= max_blocks) {
+            break;
+        }
+        blocks->push_back(new_block);
+    }
+    return true;
+}
+
+bool AccessProfile::Save(const std::string& path, const std::vector<uint64_t>& blocks) {
+    std::string contents;
+    for (const auto& new_block : blocks) {
+        contents += std::to_string(new_block) + "\n";
+    }
+
+    // Write a temporary file first so that a profile is never torn.
+    const std::string tmp_path = path + ".tmp";
+    if (!android::base::WriteStringToFile(contents, tmp_path)) {
+        PLOG(ERROR) << "Failed to write access profile: " << tmp_path;
+        return false;
+    }
+    if (rename(tmp_path.c_str(), path.c_str()) < 0) {
+        PLOG(ERROR) << "Failed to rename " << tmp_path << " to " << path;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace snapshot
+}  // namespace android
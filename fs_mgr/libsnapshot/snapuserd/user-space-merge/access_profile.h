@@ -0,0 +1,55 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace android {
+namespace snapshot {
+
+// The order in which the COW blocks of a handler are first read. A profile
+// recorded on one boot is used to prefetch the same blocks on the next one.
+//
+// Profiles are stored as plain text, one new_block per line, in access order.
+class AccessProfile {
+  public:
+    explicit AccessProfile(size_t max_blocks) : max_blocks_(max_blocks) {}
+
+    // Note an access to |new_block|. Only the first access counts; once
+    // |max_blocks| distinct blocks have been recorded, the rest are ignored.
+    void Record(uint64_t new_block);
+    std::vector<uint64_t> GetBlocks();
+
+    // Load returns false, without logging, if |path| does not exist.
+    static bool Load(const std::string& path, size_t max_blocks, std::vector<uint64_t>* blocks);
+    static bool Save(const std::string& path, const std::vector<uint64_t>& blocks);
+
+  private:
+    std::mutex lock_;
+    size_t max_blocks_;
+    std::atomic<bool> full_ = false;
+    std::unordered_set<uint64_t> seen_;
+    std::vector<uint64_t> blocks_;
+};
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,117 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "benchmark.h"
+
+#include <fstream>
+#include <sstream>
+
+#include <android-base/logging.h>
+#include <android-base/strings.h>
+
+namespace android {
+namespace snapshot {
+
+bool LoadTrace(const std::string& path, std::vector<TraceRequest>* trace) {
+    std::ifstream in(path);
+    if (!in) {
+        PLOG(ERROR) << "Could not open trace: " << path;
+        return false;
+    }
+
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line)) {
+        line_number++;
+        line = android::base::Trim(line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        TraceRequest request;
+        std::istringstream fields(line);
+        if (!(fields >> request.sector >> request.size) || !request.size) {
+            LOG(ERROR) << path << ":" << line_number << ": malformed request: " << line;
+            return false;
+        }
+        trace->emplace_back(request);
+    }
+    return true;
+}
+
+bool SaveTrace(const std::string& path, const std::vector<TraceRequest>& trace) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        PLOG(ERROR) << "Could not open trace for writing: " << path;
+        return false;
+    }
+    for (const auto& request : trace) {
+        out << request.sector << " " << request.size << "\n";
+    }
+    return !!out;
+}
+
+ReplayBenchmark::ReplayBenchmark(const std::string& base_path, const std::string& cow_path,
+                                 const ReplayConfig& config)
+    : base_path_(base_path), cow_path_(cow_path), config_(config), control_name_("benchmark") {}
+
+bool ReplayBenchmark::Init() {
+    auto opener = factory_.CreateTestOpener(control_name_);
+    handler_ = std::make_shared<SnapshotHandler>(control_name_, cow_path_, base_path_, base_path_,
+                                                 opener, 1, config_.use_iouring, false,
+                                                 config_.o_direct);
+    if (!handler_->InitCowDevice()) {
+        return false;
+    }
+    if (!handler_->InitializeWorkers()) {
+        return false;
+    }
+
+    read_worker_ = std::make_unique<ReadWorker>(cow_path_, base_path_, control_name_, base_path_,
+                                                handler_->GetSharedPtr(), opener,
+                                                config_.o_direct);
+    if (!read_worker_->Init()) {
+        return false;
+    }
+    block_server_ = static_cast<TestBlockServer*>(read_worker_->block_server());
+
+    handler_thread_ = std::async(std::launch::async, &SnapshotHandler::Start, handler_.get());
+    return true;
+}
+
+ReplayBenchmark::~ReplayBenchmark() {
+    factory_.DeleteQueue(control_name_);
+}
+
+bool ReplayBenchmark::Replay(const std::vector<TraceRequest>& trace, ReplayResult* result) {
+    result->latencies.reserve(result->latencies.size() + trace.size());
+
+    auto replay_start = std::chrono::steady_clock::now();
+    for (const auto& request : trace) {
+        auto start = std::chrono::steady_clock::now();
+        if (!read_worker_->RequestSectors(request.sector, request.size)) {
+            LOG(ERROR) << "Request for sector " << request.sector << " size " << request.size
+                       << " failed.";
+            return false;
+        }
+        std::string data = std::move(block_server_->sent_io());
+        result->latencies.emplace_back(std::chrono::steady_clock::now() - start);
+        result->bytes += data.size();
+    }
+    result->elapsed += std::chrono::steady_clock::now() - replay_start;
+    return true;
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,84 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "merge_worker.h"
+#include "prefetch_worker.h"
+#include "read_worker.h"
+#include "snapuserd_core.h"
+#include "testing/host_harness.h"
+
+namespace android {
+namespace snapshot {
+
+// A single dm-user read request, as seen by ReadWorker::RequestSectors.
+struct TraceRequest {
+    uint64_t sector;
+    uint64_t size;
+};
+
+struct ReplayConfig {
+    std::string name;
+    bool use_iouring = false;
+    bool o_direct = false;
+};
+
+struct ReplayResult {
+    std::vector<std::chrono::nanoseconds> latencies;
+    std::chrono::nanoseconds elapsed{};
+    uint64_t bytes = 0;
+};
+
+// Trace files are plain text with one "<sector> <size-in-bytes>" request per
+// line; blank lines and lines starting with '#' are ignored.
+bool LoadTrace(const std::string& path, std::vector<TraceRequest>* trace);
+bool SaveTrace(const std::string& path, const std::vector<TraceRequest>& trace);
+
+// Replays a sequence of dm-user requests against a SnapshotHandler through the
+// host TestBlockServer, timing each request.
+class ReplayBenchmark final {
+  public:
+    ReplayBenchmark(const std::string& base_path, const std::string& cow_path,
+                    const ReplayConfig& config);
+    ~ReplayBenchmark();
+
+    bool Init();
+    bool Replay(const std::vector<TraceRequest>& trace, ReplayResult* result);
+
+    uint64_t num_sectors() const { return handler_->GetNumSectors(); }
+
+  private:
+    std::string base_path_;
+    std::string cow_path_;
+    ReplayConfig config_;
+
+    TestBlockServerFactory factory_;
+    std::string control_name_;
+    std::shared_ptr<SnapshotHandler> handler_;
+    std::unique_ptr<ReadWorker> read_worker_;
+    std::future<bool> handler_thread_;
+    TestBlockServer* block_server_ = nullptr;
+};
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,133 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "block_cache.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include <android-base/logging.h>
+
+namespace android {
+namespace snapshot {
+
+BlockCache::BlockCache(size_t capacity_bytes, size_t block_size, size_t num_shards)
+    : block_size_(block_size) {
+    CHECK(block_size_ > 0);
+    num_shards = std::max<size_t>(num_shards, 1);
+    capacity_blocks_ = capacity_bytes / block_size_;
+
+    shards_.reserve(num_shards);
+    for (size_t i = 0; i < num_shards; i++) {
+        auto shard = std::make_unique<Shard>();
+        shard->capacity = ShardCapacity(capacity_blocks_, i, num_shards);
+        shard->index.reserve(shard->capacity);
+        shards_.emplace_back(std::move(shard));
+    }
+}
+
+size_t BlockCache::ShardCapacity(size_t capacity_blocks, size_t shard, size_t num_shards) {
+    // Spread the remainder so that the total matches |capacity_blocks|.
+    return capacity_blocks / num_shards + (shard < capacity_blocks % num_shards);
+}
+
+bool BlockCache::Get(uint64_t new_block, void* buffer, size_t offset, size_t size) {
+    CHECK(offset + size <= block_size_);
+
+    Shard& shard = GetShard(new_block);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto it = shard.index.find(new_block);
+    if (it == shard.index.end()) {
+        misses_++;
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    memcpy(buffer, it->second->data.get() + offset, size);
+    hits_++;
+    return true;
+}
+
+void BlockCache::Put(uint64_t new_block, const void* data) {
+    Shard& shard = GetShard(new_block);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    if (!shard.capacity) {
+        return;
+    }
+
+    auto it = shard.index.find(new_block);
+    if (it != shard.index.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        memcpy(it->second->data.get(), data, block_size_);
+        return;
+    }
+
+    if (shard.lru.size() >= shard.capacity) {
+        // Recycle the least recently used entry and its buffer.
+        auto victim = std::prev(shard.lru.end());
+        shard.index.erase(victim->new_block);
+        victim->new_block = new_block;
+        shard.lru.splice(shard.lru.begin(), shard.lru, victim);
+    } else {
+        shard.lru.push_front({new_block, std::make_unique<uint8_t[]>(block_size_)});
+    }
+    memcpy(shard.lru.front().data.get(), data, block_size_);
+    shard.index[new_block] = shard.lru.begin();
+}
+
+void BlockCache::Invalidate(uint64_t new_block) {
+    Shard& shard = GetShard(new_block);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    auto it = shard.index.find(new_block);
+    if (it == shard.index.end()) {
+        return;
+    }
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+    invalidations_++;
+}
+
+bool BlockCache::Contains(uint64_t new_block) {
+    Shard& shard = GetShard(new_block);
+    std::lock_guard<std::mutex> lock(shard.lock);
+    return shard.index.count(new_block) != 0;
+}
+
+void BlockCache::Grow(size_t capacity_bytes) {
+    size_t capacity_blocks = capacity_bytes / block_size_;
+    if (capacity_blocks <= capacity_blocks_) {
+        return;
+    }
+    capacity_blocks_ = capacity_blocks;
+
+    for (size_t i = 0; i < shards_.size(); i++) {
+        std::lock_guard<std::mutex> lock(shards_[i]->lock);
+        shards_[i]->capacity = ShardCapacity(capacity_blocks, i, shards_.size());
+    }
+}
+
+BlockCache::Stats BlockCache::GetStats() const {
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.invalidations = invalidations_;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->lock);
+        stats.cached_blocks += shard->lru.size();
+    }
+    return stats;
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,95 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace android {
+namespace snapshot {
+
+// A size-bounded LRU cache of decompressed COW blocks, keyed by the op's
+// new_block. One instance is shared by all ReadWorker threads of a
+// SnapshotHandler, so it is split into independently locked shards to keep
+// workers from contending on a single mutex.
+class BlockCache {
+  public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t invalidations = 0;
+        size_t cached_blocks = 0;
+    };
+
+    BlockCache(size_t capacity_bytes, size_t block_size, size_t num_shards = kDefaultShards);
+
+    // Copy |size| bytes, starting at |offset| within the cached block, into
+    // |buffer|. Returns false on a miss.
+    bool Get(uint64_t new_block, void* buffer, size_t offset, size_t size);
+    bool Get(uint64_t new_block, void* buffer) { return Get(new_block, buffer, 0, block_size_); }
+
+    // Insert or refresh a full block, evicting the least recently used
+    // block of the shard if it is full.
+    void Put(uint64_t new_block, const void* data);
+
+    // Drop the block, if cached.
+    void Invalidate(uint64_t new_block);
+
+    // Returns true if the block is cached, without affecting its LRU
+    // position or the hit/miss counters.
+    bool Contains(uint64_t new_block);
+
+    // Raise the capacity to |capacity_bytes|. Smaller values are ignored;
+    // the cache never shrinks.
+    void Grow(size_t capacity_bytes);
+
+    Stats GetStats() const;
+    size_t capacity_blocks() const { return capacity_blocks_; }
+
+    static constexpr size_t kDefaultShards = 8;
+
+  private:
+    struct Entry {
+        uint64_t new_block;
+        std::unique_ptr<uint8_t[]> data;
+    };
+    struct Shard {
+        std::mutex lock;
+        std::list<Entry> lru;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+        size_t capacity = 0;
+    };
+
+    static size_t ShardCapacity(size_t capacity_blocks, size_t shard, size_t num_shards);
+    Shard& GetShard(uint64_t new_block) { return *shards_[new_block % shards_.size()]; }
+
+    size_t block_size_;
+    std::atomic<size_t> capacity_blocks_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+    std::atomic<uint64_t> invalidations_ = 0;
+};
+
+}  // namespace snapshot
+}  // namespace android
@@ -19,6 +19,7 @@
 
 #include <android-base/unique_fd.h>
 #include "merge_worker.h"
+#include "prefetch_worker.h"
 #include "read_worker.h"
 #include "snapuserd_core.h"
 #include "testing/host_harness.h"
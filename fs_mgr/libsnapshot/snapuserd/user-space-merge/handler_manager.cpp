@@ -14,13 +14,20 @@
 
 #include "handler_manager.h"
 
+#include <dirent.h>
 #include <pthread.h>
 #include <sys/eventfd.h>
 
+#include <algorithm>
+#include <cstring>
+
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/strings.h>
 
 #include "android-base/properties.h"
 #include "merge_worker.h"
+#include "prefetch_worker.h"
 #include "read_worker.h"
 #include "snapuserd_core.h"
 
@@ -29,9 +36,50 @@ namespace snapshot {
 
 static constexpr uint8_t kMaxMergeThreads = 2;
 
+// Weight given to the most recent bandwidth sample of a disk.
+static constexpr double kMergeBandwidthWeight = 0.5;
+
+// Returns the name of the disk backing |path|. dm devices are resolved to
+// their first underlying device, so that all partitions within super map to
+// the same disk.
+static std::string GetMergeDisk(const std::string& path) {
+    std::string real_path;
+    if (!android::base::Realpath(path, &real_path)) {
+        return path;
+    }
+
+    std::string name = android::base::Basename(real_path);
+    for (int depth = 0; depth < 4; depth++) {
+        std::string slaves = "/sys/block/" + name + "/slaves";
+        std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(slaves.c_str()), closedir);
+        if (!dir) {
+            break;
+        }
+
+        std::string next;
+        while (struct dirent* entry = readdir(dir.get())) {
+            if (entry->d_name[0] != '.') {
+                next = entry->d_name;
+                break;
+            }
+        }
+        if (next.empty()) {
+            break;
+        }
+        name = next;
+    }
+    return name;
+}
+
 HandlerThread::HandlerThread(std::shared_ptr<SnapshotHandler> snapuserd)
     : snapuserd_(snapuserd), misc_name_(snapuserd_->GetMiscName()) {}
 
+void HandlerThread::SetMergeStarted(uint64_t ops, const std::string& disk) {
+    merge_start_ops_ = ops;
+    merge_disk_ = disk;
+    merge_start_time_ = std::chrono::steady_clock::now();
+}
+
 void HandlerThread::FreeResources() {
     // Each worker thread holds a reference to snapuserd.
     // Clear them so that all the resources
@@ -47,6 +95,10 @@ SnapshotHandlerManager::SnapshotHandlerManager() {
     if (monitor_merge_event_fd_ == -1) {
         PLOG(FATAL) << "monitor_merge_event_fd_: failed to create eventfd";
     }
+
+    size_t max_spare_workers =
+            std::max<size_t>(kNumWorkerThreads, std::thread::hardware_concurrency());
+    read_worker_pool_ = std::make_shared<ReadWorkerPool>(max_spare_workers);
 }
 
 std::shared_ptr<HandlerThread> SnapshotHandlerManager::AddHandler(
@@ -57,6 +109,15 @@ std::shared_ptr<HandlerThread> SnapshotHandlerManager::AddHandler(
     auto snapuserd = std::make_shared<SnapshotHandler>(
             misc_name, cow_device_path, backing_device, base_path_merge, opener, num_worker_threads,
             use_iouring, perform_verification_, o_direct);
+    snapuserd->SetReadWorkerPool(read_worker_pool_);
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto iter = handover_metadata_.find(misc_name);
+        if (iter != handover_metadata_.end()) {
+            snapuserd->SetHandoverMetadata(std::move(iter->second));
+            handover_metadata_.erase(iter);
+        }
+    }
     if (!snapuserd->InitCowDevice()) {
         LOG(ERROR) << "Failed to initialize Snapuserd";
         return nullptr;
@@ -74,11 +135,93 @@ std::shared_ptr<HandlerThread> SnapshotHandlerManager::AddHandler(
             LOG(ERROR) << "Handler already exists: " << misc_name;
             return nullptr;
         }
+        snapuserd->SetMergeThrottleConfig(merge_throttle_config_);
         dm_users_.push_back(handler);
     }
     return handler;
 }
 
+void SnapshotHandlerManager::SetMergeThrottle(const MergeThrottleConfig& config) {
+    std::lock_guard<std::mutex> lock(lock_);
+    merge_throttle_config_ = config;
+    for (const auto& handler : dm_users_) {
+        if (handler->snapuserd()) {
+            handler->snapuserd()->SetMergeThrottleConfig(config);
+        }
+    }
+}
+
+bool SnapshotHandlerManager::SaveAccessProfiles() {
+    std::lock_guard<std::mutex> lock(lock_);
+    bool ret = true;
+    for (const auto& handler : dm_users_) {
+        if (handler->snapuserd()) {
+            ret = handler->snapuserd()->SaveAccessProfile() && ret;
+        }
+    }
+    return ret;
+}
+
+// Handover metadata is a sequence of records, one per handler:
+//   uint32_t name_length, uint64_t state_length, name, state
+bool SnapshotHandlerManager::ExportMetadata(std::string* out) {
+    std::lock_guard<std::mutex> lock(lock_);
+    out->clear();
+    for (const auto& handler : dm_users_) {
+        if (!handler->snapuserd()) {
+            continue;
+        }
+        std::string state;
+        if (!handler->snapuserd()->ExportMetadata(&state)) {
+            // The replacement daemon parses this COW itself.
+            continue;
+        }
+        // First-stage handlers carry an "-init" suffix which the daemon
+        // replacing them does not use.
+        std::string name = handler->misc_name();
+        if (android::base::EndsWith(name, "-init")) {
+            name.resize(name.size() - strlen("-init"));
+        }
+        const uint32_t name_length = name.size();
+        const uint64_t state_length = state.size();
+        out->append(reinterpret_cast<const char*>(&name_length), sizeof(name_length));
+        out->append(reinterpret_cast<const char*>(&state_length), sizeof(state_length));
+        out->append(name);
+        out->append(state);
+    }
+    return true;
+}
+
+bool SnapshotHandlerManager::SetHandoverMetadata(std::string_view data) {
+    std::unordered_map<std::string, std::string> metadata;
+    while (!data.empty()) {
+        uint32_t name_length;
+        uint64_t state_length;
+        if (data.size() < sizeof(name_length) + sizeof(state_length)) {
+            LOG(ERROR) << "Truncated handover metadata";
+            return false;
+        }
+        memcpy(&name_length, data.data(), sizeof(name_length));
+        data.remove_prefix(sizeof(name_length));
+        memcpy(&state_length, data.data(), sizeof(state_length));
+        data.remove_prefix(sizeof(state_length));
+        if (name_length > data.size() || state_length > data.size() - name_length) {
+            LOG(ERROR) << "Truncated handover metadata";
+            return false;
+        }
+        std::string name(data.substr(0, name_length));
+        data.remove_prefix(name_length);
+        metadata[name] = std::string(data.substr(0, state_length));
+        data.remove_prefix(state_length);
+    }
+
+    LOG(INFO) << "Received handover metadata for " << metadata.size() << " snapshots";
+
+    std::lock_guard<std::mutex> lock(lock_);
+    handover_metadata_ = std::move(metadata);
+    return true;
+}
+
 bool SnapshotHandlerManager::StartHandler(const std::string& misc_name) {
     std::lock_guard<std::mutex> lock(lock_);
     auto iter = FindHandler(&lock, misc_name);
@@ -141,6 +284,7 @@ void SnapshotHandlerManager::RunThread(std::shared_ptr<HandlerThread> handler) {
     }
 
     handler->snapuserd()->CloseFds();
+    read_worker_pool_->Forget(handler->misc_name());
     bool merge_completed = handler->snapuserd()->CheckMergeCompletionStatus();
     handler->snapuserd()->UnmapBufferRegion();
 
@@ -150,6 +294,7 @@ void SnapshotHandlerManager::RunThread(std::shared_ptr<HandlerThread> handler) {
     {
         std::lock_guard<std::mutex> lock(lock_);
         if (merge_completed) {
+            UpdateMergeBandwidth(&lock, handler);
             num_partitions_merge_complete_ += 1;
             active_merge_threads_ -= 1;
             WakeupMonitorMergeThread();
@@ -209,7 +354,7 @@ bool SnapshotHandlerManager::StartMerge(std::lock_guard<std::mutex>* proof_of_lo
         merge_monitor_ = std::thread(&SnapshotHandlerManager::MonitorMerge, this);
     }
 
-    merge_handlers_.push(handler);
+    merge_handlers_.push_back(handler);
     WakeupMonitorMergeThread();
     return true;
 }
@@ -240,16 +385,15 @@ void SnapshotHandlerManager::MonitorMerge() {
                     "ro.virtual_ab.num_merge_threads", kMaxMergeThreads);
             std::lock_guard<std::mutex> lock(lock_);
             while (active_merge_threads_ < num_merge_threads && merge_handlers_.size() > 0) {
-                auto handler = merge_handlers_.front();
-                merge_handlers_.pop();
-
-                if (!handler->snapuserd()) {
-                    LOG(INFO) << "MonitorMerge: skipping deleted handler: " << handler->misc_name();
+                auto handler = PickNextMerge(&lock);
+                if (!handler) {
                     continue;
                 }
 
                 LOG(INFO) << "Starting merge for partition: "
-                          << handler->snapuserd()->GetMiscName();
+                          << handler->snapuserd()->GetMiscName()
+                          << " remaining-ops: " << handler->merge_start_ops()
+                          << " disk: " << handler->merge_disk();
                 handler->snapuserd()->InitiateMerge();
                 active_merge_threads_ += 1;
             }
@@ -259,6 +403,90 @@ void SnapshotHandlerManager::MonitorMerge() {
     LOG(INFO) << "Exiting MonitorMerge: size: " << merge_handlers_.size();
 }
 
+std::shared_ptr<HandlerThread> SnapshotHandlerManager::PickNextMerge(
+        std::lock_guard<std::mutex>* proof_of_lock) {
+    CHECK(proof_of_lock);
+
+    for (auto iter = merge_handlers_.begin(); iter != merge_handlers_.end();) {
+        if ((*iter)->snapuserd()) {
+            iter++;
+            continue;
+        }
+        LOG(INFO) << "MonitorMerge: skipping deleted handler: " << (*iter)->misc_name();
+        iter = merge_handlers_.erase(iter);
+    }
+
+    auto best = merge_handlers_.end();
+    double best_time = -1;
+    std::string best_disk;
+    for (auto iter = merge_handlers_.begin(); iter != merge_handlers_.end(); iter++) {
+        auto disk = GetMergeDisk((*iter)->snapuserd()->GetBasePathMerge());
+        double time = EstimateMergeTime(proof_of_lock, *iter, disk);
+        if (time > best_time) {
+            best = iter;
+            best_time = time;
+            best_disk = std::move(disk);
+        }
+    }
+
+    if (best == merge_handlers_.end()) {
+        return nullptr;
+    }
+
+    auto handler = *best;
+    merge_handlers_.erase(best);
+    handler->SetMergeStarted(handler->snapuserd()->GetRemainingMergeOps(), best_disk);
+    return handler;
+}
+
+double SnapshotHandlerManager::EstimateMergeTime(std::lock_guard<std::mutex>* proof_of_lock,
+                                                 const std::shared_ptr<HandlerThread>& handler,
+                                                 const std::string& disk) {
+    CHECK(proof_of_lock);
+
+    double ops = handler->snapuserd()->GetRemainingMergeOps();
+    auto iter = merge_bandwidth_.find(disk);
+    if (iter != merge_bandwidth_.end()) {
+        return ops / iter->second;
+    }
+
+    // Nothing has been merged on this disk yet; assume it performs like the
+    // average of the disks we know about.
+    if (merge_bandwidth_.empty()) {
+        return ops;
+    }
+    double total = 0;
+    for (const auto& [_, bandwidth] : merge_bandwidth_) {
+        total += bandwidth;
+    }
+    return ops / (total / merge_bandwidth_.size());
+}
+
+void SnapshotHandlerManager::UpdateMergeBandwidth(std::lock_guard<std::mutex>* proof_of_lock,
+                                                  const std::shared_ptr<HandlerThread>& handler) {
+    CHECK(proof_of_lock);
+
+    if (handler->merge_disk().empty() || !handler->merge_start_ops()) {
+        return;
+    }
+
+    std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - handler->merge_start_time();
+    if (elapsed.count() <= 0) {
+        return;
+    }
+
+    double bandwidth = handler->merge_start_ops() / elapsed.count();
+    auto [iter, inserted] = merge_bandwidth_.emplace(handler->merge_disk(), bandwidth);
+    if (!inserted) {
+        iter->second = kMergeBandwidthWeight * bandwidth +
+                       (1 - kMergeBandwidthWeight) * iter->second;
+    }
+
+    LOG(INFO) << "Merge bandwidth for disk: " << handler->merge_disk() << " "
+              << iter->second << " ops/sec";
+}
+
 std::string SnapshotHandlerManager::GetMergeStatus(const std::string& misc_name) {
     std::lock_guard<std::mutex> lock(lock_);
     auto iter = FindHandler(&lock, misc_name);
@@ -301,6 +529,28 @@ double SnapshotHandlerManager::GetMergePercentage() {
     return percentage;
 }
 
+std::string SnapshotHandlerManager::GetWorkerStats(const std::string& misc_name) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto iter = FindHandler(&lock, misc_name);
+    if (iter == dm_users_.end() || (*iter)->ThreadTerminated() || !(*iter)->snapuserd()) {
+        LOG(ERROR) << "Could not find handler: " << misc_name;
+        return {};
+    }
+    return (*iter)->snapuserd()->GetWorkerUtilization() + " spare " +
+           std::to_string(read_worker_pool_->spare_workers_in_use()) + "/" +
+           std::to_string(read_worker_pool_->max_spare_workers());
+}
+
+std::string SnapshotHandlerManager::GetMergeStats(const std::string& misc_name) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto iter = FindHandler(&lock, misc_name);
+    if (iter == dm_users_.end() || (*iter)->ThreadTerminated() || !(*iter)->snapuserd()) {
+        LOG(ERROR) << "Could not find handler: " << misc_name;
+        return {};
+    }
+    return (*iter)->snapuserd()->GetMergeStats();
+}
+
 bool SnapshotHandlerManager::GetVerificationStatus() {
     std::lock_guard<std::mutex> lock(lock_);
 
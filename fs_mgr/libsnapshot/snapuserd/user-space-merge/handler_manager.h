@@ -14,14 +14,19 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <memory>
-#include <queue>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/unique_fd.h>
 #include <snapuserd/block_server.h>
+#include "merge_throttle.h"
+#include "worker_pool.h"
 
 namespace android {
 namespace snapshot {
@@ -40,11 +45,22 @@ class HandlerThread {
     bool ThreadTerminated() { return thread_terminated_; }
     void SetThreadTerminated() { thread_terminated_ = true; }
 
+    // Bookkeeping used by the merge scheduler to learn the merge bandwidth
+    // of the underlying disk.
+    void SetMergeStarted(uint64_t ops, const std::string& disk);
+    uint64_t merge_start_ops() const { return merge_start_ops_; }
+    const std::string& merge_disk() const { return merge_disk_; }
+    std::chrono::steady_clock::time_point merge_start_time() const { return merge_start_time_; }
+
   private:
     std::thread thread_;
     std::shared_ptr<SnapshotHandler> snapuserd_;
     std::string misc_name_;
     bool thread_terminated_ = false;
+
+    uint64_t merge_start_ops_ = 0;
+    std::string merge_disk_;
+    std::chrono::steady_clock::time_point merge_start_time_;
 };
 
 class ISnapshotHandlerManager {
@@ -87,6 +103,28 @@ class ISnapshotHandlerManager {
 
     // Disable partition verification
     virtual void DisableVerification() = 0;
+
+    // Configure merge throttling for existing and future handlers.
+    virtual void SetMergeThrottle(const MergeThrottleConfig& config) = 0;
+
+    // Save the block-access profile of every handler, to be prefetched on
+    // the next boot.
+    virtual bool SaveAccessProfiles() = 0;
+
+    // Serialize the parsed COW metadata of every handler, to be handed to
+    // the daemon which replaces this one after the SELinux transition.
+    virtual bool ExportMetadata(std::string* out) = 0;
+
+    // Use metadata from ExportMetadata() for handlers added from now on.
+    virtual bool SetHandoverMetadata(std::string_view data) = 0;
+
+    // Return the read worker count and load of a handler, and how much of
+    // the shared worker pool is in use. Returns empty on error.
+    virtual std::string GetWorkerStats(const std::string& misc_name) = 0;
+
+    // Return merge progress, rate, ETA and stall times of a handler. Returns
+    // empty on error.
+    virtual std::string GetMergeStats(const std::string& misc_name) = 0;
 };
 
 class SnapshotHandlerManager final : public ISnapshotHandlerManager {
@@ -108,6 +146,12 @@ class SnapshotHandlerManager final : public ISnapshotHandlerManager {
     double GetMergePercentage() override;
     bool GetVerificationStatus() override;
     void DisableVerification() override { perform_verification_ = false; }
+    void SetMergeThrottle(const MergeThrottleConfig& config) override;
+    bool SaveAccessProfiles() override;
+    bool ExportMetadata(std::string* out) override;
+    bool SetHandoverMetadata(std::string_view data) override;
+    std::string GetWorkerStats(const std::string& misc_name) override;
+    std::string GetMergeStats(const std::string& misc_name) override;
 
   private:
     bool StartHandler(const std::shared_ptr<HandlerThread>& handler);
@@ -116,6 +160,16 @@ class SnapshotHandlerManager final : public ISnapshotHandlerManager {
                     const std::shared_ptr<HandlerThread>& handler);
     void MonitorMerge();
     void WakeupMonitorMergeThread();
+
+    // Merge scheduling. Pending merges are ordered by their estimated time
+    // to completion (remaining ops / disk bandwidth), longest first, so
+    // that the largest partitions do not end up merging last and alone.
+    std::shared_ptr<HandlerThread> PickNextMerge(std::lock_guard<std::mutex>* proof_of_lock);
+    double EstimateMergeTime(std::lock_guard<std::mutex>* proof_of_lock,
+                             const std::shared_ptr<HandlerThread>& handler,
+                             const std::string& disk);
+    void UpdateMergeBandwidth(std::lock_guard<std::mutex>* proof_of_lock,
+                              const std::shared_ptr<HandlerThread>& handler);
     bool RemoveAndJoinHandler(const std::string& misc_name);
 
     // Find a HandlerThread within a lock.
@@ -130,9 +184,18 @@ class SnapshotHandlerManager final : public ISnapshotHandlerManager {
     int active_merge_threads_ = 0;
     std::thread merge_monitor_;
     int num_partitions_merge_complete_ = 0;
-    std::queue<std::shared_ptr<HandlerThread>> merge_handlers_;
+    HandlerList merge_handlers_;
+    // Observed merge bandwidth, in ops per second, keyed by disk name.
+    std::unordered_map<std::string, double> merge_bandwidth_;
     android::base::unique_fd monitor_merge_event_fd_;
-    bool perform_verification_ = true;
+    // Atomic since batched init creates handlers concurrently.
+    std::atomic<bool> perform_verification_ = true;
+    MergeThrottleConfig merge_throttle_config_;
+    // Handed-over metadata, keyed by misc_name. Entries are consumed by
+    // AddHandler().
+    std::unordered_map<std::string, std::string> handover_metadata_;
+    // Spare read workers shared by all handlers.
+    std::shared_ptr<ReadWorkerPool> read_worker_pool_;
 };
 
 }  // namespace snapshot
@@ -0,0 +1,116 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "merge_throttle.h"
+
+#include <algorithm>
+#include <thread>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+namespace android {
+namespace snapshot {
+
+MergeThrottle::MergeThrottle(const MergeThrottleConfig& config, QueueDepthFn queue_depth)
+    : config_(config), queue_depth_(std::move(queue_depth)) {
+    config_.min_batch_blocks = std::max<size_t>(config_.min_batch_blocks, 1);
+    config_.max_batch_blocks = std::max(config_.max_batch_blocks, config_.min_batch_blocks);
+    if (config_.high_pressure <= config_.low_pressure) {
+        config_.high_pressure = config_.low_pressure + 1;
+    }
+    last_sample_ = std::chrono::steady_clock::now();
+}
+
+std::optional<uint64_t> MergeThrottle::ParsePsiTotal(const std::string& contents) {
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    for (const auto& line : android::base::Split(contents, "\n")) {
+        if (!android::base::StartsWith(line, "some ")) {
+            continue;
+        }
+        for (const auto& field : android::base::Split(line, " ")) {
+            if (!android::base::StartsWith(field, "total=")) {
+                continue;
+            }
+            uint64_t total;
+            if (android::base::ParseUint(field.substr(6), &total)) {
+                return total;
+            }
+        }
+    }
+    return {};
+}
+
+void MergeThrottle::Sample() {
+    auto now = std::chrono::steady_clock::now();
+    auto wall_us = std::chrono::duration_cast<std::chrono::microseconds>(now - last_sample_);
+
+    double pressure_level = 0;
+    if (psi_available_) {
+        std::string contents;
+        std::optional<uint64_t> total;
+        if (android::base::ReadFileToString(config_.psi_path, &contents)) {
+            total = ParsePsiTotal(contents);
+        }
+        if (!total) {
+            LOG(INFO) << "Merge throttle: PSI not available at " << config_.psi_path
+                      << ", using dm-user queue depth only";
+            psi_available_ = false;
+        } else {
+            if (last_psi_total_ && wall_us.count() > 0 && *total >= *last_psi_total_) {
+                double pressure = (*total - *last_psi_total_) * 100.0 / wall_us.count();
+                pressure_level = (pressure - config_.low_pressure) /
+                                 (config_.high_pressure - config_.low_pressure);
+            }
+            last_psi_total_ = total;
+        }
+    }
+
+    double queue_level = 0;
+    if (queue_depth_ && config_.max_queue_depth) {
+        queue_level = static_cast<double>(queue_depth_()) / config_.max_queue_depth;
+    }
+
+    level_ = std::clamp(std::max(pressure_level, queue_level), 0.0, 1.0);
+    last_sample_ = now;
+}
+
+size_t MergeThrottle::GetBatchBlocks(size_t max_blocks) const {
+    if (!config_.enabled) {
+        return max_blocks;
+    }
+    const double span = config_.max_batch_blocks - config_.min_batch_blocks;
+    size_t blocks = config_.max_batch_blocks - static_cast<size_t>(span * level_);
+    return std::clamp<size_t>(blocks, 1, max_blocks);
+}
+
+void MergeThrottle::Pace() {
+    if (!config_.enabled) {
+        return;
+    }
+
+    Sample();
+    if (level_ <= 0) {
+        return;
+    }
+
+    auto delay = std::chrono::duration_cast<std::chrono::microseconds>(config_.max_delay * level_);
+    std::this_thread::sleep_for(delay);
+    throttled_time_ += delay;
+}
+
+}  // namespace snapshot
+}  // namespace android
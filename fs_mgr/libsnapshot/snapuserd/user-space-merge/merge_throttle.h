@@ -0,0 +1,95 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+
+namespace android {
+namespace snapshot {
+
+struct MergeThrottleConfig {
+    bool enabled = false;
+
+    // Source of I/O pressure stall information.
+    std::string psi_path = "/proc/pressure/io";
+
+    // Fraction of wall time (0-100%) during which some task was stalled on
+    // I/O. Above |high_pressure| merge runs at the minimum pace; below
+    // |low_pressure| it is not throttled at all.
+    double low_pressure = 5.0;
+    double high_pressure = 40.0;
+
+    // Number of outstanding dm-user requests at which merge is treated as
+    // fully throttled, regardless of PSI.
+    uint32_t max_queue_depth = 4;
+
+    // Bounds on the number of blocks merged between pacing points.
+    size_t min_batch_blocks = 16;
+    size_t max_batch_blocks = 256;
+
+    // Longest pause inserted between two merge batches.
+    std::chrono::milliseconds max_delay = std::chrono::milliseconds(50);
+};
+
+// Adjusts merge batch size and pacing based on how busy foreground I/O is.
+// Pressure is sampled from PSI and the in-flight dm-user request count every
+// time Pace() is called. Not thread-safe; each MergeWorker owns one.
+class MergeThrottle {
+  public:
+    using QueueDepthFn = std::function<uint32_t()>;
+
+    MergeThrottle(const MergeThrottleConfig& config, QueueDepthFn queue_depth);
+
+    // Number of blocks to merge before calling Pace() again, never more
+    // than |max_blocks|.
+    size_t GetBatchBlocks(size_t max_blocks) const;
+
+    // Re-sample pressure and sleep if foreground I/O is busy. Must be called
+    // between merge batches.
+    void Pace();
+
+    std::chrono::milliseconds throttled_time() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(throttled_time_);
+    }
+
+    // Current throttle level, 0 (none) to 1 (maximum).
+    double level() const { return level_; }
+
+    // Parse the "some" line of a PSI file; returns the cumulative stall time
+    // in microseconds.
+    static std::optional<uint64_t> ParsePsiTotal(const std::string& contents);
+
+  private:
+    void Sample();
+
+    MergeThrottleConfig config_;
+    QueueDepthFn queue_depth_;
+    double level_ = 0;
+
+    bool psi_available_ = true;
+    std::optional<uint64_t> last_psi_total_;
+    std::chrono::steady_clock::time_point last_sample_;
+
+    std::chrono::steady_clock::duration throttled_time_{};
+};
+
+}  // namespace snapshot
+}  // namespace android
@@ -110,7 +110,7 @@ bool MergeWorker::MergeReplaceZeroOps() {
     SNAP_LOG(INFO) << "MergeReplaceZeroOps started....";
 
     while (!cowop_iter_->AtEnd()) {
-        int num_ops = PAYLOAD_BUFFER_SZ / BLOCK_SZ;
+        int num_ops = throttle_->GetBatchBlocks(PAYLOAD_BUFFER_SZ / BLOCK_SZ);
         std::vector<const CowOperation*> replace_zero_vec;
         uint64_t source_offset;
 
@@ -158,6 +158,17 @@ bool MergeWorker::MergeReplaceZeroOps() {
             return false;
         }
 
+        // The blocks now live on the base device. Data in the COW is
+        // immutable, so a stale entry would still be correct, but there is no
+        // reason to keep it pinned in memory.
+        if (auto cache = snapuserd_->GetBlockCache()) {
+            for (const CowOperation* cow_op : replace_zero_vec) {
+                if (cow_op->type() == kCowReplaceOp) {
+                    cache->Invalidate(cow_op->new_block);
+                }
+            }
+        }
+
         num_ops_merged += replace_zero_vec.size();
 
         if (num_ops_merged >= total_ops_merged_per_commit) {
@@ -183,6 +194,9 @@ bool MergeWorker::MergeReplaceZeroOps() {
                     << "MergeReplaceZeroOps: MergeWorker threads terminated - shutting down merge";
             return false;
         }
+
+        throttle_->Pace();
+        snapuserd_->SetMergeThrottledTime(throttle_->throttled_time());
     }
 
     // Any left over ops not flushed yet.
@@ -220,10 +234,12 @@ bool MergeWorker::MergeOrderedOpsAsync() {
         SNAP_LOG(DEBUG) << "Waiting for merge begin...";
         // Wait for RA thread to notify that the merge window
         // is ready for merging.
+        auto wait_start = std::chrono::steady_clock::now();
         if (!snapuserd_->WaitForMergeBegin()) {
             SNAP_LOG(ERROR) << "Failed waiting for merge to begin";
             return false;
         }
+        snapuserd_->AddReadAheadWaitTime(std::chrono::steady_clock::now() - wait_start);
 
         snapuserd_->SetMergeInProgress(ra_block_index_);
 
@@ -381,6 +397,10 @@ bool MergeWorker::MergeOrderedOpsAsync() {
 
         // Get the next block
         ra_block_index_ += 1;
+
+        // The RA thread keeps reading the next window while we back off.
+        throttle_->Pace();
+        snapuserd_->SetMergeThrottledTime(throttle_->throttled_time());
     }
 
     return true;
@@ -402,10 +422,12 @@ bool MergeWorker::MergeOrderedOps() {
         SNAP_LOG(DEBUG) << "Waiting for merge begin...";
         // Wait for RA thread to notify that the merge window
         // is ready for merging.
+        auto wait_start = std::chrono::steady_clock::now();
         if (!snapuserd_->WaitForMergeBegin()) {
             snapuserd_->SetMergeFailed(ra_block_index_);
             return false;
         }
+        snapuserd_->AddReadAheadWaitTime(std::chrono::steady_clock::now() - wait_start);
 
         snapuserd_->SetMergeInProgress(ra_block_index_);
 
@@ -466,6 +488,10 @@ bool MergeWorker::MergeOrderedOps() {
 
         // Get the next block
         ra_block_index_ += 1;
+
+        // The RA thread keeps reading the next window while we back off.
+        throttle_->Pace();
+        snapuserd_->SetMergeThrottledTime(throttle_->throttled_time());
     }
 
     return true;
@@ -598,7 +624,24 @@ bool MergeWorker::Run() {
 
     InitializeIouring();
 
-    if (!Merge()) {
+    auto throttle_config = snapuserd_->GetMergeThrottleConfig();
+    std::weak_ptr<SnapshotHandler> handler = snapuserd_;
+    throttle_ = std::make_unique<MergeThrottle>(throttle_config, [handler]() -> uint32_t {
+        auto snapuserd = handler.lock();
+        return snapuserd ? snapuserd->GetActiveIoRequests() : 0;
+    });
+    if (throttle_config.enabled) {
+        SNAP_LOG(INFO) << "Merge throttling enabled";
+    }
+
+    snapuserd_->MergeStarted();
+    bool merged = Merge();
+    snapuserd_->SetMergeThrottledTime(throttle_->throttled_time());
+    if (throttle_config.enabled) {
+        SNAP_LOG(INFO) << "Merge was throttled for " << throttle_->throttled_time().count()
+                       << " ms";
+    }
+    if (!merged) {
         return false;
     }
 
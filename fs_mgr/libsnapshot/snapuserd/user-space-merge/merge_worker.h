@@ -13,6 +13,7 @@
 // limitations under the License.
 #pragma once
 
+#include "merge_throttle.h"
 #include "worker.h"
 
 #include <liburing.h>
@@ -42,6 +43,7 @@ class MergeWorker : public Worker {
     BufferSink bufsink_;
     std::unique_ptr<ICowOpIter> cowop_iter_;
     std::unique_ptr<struct io_uring> ring_;
+    std::unique_ptr<MergeThrottle> throttle_;
     size_t ra_block_index_ = 0;
     uint64_t blocks_merged_in_group_ = 0;
     bool merge_async_ = false;
@@ -0,0 +1,87 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "prefetch_worker.h"
+
+#include <pthread.h>
+
+#include <algorithm>
+
+#include "snapuserd_core.h"
+#include "utility.h"
+
+namespace android {
+namespace snapshot {
+
+PrefetchWorker::PrefetchWorker(const std::string& cow_device, const std::string& misc_name,
+                               const std::string& base_path_merge,
+                               std::shared_ptr<SnapshotHandler> snapuserd,
+                               std::vector<uint64_t> blocks)
+    : Worker(cow_device, misc_name, base_path_merge, snapuserd), blocks_(std::move(blocks)) {}
+
+bool PrefetchWorker::Run() {
+    pthread_setname_np(pthread_self(), "PrefetchWorker");
+
+    // Demand reads always take precedence over prefetching.
+    if (!SetThreadPriority(ANDROID_PRIORITY_BACKGROUND)) {
+        SNAP_PLOG(ERROR) << "Failed to set thread priority";
+    }
+
+    BlockCache* cache = snapuserd_->GetBlockCache();
+    if (!cache) {
+        return true;
+    }
+
+    auto& chunk_vec = snapuserd_->GetChunkVec();
+    std::vector<uint8_t> buffer(BLOCK_SZ);
+    size_t prefetched = 0;
+
+    for (const auto& new_block : blocks_) {
+        if (snapuserd_->IsIOTerminated()) {
+            break;
+        }
+        if (cache->Contains(new_block)) {
+            continue;
+        }
+
+        sector_t sector = new_block << CHUNK_SHIFT;
+        auto it = std::lower_bound(chunk_vec.begin(), chunk_vec.end(),
+                                   std::make_pair(sector, nullptr), SnapshotHandler::compare);
+        if (it == chunk_vec.end() || it->first != sector) {
+            continue;
+        }
+
+        // Only single-block replace ops are cached; see
+        // ReadWorker::ProcessCachedReplaceOp.
+        const CowOperation* cow_op = it->second;
+        if (cow_op->type() != kCowReplaceOp || CowOpCompressionSize(cow_op, BLOCK_SZ) != BLOCK_SZ) {
+            continue;
+        }
+
+        ssize_t rv = reader_->ReadData(cow_op, buffer.data(), BLOCK_SZ);
+        if (rv < 0 || static_cast<size_t>(rv) != BLOCK_SZ) {
+            SNAP_LOG(ERROR) << "Prefetch failed for block " << new_block << " rv: " << rv;
+            return false;
+        }
+        cache->Put(new_block, buffer.data());
+        prefetched++;
+    }
+
+    SNAP_LOG(INFO) << "Prefetched " << prefetched << " of " << blocks_.size()
+                   << " profiled blocks";
+    return true;
+}
+
+}  // namespace snapshot
+}  // namespace android
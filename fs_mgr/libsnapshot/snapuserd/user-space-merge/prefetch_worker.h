@@ -0,0 +1,40 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "worker.h"
+
+namespace android {
+namespace snapshot {
+
+// Decompresses the replace blocks of an access profile into the handler's
+// BlockCache ahead of demand, in profile order.
+class PrefetchWorker : public Worker {
+  public:
+    PrefetchWorker(const std::string& cow_device, const std::string& misc_name,
+                   const std::string& base_path_merge, std::shared_ptr<SnapshotHandler> snapuserd,
+                   std::vector<uint64_t> blocks);
+    bool Run();
+
+  private:
+    std::vector<uint64_t> blocks_;
+};
+
+}  // namespace snapshot
+}  // namespace android
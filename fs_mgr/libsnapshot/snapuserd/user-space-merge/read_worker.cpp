@@ -14,12 +14,14 @@
  * limitations under the License.
  */
 
+#include <android-base/scopeguard.h>
 #include <libsnapshot/cow_format.h>
 #include <pthread.h>
 
 #include "read_worker.h"
 #include "snapuserd_core.h"
 #include "utility.h"
+#include "xor_blocks.h"
 
 namespace android {
 namespace snapshot {
@@ -29,6 +31,7 @@ using namespace android::dm;
 using android::base::unique_fd;
 
 void ReadWorker::CloseFds() {
+    FinalizeIouring();
     block_server_ = {};
     backing_store_fd_ = {};
     backing_store_direct_fd_ = {};
@@ -48,15 +51,42 @@ ReadWorker::ReadWorker(const std::string& cow_device, const std::string& backing
 // Start the replace operation. This will read the
 // internal COW format and if the block is compressed,
 // it will be de-compressed.
-bool ReadWorker::ProcessReplaceOp(const CowOperation* cow_op, void* buffer, size_t buffer_size) {
-    if (!reader_->ReadData(cow_op, buffer, buffer_size)) {
+//
+// |dest| is usually the response buffer handed out by the block server. When
+// it is large enough to hold the whole decompressed op, the data is decoded
+// straight into it; only the first |to_write| bytes are sent back.
+bool ReadWorker::ProcessReplaceOp(const CowOperation* cow_op, std::span<uint8_t> dest,
+                                  size_t to_write, size_t ignore_bytes) {
+    ssize_t rv = reader_->ReadData(cow_op, dest, to_write, ignore_bytes);
+    if (rv < 0 || static_cast<size_t>(rv) < to_write) {
         SNAP_LOG(ERROR) << "ProcessReplaceOp failed for block " << cow_op->new_block
-                        << " buffer_size: " << buffer_size;
+                        << " buffer_size: " << dest.size() << " to_write: " << to_write
+                        << " return value: " << rv;
         return false;
     }
     return true;
 }
 
+// Serve a single-block replace op from the shared decompressed-block cache,
+// populating the cache on a miss. Multi-block ops bypass the cache.
+bool ReadWorker::ProcessCachedReplaceOp(const CowOperation* cow_op, uint8_t* buffer) {
+    BlockCache* cache = snapuserd_->GetBlockCache();
+    const bool cacheable = cache && CowOpCompressionSize(cow_op, BLOCK_SZ) == BLOCK_SZ;
+    if (cacheable) {
+        snapuserd_->RecordBlockAccess(cow_op->new_block);
+    }
+    if (cacheable && cache->Get(cow_op->new_block, buffer)) {
+        return true;
+    }
+    if (!ProcessReplaceOp(cow_op, {buffer, BLOCK_SZ}, BLOCK_SZ)) {
+        return false;
+    }
+    if (cacheable) {
+        cache->Put(cow_op->new_block, buffer);
+    }
+    return true;
+}
+
 bool ReadWorker::ReadFromSourceDevice(const CowOperation* cow_op, void* buffer) {
     uint64_t offset;
     if (!reader_->GetSourceOffset(cow_op, &offset)) {
@@ -117,10 +147,7 @@ bool ReadWorker::ProcessXorOp(const CowOperation* cow_op, void* buffer) {
         return false;
     }
 
-    auto xor_out = reinterpret_cast<uint8_t*>(buffer);
-    for (size_t i = 0; i < BLOCK_SZ; i++) {
-        xor_out[i] ^= xor_buffer_[i];
-    }
+    XorBlocks(buffer, xor_buffer_.data(), BLOCK_SZ);
     return true;
 }
 
@@ -147,6 +174,13 @@ bool ReadWorker::ProcessOrderedOp(const CowOperation* cow_op, void* buffer) {
             return true;
         }
         case MERGE_GROUP_STATE::GROUP_MERGE_PENDING: {
+            // Defer the backing-device read so that it is batched with the
+            // rest of this request. The I/O completion is notified once the
+            // batch has been reaped.
+            if (QueueSourceRead(cow_op, buffer)) {
+                return true;
+            }
+
             bool ret;
             if (cow_op->type() == kCowCopyOp) {
                 ret = ProcessCopyOp(cow_op, buffer);
@@ -184,13 +218,7 @@ bool ReadWorker::ProcessCowOp(const CowOperation* cow_op, void* buffer) {
 
     switch (cow_op->type()) {
         case kCowReplaceOp: {
-            size_t buffer_size = CowOpCompressionSize(cow_op, BLOCK_SZ);
-            uint8_t chunk[buffer_size];
-            if (!ProcessReplaceOp(cow_op, chunk, buffer_size)) {
-                return false;
-            }
-            std::memcpy(buffer, chunk, BLOCK_SZ);
-            return true;
+            return ProcessCachedReplaceOp(cow_op, reinterpret_cast<uint8_t*>(buffer));
         }
 
         case kCowZeroOp: {
@@ -252,9 +280,156 @@ bool ReadWorker::Init() {
         SNAP_PLOG(ERROR) << "Unable to open block server";
         return false;
     }
+
+    // Failure here is not fatal; reads just fall back to synchronous I/O.
+    InitializeIouring();
     return true;
 }
 
+bool ReadWorker::InitializeIouring() {
+    if (!snapuserd_->IsIouringSupported()) {
+        return false;
+    }
+
+    ring_ = std::make_unique<struct io_uring>();
+
+    int ret = io_uring_queue_init(queue_depth_, ring_.get(), 0);
+    if (ret) {
+        SNAP_LOG(ERROR) << "ReadWorker: io_uring_queue_init failed with ret: " << ret;
+        ring_ = nullptr;
+        return false;
+    }
+
+    pending_reads_.reserve(PAYLOAD_BUFFER_SZ / BLOCK_SZ);
+    read_async_ = true;
+
+    SNAP_LOG(INFO) << "ReadWorker: io_uring initialized with queue depth: " << queue_depth_;
+    return true;
+}
+
+void ReadWorker::FinalizeIouring() {
+    if (read_async_) {
+        io_uring_queue_exit(ring_.get());
+        ring_ = nullptr;
+        read_async_ = false;
+    }
+}
+
+bool ReadWorker::QueueSourceRead(const CowOperation* cow_op, void* buffer) {
+    if (!read_async_) {
+        return false;
+    }
+
+    uint64_t offset;
+    if (!reader_->GetSourceOffset(cow_op, &offset)) {
+        return false;
+    }
+    // O_DIRECT reads go through the aligned bounce buffer; keep them
+    // synchronous.
+    if (direct_read_ && IsBlockAligned(offset)) {
+        return false;
+    }
+
+    pending_reads_.push_back({.cow_op = cow_op,
+                              .buffer = reinterpret_cast<uint8_t*>(buffer),
+                              .offset = offset});
+    return true;
+}
+
+// Submit all deferred reads in batches of |queue_depth_| and reap them. Any
+// read which could not be completed through the ring is retried
+// synchronously, and io_uring is disabled for this worker if the ring itself
+// failed.
+bool ReadWorker::SubmitPendingReads() {
+    size_t index = 0;
+    while (read_async_ && index < pending_reads_.size()) {
+        const size_t batch = std::min(pending_reads_.size() - index, size_t(queue_depth_));
+        size_t queued = 0;
+        for (; queued < batch; queued++) {
+            PendingRead& read = pending_reads_[index + queued];
+            struct io_uring_sqe* sqe = io_uring_get_sqe(ring_.get());
+            if (!sqe) {
+                SNAP_PLOG(ERROR) << "io_uring_get_sqe failed for ReadWorker batch";
+                break;
+            }
+            io_uring_prep_read(sqe, backing_store_fd_.get(), read.buffer, BLOCK_SZ, read.offset);
+            io_uring_sqe_set_data(sqe, &read);
+        }
+
+        int ret = io_uring_submit(ring_.get());
+        if (ret != static_cast<int>(queued)) {
+            SNAP_LOG(ERROR) << "ReadWorker: io_uring_submit failed, submitted: " << ret
+                            << " expected: " << queued;
+            FinalizeIouring();
+            break;
+        }
+
+        for (size_t reaped = 0; reaped < queued; reaped++) {
+            struct io_uring_cqe* cqe;
+            ret = io_uring_wait_cqe(ring_.get(), &cqe);
+            if (ret) {
+                SNAP_LOG(ERROR) << "ReadWorker: io_uring_wait_cqe failed: " << strerror(-ret);
+                FinalizeIouring();
+                break;
+            }
+            auto read = reinterpret_cast<PendingRead*>(io_uring_cqe_get_data(cqe));
+            // Short reads are retried synchronously below.
+            read->done = (cqe->res == static_cast<int>(BLOCK_SZ));
+            io_uring_cqe_seen(ring_.get(), cqe);
+        }
+
+        index += queued;
+    }
+
+    bool status = true;
+    for (auto& read : pending_reads_) {
+        if (read.done) {
+            continue;
+        }
+        if (!android::base::ReadFullyAtOffset(backing_store_fd_, read.buffer, BLOCK_SZ,
+                                              read.offset)) {
+            SNAP_PLOG(ERROR) << "Read from backing store: " << backing_store_device_
+                             << " failed at block: " << read.offset / BLOCK_SZ
+                             << " offset: " << read.offset % BLOCK_SZ;
+            status = false;
+            break;
+        }
+        read.done = true;
+    }
+    return status;
+}
+
+// Wait for all deferred reads, apply any xor data on top of them, and drop
+// the I/O references taken by ProcessMergingBlock(). This must run before the
+// response buffers are sent, and on every error path, so that the merge
+// thread is never left waiting on a block.
+bool ReadWorker::CompletePendingReads() {
+    if (pending_reads_.empty()) {
+        return true;
+    }
+
+    bool status = SubmitPendingReads();
+    for (auto& read : pending_reads_) {
+        if (status && read.cow_op->type() == kCowXorOp) {
+            if (xor_buffer_.empty()) {
+                xor_buffer_.resize(BLOCK_SZ);
+            }
+            ssize_t size = reader_->ReadData(read.cow_op, xor_buffer_.data(), xor_buffer_.size());
+            if (size != BLOCK_SZ) {
+                SNAP_LOG(ERROR) << "ProcessXorOp failed for block " << read.cow_op->new_block
+                                << ", return value: " << size;
+                status = false;
+            } else {
+                XorBlocks(read.buffer, xor_buffer_.data(), BLOCK_SZ);
+            }
+        }
+        // I/O is complete - decrement the refcount irrespective of the status
+        snapuserd_->NotifyIOCompletion(read.cow_op->new_block);
+    }
+    pending_reads_.clear();
+    return status;
+}
+
 bool ReadWorker::Run() {
     SNAP_LOG(INFO) << "Processing snapshot I/O requests....";
 
@@ -266,9 +441,14 @@ bool ReadWorker::Run() {
 
     // Start serving IO
     while (true) {
+        auto wait_start = std::chrono::steady_clock::now();
         if (!block_server_->ProcessRequests()) {
             break;
         }
+        if (spare_ && snapuserd_->ShouldRetireSpareWorker(request_start_ - wait_start)) {
+            SNAP_LOG(DEBUG) << "Returning spare worker to the pool";
+            break;
+        }
     }
 
     CloseFds();
@@ -290,6 +470,11 @@ bool ReadWorker::ReadDataFromBaseDevice(sector_t sector, void* buffer, size_t re
     return true;
 }
 
+bool ReadWorker::IsMultiBlockReplaceOp(const CowOperation* cow_op) {
+    return cow_op && cow_op->type() == kCowReplaceOp &&
+           CowOpCompressionSize(cow_op, BLOCK_SZ) > BLOCK_SZ;
+}
+
 bool ReadWorker::GetCowOpBlockOffset(const CowOperation* cow_op, uint64_t io_block,
                                      off_t* block_offset) {
     // If this is a replace op, get the block offset of this I/O
@@ -324,7 +509,16 @@ bool ReadWorker::ReadAlignedSector(sector_t sector, size_t sz) {
                                        std::make_pair(sector, nullptr), SnapshotHandler::compare);
             const bool sector_not_found = (it == chunk_vec.end() || it->first != sector);
 
-            void* buffer = block_server_->GetResponseBuffer(BLOCK_SZ, size);
+            // A multi-block replace op that is fully covered by this request
+            // is decompressed straight into the response buffer in one go.
+            const CowOperation* found_op = sector_not_found ? nullptr : it->second;
+            const size_t whole_op_size =
+                    IsMultiBlockReplaceOp(found_op) ? CowOpCompressionSize(found_op, BLOCK_SZ) : 0;
+            const bool serve_whole_op = whole_op_size && read_size >= whole_op_size;
+
+            void* buffer = serve_whole_op
+                                   ? block_server_->GetResponseBuffer(whole_op_size, whole_op_size)
+                                   : block_server_->GetResponseBuffer(BLOCK_SZ, size);
             if (!buffer) {
                 SNAP_LOG(ERROR) << "AcquireBuffer failed in ReadAlignedSector";
                 return false;
@@ -389,7 +583,8 @@ bool ReadWorker::ReadAlignedSector(sector_t sector, size_t sz) {
                     } else {
                         // Get the data from the disk based on the compression
                         // size
-                        if (!ProcessReplaceOp(cow_op, decompressed_buffer_.get(),
+                        if (!ProcessReplaceOp(cow_op,
+                                              {decompressed_buffer_.get(), compression_size},
                                               compression_size)) {
                             return false;
                         }
@@ -413,6 +608,24 @@ bool ReadWorker::ReadAlignedSector(sector_t sector, size_t sz) {
                     }
                 }
                 ret = size;
+            } else if (serve_whole_op) {
+                // Skip past every block of the op at once.
+                if (!ProcessReplaceOp(found_op, {reinterpret_cast<uint8_t*>(buffer), whole_op_size},
+                                      whole_op_size)) {
+                    return false;
+                }
+                ret = whole_op_size;
+            } else if (whole_op_size) {
+                // Only part of the op is requested. Keep the decompressed op
+                // around so that the remaining blocks, which are not in
+                // chunk_vec, can be served without decoding it again.
+                if (!ProcessReplaceOp(found_op, {decompressed_buffer_.get(), whole_op_size},
+                                      whole_op_size)) {
+                    return false;
+                }
+                std::memcpy(buffer, decompressed_buffer_.get(), size);
+                prev_op = found_op;
+                ret = size;
             } else {
                 // We found the sector in mapping. Check the type of COW OP and
                 // process it.
@@ -467,22 +680,43 @@ int ReadWorker::ReadUnalignedSector(
     const CowOperation* cow_op = it->second;
     if (IsMappingPresent(cow_op, requested_offset, final_offset)) {
         size_t buffer_size = CowOpCompressionSize(cow_op, BLOCK_SZ);
-        uint8_t chunk[buffer_size];
-        // Read the entire decompressed buffer based on the block-size
-        if (!ProcessReplaceOp(cow_op, chunk, buffer_size)) {
-            return -1;
-        }
         size_t skip_offset = (requested_offset - final_offset);
         size_t write_sz = std::min(size, buffer_size - skip_offset);
 
-        auto buffer =
-                reinterpret_cast<uint8_t*>(block_server_->GetResponseBuffer(BLOCK_SZ, write_sz));
+        BlockCache* cache = snapuserd_->GetBlockCache();
+        if (cache && buffer_size == BLOCK_SZ) {
+            auto buffer = block_server_->GetResponseBuffer(BLOCK_SZ, write_sz);
+            if (!buffer) {
+                SNAP_LOG(ERROR) << "ReadUnalignedSector failed to allocate buffer";
+                return -1;
+            }
+            if (cache->Get(cow_op->new_block, buffer, skip_offset, write_sz)) {
+                snapuserd_->RecordBlockAccess(cow_op->new_block);
+            } else {
+                // Decode the whole block in place so that it can be cached,
+                // then shift the requested range to the front.
+                if (!ProcessCachedReplaceOp(cow_op, reinterpret_cast<uint8_t*>(buffer))) {
+                    return -1;
+                }
+                if (skip_offset) {
+                    memmove(buffer, reinterpret_cast<uint8_t*>(buffer) + skip_offset, write_sz);
+                }
+            }
+            return write_sz;
+        }
+
+        // Reserve room for the entire decompressed op so that it can be
+        // decoded in place; only |write_sz| bytes are sent back.
+        auto buffer = reinterpret_cast<uint8_t*>(
+                block_server_->GetResponseBuffer(buffer_size, write_sz));
         if (!buffer) {
             SNAP_LOG(ERROR) << "ReadUnalignedSector failed to allocate buffer";
             return -1;
         }
 
-        std::memcpy(buffer, (char*)chunk + skip_offset, write_sz);
+        if (!ProcessReplaceOp(cow_op, {buffer, buffer_size}, write_sz, skip_offset)) {
+            return -1;
+        }
         return write_sz;
     }
 
@@ -496,7 +730,8 @@ int ReadWorker::ReadUnalignedSector(
         return -1;
     }
 
-    if (!ProcessCowOp(it->second, buffer)) {
+    // The block is shifted below, so any deferred read must land first.
+    if (!ProcessCowOp(it->second, buffer) || !CompletePendingReads()) {
         SNAP_LOG(ERROR) << "ReadUnalignedSector: " << sector << " failed of size: " << size
                         << " Aligned sector: " << it->first;
         return -1;
@@ -648,15 +883,32 @@ bool ReadWorker::ReadUnalignedSector(sector_t sector, size_t size) {
 }
 
 bool ReadWorker::RequestSectors(uint64_t sector, uint64_t len) {
+    // Foreground I/O pressure is one of the inputs to merge throttling.
+    request_start_ = std::chrono::steady_clock::now();
+    snapuserd_->IoRequestStarted();
+    auto scope_guard = android::base::make_scope_guard([this]() {
+        snapuserd_->IoRequestCompleted(std::chrono::steady_clock::now() - request_start_);
+    });
+
+    bool ret;
     // Unaligned I/O request
     if (!IsBlockAligned(sector << SECTOR_SHIFT)) {
-        return ReadUnalignedSector(sector, len);
+        ret = ReadUnalignedSector(sector, len);
+    } else {
+        ret = ReadAlignedSector(sector, len);
     }
 
-    return ReadAlignedSector(sector, len);
+    // Release any reads left behind by a failed request.
+    if (!CompletePendingReads()) {
+        return false;
+    }
+    return ret;
 }
 
 bool ReadWorker::SendBufferedIo() {
+    if (!CompletePendingReads()) {
+        return false;
+    }
     return block_server_->SendBufferedIo();
 }
 
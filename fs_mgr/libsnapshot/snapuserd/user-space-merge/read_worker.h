@@ -14,9 +14,12 @@
 
 #pragma once
 
+#include <chrono>
+#include <span>
 #include <utility>
 #include <vector>
 
+#include <liburing.h>
 #include <snapuserd/block_server.h>
 #include "worker.h"
 
@@ -37,18 +40,40 @@ class ReadWorker : public Worker, public IBlockServer::Delegate {
 
     IBlockServer* block_server() const { return block_server_.get(); }
 
+    // Spare workers are borrowed from the handler's ReadWorkerPool and exit
+    // once the handler no longer needs them.
+    void SetSpare() { spare_ = true; }
+
   private:
+    // A backing-device read for a copy or xor op which has been deferred so
+    // that all reads of a request can be submitted as one io_uring batch.
+    struct PendingRead {
+        const CowOperation* cow_op;
+        uint8_t* buffer;
+        uint64_t offset;
+        bool done = false;
+    };
+
     bool SendBufferedIo();
 
+    bool InitializeIouring();
+    void FinalizeIouring();
+    bool QueueSourceRead(const CowOperation* cow_op, void* buffer);
+    bool SubmitPendingReads();
+    bool CompletePendingReads();
+
     bool ProcessCowOp(const CowOperation* cow_op, void* buffer);
     bool ProcessXorOp(const CowOperation* cow_op, void* buffer);
     bool ProcessOrderedOp(const CowOperation* cow_op, void* buffer);
     bool ProcessCopyOp(const CowOperation* cow_op, void* buffer);
-    bool ProcessReplaceOp(const CowOperation* cow_op, void* buffer, size_t buffer_size);
+    bool ProcessReplaceOp(const CowOperation* cow_op, std::span<uint8_t> dest, size_t to_write,
+                          size_t ignore_bytes = 0);
+    bool ProcessCachedReplaceOp(const CowOperation* cow_op, uint8_t* buffer);
     bool ProcessZeroOp(void* buffer);
 
     bool IsMappingPresent(const CowOperation* cow_op, loff_t requested_offset,
                           loff_t cow_op_offset);
+    bool IsMultiBlockReplaceOp(const CowOperation* cow_op);
     bool GetCowOpBlockOffset(const CowOperation* cow_op, uint64_t io_block, off_t* block_offset);
     bool ReadAlignedSector(sector_t sector, size_t sz);
     bool ReadUnalignedSector(sector_t sector, size_t size);
@@ -70,6 +95,16 @@ class ReadWorker : public Worker, public IBlockServer::Delegate {
     std::unique_ptr<IBlockServer> block_server_;
 
     std::vector<uint8_t> xor_buffer_;
+
+    bool spare_ = false;
+    std::chrono::steady_clock::time_point request_start_;
+
+    std::unique_ptr<struct io_uring> ring_;
+    bool read_async_ = false;
+    std::vector<PendingRead> pending_reads_;
+    // A single dm-user request is at most PAYLOAD_BUFFER_SZ, i.e. 256 blocks.
+    // The ring does not use IOSQE_ASYNC, so a moderately deep queue is fine.
+    int queue_depth_ = 32;
     std::unique_ptr<void, decltype(&::free)> aligned_buffer_;
     std::unique_ptr<uint8_t[]> decompressed_buffer_;
 };
@@ -16,6 +16,9 @@
 
 #include "snapuserd_core.h"
 
+#include <inttypes.h>
+#include <zlib.h>
+
 #include <android-base/chrono_utils.h>
 #include <android-base/properties.h>
 #include <android-base/scopeguard.h>
@@ -23,6 +26,7 @@
 #include <snapuserd/dm_user_block_server.h>
 
 #include "merge_worker.h"
+#include "prefetch_worker.h"
 #include "read_worker.h"
 #include "utility.h"
 
@@ -49,7 +53,14 @@ SnapshotHandler::SnapshotHandler(std::string misc_name, std::string cow_device,
 }
 
 bool SnapshotHandler::InitializeWorkers() {
-    for (int i = 0; i < num_worker_threads_; i++) {
+    // Workers only access the cache while serving I/O, so it must exist
+    // before any of them start.
+    block_cache_ = std::make_unique<BlockCache>(kBlockCacheSize, BLOCK_SZ);
+
+    // With a shared pool, one resident worker keeps the dm-user device
+    // served and the rest are borrowed while it is busy.
+    int num_resident_workers = read_worker_pool_ ? 1 : num_worker_threads_;
+    for (int i = 0; i < num_resident_workers; i++) {
         auto wt = std::make_unique<ReadWorker>(cow_device_, backing_store_device_, misc_name_,
                                                base_path_merge_, GetSharedPtr(),
                                                block_server_opener_, o_direct_);
@@ -60,6 +71,9 @@ bool SnapshotHandler::InitializeWorkers() {
 
         worker_threads_.push_back(std::move(wt));
     }
+    live_workers_ = worker_threads_.size();
+    peak_workers_ = worker_threads_.size();
+    io_start_time_ = std::chrono::steady_clock::now();
 
     merge_thread_ = std::make_unique<MergeWorker>(cow_device_, misc_name_, base_path_merge_,
                                                   GetSharedPtr());
@@ -69,9 +83,49 @@ bool SnapshotHandler::InitializeWorkers() {
 
     update_verify_ = std::make_unique<UpdateVerify>(misc_name_);
 
+    // Prefetching is best-effort; without a usable profile, blocks are only
+    // decompressed on demand.
+    std::vector<uint64_t> profile;
+    if (AccessProfile::Load(GetAccessProfilePath(), kPrefetchCacheSize / BLOCK_SZ, &profile) &&
+        !profile.empty()) {
+        block_cache_->Grow(profile.size() * BLOCK_SZ);
+        prefetch_thread_ = std::make_unique<PrefetchWorker>(
+                cow_device_, misc_name_, base_path_merge_, GetSharedPtr(), std::move(profile));
+        if (!prefetch_thread_->Init()) {
+            SNAP_LOG(ERROR) << "Prefetch thread initialization failed";
+            prefetch_thread_ = nullptr;
+        }
+    }
+
+    return true;
+}
+
+std::string SnapshotHandler::GetAccessProfilePath() {
+    return "/metadata/ota/snapuserd-profile-" + GetPartitionName(misc_name_);
+}
+
+bool SnapshotHandler::SaveAccessProfile() {
+    auto blocks = access_profile_.GetBlocks();
+    if (blocks.empty()) {
+        return true;
+    }
+    if (!AccessProfile::Save(GetAccessProfilePath(), blocks)) {
+        return false;
+    }
+    SNAP_LOG(INFO) << "Saved access profile with " << blocks.size() << " blocks";
     return true;
 }
 
+void SnapshotHandler::SetMergeThrottleConfig(const MergeThrottleConfig& config) {
+    std::lock_guard<std::mutex> lock(lock_);
+    merge_throttle_config_ = config;
+}
+
+MergeThrottleConfig SnapshotHandler::GetMergeThrottleConfig() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return merge_throttle_config_;
+}
+
 std::unique_ptr<CowReader> SnapshotHandler::CloneReaderForWorker() {
     return reader_->CloneCowReader();
 }
@@ -89,9 +143,26 @@ void SnapshotHandler::UpdateMergeCompletionPercentage() {
     }
 }
 
+uint64_t SnapshotHandler::GetRemainingMergeOps() {
+    struct CowHeader* ch = reinterpret_cast<struct CowHeader*>(mapped_addr_);
+    uint64_t total_ops = reader_->get_num_total_data_ops();
+    if (ch->num_merge_ops >= total_ops) {
+        return 0;
+    }
+    return total_ops - ch->num_merge_ops;
+}
+
 bool SnapshotHandler::CommitMerge(int num_merge_ops) {
+    auto commit_start = std::chrono::steady_clock::now();
+    auto record_commit = android::base::make_scope_guard([&]() {
+        merge_commit_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - commit_start)
+                                    .count();
+    });
+
     struct CowHeader* ch = reinterpret_cast<struct CowHeader*>(mapped_addr_);
     ch->num_merge_ops += num_merge_ops;
+    merge_ops_committed_ += num_merge_ops;
 
     if (scratch_space_) {
         if (ra_thread_) {
@@ -133,6 +204,39 @@ bool SnapshotHandler::CommitMerge(int num_merge_ops) {
     return true;
 }
 
+std::string SnapshotHandler::GetMergeStats() {
+    struct CowHeader* ch = reinterpret_cast<struct CowHeader*>(mapped_addr_);
+    uint64_t total_ops = reader_->get_num_total_data_ops();
+    uint64_t merged_ops = std::min<uint64_t>(ch->num_merge_ops, total_ops);
+    uint64_t remaining_ops = total_ops - merged_ops;
+    // Ordered (copy and xor) ops are always merged before replace and zero
+    // ops, so the split of what is left follows from the merged count.
+    uint64_t ordered_ops = reader_->get_num_ordered_ops_to_merge();
+    uint64_t ordered_left = ordered_ops > merged_ops ? ordered_ops - merged_ops : 0;
+    uint64_t replace_left = remaining_ops - std::min(ordered_left, remaining_ops);
+
+    // Rate and ETA only cover this boot; a resumed merge has no history.
+    double rate = 0;
+    if (merge_ops_committed_ && merge_start_ns_) {
+        auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch())
+                           .count();
+        if (now > merge_start_ns_) {
+            rate = merge_ops_committed_ * 1e9 / (now - merge_start_ns_);
+        }
+    }
+    int64_t eta = remaining_ops == 0 ? 0 : (rate > 0 ? remaining_ops / rate : -1);
+
+    auto ms = [](int64_t ns) -> int64_t { return ns / 1000000; };
+    return android::base::StringPrintf(
+            "merged=%" PRIu64 "/%" PRIu64 " ordered_left=%" PRIu64 " replace_left=%" PRIu64
+            " rate=%.1f eta_s=%" PRId64 " ra_wait_ms=%" PRId64 " commit_ms=%" PRId64
+            " throttled_ms=%" PRId64 " ra_hits=%" PRIu64 " ra_misses=%" PRIu64,
+            merged_ops, total_ops, ordered_left, replace_left, rate, eta,
+            ms(merge_ra_wait_ns_), ms(merge_commit_ns_), merge_throttled_ms_.load(),
+            ra_hits_.load(), ra_misses_.load());
+}
+
 void SnapshotHandler::PrepareReadAhead() {
     struct BufferState* ra_state = GetBufferState();
     // Check if the data has to be re-constructed from COW device
@@ -160,14 +264,25 @@ bool SnapshotHandler::CheckMergeCompletionStatus() {
 }
 
 bool SnapshotHandler::ReadMetadata() {
-    reader_ = std::make_unique<CowReader>(CowReader::ReaderFlags::USERSPACE_MERGE, true);
-    CowOptions options;
+    bool imported = false;
+    if (!handover_state_.empty()) {
+        imported = ImportMetadata();
+        if (!imported) {
+            SNAP_LOG(WARNING) << "Handed-over metadata is unusable, parsing COW";
+        }
+        handover_state_ = {};
+    }
 
-    SNAP_LOG(DEBUG) << "ReadMetadata: Parsing cow file";
+    if (!imported) {
+        reader_ = std::make_unique<CowReader>(CowReader::ReaderFlags::USERSPACE_MERGE, true,
+                                              /* mmap_ops = */ true);
 
-    if (!reader_->Parse(cow_fd_)) {
-        SNAP_LOG(ERROR) << "Failed to parse";
-        return false;
+        SNAP_LOG(DEBUG) << "ReadMetadata: Parsing cow file";
+
+        if (!reader_->Parse(cow_fd_)) {
+            SNAP_LOG(ERROR) << "Failed to parse";
+            return false;
+        }
     }
 
     const auto& header = reader_->GetHeader();
@@ -189,6 +304,15 @@ bool SnapshotHandler::ReadMetadata() {
 
     UpdateMergeCompletionPercentage();
 
+    if (imported) {
+        PrepareReadAhead();
+
+        SNAP_LOG(INFO) << "Merged-ops: " << header.num_merge_ops
+                       << " Total-data-ops: " << reader_->get_num_total_data_ops()
+                       << " Unmerged-ops: " << chunk_vec_.size() << " (handed over)";
+        return true;
+    }
+
     // Initialize the iterator for reading metadata
     std::unique_ptr<ICowOpIter> cowop_iter = reader_->GetOpIter(true);
 
@@ -249,6 +373,121 @@ bool SnapshotHandler::ReadMetadata() {
     return true;
 }
 
+static constexpr uint32_t kHandlerStateMagic = 0x48445355;  // "USDH"
+static constexpr uint32_t kHandlerStateVersion = 1;
+
+// Fixed-size part of ExportMetadata() output. It is followed by the
+// CowReader state, then |num_chunks| (sector, op position) pairs in
+// chunk_vec_ order, then |num_ra_blocks| (new_block, ra_index) pairs.
+struct HandlerMetadataState {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t reader_state_size;
+    uint64_t num_chunks;
+    uint64_t num_ra_blocks;
+    uint64_t num_merge_groups;
+    uint8_t ra_thread;
+    uint8_t unused[7];
+} __attribute__((packed));
+
+bool SnapshotHandler::ExportMetadata(std::string* out) {
+    std::string reader_state;
+    if (!reader_ || !reader_->ExportState(&reader_state)) {
+        SNAP_LOG(ERROR) << "Failed to export COW reader state";
+        return false;
+    }
+
+    HandlerMetadataState state = {};
+    state.magic = kHandlerStateMagic;
+    state.version = kHandlerStateVersion;
+    state.reader_state_size = reader_state.size();
+    state.num_chunks = chunk_vec_.size();
+    state.num_ra_blocks = block_to_ra_index_.size();
+    state.num_merge_groups = merge_blk_state_.size();
+    state.ra_thread = ra_thread_;
+
+    out->clear();
+    out->reserve(sizeof(state) + reader_state.size() + chunk_vec_.size() * 2 * sizeof(uint64_t) +
+                 block_to_ra_index_.size() * 2 * sizeof(uint64_t));
+    out->append(reinterpret_cast<const char*>(&state), sizeof(state));
+    out->append(reader_state);
+    for (const auto& [sector, op] : chunk_vec_) {
+        const uint64_t entry[2] = {sector, reader_->GetOpIndex(op)};
+        out->append(reinterpret_cast<const char*>(entry), sizeof(entry));
+    }
+    for (const auto& [new_block, ra_index] : block_to_ra_index_) {
+        const uint64_t entry[2] = {new_block, static_cast<uint64_t>(ra_index)};
+        out->append(reinterpret_cast<const char*>(entry), sizeof(entry));
+    }
+    return true;
+}
+
+bool SnapshotHandler::ImportMetadata() {
+    std::string_view data = handover_state_;
+
+    HandlerMetadataState state;
+    if (data.size() < sizeof(state)) {
+        SNAP_LOG(ERROR) << "Truncated handover state";
+        return false;
+    }
+    memcpy(&state, data.data(), sizeof(state));
+    data.remove_prefix(sizeof(state));
+    if (state.magic != kHandlerStateMagic || state.version != kHandlerStateVersion) {
+        SNAP_LOG(ERROR) << "Invalid handover state";
+        return false;
+    }
+    const uint64_t entries_size = (state.num_chunks + state.num_ra_blocks) * 2 * sizeof(uint64_t);
+    if (state.reader_state_size > data.size() ||
+        data.size() - state.reader_state_size != entries_size) {
+        SNAP_LOG(ERROR) << "Truncated handover state";
+        return false;
+    }
+
+    auto reader = std::make_unique<CowReader>(CowReader::ReaderFlags::USERSPACE_MERGE, true,
+                                              /* mmap_ops = */ true);
+    if (!reader->ImportState(cow_fd_, data.substr(0, state.reader_state_size))) {
+        return false;
+    }
+    data.remove_prefix(state.reader_state_size);
+
+    const uint64_t* entries = reinterpret_cast<const uint64_t*>(data.data());
+    std::vector<std::pair<sector_t, const CowOperation*>> chunk_vec;
+    chunk_vec.reserve(state.num_chunks);
+    for (uint64_t i = 0; i < state.num_chunks; i++, entries += 2) {
+        uint64_t entry[2];
+        memcpy(entry, entries, sizeof(entry));
+        const CowOperation* op = reader->GetOpAt(entry[1]);
+        if (!op) {
+            SNAP_LOG(ERROR) << "Invalid op position in handover state: " << entry[1];
+            return false;
+        }
+        chunk_vec.emplace_back(entry[0], op);
+    }
+
+    std::unordered_map<uint64_t, int> block_to_ra_index;
+    block_to_ra_index.reserve(state.num_ra_blocks);
+    for (uint64_t i = 0; i < state.num_ra_blocks; i++, entries += 2) {
+        uint64_t entry[2];
+        memcpy(entry, entries, sizeof(entry));
+        if (entry[1] >= state.num_merge_groups) {
+            SNAP_LOG(ERROR) << "Invalid read-ahead index in handover state: " << entry[1];
+            return false;
+        }
+        block_to_ra_index[entry[0]] = static_cast<int>(entry[1]);
+    }
+
+    reader_ = std::move(reader);
+    chunk_vec_ = std::move(chunk_vec);
+    block_to_ra_index_ = std::move(block_to_ra_index);
+    merge_blk_state_.clear();
+    for (uint64_t i = 0; i < state.num_merge_groups; i++) {
+        merge_blk_state_.push_back(
+                std::make_unique<MergeGroupState>(MERGE_GROUP_STATE::GROUP_MERGE_PENDING, 0));
+    }
+    ra_thread_ = state.ra_thread;
+    return true;
+}
+
 bool SnapshotHandler::MmapMetadata() {
     const auto& header = reader_->GetHeader();
 
@@ -319,17 +558,25 @@ bool SnapshotHandler::Start() {
     std::future<bool> merge_thread =
             std::async(std::launch::async, &MergeWorker::Run, merge_thread_.get());
 
+    std::future<bool> prefetch_thread;
+    if (prefetch_thread_) {
+        prefetch_thread =
+                std::async(std::launch::async, &PrefetchWorker::Run, prefetch_thread_.get());
+    }
+
     // Now that the worker threads are up, scan the partitions.
     // If the snapshot-merge is being resumed, there is no need to scan as the
     // current slot is already marked as boot complete.
     if (perform_verification_ && !resume_merge_) {
-        update_verify_->VerifyUpdatePartition();
+        update_verify_->VerifyUpdatePartition(GetVerifyCheckpointKey());
     }
 
     bool ret = true;
     for (auto& t : threads) {
         ret = t.get() && ret;
     }
+    JoinSpareWorkers();
+    SNAP_LOG(INFO) << "Read workers: " << GetWorkerUtilization();
 
     // Worker threads are terminated by this point - this can only happen:
     //
@@ -352,6 +599,10 @@ bool SnapshotHandler::Start() {
     SNAP_LOG(INFO) << "Snapshot I/O terminated. Waiting for merge thread....";
     bool merge_thread_status = merge_thread.get();
 
+    if (prefetch_thread.valid()) {
+        prefetch_thread.get();
+    }
+
     if (ra_thread_) {
         read_ahead_retval = ra_thread_status.get();
     }
@@ -420,6 +671,14 @@ struct BufferState* SnapshotHandler::GetBufferState() {
     return ra_state;
 }
 
+std::string SnapshotHandler::GetVerifyCheckpointKey() {
+    // Identify the snapshot by its COW header and data op count, so that a
+    // checkpoint left behind by a different update is not resumed.
+    const auto& header = reader_->GetHeader();
+    uint32_t crc = crc32(0, reinterpret_cast<const Bytef*>(&header), header.prefix.header_size);
+    return android::base::StringPrintf("%08x-%" PRIu64, crc, reader_->get_num_total_data_ops());
+}
+
 bool SnapshotHandler::IsIouringSupported() {
     if (!KernelSupportsIoUring()) {
         return false;
@@ -440,9 +699,98 @@ bool SnapshotHandler::CheckPartitionVerification() {
     return update_verify_->CheckPartitionVerification();
 }
 
+void SnapshotHandler::SetReadWorkerPool(std::shared_ptr<ReadWorkerPool> pool) {
+    // A handler limited to a single worker, e.g. while an OTA is being
+    // installed, does not borrow any either.
+    if (num_worker_threads_ > 1) {
+        read_worker_pool_ = std::move(pool);
+    }
+}
+
+void SnapshotHandler::IoRequestStarted() {
+    uint32_t active = ++active_io_requests_;
+    // Keep a worker waiting on dm-user whenever possible, so that the next
+    // request does not queue behind the ones in flight.
+    if (read_worker_pool_ && active >= live_workers_) {
+        AddSpareWorker();
+    }
+}
+
+void SnapshotHandler::IoRequestCompleted(std::chrono::steady_clock::duration busy_time) {
+    active_io_requests_--;
+    io_requests_served_++;
+    io_busy_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(busy_time).count();
+}
+
+void SnapshotHandler::AddSpareWorker() {
+    std::lock_guard<std::mutex> lock(spare_workers_lock_);
+    if (spare_workers_closed_ || !read_worker_pool_->Acquire(misc_name_)) {
+        return;
+    }
+
+    // Reap spare workers which have already gone back to the pool.
+    std::erase_if(spare_workers_, [](auto& entry) {
+        return entry.second.wait_for(0s) == std::future_status::ready;
+    });
+
+    auto worker = std::make_unique<ReadWorker>(cow_device_, backing_store_device_, misc_name_,
+                                               base_path_merge_, GetSharedPtr(),
+                                               block_server_opener_, o_direct_);
+    worker->SetSpare();
+
+    uint32_t live = ++live_workers_;
+    uint32_t peak = peak_workers_;
+    while (live > peak && !peak_workers_.compare_exchange_weak(peak, live)) {
+    }
+
+    // Initializing opens the COW, the source device and a new dm-user
+    // connection, so do it on the new thread rather than delaying the
+    // request which triggered it.
+    auto future = std::async(std::launch::async, [this, worker = worker.get()]() -> bool {
+        bool ret = worker->Init();
+        if (ret) {
+            ret = worker->Run();
+        } else {
+            SNAP_LOG(ERROR) << "Spare worker initialization failed";
+        }
+        live_workers_--;
+        read_worker_pool_->Release(misc_name_);
+        return ret;
+    });
+    spare_workers_.emplace_back(std::move(worker), std::move(future));
+}
+
+void SnapshotHandler::JoinSpareWorkers() {
+    std::vector<std::pair<std::unique_ptr<ReadWorker>, std::future<bool>>> spare_workers;
+    {
+        std::lock_guard<std::mutex> lock(spare_workers_lock_);
+        spare_workers_closed_ = true;
+        spare_workers = std::move(spare_workers_);
+    }
+    for (auto& [worker, future] : spare_workers) {
+        future.get();
+    }
+}
+
+bool SnapshotHandler::ShouldRetireSpareWorker(std::chrono::steady_clock::duration idle_time) {
+    return idle_time >= kSpareWorkerIdleTimeout || read_worker_pool_->OverShare(misc_name_);
+}
+
+std::string SnapshotHandler::GetWorkerUtilization() {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - io_start_time_);
+    // Average number of workers busy serving requests.
+    double load = elapsed.count() > 0 ? static_cast<double>(io_busy_ns_) / elapsed.count() : 0;
+    return android::base::StringPrintf("workers %u (peak %u) requests %" PRIu64 " load %.2f",
+                                       live_workers_.load(), peak_workers_.load(),
+                                       io_requests_served_.load(), load);
+}
+
 void SnapshotHandler::FreeResources() {
     worker_threads_.clear();
+    spare_workers_.clear();
     read_ahead_thread_ = nullptr;
+    prefetch_thread_ = nullptr;
     merge_thread_ = nullptr;
 }
 
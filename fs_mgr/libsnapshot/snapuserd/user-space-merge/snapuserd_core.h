@@ -22,6 +22,8 @@
 #include <sys/time.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstring>
 #include <future>
@@ -48,8 +50,12 @@
 #include <snapuserd/snapuserd_kernel.h>
 #include <storage_literals/storage_literals.h>
 #include <system/thread_defs.h>
+#include "access_profile.h"
+#include "block_cache.h"
+#include "merge_throttle.h"
 #include "snapuserd_readahead.h"
 #include "snapuserd_verify.h"
+#include "worker_pool.h"
 
 namespace android {
 namespace snapshot {
@@ -63,6 +69,18 @@ static_assert(PAYLOAD_BUFFER_SZ >= BLOCK_SZ);
 
 static constexpr int kNumWorkerThreads = 4;
 
+// A spare read worker borrowed from the ReadWorkerPool returns to the pool
+// once it has waited this long for a request.
+static constexpr std::chrono::seconds kSpareWorkerIdleTimeout = 2s;
+
+// Size of the decompressed-block cache shared by the worker threads of a
+// handler. Each partition gets its own cache.
+static constexpr size_t kBlockCacheSize = 2_MiB;
+
+// When a boot-time access profile is available, the cache is grown to hold
+// up to this much prefetched data. Profiles record at most as many blocks.
+static constexpr size_t kPrefetchCacheSize = 32_MiB;
+
 #define SNAP_LOG(level) LOG(level) << misc_name_ << ": "
 #define SNAP_PLOG(level) PLOG(level) << misc_name_ << ": "
 
@@ -77,6 +95,7 @@ enum class MERGE_IO_TRANSITION {
 };
 
 class MergeWorker;
+class PrefetchWorker;
 class ReadWorker;
 
 enum class MERGE_GROUP_STATE {
@@ -174,6 +193,9 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
     bool MergeInitiated() { return merge_initiated_; }
     bool MergeMonitored() { return merge_monitored_; }
     double GetMergePercentage() { return merge_completion_percentage_; }
+    // Number of COW data ops which are yet to be merged.
+    uint64_t GetRemainingMergeOps();
+    const std::string& GetBasePathMerge() { return base_path_merge_; }
 
     // Merge Block State Transitions
     void SetMergeCompleted(size_t block_index);
@@ -186,12 +208,78 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
     bool IsIouringSupported();
     bool CheckPartitionVerification();
 
+    // Decompressed replace-op blocks, shared by all ReadWorker threads. May
+    // be null if the handler has not been initialized.
+    BlockCache* GetBlockCache() { return block_cache_.get(); }
+
+    // Access profiles. Worker threads record the replace blocks they serve;
+    // a profile saved from one boot is prefetched into the BlockCache on
+    // the next.
+    void RecordBlockAccess(uint64_t new_block) { access_profile_.Record(new_block); }
+    bool SaveAccessProfile();
+    std::string GetAccessProfilePath();
+
+    // Merge throttling. The config is picked up when the merge thread starts.
+    void SetMergeThrottleConfig(const MergeThrottleConfig& config);
+    MergeThrottleConfig GetMergeThrottleConfig();
+    void SetMergeThrottledTime(std::chrono::milliseconds time) {
+        merge_throttled_ms_ = time.count();
+    }
+    std::chrono::milliseconds GetMergeThrottledTime() {
+        return std::chrono::milliseconds(merge_throttled_ms_);
+    }
+
+    // Merge instrumentation. The merge thread reports when it starts and
+    // how long it waits for read-ahead; commits and read-ahead lookups are
+    // counted by the handler itself.
+    void MergeStarted() {
+        merge_start_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now().time_since_epoch())
+                                  .count();
+    }
+    void AddReadAheadWaitTime(std::chrono::steady_clock::duration time) {
+        merge_ra_wait_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+    }
+    // One line of key=value pairs: ops merged and left (ordered and
+    // replace/zero), merge rate and ETA, time spent waiting on read-ahead,
+    // COW commits and throttling, and read-ahead buffer hits.
+    std::string GetMergeStats();
+
+    // Number of dm-user requests currently being served by worker threads.
+    // When every worker is busy, a spare worker is borrowed from the pool.
+    void IoRequestStarted();
+    void IoRequestCompleted(std::chrono::steady_clock::duration busy_time);
+    uint32_t GetActiveIoRequests() const { return active_io_requests_; }
+
+    // Share read workers with other handlers. Must be called before
+    // InitializeWorkers(). With a pool, a single resident worker is started
+    // and the rest are borrowed on demand; without one, all
+    // |num_worker_threads_| workers are resident.
+    void SetReadWorkerPool(std::shared_ptr<ReadWorkerPool> pool);
+    // Whether a spare worker which waited |idle_time| for its last request
+    // should exit and return to the pool.
+    bool ShouldRetireSpareWorker(std::chrono::steady_clock::duration idle_time);
+    // One-line summary of worker count, request count and load.
+    std::string GetWorkerUtilization();
+
+    // Metadata handover across the SELinux transition. The first-stage
+    // daemon exports the parsed op index and read-ahead layout; the daemon
+    // replacing it sets that state before InitCowDevice() so that the COW
+    // does not have to be parsed again. If the state cannot be used, the
+    // COW is parsed as usual.
+    bool ExportMetadata(std::string* out);
+    void SetHandoverMetadata(std::string state) { handover_state_ = std::move(state); }
+
   private:
     bool ReadMetadata();
+    bool ImportMetadata();
+    void AddSpareWorker();
+    void JoinSpareWorkers();
     sector_t ChunkToSector(chunk_t chunk) { return chunk << CHUNK_SHIFT; }
     chunk_t SectorToChunk(sector_t sector) { return sector >> CHUNK_SHIFT; }
     bool IsBlockAligned(uint64_t read_size) { return ((read_size & (BLOCK_SZ - 1)) == 0); }
     struct BufferState* GetBufferState();
+    std::string GetVerifyCheckpointKey();
     void UpdateMergeCompletionPercentage();
 
     // COW device
@@ -250,6 +338,37 @@ class SnapshotHandler : public std::enable_shared_from_this<SnapshotHandler> {
 
     std::unique_ptr<UpdateVerify> update_verify_;
     std::shared_ptr<IBlockServerOpener> block_server_opener_;
+    std::unique_ptr<BlockCache> block_cache_;
+    AccessProfile access_profile_{kPrefetchCacheSize / BLOCK_SZ};
+    std::unique_ptr<PrefetchWorker> prefetch_thread_;
+
+    MergeThrottleConfig merge_throttle_config_;
+    std::atomic<int64_t> merge_throttled_ms_ = 0;
+    std::atomic<uint32_t> active_io_requests_ = 0;
+
+    // Merge instrumentation, see GetMergeStats(). Times are in nanoseconds;
+    // the start time is on the steady clock and zero until merging starts.
+    std::atomic<int64_t> merge_start_ns_ = 0;
+    std::atomic<uint64_t> merge_ops_committed_ = 0;
+    std::atomic<int64_t> merge_commit_ns_ = 0;
+    std::atomic<int64_t> merge_ra_wait_ns_ = 0;
+    std::atomic<uint64_t> ra_hits_ = 0;
+    std::atomic<uint64_t> ra_misses_ = 0;
+
+    // Shared read worker budget; null if all workers are resident.
+    std::shared_ptr<ReadWorkerPool> read_worker_pool_;
+    std::mutex spare_workers_lock_;
+    std::vector<std::pair<std::unique_ptr<ReadWorker>, std::future<bool>>> spare_workers_;
+    // Set once the resident workers have exited; no spares are added after.
+    bool spare_workers_closed_ = false;
+    std::atomic<uint32_t> live_workers_ = 0;
+    std::atomic<uint32_t> peak_workers_ = 0;
+    std::atomic<uint64_t> io_requests_served_ = 0;
+    std::atomic<int64_t> io_busy_ns_ = 0;
+    std::chrono::steady_clock::time_point io_start_time_;
+
+    // Exported by the first-stage daemon; consumed by ReadMetadata().
+    std::string handover_state_;
 };
 
 std::ostream& operator<<(std::ostream& os, MERGE_IO_TRANSITION value);
@@ -20,6 +20,7 @@
 
 #include "snapuserd_core.h"
 #include "utility.h"
+#include "xor_blocks.h"
 
 namespace android {
 namespace snapshot {
@@ -469,9 +470,7 @@ void ReadAhead::ProcessXorData(size_t& block_xor_index, size_t& xor_index,
                 uint8_t* xor_data = reinterpret_cast<uint8_t*>((char*)bufsink_.GetPayloadBufPtr() +
                                                                xor_buf_offset);
 
-                for (size_t byte_offset = 0; byte_offset < BLOCK_SZ; byte_offset++) {
-                    buffer[byte_offset] ^= xor_data[byte_offset];
-                }
+                XorBlocks(buffer, xor_data, BLOCK_SZ);
 
                 // Move to next XOR op
                 xor_index += 1;
@@ -613,9 +612,7 @@ bool ReadAhead::ReadAheadSyncIO() {
                 uint8_t* xor_data = reinterpret_cast<uint8_t*>(bufsink.GetPayloadBufPtr());
 
                 // Retrieve the original data
-                for (size_t byte_offset = 0; byte_offset < BLOCK_SZ; byte_offset++) {
-                    read_buffer[byte_offset] ^= xor_data[byte_offset];
-                }
+                XorBlocks(read_buffer, xor_data, BLOCK_SZ);
 
                 // Move to next XOR op
                 xor_index += 1;
@@ -17,16 +17,20 @@
 #include <arpa/inet.h>
 #include <cutils/sockets.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include <android-base/cmsg.h>
+#include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/scopeguard.h>
 #include <android-base/strings.h>
@@ -139,6 +143,34 @@ bool UserSnapshotServer::Receivemsg(android::base::borrowed_fd fd, const std::st
 
         auto retval = "success," + std::to_string(num_sectors);
         return Sendmsg(fd, retval);
+    } else if (cmd == "init_batch") {
+        // Message format:
+        // init_batch,<count>,<misc_name>,<cow_device_path>,<backing_device>,<base_path_merge>,...
+        //
+        // Same as "init" for each entry, but the COWs are read concurrently.
+        // Replies with the number of sectors of each handler, in order; zero
+        // means that handler could not be created.
+        size_t count = 0;
+        if (out.size() < 2 || !android::base::ParseUint(out[1], &count) ||
+            out.size() != 2 + count * 4) {
+            LOG(ERROR) << "Malformed init_batch message, " << out.size() << " parts";
+            return Sendmsg(fd, "fail");
+        }
+
+        std::vector<std::future<uint64_t>> results;
+        for (size_t i = 0; i < count; i++) {
+            const auto* entry = &out[2 + i * 4];
+            results.emplace_back(std::async(std::launch::async, [this, entry]() -> uint64_t {
+                auto handler = AddHandler(entry[0], entry[1], entry[2], entry[3]);
+                return handler ? handler->snapuserd()->GetNumSectors() : 0;
+            }));
+        }
+
+        std::string retval = "success";
+        for (auto& result : results) {
+            retval += "," + std::to_string(result.get());
+        }
+        return Sendmsg(fd, retval);
     } else if (cmd == "start") {
         // Message format:
         // start,<misc_name>
@@ -195,6 +227,12 @@ bool UserSnapshotServer::Receivemsg(android::base::borrowed_fd fd, const std::st
         if (out[1] == "second_stage_socket_handoff") {
             return Sendmsg(fd, "success");
         }
+        if (out[1] == "init_batch") {
+            return Sendmsg(fd, "success");
+        }
+        if (out[1] == "metadata_handover") {
+            return Sendmsg(fd, "success");
+        }
         return Sendmsg(fd, "fail");
     } else if (cmd == "initiate_merge") {
         if (out.size() != 2) {
@@ -223,6 +261,66 @@ bool UserSnapshotServer::Receivemsg(android::base::borrowed_fd fd, const std::st
             return Sendmsg(fd, "snapshot-merge-failed");
         }
         return Sendmsg(fd, status);
+    } else if (cmd == "worker_stats") {
+        // Message format:
+        // worker_stats,<misc_name>
+        //
+        // Reply with the handler's read worker count, requests served and
+        // load, and the use of the shared spare worker pool.
+        if (out.size() != 2) {
+            LOG(ERROR) << "Malformed worker_stats message, " << out.size() << " parts";
+            return Sendmsg(fd, "fail");
+        }
+        auto stats = handlers_->GetWorkerStats(out[1]);
+        if (stats.empty()) {
+            return Sendmsg(fd, "fail");
+        }
+        return Sendmsg(fd, stats);
+    } else if (cmd == "merge_stats") {
+        // Message format:
+        // merge_stats,<misc_name>
+        //
+        // Reply with the handler's merge progress, rate and ETA, and where
+        // the merge thread spent its time waiting.
+        if (out.size() != 2) {
+            LOG(ERROR) << "Malformed merge_stats message, " << out.size() << " parts";
+            return Sendmsg(fd, "fail");
+        }
+        auto stats = handlers_->GetMergeStats(out[1]);
+        if (stats.empty()) {
+            return Sendmsg(fd, "fail");
+        }
+        return Sendmsg(fd, stats);
+    } else if (cmd == "merge_throttle") {
+        // Message format:
+        // merge_throttle,<0|1>
+        //
+        // Enable or disable I/O pressure based merge throttling. Takes effect
+        // for merges which have not started yet.
+        if (out.size() != 2 || (out[1] != "0" && out[1] != "1")) {
+            LOG(ERROR) << "Malformed merge_throttle message, " << out.size() << " parts";
+            return Sendmsg(fd, "fail");
+        }
+        MergeThrottleConfig config;
+        config.enabled = (out[1] == "1");
+        SetMergeThrottle(config);
+        return Sendmsg(fd, "success");
+    } else if (cmd == "save_profile") {
+        // Message format: save_profile
+        //
+        // Save the blocks read by each handler so far, in access order, so
+        // that they can be prefetched on the next boot.
+        if (!handlers_->SaveAccessProfiles()) {
+            return Sendmsg(fd, "fail");
+        }
+        return Sendmsg(fd, "success");
+    } else if (cmd == "export_metadata") {
+        // Message format: export_metadata
+        //
+        // Reply with "success" and a memfd holding the parsed COW metadata
+        // of every handler, so that the daemon started after the SELinux
+        // transition does not need to parse the COWs again.
+        return SendMetadata(fd);
     } else if (cmd == "update-verify") {
         if (!handlers_->GetVerificationStatus()) {
             return Sendmsg(fd, "fail");
@@ -235,6 +333,51 @@ bool UserSnapshotServer::Receivemsg(android::base::borrowed_fd fd, const std::st
     }
 }
 
+bool UserSnapshotServer::SendMetadata(android::base::borrowed_fd fd) {
+    std::string metadata;
+    if (!handlers_->ExportMetadata(&metadata)) {
+        return Sendmsg(fd, "fail");
+    }
+
+    unique_fd memfd(memfd_create("snapuserd_metadata", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (memfd < 0) {
+        PLOG(ERROR) << "memfd_create failed";
+        return Sendmsg(fd, "fail");
+    }
+    if (!android::base::WriteFully(memfd, metadata.data(), metadata.size())) {
+        PLOG(ERROR) << "Failed to write handover metadata";
+        return Sendmsg(fd, "fail");
+    }
+    // The receiver shares the file offset.
+    if (lseek(memfd.get(), 0, SEEK_SET) < 0) {
+        PLOG(ERROR) << "lseek failed on handover metadata";
+        return Sendmsg(fd, "fail");
+    }
+    // The receiver only reads the metadata; make sure nobody can change it.
+    if (fcntl(memfd.get(), F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW |
+                                                F_SEAL_WRITE) < 0) {
+        PLOG(ERROR) << "Failed to seal handover metadata";
+        return Sendmsg(fd, "fail");
+    }
+
+    static constexpr char kSuccess[] = "success";
+    if (android::base::SendFileDescriptors(fd, kSuccess, strlen(kSuccess), memfd.get()) < 0) {
+        PLOG(ERROR) << "Failed to send handover metadata";
+        return false;
+    }
+    LOG(INFO) << "Exported " << metadata.size() << " bytes of handover metadata";
+    return true;
+}
+
+bool UserSnapshotServer::SetHandoverMetadata(android::base::borrowed_fd fd) {
+    std::string metadata;
+    if (!android::base::ReadFdToString(fd, &metadata)) {
+        PLOG(ERROR) << "Failed to read handover metadata";
+        return false;
+    }
+    return handlers_->SetHandoverMetadata(metadata);
+}
+
 bool UserSnapshotServer::Start(const std::string& socketname) {
     bool start_listening = true;
 
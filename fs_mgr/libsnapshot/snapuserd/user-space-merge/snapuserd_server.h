@@ -32,13 +32,14 @@
 
 #include <android-base/unique_fd.h>
 #include <snapuserd/block_server.h>
+#include <snapuserd/snapuserd_client.h>
 #include "handler_manager.h"
 #include "snapuserd_core.h"
 
 namespace android {
 namespace snapshot {
 
-static constexpr uint32_t kMaxPacketSize = 512;
+static constexpr uint32_t kMaxPacketSize = MAX_REQUEST_SIZE;
 
 static constexpr char kBootSnapshotsWithoutSlotSwitch[] =
         "/metadata/ota/snapshot-boot-without-slot-switch";
@@ -63,6 +64,7 @@ class UserSnapshotServer {
     bool Recv(android::base::borrowed_fd fd, std::string* data);
     bool Sendmsg(android::base::borrowed_fd fd, const std::string& msg);
     bool Receivemsg(android::base::borrowed_fd fd, const std::string& str);
+    bool SendMetadata(android::base::borrowed_fd fd);
 
     void ShutdownThreads();
     std::string GetDaemonStatus();
@@ -90,12 +92,19 @@ class UserSnapshotServer {
                                               bool o_direct = false);
     bool StartHandler(const std::string& misc_name);
 
+    // Use the metadata in |fd|, received from the first-stage daemon, when
+    // adding handlers.
+    bool SetHandoverMetadata(android::base::borrowed_fd fd);
+
     void SetTerminating() { terminating_ = true; }
     void ReceivedSocketSignal() { received_socket_signal_ = true; }
     void SetServerRunning() { is_server_running_ = true; }
     bool IsServerRunning() { return is_server_running_; }
     void SetIouringEnabled() { io_uring_enabled_ = true; }
     bool IsIouringEnabled() { return io_uring_enabled_; }
+    void SetMergeThrottle(const MergeThrottleConfig& config) {
+        handlers_->SetMergeThrottle(config);
+    }
 };
 
 }  // namespace snapshot
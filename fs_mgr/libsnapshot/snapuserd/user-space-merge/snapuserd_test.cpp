@@ -38,14 +38,20 @@
 #include <libsnapshot/cow_writer.h>
 #include <snapuserd/dm_user_block_server.h>
 #include <storage_literals/storage_literals.h>
+#include "access_profile.h"
+#include "block_cache.h"
 #include "handler_manager.h"
+#include "merge_throttle.h"
 #include "merge_worker.h"
+#include "prefetch_worker.h"
 #include "read_worker.h"
 #include "snapuserd_core.h"
 #include "testing/dm_user_harness.h"
 #include "testing/host_harness.h"
 #include "testing/temp_device.h"
 #include "utility.h"
+#include "worker_pool.h"
+#include "xor_blocks.h"
 
 namespace android {
 namespace snapshot {
@@ -1458,6 +1464,193 @@ TEST_P(HandlerTestV3, Read) {
               0);
 }
 
+TEST(BlockCacheTest, HitMissAndEviction) {
+    // Two blocks per shard, single shard so that eviction order is exact.
+    BlockCache cache(BLOCK_SZ * 2, BLOCK_SZ, 1);
+    ASSERT_EQ(cache.capacity_blocks(), 2);
+
+    std::string a(BLOCK_SZ, 'a'), b(BLOCK_SZ, 'b'), c(BLOCK_SZ, 'c');
+    std::string sink(BLOCK_SZ, '\0');
+
+    ASSERT_FALSE(cache.Get(1, sink.data()));
+    cache.Put(1, a.data());
+    cache.Put(2, b.data());
+    ASSERT_TRUE(cache.Get(1, sink.data()));
+    ASSERT_EQ(sink, a);
+
+    // Block 2 is now the least recently used one.
+    cache.Put(3, c.data());
+    ASSERT_FALSE(cache.Get(2, sink.data()));
+    ASSERT_TRUE(cache.Get(3, sink.data()));
+    ASSERT_EQ(sink, c);
+
+    // Partial reads from a cached block.
+    std::string partial(SECTOR_SIZE, '\0');
+    ASSERT_TRUE(cache.Get(1, partial.data(), BLOCK_SZ - SECTOR_SIZE, SECTOR_SIZE));
+    ASSERT_EQ(partial, std::string(SECTOR_SIZE, 'a'));
+
+    cache.Invalidate(1);
+    ASSERT_FALSE(cache.Get(1, sink.data()));
+
+    auto stats = cache.GetStats();
+    ASSERT_EQ(stats.hits, 3);
+    ASSERT_EQ(stats.misses, 3);
+    ASSERT_EQ(stats.invalidations, 1);
+    ASSERT_EQ(stats.cached_blocks, 1);
+}
+
+TEST(BlockCacheTest, ZeroCapacity) {
+    BlockCache cache(0, BLOCK_SZ);
+    std::string data(BLOCK_SZ, 'x');
+    cache.Put(5, data.data());
+    ASSERT_FALSE(cache.Get(5, data.data()));
+    ASSERT_EQ(cache.GetStats().cached_blocks, 0);
+}
+
+TEST(BlockCacheTest, Grow) {
+    BlockCache cache(BLOCK_SZ, BLOCK_SZ, 1);
+    std::string a(BLOCK_SZ, 'a'), b(BLOCK_SZ, 'b');
+
+    cache.Put(1, a.data());
+    cache.Put(2, b.data());
+    ASSERT_FALSE(cache.Contains(1));
+    ASSERT_TRUE(cache.Contains(2));
+
+    cache.Grow(BLOCK_SZ * 2);
+    ASSERT_EQ(cache.capacity_blocks(), 2);
+    cache.Put(1, a.data());
+    ASSERT_TRUE(cache.Contains(1));
+    ASSERT_TRUE(cache.Contains(2));
+
+    // The cache never shrinks.
+    cache.Grow(0);
+    ASSERT_EQ(cache.capacity_blocks(), 2);
+}
+
+TEST(AccessProfileTest, RecordFirstAccesses) {
+    AccessProfile profile(3);
+    for (uint64_t block : {5, 1, 5, 9, 1, 7, 2}) {
+        profile.Record(block);
+    }
+    ASSERT_EQ(profile.GetBlocks(), (std::vector<uint64_t>{5, 1, 9}));
+}
+
+TEST(AccessProfileTest, SaveAndLoad) {
+    TemporaryDir dir;
+    std::string path = std::string(dir.path) + "/profile";
+
+    std::vector<uint64_t> blocks;
+    ASSERT_FALSE(AccessProfile::Load(path, 10, &blocks));
+
+    ASSERT_TRUE(AccessProfile::Save(path, {42, 7, 100000}));
+    ASSERT_TRUE(AccessProfile::Load(path, 10, &blocks));
+    ASSERT_EQ(blocks, (std::vector<uint64_t>{42, 7, 100000}));
+
+    ASSERT_TRUE(AccessProfile::Load(path, 2, &blocks));
+    ASSERT_EQ(blocks, (std::vector<uint64_t>{42, 7}));
+
+    ASSERT_TRUE(android::base::WriteStringToFile("12\nbogus\n", path));
+    ASSERT_FALSE(AccessProfile::Load(path, 10, &blocks));
+}
+
+TEST(ReadWorkerPoolTest, FairShare) {
+    ReadWorkerPool pool(4);
+
+    // A single busy handler may borrow the whole budget.
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(pool.Acquire("system"));
+    }
+    ASSERT_FALSE(pool.Acquire("system"));
+    ASSERT_EQ(pool.spare_workers_in_use(), 4);
+    ASSERT_FALSE(pool.OverShare("system"));
+
+    // Once another handler contends, the first is above its share and has
+    // to give workers back before the second gets any.
+    ASSERT_FALSE(pool.Acquire("vendor"));
+    ASSERT_TRUE(pool.OverShare("system"));
+    pool.Release("system");
+    pool.Release("system");
+    ASSERT_FALSE(pool.OverShare("system"));
+    ASSERT_TRUE(pool.Acquire("vendor"));
+    ASSERT_TRUE(pool.Acquire("vendor"));
+    ASSERT_FALSE(pool.Acquire("vendor"));
+    ASSERT_EQ(pool.spare_workers_in_use(), 4);
+
+    for (int i = 0; i < 2; i++) {
+        pool.Release("system");
+        pool.Release("vendor");
+    }
+    ASSERT_EQ(pool.spare_workers_in_use(), 0);
+    pool.Forget("system");
+    pool.Forget("vendor");
+}
+
+TEST(MergeThrottleTest, ParsePsi) {
+    std::string psi =
+            "some avg10=1.50 avg60=0.75 avg300=0.20 total=123456\n"
+            "full avg10=0.00 avg60=0.00 avg300=0.00 total=789\n";
+    auto total = MergeThrottle::ParsePsiTotal(psi);
+    ASSERT_TRUE(total.has_value());
+    ASSERT_EQ(*total, 123456);
+
+    ASSERT_FALSE(MergeThrottle::ParsePsiTotal("garbage").has_value());
+}
+
+TEST(MergeThrottleTest, QueueDepth) {
+    uint32_t depth = 0;
+    MergeThrottleConfig config;
+    config.enabled = true;
+    config.psi_path = "/nonexistent/pressure/io";
+    config.max_queue_depth = 4;
+    config.min_batch_blocks = 16;
+    config.max_batch_blocks = 256;
+    config.max_delay = std::chrono::milliseconds(1);
+    MergeThrottle throttle(config, [&]() -> uint32_t { return depth; });
+
+    throttle.Pace();
+    ASSERT_EQ(throttle.level(), 0);
+    ASSERT_EQ(throttle.GetBatchBlocks(256), 256);
+    ASSERT_EQ(throttle.throttled_time().count(), 0);
+
+    depth = 8;
+    throttle.Pace();
+    ASSERT_EQ(throttle.level(), 1);
+    ASSERT_EQ(throttle.GetBatchBlocks(256), 16);
+    ASSERT_EQ(throttle.GetBatchBlocks(8), 8);
+}
+
+TEST(MergeThrottleTest, Disabled) {
+    MergeThrottleConfig config;
+    MergeThrottle throttle(config, []() -> uint32_t { return 100; });
+    throttle.Pace();
+    ASSERT_EQ(throttle.GetBatchBlocks(256), 256);
+}
+
+TEST(XorBlocksTest, MatchesScalar) {
+    // Cover the vector body, the tails and unaligned buffers.
+    for (size_t size : {0, 1, 15, 16, 31, 33, 63, 64, 100, 4096}) {
+        for (size_t offset : {0, 1, 7}) {
+            std::vector<uint8_t> src(size + offset), dst(size + offset);
+            for (size_t i = 0; i < src.size(); i++) {
+                src[i] = static_cast<uint8_t>(i * 13 + 1);
+                dst[i] = static_cast<uint8_t>(i * 7 + 3);
+            }
+            auto expected = dst;
+            for (size_t i = offset; i < expected.size(); i++) {
+                expected[i] ^= src[i];
+            }
+
+            auto actual = dst;
+            XorBlocks(actual.data() + offset, src.data() + offset, size);
+            ASSERT_EQ(actual, expected) << XorBlocksImplName() << " size: " << size;
+
+            actual = dst;
+            XorBlocksScalar(actual.data() + offset, src.data() + offset, size);
+            ASSERT_EQ(actual, expected) << "scalar size: " << size;
+        }
+    }
+}
+
 std::vector<bool> GetIoUringConfigs() {
 #if __ANDROID__
     if (!android::base::GetBoolProperty("ro.virtual_ab.io_uring.enabled", false)) {
@@ -415,6 +415,16 @@ std::string SnapshotHandler::GetMergeStatus() {
         merge_complete = merge_complete_;
     }
 
+    // The status string is parsed by libsnapshot, so cache statistics are
+    // only logged.
+    if (block_cache_) {
+        auto stats = block_cache_->GetStats();
+        SNAP_LOG(INFO) << "Block cache: hits: " << stats.hits << " misses: " << stats.misses
+                       << " invalidations: " << stats.invalidations
+                       << " cached blocks: " << stats.cached_blocks << "/"
+                       << block_cache_->capacity_blocks();
+    }
+
     if (merge_not_initiated) {
         // Merge was not initiated yet; however, we have merge completion
         // recorded in the COW Header. This can happen if the device was
@@ -670,8 +680,10 @@ MERGE_GROUP_STATE SnapshotHandler::ProcessMergingBlock(uint64_t new_block, void*
                 // higher precedence than from source device for overlapping
                 // blocks.
                 if (resume_merge_ && GetRABuffer(&lock, new_block, buffer)) {
+                    ra_hits_++;
                     return (MERGE_GROUP_STATE::GROUP_MERGE_IN_PROGRESS);
                 }
+                ra_misses_++;
                 blk_state->num_ios_in_progress += 1;  // ref count
                 [[fallthrough]];
             }
@@ -689,6 +701,7 @@ MERGE_GROUP_STATE SnapshotHandler::ProcessMergingBlock(uint64_t new_block, void*
                 if (!GetRABuffer(&lock, new_block, buffer)) {
                     return MERGE_GROUP_STATE::GROUP_INVALID;
                 }
+                ra_hits_++;
                 return state;
             }
             default: {
@@ -16,12 +16,20 @@
 
 #include "snapuserd_verify.h"
 
+#include <inttypes.h>
+#include <linux/ioprio.h>
+#include <stdio.h>
+#include <zlib.h>
+
 #include <android-base/chrono_utils.h>
+#include <android-base/file.h>
 #include <android-base/scopeguard.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 
 #include "android-base/properties.h"
 #include "snapuserd_core.h"
+#include "utility.h"
 
 namespace android {
 namespace snapshot {
@@ -57,8 +65,9 @@ void UpdateVerify::UpdatePartitionVerificationState(UpdateVerifyState state) {
     m_cv_.notify_all();
 }
 
-void UpdateVerify::VerifyUpdatePartition() {
+void UpdateVerify::VerifyUpdatePartition(const std::string& checkpoint_key) {
     bool succeeded = false;
+    checkpoint_key_ = checkpoint_key;
 
     auto scope_guard = android::base::make_scope_guard([this, &succeeded]() -> void {
         if (!succeeded) {
@@ -73,14 +82,7 @@ void UpdateVerify::VerifyUpdatePartition() {
         return;
     }
 
-    const auto parts = android::base::Split(misc_name_, "-");
-    std::string partition_name = parts[0];
-
-    constexpr auto&& suffix_b = "_b";
-    constexpr auto&& suffix_a = "_a";
-
-    partition_name.erase(partition_name.find_last_not_of(suffix_b) + 1);
-    partition_name.erase(partition_name.find_last_not_of(suffix_a) + 1);
+    std::string partition_name = GetPartitionName(misc_name_);
 
     if (dm_block_devices.find(partition_name) == dm_block_devices.end()) {
         SNAP_LOG(ERROR) << "Failed to find dm block device for " << partition_name;
@@ -104,6 +106,10 @@ bool UpdateVerify::VerifyBlocks(const std::string& partition_name,
         return false;
     }
 
+    if (!SetIoPriority(IOPRIO_CLASS_BE, kVerifyIoPriorityLevel)) {
+        SNAP_PLOG(WARNING) << "Failed to lower I/O priority for verification";
+    }
+
     loff_t file_offset = offset;
     auto verify_block_size = android::base::GetUintProperty<uint>("ro.virtual_ab.verify_block_size",
                                                                   kBlockSizeVerify);
@@ -120,19 +126,28 @@ bool UpdateVerify::VerifyBlocks(const std::string& partition_name,
     std::unique_ptr<void, decltype(&::free)> buffer(addr, ::free);
 
     uint64_t bytes_read = 0;
+    uint64_t bytes_skipped = 0;
 
     while (true) {
         size_t to_read = std::min((dev_sz - file_offset), read_sz);
-
-        if (!android::base::ReadFullyAtOffset(fd.get(), buffer.get(), to_read, file_offset)) {
-            SNAP_PLOG(ERROR) << "Failed to read block from block device: " << dm_block_device
-                             << " partition-name: " << partition_name
-                             << " at offset: " << file_offset << " read-size: " << to_read
-                             << " block-size: " << dev_sz;
-            return false;
+        uint64_t region = file_offset / verify_block_size;
+
+        if (IsRegionVerified(region)) {
+            bytes_skipped += to_read;
+        } else {
+            if (!android::base::ReadFullyAtOffset(fd.get(), buffer.get(), to_read,
+                                                  file_offset)) {
+                SNAP_PLOG(ERROR) << "Failed to read block from block device: " << dm_block_device
+                                 << " partition-name: " << partition_name
+                                 << " at offset: " << file_offset << " read-size: " << to_read
+                                 << " block-size: " << dev_sz;
+                return false;
+            }
+            uint32_t digest = crc32(0, static_cast<const Bytef*>(buffer.get()), to_read);
+            RecordVerifiedRegion(region, digest);
+            bytes_read += to_read;
         }
 
-        bytes_read += to_read;
         file_offset += (skip_blocks * verify_block_size);
         if (file_offset >= dev_sz) {
             break;
@@ -140,7 +155,8 @@ bool UpdateVerify::VerifyBlocks(const std::string& partition_name,
     }
 
     SNAP_LOG(DEBUG) << "Verification success with bytes-read: " << bytes_read
-                    << " dev_sz: " << dev_sz << " partition_name: " << partition_name;
+                    << " bytes-skipped: " << bytes_skipped << " dev_sz: " << dev_sz
+                    << " partition_name: " << partition_name;
 
     return true;
 }
@@ -199,6 +215,8 @@ bool UpdateVerify::VerifyPartition(const std::string& partition_name,
 
     auto verify_block_size =
             android::base::GetUintProperty("ro.virtual_ab.verify_block_size", kBlockSizeVerify);
+    LoadCheckpoint(fd.get(), dev_sz, verify_block_size);
+
     while (num_threads) {
         threads.emplace_back(std::async(std::launch::async, &UpdateVerify::VerifyBlocks, this,
                                         partition_name, dm_block_device, start_offset, skip_blocks,
@@ -214,6 +232,7 @@ bool UpdateVerify::VerifyPartition(const std::string& partition_name,
     for (auto& t : threads) {
         ret = t.get() && ret;
     }
+    SyncCheckpoint();
 
     if (ret) {
         succeeded = true;
@@ -227,5 +246,128 @@ bool UpdateVerify::VerifyPartition(const std::string& partition_name,
     return false;
 }
 
+std::string UpdateVerify::GetCheckpointPath() const {
+    return "/metadata/ota/snapuserd-verify-" + misc_name_;
+}
+
+void UpdateVerify::LoadCheckpoint(int fd, uint64_t dev_sz, uint64_t region_size) {
+    std::lock_guard<std::mutex> lock(checkpoint_lock_);
+
+    verified_regions_.clear();
+    checkpoint_fd_ = {};
+    unsynced_regions_ = 0;
+
+    if (checkpoint_key_.empty()) {
+        return;
+    }
+
+    /*
+     * The checkpoint is a text file: a header line identifying the snapshot
+     * and the region layout, followed by one "<region> <crc32>" line per
+     * verified region. Anything after the last newline is a torn write and
+     * is ignored.
+     */
+    const std::string path = GetCheckpointPath();
+    const std::string header = android::base::StringPrintf(
+            "%s %" PRIu64 " %" PRIu64, checkpoint_key_.c_str(), dev_sz, region_size);
+
+    std::string contents;
+    uint64_t last_region = 0;
+    uint32_t last_digest = 0;
+    if (android::base::ReadFileToString(path, &contents)) {
+        auto lines = android::base::Split(contents, "\n");
+        if (lines.size() > 1 && lines[0] == header) {
+            for (size_t i = 1; i + 1 < lines.size(); i++) {
+                uint64_t region;
+                uint32_t digest;
+                if (sscanf(lines[i].c_str(), "%" SCNu64 " %" SCNx32, &region, &digest) != 2 ||
+                    region * region_size >= dev_sz) {
+                    SNAP_LOG(WARNING) << "Ignoring malformed checkpoint: " << path;
+                    verified_regions_.clear();
+                    break;
+                }
+                verified_regions_[region] = digest;
+                last_region = region;
+                last_digest = digest;
+            }
+        }
+    }
+
+    // The region recorded last by the previous run is read back; if it no
+    // longer matches, the checkpoint does not describe this snapshot.
+    if (!verified_regions_.empty()) {
+        size_t to_read = std::min(dev_sz - last_region * region_size, region_size);
+        std::unique_ptr<void, decltype(&::free)> buffer(nullptr, ::free);
+        void* addr;
+        if (posix_memalign(&addr, getpagesize(), to_read) == 0) {
+            buffer.reset(addr);
+        }
+        if (!buffer ||
+            !android::base::ReadFullyAtOffset(fd, buffer.get(), to_read,
+                                              last_region * region_size) ||
+            crc32(0, static_cast<const Bytef*>(buffer.get()), to_read) != last_digest) {
+            SNAP_LOG(WARNING) << "Checkpoint does not match device, restarting verification";
+            verified_regions_.clear();
+        }
+    }
+
+    // Rewrite the checkpoint so that appends start on a clean line.
+    std::string data = header + "\n";
+    for (const auto& [region, digest] : verified_regions_) {
+        data += android::base::StringPrintf("%" PRIu64 " %08" PRIx32 "\n", region, digest);
+    }
+    const std::string tmp_path = path + ".tmp";
+    if (!android::base::WriteStringToFile(data, tmp_path) ||
+        rename(tmp_path.c_str(), path.c_str()) < 0) {
+        SNAP_PLOG(WARNING) << "Failed to write verification checkpoint: " << path;
+        unlink(tmp_path.c_str());
+        return;
+    }
+
+    checkpoint_fd_.reset(open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC));
+    if (checkpoint_fd_ < 0) {
+        SNAP_PLOG(WARNING) << "Failed to open verification checkpoint: " << path;
+        return;
+    }
+
+    if (!verified_regions_.empty()) {
+        SNAP_LOG(INFO) << "Resuming verification with " << verified_regions_.size()
+                       << " regions already verified";
+    }
+}
+
+bool UpdateVerify::IsRegionVerified(uint64_t region) {
+    std::lock_guard<std::mutex> lock(checkpoint_lock_);
+    return verified_regions_.count(region) != 0;
+}
+
+void UpdateVerify::RecordVerifiedRegion(uint64_t region, uint32_t digest) {
+    std::lock_guard<std::mutex> lock(checkpoint_lock_);
+
+    verified_regions_[region] = digest;
+    if (checkpoint_fd_ < 0) {
+        return;
+    }
+
+    std::string line = android::base::StringPrintf("%" PRIu64 " %08" PRIx32 "\n", region, digest);
+    if (!android::base::WriteStringToFd(line, checkpoint_fd_)) {
+        SNAP_PLOG(WARNING) << "Failed to update verification checkpoint";
+        checkpoint_fd_ = {};
+        return;
+    }
+    if (++unsynced_regions_ >= kCheckpointSyncInterval) {
+        fsync(checkpoint_fd_.get());
+        unsynced_regions_ = 0;
+    }
+}
+
+void UpdateVerify::SyncCheckpoint() {
+    std::lock_guard<std::mutex> lock(checkpoint_lock_);
+    if (checkpoint_fd_ >= 0) {
+        fsync(checkpoint_fd_.get());
+        unsynced_regions_ = 0;
+    }
+}
+
 }  // namespace snapshot
 }  // namespace android
@@ -21,7 +21,9 @@
 #include <condition_variable>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 
+#include <android-base/unique_fd.h>
 #include <snapuserd/snapuserd_kernel.h>
 #include <storage_literals/storage_literals.h>
 
@@ -33,7 +35,9 @@ using namespace android::storage_literals;
 class UpdateVerify {
   public:
     UpdateVerify(const std::string& misc_name);
-    void VerifyUpdatePartition();
+    // |checkpoint_key| identifies the snapshot contents; progress saved by an
+    // earlier run is only resumed if the key matches.
+    void VerifyUpdatePartition(const std::string& checkpoint_key);
     bool CheckPartitionVerification();
 
   private:
@@ -70,11 +74,38 @@ class UpdateVerify {
     uint64_t kThresholdSize = 750_MiB;
     uint64_t kBlockSizeVerify = 2_MiB;
 
+    /*
+     * Verification runs while the device is still booting. Progress is
+     * checkpointed to /metadata so that a reboot partway through does not
+     * throw away the regions that were already verified; each verified region
+     * is recorded along with a CRC of its contents. Checkpoints are synced
+     * every kCheckpointSyncInterval regions.
+     *
+     * The verification threads also drop to the lowest best-effort I/O
+     * priority so that they do not compete with the I/O needed to reach
+     * boot-complete.
+     */
+    static constexpr uint64_t kCheckpointSyncInterval = 64;
+    static constexpr int kVerifyIoPriorityLevel = 7;
+
+    std::string checkpoint_key_;
+    std::mutex checkpoint_lock_;
+    android::base::unique_fd checkpoint_fd_;
+    // Region index -> CRC32 of the region.
+    std::unordered_map<uint64_t, uint32_t> verified_regions_;
+    uint64_t unsynced_regions_ = 0;
+
     bool IsBlockAligned(uint64_t read_size) { return ((read_size & (BLOCK_SZ - 1)) == 0); }
     void UpdatePartitionVerificationState(UpdateVerifyState state);
     bool VerifyPartition(const std::string& partition_name, const std::string& dm_block_device);
     bool VerifyBlocks(const std::string& partition_name, const std::string& dm_block_device,
                       off_t offset, int skip_blocks, uint64_t dev_sz);
+
+    std::string GetCheckpointPath() const;
+    void LoadCheckpoint(int fd, uint64_t dev_sz, uint64_t region_size);
+    bool IsRegionVerified(uint64_t region);
+    void RecordVerifiedRegion(uint64_t region, uint32_t digest);
+    void SyncCheckpoint();
 };
 
 }  // namespace snapshot
@@ -0,0 +1,82 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "worker_pool.h"
+
+#include <algorithm>
+
+namespace android {
+namespace snapshot {
+
+size_t ReadWorkerPool::Share(std::lock_guard<std::mutex>*, const std::string& misc_name) {
+    auto now = std::chrono::steady_clock::now();
+    std::erase_if(waiting_, [&](const auto& entry) { return now - entry.second > kWaitingExpiry; });
+
+    size_t contenders = borrowed_.size();
+    for (const auto& [name, time] : waiting_) {
+        if (!borrowed_.count(name)) contenders++;
+    }
+    if (!borrowed_.count(misc_name) && !waiting_.count(misc_name)) {
+        contenders++;
+    }
+    return std::max<size_t>(1, max_spare_workers_ / contenders);
+}
+
+bool ReadWorkerPool::Acquire(const std::string& misc_name) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto iter = borrowed_.find(misc_name);
+    size_t held = (iter == borrowed_.end()) ? 0 : iter->second;
+    if (in_use_ >= max_spare_workers_ || held >= Share(&lock, misc_name)) {
+        waiting_[misc_name] = std::chrono::steady_clock::now();
+        return false;
+    }
+    waiting_.erase(misc_name);
+    borrowed_[misc_name]++;
+    in_use_++;
+    return true;
+}
+
+void ReadWorkerPool::Release(const std::string& misc_name) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto iter = borrowed_.find(misc_name);
+    if (iter == borrowed_.end()) {
+        return;
+    }
+    if (--iter->second == 0) {
+        borrowed_.erase(iter);
+    }
+    in_use_--;
+}
+
+bool ReadWorkerPool::OverShare(const std::string& misc_name) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto iter = borrowed_.find(misc_name);
+    if (iter == borrowed_.end()) {
+        return false;
+    }
+    return iter->second > Share(&lock, misc_name);
+}
+
+void ReadWorkerPool::Forget(const std::string& misc_name) {
+    std::lock_guard<std::mutex> lock(lock_);
+    waiting_.erase(misc_name);
+}
+
+size_t ReadWorkerPool::spare_workers_in_use() {
+    std::lock_guard<std::mutex> lock(lock_);
+    return in_use_;
+}
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,72 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace android {
+namespace snapshot {
+
+// Daemon-wide budget of spare ReadWorker threads.
+//
+// dm-user hands a request to whichever thread is blocked reading that
+// snapshot's control device, so every handler keeps one resident worker of
+// its own. Handlers whose workers are all busy borrow spare workers from this
+// budget, and spare workers exit again once they go idle. Handlers get an
+// equal share of the budget: the share is divided among the handlers which
+// currently hold spare workers or were recently refused one. A handler above
+// its share gets no more spares, and its spare workers should retire.
+class ReadWorkerPool {
+  public:
+    explicit ReadWorkerPool(size_t max_spare_workers) : max_spare_workers_(max_spare_workers) {}
+
+    // Reserve a spare worker for |misc_name|. Returns false if the budget or
+    // the handler's share of it is used up.
+    bool Acquire(const std::string& misc_name);
+
+    // Return a spare worker reserved with Acquire().
+    void Release(const std::string& misc_name);
+
+    // True if |misc_name| holds more spare workers than its share, e.g.
+    // because another handler started to contend for the budget.
+    bool OverShare(const std::string& misc_name);
+
+    // Drop all state of a handler which is going away.
+    void Forget(const std::string& misc_name);
+
+    size_t max_spare_workers() const { return max_spare_workers_; }
+    size_t spare_workers_in_use();
+
+  private:
+    size_t Share(std::lock_guard<std::mutex>* proof_of_lock, const std::string& misc_name);
+
+    std::mutex lock_;
+    const size_t max_spare_workers_;
+    size_t in_use_ = 0;
+    // Spare workers held, per handler. Only non-zero entries are kept.
+    std::unordered_map<std::string, size_t> borrowed_;
+    // When handlers were last refused a spare worker. Entries older than
+    // kWaitingExpiry no longer count against the share of others.
+    static constexpr std::chrono::seconds kWaitingExpiry{1};
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> waiting_;
+};
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,143 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "xor_blocks.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace android {
+namespace snapshot {
+
+void XorBlocksScalar(void* dst, const void* src, size_t size) {
+    auto out = reinterpret_cast<uint8_t*>(dst);
+    auto in = reinterpret_cast<const uint8_t*>(src);
+
+    // memcpy keeps unaligned word access well-defined; it compiles down to
+    // plain loads and stores.
+    for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t)) {
+        uint64_t a, b;
+        memcpy(&a, out, sizeof(a));
+        memcpy(&b, in, sizeof(b));
+        a ^= b;
+        memcpy(out, &a, sizeof(a));
+        out += sizeof(uint64_t);
+        in += sizeof(uint64_t);
+    }
+    for (size_t i = 0; i < size; i++) {
+        out[i] ^= in[i];
+    }
+}
+
+#if defined(__aarch64__)
+static void XorBlocksNeon(void* dst, const void* src, size_t size) {
+    auto out = reinterpret_cast<uint8_t*>(dst);
+    auto in = reinterpret_cast<const uint8_t*>(src);
+
+    for (; size >= 64; size -= 64) {
+        uint8x16x4_t a = vld1q_u8_x4(out);
+        uint8x16x4_t b = vld1q_u8_x4(in);
+        a.val[0] = veorq_u8(a.val[0], b.val[0]);
+        a.val[1] = veorq_u8(a.val[1], b.val[1]);
+        a.val[2] = veorq_u8(a.val[2], b.val[2]);
+        a.val[3] = veorq_u8(a.val[3], b.val[3]);
+        vst1q_u8_x4(out, a);
+        out += 64;
+        in += 64;
+    }
+    for (; size >= 16; size -= 16) {
+        vst1q_u8(out, veorq_u8(vld1q_u8(out), vld1q_u8(in)));
+        out += 16;
+        in += 16;
+    }
+    XorBlocksScalar(out, in, size);
+}
+#elif defined(__x86_64__)
+static void XorBlocksSse2(void* dst, const void* src, size_t size) {
+    auto out = reinterpret_cast<uint8_t*>(dst);
+    auto in = reinterpret_cast<const uint8_t*>(src);
+
+    for (; size >= 16; size -= 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(out));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_xor_si128(a, b));
+        out += 16;
+        in += 16;
+    }
+    XorBlocksScalar(out, in, size);
+}
+
+__attribute__((target("avx2"))) static void XorBlocksAvx2(void* dst, const void* src,
+                                                          size_t size) {
+    auto out = reinterpret_cast<uint8_t*>(dst);
+    auto in = reinterpret_cast<const uint8_t*>(src);
+
+    for (; size >= 32; size -= 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(out));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_xor_si256(a, b));
+        out += 32;
+        in += 32;
+    }
+    XorBlocksSse2(out, in, size);
+}
+#endif
+
+namespace {
+
+using XorFn = void (*)(void*, const void*, size_t);
+
+struct XorImpl {
+    XorFn fn;
+    const char* name;
+};
+
+XorImpl SelectXorImpl() {
+#if defined(__aarch64__)
+    // NEON is mandatory on arm64.
+    return {XorBlocksNeon, "neon"};
+#elif defined(__x86_64__)
+    if (__builtin_cpu_supports("avx2")) {
+        return {XorBlocksAvx2, "avx2"};
+    }
+    // SSE2 is part of the x86_64 baseline.
+    return {XorBlocksSse2, "sse2"};
+#else
+    return {XorBlocksScalar, "scalar"};
+#endif
+}
+
+const XorImpl& GetXorImpl() {
+    static const XorImpl impl = SelectXorImpl();
+    return impl;
+}
+
+}  // namespace
+
+void XorBlocks(void* dst, const void* src, size_t size) {
+    GetXorImpl().fn(dst, src, size);
+}
+
+const char* XorBlocksImplName() {
+    return GetXorImpl().name;
+}
+
+}  // namespace snapshot
+}  // namespace android
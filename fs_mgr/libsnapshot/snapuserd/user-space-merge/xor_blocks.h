@@ -0,0 +1,34 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+
+namespace android {
+namespace snapshot {
+
+// XOR |size| bytes of |src| into |dst|. The implementation is picked once,
+// at first use, based on the vector units the CPU supports (NEON on arm64,
+// AVX2 or SSE2 on x86_64). Buffers need not be aligned.
+void XorBlocks(void* dst, const void* src, size_t size);
+
+// Portable implementation; exposed for tests and benchmarks.
+void XorBlocksScalar(void* dst, const void* src, size_t size);
+
+// Name of the implementation XorBlocks() dispatches to.
+const char* XorBlocksImplName();
+
+}  // namespace snapshot
+}  // namespace android
@@ -0,0 +1,60 @@
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "xor_blocks.h"
+
+namespace android {
+namespace snapshot {
+
+// The byte loop snapuserd used before XorBlocks().
+static void XorBytes(void* dst, const void* src, size_t size) {
+    auto out = reinterpret_cast<uint8_t*>(dst);
+    auto in = reinterpret_cast<const uint8_t*>(src);
+    for (size_t i = 0; i < size; i++) {
+        out[i] ^= in[i];
+    }
+}
+
+template <void (*Fn)(void*, const void*, size_t)>
+static void BM_Xor(benchmark::State& state) {
+    const size_t size = state.range(0);
+    std::vector<uint8_t> dst(size, 0x5a);
+    std::vector<uint8_t> src(size);
+    for (size_t i = 0; i < size; i++) {
+        src[i] = static_cast<uint8_t>(i * 31);
+    }
+
+    for (auto _ : state) {
+        Fn(dst.data(), src.data(), size);
+        benchmark::DoNotOptimize(dst.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    state.SetLabel(Fn == XorBlocks ? XorBlocksImplName() : "");
+}
+
+BENCHMARK(BM_Xor<XorBytes>)->Arg(4096)->Arg(64 * 1024);
+BENCHMARK(BM_Xor<XorBlocksScalar>)->Arg(4096)->Arg(64 * 1024);
+BENCHMARK(BM_Xor<XorBlocks>)->Arg(4096)->Arg(64 * 1024);
+
+}  // namespace snapshot
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -14,11 +14,14 @@
 
 #include "utility.h"
 
+#include <linux/ioprio.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 
 #include <android-base/file.h>
+#include <android-base/strings.h>
 #include <processgroup/processgroup.h>
 
 #include <private/android_filesystem_config.h>
@@ -36,6 +39,15 @@ bool SetThreadPriority([[maybe_unused]] int priority) {
 #endif
 }
 
+bool SetIoPriority([[maybe_unused]] int ioprio_class, [[maybe_unused]] int level) {
+#ifdef __ANDROID__
+    return syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, gettid(),
+                   IOPRIO_PRIO_VALUE(ioprio_class, level)) != -1;
+#else
+    return true;
+#endif
+}
+
 bool SetProfiles([[maybe_unused]] std::initializer_list<std::string_view> profiles) {
 #ifdef __ANDROID__
     if (setgid(AID_SYSTEM)) {
@@ -61,5 +73,17 @@ bool KernelSupportsIoUring() {
     return major > 5 || (major == 5 && minor >= 6);
 }
 
+std::string GetPartitionName(const std::string& misc_name) {
+    const auto parts = android::base::Split(misc_name, "-");
+    std::string partition_name = parts[0];
+
+    constexpr auto&& suffix_b = "_b";
+    constexpr auto&& suffix_a = "_a";
+
+    partition_name.erase(partition_name.find_last_not_of(suffix_b) + 1);
+    partition_name.erase(partition_name.find_last_not_of(suffix_a) + 1);
+    return partition_name;
+}
+
 }  // namespace snapshot
 }  // namespace android
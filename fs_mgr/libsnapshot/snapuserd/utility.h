@@ -15,14 +15,20 @@
 #pragma once
 
 #include <initializer_list>
+#include <string>
 #include <string_view>
 
 namespace android {
 namespace snapshot {
 
 bool SetThreadPriority(int priority);
+bool SetIoPriority(int ioprio_class, int level);
 bool SetProfiles(std::initializer_list<std::string_view> profiles);
 bool KernelSupportsIoUring();
 
+// Returns the partition, without slot suffix, that a dm-user misc name such
+// as "system_b-user-cow-init" belongs to.
+std::string GetPartitionName(const std::string& misc_name);
+
 }  // namespace snapshot
 }  // namespace android
@@ -218,7 +218,8 @@ bool CompareFlags(FstabEntry::FsMgrFlags& lhs, FstabEntry::FsMgrFlags& rhs) {
            lhs.checkpoint_fs == rhs.checkpoint_fs &&
            lhs.first_stage_mount == rhs.first_stage_mount &&
            lhs.slot_select_other == rhs.slot_select_other &&
-           lhs.fs_verity == rhs.fs_verity;
+           lhs.fs_verity == rhs.fs_verity &&
+           lhs.hashtree_prewarm == rhs.hashtree_prewarm;
     // clang-format on
 }
 
@@ -442,12 +443,13 @@ source none2       swap   defaults      first_stage_mount,latemount,quota,logica
 source none3       swap   defaults      checkpoint=block
 source none4       swap   defaults      checkpoint=fs
 source none5       swap   defaults      defaults
+source none6       swap   defaults      avb,hashtree_prewarm
 )fs";
     ASSERT_TRUE(android::base::WriteStringToFile(fstab_contents, tf.path));
 
     Fstab fstab;
     EXPECT_TRUE(ReadFstabFromFile(tf.path, &fstab));
-    ASSERT_LE(6U, fstab.size());
+    ASSERT_LE(7U, fstab.size());
 
     FstabEntry* entry = GetEntryForMountPoint(&fstab, "none0");
     ASSERT_NE(nullptr, entry);
@@ -505,6 +507,15 @@ source none5       swap   defaults      defaults
         FstabEntry::FsMgrFlags flags = {};
         EXPECT_TRUE(CompareFlags(flags, entry->fs_mgr_flags));
     }
+
+    entry = GetEntryForMountPoint(&fstab, "none6");
+    ASSERT_NE(nullptr, entry);
+    {
+        FstabEntry::FsMgrFlags flags = {};
+        flags.avb = true;
+        flags.hashtree_prewarm = true;
+        EXPECT_TRUE(CompareFlags(flags, entry->fs_mgr_flags));
+    }
 }
 
 TEST(fs_mgr, ReadFstabFromFile_FsMgrOptions_AllBad) {
@@ -6,19 +6,25 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <poll.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/prctl.h>
+#include <time.h>
 #include <unistd.h>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #define SECTOR_SIZE ((__u64)512)
-#define BUFFER_BYTES 4096
+#define BUFFER_BYTES (1024 * 1024)
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 /* This should be replaced with linux/dm-user.h. */
 #ifndef _LINUX_DM_USER_H
@@ -77,6 +83,28 @@ struct dm_user_message {
 
 static bool verbose = false;
 
+/*
+ * Per-thread counters, printed when the device goes away. Service time runs
+ * from the arrival of a request to the end of its response, and is split
+ * into control device syscalls (payload reads and response writes) and the
+ * backing store, so the overhead of dm-user itself can be measured. Without
+ * a backing store it is all dm-user.
+ */
+struct stats {
+    __u64 requests = 0;
+    __u64 bytes = 0;
+    __u64 control_read_ns = 0;
+    __u64 control_write_ns = 0;
+    __u64 backing_ns = 0;
+    __u64 service_ns = 0;
+};
+
+static __u64 now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 ssize_t write_all(int fd, void* buf, size_t len) {
     char* buf_c = (char*)buf;
     ssize_t total = 0;
@@ -113,168 +141,253 @@ ssize_t read_all(int fd, void* buf, size_t len) {
     return total;
 }
 
-int not_splice(int from, int to, __u64 count) {
-    while (count > 0) {
-        char buf[BUFFER_BYTES];
-        __u64 max = count > BUFFER_BYTES ? BUFFER_BYTES : count;
-
-        if (read_all(from, buf, max) <= 0) {
-            perror("Unable to read");
-            return -EIO;
-        }
-
-        if (write_all(to, buf, max) <= 0) {
-            perror("Unable to write");
-            return -EIO;
+/* Positioned I/O on the backing store, or nothing at all if there is none. */
+static int backing_io(int backing_fd, bool write, char* buf, __u64 len, __u64 offset) {
+    if (backing_fd < 0) {
+        if (!write) memset(buf, 0, len);
+        return 0;
+    }
+    while (len > 0) {
+        ssize_t once = write ? pwrite64(backing_fd, buf, len, offset)
+                             : pread64(backing_fd, buf, len, offset);
+        if (once <= 0) {
+            if (once == 0) errno = EIO;
+            return -errno;
         }
-
-        count -= max;
+        buf += once;
+        len -= once;
+        offset += once;
     }
-
     return 0;
 }
 
-static int simple_daemon(const std::string& control_path, const std::string& backing_path) {
-    int control_fd = open(control_path.c_str(), O_RDWR);
-    if (control_fd < 0) {
-        fprintf(stderr, "Unable to open control device %s\n", control_path.c_str());
-        return -1;
+static void sync_backing(int backing_fd) {
+    if (backing_fd >= 0 && fsync(backing_fd) < 0) {
+        perror("Unable to fsync(), just sync()ing instead");
+        sync();
     }
+}
 
-    int backing_fd = open(backing_path.c_str(), O_RDWR);
-    if (backing_fd < 0) {
-        fprintf(stderr, "Unable to open backing device %s\n", backing_path.c_str());
-        return -1;
+static void print_request(const struct dm_user_message& msg) {
+    std::string type;
+    switch (msg.type) {
+        case DM_USER_REQ_MAP_WRITE:
+            type = "write";
+            break;
+        case DM_USER_REQ_MAP_READ:
+            type = "read";
+            break;
+        case DM_USER_REQ_MAP_FLUSH:
+            type = "flush";
+            break;
+        default:
+            /*
+             * FIXME: Can't I do "whatever"s here rather that
+             * std::string("whatever")?
+             */
+            type = std::string("(unknown, id=") + std::to_string(msg.type) + ")";
+            break;
+    }
+
+    std::string flags;
+    if (msg.flags & DM_USER_REQ_MAP_FLAG_SYNC) {
+        if (!flags.empty()) flags += "|";
+        flags += "S";
+    }
+    if (msg.flags & DM_USER_REQ_MAP_FLAG_META) {
+        if (!flags.empty()) flags += "|";
+        flags += "M";
+    }
+    if (msg.flags & DM_USER_REQ_MAP_FLAG_FUA) {
+        if (!flags.empty()) flags += "|";
+        flags += "FUA";
     }
+    if (msg.flags & DM_USER_REQ_MAP_FLAG_PREFLUSH) {
+        if (!flags.empty()) flags += "|";
+        flags += "F";
+    }
+
+    std::cerr << "dmuserd: Got " << type << " request " << flags << " for sector "
+              << std::to_string(msg.sector) << " with length " << std::to_string(msg.len) << "\n";
+}
+
+/*
+ * Serve requests on one control fd. Each request takes one read() of the
+ * header (plus one per MiB of payload for writes) and one write() per MiB
+ * of response: the header goes out together with the first part of the
+ * read data, the same way snapuserd answers requests.
+ */
+static int serve(int control_fd, int backing_fd, struct stats* stats) {
+    std::vector<char> storage(sizeof(struct dm_user_message) + BUFFER_BYTES);
+    struct dm_user_message* msg = (struct dm_user_message*)storage.data();
+    char* data = storage.data() + sizeof(*msg);
 
     while (1) {
-        struct dm_user_message msg;
-        char* base;
         __u64 type;
 
         if (verbose) std::cerr << "dmuserd: Waiting for message...\n";
 
-        if (read_all(control_fd, &msg, sizeof(msg)) < 0) {
+        if (read_all(control_fd, msg, sizeof(*msg)) < 0) {
             if (errno == ENOTBLK) return 0;
 
             perror("unable to read msg");
             return -1;
         }
+        /* The read above blocks until a request arrives; time from here. */
+        __u64 arrival = now_ns();
 
-        if (verbose) {
-            std::string type;
-            switch (msg.type) {
-                case DM_USER_REQ_MAP_WRITE:
-                    type = "write";
-                    break;
-                case DM_USER_REQ_MAP_READ:
-                    type = "read";
-                    break;
-                case DM_USER_REQ_MAP_FLUSH:
-                    type = "flush";
-                    break;
-                default:
-                    /*
-                     * FIXME: Can't I do "whatever"s here rather that
-                     * std::string("whatever")?
-                     */
-                    type = std::string("(unknown, id=") + std::to_string(msg.type) + ")";
-                    break;
-            }
+        if (verbose) print_request(*msg);
 
-            std::string flags;
-            if (msg.flags & DM_USER_REQ_MAP_FLAG_SYNC) {
-                if (!flags.empty()) flags += "|";
-                flags += "S";
-            }
-            if (msg.flags & DM_USER_REQ_MAP_FLAG_META) {
-                if (!flags.empty()) flags += "|";
-                flags += "M";
-            }
-            if (msg.flags & DM_USER_REQ_MAP_FLAG_FUA) {
-                if (!flags.empty()) flags += "|";
-                flags += "FUA";
-            }
-            if (msg.flags & DM_USER_REQ_MAP_FLAG_PREFLUSH) {
-                if (!flags.empty()) flags += "|";
-                flags += "F";
-            }
-
-            std::cerr << "dmuserd: Got " << type << " request " << flags << " for sector "
-                      << std::to_string(msg.sector) << " with length " << std::to_string(msg.len)
-                      << "\n";
-        }
-
-        type = msg.type;
+        __u64 len = msg->len;
+        __u64 offset = msg->sector * SECTOR_SIZE;
+        type = msg->type;
         switch (type) {
             case DM_USER_REQ_MAP_READ:
-                msg.type = DM_USER_RESP_SUCCESS;
+                msg->type = DM_USER_RESP_SUCCESS;
                 break;
             case DM_USER_REQ_MAP_WRITE:
-                if (msg.flags & DM_USER_REQ_MAP_FLAG_PREFLUSH ||
-                    msg.flags & DM_USER_REQ_MAP_FLAG_FUA) {
-                    if (fsync(backing_fd) < 0) {
-                        perror("Unable to fsync(), just sync()ing instead");
-                        sync();
-                    }
-                }
-                msg.type = DM_USER_RESP_SUCCESS;
-                if (lseek64(backing_fd, msg.sector * SECTOR_SIZE, SEEK_SET) < 0) {
-                    perror("Unable to seek");
-                    return -1;
-                }
-                if (not_splice(control_fd, backing_fd, msg.len) < 0) {
-                    if (errno == ENOTBLK) return 0;
-                    std::cerr << "unable to handle write data\n";
-                    return -1;
+                if (msg->flags & DM_USER_REQ_MAP_FLAG_PREFLUSH ||
+                    msg->flags & DM_USER_REQ_MAP_FLAG_FUA) {
+                    sync_backing(backing_fd);
                 }
-                if (msg.flags & DM_USER_REQ_MAP_FLAG_FUA) {
-                    if (fsync(backing_fd) < 0) {
-                        perror("Unable to fsync(), just sync()ing instead");
-                        sync();
+                msg->type = DM_USER_RESP_SUCCESS;
+                for (__u64 done = 0; done < len;) {
+                    __u64 max = MIN(len - done, (__u64)BUFFER_BYTES);
+                    __u64 read_start = now_ns();
+                    if (read_all(control_fd, data, max) <= 0) {
+                        if (errno == ENOTBLK) return 0;
+                        std::cerr << "unable to handle write data\n";
+                        return -1;
                     }
+                    __u64 backing_start = now_ns();
+                    stats->control_read_ns += backing_start - read_start;
+                    if (backing_io(backing_fd, true, data, max, offset + done) < 0) {
+                        perror("Unable to write backing store");
+                        return -1;
+                    }
+                    stats->backing_ns += now_ns() - backing_start;
+                    done += max;
                 }
-                break;
-            case DM_USER_REQ_MAP_FLUSH:
-                msg.type = DM_USER_RESP_SUCCESS;
-                if (fsync(backing_fd) < 0) {
-                    perror("Unable to fsync(), just sync()ing instead");
-                    sync();
+                if (msg->flags & DM_USER_REQ_MAP_FLAG_FUA) {
+                    sync_backing(backing_fd);
                 }
                 break;
+            case DM_USER_REQ_MAP_FLUSH: {
+                msg->type = DM_USER_RESP_SUCCESS;
+                __u64 backing_start = now_ns();
+                sync_backing(backing_fd);
+                stats->backing_ns += now_ns() - backing_start;
+                break;
+            }
             default:
-                std::cerr << "dmuserd: unsupported op " << std::to_string(msg.type) << "\n";
-                msg.type = DM_USER_RESP_UNSUPPORTED;
+                std::cerr << "dmuserd: unsupported op " << std::to_string(msg->type) << "\n";
+                msg->type = DM_USER_RESP_UNSUPPORTED;
                 break;
         }
 
         if (verbose) std::cerr << "dmuserd: Responding to message\n";
 
-        if (write_all(control_fd, &msg, sizeof(msg)) < 0) {
-            if (errno == ENOTBLK) return 0;
-            perror("unable to write msg");
+        /* Reads send their data after the header, anything else just the header. */
+        __u64 to_send = type == DM_USER_REQ_MAP_READ ? len : 0;
+        char* out = (char*)msg;
+        __u64 out_len = sizeof(*msg);
+        do {
+            __u64 max = MIN(to_send, (__u64)BUFFER_BYTES);
+            if (max) {
+                __u64 backing_start = now_ns();
+                if (backing_io(backing_fd, false, data, max, offset) < 0) {
+                    perror("Unable to read backing store");
+                    return -1;
+                }
+                stats->backing_ns += now_ns() - backing_start;
+            }
+
+            __u64 write_start = now_ns();
+            if (write_all(control_fd, out, out_len + max) < 0) {
+                if (errno == ENOTBLK) return 0;
+                perror("unable to write msg");
+                return -1;
+            }
+            stats->control_write_ns += now_ns() - write_start;
+
+            /* Later parts of the data go out without a header. */
+            out = data;
+            out_len = 0;
+            offset += max;
+            to_send -= max;
+        } while (to_send > 0);
+
+        stats->service_ns += now_ns() - arrival;
+        stats->requests++;
+        if (type == DM_USER_REQ_MAP_READ || type == DM_USER_REQ_MAP_WRITE) stats->bytes += len;
+    }
+}
+
+static void print_stats(int thread, const struct stats& stats) {
+    __u64 requests = MAX(stats.requests, 1);
+    fprintf(stderr,
+            "dmuserd: thread %d: %llu requests, %llu bytes, per request: service %llu ns, "
+            "control write %llu ns, payload read %llu ns, backing store %llu ns\n",
+            thread, (unsigned long long)stats.requests, (unsigned long long)stats.bytes,
+            (unsigned long long)(stats.service_ns / requests),
+            (unsigned long long)(stats.control_write_ns / requests),
+            (unsigned long long)(stats.control_read_ns / requests),
+            (unsigned long long)(stats.backing_ns / requests));
+}
+
+/*
+ * dm-user hands each request to whichever thread is blocked reading the
+ * control device, so every thread opens a control fd of its own and can
+ * optionally be pinned to a CPU.
+ */
+static int simple_daemon(const std::string& control_path, const std::string& backing_path,
+                         int num_threads, bool pin, bool print) {
+    int backing_fd = -1;
+    if (!backing_path.empty()) {
+        backing_fd = open(backing_path.c_str(), O_RDWR);
+        if (backing_fd < 0) {
+            fprintf(stderr, "Unable to open backing device %s\n", backing_path.c_str());
             return -1;
         }
+    }
 
-        switch (type) {
-            case DM_USER_REQ_MAP_READ:
-                if (verbose) std::cerr << "dmuserd: Sending read data\n";
-                if (lseek64(backing_fd, msg.sector * SECTOR_SIZE, SEEK_SET) < 0) {
-                    perror("Unable to seek");
-                    return -1;
-                }
-                if (not_splice(backing_fd, control_fd, msg.len) < 0) {
-                    if (errno == ENOTBLK) return 0;
-                    std::cerr << "unable to handle read data\n";
-                    return -1;
-                }
-                break;
+    std::vector<int> control_fds;
+    for (int i = 0; i < num_threads; i++) {
+        int control_fd = open(control_path.c_str(), O_RDWR);
+        if (control_fd < 0) {
+            fprintf(stderr, "Unable to open control device %s\n", control_path.c_str());
+            return -1;
         }
+        control_fds.push_back(control_fd);
     }
 
-    /* The daemon doesn't actully terminate for this test. */
-    perror("Unable to read from control device");
-    return -1;
+    std::vector<struct stats> stats(num_threads);
+    std::vector<int> results(num_threads);
+    std::vector<std::thread> threads;
+    int num_cpus = MAX(1, (int)std::thread::hardware_concurrency());
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back([&, i]() {
+            if (pin) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i % num_cpus, &set);
+                if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+                    perror("Unable to pin thread");
+                }
+            }
+            results[i] = serve(control_fds[i], backing_fd, &stats[i]);
+        });
+    }
+
+    int r = 0;
+    for (int i = 0; i < num_threads; i++) {
+        threads[i].join();
+        if (results[i]) r = results[i];
+        if (print) print_stats(i, stats[i]);
+        close(control_fds[i]);
+    }
+    if (backing_fd >= 0) close(backing_fd);
+    return r;
 }
 
 void usage(char* prog) {
@@ -282,19 +395,25 @@ void usage(char* prog) {
     printf("	Handles block requests in userspace, backed by memory\n");
     printf("  -h			Display this help message\n");
     printf("  -c <control dev>		Control device to use for the test\n");
-    printf("  -b <store path>		The file to use as a backing store, otherwise memory\n");
+    printf("  -b <store path>		The file to use as a backing store, otherwise reads\n");
+    printf("				return zeroes and writes are dropped\n");
+    printf("  -t <threads>		Number of threads, each with its own control fd\n");
+    printf("  -p			Pin each thread to a CPU\n");
+    printf("  -s			Print per-thread request timings on exit\n");
     printf("  -v                        Enable verbose mode\n");
 }
 
 int main(int argc, char* argv[]) {
     std::string control_path;
     std::string backing_path;
-    char* store;
+    int num_threads = 1;
+    bool pin = false;
+    bool print = false;
     int c;
 
     prctl(PR_SET_IO_FLUSHER, 0, 0, 0, 0);
 
-    while ((c = getopt(argc, argv, "h:c:s:b:v")) != -1) {
+    while ((c = getopt(argc, argv, "hc:b:t:psv")) != -1) {
         switch (c) {
             case 'h':
                 usage(basename(argv[0]));
@@ -305,6 +424,19 @@ int main(int argc, char* argv[]) {
             case 'b':
                 backing_path = optarg;
                 break;
+            case 't':
+                num_threads = atoi(optarg);
+                if (num_threads < 1) {
+                    usage(basename(argv[0]));
+                    exit(1);
+                }
+                break;
+            case 'p':
+                pin = true;
+                break;
+            case 's':
+                print = true;
+                break;
             case 'v':
                 verbose = true;
                 break;
@@ -314,7 +446,7 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    int r = simple_daemon(control_path, backing_path);
+    int r = simple_daemon(control_path, backing_path, num_threads, pin, print);
     if (r) fprintf(stderr, "simple_daemon() errored out\n");
     return r;
 }
@@ -20,12 +20,16 @@
 #include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
 #include <unistd.h>
+#include <algorithm>
 #include <memory>
 
 #include <KeyMintUtils.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android-base/scopeguard.h>
 #include <android/binder_ibinder.h>
 #include <android/binder_manager.h>
 #include <binder/IPCThreadState.h>
@@ -77,7 +81,23 @@ GateKeeperProxy::GateKeeperProxy() {
     }
 }
 
+void GateKeeperProxy::LatencyStats::Add(std::chrono::microseconds latency) {
+    count++;
+    total += latency;
+    max = std::max(max, latency);
+}
+
+static std::chrono::microseconds ElapsedSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                 start);
+}
+
 void GateKeeperProxy::store_sid(uint32_t userId, uint64_t sid) {
+    // Skip rewriting the file if it already holds this sid.
+    if (auto it = sid_cache.find(userId); it != sid_cache.end() && it->second == sid && sid != 0) {
+        return;
+    }
+
     char filename[21];
     snprintf(filename, sizeof(filename), "%u", userId);
     int fd = open(filename, O_WRONLY | O_TRUNC | O_CREAT, S_IRUSR | S_IWUSR);
@@ -85,7 +105,15 @@ void GateKeeperProxy::store_sid(uint32_t userId, uint64_t sid) {
         ALOGE("could not open file: %s: %s", filename, strerror(errno));
         return;
     }
-    write(fd, &sid, sizeof(sid));
+    if (write(fd, &sid, sizeof(sid)) != sizeof(sid)) {
+        ALOGE("could not write file: %s: %s", filename, strerror(errno));
+        sid_cache.erase(userId);
+    } else if (sid != 0) {
+        sid_cache[userId] = sid;
+    } else {
+        // A file holding 0 is neither a valid sid nor a missing file.
+        sid_cache.erase(userId);
+    }
     close(fd);
 }
 
@@ -121,6 +149,13 @@ bool GateKeeperProxy::mark_cold_boot() {
 }
 
 void GateKeeperProxy::maybe_store_sid(uint32_t userId, uint64_t sid) {
+    if (auto it = sid_cache.find(userId); it != sid_cache.end()) {
+        if (it->second == 0) {
+            store_sid(userId, sid);
+        }
+        return;
+    }
+
     char filename[21];
     snprintf(filename, sizeof(filename), "%u", userId);
     if (access(filename, F_OK) == -1) {
@@ -129,12 +164,21 @@ void GateKeeperProxy::maybe_store_sid(uint32_t userId, uint64_t sid) {
 }
 
 uint64_t GateKeeperProxy::read_sid(uint32_t userId) {
+    if (auto it = sid_cache.find(userId); it != sid_cache.end()) {
+        return it->second;
+    }
+
     char filename[21];
-    uint64_t sid;
+    uint64_t sid = 0;
     snprintf(filename, sizeof(filename), "%u", userId);
     int fd = open(filename, O_RDONLY);
-    if (fd < 0) return 0;
-    read(fd, &sid, sizeof(sid));
+    if (fd < 0) {
+        if (errno == ENOENT) sid_cache[userId] = 0;
+        return 0;
+    }
+    if (read(fd, &sid, sizeof(sid)) == sizeof(sid) && sid != 0) {
+        sid_cache[userId] = sid;
+    }
     close(fd);
     return sid;
 }
@@ -145,7 +189,9 @@ void GateKeeperProxy::clear_sid(uint32_t userId) {
     if (remove(filename) < 0 && errno != ENOENT) {
         ALOGE("%s: could not remove file [%s], attempting 0 write", __func__, strerror(errno));
         store_sid(userId, 0);
+        return;
     }
+    sid_cache[userId] = 0;
 }
 
 Status GateKeeperProxy::adjust_userId(uint32_t userId, uint32_t* hw_userId) {
@@ -166,6 +212,14 @@ Status GateKeeperProxy::adjust_userId(uint32_t userId, uint32_t* hw_userId) {
     return Status::ok();
 }
 
+std::shared_ptr<IKeystoreAuthorization> GateKeeperProxy::get_authorization_service() {
+    if (!authz_service) {
+        ::ndk::SpAIBinder authzBinder(AServiceManager_getService("android.security.authorization"));
+        authz_service = IKeystoreAuthorization::fromBinder(authzBinder);
+    }
+    return authz_service;
+}
+
 #define GK_ERROR *gkResponse = GKResponse::error(), Status::ok()
 
 Status GateKeeperProxy::enroll(int32_t userId,
@@ -173,6 +227,10 @@ Status GateKeeperProxy::enroll(int32_t userId,
                                const std::optional<std::vector<uint8_t>>& currentPassword,
                                const std::vector<uint8_t>& desiredPassword,
                                GKResponse* gkResponse) {
+    auto start = std::chrono::steady_clock::now();
+    auto record_latency =
+            android::base::make_scope_guard([&] { enroll_latency.Add(ElapsedSince(start)); });
+
     IPCThreadState* ipc = IPCThreadState::self();
     const int calling_pid = ipc->getCallingPid();
     const int calling_uid = ipc->getCallingUid();
@@ -294,6 +352,10 @@ Status GateKeeperProxy::verifyChallenge(int32_t userId, int64_t challenge,
                                         const std::vector<uint8_t>& enrolledPasswordHandle,
                                         const std::vector<uint8_t>& providedPassword,
                                         GKResponse* gkResponse) {
+    auto start = std::chrono::steady_clock::now();
+    auto record_latency =
+            android::base::make_scope_guard([&] { verify_latency.Add(ElapsedSince(start)); });
+
     IPCThreadState* ipc = IPCThreadState::self();
     const int calling_pid = ipc->getCallingPid();
     const int calling_uid = ipc->getCallingUid();
@@ -331,10 +393,12 @@ Status GateKeeperProxy::verifyChallenge(int32_t userId, int64_t challenge,
                              providedPassword.size());
 
     uint64_t secureUserId = 0;
+    auto hal_start = std::chrono::steady_clock::now();
     if (aidl_hw_device) {
         // AIDL gatekeeper service
         AidlGatekeeperVerifyResp rsp;
         auto result = aidl_hw_device->verify(hw_userId, challenge, curPwdHandle, enteredPwd, &rsp);
+        hal_verify_latency.Add(ElapsedSince(hal_start));
         if (!result.isOk()) {
             LOG(ERROR) << "verify transaction failed";
             return GK_ERROR;
@@ -365,6 +429,7 @@ Status GateKeeperProxy::verifyChallenge(int32_t userId, int64_t challenge,
                         *gkResponse = GKResponse::error();
                     }
                 });
+        hal_verify_latency.Add(ElapsedSince(hal_start));
 
         if (!hwRes.isOk()) {
             LOG(ERROR) << "verify transaction failed";
@@ -379,9 +444,7 @@ Status GateKeeperProxy::verifyChallenge(int32_t userId, int64_t challenge,
     if (gkResponse->response_code() == GKResponseCode::OK) {
         if (gkResponse->payload().size() != 0) {
             // try to connect to IKeystoreAuthorization AIDL service first.
-            AIBinder* authzAIBinder = AServiceManager_getService("android.security.authorization");
-            ::ndk::SpAIBinder authzBinder(authzAIBinder);
-            auto authzService = IKeystoreAuthorization::fromBinder(authzBinder);
+            auto authzService = get_authorization_service();
             if (authzService) {
                 if (gkResponse->payload().size() != sizeof(hw_auth_token_t)) {
                     LOG(ERROR) << "Incorrect size of AuthToken payload.";
@@ -400,6 +463,13 @@ Status GateKeeperProxy::verifyChallenge(int32_t userId, int64_t challenge,
                         betoh32(hwAuthToken->authenticator_type));
                 authToken.mac.assign(&hwAuthToken->hmac[0], &hwAuthToken->hmac[32]);
                 auto result = authzService->addAuthToken(authToken);
+                if (result.getStatus() == STATUS_DEAD_OBJECT) {
+                    // Keystore restarted since we connected; reconnect once.
+                    authz_service.reset();
+                    if ((authzService = get_authorization_service())) {
+                        result = authzService->addAuthToken(authToken);
+                    }
+                }
                 if (!result.isOk()) {
                     LOG(ERROR) << "Failure in sending AuthToken to AuthorizationService.";
                     return GK_ERROR;
@@ -475,6 +545,15 @@ status_t GateKeeperProxy::dump(int fd, const Vector<String16>&) {
         write(fd, result, strlen(result) + 1);
     }
 
+    auto dump_latency = [fd](const char* name, const LatencyStats& stats) {
+        auto avg = stats.count ? stats.total.count() / stats.count : 0;
+        dprintf(fd, "\n%s: count=%" PRIu64 " avg=%lldus max=%lldus", name, stats.count,
+                static_cast<long long>(avg), static_cast<long long>(stats.max.count()));
+    };
+    dump_latency("verify", verify_latency);
+    dump_latency("verify (HAL)", hal_verify_latency);
+    dump_latency("enroll", enroll_latency);
+
     return OK;
 }
 }  // namespace android
@@ -14,7 +14,12 @@
  * limitations under the License.
  */
 
+#include <chrono>
+#include <map>
+#include <memory>
+
 #include <aidl/android/hardware/gatekeeper/IGatekeeper.h>
+#include <aidl/android/security/authorization/IKeystoreAuthorization.h>
 #include <android/hardware/gatekeeper/1.0/IGatekeeper.h>
 #include <android/service/gatekeeper/BnGateKeeperService.h>
 #include <gatekeeper/GateKeeperResponse.h>
@@ -24,6 +29,7 @@ using AidlIGatekeeper = ::aidl::android::hardware::gatekeeper::IGatekeeper;
 using ::android::binder::Status;
 using ::android::service::gatekeeper::BnGateKeeperService;
 using GKResponse = ::android::service::gatekeeper::GateKeeperResponse;
+using ::aidl::android::security::authorization::IKeystoreAuthorization;
 
 namespace android {
 
@@ -72,11 +78,37 @@ class GateKeeperProxy : public BnGateKeeperService {
     status_t dump(int fd, const Vector<String16>&) override;
 
   private:
+    // Latency of one kind of request, reported by dump().
+    struct LatencyStats {
+        uint64_t count = 0;
+        std::chrono::microseconds total{0};
+        std::chrono::microseconds max{0};
+
+        void Add(std::chrono::microseconds latency);
+    };
+
+    // Returns the keystore authorization service, connecting on first use.
+    std::shared_ptr<IKeystoreAuthorization> get_authorization_service();
+
     // AIDL gatekeeper service.
     std::shared_ptr<AidlIGatekeeper> aidl_hw_device;
     // HIDL gatekeeper service.
     sp<IGatekeeper> hw_device;
 
+    // Keystore authorization service, kept across verify calls.
+    std::shared_ptr<IKeystoreAuthorization> authz_service;
+
+    // Secure user ids, cached from the per-user files in the working
+    // directory. An entry of 0 means the file does not exist. Binder calls
+    // are handled on a single thread, so this needs no locking.
+    std::map<uint32_t, uint64_t> sid_cache;
+
+    // Time spent in the HAL, and in the whole verify call, which is the
+    // gatekeeper share of unlock latency.
+    LatencyStats hal_verify_latency;
+    LatencyStats verify_latency;
+    LatencyStats enroll_latency;
+
     bool clear_state_if_needed_done;
     bool is_running_gsi;
 };
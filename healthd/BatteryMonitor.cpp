@@ -28,13 +28,18 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <set>
+#include <string>
 
 #include <aidl/android/hardware/health/HealthInfo.h>
 #include <android-base/file.h>
 #include <android-base/parseint.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <android/hardware/health/2.1/types.h>
 #include <android/hardware/health/translate-ndk.h>
 #include <batteryservice/BatteryService.h>
@@ -285,9 +290,47 @@ BatteryChargingState getBatteryChargingState(const char* chargingState) {
     return *ret;
 }
 
+// Keeps the sysfs attributes that are read on every update open. sysfs regenerates an attribute
+// on each read from offset 0, so a pread() gets the current value without the open(), fstat()
+// and close() of ReadFileToString.
+class SysfsFileCache {
+  public:
+    bool read(const char* path, std::string* buf) {
+        std::lock_guard<std::mutex> lock(mLock);
+        auto it = mFds.find(path);
+        if (it != mFds.end()) {
+            if (preadAll(it->second.get(), buf)) return true;
+            // The attribute went away, e.g. along with its power supply. It may be back.
+            mFds.erase(it);
+        }
+        android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path, O_RDONLY | O_CLOEXEC)));
+        if (fd == -1 || !preadAll(fd.get(), buf)) return false;
+        mFds.emplace(path, std::move(fd));
+        return true;
+    }
+
+  private:
+    static bool preadAll(int fd, std::string* buf) {
+        // Attributes are at most a page; anything longer isn't one of ours.
+        char data[4096];
+        ssize_t n = TEMP_FAILURE_RETRY(pread(fd, data, sizeof(data), 0));
+        if (n < 0) return false;
+        buf->assign(data, n);
+        return true;
+    }
+
+    std::mutex mLock;
+    std::map<std::string, android::base::unique_fd> mFds;
+};
+
+static SysfsFileCache& sysfsFileCache() {
+    static auto* cache = new SysfsFileCache();
+    return *cache;
+}
+
 static int readFromFile(const String8& path, std::string* buf) {
     buf->clear();
-    if (android::base::ReadFileToString(path.c_str(), buf)) {
+    if (sysfsFileCache().read(path.c_str(), buf)) {
         *buf = android::base::Trim(*buf);
     }
     return buf->length();
@@ -452,6 +495,7 @@ void BatteryMonitor::updateValues(void) {
     } else {
         struct dirent* entry;
         String8 path;
+        std::set<std::string> seen;
 
         mChargerNames.clear();
 
@@ -460,6 +504,18 @@ void BatteryMonitor::updateValues(void) {
 
             if (!strcmp(name, ".") || !strcmp(name, ".."))
                 continue;
+            seen.insert(name);
+
+            // A supply stays a charger or not for as long as it exists; only those of unknown
+            // type are looked at again.
+            auto cached = mPowerSupplyIsCharger.find(name);
+            if (cached != mPowerSupplyIsCharger.end()) {
+                if (cached->second) mChargerNames.add(String8(name));
+                continue;
+            }
+
+            bool isCharger = false;
+            bool known = true;
 
             // Look for "type" file in each subdirectory
             path.clear();
@@ -472,7 +528,10 @@ void BatteryMonitor::updateValues(void) {
                 path.clear();
                 path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH, name);
                 if (access(path.c_str(), R_OK) == 0)
-                    mChargerNames.add(String8(name));
+                    isCharger = true;
+                break;
+            case ANDROID_POWER_SUPPLY_TYPE_UNKNOWN:
+                known = false;
                 break;
             default:
                 break;
@@ -485,8 +544,20 @@ void BatteryMonitor::updateValues(void) {
                 path.clear();
                 path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH, name);
                 if (access(path.c_str(), R_OK) == 0)
-                    mChargerNames.add(String8(name));
+                    isCharger = true;
+
+            }
+
+            if (known) mPowerSupplyIsCharger[name] = isCharger;
+            if (isCharger) mChargerNames.add(String8(name));
+        }
 
+        // Forget supplies that went away, in case one comes back with the same name.
+        for (auto it = mPowerSupplyIsCharger.begin(); it != mPowerSupplyIsCharger.end();) {
+            if (seen.count(it->first) == 0) {
+                it = mPowerSupplyIsCharger.erase(it);
+            } else {
+                ++it;
             }
         }
     }
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <health/utils.h>
+#include <healthd/BatteryMonitor.h>
+
+using android::BatteryMonitor;
+using android::hardware::health::InitHealthdConfig;
+
+// One refresh of the health info, as done on every uevent and periodic poll.
+static void BM_updateValues(benchmark::State& state) {
+    struct healthd_config config;
+    InitHealthdConfig(&config);
+    BatteryMonitor monitor;
+    monitor.init(&config);
+    for (auto _ : state) {
+        monitor.updateValues();
+    }
+}
+BENCHMARK(BM_updateValues);
+
+BENCHMARK_MAIN();
@@ -83,25 +83,47 @@ HealthdDraw::~HealthdDraw() {}
 
 void HealthdDraw::redraw_screen(const animation* batt_anim, GRSurface* surf_unknown) {
     if (!graphics_available) return;
-    clear_screen();
 
     /* try to display *something* */
-    if (batt_anim->cur_status == BATTERY_STATUS_UNKNOWN || batt_anim->cur_level < 0 ||
-        batt_anim->num_frames == 0)
+    screen_state state;
+    state.valid = true;
+    state.unknown = batt_anim->cur_status == BATTERY_STATUS_UNKNOWN || batt_anim->cur_level < 0 ||
+                    batt_anim->num_frames == 0;
+    if (state.unknown) {
+        state.surface = surf_unknown;
+    } else {
+        state.surface = batt_anim->frames[batt_anim->cur_frame].surface;
+        state.clock = clock_text(batt_anim);
+        state.percent = percent_text(batt_anim);
+    }
+
+    // Most ticks of a full or first-frame animation land on the frame already on screen, and
+    // the clock only changes once a minute. Skip the clear, blit and page flip for those.
+    if (state == last_state_) {
+        LOGV("screen unchanged, skipping redraw\n");
+        return;
+    }
+
+    clear_screen();
+    if (state.unknown)
         draw_unknown(surf_unknown);
     else
         draw_battery(batt_anim);
     gr_flip();
+    last_state_ = std::move(state);
 }
 
 void HealthdDraw::blank_screen(bool blank, int drm) {
     if (!graphics_available) return;
     gr_fb_blank(blank, drm);
+    // The next redraw may target another display, or one that lost its contents.
+    last_state_.valid = false;
 }
 
 // support screen rotation for foldable phone
 void HealthdDraw::rotate_screen(int drm) {
     if (!graphics_available) return;
+    last_state_.valid = false;
     if (drm == 0)
         gr_rotate(GRRotation::RIGHT /* landscape mode */);
     else
@@ -176,15 +198,13 @@ void HealthdDraw::determine_xy(const animation::text_field& field,
   }
 }
 
-void HealthdDraw::draw_clock(const animation* anim) {
+std::string HealthdDraw::clock_text(const animation* anim) {
     static constexpr char CLOCK_FORMAT[] = "%H:%M";
     static constexpr int CLOCK_LENGTH = 6;
 
     const animation::text_field& field = anim->text_clock;
-
-    if (!graphics_available || field.font == nullptr || field.font->char_width == 0 ||
-        field.font->char_height == 0)
-        return;
+    if (field.font == nullptr || field.font->char_width == 0 || field.font->char_height == 0)
+        return "";
 
     time_t rawtime;
     time(&rawtime);
@@ -194,33 +214,49 @@ void HealthdDraw::draw_clock(const animation* anim) {
     size_t length = strftime(clock_str, CLOCK_LENGTH, CLOCK_FORMAT, time_info);
     if (length != CLOCK_LENGTH - 1) {
         LOGE("Could not format time\n");
-        return;
+        return "";
     }
-
-    int x, y;
-    determine_xy(field, length, &x, &y);
-
-    LOGV("drawing clock %s %d %d\n", clock_str, x, y);
-    gr_color(field.color_r, field.color_g, field.color_b, field.color_a);
-    draw_text(field.font, x, y, clock_str);
+    return std::string(clock_str, length);
 }
 
-void HealthdDraw::draw_percent(const animation* anim) {
-    if (!graphics_available) return;
+std::string HealthdDraw::percent_text(const animation* anim) {
     int cur_level = anim->cur_level;
     if (anim->cur_status == BATTERY_STATUS_FULL) {
         cur_level = 100;
     }
 
-    if (cur_level < 0) return;
+    if (cur_level < 0) return "";
 
     const animation::text_field& field = anim->text_percent;
     if (field.font == nullptr || field.font->char_width == 0 || field.font->char_height == 0) {
-        return;
+        return "";
     }
 
-    std::string str = base::StringPrintf("%d%%", cur_level);
+    return base::StringPrintf("%d%%", cur_level);
+}
+
+void HealthdDraw::draw_clock(const animation* anim) {
+    if (!graphics_available) return;
+
+    std::string str = clock_text(anim);
+    if (str.empty()) return;
+
+    const animation::text_field& field = anim->text_clock;
+    int x, y;
+    determine_xy(field, str.size(), &x, &y);
 
+    LOGV("drawing clock %s %d %d\n", str.c_str(), x, y);
+    gr_color(field.color_r, field.color_g, field.color_b, field.color_a);
+    draw_text(field.font, x, y, str.c_str());
+}
+
+void HealthdDraw::draw_percent(const animation* anim) {
+    if (!graphics_available) return;
+
+    std::string str = percent_text(anim);
+    if (str.empty()) return;
+
+    const animation::text_field& field = anim->text_percent;
     int x, y;
     determine_xy(field, str.size(), &x, &y);
 
@@ -20,6 +20,8 @@
 #include <linux/input.h>
 #include <minui/minui.h>
 
+#include <string>
+
 #include "animation.h"
 
 using namespace android;
@@ -28,7 +30,8 @@ class HealthdDraw {
  public:
   virtual ~HealthdDraw();
 
-  // Redraws screen.
+  // Redraws screen. Does nothing if the screen would look the same as after
+  // the last redraw.
   void redraw_screen(const animation* batt_anim, GRSurface* surf_unknown);
 
   // According to the index of Direct Rendering Manager,
@@ -87,6 +90,26 @@ class HealthdDraw {
  private:
   // Configures font using given animation.
   HealthdDraw(animation* anim);
+
+  // Returns the clock text, or an empty string if there is no clock.
+  std::string clock_text(const animation* anim);
+  // Returns the battery percentage text, or an empty string if there is none.
+  std::string percent_text(const animation* anim);
+
+  // What the last redraw_screen() put on screen.
+  struct screen_state {
+    bool valid = false;
+    bool unknown = false;
+    GRSurface* surface = nullptr;
+    std::string clock;
+    std::string percent;
+
+    bool operator==(const screen_state& other) const {
+      return valid == other.valid && unknown == other.unknown && surface == other.surface &&
+             clock == other.clock && percent == other.percent;
+    }
+  };
+  screen_state last_state_;
 };
 
 #endif  // HEALTHD_DRAW_H
@@ -17,8 +17,10 @@
 #ifndef HEALTHD_BATTERYMONITOR_H
 #define HEALTHD_BATTERYMONITOR_H
 
+#include <map>
 #include <memory>
 #include <optional>
+#include <string>
 
 #include <batteryservice/BatteryService.h>
 #include <utils/String8.h>
@@ -95,6 +97,8 @@ class BatteryMonitor {
   private:
     struct healthd_config *mHealthdConfig;
     Vector<String8> mChargerNames;
+    // Power supply name -> whether it is a charger, for supplies of known type.
+    std::map<std::string, bool> mPowerSupplyIsCharger;
     bool mBatteryDevicePresent;
     int mBatteryFixedCapacity;
     int mBatteryFixedTemperature;
@@ -143,24 +143,66 @@ size_t Action::CheckAllCommands() const {
     return failures;
 }
 
-void Action::ExecuteOneCommand(std::size_t command) const {
-    // We need a copy here since some Command execution may result in
-    // changing commands_ vector by importing .rc files through parser
-    Command cmd = commands_[command];
-    ExecuteCommand(cmd);
+// Upper bound on how many vendor commands are sent to the subcontext at once, so that the main
+// loop still gets to run between batches of a long action.
+static constexpr std::size_t kMaxSubcontextBatchSize = 16;
+
+std::size_t Action::ExecuteCommandsFrom(std::size_t command) const {
+    std::size_t batch_end = command;
+    if (subcontext_) {
+        while (batch_end < commands_.size() && batch_end - command < kMaxSubcontextBatchSize &&
+               commands_[batch_end].execute_in_subcontext()) {
+            ++batch_end;
+        }
+    }
+
+    if (batch_end - command < 2) {
+        // We need a copy here since some Command execution may result in
+        // changing commands_ vector by importing .rc files through parser
+        Command cmd = commands_[command];
+        ExecuteCommand(cmd);
+        return 1;
+    }
+
+    // Commands that run in the subcontext cannot modify commands_, so they are referenced in place.
+    std::vector<const std::vector<std::string>*> batch;
+    for (std::size_t i = command; i < batch_end; ++i) {
+        batch.emplace_back(&commands_[i].args());
+    }
+
+    android::base::Timer t;
+    auto results = subcontext_->ExecuteBatch(batch);
+    if (!results.ok()) {
+        // The subcontext has been restarted and there is no telling how far it got, so report each
+        // command of the batch as failed rather than running any of them a second time.
+        auto duration = t.duration();
+        Result<void> failure = results.error();
+        for (std::size_t i = command; i < batch_end; ++i) {
+            LogCommandResult(commands_[i], failure, duration);
+        }
+        return batch_end - command;
+    }
+
+    for (std::size_t i = 0; i < results->size(); ++i) {
+        LogCommandResult(commands_[command + i], (*results)[i].result, (*results)[i].duration);
+    }
+    return results->size();
 }
 
 void Action::ExecuteAllCommands() const {
-    for (const auto& c : commands_) {
-        ExecuteCommand(c);
+    for (std::size_t i = 0; i < commands_.size();) {
+        i += ExecuteCommandsFrom(i);
     }
 }
 
 void Action::ExecuteCommand(const Command& command) const {
     android::base::Timer t;
     auto result = command.InvokeFunc(subcontext_);
-    auto duration = t.duration();
+    LogCommandResult(command, result, t.duration());
+}
 
+void Action::LogCommandResult(const Command& command, const Result<void>& result,
+                              std::chrono::milliseconds duration) const {
     // Any action longer than 50ms will be warned to user as slow operation
     if (!result.has_value() || duration > 50ms ||
         android::base::GetMinimumLogSeverity() <= android::base::DEBUG) {
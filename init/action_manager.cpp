@@ -16,8 +16,17 @@
 
 #include "action_manager.h"
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 
+#ifdef INIT_FULL_SOURCES
+#include "apex_init_util.h"
+#include "bootchart.h"
+#else
+#include "host_init_stubs.h"
+#endif
+
 namespace android {
 namespace init {
 
@@ -37,9 +46,65 @@ ActionManager& ActionManager::GetInstance() {
 }
 
 void ActionManager::AddAction(std::unique_ptr<Action> action) {
+    IndexAction(action.get());
     actions_.emplace_back(std::move(action));
 }
 
+void ActionManager::IndexAction(const Action* action) {
+    if (!action->event_trigger().empty()) {
+        return;
+    }
+    for (const auto& [name, value] : action->property_triggers()) {
+        property_trigger_index_[name].emplace_back(action);
+    }
+}
+
+void ActionManager::UnindexAction(const Action* action) {
+    for (const auto& [name, value] : action->property_triggers()) {
+        auto it = property_trigger_index_.find(name);
+        if (it == property_trigger_index_.end()) {
+            continue;
+        }
+        auto& candidates = it->second;
+        candidates.erase(std::remove(candidates.begin(), candidates.end(), action),
+                         candidates.end());
+        if (candidates.empty()) {
+            property_trigger_index_.erase(it);
+        }
+    }
+}
+
+void ActionManager::RebuildPropertyTriggerIndex() {
+    property_trigger_index_.clear();
+    for (const auto& action : actions_) {
+        IndexAction(action.get());
+    }
+}
+
+// Only the actions indexed under the changed property can match a named property change, so
+// check just those rather than every action. An empty name (QueueAllPropertyActions()) still
+// goes through the full scan in ExecuteOneCommand().
+void ActionManager::QueuePropertyChangeActions(const PropertyChange& property_change) {
+    const auto& [name, value] = property_change;
+    auto it = property_trigger_index_.find(name);
+    size_t num_candidates = it == property_trigger_index_.end() ? 0 : it->second.size();
+    property_trigger_checks_saved_ += actions_.size() - num_candidates;
+
+    if (name == "sys.boot_completed" && value == "1") {
+        LOG(INFO) << "Property trigger index saved " << property_trigger_checks_saved_
+                  << " action trigger checks during boot";
+    }
+
+    if (it == property_trigger_index_.end()) {
+        return;
+    }
+    for (const auto* action : it->second) {
+        if (action->CheckEvent(property_change)) {
+            current_executing_actions_.emplace(action);
+        }
+    }
+}
+
 void ActionManager::QueueEventTrigger(const std::string& trigger) {
     auto lock = std::lock_guard{event_queue_lock_};
     event_queue_.emplace(trigger);
@@ -69,10 +134,19 @@ void ActionManager::ExecuteOneCommand() {
         auto lock = std::lock_guard{event_queue_lock_};
         // Loop through the event queue until we have an action to execute
         while (current_executing_actions_.empty() && !event_queue_.empty()) {
-            for (const auto& action : actions_) {
-                if (std::visit([&action](const auto& event) { return action->CheckEvent(event); },
-                               event_queue_.front())) {
-                    current_executing_actions_.emplace(action.get());
+            const auto& event = event_queue_.front();
+            if (auto property_change = std::get_if<PropertyChange>(&event);
+                property_change && !property_change->first.empty()) {
+                QueuePropertyChangeActions(*property_change);
+            } else {
+                if (auto trigger = std::get_if<EventTrigger>(&event)) {
+                    ParseLazyRcScriptsForTrigger(*trigger);
+                }
+                for (const auto& action : actions_) {
+                    if (std::visit([&action](const auto& e) { return action->CheckEvent(e); },
+                                   event)) {
+                        current_executing_actions_.emplace(action.get());
+                    }
                 }
             }
             event_queue_.pop();
@@ -89,18 +163,19 @@ void ActionManager::ExecuteOneCommand() {
         std::string trigger_name = action->BuildTriggersString();
         LOG(INFO) << "processing action (" << trigger_name << ") from (" << action->filename()
                   << ":" << action->line() << ")";
+        BootchartAnnotate("action " + trigger_name);
     }
 
-    action->ExecuteOneCommand(current_command_);
+    current_command_ += action->ExecuteCommandsFrom(current_command_);
 
     // If this was the last command in the current action, then remove
     // the action from the executing list.
     // If this action was oneshot, then also remove it from actions_.
-    ++current_command_;
     if (current_command_ == action->NumCommands()) {
         current_executing_actions_.pop();
         current_command_ = 0;
         if (action->oneshot()) {
+            UnindexAction(action);
             auto eraser = [&action](std::unique_ptr<Action>& a) { return a.get() == action; };
             actions_.erase(std::remove_if(actions_.begin(), actions_.end(), eraser),
                            actions_.end());
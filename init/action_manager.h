@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <map>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -40,6 +41,7 @@ class ActionManager {
     template <class UnaryPredicate>
     void RemoveActionIf(UnaryPredicate predicate) {
         actions_.erase(std::remove_if(actions_.begin(), actions_.end(), predicate), actions_.end());
+        RebuildPropertyTriggerIndex();
     }
     void QueueEventTrigger(const std::string& trigger);
     void QueuePropertyChange(const std::string& name, const std::string& value);
@@ -50,17 +52,29 @@ class ActionManager {
     void DumpState() const;
     void ClearQueue();
     auto size() const { return actions_.size(); }
+    // Number of Action::CheckEvent() calls that the property trigger index avoided.
+    size_t property_trigger_checks_saved() const { return property_trigger_checks_saved_; }
 
   private:
     ActionManager(ActionManager const&) = delete;
     void operator=(ActionManager const&) = delete;
 
+    void IndexAction(const Action* action);
+    void UnindexAction(const Action* action);
+    void RebuildPropertyTriggerIndex();
+    void QueuePropertyChangeActions(const PropertyChange& property_change);
+
     std::vector<std::unique_ptr<Action>> actions_;
     std::queue<std::variant<EventTrigger, PropertyChange, BuiltinAction>> event_queue_
             GUARDED_BY(event_queue_lock_);
     mutable std::mutex event_queue_lock_;
     std::queue<const Action*> current_executing_actions_;
     std::size_t current_command_;
+
+    // Maps a property name to the actions, in the order of actions_, that can be triggered by a
+    // change of that property: those with no event trigger and a 'property:<name>=' trigger.
+    std::map<std::string, std::vector<const Action*>> property_trigger_index_;
+    size_t property_trigger_checks_saved_ = 0;
 };
 
 }  // namespace init
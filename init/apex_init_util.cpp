@@ -19,6 +19,8 @@
 #include <dirent.h>
 #include <glob.h>
 
+#include <algorithm>
+#include <optional>
 #include <set>
 #include <vector>
 
@@ -101,23 +103,76 @@ std::set<std::string> GetApexListFrom(const std::string& apex_dir) {
     return apex_list;
 }
 
-static Result<void> ParseRcScripts(const std::vector<std::string>& files) {
-    if (files.empty()) {
-        return {};
+// An APEX RC script that has only been indexed, together with the names whose first use
+// causes it to be parsed.
+struct LazyRcScript {
+    std::string path;
+    std::set<std::string> services;
+    std::set<std::string> classnames;
+    std::set<std::string> event_triggers;
+};
+
+static std::vector<LazyRcScript> lazy_rc_scripts;
+
+// Scans an RC script for the services, service classes and event triggers that it declares.
+// Returns std::nullopt for scripts that have to be parsed right away: anything with property
+// triggers, interfaces or imports can be needed without init asking for it by name.
+static std::optional<LazyRcScript> IndexRcScript(const std::string& path) {
+    auto lines = Parser::ReadAndTokenize(path);
+    if (!lines.ok()) {
+        // Parsing it eagerly reports the error.
+        return std::nullopt;
     }
-    // APEXes can have versioned RC files. These should be filtered based on
-    // SDK version.
-    int sdk = android::base::GetIntProperty("ro.build.version.sdk", INT_MAX);
-    if (sdk < 35) sdk = 35;  // aosp/main merges only into sdk=35+ (ie. __ANDROID_API_V__+)
-    auto filtered = FilterVersionedConfigs(files, sdk);
-    if (filtered.empty()) {
-        return {};
+
+    LazyRcScript script{.path = path};
+    bool in_service = false;
+    bool has_class = false;
+    auto end_service = [&]() {
+        if (in_service && !has_class) {
+            script.classnames.emplace("default");
+        }
+        in_service = false;
+    };
+    for (const auto& line : *lines) {
+        const auto& args = line.args;
+        if (args[0] == "service") {
+            end_service();
+            if (args.size() < 2) {
+                return std::nullopt;
+            }
+            script.services.emplace(args[1]);
+            in_service = true;
+            has_class = false;
+        } else if (args[0] == "on") {
+            end_service();
+            if (args.size() < 2) {
+                return std::nullopt;
+            }
+            for (size_t i = 1; i < args.size(); ++i) {
+                if (args[i] == "&&") continue;
+                if (android::base::StartsWith(args[i], "property:")) {
+                    return std::nullopt;
+                }
+                script.event_triggers.emplace(args[i]);
+            }
+        } else if (args[0] == "import") {
+            return std::nullopt;
+        } else if (in_service && args[0] == "interface") {
+            return std::nullopt;
+        } else if (in_service && args[0] == "class") {
+            script.classnames.insert(args.begin() + 1, args.end());
+            has_class = true;
+        }
     }
+    end_service();
+    return script;
+}
 
+static Result<void> ParseFilteredRcScripts(const std::vector<std::string>& files) {
     Parser parser =
             CreateApexConfigParser(ActionManager::GetInstance(), ServiceList::GetInstance());
     std::vector<std::string> errors;
-    for (const auto& c : filtered) {
+    for (const auto& c : files) {
         auto result = parser.ParseConfigFile(c);
         // We should handle other config files even when there's an error.
         if (!result.ok()) {
@@ -130,6 +185,85 @@ static Result<void> ParseRcScripts(const std::vector<std::string>& files) {
     return {};
 }
 
+static Result<void> ParseRcScripts(const std::vector<std::string>& files) {
+    if (files.empty()) {
+        return {};
+    }
+    // APEXes can have versioned RC files. These should be filtered based on
+    // SDK version.
+    int sdk = android::base::GetIntProperty("ro.build.version.sdk", INT_MAX);
+    if (sdk < 35) sdk = 35;  // aosp/main merges only into sdk=35+ (ie. __ANDROID_API_V__+)
+    auto filtered = FilterVersionedConfigs(files, sdk);
+    if (filtered.empty()) {
+        return {};
+    }
+
+    if (android::base::GetBoolProperty("ro.init.lazy_apex_rc", false)) {
+        std::vector<std::string> eager;
+        for (const auto& c : filtered) {
+            if (auto script = IndexRcScript(c); script) {
+                lazy_rc_scripts.emplace_back(std::move(*script));
+            } else {
+                eager.emplace_back(c);
+            }
+        }
+        LOG(INFO) << "Indexed " << filtered.size() - eager.size() << " apex configs for lazy "
+                  << "loading, parsing " << eager.size() << " now";
+        filtered = std::move(eager);
+    }
+
+    return ParseFilteredRcScripts(filtered);
+}
+
+// Parses, in the order they were indexed, the lazy RC scripts that match |pred|.
+template <typename F>
+static bool ParseLazyRcScriptsIf(F pred) {
+    std::vector<std::string> files;
+    auto it = std::stable_partition(lazy_rc_scripts.begin(), lazy_rc_scripts.end(),
+                                    [&pred](const LazyRcScript& s) { return !pred(s); });
+    for (auto i = it; i != lazy_rc_scripts.end(); ++i) {
+        files.emplace_back(std::move(i->path));
+    }
+    // Erase them before parsing, so that nothing the parser does can pick them up a second time.
+    lazy_rc_scripts.erase(it, lazy_rc_scripts.end());
+    if (files.empty()) {
+        return false;
+    }
+
+    LOG(INFO) << "Lazily parsing apex configs: " << base::Join(files, ", ");
+    if (auto result = ParseFilteredRcScripts(files); !result.ok()) {
+        LOG(ERROR) << result.error();
+    }
+    return true;
+}
+
+bool ParseLazyRcScriptsForService(const std::string& name) {
+    return ParseLazyRcScriptsIf([&name](const auto& s) { return s.services.count(name) > 0; });
+}
+
+Service* FindOrParseApexService(const std::string& name) {
+    auto& service_list = ServiceList::GetInstance();
+    Service* service = service_list.FindService(name);
+    if (!service && ParseLazyRcScriptsForService(name)) {
+        service = service_list.FindService(name);
+    }
+    return service;
+}
+
+void ParseLazyRcScriptsForClass(const std::string& classname) {
+    ParseLazyRcScriptsIf([&classname](const auto& s) { return s.classnames.count(classname) > 0; });
+}
+
+void ParseLazyRcScriptsForTrigger(const std::string& trigger) {
+    ParseLazyRcScriptsIf([&trigger](const auto& s) { return s.event_triggers.count(trigger) > 0; });
+}
+
+void DropLazyRcScriptsFromApex(const std::string& apex_name) {
+    std::erase_if(lazy_rc_scripts, [&apex_name](const LazyRcScript& s) {
+        return GetApexNameFromFileName(s.path) == apex_name;
+    });
+}
+
 Result<void> ParseRcScriptsFromApex(const std::string& apex_name) {
     auto configs = OR_RETURN(CollectRcScriptsFromApex(apex_name, /*skip_apexes=*/{}));
     return ParseRcScripts(configs);
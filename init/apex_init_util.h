@@ -25,6 +25,8 @@
 namespace android {
 namespace init {
 
+class Service;
+
 // Scans apex_dir (/apex) to get the list of active APEXes.
 std::set<std::string> GetApexListFrom(const std::string& apex_dir);
 
@@ -34,5 +36,18 @@ Result<void> ParseRcScriptsFromApex(const std::string& apex_name);
 // Parse all RC scripts for all apexes under /apex.
 Result<void> ParseRcScriptsFromAllApexes(bool bootstrap);
 
+// With ro.init.lazy_apex_rc=true, the functions above only index APEX RC scripts that declare
+// nothing but services and event-triggered actions. Such a script is parsed the first time one of
+// its services, service classes or triggers is needed, through the functions below.
+// ParseLazyRcScriptsForService() returns whether anything was parsed.
+bool ParseLazyRcScriptsForService(const std::string& name);
+// Like ServiceList::FindService(), but first parses the lazy RC script declaring |name| if needed.
+Service* FindOrParseApexService(const std::string& name);
+void ParseLazyRcScriptsForClass(const std::string& classname);
+void ParseLazyRcScriptsForTrigger(const std::string& trigger);
+
+// Forgets the scripts of an APEX being unloaded that were never parsed.
+void DropLazyRcScriptsFromApex(const std::string& apex_name);
+
 }  // namespace init
 }  // namespace android
@@ -18,6 +18,7 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -28,18 +29,27 @@
 
 #include <chrono>
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <string_view>
 #include <thread>
 
 #include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 
+using android::base::ParseInt;
 using android::base::StringPrintf;
 using android::base::boot_clock;
+using android::base::unique_fd;
+using android::base::WriteStringToFile;
 using namespace std::chrono_literals;
 
 namespace android {
@@ -51,8 +61,16 @@ static std::mutex g_bootcharting_finished_mutex;
 static std::condition_variable g_bootcharting_finished_cv;
 static bool g_bootcharting_finished;
 
+// Set when /data/bootchart/enabled asks for process data to come from ftrace rather than from
+// sampling /proc/<pid>/stat.
+static bool g_bootcharting_ftrace;
+static std::string g_tracefs_instance;
+static unique_fd g_trace_marker_fd;
+
+constexpr int64_t kNanosecondsPerJiffy = 10000000;
+constexpr int64_t kSampleIntervalNs = 200000000;
+
 static long long get_uptime_jiffies() {
-    constexpr int64_t kNanosecondsPerJiffy = 10000000;
     boot_clock::time_point uptime = boot_clock::now();
     return uptime.time_since_epoch().count() / kNanosecondsPerJiffy;
 }
@@ -137,6 +155,306 @@ static void log_processes(FILE* log) {
   fputc('\n', log);
 }
 
+// ftrace mode.
+//
+// Instead of walking /proc every 200ms, the scheduler and task lifecycle events are recorded in a
+// dedicated tracefs instance, together with markers for the actions and services init starts.
+// When bootcharting stops, the trace is replayed to synthesize proc_ps.log in the same format
+// as the sampled one, so existing tools keep working. Since every fork, exec, rename and exit is
+// seen, processes that live for less than a sample interval still show up.
+
+static const char* const kTraceEvents[] = {
+        "sched/sched_switch",  "sched/sched_process_exec", "sched/sched_process_exit",
+        "task/task_newtask",   "task/task_rename",
+};
+
+static bool WriteTraceFile(const std::string& name, const std::string& value) {
+    std::string path = g_tracefs_instance + "/" + name;
+    if (!WriteStringToFile(value, path)) {
+        PLOG(ERROR) << "bootchart: failed to write '" << value << "' to " << path;
+        return false;
+    }
+    return true;
+}
+
+static bool ftrace_start() {
+    std::string tracefs = "/sys/kernel/tracing";
+    if (access((tracefs + "/instances").c_str(), F_OK) == -1) {
+        tracefs = "/sys/kernel/debug/tracing";
+    }
+    g_tracefs_instance = tracefs + "/instances/bootchart";
+    if (mkdir(g_tracefs_instance.c_str(), 0700) == -1 && errno != EEXIST) {
+        PLOG(ERROR) << "bootchart: failed to create " << g_tracefs_instance;
+        return false;
+    }
+
+    // Use the same clock as the timestamps of the other logs, and keep the start of boot rather
+    // than its end if the buffer fills up.
+    if (!WriteTraceFile("tracing_on", "0") || !WriteTraceFile("trace", "") ||
+        !WriteTraceFile("trace_clock", "boot") || !WriteTraceFile("options/overwrite", "0") ||
+        !WriteTraceFile("buffer_size_kb", "8192")) {
+        return false;
+    }
+    for (const char* event : kTraceEvents) {
+        if (!WriteTraceFile(StringPrintf("events/%s/enable", event), "1")) return false;
+    }
+
+    std::string marker = g_tracefs_instance + "/trace_marker";
+    g_trace_marker_fd.reset(open(marker.c_str(), O_WRONLY | O_CLOEXEC));
+    if (g_trace_marker_fd == -1) {
+        PLOG(ERROR) << "bootchart: failed to open " << marker;
+    }
+    return WriteTraceFile("tracing_on", "1");
+}
+
+struct TracedProcess {
+    int ppid = 0;
+    std::string name;
+    long long start_jiffies = 0;
+    int64_t runtime_ns = 0;
+    bool ran = false;
+    bool exited = false;
+};
+
+// Tracks processes through the events of a trace, attributing the run time of threads to their
+// process, and writes a proc_ps.log sample for every 200ms of trace.
+class TraceReplay {
+  public:
+    void Seed();
+    void Replay(FILE* trace, FILE* raw_log, FILE* proc_log);
+
+  private:
+    void HandleEvent(int64_t ts, int tid, std::string_view event, std::string_view args);
+    void LogSample(FILE* proc_log, int64_t ts);
+    TracedProcess* ProcessOf(int tid);
+
+    std::map<int, TracedProcess> processes_;  // by tgid
+    std::map<int, int> tgids_;                 // by tid
+    std::map<int, int64_t> switched_in_;       // by tid
+};
+
+// Returns the value of |key| in the "key=value key=value" |args| of a trace event. Values such as
+// task names may contain spaces, so a value extends up to the next word that contains a '='.
+static std::string_view TraceField(std::string_view args, std::string_view key) {
+    std::string prefix = std::string(key) + "=";
+    size_t start = android::base::StartsWith(args, prefix) ? 0 : args.find(" " + prefix);
+    if (start == std::string_view::npos) return {};
+    start += (start == 0 ? 0 : 1) + prefix.size();
+
+    size_t end = start;
+    while (true) {
+        size_t space = args.find(' ', end);
+        if (space == std::string_view::npos) return args.substr(start);
+        std::string_view word = args.substr(space + 1);
+        word = word.substr(0, word.find(' '));
+        if (word.find('=') != std::string_view::npos && !android::base::StartsWith(word, "==>")) {
+            return args.substr(start, space - start);
+        }
+        end = space + 1;
+    }
+}
+
+template <typename T>
+static std::optional<T> TraceIntField(std::string_view args, std::string_view key) {
+    T value;
+    if (!ParseInt(std::string(TraceField(args, key)), &value)) return {};
+    return value;
+}
+
+void TraceReplay::Seed() {
+    std::unique_ptr<DIR, int (*)(DIR*)> dir(opendir("/proc"), closedir);
+    if (!dir) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir.get())) != nullptr) {
+        int pid = atoi(entry->d_name);
+        if (pid == 0) continue;
+
+        std::string stat;
+        if (!android::base::ReadFileToString(StringPrintf("/proc/%d/stat", pid), &stat)) continue;
+        size_t open = stat.find('(');
+        size_t close = stat.find_last_of(')');
+        if (open == std::string::npos || close == std::string::npos) continue;
+        auto fields = android::base::Split(stat.substr(close + 2), " ");
+        // fields[0] is the state, which is field 3 in proc(5).
+        if (fields.size() < 20) continue;
+
+        TracedProcess& process = processes_[pid];
+        process.name = stat.substr(open + 1, close - open - 1);
+        std::string cmdline;
+        android::base::ReadFileToString(StringPrintf("/proc/%d/cmdline", pid), &cmdline);
+        if (!cmdline.empty()) process.name = cmdline.c_str();
+        process.ppid = atoi(fields[1].c_str());
+        process.runtime_ns = (atoll(fields[11].c_str()) + atoll(fields[12].c_str())) *
+                             kNanosecondsPerJiffy;
+        process.start_jiffies = atoll(fields[19].c_str());
+
+        std::string task_dir = StringPrintf("/proc/%d/task", pid);
+        std::unique_ptr<DIR, int (*)(DIR*)> tasks(opendir(task_dir.c_str()), closedir);
+        if (!tasks) continue;
+        struct dirent* task;
+        while ((task = readdir(tasks.get())) != nullptr) {
+            if (int tid = atoi(task->d_name); tid != 0) tgids_[tid] = pid;
+        }
+    }
+}
+
+TracedProcess* TraceReplay::ProcessOf(int tid) {
+    auto tgid = tgids_.find(tid);
+    if (tgid == tgids_.end()) return nullptr;
+    auto process = processes_.find(tgid->second);
+    return process == processes_.end() ? nullptr : &process->second;
+}
+
+void TraceReplay::HandleEvent(int64_t ts, int tid, std::string_view event, std::string_view args) {
+    if (event == "sched_switch") {
+        if (auto prev = TraceIntField<int>(args, "prev_pid")) {
+            if (auto in = switched_in_.find(*prev); in != switched_in_.end()) {
+                if (TracedProcess* process = ProcessOf(*prev)) {
+                    process->runtime_ns += ts - in->second;
+                    process->ran = true;
+                }
+                switched_in_.erase(in);
+            }
+        }
+        if (auto next = TraceIntField<int>(args, "next_pid"); next && *next != 0) {
+            switched_in_[*next] = ts;
+        }
+    } else if (event == "task_newtask") {
+        auto pid = TraceIntField<int>(args, "pid");
+        auto parent = tgids_.find(tid);
+        if (!pid || parent == tgids_.end()) return;
+        unsigned long clone_flags = strtoul(std::string(TraceField(args, "clone_flags")).c_str(),
+                                            nullptr, 16);
+        if (clone_flags & CLONE_THREAD) {
+            tgids_[*pid] = parent->second;
+            return;
+        }
+        tgids_[*pid] = *pid;
+        TracedProcess& process = processes_[*pid];
+        process = {};
+        process.ppid = parent->second;
+        process.name = TraceField(args, "comm");
+        if (auto it = processes_.find(parent->second); it != processes_.end()) {
+            process.name = it->second.name;
+        }
+        process.start_jiffies = ts / kNanosecondsPerJiffy;
+    } else if (event == "sched_process_exec") {
+        auto pid = TraceIntField<int>(args, "pid");
+        if (!pid) return;
+        if (auto it = processes_.find(*pid); it != processes_.end()) {
+            it->second.name = TraceField(args, "filename");
+        }
+    } else if (event == "task_rename") {
+        auto pid = TraceIntField<int>(args, "pid");
+        if (!pid) return;
+        if (auto it = processes_.find(*pid); it != processes_.end()) {
+            it->second.name = TraceField(args, "newcomm");
+        }
+    } else if (event == "sched_process_exit") {
+        auto pid = TraceIntField<int>(args, "pid");
+        if (!pid) return;
+        if (auto it = processes_.find(*pid); it != processes_.end()) {
+            it->second.exited = true;
+        }
+        tgids_.erase(*pid);
+        switched_in_.erase(*pid);
+    }
+}
+
+void TraceReplay::LogSample(FILE* proc_log, int64_t ts) {
+    fprintf(proc_log, "%lld\n", static_cast<long long>(ts / kNanosecondsPerJiffy));
+    for (auto it = processes_.begin(); it != processes_.end();) {
+        TracedProcess& process = it->second;
+        fprintf(proc_log, "%d (%s) %c %d 0 0 0 0 0 0 0 0 0 %lld 0 0 0 20 0 1 0 %lld 0 0\n",
+                it->first, process.name.c_str(), process.ran ? 'R' : 'S', process.ppid,
+                static_cast<long long>(process.runtime_ns / kNanosecondsPerJiffy),
+                process.start_jiffies);
+        process.ran = false;
+        // Processes that exited are reported for the interval they exited in, then dropped.
+        it = process.exited ? processes_.erase(it) : std::next(it);
+    }
+    fputc('\n', proc_log);
+}
+
+void TraceReplay::Replay(FILE* trace, FILE* raw_log, FILE* proc_log) {
+    std::optional<int64_t> next_sample;
+    char* buf = nullptr;
+    size_t buf_size = 0;
+    ssize_t len;
+    while ((len = getline(&buf, &buf_size, trace)) != -1) {
+        if (raw_log) fwrite(buf, 1, len, raw_log);
+        std::string_view line(buf, len);
+        if (line.empty() || line[0] == '#') continue;
+        if (line.back() == '\n') line.remove_suffix(1);
+
+        // <comm>-<tid> [<cpu>] <flags> <seconds>.<microseconds>: <event>: <args>
+        // The task name may contain anything, so the line is parsed starting from the timestamp.
+        size_t event_start = 0, ts_start = 0;
+        int64_t seconds = -1, micros = -1;
+        while ((event_start = line.find(": ", event_start + 1)) != std::string_view::npos) {
+            ts_start = line.rfind(' ', event_start) + 1;
+            std::string_view ts_str = line.substr(ts_start, event_start - ts_start);
+            size_t dot = ts_str.find('.');
+            if (dot != std::string_view::npos &&
+                ParseInt(std::string(ts_str.substr(0, dot)), &seconds) &&
+                ParseInt(std::string(ts_str.substr(dot + 1)), &micros)) {
+                break;
+            }
+        }
+        if (event_start == std::string_view::npos) continue;
+        size_t event_end = line.find(": ", event_start + 2);
+        size_t cpu = line.rfind('[', ts_start);
+        size_t dash = cpu == std::string_view::npos ? cpu : line.rfind('-', cpu);
+        if (event_end == std::string_view::npos || dash == std::string_view::npos) continue;
+
+        int tid;
+        if (!ParseInt(android::base::Trim(std::string(line.substr(dash + 1, cpu - dash - 1))),
+                      &tid)) {
+            continue;
+        }
+        int64_t ts = seconds * 1000000000 + micros * 1000;
+
+        if (!next_sample) next_sample = ts;
+        while (ts >= *next_sample) {
+            LogSample(proc_log, *next_sample);
+            *next_sample += kSampleIntervalNs;
+        }
+        HandleEvent(ts, tid, line.substr(event_start + 2, event_end - event_start - 2),
+                    line.substr(event_end + 2));
+    }
+    free(buf);
+    if (next_sample) LogSample(proc_log, *next_sample);
+}
+
+// Processes and threads that exist when tracing starts, taken from /proc.
+static TraceReplay* g_trace_seed;
+
+static void ftrace_stop() {
+    g_trace_marker_fd.reset();
+    WriteTraceFile("tracing_on", "0");
+
+    auto trace = fopen_unique((g_tracefs_instance + "/trace").c_str(), "re");
+    auto proc_log = fopen_unique("/data/bootchart/proc_ps.log", "we");
+    auto raw_log = fopen_unique("/data/bootchart/trace.log", "we");
+    if (trace && proc_log) {
+        g_trace_seed->Replay(&*trace, raw_log.get(), &*proc_log);
+    }
+    delete g_trace_seed;
+    g_trace_seed = nullptr;
+
+    for (const char* event : kTraceEvents) {
+        WriteTraceFile(StringPrintf("events/%s/enable", event), "0");
+    }
+    WriteTraceFile("trace", "");
+    rmdir(g_tracefs_instance.c_str());
+}
+
+void BootchartAnnotate(const std::string& event) {
+    if (g_trace_marker_fd == -1) return;
+    std::string marker = "bootchart: " + event;
+    TEMP_FAILURE_RETRY(write(g_trace_marker_fd.get(), marker.data(), marker.size()));
+}
+
 static void bootchart_thread_main() {
   LOG(INFO) << "Bootcharting started";
 
@@ -157,8 +475,11 @@ static void bootchart_thread_main() {
   // Open log files.
   auto stat_log = fopen_unique("/data/bootchart/proc_stat.log", "we");
   if (!stat_log) return;
-  auto proc_log = fopen_unique("/data/bootchart/proc_ps.log", "we");
-  if (!proc_log) return;
+  std::unique_ptr<FILE, decltype(&fclose)> proc_log(nullptr, fclose);
+  if (!g_bootcharting_ftrace) {
+    proc_log = fopen_unique("/data/bootchart/proc_ps.log", "we");
+    if (!proc_log) return;
+  }
   auto disk_log = fopen_unique("/data/bootchart/proc_diskstats.log", "we");
   if (!disk_log) return;
 
@@ -173,7 +494,7 @@ static void bootchart_thread_main() {
 
     log_file(&*stat_log, "/proc/stat");
     log_file(&*disk_log, "/proc/diskstats");
-    log_processes(&*proc_log);
+    if (proc_log) log_processes(&*proc_log);
   }
 
   LOG(INFO) << "Bootcharting finished";
@@ -187,6 +508,17 @@ static Result<void> do_bootchart_start() {
         return {};
     }
 
+    // "ftrace" in the file selects the ftrace mode, anything else the sampling one.
+    g_bootcharting_ftrace = android::base::Trim(start) == "ftrace";
+    if (g_bootcharting_ftrace && !ftrace_start()) {
+        LOG(WARNING) << "bootchart: ftrace unavailable, sampling /proc instead";
+        g_bootcharting_ftrace = false;
+    }
+    if (g_bootcharting_ftrace) {
+        g_trace_seed = new TraceReplay;
+        g_trace_seed->Seed();
+    }
+
     g_bootcharting_thread = new std::thread(bootchart_thread_main);
     return {};
 }
@@ -204,6 +536,9 @@ static Result<void> do_bootchart_stop() {
     g_bootcharting_thread->join();
     delete g_bootcharting_thread;
     g_bootcharting_thread = nullptr;
+
+    // Turns the trace into proc_ps.log.
+    if (g_bootcharting_ftrace) ftrace_stop();
     return {};
 }
 
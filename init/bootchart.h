@@ -28,6 +28,9 @@ namespace init {
 
 Result<void> do_bootchart(const BuiltinArguments& args);
 
+// Records |event| in the boot trace when bootcharting in ftrace mode. A no-op otherwise.
+void BootchartAnnotate(const std::string& event);
+
 }  // namespace init
 }  // namespace android
 
@@ -167,6 +167,7 @@ static Result<void> do_class_start(const BuiltinArguments& args) {
     // Do not start a class if it has a property persist.dont_start_class.CLASS set to 1.
     if (android::base::GetBoolProperty("persist.init.dont_start_class." + args[1], false))
         return {};
+    ParseLazyRcScriptsForClass(args[1]);
     // Starting a class does not start services which are explicitly disabled.
     // They must  be started individually.
     for (const auto& service : ServiceList::GetInstance()) {
@@ -210,6 +211,7 @@ static Result<void> do_class_restart(const BuiltinArguments& args) {
         classname = args[1];
     }
 
+    ParseLazyRcScriptsForClass(classname);
     for (const auto& service : ServiceList::GetInstance()) {
         if (!service->classnames().count(classname)) {
             continue;
@@ -230,7 +232,7 @@ static Result<void> do_domainname(const BuiltinArguments& args) {
 }
 
 static Result<void> do_enable(const BuiltinArguments& args) {
-    Service* svc = ServiceList::GetInstance().FindService(args[1]);
+    Service* svc = FindOrParseApexService(args[1]);
     if (!svc) return Error() << "Could not find service";
 
     if (auto result = svc->Enable(); !result.ok()) {
@@ -267,7 +269,7 @@ static Result<void> do_exec_background(const BuiltinArguments& args) {
 }
 
 static Result<void> do_exec_start(const BuiltinArguments& args) {
-    Service* service = ServiceList::GetInstance().FindService(args[1]);
+    Service* service = FindOrParseApexService(args[1]);
     if (!service) {
         return Error() << "Service not found";
     }
@@ -742,7 +744,7 @@ static Result<void> do_setrlimit(const BuiltinArguments& args) {
 }
 
 static Result<void> do_start(const BuiltinArguments& args) {
-    Service* svc = ServiceList::GetInstance().FindService(args[1]);
+    Service* svc = FindOrParseApexService(args[1]);
     if (!svc) return Error() << "service " << args[1] << " not found";
     errno = 0;
     if (auto result = svc->Start(); !result.ok()) {
@@ -769,7 +771,7 @@ static Result<void> do_restart(const BuiltinArguments& args) {
     }
 
     const auto& classname = args[args.size() - 1];
-    Service* svc = ServiceList::GetInstance().FindService(classname);
+    Service* svc = FindOrParseApexService(classname);
     if (!svc) return Error() << "service " << classname << " not found";
     if (only_if_running && !svc->IsRunning()) {
         return {};
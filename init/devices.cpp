@@ -172,6 +172,49 @@ bool SysfsPermissions::MatchWithSubsystem(const std::string& path,
     return Match(path);
 }
 
+void PermissionsMatcher::Add(const Permissions& permissions) {
+    const std::string& name = permissions.name_;
+    // Only '*' makes a rule a wildcard, but once it is one, fnmatch() also treats these specially.
+    size_t literal_length =
+            permissions.wildcard_ ? name.find_first_of("*?[\\") : name.length();
+
+    size_t node = 0;
+    for (size_t i = 0; i < literal_length; ++i) {
+        auto [child, inserted] = nodes_[node].children.emplace(name[i], nodes_.size());
+        if (inserted) nodes_.emplace_back();
+        node = child->second;
+    }
+
+    size_t index = rules_.size();
+    if (permissions.wildcard_) {
+        nodes_[node].wildcard_rules.emplace_back(index);
+    } else if (permissions.prefix_) {
+        nodes_[node].prefix_rules.emplace_back(index);
+    } else {
+        nodes_[node].exact_rules.emplace_back(index);
+    }
+    rules_.emplace_back(permissions);
+}
+
+void PermissionsMatcher::Match(const std::string& path, std::vector<size_t>* matches) const {
+    size_t node = 0;
+    for (size_t i = 0;; ++i) {
+        const Node& n = nodes_[node];
+        matches->insert(matches->end(), n.prefix_rules.begin(), n.prefix_rules.end());
+        for (size_t rule : n.wildcard_rules) {
+            if (rules_[rule].Match(path)) matches->emplace_back(rule);
+        }
+        if (i == path.length()) {
+            matches->insert(matches->end(), n.exact_rules.begin(), n.exact_rules.end());
+            return;
+        }
+
+        auto child = n.children.find(path[i]);
+        if (child == n.children.end()) return;
+        node = child->second;
+    }
+}
+
 void SysfsPermissions::SetPermissions(const std::string& path) const {
     std::string attribute_file = path + "/" + attribute_;
     LOG(VERBOSE) << "fixup " << attribute_file << " " << uid() << " " << gid() << " " << std::oct
@@ -256,7 +299,18 @@ void DeviceHandler::FixupSysPermissions(const std::string& upath,
     // contain, so we prepend it...
     std::string path = "/sys" + upath;
 
-    for (const auto& s : sysfs_permissions_) {
+    // MatchWithSubsystem() also tries the /sys/class and /sys/bus paths of the device, so the
+    // rules matching any of the three are candidates. They're applied in order, like before.
+    std::vector<size_t> candidates;
+    std::string path_basename = Basename(path);
+    sysfs_permissions_matcher_.Match(path, &candidates);
+    sysfs_permissions_matcher_.Match("/sys/class/" + subsystem + "/" + path_basename, &candidates);
+    sysfs_permissions_matcher_.Match("/sys/bus/" + subsystem + "/devices/" + path_basename,
+                                     &candidates);
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    for (size_t i : candidates) {
+        const auto& s = sysfs_permissions_[i];
         if (s.MatchWithSubsystem(path, subsystem)) s.SetPermissions(path);
     }
 
@@ -270,15 +324,17 @@ void DeviceHandler::FixupSysPermissions(const std::string& upath,
 
 std::tuple<mode_t, uid_t, gid_t> DeviceHandler::GetDevicePermissions(
     const std::string& path, const std::vector<std::string>& links) const {
-    // Search the perms list in reverse so that ueventd.$hardware can override ueventd.rc.
-    for (auto it = dev_permissions_.crbegin(); it != dev_permissions_.crend(); ++it) {
-        if (it->Match(path) || std::any_of(links.cbegin(), links.cend(),
-                                           [it](const auto& link) { return it->Match(link); })) {
-            return {it->perm(), it->uid(), it->gid()};
-        }
+    std::vector<size_t> matches;
+    dev_permissions_matcher_.Match(path, &matches);
+    for (const auto& link : links) {
+        dev_permissions_matcher_.Match(link, &matches);
     }
     /* Default if nothing found. */
-    return {0600, 0, 0};
+    if (matches.empty()) return {0600, 0, 0};
+
+    // The last matching rule wins so that ueventd.$hardware can override ueventd.rc.
+    const auto& p = dev_permissions_[*std::max_element(matches.begin(), matches.end())];
+    return {p.perm(), p.uid(), p.gid()};
 }
 
 void DeviceHandler::MakeDevice(const std::string& path, bool block, int major, int minor,
@@ -370,13 +426,20 @@ void SanitizePartitionName(std::string* string) {
     }
 }
 
-std::vector<std::string> DeviceHandler::GetBlockDeviceSymlinks(const Uevent& uevent) const {
-    std::string device;
-    std::string type;
-    std::string partition;
-    std::string uuid;
+// Sibling partitions share every ancestor in sysfs, and both the platform device walk and the
+// PCI/VBD prefix parsing only depend on the parent directory of the uevent, so the result is
+// computed once per parent and reused for the rest of the disk.
+const DeviceHandler::BlockDeviceLinkBase& DeviceHandler::GetBlockDeviceLinkBase(
+        const std::string& path) const {
+    auto parent = Dirname(path);
+    auto it = block_device_link_bases_.find(parent);
+    if (it != block_device_link_bases_.end()) {
+        return it->second;
+    }
 
-    if (FindPlatformDevice(uevent.path, &device)) {
+    BlockDeviceLinkBase base;
+    std::string& device = base.device;
+    if (FindPlatformDevice(path, &device)) {
         // Skip /devices/platform or /devices/ if present
         static constexpr std::string_view devices_platform_prefix = "/devices/platform/";
         static constexpr std::string_view devices_prefix = "/devices/";
@@ -387,29 +450,44 @@ std::vector<std::string> DeviceHandler::GetBlockDeviceSymlinks(const Uevent& uev
             device = device.substr(devices_prefix.length());
         }
 
-        type = "platform";
-    } else if (FindPciDevicePrefix(uevent.path, &device)) {
-        type = "pci";
-    } else if (FindVbdDevicePrefix(uevent.path, &device)) {
-        type = "vbd";
-    } else if (FindDmDevice(uevent, &partition, &uuid)) {
-        std::vector<std::string> symlinks = {"/dev/block/mapper/" + partition};
-        if (!uuid.empty()) {
-            symlinks.emplace_back("/dev/block/mapper/by-uuid/" + uuid);
+        base.type = "platform";
+    } else if (FindPciDevicePrefix(path, &device)) {
+        base.type = "pci";
+    } else if (FindVbdDevicePrefix(path, &device)) {
+        base.type = "vbd";
+    }
+
+    if (!base.type.empty()) {
+        base.link_path = "/dev/block/" + base.type + "/" + device;
+        base.is_boot_device = boot_devices_.find(device) != boot_devices_.end() ||
+                              boot_devices_.find("any") != boot_devices_.end();
+    }
+
+    return block_device_link_bases_.emplace(std::move(parent), std::move(base)).first->second;
+}
+
+std::vector<std::string> DeviceHandler::GetBlockDeviceSymlinks(const Uevent& uevent) const {
+    std::string partition;
+    std::string uuid;
+
+    const auto& base = GetBlockDeviceLinkBase(uevent.path);
+    if (base.type.empty()) {
+        if (FindDmDevice(uevent, &partition, &uuid)) {
+            std::vector<std::string> symlinks = {"/dev/block/mapper/" + partition};
+            if (!uuid.empty()) {
+                symlinks.emplace_back("/dev/block/mapper/by-uuid/" + uuid);
+            }
+            return symlinks;
         }
-        return symlinks;
-    } else {
         return {};
     }
 
     std::vector<std::string> links;
 
-    LOG(VERBOSE) << "found " << type << " device " << device;
-
-    auto link_path = "/dev/block/" + type + "/" + device;
+    LOG(VERBOSE) << "found " << base.type << " device " << base.device;
 
-    bool is_boot_device = boot_devices_.find(device) != boot_devices_.end() ||
-        boot_devices_.find("any") != boot_devices_.end();
+    const auto& link_path = base.link_path;
+    bool is_boot_device = base.is_boot_device;
     if (!uevent.partition_name.empty()) {
         std::string partition_name_sanitized(uevent.partition_name);
         SanitizePartitionName(&partition_name_sanitized);
@@ -607,6 +685,8 @@ DeviceHandler::DeviceHandler(std::vector<Permissions> dev_permissions,
                              bool skip_restorecon)
     : dev_permissions_(std::move(dev_permissions)),
       sysfs_permissions_(std::move(sysfs_permissions)),
+      dev_permissions_matcher_(dev_permissions_),
+      sysfs_permissions_matcher_(sysfs_permissions_),
       subsystems_(std::move(subsystems)),
       boot_devices_(std::move(boot_devices)),
       skip_restorecon_(skip_restorecon),
@@ -21,6 +21,7 @@
 #include <sys/types.h>
 
 #include <algorithm>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -36,6 +37,7 @@ namespace init {
 
 class Permissions {
   public:
+    friend class PermissionsMatcher;
     friend void TestPermissions(const Permissions& expected, const Permissions& test);
 
     Permissions(const std::string& name, mode_t perm, uid_t uid, gid_t gid, bool no_fnm_pathname);
@@ -74,6 +76,35 @@ class SysfsPermissions : public Permissions {
     const std::string attribute_;
 };
 
+// Finds which of a list of Permissions match a path without trying every one of them. The rules
+// are indexed by their literal part in a prefix trie: a walk along the path collects the rules
+// ending in '*' and the exact ones, and only the rules with other wildcards whose literal prefix
+// the path starts with are checked with Permissions::Match().
+class PermissionsMatcher {
+  public:
+    PermissionsMatcher() = default;
+    template <typename T>
+    explicit PermissionsMatcher(const std::vector<T>& permissions) {
+        for (const auto& p : permissions) Add(p);
+    }
+
+    // Appends the indices of the rules that match |path| to |matches|, in no particular order.
+    void Match(const std::string& path, std::vector<size_t>* matches) const;
+
+  private:
+    struct Node {
+        std::map<char, size_t> children;
+        std::vector<size_t> exact_rules;
+        std::vector<size_t> prefix_rules;
+        std::vector<size_t> wildcard_rules;
+    };
+
+    void Add(const Permissions& permissions);
+
+    std::vector<Node> nodes_{1};
+    std::vector<Permissions> rules_;
+};
+
 class Subsystem {
   public:
     friend class SubsystemParser;
@@ -135,8 +166,18 @@ class DeviceHandler : public UeventHandler {
     static std::string GetPartitionNameForDevice(const std::string& device);
 
   private:
+    // Where the symlinks of a platform, PCI or VBD block device are rooted. |type| is empty if
+    // the device is none of those.
+    struct BlockDeviceLinkBase {
+        std::string type;
+        std::string device;
+        std::string link_path;
+        bool is_boot_device = false;
+    };
+
     void ColdbootDone() override;
     bool FindPlatformDevice(std::string path, std::string* platform_device_path) const;
+    const BlockDeviceLinkBase& GetBlockDeviceLinkBase(const std::string& path) const;
     std::tuple<mode_t, uid_t, gid_t> GetDevicePermissions(
         const std::string& path, const std::vector<std::string>& links) const;
     void MakeDevice(const std::string& path, bool block, int major, int minor,
@@ -149,10 +190,14 @@ class DeviceHandler : public UeventHandler {
 
     std::vector<Permissions> dev_permissions_;
     std::vector<SysfsPermissions> sysfs_permissions_;
+    PermissionsMatcher dev_permissions_matcher_;
+    PermissionsMatcher sysfs_permissions_matcher_;
     std::vector<Subsystem> subsystems_;
     std::set<std::string> boot_devices_;
     bool skip_restorecon_;
     std::string sysfs_mount_point_;
+    // Keyed by the sysfs parent directory of the block uevent.
+    mutable std::map<std::string, BlockDeviceLinkBase> block_device_link_bases_;
 };
 
 // Exposed for testing
@@ -56,10 +56,48 @@ class DeviceHandlerTester {
         }
     }
 
+    void TestSiblingPartitionsShareLinkBase() {
+        TemporaryDir fake_sys_root;
+        device_handler_.sysfs_mount_point_ = fake_sys_root.path;
+
+        std::string platform_device_dir = fake_sys_root.path + "/devices/soc.0/f9824900.sdhci"s;
+        mkdir_recursive(platform_device_dir, 0777);
+        std::string platform_bus = fake_sys_root.path + "/bus/platform"s;
+        mkdir_recursive(platform_bus, 0777);
+        std::string subsystem = platform_device_dir + "/subsystem";
+        ASSERT_EQ(0, symlink(platform_bus.c_str(), subsystem.c_str()));
+
+        Uevent uevent = {
+                .path = "/devices/soc.0/f9824900.sdhci/mmc_host/mmc0/mmc0:0001/block/mmcblk0/"
+                        "mmcblk0p1",
+                .partition_name = "modem",
+                .partition_num = 1,
+        };
+        auto links = device_handler_.GetBlockDeviceSymlinks(uevent);
+        ASSERT_FALSE(links.empty());
+        EXPECT_EQ("/dev/block/platform/soc.0/f9824900.sdhci/by-name/modem", links[0]);
+
+        // The sibling must not walk sysfs again, so it resolves even with the link gone.
+        ASSERT_EQ(0, unlink(subsystem.c_str()));
+        uevent.path = "/devices/soc.0/f9824900.sdhci/mmc_host/mmc0/mmc0:0001/block/mmcblk0/"
+                      "mmcblk0p2";
+        uevent.partition_name = "system";
+        uevent.partition_num = 2;
+        links = device_handler_.GetBlockDeviceSymlinks(uevent);
+        ASSERT_FALSE(links.empty());
+        EXPECT_EQ("/dev/block/platform/soc.0/f9824900.sdhci/by-name/system", links[0]);
+        EXPECT_EQ(1u, device_handler_.block_device_link_bases_.size());
+    }
+
   private:
     DeviceHandler device_handler_;
 };
 
+TEST(device_handler, get_block_device_symlinks_sibling_partitions_cached) {
+    DeviceHandlerTester device_handler_tester_;
+    device_handler_tester_.TestSiblingPartitionsShareLinkBase();
+}
+
 TEST(device_handler, get_block_device_symlinks_success_platform) {
     // These are actual paths from bullhead
     const char* platform_device = "/devices/soc.0/f9824900.sdhci";
@@ -328,5 +366,34 @@ TEST(device_handler, SysfsPermissionsMatchWithSubsystemBus) {
     EXPECT_EQ(1001U, permissions.gid());
 }
 
+TEST(device_handler, PermissionsMatcher) {
+    std::vector<Permissions> permissions = {
+            Permissions("/dev/null", 0666, 0, 0, false),
+            Permissions("/dev/dri/*", 0666, 0, 1000, false),
+            Permissions("/dev/device*name", 0666, 0, 1000, false),
+            Permissions("/dev/device*name*", 0666, 0, 1000, true),
+            Permissions("/dev/d?vice*", 0666, 0, 1000, false),
+            Permissions("/dev/[ab]dev*x", 0666, 0, 1000, false),
+            Permissions("/dev/*", 0600, 0, 0, false),
+            Permissions("/dev/null", 0600, 0, 0, false),
+            Permissions("*", 0600, 0, 0, false),
+    };
+    PermissionsMatcher matcher(permissions);
+
+    for (const std::string path :
+         {"/dev/null", "/dev/nul", "/dev/nullsuffix", "/dev/dri/card0", "/dev/dri/",
+          "/dev/devicename", "/dev/device123name/something", "/dev/device/1/2/3name/something",
+          "/dev/dxvice1", "/dev/adevx", "/dev/bdev/x", "/dev/cdevx", "/sys/", "", "/"}) {
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < permissions.size(); ++i) {
+            if (permissions[i].Match(path)) expected.emplace_back(i);
+        }
+        std::vector<size_t> matches;
+        matcher.Match(path, &matches);
+        std::sort(matches.begin(), matches.end());
+        EXPECT_EQ(expected, matches) << path;
+    }
+}
+
 }  // namespace init
 }  // namespace android
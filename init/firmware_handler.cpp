@@ -28,6 +28,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <thread>
 
 #include <android-base/chrono_utils.h>
@@ -64,19 +65,52 @@ bool EqualMatch(const std::string& pattern, const std::string& path) {
 }
 }  // namespace
 
+// Copies |fw_size| bytes from |fw_fd| into the sysfs data node.  sendfile() lets the kernel move
+// the blob straight from the page cache into the firmware buffer, which matters for the large GPU,
+// modem and Wi-Fi images, but it may transfer less than requested per call and is not supported
+// by every filesystem the firmware may live on, so fall back to a plain read/write loop.
+static bool CopyFirmware(int fw_fd, size_t fw_size, int data_fd) {
+    size_t copied = 0;
+    while (copied < fw_size) {
+        ssize_t rc = sendfile(data_fd, fw_fd, nullptr, fw_size - copied);
+        if (rc == -1 && errno == EINTR) continue;
+        if (rc == -1 && copied == 0 && (errno == EINVAL || errno == ENOSYS)) break;
+        if (rc == -1) return false;
+        if (rc == 0) {
+            errno = EIO;
+            return false;
+        }
+        copied += rc;
+    }
+    if (copied == fw_size) return true;
+
+    char buf[64 * 1024];
+    while (copied < fw_size) {
+        ssize_t n = TEMP_FAILURE_RETRY(read(fw_fd, buf, std::min(sizeof(buf), fw_size - copied)));
+        if (n == -1) return false;
+        if (n == 0) {
+            errno = EIO;
+            return false;
+        }
+        if (!WriteFully(data_fd, buf, n)) return false;
+        copied += n;
+    }
+    return true;
+}
+
 static void LoadFirmware(const std::string& firmware, const std::string& root, int fw_fd,
                          size_t fw_size, int loading_fd, int data_fd) {
     // Start transfer.
     WriteFully(loading_fd, "1", 1);
 
     // Copy the firmware.
-    int rc = sendfile(data_fd, fw_fd, nullptr, fw_size);
-    if (rc == -1) {
-        PLOG(ERROR) << "firmware: sendfile failed { '" << root << "', '" << firmware << "' }";
+    bool ok = CopyFirmware(fw_fd, fw_size, data_fd);
+    if (!ok) {
+        PLOG(ERROR) << "firmware: copy failed { '" << root << "', '" << firmware << "' }";
     }
 
     // Tell the firmware whether to abort or commit.
-    const char* response = (rc != -1) ? "0" : "-1";
+    const char* response = ok ? "0" : "-1";
     WriteFully(loading_fd, response, strlen(response));
 }
 
@@ -264,8 +298,8 @@ std::string FirmwareHandler::GetFirmwarePath(const Uevent& uevent) const {
     return uevent.firmware;
 }
 
-void FirmwareHandler::ProcessFirmwareEvent(const std::string& path,
-                                           const std::string& firmware) const {
+void FirmwareHandler::ProcessFirmwareEvent(const std::string& path, const std::string& firmware,
+                                           const std::string& directory_hint) const {
     std::string root = "/sys" + path;
     std::string loading = root + "/loading";
     std::string data = root + "/data";
@@ -302,6 +336,11 @@ void FirmwareHandler::ProcessFirmwareEvent(const std::string& path,
         return true;
     };
 
+    // The parent already located the file; only search every directory if it has since gone away.
+    if (!directory_hint.empty() && TryLoadFirmware(directory_hint)) {
+        return;
+    }
+
     int booting = IsBooting();
 try_loading_again:
     attempted_paths_and_errors.clear();
@@ -353,9 +392,41 @@ bool FirmwareHandler::ForEachFirmwareDirectory(
     return false;
 }
 
+std::string FirmwareHandler::FindFirmwareDirectory(const std::string& firmware) {
+    auto it = firmware_directory_cache_.find(firmware);
+    if (it != firmware_directory_cache_.end()) {
+        if (access((it->second + firmware).c_str(), R_OK) == 0) {
+            return it->second;
+        }
+        firmware_directory_cache_.erase(it);
+    }
+
+    std::string found;
+    ForEachFirmwareDirectory([&](const std::string& firmware_directory) {
+        if (access((firmware_directory + firmware).c_str(), R_OK) != 0) {
+            return false;
+        }
+        found = firmware_directory;
+        return true;
+    });
+    if (!found.empty()) {
+        firmware_directory_cache_.emplace(firmware, found);
+    }
+    return found;
+}
+
 void FirmwareHandler::HandleUevent(const Uevent& uevent) {
     if (uevent.subsystem != "firmware" || uevent.action != "add") return;
 
+    // External handlers may substitute a different file, and they run in the child, so only
+    // resolve the directory up front when none of them applies.  Doing it here rather than in the
+    // child lets the result be remembered for the next request of the same firmware.
+    std::string directory_hint;
+    if (std::none_of(external_firmware_handlers_.begin(), external_firmware_handlers_.end(),
+                     [&](const auto& handler) { return handler.match(uevent.path); })) {
+        directory_hint = FindFirmwareDirectory(uevent.firmware);
+    }
+
     // Loading the firmware in a child means we can do that in parallel...
     auto pid = fork();
     if (pid == -1) {
@@ -364,7 +435,7 @@ void FirmwareHandler::HandleUevent(const Uevent& uevent) {
     if (pid == 0) {
         Timer t;
         auto firmware = GetFirmwarePath(uevent);
-        ProcessFirmwareEvent(uevent.path, firmware);
+        ProcessFirmwareEvent(uevent.path, firmware, directory_hint);
         LOG(INFO) << "loading " << uevent.path << " took " << t;
         _exit(EXIT_SUCCESS);
     }
@@ -20,6 +20,7 @@
 #include <pwd.h>
 
 #include <functional>
+#include <map>
 #include <string>
 #include <vector>
 
@@ -53,15 +54,21 @@ class FirmwareHandler : public UeventHandler {
   private:
     friend void FirmwareTestWithExternalHandler(const std::string& test_name,
                                                 bool expect_new_firmware);
+    friend void FirmwareTestDirectoryCache();
 
     Result<std::string> RunExternalHandler(const std::string& handler, uid_t uid, gid_t gid,
                                            const Uevent& uevent) const;
     std::string GetFirmwarePath(const Uevent& uevent) const;
-    void ProcessFirmwareEvent(const std::string& path, const std::string& firmware) const;
+    void ProcessFirmwareEvent(const std::string& path, const std::string& firmware,
+                              const std::string& directory_hint) const;
     bool ForEachFirmwareDirectory(std::function<bool(const std::string&)> handler) const;
+    // Returns the firmware directory containing |firmware|, or an empty string if there is none.
+    // Hits are cached and revalidated before use.
+    std::string FindFirmwareDirectory(const std::string& firmware);
 
     std::vector<std::string> firmware_directories_;
     std::vector<ExternalFirmwareHandler> external_firmware_handlers_;
+    std::map<std::string, std::string> firmware_directory_cache_;
 };
 
 }  // namespace init
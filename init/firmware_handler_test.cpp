@@ -17,6 +17,8 @@
 #include "firmware_handler.h"
 
 #include <stdlib.h>
+#include <unistd.h>
+
 #include <iostream>
 
 #include <android-base/file.h>
@@ -25,6 +27,7 @@
 #include "uevent.h"
 
 using android::base::GetExecutablePath;
+using android::base::WriteStringToFile;
 using namespace std::literals;
 
 namespace android {
@@ -120,6 +123,30 @@ TEST(firmware_handler, Matching) {
     ASSERT_FALSE(h.match("/dev/path/b.bin"));
 }
 
+void FirmwareTestDirectoryCache() {
+    TemporaryDir first;
+    TemporaryDir second;
+    std::string first_dir = first.path + "/"s;
+    std::string second_dir = second.path + "/"s;
+    ASSERT_TRUE(WriteStringToFile("fw", second_dir + "a.bin"));
+
+    auto firmware_handler = FirmwareHandler({first_dir, second_dir}, {});
+    EXPECT_EQ(second_dir, firmware_handler.FindFirmwareDirectory("a.bin"));
+    EXPECT_EQ(second_dir, firmware_handler.firmware_directory_cache_["a.bin"]);
+    EXPECT_EQ("", firmware_handler.FindFirmwareDirectory("missing.bin"));
+    EXPECT_EQ(0u, firmware_handler.firmware_directory_cache_.count("missing.bin"));
+
+    // A stale entry is dropped and the search is redone.
+    ASSERT_EQ(0, unlink((second_dir + "a.bin").c_str()));
+    ASSERT_TRUE(WriteStringToFile("fw", first_dir + "a.bin"));
+    EXPECT_EQ(first_dir, firmware_handler.FindFirmwareDirectory("a.bin"));
+    unlink((first_dir + "a.bin").c_str());
+}
+
+TEST(firmware_handler, DirectoryCache) {
+    FirmwareTestDirectoryCache();
+}
+
 }  // namespace init
 }  // namespace android
 
@@ -23,10 +23,12 @@
 
 #include <chrono>
 #include <filesystem>
+#include <future>
 #include <map>
 #include <memory>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <android-base/chrono_utils.h>
@@ -111,9 +113,13 @@ class FirstStageMountVBootV2 : public FirstStageMount {
     bool GetDmVerityDevices(std::set<std::string>* devices);
     bool SetUpDmVerity(FstabEntry* fstab_entry);
 
+    void StartOpenAvbHandle();
     bool InitAvbHandle();
 
     bool need_dm_verity_;
+    // Whether AvbHandle::Open() only reads physical partitions, so it can run before the logical
+    // partitions are created.
+    bool can_open_avb_early_ = false;
     bool dsu_not_on_userdata_ = false;
     bool use_snapuserd_ = false;
 
@@ -128,6 +134,8 @@ class FirstStageMountVBootV2 : public FirstStageMount {
 
     std::vector<std::string> vbmeta_partitions_;
     AvbUniquePtr avb_handle_;
+    // Set by StartOpenAvbHandle() and consumed by InitAvbHandle().
+    std::future<std::pair<AvbUniquePtr, std::chrono::milliseconds>> pending_avb_handle_;
 };
 
 // Static Functions
@@ -203,6 +211,33 @@ static bool GetRootEntry(FstabEntry* root_entry) {
     return true;
 }
 
+// Appends "<step>:<ms>" to kEnvFirstStageMountTimes for second stage init to report.
+static void RecordStepTime(const std::string& step, std::chrono::milliseconds duration) {
+    std::string times;
+    if (auto recorded = getenv(kEnvFirstStageMountTimes); recorded) {
+        times = recorded + ","s;
+    }
+    times += step + ":" + std::to_string(duration.count());
+    setenv(kEnvFirstStageMountTimes, times.c_str(), 1);
+    LOG(INFO) << "First stage mount step '" << step << "' took " << duration.count() << "ms";
+}
+
+// Records the time spent waiting for ueventd to create device-mapper nodes, and logs how those
+// waits were distributed.
+static void RecordDmWaitTime() {
+    auto stats = android::dm::DeviceMapper::Instance().GetWaitStats();
+    if (stats.count == 0) return;
+    RecordStepTime("dm_wait", stats.total);
+
+    std::string histogram;
+    for (size_t i = 0; i < stats.buckets.size(); i++) {
+        if (i) histogram += " ";
+        histogram += std::to_string(stats.buckets[i]);
+    }
+    LOG(INFO) << "Waited " << stats.count << " times for device-mapper nodes, max "
+              << stats.max.count() << "ms, log2(ms) histogram: " << histogram;
+}
+
 static bool IsStandaloneImageRollback(const AvbHandle& builtin_vbmeta,
                                       const AvbHandle& standalone_vbmeta,
                                       const FstabEntry& fstab_entry) {
@@ -241,7 +276,15 @@ Result<std::unique_ptr<FirstStageMount>> FirstStageMount::Create(const std::stri
 }
 
 bool FirstStageMountVBootV2::DoCreateDevices() {
+    Timer devices_timer;
     if (!InitDevices()) return false;
+    RecordStepTime("devices", devices_timer.duration());
+
+    // The vbmeta partitions exist now, so verify them and parse their hashtree descriptors
+    // while the logical partitions are being created.
+    if (need_dm_verity_ && can_open_avb_early_ && !avb_handle_ && !pending_avb_handle_.valid()) {
+        StartOpenAvbHandle();
+    }
 
     // Mount /metadata before creating logical partitions, since we need to
     // know whether a snapshot merge is in progress.
@@ -249,15 +292,19 @@ bool FirstStageMountVBootV2::DoCreateDevices() {
         return entry.mount_point == "/metadata";
     });
     if (metadata_partition != fstab_.end()) {
+        Timer metadata_timer;
         if (MountPartition(metadata_partition, true /* erase_same_mounts */)) {
             // Copies DSU AVB keys from the ramdisk to /metadata.
             // Must be done before the following TrySwitchSystemAsRoot().
             // Otherwise, ramdisk will be inaccessible after switching root.
             CopyDsuAvbKeys();
         }
+        RecordStepTime("metadata", metadata_timer.duration());
     }
 
+    Timer logical_timer;
     if (!CreateLogicalPartitions()) return false;
+    RecordStepTime("logical", logical_timer.duration());
 
     return true;
 }
@@ -269,7 +316,10 @@ bool FirstStageMountVBootV2::DoFirstStageMount() {
         return true;
     }
 
+    Timer t;
     if (!MountPartitions()) return false;
+    RecordStepTime("mount", t.duration());
+    RecordDmWaitTime();
 
     return true;
 }
@@ -744,6 +794,7 @@ FirstStageMountVBootV2::FirstStageMountVBootV2(Fstab fstab)
 
 bool FirstStageMountVBootV2::GetDmVerityDevices(std::set<std::string>* devices) {
     need_dm_verity_ = false;
+    can_open_avb_early_ = true;
 
     std::set<std::string> logical_partitions;
 
@@ -775,6 +826,7 @@ bool FirstStageMountVBootV2::GetDmVerityDevices(std::set<std::string>* devices)
         for (const auto& partition : vbmeta_partitions_) {
             std::string partition_name = partition + ab_suffix;
             if (logical_partitions.count(partition_name)) {
+                can_open_avb_early_ = false;
                 continue;
             }
             // devices is of type std::set so it's not an issue to emplace a
@@ -861,10 +913,29 @@ bool FirstStageMountVBootV2::SetUpDmVerity(FstabEntry* fstab_entry) {
     }
 }
 
+// Opens the AvbHandle on a separate thread. This is only done when none of the vbmeta partitions
+// are logical, since those would be read before their dm-linear devices are created.
+void FirstStageMountVBootV2::StartOpenAvbHandle() {
+    pending_avb_handle_ = std::async(std::launch::async, [] {
+        Timer t;
+        auto avb_handle = AvbHandle::Open();
+        return std::make_pair(std::move(avb_handle), t.duration());
+    });
+}
+
 bool FirstStageMountVBootV2::InitAvbHandle() {
     if (avb_handle_) return true;  // Returns true if the handle is already initialized.
 
-    avb_handle_ = AvbHandle::Open();
+    Timer t;
+    if (pending_avb_handle_.valid()) {
+        auto [avb_handle, open_time] = pending_avb_handle_.get();
+        avb_handle_ = std::move(avb_handle);
+        RecordStepTime("avb", open_time);
+        RecordStepTime("avb_wait", t.duration());
+    } else {
+        avb_handle_ = AvbHandle::Open();
+        RecordStepTime("avb", t.duration());
+    }
 
     if (!avb_handle_) {
         PLOG(ERROR) << "Failed to open AvbHandle";
@@ -23,6 +23,10 @@
 namespace android {
 namespace init {
 
+// Comma separated "<step>:<ms>" durations of the first stage mount steps, which second stage
+// init reports as ro.boottime.init.mount.<step>.
+static constexpr char kEnvFirstStageMountTimes[] = "INIT_FIRST_STAGE_MOUNT_TIMES";
+
 class FirstStageMount {
   public:
     virtual ~FirstStageMount() = default;
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "host_init_replay.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <algorithm>
+#include <map>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/properties.h>
+#include <android-base/strings.h>
+
+namespace android {
+namespace init {
+
+namespace {
+
+// The triggers init.cpp queues itself, followed by those 'on late-init' in rootdir/init.rc
+// triggers. The trigger builtin is a stub on the host, so they are queued here instead.
+const char* const kBootTriggers[] = {
+        "early-init",
+        "init",
+        "late-init",
+        "early-fs",
+        "fs",
+        "post-fs",
+        "late-fs",
+        "post-fs-data",
+        "load_persist_props_action",
+        "zygote-start",
+        "firmware_mounts_complete",
+        "early-boot",
+        "boot",
+};
+
+// Number of actions listed, the most expensive first.
+constexpr size_t kTopActions = 50;
+
+uint64_t ThreadCpuNs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+struct Cost {
+    uint64_t cpu_ns = 0;
+    uint64_t count = 0;
+};
+
+Result<std::vector<std::pair<std::string, std::string>>> ReadPropertyLog(const std::string& path) {
+    std::string contents;
+    if (!android::base::ReadFileToString(path, &contents)) {
+        return ErrnoError() << "Could not read property log '" << path << "'";
+    }
+
+    std::vector<std::pair<std::string, std::string>> changes;
+    int line_number = 0;
+    for (const auto& raw_line : android::base::Split(contents, "\n")) {
+        line_number++;
+        auto line = android::base::Trim(raw_line);
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line[0] == '[') {
+            // [name]: [value]
+            auto separator = line.find("]: [");
+            if (separator == std::string::npos || line.back() != ']') {
+                return Error() << path << ":" << line_number << ": malformed line";
+            }
+            changes.emplace_back(line.substr(1, separator - 1),
+                                 line.substr(separator + 4, line.size() - separator - 5));
+        } else {
+            auto separator = line.find('=');
+            if (separator == std::string::npos || separator == 0) {
+                return Error() << path << ":" << line_number << ": malformed line";
+            }
+            changes.emplace_back(line.substr(0, separator), line.substr(separator + 1));
+        }
+    }
+    return changes;
+}
+
+// Attributes CPU time to the action ActionManager is executing. ActionManager logs every action
+// it starts, so the logger tells where one action ends and the next begins.
+class ActionTracker {
+  public:
+    explicit ActionTracker(std::map<std::string, Cost>* actions) : actions_(actions) {
+        saved_severity_ = android::base::SetMinimumLogSeverity(android::base::INFO);
+        saved_logger_ = android::base::SetLogger(
+                [this](android::base::LogId, android::base::LogSeverity severity, const char*,
+                       const char*, unsigned int, const char* message) {
+                    OnLog(severity, message);
+                });
+    }
+
+    ~ActionTracker() {
+        android::base::SetLogger(std::move(saved_logger_));
+        android::base::SetMinimumLogSeverity(saved_severity_);
+    }
+
+    // Charges the time since the current action started to it.
+    void Finish() {
+        if (!current_.empty()) {
+            auto& cost = (*actions_)[current_];
+            cost.cpu_ns += ThreadCpuNs() - start_ns_;
+            cost.count++;
+            current_.clear();
+        }
+    }
+
+    size_t errors() const { return errors_; }
+
+  private:
+    void OnLog(android::base::LogSeverity severity, const char* message) {
+        // Host checks fail for anything that needs the device, so errors are only counted.
+        if (severity >= android::base::ERROR) {
+            errors_++;
+            return;
+        }
+        static constexpr std::string_view kPrefix = "processing action (";
+        std::string_view msg = message;
+        if (!android::base::StartsWith(msg, kPrefix)) {
+            return;
+        }
+        Finish();
+        // processing action (<triggers>) from (<file>:<line>)
+        msg.remove_prefix(kPrefix.size());
+        auto from = msg.find(") from (");
+        if (from == std::string_view::npos) {
+            current_ = msg;
+        } else {
+            auto location = msg.substr(from + 8);
+            if (!location.empty() && location.back() == ')') {
+                location.remove_suffix(1);
+            }
+            current_ = std::string(msg.substr(0, from)) + " @ " + std::string(location);
+        }
+        start_ns_ = ThreadCpuNs();
+    }
+
+    std::map<std::string, Cost>* actions_;
+    std::string current_;
+    uint64_t start_ns_ = 0;
+    size_t errors_ = 0;
+    android::base::LogSeverity saved_severity_;
+    android::base::LogFunction saved_logger_;
+};
+
+void PrintCosts(const char* title, const std::map<std::string, Cost>& costs, int repeat,
+                size_t limit) {
+    std::vector<std::pair<std::string, Cost>> sorted(costs.begin(), costs.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second.cpu_ns > b.second.cpu_ns;
+    });
+    if (sorted.size() > limit) {
+        sorted.resize(limit);
+    }
+
+    printf("\n%s (cpu ms and count per run):\n", title);
+    for (const auto& [name, cost] : sorted) {
+        printf("%10.3f %6" PRIu64 "  %s\n", cost.cpu_ns / 1e6 / repeat, cost.count / repeat,
+               name.c_str());
+    }
+}
+
+}  // namespace
+
+Result<void> ReplayBoot(const ReplayOptions& options, const ParseScriptsFunction& parse_scripts) {
+    if (options.repeat < 1) {
+        return Error() << "Replay repeat count must be at least 1";
+    }
+    std::vector<std::pair<std::string, std::string>> property_changes;
+    if (!options.property_log.empty()) {
+        auto changes = ReadPropertyLog(options.property_log);
+        if (!changes.ok()) {
+            return changes.error();
+        }
+        property_changes = std::move(*changes);
+    }
+
+    uint64_t parse_ns = 0;
+    std::map<std::string, Cost> triggers;
+    std::map<std::string, Cost> actions;
+    size_t errors = 0;
+
+    for (int run = 0; run < options.repeat; run++) {
+        ActionManager am;
+        ServiceList sl;
+        Parser parser;
+
+        uint64_t start = ThreadCpuNs();
+        if (!parse_scripts(&am, &sl, &parser)) {
+            return Error() << "Failed to parse init scripts";
+        }
+        parse_ns += ThreadCpuNs() - start;
+
+        ActionTracker tracker(&actions);
+        auto run_until_idle = [&](const std::string& trigger, const std::function<void()>& queue) {
+            uint64_t trigger_start = ThreadCpuNs();
+            queue();
+            while (am.HasMoreCommands()) {
+                am.ExecuteOneCommand();
+            }
+            tracker.Finish();
+            auto& cost = triggers[trigger];
+            cost.cpu_ns += ThreadCpuNs() - trigger_start;
+            cost.count++;
+        };
+
+        for (const char* trigger : kBootTriggers) {
+            run_until_idle(trigger, [&] { am.QueueEventTrigger(trigger); });
+        }
+        // Properties are also read back when actions check the other conditions of a trigger.
+        for (const auto& [name, value] : property_changes) {
+            run_until_idle("property:" + name, [&] {
+                android::base::SetProperty(name, value);
+                am.QueuePropertyChange(name, value);
+            });
+        }
+        errors += tracker.errors();
+    }
+
+    printf("parse: %.3f cpu ms per run\n", parse_ns / 1e6 / options.repeat);
+    PrintCosts("triggers", triggers, options.repeat, triggers.size());
+    PrintCosts("actions", actions, options.repeat, kTopActions);
+    if (errors > 0) {
+        printf("\n%zu errors logged by host checks during the replay\n", errors / options.repeat);
+    }
+    return {};
+}
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "action_manager.h"
+#include "parser.h"
+#include "result.h"
+#include "service_list.h"
+
+namespace android {
+namespace init {
+
+struct ReplayOptions {
+    // Property changes to replay after the boot triggers, one per line, either as "name=value"
+    // or in the "[name]: [value]" format printed by getprop. Optional.
+    std::string property_log;
+    // Number of times the scripts are parsed and the boot is replayed; costs are averaged.
+    int repeat = 1;
+};
+
+using ParseScriptsFunction = std::function<bool(ActionManager*, ServiceList*, Parser*)>;
+
+// Replays a boot on the host: parses the init scripts with |parse_scripts| into fresh
+// ActionManager and ServiceList instances, then runs the event queue through the triggers init
+// queues from early-init to boot and through the property changes in the log. Builtins are the
+// host checks, so nothing on the host is modified. Prints the CPU time spent parsing, per trigger
+// and per action.
+Result<void> ReplayBoot(const ReplayOptions& options, const ParseScriptsFunction& parse_scripts);
+
+}  // namespace init
+}  // namespace android
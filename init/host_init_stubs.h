@@ -40,6 +40,12 @@
 namespace android {
 namespace init {
 
+// apex_init_util.h
+inline void ParseLazyRcScriptsForTrigger(const std::string&) {}
+
+// bootchart.h
+inline void BootchartAnnotate(const std::string&) {}
+
 // property_service.h
 inline bool CanReadProperty(const std::string&, const std::string&) {
     return true;
@@ -42,6 +42,7 @@
 #include "action_parser.h"
 #include "check_builtins.h"
 #include "host_import_parser.h"
+#include "host_init_replay.h"
 #include "host_init_stubs.h"
 #include "interface_utils.h"
 #include "parser.h"
@@ -163,6 +164,13 @@ Multiple script mode options:
   --out_odm=DIR               Path to the output product directory for the odm partition.
   --out_vendor=DIR            Path to the output product directory for the vendor partition.
   --out_product=DIR           Path to the output product directory for the product partition.
+
+Replay options:
+  --replay                    After checking, replay the boot from early-init to boot and print
+                              the CPU time spent parsing, per trigger and per action.
+  --replay_properties=FILE    Also replay these property changes after boot, one "name=value" or
+                              getprop style "[name]: [value]" per line. Implies --replay.
+  --replay_repeat=N           Parse and replay N times and average the costs. Implies --replay.
 )");
 }
 
@@ -211,6 +219,8 @@ int main(int argc, char** argv) {
 
     auto property_infos = std::vector<PropertyInfoEntry>();
     std::map<std::string, std::string> partition_map;
+    bool replay = false;
+    ReplayOptions replay_options;
 
     while (true) {
         static const char kPropertyContexts[] = "property-contexts=";
@@ -222,6 +232,9 @@ int main(int argc, char** argv) {
                 {"out_odm", required_argument, nullptr, 0},
                 {"out_vendor", required_argument, nullptr, 0},
                 {"out_product", required_argument, nullptr, 0},
+                {"replay", no_argument, nullptr, 0},
+                {"replay_properties", required_argument, nullptr, 0},
+                {"replay_repeat", required_argument, nullptr, 0},
                 {nullptr, 0, nullptr, 0},
         };
 
@@ -237,6 +250,20 @@ int main(int argc, char** argv) {
                 if (long_options[option_index].name == kPropertyContexts) {
                     HandlePropertyContexts(optarg, &property_infos);
                 }
+                if (long_options[option_index].name == "replay"s) {
+                    replay = true;
+                }
+                if (long_options[option_index].name == "replay_properties"s) {
+                    replay = true;
+                    replay_options.property_log = optarg;
+                }
+                if (long_options[option_index].name == "replay_repeat"s) {
+                    replay = true;
+                    if (!ParseInt(optarg, &replay_options.repeat, 1)) {
+                        PrintUsage();
+                        return EXIT_FAILURE;
+                    }
+                }
                 for (const auto& p : partition_search_order) {
                     if (long_options[option_index].name == "out_" + p) {
                         if (partition_map.find(p) != partition_map.end()) {
@@ -294,34 +321,53 @@ int main(int argc, char** argv) {
 
     const BuiltinFunctionMap& function_map = GetBuiltinFunctionMap();
     Action::set_function_map(&function_map);
+
+    const auto parse_scripts_with = [&](Subcontext* subcontext) {
+        return [&, subcontext](ActionManager* am, ServiceList* sl, Parser* parser) {
+            parser->AddSectionParser(
+                    "service", std::make_unique<ServiceParser>(
+                                       sl, subcontext, *interface_inheritance_hierarchy_map));
+            parser->AddSectionParser("on", std::make_unique<ActionParser>(am, subcontext));
+            parser->AddSectionParser("import", std::make_unique<HostImportParser>());
+
+            if (!partition_map.empty()) {
+                for (const auto& p : partition_search_order) {
+                    if (partition_map.find(p) != partition_map.end()) {
+                        parser->ParseConfig(partition_map.at(p) + "etc/init");
+                    }
+                }
+            } else {
+                if (!parser->ParseConfigFileInsecure(*argv, true /* follow_symlinks */)) {
+                    // Follow symlinks as inputs during build execution in Bazel's
+                    // execution root are symlinks, unlike Soong or Make.
+                    LOG(ERROR) << "Failed to open init rc script '" << *argv << "'";
+                    return false;
+                }
+            }
+            return true;
+        };
+    };
+
     ActionManager& am = ActionManager::GetInstance();
     ServiceList& sl = ServiceList::GetInstance();
     Parser parser;
-    parser.AddSectionParser("service",
-                            std::make_unique<ServiceParser>(&sl, GetSubcontext(),
-                                                            *interface_inheritance_hierarchy_map));
-    parser.AddSectionParser("on", std::make_unique<ActionParser>(&am, GetSubcontext()));
-    parser.AddSectionParser("import", std::make_unique<HostImportParser>());
-
-    if (!partition_map.empty()) {
-        for (const auto& p : partition_search_order) {
-            if (partition_map.find(p) != partition_map.end()) {
-                parser.ParseConfig(partition_map.at(p) + "etc/init");
-            }
-        }
-    } else {
-        if (!parser.ParseConfigFileInsecure(*argv, true /* follow_symlinks */)) {
-          // Follow symlinks as inputs during build execution in Bazel's
-          // execution root are symlinks, unlike Soong or Make.
-            LOG(ERROR) << "Failed to open init rc script '" << *argv << "'";
-            return EXIT_FAILURE;
-        }
+    if (!parse_scripts_with(GetSubcontext())(&am, &sl, &parser)) {
+        return EXIT_FAILURE;
     }
     size_t failures = parser.parse_error_count() + am.CheckAllCommands() + sl.CheckAllCommands();
     if (failures > 0) {
         LOG(ERROR) << "Failed to parse init scripts with " << failures << " error(s).";
         return EXIT_FAILURE;
     }
+
+    if (replay) {
+        // The host subcontext has no process to run vendor commands in, so the replay parses
+        // the scripts without it and runs every command in-process.
+        if (auto result = ReplayBoot(replay_options, parse_scripts_with(nullptr)); !result.ok()) {
+            LOG(ERROR) << result.error();
+            return EXIT_FAILURE;
+        }
+    }
     return EXIT_SUCCESS;
 }
 
@@ -445,6 +445,7 @@ int StopServicesFromApex(const std::string& apex_name) {
 }
 
 void RemoveServiceAndActionFromApex(const std::string& apex_name) {
+    DropLazyRcScriptsFromApex(apex_name);
     // Remove services and actions that match apex name
     ActionManager::GetInstance().RemoveActionIf([&](const std::unique_ptr<Action>& action) -> bool {
         if (GetApexNameFromFileName(action->filename()) == apex_name) {
@@ -516,6 +517,7 @@ static const std::map<std::string, ControlMessageFunction, std::less<>>& GetCont
         {"start",             DoControlStart},
         {"stop",              DoControlStop},
         {"restart",           DoControlRestart},
+        {"dump_timings",      [](auto* service) { service->DumpStartTimings(); return Result<void>{}; }},
     };
     // clang-format on
 
@@ -561,7 +563,7 @@ static bool HandleControlMessage(std::string_view message, const std::string& na
     if (ConsumePrefix(&action, "interface_")) {
         service = ServiceList::GetInstance().FindInterface(name);
     } else {
-        service = ServiceList::GetInstance().FindService(name);
+        service = FindOrParseApexService(name);
     }
 
     if (service == nullptr) {
@@ -647,6 +649,10 @@ static Result<void> SetupCgroupsAction(const BuiltinArguments&) {
     if (!CgroupSetup()) {
         return ErrnoError() << "Failed to setup cgroups";
     }
+    // Processes fall back to parsing the JSON files if this fails
+    if (!WriteTaskProfilesRcFile()) {
+        LOG(WARNING) << "Failed to write " << TASK_PROFILES_RC_PATH;
+    }
 
     return {};
 }
@@ -872,6 +878,11 @@ static void RecordStageBoottimes(const boot_clock::time_point& second_stage_star
     }
     unsetenv(kEnvSelinuxStartedAt);
 
+    if (auto compile_time_str = getenv(kEnvSelinuxCompileDurationMs); compile_time_str) {
+        SetProperty("ro.boottime.init.selinux_compile", compile_time_str);
+        unsetenv(kEnvSelinuxCompileDurationMs);
+    }
+
     if (selinux_start_time_ns == -1) return;
     if (first_stage_start_time_ns == -1) return;
 
@@ -884,6 +895,15 @@ static void RecordStageBoottimes(const boot_clock::time_point& second_stage_star
         SetProperty("ro.boottime.init.modules", init_module_time_str);
         unsetenv(kEnvInitModuleDurationMs);
     }
+    if (auto mount_times_str = getenv(kEnvFirstStageMountTimes); mount_times_str) {
+        for (const auto& step_time : android::base::Split(mount_times_str, ",")) {
+            auto pos = step_time.find(':');
+            if (pos == std::string::npos) continue;
+            SetProperty("ro.boottime.init.mount." + step_time.substr(0, pos),
+                        step_time.substr(pos + 1));
+        }
+        unsetenv(kEnvFirstStageMountTimes);
+    }
 }
 
 void SendLoadPersistentPropertiesMessage() {
@@ -176,6 +176,60 @@ execute_third
     EXPECT_EQ(3, num_executed);
 }
 
+TEST(init, PropertyTriggerIndex) {
+    std::string init_script =
+        R"init(
+on property:init.test.index.a=1
+execute_first
+
+on property:init.test.index.b=1
+fail_test
+
+on property:init.test.index.a=*
+execute_second
+
+on boot && property:init.test.index.a=1
+fail_test
+
+)init";
+
+    int num_executed = 0;
+    auto do_execute_first = [&num_executed](const BuiltinArguments&) {
+        EXPECT_EQ(0, num_executed++);
+        return Result<void>{};
+    };
+    auto do_execute_second = [&num_executed](const BuiltinArguments&) {
+        EXPECT_EQ(1, num_executed++);
+        return Result<void>{};
+    };
+    auto do_fail_test = [](const BuiltinArguments&) {
+        ADD_FAILURE() << "action triggered by the wrong property change";
+        return Result<void>{};
+    };
+
+    BuiltinFunctionMap test_function_map = {
+            {"execute_first", {0, 0, {false, do_execute_first}}},
+            {"execute_second", {0, 0, {false, do_execute_second}}},
+            {"fail_test", {0, 0, {false, do_fail_test}}},
+    };
+
+    ActionManagerCommand change_a = [](ActionManager& am) {
+        am.QueuePropertyChange("init.test.index.a", "1");
+    };
+    ActionManagerCommand change_c = [](ActionManager& am) {
+        am.QueuePropertyChange("init.test.index.c", "1");
+    };
+    std::vector<ActionManagerCommand> commands{change_a, change_c};
+
+    ActionManager action_manager;
+    ServiceList service_list;
+    TestInitText(init_script, test_function_map, commands, &action_manager, &service_list);
+    EXPECT_EQ(2, num_executed);
+    // Only the two 'init.test.index.a' actions were checked for the first change, and none for
+    // the second.
+    EXPECT_EQ(2u + 4u, action_manager.property_trigger_checks_saved());
+}
+
 TEST(init, OverrideService) {
     std::string init_script = R"init(
 service A something
@@ -201,6 +255,51 @@ service A something
     EXPECT_TRUE(service->is_override());
 }
 
+TEST(init, ServiceListLookups) {
+    std::string init_script = R"init(
+service A something
+    class first
+    user nobody
+    interface aidl android.test.IFirst/default
+
+service B something
+    class second
+    user nobody
+    interface aidl android.test.ISecond/default
+
+service A something
+    class third
+    user nobody
+    interface aidl android.test.IThird/default
+    override
+)init";
+
+    ActionManager action_manager;
+    ServiceList service_list;
+    TestInitText(init_script, BuiltinFunctionMap(), {}, &action_manager, &service_list);
+    ASSERT_EQ(2, std::distance(service_list.begin(), service_list.end()));
+
+    Service* a = service_list.FindService("A");
+    ASSERT_NE(nullptr, a);
+    EXPECT_EQ(std::set<std::string>({"third"}), a->classnames());
+    EXPECT_EQ(a, service_list.FindInterface("aidl/android.test.IThird/default"));
+    // The overridden definition's interface went away with it.
+    EXPECT_EQ(nullptr, service_list.FindInterface("aidl/android.test.IFirst/default"));
+
+    Service* b = service_list.FindService(std::string("B"));
+    ASSERT_NE(nullptr, b);
+    EXPECT_EQ(b, service_list.FindInterface("aidl/android.test.ISecond/default"));
+    EXPECT_EQ(nullptr, service_list.FindService("C"));
+
+    // Neither service is running, so no pid matches but 0.
+    EXPECT_EQ(nullptr, service_list.FindService(12345, &Service::pid));
+    EXPECT_NE(nullptr, service_list.FindService(0, &Service::pid));
+
+    service_list.RemoveService(*b);
+    EXPECT_EQ(nullptr, service_list.FindService("B"));
+    EXPECT_EQ(nullptr, service_list.FindInterface("aidl/android.test.ISecond/default"));
+}
+
 TEST(init, StartConsole) {
     if (GetProperty("ro.build.type", "") == "user") {
         GTEST_SKIP() << "Must run on userdebug/eng builds. b/262090304";
@@ -16,15 +16,22 @@
 
 #include "mount_namespace.h"
 
+#include <fcntl.h>
 #include <sys/mount.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <chrono>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
 #include <android-base/result.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 
 #include "util.h"
@@ -33,7 +40,56 @@ namespace android {
 namespace init {
 namespace {
 
+// The new mount API (Linux 5.2+ for open_tree/move_mount, 5.12+ for
+// mount_setattr). The syscall numbers are the same on every architecture we
+// support; libc does not wrap them yet.
+static constexpr long kSysOpenTree = 428;
+static constexpr long kSysMoveMount = 429;
+static constexpr long kSysMountSetattr = 442;
+
+static constexpr unsigned int kOpenTreeClone = 1;
+static constexpr unsigned int kMoveMountFEmptyPath = 0x4;
+static constexpr unsigned int kAtRecursive = 0x8000;
+
+// Matches struct mount_attr in <linux/mount.h>.
+struct MountAttr {
+    uint64_t attr_set;
+    uint64_t attr_clr;
+    uint64_t propagation;
+    uint64_t userns_fd;
+};
+
+// Cleared the first time a syscall of the new mount API is missing, after
+// which mount(2) is used directly.
+static bool new_mount_api_supported = true;
+
+static bool FallBackToMount(int saved_errno) {
+    if (saved_errno != ENOSYS) return false;
+    new_mount_api_supported = false;
+    LOG(INFO) << "New mount API is not supported, using mount(2)";
+    return true;
+}
+
 static bool BindMount(const std::string& source, const std::string& mount_point) {
+    if (new_mount_api_supported) {
+        // Clone the whole tree under |source| into a detached mount, then
+        // attach it at |mount_point|.
+        android::base::unique_fd tree(static_cast<int>(
+                syscall(kSysOpenTree, AT_FDCWD, source.c_str(),
+                        kOpenTreeClone | kAtRecursive | O_CLOEXEC)));
+        if (tree >= 0) {
+            if (syscall(kSysMoveMount, tree.get(), "", AT_FDCWD, mount_point.c_str(),
+                        kMoveMountFEmptyPath) == 0) {
+                return true;
+            }
+            PLOG(ERROR) << "Failed to move mount " << source << " to " << mount_point;
+            return false;
+        }
+        if (!FallBackToMount(errno)) {
+            PLOG(ERROR) << "Failed to clone mount tree " << source;
+            return false;
+        }
+    }
     if (mount(source.c_str(), mount_point.c_str(), nullptr, MS_BIND | MS_REC, nullptr) == -1) {
         PLOG(ERROR) << "Failed to bind mount " << source;
         return false;
@@ -41,7 +97,23 @@ static bool BindMount(const std::string& source, const std::string& mount_point)
     return true;
 }
 
+// Changes the propagation type of |mount_point|, and of every mount below it
+// if MS_REC is set in |mountflags|.
 static bool ChangeMount(const std::string& mount_point, unsigned long mountflags) {
+    if (new_mount_api_supported) {
+        MountAttr attr = {};
+        attr.propagation = mountflags & ~MS_REC;
+        unsigned int flags = (mountflags & MS_REC) ? kAtRecursive : 0;
+        if (syscall(kSysMountSetattr, AT_FDCWD, mount_point.c_str(), flags, &attr,
+                    sizeof(attr)) == 0) {
+            return true;
+        }
+        if (!FallBackToMount(errno)) {
+            PLOG(ERROR) << "Failed to set propagation of " << mount_point << " to " << std::hex
+                        << mountflags;
+            return false;
+        }
+    }
     if (mount(nullptr, mount_point.c_str(), nullptr, mountflags, nullptr) == -1) {
         PLOG(ERROR) << "Failed to remount " << mount_point << " as " << std::hex << mountflags;
         return false;
@@ -49,6 +121,29 @@ static bool ChangeMount(const std::string& mount_point, unsigned long mountflags
     return true;
 }
 
+// Records how long each step of SetupMountNamespaces() takes.
+class StepTimer {
+  public:
+    void Step(const char* name) {
+        auto now = std::chrono::steady_clock::now();
+        steps_.emplace_back(name, now - last_);
+        last_ = now;
+    }
+
+    std::string Report() const {
+        std::vector<std::string> parts;
+        for (const auto& [name, duration] : steps_) {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+            parts.emplace_back(android::base::StringPrintf("%s=%.3fms", name, us / 1000.0));
+        }
+        return android::base::Join(parts, ", ");
+    }
+
+  private:
+    std::chrono::steady_clock::time_point last_ = std::chrono::steady_clock::now();
+    std::vector<std::pair<const char*, std::chrono::steady_clock::duration>> steps_;
+};
+
 static int OpenMountNamespace() {
     int fd = open("/proc/self/ns/mnt", O_RDONLY | O_CLOEXEC);
     if (fd < 0) {
@@ -84,6 +179,8 @@ bool NeedsTwoMountNamespaces() {
 }
 
 bool SetupMountNamespaces() {
+    StepTimer timer;
+
     // Set the propagation type of / as shared so that any mounting event (e.g.
     // /data) is by default visible to all processes. When private mounting is
     // needed for /foo/bar, then we will make /foo/bar as a mount point (by
@@ -100,6 +197,7 @@ bool SetupMountNamespaces() {
     // based on the mount namespace. Subdirectory will be bind-mounted based on current mount
     // namespace
     if (!(ChangeMount("/linkerconfig", MS_PRIVATE))) return false;
+    timer.Step("propagation");
 
     // The two mount namespaces present challenges for scoped storage, because
     // vold, which is responsible for most of the mounting, lives in the
@@ -139,6 +237,7 @@ bool SetupMountNamespaces() {
     // will be inherited by new mount namespaces.
     if (!(ChangeMount("/mnt/installer", MS_SHARED))) return false;
     if (!(ChangeMount("/mnt/androidwritable", MS_SHARED))) return false;
+    timer.Step("storage");
 
     bootstrap_ns_fd.reset(OpenMountNamespace());
     bootstrap_ns_id = GetMountNamespaceId();
@@ -158,6 +257,7 @@ bool SetupMountNamespaces() {
         }
         default_ns_fd.reset(OpenMountNamespace());
         default_ns_id = GetMountNamespaceId();
+        timer.Step("unshare");
 
         if (setns(bootstrap_ns_fd.get(), CLONE_NEWNS) == -1) {
             PLOG(ERROR) << "Cannot switch back to bootstrap mount namespace";
@@ -180,13 +280,14 @@ bool SetupMountNamespaces() {
         //     /apex
         //       {APEXes, can be from /data partition}
         if (!(BindMount("/bootstrap-apex", "/apex"))) return false;
+        timer.Step("bootstrap_apex");
     } else {
         // Otherwise, default == bootstrap
         default_ns_fd.reset(OpenMountNamespace());
         default_ns_id = GetMountNamespaceId();
     }
 
-    LOG(INFO) << "SetupMountNamespaces done";
+    LOG(INFO) << "SetupMountNamespaces done (" << timer.Report() << ")";
     return success;
 }
 
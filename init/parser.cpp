@@ -18,7 +18,11 @@
 
 #include <dirent.h>
 
+#include <algorithm>
+#include <atomic>
 #include <map>
+#include <optional>
+#include <thread>
 
 #include <android-base/chrono_utils.h>
 #include <android-base/file.h>
@@ -42,7 +46,7 @@ void Parser::AddSingleLineParser(const std::string& prefix, LineCallback callbac
     line_callbacks_.emplace_back(prefix, std::move(callback));
 }
 
-void Parser::ParseData(const std::string& filename, std::string* data) {
+Parser::TokenizedFile Parser::Tokenize(std::string* data) {
     data->push_back('\n');
     data->push_back('\0');
 
@@ -51,9 +55,37 @@ void Parser::ParseData(const std::string& filename, std::string* data) {
     state.ptr = data->data();
     state.nexttoken = 0;
 
+    TokenizedFile lines;
+    std::vector<std::string> args;
+    for (;;) {
+        switch (next_token(&state)) {
+            case T_EOF:
+                return lines;
+            case T_NEWLINE:
+                state.line++;
+                if (args.empty()) break;
+                lines.push_back({state.line, std::move(args)});
+                args.clear();
+                break;
+            case T_TEXT:
+                args.emplace_back(state.text);
+                break;
+        }
+    }
+}
+
+Result<Parser::TokenizedFile> Parser::ReadAndTokenize(const std::string& path) {
+    auto config_contents = ReadFile(path);
+    if (!config_contents.ok()) {
+        return Error() << "Unable to read config file '" << path
+                       << "': " << config_contents.error();
+    }
+    return Tokenize(&config_contents.value());
+}
+
+void Parser::ParseTokens(const std::string& filename, TokenizedFile&& lines) {
     SectionParser* section_parser = nullptr;
     int section_start_line = -1;
-    std::vector<std::string> args;
 
     // If we encounter a bad section start, there is no valid parser object to parse the subsequent
     // sections, so we must suppress errors until the next valid section is found.
@@ -72,63 +104,54 @@ void Parser::ParseData(const std::string& filename, std::string* data) {
         section_start_line = -1;
     };
 
-    for (;;) {
-        switch (next_token(&state)) {
-            case T_EOF:
-                end_section();
-
-                for (const auto& [section_name, section_parser] : section_parsers_) {
-                    section_parser->EndFile();
-                }
-
-                return;
-            case T_NEWLINE: {
-                state.line++;
-                if (args.empty()) break;
-                // If we have a line matching a prefix we recognize, call its callback and unset any
-                // current section parsers.  This is meant for /sys/ and /dev/ line entries for
-                // uevent.
-                auto line_callback = std::find_if(
-                    line_callbacks_.begin(), line_callbacks_.end(),
-                    [&args](const auto& c) { return android::base::StartsWith(args[0], c.first); });
-                if (line_callback != line_callbacks_.end()) {
-                    end_section();
-
-                    if (auto result = line_callback->second(std::move(args)); !result.ok()) {
-                        parse_error_count_++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                    }
-                } else if (section_parsers_.count(args[0])) {
-                    end_section();
-                    section_parser = section_parsers_[args[0]].get();
-                    section_start_line = state.line;
-                    if (auto result =
-                                section_parser->ParseSection(std::move(args), filename, state.line);
-                        !result.ok()) {
-                        parse_error_count_++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                        section_parser = nullptr;
-                        bad_section_found = true;
-                    }
-                } else if (section_parser) {
-                    if (auto result = section_parser->ParseLineSection(std::move(args), state.line);
-                        !result.ok()) {
-                        parse_error_count_++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                    }
-                } else if (!bad_section_found) {
-                    parse_error_count_++;
-                    LOG(ERROR) << filename << ": " << state.line
-                               << ": Invalid section keyword found";
-                }
-                args.clear();
-                break;
+    for (auto& tokenized_line : lines) {
+        int line = tokenized_line.line;
+        auto& args = tokenized_line.args;
+        // If we have a line matching a prefix we recognize, call its callback and unset any
+        // current section parsers.  This is meant for /sys/ and /dev/ line entries for
+        // uevent.
+        auto line_callback = std::find_if(
+            line_callbacks_.begin(), line_callbacks_.end(),
+            [&args](const auto& c) { return android::base::StartsWith(args[0], c.first); });
+        if (line_callback != line_callbacks_.end()) {
+            end_section();
+
+            if (auto result = line_callback->second(std::move(args)); !result.ok()) {
+                parse_error_count_++;
+                LOG(ERROR) << filename << ": " << line << ": " << result.error();
             }
-            case T_TEXT:
-                args.emplace_back(state.text);
-                break;
+        } else if (section_parsers_.count(args[0])) {
+            end_section();
+            section_parser = section_parsers_[args[0]].get();
+            section_start_line = line;
+            if (auto result = section_parser->ParseSection(std::move(args), filename, line);
+                !result.ok()) {
+                parse_error_count_++;
+                LOG(ERROR) << filename << ": " << line << ": " << result.error();
+                section_parser = nullptr;
+                bad_section_found = true;
+            }
+        } else if (section_parser) {
+            if (auto result = section_parser->ParseLineSection(std::move(args), line);
+                !result.ok()) {
+                parse_error_count_++;
+                LOG(ERROR) << filename << ": " << line << ": " << result.error();
+            }
+        } else if (!bad_section_found) {
+            parse_error_count_++;
+            LOG(ERROR) << filename << ": " << line << ": Invalid section keyword found";
         }
     }
+
+    end_section();
+
+    for (const auto& [section_name, section_parser] : section_parsers_) {
+        section_parser->EndFile();
+    }
+}
+
+void Parser::ParseData(const std::string& filename, std::string* data) {
+    ParseTokens(filename, Tokenize(data));
 }
 
 bool Parser::ParseConfigFileInsecure(const std::string& path, bool follow_symlinks = false) {
@@ -144,13 +167,12 @@ bool Parser::ParseConfigFileInsecure(const std::string& path, bool follow_symlin
 Result<void> Parser::ParseConfigFile(const std::string& path) {
     LOG(INFO) << "Parsing file " << path << "...";
     android::base::Timer t;
-    auto config_contents = ReadFile(path);
-    if (!config_contents.ok()) {
-        return Error() << "Unable to read config file '" << path
-                       << "': " << config_contents.error();
+    auto lines = ReadAndTokenize(path);
+    if (!lines.ok()) {
+        return lines.error();
     }
 
-    ParseData(path, &config_contents.value());
+    ParseTokens(path, std::move(*lines));
 
     LOG(VERBOSE) << "(Parsing " << path << " took " << t << ".)";
     return {};
@@ -175,10 +197,36 @@ bool Parser::ParseConfigDir(const std::string& path) {
     }
     // Sort first so we load files in a consistent order (bug 31996208)
     std::sort(files.begin(), files.end());
-    for (const auto& file : files) {
-        if (auto result = ParseConfigFile(file); !result.ok()) {
-            LOG(ERROR) << "could not import file '" << file << "': " << result.error();
+
+    // Reading and tokenizing the files is done in parallel. The tokens are then handed to the
+    // section parsers one file at a time, in the sorted order, so imports and the order of
+    // actions and services are the same as when parsing the files one after another.
+    std::vector<std::optional<Result<TokenizedFile>>> tokenized_files(files.size());
+    std::atomic<size_t> next_file = 0;
+    auto tokenize_files = [&] {
+        for (size_t i = next_file++; i < files.size(); i = next_file++) {
+            tokenized_files[i] = ReadAndTokenize(files[i]);
+        }
+    };
+    size_t num_threads = std::min<size_t>(std::thread::hardware_concurrency(), files.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(tokenize_files);
+    }
+    tokenize_files();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        const auto& file = files[i];
+        auto& lines = *tokenized_files[i];
+        if (!lines.ok()) {
+            LOG(ERROR) << "could not import file '" << file << "': " << lines.error();
+            continue;
         }
+        LOG(INFO) << "Parsing file " << file << "...";
+        ParseTokens(file, std::move(*lines));
     }
     return true;
 }
@@ -81,7 +81,19 @@ class Parser {
 
     size_t parse_error_count() const { return parse_error_count_; }
 
+    // A config file split into the tokens of each of its non-empty lines. Getting there doesn't
+    // involve the section parsers, so it can be done for several files in parallel.
+    struct TokenizedLine {
+        int line;
+        std::vector<std::string> args;
+    };
+    using TokenizedFile = std::vector<TokenizedLine>;
+
+    static Result<TokenizedFile> ReadAndTokenize(const std::string& path);
+
   private:
+    static TokenizedFile Tokenize(std::string* data);
+    void ParseTokens(const std::string& filename, TokenizedFile&& lines);
     void ParseData(const std::string& filename, std::string* data);
     bool ParseConfigDir(const std::string& path);
 
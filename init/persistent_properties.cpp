@@ -18,10 +18,12 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/system_properties.h>
 #include <sys/types.h>
 
+#include <algorithm>
 #include <memory>
 #include <unordered_map>
 
@@ -47,6 +49,38 @@ namespace {
 
 constexpr const char kLegacyPersistentPropertyDir[] = "/data/property";
 
+// Updates are appended to a journal next to the persistent property file. The journal is folded
+// back into the file by rewriting it once the journal has grown past both this and the size of
+// the file, so a rewrite is paid for by as many bytes of cheap appends.
+constexpr size_t kMinJournalCompactionSize = 16 * 1024;
+
+// Each journal entry is a serialized PersistentPropertyRecord preceded by this header, which lets
+// replay detect an entry torn by a crash or power loss.
+struct JournalEntryHeader {
+    uint32_t size;
+    uint32_t checksum;
+};
+
+using PersistentPropertyRecord = PersistentProperties::PersistentPropertyRecord;
+
+std::string JournalFilename() {
+    return persistent_property_filename + ".journal";
+}
+
+// FNV-1a.
+uint32_t JournalChecksum(const std::string& data) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool IsPersistentPropertyName(const std::string& name) {
+    return StartsWith(name, "persist.") || StartsWith(name, "next_boot.");
+}
+
 void AddPersistentProperty(const std::string& name, const std::string& value,
                            PersistentProperties* persistent_properties) {
     auto persistent_property_record = persistent_properties->add_properties();
@@ -54,6 +88,33 @@ void AddPersistentProperty(const std::string& name, const std::string& value,
     persistent_property_record->set_value(value);
 }
 
+// Returns false if the property already had this value.
+bool SetPersistentProperty(const std::string& name, const std::string& value,
+                           PersistentProperties* persistent_properties) {
+    auto it = std::find_if(persistent_properties->mutable_properties()->begin(),
+                           persistent_properties->mutable_properties()->end(),
+                           [&name](const auto& record) { return record.name() == name; });
+    if (it != persistent_properties->mutable_properties()->end()) {
+        if (it->value() == value) {
+            return false;
+        }
+        it->set_value(value);
+    } else {
+        AddPersistentProperty(name, value, persistent_properties);
+    }
+    return true;
+}
+
+Result<void> FsyncPersistentPropertyDir() {
+    auto dir = Dirname(persistent_property_filename);
+    auto dir_fd = unique_fd{open(dir.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)};
+    if (dir_fd < 0) {
+        return ErrnoError() << "Unable to open persistent properties directory for fsync()";
+    }
+    fsync(dir_fd.get());
+    return {};
+}
+
 Result<PersistentProperties> LoadLegacyPersistentProperties() {
     std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(kLegacyPersistentPropertyDir), closedir);
     if (!dir) {
@@ -144,7 +205,7 @@ Result<PersistentProperties> ParsePersistentPropertyFile(const std::string& file
         return Error() << "Unable to parse persistent property file: Could not parse protobuf";
     }
     for (auto& prop : persistent_properties.properties()) {
-        if (!StartsWith(prop.name(), "persist.") && !StartsWith(prop.name(), "next_boot.")) {
+        if (!IsPersistentPropertyName(prop.name())) {
             return Error() << "Unable to load persistent property file: property '" << prop.name()
                            << "' doesn't start with 'persist.' or 'next_boot.'";
         }
@@ -152,6 +213,99 @@ Result<PersistentProperties> ParsePersistentPropertyFile(const std::string& file
     return persistent_properties;
 }
 
+// Applies the journal on top of the persistent property file. Replay stops at the first entry
+// that is torn or corrupt, and the journal is truncated there so that later appends stay valid.
+void ReplayPersistentPropertyJournal(PersistentProperties* persistent_properties) {
+    const std::string journal_filename = JournalFilename();
+    auto journal = ReadFile(journal_filename);
+    if (!journal.ok()) {
+        if (journal.error().code() != ENOENT) {
+            LOG(ERROR) << "Unable to read persistent property journal: " << journal.error();
+        }
+        return;
+    }
+
+    std::unordered_map<std::string, PersistentPropertyRecord*> records;
+    for (auto& record : *persistent_properties->mutable_properties()) {
+        records.emplace(record.name(), &record);
+    }
+
+    size_t offset = 0;
+    while (journal->size() - offset >= sizeof(JournalEntryHeader)) {
+        JournalEntryHeader header;
+        memcpy(&header, journal->data() + offset, sizeof(header));
+        if (journal->size() - offset - sizeof(header) < header.size) {
+            break;
+        }
+        auto data = journal->substr(offset + sizeof(header), header.size);
+        PersistentPropertyRecord record;
+        if (JournalChecksum(data) != header.checksum || !record.ParseFromString(data) ||
+            !IsPersistentPropertyName(record.name())) {
+            break;
+        }
+
+        if (auto it = records.find(record.name()); it != records.end()) {
+            it->second->set_value(record.value());
+        } else {
+            auto added = persistent_properties->add_properties();
+            *added = std::move(record);
+            records.emplace(added->name(), added);
+        }
+        offset += sizeof(header) + header.size;
+    }
+
+    if (offset < journal->size()) {
+        LOG(WARNING) << "Discarding " << journal->size() - offset
+                     << " bytes of torn or corrupt persistent property journal";
+        if (truncate(journal_filename.c_str(), offset) == -1) {
+            PLOG(ERROR) << "Unable to truncate persistent property journal";
+        }
+    }
+}
+
+// Returns the size of the journal after appending the update.
+Result<size_t> AppendPersistentPropertyJournal(const std::string& name, const std::string& value) {
+    PersistentPropertyRecord record;
+    record.set_name(name);
+    record.set_value(value);
+    std::string data;
+    if (!record.SerializeToString(&data)) {
+        return Error() << "Unable to serialize property";
+    }
+    JournalEntryHeader header = {.size = static_cast<uint32_t>(data.size()),
+                                 .checksum = JournalChecksum(data)};
+    std::string entry(reinterpret_cast<const char*>(&header), sizeof(header));
+    entry += data;
+
+    unique_fd fd(TEMP_FAILURE_RETRY(open(JournalFilename().c_str(),
+                                         O_WRONLY | O_CREAT | O_APPEND | O_NOFOLLOW | O_CLOEXEC,
+                                         0600)));
+    if (fd == -1) {
+        return ErrnoError() << "Could not open persistent property journal";
+    }
+    struct stat sb;
+    if (fstat(fd.get(), &sb) == -1) {
+        return ErrnoError() << "fstat on persistent property journal failed";
+    }
+    if (!WriteStringToFd(entry, fd)) {
+        int saved_errno = errno;
+        // Don't leave a partial entry behind, entries appended after it couldn't be replayed.
+        if (ftruncate(fd.get(), sb.st_size) == -1) {
+            PLOG(ERROR) << "Unable to truncate persistent property journal";
+        }
+        return Error(saved_errno) << "Unable to append to persistent property journal";
+    }
+    fsync(fd.get());
+
+    if (sb.st_size == 0) {
+        // The journal may have just been created.
+        if (auto result = FsyncPersistentPropertyDir(); !result.ok()) {
+            return result.error();
+        }
+    }
+    return sb.st_size + entry.size();
+}
+
 }  // namespace
 
 Result<PersistentProperties> LoadPersistentPropertyFile() {
@@ -163,7 +317,10 @@ Result<PersistentProperties> LoadPersistentPropertyFile() {
         // If the file cannot be parsed in either format, then we don't have any recovery
         // mechanisms, so we delete it to allow for future writes to take place successfully.
         unlink(persistent_property_filename.c_str());
+        unlink(JournalFilename().c_str());
+        return persistent_properties;
     }
+    ReplayPersistentPropertyJournal(&*persistent_properties);
     return persistent_properties;
 }
 
@@ -194,12 +351,13 @@ Result<void> WritePersistentPropertyFile(const PersistentProperties& persistent_
     // directories must be fsync()'ed otherwise, the rename is not necessarily written to storage.
     // Note in this case, that the source and destination directories are the same, so only one
     // fsync() is required.
-    auto dir = Dirname(persistent_property_filename);
-    auto dir_fd = unique_fd{open(dir.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)};
-    if (dir_fd < 0) {
-        return ErrnoError() << "Unable to open persistent properties directory for fsync()";
+    if (auto result = FsyncPersistentPropertyDir(); !result.ok()) {
+        return result.error();
     }
-    fsync(dir_fd.get());
+
+    // The file now holds everything that was in the journal. Should this unlink() not reach
+    // storage, replaying the journal again on top of the file only sets the same values again.
+    unlink(JournalFilename().c_str());
 
     return {};
 }
@@ -223,26 +381,30 @@ PersistentProperties LoadPersistentPropertiesFromMemory() {
 }
 
 // Persistent properties are not written often, so we rather not keep any data in memory and read
-// then rewrite the persistent property file for each update.
+// the persistent property file for each update. The update itself is only appended to the
+// journal, unless the journal has grown large enough to be folded back into the file.
 void WritePersistentProperty(const std::string& name, const std::string& value) {
     auto persistent_properties = LoadPersistentPropertyFile();
 
+    bool rewrite_file = false;
     if (!persistent_properties.ok()) {
         LOG(ERROR) << "Recovering persistent properties from memory: "
                    << persistent_properties.error();
         persistent_properties = LoadPersistentPropertiesFromMemory();
+        rewrite_file = true;
     }
-    auto it = std::find_if(persistent_properties->mutable_properties()->begin(),
-                           persistent_properties->mutable_properties()->end(),
-                           [&name](const auto& record) { return record.name() == name; });
-    if (it != persistent_properties->mutable_properties()->end()) {
-        if (it->value() == value) {
+    if (!SetPersistentProperty(name, value, &persistent_properties.value())) {
+        return;
+    }
+
+    if (!rewrite_file) {
+        auto journal_size = AppendPersistentPropertyJournal(name, value);
+        if (!journal_size.ok()) {
+            LOG(ERROR) << "Rewriting persistent property file: " << journal_size.error();
+        } else if (*journal_size <
+                   std::max(kMinJournalCompactionSize, persistent_properties->ByteSizeLong())) {
             return;
         }
-        it->set_name(name);
-        it->set_value(value);
-    } else {
-        AddPersistentProperty(name, value, &persistent_properties.value());
     }
 
     if (auto result = WritePersistentPropertyFile(*persistent_properties); !result.ok()) {
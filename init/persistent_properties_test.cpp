@@ -238,5 +238,77 @@ TEST(persistent_properties, StagedPersistProperty) {
     CheckPropertiesEqual(expected_persistent_properties, second_read_back_properties);
 }
 
+TEST(persistent_properties, UpdatesAreJournaled) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties = {
+            {"persist.sys.locale", "en-US"},
+            {"persist.sys.timezone", "America/Los_Angeles"},
+    };
+    ASSERT_RESULT_OK(
+            WritePersistentPropertyFile(VectorToPersistentProperties(persistent_properties)));
+    auto file_contents = ReadFile(tf.path);
+    ASSERT_RESULT_OK(file_contents);
+
+    WritePersistentProperty("persist.sys.locale", "pt-BR");
+    WritePersistentProperty("persist.sys.new", "1");
+    WritePersistentProperty("persist.sys.new", "2");
+
+    // The updates only went to the journal.
+    auto unchanged_contents = ReadFile(tf.path);
+    ASSERT_RESULT_OK(unchanged_contents);
+    EXPECT_EQ(*file_contents, *unchanged_contents);
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties_expected = {
+            {"persist.sys.locale", "pt-BR"},
+            {"persist.sys.timezone", "America/Los_Angeles"},
+            {"persist.sys.new", "2"},
+    };
+    auto read_back_properties = LoadPersistentProperties();
+    CheckPropertiesEqual(persistent_properties_expected, read_back_properties);
+
+    // Rewriting the file drops the journal.
+    ASSERT_RESULT_OK(
+            WritePersistentPropertyFile(VectorToPersistentProperties(persistent_properties)));
+    EXPECT_NE(0, access((tf.path + ".journal"s).c_str(), F_OK));
+    read_back_properties = LoadPersistentProperties();
+    CheckPropertiesEqual(persistent_properties, read_back_properties);
+}
+
+TEST(persistent_properties, TornJournalEntryIsDiscarded) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+    const std::string journal_filename = tf.path + ".journal"s;
+
+    WritePersistentProperty("persist.sys.locale", "pt-BR");
+    auto journal = ReadFile(journal_filename);
+    ASSERT_RESULT_OK(journal);
+
+    // Append the first half of another entry, as if power was lost while writing it.
+    WritePersistentProperty("persist.sys.timezone", "America/Los_Angeles");
+    auto full_journal = ReadFile(journal_filename);
+    ASSERT_RESULT_OK(full_journal);
+    ASSERT_GT(full_journal->size(), journal->size());
+    auto torn_size = journal->size() + (full_journal->size() - journal->size()) / 2;
+    ASSERT_RESULT_OK(WriteFile(journal_filename, full_journal->substr(0, torn_size)));
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties_expected = {
+            {"persist.sys.locale", "pt-BR"},
+    };
+    auto read_back_properties = LoadPersistentProperties();
+    CheckPropertiesEqual(persistent_properties_expected, read_back_properties);
+
+    // The torn entry was cut off, so new entries are replayed again.
+    WritePersistentProperty("persist.sys.timezone", "Europe/Paris");
+    persistent_properties_expected.emplace_back("persist.sys.timezone", "Europe/Paris");
+    read_back_properties = LoadPersistentProperties();
+    CheckPropertiesEqual(persistent_properties_expected, read_back_properties);
+
+    unlink(journal_filename.c_str());
+}
+
 }  // namespace init
 }  // namespace android
@@ -39,6 +39,8 @@
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
 
+#include <functional>
+#include <future>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -46,6 +48,7 @@
 #include <queue>
 #include <string_view>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 
 #include <InitProperties.sysprop.h>
@@ -57,11 +60,13 @@
 #include <android-base/result.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <cutils/properties.h>
 #include <fs_mgr.h>
 #include <private/android_filesystem_config.h>
 #include <property_info_parser/property_info_parser.h>
 #include <property_info_serializer/property_info_serializer.h>
 #include <selinux/android.h>
+#include <selinux/avc.h>
 #include <selinux/label.h>
 #include <selinux/selinux.h>
 #include <vendorsupport/api_level.h>
@@ -83,6 +88,8 @@ static constexpr char APPCOMPAT_OVERRIDE_PROP_FOLDERNAME[] =
         "/dev/__properties__/appcompat_override";
 static constexpr char APPCOMPAT_OVERRIDE_PROP_TREE_FILE[] =
         "/dev/__properties__/appcompat_override/property_info";
+static constexpr char PROPERTY_INFO_CACHE_FOLDERNAME[] = "/metadata/property_info";
+static constexpr char PROPERTY_INFO_CACHE_FILE[] = "/metadata/property_info/property_info";
 using namespace std::literals;
 
 using android::base::ErrnoError;
@@ -99,10 +106,12 @@ using android::base::Timer;
 using android::base::Trim;
 using android::base::unique_fd;
 using android::base::WriteStringToFile;
-using android::properties::BuildTrie;
 using android::properties::ParsePropertyInfoFile;
+using android::properties::PropertyInfoArea;
 using android::properties::PropertyInfoAreaFile;
+using android::properties::PropertyInfoAreaHeader;
 using android::properties::PropertyInfoEntry;
+using android::properties::PropertyInfoTrieBuilder;
 using android::sysprop::InitProperties::is_userspace_reboot_supported;
 
 namespace android {
@@ -124,6 +133,12 @@ static int init_socket = -1;
 static bool accept_messages = false;
 static std::mutex accept_messages_lock;
 static std::mutex selinux_check_access_lock;
+// "<source context> <target context>" pairs that CheckMacPerms() has granted 'set' for.  Only
+// grants are cached, so denials keep being audited.  Guarded by selinux_check_access_lock.
+static std::unordered_set<std::string> granted_set_permissions;
+// Whether the SELinux status page could be mapped; without it, a policy reload can't be noticed
+// and nothing is cached.
+static std::optional<bool> selinux_status_available;
 static std::thread property_service_thread;
 static std::thread property_service_for_system_thread;
 
@@ -175,20 +190,46 @@ bool CanReadProperty(const std::string& source_context, const std::string& name)
                                 &audit_data) == 0;
 }
 
+// Returns whether granted_set_permissions may be used, first dropping it if the policy was reloaded
+// or the enforcing mode changed since the last call.  Must hold selinux_check_access_lock.
+static bool UpdateSetPermissionCache() {
+    if (!selinux_status_available) {
+        selinux_status_available = selinux_status_open(0 /* fallback */) == 0;
+    }
+    if (!*selinux_status_available) {
+        return false;
+    }
+    if (selinux_status_updated() != 0) {
+        granted_set_permissions.clear();
+    }
+    return true;
+}
+
 static bool CheckMacPerms(const std::string& name, const char* target_context,
                           const char* source_context, const ucred& cr) {
     if (!target_context || !source_context) {
         return false;
     }
 
+    std::string cache_key = StringPrintf("%s %s", source_context, target_context);
+
+    auto lock = std::lock_guard{selinux_check_access_lock};
+    bool use_cache = UpdateSetPermissionCache();
+    if (use_cache && granted_set_permissions.count(cache_key)) {
+        return true;
+    }
+
     PropertyAuditData audit_data;
 
     audit_data.name = name.c_str();
     audit_data.cr = &cr;
 
-    auto lock = std::lock_guard{selinux_check_access_lock};
-    return selinux_check_access(source_context, target_context, "property_service", "set",
-                                &audit_data) == 0;
+    bool granted = selinux_check_access(source_context, target_context, "property_service", "set",
+                                        &audit_data) == 0;
+    if (granted && use_cache) {
+        granted_set_permissions.emplace(std::move(cache_key));
+    }
+    return granted;
 }
 
 void NotifyPropertyChange(const std::string& name, const std::string& value) {
@@ -285,6 +326,13 @@ class SocketConnection {
         return result == sizeof(value);
     }
 
+    bool SendUint32s(const std::vector<uint32_t>& values) {
+        if (!socket_.ok()) {
+            return true;
+        }
+        return android::base::WriteFully(socket_, values.data(), values.size() * sizeof(uint32_t));
+    }
+
     bool GetSourceContext(std::string* source_context) const {
         char* c_source_context = nullptr;
         if (getpeercon(socket_.get(), &c_source_context) != 0) {
@@ -689,6 +737,49 @@ static void handle_property_set_fd(int fd) {
         break;
       }
 
+    case PROP_MSG_SETPROP_BATCH: {
+        uint32_t count = 0;
+        if (!socket.RecvUint32(&count, &timeout_ms) || count > PROPERTY_SET_BATCH_MAX) {
+            PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error while reading the count";
+            socket.SendUint32(PROP_ERROR_READ_DATA);
+            return;
+        }
+
+        std::vector<std::pair<std::string, std::string>> properties(count);
+        for (auto& [name, value] : properties) {
+            if (!socket.RecvString(&name, &timeout_ms) ||
+                !socket.RecvString(&value, &timeout_ms)) {
+                PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error while reading name/value "
+                               "from the socket";
+                socket.SendUint32(PROP_ERROR_READ_DATA);
+                return;
+            }
+        }
+
+        std::string source_context;
+        if (!socket.GetSourceContext(&source_context)) {
+            PLOG(ERROR) << "Unable to set " << count << " properties: getpeercon() failed";
+            socket.SendUint32(PROP_ERROR_PERMISSION_DENIED);
+            return;
+        }
+
+        // Control messages and sys.powerctl are handled synchronously, as for PROP_MSG_SETPROP.
+        const auto& cr = socket.cred();
+        std::vector<uint32_t> results;
+        results.reserve(count);
+        for (const auto& [name, value] : properties) {
+            std::string error;
+            auto result = HandlePropertySetNoSocket(name, value, source_context, cr, &error);
+            if (result != PROP_SUCCESS) {
+                LOG(ERROR) << "Unable to set property '" << name << "' from uid:" << cr.uid
+                           << " gid:" << cr.gid << " pid:" << cr.pid << ": " << error;
+            }
+            results.emplace_back(result);
+        }
+        socket.SendUint32s(results);
+        break;
+      }
+
     default:
         LOG(ERROR) << "sys_prop: invalid command " << cmd;
         socket.SendUint32(PROP_ERROR_INVALID_CMD);
@@ -710,13 +801,64 @@ uint32_t InitPropertySet(const std::string& name, const std::string& value) {
 static Result<void> load_properties_from_file(const char*, const char*,
                                               std::map<std::string, std::string>*);
 
+// A property assignment or import directive from a .prop file, tokenized but not yet checked
+// against the property contexts.
+struct PropertyFileLine {
+    bool is_import;
+    // The property name, or the unexpanded file name for an import.
+    std::string key;
+    // The property value, or the filter of an import.
+    std::string value;
+};
+
+// Splits .prop file contents into lines. This only touches |data|, so several files can be
+// tokenized concurrently.
+static void ParsePropertyFile(char* data, std::vector<PropertyFileLine>* lines) {
+    char *key, *value, *eol, *sol, *tmp, *fn;
+
+    sol = data;
+    while ((eol = strchr(sol, '\n'))) {
+        key = sol;
+        *eol++ = 0;
+        sol = eol;
+
+        while (isspace(*key)) key++;
+        if (*key == '#') continue;
+
+        tmp = eol - 2;
+        while ((tmp > key) && isspace(*tmp)) *tmp-- = 0;
+
+        if (!strncmp(key, "import ", 7)) {
+            fn = key + 7;
+            while (isspace(*fn)) fn++;
+
+            key = strchr(fn, ' ');
+            if (key) {
+                *key++ = 0;
+                while (isspace(*key)) key++;
+            }
+            lines->push_back({true, fn, key ? key : ""});
+        } else {
+            value = strchr(key, '=');
+            if (!value) continue;
+            *value++ = 0;
+
+            tmp = value - 2;
+            while ((tmp > key) && isspace(*tmp)) *tmp-- = 0;
+
+            while (isspace(*value)) value++;
+
+            lines->push_back({false, key, value});
+        }
+    }
+}
+
 /*
  * Filter is used to decide which properties to load: NULL loads all keys,
  * "ro.foo.*" is a prefix match, and "ro.foo.bar" is an exact match.
  */
-static void LoadProperties(char* data, const char* filter, const char* filename,
-                           std::map<std::string, std::string>* properties) {
-    char *key, *value, *eol, *sol, *tmp, *fn;
+static void LoadProperties(const std::vector<PropertyFileLine>& lines, const char* filter,
+                           const char* filename, std::map<std::string, std::string>* properties) {
     size_t flen = 0;
 
     static constexpr const char* const kVendorPathPrefixes[4] = {
@@ -739,89 +881,59 @@ static void LoadProperties(char* data, const char* filter, const char* filename,
         flen = strlen(filter);
     }
 
-    sol = data;
-    while ((eol = strchr(sol, '\n'))) {
-        key = sol;
-        *eol++ = 0;
-        sol = eol;
-
-        while (isspace(*key)) key++;
-        if (*key == '#') continue;
-
-        tmp = eol - 2;
-        while ((tmp > key) && isspace(*tmp)) *tmp-- = 0;
-
-        if (!strncmp(key, "import ", 7) && flen == 0) {
-            fn = key + 7;
-            while (isspace(*fn)) fn++;
-
-            key = strchr(fn, ' ');
-            if (key) {
-                *key++ = 0;
-                while (isspace(*key)) key++;
-            }
-
-            std::string raw_filename(fn);
-            auto expanded_filename = ExpandProps(raw_filename);
+    for (const auto& [is_import, key, value] : lines) {
+        if (is_import) {
+            // Imported files are never themselves filtered down further.
+            if (flen > 0) continue;
 
+            auto expanded_filename = ExpandProps(key);
             if (!expanded_filename.ok()) {
                 LOG(ERROR) << "Could not expand filename ': " << expanded_filename.error();
                 continue;
             }
 
-            if (auto res = load_properties_from_file(expanded_filename->c_str(), key, properties);
+            const char* import_filter = value.empty() ? nullptr : value.c_str();
+            if (auto res = load_properties_from_file(expanded_filename->c_str(), import_filter,
+                                                     properties);
                 !res.ok()) {
                 LOG(WARNING) << res.error();
             }
-        } else {
-            value = strchr(key, '=');
-            if (!value) continue;
-            *value++ = 0;
-
-            tmp = value - 2;
-            while ((tmp > key) && isspace(*tmp)) *tmp-- = 0;
-
-            while (isspace(*value)) value++;
+            continue;
+        }
 
-            if (flen > 0) {
-                if (filter[flen - 1] == '*') {
-                    if (strncmp(key, filter, flen - 1) != 0) continue;
-                } else {
-                    if (strcmp(key, filter) != 0) continue;
-                }
+        if (flen > 0) {
+            if (filter[flen - 1] == '*') {
+                if (strncmp(key.c_str(), filter, flen - 1) != 0) continue;
+            } else {
+                if (key != filter) continue;
             }
+        }
 
-            if (StartsWith(key, "ctl.") || key == "sys.powerctl"s ||
-                std::string{key} == kRestoreconProperty) {
-                LOG(ERROR) << "Ignoring disallowed property '" << key
-                           << "' with special meaning in prop file '" << filename << "'";
-                continue;
-            }
+        if (StartsWith(key, "ctl.") || key == "sys.powerctl" || key == kRestoreconProperty) {
+            LOG(ERROR) << "Ignoring disallowed property '" << key
+                       << "' with special meaning in prop file '" << filename << "'";
+            continue;
+        }
 
-            ucred cr = {.pid = 1, .uid = 0, .gid = 0};
-            std::string error;
-            if (CheckPermissions(key, value, context, cr, &error) == PROP_SUCCESS) {
-                auto it = properties->find(key);
-                if (it == properties->end()) {
-                    (*properties)[key] = value;
-                } else if (it->second != value) {
-                    LOG(WARNING) << "Overriding previous property '" << key << "':'" << it->second
-                                 << "' with new value '" << value << "'";
-                    it->second = value;
-                }
-            } else {
-                LOG(ERROR) << "Do not have permissions to set '" << key << "' to '" << value
-                           << "' in property file '" << filename << "': " << error;
+        ucred cr = {.pid = 1, .uid = 0, .gid = 0};
+        std::string error;
+        if (CheckPermissions(key, value, context, cr, &error) == PROP_SUCCESS) {
+            auto it = properties->find(key);
+            if (it == properties->end()) {
+                (*properties)[key] = value;
+            } else if (it->second != value) {
+                LOG(WARNING) << "Overriding previous property '" << key << "':'" << it->second
+                             << "' with new value '" << value << "'";
+                it->second = value;
             }
+        } else {
+            LOG(ERROR) << "Do not have permissions to set '" << key << "' to '" << value
+                       << "' in property file '" << filename << "': " << error;
         }
     }
 }
 
-// Filter is used to decide which properties to load: NULL loads all keys,
-// "ro.foo.*" is a prefix match, and "ro.foo.bar" is an exact match.
-static Result<void> load_properties_from_file(const char* filename, const char* filter,
-                                              std::map<std::string, std::string>* properties) {
-    Timer t;
+static Result<std::vector<PropertyFileLine>> ReadPropertyFile(const std::string& filename) {
     auto file_contents = ReadFile(filename);
     if (!file_contents.ok()) {
         return Error() << "Couldn't load property file '" << filename
@@ -829,7 +941,22 @@ static Result<void> load_properties_from_file(const char* filename, const char*
     }
     file_contents->push_back('\n');
 
-    LoadProperties(file_contents->data(), filter, filename, properties);
+    std::vector<PropertyFileLine> lines;
+    ParsePropertyFile(file_contents->data(), &lines);
+    return lines;
+}
+
+// Filter is used to decide which properties to load: NULL loads all keys,
+// "ro.foo.*" is a prefix match, and "ro.foo.bar" is an exact match.
+static Result<void> load_properties_from_file(const char* filename, const char* filter,
+                                              std::map<std::string, std::string>* properties) {
+    Timer t;
+    auto lines = ReadPropertyFile(filename);
+    if (!lines.ok()) {
+        return lines.error();
+    }
+
+    LoadProperties(*lines, filter, filename, properties);
     LOG(VERBOSE) << "(Loading properties from " << filename << " took " << t << ".)";
     return {};
 }
@@ -1159,9 +1286,43 @@ void PropertyLoadBootDefaults() {
     // property files, regardless of if they are "ro." properties or not.
     std::map<std::string, std::string> properties;
 
+    // Reading the partitions' property files is dominated by first-touch I/O on each partition,
+    // so read and tokenize them all concurrently up front. They are still applied strictly in
+    // the precedence order below; only the permission checks and merging are serialized.
+    std::vector<std::string> prefetch_paths = {
+            "/system/build.prop",       "/system_ext/etc/build.prop", "/system_dlkm/etc/build.prop",
+            "/vendor/default.prop",     "/vendor/build.prop",         "/vendor_dlkm/etc/build.prop",
+            "/odm_dlkm/etc/build.prop", "/odm/etc/build.prop",        "/product/etc/build.prop",
+            kDebugRamdiskProp,
+    };
+    if (IsRecoveryMode()) {
+        prefetch_paths.emplace_back("/prop.default");
+    }
+    std::map<std::string, std::future<Result<std::vector<PropertyFileLine>>>> prefetched;
+    for (const auto& path : prefetch_paths) {
+        prefetched.emplace(path, std::async(std::launch::async, ReadPropertyFile, path));
+    }
+
+    const auto load_properties = [&prefetched](const std::string& path,
+                                               std::map<std::string, std::string>* properties)
+            -> Result<void> {
+        auto it = prefetched.find(path);
+        if (it == prefetched.end()) {
+            return load_properties_from_file(path.c_str(), nullptr, properties);
+        }
+        Timer t;
+        auto lines = it->second.get();
+        prefetched.erase(it);
+        if (!lines.ok()) {
+            return lines.error();
+        }
+        LoadProperties(*lines, nullptr, path.c_str(), properties);
+        LOG(VERBOSE) << "(Loading properties from " << path << " took " << t << ".)";
+        return {};
+    };
+
     if (IsRecoveryMode()) {
-        if (auto res = load_properties_from_file("/prop.default", nullptr, &properties);
-            !res.ok()) {
+        if (auto res = load_properties("/prop.default", &properties); !res.ok()) {
             LOG(ERROR) << res.error();
         }
     }
@@ -1169,10 +1330,11 @@ void PropertyLoadBootDefaults() {
     // /<part>/etc/build.prop is the canonical location of the build-time properties since S.
     // Falling back to /<part>/defalt.prop and /<part>/build.prop only when legacy path has to
     // be supported, which is controlled by the support_legacy_path_until argument.
-    const auto load_properties_from_partition = [&properties](const std::string& partition,
-                                                              int support_legacy_path_until) {
+    const auto load_properties_from_partition = [&properties, &load_properties](
+                                                        const std::string& partition,
+                                                        int support_legacy_path_until) {
         auto path = "/" + partition + "/etc/build.prop";
-        if (load_properties_from_file(path.c_str(), nullptr, &properties).ok()) {
+        if (load_properties(path, &properties).ok()) {
             return;
         }
         // To read ro.<partition>.build.version.sdk, temporarily load the legacy paths into a
@@ -1212,28 +1374,26 @@ void PropertyLoadBootDefaults() {
     LoadPropertiesFromSecondStageRes(&properties);
 
     // system should have build.prop, unlike the other partitions
-    if (auto res = load_properties_from_file("/system/build.prop", nullptr, &properties);
-        !res.ok()) {
+    if (auto res = load_properties("/system/build.prop", &properties); !res.ok()) {
         LOG(WARNING) << res.error();
     }
 
     load_properties_from_partition("system_ext", /* support_legacy_path_until */ 30);
-    load_properties_from_file("/system_dlkm/etc/build.prop", nullptr, &properties);
+    load_properties("/system_dlkm/etc/build.prop", &properties);
     // TODO(b/117892318): uncomment the following condition when vendor.imgs for aosp_* targets are
     // all updated.
     // if (SelinuxGetVendorAndroidVersion() <= __ANDROID_API_R__) {
-    load_properties_from_file("/vendor/default.prop", nullptr, &properties);
+    load_properties("/vendor/default.prop", &properties);
     // }
-    load_properties_from_file("/vendor/build.prop", nullptr, &properties);
-    load_properties_from_file("/vendor_dlkm/etc/build.prop", nullptr, &properties);
-    load_properties_from_file("/odm_dlkm/etc/build.prop", nullptr, &properties);
+    load_properties("/vendor/build.prop", &properties);
+    load_properties("/vendor_dlkm/etc/build.prop", &properties);
+    load_properties("/odm_dlkm/etc/build.prop", &properties);
     load_properties_from_partition("odm", /* support_legacy_path_until */ 28);
     load_properties_from_partition("product", /* support_legacy_path_until */ 30);
 
     if (access(kDebugRamdiskProp, R_OK) == 0) {
         LOG(INFO) << "Loading " << kDebugRamdiskProp;
-        if (auto res = load_properties_from_file(kDebugRamdiskProp, nullptr, &properties);
-            !res.ok()) {
+        if (auto res = load_properties(kDebugRamdiskProp, &properties); !res.ok()) {
             LOG(WARNING) << res.error();
         }
     }
@@ -1259,67 +1419,127 @@ void PropertyLoadBootDefaults() {
     update_sys_usb_config();
 }
 
-bool LoadPropertyInfoFromFile(const std::string& filename,
-                              std::vector<PropertyInfoEntry>* property_infos) {
-    auto file_contents = std::string();
-    if (!ReadFileToString(filename, &file_contents)) {
-        PLOG(ERROR) << "Could not read properties from '" << filename << "'";
-        return false;
-    }
-
+static void ParsePropertyInfoFromFile(const std::string& filename,
+                                      const std::string& file_contents,
+                                      bool require_prefix_or_exact,
+                                      std::vector<PropertyInfoEntry>* property_infos) {
     auto errors = std::vector<std::string>{};
-    bool require_prefix_or_exact = SelinuxGetVendorAndroidVersion() >= __ANDROID_API_R__;
     ParsePropertyInfoFile(file_contents, require_prefix_or_exact, property_infos, &errors);
     // Individual parsing errors are reported but do not cause a failed boot, which is what
     // returning false would do here.
     for (const auto& error : errors) {
         LOG(ERROR) << "Could not read line from '" << filename << "': " << error;
     }
+}
 
-    return true;
+// The serialized property contexts are cached on /metadata, keyed by the contents of the files
+// they were built from, so that boots with unchanged property_contexts neither parse them nor
+// build the trie again.  The key is the first line of the cache file.
+static std::string PropertyInfoCacheKey(
+        const std::vector<std::pair<std::string, std::string>>& property_contexts,
+        bool require_prefix_or_exact) {
+    auto key = StringPrintf("property_info_cache v1 %d", require_prefix_or_exact);
+    for (const auto& [filename, file_contents] : property_contexts) {
+        key += StringPrintf(" %s:%zu:%016zx", filename.c_str(), file_contents.size(),
+                            std::hash<std::string>{}(file_contents));
+    }
+    return key;
+}
+
+static std::optional<std::string> ReadPropertyInfoCache(const std::string& key) {
+    auto cache_contents = std::string();
+    if (!ReadFileToString(PROPERTY_INFO_CACHE_FILE, &cache_contents)) {
+        return {};
+    }
+
+    auto newline = cache_contents.find('\n');
+    if (newline == std::string::npos || cache_contents.compare(0, newline, key) != 0) {
+        return {};
+    }
+
+    auto serialized_contexts = cache_contents.substr(newline + 1);
+    auto property_info_area =
+            reinterpret_cast<const PropertyInfoArea*>(serialized_contexts.data());
+    if (serialized_contexts.size() < sizeof(PropertyInfoAreaHeader) ||
+        property_info_area->size() != serialized_contexts.size() ||
+        property_info_area->minimum_supported_version() > 1) {
+        LOG(WARNING) << "Ignoring corrupt " << PROPERTY_INFO_CACHE_FILE;
+        return {};
+    }
+    return serialized_contexts;
+}
+
+static void WritePropertyInfoCache(const std::string& key, const std::string& serialized_contexts) {
+    // /metadata isn't mounted on every device, nor in every boot mode, so failing here is normal.
+    if (mkdir(PROPERTY_INFO_CACHE_FOLDERNAME, 0700) == -1 && errno != EEXIST) {
+        return;
+    }
+    auto temp_file = std::string(PROPERTY_INFO_CACHE_FILE) + ".tmp";
+    if (!WriteStringToFile(key + '\n' + serialized_contexts, temp_file, 0600, 0, 0, false) ||
+        rename(temp_file.c_str(), PROPERTY_INFO_CACHE_FILE) == -1) {
+        PLOG(WARNING) << "Unable to write " << PROPERTY_INFO_CACHE_FILE;
+        unlink(temp_file.c_str());
+    }
 }
 
 void CreateSerializedPropertyInfo() {
-    auto property_infos = std::vector<PropertyInfoEntry>();
+    auto filenames = std::vector<std::string>();
+    bool check_access;
     if (access("/system/etc/selinux/plat_property_contexts", R_OK) != -1) {
-        if (!LoadPropertyInfoFromFile("/system/etc/selinux/plat_property_contexts",
-                                      &property_infos)) {
-            return;
-        }
-        // Don't check for failure here, since we don't always have all of these partitions.
-        // E.g. In case of recovery, the vendor partition will not have mounted and we
-        // still need the system / platform properties to function.
-        if (access("/system_ext/etc/selinux/system_ext_property_contexts", R_OK) != -1) {
-            LoadPropertyInfoFromFile("/system_ext/etc/selinux/system_ext_property_contexts",
-                                     &property_infos);
-        }
-        if (access("/vendor/etc/selinux/vendor_property_contexts", R_OK) != -1) {
-            LoadPropertyInfoFromFile("/vendor/etc/selinux/vendor_property_contexts",
-                                     &property_infos);
-        }
-        if (access("/product/etc/selinux/product_property_contexts", R_OK) != -1) {
-            LoadPropertyInfoFromFile("/product/etc/selinux/product_property_contexts",
-                                     &property_infos);
-        }
-        if (access("/odm/etc/selinux/odm_property_contexts", R_OK) != -1) {
-            LoadPropertyInfoFromFile("/odm/etc/selinux/odm_property_contexts", &property_infos);
-        }
+        // Don't check for failure for anything but the platform file, since we don't always have
+        // all of these partitions. E.g. In case of recovery, the vendor partition will not have
+        // mounted and we still need the system / platform properties to function.
+        filenames = {
+                "/system/etc/selinux/plat_property_contexts",
+                "/system_ext/etc/selinux/system_ext_property_contexts",
+                "/vendor/etc/selinux/vendor_property_contexts",
+                "/product/etc/selinux/product_property_contexts",
+                "/odm/etc/selinux/odm_property_contexts",
+        };
+        check_access = true;
     } else {
-        if (!LoadPropertyInfoFromFile("/plat_property_contexts", &property_infos)) {
-            return;
+        filenames = {
+                "/plat_property_contexts",
+                "/system_ext_property_contexts",
+                "/vendor_property_contexts",
+                "/product_property_contexts",
+                "/odm_property_contexts",
+        };
+        check_access = false;
+    }
+
+    auto property_contexts = std::vector<std::pair<std::string, std::string>>();
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        const auto& filename = filenames[i];
+        if (i > 0 && check_access && access(filename.c_str(), R_OK) == -1) {
+            continue;
         }
-        LoadPropertyInfoFromFile("/system_ext_property_contexts", &property_infos);
-        LoadPropertyInfoFromFile("/vendor_property_contexts", &property_infos);
-        LoadPropertyInfoFromFile("/product_property_contexts", &property_infos);
-        LoadPropertyInfoFromFile("/odm_property_contexts", &property_infos);
+        auto file_contents = std::string();
+        if (!ReadFileToString(filename, &file_contents)) {
+            PLOG(ERROR) << "Could not read properties from '" << filename << "'";
+            if (i == 0) return;
+            continue;
+        }
+        property_contexts.emplace_back(filename, std::move(file_contents));
     }
 
-    auto serialized_contexts = std::string();
-    auto error = std::string();
-    if (!BuildTrie(property_infos, "u:object_r:default_prop:s0", "string", &serialized_contexts,
-                   &error)) {
-        LOG(ERROR) << "Unable to serialize property contexts: " << error;
-        return;
+    bool require_prefix_or_exact = SelinuxGetVendorAndroidVersion() >= __ANDROID_API_R__;
+    auto cache_key = PropertyInfoCacheKey(property_contexts, require_prefix_or_exact);
+    auto serialized_contexts = ReadPropertyInfoCache(cache_key).value_or(std::string());
+    if (serialized_contexts.empty()) {
+        auto trie_builder = PropertyInfoTrieBuilder("u:object_r:default_prop:s0", "string");
+        for (const auto& [filename, file_contents] : property_contexts) {
+            auto property_infos = std::vector<PropertyInfoEntry>();
+            ParsePropertyInfoFromFile(filename, file_contents, require_prefix_or_exact,
+                                      &property_infos);
+            auto error = std::string();
+            if (!trie_builder.AddEntries(property_infos, &error)) {
+                LOG(ERROR) << "Unable to serialize property contexts: " << error;
+                return;
+            }
+        }
+        serialized_contexts = trie_builder.Serialize(true);
+        WritePropertyInfoCache(cache_key, serialized_contexts);
     }
 
     if (!WriteStringToFile(serialized_contexts, PROP_TREE_FILE, 0444, 0, 0, false)) {
@@ -1404,6 +1624,10 @@ static void ProcessBootconfig() {
     });
 }
 
+bool LoadPropertyInfo() {
+    return property_info_area.LoadDefaultPath();
+}
+
 void PropertyInit() {
     selinux_callback cb;
     cb.func_audit = PropertyAuditCallback;
@@ -1414,7 +1638,7 @@ void PropertyInit() {
     if (__system_property_area_init()) {
         LOG(FATAL) << "Failed to initialize property area";
     }
-    if (!property_info_area.LoadDefaultPath()) {
+    if (!LoadPropertyInfo()) {
         LOG(FATAL) << "Failed to load serialized property info file";
     }
 
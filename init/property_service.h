@@ -33,6 +33,11 @@ static constexpr const char kRestoreconProperty[] = "selinux.restorecon_recursiv
 
 bool CanReadProperty(const std::string& source_context, const std::string& name);
 
+// Exposed for benchmarking; PropertyInit() does both for init.
+bool LoadPropertyInfo();
+uint32_t CheckPermissions(const std::string& name, const std::string& value,
+                          const std::string& source_context, const ucred& cr, std::string* error);
+
 void PropertyInit();
 void StartPropertyService(int* epoll_socket);
 
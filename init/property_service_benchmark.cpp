@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "property_service.h"
+
+#include <sys/system_properties.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include <android-base/properties.h>
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+#include <property_info_parser/property_info_parser.h>
+#include <selinux/selinux.h>
+
+using android::base::StringPrintf;
+using android::properties::PropertyInfoAreaFile;
+
+namespace android {
+namespace init {
+
+// Runs the permission checks that HandlePropertySet() does before it sets a property, without
+// setting anything.
+static void BenchmarkCheckPermissions(benchmark::State& state, const std::string& name) {
+    if (getuid() != 0) {
+        state.SkipWithError("Skipping benchmark, must be run as root.");
+        return;
+    }
+    if (!LoadPropertyInfo()) {
+        state.SkipWithError("Failed to load serialized property info file");
+        return;
+    }
+    char* context;
+    if (getcon(&context) != 0) {
+        state.SkipWithError("getcon() failed");
+        return;
+    }
+    std::string source_context = context;
+    free(context);
+
+    ucred cr = {.pid = getpid(), .uid = getuid(), .gid = getgid()};
+    std::string error;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(CheckPermissions(name, "1", source_context, cr, &error));
+    }
+}
+
+BENCHMARK_CAPTURE(BenchmarkCheckPermissions, property, std::string("debug.init.benchmark"));
+BENCHMARK_CAPTURE(BenchmarkCheckPermissions, control, std::string("ctl.start"));
+
+// The benchmarks below go through the property service of the running init, so they cover the
+// whole path: the socket, HandlePropertySet(), the permission checks, updating the property area,
+// waking up waiters and queueing property triggers. Each thread sets its own debug property, so
+// only a handful of properties are added to the property area.
+
+// Names looked up by a booting device, across the common property_contexts prefixes.
+static const char* const kRealisticNames[] = {
+        "ro.build.fingerprint",       "ro.product.model",
+        "persist.sys.locale",         "sys.boot_completed",
+        "dev.bootcomplete",           "init.svc.surfaceflinger",
+        "ctl.start",                  "vendor.audio.feature.enabled",
+        "debug.hwui.renderer",        "persist.device_config.runtime_native.usap_pool_enabled",
+        "ro.boot.hardware.sku",       "net.dns1",
+        "service.bootanim.exit",      "ro.vendor.build.version.sdk",
+        "sys.usb.config",             "log.tag.ActivityManager",
+};
+
+// Reports percentiles of per-operation latencies, averaged over the benchmark threads.
+static void ReportLatencies(benchmark::State& state, std::vector<int64_t>* ns) {
+    if (ns->empty()) {
+        return;
+    }
+    std::sort(ns->begin(), ns->end());
+    auto at = [ns](double p) {
+        size_t i = std::min(ns->size() - 1, static_cast<size_t>(p * ns->size()));
+        return static_cast<double>((*ns)[i]);
+    };
+    state.counters["p50_ns"] = benchmark::Counter(at(0.50), benchmark::Counter::kAvgThreads);
+    state.counters["p90_ns"] = benchmark::Counter(at(0.90), benchmark::Counter::kAvgThreads);
+    state.counters["p99_ns"] = benchmark::Counter(at(0.99), benchmark::Counter::kAvgThreads);
+}
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+// Sets a property through the property service, alternating its value so every set is a change.
+static void BenchmarkPropertySet(benchmark::State& state) {
+    if (getuid() != 0) {
+        state.SkipWithError("Skipping benchmark, must be run as root.");
+        return;
+    }
+    std::string name = StringPrintf("debug.init.benchmark.set%d", state.thread_index());
+    std::vector<int64_t> latencies;
+    size_t i = 0;
+    for (auto _ : state) {
+        int64_t start = NowNs();
+        if (__system_property_set(name.c_str(), (i++ & 1) ? "1" : "0") != 0) {
+            state.SkipWithError("__system_property_set failed");
+            break;
+        }
+        latencies.emplace_back(NowNs() - start);
+    }
+    ReportLatencies(state, &latencies);
+}
+BENCHMARK(BenchmarkPropertySet)->ThreadRange(1, 16)->UseRealTime();
+
+// Time from a set until a thread blocked in __system_property_wait() sees the new value.
+static void BenchmarkPropertySetToWake(benchmark::State& state) {
+    if (getuid() != 0) {
+        state.SkipWithError("Skipping benchmark, must be run as root.");
+        return;
+    }
+    const char* name = "debug.init.benchmark.wake";
+    if (__system_property_set(name, "0") != 0) {
+        state.SkipWithError("__system_property_set failed");
+        return;
+    }
+    const prop_info* pi = __system_property_find(name);
+    if (!pi) {
+        state.SkipWithError("__system_property_find failed");
+        return;
+    }
+
+    std::atomic<bool> stop = false;
+    std::atomic<int64_t> woken_at = 0;
+    uint32_t serial = __system_property_serial(pi);
+    std::thread waiter([&] {
+        uint32_t seen = serial;
+        while (!stop) {
+            timespec timeout = {.tv_sec = 0, .tv_nsec = 100 * 1000 * 1000};
+            if (__system_property_wait(pi, seen, &seen, &timeout)) {
+                woken_at = NowNs();
+            }
+        }
+    });
+
+    std::vector<int64_t> latencies;
+    size_t i = 0;
+    for (auto _ : state) {
+        woken_at = 0;
+        int64_t start = NowNs();
+        if (__system_property_set(name, (++i & 1) ? "1" : "0") != 0) {
+            state.SkipWithError("__system_property_set failed");
+            break;
+        }
+        int64_t woken;
+        while ((woken = woken_at) == 0) {
+            std::this_thread::yield();
+        }
+        latencies.emplace_back(woken - start);
+    }
+    stop = true;
+    waiter.join();
+    ReportLatencies(state, &latencies);
+}
+BENCHMARK(BenchmarkPropertySetToWake)->UseRealTime();
+
+// Reads through a prop_info found once, as callers caching the lookup do.
+static void BenchmarkPropertyReadCached(benchmark::State& state) {
+    const prop_info* pi = __system_property_find("ro.build.fingerprint");
+    if (!pi) {
+        state.SkipWithError("ro.build.fingerprint is not set");
+        return;
+    }
+    for (auto _ : state) {
+        __system_property_read_callback(
+                pi,
+                [](void* cookie, const char*, const char* value, uint32_t) {
+                    benchmark::DoNotOptimize(cookie);
+                    benchmark::DoNotOptimize(value);
+                },
+                nullptr);
+    }
+}
+BENCHMARK(BenchmarkPropertyReadCached)->ThreadRange(1, 16);
+
+// Finds and reads a property on every call, as property_get() and GetProperty() do.
+static void BenchmarkPropertyGet(benchmark::State& state) {
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(android::base::GetProperty(
+                kRealisticNames[i++ % std::size(kRealisticNames)], ""));
+    }
+}
+BENCHMARK(BenchmarkPropertyGet)->ThreadRange(1, 16);
+
+// Maps property names to their SELinux context and type, as every set and every first read of a
+// property does.
+static void BenchmarkPropertyContextLookup(benchmark::State& state) {
+    PropertyInfoAreaFile property_info_area;
+    if (!property_info_area.LoadDefaultPath()) {
+        state.SkipWithError("Failed to load serialized property info file");
+        return;
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        const char* context;
+        const char* type;
+        property_info_area->GetPropertyInfo(kRealisticNames[i++ % std::size(kRealisticNames)],
+                                            &context, &type);
+        benchmark::DoNotOptimize(context);
+        benchmark::DoNotOptimize(type);
+    }
+}
+BENCHMARK(BenchmarkPropertyContextLookup);
+
+}  // namespace init
+}  // namespace android
@@ -24,6 +24,7 @@
 #include <android-base/properties.h>
 #include <android-base/scopeguard.h>
 #include <android-base/strings.h>
+#include <cutils/properties.h>
 #include <gtest/gtest.h>
 
 using android::base::GetProperty;
@@ -77,6 +78,26 @@ TEST(property_service, non_utf8_value) {
     EXPECT_TRUE(SetProperty("property_service_utf8_test", "\xF0\x90\x80\x80"));
 }
 
+TEST(property_service, set_batch) {
+    if (getuid() != 0) {
+        GTEST_SKIP() << "Skipping test, must be run as root.";
+        return;
+    }
+
+    const char* keys[] = {"property_service_batch_test.a", "property_service_batch_test.b",
+                          "property_service_batch_test..invalid"};
+    const char* values[] = {"batch_a", "batch_b", "invalid"};
+    uint32_t results[3] = {};
+    ASSERT_EQ(0, property_set_batch(3, keys, values, results));
+    EXPECT_EQ(static_cast<uint32_t>(PROP_SUCCESS), results[0]);
+    EXPECT_EQ(static_cast<uint32_t>(PROP_SUCCESS), results[1]);
+    EXPECT_EQ(static_cast<uint32_t>(PROP_ERROR_INVALID_NAME), results[2]);
+    EXPECT_EQ("batch_a", GetProperty("property_service_batch_test.a", ""));
+    EXPECT_EQ("batch_b", GetProperty("property_service_batch_test.b", ""));
+
+    EXPECT_EQ(-1, property_set_batch(PROPERTY_SET_BATCH_MAX + 1, keys, values, results));
+}
+
 TEST(property_service, userspace_reboot_not_supported) {
     if (getuid() != 0) {
         GTEST_SKIP() << "Skipping test, must be run as root.";
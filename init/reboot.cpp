@@ -34,6 +34,7 @@
 #include <sys/wait.h>
 
 #include <chrono>
+#include <future>
 #include <memory>
 #include <set>
 #include <thread>
@@ -85,6 +86,10 @@ namespace init {
 
 static bool shutting_down = false;
 
+// How long to wait for services that were sent SIGKILL during shutdown to be reaped. Killed
+// processes exit almost immediately unless they are blocked in the kernel.
+static constexpr std::chrono::milliseconds kSigkillReapTimeout = 1000ms;
+
 static const std::set<std::string> kDebuggingServices{"tombstoned", "logd", "adbd", "console"};
 
 static std::set<std::string> GetPostDataDebuggingServices() {
@@ -170,6 +175,8 @@ class MountEntry {
         }
     }
 
+    const std::string& mnt_dir() const { return mnt_dir_; }
+
     static bool IsBlockDevice(const struct mntent& mntent) {
         return android::base::StartsWith(mntent.mnt_fsname, "/dev/block");
     }
@@ -420,7 +427,7 @@ static UmountStat TryUmountAndFsck(unsigned int cmd, bool run_fsck,
     std::vector<MountEntry> block_devices;
     std::vector<MountEntry> emulated_devices;
 
-    if (run_fsck && !FindPartitionsToUmount(&block_devices, &emulated_devices, false)) {
+    if (!FindPartitionsToUmount(&block_devices, &emulated_devices, false) && run_fsck) {
         return UMOUNT_STAT_ERROR;
     }
     auto sm = snapshot::SnapshotManager::New();
@@ -429,8 +436,19 @@ static UmountStat TryUmountAndFsck(unsigned int cmd, bool run_fsck,
         LOG(INFO) << "OTA update in progress";
         ota_update_in_progress = true;
     }
+    // Let the next boot skip fsck on the partitions that get unmounted cleanly. The records live
+    // on /metadata, so they have to be written before it goes away; if unmounting fails, they
+    // are taken back below where /metadata is still around, and the superblock check at boot
+    // catches the rest.
+    for (const auto& entry : block_devices) {
+        fs_mgr_set_clean_shutdown(entry.mnt_dir(), true);
+    }
+
     UmountStat stat = UmountPartitions(timeout - t.duration());
     if (stat != UMOUNT_STAT_SUCCESS) {
+        for (const auto& entry : block_devices) {
+            fs_mgr_set_clean_shutdown(entry.mnt_dir(), false);
+        }
         LOG(INFO) << "umount timeout, last resort, kill all and try";
         if (DUMP_ON_UMOUNT_FAILURE) DumpUmountDebuggingInfo();
         // Since umount timedout, we will try to kill all processes
@@ -459,9 +477,14 @@ static UmountStat TryUmountAndFsck(unsigned int cmd, bool run_fsck,
         sem_post(reboot_semaphore);
 
         // fsck part is excluded from timeout check. It only runs for user initiated shutdown
-        // and should not affect reboot time.
+        // and should not affect reboot time. All partitions are unmounted at this point, so
+        // they are checked concurrently.
+        std::vector<std::thread> fsck_threads;
         for (auto& entry : block_devices) {
-            entry.DoFsck();
+            fsck_threads.emplace_back([&entry] { entry.DoFsck(); });
+        }
+        for (auto& thread : fsck_threads) {
+            thread.join();
         }
 
         LOG(INFO) << "Resume reboot monitor thread after fsck";
@@ -734,8 +757,9 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
     if (shutdown_timeout > 0ms) {
         StopServicesAndLogViolations(stop_first, shutdown_timeout / 2, true /* SIGTERM */);
     }
-    // Send SIGKILL to ones that didn't terminate cleanly.
-    StopServicesAndLogViolations(stop_first, 0ms, false /* SIGKILL */);
+    // Send SIGKILL to ones that didn't terminate cleanly, and wait for them to be reaped so that
+    // they no longer hold files open when partitions are unmounted below.
+    StopServicesAndLogViolations(stop_first, kSigkillReapTimeout, false /* SIGKILL */);
     SubcontextTerminate();
     // Reap subcontext pids.
     ReapAnyOutstandingChildren();
@@ -822,11 +846,38 @@ static std::chrono::milliseconds GetMillisProperty(const std::string& name,
     return std::chrono::milliseconds(std::move(value));
 }
 
+// Collects the duration of each phase of a userspace reboot, to be logged as
+// one line once the teardown is over.
+class UserspaceRebootPhases {
+  public:
+    // Ends the current phase, giving it |name|.
+    void EndPhase(const std::string& name) {
+        phases_.emplace_back(name, phase_timer_.duration());
+        phase_timer_ = Timer();
+    }
+
+    std::string Report() const {
+        std::vector<std::string> parts;
+        for (const auto& [name, duration] : phases_) {
+            parts.emplace_back(name + "=" + std::to_string(duration.count()) + "ms");
+        }
+        parts.emplace_back("total=" + std::to_string(total_timer_.duration().count()) + "ms");
+        return android::base::Join(parts, " ");
+    }
+
+  private:
+    Timer total_timer_;
+    Timer phase_timer_;
+    std::vector<std::pair<std::string, std::chrono::milliseconds>> phases_;
+};
+
 static Result<void> DoUserspaceReboot() {
     LOG(INFO) << "Userspace reboot initiated";
+    UserspaceRebootPhases phases;
     // An ugly way to pass a more precise reason on why fallback to hard reboot was triggered.
     std::string sub_reason = "";
-    auto guard = android::base::make_scope_guard([&sub_reason] {
+    auto guard = android::base::make_scope_guard([&sub_reason, &phases] {
+        LOG(INFO) << "Userspace reboot aborted after: " << phases.Report();
         // Leave shutdown so that we can handle a full reboot.
         LeaveShutdown();
         trigger_shutdown("reboot,userspace_failed,shutdown_aborted," + sub_reason);
@@ -857,12 +908,16 @@ static Result<void> DoUserspaceReboot() {
             were_enabled.insert(s->name());
         }
     }
-    {
+    phases.EndPhase("prepare");
+    // Flush dirty data while the services are handling SIGTERM, rather than
+    // before signalling them. Whatever they write while exiting is flushed by
+    // the second sync() below.
+    LOG(INFO) << "sync() while terminating services...";
+    auto sync_done = std::async(std::launch::async, [] {
         Timer sync_timer;
-        LOG(INFO) << "sync() before terminating services...";
         sync();
         LOG(INFO) << "sync() took " << sync_timer;
-    }
+    });
     auto sigterm_timeout = GetMillisProperty("init.userspace_reboot.sigterm.timeoutmillis", 5s);
     auto sigkill_timeout = GetMillisProperty("init.userspace_reboot.sigkill.timeoutmillis", 10s);
     LOG(INFO) << "Timeout to terminate services: " << sigterm_timeout.count() << "ms "
@@ -870,6 +925,7 @@ static Result<void> DoUserspaceReboot() {
     std::string services_file_name = "/metadata/userspacereboot/services.txt";
     const int flags = O_RDWR | O_CREAT | O_SYNC | O_APPEND | O_CLOEXEC;
     StopServicesAndLogViolations(stop_first, sigterm_timeout, true /* SIGTERM */);
+    sync_done.wait();
     if (int r = StopServicesAndLogViolations(stop_first, sigkill_timeout, false /* SIGKILL */);
         r > 0) {
         auto fd = unique_fd(TEMP_FAILURE_RETRY(open(services_file_name.c_str(), flags, 0666)));
@@ -882,14 +938,20 @@ static Result<void> DoUserspaceReboot() {
         sub_reason = "sigkill";
         return Error() << r << " post-data services are still running";
     }
-    if (auto result = KillZramBackingDevice(); !result.ok()) {
+    phases.EndPhase("stop_services");
+    // Turning off zram swap and resetting vold's volumes don't depend on each
+    // other, and both can take a while, so do them at the same time.
+    auto zram_result = std::async(std::launch::async, KillZramBackingDevice);
+    auto vold_result = CallVdc("volume", "reset");
+    if (auto result = zram_result.get(); !result.ok()) {
         sub_reason = "zram";
         return result;
     }
-    if (auto result = CallVdc("volume", "reset"); !result.ok()) {
+    if (!vold_result.ok()) {
         sub_reason = "vold_reset";
-        return result;
+        return vold_result;
     }
+    phases.EndPhase("zram_and_volumes");
     const auto& debugging_services = GetPostDataDebuggingServices();
     if (int r = StopServicesAndLogViolations(debugging_services, sigkill_timeout,
                                              false /* SIGKILL */);
@@ -904,16 +966,21 @@ static Result<void> DoUserspaceReboot() {
         sub_reason = "sigkill_debug";
         return Error() << r << " debugging services are still running";
     }
+    phases.EndPhase("stop_debugging_services");
     {
         Timer sync_timer;
         LOG(INFO) << "sync() after stopping services...";
         sync();
         LOG(INFO) << "sync() took " << sync_timer;
     }
+    phases.EndPhase("sync");
     if (auto result = UnmountAllApexes(); !result.ok()) {
         sub_reason = "apex";
         return result;
     }
+    phases.EndPhase("unmount_apexes");
+    // The bootstrap and default mount namespaces created at boot are kept and
+    // reused as they are; only the APEX mounts in them are replaced.
     if (!SwitchToMountNamespaceIfNeeded(NS_BOOTSTRAP).ok()) {
         sub_reason = "ns_switch";
         return Error() << "Failed to switch to bootstrap namespace";
@@ -943,6 +1010,8 @@ static Result<void> DoUserspaceReboot() {
         }
     }
     ServiceList::GetInstance().ResetState();
+    phases.EndPhase("reset_state");
+    LOG(INFO) << "Userspace reboot teardown done: " << phases.Report();
     LeaveShutdown();
     ActionManager::GetInstance().QueueEventTrigger("userspace-reboot-resume");
     guard.Disable();  // Go on with userspace reboot.
@@ -16,6 +16,12 @@
 
 #include "selabel.h"
 
+#include <errno.h>
+
+#include <mutex>
+#include <unordered_map>
+
+#include <android-base/thread_annotations.h>
 #include <selinux/android.h>
 
 namespace android {
@@ -24,8 +30,75 @@ namespace init {
 namespace {
 
 selabel_handle* sehandle = nullptr;
+
+// init and ueventd resolve the same paths over and over, e.g. a device node on every "add" and
+// "change" uevent for it, or a directory named by several mkdir commands, so lookups are memoized.
+// A result only depends on the sehandle, so the cache is dropped whenever a new one is installed.
+// It is bounded by flushing it when full, which is rare enough for the lost hits not to matter.
+constexpr size_t kLookupCacheMaxEntries = 1024;
+
+struct CachedLookup {
+    int error;  // 0 if the lookup succeeded, otherwise the errno it failed with.
+    std::string context;
+};
+
+std::mutex lookup_cache_lock;
+std::unordered_map<std::string, CachedLookup> lookup_cache GUARDED_BY(lookup_cache_lock);
+SelabelLookupStats lookup_stats GUARDED_BY(lookup_cache_lock);
+
+// The mode is part of the key, separated from the path by a character that cannot be in a path.
+std::string LookupCacheKey(const std::string& key, const std::vector<std::string>& aliases,
+                           int type) {
+    std::string cache_key = std::to_string(type);
+    cache_key += '\0';
+    cache_key += key;
+    for (const auto& alias : aliases) {
+        cache_key += '\0';
+        cache_key += alias;
+    }
+    return cache_key;
+}
+
+template <typename F>
+bool CachedLookupFileContext(const std::string& cache_key, std::string* result, F lookup) {
+    {
+        std::lock_guard<std::mutex> lock(lookup_cache_lock);
+        if (auto it = lookup_cache.find(cache_key); it != lookup_cache.end()) {
+            lookup_stats.hits++;
+            if (it->second.error != 0) {
+                errno = it->second.error;
+                return false;
+            }
+            *result = it->second.context;
+            return true;
+        }
+        lookup_stats.misses++;
+    }
+
+    char* context;
+    CachedLookup entry{};
+    if (lookup(&context) != 0) {
+        entry.error = errno;
+    } else {
+        entry.context = context;
+        free(context);
+    }
+
+    std::lock_guard<std::mutex> lock(lookup_cache_lock);
+    if (lookup_cache.size() >= kLookupCacheMaxEntries) {
+        lookup_cache.clear();
+    }
+    auto& cached = lookup_cache.insert_or_assign(cache_key, std::move(entry)).first->second;
+    if (cached.error != 0) {
+        errno = cached.error;
+        return false;
+    }
+    *result = cached.context;
+    return true;
 }
 
+}  // namespace
+
 // selinux_android_file_context_handle() takes on the order of 10+ms to run, so we want to cache
 // its value.  selinux_android_restorecon() also needs an sehandle for file context look up.  It
 // will create and store its own copy, but selinux_android_set_sehandle() can be used to provide
@@ -33,25 +106,30 @@ selabel_handle* sehandle = nullptr;
 void SelabelInitialize() {
     sehandle = selinux_android_file_context_handle();
     selinux_android_set_sehandle(sehandle);
+
+    std::lock_guard<std::mutex> lock(lookup_cache_lock);
+    lookup_cache.clear();
 }
 
-// A C++ wrapper around selabel_lookup() using the cached sehandle.
+SelabelLookupStats SelabelGetLookupStats() {
+    std::lock_guard<std::mutex> lock(lookup_cache_lock);
+    return lookup_stats;
+}
+
+// A C++ wrapper around selabel_lookup() using the cached sehandle and memoizing its results.
 // If sehandle is null, this returns success with an empty context.
 bool SelabelLookupFileContext(const std::string& key, int type, std::string* result) {
     result->clear();
 
     if (!sehandle) return true;
 
-    char* context;
-    if (selabel_lookup(sehandle, &context, key.c_str(), type) != 0) {
-        return false;
-    }
-    *result = context;
-    free(context);
-    return true;
+    return CachedLookupFileContext(LookupCacheKey(key, {}, type), result, [&](char** context) {
+        return selabel_lookup(sehandle, context, key.c_str(), type);
+    });
 }
 
-// A C++ wrapper around selabel_lookup_best_match() using the cached sehandle.
+// A C++ wrapper around selabel_lookup_best_match() using the cached sehandle and memoizing its
+// results.
 // If sehandle is null, this returns success with an empty context.
 bool SelabelLookupFileContextBestMatch(const std::string& key,
                                        const std::vector<std::string>& aliases, int type,
@@ -60,19 +138,16 @@ bool SelabelLookupFileContextBestMatch(const std::string& key,
 
     if (!sehandle) return true;
 
-    std::vector<const char*> c_aliases;
-    for (const auto& alias : aliases) {
-        c_aliases.emplace_back(alias.c_str());
-    }
-    c_aliases.emplace_back(nullptr);
-
-    char* context;
-    if (selabel_lookup_best_match(sehandle, &context, key.c_str(), &c_aliases[0], type) != 0) {
-        return false;
-    }
-    *result = context;
-    free(context);
-    return true;
+    return CachedLookupFileContext(
+            LookupCacheKey(key, aliases, type), result, [&](char** context) {
+                std::vector<const char*> c_aliases;
+                for (const auto& alias : aliases) {
+                    c_aliases.emplace_back(alias.c_str());
+                }
+                c_aliases.emplace_back(nullptr);
+                return selabel_lookup_best_match(sehandle, context, key.c_str(), &c_aliases[0],
+                                                 type);
+            });
 }
 
 }  // namespace init
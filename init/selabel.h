@@ -16,13 +16,22 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <string>
 #include <vector>
 
 namespace android {
 namespace init {
 
+struct SelabelLookupStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
 void SelabelInitialize();
+// Returns how many SelabelLookupFileContext*() calls were answered from the lookup cache.
+SelabelLookupStats SelabelGetLookupStats();
 bool SelabelLookupFileContext(const std::string& key, int type, std::string* result);
 bool SelabelLookupFileContextBestMatch(const std::string& key,
                                        const std::vector<std::string>& aliases, int type,
@@ -48,6 +48,9 @@
 //    OpenSplitPolicy() function below to compile the SEPolicy to a temp directory and load it.
 //    That function contains even more documentation with the specific implementation details of how
 //    the SEPolicy is compiled if needed.
+// 3) On devices built with PRODUCT_SEPOLICY_METADATA_CACHE, the policy compiled in step 2 is kept on
+//    /metadata/sepolicy along with a hash of every compiler input, and is loaded from there instead
+//    of being compiled again for as long as none of those inputs change.
 
 #include "selinux.h"
 
@@ -56,11 +59,13 @@
 #include <linux/audit.h>
 #include <linux/netlink.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <android-base/chrono_utils.h>
 #include <android-base/file.h>
+#include <android-base/hex.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
 #include <android-base/result.h>
@@ -71,6 +76,7 @@
 #include <fs_mgr.h>
 #include <libgsi/libgsi.h>
 #include <libsnapshot/snapshot.h>
+#include <openssl/sha.h>
 #include <selinux/android.h>
 
 #include "block_dev_initializer.h"
@@ -220,6 +226,131 @@ struct PolicyFile {
     std::string path;
 };
 
+// The split policy compiled by secilc is cached on /metadata so that only the first boot after one
+// of its inputs changes pays for the compilation. The key file holds the SHA-256 of every compiler
+// input on its first line and the SHA-256 of the cached policy on its second line.
+constexpr const char kSplitPolicyCacheDir[] = "/metadata/sepolicy";
+constexpr const char kSplitPolicyCacheFile[] = "/metadata/sepolicy/compiled_sepolicy";
+constexpr const char kSplitPolicyCacheKeyFile[] = "/metadata/sepolicy/compiled_sepolicy.key";
+
+std::string Sha256Hex(const std::string& data) {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const uint8_t*>(data.data()), data.size(), digest);
+    return android::base::HexString(digest, sizeof(digest));
+}
+
+bool HashFileContents(SHA256_CTX* ctx, const char* path) {
+    unique_fd fd(open(path, O_RDONLY | O_CLOEXEC));
+    if (fd < 0) {
+        PLOG(ERROR) << "Failed to open " << path;
+        return false;
+    }
+    char buf[16 * 1024];
+    ssize_t n;
+    while ((n = TEMP_FAILURE_RETRY(read(fd.get(), buf, sizeof(buf)))) > 0) {
+        SHA256_Update(ctx, buf, n);
+    }
+    if (n < 0) {
+        PLOG(ERROR) << "Failed to read " << path;
+        return false;
+    }
+    return true;
+}
+
+// Returns the cache key of a secilc invocation: the hash of its arguments, of the contents of every
+// CIL file it reads, of the compiler binary and of /system/build.prop, which changes whenever
+// libsepol may have. |output| is skipped since its name is randomized on every boot.
+std::optional<std::string> GetSplitPolicyCacheKey(const std::vector<const char*>& compile_args,
+                                                  const char* output) {
+    SHA256_CTX ctx;
+    SHA256_Init(&ctx);
+    for (const char* arg : compile_args) {
+        if (arg == output) continue;
+        SHA256_Update(&ctx, arg, strlen(arg) + 1);
+        if (arg == compile_args[0] || android::base::EndsWith(arg, ".cil")) {
+            if (!HashFileContents(&ctx, arg)) return std::nullopt;
+        }
+    }
+    if (!HashFileContents(&ctx, "/system/build.prop")) return std::nullopt;
+
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256_Final(digest, &ctx);
+    return android::base::HexString(digest, sizeof(digest));
+}
+
+// The cache is only usable once first stage init has mounted /metadata. Before that the directory
+// is part of the ramdisk and anything written there would be lost.
+bool IsSplitPolicyCacheAvailable() {
+    if (!SEPOLICY_METADATA_CACHE) return false;
+
+    android::fs_mgr::Fstab mounts;
+    if (!ReadFstabFromFile("/proc/mounts", &mounts)) {
+        LOG(ERROR) << "Could not read /proc/mounts";
+        return false;
+    }
+    return GetEntryForMountPoint(&mounts, "/metadata") != nullptr;
+}
+
+bool OpenCachedSplitPolicy(const std::string& key, PolicyFile* policy_file) {
+    std::string contents;
+    if (!android::base::ReadFileToString(kSplitPolicyCacheKeyFile, &contents)) {
+        if (errno != ENOENT) PLOG(WARNING) << "Failed to read " << kSplitPolicyCacheKeyFile;
+        return false;
+    }
+    auto lines = android::base::Split(contents, "\n");
+    if (lines.size() < 2 || lines[0] != key) {
+        LOG(INFO) << "Cached SELinux policy does not match the current policy inputs";
+        return false;
+    }
+
+    unique_fd fd(open(kSplitPolicyCacheFile, O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+    std::string policy;
+    if (fd < 0 || !android::base::ReadFdToString(fd, &policy)) {
+        PLOG(WARNING) << "Failed to read " << kSplitPolicyCacheFile;
+        return false;
+    }
+    // A torn write must never reach security_load_policy(), which would fail the boot.
+    if (Sha256Hex(policy) != lines[1]) {
+        LOG(WARNING) << "Cached SELinux policy is corrupt, ignoring it";
+        return false;
+    }
+    if (lseek(fd.get(), 0, SEEK_SET) != 0) {
+        PLOG(WARNING) << "Failed to rewind " << kSplitPolicyCacheFile;
+        return false;
+    }
+
+    policy_file->fd = std::move(fd);
+    policy_file->path = kSplitPolicyCacheFile;
+    return true;
+}
+
+void WriteSplitPolicyCache(const std::string& key, int policy_fd) {
+    std::string policy;
+    if (!android::base::ReadFdToString(policy_fd, &policy) || lseek(policy_fd, 0, SEEK_SET) != 0) {
+        PLOG(WARNING) << "Failed to read the compiled SELinux policy";
+        return;
+    }
+    if (mkdir(kSplitPolicyCacheDir, 0700) != 0 && errno != EEXIST) {
+        PLOG(WARNING) << "Failed to create " << kSplitPolicyCacheDir;
+        return;
+    }
+    // Drop the key first so that an interrupted update leaves no key describing a stale policy.
+    if (unlink(kSplitPolicyCacheKeyFile) != 0 && errno != ENOENT) {
+        PLOG(WARNING) << "Failed to remove " << kSplitPolicyCacheKeyFile;
+        return;
+    }
+    if (!android::base::WriteStringToFile(policy, kSplitPolicyCacheFile, 0600, 0, 0)) {
+        PLOG(WARNING) << "Failed to write " << kSplitPolicyCacheFile;
+        return;
+    }
+    if (!android::base::WriteStringToFile(key + "\n" + Sha256Hex(policy) + "\n",
+                                          kSplitPolicyCacheKeyFile, 0600, 0, 0)) {
+        PLOG(WARNING) << "Failed to write " << kSplitPolicyCacheKeyFile;
+        return;
+    }
+    LOG(INFO) << "Cached compiled SELinux policy in " << kSplitPolicyCacheFile;
+}
+
 bool OpenSplitPolicy(PolicyFile* policy_file) {
     // IMPLEMENTATION NOTE: Split policy consists of three or more CIL files:
     // * platform -- policy needed due to logic contained in the system image,
@@ -364,13 +495,34 @@ bool OpenSplitPolicy(PolicyFile* policy_file) {
     if (!odm_policy_cil_file.empty()) {
         compile_args.push_back(odm_policy_cil_file.c_str());
     }
+
+    // The userdebug policy is never cached, for the same reason it never uses the precompiled
+    // policy from the vendor image.
+    std::optional<std::string> cache_key;
+    if (!use_userdebug_policy && IsSplitPolicyCacheAvailable()) {
+        cache_key = GetSplitPolicyCacheKey(compile_args, compiled_sepolicy);
+        if (cache_key && OpenCachedSplitPolicy(*cache_key, policy_file)) {
+            LOG(INFO) << "Using cached SELinux policy " << kSplitPolicyCacheFile;
+            unlink(compiled_sepolicy);
+            return true;
+        }
+    }
+
     compile_args.push_back(nullptr);
 
+    Timer compile_timer;
     if (!ForkExecveAndWaitForCompletion(compile_args[0], (char**)compile_args.data())) {
         unlink(compiled_sepolicy);
         return false;
     }
     unlink(compiled_sepolicy);
+    LOG(INFO) << "Compiled SELinux policy in " << compile_timer;
+    setenv(kEnvSelinuxCompileDurationMs, std::to_string(compile_timer.duration().count()).c_str(),
+           1);
+
+    if (cache_key) {
+        WriteSplitPolicyCache(*cache_key, compiled_sepolicy_fd.get());
+    }
 
     policy_file->fd = std::move(compiled_sepolicy_fd);
     policy_file->path = compiled_sepolicy;
@@ -35,6 +35,9 @@ void SelinuxSetupKernelLogging();
 int SelinuxGetVendorAndroidVersion();
 
 static constexpr char kEnvSelinuxStartedAt[] = "SELINUX_STARTED_AT";
+// Time secilc took to compile the split policy, which second stage init reports as
+// ro.boottime.init.selinux_compile. Unset when a precompiled or cached policy was loaded.
+static constexpr char kEnvSelinuxCompileDurationMs[] = "SELINUX_COMPILE_DURATION_MS";
 
 }  // namespace init
 }  // namespace android
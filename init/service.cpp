@@ -53,6 +53,7 @@
 #ifdef INIT_FULL_SOURCES
 #include <android/api-level.h>
 
+#include "bootchart.h"
 #include "mount_namespace.h"
 #include "reboot_utils.h"
 #include "selinux.h"
@@ -116,6 +117,13 @@ static Result<std::string> ComputeContextFromExecutable(const std::string& servi
     return computed_context;
 }
 
+// Changing the label of a file updates its ctime, so a matching ctime means a context computed
+// from the file's label is still valid.
+static bool IsSameFile(const struct stat& a, const struct stat& b) {
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_ctim.tv_sec == b.st_ctim.tv_sec &&
+           a.st_ctim.tv_nsec == b.st_ctim.tv_nsec;
+}
+
 static bool ExpandArgsAndExecv(const std::vector<std::string>& args, bool sigstop) {
     std::vector<std::string> expanded_args;
     std::vector<char*> c_strings;
@@ -412,6 +420,17 @@ void Service::Reap(const siginfo_t& siginfo) {
     return;
 }
 
+static std::chrono::microseconds MicrosecondsSince(boot_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(boot_clock::now() - start);
+}
+
+void Service::DumpStartTimings() const {
+    LOG(INFO) << "service '" << name_ << "' last start took " << start_timings_.total.count()
+              << "us: seclabel " << start_timings_.seclabel.count() << "us, descriptors "
+              << start_timings_.descriptors.count() << "us, fork " << start_timings_.fork.count()
+              << "us, cgroups " << start_timings_.cgroups.count() << "us";
+}
+
 void Service::DumpState() const {
     LOG(INFO) << "service " << name_;
     LOG(INFO) << "  class '" << Join(classnames_, " ") << "'";
@@ -422,6 +441,9 @@ void Service::DumpState() const {
     for (const auto& file : files_) {
         LOG(INFO) << "  file " << file.name;
     }
+    if (start_timings_.total.count() > 0) {
+        DumpStartTimings();
+    }
 }
 
 
@@ -621,6 +643,9 @@ Result<void> Service::Start() {
         return {};
     }
 
+    auto start_time = boot_clock::now();
+    StartTimings timings;
+
     // cgroups_activated is used for communication from the parent to the child
     // while setsid_finished is used for communication from the child process to
     // the parent process. These two communication channels are separate because
@@ -634,6 +659,7 @@ Result<void> Service::Start() {
         return result;
     }
 
+    auto step_start = boot_clock::now();
     struct stat sb;
     if (stat(args_[0].c_str(), &sb) == -1) {
         flags_ |= SVC_DISABLED;
@@ -643,13 +669,18 @@ Result<void> Service::Start() {
     std::string scon;
     if (!seclabel_.empty()) {
         scon = seclabel_;
+    } else if (computed_seclabel_stat_ && IsSameFile(*computed_seclabel_stat_, sb)) {
+        scon = computed_seclabel_;
     } else {
         auto result = ComputeContextFromExecutable(args_[0]);
         if (!result.ok()) {
             return result.error();
         }
         scon = *result;
+        computed_seclabel_ = scon;
+        computed_seclabel_stat_ = sb;
     }
+    timings.seclabel = MicrosecondsSince(step_start);
 
     if (!mount_namespace_.has_value()) {
         // remember from which mount namespace the service should start
@@ -659,7 +690,9 @@ Result<void> Service::Start() {
     post_data_ = ServiceList::GetInstance().IsPostData();
 
     LOG(INFO) << "starting service '" << name_ << "'...";
+    BootchartAnnotate("service " + name_);
 
+    step_start = boot_clock::now();
     std::vector<Descriptor> descriptors;
     for (const auto& socket : sockets_) {
         if (auto result = socket.Create(scon); result.ok()) {
@@ -676,7 +709,9 @@ Result<void> Service::Start() {
             LOG(INFO) << "Could not open file '" << file.name << "': " << result.error();
         }
     }
+    timings.descriptors = MicrosecondsSince(step_start);
 
+    step_start = boot_clock::now();
     pid_t pid = -1;
     if (namespaces_.flags) {
         pid = clone(nullptr, nullptr, namespaces_.flags | SIGCHLD, nullptr);
@@ -693,6 +728,7 @@ Result<void> Service::Start() {
     } else {
         cgroups_activated.CloseReadFd();
         setsid_finished.CloseWriteFd();
+        timings.fork = MicrosecondsSince(step_start);
     }
 
     if (pid < 0) {
@@ -716,6 +752,7 @@ Result<void> Service::Start() {
     start_order_ = next_start_order_++;
     process_cgroup_empty_ = false;
 
+    step_start = boot_clock::now();
     if (CgroupsAvailable()) {
         bool use_memcg = swappiness_ != -1 || soft_limit_in_bytes_ != -1 || limit_in_bytes_ != -1 ||
                          limit_percent_ != -1 || !limit_property_.empty();
@@ -738,6 +775,7 @@ Result<void> Service::Start() {
             ConfigureMemcg();
         }
     }
+    timings.cgroups = MicrosecondsSince(step_start);
 
     if (oom_score_adjust_ != DEFAULT_OOM_SCORE_ADJUST) {
         LmkdRegister(name_, uid(), pid_, oom_score_adjust_);
@@ -776,10 +814,14 @@ Result<void> Service::Start() {
 
     setsid_finished.Close();
 
+    timings.total = MicrosecondsSince(start_time);
+    start_timings_ = timings;
+
     NotifyStateChange("running");
     reboot_on_failure.Disable();
 
-    LOG(INFO) << "... started service '" << name_ << "' has pid " << pid_;
+    LOG(INFO) << "... started service '" << name_ << "' has pid " << pid_ << " (took "
+              << timings.total.count() << "us)";
 
     return {};
 }
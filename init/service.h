@@ -17,6 +17,7 @@
 #pragma once
 
 #include <signal.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <algorithm>
@@ -69,6 +70,16 @@ class Service {
     friend class ServiceParser;
 
   public:
+    // How long the steps of the last Start() took in init. The time the child spends on its own
+    // setup, such as the SELinux transition at exec, is not included.
+    struct StartTimings {
+        std::chrono::microseconds seclabel{};     // stat() of the executable and its context
+        std::chrono::microseconds descriptors{};  // creating sockets and files
+        std::chrono::microseconds fork{};
+        std::chrono::microseconds cgroups{};  // process group, profiles and memcg setup
+        std::chrono::microseconds total{};
+    };
+
     Service(const std::string& name, Subcontext* subcontext_for_restart_commands,
             const std::string& filename, const std::vector<std::string>& args);
 
@@ -115,6 +126,8 @@ class Service {
     unsigned flags() const { return flags_; }
     pid_t pid() const { return pid_; }
     android::base::boot_clock::time_point time_started() const { return time_started_; }
+    const StartTimings& start_timings() const { return start_timings_; }
+    void DumpStartTimings() const;
     int crash_count() const { return crash_count_; }
     int was_last_exit_ok() const { return was_last_exit_ok_; }
     uid_t uid() const { return proc_attr_.uid(); }
@@ -183,6 +196,7 @@ class Service {
     unsigned flags_;
     pid_t pid_;
     android::base::boot_clock::time_point time_started_;  // time of last start
+    StartTimings start_timings_;
     android::base::boot_clock::time_point time_crashed_;  // first crash within inspection window
     int crash_count_;                     // number of times crashed within window
     bool upgraded_mte_ = false;           // whether we upgraded async MTE -> sync MTE before
@@ -196,6 +210,10 @@ class Service {
     NamespaceInfo namespaces_;
 
     std::string seclabel_;
+    // The context computed from args_[0] when no seclabel is given, and the stat() of the
+    // executable it was computed for, so that restarts don't repeat the SELinux queries.
+    std::string computed_seclabel_;
+    std::optional<struct stat> computed_seclabel_stat_;
 
     std::vector<SocketDescriptor> sockets_;
     std::vector<FileDescriptor> files_;
@@ -37,9 +37,62 @@ size_t ServiceList::CheckAllCommands() {
 }
 
 void ServiceList::AddService(std::unique_ptr<Service> service) {
+    IndexService(service.get());
     services_.emplace_back(std::move(service));
 }
 
+void ServiceList::IndexService(Service* service) {
+    // The first service with a given name or interface wins, as with a linear scan.
+    by_name_.emplace(service->name(), service);
+    for (const auto& interface : service->interfaces()) {
+        by_interface_.emplace(interface, service);
+    }
+}
+
+void ServiceList::RebuildIndexes() {
+    by_name_.clear();
+    by_interface_.clear();
+    by_pid_.clear();
+    for (const auto& service : services_) {
+        IndexService(service.get());
+    }
+}
+
+Service* ServiceList::FindServiceByName(const std::string& name) const {
+    auto it = by_name_.find(name);
+    return it != by_name_.end() ? it->second : nullptr;
+}
+
+Service* ServiceList::FindServiceByPid(pid_t pid) const {
+    if (pid <= 0) {
+        // Stopped services all have a pid of 0; match the first one, as a scan would.
+        for (const auto& service : services_) {
+            if (service->pid() == pid) return service.get();
+        }
+        return nullptr;
+    }
+
+    if (auto it = by_pid_.find(pid); it != by_pid_.end()) {
+        if (it->second->pid() == pid) {
+            return it->second;
+        }
+        by_pid_.erase(it);
+    }
+
+    // Either the service started since the cache was last refreshed, or no
+    // service has this pid. Refresh the whole cache so that the next lookups
+    // for other running services are hits.
+    Service* found = nullptr;
+    by_pid_.clear();
+    for (const auto& service : services_) {
+        if (service->pid() > 0) {
+            by_pid_.emplace(service->pid(), service.get());
+            if (service->pid() == pid) found = service.get();
+        }
+    }
+    return found;
+}
+
 // Shutdown services in the opposite order that they were started.
 const std::vector<Service*> ServiceList::services_in_shutdown_order() const {
     std::vector<Service*> shutdown_services;
@@ -60,6 +113,7 @@ void ServiceList::RemoveService(const Service& svc) {
     }
 
     services_.erase(svc_it);
+    RebuildIndexes();
 }
 
 void ServiceList::DumpState() const {
@@ -18,6 +18,9 @@
 
 #include <iterator>
 #include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/logging.h>
@@ -42,10 +45,18 @@ class ServiceList {
     void RemoveServiceIf(UnaryPredicate predicate) {
         services_.erase(std::remove_if(services_.begin(), services_.end(), predicate),
                         services_.end());
+        RebuildIndexes();
     }
 
+    // Lookups by name and by pid, the common cases, go through hash indexes; any other member
+    // function is matched with a linear scan.
     template <typename T, typename F = decltype(&Service::name)>
     Service* FindService(T value, F function = &Service::name) const {
+        if constexpr (std::is_same_v<F, decltype(&Service::name)>) {
+            if (function == &Service::name) return FindServiceByName(value);
+        } else if constexpr (std::is_same_v<F, decltype(&Service::pid)>) {
+            if (function == &Service::pid) return FindServiceByPid(value);
+        }
         auto svc = std::find_if(services_.begin(), services_.end(),
                                 [&function, &value](const std::unique_ptr<Service>& s) {
                                     return std::invoke(function, s) == value;
@@ -68,13 +79,8 @@ class ServiceList {
     }
 
     Service* FindInterface(const std::string& interface_name) {
-        for (const auto& svc : services_) {
-            if (svc->interfaces().count(interface_name) > 0) {
-                return svc.get();
-            }
-        }
-
-        return nullptr;
+        auto it = by_interface_.find(interface_name);
+        return it != by_interface_.end() ? it->second : nullptr;
     }
 
     void DumpState() const;
@@ -93,8 +99,20 @@ class ServiceList {
     auto size() const { return services_.size(); }
 
   private:
+    Service* FindServiceByName(const std::string& name) const;
+    Service* FindServiceByPid(pid_t pid) const;
+    void IndexService(Service* service);
+    void RebuildIndexes();
+
     std::vector<std::unique_ptr<Service>> services_;
 
+    // Indexes into |services_|. Names and interfaces are fixed once a service is added. Pids
+    // change as services start and stop, so |by_pid_| is a cache that is checked on lookup and
+    // refreshed on a miss.
+    std::unordered_map<std::string, Service*> by_name_;
+    std::unordered_map<std::string, Service*> by_interface_;
+    mutable std::unordered_map<pid_t, Service*> by_pid_;
+
     bool post_data_ = false;
     std::vector<std::string> delayed_service_names_;
 };
@@ -308,7 +308,24 @@ bool SnapuserdSelinuxHelper::TestSnapuserdIsReady() {
     return false;
 }
 
+// Fetch the COW metadata parsed by the first-stage daemon, so that its
+// replacement can start serving I/O without parsing the COWs again. This is
+// an optimization only; failures are not fatal.
+static unique_fd ExportFirstStageSnapuserdMetadata() {
+    auto client = SnapuserdClient::TryConnect(android::snapshot::kSnapuserdSocket, 1s);
+    if (!client || !client->SupportsMetadataHandover()) {
+        return {};
+    }
+    return client->ExportMetadata();
+}
+
 void SnapuserdSelinuxHelper::RelaunchFirstStageSnapuserd() {
+    unique_fd metadata_fd = ExportFirstStageSnapuserdMetadata();
+    if (metadata_fd >= 0) {
+        // Flags must precede the handler arguments.
+        argv_.insert(argv_.begin() + 2, "-metadata_fd=" + std::to_string(metadata_fd.get()));
+    }
+
     if (!sm_->DetachFirstStageSnapuserdForSelinux()) {
         LOG(FATAL) << "Could not perform selinux transition";
     }
@@ -357,6 +374,10 @@ void SnapuserdSelinuxHelper::RelaunchFirstStageSnapuserd() {
     if (fcntl(fd.value(), F_SETFD, FD_CLOEXEC) < 0) {
         PLOG(FATAL) << "fcntl FD_CLOEXEC failed for snapuserd fd";
     }
+    // The metadata memfd, on the other hand, is inherited.
+    if (metadata_fd >= 0 && fcntl(metadata_fd.get(), F_SETFD, 0) < 0) {
+        PLOG(FATAL) << "fcntl failed for snapuserd metadata fd";
+    }
 
     std::vector<char*> argv;
     for (auto& arg : argv_) {
@@ -22,6 +22,7 @@
 #include <sys/resource.h>
 #include <unistd.h>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
@@ -66,8 +67,11 @@ class SubcontextProcess {
     void MainLoop();
 
   private:
+    Result<void> InvokeCommand(const SubcontextCommand::ExecuteCommand& execute_command) const;
     void RunCommand(const SubcontextCommand::ExecuteCommand& execute_command,
                     SubcontextReply* reply) const;
+    void RunBatch(const SubcontextCommand::ExecuteBatchCommand& execute_batch_command,
+                  SubcontextReply* reply) const;
     void ExpandArgs(const SubcontextCommand::ExpandArgsCommand& expand_args_command,
                     SubcontextReply* reply) const;
 
@@ -76,8 +80,8 @@ class SubcontextProcess {
     const int init_fd_;
 };
 
-void SubcontextProcess::RunCommand(const SubcontextCommand::ExecuteCommand& execute_command,
-                                   SubcontextReply* reply) const {
+Result<void> SubcontextProcess::InvokeCommand(
+        const SubcontextCommand::ExecuteCommand& execute_command) const {
     // Need to use ArraySplice instead of this code.
     auto args = std::vector<std::string>();
     for (const auto& string : execute_command.args()) {
@@ -85,13 +89,15 @@ void SubcontextProcess::RunCommand(const SubcontextCommand::ExecuteCommand& exec
     }
 
     auto map_result = function_map_->Find(args);
-    Result<void> result;
     if (!map_result.ok()) {
-        result = Error() << "Cannot find command: " << map_result.error();
-    } else {
-        result = RunBuiltinFunction(map_result->function, args, context_);
+        return Error() << "Cannot find command: " << map_result.error();
     }
+    return RunBuiltinFunction(map_result->function, args, context_);
+}
 
+void SubcontextProcess::RunCommand(const SubcontextCommand::ExecuteCommand& execute_command,
+                                   SubcontextReply* reply) const {
+    auto result = InvokeCommand(execute_command);
     if (result.ok()) {
         reply->set_success(true);
     } else {
@@ -101,6 +107,30 @@ void SubcontextProcess::RunCommand(const SubcontextCommand::ExecuteCommand& exec
     }
 }
 
+void SubcontextProcess::RunBatch(
+        const SubcontextCommand::ExecuteBatchCommand& execute_batch_command,
+        SubcontextReply* reply) const {
+    auto* batch_reply = reply->mutable_execute_batch_reply();
+    for (const auto& execute_command : execute_batch_command.commands()) {
+        android::base::Timer t;
+        auto result = InvokeCommand(execute_command);
+
+        auto* command_result = batch_reply->add_results();
+        command_result->set_duration_ms(t.duration().count());
+        if (!result.ok()) {
+            auto* failure = command_result->mutable_failure();
+            failure->set_error_string(result.error().message());
+            failure->set_error_errno(result.error().code());
+        }
+
+        // init would have handled the shutdown before running the next command, so stop here and
+        // let it run the remainder of the batch itself if it gets that far.
+        if (!shutdown_command.empty()) {
+            break;
+        }
+    }
+}
+
 void SubcontextProcess::ExpandArgs(const SubcontextCommand::ExpandArgsCommand& expand_args_command,
                                    SubcontextReply* reply) const {
     for (const auto& arg : expand_args_command.args()) {
@@ -156,6 +186,10 @@ void SubcontextProcess::MainLoop() {
                 ExpandArgs(subcontext_command.expand_args_command(), &reply);
                 break;
             }
+            case SubcontextCommand::kExecuteBatchCommand: {
+                RunBatch(subcontext_command.execute_batch_command(), &reply);
+                break;
+            }
             default:
                 LOG(FATAL) << "Unknown message type from init: "
                            << subcontext_command.command_case();
@@ -316,6 +350,49 @@ Result<void> Subcontext::Execute(const std::vector<std::string>& args) {
     return {};
 }
 
+Result<std::vector<SubcontextBatchResult>> Subcontext::ExecuteBatch(
+        const std::vector<const std::vector<std::string>*>& commands) {
+    auto subcontext_command = SubcontextCommand{};
+    auto* execute_batch_command = subcontext_command.mutable_execute_batch_command();
+    for (const auto* args : commands) {
+        auto* execute_command = execute_batch_command->add_commands();
+        std::copy(args->begin(), args->end(),
+                  RepeatedPtrFieldBackInserter(execute_command->mutable_args()));
+    }
+
+    auto subcontext_reply = TransmitMessage(subcontext_command);
+    if (!subcontext_reply.ok()) {
+        return subcontext_reply.error();
+    }
+
+    if (subcontext_reply->reply_case() == SubcontextReply::kFailure) {
+        auto& failure = subcontext_reply->failure();
+        return ResultError<>(failure.error_string(), failure.error_errno());
+    }
+
+    if (subcontext_reply->reply_case() != SubcontextReply::kExecuteBatchReply) {
+        return Error() << "Unexpected message type from subcontext: "
+                       << subcontext_reply->reply_case();
+    }
+
+    auto& reply = subcontext_reply->execute_batch_reply();
+    if (reply.results_size() == 0 || static_cast<size_t>(reply.results_size()) > commands.size()) {
+        return Error() << "Subcontext returned " << reply.results_size()
+                       << " results for a batch of " << commands.size() << " commands";
+    }
+
+    auto results = std::vector<SubcontextBatchResult>{};
+    for (const auto& command_result : reply.results()) {
+        auto& batch_result = results.emplace_back();
+        batch_result.duration = std::chrono::milliseconds(command_result.duration_ms());
+        if (command_result.has_failure()) {
+            auto& failure = command_result.failure();
+            batch_result.result = ResultError<>(failure.error_string(), failure.error_errno());
+        }
+    }
+    return results;
+}
+
 Result<std::vector<std::string>> Subcontext::ExpandArgs(const std::vector<std::string>& args) {
     auto subcontext_command = SubcontextCommand{};
     std::copy(args.begin(), args.end(),
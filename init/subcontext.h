@@ -18,6 +18,7 @@
 
 #include <signal.h>
 
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -34,6 +35,11 @@ static constexpr const char kInitContext[] = "u:r:init:s0";
 static constexpr const char kVendorContext[] = "u:r:vendor_init:s0";
 static constexpr const char kTestContext[] = "test-test-test";
 
+struct SubcontextBatchResult {
+    Result<void> result;
+    std::chrono::milliseconds duration;
+};
+
 class Subcontext {
   public:
     Subcontext(std::vector<std::string> path_prefixes, std::string_view context, bool host = false)
@@ -46,6 +52,10 @@ class Subcontext {
     }
 
     Result<void> Execute(const std::vector<std::string>& args);
+    // Runs each command in order with a single round trip to the subcontext. The subcontext stops
+    // early if a command triggers a shutdown, so fewer results than commands may be returned.
+    Result<std::vector<SubcontextBatchResult>> ExecuteBatch(
+            const std::vector<const std::vector<std::string>*>& commands);
     Result<std::vector<std::string>> ExpandArgs(const std::vector<std::string>& args);
     void Restart();
     bool PathMatchesSubcontext(const std::string& path) const;
@@ -148,6 +148,37 @@ TEST(subcontext, TriggerShutdown) {
     EXPECT_EQ(kTestShutdownCommand, trigger_shutdown_command);
 }
 
+TEST(subcontext, ExecuteBatch) {
+    static constexpr const char kTestShutdownCommand[] = "reboot,test-batch-shutdown";
+    static std::string trigger_shutdown_command;
+    trigger_shutdown = [](const std::string& command) { trigger_shutdown_command = command; };
+    RunTest([](auto& subcontext) {
+        auto first_pid = subcontext.pid();
+
+        auto add_this = std::vector<std::string>{"add_word", "this"};
+        auto add_is = std::vector<std::string>{"add_word", "is"};
+        auto sane_error = std::vector<std::string>{"generate_sane_error"};
+        auto shutdown = std::vector<std::string>{"trigger_shutdown", kTestShutdownCommand};
+        auto add_skipped = std::vector<std::string>{"add_word", "skipped"};
+
+        auto results =
+                subcontext.ExecuteBatch({&add_this, &sane_error, &add_is, &shutdown, &add_skipped});
+        ASSERT_RESULT_OK(results);
+        ASSERT_EQ(4U, results->size());
+        EXPECT_RESULT_OK(results->at(0).result);
+        ASSERT_FALSE(results->at(1).result.ok());
+        EXPECT_EQ("Sane error!", results->at(1).result.error().message());
+        EXPECT_RESULT_OK(results->at(2).result);
+        EXPECT_RESULT_OK(results->at(3).result);
+
+        auto result = subcontext.Execute(std::vector<std::string>{"return_words_as_error"});
+        ASSERT_FALSE(result.ok());
+        EXPECT_EQ("this is", result.error().message());
+        EXPECT_EQ(first_pid, subcontext.pid());
+    });
+    EXPECT_EQ(kTestShutdownCommand, trigger_shutdown_command);
+}
+
 TEST(subcontext, ExpandArgs) {
     RunTest([](auto& subcontext) {
         auto args = std::vector<std::string>{
@@ -17,8 +17,10 @@
 #include "uevent_listener.h"
 
 #include <fcntl.h>
+#include <linux/netlink.h>
 #include <poll.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <memory>
@@ -29,7 +31,7 @@
 namespace android {
 namespace init {
 
-static void ParseEvent(const char* msg, Uevent* uevent) {
+void ParseEvent(const char* msg, Uevent* uevent) {
     uevent->partition_num = -1;
     uevent->major = -1;
     uevent->minor = -1;
@@ -86,7 +88,26 @@ static void ParseEvent(const char* msg, Uevent* uevent) {
     }
 }
 
-UeventListener::UeventListener(size_t uevent_socket_rcvbuf_size) {
+// Number of uevents read from the socket with a single recvmmsg() call. Hotplug and cold boot
+// produce uevents in bursts, so this saves most of the syscalls of reading them one by one.
+static constexpr size_t kUeventBatchSize = 16;
+
+struct UeventListener::UeventBatch {
+    struct Message {
+        char msg[UEVENT_MSG_LEN + 2];
+        sockaddr_nl addr;
+        char control[CMSG_SPACE(sizeof(ucred))];
+        iovec iov;
+    };
+
+    Message messages[kUeventBatchSize];
+    mmsghdr headers[kUeventBatchSize];
+    size_t size = 0;
+    size_t next = 0;
+};
+
+UeventListener::UeventListener(size_t uevent_socket_rcvbuf_size)
+    : batch_(std::make_unique<UeventBatch>()) {
     device_fd_.reset(uevent_open_socket(uevent_socket_rcvbuf_size, true));
     if (device_fd_ == -1) {
         LOG(FATAL) << "Could not open uevent socket";
@@ -95,28 +116,77 @@ UeventListener::UeventListener(size_t uevent_socket_rcvbuf_size) {
     fcntl(device_fd_.get(), F_SETFL, O_NONBLOCK);
 }
 
+UeventListener::~UeventListener() = default;
+
+// Hands out the messages of the current batch, and reads a new batch once they're all consumed.
+// Like uevent_kernel_multicast_recv(), messages that don't come from the kernel are rejected.
 ReadUeventResult UeventListener::ReadUevent(Uevent* uevent) const {
-    char msg[UEVENT_MSG_LEN + 2];
-    int n = uevent_kernel_multicast_recv(device_fd_.get(), msg, UEVENT_MSG_LEN);
-    if (n <= 0) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            PLOG(ERROR) << "Error reading from Uevent Fd";
+    UeventBatch& batch = *batch_;
+    if (batch.next == batch.size) {
+        for (size_t i = 0; i < kUeventBatchSize; ++i) {
+            auto& message = batch.messages[i];
+            message.iov = {message.msg, UEVENT_MSG_LEN};
+            batch.headers[i].msg_hdr = {
+                    .msg_name = &message.addr,
+                    .msg_namelen = sizeof(message.addr),
+                    .msg_iov = &message.iov,
+                    .msg_iovlen = 1,
+                    .msg_control = message.control,
+                    .msg_controllen = sizeof(message.control),
+            };
         }
+        batch.next = batch.size = 0;
+        int n = TEMP_FAILURE_RETRY(
+                recvmmsg(device_fd_.get(), batch.headers, kUeventBatchSize, 0, nullptr));
+        if (n <= 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                PLOG(ERROR) << "Error reading from Uevent Fd";
+            }
+            return ReadUeventResult::kFailed;
+        }
+        batch.size = n;
+    }
+
+    auto& header = batch.headers[batch.next];
+    auto& message = batch.messages[batch.next];
+    batch.next++;
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&header.msg_hdr);
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_CREDENTIALS || message.addr.nl_pid != 0 ||
+        message.addr.nl_groups == 0) {
+        memset(message.msg, 0, sizeof(message.msg));
+        errno = EIO;
+        PLOG(ERROR) << "Error reading from Uevent Fd";
         return ReadUeventResult::kFailed;
     }
+
+    size_t n = header.msg_len;
     if (n >= UEVENT_MSG_LEN) {
         LOG(ERROR) << "Uevent overflowed buffer, discarding";
         return ReadUeventResult::kInvalid;
     }
 
-    msg[n] = '\0';
-    msg[n + 1] = '\0';
+    message.msg[n] = '\0';
+    message.msg[n + 1] = '\0';
 
-    ParseEvent(msg, uevent);
+    ParseEvent(message.msg, uevent);
 
     return ReadUeventResult::kSuccess;
 }
 
+// Reads and handles uevents until the socket has been drained. The same Uevent is reused for all
+// of them so that its strings don't have to be reallocated for every uevent.
+ListenerAction UeventListener::ReadUevents(const ListenerCallback& callback) const {
+    Uevent uevent;
+    ReadUeventResult result;
+    while ((result = ReadUevent(&uevent)) != ReadUeventResult::kFailed) {
+        // Skip processing the uevent if it is invalid.
+        if (result == ReadUeventResult::kInvalid) continue;
+        if (callback(uevent) == ListenerAction::kStop) return ListenerAction::kStop;
+    }
+    return ListenerAction::kContinue;
+}
+
 // RegenerateUevents*() walks parts of the /sys tree and pokes the uevent files to cause the kernel
 // to regenerate device add uevents that have already happened.  This is particularly useful when
 // starting ueventd, to regenerate all of the uevents that it had previously missed.
@@ -134,13 +204,7 @@ ListenerAction UeventListener::RegenerateUeventsForDir(DIR* d,
         write(fd, "add\n", 4);
         close(fd);
 
-        Uevent uevent;
-        ReadUeventResult result;
-        while ((result = ReadUevent(&uevent)) != ReadUeventResult::kFailed) {
-            // Skip processing the uevent if it is invalid.
-            if (result == ReadUeventResult::kInvalid) continue;
-            if (callback(uevent) == ListenerAction::kStop) return ListenerAction::kStop;
-        }
+        if (ReadUevents(callback) == ListenerAction::kStop) return ListenerAction::kStop;
     }
 
     dirent* de;
@@ -191,6 +255,11 @@ void UeventListener::Poll(const ListenerCallback& callback,
 
     auto start_time = steady_clock::now();
 
+    // Uevents left in the batch by a callback that stopped early won't wake up poll().
+    if (batch_->next != batch_->size) {
+        if (ReadUevents(callback) == ListenerAction::kStop) return;
+    }
+
     while (true) {
         ufd.revents = 0;
 
@@ -213,13 +282,7 @@ void UeventListener::Poll(const ListenerCallback& callback,
         if (ufd.revents & POLLIN) {
             // We're non-blocking, so if we receive a poll event keep processing until
             // we have exhausted all uevent messages.
-            Uevent uevent;
-            ReadUeventResult result;
-            while ((result = ReadUevent(&uevent)) != ReadUeventResult::kFailed) {
-                // Skip processing the uevent if it is invalid.
-                if (result == ReadUeventResult::kInvalid) continue;
-                if (callback(uevent) == ListenerAction::kStop) return;
-            }
+            if (ReadUevents(callback) == ListenerAction::kStop) return;
         }
     }
 }
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "uevent_listener.h"
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+namespace android {
+namespace init {
+
+// Parses a typical block device add uevent into the same Uevent over and over, as
+// UeventListener does while draining the socket. Reports uevents/sec as items_per_second.
+static void BenchmarkParseEvent(benchmark::State& state) {
+    static const char kMessage[] =
+            "add@/devices/platform/soc/1d84000.ufshc/host0/target0:0:0/0:0:0:0/block/sda/sda1\0"
+            "ACTION=add\0"
+            "DEVPATH=/devices/platform/soc/1d84000.ufshc/host0/target0:0:0/0:0:0:0/block/sda/sda1\0"
+            "SUBSYSTEM=block\0"
+            "MAJOR=8\0"
+            "MINOR=1\0"
+            "DEVNAME=sda1\0"
+            "DEVTYPE=partition\0"
+            "PARTN=1\0"
+            "PARTNAME=super\0"
+            "SEQNUM=4242\0";
+
+    Uevent uevent;
+    for (auto _ : state) {
+        ParseEvent(kMessage, &uevent);
+        benchmark::DoNotOptimize(uevent);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BenchmarkParseEvent);
+
+}  // namespace init
+}  // namespace android
@@ -24,10 +24,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <new>
 #include <set>
 #include <thread>
 
@@ -88,10 +92,12 @@
 // 1) ueventd regenerates uevents by doing the /sys traversal and listens to the netlink socket for
 //    the generated uevents.  It writes these uevents into a queue represented by a vector.
 //
-// 2) ueventd forks 'n' separate uevent handler subprocesses and has each of them to handle the
-//    uevents in the queue based on a starting offset (their process number) and a stride (the total
-//    number of processes).  Note that no IPC happens at this point and only const functions from
-//    DeviceHandler should be called from this context.
+// 2) ueventd forks 'n' separate uevent handler subprocesses and has each of them repeatedly claim
+//    the next chunk of uevents in the queue from a counter in shared memory, so that a subprocess
+//    that is given cheap uevents moves on to more work instead of idling.  Besides that counter,
+//    no IPC happens at this point and only const functions from DeviceHandler should be called
+//    from this context.  With parallel restorecon enabled, each subprocess then claims
+//    directories to restorecon the same way.
 //
 // 3) In parallel to the subprocesses handling the uevents, the main thread of ueventd calls
 //    selinux_android_restorecon() recursively on /sys/class, /sys/block, and /sys/devices.
@@ -111,6 +117,17 @@
 namespace android {
 namespace init {
 
+// Shared by ueventd and its cold boot subprocesses through a MAP_SHARED mapping, which is inherited
+// across fork().  Each counter is the index of the next unclaimed entry in the respective queue.
+struct ColdBootWorkQueue {
+    std::atomic<size_t> next_uevent;
+    std::atomic<size_t> next_restorecon;
+};
+static_assert(std::atomic<size_t>::is_always_lock_free);
+
+// Uevents are claimed a few at a time, since handling one is usually much cheaper than claiming it.
+static constexpr size_t kUeventChunkSize = 16;
+
 class ColdBoot {
   public:
     ColdBoot(UeventListener& uevent_listener,
@@ -126,11 +143,11 @@ class ColdBoot {
     void Run();
 
   private:
-    void UeventHandlerMain(unsigned int process_num, unsigned int total_processes);
+    void UeventHandlerMain();
     void RegenerateUevents();
     void ForkSubProcesses();
     void WaitForSubProcesses();
-    void RestoreConHandler(unsigned int process_num, unsigned int total_processes);
+    void RestoreConHandler(unsigned int process_num);
     void GenerateRestoreCon(const std::string& directory);
 
     UeventListener& uevent_listener_;
@@ -143,25 +160,37 @@ class ColdBoot {
 
     std::set<pid_t> subprocess_pids_;
 
+    ColdBootWorkQueue* work_queue_ = nullptr;
+
     std::vector<std::string> restorecon_queue_;
 
     std::vector<std::string> parallel_restorecon_queue_;
 };
 
-void ColdBoot::UeventHandlerMain(unsigned int process_num, unsigned int total_processes) {
-    for (unsigned int i = process_num; i < uevent_queue_.size(); i += total_processes) {
-        auto& uevent = uevent_queue_[i];
+void ColdBoot::UeventHandlerMain() {
+    while (true) {
+        size_t begin =
+                work_queue_->next_uevent.fetch_add(kUeventChunkSize, std::memory_order_relaxed);
+        if (begin >= uevent_queue_.size()) break;
+        size_t end = std::min(begin + kUeventChunkSize, uevent_queue_.size());
 
-        for (auto& uevent_handler : uevent_handlers_) {
-            uevent_handler->HandleUevent(uevent);
+        for (size_t i = begin; i < end; ++i) {
+            auto& uevent = uevent_queue_[i];
+
+            for (auto& uevent_handler : uevent_handlers_) {
+                uevent_handler->HandleUevent(uevent);
+            }
         }
     }
 }
 
-void ColdBoot::RestoreConHandler(unsigned int process_num, unsigned int total_processes) {
+void ColdBoot::RestoreConHandler(unsigned int process_num) {
     android::base::Timer t_process;
 
-    for (unsigned int i = process_num; i < restorecon_queue_.size(); i += total_processes) {
+    while (true) {
+        size_t i = work_queue_->next_restorecon.fetch_add(1, std::memory_order_relaxed);
+        if (i >= restorecon_queue_.size()) break;
+
         android::base::Timer t;
         auto& dir = restorecon_queue_[i];
 
@@ -222,9 +251,12 @@ void ColdBoot::ForkSubProcesses() {
         }
 
         if (pid == 0) {
-            UeventHandlerMain(i, num_handler_subprocesses_);
+            UeventHandlerMain();
+            auto selabel_stats = SelabelGetLookupStats();
+            LOG(VERBOSE) << "selabel lookups on process '" << i << "': " << selabel_stats.hits
+                         << " cached, " << selabel_stats.misses << " uncached";
             if (enable_parallel_restorecon_) {
-                RestoreConHandler(i, num_handler_subprocesses_);
+                RestoreConHandler(i);
             }
             _exit(EXIT_SUCCESS);
         }
@@ -284,6 +316,13 @@ void ColdBoot::Run() {
         }
     }
 
+    void* work_queue = mmap(nullptr, sizeof(ColdBootWorkQueue), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (work_queue == MAP_FAILED) {
+        PLOG(FATAL) << "mmap() of the cold boot work queue failed";
+    }
+    work_queue_ = new (work_queue) ColdBootWorkQueue{};
+
     ForkSubProcesses();
 
     if (!enable_parallel_restorecon_) {
@@ -292,6 +331,9 @@ void ColdBoot::Run() {
 
     WaitForSubProcesses();
 
+    munmap(work_queue, sizeof(ColdBootWorkQueue));
+    work_queue_ = nullptr;
+
     android::base::SetProperty(kColdBootDoneProp, "true");
     LOG(INFO) << "Coldboot took " << cold_boot_timer.duration().count() / 1000.0f << " seconds";
 }
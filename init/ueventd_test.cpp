@@ -32,6 +32,8 @@
 #include <selinux/label.h>
 #include <selinux/selinux.h>
 
+#include "selabel.h"
+
 using namespace std::chrono_literals;
 using namespace std::string_literals;
 
@@ -197,3 +199,32 @@ TEST(ueventd, selabel_lookup_MultiThreaded) {
     EXPECT_EQ(0U, num_context_check_failures);
     EXPECT_GT(num_successes, 0U);
 }
+
+TEST(ueventd, SelabelLookupFileContext_Cached) {
+    if (getuid() != 0) {
+        GTEST_SKIP() << "Skipping test, must be run as root.";
+        return;
+    }
+
+    std::unique_ptr<selabel_handle, decltype(&selabel_close)> sehandle(
+        selinux_android_file_context_handle(), &selabel_close);
+    ASSERT_TRUE(sehandle);
+
+    char* secontext;
+    ASSERT_EQ(0, selabel_lookup(sehandle.get(), &secontext, "/dev/null", 020666));
+    std::string expected_context = secontext;
+    freecon(secontext);
+
+    android::init::SelabelInitialize();
+
+    auto before = android::init::SelabelGetLookupStats();
+    std::string context;
+    ASSERT_TRUE(android::init::SelabelLookupFileContext("/dev/null", 020666, &context));
+    EXPECT_EQ(expected_context, context);
+    ASSERT_TRUE(android::init::SelabelLookupFileContext("/dev/null", 020666, &context));
+    EXPECT_EQ(expected_context, context);
+    auto after = android::init::SelabelGetLookupStats();
+
+    EXPECT_EQ(before.misses + 1, after.misses);
+    EXPECT_EQ(before.hits + 1, after.hits);
+}
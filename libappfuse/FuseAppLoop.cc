@@ -94,7 +94,8 @@ bool HandleMessage(FuseAppLoop* loop, FuseBuffer* buffer, int fd, FuseAppLoopCal
     LOG(VERBOSE) << "Read a fuse packet, opcode=" << opcode;
     switch (opcode) {
         case FUSE_FORGET:
-            // Do not reply to FUSE_FORGET.
+        case FUSE_BATCH_FORGET:
+            // Do not reply to FUSE_FORGET and FUSE_BATCH_FORGET.
             return true;
 
         case FUSE_LOOKUP:
@@ -223,7 +224,8 @@ void FuseAppLoop::Start(FuseAppLoopCallback* callback) {
     last_event = 0;
     break_event = 0;
 
-    FuseBuffer buffer;
+    // FuseBuffer is too large for the stack of the threads that run the loop.
+    std::unique_ptr<FuseBuffer> buffer(new FuseBuffer());
     while (true) {
         if (!epoll_controller->Wait(1)) {
             break;
@@ -236,7 +238,7 @@ void FuseAppLoop::Start(FuseAppLoopCallback* callback) {
             break;
         }
 
-        if (!HandleMessage(this, &buffer, fd_, callback)) {
+        if (!HandleMessage(this, buffer.get(), fd_, callback)) {
             break;
         }
     }
@@ -17,8 +17,13 @@
 #include "libappfuse/FuseBridgeLoop.h"
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
+#include <condition_variable>
+#include <functional>
+#include <thread>
 #include <unordered_map>
 
 #include <android-base/logging.h>
@@ -72,13 +77,51 @@ class FuseBridgeEntry {
           device_fd_(std::move(dev_fd)),
           proxy_fd_(std::move(proxy_fd)),
           state_(FuseBridgeState::kWaitToReadEither),
-          last_state_(FuseBridgeState::kWaitToReadEither),
           last_device_events_({this, 0}),
           last_proxy_events_({this, 0}),
-          open_count_(0) {}
+          open_count_(0),
+          mounted_(false),
+          transfer_pending_(false),
+          stop_worker_(false) {}
+
+    ~FuseBridgeEntry() { StopWorker(); }
+
+    // Starts the worker thread that runs Transfer() for this bridge, so that
+    // copying one mount's messages does not hold up the others. |on_done| is
+    // invoked on the worker after each transfer.
+    void StartWorker(std::function<void(FuseBridgeEntry*)> on_done) {
+        on_done_ = std::move(on_done);
+        worker_ = std::thread([this] { RunWorker(); });
+    }
+
+    // Hands the events last observed by epoll to the worker. The caller must
+    // not watch the bridge's FDs again until |on_done| has been invoked.
+    void ScheduleTransfer() {
+        std::lock_guard<std::mutex> lock(worker_mutex_);
+        transfer_pending_ = true;
+        worker_cv_.notify_one();
+    }
+
+    void StopWorker() {
+        {
+            std::lock_guard<std::mutex> lock(worker_mutex_);
+            stop_worker_ = true;
+            worker_cv_.notify_one();
+        }
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+    }
+
+    // Returns true once after the bridge has replied to FUSE_INIT.
+    bool TakeMounted() {
+        const bool mounted = mounted_;
+        mounted_ = false;
+        return mounted;
+    }
 
     // Transfer bytes depends on availability of FDs and the internal |state_|.
-    void Transfer(FuseBridgeLoopCallback* callback) {
+    void Transfer() {
         constexpr int kUnexpectedEventMask = ~(EPOLLIN | EPOLLOUT);
         const bool unexpected_event = (last_device_events_.events & kUnexpectedEventMask) ||
                                       (last_proxy_events_.events & kUnexpectedEventMask);
@@ -86,7 +129,6 @@ class FuseBridgeEntry {
         const bool proxy_read_ready = last_proxy_events_.events & EPOLLIN;
         const bool proxy_write_ready = last_proxy_events_.events & EPOLLOUT;
 
-        last_state_ = state_;
         last_device_events_.events = 0;
         last_proxy_events_.events = 0;
 
@@ -105,7 +147,7 @@ class FuseBridgeEntry {
                 if (proxy_read_ready) {
                     state_ = ReadFromProxy();
                 } else if (device_read_ready) {
-                    state_ = ReadFromDevice(callback);
+                    state_ = ReadFromDevice();
                 }
                 return;
 
@@ -131,6 +173,21 @@ class FuseBridgeEntry {
   private:
     friend class BridgeEpollController;
 
+    void RunWorker() {
+        std::unique_lock<std::mutex> lock(worker_mutex_);
+        while (true) {
+            worker_cv_.wait(lock, [this] { return transfer_pending_ || stop_worker_; });
+            if (stop_worker_) {
+                return;
+            }
+            transfer_pending_ = false;
+            lock.unlock();
+            Transfer();
+            on_done_(this);
+            lock.lock();
+        }
+    }
+
     FuseBridgeState ReadFromProxy() {
         switch (buffer_.response.ReadOrAgain(proxy_fd_)) {
             case ResultOrAgain::kSuccess:
@@ -173,7 +230,7 @@ class FuseBridgeEntry {
         return FuseBridgeState::kWaitToReadEither;
     }
 
-    FuseBridgeState ReadFromDevice(FuseBridgeLoopCallback* callback) {
+    FuseBridgeState ReadFromDevice() {
         LOG(VERBOSE) << "ReadFromDevice";
         if (!buffer_.request.Read(device_fd_)) {
             return FuseBridgeState::kClosing;
@@ -187,7 +244,8 @@ class FuseBridgeEntry {
         }
         switch (opcode) {
             case FUSE_FORGET:
-                // Do not reply to FUSE_FORGET.
+            case FUSE_BATCH_FORGET:
+                // Do not reply to FUSE_FORGET and FUSE_BATCH_FORGET.
                 return FuseBridgeState::kWaitToReadEither;
 
             case FUSE_LOOKUP:
@@ -203,7 +261,7 @@ class FuseBridgeEntry {
                 return WriteToProxy();
 
             case FUSE_INIT:
-                buffer_.HandleInit();
+                buffer_.HandleInit(GetMaxTransferSize(proxy_fd_));
                 break;
 
             default:
@@ -217,7 +275,7 @@ class FuseBridgeEntry {
         }
 
         if (opcode == FUSE_INIT) {
-            callback->OnMount(mount_id_);
+            mounted_ = true;
         }
 
         return FuseBridgeState::kWaitToReadEither;
@@ -244,7 +302,6 @@ class FuseBridgeEntry {
     base::unique_fd proxy_fd_;
     FuseBuffer buffer_;
     FuseBridgeState state_;
-    FuseBridgeState last_state_;
     FuseBridgeEntryEvent last_device_events_;
     FuseBridgeEntryEvent last_proxy_events_;
 
@@ -253,26 +310,49 @@ class FuseBridgeEntry {
     std::unordered_map<uint64_t, uint32_t> opcode_map_;
 
     int open_count_;
+    bool mounted_;
+
+    std::thread worker_;
+    std::mutex worker_mutex_;
+    std::condition_variable worker_cv_;
+    bool transfer_pending_;
+    bool stop_worker_;
+    std::function<void(FuseBridgeEntry*)> on_done_;
 
     DISALLOW_COPY_AND_ASSIGN(FuseBridgeEntry);
 };
 
 class BridgeEpollController : private EpollController {
   public:
-    BridgeEpollController(base::unique_fd&& poll_fd) : EpollController(std::move(poll_fd)) {}
+    BridgeEpollController(base::unique_fd&& poll_fd)
+        : EpollController(std::move(poll_fd)), done_event_({nullptr, 0}) {}
+
+    // Watches |event_fd|; Wait() reports it as a nullptr entry.
+    bool AddDoneEventPoll(int event_fd) {
+        return EpollController::InvokeControl(EPOLL_CTL_ADD, event_fd, EPOLLIN, &done_event_);
+    }
 
     bool AddBridgePoll(FuseBridgeEntry* bridge) const {
-        return InvokeControl(EPOLL_CTL_ADD, bridge);
+        return InvokeControl(EPOLL_CTL_ADD, bridge, bridge->state_);
     }
 
-    bool UpdateOrDeleteBridgePoll(FuseBridgeEntry* bridge) const {
-        return InvokeControl(
-            bridge->state_ != FuseBridgeState::kClosing ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, bridge);
+    // Stops watching the bridge while its worker runs a transfer. The FDs are removed rather
+    // than modified to no events, as epoll still reports hangups for those.
+    bool DeleteBridgePoll(FuseBridgeEntry* bridge) const {
+        return InvokeControl(EPOLL_CTL_DEL, bridge, bridge->state_);
+    }
+
+    // Watches the bridge again after a transfer unless it is closing.
+    bool RestoreBridgePoll(FuseBridgeEntry* bridge) const {
+        if (bridge->state_ == FuseBridgeState::kClosing) {
+            return true;
+        }
+        return InvokeControl(EPOLL_CTL_ADD, bridge, bridge->state_);
     }
 
     bool Wait(size_t bridge_count, std::unordered_set<FuseBridgeEntry*>* entries_out) {
         CHECK(entries_out);
-        const size_t event_count = std::max<size_t>(bridge_count * 2, 1);
+        const size_t event_count = bridge_count * 2 + 1;
         if (!EpollController::Wait(event_count)) {
             return false;
         }
@@ -287,28 +367,22 @@ class BridgeEpollController : private EpollController {
     }
 
   private:
-    bool InvokeControl(int op, FuseBridgeEntry* bridge) const {
+    bool InvokeControl(int op, FuseBridgeEntry* bridge, FuseBridgeState state) const {
         LOG(VERBOSE) << "InvokeControl op=" << op << " bridge=" << bridge->mount_id_
-                     << " state=" << static_cast<int>(bridge->state_)
-                     << " last_state=" << static_cast<int>(bridge->last_state_);
+                     << " state=" << static_cast<int>(state);
 
-        int last_device_events;
-        int last_proxy_events;
         int device_events;
         int proxy_events;
-        GetObservedEvents(bridge->last_state_, &last_device_events, &last_proxy_events);
-        GetObservedEvents(bridge->state_, &device_events, &proxy_events);
+        GetObservedEvents(state, &device_events, &proxy_events);
         bool result = true;
-        if (op != EPOLL_CTL_MOD || last_device_events != device_events) {
-            result &= EpollController::InvokeControl(op, bridge->device_fd_, device_events,
-                                                     &bridge->last_device_events_);
-        }
-        if (op != EPOLL_CTL_MOD || last_proxy_events != proxy_events) {
-            result &= EpollController::InvokeControl(op, bridge->proxy_fd_, proxy_events,
-                                                     &bridge->last_proxy_events_);
-        }
+        result &= EpollController::InvokeControl(op, bridge->device_fd_, device_events,
+                                                 &bridge->last_device_events_);
+        result &= EpollController::InvokeControl(op, bridge->proxy_fd_, proxy_events,
+                                                 &bridge->last_proxy_events_);
         return result;
     }
+
+    FuseBridgeEntryEvent done_event_;
 };
 
 std::recursive_mutex FuseBridgeLoop::mutex_;
@@ -321,6 +395,16 @@ FuseBridgeLoop::FuseBridgeLoop() : opened_(true) {
         return;
     }
     epoll_controller_.reset(new BridgeEpollController(std::move(epoll_fd)));
+
+    done_event_fd_.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (done_event_fd_.get() == -1) {
+        PLOG(ERROR) << "Failed to open eventfd";
+        opened_ = false;
+        return;
+    }
+    if (!epoll_controller_->AddDoneEventPoll(done_event_fd_)) {
+        opened_ = false;
+    }
 }
 
 FuseBridgeLoop::~FuseBridgeLoop() { CHECK(bridges_.empty()); }
@@ -339,6 +423,7 @@ bool FuseBridgeLoop::AddBridge(int mount_id, base::unique_fd dev_fd, base::uniqu
         LOG(ERROR) << "Tried to add a mount point that has already been added";
         return false;
     }
+    bridge->StartWorker([this](FuseBridgeEntry* entry) { OnTransferDone(entry); });
     if (!epoll_controller_->AddBridgePoll(bridge.get())) {
         return false;
     }
@@ -347,11 +432,51 @@ bool FuseBridgeLoop::AddBridge(int mount_id, base::unique_fd dev_fd, base::uniqu
     return true;
 }
 
+void FuseBridgeLoop::OnTransferDone(FuseBridgeEntry* entry) {
+    {
+        std::lock_guard<std::mutex> lock(done_mutex_);
+        done_entries_.push_back(entry);
+    }
+    const uint64_t value = 1;
+    if (TEMP_FAILURE_RETRY(write(done_event_fd_, &value, sizeof(value))) == -1) {
+        PLOG(ERROR) << "Failed to signal eventfd";
+    }
+}
+
 bool FuseBridgeLoop::ProcessEventLocked(const std::unordered_set<FuseBridgeEntry*>& entries,
                                         FuseBridgeLoopCallback* callback) {
+    bool transfers_done = false;
     for (auto entry : entries) {
-        entry->Transfer(callback);
-        if (!epoll_controller_->UpdateOrDeleteBridgePoll(entry)) {
+        if (entry == nullptr) {
+            transfers_done = true;
+            continue;
+        }
+        // Each bridge has at most one transfer in flight, so its messages stay
+        // in order.
+        if (!epoll_controller_->DeleteBridgePoll(entry)) {
+            return false;
+        }
+        entry->ScheduleTransfer();
+    }
+    if (!transfers_done) {
+        return true;
+    }
+
+    uint64_t value;
+    if (TEMP_FAILURE_RETRY(read(done_event_fd_, &value, sizeof(value))) == -1 && errno != EAGAIN) {
+        PLOG(ERROR) << "Failed to read eventfd";
+        return false;
+    }
+    std::vector<FuseBridgeEntry*> done_entries;
+    {
+        std::lock_guard<std::mutex> lock(done_mutex_);
+        done_entries.swap(done_entries_);
+    }
+    for (auto entry : done_entries) {
+        if (entry->TakeMounted()) {
+            callback->OnMount(entry->mount_id());
+        }
+        if (!epoll_controller_->RestoreBridgePoll(entry)) {
             return false;
         }
         if (entry->IsClosing()) {
@@ -377,6 +502,8 @@ void FuseBridgeLoop::Start(FuseBridgeLoopCallback* callback) {
             std::lock_guard<std::recursive_mutex> lock(mutex_);
             if (!(wait_result && ProcessEventLocked(entries, callback))) {
                 for (auto it = bridges_.begin(); it != bridges_.end();) {
+                    // Wait for any transfer in flight before closing the FDs.
+                    it->second->StopWorker();
                     callback->OnClosed(it->second->mount_id());
                     it = bridges_.erase(it);
                 }
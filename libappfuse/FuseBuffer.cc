@@ -149,10 +149,14 @@ bool SetupMessageSockets(base::unique_fd (*result)[2]) {
     }
 
     constexpr int kMaxMessageSize = sizeof(FuseBuffer);
-    if (setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &kMaxMessageSize, sizeof(int)) != 0 ||
-        setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &kMaxMessageSize, sizeof(int)) != 0) {
-        PLOG(ERROR) << "Failed to update buffer size for socket";
-        return false;
+    for (const auto& fd : fds) {
+        // SO_SNDBUF is capped by net.core.wmem_max, which is usually too small for
+        // kFuseMaxWrite. Callers with CAP_NET_ADMIN can go beyond it.
+        if (setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE, &kMaxMessageSize, sizeof(int)) != 0 &&
+            setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &kMaxMessageSize, sizeof(int)) != 0) {
+            PLOG(ERROR) << "Failed to update buffer size for socket";
+            return false;
+        }
     }
 
     (*result)[0] = std::move(fds[0]);
@@ -160,6 +164,26 @@ bool SetupMessageSockets(base::unique_fd (*result)[2]) {
     return true;
 }
 
+size_t GetMaxTransferSize(int fd) {
+    int buffer_size;
+    socklen_t length = sizeof(buffer_size);
+    if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, &length) != 0) {
+        PLOG(ERROR) << "Failed to get buffer size for socket";
+        return kFuseDefaultMaxTransfer;
+    }
+
+    // The kernel rejects a message longer than the send buffer minus a small overhead.
+    constexpr size_t kSocketOverhead = 32;
+    constexpr size_t kRequestHeaderSize = sizeof(fuse_in_header) + sizeof(fuse_write_in);
+    const size_t page_size = getpagesize();
+    if (static_cast<size_t>(buffer_size) < kSocketOverhead + kRequestHeaderSize + page_size) {
+        return kFuseDefaultMaxTransfer;
+    }
+    size_t max_transfer = buffer_size - kSocketOverhead - kRequestHeaderSize;
+    max_transfer = std::min(max_transfer - max_transfer % page_size, kFuseMaxWrite);
+    return std::max(max_transfer, kFuseDefaultMaxTransfer);
+}
+
 template <typename T>
 bool FuseMessage<T>::Read(int fd) {
     return ReadInternal(this, fd, 0) == ResultOrAgain::kSuccess;
@@ -208,13 +232,14 @@ void FuseResponseBase<N>::Reset(uint32_t data_length, int32_t error, uint64_t un
     ResetHeader(data_length, error, unique);
 }
 
-void FuseBuffer::HandleInit() {
+void FuseBuffer::HandleInit(size_t max_transfer) {
   const fuse_init_in* const in = &request.init_in;
 
   // Before writing |out|, we need to copy data from |in|.
   const uint64_t unique = request.header.unique;
   const uint32_t minor = in->minor;
   const uint32_t max_readahead = in->max_readahead;
+  const uint32_t in_flags = in->flags;
 
   // Kernel 2.6.16 is the first stable kernel with struct fuse_init_out
   // defined (fuse version 7.6). The structure is the same from 7.6 through
@@ -228,8 +253,36 @@ void FuseBuffer::HandleInit() {
     return;
   }
 
-  // We limit ourselves to minor=15 because we don't handle BATCH_FORGET yet.
-  // Thus we need to use FUSE_COMPAT_22_INIT_OUT_SIZE.
+  // Let the kernel keep several reads in flight, so that the proxy side can
+  // complete them asynchronously.
+  uint32_t flags = FUSE_ATOMIC_O_TRUNC | FUSE_BIG_WRITES;
+  if (in_flags & FUSE_ASYNC_READ) {
+    flags |= FUSE_ASYNC_READ;
+  }
+
+#if defined(FUSE_MAX_PAGES)
+  // Requests larger than kFuseDefaultMaxTransfer need FUSE_MAX_PAGES, which
+  // came with minor=28.
+  const size_t page_size = getpagesize();
+  max_transfer = std::min(max_transfer, kFuseMaxWrite);
+  max_transfer -= max_transfer % page_size;
+  if (minor >= 28 && (in_flags & FUSE_MAX_PAGES) && max_transfer > kFuseDefaultMaxTransfer) {
+    response.Reset(sizeof(fuse_init_out), kFuseSuccess, unique);
+    fuse_init_out* const out = &response.init_out;
+    out->major = FUSE_KERNEL_VERSION;
+    out->minor = 28;
+    out->max_readahead = max_readahead;
+    out->flags = flags | FUSE_MAX_PAGES;
+    out->max_background = 32;
+    out->congestion_threshold = 32;
+    out->max_write = max_transfer;
+    out->max_pages = max_transfer / page_size;
+    return;
+  }
+#endif
+
+  // Otherwise we limit ourselves to minor=15, the last version with the
+  // FUSE_COMPAT_22_INIT_OUT_SIZE layout.
 #if defined(FUSE_COMPAT_22_INIT_OUT_SIZE)
   // FUSE_KERNEL_VERSION >= 23.
   const size_t response_size = FUSE_COMPAT_22_INIT_OUT_SIZE;
@@ -242,10 +295,10 @@ void FuseBuffer::HandleInit() {
   out->major = FUSE_KERNEL_VERSION;
   out->minor = std::min(minor, 15u);
   out->max_readahead = max_readahead;
-  out->flags = FUSE_ATOMIC_O_TRUNC | FUSE_BIG_WRITES;
+  out->flags = flags;
   out->max_background = 32;
   out->congestion_threshold = 32;
-  out->max_write = kFuseMaxWrite;
+  out->max_write = kFuseDefaultMaxTransfer;
 }
 
 void FuseBuffer::HandleNotImpl() {
@@ -29,6 +29,9 @@ namespace fuse {
 
 class EpollController;
 
+// Callbacks may return before replying, and reply later from any thread through the
+// FuseAppLoop::Reply* methods, so that several requests can be in flight at once. Only the
+// |data| passed to OnWrite must be consumed before the callback returns.
 class FuseAppLoopCallback {
  public:
    virtual void OnLookup(uint64_t unique, uint64_t inode) = 0;
@@ -18,11 +18,14 @@
 #define ANDROID_LIBAPPFUSE_FUSEBRIDGELOOP_H_
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <unordered_set>
+#include <vector>
 
 #include <android-base/macros.h>
+#include <android-base/unique_fd.h>
 
 #include "libappfuse/FuseBuffer.h"
 
@@ -58,8 +61,17 @@ class FuseBridgeLoop final {
     bool ProcessEventLocked(const std::unordered_set<FuseBridgeEntry*>& entries,
                             FuseBridgeLoopCallback* callback);
 
+    // Called on a bridge's worker thread once it has finished a transfer.
+    void OnTransferDone(FuseBridgeEntry* entry);
+
     std::unique_ptr<BridgeEpollController> epoll_controller_;
 
+    // Signalled by bridge workers; |done_entries_| lists the bridges whose
+    // transfers have finished and need their FDs watched again.
+    base::unique_fd done_event_fd_;
+    std::mutex done_mutex_;
+    std::vector<FuseBridgeEntry*> done_entries_;
+
     // Map between |mount_id| and bridge entry.
     std::map<int, std::unique_ptr<FuseBridgeEntry>> bridges_;
 
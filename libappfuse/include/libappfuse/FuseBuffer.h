@@ -23,15 +23,21 @@
 namespace android {
 namespace fuse {
 
-// The numbers came from sdcard.c.
-// Maximum number of bytes to write/read in one request/one reply.
-constexpr size_t kFuseMaxWrite = 128 * 1024;
-constexpr size_t kFuseMaxRead = 128 * 1024;
+// Maximum number of bytes to write/read in one request/one reply. FUSE_INIT only negotiates
+// this much when both the kernel and the proxy socket can carry it.
+constexpr size_t kFuseMaxWrite = 1024 * 1024;
+constexpr size_t kFuseMaxRead = 1024 * 1024;
+// The number came from sdcard.c. Kernels without FUSE_MAX_PAGES never send more than this.
+constexpr size_t kFuseDefaultMaxTransfer = 128 * 1024;
 constexpr int32_t kFuseSuccess = 0;
 
 // Setup sockets to transfer FuseMessage.
 bool SetupMessageSockets(base::unique_fd (*sockets)[2]);
 
+// Returns the largest read/write payload that can be sent over a socket created by
+// SetupMessageSockets, which is between kFuseDefaultMaxTransfer and kFuseMaxWrite.
+size_t GetMaxTransferSize(int fd);
+
 enum class ResultOrAgain {
     kSuccess,
     kFailure,
@@ -102,7 +108,9 @@ union FuseBuffer final {
   FuseRequest request;
   FuseResponse response;
 
-  void HandleInit();
+  // Replies to FUSE_INIT. |max_transfer| is the largest read/write payload the caller can
+  // handle; sizes above kFuseDefaultMaxTransfer are only used if the kernel supports them.
+  void HandleInit(size_t max_transfer = kFuseDefaultMaxTransfer);
   void HandleNotImpl();
 };
 
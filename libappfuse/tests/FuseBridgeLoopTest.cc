@@ -18,6 +18,7 @@
 
 #include <sys/socket.h>
 
+#include <chrono>
 #include <sstream>
 #include <thread>
 
@@ -157,6 +158,21 @@ TEST_F(FuseBridgeLoopTest, FuseForget) {
       "The loop must not respond to FUSE_FORGET";
 }
 
+TEST_F(FuseBridgeLoopTest, FuseBatchForget) {
+  memset(&request_, 0, sizeof(FuseRequest));
+  request_.header.opcode = FUSE_BATCH_FORGET;
+  request_.header.unique = 1u;
+  request_.header.len = sizeof(fuse_in_header) + sizeof(fuse_batch_forget_in);
+  ASSERT_TRUE(request_.Write(dev_sockets_[0]));
+
+  SendInitRequest(2u);
+
+  memset(&response_, 0, sizeof(FuseResponse));
+  ASSERT_TRUE(response_.Read(dev_sockets_[0]));
+  EXPECT_EQ(2u, response_.header.unique) <<
+      "The loop must not respond to FUSE_BATCH_FORGET";
+}
+
 TEST_F(FuseBridgeLoopTest, FuseNotImpl) {
   CheckNotImpl(FUSE_SETATTR);
   CheckNotImpl(FUSE_READLINK);
@@ -188,7 +204,6 @@ TEST_F(FuseBridgeLoopTest, FuseNotImpl) {
   CheckNotImpl(FUSE_IOCTL);
   CheckNotImpl(FUSE_POLL);
   CheckNotImpl(FUSE_NOTIFY_REPLY);
-  CheckNotImpl(FUSE_BATCH_FORGET);
   CheckNotImpl(FUSE_FALLOCATE);
   CheckNotImpl(FUSE_READDIRPLUS);
   CheckNotImpl(FUSE_RENAME2);
@@ -210,5 +225,35 @@ TEST_F(FuseBridgeLoopTest, Proxy) {
   Close();
 }
 
+TEST_F(FuseBridgeLoopTest, ReadThroughput) {
+  constexpr int kIterations = 2048;
+  const size_t transfer_size = GetMaxTransferSize(proxy_sockets_[1]);
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < kIterations; i++) {
+    memset(&request_, 0, sizeof(FuseRequest));
+    request_.header.opcode = FUSE_READ;
+    request_.header.unique = i + 1;
+    request_.header.len = sizeof(fuse_in_header) + sizeof(fuse_read_in);
+    request_.read_in.size = transfer_size;
+    ASSERT_TRUE(request_.Write(dev_sockets_[0]));
+
+    ASSERT_TRUE(request_.Read(proxy_sockets_[1]));
+    ASSERT_EQ(static_cast<uint64_t>(i + 1), request_.header.unique);
+    response_.ResetHeader(transfer_size, kFuseSuccess, request_.header.unique);
+    ASSERT_TRUE(response_.Write(proxy_sockets_[1]));
+
+    ASSERT_TRUE(response_.Read(dev_sockets_[0]));
+    ASSERT_EQ(static_cast<uint64_t>(i + 1), response_.header.unique);
+    ASSERT_EQ(sizeof(fuse_out_header) + transfer_size, response_.header.len);
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  LOG(INFO) << "Proxied " << kIterations << " reads at "
+            << (kIterations * transfer_size / 1048576.0) / elapsed.count() << " MiB/s";
+
+  CheckProxy(FUSE_OPEN);
+  CheckProxy(FUSE_RELEASE);
+  Close();
+}
+
 }  // namespace fuse
 }  // namespace android
@@ -19,6 +19,7 @@
 #include <fcntl.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include <thread>
 
@@ -174,7 +175,47 @@ TEST(FuseBufferTest, HandleInit) {
   EXPECT_EQ(15u, buffer.response.init_out.minor);
   EXPECT_EQ(static_cast<unsigned int>(FUSE_ATOMIC_O_TRUNC | FUSE_BIG_WRITES),
       buffer.response.init_out.flags);
+  EXPECT_EQ(kFuseDefaultMaxTransfer, buffer.response.init_out.max_write);
+}
+
+TEST(FuseBufferTest, HandleInit_MaxPages) {
+  FuseBuffer buffer;
+  memset(&buffer, 0, sizeof(FuseBuffer));
+
+  buffer.request.header.opcode = FUSE_INIT;
+  buffer.request.init_in.major = FUSE_KERNEL_VERSION;
+  buffer.request.init_in.minor = FUSE_KERNEL_MINOR_VERSION;
+  buffer.request.init_in.flags = FUSE_ASYNC_READ | FUSE_MAX_PAGES;
+
+  buffer.HandleInit(kFuseMaxWrite);
+
+  ASSERT_EQ(sizeof(fuse_out_header) + sizeof(fuse_init_out), buffer.response.header.len);
+  EXPECT_EQ(kFuseSuccess, buffer.response.header.error);
+  EXPECT_EQ(28u, buffer.response.init_out.minor);
+  EXPECT_EQ(static_cast<unsigned int>(FUSE_ATOMIC_O_TRUNC | FUSE_BIG_WRITES | FUSE_ASYNC_READ |
+                                      FUSE_MAX_PAGES),
+            buffer.response.init_out.flags);
   EXPECT_EQ(kFuseMaxWrite, buffer.response.init_out.max_write);
+  EXPECT_EQ(kFuseMaxWrite / getpagesize(), buffer.response.init_out.max_pages);
+}
+
+TEST(FuseBufferTest, HandleInit_MaxPagesUnsupported) {
+  FuseBuffer buffer;
+  memset(&buffer, 0, sizeof(FuseBuffer));
+
+  buffer.request.header.opcode = FUSE_INIT;
+  buffer.request.init_in.major = FUSE_KERNEL_VERSION;
+  buffer.request.init_in.minor = 27;
+  buffer.request.init_in.flags = FUSE_MAX_PAGES;
+
+  buffer.HandleInit(kFuseMaxWrite);
+
+  ASSERT_EQ(sizeof(fuse_out_header) + FUSE_COMPAT_22_INIT_OUT_SIZE,
+            buffer.response.header.len);
+  EXPECT_EQ(15u, buffer.response.init_out.minor);
+  EXPECT_EQ(static_cast<unsigned int>(FUSE_ATOMIC_O_TRUNC | FUSE_BIG_WRITES),
+      buffer.response.init_out.flags);
+  EXPECT_EQ(kFuseDefaultMaxTransfer, buffer.response.init_out.max_write);
 }
 
 TEST(FuseBufferTest, HandleNotImpl) {
@@ -211,5 +252,20 @@ TEST(SetupMessageSocketsTest, Stress) {
     thread.join();
 }
 
+TEST(SetupMessageSocketsTest, MaxTransferSize) {
+    base::unique_fd fds[2];
+    ASSERT_TRUE(SetupMessageSockets(&fds));
+
+    const size_t max_transfer = GetMaxTransferSize(fds[0]);
+    EXPECT_GE(max_transfer, kFuseDefaultMaxTransfer);
+    EXPECT_LE(max_transfer, kFuseMaxWrite);
+
+    FuseRequest request;
+    request.Reset(sizeof(fuse_write_in) + max_transfer, FUSE_WRITE, 1u);
+    ASSERT_TRUE(request.Write(fds[0]));
+    ASSERT_TRUE(request.Read(fds[1]));
+    EXPECT_EQ(sizeof(fuse_in_header) + sizeof(fuse_write_in) + max_transfer, request.header.len);
+}
+
 } // namespace fuse
 } // namespace android
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/ashmem.h>
+
+/*
+ * Recycling pool of fixed-size regions, built on top of the ashmem API so that
+ * it works with both ashmem-dev.cpp and ashmem-host.cpp.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+struct ashmem_pool {
+    pthread_mutex_t lock;
+    std::string name;
+    size_t size;
+    size_t max_cached;
+    std::vector<int> fds;
+};
+
+ashmem_pool* ashmem_pool_create(const char* name, size_t size, size_t max_cached) {
+    ashmem_pool* pool = new ashmem_pool;
+    pthread_mutex_init(&pool->lock, nullptr);
+    pool->name = name ? name : "";
+    pool->size = size;
+    pool->max_cached = max_cached;
+    pool->fds.reserve(max_cached);
+    return pool;
+}
+
+void ashmem_pool_destroy(ashmem_pool* pool) {
+    if (!pool) {
+        return;
+    }
+
+    for (int fd : pool->fds) {
+        close(fd);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    delete pool;
+}
+
+int ashmem_pool_get(ashmem_pool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    if (!pool->fds.empty()) {
+        int fd = pool->fds.back();
+        pool->fds.pop_back();
+        pthread_mutex_unlock(&pool->lock);
+        return fd;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return ashmem_create_region(pool->name.empty() ? nullptr : pool->name.c_str(), pool->size);
+}
+
+/*
+ * Drop the pages of a region being returned to a pool, so that the next user
+ * sees zeroes just as it would with a new region. memfd regions keep their
+ * F_SEAL_GROW | F_SEAL_SHRINK seals, and punching a hole does not change the
+ * size, so it is allowed. A region that was made read-only, or an ashmem
+ * region, fails here and is simply closed.
+ */
+static bool ashmem_pool_recycle_region(ashmem_pool* pool, int fd) {
+    if (ashmem_get_size_region(fd) != static_cast<int>(pool->size)) {
+        return false;
+    }
+
+#if defined(__linux__)
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, pool->size) == 0;
+#else
+    return false;
+#endif
+}
+
+void ashmem_pool_put(ashmem_pool* pool, int fd) {
+    if (fd < 0) {
+        return;
+    }
+
+    int save_errno = errno;
+    if (ashmem_pool_recycle_region(pool, fd)) {
+        pthread_mutex_lock(&pool->lock);
+        if (pool->fds.size() < pool->max_cached) {
+            pool->fds.push_back(fd);
+            fd = -1;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    errno = save_errno;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/ashmem.h>
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+// Map the region and touch every page, as a real client filling a buffer would.
+static void use_region(benchmark::State& state, int fd, size_t size) {
+    void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (region == MAP_FAILED) {
+        state.SkipWithError("mmap failed");
+        return;
+    }
+    memset(region, 0xa5, size);
+    munmap(region, size);
+}
+
+static void BM_ashmem_create_close(benchmark::State& state) {
+    size_t size = state.range(0);
+    for (auto _ : state) {
+        int fd = ashmem_create_region("bench", size);
+        if (fd < 0) {
+            state.SkipWithError("ashmem_create_region failed");
+            break;
+        }
+        use_region(state, fd, size);
+        close(fd);
+    }
+}
+BENCHMARK(BM_ashmem_create_close)->Range(4096, 1 << 20);
+
+static void BM_ashmem_pool_get_put(benchmark::State& state) {
+    size_t size = state.range(0);
+    ashmem_pool* pool = ashmem_pool_create("bench", size, 4);
+    for (auto _ : state) {
+        int fd = ashmem_pool_get(pool);
+        if (fd < 0) {
+            state.SkipWithError("ashmem_pool_get failed");
+            break;
+        }
+        use_region(state, fd, size);
+        ashmem_pool_put(pool, fd);
+    }
+    ashmem_pool_destroy(pool);
+}
+BENCHMARK(BM_ashmem_pool_get_put)->Range(4096, 1 << 20);
@@ -286,3 +286,45 @@ TEST(AshmemTest, ForkMultiRegionTest) {
         EXPECT_EQ(0, munmap(region, size));
     }
 }
+
+TEST(AshmemTest, PoolTest) {
+    const size_t size = getpagesize() * 4;
+    std::vector<uint8_t> data(size);
+    FillData(data);
+    std::vector<uint8_t> zeroes(size);
+
+    ashmem_pool* pool = ashmem_pool_create("pool-test", size, 2);
+    ASSERT_NE(nullptr, pool);
+
+    for (int i = 0; i < 4; i++) {
+        unique_fd fd(ashmem_pool_get(pool));
+        ASSERT_TRUE(fd >= 0);
+        ASSERT_TRUE(ashmem_valid(fd));
+        ASSERT_EQ(size, static_cast<size_t>(ashmem_get_size_region(fd)));
+        ASSERT_EQ(FD_CLOEXEC, (fcntl(fd, F_GETFD) & FD_CLOEXEC));
+
+        // A recycled region must not leak the previous user's data.
+        void* region = nullptr;
+        ASSERT_NO_FATAL_FAILURE(TestMmap(fd, size, PROT_READ | PROT_WRITE, &region));
+        ASSERT_EQ(0, memcmp(region, zeroes.data(), size));
+        memcpy(region, data.data(), size);
+        EXPECT_EQ(0, munmap(region, size));
+
+        ashmem_pool_put(pool, fd.release());
+    }
+
+    // A region that was made read-only cannot be handed out again.
+    unique_fd fd(ashmem_pool_get(pool));
+    ASSERT_TRUE(fd >= 0);
+    ASSERT_EQ(0, ashmem_set_prot_region(fd, PROT_READ));
+    ashmem_pool_put(pool, fd.release());
+
+    fd.reset(ashmem_pool_get(pool));
+    ASSERT_TRUE(fd >= 0);
+    ASSERT_EQ(0, ashmem_set_prot_region(fd, PROT_READ | PROT_WRITE));
+    void* region = nullptr;
+    ASSERT_NO_FATAL_FAILURE(TestMmap(fd, size, PROT_READ | PROT_WRITE, &region));
+    EXPECT_EQ(0, munmap(region, size));
+
+    ashmem_pool_destroy(pool);
+}
@@ -32,9 +32,14 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <map>
+#include <mutex>
 #include <string>
+#include <vector>
 
+#include <android-base/file.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <cutils/fs.h>
 #include <log/log.h>
 #include <private/android_filesystem_config.h>
@@ -247,26 +252,90 @@ static size_t strip(const char* path, size_t len, const char suffix[]) {
     return len - strlen(suffix);
 }
 
-static int fs_config_open(int dir, int which, const char* target_out_path) {
-    int fd = -1;
-
+// Finds the override file to use, preferring the one under target_out_path to
+// the one on the running system, and stats it. Returns false if neither exists.
+static bool fs_config_path(int dir, int which, const char* target_out_path, std::string* path,
+                           struct stat* st) {
     if (target_out_path && *target_out_path) {
         // target_out_path is the path to the directory holding content of
         // system partition but as we cannot guarantee it ends with '/system'
         // or with or without a trailing slash, need to strip them carefully.
-        char* name = NULL;
         size_t len = strlen(target_out_path);
         len = strip(target_out_path, len, "/");
         len = strip(target_out_path, len, "/system");
-        if (asprintf(&name, "%.*s%s", (int)len, target_out_path, conf[which][dir]) != -1) {
-            fd = TEMP_FAILURE_RETRY(open(name, O_RDONLY));
-            free(name);
-        }
+        *path = std::string(target_out_path, len) + conf[which][dir];
+        if (TEMP_FAILURE_RETRY(stat(path->c_str(), st)) == 0) return true;
     }
-    if (fd < 0) {
-        fd = TEMP_FAILURE_RETRY(open(conf[which][dir], O_RDONLY));
+    *path = conf[which][dir];
+    return TEMP_FAILURE_RETRY(stat(path->c_str(), st)) == 0;
+}
+
+// Parsed contents of an fs_config_(dirs|files) override file. Build tools call
+// fs_config() once per file in an image, so each override file is only read
+// again once stat() reports that it changed.
+struct fs_config_file {
+    dev_t dev = 0;
+    ino_t ino = 0;
+    off_t size = -1;
+    struct timespec mtime = {};
+    std::vector<struct fs_config> configs;
+    std::vector<std::string> prefixes;
+};
+
+static std::mutex fs_config_files_lock;
+
+// Intentionally leaked to avoid destruction while another thread is in get_fs_config().
+static std::map<std::string, fs_config_file>& fs_config_files() {
+    static auto* files = new std::map<std::string, fs_config_file>();
+    return *files;
+}
+
+static bool fs_config_file_is_current(const fs_config_file& file, const struct stat& st) {
+    return file.dev == st.st_dev && file.ino == st.st_ino && file.size == st.st_size &&
+           file.mtime.tv_sec == st.st_mtim.tv_sec && file.mtime.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+// Reads the entries of the file at path, stopping at the first corrupt one.
+static void fs_config_file_load(const std::string& path, fs_config_file* file) {
+    file->configs.clear();
+    file->prefixes.clear();
+    file->size = -1;
+
+    android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    struct stat st;
+    std::string content;
+    if (fd == -1 || fstat(fd.get(), &st) == -1 || !android::base::ReadFdToString(fd, &content)) {
+        return;
+    }
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    file->size = st.st_size;
+    file->mtime = st.st_mtim;
+
+    size_t offset = 0;
+    while (content.size() - offset >= sizeof(fs_path_config_from_file)) {
+        struct fs_path_config_from_file header;
+        memcpy(&header, content.data() + offset, sizeof(header));
+        uint16_t host_len = header.len;
+        ssize_t remainder = host_len - sizeof(header);
+        if (remainder <= 0) {
+            ALOGE("%s len is corrupted", path.c_str());
+            break;
+        }
+        if (content.size() - offset - sizeof(header) < static_cast<size_t>(remainder)) {
+            ALOGE("%s prefix is truncated", path.c_str());
+            break;
+        }
+        const char* prefix = content.data() + offset + sizeof(header);
+        size_t len = strnlen(prefix, remainder);
+        if (len >= static_cast<size_t>(remainder)) {  // missing a terminating null
+            ALOGE("%s is corrupted", path.c_str());
+            break;
+        }
+        file->configs.push_back({header.uid, header.gid, header.mode, header.capabilities});
+        file->prefixes.emplace_back(prefix, len);
+        offset += host_len;
     }
-    return fd;
 }
 
 // if path is "odm/<stuff>", "oem/<stuff>", "product/<stuff>",
@@ -279,19 +348,66 @@ static bool is_partition(const std::string& path) {
     return false;
 }
 
+// The path being looked up, massaged once for all the patterns it is compared
+// against.
+struct fs_config_input {
+    bool dir;
+    // Directories have to end with / to be used by fnmatch.
+    std::string path;
+    // "<partition>/<stuff>" for "system/<partition>/<stuff>" or
+    // "vendor/odm/<stuff>", otherwise empty.
+    std::string path_in_partition;
+};
+
+static void fs_config_input_init(bool dir, const char* path, size_t plen,
+                                 fs_config_input* input) {
+    input->dir = dir;
+    input->path.assign(path, plen);
+    if (dir && !EndsWith(input->path, "/")) {
+        input->path.append("/");
+    }
+
+    // Check match between logical partition's files and patterns.
+    static constexpr const char* kLogicalPartitions[] = {"system/product/", "system/system_ext/",
+                                                         "system/vendor/", "vendor/odm/"};
+    input->path_in_partition.clear();
+    for (auto& logical_partition : kLogicalPartitions) {
+        if (StartsWith(input->path, logical_partition)) {
+            std::string path_in_partition = input->path.substr(input->path.find('/') + 1);
+            if (is_partition(path_in_partition)) {
+                input->path_in_partition = std::move(path_in_partition);
+            }
+            break;
+        }
+    }
+}
+
+// Returns whether path starts with the characters of the pattern that come
+// before its first wildcard, which fnmatch requires for a match.
+static bool fs_config_literal_prefix_matches(const char* prefix, size_t len,
+                                             const std::string& path) {
+    for (size_t i = 0; i < len; ++i) {
+        char c = prefix[i];
+        if (c == '*' || c == '?' || c == '[') return true;
+        if (i >= path.size() || path[i] != c) return false;
+    }
+    return true;
+}
+
 // alias prefixes of "<partition>/<stuff>" to "system/<partition>/<stuff>" or
 // "system/<partition>/<stuff>" to "<partition>/<stuff>"
-static bool fs_config_cmp(bool dir, const char* prefix, size_t len, const char* path, size_t plen) {
-    std::string pattern(prefix, len);
-    std::string input(path, plen);
+static bool fs_config_match(const char* prefix, size_t len, const fs_config_input& input) {
+    bool path_may_match = fs_config_literal_prefix_matches(prefix, len, input.path);
+    bool path_in_partition_may_match =
+            !input.path_in_partition.empty() &&
+            fs_config_literal_prefix_matches(prefix, len, input.path_in_partition);
+    if (!path_may_match && !path_in_partition_may_match) return false;
 
-    // Massage pattern and input so that they can be used by fnmatch where
-    // directories have to end with /.
-    if (dir) {
-        if (!EndsWith(input, "/")) {
-            input.append("/");
-        }
+    std::string pattern(prefix, len);
 
+    // Massage pattern so that it can be used by fnmatch where directories have
+    // to end with /.
+    if (input.dir) {
         if (!EndsWith(pattern, "/*")) {
             if (EndsWith(pattern, "/")) {
                 pattern.append("*");
@@ -304,21 +420,17 @@ static bool fs_config_cmp(bool dir, const char* prefix, size_t len, const char*
     // no FNM_PATHNAME is set in order to match a/b/c/d with a/*
     // FNM_ESCAPE is set in order to prevent using \\? and \\* and maintenance issues.
     const int fnm_flags = FNM_NOESCAPE;
-    if (fnmatch(pattern.c_str(), input.c_str(), fnm_flags) == 0) return true;
-
-    // Check match between logical partition's files and patterns.
-    static constexpr const char* kLogicalPartitions[] = {"system/product/", "system/system_ext/",
-                                                         "system/vendor/", "vendor/odm/"};
-    for (auto& logical_partition : kLogicalPartitions) {
-        if (StartsWith(input, logical_partition)) {
-            std::string input_in_partition = input.substr(input.find('/') + 1);
-            if (!is_partition(input_in_partition)) continue;
-            if (fnmatch(pattern.c_str(), input_in_partition.c_str(), fnm_flags) == 0) {
-                return true;
-            }
-        }
+    if (path_may_match && fnmatch(pattern.c_str(), input.path.c_str(), fnm_flags) == 0) {
+        return true;
     }
-    return false;
+    return path_in_partition_may_match &&
+           fnmatch(pattern.c_str(), input.path_in_partition.c_str(), fnm_flags) == 0;
+}
+
+static bool fs_config_cmp(bool dir, const char* prefix, size_t len, const char* path, size_t plen) {
+    fs_config_input input;
+    fs_config_input_init(dir, path, plen, &input);
+    return fs_config_match(prefix, len, input);
 }
 #ifndef __ANDROID_VNDK__
 auto __for_testing_only__fs_config_cmp = fs_config_cmp;
@@ -335,52 +447,30 @@ bool get_fs_config(const char* path, bool dir, const char* target_out_path,
 
     plen = strlen(path);
 
-    for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
-        struct fs_path_config_from_file header;
-
-        int fd = fs_config_open(dir, which, target_out_path);
-        if (fd < 0) continue;
+    fs_config_input input;
+    fs_config_input_init(dir, path, plen, &input);
 
-        while (TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header))) == sizeof(header)) {
-            char* prefix;
-            uint16_t host_len = header.len;
-            ssize_t len, remainder = host_len - sizeof(header);
-            if (remainder <= 0) {
-                ALOGE("%s len is corrupted", conf[which][dir]);
-                break;
-            }
-            prefix = static_cast<char*>(calloc(1, remainder));
-            if (!prefix) {
-                ALOGE("%s out of memory", conf[which][dir]);
-                break;
-            }
-            if (TEMP_FAILURE_RETRY(read(fd, prefix, remainder)) != remainder) {
-                free(prefix);
-                ALOGE("%s prefix is truncated", conf[which][dir]);
-                break;
-            }
-            len = strnlen(prefix, remainder);
-            if (len >= remainder) {  // missing a terminating null
-                free(prefix);
-                ALOGE("%s is corrupted", conf[which][dir]);
-                break;
-            }
-            if (fs_config_cmp(dir, prefix, len, path, plen)) {
-                free(prefix);
-                close(fd);
-                fs_conf->uid = header.uid;
-                fs_conf->gid = header.gid;
-                fs_conf->mode = header.mode;
-                fs_conf->capabilities = header.capabilities;
+    for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+        std::string conf_path;
+        struct stat st;
+        if (!fs_config_path(dir, which, target_out_path, &conf_path, &st)) continue;
+
+        std::lock_guard<std::mutex> lock(fs_config_files_lock);
+        fs_config_file& file = fs_config_files()[conf_path];
+        if (!fs_config_file_is_current(file, st)) {
+            fs_config_file_load(conf_path, &file);
+        }
+        for (size_t i = 0; i < file.prefixes.size(); ++i) {
+            const std::string& prefix = file.prefixes[i];
+            if (fs_config_match(prefix.c_str(), prefix.size(), input)) {
+                *fs_conf = file.configs[i];
                 return true;
             }
-            free(prefix);
         }
-        close(fd);
     }
 
     for (pc = dir ? android_dirs : android_files; pc->prefix; pc++) {
-        if (fs_config_cmp(dir, pc->prefix, strlen(pc->prefix), path, plen)) {
+        if (fs_config_match(pc->prefix, strlen(pc->prefix), input)) {
             fs_conf->uid = pc->uid;
             fs_conf->gid = pc->gid;
             fs_conf->mode = pc->mode;
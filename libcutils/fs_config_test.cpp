@@ -15,6 +15,8 @@
  */
 
 #include <inttypes.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include <string>
 
@@ -25,6 +27,7 @@
 #include <android-base/strings.h>
 
 #include <private/android_filesystem_config.h>
+#include <private/fs_config.h>
 
 #include "fs_config.h"
 
@@ -258,3 +261,50 @@ TEST(fs_config, odm_files_alias) {
 TEST(fs_config, system_alias) {
     EXPECT_FALSE(check_fs_config_cmp(fs_config_cmp_tests));
 }
+
+static std::string make_fs_config_entry(uint16_t mode, uint16_t uid, const std::string& prefix) {
+    size_t len = sizeof(fs_path_config_from_file) + prefix.size() + 1;
+    len = (len + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    std::string entry(len, '\0');
+    fs_path_config_from_file header = {};
+    header.len = len;
+    header.mode = mode;
+    header.uid = uid;
+    header.gid = uid;
+    memcpy(entry.data(), &header, sizeof(header));
+    memcpy(entry.data() + sizeof(header), prefix.c_str(), prefix.size());
+    return entry;
+}
+
+TEST(fs_config, override_file_reloaded) {
+    TemporaryDir target_out;
+    std::string etc = std::string(target_out.path) + "/system/etc";
+    ASSERT_EQ(0, mkdir((std::string(target_out.path) + "/system").c_str(), 0755));
+    ASSERT_EQ(0, mkdir(etc.c_str(), 0755));
+    std::string system_path = std::string(target_out.path) + "/system";
+    std::string files = etc + "/fs_config_files";
+
+    ASSERT_TRUE(android::base::WriteStringToFile(
+            make_fs_config_entry(0600, AID_SYSTEM, "system/bin/foo"), files));
+    struct fs_config conf;
+    ASSERT_TRUE(get_fs_config("system/bin/foo", false, system_path.c_str(), &conf));
+    EXPECT_EQ(0600u, conf.mode);
+    EXPECT_EQ(AID_SYSTEM, conf.uid);
+    ASSERT_TRUE(get_fs_config("/system/vendor/bin/bar", false, system_path.c_str(), &conf));
+    EXPECT_EQ(00755u, conf.mode);
+    EXPECT_EQ(AID_SHELL, conf.gid);
+
+    ASSERT_TRUE(android::base::WriteStringToFile(
+            make_fs_config_entry(0640, AID_ROOT, "system/bin/f*") +
+                    make_fs_config_entry(0600, AID_SYSTEM, "system/bin/foo"),
+            files));
+    ASSERT_TRUE(get_fs_config("system/bin/foo", false, system_path.c_str(), &conf));
+    EXPECT_EQ(0640u, conf.mode);
+    EXPECT_EQ(AID_ROOT, conf.uid);
+
+    ASSERT_EQ(0, unlink(files.c_str()));
+    ASSERT_TRUE(get_fs_config("system/bin/foo", false, system_path.c_str(), &conf));
+    EXPECT_EQ(00755u, conf.mode);
+    ASSERT_EQ(0, rmdir(etc.c_str()));
+    ASSERT_EQ(0, rmdir(system_path.c_str()));
+}
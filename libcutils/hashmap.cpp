@@ -19,27 +19,113 @@
 #include <assert.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 
-typedef struct Entry Entry;
-struct Entry {
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+// An open-addressing hash table in the style of SwissTable. Each slot has a control byte
+// which is kEmpty, kDeleted, or the low 7 bits of the hash of the key it holds. Lookups probe
+// the slots a group of kGroupWidth control bytes at a time, comparing all of a group's bytes
+// at once, and only call the equals function on slots whose 7 bits match.
+
+typedef struct Slot Slot;
+struct Slot {
     void* key;
-    int hash;
     void* value;
-    Entry* next;
+    int hash;
 };
 
 struct Hashmap {
-    Entry** buckets;
-    size_t bucketCount;
+    Slot* slots;
+    uint8_t* ctrl;
+    size_t capacity;
     int (*hash)(void* key);
     bool (*equals)(void* keyA, void* keyB);
     pthread_mutex_t lock;
     size_t size;
+    // Number of kDeleted slots, which lookups probe past and insertions reuse.
+    size_t deleted;
 };
 
+static const uint8_t kEmpty = 0x80;
+static const uint8_t kDeleted = 0xfe;
+static const size_t kGroupWidth = 8;
+
+static const uint64_t kLsbs = 0x0101010101010101ull;
+static const uint64_t kMsbs = 0x8080808080808080ull;
+
+// Keep the load, counting deleted slots, at no more than 7/8.
+static inline size_t maxLoad(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+static inline uint64_t loadGroup(const uint8_t* ctrl) {
+    uint64_t group;
+    memcpy(&group, ctrl, sizeof(group));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    group = __builtin_bswap64(group);
+#endif
+    return group;
+}
+
+// Each of these returns a mask with the top bit of byte i set if control byte i matches.
+// The portable version of matchHash can report false positives next to a true match, though
+// only on full slots, so callers still compare the keys. They rely on unsigned wraparound.
+#ifdef __clang__
+__attribute__((no_sanitize("integer")))
+#endif
+static inline uint64_t matchHash(uint64_t group, uint8_t h2) {
+#if defined(__aarch64__)
+    uint8x8_t eq = vceq_u8(vcreate_u8(group), vdup_n_u8(h2));
+    return vget_lane_u64(vreinterpret_u64_u8(eq), 0) & kMsbs;
+#elif defined(__x86_64__)
+    __m128i eq = _mm_cmpeq_epi8(_mm_cvtsi64_si128(group), _mm_set1_epi8(h2));
+    return _mm_cvtsi128_si64(eq) & kMsbs;
+#else
+    uint64_t x = group ^ (kLsbs * h2);
+    return (x - kLsbs) & ~x & kMsbs;
+#endif
+}
+
+#ifdef __clang__
+__attribute__((no_sanitize("integer")))
+#endif
+static inline uint64_t matchEmpty(uint64_t group) {
+    return group & (~group << 6) & kMsbs;
+}
+
+#ifdef __clang__
+__attribute__((no_sanitize("integer")))
+#endif
+static inline uint64_t matchEmptyOrDeleted(uint64_t group) {
+    return group & (~group << 7) & kMsbs;
+}
+
+static inline size_t lowestMatch(uint64_t mask) {
+    return __builtin_ctzll(mask) / 8;
+}
+
+static bool allocateSlots(Hashmap* map, size_t capacity) {
+    // One allocation for both arrays; the control bytes go last to keep the slots aligned.
+    Slot* slots = static_cast<Slot*>(malloc(capacity * (sizeof(Slot) + 1)));
+    if (slots == NULL) {
+        return false;
+    }
+    map->slots = slots;
+    map->ctrl = reinterpret_cast<uint8_t*>(slots + capacity);
+    memset(map->ctrl, kEmpty, capacity);
+    map->capacity = capacity;
+    map->deleted = 0;
+    return true;
+}
+
 Hashmap* hashmapCreate(size_t initialCapacity,
         int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
     assert(hash != NULL);
@@ -50,16 +136,13 @@ Hashmap* hashmapCreate(size_t initialCapacity,
         return NULL;
     }
 
-    // 0.75 load factor.
-    size_t minimumBucketCount = initialCapacity * 4 / 3;
-    map->bucketCount = 1;
-    while (map->bucketCount <= minimumBucketCount) {
-        // Bucket count must be power of 2.
-        map->bucketCount <<= 1;
+    // Capacity must be a power of 2, and at least one group.
+    size_t capacity = kGroupWidth;
+    while (maxLoad(capacity) < initialCapacity) {
+        capacity <<= 1;
     }
 
-    map->buckets = static_cast<Entry**>(calloc(map->bucketCount, sizeof(Entry*)));
-    if (map->buckets == NULL) {
+    if (!allocateSlots(map, capacity)) {
         free(map);
         return NULL;
     }
@@ -93,41 +176,103 @@ static inline int hashKey(Hashmap* map, void* key) {
     return h;
 }
 
-static inline size_t calculateIndex(size_t bucketCount, int hash) {
-    return ((size_t) hash) & (bucketCount - 1);
+// The top bits of the hash pick the first group to probe, the low 7 are kept in the control
+// byte. Groups are then probed in triangular order, which visits every group once.
+static inline size_t firstGroup(size_t capacity, int hash) {
+    return (((unsigned int) hash) >> 7) & (capacity / kGroupWidth - 1);
 }
 
-static void expandIfNecessary(Hashmap* map) {
-    // If the load factor exceeds 0.75...
-    if (map->size > (map->bucketCount * 3 / 4)) {
-        // Start off with a 0.33 load factor.
-        size_t newBucketCount = map->bucketCount << 1;
-        Entry** newBuckets = static_cast<Entry**>(calloc(newBucketCount, sizeof(Entry*)));
-        if (newBuckets == NULL) {
-            // Abort expansion.
-            return;
-        }
+static inline uint8_t controlByte(int hash) {
+    return ((unsigned int) hash) & 0x7f;
+}
+
+static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
+        bool (*equals)(void*, void*)) {
+    if (keyA == keyB) {
+        return true;
+    }
+    if (hashA != hashB) {
+        return false;
+    }
+    return equals(keyA, keyB);
+}
 
-        // Move over existing entries.
-        size_t i;
-        for (i = 0; i < map->bucketCount; i++) {
-            Entry* entry = map->buckets[i];
-            while (entry != NULL) {
-                Entry* next = entry->next;
-                size_t index = calculateIndex(newBucketCount, entry->hash);
-                entry->next = newBuckets[index];
-                newBuckets[index] = entry;
-                entry = next;
+// Returns the index of the slot holding key, or capacity if there is none.
+static inline size_t findSlot(Hashmap* map, void* key, int hash) {
+    const size_t groupMask = map->capacity / kGroupWidth - 1;
+    const uint8_t h2 = controlByte(hash);
+    size_t group = firstGroup(map->capacity, hash);
+    for (size_t step = 1; step <= groupMask + 1; step++) {
+        const size_t base = group * kGroupWidth;
+        const uint64_t ctrl = loadGroup(map->ctrl + base);
+        for (uint64_t mask = matchHash(ctrl, h2); mask != 0; mask &= mask - 1) {
+            const size_t index = base + lowestMatch(mask);
+            Slot* slot = &map->slots[index];
+            if (equalKeys(slot->key, slot->hash, key, hash, map->equals)) {
+                return index;
             }
         }
+        // An insertion would have used this group's empty slot before going further.
+        if (matchEmpty(ctrl) != 0) {
+            break;
+        }
+        group = (group + step) & groupMask;
+    }
+    return map->capacity;
+}
 
-        // Copy over internals.
-        free(map->buckets);
-        map->buckets = newBuckets;
-        map->bucketCount = newBucketCount;
+// Returns the index of the first free slot on the probe sequence for hash.
+static size_t findFreeSlot(Hashmap* map, int hash) {
+    const size_t groupMask = map->capacity / kGroupWidth - 1;
+    size_t group = firstGroup(map->capacity, hash);
+    for (size_t step = 1;; step++) {
+        const size_t base = group * kGroupWidth;
+        const uint64_t mask = matchEmptyOrDeleted(loadGroup(map->ctrl + base));
+        if (mask != 0) {
+            return base + lowestMatch(mask);
+        }
+        group = (group + step) & groupMask;
     }
 }
 
+// Moves the entries to a new table of the given capacity, dropping deleted slots.
+static bool resize(Hashmap* map, size_t newCapacity) {
+    Slot* oldSlots = map->slots;
+    uint8_t* oldCtrl = map->ctrl;
+    size_t oldCapacity = map->capacity;
+    if (!allocateSlots(map, newCapacity)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldCtrl[i] & kEmpty) {
+            continue;
+        }
+        size_t index = findFreeSlot(map, oldSlots[i].hash);
+        map->ctrl[index] = oldCtrl[i];
+        map->slots[index] = oldSlots[i];
+    }
+    free(oldSlots);
+    return true;
+}
+
+// Makes room for one more entry, if need be.
+static bool reserveSlot(Hashmap* map) {
+    if (map->size + map->deleted < maxLoad(map->capacity)) {
+        return true;
+    }
+    // Grow if the table is mostly live entries, otherwise just clear out the deleted slots.
+    size_t newCapacity = map->capacity;
+    if (map->size >= maxLoad(map->capacity) / 2) {
+        newCapacity <<= 1;
+    }
+    if (resize(map, newCapacity)) {
+        return true;
+    }
+    // Carry on over the maximum load as long as lookups still find an empty slot somewhere.
+    return map->size + map->deleted + 1 < map->capacity;
+}
+
 void hashmapLock(Hashmap* map) {
     pthread_mutex_lock(&map->lock);
 }
@@ -137,16 +282,7 @@ void hashmapUnlock(Hashmap* map) {
 }
 
 void hashmapFree(Hashmap* map) {
-    size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry* next = entry->next;
-            free(entry);
-            entry = next;
-        }
-    }
-    free(map->buckets);
+    free(map->slots);
     pthread_mutex_destroy(&map->lock);
     free(map);
 }
@@ -166,109 +302,72 @@ int hashmapHash(void* key, size_t keySize) {
     return h;
 }
 
-static Entry* createEntry(void* key, int hash, void* value) {
-    Entry* entry = static_cast<Entry*>(malloc(sizeof(Entry)));
-    if (entry == NULL) {
-        return NULL;
-    }
-    entry->key = key;
-    entry->hash = hash;
-    entry->value = value;
-    entry->next = NULL;
-    return entry;
-}
-
-static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
-        bool (*equals)(void*, void*)) {
-    if (keyA == keyB) {
-        return true;
-    }
-    if (hashA != hashB) {
-        return false;
-    }
-    return equals(keyA, keyB);
-}
-
 void* hashmapPut(Hashmap* map, void* key, void* value) {
     int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry** p = &(map->buckets[index]);
-    while (true) {
-        Entry* current = *p;
-
-        // Add a new entry.
-        if (current == NULL) {
-            *p = createEntry(key, hash, value);
-            if (*p == NULL) {
-                errno = ENOMEM;
-                return NULL;
-            }
-            map->size++;
-            expandIfNecessary(map);
-            return NULL;
-        }
 
-        // Replace existing entry.
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* oldValue = current->value;
-            current->value = value;
-            return oldValue;
-        }
+    // Replace existing entry.
+    size_t index = findSlot(map, key, hash);
+    if (index != map->capacity) {
+        void* oldValue = map->slots[index].value;
+        map->slots[index].value = value;
+        return oldValue;
+    }
 
-        // Move to next entry.
-        p = &current->next;
+    // Add a new entry.
+    if (!reserveSlot(map)) {
+        errno = ENOMEM;
+        return NULL;
     }
+    index = findFreeSlot(map, hash);
+    if (map->ctrl[index] == kDeleted) {
+        map->deleted--;
+    }
+    map->ctrl[index] = controlByte(hash);
+    map->slots[index].key = key;
+    map->slots[index].hash = hash;
+    map->slots[index].value = value;
+    map->size++;
+    return NULL;
 }
 
 void* hashmapGet(Hashmap* map, void* key) {
     int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry* entry = map->buckets[index];
-    while (entry != NULL) {
-        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
-            return entry->value;
-        }
-        entry = entry->next;
+    size_t index = findSlot(map, key, hash);
+    if (index == map->capacity) {
+        return NULL;
     }
-
-    return NULL;
+    return map->slots[index].value;
 }
 
 void* hashmapRemove(Hashmap* map, void* key) {
     int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    // Pointer to the current entry.
-    Entry** p = &(map->buckets[index]);
-    Entry* current;
-    while ((current = *p) != NULL) {
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* value = current->value;
-            *p = current->next;
-            free(current);
-            map->size--;
-            return value;
-        }
-
-        p = &current->next;
+    size_t index = findSlot(map, key, hash);
+    if (index == map->capacity) {
+        return NULL;
     }
 
-    return NULL;
+    // Lookups stop at a group with an empty slot, so if this group already has one, the slot
+    // can be made empty too. Otherwise lookups must still probe past it.
+    size_t base = index & ~(kGroupWidth - 1);
+    if (matchEmpty(loadGroup(map->ctrl + base)) != 0) {
+        map->ctrl[index] = kEmpty;
+    } else {
+        map->ctrl[index] = kDeleted;
+        map->deleted++;
+    }
+    map->size--;
+    return map->slots[index].value;
 }
 
 void hashmapForEach(Hashmap* map, bool (*callback)(void* key, void* value, void* context),
                     void* context) {
-    size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry *next = entry->next;
-            if (!callback(entry->key, entry->value, context)) {
-                return;
-            }
-            entry = next;
+    // The callback may remove entries, including the current one.
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->ctrl[i] & kEmpty) {
+            continue;
+        }
+        if (!callback(map->slots[i].key, map->slots[i].value, context)) {
+            return;
         }
     }
 }
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/hashmap.h>
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+static int str_hash(void* key) {
+    return hashmapHash(key, strlen(static_cast<char*>(key)));
+}
+
+static bool str_equals(void* keyA, void* keyB) {
+    return strcmp(static_cast<char*>(keyA), static_cast<char*>(keyB)) == 0;
+}
+
+static std::vector<std::string> make_keys(size_t count, const char* prefix) {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < count; i++) {
+        keys.push_back(prefix + std::to_string(i));
+    }
+    return keys;
+}
+
+static Hashmap* make_map(std::vector<std::string>& keys) {
+    Hashmap* map = hashmapCreate(keys.size(), str_hash, str_equals);
+    for (std::string& key : keys) {
+        hashmapPut(map, key.data(), key.data());
+    }
+    return map;
+}
+
+static void BM_hashmap_get_hit(benchmark::State& state) {
+    std::vector<std::string> keys = make_keys(state.range(0), "key");
+    Hashmap* map = make_map(keys);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hashmapGet(map, keys[i++ % keys.size()].data()));
+    }
+    hashmapFree(map);
+}
+BENCHMARK(BM_hashmap_get_hit)->Range(8, 4096);
+
+static void BM_hashmap_get_miss(benchmark::State& state) {
+    std::vector<std::string> keys = make_keys(state.range(0), "key");
+    std::vector<std::string> missing = make_keys(state.range(0), "missing");
+    Hashmap* map = make_map(keys);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(hashmapGet(map, missing[i++ % missing.size()].data()));
+    }
+    hashmapFree(map);
+}
+BENCHMARK(BM_hashmap_get_miss)->Range(8, 4096);
+
+static void BM_hashmap_put_remove(benchmark::State& state) {
+    std::vector<std::string> keys = make_keys(state.range(0), "key");
+    Hashmap* map = make_map(keys);
+    std::string extra = "extra";
+    for (auto _ : state) {
+        hashmapPut(map, extra.data(), extra.data());
+        hashmapRemove(map, extra.data());
+    }
+    hashmapFree(map);
+}
+BENCHMARK(BM_hashmap_put_remove)->Range(8, 4096);
+
+// Building and tearing down a small map, as str_parms does for every parameter string.
+static void BM_hashmap_create_fill_free(benchmark::State& state) {
+    std::vector<std::string> keys = make_keys(state.range(0), "key");
+    for (auto _ : state) {
+        Hashmap* map = make_map(keys);
+        hashmapFree(map);
+    }
+}
+BENCHMARK(BM_hashmap_create_fill_free)->Arg(4)->Arg(16);
+
+static void BM_hashmap_for_each(benchmark::State& state) {
+    std::vector<std::string> keys = make_keys(state.range(0), "key");
+    Hashmap* map = make_map(keys);
+    for (auto _ : state) {
+        size_t count = 0;
+        hashmapForEach(
+                map,
+                [](void*, void*, void* context) {
+                    ++*static_cast<size_t*>(context);
+                    return true;
+                },
+                &count);
+        benchmark::DoNotOptimize(count);
+    }
+    hashmapFree(map);
+}
+BENCHMARK(BM_hashmap_for_each)->Range(8, 4096);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/hashmap.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+static int str_hash(void* key) {
+    return hashmapHash(key, strlen(static_cast<char*>(key)));
+}
+
+static bool str_equals(void* keyA, void* keyB) {
+    return strcmp(static_cast<char*>(keyA), static_cast<char*>(keyB)) == 0;
+}
+
+// Puts every key in the same probe sequence.
+static int colliding_hash(void*) {
+    return 0;
+}
+
+static void* int_value(intptr_t i) {
+    return reinterpret_cast<void*>(i);
+}
+
+TEST(hashmap, put_get_remove) {
+    Hashmap* map = hashmapCreate(0, str_hash, str_equals);
+    ASSERT_NE(nullptr, map);
+
+    char foo[] = "foo";
+    char bar[] = "bar";
+    EXPECT_EQ(nullptr, hashmapPut(map, foo, int_value(1)));
+    EXPECT_EQ(nullptr, hashmapPut(map, bar, int_value(2)));
+    char foo2[] = "foo";
+    EXPECT_EQ(int_value(1), hashmapPut(map, foo2, int_value(3)));
+
+    EXPECT_EQ(int_value(3), hashmapGet(map, foo));
+    EXPECT_EQ(int_value(2), hashmapGet(map, bar));
+    char baz[] = "baz";
+    EXPECT_EQ(nullptr, hashmapGet(map, baz));
+
+    EXPECT_EQ(int_value(3), hashmapRemove(map, foo));
+    EXPECT_EQ(nullptr, hashmapRemove(map, foo));
+    EXPECT_EQ(nullptr, hashmapGet(map, foo));
+    EXPECT_EQ(int_value(2), hashmapGet(map, bar));
+
+    hashmapFree(map);
+}
+
+static void check_against_std_map(int (*hash)(void*), size_t count) {
+    Hashmap* map = hashmapCreate(4, hash, str_equals);
+    ASSERT_NE(nullptr, map);
+
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < count; i++) {
+        keys.push_back(std::to_string(i));
+    }
+    std::map<std::string, intptr_t> expected;
+    std::mt19937 random(0);
+    for (size_t i = 0; i < count * 8; i++) {
+        std::string& key = keys[random() % count];
+        void* k = key.data();
+        if (random() % 3 == 0) {
+            auto it = expected.find(key);
+            EXPECT_EQ(it == expected.end() ? nullptr : int_value(it->second),
+                      hashmapRemove(map, k));
+            if (it != expected.end()) expected.erase(it);
+        } else {
+            auto it = expected.find(key);
+            EXPECT_EQ(it == expected.end() ? nullptr : int_value(it->second),
+                      hashmapPut(map, k, int_value(i + 1)));
+            expected[key] = i + 1;
+        }
+    }
+
+    for (std::string& key : keys) {
+        auto it = expected.find(key);
+        EXPECT_EQ(it == expected.end() ? nullptr : int_value(it->second),
+                  hashmapGet(map, key.data()))
+                << key;
+    }
+
+    hashmapFree(map);
+}
+
+TEST(hashmap, matches_std_map) {
+    check_against_std_map(str_hash, 1000);
+}
+
+TEST(hashmap, matches_std_map_colliding) {
+    check_against_std_map(colliding_hash, 100);
+}
+
+static bool remove_all(void* key, void*, void* context) {
+    Hashmap* map = static_cast<Hashmap*>(context);
+    hashmapRemove(map, key);
+    return true;
+}
+
+TEST(hashmap, for_each_remove) {
+    Hashmap* map = hashmapCreate(5, str_hash, str_equals);
+    ASSERT_NE(nullptr, map);
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 100; i++) {
+        keys.push_back(std::to_string(i));
+    }
+    for (std::string& key : keys) {
+        hashmapPut(map, key.data(), int_value(1));
+    }
+
+    size_t count = 0;
+    hashmapForEach(
+            map,
+            [](void*, void*, void* context) {
+                ++*static_cast<size_t*>(context);
+                return true;
+            },
+            &count);
+    EXPECT_EQ(keys.size(), count);
+
+    // Removing the current entry while iterating is allowed.
+    hashmapForEach(map, remove_all, map);
+    for (std::string& key : keys) {
+        EXPECT_EQ(nullptr, hashmapGet(map, key.data()));
+    }
+
+    hashmapFree(map);
+}
@@ -33,6 +33,24 @@ int ashmem_pin_region(int fd, size_t offset, size_t len);
 int ashmem_unpin_region(int fd, size_t offset, size_t len);
 int ashmem_get_size_region(int fd);
 
+/*
+ * A pool of regions that all have the same name and size. A region returned
+ * with ashmem_pool_put() has its pages dropped and is handed out again by a
+ * later ashmem_pool_get(), which avoids creating, sizing and sealing a new
+ * region each time. Regions from ashmem_pool_get() read as zeroes, just like
+ * regions from ashmem_create_region().
+ *
+ * Only put back a region after every mapping of it has been unmapped and no
+ * other process holds it, because the same file is reused. Regions that were
+ * made read-only, or that cannot be recycled, are closed.
+ */
+typedef struct ashmem_pool ashmem_pool;
+
+ashmem_pool* ashmem_pool_create(const char* name, size_t size, size_t max_cached);
+void ashmem_pool_destroy(ashmem_pool* pool);
+int ashmem_pool_get(ashmem_pool* pool);
+void ashmem_pool_put(ashmem_pool* pool, int fd);
+
 #ifdef __cplusplus
 }
 #endif
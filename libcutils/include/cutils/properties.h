@@ -110,6 +110,20 @@ int32_t property_get_int32(const char *key, int32_t default_value);
 */
 int property_set(const char *key, const char *value);
 
+/* The property service message used by property_set_batch(). */
+#define PROP_MSG_SETPROP_BATCH 0x00020002
+#define PROPERTY_SET_BATCH_MAX 64
+
+/* property_set_batch: sets up to PROPERTY_SET_BATCH_MAX properties with a
+** single request to the property service, rather than one request each.
+**
+** Returns 0 once the property service has handled the request, in which case
+** results[i] is PROP_SUCCESS or the PROP_ERROR_* code for keys[i]; returns < 0
+** if the request couldn't be made.
+*/
+int property_set_batch(size_t count, const char* const* keys, const char* const* values,
+                       uint32_t* results);
+
 int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);
 
 #if defined(__BIONIC_FORTIFY)
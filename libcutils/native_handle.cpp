@@ -22,6 +22,11 @@
 #include <string.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <malloc.h>
+#include <sys/syscall.h>
+#endif
+
 // Needs to come after stdlib includes to capture the __BIONIC__ definition
 #ifdef __BIONIC__
 #include <android/fdsan.h>
@@ -50,6 +55,109 @@ uint64_t get_fdsan_tag(const native_handle_t* handle) {
                                           reinterpret_cast<uint64_t>(handle));
 }
 
+#if defined(__linux__) && defined(__NR_close_range)
+bool close_range_unsupported = false;
+
+// Closes the fds of h with a single close_range() if they are consecutive, which they usually
+// are when they were just dup()ed. Returns false if the caller has to close them one by one.
+bool close_contiguous(const native_handle_t* h, uint64_t tag) {
+    const int numFds = h->numFds;
+    if (numFds < 2 || __atomic_load_n(&close_range_unsupported, __ATOMIC_RELAXED)) return false;
+
+    const int first = h->data[0];
+    if (first < 0) return false;
+    for (int i = 1; i < numFds; ++i) {
+        if (h->data[i] != first + i) return false;
+    }
+
+    // fdsan only tracks ownership in userspace, so releasing it first leaves it in the same state
+    // as android_fdsan_close_with_tag() would, including the error if the tag doesn't match.
+    for (int i = 0; i < numFds; ++i) {
+        android_fdsan_exchange_owner_tag(h->data[i], tag, 0);
+    }
+    if (syscall(__NR_close_range, first, first + numFds - 1, 0) == 0) return true;
+
+    // Kernels before 5.9; the fds are untagged now, so a plain loop finishes the job.
+    __atomic_store_n(&close_range_unsupported, true, __ATOMIC_RELAXED);
+    for (int i = 0; i < numFds; ++i) {
+        close(h->data[i]);
+    }
+    return true;
+}
+#else
+bool close_contiguous(const native_handle_t*, uint64_t) {
+    return false;
+}
+#endif
+
+#if defined(__linux__)
+// Freed handles are kept in small per-thread stacks, one per size class, so that the create and
+// delete pairs gralloc and codecs go through every frame skip malloc. Each class holds handles
+// with room for up to that many fds and ints together. Nothing is shared between threads, so
+// neither path ever waits.
+constexpr int kPoolClassInts[] = {8, 16, 32, 64};
+constexpr int kPoolClasses = sizeof(kPoolClassInts) / sizeof(kPoolClassInts[0]);
+constexpr int kPoolDepth = 8;
+
+constexpr size_t pool_class_size(int cls) {
+    return sizeof(native_handle_t) + sizeof(int) * kPoolClassInts[cls];
+}
+
+struct HandlePool {
+    native_handle_t* handles[kPoolClasses][kPoolDepth];
+    int count[kPoolClasses];
+
+    ~HandlePool();
+};
+
+// Set once the thread's pool is destroyed, for handles deleted by later thread_local destructors.
+thread_local bool pool_gone = false;
+thread_local HandlePool pool = {};
+
+HandlePool::~HandlePool() {
+    pool_gone = true;
+    for (int cls = 0; cls < kPoolClasses; ++cls) {
+        for (int i = 0; i < count[cls]; ++i) free(handles[cls][i]);
+    }
+}
+
+native_handle_t* pool_get(int numInts) {
+    for (int cls = 0; cls < kPoolClasses; ++cls) {
+        if (numInts > kPoolClassInts[cls]) continue;
+        if (!pool_gone && pool.count[cls] > 0) {
+            return pool.handles[cls][--pool.count[cls]];
+        }
+        return static_cast<native_handle_t*>(malloc(pool_class_size(cls)));
+    }
+    return static_cast<native_handle_t*>(malloc(sizeof(native_handle_t) + sizeof(int) * numInts));
+}
+
+void pool_put(native_handle_t* h) {
+    if (!pool_gone) {
+        // Handles need not come from pool_get(), as long as they came from malloc(). Whatever
+        // the allocator says fits decides the class.
+        size_t usable = malloc_usable_size(h);
+        for (int cls = kPoolClasses - 1; cls >= 0; --cls) {
+            if (usable < pool_class_size(cls)) continue;
+            if (pool.count[cls] < kPoolDepth) {
+                pool.handles[cls][pool.count[cls]++] = h;
+                return;
+            }
+            break;
+        }
+    }
+    free(h);
+}
+#else
+native_handle_t* pool_get(int numInts) {
+    return static_cast<native_handle_t*>(malloc(sizeof(native_handle_t) + sizeof(int) * numInts));
+}
+
+void pool_put(native_handle_t* h) {
+    free(h);
+}
+#endif
+
 int close_internal(const native_handle_t* h, bool allowUntagged) {
     if (!h) return 0;
 
@@ -63,8 +171,10 @@ int close_internal(const native_handle_t* h, bool allowUntagged) {
         tag = get_fdsan_tag(h);
     }
     int saved_errno = errno;
-    for (int i = 0; i < numFds; ++i) {
-        android_fdsan_close_with_tag(h->data[i], tag);
+    if (!close_contiguous(h, tag)) {
+        for (int i = 0; i < numFds; ++i) {
+            android_fdsan_close_with_tag(h->data[i], tag);
+        }
     }
     errno = saved_errno;
     return 0;
@@ -103,8 +213,7 @@ native_handle_t* native_handle_create(int numFds, int numInts) {
         return NULL;
     }
 
-    size_t mallocSize = sizeof(native_handle_t) + (sizeof(int) * (numFds + numInts));
-    native_handle_t* h = static_cast<native_handle_t*>(malloc(mallocSize));
+    native_handle_t* h = pool_get(numFds + numInts);
     if (h) {
         h->version = sizeof(native_handle_t);
         h->numFds = numFds;
@@ -144,7 +253,7 @@ native_handle_t* native_handle_clone(const native_handle_t* handle) {
 int native_handle_delete(native_handle_t* h) {
     if (h) {
         if (h->version != sizeof(native_handle_t)) return -EINVAL;
-        free(h);
+        pool_put(h);
     }
     return 0;
 }
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/native_handle.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+// A gralloc-sized handle: a couple of fds and a couple dozen ints.
+static constexpr int kFds = 2;
+static constexpr int kInts = 22;
+
+static void BM_native_handle_create_delete(benchmark::State& state) {
+    for (auto _ : state) {
+        native_handle_t* h = native_handle_create(kFds, kInts);
+        benchmark::DoNotOptimize(h);
+        native_handle_delete(h);
+    }
+}
+BENCHMARK(BM_native_handle_create_delete);
+
+static void BM_native_handle_clone_close(benchmark::State& state) {
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    native_handle_t* h = native_handle_create(state.range(0), kInts);
+    for (int i = 0; i < h->numFds; ++i) h->data[i] = fd;
+    for (auto _ : state) {
+        native_handle_t* clone = native_handle_clone(h);
+        if (!clone) {
+            state.SkipWithError("native_handle_clone failed");
+            break;
+        }
+        native_handle_close(clone);
+        native_handle_delete(clone);
+    }
+    native_handle_delete(h);
+    close(fd);
+}
+BENCHMARK(BM_native_handle_clone_close)->Arg(1)->Arg(4)->Arg(16);
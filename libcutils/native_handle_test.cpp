@@ -16,6 +16,9 @@
 
 #include <cutils/native_handle.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <gtest/gtest.h>
 
 TEST(native_handle, native_handle_delete) {
@@ -25,3 +28,94 @@ TEST(native_handle, native_handle_delete) {
 TEST(native_handle, native_handle_close) {
     ASSERT_EQ(0, native_handle_close(nullptr));
 }
+
+// Duplicates fd to count consecutive fds starting at or above base.
+static void dup_consecutive(int fd, int base, int count, int* fds) {
+    fds[0] = fcntl(fd, F_DUPFD, base);
+    ASSERT_GE(fds[0], 0);
+    for (int i = 1; i < count; ++i) {
+        fds[i] = fcntl(fd, F_DUPFD, fds[0] + i);
+        ASSERT_EQ(fds[0] + i, fds[i]);
+    }
+}
+
+static bool is_open(int fd) {
+    return fcntl(fd, F_GETFD) != -1;
+}
+
+TEST(native_handle, close_consecutive_fds) {
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    ASSERT_GE(fd, 0);
+
+    native_handle_t* h = native_handle_create(4, 1);
+    ASSERT_NE(nullptr, h);
+    dup_consecutive(fd, 600, 4, h->data);
+    int first = h->data[0];
+    ASSERT_EQ(0, native_handle_close(h));
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_FALSE(is_open(first + i)) << first + i;
+    }
+    ASSERT_EQ(0, native_handle_delete(h));
+
+    // Out of order fds go through the one at a time path; a neighbour must survive either way.
+    int fds[3];
+    dup_consecutive(fd, 650, 3, fds);
+    h = native_handle_create(2, 0);
+    ASSERT_NE(nullptr, h);
+    h->data[0] = fds[2];
+    h->data[1] = fds[0];
+    ASSERT_EQ(0, native_handle_close(h));
+    EXPECT_FALSE(is_open(fds[0]));
+    EXPECT_TRUE(is_open(fds[1]));
+    EXPECT_FALSE(is_open(fds[2]));
+    close(fds[1]);
+    ASSERT_EQ(0, native_handle_delete(h));
+
+    close(fd);
+}
+
+TEST(native_handle, clone) {
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    ASSERT_GE(fd, 0);
+
+    native_handle_t* h = native_handle_create(1, 2);
+    ASSERT_NE(nullptr, h);
+    h->data[0] = fd;
+    h->data[1] = 42;
+    h->data[2] = 43;
+
+    native_handle_t* clone = native_handle_clone(h);
+    ASSERT_NE(nullptr, clone);
+    EXPECT_EQ(1, clone->numFds);
+    EXPECT_EQ(2, clone->numInts);
+    EXPECT_NE(fd, clone->data[0]);
+    EXPECT_TRUE(is_open(clone->data[0]));
+    EXPECT_EQ(42, clone->data[1]);
+    EXPECT_EQ(43, clone->data[2]);
+
+    ASSERT_EQ(0, native_handle_close(clone));
+    ASSERT_EQ(0, native_handle_delete(clone));
+    ASSERT_EQ(0, native_handle_close(h));
+    ASSERT_EQ(0, native_handle_delete(h));
+}
+
+TEST(native_handle, create_reuses_deleted) {
+    native_handle_t* h = native_handle_create(2, 10);
+    ASSERT_NE(nullptr, h);
+    ASSERT_EQ(0, native_handle_delete(h));
+
+    // A smaller request of the same size class gets the same handle back.
+    native_handle_t* again = native_handle_create(1, 8);
+    ASSERT_NE(nullptr, again);
+    EXPECT_EQ(1, again->numFds);
+    EXPECT_EQ(8, again->numInts);
+#if defined(__linux__)
+    EXPECT_EQ(h, again);
+#endif
+    ASSERT_EQ(0, native_handle_delete(again));
+
+    // Too big for any class.
+    h = native_handle_create(0, NATIVE_HANDLE_MAX_INTS);
+    ASSERT_NE(nullptr, h);
+    ASSERT_EQ(0, native_handle_delete(h));
+}
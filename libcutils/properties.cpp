@@ -20,9 +20,16 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include <mutex>
+#include <string>
+
+#include <android-base/file.h>
 #include <android-base/properties.h>
+#include <android-base/unique_fd.h>
 
 int8_t property_get_bool(const char* key, int8_t default_value) {
     if (!key) return default_value;
@@ -82,8 +89,91 @@ int property_set(const char* key, const char* value) {
     return __system_property_set(key, value);
 }
 
+#if __has_include(<sys/system_properties.h>)
+
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <sys/_system_properties.h>
+
+// A small cache of the most recently read properties, since native code tends to poll the same few
+// properties over and over.  Each entry is revalidated against the serial of its prop_info, which
+// is a plain load from the property area, so a hit costs neither a trie lookup nor a syscall.
+// Properties that don't exist are cached too, until the serial of the whole area changes.
+struct cached_property {
+    char name[96];
+    size_t name_len;
+    const prop_info* pi;
+    // The serial of pi when value was read, or of the property area when pi was found missing.
+    uint32_t serial;
+    bool valid;
+    int value_len;
+    char value[PROP_VALUE_MAX];
+};
+
+static constexpr size_t kCachedPropertyCount = 16;
+static std::mutex g_cached_properties_lock;
+static cached_property g_cached_properties[kCachedPropertyCount];
+static size_t g_cached_properties_next;
+
+static int cached_property_read(cached_property* cp, const char* key, char* value) {
+    if (cp->pi == nullptr) {
+        uint32_t area_serial = __system_property_area_serial();
+        if (!cp->valid || cp->serial != area_serial) {
+            cp->pi = __system_property_find(key);
+            cp->serial = area_serial;
+            cp->valid = cp->pi == nullptr;
+        }
+        if (cp->pi == nullptr) {
+            value[0] = '\0';
+            return 0;
+        }
+    }
+
+    uint32_t serial = __system_property_serial(cp->pi);
+    if (!cp->valid || cp->serial != serial) {
+        cp->value_len = __system_property_read(cp->pi, nullptr, cp->value);
+        cp->serial = serial;
+        cp->valid = true;
+    }
+    memcpy(value, cp->value, cp->value_len + 1);
+    return cp->value_len;
+}
+
+static int cached_property_get(const char* key, char* value) {
+    size_t key_len = strlen(key);
+    if (key_len >= sizeof(cached_property::name)) {
+        return __system_property_get(key, value);
+    }
+
+    // Rather than wait, read the property directly if another thread is using the cache, which
+    // also keeps this safe to call from a signal handler.
+    std::unique_lock lock(g_cached_properties_lock, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return __system_property_get(key, value);
+    }
+
+    for (auto& cp : g_cached_properties) {
+        if (cp.name_len == key_len && !memcmp(cp.name, key, key_len)) {
+            return cached_property_read(&cp, key, value);
+        }
+    }
+
+    cached_property* cp = &g_cached_properties[g_cached_properties_next];
+    g_cached_properties_next = (g_cached_properties_next + 1) % kCachedPropertyCount;
+    memcpy(cp->name, key, key_len + 1);
+    cp->name_len = key_len;
+    cp->pi = nullptr;
+    cp->valid = false;
+    return cached_property_read(cp, key, value);
+}
+
+#endif
+
 int property_get(const char* key, char* value, const char* default_value) {
+#if __has_include(<sys/system_properties.h>)
+    int len = cached_property_get(key, value);
+#else
     int len = __system_property_get(key, value);
+#endif
     if (len < 1 && default_value) {
         snprintf(value, PROPERTY_VALUE_MAX, "%s", default_value);
         return strlen(value);
@@ -93,9 +183,6 @@ int property_get(const char* key, char* value, const char* default_value) {
 
 #if __has_include(<sys/system_properties.h>)
 
-#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
-#include <sys/_system_properties.h>
-
 struct callback_data {
     void (*callback)(const char* name, const char* value, void* cookie);
     void* cookie;
@@ -115,4 +202,48 @@ int property_list(void (*fn)(const char* name, const char* value, void* cookie),
     return __system_property_foreach(property_list_callback, &data);
 }
 
+static void append_uint32(std::string* request, uint32_t value) {
+    request->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void append_string(std::string* request, const char* value) {
+    size_t len = strlen(value);
+    append_uint32(request, len);
+    request->append(value, len);
+}
+
+int property_set_batch(size_t count, const char* const* keys, const char* const* values,
+                       uint32_t* results) {
+    if (count > PROPERTY_SET_BATCH_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (count == 0) return 0;
+
+    std::string request;
+    append_uint32(&request, PROP_MSG_SETPROP_BATCH);
+    append_uint32(&request, count);
+    for (size_t i = 0; i < count; ++i) {
+        append_string(&request, keys[i]);
+        append_string(&request, values[i]);
+    }
+
+    android::base::unique_fd fd(socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (fd == -1) return -1;
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_LOCAL;
+    strlcpy(addr.sun_path, "/dev/socket/" PROP_SERVICE_NAME, sizeof(addr.sun_path));
+    if (TEMP_FAILURE_RETRY(connect(fd.get(), reinterpret_cast<sockaddr*>(&addr),
+                                   sizeof(addr))) == -1) {
+        return -1;
+    }
+
+    if (!android::base::WriteFully(fd, request.data(), request.size()) ||
+        !android::base::ReadFully(fd, results, count * sizeof(*results))) {
+        return -1;
+    }
+    return 0;
+}
+
 #endif
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cutils/properties.h>
+
+#include <benchmark/benchmark.h>
+
+// Set on every device; the missing one is the kind of debug property that native code polls.
+static constexpr char kProperty[] = "ro.build.type";
+static constexpr char kMissingProperty[] = "libcutils.benchmark.missing";
+
+// The uncached reads that property_get() used to do every time, for comparison.
+#if __has_include(<sys/system_properties.h>)
+static void BM___system_property_get(benchmark::State& state) {
+    char value[PROPERTY_VALUE_MAX];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(__system_property_get(kProperty, value));
+    }
+}
+BENCHMARK(BM___system_property_get);
+
+static void BM___system_property_get_missing(benchmark::State& state) {
+    char value[PROPERTY_VALUE_MAX];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(__system_property_get(kMissingProperty, value));
+    }
+}
+BENCHMARK(BM___system_property_get_missing);
+#endif
+
+static void BM_property_get(benchmark::State& state) {
+    char value[PROPERTY_VALUE_MAX];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(property_get(kProperty, value, ""));
+    }
+}
+BENCHMARK(BM_property_get);
+
+static void BM_property_get_bool_missing(benchmark::State& state) {
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(property_get_bool(kMissingProperty, false));
+    }
+}
+BENCHMARK(BM_property_get_bool_missing);
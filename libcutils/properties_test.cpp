@@ -117,6 +117,29 @@ TEST_F(PropertiesTest, property_set) {
     ResetValue();
 }
 
+TEST_F(PropertiesTest, property_get_sees_updates) {
+    // Repeated reads are served from a cache, which must still see every change.
+    for (int i = 0; i < 20; ++i) {
+        std::string value = ToString(i);
+        ASSERT_OK(property_set(PROPERTY_TEST_KEY, value.c_str()));
+        for (int j = 0; j < 3; ++j) {
+            EXPECT_EQ(static_cast<int>(value.size()),
+                      property_get(PROPERTY_TEST_KEY, mValue, PROPERTY_TEST_VALUE_DEFAULT));
+            EXPECT_EQ(value, mValue);
+            EXPECT_EQ(i, property_get_int32(PROPERTY_TEST_KEY, -1));
+        }
+    }
+
+    // Reading many other properties in between evicts the test key from the cache.
+    for (int i = 0; i < 64; ++i) {
+        std::string key = "libcutils.test.missing" + ToString(i);
+        EXPECT_EQ(0, property_get(key.c_str(), mValue, ""));
+    }
+    ASSERT_OK(property_set(PROPERTY_TEST_KEY, "after"));
+    EXPECT_EQ(5, property_get(PROPERTY_TEST_KEY, mValue, PROPERTY_TEST_VALUE_DEFAULT));
+    EXPECT_STREQ("after", mValue);
+}
+
 TEST_F(PropertiesTest, property_set_empty) {
     // Set to empty string => get returns default always
     const char* EMPTY_STRING_DEFAULT = "EMPTY_STRING";
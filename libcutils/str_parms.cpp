@@ -26,163 +26,162 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <cutils/hashmap.h>
 #include <cutils/memory.h>
 #include <log/log.h>
 
-/* When an object is allocated but not freed in a function,
- * because its ownership is released to other object like a hashmap,
- * call RELEASE_OWNERSHIP to tell the clang analyzer and avoid
- * false warnings about potential memory leak.
- * For now, a "temporary" assignment to global variables
- * is enough to confuse the clang static analyzer.
+/* Pairs are kept in insertion order. A key or value points either into the
+ * str_parms's own copy of the string it was created from, which is tokenized
+ * in place, or to a string allocated when it was added later.
  */
-#ifdef __clang_analyzer__
-static void *released_pointer;
-#define RELEASE_OWNERSHIP(x) { released_pointer = x; released_pointer = 0; }
-#else
-#define RELEASE_OWNERSHIP(x)
-#endif
+struct str_parms_pair {
+    char *key;
+    char *value;
+};
+
+/* Enough for typical parameter strings, so that parsing one takes a single
+ * allocation for the str_parms, its pairs and its copy of the string.
+ */
+#define STR_PARMS_INLINE_PAIRS 16
 
 struct str_parms {
-    Hashmap *map;
+    struct str_parms_pair *pairs;
+    size_t count;
+    size_t capacity;
+    char *buffer;
+    size_t buffer_size;
+    struct str_parms_pair inline_pairs[STR_PARMS_INLINE_PAIRS];
+    /* The buffer follows. */
 };
 
-
-static bool str_eq(void *key_a, void *key_b)
+static struct str_parms *str_parms_alloc(size_t buffer_size)
 {
-    return !strcmp((const char *)key_a, (const char *)key_b);
+    str_parms* s = static_cast<str_parms*>(malloc(sizeof(str_parms) + buffer_size));
+    if (!s) return NULL;
+
+    s->pairs = s->inline_pairs;
+    s->count = 0;
+    s->capacity = STR_PARMS_INLINE_PAIRS;
+    s->buffer = buffer_size ? reinterpret_cast<char*>(s + 1) : NULL;
+    s->buffer_size = buffer_size;
+    return s;
 }
 
-/* use djb hash unless we find it inadequate */
-#ifdef __clang__
-__attribute__((no_sanitize("integer")))
-#endif
-static int str_hash_fn(void *str)
+static bool is_in_buffer(struct str_parms *str_parms, const char *str)
 {
-    uint32_t hash = 5381;
-
-    for (char* p = static_cast<char*>(str); p && *p; p++)
-        hash = ((hash << 5) + hash) + *p;
-    return (int)hash;
+    uintptr_t p = reinterpret_cast<uintptr_t>(str);
+    uintptr_t buffer = reinterpret_cast<uintptr_t>(str_parms->buffer);
+    return p >= buffer && p < buffer + str_parms->buffer_size;
 }
 
-struct str_parms *str_parms_create(void)
+/* Frees str unless it points into the buffer. */
+static void release_str(struct str_parms *str_parms, char *str)
 {
-    str_parms* s = static_cast<str_parms*>(calloc(1, sizeof(str_parms)));
-    if (!s) return NULL;
+    if (!is_in_buffer(str_parms, str))
+        free(str);
+}
 
-    s->map = hashmapCreate(5, str_hash_fn, str_eq);
-    if (!s->map) {
-        free(s);
-        return NULL;
+static struct str_parms_pair *find_pair(struct str_parms *str_parms, const char *key)
+{
+    for (size_t i = 0; i < str_parms->count; i++) {
+        if (!strcmp(str_parms->pairs[i].key, key))
+            return &str_parms->pairs[i];
     }
-
-    return s;
+    return NULL;
 }
 
-struct remove_ctxt {
-    struct str_parms *str_parms;
-    const char *key;
-};
-
-static bool remove_pair(void *key, void *value, void *context)
+/* Sets errno to ENOMEM and returns false if the pairs can't grow. */
+static bool append_pair(struct str_parms *str_parms, char *key, char *value)
 {
-    remove_ctxt* ctxt = static_cast<remove_ctxt*>(context);
-    bool should_continue;
-
-    /*
-     * - if key is not supplied, then we are removing all entries,
-     *   so remove key and continue (i.e. return true)
-     * - if key is supplied and matches, then remove it and don't
-     *   continue (return false). Otherwise, return true and keep searching
-     *   for key.
-     *
-     */
-    if (!ctxt->key) {
-        should_continue = true;
-        goto do_remove;
-    } else if (!strcmp(ctxt->key, static_cast<const char*>(key))) {
-        should_continue = false;
-        goto do_remove;
+    if (str_parms->count == str_parms->capacity) {
+        size_t capacity = str_parms->capacity * 2;
+        str_parms_pair* pairs =
+                static_cast<str_parms_pair*>(malloc(capacity * sizeof(str_parms_pair)));
+        if (!pairs) {
+            errno = ENOMEM;
+            return false;
+        }
+        memcpy(pairs, str_parms->pairs, str_parms->count * sizeof(str_parms_pair));
+        if (str_parms->pairs != str_parms->inline_pairs)
+            free(str_parms->pairs);
+        str_parms->pairs = pairs;
+        str_parms->capacity = capacity;
     }
 
+    str_parms->pairs[str_parms->count].key = key;
+    str_parms->pairs[str_parms->count].value = value;
+    str_parms->count++;
     return true;
+}
 
-do_remove:
-    hashmapRemove(ctxt->str_parms->map, key);
-    free(key);
-    free(value);
-    return should_continue;
+struct str_parms *str_parms_create(void)
+{
+    return str_parms_alloc(0);
 }
 
 void str_parms_del(struct str_parms *str_parms, const char *key)
 {
-    struct remove_ctxt ctxt = {
-        .str_parms = str_parms,
-        .key = key,
-    };
-    hashmapForEach(str_parms->map, remove_pair, &ctxt);
+    str_parms_pair* pair = find_pair(str_parms, key);
+    if (!pair)
+        return;
+
+    release_str(str_parms, pair->key);
+    release_str(str_parms, pair->value);
+    str_parms_pair* end = str_parms->pairs + str_parms->count;
+    memmove(pair, pair + 1, (end - (pair + 1)) * sizeof(str_parms_pair));
+    str_parms->count--;
 }
 
 void str_parms_destroy(struct str_parms *str_parms)
 {
-    struct remove_ctxt ctxt = {
-        .str_parms = str_parms,
-    };
-
-    hashmapForEach(str_parms->map, remove_pair, &ctxt);
-    hashmapFree(str_parms->map);
+    for (size_t i = 0; i < str_parms->count; i++) {
+        release_str(str_parms, str_parms->pairs[i].key);
+        release_str(str_parms, str_parms->pairs[i].value);
+    }
+    if (str_parms->pairs != str_parms->inline_pairs)
+        free(str_parms->pairs);
     free(str_parms);
 }
 
 struct str_parms *str_parms_create_str(const char *_string)
 {
     struct str_parms *str_parms;
-    char *str;
     char *kvpair;
     char *tmpstr;
+    size_t len = strlen(_string);
     int items = 0;
 
-    str_parms = str_parms_create();
+    str_parms = str_parms_alloc(len + 1);
     if (!str_parms)
-        goto err_create_str_parms;
+        return NULL;
 
-    str = strdup(_string);
-    if (!str)
-        goto err_strdup;
+    memcpy(str_parms->buffer, _string, len + 1);
 
     ALOGV("%s: source string == '%s'\n", __func__, _string);
 
-    kvpair = strtok_r(str, ";", &tmpstr);
+    kvpair = strtok_r(str_parms->buffer, ";", &tmpstr);
     while (kvpair && *kvpair) {
         char *eq = strchr(kvpair, '='); /* would love strchrnul */
         char *value;
-        char *key;
-        void *old_val;
+        str_parms_pair *pair;
 
         if (eq == kvpair)
             goto next_pair;
 
         if (eq) {
-            key = strndup(kvpair, eq - kvpair);
-            if (*(++eq))
-                value = strdup(eq);
-            else
-                value = strdup("");
+            *eq = '\0';
+            value = eq + 1;
         } else {
-            key = strdup(kvpair);
-            value = strdup("");
+            /* The empty string at the end of the token. */
+            value = kvpair + strlen(kvpair);
         }
 
-        /* if we replaced a value, free it */
-        old_val = hashmapPut(str_parms->map, key, value);
-        RELEASE_OWNERSHIP(value);
-        if (old_val) {
-            free(old_val);
-            free(key);
-        } else {
-            RELEASE_OWNERSHIP(key);
+        /* if the key is already there, keep its place and replace its value */
+        pair = find_pair(str_parms, kvpair);
+        if (pair) {
+            pair->value = value;
+        } else if (!append_pair(str_parms, kvpair, value)) {
+            str_parms_destroy(str_parms);
+            return NULL;
         }
 
         items++;
@@ -193,59 +192,48 @@ next_pair:
     if (!items)
         ALOGV("%s: no items found in string\n", __func__);
 
-    free(str);
-
     return str_parms;
-
-err_strdup:
-    str_parms_destroy(str_parms);
-err_create_str_parms:
-    return NULL;
 }
 
 int str_parms_add_str(struct str_parms *str_parms, const char *key,
                       const char *value)
 {
-    void *tmp_key = NULL;
-    void *tmp_val = NULL;
-    void *old_val = NULL;
+    char *tmp_key = NULL;
+    char *tmp_val = NULL;
+    str_parms_pair *pair;
 
-    // strdup and hashmapPut both set errno on failure.
+    // strdup and append_pair both set errno on failure.
     // Set errno to 0 so we can recognize whether anything went wrong.
     int saved_errno = errno;
     errno = 0;
 
-    tmp_key = strdup(key);
-    if (tmp_key == NULL) {
+    tmp_val = strdup(value);
+    if (tmp_val == NULL) {
         goto clean_up;
     }
 
-    tmp_val = strdup(value);
-    if (tmp_val == NULL) {
+    pair = find_pair(str_parms, key);
+    if (pair) {
+        // For existing keys, the pair takes ownership of tmp_val.
+        release_str(str_parms, pair->value);
+        pair->value = tmp_val;
+        tmp_val = NULL;
         goto clean_up;
     }
 
-    old_val = hashmapPut(str_parms->map, tmp_key, tmp_val);
-    if (old_val == NULL) {
-        // Did hashmapPut fail?
-        if (errno == ENOMEM) {
-            goto clean_up;
-        }
-        // For new keys, hashmap takes ownership of tmp_key and tmp_val.
-        RELEASE_OWNERSHIP(tmp_key);
-        RELEASE_OWNERSHIP(tmp_val);
+    tmp_key = strdup(key);
+    if (tmp_key == NULL) {
+        goto clean_up;
+    }
+
+    if (append_pair(str_parms, tmp_key, tmp_val)) {
+        // For new keys, the pair takes ownership of tmp_key and tmp_val.
         tmp_key = tmp_val = NULL;
-    } else {
-        // For existing keys, hashmap takes ownership of tmp_val.
-        // (It also gives up ownership of old_val.)
-        RELEASE_OWNERSHIP(tmp_val);
-        tmp_val = NULL;
     }
 
 clean_up:
     free(tmp_key);
     free(tmp_val);
-    free(old_val);
     int result = -errno;
     errno = saved_errno;
     return result;
@@ -279,16 +267,15 @@ int str_parms_add_float(struct str_parms *str_parms, const char *key,
 }
 
 int str_parms_has_key(struct str_parms *str_parms, const char *key) {
-    return hashmapGet(str_parms->map, (void *)key) != NULL;
+    return find_pair(str_parms, key) != NULL;
 }
 
 int str_parms_get_str(struct str_parms *str_parms, const char *key, char *val,
                       int len)
 {
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)key));
-    if (value)
-        return strlcpy(val, value, len);
+    str_parms_pair* pair = find_pair(str_parms, key);
+    if (pair)
+        return strlcpy(val, pair->value, len);
 
     return -ENOENT;
 }
@@ -297,11 +284,11 @@ int str_parms_get_int(struct str_parms *str_parms, const char *key, int *val)
 {
     char *end;
 
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)key));
-    if (!value)
+    str_parms_pair* pair = find_pair(str_parms, key);
+    if (!pair)
         return -ENOENT;
 
+    const char* value = pair->value;
     *val = (int)strtol(value, &end, 0);
     if (*value != '\0' && *end == '\0')
         return 0;
@@ -315,11 +302,11 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
     float out;
     char *end;
 
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)(key)));
-    if (!value)
+    str_parms_pair* pair = find_pair(str_parms, key);
+    if (!pair)
         return -ENOENT;
 
+    const char* value = pair->value;
     out = strtof(value, &end);
     if (*value == '\0' || *end != '\0')
         return -EINVAL;
@@ -328,42 +315,33 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
     return 0;
 }
 
-static bool combine_strings(void *key, void *value, void *context)
+char *str_parms_to_str(struct str_parms *str_parms)
 {
-    char** old_str = static_cast<char**>(context);
-    char *new_str;
-    int ret;
-
-    ret = asprintf(&new_str, "%s%s%s=%s",
-                   *old_str ? *old_str : "",
-                   *old_str ? ";" : "",
-                   (char *)key,
-                   (char *)value);
-    if (*old_str)
-        free(*old_str);
-
-    if (ret >= 0) {
-        *old_str = new_str;
-        return true;
+    size_t len = 0;
+    for (size_t i = 0; i < str_parms->count; i++) {
+        // "key=value", and a ';' or the terminating NUL.
+        len += strlen(str_parms->pairs[i].key) + 1 + strlen(str_parms->pairs[i].value) + 1;
     }
 
-    *old_str = NULL;
-    return false;
-}
-
-char *str_parms_to_str(struct str_parms *str_parms)
-{
-    char *str = NULL;
-    hashmapForEach(str_parms->map, combine_strings, &str);
-    return (str != NULL) ? str : strdup("");
-}
+    char* str = static_cast<char*>(malloc(len ? len : 1));
+    if (!str)
+        return NULL;
 
-static bool dump_entry(void* key, void* value, void* /*context*/) {
-    ALOGI("key: '%s' value: '%s'\n", (char *)key, (char *)value);
-    return true;
+    char* p = str;
+    for (size_t i = 0; i < str_parms->count; i++) {
+        if (i)
+            *p++ = ';';
+        p = stpcpy(p, str_parms->pairs[i].key);
+        *p++ = '=';
+        p = stpcpy(p, str_parms->pairs[i].value);
+    }
+    *p = '\0';
+    return str;
 }
 
 void str_parms_dump(struct str_parms *str_parms)
 {
-    hashmapForEach(str_parms->map, dump_entry, str_parms);
+    for (size_t i = 0; i < str_parms->count; i++) {
+        ALOGI("key: '%s' value: '%s'\n", str_parms->pairs[i].key, str_parms->pairs[i].value);
+    }
 }
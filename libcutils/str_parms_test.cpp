@@ -17,6 +17,8 @@
 #include <cutils/str_parms.h>
 #include <gtest/gtest.h>
 
+#include <string>
+
 static void test_str_parms_str(const char* str, const char* expected) {
     str_parms* str_parms = str_parms_create_str(str);
     str_parms_add_str(str_parms, "dude", "woah");
@@ -55,3 +57,36 @@ TEST(str_parms, put_ENOMEM) {
     ASSERT_EQ(ENOMEM, errno);
     test_str_parms_str("foo=bar;baz=", "foo=bar;baz=");
 }
+
+TEST(str_parms, many_pairs) {
+    std::string str;
+    std::string expected;
+    for (int i = 0; i < 40; i++) {
+        std::string pair = "key" + std::to_string(i) + "=" + std::to_string(i);
+        str += pair + ";";
+        if (i % 3 != 0) {
+            if (!expected.empty()) expected += ";";
+            expected += pair;
+        }
+    }
+    str_parms* str_parms = str_parms_create_str(str.c_str());
+    ASSERT_NE(nullptr, str_parms);
+    for (int i = 0; i < 40; i += 3) {
+        str_parms_del(str_parms, ("key" + std::to_string(i)).c_str());
+    }
+
+    int value;
+    ASSERT_EQ(0, str_parms_get_int(str_parms, "key38", &value));
+    EXPECT_EQ(38, value);
+    EXPECT_EQ(-ENOENT, str_parms_get_int(str_parms, "key39", &value));
+
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "key1", "one"));
+    ASSERT_EQ(0, str_parms_add_int(str_parms, "added", 7));
+    expected.replace(expected.find("key1=1"), strlen("key1=1"), "key1=one");
+    expected += ";added=7";
+
+    char* out_str = str_parms_to_str(str_parms);
+    str_parms_destroy(str_parms);
+    EXPECT_STREQ(expected.c_str(), out_str);
+    free(out_str);
+}
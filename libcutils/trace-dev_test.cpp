@@ -609,3 +609,80 @@ TEST_F(TraceDevTest, atrace_int64_body_truncated) {
   expected += android::base::StringPrintf("%.*s|17179869183", expected_len, name.c_str());
   ASSERT_STREQ(expected.c_str(), actual.c_str());
 }
+
+class TraceDevBufferedTest : public TraceDevTest {
+ protected:
+  void SetUp() override {
+    TraceDevTest::SetUp();
+    atomic_store(&atrace_buffer_delay_ns, kDelayNs);
+  }
+
+  void TearDown() override {
+    atomic_store(&atrace_buffer_delay_ns, 0);
+    if (atrace_buffer != nullptr) {
+      atrace_buffer->depth = 0;
+      atrace_flush_buffer(atrace_buffer, nullptr, 0);
+    }
+    TraceDevTest::TearDown();
+  }
+
+  std::string ReadMarker() {
+    std::string actual;
+    EXPECT_EQ(0, lseek(atrace_marker_fd, 0, SEEK_SET));
+    EXPECT_TRUE(android::base::ReadFdToString(atrace_marker_fd, &actual));
+    return actual;
+  }
+
+  static constexpr uint64_t kDelayNs = 1000000000;
+};
+
+TEST_F(TraceDevBufferedTest, slices_flushed_when_outermost_ends) {
+  atrace_begin_body("outer");
+  atrace_begin_body("inner");
+  atrace_end_body();
+  EXPECT_EQ(0, lseek(atrace_marker_fd, 0, SEEK_CUR));
+
+  atrace_end_body();
+  std::string expected = android::base::StringPrintf("B|%d|outerB|%d|innerE|%dE|%d", getpid(),
+                                                     getpid(), getpid(), getpid());
+  ASSERT_EQ(expected, ReadMarker());
+}
+
+TEST_F(TraceDevBufferedTest, other_events_flush_pending_slices) {
+  atrace_begin_body("slice");
+  atrace_int_body("counter", 7);
+  std::string expected =
+      android::base::StringPrintf("B|%d|sliceC|%d|counter|7", getpid(), getpid());
+  ASSERT_EQ(expected, ReadMarker());
+
+  atrace_end_body();
+  expected += android::base::StringPrintf("E|%d", getpid());
+  ASSERT_EQ(expected, ReadMarker());
+}
+
+TEST_F(TraceDevBufferedTest, stale_events_flushed) {
+  atrace_begin_body("outer");
+  atrace_begin_body("inner");
+  EXPECT_EQ(0, lseek(atrace_marker_fd, 0, SEEK_CUR));
+
+  atrace_buffer->first_event_ns -= kDelayNs;
+  atrace_end_body();
+  std::string expected = android::base::StringPrintf("B|%d|outerB|%d|innerE|%d", getpid(),
+                                                     getpid(), getpid());
+  ASSERT_EQ(expected, ReadMarker());
+}
+
+TEST_F(TraceDevBufferedTest, full_buffer_flushed) {
+  atrace_begin_body("outer");
+  std::string expected = android::base::StringPrintf("B|%d|outer", getpid());
+  for (int i = 0; i < ATRACE_BUFFER_MAX_EVENTS; i++) {
+    atrace_begin_body("inner");
+    atrace_end_body();
+    expected += android::base::StringPrintf("B|%d|innerE|%d", getpid(), getpid());
+  }
+  EXPECT_LT(0, lseek(atrace_marker_fd, 0, SEEK_CUR));
+
+  atrace_end_body();
+  expected += android::base::StringPrintf("E|%d", getpid());
+  ASSERT_EQ(expected, ReadMarker());
+}
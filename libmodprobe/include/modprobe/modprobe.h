@@ -64,6 +64,10 @@ class Modprobe {
     void ParseCfg(const std::string& cfg, std::function<bool(const std::vector<std::string>&)> f);
 
     std::vector<std::pair<std::string, std::string>> module_aliases_;
+    // Indices into module_aliases_: aliases without wildcards by alias, and the others by the part
+    // of the alias up to the first ':' if that has no wildcards ("usb:", "pci:", ...), or "".
+    std::unordered_map<std::string, std::vector<size_t>> module_exact_aliases_;
+    std::unordered_map<std::string, std::vector<size_t>> module_wildcard_aliases_;
     std::unordered_map<std::string, std::vector<std::string>> module_deps_;
     std::vector<std::pair<std::string, std::string>> module_pre_softdep_;
     std::vector<std::pair<std::string, std::string>> module_post_softdep_;
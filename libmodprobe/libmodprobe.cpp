@@ -21,6 +21,7 @@
 #include <sys/syscall.h>
 
 #include <algorithm>
+#include <condition_variable>
 #include <map>
 #include <set>
 #include <string>
@@ -106,8 +107,18 @@ bool Modprobe::ParseAliasCallback(const std::vector<std::string>& args) {
 
     const std::string& alias = *it++;
     const std::string& module_name = *it++;
+    size_t index = module_aliases_.size();
     this->module_aliases_.emplace_back(alias, module_name);
 
+    auto wildcard = alias.find_first_of("*?[\\");
+    if (wildcard == std::string::npos) {
+        module_exact_aliases_[alias].emplace_back(index);
+    } else {
+        auto colon = alias.find(':');
+        auto bus = colon < wildcard ? alias.substr(0, colon + 1) : "";
+        module_wildcard_aliases_[bus].emplace_back(index);
+    }
+
     return true;
 }
 
@@ -406,12 +417,25 @@ bool Modprobe::LoadWithAliases(const std::string& module_name, bool strict,
     bool module_loaded = false;
 
     // use aliases to expand list of modules to load (multiple modules
-    // may alias themselves to the requested name)
-    for (const auto& [alias, aliased_module] : module_aliases_) {
-        if (fnmatch(alias.c_str(), module_name.c_str(), 0) != 0) continue;
+    // may alias themselves to the requested name). Only the aliases that can match the name are
+    // considered, rather than running fnmatch() on every alias for every modalias uevent.
+    auto add_aliased_module = [&](size_t index, bool wildcard) {
+        const auto& [alias, aliased_module] = module_aliases_[index];
+        if (wildcard && fnmatch(alias.c_str(), module_name.c_str(), 0) != 0) return;
         LOG(VERBOSE) << "Found alias for '" << module_name << "': '" << aliased_module;
-        if (module_loaded_.count(MakeCanonical(aliased_module))) continue;
+        if (module_loaded_.count(MakeCanonical(aliased_module))) return;
         modules_to_load.emplace(aliased_module);
+    };
+    if (auto exact = module_exact_aliases_.find(module_name);
+        exact != module_exact_aliases_.end()) {
+        for (auto index : exact->second) add_aliased_module(index, false);
+    }
+    auto colon = module_name.find(':');
+    for (const auto& bus : {std::string(), module_name.substr(0, colon + 1)}) {
+        auto wildcards = module_wildcard_aliases_.find(bus);
+        if (wildcards == module_wildcard_aliases_.end()) continue;
+        for (auto index : wildcards->second) add_aliased_module(index, true);
+        if (colon == std::string::npos) break;
     }
 
     // attempt to load all modules aliased to this name
@@ -440,107 +464,137 @@ bool Modprobe::IsBlocklisted(const std::string& module_name) {
     return module_blocklist_.count(canonical_name) > 0;
 }
 
-// Another option to load kernel modules. load independent modules dependencies
-// in parallel and then update dependency list of other remaining modules,
-// repeat these steps until all modules are loaded.
+// Another option to load kernel modules. Builds the graph of the listed modules and their hard
+// dependencies, then loads each module on a pool of |num_threads| threads as soon as all of its
+// dependencies are loaded, rather than in waves of independent modules.
+// Modules with the load_sequential=1 option are loaded while no other module is being loaded.
 // Discard all blocklist.
 // Softdeps are taken care in InsmodWithDeps().
 bool Modprobe::LoadModulesParallel(int num_threads) {
-    bool ret = true;
-    std::unordered_map<std::string, std::vector<std::string>> mod_with_deps;
+    // For each module, the dependencies that haven't been loaded yet and the modules that depend
+    // on it.
+    std::unordered_map<std::string, std::unordered_set<std::string>> pending_deps;
+    std::unordered_map<std::string, std::vector<std::string>> dependents;
+    std::unordered_set<std::string> sequential;
 
-    // Get dependencies
+    std::vector<std::string> to_visit;
     for (const auto& module : module_load_) {
         // Skip blocklist modules
         if (IsBlocklisted(module)) {
             LOG(VERBOSE) << "LMP: Blocklist: Module " << module << " skipping...";
             continue;
         }
-        auto dependencies = GetDependencies(MakeCanonical(module));
-        if (dependencies.empty()) {
-            LOG(ERROR) << "LMP: Hard-dep: Module " << module
-                       << " not in .dep file";
+        auto canonical_name = MakeCanonical(module);
+        if (GetDependencies(canonical_name).empty()) {
+            LOG(ERROR) << "LMP: Hard-dep: Module " << module << " not in .dep file";
             return false;
         }
-        mod_with_deps[MakeCanonical(module)] = dependencies;
+        to_visit.emplace_back(canonical_name);
     }
+    while (!to_visit.empty()) {
+        auto module = std::move(to_visit.back());
+        to_visit.pop_back();
+        if (pending_deps.count(module)) continue;
 
-    while (!mod_with_deps.empty()) {
-        std::vector<std::thread> threads;
-        std::vector<std::string> mods_path_to_load;
-        std::mutex vector_lock;
-
-        // Find independent modules
-        for (const auto& [it_mod, it_dep] : mod_with_deps) {
-            auto itd_last = it_dep.rbegin();
-            if (itd_last == it_dep.rend())
-                continue;
-
-            auto cnd_last = MakeCanonical(*itd_last);
+        auto& deps = pending_deps[module];
+        auto dependencies = GetDependencies(module);
+        for (auto dep = std::next(dependencies.begin()); dep < dependencies.end(); ++dep) {
+            auto canonical_dep = MakeCanonical(*dep);
             // Hard-dependencies cannot be blocklisted
-            if (IsBlocklisted(cnd_last)) {
-                LOG(ERROR) << "LMP: Blocklist: Module-dep " << cnd_last
-                           << " : failed to load module " << it_mod;
+            if (IsBlocklisted(canonical_dep)) {
+                LOG(ERROR) << "LMP: Blocklist: Module-dep " << canonical_dep
+                           << " : failed to load module " << module;
                 return false;
             }
-
-            std::string str = "load_sequential=1";
-            auto it = module_options_[cnd_last].find(str);
-            if (it != std::string::npos) {
-                module_options_[cnd_last].erase(it, it + str.size());
-
-                if (!LoadWithAliases(cnd_last, true)) {
-                    return false;
-                }
-            } else {
-                if (std::find(mods_path_to_load.begin(), mods_path_to_load.end(),
-                            cnd_last) == mods_path_to_load.end()) {
-                    mods_path_to_load.emplace_back(cnd_last);
-                }
+            if (deps.emplace(canonical_dep).second) {
+                dependents[canonical_dep].emplace_back(module);
+                to_visit.emplace_back(canonical_dep);
             }
         }
 
-        // Load independent modules in parallel
-        auto thread_function = [&] {
-            std::unique_lock lk(vector_lock);
-            while (!mods_path_to_load.empty()) {
-                auto ret_load = true;
-                auto mod_to_load = std::move(mods_path_to_load.back());
-                mods_path_to_load.pop_back();
-
-                lk.unlock();
-                ret_load &= LoadWithAliases(mod_to_load, true);
-                lk.lock();
-                if (!ret_load) {
-                    ret &= ret_load;
-                }
-            }
-        };
+        auto options = module_options_.find(module);
+        if (options != module_options_.end() &&
+            options->second.find("load_sequential=1") != std::string::npos) {
+            sequential.emplace(module);
+        }
+    }
 
-        std::generate_n(std::back_inserter(threads), num_threads,
-                        [&] { return std::thread(thread_function); });
+    std::mutex lock;
+    std::condition_variable cv;
+    std::vector<std::string> ready;
+    std::vector<std::string> ready_sequential;
+    size_t remaining = pending_deps.size();
+    int in_flight = 0;
+    bool sequential_running = false;
+    bool ret = true;
 
-        // Wait for the threads.
-        for (auto& thread : threads) {
-            thread.join();
-        }
+    auto make_ready = [&](const std::string& module) {
+        (sequential.count(module) ? ready_sequential : ready).emplace_back(module);
+    };
+    for (const auto& [module, deps] : pending_deps) {
+        if (deps.empty()) make_ready(module);
+    }
+
+    auto thread_function = [&] {
+        std::unique_lock lk(lock);
+        while (true) {
+            cv.wait(lk, [&] {
+                return !ret || remaining == 0 ||
+                       (!sequential_running &&
+                        (!ready.empty() || (!ready_sequential.empty() && in_flight == 0))) ||
+                       (in_flight == 0 && ready.empty() && ready_sequential.empty());
+            });
+            if (!ret || remaining == 0) break;
+            if (in_flight == 0 && ready.empty() && ready_sequential.empty()) {
+                LOG(ERROR) << "LMP: " << remaining << " modules have circular dependencies";
+                ret = false;
+                cv.notify_all();
+                break;
+            }
 
-        if (!ret) return ret;
+            std::string module;
+            bool is_sequential = ready.empty();
+            if (is_sequential) {
+                module = std::move(ready_sequential.back());
+                ready_sequential.pop_back();
+                sequential_running = true;
 
-        std::lock_guard guard(module_loaded_lock_);
-        // Remove loaded module form mod_with_deps and soft dependencies of other modules
-        for (const auto& module_loaded : module_loaded_)
-            mod_with_deps.erase(module_loaded);
+                std::string str = "load_sequential=1";
+                auto& options = module_options_[module];
+                options.erase(options.find(str), str.size());
+            } else {
+                module = std::move(ready.back());
+                ready.pop_back();
+            }
+            in_flight++;
+
+            lk.unlock();
+            bool loaded = LoadWithAliases(module, true);
+            lk.lock();
 
-        // Remove loaded module form dependencies of other modules which are not loaded yet
-        for (const auto& module_loaded_path : module_loaded_paths_) {
-            for (auto& [mod, deps] : mod_with_deps) {
-                auto it = std::find(deps.begin(), deps.end(), module_loaded_path);
-                if (it != deps.end()) {
-                    deps.erase(it);
+            in_flight--;
+            remaining--;
+            if (is_sequential) sequential_running = false;
+            if (!loaded) {
+                ret = false;
+            } else {
+                for (const auto& dependent : dependents[module]) {
+                    auto& deps = pending_deps[dependent];
+                    deps.erase(module);
+                    if (deps.empty()) make_ready(dependent);
                 }
             }
+            cv.notify_all();
         }
+    };
+
+    std::vector<std::thread> threads;
+    std::generate_n(std::back_inserter(threads), std::max(num_threads, 1),
+                    [&] { return std::thread(thread_function); });
+
+    // Wait for the threads.
+    for (auto& thread : threads) {
+        thread.join();
     }
 
     return ret;
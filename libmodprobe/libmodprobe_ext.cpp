@@ -17,6 +17,7 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/unique_fd.h>
@@ -50,6 +51,7 @@ bool Modprobe::Insmod(const std::string& path_name, const std::string& parameter
     }
 
     LOG(INFO) << "Loading module " << path_name << " with args '" << options << "'";
+    android::base::Timer t;
     int ret = syscall(__NR_finit_module, fd.get(), options.c_str(), 0);
     if (ret != 0) {
         if (errno == EEXIST) {
@@ -63,7 +65,7 @@ bool Modprobe::Insmod(const std::string& path_name, const std::string& parameter
         return false;
     }
 
-    LOG(INFO) << "Loaded kernel module " << path_name;
+    LOG(INFO) << "Loaded kernel module " << path_name << " (took " << t << ")";
     std::lock_guard guard(module_loaded_lock_);
     module_loaded_paths_.emplace(path_name);
     module_loaded_.emplace(canonical_name);
@@ -18,6 +18,7 @@
 
 #include <android-base/file.h>
 #include <android-base/macros.h>
+#include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
 
@@ -219,3 +220,114 @@ TEST(libmodprobe, ModuleDepLineWithoutColonIsSkipped) {
     Modprobe m({dir.path});
     EXPECT_FALSE(m.LoadWithAliases("no_colon", true));
 }
+
+TEST(libmodprobe, LoadModulesParallel) {
+    const std::string modules_dep =
+            "test1.ko: test2.ko test3.ko\n"
+            "test2.ko: test3.ko\n"
+            "test3.ko:\n"
+            "test4.ko:\n"
+            "test5.ko: test3.ko\n";
+
+    const std::string modules_options = "options test4.ko load_sequential=1\n";
+
+    const std::string modules_load =
+            "test1.ko\n"
+            "test4.ko\n"
+            "test5.ko\n";
+
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_dep, dir_path + "/modules.dep", 0600,
+                                                 getuid(), getgid()));
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_options, dir_path + "/modules.options",
+                                                 0600, getuid(), getgid()));
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_load, dir_path + "/modules.load", 0600,
+                                                 getuid(), getgid()));
+
+    kernel_cmdline = "";
+    test_modules = {
+            dir_path + "/test1.ko", dir_path + "/test2.ko", dir_path + "/test3.ko",
+            dir_path + "/test4.ko", dir_path + "/test5.ko",
+    };
+    modules_loaded.clear();
+
+    // The fake Insmod() isn't thread safe.
+    Modprobe m({dir.path});
+    EXPECT_TRUE(m.LoadModulesParallel(1));
+
+    auto position = [&](const std::string& module) {
+        return std::find_if(modules_loaded.begin(), modules_loaded.end(),
+                            [&](const auto& loaded) {
+                                return android::base::StartsWith(loaded, dir_path + module);
+                            }) -
+               modules_loaded.begin();
+    };
+    ASSERT_EQ(5u, modules_loaded.size());
+    EXPECT_LT(position("/test3.ko"), position("/test2.ko"));
+    EXPECT_LT(position("/test2.ko"), position("/test1.ko"));
+    EXPECT_LT(position("/test3.ko"), position("/test5.ko"));
+    for (const auto& loaded : modules_loaded) {
+        EXPECT_EQ(std::string::npos, loaded.find("load_sequential")) << loaded;
+    }
+}
+
+TEST(libmodprobe, LoadModulesParallelMissingDependencies) {
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    ASSERT_TRUE(android::base::WriteStringToFile("test1.ko:\n", dir_path + "/modules.dep", 0600,
+                                                 getuid(), getgid()));
+    ASSERT_TRUE(android::base::WriteStringToFile("test1.ko\ntest2.ko\n",
+                                                 dir_path + "/modules.load", 0600, getuid(),
+                                                 getgid()));
+
+    kernel_cmdline = "";
+    test_modules = {dir_path + "/test1.ko", dir_path + "/test2.ko"};
+    modules_loaded.clear();
+
+    // test2.ko isn't in modules.dep, so nothing is loaded.
+    Modprobe m({dir.path});
+    EXPECT_FALSE(m.LoadModulesParallel(2));
+    EXPECT_TRUE(modules_loaded.empty());
+}
+
+TEST(libmodprobe, WildcardAliases) {
+    const std::string modules_dep =
+            "test1.ko:\n"
+            "test2.ko:\n"
+            "test3.ko:\n"
+            "test4.ko:\n";
+
+    const std::string modules_alias =
+            "alias usb:v1234p* test1\n"
+            "alias *:v1234p5678 test2\n"
+            "alias pci:v1234* test3\n"
+            "alias usb:v1234p5678 test4\n";
+
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_dep, dir_path + "/modules.dep", 0600,
+                                                 getuid(), getgid()));
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_alias, dir_path + "/modules.alias", 0600,
+                                                 getuid(), getgid()));
+
+    kernel_cmdline = "";
+    test_modules = {
+            dir_path + "/test1.ko",
+            dir_path + "/test2.ko",
+            dir_path + "/test3.ko",
+            dir_path + "/test4.ko",
+    };
+    modules_loaded.clear();
+
+    Modprobe m({dir.path});
+    EXPECT_TRUE(m.LoadWithAliases("usb:v1234p5678", true));
+
+    std::sort(modules_loaded.begin(), modules_loaded.end());
+    std::vector<std::string> expected_modules_loaded = {
+            dir_path + "/test1.ko",
+            dir_path + "/test2.ko",
+            dir_path + "/test4.ko",
+    };
+    EXPECT_EQ(expected_modules_loaded, modules_loaded);
+}
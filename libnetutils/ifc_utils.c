@@ -249,31 +249,113 @@ int ifc_set_addr(const char *name, in_addr_t addr)
 }
 
 /*
- * Adds or deletes an IP address on an interface.
+ * Netlink batching.
  *
- * Action is one of:
- * - RTM_NEWADDR (to add a new address)
- * - RTM_DELADDR (to delete an existing address)
+ * A batch collects rtnetlink requests and sends them on a netlink socket
+ * kept open for the life of the process, as few sendmsg() calls as
+ * possible, then collects all the acknowledgements. Configuring many
+ * addresses and routes then costs a couple of round trips rather than one
+ * per request.
+ */
+
+// Requests are sent in chunks of at most this size, so that the kernel can
+// queue all of a chunk's acknowledgements without running out of buffer.
+#define IFC_BATCH_CHUNK_SIZE 16384
+
+// Large enough for any request built by this file.
+#define IFC_BATCH_MAX_MSG 256
+
+struct ifc_batch {
+    char *buf;
+    size_t len;
+    size_t cap;
+    // Offset of each request in |buf|, and whether EEXIST counts as success.
+    size_t *offsets;
+    bool *eexist_ok;
+    size_t count;
+};
+
+static int ifc_nl_sock = -1;
+static uint32_t ifc_nl_seq = 0;
+static pthread_mutex_t ifc_nl_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct ifc_batch *ifc_batch_begin(void) {
+    return calloc(1, sizeof(struct ifc_batch));
+}
+
+void ifc_batch_abort(struct ifc_batch *batch) {
+    if (batch == NULL) {
+        return;
+    }
+    free(batch->buf);
+    free(batch->offsets);
+    free(batch->eexist_ok);
+    free(batch);
+}
+
+// Reserves room for a request of at most IFC_BATCH_MAX_MSG bytes and
+// returns it zeroed, or NULL if out of memory. The caller sets nlmsg_len.
+static struct nlmsghdr *ifc_batch_reserve(struct ifc_batch *batch, bool eexist_ok) {
+    if (batch->len + IFC_BATCH_MAX_MSG > batch->cap) {
+        size_t cap = batch->cap ? batch->cap * 2 : 4096;
+        char *buf = realloc(batch->buf, cap);
+        if (buf == NULL) {
+            return NULL;
+        }
+        batch->buf = buf;
+        batch->cap = cap;
+    }
+    size_t *offsets = realloc(batch->offsets, (batch->count + 1) * sizeof(*offsets));
+    if (offsets == NULL) {
+        return NULL;
+    }
+    batch->offsets = offsets;
+    bool *eexist = realloc(batch->eexist_ok, (batch->count + 1) * sizeof(*eexist));
+    if (eexist == NULL) {
+        return NULL;
+    }
+    batch->eexist_ok = eexist;
+
+    batch->offsets[batch->count] = batch->len;
+    batch->eexist_ok[batch->count] = eexist_ok;
+    struct nlmsghdr *nh = (struct nlmsghdr *) (batch->buf + batch->len);
+    memset(nh, 0, IFC_BATCH_MAX_MSG);
+    return nh;
+}
+
+// Appends an attribute to |nh|, which must have room for it.
+static void ifc_add_rtattr(struct nlmsghdr *nh, int type, const void *data, size_t len) {
+    struct rtattr *rta = (struct rtattr *) (((char *) nh) + NLMSG_ALIGN(nh->nlmsg_len));
+    rta->rta_type = type;
+    rta->rta_len = RTA_LENGTH(len);
+    memcpy(RTA_DATA(rta), data, len);
+    nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_LENGTH(len);
+}
+
+// Returns the offset just past request |index| in |batch|.
+static size_t ifc_batch_msg_end(const struct ifc_batch *batch, size_t index) {
+    return (index + 1 < batch->count) ? batch->offsets[index + 1] : batch->len;
+}
+
+static void ifc_batch_commit_msg(struct ifc_batch *batch, struct nlmsghdr *nh) {
+    batch->len += NLMSG_ALIGN(nh->nlmsg_len);
+    batch->count++;
+}
+
+/*
+ * Queues an RTM_NEWADDR or RTM_DELADDR request, as ifc_act_on_address()
+ * would send.
  *
  * Returns zero on success and negative errno on failure.
  */
-int ifc_act_on_address(int action, const char* name, const char* address, int prefixlen,
-                       bool nodad) {
-    int ifindex, s, len, ret;
+int ifc_batch_act_on_address(struct ifc_batch *batch, int action, const char *name,
+                             const char *address, int prefixlen, bool nodad) {
+    int ifindex, ret;
     struct sockaddr_storage ss;
-    int saved_errno;
     void *addr;
     size_t addrlen;
-    struct {
-        struct nlmsghdr n;
-        struct ifaddrmsg r;
-        // Allow for IPv4 or IPv6 address, headers, IPv4 broadcast address and padding.
-        char attrbuf[NLMSG_ALIGN(sizeof(struct rtattr)) + NLMSG_ALIGN(INET6_ADDRLEN) +
-                     NLMSG_ALIGN(sizeof(struct rtattr)) + NLMSG_ALIGN(INET_ADDRLEN)];
-    } req;
-    struct rtattr *rta;
     struct nlmsghdr *nh;
-    struct nlmsgerr *err;
+    struct ifaddrmsg *ifa;
 
     // Get interface ID.
     ifindex = if_nametoindex(name);
@@ -300,66 +382,261 @@ int ifc_act_on_address(int action, const char* name, const char* address, int pr
         return -EAFNOSUPPORT;
     }
 
-    // Fill in netlink structures.
-    memset(&req, 0, sizeof(req));
+    nh = ifc_batch_reserve(batch, false);
+    if (nh == NULL) {
+        return -ENOMEM;
+    }
 
     // Netlink message header.
-    req.n.nlmsg_len = NLMSG_LENGTH(sizeof(req.r));
-    req.n.nlmsg_type = action;
-    req.n.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
-    req.n.nlmsg_pid = getpid();
+    nh->nlmsg_len = NLMSG_LENGTH(sizeof(*ifa));
+    nh->nlmsg_type = action;
+    nh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
 
     // Interface address message header.
-    req.r.ifa_family = ss.ss_family;
-    req.r.ifa_flags = nodad ? IFA_F_NODAD : 0;
-    req.r.ifa_prefixlen = prefixlen;
-    req.r.ifa_index = ifindex;
+    ifa = NLMSG_DATA(nh);
+    ifa->ifa_family = ss.ss_family;
+    ifa->ifa_flags = nodad ? IFA_F_NODAD : 0;
+    ifa->ifa_prefixlen = prefixlen;
+    ifa->ifa_index = ifindex;
 
     // Routing attribute. Contains the actual IP address.
-    rta = (struct rtattr *) (((char *) &req) + NLMSG_ALIGN(req.n.nlmsg_len));
-    rta->rta_type = IFA_LOCAL;
-    rta->rta_len = RTA_LENGTH(addrlen);
-    req.n.nlmsg_len = NLMSG_ALIGN(req.n.nlmsg_len) + RTA_LENGTH(addrlen);
-    memcpy(RTA_DATA(rta), addr, addrlen);
+    ifc_add_rtattr(nh, IFA_LOCAL, addr, addrlen);
 
     // Add an explicit IFA_BROADCAST for IPv4 RTM_NEWADDRs.
     if (ss.ss_family == AF_INET && action == RTM_NEWADDR) {
-        rta = (struct rtattr *) (((char *) &req) + NLMSG_ALIGN(req.n.nlmsg_len));
-        rta->rta_type = IFA_BROADCAST;
-        rta->rta_len = RTA_LENGTH(addrlen);
-        req.n.nlmsg_len = NLMSG_ALIGN(req.n.nlmsg_len) + RTA_LENGTH(addrlen);
         ((struct in_addr *)addr)->s_addr |= htonl((1<<(32-prefixlen))-1);
-        memcpy(RTA_DATA(rta), addr, addrlen);
+        ifc_add_rtattr(nh, IFA_BROADCAST, addr, addrlen);
+    }
+
+    ifc_batch_commit_msg(batch, nh);
+    return 0;
+}
+
+/*
+ * Queues an RTM_NEWROUTE or RTM_DELROUTE request for an IPv4 route in the
+ * main table, the netlink equivalent of ifc_act_on_ipv4_route() with
+ * SIOCADDRT or SIOCDELRT. Adding a route which already exists succeeds.
+ *
+ * Returns zero on success and negative errno on failure.
+ */
+int ifc_batch_act_on_ipv4_route(struct ifc_batch *batch, int action, const char *ifname,
+                                struct in_addr dst, int prefix_length, struct in_addr gw) {
+    int ifindex;
+    uint32_t oif;
+    struct nlmsghdr *nh;
+    struct rtmsg *rtm;
+
+    if (action != RTM_NEWROUTE && action != RTM_DELROUTE) {
+        return -EINVAL;
+    }
+    if (prefix_length < 0 || prefix_length > 32) {
+        return -EINVAL;
     }
 
-    s = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
-    if (s < 0) {
+    ifindex = if_nametoindex(ifname);
+    if (ifindex == 0) {
         return -errno;
     }
 
-    if (send(s, &req, req.n.nlmsg_len, 0) < 0) {
-        saved_errno = errno;
-        close(s);
-        return -saved_errno;
+    nh = ifc_batch_reserve(batch, action == RTM_NEWROUTE);
+    if (nh == NULL) {
+        return -ENOMEM;
+    }
+
+    nh->nlmsg_len = NLMSG_LENGTH(sizeof(*rtm));
+    nh->nlmsg_type = action;
+    nh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    if (action == RTM_NEWROUTE) {
+        nh->nlmsg_flags |= NLM_F_CREATE | NLM_F_EXCL;
+    }
+
+    rtm = NLMSG_DATA(nh);
+    rtm->rtm_family = AF_INET;
+    rtm->rtm_dst_len = prefix_length;
+    rtm->rtm_table = RT_TABLE_MAIN;
+    if (action == RTM_NEWROUTE) {
+        rtm->rtm_protocol = RTPROT_BOOT;
+        rtm->rtm_scope = gw.s_addr ? RT_SCOPE_UNIVERSE : RT_SCOPE_LINK;
+        rtm->rtm_type = RTN_UNICAST;
+    } else {
+        rtm->rtm_scope = RT_SCOPE_NOWHERE;
+    }
+
+    if (prefix_length > 0) {
+        ifc_add_rtattr(nh, RTA_DST, &dst, INET_ADDRLEN);
+    }
+    if (gw.s_addr != 0) {
+        ifc_add_rtattr(nh, RTA_GATEWAY, &gw, INET_ADDRLEN);
+    }
+    oif = ifindex;
+    ifc_add_rtattr(nh, RTA_OIF, &oif, sizeof(oif));
+
+    ifc_batch_commit_msg(batch, nh);
+    return 0;
+}
+
+// Called with ifc_nl_mutex held.
+static int ifc_nl_open(void) {
+    if (ifc_nl_sock >= 0) {
+        return 0;
+    }
+    ifc_nl_sock = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (ifc_nl_sock < 0) {
+        return -errno;
+    }
+    // Successful requests are acknowledged with just their header.
+    int on = 1;
+    setsockopt(ifc_nl_sock, SOL_NETLINK, NETLINK_CAP_ACK, &on, sizeof(on));
+    return 0;
+}
+
+// Called with ifc_nl_mutex held. Drops the socket after an error, so that
+// stale acknowledgements are not read by the next batch.
+static void ifc_nl_reset(void) {
+    if (ifc_nl_sock >= 0) {
+        close(ifc_nl_sock);
+        ifc_nl_sock = -1;
+    }
+}
+
+/*
+ * Sends requests [first, last) of |batch|, which were numbered from
+ * |seq_base|, and waits for their acknowledgements. Called with
+ * ifc_nl_mutex held.
+ */
+static int ifc_batch_send_chunk(struct ifc_batch *batch, size_t first, size_t last,
+                                uint32_t seq_base, int *results) {
+    size_t start = batch->offsets[first];
+    size_t end = ifc_batch_msg_end(batch, last - 1);
+    struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+    struct iovec iov = {.iov_base = batch->buf + start, .iov_len = end - start};
+    struct msghdr msg = {
+            .msg_name = &kernel,
+            .msg_namelen = sizeof(kernel),
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+    };
+    size_t pending = last - first;
+    char buf[8192];
+
+    if (TEMP_FAILURE_RETRY(sendmsg(ifc_nl_sock, &msg, 0)) < 0) {
+        return -errno;
     }
 
-    char buf[NLMSG_ALIGN(sizeof(struct nlmsgerr)) + sizeof(req)];
-    len = recv(s, buf, sizeof(buf), 0);
-    saved_errno = errno;
-    close(s);
-    if (len < 0) {
-        return -saved_errno;
+    while (pending) {
+        ssize_t len = TEMP_FAILURE_RETRY(recv(ifc_nl_sock, buf, sizeof(buf), 0));
+        if (len < 0) {
+            return -errno;
+        }
+        for (struct nlmsghdr *nh = (struct nlmsghdr *) buf; NLMSG_OK(nh, (size_t) len);
+             nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type != NLMSG_ERROR) {
+                continue;
+            }
+            uint32_t index = nh->nlmsg_seq - seq_base;
+            if (index < first || index >= last) {
+                continue;
+            }
+            struct nlmsgerr *err = NLMSG_DATA(nh);
+            int error = err->error;
+            if (error == -EEXIST && batch->eexist_ok[index]) {
+                error = 0;
+            }
+            results[index] = error;
+            pending--;
+        }
     }
+    return 0;
+}
+
+/*
+ * Sends every request in |batch| and waits for all of them to be
+ * acknowledged, then frees |batch|. If |results| is not NULL, it receives
+ * the status of each request (zero or negative errno), in the order they
+ * were queued.
+ *
+ * Returns zero if all requests were sent and acknowledged (even if some of
+ * them failed), and negative errno otherwise. In the latter case, the
+ * contents of |results| are undefined.
+ */
+int ifc_batch_commit(struct ifc_batch *batch, int *results) {
+    int ret = 0;
+    int *status;
+    size_t first, last;
+    uint32_t seq_base;
 
-    // Parse the acknowledgement to find the return code.
-    nh = (struct nlmsghdr *) buf;
-    if (!NLMSG_OK(nh, (unsigned) len) || nh->nlmsg_type != NLMSG_ERROR) {
+    if (batch == NULL) {
         return -EINVAL;
     }
-    err = NLMSG_DATA(nh);
+    if (batch->count == 0) {
+        ifc_batch_abort(batch);
+        return 0;
+    }
+
+    status = calloc(batch->count, sizeof(*status));
+    if (status == NULL) {
+        ifc_batch_abort(batch);
+        return -ENOMEM;
+    }
+
+    pthread_mutex_lock(&ifc_nl_mutex);
+    ret = ifc_nl_open();
+    if (ret == 0) {
+        seq_base = ifc_nl_seq;
+        ifc_nl_seq += batch->count;
+        for (size_t i = 0; i < batch->count; i++) {
+            struct nlmsghdr *nh = (struct nlmsghdr *) (batch->buf + batch->offsets[i]);
+            nh->nlmsg_seq = seq_base + i;
+        }
+
+        for (first = 0; first < batch->count && ret == 0; first = last) {
+            // Always send at least one request, then as many more as fit.
+            last = first + 1;
+            while (last < batch->count &&
+                   ifc_batch_msg_end(batch, last) - batch->offsets[first] <= IFC_BATCH_CHUNK_SIZE) {
+                last++;
+            }
+            ret = ifc_batch_send_chunk(batch, first, last, seq_base, status);
+        }
+        if (ret) {
+            ifc_nl_reset();
+        }
+    }
+    pthread_mutex_unlock(&ifc_nl_mutex);
+
+    if (ret == 0 && results != NULL) {
+        memcpy(results, status, batch->count * sizeof(*status));
+    }
+    free(status);
+    ifc_batch_abort(batch);
+    return ret;
+}
 
-    // Return code is negative errno.
-    return err->error;
+/*
+ * Adds or deletes an IP address on an interface.
+ *
+ * Action is one of:
+ * - RTM_NEWADDR (to add a new address)
+ * - RTM_DELADDR (to delete an existing address)
+ *
+ * Returns zero on success and negative errno on failure.
+ */
+int ifc_act_on_address(int action, const char* name, const char* address, int prefixlen,
+                       bool nodad) {
+    struct ifc_batch* batch;
+    int ret, result;
+
+    batch = ifc_batch_begin();
+    if (batch == NULL) {
+        return -ENOMEM;
+    }
+    ret = ifc_batch_act_on_address(batch, action, name, address, prefixlen, nodad);
+    if (ret) {
+        ifc_batch_abort(batch);
+        return ret;
+    }
+    ret = ifc_batch_commit(batch, &result);
+    return ret ? ret : result;
 }
 
 // Pass bitwise complement of prefix length to disable DAD, ie. use ~64 instead of 64.
@@ -385,11 +662,22 @@ int ifc_clear_ipv6_addresses(const char *name) {
     unsigned int prefixlen;
     int lasterror = 0, i, j, ret;
     char ifname[64];  // Currently, IFNAMSIZ = 16.
+    char (*addrs)[INET6_ADDRSTRLEN] = NULL;
+    int *results = NULL;
+    size_t count = 0;
+    struct ifc_batch *batch;
     FILE *f = fopen("/proc/net/if_inet6", "r");
     if (!f) {
         return -errno;
     }
 
+    // All the deletions are sent as a single batch.
+    batch = ifc_batch_begin();
+    if (batch == NULL) {
+        fclose(f);
+        return -ENOMEM;
+    }
+
     // Format:
     // 20010db8000a0001fc446aa4b5b347ed 03 40 00 01    wlan0
     while (fscanf(f, "%32s %*02x %02x %*02x %*02x %63s\n",
@@ -414,15 +702,52 @@ int ifc_clear_ipv6_addresses(const char *name) {
             continue;
         }
 
-        ret = ifc_del_address(ifname, addrstr, prefixlen);
+        ret = ifc_batch_act_on_address(batch, RTM_DELADDR, ifname, addrstr, prefixlen, false);
         if (ret) {
             ALOGE("Deleting address %s/%d on %s: %s", addrstr, prefixlen, ifname,
                  strerror(-ret));
             lasterror = ret;
+            continue;
         }
-    }
 
+        // Remember the address, to report which deletions failed.
+        char (*new_addrs)[INET6_ADDRSTRLEN] = realloc(addrs, (count + 1) * sizeof(*addrs));
+        if (new_addrs == NULL) {
+            lasterror = -ENOMEM;
+            break;
+        }
+        addrs = new_addrs;
+        snprintf(addrs[count++], sizeof(*addrs), "%s", addrstr);
+    }
     fclose(f);
+
+    if (lasterror == -ENOMEM) {
+        ifc_batch_abort(batch);
+        free(addrs);
+        return lasterror;
+    }
+
+    results = calloc(count ? count : 1, sizeof(*results));
+    if (results == NULL) {
+        ifc_batch_abort(batch);
+        free(addrs);
+        return -ENOMEM;
+    }
+    ret = ifc_batch_commit(batch, results);
+    if (ret) {
+        ALOGE("Deleting addresses on %s: %s", name, strerror(-ret));
+        lasterror = ret;
+    } else {
+        for (size_t k = 0; k < count; k++) {
+            if (results[k]) {
+                ALOGE("Deleting address %s on %s: %s", addrs[k], name, strerror(-results[k]));
+                lasterror = results[k];
+            }
+        }
+    }
+
+    free(results);
+    free(addrs);
     return lasterror;
 }
 
@@ -49,6 +49,22 @@ extern int ifc_add_address(const char *name, const char *address,
                            int prefixlen);
 extern int ifc_del_address(const char *name, const char *address,
                            int prefixlen);
+
+/*
+ * Batches of rtnetlink requests, sent together on a persistent socket.
+ * Queue requests with ifc_batch_act_on_*(), then send them with
+ * ifc_batch_commit() or discard them with ifc_batch_abort(); both free the
+ * batch.
+ */
+struct ifc_batch;
+extern struct ifc_batch *ifc_batch_begin(void);
+extern int ifc_batch_act_on_address(struct ifc_batch *batch, int action, const char *name,
+                                    const char *address, int prefixlen, bool nodad);
+extern int ifc_batch_act_on_ipv4_route(struct ifc_batch *batch, int action, const char *ifname,
+                                       struct in_addr dst, int prefix_length, struct in_addr gw);
+extern int ifc_batch_commit(struct ifc_batch *batch, int *results);
+extern void ifc_batch_abort(struct ifc_batch *batch);
+
 extern int ifc_set_prefixLength(const char *name, int prefixLength);
 extern int ifc_set_hwaddr(const char *name, const void *ptr);
 extern int ifc_clear_addresses(const char *name);
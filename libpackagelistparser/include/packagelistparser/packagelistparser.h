@@ -81,4 +81,65 @@ bool packagelist_parse_file(const char* path, bool (*callback)(pkg_info* info, v
 /** Frees the given `pkg_info`. */
 void packagelist_free(pkg_info* info);
 
+/**
+ * Looks up the first package called `name` in the given package list, or the system's default one
+ * if `path` is NULL, without parsing or indexing the other lines.
+ * Use this for a single lookup; packagelist_open() pays off once there are several.
+ * Returns a `pkg_info` the caller should free with packagelist_free(), or NULL with errno set to
+ * ENOENT if there is no such package or EINVAL if its line is malformed.
+ */
+pkg_info* packagelist_find_package(const char* path, const char* name);
+
+/** A field of a `pkg_view`. Not NUL-terminated. */
+typedef struct pkg_str {
+  const char* data;
+  size_t len;
+} pkg_str;
+
+/**
+ * A package as returned by the lookup functions below.
+ * The strings point into the mapped package list and stay valid until packagelist_close().
+ */
+typedef struct pkg_view {
+  pkg_str name;
+  uid_t uid;
+  bool debuggable;
+  pkg_str data_dir;
+  pkg_str seinfo;
+
+  /** Comma-separated gids, or "none". See packagelist_view_gids(). */
+  pkg_str gids;
+
+  bool profileable_from_shell;
+  long version_code;
+} pkg_view;
+
+/** A mapped package list with indexes by name and by uid. */
+typedef struct packagelist packagelist;
+
+/**
+ * Maps the given package list, or the system's default one if `path` is NULL, and indexes it.
+ * Returns NULL on failure.
+ * Lookups don't allocate, so callers that need several packages should keep this open.
+ */
+packagelist* packagelist_open(const char* path);
+
+/** Unmaps a package list returned by packagelist_open(). */
+void packagelist_close(packagelist* list);
+
+/** Finds the package called `name`. Returns false if there is none or its line is malformed. */
+bool packagelist_find_by_name(const packagelist* list, const char* name, pkg_view* view);
+
+/**
+ * Finds the first package in the file with the given uid.
+ * Returns false if there is none or its line is malformed.
+ */
+bool packagelist_find_by_uid(const packagelist* list, uid_t uid, pkg_view* view);
+
+/**
+ * Parses the gids of `view` into `gids`, storing at most `max` of them.
+ * Returns the total number of gids, which may be more than `max`, or -1 if they are malformed.
+ */
+ssize_t packagelist_view_gids(const pkg_view* view, gid_t* gids, size_t max);
+
 __END_DECLS
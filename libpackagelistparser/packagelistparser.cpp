@@ -19,12 +19,22 @@
 #include <packagelistparser/packagelistparser.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <charconv>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include <log/log.h>
 
@@ -64,7 +74,7 @@ static bool parse_gids(const char* path, size_t line_number, const char* gids, p
 
 static bool parse_line(const char* path, size_t line_number, const char* line, pkg_info* info) {
   int debuggable;
-  char* gid_list;
+  char* gid_list = nullptr;
   int profileable_from_shell = 0;
   int fields =
       sscanf(line, "%ms %u %d %ms %ms %ms %d %ld", &info->name, &info->uid,
@@ -117,8 +127,10 @@ bool packagelist_parse_file(const char* path, bool (*callback)(pkg_info*, void*)
   return true;
 }
 
+static const char kPackagesList[] = "/data/system/packages.list";
+
 bool packagelist_parse(bool (*callback)(pkg_info*, void*), void* user_data) {
-  return packagelist_parse_file("/data/system/packages.list", callback, user_data);
+  return packagelist_parse_file(kPackagesList, callback, user_data);
 }
 
 void packagelist_free(pkg_info* info) {
@@ -130,3 +142,250 @@ void packagelist_free(pkg_info* info) {
   delete[] info->gids.gids;
   free(info);
 }
+
+namespace {
+
+struct line_entry {
+  size_t offset;
+  size_t length;
+  size_t name_length;
+  uid_t uid;
+};
+
+// Returns the next whitespace-separated field of [*p, end), like sscanf's %s.
+std::string_view next_field(const char** p, const char* end) {
+  const char* begin = *p;
+  while (begin < end && isspace(*begin)) ++begin;
+  const char* field_end = begin;
+  while (field_end < end && !isspace(*field_end)) ++field_end;
+  *p = field_end;
+  return std::string_view(begin, field_end - begin);
+}
+
+template <typename T>
+bool parse_number(std::string_view field, T* value) {
+  if (field.empty()) return false;
+  auto [ptr, ec] = std::from_chars(field.data(), field.data() + field.size(), *value);
+  return ec == std::errc() && ptr == field.data() + field.size();
+}
+
+// Like sscanf's %u, which the line parser above uses, accept a negative uid and wrap it.
+bool parse_uid(std::string_view field, uid_t* uid) {
+  if (!field.empty() && field[0] == '-') {
+    long value;
+    if (!parse_number(field, &value)) return false;
+    *uid = static_cast<uid_t>(value);
+    return true;
+  }
+  return parse_number(field, uid);
+}
+
+pkg_str to_pkg_str(std::string_view field) {
+  return {field.data(), field.size()};
+}
+
+}  // namespace
+
+struct packagelist {
+  const char* data;
+  size_t size;
+  // Sorted by name.
+  std::vector<line_entry> by_name;
+  // Indexes into by_name, sorted by uid and then by position in the file.
+  std::vector<uint32_t> by_uid;
+
+  std::string_view name_of(const line_entry& entry) const {
+    return std::string_view(data + entry.offset, entry.name_length);
+  }
+};
+
+// Maps `path` read-only. An empty file maps to a null `data` with zero `size`.
+static bool map_file(const char* path, const char** data, size_t* size) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    ALOGE("couldn't open '%s': %s", path, strerror(errno));
+    return false;
+  }
+
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    ALOGE("couldn't stat '%s': %s", path, strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  *data = nullptr;
+  *size = sb.st_size;
+  if (*size > 0) {
+    void* mapped = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+      ALOGE("couldn't mmap '%s': %s", path, strerror(errno));
+      close(fd);
+      return false;
+    }
+    *data = static_cast<const char*>(mapped);
+  }
+  close(fd);
+  return true;
+}
+
+packagelist* packagelist_open(const char* path) {
+  if (!path) path = kPackagesList;
+
+  std::unique_ptr<packagelist> list(new packagelist{});
+  if (!map_file(path, &list->data, &list->size)) return nullptr;
+
+  // One pass over the file pulls out just the name and uid of each line.
+  const char* end = list->data + list->size;
+  size_t line_number = 0;
+  for (const char* line = list->data; line < end;) {
+    ++line_number;
+    const char* line_end = static_cast<const char*>(memchr(line, '\n', end - line));
+    if (!line_end) line_end = end;
+
+    const char* p = line;
+    std::string_view name = next_field(&p, line_end);
+    line_entry entry = {};
+    if (!name.empty() && parse_uid(next_field(&p, line_end), &entry.uid)) {
+      entry.offset = name.data() - list->data;
+      entry.length = line_end - name.data();
+      entry.name_length = name.size();
+      list->by_name.push_back(entry);
+    } else if (line_end != line) {
+      ALOGE("%s:%zu: couldn't parse name and uid", path, line_number);
+    }
+
+    line = line_end + 1;
+  }
+
+  std::stable_sort(list->by_name.begin(), list->by_name.end(),
+                   [&list](const line_entry& a, const line_entry& b) {
+                     return list->name_of(a) < list->name_of(b);
+                   });
+
+  list->by_uid.resize(list->by_name.size());
+  for (size_t i = 0; i < list->by_uid.size(); ++i) list->by_uid[i] = i;
+  std::sort(list->by_uid.begin(), list->by_uid.end(), [&list](uint32_t a, uint32_t b) {
+    const line_entry& ea = list->by_name[a];
+    const line_entry& eb = list->by_name[b];
+    return ea.uid != eb.uid ? ea.uid < eb.uid : ea.offset < eb.offset;
+  });
+
+  return list.release();
+}
+
+void packagelist_close(packagelist* list) {
+  if (!list) return;
+
+  if (list->size > 0) munmap(const_cast<char*>(list->data), list->size);
+  delete list;
+}
+
+static bool parse_view(const packagelist* list, const line_entry& entry, pkg_view* view) {
+  const char* p = list->data + entry.offset;
+  const char* end = p + entry.length;
+
+  *view = {};
+  view->name = to_pkg_str(next_field(&p, end));
+  view->uid = entry.uid;
+  next_field(&p, end);
+
+  int debuggable;
+  if (!parse_number(next_field(&p, end), &debuggable)) return false;
+  view->debuggable = debuggable;
+
+  view->data_dir = to_pkg_str(next_field(&p, end));
+  view->seinfo = to_pkg_str(next_field(&p, end));
+  view->gids = to_pkg_str(next_field(&p, end));
+  if (view->gids.len == 0) {
+    ALOGE("too few fields in line for %.*s", static_cast<int>(view->name.len), view->name.data);
+    return false;
+  }
+
+  // The final fields are optional (and not usually present).
+  int profileable_from_shell = 0;
+  std::string_view field = next_field(&p, end);
+  if (!field.empty()) {
+    if (!parse_number(field, &profileable_from_shell)) return false;
+    field = next_field(&p, end);
+    if (!field.empty() && !parse_number(field, &view->version_code)) return false;
+  }
+  view->profileable_from_shell = profileable_from_shell;
+
+  return true;
+}
+
+bool packagelist_find_by_name(const packagelist* list, const char* name, pkg_view* view) {
+  std::string_view key(name);
+  auto it = std::lower_bound(
+      list->by_name.begin(), list->by_name.end(), key,
+      [list](const line_entry& entry, std::string_view key) { return list->name_of(entry) < key; });
+  if (it == list->by_name.end() || list->name_of(*it) != key) return false;
+
+  return parse_view(list, *it, view);
+}
+
+bool packagelist_find_by_uid(const packagelist* list, uid_t uid, pkg_view* view) {
+  auto it = std::lower_bound(
+      list->by_uid.begin(), list->by_uid.end(), uid,
+      [list](uint32_t index, uid_t uid) { return list->by_name[index].uid < uid; });
+  if (it == list->by_uid.end() || list->by_name[*it].uid != uid) return false;
+
+  return parse_view(list, list->by_name[*it], view);
+}
+
+pkg_info* packagelist_find_package(const char* path, const char* name) {
+  if (!path) path = kPackagesList;
+
+  const char* data;
+  size_t size;
+  if (!map_file(path, &data, &size)) return nullptr;
+
+  // Only the name of each line is looked at until the package turns up.
+  std::string_view key(name);
+  const char* end = data + size;
+  size_t line_number = 0;
+  pkg_info* result = nullptr;
+  errno = ENOENT;
+  for (const char* line = data; line < end;) {
+    ++line_number;
+    const char* line_end = static_cast<const char*>(memchr(line, '\n', end - line));
+    if (!line_end) line_end = end;
+
+    const char* p = line;
+    if (next_field(&p, line_end) == key) {
+      std::unique_ptr<pkg_info, decltype(&packagelist_free)> info(
+          static_cast<pkg_info*>(calloc(1, sizeof(pkg_info))), &packagelist_free);
+      std::string text(line, line_end);
+      if (info && parse_line(path, line_number, text.c_str(), info.get())) {
+        result = info.release();
+      } else {
+        errno = EINVAL;
+      }
+      break;
+    }
+
+    line = line_end + 1;
+  }
+
+  if (size > 0) munmap(const_cast<char*>(data), size);
+  return result;
+}
+
+ssize_t packagelist_view_gids(const pkg_view* view, gid_t* gids, size_t max) {
+  std::string_view field(view->gids.data, view->gids.len);
+  if (field == "none") return 0;
+
+  ssize_t count = 0;
+  while (true) {
+    size_t comma = field.find(',');
+    unsigned long gid;
+    if (!parse_number(field.substr(0, comma), &gid) || gid > GID_MAX) return -1;
+
+    if (static_cast<size_t>(count) < max) gids[count] = gid;
+    ++count;
+
+    if (comma == std::string_view::npos) return count;
+    field.remove_prefix(comma + 1);
+  }
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <packagelistparser/packagelistparser.h>
+
+#include <string.h>
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+
+#include <benchmark/benchmark.h>
+
+// Roughly the size of a packages.list on a device with many apps installed.
+static constexpr int kPackages = 1000;
+
+// Writes a package list and returns the name of its last package, which is what a lookup for
+// a recently installed app under development has to get through.
+static std::string WritePackageList(const TemporaryFile& tf) {
+  std::string contents;
+  for (int i = 0; i < kPackages; ++i) {
+    contents += android::base::StringPrintf(
+        "com.example.app%d %d 0 /data/user/0/com.example.app%d "
+        "default:targetSdkVersion=34 3003,3002 0 %d\n",
+        i, 10000 + i, i, i);
+  }
+  android::base::WriteStringToFile(contents, tf.path);
+  return android::base::StringPrintf("com.example.app%d", kPackages - 1);
+}
+
+static void BM_parse_callback(benchmark::State& state) {
+  TemporaryFile tf;
+  std::string name = WritePackageList(tf);
+  for (auto _ : state) {
+    pkg_info info = {.name = name.data()};
+    packagelist_parse_file(
+        tf.path,
+        [](pkg_info* this_package, void* user_data) {
+          pkg_info* p = static_cast<pkg_info*>(user_data);
+          bool found = strcmp(p->name, this_package->name) == 0;
+          if (found) p->uid = this_package->uid;
+          packagelist_free(this_package);
+          return !found;
+        },
+        &info);
+    benchmark::DoNotOptimize(info.uid);
+  }
+}
+BENCHMARK(BM_parse_callback);
+
+static void BM_find_package(benchmark::State& state) {
+  TemporaryFile tf;
+  std::string name = WritePackageList(tf);
+  for (auto _ : state) {
+    pkg_info* info = packagelist_find_package(tf.path, name.c_str());
+    benchmark::DoNotOptimize(info);
+    packagelist_free(info);
+  }
+}
+BENCHMARK(BM_find_package);
+
+static void BM_open_find_by_name(benchmark::State& state) {
+  TemporaryFile tf;
+  std::string name = WritePackageList(tf);
+  for (auto _ : state) {
+    packagelist* list = packagelist_open(tf.path);
+    pkg_view view;
+    benchmark::DoNotOptimize(packagelist_find_by_name(list, name.c_str(), &view));
+    packagelist_close(list);
+  }
+}
+BENCHMARK(BM_open_find_by_name);
+
+BENCHMARK_MAIN();
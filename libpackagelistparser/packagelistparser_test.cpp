@@ -16,6 +16,8 @@
 
 #include <packagelistparser/packagelistparser.h>
 
+#include <errno.h>
+
 #include <memory>
 
 #include <android-base/file.h>
@@ -129,6 +131,104 @@ TEST(packagelistparser, system_package_list) {
   ASSERT_GT(packages.size(), 10U);
 }
 
+static std::string str(const pkg_str& s) {
+  return std::string(s.data, s.len);
+}
+
+TEST(packagelistparser, lookup) {
+  TemporaryFile tf;
+  android::base::WriteStringToFile(
+      "com.test.b 10007 1 /data/user/0/com.test.b platform:privapp:targetSdkVersion=21 1023\n"
+      "com.test.a 10011 0 /data/user/0/com.test.a media:privapp:targetSdkVersion=30 "
+      "2001,1065,1023\n"
+      // Shares com.test.b's uid.
+      "com.test.c 10007 0 /data/user/0/com.test.c selabel:blah none 1 123",
+      tf.path);
+
+  packagelist* list = packagelist_open(tf.path);
+  ASSERT_NE(nullptr, list);
+
+  pkg_view view;
+  ASSERT_TRUE(packagelist_find_by_name(list, "com.test.a", &view));
+  ASSERT_EQ("com.test.a", str(view.name));
+  ASSERT_EQ(10011U, view.uid);
+  ASSERT_FALSE(view.debuggable);
+  ASSERT_EQ("/data/user/0/com.test.a", str(view.data_dir));
+  ASSERT_EQ("media:privapp:targetSdkVersion=30", str(view.seinfo));
+  gid_t gids[2];
+  ASSERT_EQ(3, packagelist_view_gids(&view, gids, 2));
+  ASSERT_EQ(2001U, gids[0]);
+  ASSERT_EQ(1065U, gids[1]);
+  ASSERT_FALSE(view.profileable_from_shell);
+  ASSERT_EQ(0, view.version_code);
+
+  // The last line has no trailing newline.
+  ASSERT_TRUE(packagelist_find_by_name(list, "com.test.c", &view));
+  ASSERT_EQ("selabel:blah", str(view.seinfo));
+  ASSERT_EQ(0, packagelist_view_gids(&view, gids, 2));
+  ASSERT_TRUE(view.profileable_from_shell);
+  ASSERT_EQ(123, view.version_code);
+
+  // A shared uid finds the first package in the file.
+  ASSERT_TRUE(packagelist_find_by_uid(list, 10007, &view));
+  ASSERT_EQ("com.test.b", str(view.name));
+  ASSERT_TRUE(view.debuggable);
+
+  ASSERT_FALSE(packagelist_find_by_name(list, "com.test", &view));
+  ASSERT_FALSE(packagelist_find_by_name(list, "com.test.d", &view));
+  ASSERT_FALSE(packagelist_find_by_uid(list, 10008, &view));
+
+  packagelist_close(list);
+}
+
+TEST(packagelistparser, lookup_empty) {
+  TemporaryFile tf;
+  packagelist* list = packagelist_open(tf.path);
+  ASSERT_NE(nullptr, list);
+  pkg_view view;
+  ASSERT_FALSE(packagelist_find_by_name(list, "com.test.a", &view));
+  ASSERT_FALSE(packagelist_find_by_uid(list, 10007, &view));
+  packagelist_close(list);
+}
+
+TEST(packagelistparser, find_package) {
+  TemporaryFile tf;
+  android::base::WriteStringToFile(
+      // A malformed line before the match doesn't stop the lookup.
+      "com.test.bad\n"
+      "com.test.a 10011 1 /data/user/0/com.test.a media:privapp:targetSdkVersion=30 2001,1065\n"
+      "com.test.b 10007 0 /data/user/0/com.test.b selabel:blah\n"
+      "com.test.c 10008 0 /data/user/0/com.test.c selabel:blah none 1 123",
+      tf.path);
+
+  pkg_info* info = packagelist_find_package(tf.path, "com.test.a");
+  ASSERT_NE(nullptr, info);
+  ASSERT_STREQ("com.test.a", info->name);
+  ASSERT_EQ(10011U, info->uid);
+  ASSERT_TRUE(info->debuggable);
+  ASSERT_STREQ("/data/user/0/com.test.a", info->data_dir);
+  ASSERT_STREQ("media:privapp:targetSdkVersion=30", info->seinfo);
+  ASSERT_EQ(2U, info->gids.cnt);
+  ASSERT_EQ(1065U, info->gids.gids[1]);
+  packagelist_free(info);
+
+  // The last line has no trailing newline.
+  info = packagelist_find_package(tf.path, "com.test.c");
+  ASSERT_NE(nullptr, info);
+  ASSERT_TRUE(info->profileable_from_shell);
+  ASSERT_EQ(123, info->version_code);
+  packagelist_free(info);
+
+  errno = 0;
+  ASSERT_EQ(nullptr, packagelist_find_package(tf.path, "com.test"));
+  ASSERT_EQ(ENOENT, errno);
+
+  // Too few fields.
+  errno = 0;
+  ASSERT_EQ(nullptr, packagelist_find_package(tf.path, "com.test.b"));
+  ASSERT_EQ(EINVAL, errno);
+}
+
 TEST(packagelistparser, packagelist_free_nullptr) {
   packagelist_free(nullptr);
 }
@@ -20,8 +20,6 @@
 #include <errno.h>
 #include <unistd.h>
 
-#include <regex>
-
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
@@ -31,6 +29,7 @@
 
 using android::base::StartsWith;
 using android::base::StringPrintf;
+using android::base::StringReplace;
 using android::base::WriteStringToFile;
 
 static constexpr const char* CGROUP_PROCS_FILE = "/cgroup.procs";
@@ -84,8 +83,10 @@ std::string CgroupController::GetProcsFilePath(const std::string& rel_path, uid_
                                                pid_t pid) const {
     std::string proc_path(path());
     proc_path.append("/").append(rel_path);
-    proc_path = regex_replace(proc_path, std::regex("<uid>"), std::to_string(uid));
-    proc_path = regex_replace(proc_path, std::regex("<pid>"), std::to_string(pid));
+    if (proc_path.find('<') != std::string::npos) {
+        proc_path = StringReplace(proc_path, "<uid>", std::to_string(uid), true);
+        proc_path = StringReplace(proc_path, "<pid>", std::to_string(pid), true);
+    }
 
     return proc_path.append(CGROUP_PROCS_FILE);
 }
@@ -143,6 +144,15 @@ CgroupMap& CgroupMap::GetInstance() {
 bool CgroupMap::LoadRcFile() {
     if (!loaded_) {
         loaded_ = (ACgroupFile_getVersion() != 0);
+        if (loaded_) {
+            // The rc file stays mapped for the lifetime of the process, so the controller names
+            // can be used as keys directly.
+            auto controller_count = ACgroupFile_getControllerCount();
+            for (uint32_t i = 0; i < controller_count; ++i) {
+                const ACgroupController* controller = ACgroupFile_getController(i);
+                controllers_.emplace(ACgroupController_getName(controller), controller);
+            }
+        }
     }
     return loaded_;
 }
@@ -181,15 +191,8 @@ CgroupController CgroupMap::FindController(const std::string& name) const {
         return CgroupController(nullptr);
     }
 
-    auto controller_count = ACgroupFile_getControllerCount();
-    for (uint32_t i = 0; i < controller_count; ++i) {
-        const ACgroupController* controller = ACgroupFile_getController(i);
-        if (name == ACgroupController_getName(controller)) {
-            return CgroupController(controller);
-        }
-    }
-
-    return CgroupController(nullptr);
+    auto it = controllers_.find(name);
+    return CgroupController(it != controllers_.end() ? it->second : nullptr);
 }
 
 CgroupController CgroupMap::FindControllerByPath(const std::string& path) const {
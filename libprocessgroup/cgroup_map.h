@@ -19,6 +19,8 @@
 #include <sys/types.h>
 
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 #include <android/cgrouprc.h>
 
@@ -63,6 +65,8 @@ class CgroupMap {
 
   private:
     bool loaded_ = false;
+    // Controllers from the rc file, indexed by name.
+    std::unordered_map<std::string_view, const ACgroupController*> controllers_;
     CgroupMap();
     bool LoadRcFile();
     void Print() const;
@@ -18,7 +18,10 @@
 
 #include <sys/cdefs.h>
 #include <sys/types.h>
+#include <chrono>
+#include <functional>
 #include <initializer_list>
+#include <memory>
 #include <span>
 #include <string>
 #include <string_view>
@@ -49,6 +52,10 @@ bool SetProcessProfiles(uid_t uid, pid_t pid, std::initializer_list<std::string_
 bool SetTaskProfiles(pid_t tid, std::span<const std::string_view> profiles,
                      bool use_fd_cache = false);
 bool SetProcessProfiles(uid_t uid, pid_t pid, std::span<const std::string_view> profiles);
+// Applies the profiles to several processes of the same UID, opening each cgroup file that the
+// processes share only once.
+bool SetProcessProfiles(uid_t uid, std::span<const pid_t> pids,
+                        std::span<const std::string_view> profiles, bool use_fd_cache = false);
 #endif
 
 __BEGIN_DECLS
@@ -58,6 +65,11 @@ __BEGIN_DECLS
 bool SetProcessProfilesCached(uid_t uid, pid_t pid, const std::vector<std::string>& profiles);
 
 static constexpr const char* CGROUPS_RC_PATH = "/dev/cgroup_info/cgroup.rc";
+static constexpr const char* TASK_PROFILES_RC_PATH = "/dev/cgroup_info/task_profiles.rc";
+
+// Flattens the task profiles JSON files into TASK_PROFILES_RC_PATH, which processes load instead
+// of parsing the JSON files. Only init should call this, after cgroups are set up.
+bool WriteTaskProfilesRcFile();
 
 bool UsePerAppMemcg();
 
@@ -101,3 +113,48 @@ bool isProfileValidForProcess(const std::string& profile_name, uid_t uid, pid_t
 #endif // __ANDROID_VNDK__
 
 __END_DECLS
+
+#ifndef __ANDROID_VNDK__
+
+// Kills several process groups at once. killProcessGroup() waits for one group to empty before
+// the caller can move on to the next; ProcessGroupKiller signals each group as it is added and
+// waits for all of their cgroup.events files with a single epoll set, so that killing N groups
+// takes as long as the slowest one rather than the sum of all of them.
+class ProcessGroupKiller {
+  public:
+    // Called once for each group with the value killProcessGroup() would have returned for it.
+    using Callback = std::function<void(uid_t uid, pid_t initialPid, int ret)>;
+
+    ProcessGroupKiller();
+    // Groups that are still pending are abandoned without their callbacks being called.
+    ~ProcessGroupKiller();
+
+    ProcessGroupKiller(const ProcessGroupKiller&) = delete;
+    ProcessGroupKiller& operator=(const ProcessGroupKiller&) = delete;
+
+    // Signals the group and starts waiting for its cgroup to be emptied and removed, giving up
+    // at `until`. The callback is never called from within Add(), even if the group could not be
+    // signalled; it is called from the next HandleEvents() or WaitAll().
+    void Add(uid_t uid, pid_t initialPid, int signal, Callback callback,
+             std::chrono::steady_clock::time_point until =
+                     std::chrono::steady_clock::now() + std::chrono::milliseconds(2200));
+
+    // An epoll fd that becomes readable when HandleEvents() has work to do, for callers that run
+    // their own event loop.
+    int fd() const;
+
+    // Reports every group that has been removed or whose deadline has passed, without blocking.
+    void HandleEvents();
+
+    // Blocks until every group added so far has been reported.
+    void WaitAll();
+
+    // Returns the number of groups that have not been reported yet.
+    size_t pending() const;
+
+  private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+#endif // __ANDROID_VNDK__
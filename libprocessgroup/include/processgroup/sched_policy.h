@@ -69,6 +69,13 @@ extern int set_sched_policy(int tid, SchedPolicy policy);
  */
 extern int get_sched_policy(int tid, SchedPolicy* policy);
 
+/* Apply set_cpuset_policy() or set_sched_policy() to every thread of process pid in one pass
+ * over /proc/<pid>/task. Threads that exit meanwhile are skipped.
+ * Return value: 0 for success, or -1 if the policy could not be applied to some thread.
+ */
+extern int set_cpuset_policy_for_process(int pid, SchedPolicy policy);
+extern int set_sched_policy_for_process(int pid, SchedPolicy policy);
+
 /* Return a displayable string corresponding to policy.
  * Return value: NUL-terminated name of unspecified length, nullptr if invalid;
  * the caller is responsible for displaying the useful part of the string.
@@ -26,7 +26,9 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/epoll.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -35,6 +37,7 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <set>
 #include <string>
 #include <thread>
@@ -46,6 +49,7 @@
 #include <android-base/strings.h>
 #include <cutils/android_filesystem_config.h>
 #include <processgroup/processgroup.h>
+#include <sched_policy_cache.h>
 #include <task_profiles.h>
 
 using android::base::GetBoolProperty;
@@ -166,42 +170,59 @@ static bool isMemoryCgroupSupported() {
     return memcg_supported;
 }
 
+bool WriteTaskProfilesRcFile() {
+    return TaskProfiles::WriteRcFile(TASK_PROFILES_RC_PATH);
+}
+
 void DropTaskProfilesResourceCaching() {
     TaskProfiles::GetInstance().DropResourceCaching(ProfileAction::RCT_TASK);
     TaskProfiles::GetInstance().DropResourceCaching(ProfileAction::RCT_PROCESS);
 }
 
 bool SetProcessProfiles(uid_t uid, pid_t pid, const std::vector<std::string>& profiles) {
+    DropCachedSchedPolicies();
     return TaskProfiles::GetInstance().SetProcessProfiles(
             uid, pid, std::span<const std::string>(profiles), false);
 }
 
 bool SetProcessProfiles(uid_t uid, pid_t pid, std::initializer_list<std::string_view> profiles) {
+    DropCachedSchedPolicies();
     return TaskProfiles::GetInstance().SetProcessProfiles(
             uid, pid, std::span<const std::string_view>(profiles), false);
 }
 
 bool SetProcessProfiles(uid_t uid, pid_t pid, std::span<const std::string_view> profiles) {
+    DropCachedSchedPolicies();
     return TaskProfiles::GetInstance().SetProcessProfiles(uid, pid, profiles, false);
 }
 
+bool SetProcessProfiles(uid_t uid, std::span<const pid_t> pids,
+                        std::span<const std::string_view> profiles, bool use_fd_cache) {
+    DropCachedSchedPolicies();
+    return TaskProfiles::GetInstance().SetProcessProfiles(uid, pids, profiles, use_fd_cache);
+}
+
 bool SetProcessProfilesCached(uid_t uid, pid_t pid, const std::vector<std::string>& profiles) {
+    DropCachedSchedPolicies();
     return TaskProfiles::GetInstance().SetProcessProfiles(
             uid, pid, std::span<const std::string>(profiles), true);
 }
 
 bool SetTaskProfiles(pid_t tid, const std::vector<std::string>& profiles, bool use_fd_cache) {
+    DropCachedSchedPolicy(tid);
     return TaskProfiles::GetInstance().SetTaskProfiles(tid, std::span<const std::string>(profiles),
                                                        use_fd_cache);
 }
 
 bool SetTaskProfiles(pid_t tid, std::initializer_list<std::string_view> profiles,
                      bool use_fd_cache) {
+    DropCachedSchedPolicy(tid);
     return TaskProfiles::GetInstance().SetTaskProfiles(
             tid, std::span<const std::string_view>(profiles), use_fd_cache);
 }
 
 bool SetTaskProfiles(pid_t tid, std::span<const std::string_view> profiles, bool use_fd_cache) {
+    DropCachedSchedPolicy(tid);
     return TaskProfiles::GetInstance().SetTaskProfiles(tid, profiles, use_fd_cache);
 }
 
@@ -221,6 +242,7 @@ extern "C" bool android_set_process_profiles(uid_t uid, pid_t pid, size_t num_pr
 }
 
 bool SetUserProfiles(uid_t uid, const std::vector<std::string>& profiles) {
+    DropCachedSchedPolicies();
     return TaskProfiles::GetInstance().SetUserProfiles(uid, std::span<const std::string>(profiles),
                                                        false);
 }
@@ -514,6 +536,34 @@ static populated_status cgroupIsPopulated(int events_fd) {
         populated_status::populated : populated_status::not_populated;
 }
 
+// Removes the cgroup(s) of a process group once it is empty. Returns 0 on success, otherwise -1
+// with errno set; EBUSY means processes are still exiting and the removal should be retried.
+static int RemoveProcessGroup(const std::string& hierarchy_root_path, uid_t uid,
+                              pid_t initialPid) {
+    const std::string cgroup_v2_path =
+            ConvertUidPidToPath(hierarchy_root_path.c_str(), uid, initialPid);
+
+    int ret = RemoveCgroup(hierarchy_root_path.c_str(), uid, initialPid);
+    if (ret)
+        PLOG(ERROR) << "Unable to remove cgroup " << cgroup_v2_path;
+    else
+        LOG(INFO) << "Removed cgroup " << cgroup_v2_path;
+
+    if (isMemoryCgroupSupported() && UsePerAppMemcg()) {
+        // This per-application memcg v1 case should eventually be removed after migration to
+        // memcg v2.
+        std::string memcg_apps_path;
+        if (CgroupGetMemcgAppsPath(&memcg_apps_path) &&
+            (ret = RemoveCgroup(memcg_apps_path.c_str(), uid, initialPid)) < 0) {
+            const auto memcg_v1_cgroup_path =
+                    ConvertUidPidToPath(memcg_apps_path.c_str(), uid, initialPid);
+            PLOG(ERROR) << "Unable to remove memcg v1 cgroup " << memcg_v1_cgroup_path;
+        }
+    }
+
+    return ret;
+}
+
 // The default timeout of 2200ms comes from the default number of retries in a previous
 // implementation of this function. The default retry value was 40 for killing and 400 for cgroup
 // removal with 5ms sleeps between each retry.
@@ -606,23 +656,7 @@ static int KillProcessGroup(
                          << " after " << kill_duration.count() << " ms";
         }
 
-        ret = RemoveCgroup(hierarchy_root_path.c_str(), uid, initialPid);
-        if (ret)
-            PLOG(ERROR) << "Unable to remove cgroup " << cgroup_v2_path;
-        else
-            LOG(INFO) << "Removed cgroup " << cgroup_v2_path;
-
-        if (isMemoryCgroupSupported() && UsePerAppMemcg()) {
-            // This per-application memcg v1 case should eventually be removed after migration to
-            // memcg v2.
-            std::string memcg_apps_path;
-            if (CgroupGetMemcgAppsPath(&memcg_apps_path) &&
-                (ret = RemoveCgroup(memcg_apps_path.c_str(), uid, initialPid)) < 0) {
-                const auto memcg_v1_cgroup_path =
-                        ConvertUidPidToPath(memcg_apps_path.c_str(), uid, initialPid);
-                PLOG(ERROR) << "Unable to remove memcg v1 cgroup " << memcg_v1_cgroup_path;
-            }
-        }
+        ret = RemoveProcessGroup(hierarchy_root_path, uid, initialPid);
 
         if (once) break;
         if (std::chrono::steady_clock::now() >= until) break;
@@ -639,6 +673,241 @@ int killProcessGroupOnce(uid_t uid, pid_t initialPid, int signal) {
     return KillProcessGroup(uid, initialPid, signal, true);
 }
 
+struct ProcessGroupKiller::State {
+    static constexpr uint64_t kTimerId = 0;
+    static constexpr int kMaxEvents = 16;
+
+    struct Group {
+        uid_t uid;
+        pid_t initial_pid;
+        int signal;
+        Callback callback;
+        std::string hierarchy_root_path;
+        std::string cgroup_v2_path;
+        android::base::unique_fd events_fd;
+        // Set if the events fd could not be added to the epoll set, in which case the group is
+        // polled every 5ms like KillProcessGroup() does when poll() fails.
+        bool poll_failed;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point until;
+        std::chrono::steady_clock::time_point next_check;
+    };
+
+    struct Report {
+        Callback callback;
+        uid_t uid;
+        pid_t initial_pid;
+        int ret;
+    };
+
+    std::optional<int> Check(Group& group, std::chrono::steady_clock::time_point now);
+    void Poll(bool block);
+    void ArmTimer();
+
+    android::base::unique_fd epoll_fd;
+    android::base::unique_fd timer_fd;
+    uint64_t next_id = kTimerId + 1;
+    std::map<uint64_t, Group> groups;
+    std::vector<Report> reports;
+};
+
+// Does one iteration of the KillProcessGroup() loop for the group. Returns the result for the
+// group once it is done, or nullopt if it has to be checked again later.
+std::optional<int> ProcessGroupKiller::State::Check(Group& group,
+                                                    std::chrono::steady_clock::time_point now) {
+    const populated_status populated = cgroupIsPopulated(group.events_fd.get());
+    if (populated == populated_status::populated && now < group.until) {
+        sendSignalToProcessGroup(group.uid, group.initial_pid, group.signal);
+        group.next_check = group.poll_failed ? std::min(now + 5ms, group.until) : group.until;
+        return std::nullopt;
+    }
+
+    const std::chrono::milliseconds kill_duration = toMillisec(now - group.start);
+    if (populated == populated_status::populated) {
+        LOG(WARNING) << "Still waiting on process(es) to exit for cgroup " << group.cgroup_v2_path
+                     << " after " << kill_duration.count() << " ms";
+    } else if (populated == populated_status::not_populated) {
+        LOG(VERBOSE) << "Killed all processes under cgroup " << group.cgroup_v2_path << " after "
+                     << kill_duration.count() << " ms";
+    }
+
+    const int ret = RemoveProcessGroup(group.hierarchy_root_path, group.uid, group.initial_pid);
+    if (ret && errno == EBUSY && now < group.until) {
+        // The processes have exited but the kernel has not released the cgroup yet. No event
+        // will tell us when it does, so retry shortly.
+        group.next_check = std::min(now + 5ms, group.until);
+        return std::nullopt;
+    }
+    return ret;
+}
+
+// Arms the timer for the earliest time a group has to be checked again, or to fire immediately
+// if there are reports to deliver, so that callers waiting on fd() get to run HandleEvents().
+void ProcessGroupKiller::State::ArmTimer() {
+    std::optional<std::chrono::steady_clock::time_point> next;
+    if (!reports.empty()) next = std::chrono::steady_clock::now();
+    for (const auto& [id, group] : groups) {
+        if (!next || group.next_check < *next) next = group.next_check;
+    }
+
+    struct itimerspec spec = {};
+    if (next) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                next->time_since_epoch())
+                                .count();
+        spec.it_value.tv_sec = ns / 1000000000;
+        spec.it_value.tv_nsec = ns % 1000000000;
+        // A zero it_value disarms the timer
+        if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+    }
+    if (timerfd_settime(timer_fd.get(), TFD_TIMER_ABSTIME, &spec, nullptr) == -1) {
+        PLOG(ERROR) << "timerfd_settime failed";
+    }
+}
+
+void ProcessGroupKiller::State::Poll(bool block) {
+    std::set<uint64_t> ready;
+    bool check_all = false;
+
+    struct epoll_event events[kMaxEvents];
+    const int timeout = block && !groups.empty() ? -1 : 0;
+    const int n = TEMP_FAILURE_RETRY(epoll_wait(epoll_fd.get(), events, kMaxEvents, timeout));
+    if (n == -1) {
+        // Fallback to 5ms sleeps if epoll fails
+        PLOG(ERROR) << "epoll_wait failed";
+        if (timeout != 0) std::this_thread::sleep_for(5ms);
+        check_all = true;
+    }
+    for (int i = 0; i < n; i++) {
+        const uint64_t id = events[i].data.u64;
+        if (id == kTimerId) {
+            uint64_t expirations;
+            TEMP_FAILURE_RETRY(read(timer_fd.get(), &expirations, sizeof(expirations)));
+        } else {
+            ready.emplace(id);
+        }
+    }
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (auto it = groups.begin(); it != groups.end();) {
+        Group& group = it->second;
+        if (check_all || ready.count(it->first) || group.next_check <= now) {
+            if (std::optional<int> ret = Check(group, now)) {
+                reports.push_back(
+                        {std::move(group.callback), group.uid, group.initial_pid, *ret});
+                it = groups.erase(it);
+                continue;
+            }
+        }
+        ++it;
+    }
+
+    // Callbacks may add more groups, so take the reports out before calling them.
+    std::vector<Report> delivered = std::move(reports);
+    reports.clear();
+    for (auto& report : delivered) {
+        if (report.callback) report.callback(report.uid, report.initial_pid, report.ret);
+    }
+    ArmTimer();
+}
+
+ProcessGroupKiller::ProcessGroupKiller() : state_(std::make_unique<State>()) {
+    state_->epoll_fd.reset(epoll_create1(EPOLL_CLOEXEC));
+    if (state_->epoll_fd.get() == -1) {
+        PLOG(ERROR) << "epoll_create1 failed";
+    }
+    state_->timer_fd.reset(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    if (state_->timer_fd.get() == -1) {
+        PLOG(ERROR) << "timerfd_create failed";
+    }
+
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data = {.u64 = State::kTimerId},
+    };
+    if (epoll_ctl(state_->epoll_fd.get(), EPOLL_CTL_ADD, state_->timer_fd.get(), &ev) == -1) {
+        PLOG(ERROR) << "Failed to add timerfd to epoll set";
+    }
+}
+
+ProcessGroupKiller::~ProcessGroupKiller() = default;
+
+void ProcessGroupKiller::Add(uid_t uid, pid_t initialPid, int signal, Callback callback,
+                             std::chrono::steady_clock::time_point until) {
+    auto report = [&](int ret) {
+        state_->reports.push_back({std::move(callback), uid, initialPid, ret});
+        state_->ArmTimer();
+    };
+
+    if (initialPid <= 0) {
+        LOG(ERROR) << __func__ << ": invalid PID " << initialPid;
+        return report(-1);
+    }
+
+    // Same as KillProcessGroup(): always signal the initialPid, even without a cgroup.
+    const bool signal_ret = sendSignalToProcessGroup(uid, initialPid, signal);
+
+    if (!CgroupsAvailable() || !signal_ret) return report(signal_ret ? 0 : -1);
+
+    std::string hierarchy_root_path;
+    CgroupGetControllerPath(CGROUPV2_HIERARCHY_NAME, &hierarchy_root_path);
+
+    std::string cgroup_v2_path = ConvertUidPidToPath(hierarchy_root_path.c_str(), uid, initialPid);
+
+    const std::string eventsfile = cgroup_v2_path + '/' + PROCESSGROUP_CGROUP_EVENTS_FILE;
+    android::base::unique_fd events_fd(open(eventsfile.c_str(), O_RDONLY | O_CLOEXEC));
+    if (events_fd.get() == -1) {
+        PLOG(WARNING) << "Error opening " << eventsfile << " for ProcessGroupKiller";
+        return report(-1);
+    }
+
+    const uint64_t id = state_->next_id++;
+    struct epoll_event ev = {
+        .events = EPOLLPRI,
+        .data = {.u64 = id},
+    };
+    const bool poll_failed =
+            epoll_ctl(state_->epoll_fd.get(), EPOLL_CTL_ADD, events_fd.get(), &ev) == -1;
+    if (poll_failed) {
+        PLOG(ERROR) << "Failed to add " << eventsfile << " to epoll set";
+    }
+
+    // Check the group from the next HandleEvents() or WaitAll(), since it may already be empty.
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    state_->groups.emplace(id, State::Group{
+                                       .uid = uid,
+                                       .initial_pid = initialPid,
+                                       .signal = signal,
+                                       .callback = std::move(callback),
+                                       .hierarchy_root_path = std::move(hierarchy_root_path),
+                                       .cgroup_v2_path = std::move(cgroup_v2_path),
+                                       .events_fd = std::move(events_fd),
+                                       .poll_failed = poll_failed,
+                                       .start = now,
+                                       .until = until,
+                                       .next_check = now,
+                               });
+    state_->ArmTimer();
+}
+
+int ProcessGroupKiller::fd() const {
+    return state_->epoll_fd.get();
+}
+
+void ProcessGroupKiller::HandleEvents() {
+    state_->Poll(false);
+}
+
+void ProcessGroupKiller::WaitAll() {
+    while (pending() > 0) {
+        state_->Poll(true);
+    }
+}
+
+size_t ProcessGroupKiller::pending() const {
+    return state_->groups.size() + state_->reports.size();
+}
+
 static int createProcessGroupInternal(uid_t uid, pid_t initialPid, std::string cgroup,
                                       bool activate_controllers) {
     auto uid_path = ConvertUidToPath(cgroup.c_str(), uid);
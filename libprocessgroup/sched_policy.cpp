@@ -18,16 +18,30 @@
 
 #define LOG_TAG "SchedPolicy"
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stdlib.h>
 #include <unistd.h>
 
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
 #include <android-base/logging.h>
+#include <android-base/stringprintf.h>
 #include <android-base/threads.h>
+#include <android-base/unique_fd.h>
 #include <cgroup_map.h>
 #include <processgroup/processgroup.h>
+#include <sched_policy_cache.h>
+#include <task_profiles.h>
 
 using android::base::GetThreadId;
+using android::base::StringPrintf;
+using android::base::unique_fd;
 
 /* Re-map SP_DEFAULT to the system default policy, and leave other values unchanged.
  * Call this any place a SchedPolicy is used as an input parameter.
@@ -39,29 +53,256 @@ static inline SchedPolicy _policy(SchedPolicy p) {
 
 #if defined(__ANDROID__)
 
-int set_cpuset_policy(pid_t tid, SchedPolicy policy) {
-    if (tid == 0) {
-        tid = GetThreadId();
+static const char* cpuset_profile(SchedPolicy policy) {
+    switch (policy) {
+        case SP_BACKGROUND:
+            return "CPUSET_SP_BACKGROUND";
+        case SP_FOREGROUND:
+        case SP_AUDIO_APP:
+        case SP_AUDIO_SYS:
+            return "CPUSET_SP_FOREGROUND";
+        case SP_TOP_APP:
+            return "CPUSET_SP_TOP_APP";
+        case SP_SYSTEM:
+            return "CPUSET_SP_SYSTEM";
+        case SP_RESTRICTED:
+            return "CPUSET_SP_RESTRICTED";
+        default:
+            return nullptr;
     }
-    policy = _policy(policy);
+}
 
+static const char* sched_profile(SchedPolicy policy) {
     switch (policy) {
         case SP_BACKGROUND:
-            return SetTaskProfiles(tid, {"CPUSET_SP_BACKGROUND"}, true) ? 0 : -1;
+            return "SCHED_SP_BACKGROUND";
         case SP_FOREGROUND:
         case SP_AUDIO_APP:
         case SP_AUDIO_SYS:
-            return SetTaskProfiles(tid, {"CPUSET_SP_FOREGROUND"}, true) ? 0 : -1;
+            return "SCHED_SP_FOREGROUND";
         case SP_TOP_APP:
-            return SetTaskProfiles(tid, {"CPUSET_SP_TOP_APP"}, true) ? 0 : -1;
+            return "SCHED_SP_TOP_APP";
         case SP_SYSTEM:
-            return SetTaskProfiles(tid, {"CPUSET_SP_SYSTEM"}, true) ? 0 : -1;
-        case SP_RESTRICTED:
-            return SetTaskProfiles(tid, {"CPUSET_SP_RESTRICTED"}, true) ? 0 : -1;
+            return "SCHED_SP_SYSTEM";
+        case SP_RT_APP:
+            return "SCHED_SP_RT_APP";
         default:
-            break;
+            return "SCHED_SP_DEFAULT";
+    }
+}
+
+static int get_sched_policy_from_group(const std::string& group, SchedPolicy* policy);
+
+namespace {
+
+// Remembers the policies that set_sched_policy() and set_cpuset_policy() gave recent threads, so
+// that get_sched_policy() can answer from the task profiles instead of parsing /proc/<tid>/cgroup.
+// Each entry keeps /proc/<tid> open: once the thread exits, lookups through that fd fail even if
+// the tid has been reused, which is what invalidates the entry.
+class PolicyCache {
+  public:
+    static PolicyCache& GetInstance() {
+        // Leaked like TaskProfiles, for the same reason
+        static auto* instance = new PolicyCache;
+        return *instance;
     }
 
+    void SetSchedPolicy(pid_t tid, SchedPolicy policy);
+    void SetCpusetPolicy(pid_t tid, SchedPolicy policy);
+    bool GetPolicy(pid_t tid, SchedPolicy* policy);
+    void Drop(pid_t tid);
+    void DropAll();
+
+  private:
+    static constexpr size_t kCacheSize = 128;
+    static constexpr int kUnknown = -2;
+
+    struct Entry {
+        pid_t tid;
+        unique_fd proc_fd;
+        int sched_policy = kUnknown;
+        int cpuset_policy = kUnknown;
+    };
+
+    // The group each policy's profile puts a task in, or nullopt if it can't be told without
+    // looking at the task.
+    struct Groups {
+        std::optional<std::string> sched[SP_CNT];
+        std::optional<std::string> cpuset[SP_CNT];
+    };
+
+    PolicyCache();
+    Entry* FindOrAdd(pid_t tid);
+    std::list<Entry>::iterator Find(pid_t tid);
+
+    std::unique_ptr<Groups> groups_;
+    const char* sched_controller_ = nullptr;
+    std::mutex mutex_;
+    // Most recently set first
+    std::list<Entry> entries_;
+};
+
+static std::optional<std::string> profile_group(const char* profile_name, const char* controller) {
+    TaskProfile* profile = TaskProfiles::GetInstance().GetProfile(profile_name);
+    std::string path;
+    if (profile == nullptr || !profile->GetCgroupPath(controller, &path) ||
+        path.find('<') != std::string::npos) {
+        return std::nullopt;
+    }
+    // GetTaskGroup() reports the group without the leading '/'
+    if (!path.empty() && path[0] == '/') {
+        path.erase(0, 1);
+    }
+    return path;
+}
+
+PolicyCache::PolicyCache() {
+    auto& cg_map = CgroupMap::GetInstance();
+    auto schedtune = cg_map.FindController("schedtune");
+    auto cpu = cg_map.FindController("cpu");
+    auto cpuset = cg_map.FindController("cpuset");
+
+    if (schedtune.IsUsable()) {
+        sched_controller_ = "schedtune";
+    } else if (cpu.IsUsable()) {
+        sched_controller_ = "cpu";
+    }
+
+    // In the unified hierarchy every controller reports the same group, so a cpuset change
+    // would also move the task's cpu group and the two can't be tracked apart.
+    if ((sched_controller_ && cg_map.FindController(sched_controller_).version() == 2) ||
+        (cpuset.IsUsable() && cpuset.version() == 2)) {
+        return;
+    }
+
+    groups_ = std::make_unique<Groups>();
+    for (int p = 0; p < SP_CNT; p++) {
+        SchedPolicy policy = static_cast<SchedPolicy>(p);
+        if (sched_controller_) {
+            groups_->sched[p] = profile_group(sched_profile(policy), sched_controller_);
+        }
+        const char* profile = cpuset_profile(policy);
+        if (profile != nullptr && cpuset.IsUsable()) {
+            groups_->cpuset[p] = profile_group(profile, "cpuset");
+        }
+    }
+}
+
+std::list<PolicyCache::Entry>::iterator PolicyCache::Find(pid_t tid) {
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->tid == tid) return it;
+    }
+    return entries_.end();
+}
+
+PolicyCache::Entry* PolicyCache::FindOrAdd(pid_t tid) {
+    auto it = Find(tid);
+    if (it != entries_.end()) {
+        entries_.splice(entries_.begin(), entries_, it);
+        return &entries_.front();
+    }
+
+    std::string proc_path = StringPrintf("/proc/%d", tid);
+    unique_fd fd(TEMP_FAILURE_RETRY(open(proc_path.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC)));
+    if (fd < 0) {
+        return nullptr;
+    }
+    if (entries_.size() >= kCacheSize) {
+        entries_.pop_back();
+    }
+    entries_.push_front(Entry{.tid = tid, .proc_fd = std::move(fd)});
+    return &entries_.front();
+}
+
+void PolicyCache::SetSchedPolicy(pid_t tid, SchedPolicy policy) {
+    if (!groups_) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = FindOrAdd(tid);
+    if (entry) entry->sched_policy = policy;
+}
+
+void PolicyCache::SetCpusetPolicy(pid_t tid, SchedPolicy policy) {
+    if (!groups_) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry* entry = FindOrAdd(tid);
+    if (entry) entry->cpuset_policy = policy;
+}
+
+bool PolicyCache::GetPolicy(pid_t tid, SchedPolicy* policy) {
+    if (!groups_) return false;
+
+    int sched_policy, cpuset_policy;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = Find(tid);
+        if (it == entries_.end()) return false;
+        if (faccessat(it->proc_fd, "cgroup", F_OK, 0) != 0) {
+            // the thread is gone, whatever now has this tid was never set through us
+            entries_.erase(it);
+            return false;
+        }
+        sched_policy = it->sched_policy;
+        cpuset_policy = it->cpuset_policy;
+    }
+
+    // Mirrors the order get_sched_policy() reads the groups in
+    std::string group;
+    if (schedboost_enabled()) {
+        if (sched_policy == kUnknown || !groups_->sched[sched_policy]) return false;
+        group = *groups_->sched[sched_policy];
+        if (!group.empty()) {
+            if (get_sched_policy_from_group(group, policy) == 0) return true;
+            group.clear();
+        }
+    }
+    if (cpusets_enabled()) {
+        if (cpuset_policy == kUnknown || !groups_->cpuset[cpuset_policy]) return false;
+        group = *groups_->cpuset[cpuset_policy];
+    }
+    int saved_errno = errno;
+    if (get_sched_policy_from_group(group, policy) < 0) {
+        // let the slow path report the error
+        errno = saved_errno;
+        return false;
+    }
+    return true;
+}
+
+void PolicyCache::Drop(pid_t tid) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = Find(tid);
+    if (it != entries_.end()) entries_.erase(it);
+}
+
+void PolicyCache::DropAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+}
+
+}  // namespace
+
+void DropCachedSchedPolicy(pid_t tid) {
+    PolicyCache::GetInstance().Drop(tid == 0 ? GetThreadId() : tid);
+}
+
+void DropCachedSchedPolicies() {
+    PolicyCache::GetInstance().DropAll();
+}
+
+int set_cpuset_policy(pid_t tid, SchedPolicy policy) {
+    if (tid == 0) {
+        tid = GetThreadId();
+    }
+    policy = _policy(policy);
+
+    const char* profile = cpuset_profile(policy);
+    if (profile == nullptr) {
+        return 0;
+    }
+    if (!SetTaskProfiles(tid, {profile}, true)) {
+        return -1;
+    }
+    PolicyCache::GetInstance().SetCpusetPolicy(tid, policy);
     return 0;
 }
 
@@ -116,26 +357,55 @@ int set_sched_policy(pid_t tid, SchedPolicy policy) {
     }
 #endif
 
-    switch (policy) {
-        case SP_BACKGROUND:
-            return SetTaskProfiles(tid, {"SCHED_SP_BACKGROUND"}, true) ? 0 : -1;
-        case SP_FOREGROUND:
-        case SP_AUDIO_APP:
-        case SP_AUDIO_SYS:
-            return SetTaskProfiles(tid, {"SCHED_SP_FOREGROUND"}, true) ? 0 : -1;
-        case SP_TOP_APP:
-            return SetTaskProfiles(tid, {"SCHED_SP_TOP_APP"}, true) ? 0 : -1;
-        case SP_SYSTEM:
-            return SetTaskProfiles(tid, {"SCHED_SP_SYSTEM"}, true) ? 0 : -1;
-        case SP_RT_APP:
-            return SetTaskProfiles(tid, {"SCHED_SP_RT_APP"}, true) ? 0 : -1;
-        default:
-            return SetTaskProfiles(tid, {"SCHED_SP_DEFAULT"}, true) ? 0 : -1;
+    if (!SetTaskProfiles(tid, {sched_profile(policy)}, true)) {
+        return -1;
     }
-
+    PolicyCache::GetInstance().SetSchedPolicy(tid, policy);
     return 0;
 }
 
+// Applies profile to every thread of pid, looking the profile up once for the whole process.
+static int set_process_threads_profile(pid_t pid, const char* profile) {
+    TaskProfile* task_profile = TaskProfiles::GetInstance().GetProfile(profile);
+    if (task_profile == nullptr) {
+        LOG(WARNING) << "Failed to find " << profile << " task profile";
+        return -1;
+    }
+
+    std::string task_path = StringPrintf("/proc/%d/task", pid);
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(task_path.c_str()), closedir);
+    if (!dir) {
+        return -1;
+    }
+
+    task_profile->EnableResourceCaching(ProfileAction::RCT_TASK);
+    int ret = 0;
+    dirent* dp;
+    while ((dp = readdir(dir.get())) != nullptr) {
+        pid_t tid = atoi(dp->d_name);
+        if (tid <= 0) {
+            continue;
+        }
+        DropCachedSchedPolicy(tid);
+        if (!task_profile->ExecuteForTask(tid) && faccessat(dirfd(dir.get()), dp->d_name,
+                                                            F_OK, 0) == 0) {
+            // threads exiting while we go are not a failure
+            LOG(WARNING) << "Failed to apply " << profile << " task profile to " << tid;
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int set_cpuset_policy_for_process(pid_t pid, SchedPolicy policy) {
+    const char* profile = cpuset_profile(_policy(policy));
+    return profile ? set_process_threads_profile(pid, profile) : 0;
+}
+
+int set_sched_policy_for_process(pid_t pid, SchedPolicy policy) {
+    return set_process_threads_profile(pid, sched_profile(_policy(policy)));
+}
+
 bool cpusets_enabled() {
     static bool enabled = (CgroupMap::GetInstance().FindController("cpuset").IsUsable());
     return enabled;
@@ -191,6 +461,10 @@ int get_sched_policy(pid_t tid, SchedPolicy* policy) {
         tid = GetThreadId();
     }
 
+    if (PolicyCache::GetInstance().GetPolicy(tid, policy)) {
+        return 0;
+    }
+
     std::string group;
     if (schedboost_enabled()) {
         if ((getCGroupSubsys(tid, "schedtune", group) < 0) &&
@@ -228,6 +502,18 @@ int get_sched_policy(int, SchedPolicy* policy) {
     return 0;
 }
 
+int set_cpuset_policy_for_process(int, SchedPolicy) {
+    return 0;
+}
+
+int set_sched_policy_for_process(int, SchedPolicy) {
+    return 0;
+}
+
+void DropCachedSchedPolicy(pid_t) {}
+
+void DropCachedSchedPolicies() {}
+
 #endif
 
 const char* get_sched_policy_name(SchedPolicy policy) {
@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+// Forget the policy set_sched_policy() and set_cpuset_policy() recorded for a thread. Called
+// whenever a task profile moves the thread behind sched_policy's back. A tid of 0 means the
+// calling thread.
+void DropCachedSchedPolicy(pid_t tid);
+
+// Forget the policies recorded for all threads, for when the threads moved are not known.
+void DropCachedSchedPolicies();
@@ -19,8 +19,11 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <task_profiles.h>
+#include <algorithm>
 #include <string>
 
 #include <android-base/file.h>
@@ -36,10 +39,15 @@
 #include <json/value.h>
 
 #include <build_flags.h>
+#include <processgroup/processgroup.h>
+
+#include "task_profiles_file.h"
 
 // To avoid issues in sdk_mac build
 #if defined(__ANDROID__)
+#include <linux/ioprio.h>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
 #endif
 
 using android::base::GetThreadId;
@@ -47,7 +55,10 @@ using android::base::GetUintProperty;
 using android::base::StringPrintf;
 using android::base::StringReplace;
 using android::base::unique_fd;
+using android::base::WriteFully;
 using android::base::WriteStringToFile;
+using android::processgroup::format::TaskProfilesFile;
+using android::processgroup::format::TaskProfilesRecord;
 
 static constexpr const char* TASK_PROFILE_DB_FILE = "/etc/task_profiles.json";
 static constexpr const char* TASK_PROFILE_DB_VENDOR_FILE = "/vendor/etc/task_profiles.json";
@@ -118,6 +129,16 @@ bool FdCacheHelper::IsAppDependentPath(const std::string& path) {
 
 IProfileAttribute::~IProfileAttribute() = default;
 
+bool ProfileAction::ExecuteForProcesses(uid_t uid, std::span<const pid_t> pids) const {
+    bool success = true;
+    for (pid_t pid : pids) {
+        if (!ExecuteForProcess(uid, pid)) {
+            success = false;
+        }
+    }
+    return success;
+}
+
 const std::string& ProfileAttribute::file_name() const {
     if (controller()->version() == 2 && !file_v2_name_.empty()) return file_v2_name_;
     return file_name_;
@@ -134,19 +155,22 @@ static bool isSystemApp(uid_t uid) {
     return uid < AID_APP_START;
 }
 
+// These are built on every kill, process group creation and profile application, so append the
+// pieces directly instead of going through a format string.
 std::string ConvertUidToPath(const char* root_cgroup_path, uid_t uid) {
+    std::string path(root_cgroup_path);
+    path.reserve(path.size() + 32);
     if (android::libprocessgroup_flags::cgroup_v2_sys_app_isolation()) {
-        if (isSystemApp(uid))
-            return StringPrintf("%s/system/uid_%u", root_cgroup_path, uid);
-        else
-            return StringPrintf("%s/apps/uid_%u", root_cgroup_path, uid);
+        path.append(isSystemApp(uid) ? "/system" : "/apps");
     }
-    return StringPrintf("%s/uid_%u", root_cgroup_path, uid);
+    path.append("/uid_").append(std::to_string(uid));
+    return path;
 }
 
 std::string ConvertUidPidToPath(const char* root_cgroup_path, uid_t uid, pid_t pid) {
-    const std::string uid_path = ConvertUidToPath(root_cgroup_path, uid);
-    return StringPrintf("%s/pid_%d", uid_path.c_str(), pid);
+    std::string path = ConvertUidToPath(root_cgroup_path, uid);
+    path.append("/pid_").append(std::to_string(pid));
+    return path;
 }
 
 bool ProfileAttribute::GetPathForProcess(uid_t uid, pid_t pid, std::string* path) const {
@@ -235,12 +259,63 @@ bool SetTimerSlackAction::ExecuteForTask(pid_t tid) const {
     return true;
 }
 
+bool SetIoPriorityAction::SetIoPriority(int which, int who) const {
+    if (syscall(SYS_ioprio_set, which, who, ioprio_) == 0) {
+        return true;
+    }
+    if (errno == ESRCH) {
+        // This happens when the task is already dead
+        return true;
+    }
+    PLOG(ERROR) << "ioprio_set(" << which << ", " << who << ", " << ioprio_ << ") failed";
+    return optional_;
+}
+
+bool SetIoPriorityAction::ExecuteForProcess(uid_t, pid_t pid) const {
+    // The I/O priority belongs to each thread, so all of them have to be set
+    std::string task_path = StringPrintf("/proc/%d/task", pid);
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(task_path.c_str()), closedir);
+    if (!dir) {
+        return SetIoPriority(IOPRIO_WHO_PROCESS, pid);
+    }
+
+    bool success = true;
+    dirent* dp;
+    while ((dp = readdir(dir.get())) != nullptr) {
+        pid_t tid = atoi(dp->d_name);
+        if (tid > 0 && !SetIoPriority(IOPRIO_WHO_PROCESS, tid)) {
+            success = false;
+        }
+    }
+    return success;
+}
+
+bool SetIoPriorityAction::ExecuteForTask(pid_t tid) const {
+    return SetIoPriority(IOPRIO_WHO_PROCESS, tid);
+}
+
+bool SetIoPriorityAction::ExecuteForUID(uid_t uid) const {
+    return SetIoPriority(IOPRIO_WHO_USER, uid);
+}
+
 #else
 
 bool SetTimerSlackAction::ExecuteForTask(int) const {
     return true;
 };
 
+bool SetIoPriorityAction::ExecuteForProcess(uid_t, pid_t) const {
+    return true;
+}
+
+bool SetIoPriorityAction::ExecuteForTask(pid_t) const {
+    return true;
+}
+
+bool SetIoPriorityAction::ExecuteForUID(uid_t) const {
+    return true;
+}
+
 #endif
 
 bool SetAttributeAction::WriteValueToFile(const std::string& path) const {
@@ -411,18 +486,112 @@ bool SetCgroupAction::ExecuteForProcess(uid_t uid, pid_t pid) const {
     }
 
     // fd was not cached or cached fd can't be used
-    std::string procs_path = controller()->GetProcsFilePath(path_, uid, pid);
-    unique_fd tmp_fd(TEMP_FAILURE_RETRY(open(procs_path.c_str(), O_WRONLY | O_CLOEXEC)));
-    if (tmp_fd < 0) {
+    return AddPidsToCgroup(uid, std::span<const pid_t>(&pid, 1));
+}
+
+bool SetCgroupAction::ExecuteForProcesses(uid_t uid, std::span<const pid_t> pids) const {
+    if (pids.empty()) {
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(fd_mutex_);
+        if (FdCacheHelper::IsCached(fd_[ProfileAction::RCT_PROCESS])) {
+            bool success = true;
+            for (pid_t pid : pids) {
+                if (!AddTidToCgroup(pid, fd_[ProfileAction::RCT_PROCESS], RCT_PROCESS)) {
+                    LOG(ERROR) << "Failed to add task into cgroup";
+                    success = false;
+                }
+            }
+            return success;
+        }
+
+        if (fd_[ProfileAction::RCT_PROCESS] == FdCacheHelper::FDS_INACCESSIBLE) {
+            // no permissions to access the file, ignore
+            return true;
+        }
+    }
+
+    if (path_.find("<pid>") != std::string::npos) {
+        // Every process has a procs file of its own.
+        return ProfileAction::ExecuteForProcesses(uid, pids);
+    }
+
+    // All the processes share one procs file, open it only once.
+    return AddPidsToCgroup(uid, pids);
+}
+
+// Must be called with fd_mutex_ held.
+int SetCgroupAction::GetUidProcsFd(uid_t uid, bool reopen) const {
+    auto it = std::find_if(uid_fds_.begin(), uid_fds_.end(),
+                           [uid](const auto& entry) { return entry.first == uid; });
+    if (it != uid_fds_.end()) {
+        if (!reopen) {
+            uid_fds_.splice(uid_fds_.begin(), uid_fds_, it);
+            return uid_fds_.front().second.get();
+        }
+        uid_fds_.erase(it);
+    }
+
+    // pid doesn't matter because the path doesn't use it when uid_fd_caching_ is set
+    std::string procs_path = controller()->GetProcsFilePath(path_, uid, 0);
+    unique_fd fd(TEMP_FAILURE_RETRY(open(procs_path.c_str(), O_WRONLY | O_CLOEXEC)));
+    if (fd < 0) {
         PLOG(WARNING) << Name() << "::" << __func__ << ": failed to open " << procs_path;
-        return false;
+        return -1;
     }
-    if (!AddTidToCgroup(pid, tmp_fd, RCT_PROCESS)) {
-        LOG(ERROR) << "Failed to add task into cgroup";
-        return false;
+    uid_fds_.emplace_front(uid, std::move(fd));
+    if (uid_fds_.size() > kUidFdCacheSize) {
+        uid_fds_.pop_back();
     }
+    return uid_fds_.front().second.get();
+}
 
-    return true;
+bool SetCgroupAction::AddPidsToCgroup(uid_t uid, std::span<const pid_t> pids) const {
+    std::unique_lock<std::mutex> lock(fd_mutex_);
+    if (!uid_fd_caching_) {
+        lock.unlock();
+
+        std::string procs_path = controller()->GetProcsFilePath(path_, uid, pids[0]);
+        unique_fd tmp_fd(TEMP_FAILURE_RETRY(open(procs_path.c_str(), O_WRONLY | O_CLOEXEC)));
+        if (tmp_fd < 0) {
+            PLOG(WARNING) << Name() << "::" << __func__ << ": failed to open " << procs_path;
+            return false;
+        }
+        bool success = true;
+        for (pid_t pid : pids) {
+            if (!AddTidToCgroup(pid, tmp_fd, RCT_PROCESS)) {
+                LOG(ERROR) << "Failed to add task into cgroup";
+                success = false;
+            }
+        }
+        return success;
+    }
+
+    int fd = GetUidProcsFd(uid, /*reopen=*/false);
+    if (fd < 0) {
+        return false;
+    }
+    bool success = true;
+    for (pid_t pid : pids) {
+        std::string value = std::to_string(pid);
+        if (TEMP_FAILURE_RETRY(write(fd, value.c_str(), value.length())) == value.length()) {
+            continue;
+        }
+        if (errno == ENODEV) {
+            // The cgroup of the UID has been removed since its procs file was cached.
+            fd = GetUidProcsFd(uid, /*reopen=*/true);
+            if (fd < 0) {
+                return false;
+            }
+        }
+        if (!AddTidToCgroup(pid, fd, RCT_PROCESS)) {
+            LOG(ERROR) << "Failed to add task into cgroup";
+            success = false;
+        }
+    }
+    return success;
 }
 
 bool SetCgroupAction::ExecuteForTask(pid_t tid) const {
@@ -448,6 +617,13 @@ bool SetCgroupAction::ExecuteForTask(pid_t tid) const {
 
 void SetCgroupAction::EnableResourceCaching(ResourceCacheType cache_type) {
     std::lock_guard<std::mutex> lock(fd_mutex_);
+    if (cache_type == ProfileAction::RCT_PROCESS &&
+        fd_[cache_type] == FdCacheHelper::FDS_APP_DEPENDENT) {
+        // A procs file that depends on the UID only can't be shared by all processes, but it can
+        // be shared by the processes of each UID.
+        uid_fd_caching_ = path_.find("<pid>") == std::string::npos;
+        return;
+    }
     // Return early to prevent unnecessary calls to controller_.Get{Tasks|Procs}FilePath() which
     // include regex evaluations
     if (fd_[cache_type] != FdCacheHelper::FDS_NOT_CACHED) {
@@ -470,6 +646,10 @@ void SetCgroupAction::EnableResourceCaching(ResourceCacheType cache_type) {
 void SetCgroupAction::DropResourceCaching(ResourceCacheType cache_type) {
     std::lock_guard<std::mutex> lock(fd_mutex_);
     FdCacheHelper::Drop(fd_[cache_type]);
+    if (cache_type == ProfileAction::RCT_PROCESS) {
+        uid_fds_.clear();
+        uid_fd_caching_ = false;
+    }
 }
 
 bool SetCgroupAction::IsValidForProcess(uid_t uid, pid_t pid) const {
@@ -505,6 +685,14 @@ bool SetCgroupAction::IsValidForTask(int) const {
     return access(tasks_path.c_str(), W_OK) == 0;
 }
 
+bool SetCgroupAction::GetCgroupPath(std::string_view controller, std::string* path) const {
+    if (controller_.name() != controller) {
+        return false;
+    }
+    *path = path_;
+    return true;
+}
+
 WriteFileAction::WriteFileAction(const std::string& task_path, const std::string& proc_path,
                                  const std::string& value, bool logfailures)
     : task_path_(task_path), proc_path_(proc_path), value_(value), logfailures_(logfailures) {
@@ -679,6 +867,13 @@ bool ApplyProfileAction::ExecuteForProcess(uid_t uid, pid_t pid) const {
     return true;
 }
 
+bool ApplyProfileAction::ExecuteForProcesses(uid_t uid, std::span<const pid_t> pids) const {
+    for (const auto& profile : profiles_) {
+        profile->ExecuteForProcesses(uid, pids);
+    }
+    return true;
+}
+
 bool ApplyProfileAction::ExecuteForTask(pid_t tid) const {
     for (const auto& profile : profiles_) {
         profile->ExecuteForTask(tid);
@@ -716,6 +911,14 @@ bool ApplyProfileAction::IsValidForTask(pid_t tid) const {
     return true;
 }
 
+bool ApplyProfileAction::GetCgroupPath(std::string_view controller, std::string* path) const {
+    bool found = false;
+    for (const auto& profile : profiles_) {
+        found |= profile->GetCgroupPath(controller, path);
+    }
+    return found;
+}
+
 void TaskProfile::MoveTo(TaskProfile* profile) {
     profile->elements_ = std::move(elements_);
     profile->res_cached_ = res_cached_;
@@ -731,6 +934,16 @@ bool TaskProfile::ExecuteForProcess(uid_t uid, pid_t pid) const {
     return true;
 }
 
+bool TaskProfile::ExecuteForProcesses(uid_t uid, std::span<const pid_t> pids) const {
+    for (const auto& element : elements_) {
+        if (!element->ExecuteForProcesses(uid, pids)) {
+            LOG(VERBOSE) << "Applying profile action " << element->Name() << " failed";
+            return false;
+        }
+    }
+    return true;
+}
+
 bool TaskProfile::ExecuteForTask(pid_t tid) const {
     if (tid == 0) {
         tid = GetThreadId();
@@ -792,6 +1005,14 @@ bool TaskProfile::IsValidForTask(pid_t tid) const {
     return true;
 }
 
+bool TaskProfile::GetCgroupPath(std::string_view controller, std::string* path) const {
+    bool found = false;
+    for (const auto& element : elements_) {
+        found |= element->GetCgroupPath(controller, path);
+    }
+    return found;
+}
+
 void TaskProfiles::DropResourceCaching(ProfileAction::ResourceCacheType cache_type) const {
     for (auto& iter : profiles_) {
         iter.second->DropResourceCaching(cache_type);
@@ -806,32 +1027,47 @@ TaskProfiles& TaskProfiles::GetInstance() {
 }
 
 TaskProfiles::TaskProfiles() {
-    // load system task profiles
-    if (!Load(CgroupMap::GetInstance(), TASK_PROFILE_DB_FILE)) {
-        LOG(ERROR) << "Loading " << TASK_PROFILE_DB_FILE << " for [" << getpid() << "] failed";
+    // load the profiles flattened by init if they are available
+    if (!access(TASK_PROFILES_RC_PATH, F_OK) &&
+        LoadRcFile(CgroupMap::GetInstance(), TASK_PROFILES_RC_PATH)) {
+        return;
     }
 
-    // load API-level specific system task profiles if available
+    for (const auto& file_name : ProfileFiles()) {
+        if (!Load(CgroupMap::GetInstance(), file_name)) {
+            LOG(ERROR) << "Loading " << file_name << " for [" << getpid() << "] failed";
+        }
+    }
+}
+
+std::vector<std::string> TaskProfiles::ProfileFiles() {
+    // system task profiles
+    std::vector<std::string> files = {TASK_PROFILE_DB_FILE};
+
+    // API-level specific system task profiles if available
     unsigned int api_level = GetUintProperty<unsigned int>("ro.product.first_api_level", 0);
     if (api_level > 0) {
         std::string api_profiles_path =
                 android::base::StringPrintf(TEMPLATE_TASK_PROFILE_API_FILE, api_level);
         if (!access(api_profiles_path.c_str(), F_OK) || errno != ENOENT) {
-            if (!Load(CgroupMap::GetInstance(), api_profiles_path)) {
-                LOG(ERROR) << "Loading " << api_profiles_path << " for [" << getpid() << "] failed";
-            }
+            files.emplace_back(std::move(api_profiles_path));
         }
     }
 
-    // load vendor task profiles if the file exists
-    if (!access(TASK_PROFILE_DB_VENDOR_FILE, F_OK) &&
-        !Load(CgroupMap::GetInstance(), TASK_PROFILE_DB_VENDOR_FILE)) {
-        LOG(ERROR) << "Loading " << TASK_PROFILE_DB_VENDOR_FILE << " for [" << getpid()
-                   << "] failed";
+    // vendor task profiles if the file exists
+    if (!access(TASK_PROFILE_DB_VENDOR_FILE, F_OK)) {
+        files.emplace_back(TASK_PROFILE_DB_VENDOR_FILE);
     }
+    return files;
 }
 
-bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
+const std::string& TaskProfiles::ProfilesDesc::Action::Param(std::string_view key) const {
+    static const std::string kEmpty;
+    auto iter = params.find(key);
+    return iter != params.end() ? iter->second : kEmpty;
+}
+
+bool TaskProfiles::ReadDesc(const std::string& file_name, ProfilesDesc* desc) {
     std::string json_doc;
 
     if (!android::base::ReadFileToString(file_name, &json_doc)) {
@@ -848,12 +1084,108 @@ bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
         return false;
     }
 
+    desc->file_name = file_name;
+
     const Json::Value& attr = root["Attributes"];
     for (Json::Value::ArrayIndex i = 0; i < attr.size(); ++i) {
-        std::string name = attr[i]["Name"].asString();
-        std::string controller_name = attr[i]["Controller"].asString();
-        std::string file_attr = attr[i]["File"].asString();
-        std::string file_v2_attr = attr[i]["FileV2"].asString();
+        desc->attributes.push_back({
+                .name = attr[i]["Name"].asString(),
+                .controller = attr[i]["Controller"].asString(),
+                .file = attr[i]["File"].asString(),
+                .file_v2 = attr[i]["FileV2"].asString(),
+        });
+    }
+
+    const Json::Value& profiles_val = root["Profiles"];
+    for (Json::Value::ArrayIndex i = 0; i < profiles_val.size(); ++i) {
+        const Json::Value& profile_val = profiles_val[i];
+        auto& profile = desc->profiles.emplace_back();
+        profile.name = profile_val["Name"].asString();
+
+        const Json::Value& actions = profile_val["Actions"];
+        for (Json::Value::ArrayIndex act_idx = 0; act_idx < actions.size(); ++act_idx) {
+            const Json::Value& action_val = actions[act_idx];
+            auto& action = profile.actions.emplace_back();
+            action.name = action_val["Name"].asString();
+
+            const Json::Value& params_val = action_val["Params"];
+            if (!params_val.isObject()) {
+                continue;
+            }
+            for (const auto& key : params_val.getMemberNames()) {
+                const Json::Value& value = params_val[key];
+                // No action takes structured parameters
+                if (!value.isObject() && !value.isArray()) {
+                    action.params[key] = value.asString();
+                }
+            }
+        }
+    }
+
+    const Json::Value& aggregateprofiles_val = root["AggregateProfiles"];
+    for (Json::Value::ArrayIndex i = 0; i < aggregateprofiles_val.size(); ++i) {
+        const Json::Value& aggregateprofile_val = aggregateprofiles_val[i];
+        auto& aggregate_profile = desc->aggregate_profiles.emplace_back();
+        aggregate_profile.name = aggregateprofile_val["Name"].asString();
+
+        const Json::Value& aggregateprofiles = aggregateprofile_val["Profiles"];
+        for (Json::Value::ArrayIndex pf_idx = 0; pf_idx < aggregateprofiles.size(); ++pf_idx) {
+            aggregate_profile.profiles.emplace_back(aggregateprofiles[pf_idx].asString());
+        }
+    }
+
+    return true;
+}
+
+bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
+    ProfilesDesc desc;
+    if (!ReadDesc(file_name, &desc)) {
+        return false;
+    }
+    return Load(cg_map, desc);
+}
+
+// Packs an I/O scheduling class name and a priority level the way ioprio_set(2) takes them.
+static bool ParseIoPriority(const std::string& class_name, const std::string& prio, int* ioprio) {
+    // Class values and layout from linux/ioprio.h, which the sdk_mac build does not have
+    static constexpr struct {
+        const char* name;
+        int value;
+    } kClasses[] = {{"NONE", 0}, {"RT", 1}, {"BE", 2}, {"IDLE", 3}};
+    constexpr int kClassShift = 13;
+    constexpr int kLevels = 8;
+
+    int class_value = -1;
+    for (const auto& c : kClasses) {
+        if (class_name == c.name) class_value = c.value;
+    }
+    if (class_value < 0) {
+        return false;
+    }
+
+    int level = 0;
+    if (!prio.empty()) {
+        char* end;
+        level = strtol(prio.c_str(), &end, 10);
+        if (*end != '\0' || level < 0 || level >= kLevels) {
+            return false;
+        }
+    }
+    // NONE means "derive from the nice value" and has no level of its own
+    if (class_value == 0 && level != 0) {
+        return false;
+    }
+
+    *ioprio = (class_value << kClassShift) | level;
+    return true;
+}
+
+bool TaskProfiles::Load(const CgroupMap& cg_map, const ProfilesDesc& desc) {
+    for (const auto& attr : desc.attributes) {
+        const std::string& name = attr.name;
+        const std::string& controller_name = attr.controller;
+        const std::string& file_attr = attr.file;
+        const std::string& file_v2_attr = attr.file_v2;
 
         if (!file_v2_attr.empty() && file_attr.empty()) {
             LOG(ERROR) << "Attribute " << name << " has FileV2 but no File property";
@@ -874,21 +1206,15 @@ bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
         }
     }
 
-    const Json::Value& profiles_val = root["Profiles"];
-    for (Json::Value::ArrayIndex i = 0; i < profiles_val.size(); ++i) {
-        const Json::Value& profile_val = profiles_val[i];
-
-        std::string profile_name = profile_val["Name"].asString();
-        const Json::Value& actions = profile_val["Actions"];
+    for (const auto& profile_desc : desc.profiles) {
+        const std::string& profile_name = profile_desc.name;
         auto profile = std::make_shared<TaskProfile>(profile_name);
 
-        for (Json::Value::ArrayIndex act_idx = 0; act_idx < actions.size(); ++act_idx) {
-            const Json::Value& action_val = actions[act_idx];
-            std::string action_name = action_val["Name"].asString();
-            const Json::Value& params_val = action_val["Params"];
+        for (const auto& action_val : profile_desc.actions) {
+            const std::string& action_name = action_val.name;
             if (action_name == "JoinCgroup") {
-                std::string controller_name = params_val["Controller"].asString();
-                std::string path = params_val["Path"].asString();
+                std::string controller_name = action_val.Param("Controller");
+                std::string path = action_val.Param("Path");
 
                 auto controller = cg_map.FindController(controller_name);
                 if (controller.HasValue()) {
@@ -903,7 +1229,7 @@ bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
                     LOG(WARNING) << "JoinCgroup: controller " << controller_name << " is not found";
                 }
             } else if (action_name == "SetTimerSlack") {
-                std::string slack_value = params_val["Slack"].asString();
+                std::string slack_value = action_val.Param("Slack");
                 char* end;
                 unsigned long slack;
 
@@ -913,10 +1239,22 @@ bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
                 } else {
                     LOG(WARNING) << "SetTimerSlack: invalid parameter: " << slack_value;
                 }
+            } else if (action_name == "SetIoPriority") {
+                std::string class_value = action_val.Param("Class");
+                std::string prio_value = action_val.Param("Priority");
+                bool optional = strcmp(action_val.Param("Optional").c_str(), "true") == 0;
+                int ioprio;
+
+                if (ParseIoPriority(class_value, prio_value, &ioprio)) {
+                    profile->Add(std::make_unique<SetIoPriorityAction>(ioprio, optional));
+                } else {
+                    LOG(WARNING) << "SetIoPriority: invalid parameters: " << class_value << " "
+                                 << prio_value;
+                }
             } else if (action_name == "SetAttribute") {
-                std::string attr_name = params_val["Name"].asString();
-                std::string attr_value = params_val["Value"].asString();
-                bool optional = strcmp(params_val["Optional"].asString().c_str(), "true") == 0;
+                std::string attr_name = action_val.Param("Name");
+                std::string attr_value = action_val.Param("Value");
+                bool optional = strcmp(action_val.Param("Optional").c_str(), "true") == 0;
 
                 auto iter = attributes_.find(attr_name);
                 if (iter != attributes_.end()) {
@@ -926,8 +1264,8 @@ bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
                     LOG(WARNING) << "SetAttribute: unknown attribute: " << attr_name;
                 }
             } else if (action_name == "SetClamps") {
-                std::string boost_value = params_val["Boost"].asString();
-                std::string clamp_value = params_val["Clamp"].asString();
+                std::string boost_value = action_val.Param("Boost");
+                std::string clamp_value = action_val.Param("Clamp");
                 char* end;
                 unsigned long boost;
 
@@ -943,12 +1281,12 @@ bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
                     LOG(WARNING) << "SetClamps: invalid parameter: " << boost_value;
                 }
             } else if (action_name == "WriteFile") {
-                std::string attr_filepath = params_val["FilePath"].asString();
-                std::string attr_procfilepath = params_val["ProcFilePath"].asString();
-                std::string attr_value = params_val["Value"].asString();
+                std::string attr_filepath = action_val.Param("FilePath");
+                std::string attr_procfilepath = action_val.Param("ProcFilePath");
+                std::string attr_value = action_val.Param("Value");
                 // FilePath and Value are mandatory
                 if (!attr_filepath.empty() && !attr_value.empty()) {
-                    std::string attr_logfailures = params_val["LogFailures"].asString();
+                    std::string attr_logfailures = action_val.Param("LogFailures");
                     bool logfailures = attr_logfailures.empty() || attr_logfailures == "true";
                     profile->Add(std::make_unique<WriteFileAction>(attr_filepath, attr_procfilepath,
                                                                    attr_value, logfailures));
@@ -974,17 +1312,12 @@ bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
         }
     }
 
-    const Json::Value& aggregateprofiles_val = root["AggregateProfiles"];
-    for (Json::Value::ArrayIndex i = 0; i < aggregateprofiles_val.size(); ++i) {
-        const Json::Value& aggregateprofile_val = aggregateprofiles_val[i];
-
-        std::string aggregateprofile_name = aggregateprofile_val["Name"].asString();
-        const Json::Value& aggregateprofiles = aggregateprofile_val["Profiles"];
+    for (const auto& aggregateprofile_val : desc.aggregate_profiles) {
+        const std::string& aggregateprofile_name = aggregateprofile_val.name;
         std::vector<std::shared_ptr<TaskProfile>> profiles;
         bool ret = true;
 
-        for (Json::Value::ArrayIndex pf_idx = 0; pf_idx < aggregateprofiles.size(); ++pf_idx) {
-            std::string profile_name = aggregateprofiles[pf_idx].asString();
+        for (const auto& profile_name : aggregateprofile_val.profiles) {
 
             if (profile_name == aggregateprofile_name) {
                 LOG(WARNING) << "AggregateProfiles: recursive profile name: " << profile_name;
@@ -1008,6 +1341,227 @@ bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
     return true;
 }
 
+bool TaskProfiles::WriteRcFile(const std::string& path) {
+    std::vector<TaskProfilesRecord> records;
+    std::vector<uint32_t> string_refs;
+    std::string string_table;
+    std::map<std::string, uint32_t, std::less<>> string_offsets;
+
+    auto add_record = [&](TaskProfilesRecord::Type type,
+                          const std::vector<std::string_view>& strings) {
+        records.push_back({.type_ = type,
+                           .first_string_ = static_cast<uint32_t>(string_refs.size()),
+                           .string_count_ = static_cast<uint32_t>(strings.size())});
+        for (const auto& str : strings) {
+            auto iter = string_offsets.find(str);
+            if (iter == string_offsets.end()) {
+                iter = string_offsets.emplace(str, string_table.size()).first;
+                string_table.append(str).push_back('\0');
+            }
+            string_refs.push_back(iter->second);
+        }
+    };
+
+    for (const auto& file_name : ProfileFiles()) {
+        ProfilesDesc desc;
+        if (!ReadDesc(file_name, &desc)) {
+            // Leave it to each process to report the failure
+            return false;
+        }
+
+        add_record(TaskProfilesRecord::SOURCE, {desc.file_name});
+        for (const auto& attr : desc.attributes) {
+            add_record(TaskProfilesRecord::ATTRIBUTE,
+                       {attr.name, attr.controller, attr.file, attr.file_v2});
+        }
+        for (const auto& profile : desc.profiles) {
+            add_record(TaskProfilesRecord::PROFILE, {profile.name});
+            for (const auto& action : profile.actions) {
+                std::vector<std::string_view> strings = {action.name};
+                for (const auto& [key, value] : action.params) {
+                    strings.push_back(key);
+                    strings.push_back(value);
+                }
+                add_record(TaskProfilesRecord::ACTION, strings);
+            }
+        }
+        for (const auto& aggregate_profile : desc.aggregate_profiles) {
+            std::vector<std::string_view> strings = {aggregate_profile.name};
+            strings.insert(strings.end(), aggregate_profile.profiles.begin(),
+                           aggregate_profile.profiles.end());
+            add_record(TaskProfilesRecord::AGGREGATE_PROFILE, strings);
+        }
+    }
+
+    TaskProfilesFile header = {
+            .magic_ = TaskProfilesFile::FILE_MAGIC,
+            .version_ = TaskProfilesFile::FILE_CURR_VERSION,
+            .record_count_ = static_cast<uint32_t>(records.size()),
+            .string_ref_count_ = static_cast<uint32_t>(string_refs.size()),
+            .string_table_size_ = static_cast<uint32_t>(string_table.size()),
+    };
+
+    // Write to a temporary file first so that no process ever maps a partially written one
+    std::string tmp_path = path + ".tmp";
+    unique_fd fd(TEMP_FAILURE_RETRY(open(tmp_path.c_str(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC,
+                                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)));
+    if (fd < 0) {
+        PLOG(ERROR) << "open() failed for " << tmp_path;
+        return false;
+    }
+    if (!WriteFully(fd, &header, sizeof(header)) ||
+        !WriteFully(fd, records.data(), records.size() * sizeof(TaskProfilesRecord)) ||
+        !WriteFully(fd, string_refs.data(), string_refs.size() * sizeof(uint32_t)) ||
+        !WriteFully(fd, string_table.data(), string_table.size())) {
+        PLOG(ERROR) << "write() failed for " << tmp_path;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    if (rename(tmp_path.c_str(), path.c_str()) < 0) {
+        PLOG(ERROR) << "rename() failed for " << path;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool TaskProfiles::LoadRcFile(const CgroupMap& cg_map, const std::string& path) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        PLOG(ERROR) << "open() failed for " << path;
+        return false;
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) < 0) {
+        PLOG(ERROR) << "fstat() failed for " << path;
+        return false;
+    }
+
+    size_t file_size = sb.st_size;
+    if (file_size < sizeof(TaskProfilesFile)) {
+        LOG(ERROR) << "Invalid file format " << path;
+        return false;
+    }
+
+    void* file_data = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (file_data == MAP_FAILED) {
+        PLOG(ERROR) << "Failed to mmap " << path;
+        return false;
+    }
+    auto unmap = [&]() { munmap(file_data, file_size); };
+
+    auto header = static_cast<const TaskProfilesFile*>(file_data);
+    if (header->magic_ != TaskProfilesFile::FILE_MAGIC ||
+        header->version_ != TaskProfilesFile::FILE_CURR_VERSION) {
+        LOG(ERROR) << path << " file version mismatch";
+        unmap();
+        return false;
+    }
+
+    uint64_t expected = sizeof(TaskProfilesFile) +
+                        uint64_t(header->record_count_) * sizeof(TaskProfilesRecord) +
+                        uint64_t(header->string_ref_count_) * sizeof(uint32_t) +
+                        header->string_table_size_;
+    if (file_size != expected) {
+        LOG(ERROR) << path << " file has invalid size, expected " << expected << ", actual "
+                   << file_size;
+        unmap();
+        return false;
+    }
+
+    auto records = reinterpret_cast<const TaskProfilesRecord*>(header + 1);
+    auto string_refs = reinterpret_cast<const uint32_t*>(records + header->record_count_);
+    auto string_table = reinterpret_cast<const char*>(string_refs + header->string_ref_count_);
+    if (header->string_table_size_ > 0 && string_table[header->string_table_size_ - 1] != '\0') {
+        LOG(ERROR) << path << " has an unterminated string table";
+        unmap();
+        return false;
+    }
+
+    // Decode the whole file before anything is applied, so that a corrupt file can still be
+    // replaced by the JSON files.
+    std::vector<ProfilesDesc> descs;
+    bool valid = true;
+    for (uint32_t i = 0; valid && i < header->record_count_; ++i) {
+        const TaskProfilesRecord& record = records[i];
+        if (record.string_count_ == 0 ||
+            record.first_string_ > header->string_ref_count_ ||
+            record.string_count_ > header->string_ref_count_ - record.first_string_) {
+            valid = false;
+            break;
+        }
+        std::vector<std::string> strings;
+        for (uint32_t j = 0; j < record.string_count_; ++j) {
+            uint32_t offset = string_refs[record.first_string_ + j];
+            if (offset >= header->string_table_size_) {
+                valid = false;
+                break;
+            }
+            strings.emplace_back(string_table + offset);
+        }
+        if (!valid) break;
+
+        if (record.type_ == TaskProfilesRecord::SOURCE) {
+            descs.emplace_back().file_name = std::move(strings[0]);
+            continue;
+        }
+        if (descs.empty()) {
+            valid = false;
+            break;
+        }
+        ProfilesDesc& desc = descs.back();
+        switch (record.type_) {
+            case TaskProfilesRecord::ATTRIBUTE:
+                if (strings.size() != 4) {
+                    valid = false;
+                    break;
+                }
+                desc.attributes.push_back({std::move(strings[0]), std::move(strings[1]),
+                                           std::move(strings[2]), std::move(strings[3])});
+                break;
+            case TaskProfilesRecord::PROFILE:
+                desc.profiles.emplace_back().name = std::move(strings[0]);
+                break;
+            case TaskProfilesRecord::ACTION: {
+                if (desc.profiles.empty() || strings.size() % 2 != 1) {
+                    valid = false;
+                    break;
+                }
+                auto& action = desc.profiles.back().actions.emplace_back();
+                action.name = std::move(strings[0]);
+                for (size_t j = 1; j < strings.size(); j += 2) {
+                    action.params[std::move(strings[j])] = std::move(strings[j + 1]);
+                }
+                break;
+            }
+            case TaskProfilesRecord::AGGREGATE_PROFILE: {
+                auto& aggregate_profile = desc.aggregate_profiles.emplace_back();
+                aggregate_profile.name = std::move(strings[0]);
+                aggregate_profile.profiles.assign(std::make_move_iterator(strings.begin() + 1),
+                                                  std::make_move_iterator(strings.end()));
+                break;
+            }
+            default:
+                valid = false;
+                break;
+        }
+    }
+    unmap();
+
+    if (!valid) {
+        LOG(ERROR) << path << " is corrupt";
+        return false;
+    }
+
+    for (const auto& desc : descs) {
+        if (!Load(cg_map, desc)) {
+            LOG(ERROR) << "Loading " << desc.file_name << " for [" << getpid() << "] failed";
+        }
+    }
+    return true;
+}
+
 TaskProfile* TaskProfiles::GetProfile(std::string_view name) const {
     auto iter = profiles_.find(name);
 
@@ -1066,6 +1620,29 @@ bool TaskProfiles::SetProcessProfiles(uid_t uid, pid_t pid, std::span<const T> p
     return success;
 }
 
+template <typename T>
+bool TaskProfiles::SetProcessProfiles(uid_t uid, std::span<const pid_t> pids,
+                                      std::span<const T> profiles, bool use_fd_cache) {
+    bool success = true;
+    for (const auto& name : profiles) {
+        TaskProfile* profile = GetProfile(name);
+        if (profile != nullptr) {
+            if (use_fd_cache) {
+                profile->EnableResourceCaching(ProfileAction::RCT_PROCESS);
+            }
+            if (!profile->ExecuteForProcesses(uid, pids)) {
+                LOG(WARNING) << "Failed to apply " << name << " process profile to "
+                             << pids.size() << " processes";
+                success = false;
+            }
+        } else {
+            LOG(WARNING) << "Failed to find " << name << " process profile";
+            success = false;
+        }
+    }
+    return success;
+}
+
 template <typename T>
 bool TaskProfiles::SetTaskProfiles(pid_t tid, std::span<const T> profiles, bool use_fd_cache) {
     bool success = true;
@@ -1093,6 +1670,9 @@ template bool TaskProfiles::SetProcessProfiles(uid_t uid, pid_t pid,
 template bool TaskProfiles::SetProcessProfiles(uid_t uid, pid_t pid,
                                                std::span<const std::string_view> profiles,
                                                bool use_fd_cache);
+template bool TaskProfiles::SetProcessProfiles(uid_t uid, std::span<const pid_t> pids,
+                                               std::span<const std::string_view> profiles,
+                                               bool use_fd_cache);
 template bool TaskProfiles::SetTaskProfiles(pid_t tid, std::span<const std::string> profiles,
                                             bool use_fd_cache);
 template bool TaskProfiles::SetTaskProfiles(pid_t tid, std::span<const std::string_view> profiles,
@@ -18,6 +18,7 @@
 
 #include <sys/types.h>
 
+#include <list>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -77,6 +78,9 @@ class ProfileAction {
 
     // Default implementations will fail
     virtual bool ExecuteForProcess(uid_t, pid_t) const { return false; }
+    // Applies the action to several processes of one UID. Actions that can share work between the
+    // processes override this.
+    virtual bool ExecuteForProcesses(uid_t uid, std::span<const pid_t> pids) const;
     virtual bool ExecuteForTask(int) const { return false; }
     virtual bool ExecuteForUID(uid_t) const { return false; }
 
@@ -84,6 +88,9 @@ class ProfileAction {
     virtual void DropResourceCaching(ResourceCacheType) {}
     virtual bool IsValidForProcess(uid_t, pid_t) const { return false; }
     virtual bool IsValidForTask(pid_t) const { return false; }
+    // Reports the cgroup path, relative to the controller root, that the action moves a task to.
+    // The path may still contain <uid> and <pid> placeholders.
+    virtual bool GetCgroupPath(std::string_view, std::string*) const { return false; }
 
   protected:
     enum CacheUseResult { SUCCESS, FAIL, UNUSED };
@@ -118,6 +125,27 @@ class SetTimerSlackAction : public ProfileAction {
     static bool IsTimerSlackSupported(pid_t tid);
 };
 
+// Set I/O scheduling class and priority profile element
+class SetIoPriorityAction : public ProfileAction {
+  public:
+    // ioprio is a class and priority packed as for ioprio_set(2)
+    SetIoPriorityAction(int ioprio, bool optional) noexcept
+        : ioprio_(ioprio), optional_(optional) {}
+
+    const char* Name() const override { return "SetIoPriority"; }
+    bool ExecuteForProcess(uid_t uid, pid_t pid) const override;
+    bool ExecuteForTask(pid_t tid) const override;
+    bool ExecuteForUID(uid_t uid) const override;
+    bool IsValidForProcess(uid_t, pid_t) const override { return true; }
+    bool IsValidForTask(pid_t) const override { return true; }
+
+  private:
+    int ioprio_;
+    bool optional_;
+
+    bool SetIoPriority(int which, int who) const;
+};
+
 // Set attribute profile element
 class SetAttributeAction : public ProfileAction {
   public:
@@ -146,22 +174,33 @@ class SetCgroupAction : public ProfileAction {
 
     const char* Name() const override { return "SetCgroup"; }
     bool ExecuteForProcess(uid_t uid, pid_t pid) const override;
+    bool ExecuteForProcesses(uid_t uid, std::span<const pid_t> pids) const override;
     bool ExecuteForTask(pid_t tid) const override;
     void EnableResourceCaching(ResourceCacheType cache_type) override;
     void DropResourceCaching(ResourceCacheType cache_type) override;
     bool IsValidForProcess(uid_t uid, pid_t pid) const override;
     bool IsValidForTask(pid_t tid) const override;
+    bool GetCgroupPath(std::string_view controller, std::string* path) const override;
 
     const CgroupController* controller() const { return &controller_; }
 
   private:
+    // How many per-UID procs files are kept open for a path that depends on the UID only.
+    static constexpr size_t kUidFdCacheSize = 16;
+
     CgroupController controller_;
     std::string path_;
     android::base::unique_fd fd_[ProfileAction::RCT_COUNT];
+    // Most recently used first. Only filled when process resource caching is enabled and path_
+    // contains <uid> but not <pid>.
+    mutable std::list<std::pair<uid_t, android::base::unique_fd>> uid_fds_;
+    bool uid_fd_caching_ = false;
     mutable std::mutex fd_mutex_;
 
     bool AddTidToCgroup(pid_t tid, int fd, ResourceCacheType cache_type) const;
     CacheUseResult UseCachedFd(ResourceCacheType cache_type, int id) const;
+    int GetUidProcsFd(uid_t uid, bool reopen) const;
+    bool AddPidsToCgroup(uid_t uid, std::span<const pid_t> pids) const;
 };
 
 // Write to file action
@@ -198,12 +237,15 @@ class TaskProfile {
     void MoveTo(TaskProfile* profile);
 
     bool ExecuteForProcess(uid_t uid, pid_t pid) const;
+    bool ExecuteForProcesses(uid_t uid, std::span<const pid_t> pids) const;
     bool ExecuteForTask(pid_t tid) const;
     bool ExecuteForUID(uid_t uid) const;
     void EnableResourceCaching(ProfileAction::ResourceCacheType cache_type);
     void DropResourceCaching(ProfileAction::ResourceCacheType cache_type);
     bool IsValidForProcess(uid_t uid, pid_t pid) const;
     bool IsValidForTask(pid_t tid) const;
+    // Reports where the profile leaves a task in the controller's hierarchy. Later actions win.
+    bool GetCgroupPath(std::string_view controller, std::string* path) const;
 
   private:
     const std::string name_;
@@ -219,11 +261,13 @@ class ApplyProfileAction : public ProfileAction {
 
     const char* Name() const override { return "ApplyProfileAction"; }
     bool ExecuteForProcess(uid_t uid, pid_t pid) const override;
+    bool ExecuteForProcesses(uid_t uid, std::span<const pid_t> pids) const override;
     bool ExecuteForTask(pid_t tid) const override;
     void EnableResourceCaching(ProfileAction::ResourceCacheType cache_type) override;
     void DropResourceCaching(ProfileAction::ResourceCacheType cache_type) override;
     bool IsValidForProcess(uid_t uid, pid_t pid) const override;
     bool IsValidForTask(pid_t tid) const override;
+    bool GetCgroupPath(std::string_view controller, std::string* path) const override;
 
   private:
     std::vector<std::shared_ptr<TaskProfile>> profiles_;
@@ -240,14 +284,51 @@ class TaskProfiles {
     template <typename T>
     bool SetProcessProfiles(uid_t uid, pid_t pid, std::span<const T> profiles, bool use_fd_cache);
     template <typename T>
+    bool SetProcessProfiles(uid_t uid, std::span<const pid_t> pids, std::span<const T> profiles,
+                            bool use_fd_cache);
+    template <typename T>
     bool SetTaskProfiles(pid_t tid, std::span<const T> profiles, bool use_fd_cache);
     template <typename T>
     bool SetUserProfiles(uid_t uid, std::span<const T> profiles, bool use_fd_cache);
 
+    // Flattens the task profiles JSON files into a file that later instances load instead.
+    static bool WriteRcFile(const std::string& path);
+
   private:
+    // The contents of one task profiles file, before controllers and attributes are resolved.
+    struct ProfilesDesc {
+        struct Attribute {
+            std::string name, controller, file, file_v2;
+        };
+        struct Action {
+            std::string name;
+            std::map<std::string, std::string, std::less<>> params;
+
+            // Returns the empty string for missing parameters, like Json::Value does.
+            const std::string& Param(std::string_view key) const;
+        };
+        struct Profile {
+            std::string name;
+            std::vector<Action> actions;
+        };
+        struct AggregateProfile {
+            std::string name;
+            std::vector<std::string> profiles;
+        };
+
+        std::string file_name;
+        std::vector<Attribute> attributes;
+        std::vector<Profile> profiles;
+        std::vector<AggregateProfile> aggregate_profiles;
+    };
+
     TaskProfiles();
 
+    static std::vector<std::string> ProfileFiles();
+    static bool ReadDesc(const std::string& file_name, ProfilesDesc* desc);
     bool Load(const CgroupMap& cg_map, const std::string& file_name);
+    bool Load(const CgroupMap& cg_map, const ProfilesDesc& desc);
+    bool LoadRcFile(const CgroupMap& cg_map, const std::string& path);
 
     std::map<std::string, std::shared_ptr<TaskProfile>, std::less<>> profiles_;
     std::map<std::string, std::unique_ptr<IProfileAttribute>, std::less<>> attributes_;
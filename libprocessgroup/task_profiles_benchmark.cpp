@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Latency of applying task profiles and of process group setup and teardown. Needs root on a
+// device with the cgroup hierarchy and task profiles set up by init.
+//
+// Profiles are applied to forked subject processes rather than to the benchmark itself, and
+// process groups are created under an app uid that is practically never assigned, so a run
+// leaves nothing behind in the cgroups of real apps.
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+#include <benchmark/benchmark.h>
+#include <cutils/android_filesystem_config.h>
+#include <processgroup/processgroup.h>
+
+using android::base::unique_fd;
+
+namespace {
+
+constexpr uid_t kScratchUid = AID_APP_END;
+
+// A process for profiles to be applied to, running |threads| threads which block until the
+// process is killed.
+class Subject {
+  public:
+    explicit Subject(int threads) {
+        int fds[2];
+        if (pipe(fds) < 0) {
+            return;
+        }
+        unique_fd read_end(fds[0]), write_end(fds[1]);
+
+        pid_ = fork();
+        if (pid_ == 0) {
+            read_end.reset();
+            for (int i = 1; i < threads; i++) {
+                std::thread([] {
+                    while (true) pause();
+                }).detach();
+            }
+            char ready = 0;
+            (void)write(write_end.get(), &ready, 1);
+            while (true) pause();
+        }
+        write_end.reset();
+
+        char ready;
+        if (pid_ > 0 && TEMP_FAILURE_RETRY(read(read_end.get(), &ready, 1)) != 1) {
+            Kill();
+        }
+    }
+
+    ~Subject() { Kill(); }
+
+    bool ok() const { return pid_ > 0; }
+    pid_t pid() const { return pid_; }
+
+    void Kill() {
+        if (pid_ > 0) {
+            kill(pid_, SIGKILL);
+            TEMP_FAILURE_RETRY(waitpid(pid_, nullptr, 0));
+        }
+        pid_ = -1;
+    }
+
+  private:
+    pid_t pid_ = -1;
+};
+
+// Alternates the main thread of a subject between two profiles, as a thread switching between
+// foreground and background would.
+void BM_SetTaskProfiles(benchmark::State& state, const char* from, const char* to) {
+    bool use_fd_cache = state.range(0);
+    Subject subject(1);
+    if (!subject.ok()) {
+        state.SkipWithError("Could not start subject process");
+        return;
+    }
+    DropTaskProfilesResourceCaching();
+
+    const std::vector<std::string> profiles[] = {{from}, {to}};
+    size_t i = 0;
+    for (auto _ : state) {
+        if (!SetTaskProfiles(subject.pid(), profiles[i++ & 1], use_fd_cache)) {
+            state.SkipWithError("SetTaskProfiles failed");
+            break;
+        }
+    }
+}
+BENCHMARK_CAPTURE(BM_SetTaskProfiles, sched_fg_bg, "SCHED_SP_FOREGROUND", "SCHED_SP_BACKGROUND")
+        ->ArgName("use_fd_cache")
+        ->Arg(0)
+        ->Arg(1);
+BENCHMARK_CAPTURE(BM_SetTaskProfiles, cpuset_top_bg, "CPUSET_SP_TOP_APP", "CPUSET_SP_BACKGROUND")
+        ->ArgName("use_fd_cache")
+        ->Arg(0)
+        ->Arg(1);
+BENCHMARK_CAPTURE(BM_SetTaskProfiles, perf_high_low, "HighPerformance", "HighEnergySaving")
+        ->ArgName("use_fd_cache")
+        ->Arg(0)
+        ->Arg(1);
+
+// Moves a whole app process between top-app and background, as the activity manager does on an
+// app transition, with and without the cached per-uid resources.
+void BM_SetProcessProfiles(benchmark::State& state) {
+    bool cached = state.range(0);
+    Subject subject(1);
+    if (!subject.ok()) {
+        state.SkipWithError("Could not start subject process");
+        return;
+    }
+    DropTaskProfilesResourceCaching();
+
+    const std::vector<std::string> profiles[] = {{"CPUSET_SP_TOP_APP", "SCHED_SP_TOP_APP"},
+                                                 {"CPUSET_SP_BACKGROUND", "SCHED_SP_BACKGROUND"}};
+    size_t i = 0;
+    for (auto _ : state) {
+        const auto& next = profiles[i++ & 1];
+        bool ok = cached ? SetProcessProfilesCached(kScratchUid, subject.pid(), next)
+                         : SetProcessProfiles(kScratchUid, subject.pid(), next);
+        if (!ok) {
+            state.SkipWithError("SetProcessProfiles failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_SetProcessProfiles)->ArgName("cached")->Arg(0)->Arg(1);
+
+// Cost of moving a process between cpusets as its thread count grows; the kernel migrates every
+// thread of the process.
+void BM_SetProcessProfilesThreads(benchmark::State& state) {
+    Subject subject(state.range(0));
+    if (!subject.ok()) {
+        state.SkipWithError("Could not start subject process");
+        return;
+    }
+    DropTaskProfilesResourceCaching();
+
+    const std::vector<std::string> profiles[] = {{"CPUSET_SP_TOP_APP"}, {"CPUSET_SP_BACKGROUND"}};
+    size_t i = 0;
+    for (auto _ : state) {
+        if (!SetProcessProfiles(kScratchUid, subject.pid(), profiles[i++ & 1])) {
+            state.SkipWithError("SetProcessProfiles failed");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_SetProcessProfilesThreads)->ArgName("threads")->RangeMultiplier(4)->Range(1, 256);
+
+// Puts a fresh process in its own process group and kills the group again, as happens for every
+// app process started and stopped. Starting and reaping the process is not timed.
+void BM_CreateKillProcessGroup(benchmark::State& state) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        Subject subject(1);
+        if (!subject.ok()) {
+            state.SkipWithError("Could not start subject process");
+            break;
+        }
+        state.ResumeTiming();
+
+        if (createProcessGroup(kScratchUid, subject.pid()) != 0) {
+            state.SkipWithError("createProcessGroup failed");
+            break;
+        }
+        if (killProcessGroup(kScratchUid, subject.pid(), SIGKILL) != 0) {
+            state.SkipWithError("killProcessGroup failed");
+            break;
+        }
+
+        state.PauseTiming();
+        subject.Kill();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_CreateKillProcessGroup);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace android {
+namespace processgroup {
+namespace format {
+
+// Flattened contents of the task profiles JSON files. Init writes it once cgroups are set up so
+// that other processes can mmap it rather than parse the JSON files themselves.
+//
+// The header is followed by record_count_ TaskProfilesRecords, then string_ref_count_ uint32_t
+// offsets into the string table, then string_table_size_ bytes of NUL-terminated strings.
+struct TaskProfilesFile {
+    uint32_t magic_;
+    uint32_t version_;
+    uint32_t record_count_;
+    uint32_t string_ref_count_;
+    uint32_t string_table_size_;
+
+    static constexpr uint32_t FILE_MAGIC = 0x46505354;  // "TSPF"
+    static constexpr uint32_t FILE_VERSION_1 = 1;
+    static constexpr uint32_t FILE_CURR_VERSION = FILE_VERSION_1;
+};
+
+// The strings of a record are string_count_ consecutive string refs starting at first_string_:
+//   SOURCE:            file name; starts the records read from that file
+//   ATTRIBUTE:         name, controller, file, file v2
+//   PROFILE:           name
+//   ACTION:            name, then key and value of each parameter; belongs to the last PROFILE
+//   AGGREGATE_PROFILE: name, then the names of the profiles it applies
+struct TaskProfilesRecord {
+    enum Type : uint32_t {
+        SOURCE = 0,
+        ATTRIBUTE,
+        PROFILE,
+        ACTION,
+        AGGREGATE_PROFILE,
+    };
+
+    uint32_t type_;
+    uint32_t first_string_;
+    uint32_t string_count_;
+};
+
+}  // namespace format
+}  // namespace processgroup
+}  // namespace android
@@ -21,6 +21,7 @@
 #include <mntent.h>
 #include <processgroup/processgroup.h>
 #include <stdio.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include <fstream>
@@ -202,6 +203,26 @@ TEST_P(TaskProfileFixture, TaskProfile) {
     EXPECT_EQ(tp2.IsValidForTask(getpid()), params.result);
 }
 
+TEST(SetIoPriorityActionTest, ExecuteForTask) {
+#ifdef __ANDROID__
+    constexpr int kIoprioWhoProcess = 1;
+    constexpr int kBestEffortLowest = (2 << 13) | 7;
+    pid_t tid = gettid();
+    int saved = syscall(SYS_ioprio_get, kIoprioWhoProcess, tid);
+    ASSERT_GE(saved, 0);
+
+    SetIoPriorityAction a(kBestEffortLowest, false);
+    EXPECT_TRUE(a.ExecuteForTask(tid));
+    EXPECT_EQ(syscall(SYS_ioprio_get, kIoprioWhoProcess, tid), kBestEffortLowest);
+
+    // Raising the priority back needs no privileges within the best-effort class
+    SetIoPriorityAction restore(saved, false);
+    EXPECT_TRUE(restore.ExecuteForTask(tid));
+#else
+    GTEST_SKIP() << "ioprio actions are no-ops off Android";
+#endif
+}
+
 // Test the four combinations of optional_attr {false, true} and cgroup attribute { does not exist,
 // exists }.
 INSTANTIATE_TEST_SUITE_P(
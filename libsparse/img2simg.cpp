@@ -38,7 +38,12 @@
 #endif
 
 void usage() {
-  fprintf(stderr, "Usage: img2simg [-s] <raw_image_file> <sparse_image_file> [<block_size>]\n");
+  fprintf(stderr,
+          "Usage: img2simg [-s] [-c] [-j <threads>] <raw_image_file> <sparse_image_file> "
+          "[<block_size>]\n"
+          "  -s  detect holes in the raw image\n"
+          "  -c  append a crc chunk\n"
+          "  -j  threads used to write, 0 for one per CPU (default 1)\n");
 }
 
 int main(int argc, char* argv[]) {
@@ -52,13 +57,21 @@ int main(int argc, char* argv[]) {
   int ret;
   struct sparse_file* s;
   unsigned int block_size = 4096;
+  unsigned int threads = 1;
+  bool crc = false;
   off64_t len;
 
-  while ((opt = getopt(argc, argv, "s")) != -1) {
+  while ((opt = getopt(argc, argv, "scj:")) != -1) {
     switch (opt) {
       case 's':
         mode = SPARSE_READ_MODE_HOLE;
         break;
+      case 'c':
+        crc = true;
+        break;
+      case 'j':
+        threads = atoi(optarg);
+        break;
       default:
         usage();
         exit(EXIT_FAILURE);
@@ -112,13 +125,14 @@ int main(int argc, char* argv[]) {
   }
 
   sparse_file_verbose(s);
+  sparse_file_set_threads(s, threads);
   ret = sparse_file_read(s, in, mode, false);
   if (ret) {
     fprintf(stderr, "Failed to read file\n");
     exit(EXIT_FAILURE);
   }
 
-  ret = sparse_file_write(s, out, false, true, false);
+  ret = sparse_file_write(s, out, false, true, crc);
   if (ret) {
     fprintf(stderr, "Failed to write sparse file\n");
     exit(EXIT_FAILURE);
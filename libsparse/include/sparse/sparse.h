@@ -333,6 +333,171 @@ int sparse_file_resparse(struct sparse_file *in_s, unsigned int max_len,
  */
 void sparse_file_verbose(struct sparse_file *s);
 
+/**
+ * sparse_file_set_threads - set the number of threads used to write
+ *
+ * @s - sparse file cookie
+ * @threads - number of threads, or 0 for one per CPU
+ *
+ * Lets sparse_file_write() and sparse_file_callback() spread crc calculation
+ * and gzip compression over several threads.  The output is the same as
+ * with a single thread, except that gzip data is deflated in independent
+ * blocks.  The default is 1.
+ */
+void sparse_file_set_threads(struct sparse_file *s, unsigned int threads);
+
+struct sparse_index;
+
+/**
+ * enum sparse_index_type - kind of chunk a sparse_index_entry came from
+ */
+enum sparse_index_type {
+	SPARSE_INDEX_RAW = 0xCAC1,
+	SPARSE_INDEX_FILL = 0xCAC2,
+	SPARSE_INDEX_DONT_CARE = 0xCAC3,
+};
+
+/**
+ * struct sparse_index_entry - one chunk of a sparse image
+ *
+ * @offset - offset of the chunk in the expanded image
+ * @len - length of the chunk in the expanded image
+ * @type - what the chunk holds
+ * @fill_val - fill value, for SPARSE_INDEX_FILL
+ * @data_offset - offset of the data in the sparse image, for SPARSE_INDEX_RAW
+ */
+struct sparse_index_entry {
+	int64_t offset;
+	int64_t len;
+	enum sparse_index_type type;
+	uint32_t fill_val;
+	int64_t data_offset;
+};
+
+/**
+ * sparse_index_build - index the chunks of an Android sparse image
+ *
+ * @fd - file descriptor of the sparse image
+ *
+ * Reads only the chunk headers of the image, using positioned reads so the
+ * file offset of @fd is not changed.  The index can be saved as a sidecar
+ * file with sparse_index_save() so that later readers skip even that.
+ *
+ * Returns the index, or NULL on error.
+ */
+struct sparse_index *sparse_index_build(int fd);
+
+/**
+ * sparse_index_save - write an index to a sidecar file
+ *
+ * @index - index
+ * @index_fd - file descriptor to write the index to
+ *
+ * Returns 0 on success, negative errno on error.
+ */
+int sparse_index_save(struct sparse_index *index, int index_fd);
+
+/**
+ * sparse_index_load - read an index sidecar file
+ *
+ * @index_fd - file descriptor of the index sidecar file
+ * @image_fd - file descriptor of the sparse image it describes
+ *
+ * The index is rejected if it is corrupt or was built from a different
+ * image (checked by size and header).
+ *
+ * Returns the index, or NULL on error.
+ */
+struct sparse_index *sparse_index_load(int index_fd, int image_fd);
+
+/**
+ * sparse_index_destroy - free an index
+ *
+ * @index - index
+ */
+void sparse_index_destroy(struct sparse_index *index);
+
+/**
+ * sparse_index_len - size of the expanded image
+ *
+ * @index - index
+ */
+int64_t sparse_index_len(struct sparse_index *index);
+
+/**
+ * sparse_index_lookup - find the chunk holding an offset of the expanded image
+ *
+ * @index - index
+ * @offset - offset in the expanded image
+ * @entry - filled in with the chunk containing @offset
+ *
+ * Runs in O(log n) in the number of chunks.
+ *
+ * Returns 0 on success, -EINVAL if @offset is outside the image.
+ */
+int sparse_index_lookup(struct sparse_index *index, int64_t offset,
+		struct sparse_index_entry *entry);
+
+/**
+ * sparse_index_read - read part of the expanded image
+ *
+ * @index - index
+ * @image_fd - file descriptor of the sparse image
+ * @offset - offset in the expanded image
+ * @buf - buffer to read into
+ * @len - number of bytes to read
+ *
+ * "Don't care" data reads as zeros.
+ *
+ * Returns 0 on success, negative errno on error.
+ */
+int sparse_index_read(struct sparse_index *index, int image_fd, int64_t offset, void *buf,
+		size_t len);
+
+/**
+ * struct sparse_stream_chunk - piece of an Android sparse image passed to
+ * the callback of sparse_file_stream()
+ *
+ * @type - what the piece holds
+ * @block_size - block size of the image
+ * @image_len - size of the expanded image
+ * @offset - offset of the piece in the expanded image
+ * @len - length of the piece in the expanded image
+ * @fill_val - fill value, for SPARSE_INDEX_FILL
+ * @data - @len bytes of data, for SPARSE_INDEX_RAW
+ */
+struct sparse_stream_chunk {
+	enum sparse_index_type type;
+	unsigned int block_size;
+	int64_t image_len;
+	int64_t offset;
+	int64_t len;
+	uint32_t fill_val;
+	const void *data;
+};
+
+/**
+ * sparse_file_stream - read an Android sparse image in a single forward pass
+ *
+ * @fd - file descriptor to read from, which need not be seekable
+ * @crc - verify the crc of the image
+ * @chunk - function to call for each piece of the image
+ * @priv - value that will be passed as the first argument to chunk
+ *
+ * Reads the image strictly sequentially, so @fd can be a pipe or a socket,
+ * and memory use does not depend on the size of the image.  @chunk is
+ * called in order of offset, once for each fill and "don't care" chunk and
+ * once for every piece of up to 1MB of a raw chunk.  The data pointer is
+ * only valid during the call.  A crc chunk is checked against the data
+ * passed before it, so with @crc a mismatch is only reported after that
+ * data went to @chunk.  The callback should return negative on error,
+ * 0 on success.
+ *
+ * Returns 0 on success, negative errno on error.
+ */
+int sparse_file_stream(int fd, bool crc,
+		int (*chunk)(void *priv, const struct sparse_stream_chunk *chunk), void *priv);
+
 /**
  * sparse_print_verbose - function called to print verbose errors
  *
@@ -30,6 +30,15 @@
 #include <unistd.h>
 #include <zlib.h>
 
+#if defined(__linux__)
+#include <linux/falloc.h>
+#include <sys/syscall.h>
+#endif
+
+#include <new>
+#include <thread>
+#include <vector>
+
 #include "defs.h"
 #include "output_file.h"
 #include "sparse_crc32.h"
@@ -60,12 +69,25 @@
 
 static constexpr size_t kMaxMmapSize = 256 * 1024 * 1024;
 
+/* Smallest slice of a buffer worth checksumming on its own thread */
+static constexpr size_t kMinCrcSliceSize = 1024 * 1024;
+
+/* Input size of each independently deflated block of a parallel gzip stream */
+static constexpr size_t kGzBlockSize = 1024 * 1024;
+
+/* Each block is primed with up to this much of the data before it */
+static constexpr size_t kGzDictSize = 32 * 1024;
+
 struct output_file_ops {
   int (*open)(struct output_file*, int fd);
   int (*skip)(struct output_file*, int64_t);
   int (*pad)(struct output_file*, int64_t);
   int (*write)(struct output_file*, void*, size_t);
   void (*close)(struct output_file*);
+  /* Optional: skip |len| bytes that must read back as zero */
+  int (*punch)(struct output_file*, int64_t len);
+  /* Optional: copy |len| bytes at |offset| of |fd| without passing through memory */
+  int (*copy_fd)(struct output_file*, int fd, int64_t offset, uint64_t len);
 };
 
 struct sparse_file_ops {
@@ -83,6 +105,7 @@ struct output_file {
   struct output_file_ops* ops;
   struct sparse_file_ops* sparse_ops;
   int use_crc;
+  unsigned int threads;
   unsigned int block_size;
   int64_t len;
   char* zero_buf;
@@ -104,6 +127,23 @@ struct output_file_normal {
 
 #define to_output_file_normal(_o) container_of((_o), struct output_file_normal, out)
 
+/*
+ * gzip output compressed on several threads. Data is collected into batches
+ * of |threads| blocks; each block is deflated on its own with the previous
+ * 32K as dictionary and ends on a byte boundary, so the blocks concatenate
+ * into a single deflate stream.
+ */
+struct output_file_pgz {
+  struct output_file out;
+  int fd;
+  uint32_t crc;
+  uint64_t in_len;
+  std::vector<char> pending;
+  std::vector<char> dict;
+};
+
+#define to_output_file_pgz(_o) container_of((_o), struct output_file_pgz, out)
+
 struct output_file_callback {
   struct output_file out;
   void* priv;
@@ -143,12 +183,11 @@ static int file_pad(struct output_file* out, int64_t len) {
   return 0;
 }
 
-static int file_write(struct output_file* out, void* data, size_t len) {
+static int write_all(int fd, const void* data, size_t len) {
   ssize_t ret;
-  struct output_file_normal* outn = to_output_file_normal(out);
 
   while (len > 0) {
-    ret = write(outn->fd, data, len);
+    ret = write(fd, data, len);
     if (ret < 0) {
       if (errno == EINTR) {
         continue;
@@ -157,25 +196,92 @@ static int file_write(struct output_file* out, void* data, size_t len) {
       return -1;
     }
 
-    data = (char*)data + ret;
+    data = (const char*)data + ret;
     len -= ret;
   }
 
   return 0;
 }
 
+static int file_write(struct output_file* out, void* data, size_t len) {
+  struct output_file_normal* outn = to_output_file_normal(out);
+
+  return write_all(outn->fd, data, len);
+}
+
 static void file_close(struct output_file* out) {
   struct output_file_normal* outn = to_output_file_normal(out);
 
   free(outn);
 }
 
+static int file_punch(struct output_file* out, int64_t len) {
+#if defined(__linux__)
+  struct output_file_normal* outn = to_output_file_normal(out);
+  off64_t pos = lseek64(outn->fd, 0, SEEK_CUR);
+
+  if (pos < 0) {
+    return -errno;
+  }
+  /* Leaves a hole on filesystems, and zeroes (usually by unmapping) block devices */
+  if (fallocate(outn->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, pos, len) < 0) {
+    return -errno;
+  }
+  return file_skip(out, len);
+#else
+  (void)out;
+  (void)len;
+  return -EOPNOTSUPP;
+#endif
+}
+
+static int file_copy_fd(struct output_file* out, int fd, int64_t offset, uint64_t len) {
+#if defined(__linux__) && defined(__NR_copy_file_range)
+  struct output_file_normal* outn = to_output_file_normal(out);
+  loff_t in_off = offset;
+
+  /*
+   * Called directly so that older bionic and glibc still get it. Only the
+   * first call may fail with "not supported"; after that the copy has
+   * started and any error is real.
+   */
+  while (len > 0) {
+    size_t count = std::min<uint64_t>(len, kMaxMmapSize);
+    ssize_t ret = syscall(__NR_copy_file_range, fd, &in_off, outn->fd, nullptr, count, 0);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (in_off == offset) {
+        return -EOPNOTSUPP;
+      }
+      error_errno("copy_file_range");
+      return -1;
+    }
+    if (ret == 0) {
+      error("copy_file_range: unexpected end of input");
+      return -1;
+    }
+    len -= ret;
+  }
+  return 0;
+#else
+  (void)out;
+  (void)fd;
+  (void)offset;
+  (void)len;
+  return -EOPNOTSUPP;
+#endif
+}
+
 static struct output_file_ops file_ops = {
     .open = file_open,
     .skip = file_skip,
     .pad = file_pad,
     .write = file_write,
     .close = file_close,
+    .punch = file_punch,
+    .copy_fd = file_copy_fd,
 };
 
 static int gz_file_open(struct output_file* out, int fd) {
@@ -257,6 +363,182 @@ static struct output_file_ops gz_file_ops = {
     .close = gz_file_close,
 };
 
+struct pgz_block {
+  const char* in;
+  size_t in_len;
+  const char* dict;
+  size_t dict_len;
+  bool finish;
+  bool ok;
+  uint32_t crc;
+  std::vector<char> out;
+};
+
+static void pgz_compress_block(struct pgz_block* blk) {
+  z_stream strm = {};
+  int ret;
+
+  blk->ok = false;
+  blk->crc = crc32(0, reinterpret_cast<const Bytef*>(blk->in), blk->in_len);
+
+  if (deflateInit2(&strm, 9, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return;
+  }
+  if (blk->dict_len &&
+      deflateSetDictionary(&strm, reinterpret_cast<const Bytef*>(blk->dict), blk->dict_len) !=
+          Z_OK) {
+    deflateEnd(&strm);
+    return;
+  }
+
+  /* Room for the worst case plus the empty stored block of a sync flush */
+  blk->out.resize(deflateBound(&strm, blk->in_len) + 16);
+  strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(blk->in));
+  strm.avail_in = blk->in_len;
+  strm.next_out = reinterpret_cast<Bytef*>(blk->out.data());
+  strm.avail_out = blk->out.size();
+
+  ret = deflate(&strm, blk->finish ? Z_FINISH : Z_SYNC_FLUSH);
+  if (blk->finish) {
+    blk->ok = ret == Z_STREAM_END;
+  } else {
+    blk->ok = ret == Z_OK && strm.avail_in == 0 && strm.avail_out != 0;
+  }
+  blk->out.resize(strm.total_out);
+  deflateEnd(&strm);
+}
+
+/* Compress and write out everything in |pending|; |last| ends the deflate stream */
+static int pgz_flush(struct output_file_pgz* outpgz, bool last) {
+  std::vector<char>& pending = outpgz->pending;
+  size_t nr_blocks = DIV_ROUND_UP(pending.size(), kGzBlockSize);
+  std::vector<struct pgz_block> blocks;
+  std::vector<std::thread> threads;
+
+  if (!nr_blocks && !last) {
+    return 0;
+  }
+  blocks.resize(std::max<size_t>(nr_blocks, 1));
+  for (size_t i = 0; i < blocks.size(); i++) {
+    struct pgz_block* blk = &blocks[i];
+    size_t offset = i * kGzBlockSize;
+
+    blk->in = pending.data() + offset;
+    blk->in_len = std::min(kGzBlockSize, pending.size() - offset);
+    if (i == 0) {
+      blk->dict = outpgz->dict.data();
+      blk->dict_len = outpgz->dict.size();
+    } else {
+      blk->dict_len = std::min(kGzDictSize, offset);
+      blk->dict = blk->in - blk->dict_len;
+    }
+    blk->finish = last && i == blocks.size() - 1;
+  }
+
+  for (size_t i = 1; i < blocks.size(); i++) {
+    threads.emplace_back(pgz_compress_block, &blocks[i]);
+  }
+  pgz_compress_block(&blocks[0]);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (auto& blk : blocks) {
+    if (!blk.ok) {
+      error("deflate failed");
+      return -1;
+    }
+    if (write_all(outpgz->fd, blk.out.data(), blk.out.size()) < 0) {
+      return -1;
+    }
+    outpgz->crc = crc32_combine(outpgz->crc, blk.crc, blk.in_len);
+  }
+
+  if (pending.size() >= kGzDictSize) {
+    outpgz->dict.assign(pending.end() - kGzDictSize, pending.end());
+  } else {
+    outpgz->dict.insert(outpgz->dict.end(), pending.begin(), pending.end());
+    if (outpgz->dict.size() > kGzDictSize) {
+      outpgz->dict.erase(outpgz->dict.begin(), outpgz->dict.end() - kGzDictSize);
+    }
+  }
+  outpgz->in_len += pending.size();
+  pending.clear();
+
+  return 0;
+}
+
+/* Queue |len| bytes of |data|, or of zeros if |data| is null */
+static int pgz_append(struct output_file_pgz* outpgz, const char* data, uint64_t len) {
+  size_t batch = kGzBlockSize * outpgz->out.threads;
+
+  while (len > 0) {
+    size_t count = std::min<uint64_t>(len, batch - outpgz->pending.size());
+    if (data) {
+      outpgz->pending.insert(outpgz->pending.end(), data, data + count);
+      data += count;
+    } else {
+      outpgz->pending.resize(outpgz->pending.size() + count, 0);
+    }
+    len -= count;
+    if (outpgz->pending.size() == batch && pgz_flush(outpgz, false) < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int pgz_file_open(struct output_file* out, int fd) {
+  struct output_file_pgz* outpgz = to_output_file_pgz(out);
+  /* magic, deflate, no flags, no mtime, max compression, unix */
+  static const unsigned char header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 2, 3};
+
+  outpgz->fd = fd;
+  outpgz->pending.reserve(kGzBlockSize * out->threads);
+  return write_all(fd, header, sizeof(header));
+}
+
+static int pgz_file_skip(struct output_file* out, int64_t cnt) {
+  return pgz_append(to_output_file_pgz(out), nullptr, cnt);
+}
+
+static int pgz_file_pad(struct output_file* out, int64_t len) {
+  struct output_file_pgz* outpgz = to_output_file_pgz(out);
+  int64_t cur = outpgz->in_len + outpgz->pending.size();
+
+  if (cur >= len) {
+    return 0;
+  }
+  return pgz_append(outpgz, nullptr, len - cur);
+}
+
+static int pgz_file_write(struct output_file* out, void* data, size_t len) {
+  return pgz_append(to_output_file_pgz(out), reinterpret_cast<const char*>(data), len);
+}
+
+static void pgz_file_close(struct output_file* out) {
+  struct output_file_pgz* outpgz = to_output_file_pgz(out);
+  unsigned char trailer[8];
+
+  if (pgz_flush(outpgz, true) == 0) {
+    for (int i = 0; i < 4; i++) {
+      trailer[i] = outpgz->crc >> (8 * i);
+      trailer[4 + i] = outpgz->in_len >> (8 * i);
+    }
+    write_all(outpgz->fd, trailer, sizeof(trailer));
+  }
+  delete outpgz;
+}
+
+static struct output_file_ops pgz_file_ops = {
+    .open = pgz_file_open,
+    .skip = pgz_file_skip,
+    .pad = pgz_file_pad,
+    .write = pgz_file_write,
+    .close = pgz_file_close,
+};
+
 static int callback_file_open(struct output_file* out __unused, int fd __unused) {
   return 0;
 }
@@ -321,6 +603,46 @@ int read_all(int fd, void* buf, size_t len) {
   return 0;
 }
 
+/*
+ * Same result as sparse_crc32(), but large buffers are split into slices
+ * that are checksummed on separate threads and then folded together in order
+ * with crc32_combine().
+ */
+static uint32_t output_file_crc32(struct output_file* out, uint32_t crc, const void* data,
+                                  uint64_t len) {
+  const char* p = reinterpret_cast<const char*>(data);
+
+  while (len > 0) {
+    /* Bound each pass so that slice lengths fit in crc32_combine()'s z_off_t */
+    size_t pass = std::min<uint64_t>(len, kMaxMmapSize);
+    size_t nr_slices = std::min<size_t>(out->threads, pass / kMinCrcSliceSize);
+
+    if (nr_slices <= 1) {
+      crc = sparse_crc32(crc, p, pass);
+    } else {
+      size_t slice = DIV_ROUND_UP(pass, nr_slices);
+      std::vector<uint32_t> crcs(nr_slices);
+      std::vector<std::thread> threads;
+
+      for (size_t i = 0; i < nr_slices; i++) {
+        size_t offset = i * slice;
+        size_t slice_len = std::min(slice, pass - offset);
+        threads.emplace_back([&crcs, i, p, offset, slice_len]() {
+          crcs[i] = sparse_crc32(0, p + offset, slice_len);
+        });
+      }
+      for (size_t i = 0; i < nr_slices; i++) {
+        threads[i].join();
+        crc = crc32_combine(crc, crcs[i], std::min(slice, pass - i * slice));
+      }
+    }
+    p += pass;
+    len -= pass;
+  }
+
+  return crc;
+}
+
 template <typename T>
 static bool write_fd_chunk_range(int fd, int64_t offset, uint64_t len, T callback) {
   uint64_t bytes_written = 0;
@@ -429,7 +751,7 @@ static int write_sparse_data_chunk(struct output_file* out, uint64_t len, void*
   }
 
   if (out->use_crc) {
-    out->crc32 = sparse_crc32(out->crc32, data, len);
+    out->crc32 = output_file_crc32(out, out->crc32, data, len);
     if (zero_len) {
       uint64_t len = zero_len;
       uint64_t write_len;
@@ -468,7 +790,7 @@ static int write_sparse_fd_chunk(struct output_file* out, uint64_t len, int fd,
     ret = out->ops->write(out, data, size);
     if (ret < 0) return false;
     if (out->use_crc) {
-      out->crc32 = sparse_crc32(out->crc32, data, size);
+      out->crc32 = output_file_crc32(out, out->crc32, data, size);
     }
     return true;
   });
@@ -556,6 +878,11 @@ static int write_normal_fill_chunk(struct output_file* out, uint64_t len, uint32
   unsigned int i;
   uint64_t write_len;
 
+  /* Zero fills don't need to be written out if the output can hold holes */
+  if (fill_val == 0 && out->ops->punch && out->ops->punch(out, len) == 0) {
+    return 0;
+  }
+
   /* Initialize fill_buf with the fill_val */
   for (i = 0; i < FILL_ZERO_BUFSIZE / sizeof(uint32_t); i++) {
     out->fill_buf[i] = fill_val;
@@ -575,14 +902,23 @@ static int write_normal_fill_chunk(struct output_file* out, uint64_t len, uint32
 }
 
 static int write_normal_fd_chunk(struct output_file* out, uint64_t len, int fd, int64_t offset) {
-  int ret;
+  int ret = -EOPNOTSUPP;
   uint64_t rnd_up_len = ALIGN(len, out->block_size);
 
-  bool ok = write_fd_chunk_range(fd, offset, len, [&ret, out](char* data, size_t size) -> bool {
-    ret = out->ops->write(out, data, size);
-    return ret >= 0;
-  });
-  if (!ok) return ret;
+  /* Let the kernel copy (or reflink) the data if it can, otherwise map and write it */
+  if (out->ops->copy_fd) {
+    ret = out->ops->copy_fd(out, fd, offset, len);
+    if (ret < 0 && ret != -EOPNOTSUPP) {
+      return ret;
+    }
+  }
+  if (ret == -EOPNOTSUPP) {
+    bool ok = write_fd_chunk_range(fd, offset, len, [&ret, out](char* data, size_t size) -> bool {
+      ret = out->ops->write(out, data, size);
+      return ret >= 0;
+    });
+    if (!ok) return ret;
+  }
 
   if (rnd_up_len > len) {
     ret = out->ops->skip(out, rnd_up_len - len);
@@ -692,6 +1028,18 @@ static struct output_file* output_file_new_gz(void) {
   return &outgz->out;
 }
 
+static struct output_file* output_file_new_pgz(void) {
+  struct output_file_pgz* outpgz = new (std::nothrow) output_file_pgz();
+  if (!outpgz) {
+    error_errno("malloc struct outpgz");
+    return nullptr;
+  }
+
+  outpgz->out.ops = &pgz_file_ops;
+
+  return &outpgz->out;
+}
+
 static struct output_file* output_file_new_normal(void) {
   struct output_file_normal* outn =
       reinterpret_cast<struct output_file_normal*>(calloc(1, sizeof(struct output_file_normal)));
@@ -707,7 +1055,8 @@ static struct output_file* output_file_new_normal(void) {
 
 struct output_file* output_file_open_callback(int (*write)(void*, const void*, size_t), void* priv,
                                               unsigned int block_size, int64_t len, int gz __unused,
-                                              int sparse, int chunks, int crc) {
+                                              int sparse, int chunks, int crc,
+                                              unsigned int threads) {
   int ret;
   struct output_file_callback* outc;
 
@@ -719,6 +1068,7 @@ struct output_file* output_file_open_callback(int (*write)(void*, const void*, s
   }
 
   outc->out.ops = &callback_file_ops;
+  outc->out.threads = std::max(threads, 1u);
   outc->priv = priv;
   outc->write = write;
 
@@ -732,11 +1082,14 @@ struct output_file* output_file_open_callback(int (*write)(void*, const void*, s
 }
 
 struct output_file* output_file_open_fd(int fd, unsigned int block_size, int64_t len, int gz,
-                                        int sparse, int chunks, int crc) {
+                                        int sparse, int chunks, int crc, unsigned int threads) {
   int ret;
   struct output_file* out;
+  bool pgz = gz && threads > 1;
 
-  if (gz) {
+  if (pgz) {
+    out = output_file_new_pgz();
+  } else if (gz) {
     out = output_file_new_gz();
   } else {
     out = output_file_new_normal();
@@ -745,11 +1098,16 @@ struct output_file* output_file_open_fd(int fd, unsigned int block_size, int64_t
     return nullptr;
   }
 
+  out->threads = std::max(threads, 1u);
   out->ops->open(out, fd);
 
   ret = output_file_init(out, block_size, len, sparse, chunks, crc);
   if (ret < 0) {
-    free(out);
+    if (pgz) {
+      delete to_output_file_pgz(out);
+    } else {
+      free(out);
+    }
     return nullptr;
   }
 
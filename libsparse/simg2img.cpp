@@ -16,6 +16,7 @@
 
 #include <sparse/sparse.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -25,6 +26,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <vector>
+
 #ifndef O_BINARY
 #define O_BINARY 0
 #endif
@@ -33,6 +37,83 @@ void usage() {
   fprintf(stderr, "Usage: simg2img <sparse_image_files> <raw_image_file>\n");
 }
 
+struct stream_output {
+  int fd;
+  int64_t image_len;
+  std::vector<uint32_t> fill;
+};
+
+static int write_at(int fd, int64_t offset, const void* data, size_t len) {
+  if (lseek(fd, offset, SEEK_SET) == -1) {
+    return -errno;
+  }
+  const char* p = static_cast<const char*>(data);
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return -errno;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/* Writes one piece of a streamed sparse image to the output */
+static int write_stream_chunk(void* priv, const struct sparse_stream_chunk* chunk) {
+  struct stream_output* out = static_cast<struct stream_output*>(priv);
+  out->image_len = chunk->image_len;
+
+  switch (chunk->type) {
+    case SPARSE_INDEX_RAW:
+      return write_at(out->fd, chunk->offset, chunk->data, chunk->len);
+    case SPARSE_INDEX_FILL: {
+      out->fill.assign(std::min<int64_t>(chunk->len, 1024 * 1024) / sizeof(uint32_t),
+                       chunk->fill_val);
+      int64_t offset = chunk->offset;
+      int64_t remain = chunk->len;
+      while (remain > 0) {
+        size_t len = std::min<int64_t>(remain, out->fill.size() * sizeof(uint32_t));
+        int ret = write_at(out->fd, offset, out->fill.data(), len);
+        if (ret < 0) {
+          return ret;
+        }
+        offset += len;
+        remain -= len;
+      }
+      return 0;
+    }
+    default:
+      /* Don't care chunks keep what the output already holds */
+      return 0;
+  }
+}
+
+/*
+ * Pipes can't be rewound, which sparse_file_import() needs, so stdin is
+ * converted chunk by chunk as it comes in.
+ */
+static bool stream_to_output(int in, int out) {
+  struct stream_output output = {out, 0, {}};
+  int ret = sparse_file_stream(in, false, write_stream_chunk, &output);
+  if (ret < 0) {
+    fprintf(stderr, "Failed to read sparse file: %s\n", strerror(-ret));
+    return false;
+  }
+
+  off_t size = lseek(out, 0, SEEK_END);
+  if (size == -1) {
+    perror("lseek failed");
+    return false;
+  }
+  if (size < output.image_len && ftruncate(out, output.image_len) < 0) {
+    perror("ftruncate failed");
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char* argv[]) {
   int in;
   int out;
@@ -52,7 +133,10 @@ int main(int argc, char* argv[]) {
 
   for (i = 1; i < argc - 1; i++) {
     if (strcmp(argv[i], "-") == 0) {
-      in = STDIN_FILENO;
+      if (!stream_to_output(STDIN_FILENO, out)) {
+        exit(EXIT_FAILURE);
+      }
+      continue;
     } else {
       in = open(argv[i], O_RDONLY | O_BINARY);
       if (in < 0) {
@@ -17,6 +17,9 @@
 #include <assert.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <thread>
+
 #include <sparse/sparse.h>
 
 #include "defs.h"
@@ -41,6 +44,7 @@ struct sparse_file* sparse_file_new(unsigned int block_size, int64_t len) {
 
   s->block_size = block_size;
   s->len = len;
+  s->threads = 1;
 
   return s;
 }
@@ -154,7 +158,7 @@ int sparse_file_write(struct sparse_file* s, int fd, bool gz, bool sparse, bool
   }
 
   chunks = sparse_count_chunks(s);
-  out = output_file_open_fd(fd, s->block_size, s->len, gz, sparse, chunks, crc);
+  out = output_file_open_fd(fd, s->block_size, s->len, gz, sparse, chunks, crc, s->threads);
 
   if (!out) return -ENOMEM;
 
@@ -172,7 +176,8 @@ int sparse_file_callback(struct sparse_file* s, bool sparse, bool crc,
   struct output_file* out;
 
   chunks = sparse_count_chunks(s);
-  out = output_file_open_callback(write, priv, s->block_size, s->len, false, sparse, chunks, crc);
+  out = output_file_open_callback(write, priv, s->block_size, s->len, false, sparse, chunks, crc,
+                                  s->threads);
 
   if (!out) return -ENOMEM;
 
@@ -211,7 +216,7 @@ int sparse_file_foreach_chunk(struct sparse_file* s, bool sparse, bool crc,
   chk.block = chk.nr_blocks = 0;
   chunks = sparse_count_chunks(s);
   out = output_file_open_callback(foreach_chunk_write, &chk, s->block_size, s->len, false, sparse,
-                                  chunks, crc);
+                                  chunks, crc, s->threads);
 
   if (!out) return -ENOMEM;
 
@@ -233,14 +238,49 @@ static int out_counter_write(void* priv, const void* data __unused, size_t len)
   return 0;
 }
 
+/* Bytes taken up by @bb once written out as a sparse chunk, header included */
+static int64_t sparse_chunk_len(struct sparse_file* s, struct backed_block* bb) {
+  if (backed_block_type(bb) == BACKED_BLOCK_FILL) {
+    return sizeof(chunk_header_t) + sizeof(uint32_t);
+  }
+  return sizeof(chunk_header_t) + ALIGN(backed_block_len(bb), s->block_size);
+}
+
+/*
+ * The size of a sparse image only depends on the chunk layout, so work it out
+ * from the backed block list instead of reading every chunk through a
+ * counting output file.
+ */
+static int64_t sparse_file_sparse_len(struct sparse_file* s, bool crc) {
+  struct backed_block* bb;
+  unsigned int last_block = 0;
+  int64_t count = sizeof(sparse_header_t);
+
+  for (bb = backed_block_iter_new(s->backed_block_list); bb; bb = backed_block_iter_next(bb)) {
+    if (backed_block_block(bb) > last_block) count += sizeof(chunk_header_t);
+    count += sparse_chunk_len(s, bb);
+    last_block = backed_block_block(bb) + DIV_ROUND_UP(backed_block_len(bb), s->block_size);
+  }
+
+  if (s->len > (int64_t)last_block * s->block_size) count += sizeof(chunk_header_t);
+  if (crc) count += sizeof(chunk_header_t) + sizeof(uint32_t);
+
+  return count;
+}
+
 int64_t sparse_file_len(struct sparse_file* s, bool sparse, bool crc) {
   int ret;
-  int chunks = sparse_count_chunks(s);
+  int chunks;
   int64_t count = 0;
   struct output_file* out;
 
+  if (sparse) {
+    return sparse_file_sparse_len(s, crc);
+  }
+
+  chunks = sparse_count_chunks(s);
   out = output_file_open_callback(out_counter_write, &count, s->block_size, s->len, false, sparse,
-                                  chunks, crc);
+                                  chunks, crc, 1);
   if (!out) {
     return -1;
   }
@@ -260,15 +300,20 @@ unsigned int sparse_file_block_size(struct sparse_file* s) {
   return s->block_size;
 }
 
-static int move_chunks_up_to_len(struct sparse_file* from, struct sparse_file* to, unsigned int len,
-                                 backed_block** out_bb) {
-  int64_t count = 0;
-  struct output_file* out_counter;
+/*
+ * Walk the chunks of @s starting at @start and find the last one that still
+ * fits in a sparse file of @len bytes, splitting a chunk if that gets closer
+ * to @len.  Nothing is moved; the piece is @start up to *out_last, and the
+ * next piece starts at *out_next, which is NULL once the list is exhausted.
+ */
+static int find_chunks_up_to_len(struct sparse_file* s, struct backed_block* start,
+                                 unsigned int len, backed_block** out_last,
+                                 backed_block** out_next) {
   struct backed_block* last_bb = nullptr;
   struct backed_block* bb;
-  struct backed_block* start;
   unsigned int last_block = 0;
   int64_t file_len = 0;
+  int64_t count;
   int ret;
 
   /*
@@ -278,24 +323,12 @@ static int move_chunks_up_to_len(struct sparse_file* from, struct sparse_file* t
   int overhead = sizeof(sparse_header_t) + 2 * sizeof(chunk_header_t) + sizeof(uint32_t);
   len -= overhead;
 
-  start = backed_block_iter_new(from->backed_block_list);
-  out_counter = output_file_open_callback(out_counter_write, &count, to->block_size, to->len, false,
-                                          true, 0, false);
-  if (!out_counter) {
-    return -1;
-  }
-
   for (bb = start; bb; bb = backed_block_iter_next(bb)) {
     count = 0;
     if (backed_block_block(bb) > last_block) count += sizeof(chunk_header_t);
-    last_block = backed_block_block(bb) + DIV_ROUND_UP(backed_block_len(bb), to->block_size);
+    last_block = backed_block_block(bb) + DIV_ROUND_UP(backed_block_len(bb), s->block_size);
+    count += sparse_chunk_len(s, bb);
 
-    /* will call out_counter_write to update count */
-    ret = sparse_file_write_block(out_counter, bb);
-    if (ret) {
-      bb = nullptr;
-      goto out;
-    }
     if (file_len + count > len) {
       /*
        * If the remaining available size is more than 1/8th of the
@@ -304,66 +337,74 @@ static int move_chunks_up_to_len(struct sparse_file* from, struct sparse_file* t
        */
       file_len += sizeof(chunk_header_t);
       if (!last_bb || (len - file_len > (len / 8))) {
-        backed_block_split(from->backed_block_list, bb, len - file_len);
+        ret = backed_block_split(s->backed_block_list, bb, len - file_len);
+        if (ret < 0) {
+          return ret;
+        }
         last_bb = bb;
+        bb = backed_block_iter_next(bb);
       }
-      goto move;
+      break;
     }
     file_len += count;
     last_bb = bb;
   }
 
-move:
-  backed_block_list_move(from->backed_block_list, to->backed_block_list, start, last_bb);
-
-out:
-  output_file_close(out_counter);
-
-  *out_bb = bb;
+  *out_last = last_bb;
+  *out_next = bb;
   return 0;
 }
 
 int sparse_file_resparse(struct sparse_file* in_s, unsigned int max_len, struct sparse_file** out_s,
                          int out_s_count) {
-  struct backed_block* bb;
+  struct backed_block* start;
+  struct backed_block* last_bb;
+  struct backed_block* next;
   struct sparse_file* s;
-  struct sparse_file* tmp;
   int c = 0;
 
-  tmp = sparse_file_new(in_s->block_size, in_s->len);
-  if (!tmp) {
-    return -ENOMEM;
-  }
-
+  /*
+   * Pieces are cut off the head of in_s one after another, so each one is a
+   * single pass over its own chunks.  Pieces that do not fit in out_s stay
+   * where they are in in_s.
+   */
+  start = backed_block_iter_new(in_s->backed_block_list);
   do {
-    s = sparse_file_new(in_s->block_size, in_s->len);
-
-    if (move_chunks_up_to_len(in_s, s, max_len, &bb) < 0) {
-      sparse_file_destroy(s);
-      for (int i = 0; i < c && i < out_s_count; i++) {
-        sparse_file_destroy(out_s[i]);
-        out_s[i] = nullptr;
-      }
-      sparse_file_destroy(tmp);
-      return -1;
+    if (find_chunks_up_to_len(in_s, start, max_len, &last_bb, &next) < 0) {
+      goto err;
     }
 
     if (c < out_s_count) {
+      s = sparse_file_new(in_s->block_size, in_s->len);
+      if (!s) {
+        goto err;
+      }
+      if (last_bb) {
+        backed_block_list_move(in_s->backed_block_list, s->backed_block_list, start, last_bb);
+      }
       out_s[c] = s;
-    } else {
-      backed_block_list_move(s->backed_block_list, tmp->backed_block_list, nullptr, nullptr);
-      sparse_file_destroy(s);
     }
+    start = next;
     c++;
-  } while (bb);
-
-  backed_block_list_move(tmp->backed_block_list, in_s->backed_block_list, nullptr, nullptr);
-
-  sparse_file_destroy(tmp);
+  } while (start);
 
   return c;
+
+err:
+  for (int i = 0; i < c && i < out_s_count; i++) {
+    sparse_file_destroy(out_s[i]);
+    out_s[i] = nullptr;
+  }
+  return -1;
 }
 
 void sparse_file_verbose(struct sparse_file* s) {
   s->verbose = true;
 }
+
+void sparse_file_set_threads(struct sparse_file* s, unsigned int threads) {
+  if (!threads) {
+    threads = std::thread::hardware_concurrency();
+  }
+  s->threads = std::max(threads, 1u);
+}
@@ -17,8 +17,16 @@
 #ifndef _LIBSPARSE_SPARSE_CRC32_H_
 #define _LIBSPARSE_SPARSE_CRC32_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+/* Uses the fastest crc32 instructions the CPU supports */
 uint32_t sparse_crc32(uint32_t crc, const void* buf, size_t size);
 
+/* Table-driven version; sparse_crc32() always returns the same result */
+uint32_t sparse_crc32_generic(uint32_t crc, const void* buf, size_t size);
+
+/* Name of the implementation sparse_crc32() uses on this CPU */
+const char* sparse_crc32_name(void);
+
 #endif
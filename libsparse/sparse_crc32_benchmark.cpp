@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "sparse_crc32.h"
+
+static std::vector<uint8_t> make_buffer(size_t size) {
+  std::vector<uint8_t> buf(size);
+  srand(size);
+  for (auto& c : buf) {
+    c = rand();
+  }
+  return buf;
+}
+
+template <uint32_t (*crc_fn)(uint32_t, const void*, size_t)>
+static void BM_crc32(benchmark::State& state) {
+  // Odd offset so that the kernels also take their unaligned head path.
+  auto buf = make_buffer(state.range(0) + 1);
+  const uint8_t* data = buf.data() + 1;
+  size_t size = state.range(0);
+
+  if (sparse_crc32(0, data, size) != sparse_crc32_generic(0, data, size)) {
+    state.SkipWithError("crc mismatch between sparse_crc32 and sparse_crc32_generic");
+    return;
+  }
+
+  uint32_t crc = 0;
+  for (auto _ : state) {
+    crc = crc_fn(crc, data, size);
+    benchmark::DoNotOptimize(crc);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  state.SetLabel(crc_fn == sparse_crc32 ? sparse_crc32_name() : "generic");
+}
+
+BENCHMARK_TEMPLATE(BM_crc32, sparse_crc32)->Arg(64)->Arg(4096)->Arg(1 << 20)->Arg(64 << 20);
+BENCHMARK_TEMPLATE(BM_crc32, sparse_crc32_generic)->Arg(64)->Arg(4096)->Arg(1 << 20)->Arg(64 << 20);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runtime-dispatched crc32 kernels. All of them compute the same
+ * reflected 0xedb88320 crc as the table in sparse_crc32.cpp.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "sparse_crc32.h"
+
+#if defined(__aarch64__)
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+#define SPARSE_CRC32_ARMV8 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPARSE_CRC32_PCLMUL 1
+#endif
+
+/* Shorter buffers are not worth an indirect call; the fill chunk crc is 4 bytes at a time */
+#define CRC32_HW_MIN_LEN 64
+
+#if defined(SPARSE_CRC32_ARMV8)
+
+__attribute__((target("crc"))) static uint32_t crc32_armv8(uint32_t crc, const void* buf,
+                                                          size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+  uint64_t v[4];
+
+  crc = ~crc;
+  while (size && (reinterpret_cast<uintptr_t>(p) & 7)) {
+    crc = __crc32b(crc, *p++);
+    size--;
+  }
+  while (size >= sizeof(v)) {
+    memcpy(v, p, sizeof(v));
+    crc = __crc32d(crc, v[0]);
+    crc = __crc32d(crc, v[1]);
+    crc = __crc32d(crc, v[2]);
+    crc = __crc32d(crc, v[3]);
+    p += sizeof(v);
+    size -= sizeof(v);
+  }
+  while (size >= sizeof(v[0])) {
+    memcpy(v, p, sizeof(v[0]));
+    crc = __crc32d(crc, v[0]);
+    p += sizeof(v[0]);
+    size -= sizeof(v[0]);
+  }
+  while (size--) {
+    crc = __crc32b(crc, *p++);
+  }
+  return ~crc;
+}
+
+static bool cpu_has_armv8_crc32() {
+#if defined(__APPLE__)
+  return true;
+#elif defined(__linux__)
+  return getauxval(AT_HWCAP) & HWCAP_CRC32;
+#else
+  return false;
+#endif
+}
+
+#endif /* SPARSE_CRC32_ARMV8 */
+
+#if defined(SPARSE_CRC32_PCLMUL)
+
+/*
+ * Folds |len| bytes, a multiple of 16 and at least 64, into the inverted crc
+ * state |crc| with carry-less multiplication, as described in Intel's "Fast
+ * CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ * The constants are the bit-reflected fold and Barrett reduction constants
+ * for 0xedb88320 given at the end of that paper.
+ */
+__attribute__((target("pclmul,sse4.1"))) static uint32_t crc32_pclmul_fold(const uint8_t* buf,
+                                                                          size_t len,
+                                                                          uint32_t crc) {
+  alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00));
+  x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10));
+  x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20));
+  x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+  buf += 64;
+  len -= 64;
+
+  /* Fold four lanes of 64 bytes at a time */
+  while (len >= 64) {
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+    y5 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x00));
+    y6 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x10));
+    y7 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x20));
+    y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + 0x30));
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+    buf += 64;
+    len -= 64;
+  }
+
+  /* Fold the four lanes into one */
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* Fold any remaining 16 byte blocks */
+  while (len >= 16) {
+    x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    buf += 16;
+    len -= 16;
+  }
+
+  /* Reduce 128 bits to 64 */
+  x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+  x1 = _mm_srli_si128(x1, 8);
+  x1 = _mm_xor_si128(x1, x2);
+  x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, x3);
+  x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+  x2 = _mm_and_si128(x1, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2 = _mm_and_si128(x2, x3);
+  x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const void* buf, size_t size) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+
+  if (size >= 64) {
+    size_t len = size & ~static_cast<size_t>(15);
+    crc = ~crc32_pclmul_fold(p, len, ~crc);
+    p += len;
+    size -= len;
+  }
+  return sparse_crc32_generic(crc, p, size);
+}
+
+static bool cpu_has_pclmul() {
+  return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+#endif /* SPARSE_CRC32_PCLMUL */
+
+struct crc32_impl {
+  const char* name;
+  uint32_t (*fn)(uint32_t crc, const void* buf, size_t size);
+};
+
+static struct crc32_impl select_crc32() {
+#if defined(SPARSE_CRC32_ARMV8)
+  if (cpu_has_armv8_crc32()) return {"armv8-crc32", crc32_armv8};
+#endif
+#if defined(SPARSE_CRC32_PCLMUL)
+  if (cpu_has_pclmul()) return {"pclmul", crc32_pclmul};
+#endif
+  return {"generic", sparse_crc32_generic};
+}
+
+static const struct crc32_impl& get_crc32_impl() {
+  static const struct crc32_impl impl = select_crc32();
+  return impl;
+}
+
+uint32_t sparse_crc32(uint32_t crc, const void* buf, size_t size) {
+  if (size < CRC32_HW_MIN_LEN) {
+    return sparse_crc32_generic(crc, buf, size);
+  }
+  return get_crc32_impl().fn(crc, buf, size);
+}
+
+const char* sparse_crc32_name(void) {
+  return get_crc32_impl().name;
+}
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _FILE_OFFSET_BITS 64
+#define _LARGEFILE64_SOURCE 1
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+#include <android-base/file.h>
+#include <sparse/sparse.h>
+
+#include "defs.h"
+#include "sparse_crc32.h"
+#include "sparse_format.h"
+
+#define SPARSE_HEADER_MAJOR_VER 1
+#define SPARSE_HEADER_LEN (sizeof(sparse_header_t))
+#define CHUNK_HEADER_LEN (sizeof(chunk_header_t))
+
+#define SPARSE_INDEX_MAGIC 0x58495053 /* "SPIX" */
+#define SPARSE_INDEX_VERSION 1
+
+/*
+ * Sidecar file layout: a header followed by one entry per chunk of the
+ * image, sorted by block. CRC32 chunks don't cover any blocks, so they are
+ * not listed; every other block of the image is in exactly one entry.
+ */
+typedef struct sparse_index_header {
+  __le32 magic;
+  __le16 version;
+  __le16 entry_sz;
+  __le32 blk_sz;
+  __le32 total_blks;
+  __le32 nr_entries;
+  __le32 entries_crc;
+  __le64 image_len; /* size of the sparse image the index was built from */
+} sparse_index_header_t;
+
+typedef struct sparse_index_chunk {
+  __le32 block;
+  __le32 nr_blocks;
+  __le16 type; /* CHUNK_TYPE_* */
+  __le16 reserved1;
+  __le32 fill_val;
+  __le64 data_offset; /* of the raw data in the sparse image */
+} sparse_index_chunk_t;
+
+struct sparse_index {
+  unsigned int block_size;
+  unsigned int total_blks;
+  uint64_t image_len = 0;
+  std::vector<sparse_index_chunk_t> chunks;
+};
+
+static int read_at(int fd, void* buf, size_t len, int64_t offset) {
+  if (!android::base::ReadFullyAtOffset(fd, buf, len, offset)) {
+    return errno ? -errno : -EINVAL;
+  }
+  return 0;
+}
+
+static int file_len(int fd, uint64_t* len) {
+  struct stat st;
+
+  if (fstat(fd, &st) < 0) {
+    return -errno;
+  }
+  *len = st.st_size;
+  return 0;
+}
+
+static int read_sparse_header(int fd, sparse_header_t* header) {
+  int ret = read_at(fd, header, sizeof(*header), 0);
+  if (ret < 0) {
+    return ret;
+  }
+  if (header->magic != SPARSE_HEADER_MAGIC ||
+      header->major_version != SPARSE_HEADER_MAJOR_VER ||
+      header->file_hdr_sz < SPARSE_HEADER_LEN || header->chunk_hdr_sz < CHUNK_HEADER_LEN ||
+      !header->blk_sz || (header->blk_sz % 4)) {
+    return -EINVAL;
+  }
+  return 0;
+}
+
+struct sparse_index* sparse_index_build(int fd) {
+  sparse_header_t header;
+  chunk_header_t chunk;
+  int64_t offset;
+  unsigned int block = 0;
+
+  if (read_sparse_header(fd, &header) < 0) {
+    return nullptr;
+  }
+
+  struct sparse_index* index = new (std::nothrow) sparse_index();
+  if (!index) {
+    return nullptr;
+  }
+  index->block_size = header.blk_sz;
+  index->total_blks = header.total_blks;
+  if (file_len(fd, &index->image_len) < 0) {
+    delete index;
+    return nullptr;
+  }
+
+  /* Only chunk headers are read; the data in between is never touched */
+  offset = header.file_hdr_sz;
+  for (unsigned int i = 0; i < header.total_chunks; i++) {
+    if (read_at(fd, &chunk, sizeof(chunk), offset) < 0 || chunk.total_sz < header.chunk_hdr_sz) {
+      delete index;
+      return nullptr;
+    }
+
+    sparse_index_chunk_t entry = {};
+    entry.block = block;
+    entry.nr_blocks = chunk.chunk_sz;
+    entry.type = chunk.chunk_type;
+    entry.data_offset = offset + header.chunk_hdr_sz;
+
+    switch (chunk.chunk_type) {
+      case CHUNK_TYPE_RAW:
+        if (chunk.total_sz - header.chunk_hdr_sz !=
+            static_cast<uint64_t>(chunk.chunk_sz) * header.blk_sz) {
+          delete index;
+          return nullptr;
+        }
+        break;
+      case CHUNK_TYPE_FILL:
+        if (read_at(fd, &entry.fill_val, sizeof(entry.fill_val), entry.data_offset) < 0) {
+          delete index;
+          return nullptr;
+        }
+        break;
+      case CHUNK_TYPE_DONT_CARE:
+        break;
+      case CHUNK_TYPE_CRC32:
+        entry.nr_blocks = 0;
+        break;
+      default:
+        delete index;
+        return nullptr;
+    }
+    if (entry.nr_blocks) {
+      index->chunks.push_back(entry);
+    }
+    block += chunk.chunk_sz;
+    offset += chunk.total_sz;
+  }
+
+  if (block != header.total_blks) {
+    delete index;
+    return nullptr;
+  }
+  return index;
+}
+
+static uint32_t entries_crc(const struct sparse_index* index) {
+  return sparse_crc32(0, index->chunks.data(), index->chunks.size() * sizeof(index->chunks[0]));
+}
+
+int sparse_index_save(struct sparse_index* index, int index_fd) {
+  sparse_index_header_t header = {
+      .magic = SPARSE_INDEX_MAGIC,
+      .version = SPARSE_INDEX_VERSION,
+      .entry_sz = sizeof(sparse_index_chunk_t),
+      .blk_sz = index->block_size,
+      .total_blks = index->total_blks,
+      .nr_entries = static_cast<uint32_t>(index->chunks.size()),
+      .entries_crc = entries_crc(index),
+      .image_len = index->image_len,
+  };
+
+  if (!android::base::WriteFully(index_fd, &header, sizeof(header)) ||
+      !android::base::WriteFully(index_fd, index->chunks.data(),
+                                 index->chunks.size() * sizeof(index->chunks[0]))) {
+    return -errno;
+  }
+  return 0;
+}
+
+struct sparse_index* sparse_index_load(int index_fd, int image_fd) {
+  sparse_index_header_t header;
+  sparse_header_t image_header;
+  uint64_t image_len = 0;
+
+  if (!android::base::ReadFully(index_fd, &header, sizeof(header)) ||
+      header.magic != SPARSE_INDEX_MAGIC || header.version != SPARSE_INDEX_VERSION ||
+      header.entry_sz != sizeof(sparse_index_chunk_t)) {
+    return nullptr;
+  }
+
+  /* A stale index is useless: it must describe this exact image */
+  if (read_sparse_header(image_fd, &image_header) < 0 || file_len(image_fd, &image_len) < 0 ||
+      image_len != header.image_len || image_header.blk_sz != header.blk_sz ||
+      image_header.total_blks != header.total_blks) {
+    return nullptr;
+  }
+
+  struct sparse_index* index = new (std::nothrow) sparse_index();
+  if (!index) {
+    return nullptr;
+  }
+  index->block_size = header.blk_sz;
+  index->total_blks = header.total_blks;
+  index->image_len = header.image_len;
+  index->chunks.resize(header.nr_entries);
+  if (!android::base::ReadFully(index_fd, index->chunks.data(),
+                                index->chunks.size() * sizeof(index->chunks[0])) ||
+      entries_crc(index) != header.entries_crc) {
+    delete index;
+    return nullptr;
+  }
+  return index;
+}
+
+void sparse_index_destroy(struct sparse_index* index) {
+  delete index;
+}
+
+int64_t sparse_index_len(struct sparse_index* index) {
+  return static_cast<int64_t>(index->total_blks) * index->block_size;
+}
+
+int sparse_index_lookup(struct sparse_index* index, int64_t offset,
+                        struct sparse_index_entry* entry) {
+  if (offset < 0 || offset >= sparse_index_len(index)) {
+    return -EINVAL;
+  }
+
+  int64_t block = offset / index->block_size;
+  auto it = std::upper_bound(index->chunks.begin(), index->chunks.end(), block,
+                             [](int64_t block, const sparse_index_chunk_t& chunk) -> bool {
+                               return block < chunk.block;
+                             });
+  if (it == index->chunks.begin()) {
+    return -EINVAL;
+  }
+  const sparse_index_chunk_t& chunk = *(it - 1);
+  if (block >= static_cast<int64_t>(chunk.block) + chunk.nr_blocks) {
+    return -EINVAL;
+  }
+
+  entry->offset = static_cast<int64_t>(chunk.block) * index->block_size;
+  entry->len = static_cast<int64_t>(chunk.nr_blocks) * index->block_size;
+  entry->type = static_cast<enum sparse_index_type>(chunk.type);
+  entry->fill_val = chunk.type == CHUNK_TYPE_FILL ? chunk.fill_val : 0;
+  entry->data_offset = chunk.type == CHUNK_TYPE_RAW ? static_cast<int64_t>(chunk.data_offset) : -1;
+  return 0;
+}
+
+int sparse_index_read(struct sparse_index* index, int image_fd, int64_t offset, void* buf,
+                      size_t len) {
+  char* p = reinterpret_cast<char*>(buf);
+  struct sparse_index_entry entry;
+  int ret;
+
+  if (offset < 0 || static_cast<uint64_t>(offset) + len >
+                            static_cast<uint64_t>(sparse_index_len(index))) {
+    return -EINVAL;
+  }
+
+  while (len > 0) {
+    ret = sparse_index_lookup(index, offset, &entry);
+    if (ret < 0) {
+      return ret;
+    }
+
+    int64_t skip = offset - entry.offset;
+    size_t count = std::min<uint64_t>(len, entry.len - skip);
+    switch (entry.type) {
+      case SPARSE_INDEX_RAW:
+        ret = read_at(image_fd, p, count, entry.data_offset + skip);
+        if (ret < 0) {
+          return ret;
+        }
+        break;
+      case SPARSE_INDEX_FILL:
+        for (size_t i = 0; i < count; i++) {
+          p[i] = reinterpret_cast<const char*>(&entry.fill_val)[(skip + i) % sizeof(uint32_t)];
+        }
+        break;
+      default:
+        memset(p, 0, count);
+        break;
+    }
+    p += count;
+    offset += count;
+    len -= count;
+  }
+  return 0;
+}
@@ -26,10 +26,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <algorithm>
+#include <memory>
+#include <new>
 #include <string>
 
 #include <sparse/sparse.h>
 
+#include "android-base/mapped_file.h"
 #include "android-base/stringprintf.h"
 #include "defs.h"
 #include "output_file.h"
@@ -49,6 +52,9 @@
 static constexpr int64_t COPY_BUF_SIZE = 1024 * 1024;
 static char* copybuf;
 
+/* Regular files are scanned through mappings of up to this size */
+static constexpr int64_t READ_MAP_SIZE = 64 * 1024 * 1024;
+
 static std::string ErrorString(int err) {
   if (err == -EOVERFLOW) return "EOF while reading file";
   if (err == -EINVAL) return "Invalid sparse file format";
@@ -457,18 +463,276 @@ static int sparse_file_read_sparse(struct sparse_file* s, SparseFileSource* sour
   return 0;
 }
 
+/* Reads and drops len bytes, for sources that can't seek */
+static int stream_skip(int fd, char* buf, int64_t len) {
+  while (len > 0) {
+    int64_t chunk = std::min(len, COPY_BUF_SIZE);
+    int ret = read_all(fd, buf, chunk);
+    if (ret < 0) {
+      return ret;
+    }
+    len -= chunk;
+  }
+  return 0;
+}
+
+/* Adds len bytes of the fill value to the crc, using buf as scratch space */
+static uint32_t stream_fill_crc32(uint32_t crc32, char* buf, uint32_t fill_val, int64_t len) {
+  uint32_t* fillbuf = reinterpret_cast<uint32_t*>(buf);
+  for (size_t i = 0; i < COPY_BUF_SIZE / sizeof(fill_val); i++) {
+    fillbuf[i] = fill_val;
+  }
+  while (len > 0) {
+    int64_t chunk = std::min(len, COPY_BUF_SIZE);
+    crc32 = sparse_crc32(crc32, buf, chunk);
+    len -= chunk;
+  }
+  return crc32;
+}
+
+int sparse_file_stream(int fd, bool crc,
+                       int (*chunk)(void* priv, const struct sparse_stream_chunk* chunk),
+                       void* priv) {
+  int ret;
+  sparse_header_t sparse_header;
+  chunk_header_t chunk_header;
+  uint32_t crc32 = 0;
+  unsigned int cur_block = 0;
+
+  ret = read_all(fd, &sparse_header, sizeof(sparse_header));
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (sparse_header.magic != SPARSE_HEADER_MAGIC ||
+      sparse_header.major_version != SPARSE_HEADER_MAJOR_VER ||
+      sparse_header.file_hdr_sz < SPARSE_HEADER_LEN ||
+      sparse_header.chunk_hdr_sz < CHUNK_HEADER_LEN || !sparse_header.blk_sz ||
+      (sparse_header.blk_sz % 4)) {
+    return -EINVAL;
+  }
+
+  std::unique_ptr<char[]> buf(new (std::nothrow) char[COPY_BUF_SIZE]);
+  if (!buf) {
+    return -ENOMEM;
+  }
+
+  ret = stream_skip(fd, buf.get(), sparse_header.file_hdr_sz - SPARSE_HEADER_LEN);
+  if (ret < 0) {
+    return ret;
+  }
+
+  struct sparse_stream_chunk piece = {};
+  piece.block_size = sparse_header.blk_sz;
+  piece.image_len = (int64_t)sparse_header.total_blks * sparse_header.blk_sz;
+
+  for (unsigned int i = 0; i < sparse_header.total_chunks; i++) {
+    ret = read_all(fd, &chunk_header, sizeof(chunk_header));
+    if (ret < 0) {
+      return ret;
+    }
+    ret = stream_skip(fd, buf.get(), sparse_header.chunk_hdr_sz - CHUNK_HEADER_LEN);
+    if (ret < 0) {
+      return ret;
+    }
+
+    if (chunk_header.total_sz < sparse_header.chunk_hdr_sz) {
+      return -EINVAL;
+    }
+    int64_t data_size = chunk_header.total_sz - sparse_header.chunk_hdr_sz;
+    int64_t len = (int64_t)chunk_header.chunk_sz * sparse_header.blk_sz;
+
+    if (chunk_header.chunk_type != CHUNK_TYPE_CRC32 &&
+        chunk_header.chunk_sz > sparse_header.total_blks - cur_block) {
+      return -EINVAL;
+    }
+    piece.offset = (int64_t)cur_block * sparse_header.blk_sz;
+    piece.data = nullptr;
+
+    switch (chunk_header.chunk_type) {
+      case CHUNK_TYPE_RAW:
+        if (data_size != len) {
+          return -EINVAL;
+        }
+        piece.type = SPARSE_INDEX_RAW;
+        piece.data = buf.get();
+        while (len > 0) {
+          piece.len = std::min(len, COPY_BUF_SIZE);
+          ret = read_all(fd, buf.get(), piece.len);
+          if (ret < 0) {
+            return ret;
+          }
+          if (crc) {
+            crc32 = sparse_crc32(crc32, buf.get(), piece.len);
+          }
+          ret = chunk(priv, &piece);
+          if (ret < 0) {
+            return ret;
+          }
+          piece.offset += piece.len;
+          len -= piece.len;
+        }
+        break;
+      case CHUNK_TYPE_FILL:
+        if (data_size != sizeof(piece.fill_val)) {
+          return -EINVAL;
+        }
+        ret = read_all(fd, &piece.fill_val, sizeof(piece.fill_val));
+        if (ret < 0) {
+          return ret;
+        }
+        if (crc) {
+          crc32 = stream_fill_crc32(crc32, buf.get(), piece.fill_val, len);
+        }
+        piece.type = SPARSE_INDEX_FILL;
+        piece.len = len;
+        ret = chunk(priv, &piece);
+        if (ret < 0) {
+          return ret;
+        }
+        break;
+      case CHUNK_TYPE_DONT_CARE:
+        if (data_size != 0) {
+          return -EINVAL;
+        }
+        if (crc) {
+          crc32 = stream_fill_crc32(crc32, buf.get(), 0, len);
+        }
+        piece.type = SPARSE_INDEX_DONT_CARE;
+        piece.len = len;
+        ret = chunk(priv, &piece);
+        if (ret < 0) {
+          return ret;
+        }
+        break;
+      case CHUNK_TYPE_CRC32: {
+        uint32_t file_crc32;
+        if (data_size != sizeof(file_crc32)) {
+          return -EINVAL;
+        }
+        ret = read_all(fd, &file_crc32, sizeof(file_crc32));
+        if (ret < 0) {
+          return ret;
+        }
+        if (crc && file_crc32 != crc32) {
+          return -EINVAL;
+        }
+        continue;
+      }
+      default:
+        return -EINVAL;
+    }
+
+    cur_block += chunk_header.chunk_sz;
+  }
+
+  if (sparse_header.total_blks != cur_block) {
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+/* A block is a fill block iff every 32 bit word equals the one after it */
+static bool block_is_fill(const uint32_t* buf, unsigned int block_size) {
+  return !memcmp(buf, buf + 1, block_size - sizeof(uint32_t));
+}
+
+/*
+ * Consecutive blocks of the same kind found by do_sparse_file_read_normal(),
+ * added to the sparse file as one backed block.
+ */
+struct normal_read_run {
+  bool fill;
+  uint32_t fill_val;
+  int64_t offset;
+  int64_t len;
+  unsigned int block;
+};
+
+static int flush_normal_read_run(struct sparse_file* s, int fd, struct normal_read_run* run) {
+  int ret = 0;
+
+  if (run->len == 0) {
+    return 0;
+  }
+  if (run->fill) {
+    /* TODO: add flag to use skip instead of fill for fill_val == 0 */
+    ret = sparse_file_add_fill(s, run->fill_val, run->len, run->block);
+  } else {
+    ret = sparse_file_add_fd(s, fd, run->offset, run->len, run->block);
+  }
+  run->block += DIV_ROUND_UP(run->len, s->block_size);
+  run->offset += run->len;
+  run->len = 0;
+  return ret;
+}
+
+static int add_normal_read_block(struct sparse_file* s, int fd, struct normal_read_run* run,
+                                 const uint32_t* data, unsigned int len) {
+  bool fill = len == s->block_size && block_is_fill(data, len);
+  int ret;
+
+  if (run->len && (fill != run->fill || (fill && data[0] != run->fill_val))) {
+    ret = flush_normal_read_run(s, fd, run);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  run->fill = fill;
+  if (fill) {
+    run->fill_val = data[0];
+  }
+  run->len += len;
+  return 0;
+}
+
 static int do_sparse_file_read_normal(struct sparse_file* s, int fd, uint32_t* buf, int64_t offset,
                                       int64_t remain) {
   int ret;
-  unsigned int block = offset / s->block_size;
   unsigned int to_read;
-  unsigned int i;
-  bool sparse_block;
+  int64_t map_size = ALIGN_DOWN(READ_MAP_SIZE, s->block_size);
+  struct normal_read_run run = {};
+  bool mapped = false;
 
   if (!buf) {
     return -ENOMEM;
   }
 
+  run.offset = offset;
+  run.block = offset / s->block_size;
+
+  /*
+   * Scan the blocks in place when the input can be mapped. Data blocks
+   * only record their offset, so nothing is copied until the output is
+   * written. Pipes and anything else that can't be mapped are read.
+   */
+  while (remain > 0) {
+    size_t len = std::min(remain, map_size);
+    auto m = android::base::MappedFile::FromFd(fd, offset, len, PROT_READ);
+    if (!m) {
+      break;
+    }
+
+    const char* data = m->data();
+    for (size_t pos = 0; pos < len; pos += s->block_size) {
+      to_read = std::min<size_t>(len - pos, s->block_size);
+      ret = add_normal_read_block(s, fd, &run, reinterpret_cast<const uint32_t*>(data + pos),
+                                  to_read);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+
+    remain -= len;
+    offset += len;
+    mapped = true;
+  }
+
+  if (remain > 0 && mapped && lseek64(fd, offset, SEEK_SET) < 0) {
+    return -errno;
+  }
+
   while (remain > 0) {
     to_read = std::min(remain, (int64_t)(s->block_size));
     ret = read_all(fd, buf, to_read);
@@ -477,31 +741,16 @@ static int do_sparse_file_read_normal(struct sparse_file* s, int fd, uint32_t* b
       return ret;
     }
 
-    if (to_read == s->block_size) {
-      sparse_block = true;
-      for (i = 1; i < s->block_size / sizeof(uint32_t); i++) {
-        if (buf[0] != buf[i]) {
-          sparse_block = false;
-          break;
-        }
-      }
-    } else {
-      sparse_block = false;
-    }
-
-    if (sparse_block) {
-      /* TODO: add flag to use skip instead of fill for buf[0] == 0 */
-      sparse_file_add_fill(s, buf[0], to_read, block);
-    } else {
-      sparse_file_add_fd(s, fd, offset, to_read, block);
+    ret = add_normal_read_block(s, fd, &run, buf, to_read);
+    if (ret < 0) {
+      return ret;
     }
 
     remain -= to_read;
     offset += to_read;
-    block++;
   }
 
-  return 0;
+  return flush_normal_read_run(s, fd, &run);
 }
 
 static int sparse_file_read_normal(struct sparse_file* s, int fd) {
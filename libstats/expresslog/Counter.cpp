@@ -20,6 +20,8 @@
 #include <string.h>
 #include <utils/hash/farmhash.h>
 
+#include "FlushInterval.h"
+
 namespace android {
 namespace expresslog {
 
@@ -33,5 +35,31 @@ void Counter::logIncrementWithUid(const char* metricName, int32_t uid, int64_t a
     stats_write(EXPRESS_UID_EVENT_REPORTED, metricIdHash, amount, uid);
 }
 
+Counter::Batch::Batch(const char* metricId, std::chrono::milliseconds flushInterval)
+    : mMetricIdHash(farmhash::Fingerprint64(metricId, strlen(metricId))),
+      mAmount(0),
+      mFlushIntervalNs(std::chrono::nanoseconds(flushInterval).count()),
+      mNextFlushNs(flushClockNs() + mFlushIntervalNs) {
+}
+
+Counter::Batch::~Batch() {
+    flush();
+}
+
+void Counter::Batch::logIncrement(int64_t amount) {
+    mAmount.fetch_add(amount, std::memory_order_relaxed);
+    if (isFlushDue(mNextFlushNs, mFlushIntervalNs)) {
+        flush();
+    }
+}
+
+void Counter::Batch::flush() {
+    const int64_t amount = mAmount.exchange(0, std::memory_order_relaxed);
+    if (amount == 0) {
+        return;
+    }
+    stats_write(EXPRESS_EVENT_REPORTED, mMetricIdHash, amount);
+}
+
 }  // namespace expresslog
 }  // namespace android
@@ -0,0 +1,51 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+
+namespace android {
+namespace expresslog {
+
+inline int64_t flushClockNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+/**
+ * Returns true if the deadline in nextFlushNs has passed, and moves it intervalNs past now.
+ * Only one of the threads racing past the same deadline gets true. An interval that is not
+ * positive never flushes.
+ */
+inline bool isFlushDue(std::atomic<int64_t>& nextFlushNs, int64_t intervalNs,
+                       int64_t nowNs = flushClockNs()) {
+    if (intervalNs <= 0) {
+        return false;
+    }
+    int64_t next = nextFlushNs.load(std::memory_order_relaxed);
+    if (nowNs < next) {
+        return false;
+    }
+    return nextFlushNs.compare_exchange_strong(next, nowNs + intervalNs,
+                                               std::memory_order_relaxed);
+}
+
+}  // namespace expresslog
+}  // namespace android
@@ -23,6 +23,8 @@
 #include <string.h>
 #include <utils/hash/farmhash.h>
 
+#include "FlushInterval.h"
+
 namespace android {
 namespace expresslog {
 
@@ -76,5 +78,35 @@ void Histogram::logSampleWithUid(int32_t uid, float sample) const {
     stats_write(EXPRESS_UID_HISTOGRAM_SAMPLE_REPORTED, mMetricIdHash, /*count*/ 1, binIndex, uid);
 }
 
+Histogram::Batch::Batch(const Histogram& histogram, std::chrono::milliseconds flushInterval)
+    : mHistogram(histogram),
+      mBinsCount(histogram.mBinOptions->getBinsCount()),
+      mCounts(new std::atomic<int32_t>[mBinsCount]()),
+      mFlushIntervalNs(std::chrono::nanoseconds(flushInterval).count()),
+      mNextFlushNs(flushClockNs() + mFlushIntervalNs) {
+}
+
+Histogram::Batch::~Batch() {
+    flush();
+}
+
+void Histogram::Batch::logSample(float sample) {
+    const int binIndex = mHistogram.mBinOptions->getBinForSample(sample);
+    mCounts[binIndex].fetch_add(1, std::memory_order_relaxed);
+    if (isFlushDue(mNextFlushNs, mFlushIntervalNs)) {
+        flush();
+    }
+}
+
+void Histogram::Batch::flush() {
+    for (int binIndex = 0; binIndex < mBinsCount; binIndex++) {
+        const int32_t count = mCounts[binIndex].exchange(0, std::memory_order_relaxed);
+        if (count == 0) {
+            continue;
+        }
+        stats_write(EXPRESS_HISTOGRAM_SAMPLE_REPORTED, mHistogram.mMetricIdHash, count, binIndex);
+    }
+}
+
 }  // namespace expresslog
 }  // namespace android
@@ -17,6 +17,9 @@
 #pragma once
 #include <stdint.h>
 
+#include <atomic>
+#include <chrono>
+
 namespace android {
 namespace expresslog {
 
@@ -26,6 +29,35 @@ public:
     static void logIncrement(const char* metricId, int64_t amount = 1);
 
     static void logIncrementWithUid(const char* metricId, int32_t uid, int64_t amount = 1);
+
+    /**
+     * Sums the increments of one metric and logs the total on flush(), as a single StatsD write.
+     * logIncrement() is a relaxed atomic add and takes no lock, so it can be used on hot paths
+     * and from any thread. With a positive flushInterval, logIncrement() also flushes once the
+     * interval has passed since the last flush. The destructor flushes.
+     */
+    class Batch final {
+    public:
+        explicit Batch(const char* metricId,
+                       std::chrono::milliseconds flushInterval = std::chrono::milliseconds::zero());
+        ~Batch();
+
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+        void logIncrement(int64_t amount = 1);
+
+        /**
+         * Logs the total of the increments since the last flush
+         */
+        void flush();
+
+    private:
+        const int64_t mMetricIdHash;
+        std::atomic<int64_t> mAmount;
+        const int64_t mFlushIntervalNs;
+        std::atomic<int64_t> mNextFlushNs;
+    };
 };
 
 }  // namespace expresslog
@@ -17,6 +17,8 @@
 #pragma once
 #include <stdint.h>
 
+#include <atomic>
+#include <chrono>
 #include <memory>
 
 namespace android {
@@ -77,6 +79,40 @@ public:
      */
     void logSampleWithUid(int32_t uid, float sample) const;
 
+    /**
+     * Accumulates samples for a Histogram and reports them on flush(), with one StatsD write per
+     * non-empty bin. logSample() is a relaxed atomic increment and takes no lock, so it can be
+     * used on hot paths and from any thread. With a positive flushInterval, logSample() also
+     * flushes once the interval has passed since the last flush. The destructor flushes, and
+     * histogram must outlive the batch.
+     */
+    class Batch final {
+    public:
+        explicit Batch(const Histogram& histogram,
+                       std::chrono::milliseconds flushInterval = std::chrono::milliseconds::zero());
+        ~Batch();
+
+        Batch(const Batch&) = delete;
+        Batch& operator=(const Batch&) = delete;
+
+        /**
+         * Increments sample count for automatically calculated bin, without logging it yet
+         */
+        void logSample(float sample);
+
+        /**
+         * Logs the sample counts accumulated since the last flush
+         */
+        void flush();
+
+    private:
+        const Histogram& mHistogram;
+        const int mBinsCount;
+        const std::unique_ptr<std::atomic<int32_t>[]> mCounts;
+        const int64_t mFlushIntervalNs;
+        std::atomic<int64_t> mNextFlushNs;
+    };
+
 private:
     const int64_t mMetricIdHash;
     const std::shared_ptr<BinOptions> mBinOptions;
@@ -0,0 +1,46 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "FlushInterval.h"
+
+#include <gtest/gtest.h>
+
+namespace android {
+namespace expresslog {
+
+TEST(FlushInterval, dueOnceDeadlinePassed) {
+    std::atomic<int64_t> nextFlushNs(1000);
+    ASSERT_FALSE(isFlushDue(nextFlushNs, 100, 999));
+    ASSERT_EQ(1000, nextFlushNs.load());
+
+    ASSERT_TRUE(isFlushDue(nextFlushNs, 100, 1000));
+    ASSERT_EQ(1100, nextFlushNs.load());
+
+    // The deadline moved on, so the same time is not due again.
+    ASSERT_FALSE(isFlushDue(nextFlushNs, 100, 1000));
+    ASSERT_TRUE(isFlushDue(nextFlushNs, 100, 5000));
+    ASSERT_EQ(5100, nextFlushNs.load());
+}
+
+TEST(FlushInterval, nonPositiveIntervalNeverDue) {
+    std::atomic<int64_t> nextFlushNs(0);
+    ASSERT_FALSE(isFlushDue(nextFlushNs, 0, 1000));
+    ASSERT_FALSE(isFlushDue(nextFlushNs, -1, 1000));
+    ASSERT_EQ(0, nextFlushNs.load());
+}
+
+}  // namespace expresslog
+}  // namespace android
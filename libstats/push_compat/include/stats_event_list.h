@@ -29,6 +29,22 @@ void stats_log_close();
 int android_log_write_char_array(android_log_context ctx, const char* value, size_t len);
 extern int (*write_to_statsd)(struct iovec* vec, size_t nr);
 
+/*
+ * Hands events to a background thread that sends them to statsd in batches,
+ * so that the caller does not make a system call per event. Events are
+ * dropped, and counted below, when the writer falls a full queue behind.
+ * Returns 0, or -errno if the writer could not be started.
+ */
+int stats_log_start_async_writer();
+
+struct stats_log_async_writer_stats {
+    uint64_t queued;            /* events handed to the writer */
+    uint64_t written;           /* events sent to statsd */
+    uint64_t dropped_ring_full; /* events dropped because the queue was full */
+    uint64_t dropped_send;      /* events dropped because statsd did not take them */
+};
+void stats_log_get_async_writer_stats(struct stats_log_async_writer_stats* stats);
+
 #ifdef __cplusplus
 }
 #endif
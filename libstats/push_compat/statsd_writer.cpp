@@ -29,13 +29,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <linux/futex.h>
+
+#include "include/stats_event_list.h"
+
 static pthread_mutex_t log_init_lock = PTHREAD_MUTEX_INITIALIZER;
 static atomic_int dropped = 0;
 static atomic_int log_error = 0;
@@ -73,6 +79,40 @@ struct android_log_transport_write statsdLoggerWrite = {
         .noteDrop = statsdNoteDrop,
 };
 
+/*
+ * Optional background writer. Callers copy each event into a slot of a bounded
+ * lock-free ring, and one thread sends the queued events to statsd with
+ * sendmmsg(), several datagrams per system call.
+ *
+ * The ring is the usual bounded queue with a sequence number per slot: a slot
+ * is free for the producer claiming position pos when its sequence is pos, and
+ * ready for the writer when its sequence is pos + 1.
+ */
+static const size_t kAsyncSlotCount = 256;  // power of 2
+static const size_t kAsyncSlotSize = 1024;  // header and payload
+static const size_t kAsyncBatchSize = 32;
+static const int kAsyncSendTimeoutMs = 100;
+
+struct async_slot {
+    atomic_uint seq;
+    size_t len;
+    unsigned char data[kAsyncSlotSize];
+};
+
+static struct async_slot* async_slots;
+static atomic_uint async_enqueue_pos;
+static unsigned async_dequeue_pos;  // writer thread only
+static atomic_int async_running;
+static atomic_int async_sleeping;  // futex word
+static pthread_t async_thread;
+static atomic_ullong async_queued;
+static atomic_ullong async_written;
+static atomic_ullong async_dropped_full;
+static atomic_ullong async_dropped_send;
+
+static void statsdReportDrops(int sock, android_log_header_t* header);
+static int asyncEnqueue(struct iovec* vec, size_t nr);
+
 /* log_init_lock assumed */
 static int statsdOpen() {
     int i, ret = 0;
@@ -153,6 +193,36 @@ static void statsdNoteDrop(int error, int tag) {
     atomic_exchange_explicit(&atom_tag, tag, memory_order_relaxed);
 }
 
+/* Sends the count of dropped events, if any, with the tid and time in header. */
+static void statsdReportDrops(int sock, android_log_header_t* header) {
+    int32_t snapshot = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+    if (!snapshot) {
+        return;
+    }
+    android_log_event_long_t buffer;
+    header->id = LOG_ID_STATS;
+    // store the last log error in the tag field. This tag field is not used by statsd.
+    buffer.header.tag = atomic_load(&log_error);
+    buffer.payload.type = EVENT_TYPE_LONG;
+    // format:
+    // |atom_tag|dropped_count|
+    int64_t composed_long = atomic_load(&atom_tag);
+    // Send 2 int32's via an int64.
+    composed_long = ((composed_long << 32) | ((int64_t)snapshot));
+    buffer.payload.data = composed_long;
+
+    struct iovec vec[2];
+    vec[0].iov_base = header;
+    vec[0].iov_len = sizeof(*header);
+    vec[1].iov_base = &buffer;
+    vec[1].iov_len = sizeof(buffer);
+
+    ssize_t ret = TEMP_FAILURE_RETRY(writev(sock, vec, 2));
+    if (ret != (ssize_t)(sizeof(*header) + sizeof(buffer))) {
+        atomic_fetch_add_explicit(&dropped, snapshot, memory_order_relaxed);
+    }
+}
+
 static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
     ssize_t ret;
     int sock;
@@ -195,30 +265,10 @@ static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
     newVec[0].iov_base = (unsigned char*)&header;
     newVec[0].iov_len = sizeof(header);
 
-    // If we dropped events before, try to tell statsd.
-    if (sock >= 0) {
-        int32_t snapshot = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
-        if (snapshot) {
-            android_log_event_long_t buffer;
-            header.id = LOG_ID_STATS;
-            // store the last log error in the tag field. This tag field is not used by statsd.
-            buffer.header.tag = atomic_load(&log_error);
-            buffer.payload.type = EVENT_TYPE_LONG;
-            // format:
-            // |atom_tag|dropped_count|
-            int64_t composed_long = atomic_load(&atom_tag);
-            // Send 2 int32's via an int64.
-            composed_long = ((composed_long << 32) | ((int64_t)snapshot));
-            buffer.payload.data = composed_long;
-
-            newVec[headerLength].iov_base = &buffer;
-            newVec[headerLength].iov_len = sizeof(buffer);
-
-            ret = TEMP_FAILURE_RETRY(writev(sock, newVec, 2));
-            if (ret != (ssize_t)(sizeof(header) + sizeof(buffer))) {
-                atomic_fetch_add_explicit(&dropped, snapshot, memory_order_relaxed);
-            }
-        }
+    // If we dropped events before, try to tell statsd. With the async writer
+    // running, it does this before each batch instead.
+    if (sock >= 0 && !atomic_load_explicit(&async_running, memory_order_relaxed)) {
+        statsdReportDrops(sock, &header);
     }
 
     header.id = LOG_ID_STATS;
@@ -236,6 +286,14 @@ static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
         }
     }
 
+    if (atomic_load_explicit(&async_running, memory_order_relaxed)) {
+        ret = asyncEnqueue(newVec, i);
+        if (ret != -EMSGSIZE) {
+            return ret;
+        }
+        // Too big for a slot, write it from here.
+    }
+
     /*
      * The write below could be lost, but will never block.
      *
@@ -283,3 +341,196 @@ static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
 
     return ret;
 }
+
+static int asyncEventTag(const struct async_slot* slot) {
+    int32_t tag = 0;
+    if (slot->len >= sizeof(android_log_header_t) + sizeof(tag)) {
+        memcpy(&tag, slot->data + sizeof(android_log_header_t), sizeof(tag));
+    }
+    return tag;
+}
+
+/* Copies an event to the ring, returns its payload size or -errno. */
+static int asyncEnqueue(struct iovec* vec, size_t nr) {
+    size_t len = 0;
+    for (size_t i = 0; i < nr; i++) {
+        len += vec[i].iov_len;
+    }
+    if (len > kAsyncSlotSize) {
+        return -EMSGSIZE;
+    }
+
+    struct async_slot* slot;
+    unsigned pos = atomic_load_explicit(&async_enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        slot = &async_slots[pos & (kAsyncSlotCount - 1)];
+        unsigned seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int diff = (int)(seq - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&async_enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // The writer is behind by a full ring: statsd is not keeping up.
+            atomic_fetch_add_explicit(&async_dropped_full, 1, memory_order_relaxed);
+            return -EAGAIN;
+        } else {
+            pos = atomic_load_explicit(&async_enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    unsigned char* p = slot->data;
+    for (size_t i = 0; i < nr; i++) {
+        memcpy(p, vec[i].iov_base, vec[i].iov_len);
+        p += vec[i].iov_len;
+    }
+    slot->len = len;
+    atomic_store(&slot->seq, pos + 1);
+    atomic_fetch_add_explicit(&async_queued, 1, memory_order_relaxed);
+
+    // Only wake the writer, a system call, if it went to sleep on an empty ring.
+    if (atomic_exchange(&async_sleeping, 0)) {
+        syscall(__NR_futex, &async_sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+    return len - sizeof(android_log_header_t);
+}
+
+/* Sends up to kAsyncBatchSize ready events, returns how many were taken off the ring. */
+static size_t asyncWriteBatch() {
+    struct mmsghdr msgs[kAsyncBatchSize];
+    struct iovec vecs[kAsyncBatchSize];
+    struct async_slot* slots[kAsyncBatchSize];
+    size_t n = 0;
+
+    while (n < kAsyncBatchSize) {
+        struct async_slot* slot = &async_slots[(async_dequeue_pos + n) & (kAsyncSlotCount - 1)];
+        if (atomic_load(&slot->seq) != async_dequeue_pos + n + 1) {
+            break;
+        }
+        slots[n] = slot;
+        vecs[n].iov_base = slot->data;
+        vecs[n].iov_len = slot->len;
+        memset(&msgs[n], 0, sizeof(msgs[n]));
+        msgs[n].msg_hdr.msg_iov = &vecs[n];
+        msgs[n].msg_hdr.msg_iovlen = 1;
+        n++;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    int sock = atomic_load(&statsdLoggerWrite.sock);
+    if (sock < 0 && !statd_writer_trylock()) {
+        // statsd went away or is not up yet, try to reconnect.
+        __statsdClose(sock);
+        statsdOpen();
+        statsd_writer_init_unlock();
+        sock = atomic_load(&statsdLoggerWrite.sock);
+    }
+
+    size_t sent = 0;
+    if (sock >= 0) {
+        android_log_header_t header;
+        memcpy(&header, slots[0]->data, sizeof(header));
+        statsdReportDrops(sock, &header);
+
+        while (sent < n) {
+            int ret = TEMP_FAILURE_RETRY(sendmmsg(sock, msgs + sent, n - sent, 0));
+            if (ret < 0 && errno == EAGAIN) {
+                // statsd is busy. Unlike a caller, the writer can afford to wait a
+                // little for it while the ring takes new events.
+                struct pollfd pfd = {.fd = sock, .events = POLLOUT};
+                if (TEMP_FAILURE_RETRY(poll(&pfd, 1, kAsyncSendTimeoutMs)) > 0) {
+                    continue;
+                }
+                break;
+            }
+            if (ret <= 0) {
+                if (ret < 0 && (errno == ENOTCONN || errno == ECONNREFUSED || errno == ENOENT) &&
+                    !statd_writer_trylock()) {
+                    __statsdClose(-errno);
+                    statsd_writer_init_unlock();
+                }
+                break;
+            }
+            sent += ret;
+        }
+    }
+    atomic_fetch_add_explicit(&async_written, sent, memory_order_relaxed);
+
+    // Whatever could not be sent is dropped, as the synchronous write would have.
+    for (size_t i = sent; i < n; i++) {
+        atomic_fetch_add_explicit(&async_dropped_send, 1, memory_order_relaxed);
+        statsdNoteDrop(sock < 0 ? sock : -EAGAIN, asyncEventTag(slots[i]));
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        atomic_store_explicit(&slots[i]->seq, async_dequeue_pos + i + kAsyncSlotCount,
+                              memory_order_release);
+    }
+    async_dequeue_pos += n;
+    return n;
+}
+
+static bool asyncRingEmpty() {
+    struct async_slot* slot = &async_slots[async_dequeue_pos & (kAsyncSlotCount - 1)];
+    return atomic_load(&slot->seq) != async_dequeue_pos + 1;
+}
+
+static void* asyncWriterThread(void*) {
+    pthread_setname_np(pthread_self(), "statsd_writer");
+    for (;;) {
+        if (asyncWriteBatch()) {
+            continue;
+        }
+        atomic_store(&async_sleeping, 1);
+        if (!asyncRingEmpty()) {
+            atomic_store(&async_sleeping, 0);
+            continue;
+        }
+        syscall(__NR_futex, &async_sleeping, FUTEX_WAIT_PRIVATE, 1, NULL, NULL, 0);
+    }
+    return NULL;
+}
+
+static void asyncAtforkChild() {
+    // The writer thread does not survive fork, write synchronously in the child.
+    atomic_store(&async_running, 0);
+}
+
+int stats_log_start_async_writer() {
+    statsd_writer_init_lock();
+    int ret = 0;
+    if (!atomic_load(&async_running)) {
+        if (!async_slots) {
+            async_slots = (struct async_slot*)calloc(kAsyncSlotCount, sizeof(struct async_slot));
+            if (!async_slots) {
+                statsd_writer_init_unlock();
+                return -ENOMEM;
+            }
+            pthread_atfork(NULL, NULL, asyncAtforkChild);
+        }
+        for (size_t i = 0; i < kAsyncSlotCount; i++) {
+            atomic_store(&async_slots[i].seq, (unsigned)i);
+        }
+        atomic_store(&async_enqueue_pos, 0u);
+        async_dequeue_pos = 0;
+
+        ret = -pthread_create(&async_thread, NULL, asyncWriterThread, NULL);
+        if (ret == 0) {
+            pthread_detach(async_thread);
+            atomic_store(&async_running, 1);
+        }
+    }
+    statsd_writer_init_unlock();
+    return ret;
+}
+
+void stats_log_get_async_writer_stats(struct stats_log_async_writer_stats* stats) {
+    stats->queued = atomic_load_explicit(&async_queued, memory_order_relaxed);
+    stats->written = atomic_load_explicit(&async_written, memory_order_relaxed);
+    stats->dropped_ring_full = atomic_load_explicit(&async_dropped_full, memory_order_relaxed);
+    stats->dropped_send = atomic_load_explicit(&async_dropped_send, memory_order_relaxed);
+}
@@ -62,6 +62,10 @@ enum MethodIndex {
 // Table of methods pointers in libstatssocket APIs.
 static void* g_Methods[k_MethodCount];
 
+// Points at g_Methods once every method is bound. The forwarding functions only need an
+// acquire load of this pointer after initialization, rather than going through std::call_once.
+static _Atomic(void* const*) g_MethodTable = nullptr;
+
 //
 // Libstatssocket lazy loading.
 //
@@ -130,15 +134,26 @@ static void InitializeOnce() {
     }
 }
 
-static void EnsureInitialized() {
+static void* const* InitializeSlow() {
     static std::once_flag initialize_flag;
-    std::call_once(initialize_flag, InitializeOnce);
+    std::call_once(initialize_flag, [] {
+        InitializeOnce();
+        atomic_store_explicit(&g_MethodTable, g_Methods, memory_order_release);
+    });
+    return g_Methods;
+}
+
+static inline void* const* EnsureInitialized() {
+    void* const* methods = atomic_load_explicit(&g_MethodTable, memory_order_acquire);
+    if (__builtin_expect(methods != nullptr, 1)) {
+        return methods;
+    }
+    return InitializeSlow();
 }
 
 #define INVOKE_METHOD(name, args...)                            \
     do {                                                        \
-        EnsureInitialized();                                    \
-        void* method = g_Methods[k_##name];                     \
+        void* method = EnsureInitialized()[k_##name];           \
         return reinterpret_cast<decltype(&name)>(method)(args); \
     } while (0)
 
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dlfcn.h>
+
+#include <benchmark/benchmark.h>
+
+#include "stats_event.h"
+
+#include "statssocket_lazy.h"
+
+// Compares building an event through the libstatssocket_lazy wrappers against calling the same
+// libstatssocket.so functions through pointers resolved up front. The difference is the
+// per-call cost of the lazy wrappers once they are initialized. Events are built but not
+// written, so statsd is not involved.
+
+static constexpr uint32_t kAtomId = 100000;
+static constexpr int kFieldsPerEvent = 16;
+
+static void BM_LazyBuildEvent(benchmark::State& state) {
+    if (!android::statssocket::lazy::IsAvailable()) {
+        state.SkipWithError("libstatssocket.so is not available");
+        return;
+    }
+    for (auto _ : state) {
+        AStatsEvent* event = AStatsEvent_obtain();
+        AStatsEvent_setAtomId(event, kAtomId);
+        for (int i = 0; i < kFieldsPerEvent; ++i) {
+            AStatsEvent_writeInt32(event, i);
+        }
+        AStatsEvent_build(event);
+        AStatsEvent_release(event);
+    }
+    state.SetItemsProcessed(state.iterations() * (kFieldsPerEvent + 4));
+}
+BENCHMARK(BM_LazyBuildEvent);
+
+static void BM_DirectBuildEvent(benchmark::State& state) {
+    void* handle = dlopen("libstatssocket.so", RTLD_NOW);
+    if (handle == nullptr) {
+        state.SkipWithError("libstatssocket.so is not available");
+        return;
+    }
+    auto obtain = reinterpret_cast<decltype(&AStatsEvent_obtain)>(
+            dlsym(handle, "AStatsEvent_obtain"));
+    auto set_atom_id = reinterpret_cast<decltype(&AStatsEvent_setAtomId)>(
+            dlsym(handle, "AStatsEvent_setAtomId"));
+    auto write_int32 = reinterpret_cast<decltype(&AStatsEvent_writeInt32)>(
+            dlsym(handle, "AStatsEvent_writeInt32"));
+    auto build = reinterpret_cast<decltype(&AStatsEvent_build)>(
+            dlsym(handle, "AStatsEvent_build"));
+    auto release = reinterpret_cast<decltype(&AStatsEvent_release)>(
+            dlsym(handle, "AStatsEvent_release"));
+    if (!obtain || !set_atom_id || !write_int32 || !build || !release) {
+        state.SkipWithError("Missing symbol in libstatssocket.so");
+        dlclose(handle);
+        return;
+    }
+    for (auto _ : state) {
+        AStatsEvent* event = obtain();
+        set_atom_id(event, kAtomId);
+        for (int i = 0; i < kFieldsPerEvent; ++i) {
+            write_int32(event, i);
+        }
+        build(event);
+        release(event);
+    }
+    state.SetItemsProcessed(state.iterations() * (kFieldsPerEvent + 4));
+    dlclose(handle);
+}
+BENCHMARK(BM_DirectBuildEvent);
+
+BENCHMARK_MAIN();
@@ -113,3 +113,23 @@ void autosuspend_set_wakeup_callback(void (*func)(bool success)) {
 
     autosuspend_ops->set_wakeup_callback(func);
 }
+
+void autosuspend_notify_wakelock_release(void) {
+    if (autosuspend_ops == NULL) {
+        return;  // nothing can be waiting for a retry yet
+    }
+
+    autosuspend_ops->notify_wakelock_release();
+}
+
+int autosuspend_get_stats(struct autosuspend_stats* stats) {
+    int ret;
+
+    ret = autosuspend_init();
+    if (ret) {
+        return ret;
+    }
+
+    autosuspend_ops->get_stats(stats);
+    return 0;
+}
@@ -17,11 +17,15 @@
 #ifndef _LIBSUSPEND_AUTOSUSPEND_OPS_H_
 #define _LIBSUSPEND_AUTOSUSPEND_OPS_H_
 
+struct autosuspend_stats;
+
 struct autosuspend_ops {
     int (*enable)(void);
     int (*disable)(void);
     int (*force_suspend)(int timeout_ms);
     void (*set_wakeup_callback)(void (*func)(bool success));
+    void (*notify_wakelock_release)(void);
+    void (*get_stats)(struct autosuspend_stats* stats);
 };
 
 __BEGIN_DECLS
@@ -17,25 +17,36 @@
 #define LOG_TAG "libsuspend"
 //#define LOG_NDEBUG 0
 
+#include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <poll.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <mutex>
+
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 
+#include <suspend/autosuspend.h>
+
 #include "autosuspend_ops.h"
 
 #define BASE_SLEEP_TIME 100000
 #define MAX_SLEEP_TIME 60000000
+// notified retries are spaced at least this far apart, so a burst of wakelock
+// releases cannot turn the suspend thread into a busy loop
+#define MIN_RETRY_TIME 10000
 
 static int state_fd = -1;
 static int wakeup_count_fd;
@@ -52,6 +63,17 @@ static int sleep_time = BASE_SLEEP_TIME;
 static constexpr char sys_power_state[] = "/sys/power/state";
 static constexpr char sys_power_wakeup_count[] = "/sys/power/wakeup_count";
 static bool autosuspend_is_init = false;
+static int retry_event_fd = -1;
+static std::mutex stats_lock;
+static struct autosuspend_stats stats;
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    // CLOCK_MONOTONIC stops while suspended, so time spent asleep never shows
+    // up as attempt latency or backoff
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
 
 static void update_sleep_time(bool success) {
     if (success) {
@@ -62,12 +84,60 @@ static void update_sleep_time(bool success) {
     sleep_time = MIN(sleep_time * 2, MAX_SLEEP_TIME);
 }
 
+// Waits up to timeout_us for the next retry. Returns true if the wait was cut
+// short by autosuspend_notify_wakelock_release().
+static bool wait_for_retry(int timeout_us) {
+    uint64_t start = now_us();
+    bool notified = false;
+
+    struct pollfd pfd = {.fd = retry_event_fd, .events = POLLIN};
+    int ret = TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout_us / 1000));
+    if (ret < 0) {
+        PLOG(ERROR) << "error waiting for retry event";
+        usleep(timeout_us);
+    } else if (ret > 0) {
+        eventfd_t count;
+        eventfd_read(retry_event_fd, &count);
+        notified = true;
+
+        uint64_t waited = now_us() - start;
+        if (waited < MIN_RETRY_TIME) {
+            usleep(MIN_RETRY_TIME - waited);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(stats_lock);
+    stats.total_backoff_us += now_us() - start;
+    if (notified) {
+        stats.notified_retries++;
+    }
+    return notified;
+}
+
+static void record_attempt(bool success, uint64_t latency_us) {
+    std::lock_guard<std::mutex> lock(stats_lock);
+    stats.attempts++;
+    if (success) {
+        stats.successes++;
+    } else {
+        stats.failures++;
+    }
+    stats.last_attempt_latency_us = latency_us;
+    stats.max_attempt_latency_us = MAX(stats.max_attempt_latency_us, latency_us);
+    stats.total_attempt_latency_us += latency_us;
+}
+
 static void* suspend_thread_func(void* arg __attribute__((unused))) {
     bool success = true;
 
     while (true) {
         update_sleep_time(success);
-        usleep(sleep_time);
+        if (wait_for_retry(sleep_time)) {
+            // whatever held off the last attempts is gone, so start the
+            // backoff over
+            sleep_time = BASE_SLEEP_TIME;
+        }
+        uint64_t retry_start = now_us();
         success = false;
         LOG(VERBOSE) << "read wakeup_count";
         lseek(wakeup_count_fd, 0, SEEK_SET);
@@ -84,7 +154,13 @@ static void* suspend_thread_func(void* arg __attribute__((unused))) {
         }
 
         LOG(VERBOSE) << "wait";
-        int ret = sem_wait(&suspend_lockout);
+        int ret = sem_trywait(&suspend_lockout);
+        if (ret < 0 && errno == EAGAIN) {
+            // autosuspend is disabled; time spent waiting for it to be enabled
+            // again is not attempt latency
+            ret = sem_wait(&suspend_lockout);
+            retry_start = now_us();
+        }
         if (ret < 0) {
             PLOG(ERROR) << "error waiting on semaphore";
             continue;
@@ -93,7 +169,9 @@ static void* suspend_thread_func(void* arg __attribute__((unused))) {
         LOG(VERBOSE) << "write " << wakeup_count << " to wakeup_count";
         if (WriteStringToFd(wakeup_count, wakeup_count_fd)) {
             LOG(VERBOSE) << "write " << sleep_state << " to " << sys_power_state;
+            uint64_t latency = now_us() - retry_start;
             success = WriteStringToFd(sleep_state, state_fd);
+            record_attempt(success, latency);
 
             void (*func)(bool success) = wakeup_func;
             if (func != NULL) {
@@ -101,6 +179,8 @@ static void* suspend_thread_func(void* arg __attribute__((unused))) {
             }
         } else {
             PLOG(ERROR) << "error writing to " << sys_power_wakeup_count;
+            std::lock_guard<std::mutex> lock(stats_lock);
+            stats.wakeup_count_mismatches++;
         }
 
         LOG(VERBOSE) << "release sem";
@@ -182,6 +262,9 @@ static int autosuspend_wakeup_count_enable(void) {
         PLOG(ERROR) << "error changing semaphore";
     }
 
+    // don't let a backoff built up while disabled delay the first attempt
+    eventfd_write(retry_event_fd, 1);
+
     LOG(VERBOSE) << "autosuspend_wakeup_count_enable done";
 
     return ret;
@@ -216,7 +299,7 @@ static int force_suspend(int timeout_ms) {
     return WriteStringToFd(sleep_state, state_fd) ? 0 : -1;
 }
 
-static void autosuspend_set_wakeup_callback(void (*func)(bool success)) {
+static void autosuspend_wakeup_count_set_wakeup_callback(void (*func)(bool success)) {
     if (wakeup_func != NULL) {
         LOG(ERROR) << "duplicate wakeup callback applied, keeping original";
         return;
@@ -224,13 +307,31 @@ static void autosuspend_set_wakeup_callback(void (*func)(bool success)) {
     wakeup_func = func;
 }
 
+static void autosuspend_wakeup_count_notify_wakelock_release(void) {
+    eventfd_write(retry_event_fd, 1);
+}
+
+static void autosuspend_wakeup_count_get_stats(struct autosuspend_stats* out) {
+    std::lock_guard<std::mutex> lock(stats_lock);
+    *out = stats;
+}
+
 struct autosuspend_ops autosuspend_wakeup_count_ops = {
     .enable = autosuspend_wakeup_count_enable,
     .disable = autosuspend_wakeup_count_disable,
     .force_suspend = force_suspend,
-    .set_wakeup_callback = autosuspend_set_wakeup_callback,
+    .set_wakeup_callback = autosuspend_wakeup_count_set_wakeup_callback,
+    .notify_wakelock_release = autosuspend_wakeup_count_notify_wakelock_release,
+    .get_stats = autosuspend_wakeup_count_get_stats,
 };
 
 struct autosuspend_ops* autosuspend_wakeup_count_init(void) {
+    if (retry_event_fd < 0) {
+        retry_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (retry_event_fd < 0) {
+            PLOG(ERROR) << "error creating retry eventfd";
+            return NULL;
+        }
+    }
     return &autosuspend_wakeup_count_ops;
 }
@@ -19,6 +19,7 @@
 
 #include <sys/cdefs.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 __BEGIN_DECLS
 
@@ -64,6 +65,43 @@ int autosuspend_force_suspend(int timeout_ms);
  */
 void autosuspend_set_wakeup_callback(void (*func)(bool success));
 
+/*
+ * autosuspend_notify_wakelock_release
+ *
+ * Tell autosuspend that a wakelock was released, so that a suspend attempt
+ * waiting out its retry backoff is made right away instead. Cheap enough to
+ * call on every release.
+ */
+void autosuspend_notify_wakelock_release(void);
+
+struct autosuspend_stats {
+    /* suspend attempts, i.e. writes to /sys/power/state, and how they ended */
+    uint64_t attempts;
+    uint64_t successes;
+    uint64_t failures;
+    /* wakeup_count writes rejected because a wakeup event came in */
+    uint64_t wakeup_count_mismatches;
+    /* retries started by a notification rather than by the backoff expiring */
+    uint64_t notified_retries;
+    /* time from starting a retry to entering suspend, in microseconds; this
+     * covers waiting for wakeup events in progress to finish */
+    uint64_t last_attempt_latency_us;
+    uint64_t max_attempt_latency_us;
+    uint64_t total_attempt_latency_us;
+    /* time spent in retry backoff, in microseconds */
+    uint64_t total_backoff_us;
+};
+
+/*
+ * autosuspend_get_stats
+ *
+ * Copy the suspend attempt statistics collected since autosuspend was first
+ * enabled into stats.
+ *
+ * Returns 0 on success, -1 if autosuspend could not be initialized.
+ */
+int autosuspend_get_stats(struct autosuspend_stats* stats);
+
 __END_DECLS
 
 #endif
@@ -37,6 +37,8 @@
  * break builds.
  */
 
+#include <stddef.h>
+
 #include "../ndk/sync.h"
 
 __BEGIN_DECLS
@@ -44,6 +46,26 @@ __BEGIN_DECLS
 /* timeout in msecs */
 int sync_wait(int fd, int timeout);
 
+/* Merges count fences into a new fence that signals once all of them have.
+ * The inputs are not closed. Merging is done as a balanced tree, which keeps
+ * the work in the kernel at O(count log count) points instead of the
+ * O(count^2) of merging them one at a time into a growing fence.
+ * Returns the new fence fd, or -1 with errno set.
+ */
+int sync_merge_many(const char *name, const int *fds, size_t count);
+
+/* Waits until any of the fences is signaled, for at most timeout msecs (-1
+ * waits forever). Returns the index of a signaled fence, or -1 with errno set
+ * to ETIME on timeout.
+ */
+int sync_wait_any(const int *fds, size_t count, int timeout);
+
+/* Waits until all of the fences are signaled, for at most timeout msecs in
+ * total (-1 waits forever). Returns 0, or -1 with errno set to ETIME on
+ * timeout.
+ */
+int sync_wait_all(const int *fds, size_t count, int timeout);
+
 __END_DECLS
 
 #endif /* __SYS_CORE_SYNC_H */
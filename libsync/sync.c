@@ -22,7 +22,10 @@
 #include <poll.h>
 #include <stdatomic.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -151,6 +154,123 @@ int sync_wait(int fd, int timeout)
     return ret;
 }
 
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* Polls fds that are not yet known to be signaled. Signaled entries have their fd negated (poll
+ * ignores negative fds) and the number of them is returned, or -1 on error or timeout.
+ */
+static int sync_poll_fences(struct pollfd *fds, size_t count, int timeout)
+{
+    int ret;
+    int signaled = 0;
+    size_t i;
+
+    do {
+        ret = poll(fds, count, timeout);
+    } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+
+    if (ret == 0) {
+        errno = ETIME;
+        return -1;
+    } else if (ret < 0) {
+        return ret;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (fds[i].revents & (POLLERR | POLLNVAL)) {
+            errno = EINVAL;
+            return -1;
+        }
+        if (fds[i].revents & POLLIN) {
+            fds[i].fd = -fds[i].fd - 1;
+            signaled++;
+        }
+    }
+    return signaled;
+}
+
+static struct pollfd *sync_alloc_pollfds(const int *fds, size_t count)
+{
+    struct pollfd *pfds;
+    size_t i;
+
+    if (count == 0 || !fds) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    pfds = calloc(count, sizeof(*pfds));
+    if (!pfds)
+        return NULL;
+
+    for (i = 0; i < count; i++) {
+        if (fds[i] < 0) {
+            free(pfds);
+            errno = EINVAL;
+            return NULL;
+        }
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLIN;
+    }
+    return pfds;
+}
+
+int sync_wait_any(const int *fds, size_t count, int timeout)
+{
+    struct pollfd *pfds;
+    int ret;
+    size_t i;
+
+    pfds = sync_alloc_pollfds(fds, count);
+    if (!pfds)
+        return -1;
+
+    ret = sync_poll_fences(pfds, count, timeout);
+    if (ret > 0) {
+        for (i = 0; i < count; i++) {
+            if (pfds[i].fd < 0) {
+                ret = i;
+                break;
+            }
+        }
+    }
+    free(pfds);
+    return ret;
+}
+
+int sync_wait_all(const int *fds, size_t count, int timeout)
+{
+    struct pollfd *pfds;
+    int64_t deadline = timeout >= 0 ? now_ms() + timeout : 0;
+    size_t remaining = count;
+    int ret = 0;
+
+    pfds = sync_alloc_pollfds(fds, count);
+    if (!pfds)
+        return -1;
+
+    while (remaining > 0) {
+        int remaining_ms = -1;
+        if (timeout >= 0) {
+            int64_t left = deadline - now_ms();
+            remaining_ms = left > 0 ? (int)left : 0;
+        }
+
+        ret = sync_poll_fences(pfds, count, remaining_ms);
+        if (ret < 0)
+            break;
+        remaining -= ret;
+        ret = 0;
+    }
+    free(pfds);
+    return ret;
+}
+
 static int legacy_sync_merge(const char *name, int fd1, int fd2)
 {
     struct sync_legacy_merge_data data;
@@ -206,6 +326,70 @@ int sync_merge(const char *name, int fd1, int fd2)
     return ret;
 }
 
+int sync_merge_many(const char *name, const int *fds, size_t count)
+{
+    int *level;
+    char *owned;
+    size_t n, i;
+    int ret = -1;
+    int save_errno;
+
+    if (count == 0 || !fds) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (count == 1)
+        return fcntl(fds[0], F_DUPFD_CLOEXEC, 0);
+
+    level = malloc(count * sizeof(*level));
+    owned = calloc(count, sizeof(*owned));
+    if (!level || !owned)
+        goto out;
+    memcpy(level, fds, count * sizeof(*level));
+
+    /* Merge neighbours pairwise, level by level. Every fence is copied into
+     * log2(count) merges instead of up to count - 1 as when merging into one
+     * growing fence, and intermediate fences are closed as soon as they have
+     * been consumed.
+     */
+    for (n = count; n > 1; n = (n + 1) / 2) {
+        for (i = 0; i < n / 2; i++) {
+            int a = level[2 * i], b = level[2 * i + 1];
+            int merged = sync_merge(name, a, b);
+            if (owned[2 * i])
+                close(a);
+            if (owned[2 * i + 1])
+                close(b);
+            owned[2 * i] = owned[2 * i + 1] = 0;
+            if (merged < 0) {
+                /* Consumed entries are no longer owned, so this closes the
+                 * merges made so far and the rest of this level.
+                 */
+                save_errno = errno;
+                for (i = 0; i < n; i++) {
+                    if (owned[i])
+                        close(level[i]);
+                }
+                errno = save_errno;
+                goto out;
+            }
+            level[i] = merged;
+            owned[i] = 1;
+        }
+        if (n % 2) {
+            level[n / 2] = level[n - 1];
+            owned[n / 2] = owned[n - 1];
+            owned[n - 1] = 0;
+        }
+    }
+    ret = level[0];
+
+out:
+    free(level);
+    free(owned);
+    return ret;
+}
+
 static struct sync_fence_info_data *legacy_sync_fence_info(int fd)
 {
     struct sync_fence_info_data *legacy_info;
@@ -14,6 +14,7 @@
 #include <tuple>
 #include <random>
 #include <unordered_map>
+#include <chrono>
 
 /* These deprecated declarations were in the legacy android/sync.h. They've been removed to
  * encourage code to move to the modern equivalents. But they are still implemented in libsync.so
@@ -117,6 +118,10 @@ class SyncFence {
         m_fd = -1;
         m_fdInitialized = false;
     }
+    explicit SyncFence(int fd) noexcept {
+        if (fd != -1)
+            setFd(fd);
+    }
 public:
     bool isValid() const {
         if (m_fdInitialized) {
@@ -185,6 +190,13 @@ public:
             temp.clearFd();
         }
     }
+    // Merges all the sources at once through sync_merge_many().
+    static SyncFence mergeMany(const vector<SyncFence> &sources) noexcept {
+        vector<int> fds;
+        for (auto &source : sources)
+            fds.push_back(source.getFd());
+        return SyncFence(sync_merge_many("mergeManyFence", fds.data(), fds.size()));
+    }
     void destroy() {
         if (isValid()) {
             close(m_fd);
@@ -512,6 +524,124 @@ TEST(FenceTest, GetInfoSignaled) {
     ASSERT_EQ(info[0].status, 1);
 }
 
+TEST(FenceTest, MergeMany) {
+    const int timelineCount = 7;
+    SyncTimeline timelines[timelineCount];
+    vector<SyncFence> fences;
+    for (auto &timeline : timelines) {
+        ASSERT_TRUE(timeline.isValid());
+        fences.emplace_back(timeline, 5);
+        ASSERT_TRUE(fences.back().isValid());
+    }
+
+    // The tree merge must produce the same fence as merging one at a time.
+    SyncFence chained(fences);
+    SyncFence merged = SyncFence::mergeMany(fences);
+    ASSERT_TRUE(merged.isValid());
+    ASSERT_EQ(merged.getActiveCount(), chained.getActiveCount());
+    ASSERT_EQ(merged.getSize(), timelineCount);
+    CheckModernLegacyInfoMatch(merged);
+
+    // The sources must still be open.
+    for (auto &fence : fences)
+        ASSERT_TRUE(fence.isValid());
+
+    for (int i = 0; i < timelineCount; i++) {
+        ASSERT_EQ(merged.wait(0), -1);
+        ASSERT_EQ(errno, ETIME);
+        timelines[i].inc(5);
+        ASSERT_EQ(merged.getSignaledCount(), i + 1);
+    }
+    ASSERT_EQ(merged.wait(0), 0);
+}
+
+TEST(FenceTest, MergeManySingle) {
+    SyncTimeline timeline;
+    ASSERT_TRUE(timeline.isValid());
+
+    vector<SyncFence> fences;
+    fences.emplace_back(timeline, 1);
+    SyncFence merged = SyncFence::mergeMany(fences);
+    ASSERT_TRUE(merged.isValid());
+    ASSERT_NE(merged.getFd(), fences[0].getFd());
+
+    ASSERT_EQ(timeline.inc(1), 0);
+    ASSERT_EQ(merged.wait(0), 0);
+}
+
+TEST(FenceTest, MergeManyNegative) {
+    int fds[] = {-1, -1};
+    ASSERT_EQ(sync_merge_many("bad", fds, 0), -1);
+    ASSERT_EQ(errno, EINVAL);
+    ASSERT_EQ(sync_merge_many("bad", fds, 2), -1);
+}
+
+TEST(FenceTest, WaitAny) {
+    SyncTimeline timelineA, timelineB, timelineC;
+    SyncFence fenceA(timelineA, 1);
+    SyncFence fenceB(timelineB, 1);
+    SyncFence fenceC(timelineC, 1);
+    int fds[] = {fenceA.getFd(), fenceB.getFd(), fenceC.getFd()};
+
+    ASSERT_EQ(sync_wait_any(fds, 3, 0), -1);
+    ASSERT_EQ(errno, ETIME);
+
+    ASSERT_EQ(timelineB.inc(1), 0);
+    ASSERT_EQ(sync_wait_any(fds, 3, 0), 1);
+
+    // Wake up from a blocking wait.
+    thread signaler([&timelineC]() {
+        usleep(10000);
+        timelineC.inc(1);
+    });
+    int fdsAC[] = {fenceA.getFd(), fenceC.getFd()};
+    ASSERT_EQ(sync_wait_any(fdsAC, 2, 1000), 1);
+    signaler.join();
+}
+
+TEST(FenceTest, WaitAll) {
+    SyncTimeline timelineA, timelineB, timelineC;
+    SyncFence fenceA(timelineA, 1);
+    SyncFence fenceB(timelineB, 1);
+    SyncFence fenceC(timelineC, 1);
+    int fds[] = {fenceA.getFd(), fenceB.getFd(), fenceC.getFd()};
+
+    ASSERT_EQ(timelineA.inc(1), 0);
+    ASSERT_EQ(timelineC.inc(1), 0);
+    ASSERT_EQ(sync_wait_all(fds, 3, 0), -1);
+    ASSERT_EQ(errno, ETIME);
+
+    thread signaler([&timelineB]() {
+        usleep(10000);
+        timelineB.inc(1);
+    });
+    ASSERT_EQ(sync_wait_all(fds, 3, 1000), 0);
+    signaler.join();
+}
+
+TEST(FenceTest, DISABLED_BenchmarkMergeMany) {
+    const int timelineCount = 256;
+    vector<SyncTimeline> timelines(timelineCount);
+    vector<SyncFence> fences;
+    for (auto &timeline : timelines) {
+        ASSERT_TRUE(timeline.isValid());
+        fences.emplace_back(timeline, 1);
+    }
+
+    auto start = chrono::steady_clock::now();
+    SyncFence chained(fences);
+    chrono::duration<double, milli> chainedMs = chrono::steady_clock::now() - start;
+    ASSERT_TRUE(chained.isValid());
+
+    start = chrono::steady_clock::now();
+    SyncFence merged = SyncFence::mergeMany(fences);
+    chrono::duration<double, milli> treeMs = chrono::steady_clock::now() - start;
+    ASSERT_TRUE(merged.isValid());
+
+    cout << "merging " << timelineCount << " fences: chained " << chainedMs.count()
+         << " ms, tree " << treeMs.count() << " ms" << endl;
+}
+
 TEST(StressTest, TwoThreadsSharedTimeline) {
     const int iterations = 1 << 16;
     int counter = 0;
@@ -18,6 +18,7 @@
 
 #include "SocketListener.h"
 
+#include <atomic>
 #include <vector>
 
 class FrameworkCommand;
@@ -34,7 +35,7 @@ private:
     int mCommandCount;
     bool mWithSeq;
     std::vector<FrameworkCommand*> mCommands;
-    bool mSkipToNextNullByte;
+    std::atomic<bool> mSkipToNextNullByte;
 
 public:
     FrameworkListener(const char *socketName);
@@ -16,9 +16,13 @@
 #ifndef _NETLINKEVENT_H
 #define _NETLINKEVENT_H
 
+#include <stdint.h>
+
 #include <sysutils/NetlinkListener.h>
 
 #define NL_PARAMS_MAX 32
+/* Space for the parameters formatted from a binary message */
+#define NL_TEXT_MAX 1024
 
 class NetlinkEvent {
 public:
@@ -38,16 +42,27 @@ public:
 
 private:
     int  mSeq;
-    char *mPath;
+    const char *mPath;
     Action mAction;
-    char *mSubsystem;
-    char *mParams[NL_PARAMS_MAX];
+    const char *mSubsystem;
+    const char *mParams[NL_PARAMS_MAX];
+    // Copy of the message made by decode(), which the strings point into.
+    char *mCopy;
+    // Parameters formatted by parsing binary messages live in mText, unless
+    // they did not fit and had to be allocated.
+    uint32_t mAllocatedParams;
+    size_t mTextLen;
+    char mText[NL_TEXT_MAX];
 
 public:
     NetlinkEvent();
     virtual ~NetlinkEvent();
 
     bool decode(char *buffer, int size, int format = NetlinkListener::NETLINK_FORMAT_ASCII);
+    // Like decode(), but the event points into buffer instead of copying it,
+    // so buffer must not change until the event is destroyed.
+    bool decodeInPlace(char *buffer, int size,
+                       int format = NetlinkListener::NETLINK_FORMAT_ASCII);
     const char *findParam(const char *paramName);
 
     const char *getSubsystem() { return mSubsystem; }
@@ -65,6 +80,9 @@ public:
     bool parseRtMessage(const struct nlmsghdr *nh);
     bool parseNdUserOptMessage(const struct nlmsghdr *nh);
     struct nlattr* findNlAttr(const nlmsghdr* nl, size_t hdrlen, uint16_t attr);
+
+ private:
+    void setParam(int index, const char *format, ...) __attribute__((format(printf, 3, 4)));
 };
 
 #endif
@@ -23,6 +23,9 @@ class NetlinkEvent;
 class NetlinkListener : public SocketListener {
     char mBuffer[64 * 1024] __attribute__((aligned(4)));
     int mFormat;
+    // Room for the rest of the datagrams received together with the one in
+    // mBuffer, allocated on first use.
+    char *mBatchBuffer;
 
 public:
     static const int NETLINK_FORMAT_ASCII = 0;
@@ -39,7 +42,7 @@ public:
 #else
     NetlinkListener(int socket, int format = NETLINK_FORMAT_ASCII);
 #endif
-    virtual ~NetlinkListener() {}
+    virtual ~NetlinkListener();
 
 protected:
     virtual bool onDataAvailable(SocketClient *cli);
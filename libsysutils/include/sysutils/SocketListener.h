@@ -17,6 +17,7 @@
 #define _SOCKETLISTENER_H
 
 #include <pthread.h>
+#include <stdint.h>
 
 #include <unordered_map>
 #include <vector>
@@ -31,7 +32,8 @@ class SocketListener {
     std::unordered_map<int, SocketClient*> mClients;
     pthread_mutex_t         mClientsLock;
     int                     mCtrlPipe[2];
-    pthread_t               mThread;
+    int                     mEpollFd;
+    std::vector<pthread_t>  mThreads;
     bool                    mUseCmdNum;
 
 public:
@@ -42,13 +44,17 @@ public:
     virtual ~SocketListener();
     int startListener();
     int startListener(int backlog);
+    // Serves clients from numThreads threads. A client is only served by one
+    // thread at a time, so its data is still handled in order, but
+    // onDataAvailable() may run concurrently for different clients.
+    int startListener(int backlog, int numThreads);
     int stopListener();
 
     void sendBroadcast(int code, const char *msg, bool addErrno);
 
     void runOnEachSocket(SocketClientCommand *command);
 
-    bool release(SocketClient *c) { return release(c, true); }
+    bool release(SocketClient *c);
 
 protected:
     virtual bool onDataAvailable(SocketClient *c) = 0;
@@ -60,7 +66,8 @@ private:
     // while processing it.
     std::vector<SocketClient*> snapshotClients();
 
-    bool release(SocketClient *c, bool wakeup);
+    // Adds fd to the epoll set, or re-enables it after a one-shot event.
+    bool watch(int fd, int op, uint32_t events);
     void runListener();
     void init(const char *socketName, int socketFd, bool listen, bool useCmdNum);
 };
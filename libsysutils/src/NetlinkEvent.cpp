@@ -29,6 +29,8 @@
 #include <net/if.h>
 #include <netinet/icmp6.h>
 #include <netinet/in.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/personality.h>
@@ -142,18 +144,54 @@ static_assert(sizeof(ulog_packet_msg64_t) == 192);
 
 /******************************************************************************/
 
+static_assert(NL_PARAMS_MAX <= 32, "mAllocatedParams has one bit per parameter");
+
 NetlinkEvent::NetlinkEvent() {
     mAction = Action::kUnknown;
     memset(mParams, 0, sizeof(mParams));
     mPath = nullptr;
     mSubsystem = nullptr;
+    mCopy = nullptr;
+    mAllocatedParams = 0;
+    mTextLen = 0;
 }
 
 NetlinkEvent::~NetlinkEvent() {
-    free(mPath);
-    free(mSubsystem);
-    for (auto param : mParams) {
-        free(param);
+    free(mCopy);
+    for (int i = 0; i < NL_PARAMS_MAX; i++) {
+        if (mAllocatedParams & (1u << i)) {
+            free(const_cast<char*>(mParams[i]));
+        }
+    }
+}
+
+/*
+ * Formats parameter 'index' into mText, or into an allocation of its own if
+ * it does not fit.
+ */
+void NetlinkEvent::setParam(int index, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    char *text = mText + mTextLen;
+    size_t avail = sizeof(mText) - mTextLen;
+    int len = vsnprintf(text, avail, format, ap);
+    va_end(ap);
+    if (len < 0) {
+        return;
+    }
+    if (static_cast<size_t>(len) < avail) {
+        mParams[index] = text;
+        mTextLen += len + 1;
+        return;
+    }
+
+    char *param = nullptr;
+    va_start(ap, format);
+    len = vasprintf(&param, format, ap);
+    va_end(ap);
+    if (len >= 0) {
+        mParams[index] = param;
+        mAllocatedParams |= 1u << index;
     }
 }
 
@@ -231,16 +269,16 @@ bool NetlinkEvent::parseIfInfoMessage(const struct nlmsghdr *nh) {
     for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
         switch(rta->rta_type) {
             case IFLA_IFNAME:
-                asprintf(&mParams[0], "INTERFACE=%s", (char *) RTA_DATA(rta));
+                setParam(0, "INTERFACE=%s", (char *) RTA_DATA(rta));
                 // We can get the interface change information from sysfs update
                 // already. But in case we missed those message when devices start.
                 // We do a update again when received a kLinkUp event. To make
                 // the message consistent, use IFINDEX here as well since sysfs
                 // uses IFINDEX.
-                asprintf(&mParams[1], "IFINDEX=%d", ifi->ifi_index);
+                setParam(1, "IFINDEX=%d", ifi->ifi_index);
                 mAction = (ifi->ifi_flags & IFF_LOWER_UP) ? Action::kLinkUp :
                                                             Action::kLinkDown;
-                mSubsystem = strdup("net");
+                mSubsystem = "net";
                 return true;
         }
     }
@@ -335,18 +373,18 @@ bool NetlinkEvent::parseIfAddrMessage(const struct nlmsghdr *nh) {
     // Fill in netlink event information.
     mAction = (type == RTM_NEWADDR) ? Action::kAddressUpdated :
                                       Action::kAddressRemoved;
-    mSubsystem = strdup("net");
-    asprintf(&mParams[0], "ADDRESS=%s/%d", addrstr, ifaddr->ifa_prefixlen);
-    asprintf(&mParams[1], "INTERFACE=%s", ifname);
-    asprintf(&mParams[2], "FLAGS=%u", flags);
-    asprintf(&mParams[3], "SCOPE=%u", ifaddr->ifa_scope);
-    asprintf(&mParams[4], "IFINDEX=%u", ifaddr->ifa_index);
+    mSubsystem = "net";
+    setParam(0, "ADDRESS=%s/%d", addrstr, ifaddr->ifa_prefixlen);
+    setParam(1, "INTERFACE=%s", ifname);
+    setParam(2, "FLAGS=%u", flags);
+    setParam(3, "SCOPE=%u", ifaddr->ifa_scope);
+    setParam(4, "IFINDEX=%u", ifaddr->ifa_index);
 
     if (cacheinfo) {
-        asprintf(&mParams[5], "PREFERRED=%u", cacheinfo->ifa_prefered);
-        asprintf(&mParams[6], "VALID=%u", cacheinfo->ifa_valid);
-        asprintf(&mParams[7], "CSTAMP=%u", cacheinfo->cstamp);
-        asprintf(&mParams[8], "TSTAMP=%u", cacheinfo->tstamp);
+        setParam(5, "PREFERRED=%u", cacheinfo->ifa_prefered);
+        setParam(6, "VALID=%u", cacheinfo->ifa_valid);
+        setParam(7, "CSTAMP=%u", cacheinfo->cstamp);
+        setParam(8, "TSTAMP=%u", cacheinfo->tstamp);
     }
 
     return true;
@@ -371,9 +409,9 @@ bool NetlinkEvent::parseUlogPacketMessage(const struct nlmsghdr *nh) {
         devname = pm32->indev_name[0] ? pm32->indev_name : pm32->outdev_name;
     }
 
-    asprintf(&mParams[0], "ALERT_NAME=%s", alert);
-    asprintf(&mParams[1], "INTERFACE=%s", devname);
-    mSubsystem = strdup("qlog");
+    setParam(0, "ALERT_NAME=%s", alert);
+    setParam(1, "INTERFACE=%s", devname);
+    mSubsystem = "qlog";
     mAction = Action::kChange;
     return true;
 }
@@ -411,17 +449,16 @@ bool NetlinkEvent::parseNfPacketMessage(struct nlmsghdr *nh) {
         raw = (char*)nlAttrData(payload);
     }
 
-    size_t hexSize = 5 + (len * 2);
-    char* hex = (char*)calloc(1, hexSize);
-    strlcpy(hex, "HEX=", hexSize);
+    char hex[2 * 256 + 1];
     for (int i = 0; i < len; i++) {
-        hex[4 + (i * 2)] = "0123456789abcdef"[(raw[i] >> 4) & 0xf];
-        hex[5 + (i * 2)] = "0123456789abcdef"[raw[i] & 0xf];
+        hex[i * 2] = "0123456789abcdef"[(raw[i] >> 4) & 0xf];
+        hex[1 + (i * 2)] = "0123456789abcdef"[raw[i] & 0xf];
     }
+    hex[len * 2] = '\0';
 
-    asprintf(&mParams[0], "UID=%d", uid);
-    mParams[1] = hex;
-    mSubsystem = strdup("strict");
+    setParam(0, "UID=%d", uid);
+    setParam(1, "HEX=%s", hex);
+    mSubsystem = "strict";
     mAction = Action::kChange;
     return true;
 }
@@ -510,10 +547,10 @@ bool NetlinkEvent::parseRtMessage(const struct nlmsghdr *nh) {
     // Fill in netlink event information.
     mAction = (type == RTM_NEWROUTE) ? Action::kRouteUpdated :
                                        Action::kRouteRemoved;
-    mSubsystem = strdup("net");
-    asprintf(&mParams[0], "ROUTE=%s/%d", dst, prefixLength);
-    asprintf(&mParams[1], "GATEWAY=%s", (*gw) ? gw : "");
-    asprintf(&mParams[2], "INTERFACE=%s", (*dev) ? dev : "");
+    mSubsystem = "net";
+    setParam(0, "ROUTE=%s/%d", dst, prefixLength);
+    setParam(1, "GATEWAY=%s", (*gw) ? gw : "");
+    setParam(2, "INTERFACE=%s", (*dev) ? dev : "");
 
     return true;
 }
@@ -612,10 +649,10 @@ bool NetlinkEvent::parseNdUserOptMessage(const struct nlmsghdr *nh) {
         buf[pos] = '\0';
 
         mAction = Action::kRdnss;
-        mSubsystem = strdup("net");
-        asprintf(&mParams[0], "INTERFACE=%s", ifname);
-        asprintf(&mParams[1], "LIFETIME=%u", lifetime);
-        asprintf(&mParams[2], "SERVERS=%s", buf);
+        mSubsystem = "net";
+        setParam(0, "INTERFACE=%s", ifname);
+        setParam(1, "LIFETIME=%u", lifetime);
+        setParam(2, "SERVERS=%s", buf);
         free(buf);
     } else if (opthdr->nd_opt_type == ND_OPT_DNSSL) {
         // TODO: support DNSSL.
@@ -734,7 +771,7 @@ bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
                     return false;
                 }
             }
-            mPath = strdup(p+1);
+            mPath = p + 1;
             first = 0;
         } else {
             const char* a;
@@ -750,9 +787,9 @@ bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
                     SLOGE("NetlinkEvent::parseAsciiNetlinkMessage: failed to parse SEQNUM=%s", a);
                 }
             } else if ((a = HAS_CONST_PREFIX(s, end, "SUBSYSTEM=")) != nullptr) {
-                mSubsystem = strdup(a);
+                mSubsystem = a;
             } else if (param_idx < NL_PARAMS_MAX) {
-                mParams[param_idx++] = strdup(s);
+                mParams[param_idx++] = s;
             }
         }
         s += strlen(s) + 1;
@@ -761,6 +798,21 @@ bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
 }
 
 bool NetlinkEvent::decode(char *buffer, int size, int format) {
+    // Only ASCII messages are referred to by the event, binary ones are
+    // formatted into mText.
+    if (format == NetlinkListener::NETLINK_FORMAT_ASCII && size > 0) {
+        mCopy = static_cast<char *>(malloc(size));
+        if (!mCopy) {
+            SLOGE("NetlinkEvent::decode: out of memory");
+            return false;
+        }
+        memcpy(mCopy, buffer, size);
+        buffer = mCopy;
+    }
+    return decodeInPlace(buffer, size, format);
+}
+
+bool NetlinkEvent::decodeInPlace(char *buffer, int size, int format) {
     if (format == NetlinkListener::NETLINK_FORMAT_BINARY
             || format == NetlinkListener::NETLINK_FORMAT_BINARY_UNICAST) {
         return parseBinaryNetlinkMessage(buffer, size);
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sysutils/NetlinkEvent.h>
+
+#include <arpa/inet.h>
+#include <linux/if_addr.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nfnetlink_log.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <string.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const char kUevent[] =
+        "add@/devices/virtual/net/wlan0\0ACTION=add\0DEVPATH=/devices/virtual/net/wlan0\0"
+        "SUBSYSTEM=net\0INTERFACE=wlan0\0IFINDEX=7\0SEQNUM=1234";
+
+// An RTM_NEWADDR message for 192.0.2.1/24 on the loopback interface.
+struct AddrMessage {
+    nlmsghdr hdr;
+    ifaddrmsg ifa;
+    rtattr addr_rta;
+    in_addr addr;
+    rtattr cacheinfo_rta;
+    ifa_cacheinfo cacheinfo;
+};
+
+AddrMessage makeAddrMessage() {
+    AddrMessage msg = {};
+    msg.hdr.nlmsg_len = sizeof(msg);
+    msg.hdr.nlmsg_type = RTM_NEWADDR;
+    msg.ifa.ifa_family = AF_INET;
+    msg.ifa.ifa_prefixlen = 24;
+    msg.ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+    msg.ifa.ifa_index = if_nametoindex("lo");
+    msg.addr_rta.rta_len = RTA_LENGTH(sizeof(msg.addr));
+    msg.addr_rta.rta_type = IFA_ADDRESS;
+    inet_pton(AF_INET, "192.0.2.1", &msg.addr);
+    msg.cacheinfo_rta.rta_len = RTA_LENGTH(sizeof(msg.cacheinfo));
+    msg.cacheinfo_rta.rta_type = IFA_CACHEINFO;
+    msg.cacheinfo.ifa_prefered = 100;
+    msg.cacheinfo.ifa_valid = 200;
+    return msg;
+}
+
+}  // unnamed namespace
+
+TEST(NetlinkEventTest, DecodesAsciiCopy) {
+    std::string buffer(kUevent, sizeof(kUevent));
+    NetlinkEvent evt;
+    ASSERT_TRUE(evt.decode(buffer.data(), buffer.size()));
+
+    // The event keeps its own copy of the message.
+    buffer.assign(buffer.size(), 'x');
+    EXPECT_EQ(NetlinkEvent::Action::kAdd, evt.getAction());
+    EXPECT_STREQ("net", evt.getSubsystem());
+    EXPECT_STREQ("wlan0", evt.findParam("INTERFACE"));
+    EXPECT_STREQ("7", evt.findParam("IFINDEX"));
+    EXPECT_EQ(nullptr, evt.findParam("SEQNUM"));
+}
+
+TEST(NetlinkEventTest, DecodesAsciiInPlace) {
+    std::string buffer(kUevent, sizeof(kUevent));
+    NetlinkEvent evt;
+    ASSERT_TRUE(evt.decodeInPlace(buffer.data(), buffer.size()));
+
+    const char* interface = evt.findParam("INTERFACE");
+    EXPECT_STREQ("wlan0", interface);
+    EXPECT_GE(interface, buffer.data());
+    EXPECT_LT(interface, buffer.data() + buffer.size());
+    EXPECT_STREQ("net", evt.getSubsystem());
+}
+
+TEST(NetlinkEventTest, DecodesAddressMessage) {
+    AddrMessage msg = makeAddrMessage();
+    NetlinkEvent evt;
+    ASSERT_TRUE(evt.decodeInPlace(reinterpret_cast<char*>(&msg), sizeof(msg),
+                                  NetlinkListener::NETLINK_FORMAT_BINARY));
+
+    EXPECT_EQ(NetlinkEvent::Action::kAddressUpdated, evt.getAction());
+    EXPECT_STREQ("net", evt.getSubsystem());
+    EXPECT_STREQ("192.0.2.1/24", evt.findParam("ADDRESS"));
+    EXPECT_STREQ("lo", evt.findParam("INTERFACE"));
+    EXPECT_STREQ("0", evt.findParam("SCOPE"));
+    EXPECT_STREQ("100", evt.findParam("PREFERRED"));
+    EXPECT_STREQ("200", evt.findParam("VALID"));
+}
+
+TEST(NetlinkEventTest, DecodesNflogPacket) {
+    struct {
+        nlmsghdr hdr;
+        nfgenmsg nfgen;
+        nlattr uid_nla;
+        uint32_t uid;
+        nlattr payload_nla;
+        uint8_t payload[300];
+    } msg = {};
+    msg.hdr.nlmsg_len = sizeof(msg);
+    msg.hdr.nlmsg_type = NFNL_SUBSYS_ULOG << 8 | NFULNL_MSG_PACKET;
+    msg.uid_nla.nla_len = NLA_HDRLEN + sizeof(msg.uid);
+    msg.uid_nla.nla_type = NFULA_UID;
+    msg.uid = htonl(10042);
+    msg.payload_nla.nla_len = NLA_HDRLEN + sizeof(msg.payload);
+    msg.payload_nla.nla_type = NFULA_PAYLOAD;
+    memset(msg.payload, 0xa5, sizeof(msg.payload));
+
+    NetlinkEvent evt;
+    ASSERT_TRUE(evt.decodeInPlace(reinterpret_cast<char*>(&msg), sizeof(msg),
+                                  NetlinkListener::NETLINK_FORMAT_BINARY));
+
+    EXPECT_STREQ("strict", evt.getSubsystem());
+    EXPECT_STREQ("10042", evt.findParam("UID"));
+    // Only the first 256 bytes of the payload are reported.
+    std::string hex;
+    for (int i = 0; i < 256; i++) hex += "a5";
+    EXPECT_EQ(hex, evt.findParam("HEX"));
+}
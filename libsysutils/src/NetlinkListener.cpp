@@ -17,6 +17,7 @@
 #define LOG_TAG "NetlinkListener"
 
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -24,10 +25,12 @@
 
 #include <linux/netlink.h> /* out of order because must follow sys/socket.h */
 
-#include <cutils/uevent.h>
 #include <log/log.h>
 #include <sysutils/NetlinkEvent.h>
 
+// Maximum number of datagrams read by one recvmmsg().
+static const int kMaxBatch = 8;
+
 #if 1
 /* temporary version until we can get Motorola to update their
  * ril.so.  Their prebuilt ril.so is using this private class
@@ -36,26 +39,79 @@
 NetlinkListener::NetlinkListener(int socket) :
                             SocketListener(socket, false) {
     mFormat = NETLINK_FORMAT_ASCII;
+    mBatchBuffer = nullptr;
 }
 #endif
 
 NetlinkListener::NetlinkListener(int socket, int format) :
-                            SocketListener(socket, false), mFormat(format) {
+                            SocketListener(socket, false), mFormat(format), mBatchBuffer(nullptr) {
+}
+
+NetlinkListener::~NetlinkListener() {
+    free(mBatchBuffer);
+}
+
+/*
+ * Checks that a received message actually originates from the kernel, as
+ * uevent_kernel_recv() does.
+ */
+static bool isKernelMessage(const struct msghdr& hdr, bool require_group) {
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
+    if (cmsg == nullptr || cmsg->cmsg_type != SCM_CREDENTIALS) {
+        /* ignoring netlink message with no sender credentials */
+        return false;
+    }
+
+    const struct sockaddr_nl* addr = reinterpret_cast<const sockaddr_nl*>(hdr.msg_name);
+    if (addr->nl_pid != 0) {
+        /* ignore non-kernel */
+        return false;
+    }
+    if (require_group && addr->nl_groups == 0) {
+        /* ignore unicast messages when requested */
+        return false;
+    }
+    return true;
 }
 
 bool NetlinkListener::onDataAvailable(SocketClient *cli)
 {
     int socket = cli->getSocket();
-    ssize_t count;
-    uid_t uid = -1;
 
     bool require_group = true;
     if (mFormat == NETLINK_FORMAT_BINARY_UNICAST) {
         require_group = false;
     }
 
-    count = TEMP_FAILURE_RETRY(uevent_kernel_recv(socket,
-            mBuffer, sizeof(mBuffer), require_group, &uid));
+    // Bursts of events are drained with a single recvmmsg(), each datagram
+    // getting as much room as mBuffer.
+    if (!mBatchBuffer) {
+        mBatchBuffer = static_cast<char*>(malloc((kMaxBatch - 1) * sizeof(mBuffer)));
+    }
+    const int batch = mBatchBuffer ? kMaxBatch : 1;
+
+    struct iovec iov[kMaxBatch];
+    struct sockaddr_nl addr[kMaxBatch];
+    char control[kMaxBatch][CMSG_SPACE(sizeof(struct ucred))];
+    struct mmsghdr msgs[kMaxBatch];
+    memset(msgs, 0, sizeof(msgs));
+    for (int i = 0; i < batch; i++) {
+        iov[i].iov_base = i == 0 ? mBuffer : mBatchBuffer + (i - 1) * sizeof(mBuffer);
+        iov[i].iov_len = sizeof(mBuffer);
+        msgs[i].msg_hdr.msg_name = &addr[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = control[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    // The listener only calls us once the socket is readable, so this
+    // receives at least one datagram.
+    int count = TEMP_FAILURE_RETRY(recvmmsg(socket, msgs, batch, MSG_DONTWAIT, nullptr));
+    if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+    }
     if (count < 0) {
 #ifdef __ANDROID_RECOVERY__
         SLOGW("recvmsg failed (%s)", strerror(errno));
@@ -65,15 +121,32 @@ bool NetlinkListener::onDataAvailable(SocketClient *cli)
         return false;
     }
 
-    NetlinkEvent *evt = new NetlinkEvent();
-    if (evt->decode(mBuffer, count, mFormat)) {
-        onEvent(evt);
-    } else if (mFormat != NETLINK_FORMAT_BINARY) {
-        // Don't complain if parseBinaryNetlinkMessage returns false. That can
-        // just mean that the buffer contained no messages we're interested in.
-        SLOGE("Error decoding NetlinkEvent");
-    }
+    bool ret = true;
+    for (int i = 0; i < count; i++) {
+        char *buffer = static_cast<char*>(iov[i].iov_base);
+        int size = msgs[i].msg_len;
+        if (!isKernelMessage(msgs[i].msg_hdr, require_group)) {
+            /* clear residual potentially malicious data */
+            memset(buffer, 0, size);
+#ifdef __ANDROID_RECOVERY__
+            SLOGW("recvmsg failed (%s)", strerror(EIO));
+#else
+            SLOGE("recvmsg failed (%s)", strerror(EIO));
+#endif
+            ret = false;
+            continue;
+        }
 
-    delete evt;
-    return true;
+        // The event only lives until onEvent() returns, so it can refer to
+        // the receive buffer instead of copying it.
+        NetlinkEvent evt;
+        if (evt.decodeInPlace(buffer, size, mFormat)) {
+            onEvent(&evt);
+        } else if (mFormat != NETLINK_FORMAT_BINARY) {
+            // Don't complain if parseBinaryNetlinkMessage returns false. That can
+            // just mean that the buffer contained no messages we're interested in.
+            SLOGE("Error decoding NetlinkEvent");
+        }
+    }
+    return ret;
 }
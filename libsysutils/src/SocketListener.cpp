@@ -19,7 +19,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -34,7 +34,9 @@
 #include <sysutils/SocketClient.h>
 
 #define CtrlPipe_Shutdown 0
-#define CtrlPipe_Wakeup   1
+
+// Events returned by one epoll_wait() when a single thread serves all clients.
+static const int kMaxEvents = 16;
 
 SocketListener::SocketListener(const char *socketName, bool listen) {
     init(socketName, -1, listen, false);
@@ -53,6 +55,9 @@ void SocketListener::init(const char *socketName, int socketFd, bool listen, boo
     mSocketName = socketName;
     mSock = socketFd;
     mUseCmdNum = useCmdNum;
+    mCtrlPipe[0] = -1;
+    mCtrlPipe[1] = -1;
+    mEpollFd = -1;
     pthread_mutex_init(&mClientsLock, nullptr);
 }
 
@@ -64,6 +69,9 @@ SocketListener::~SocketListener() {
         close(mCtrlPipe[0]);
         close(mCtrlPipe[1]);
     }
+    if (mEpollFd != -1) {
+        close(mEpollFd);
+    }
     for (auto pair : mClients) {
         pair.second->decRef();
     }
@@ -74,11 +82,19 @@ int SocketListener::startListener() {
 }
 
 int SocketListener::startListener(int backlog) {
+    return startListener(backlog, 1);
+}
+
+int SocketListener::startListener(int backlog, int numThreads) {
 
     if (!mSocketName && mSock == -1) {
         SLOGE("Failed to start unbound listener");
         errno = EINVAL;
         return -1;
+    } else if (numThreads < 1) {
+        SLOGE("Invalid number of listener threads: %d", numThreads);
+        errno = EINVAL;
+        return -1;
     } else if (mSocketName) {
         if ((mSock = android_get_control_socket(mSocketName)) < 0) {
             SLOGE("Obtaining file descriptor socket '%s' failed: %s",
@@ -100,11 +116,30 @@ int SocketListener::startListener(int backlog) {
         return -1;
     }
 
-    if (pthread_create(&mThread, nullptr, SocketListener::threadStart, this)) {
-        SLOGE("pthread_create (%s)", strerror(errno));
+    if ((mEpollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        SLOGE("epoll_create1 failed (%s)", strerror(errno));
+        return -1;
+    }
+
+    // With several threads, every socket is one-shot and re-enabled once it
+    // has been handled, so that only one thread at a time serves it. The
+    // control pipe is never read and stays readable to stop every thread.
+    mThreads.resize(numThreads);
+    const uint32_t oneShot = numThreads > 1 ? EPOLLONESHOT : 0;
+    if (!watch(mCtrlPipe[0], EPOLL_CTL_ADD, EPOLLIN) ||
+        !watch(mSock, EPOLL_CTL_ADD, EPOLLIN | oneShot)) {
         return -1;
     }
 
+    for (int i = 0; i < numThreads; ++i) {
+        if (pthread_create(&mThreads[i], nullptr, SocketListener::threadStart, this)) {
+            SLOGE("pthread_create (%s)", strerror(errno));
+            mThreads.resize(i);
+            stopListener();
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -118,15 +153,20 @@ int SocketListener::stopListener() {
         return -1;
     }
 
-    void *ret;
-    if (pthread_join(mThread, &ret)) {
-        SLOGE("Error joining to listener thread (%s)", strerror(errno));
-        return -1;
+    for (pthread_t thread : mThreads) {
+        void *ret;
+        if (pthread_join(thread, &ret)) {
+            SLOGE("Error joining to listener thread (%s)", strerror(errno));
+            return -1;
+        }
     }
+    mThreads.clear();
     close(mCtrlPipe[0]);
     close(mCtrlPipe[1]);
     mCtrlPipe[0] = -1;
     mCtrlPipe[1] = -1;
+    close(mEpollFd);
+    mEpollFd = -1;
 
     if (mSocketName && mSock > -1) {
         close(mSock);
@@ -148,96 +188,101 @@ void *SocketListener::threadStart(void *obj) {
     return nullptr;
 }
 
-void SocketListener::runListener() {
-    while (true) {
-        std::vector<pollfd> fds;
+bool SocketListener::watch(int fd, int op, uint32_t events) {
+    struct epoll_event event = {.events = events, .data = {.fd = fd}};
+    if (epoll_ctl(mEpollFd, op, fd, &event) < 0) {
+        SLOGE("epoll_ctl of fd %d failed (%s)", fd, strerror(errno));
+        return false;
+    }
+    return true;
+}
 
-        pthread_mutex_lock(&mClientsLock);
-        fds.reserve(2 + mClients.size());
-        fds.push_back({.fd = mCtrlPipe[0], .events = POLLIN});
-        if (mListen) fds.push_back({.fd = mSock, .events = POLLIN});
-        for (auto pair : mClients) {
-            // NB: calling out to an other object with mClientsLock held (safe)
-            const int fd = pair.second->getSocket();
-            if (fd != pair.first) SLOGE("fd mismatch: %d != %d", fd, pair.first);
-            fds.push_back({.fd = fd, .events = POLLIN});
-        }
-        pthread_mutex_unlock(&mClientsLock);
+void SocketListener::runListener() {
+    const bool oneShot = mThreads.size() > 1;
+    const uint32_t clientEvents = EPOLLIN | (oneShot ? EPOLLONESHOT : 0);
+    // A one-shot thread takes a single event so that it does not hold back
+    // ready clients that other threads could serve.
+    const int maxEvents = oneShot ? 1 : kMaxEvents;
+    struct epoll_event events[kMaxEvents];
 
+    while (true) {
         SLOGV("mListen=%d, mSocketName=%s", mListen, mSocketName);
-        int rc = TEMP_FAILURE_RETRY(poll(fds.data(), fds.size(), -1));
+        int rc = TEMP_FAILURE_RETRY(epoll_wait(mEpollFd, events, maxEvents, -1));
         if (rc < 0) {
-            SLOGE("poll failed (%s) mListen=%d", strerror(errno), mListen);
+            SLOGE("epoll_wait failed (%s) mListen=%d", strerror(errno), mListen);
             sleep(1);
             continue;
         }
 
-        if (fds[0].revents & (POLLIN | POLLERR)) {
-            char c = CtrlPipe_Shutdown;
-            TEMP_FAILURE_RETRY(read(mCtrlPipe[0], &c, 1));
-            if (c == CtrlPipe_Shutdown) {
-                break;
+        for (int i = 0; i < rc; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == mCtrlPipe[0]) {
+                return;
             }
-            continue;
-        }
-        if (mListen && (fds[1].revents & (POLLIN | POLLERR))) {
-            int c = TEMP_FAILURE_RETRY(accept4(mSock, nullptr, nullptr, SOCK_CLOEXEC));
-            if (c < 0) {
-                SLOGE("accept failed (%s)", strerror(errno));
-                sleep(1);
+            if (mListen && fd == mSock) {
+                int c = TEMP_FAILURE_RETRY(accept4(mSock, nullptr, nullptr, SOCK_CLOEXEC));
+                if (c < 0) {
+                    SLOGE("accept failed (%s)", strerror(errno));
+                    sleep(1);
+                } else {
+                    pthread_mutex_lock(&mClientsLock);
+                    mClients[c] = new SocketClient(c, true, mUseCmdNum);
+                    watch(c, EPOLL_CTL_ADD, clientEvents);
+                    pthread_mutex_unlock(&mClientsLock);
+                }
+                if (oneShot) watch(mSock, EPOLL_CTL_MOD, EPOLLIN | EPOLLONESHOT);
                 continue;
             }
+
+            // Take a reference, so we can release the lock before invoking the
+            // callback.
             pthread_mutex_lock(&mClientsLock);
-            mClients[c] = new SocketClient(c, true, mUseCmdNum);
+            auto it = mClients.find(fd);
+            SocketClient* c = it != mClients.end() ? it->second : nullptr;
+            if (c) c->incRef();
             pthread_mutex_unlock(&mClientsLock);
-        }
-
-        // Add all active clients to the pending list first, so we can release
-        // the lock before invoking the callbacks.
-        std::vector<SocketClient*> pending;
-        pthread_mutex_lock(&mClientsLock);
-        const int size = fds.size();
-        for (int i = mListen ? 2 : 1; i < size; ++i) {
-            const struct pollfd& p = fds[i];
-            if (p.revents & (POLLIN | POLLERR)) {
-                auto it = mClients.find(p.fd);
-                if (it == mClients.end()) {
-                    SLOGE("fd vanished: %d", p.fd);
-                    continue;
-                }
-                SocketClient* c = it->second;
-                pending.push_back(c);
-                c->incRef();
+            if (!c) {
+                SLOGE("fd vanished: %d", fd);
+                continue;
             }
-        }
-        pthread_mutex_unlock(&mClientsLock);
 
-        for (SocketClient* c : pending) {
             // Process it, if false is returned, remove from the map
-            SLOGV("processing fd %d", c->getSocket());
+            SLOGV("processing fd %d", fd);
             if (!onDataAvailable(c)) {
-                release(c, false);
+                release(c);
+            }
+            if (oneShot) {
+                // Unless the client was released meanwhile.
+                pthread_mutex_lock(&mClientsLock);
+                it = mClients.find(fd);
+                if (it != mClients.end() && it->second == c) {
+                    watch(fd, EPOLL_CTL_MOD, clientEvents);
+                }
+                pthread_mutex_unlock(&mClientsLock);
             }
             c->decRef();
         }
     }
 }
 
-bool SocketListener::release(SocketClient* c, bool wakeup) {
+bool SocketListener::release(SocketClient* c) {
     bool ret = false;
     /* if our sockets are connection-based, remove and destroy it */
     if (mListen && c) {
         /* Remove the client from our map */
         SLOGV("going to zap %d for %s", c->getSocket(), mSocketName);
         pthread_mutex_lock(&mClientsLock);
-        ret = (mClients.erase(c->getSocket()) != 0);
+        auto it = mClients.find(c->getSocket());
+        if (it != mClients.end() && it->second == c) {
+            // The socket is only closed once the last reference is gone, so it
+            // cannot have been reused yet.
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, c->getSocket(), nullptr);
+            mClients.erase(it);
+            ret = true;
+        }
         pthread_mutex_unlock(&mClientsLock);
         if (ret) {
             ret = c->decRef();
-            if (wakeup) {
-                char b = CtrlPipe_Wakeup;
-                TEMP_FAILURE_RETRY(write(mCtrlPipe[1], &b, 1));
-            }
         }
     }
     return ret;
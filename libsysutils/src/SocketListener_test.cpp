@@ -23,7 +23,11 @@
 #include <sys/un.h>
 
 #include <algorithm>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -181,3 +185,107 @@ TEST_F(FrameworkListenerTest, MultipleClients) {
     EXPECT_EQ(std::string("42 test,2") + '\0', recvReply(client2.get()));
     EXPECT_EQ(std::string("42 test,1") + '\0', recvReply(client1.get()));
 }
+
+namespace {
+
+std::mutex gWaitLock;
+std::condition_variable gWaitCond;
+bool gWaitDone = false;
+
+// Test command which blocks until a "release" command is run on another client.
+class WaitCommand : public FrameworkCommand {
+  public:
+    WaitCommand() : FrameworkCommand("wait") {}
+    ~WaitCommand() override {}
+
+    int runCommand(SocketClient* cli, int /*argc*/, char** /*argv*/) {
+        std::unique_lock<std::mutex> lock(gWaitLock);
+        gWaitCond.wait(lock, [] { return gWaitDone; });
+        cli->sendMsg(43, "waited", /*addErrno=*/false, /*useCmdNum=*/false);
+        return 0;
+    }
+};
+
+class ReleaseCommand : public FrameworkCommand {
+  public:
+    ReleaseCommand() : FrameworkCommand("release") {}
+    ~ReleaseCommand() override {}
+
+    int runCommand(SocketClient* cli, int /*argc*/, char** /*argv*/) {
+        {
+            std::lock_guard<std::mutex> lock(gWaitLock);
+            gWaitDone = true;
+        }
+        gWaitCond.notify_all();
+        cli->sendMsg(44, "released", /*addErrno=*/false, /*useCmdNum=*/false);
+        return 0;
+    }
+};
+
+class ThreadedTestListener : public TestListener {
+  public:
+    ThreadedTestListener(int fd) : TestListener(fd) {
+        registerCmd(new WaitCommand);     // Leaked :-(
+        registerCmd(new ReleaseCommand);  // Leaked :-(
+    }
+};
+
+}  // unnamed namespace
+
+class FrameworkListenerThreadsTest : public testing::Test {
+  public:
+    FrameworkListenerThreadsTest() {
+        mSocketPath = testSocketPath();
+        mSserverFd = serverSocket(mSocketPath);
+        mListener = std::make_unique<ThreadedTestListener>(mSserverFd.get());
+        EXPECT_EQ(0, mListener->startListener(/*backlog=*/16, /*numThreads=*/4));
+    }
+
+    ~FrameworkListenerThreadsTest() override {
+        EXPECT_EQ(0, mListener->stopListener());
+        unlink(mSocketPath.c_str());
+    }
+
+  protected:
+    std::string mSocketPath;
+    unique_fd mSserverFd;
+    std::unique_ptr<ThreadedTestListener> mListener;
+};
+
+TEST_F(FrameworkListenerThreadsTest, SlowClientDoesNotStallOthers) {
+    gWaitDone = false;
+    unique_fd client1 = clientSocket(mSocketPath);
+    unique_fd client2 = clientSocket(mSocketPath);
+    sendCmd(client1.get(), "wait");
+    sendCmd(client2.get(), "test 2");
+    EXPECT_EQ(std::string("42 test,2") + '\0', recvReply(client2.get()));
+
+    sendCmd(client2.get(), "release");
+    EXPECT_EQ(std::string("44 released") + '\0', recvReply(client2.get()));
+    EXPECT_EQ(std::string("43 waited") + '\0', recvReply(client1.get()));
+}
+
+TEST_F(FrameworkListenerThreadsTest, ClientsServedInOrder) {
+    std::vector<unique_fd> clients;
+    std::vector<std::string> expected;
+    for (int i = 0; i < 8; i++) {
+        clients.push_back(clientSocket(mSocketPath));
+        expected.emplace_back();
+    }
+    for (int round = 0; round < 16; round++) {
+        for (size_t i = 0; i < clients.size(); i++) {
+            std::string args = std::to_string(i) + " " + std::to_string(round);
+            sendCmd(clients[i].get(), ("test " + args).c_str());
+            expected[i] += "42 test," + std::to_string(i) + "," + std::to_string(round) + '\0';
+        }
+    }
+    for (size_t i = 0; i < clients.size(); i++) {
+        std::string reply;
+        while (reply.size() < expected[i].size()) {
+            std::string part = recvReply(clients[i].get());
+            if (part.empty()) break;
+            reply += part;
+        }
+        EXPECT_EQ(expected[i], reply);
+    }
+}
@@ -50,6 +50,7 @@ struct usb_request
     void *private_data; /* struct usbdevfs_urb* */
     int endpoint;
     void *client_data;  /* free for use by client */
+    int status;         /* URB status once reaped: 0, or a negative errno */
 };
 
 /* Callback for notification when new USB devices are attached.
@@ -267,6 +268,51 @@ struct usb_request *usb_request_wait(struct usb_device *dev, int timeoutMillis);
 /* Cancels a pending usb_request_queue() operation. */
 int usb_request_cancel(struct usb_request *req);
 
+/* Reaps up to count completed requests from any endpoint of the device into reqs.
+ * The first request is waited for as in usb_request_wait(); the rest are only taken if they
+ * have already completed. timeoutMillis == 0 never blocks, which suits callers that wait for
+ * POLLOUT on usb_device_get_fd() in their own poll or epoll loop.
+ * Returns the number of requests reaped, which is 0 if none completed in time.
+ */
+int usb_device_reap_requests(struct usb_device *dev, struct usb_request **reqs, int count,
+                             int timeoutMillis);
+
+/* Allocates a transfer buffer mapped from the usbfs device, so that the kernel can do the
+ * transfer without copying through its own bounce buffer.
+ * Returns NULL if the kernel does not support this; callers can fall back to malloc().
+ */
+void *usb_device_alloc_buffer(struct usb_device *dev, size_t size);
+
+/* Frees a buffer allocated by usb_device_alloc_buffer(). */
+void usb_device_free_buffer(struct usb_device *dev, void *buffer, size_t size);
+
+struct usb_transfer_queue;
+
+/* Creates a queue that keeps up to depth requests in flight on one bulk or interrupt endpoint.
+ * A queue is not thread safe.
+ */
+struct usb_transfer_queue *usb_transfer_queue_new(struct usb_device *dev,
+        const struct usb_endpoint_descriptor *ep_desc, int depth);
+
+/* Frees the queue. Every request submitted on it must have been reaped and released. */
+void usb_transfer_queue_free(struct usb_transfer_queue *queue);
+
+/* Submits a transfer of length bytes to or from buffer, which is used in place and must stay
+ * valid until the request is reaped.
+ * Returns the in-flight request, or NULL with errno set to EBUSY if depth requests are already
+ * outstanding.
+ */
+struct usb_request *usb_transfer_queue_submit(struct usb_transfer_queue *queue, void *buffer,
+        int length, void *client_data);
+
+/* Returns a request reaped with usb_device_reap_requests() or usb_request_wait() to its queue,
+ * so that it can carry another transfer.
+ */
+void usb_transfer_queue_release(struct usb_transfer_queue *queue, struct usb_request *req);
+
+/* Returns the number of requests submitted on the queue and not yet released. */
+int usb_transfer_queue_in_flight(struct usb_transfer_queue *queue);
+
 #ifdef __cplusplus
 }
 #endif
@@ -29,14 +29,19 @@
 #include <stddef.h>
 
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
 #include <poll.h>
+#include <pthread.h>
 
 #include <linux/usbdevice_fs.h>
 
@@ -62,6 +67,11 @@
 
 #define MAX_USBFS_WD_COUNT      10
 
+// Large enough to take a whole hub's worth of inotify events in one read()
+#define INOTIFY_EVENT_BUF_SIZE  (16 * 1024)
+
+#define DESCRIPTOR_CACHE_SIZE   16
+
 struct usb_host_context {
     int                         fd;
     usb_device_added_cb         cb_added;
@@ -220,19 +230,69 @@ int usb_host_load(struct usb_host_context *context,
     return done;
 } /* usb_host_load() */
 
+static int is_device_wd(struct usb_host_context *context, int wd)
+{
+    int i;
+
+    for (i = 1; i < MAX_USBFS_WD_COUNT; i++) {
+        if (context->wds[i] == wd)
+            return 1;
+    }
+    return 0;
+}
+
+/* A device that was both created and removed within one batch of events is
+ * never reported. Whole-bus events are left alone.
+ */
+static void coalesce_events(struct usb_host_context *context, const char *event_buf,
+                            int length, unsigned char *skip)
+{
+    int offset, next, index, next_index;
+
+    for (offset = 0, index = 0; offset < length; offset = next, index++) {
+        const struct inotify_event *event = (const struct inotify_event*)&event_buf[offset];
+        next = offset + sizeof(struct inotify_event) + event->len;
+        if (skip[index] || event->mask != IN_CREATE || !event->len ||
+                !is_device_wd(context, event->wd))
+            continue;
+
+        int later_offset = next, later_next;
+        for (next_index = index + 1; later_offset < length;
+                later_offset = later_next, next_index++) {
+            const struct inotify_event *later =
+                    (const struct inotify_event*)&event_buf[later_offset];
+            later_next = later_offset + sizeof(struct inotify_event) + later->len;
+            if (!skip[next_index] && later->mask == IN_DELETE && later->wd == event->wd &&
+                    later->len && !strcmp(later->name, event->name)) {
+                D("coalesced create and delete of %s\n", event->name);
+                skip[index] = 1;
+                skip[next_index] = 1;
+                break;
+            }
+        }
+    }
+}
+
 int usb_host_read_event(struct usb_host_context *context)
 {
     struct inotify_event* event;
-    char event_buf[512];
+    char event_buf[INOTIFY_EVENT_BUF_SIZE]
+            __attribute__((aligned(__alignof__(struct inotify_event))));
+    unsigned char skip[INOTIFY_EVENT_BUF_SIZE / sizeof(struct inotify_event)];
     char path[100];
     int i, ret, done = 0;
-    int offset = 0;
+    int offset = 0, index = 0;
     int wd;
 
     ret = read(context->fd, event_buf, sizeof(event_buf));
     if (ret >= (int)sizeof(struct inotify_event)) {
-        while (offset < ret && !done) {
+        memset(skip, 0, sizeof(skip));
+        coalesce_events(context, event_buf, ret, skip);
+        for (; offset < ret && !done;
+                offset += sizeof(struct inotify_event) + event->len, index++) {
             event = (struct inotify_event*)&event_buf[offset];
+            if (skip[index])
+                continue;
             done = 0;
             wd = event->wd;
             if (wd == context->wdd) {
@@ -290,8 +350,6 @@ int usb_host_read_event(struct usb_host_context *context)
                     }
                 }
             }
-
-            offset += sizeof(struct inotify_event) + event->len;
         }
     }
 
@@ -316,16 +374,23 @@ void usb_host_run(struct usb_host_context *context,
 
 struct usb_device *usb_device_open(const char *dev_name)
 {
-    int fd, attempts, writeable = 1;
-    const int SLEEP_BETWEEN_ATTEMPTS_US = 100000; /* 100 ms */
-    const int64_t MAX_ATTEMPTS = 10;              /* 1s */
+    int fd, writeable = 1;
+    const int MAX_WAIT_MS = 1000;
+    const int SLEEP_BETWEEN_ATTEMPTS_US = 100000; /* 100 ms, if inotify is unavailable */
     D("usb_device_open %s\n", dev_name);
 
-    /* Hack around waiting for permissions to be set on the USB device node.
-     * Should really be a timeout instead of attempt count, and should REALLY
-     * be triggered by the perm change via inotify rather than polling.
+    /* A freshly created USB device node may not have its permissions set up
+     * yet. Wait up to a second for that, waking up on the node's attribute
+     * changes rather than polling.
      */
-    for (attempts = 0; attempts < MAX_ATTEMPTS; ++attempts) {
+    int ifd = inotify_init1(IN_CLOEXEC);
+    if (ifd >= 0 && inotify_add_watch(ifd, dev_name, IN_ATTRIB) < 0) {
+        close(ifd);
+        ifd = -1;
+    }
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (1) {
         if (access(dev_name, R_OK | W_OK) == 0) {
             writeable = 1;
             break;
@@ -336,10 +401,27 @@ struct usb_device *usb_device_open(const char *dev_name)
                 break;
             }
         }
-        /* not writeable or readable - sleep and try again. */
-        D("usb_device_open no access sleeping\n");
-        usleep(SLEEP_BETWEEN_ATTEMPTS_US);
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int waited_ms = (now.tv_sec - start.tv_sec) * 1000 +
+                        (now.tv_nsec - start.tv_nsec) / 1000000;
+        if (waited_ms >= MAX_WAIT_MS)
+            break;
+
+        /* not writeable or readable - wait and try again. */
+        D("usb_device_open no access waiting\n");
+        if (ifd >= 0) {
+            char event_buf[sizeof(struct inotify_event) + NAME_MAX + 1];
+            struct pollfd p = {.fd = ifd, .events = POLLIN, .revents = 0};
+            if (poll(&p, 1, MAX_WAIT_MS - waited_ms) > 0)
+                TEMP_FAILURE_RETRY(read(ifd, event_buf, sizeof(event_buf)));
+        } else {
+            usleep(SLEEP_BETWEEN_ATTEMPTS_US);
+        }
     }
+    if (ifd >= 0)
+        close(ifd);
 
     if (writeable) {
         fd = open(dev_name, O_RDWR);
@@ -361,6 +443,56 @@ void usb_device_close(struct usb_device *device)
     free(device);
 }
 
+/* usbfs returns the same raw descriptors for as long as a device node exists, and a
+ * reconnected device gets a new node, so descriptors can be cached by device number and inode.
+ * This saves re-reading them every time a client reopens the same device.
+ */
+struct usb_descriptor_cache_entry {
+    dev_t rdev;
+    ino_t ino;
+    int length;
+    unsigned char *desc;
+};
+
+static struct usb_descriptor_cache_entry descriptor_cache[DESCRIPTOR_CACHE_SIZE];
+static int descriptor_cache_next;
+static pthread_mutex_t descriptor_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int usb_descriptor_cache_get(const struct stat *st, unsigned char *desc)
+{
+    int i, length = -1;
+
+    pthread_mutex_lock(&descriptor_cache_lock);
+    for (i = 0; i < DESCRIPTOR_CACHE_SIZE; i++) {
+        struct usb_descriptor_cache_entry *entry = &descriptor_cache[i];
+        if (entry->desc && entry->rdev == st->st_rdev && entry->ino == st->st_ino) {
+            memcpy(desc, entry->desc, entry->length);
+            length = entry->length;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&descriptor_cache_lock);
+    return length;
+}
+
+static void usb_descriptor_cache_put(const struct stat *st, const unsigned char *desc, int length)
+{
+    unsigned char *copy = malloc(length);
+    if (!copy)
+        return;
+    memcpy(copy, desc, length);
+
+    pthread_mutex_lock(&descriptor_cache_lock);
+    struct usb_descriptor_cache_entry *entry = &descriptor_cache[descriptor_cache_next];
+    descriptor_cache_next = (descriptor_cache_next + 1) % DESCRIPTOR_CACHE_SIZE;
+    free(entry->desc);
+    entry->rdev = st->st_rdev;
+    entry->ino = st->st_ino;
+    entry->length = length;
+    entry->desc = copy;
+    pthread_mutex_unlock(&descriptor_cache_lock);
+}
+
 struct usb_device *usb_device_new(const char *dev_name, int fd)
 {
     struct usb_device *device = calloc(1, sizeof(struct usb_device));
@@ -368,13 +500,23 @@ struct usb_device *usb_device_new(const char *dev_name, int fd)
 
     D("usb_device_new %s fd: %d\n", dev_name, fd);
 
-    if (lseek(fd, 0, SEEK_SET) != 0)
-        goto failed;
-    length = read(fd, device->desc, sizeof(device->desc));
-    D("usb_device_new read returned %d errno %d\n", length, errno);
-    if (length < 0)
+    if (!device)
         goto failed;
 
+    struct stat st;
+    int cacheable = fstat(fd, &st) == 0 && S_ISCHR(st.st_mode);
+    length = cacheable ? usb_descriptor_cache_get(&st, device->desc) : -1;
+    if (length < 0) {
+        if (lseek(fd, 0, SEEK_SET) != 0)
+            goto failed;
+        length = read(fd, device->desc, sizeof(device->desc));
+        D("usb_device_new read returned %d errno %d\n", length, errno);
+        if (length < 0)
+            goto failed;
+        if (cacheable && length > 0)
+            usb_descriptor_cache_put(&st, device->desc, length);
+    }
+
     strncpy(device->dev_name, dev_name, sizeof(device->dev_name) - 1);
     device->fd = fd;
     device->desc_length = length;
@@ -683,35 +825,46 @@ int usb_device_reset(struct usb_device *device)
     return ioctl(device->fd, USBDEVFS_RESET);
 }
 
-struct usb_request *usb_request_new(struct usb_device *dev,
-        const struct usb_endpoint_descriptor *ep_desc)
+static int usb_request_init(struct usb_request *req, struct usbdevfs_urb *urb,
+        struct usb_device *dev, const struct usb_endpoint_descriptor *ep_desc)
 {
-    struct usbdevfs_urb *urb = calloc(1, sizeof(struct usbdevfs_urb));
-    if (!urb)
-        return NULL;
-
     if ((ep_desc->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK) == USB_ENDPOINT_XFER_BULK)
         urb->type = USBDEVFS_URB_TYPE_BULK;
     else if ((ep_desc->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK) == USB_ENDPOINT_XFER_INT)
         urb->type = USBDEVFS_URB_TYPE_INTERRUPT;
     else {
         D("Unsupported endpoint type %d", ep_desc->bmAttributes & USB_ENDPOINT_XFERTYPE_MASK);
-        free(urb);
-        return NULL;
+        return -1;
     }
     urb->endpoint = ep_desc->bEndpointAddress;
 
+    req->dev = dev;
+    req->max_packet_size = __le16_to_cpu(ep_desc->wMaxPacketSize);
+    req->private_data = urb;
+    req->endpoint = urb->endpoint;
+    urb->usercontext = req;
+
+    return 0;
+}
+
+struct usb_request *usb_request_new(struct usb_device *dev,
+        const struct usb_endpoint_descriptor *ep_desc)
+{
+    struct usbdevfs_urb *urb = calloc(1, sizeof(struct usbdevfs_urb));
+    if (!urb)
+        return NULL;
+
     struct usb_request *req = calloc(1, sizeof(struct usb_request));
     if (!req) {
         free(urb);
         return NULL;
     }
 
-    req->dev = dev;
-    req->max_packet_size = __le16_to_cpu(ep_desc->wMaxPacketSize);
-    req->private_data = urb;
-    req->endpoint = urb->endpoint;
-    urb->usercontext = req;
+    if (usb_request_init(req, urb, dev, ep_desc) < 0) {
+        free(req);
+        free(urb);
+        return NULL;
+    }
 
     return req;
 }
@@ -767,6 +920,7 @@ struct usb_request *usb_request_wait(struct usb_device *dev, int timeoutMillis)
 
         struct usb_request *req = (struct usb_request*)urb->usercontext;
         req->actual_length = urb->actual_length;
+        req->status = urb->status;
 
         return req;
     }
@@ -777,3 +931,138 @@ int usb_request_cancel(struct usb_request *req)
     struct usbdevfs_urb *urb = ((struct usbdevfs_urb*)req->private_data);
     return ioctl(req->dev->fd, USBDEVFS_DISCARDURB, urb);
 }
+
+int usb_device_reap_requests(struct usb_device *dev, struct usb_request **reqs, int count,
+                             int timeoutMillis)
+{
+    int n;
+
+    // usbfs only reaps one URB per ioctl, but after the first completion the rest can be
+    // picked up without blocking.
+    for (n = 0; n < count; n++) {
+        struct usb_request *req = usb_request_wait(dev, n == 0 ? timeoutMillis : 0);
+        if (!req)
+            break;
+        reqs[n] = req;
+    }
+    return n;
+}
+
+void *usb_device_alloc_buffer(struct usb_device *dev, size_t size)
+{
+    // Since Linux 4.6, URBs whose buffer lies in memory mapped from the usbfs fd skip the
+    // kernel's copy to and from its own buffer.
+    void *buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, dev->fd, 0);
+    if (buffer == MAP_FAILED) {
+        D("[ usbfs mmap of %zu bytes failed, errno %d ]\n", size, errno);
+        return NULL;
+    }
+    return buffer;
+}
+
+void usb_device_free_buffer(struct usb_device *dev __attribute__((unused)), void *buffer,
+                            size_t size)
+{
+    if (buffer)
+        munmap(buffer, size);
+}
+
+struct usb_transfer_slot {
+    struct usb_request req;
+    struct usbdevfs_urb urb;
+    struct usb_transfer_slot *next_free;
+};
+
+struct usb_transfer_queue {
+    struct usb_transfer_slot *slots;
+    struct usb_transfer_slot *free_slots;
+    int depth;
+    int in_flight;
+};
+
+struct usb_transfer_queue *usb_transfer_queue_new(struct usb_device *dev,
+        const struct usb_endpoint_descriptor *ep_desc, int depth)
+{
+    if (depth <= 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct usb_transfer_queue *queue = calloc(1, sizeof(struct usb_transfer_queue));
+    if (!queue)
+        return NULL;
+
+    queue->slots = calloc(depth, sizeof(struct usb_transfer_slot));
+    if (!queue->slots) {
+        free(queue);
+        return NULL;
+    }
+    queue->depth = depth;
+
+    for (int i = depth - 1; i >= 0; i--) {
+        struct usb_transfer_slot *slot = &queue->slots[i];
+        if (usb_request_init(&slot->req, &slot->urb, dev, ep_desc) < 0) {
+            free(queue->slots);
+            free(queue);
+            errno = EINVAL;
+            return NULL;
+        }
+        slot->next_free = queue->free_slots;
+        queue->free_slots = slot;
+    }
+
+    return queue;
+}
+
+void usb_transfer_queue_free(struct usb_transfer_queue *queue)
+{
+    if (!queue)
+        return;
+
+    if (queue->in_flight)
+        D("[ freeing transfer queue with %d requests in flight ]\n", queue->in_flight);
+    free(queue->slots);
+    free(queue);
+}
+
+struct usb_request *usb_transfer_queue_submit(struct usb_transfer_queue *queue, void *buffer,
+        int length, void *client_data)
+{
+    struct usb_transfer_slot *slot = queue->free_slots;
+    if (!slot) {
+        errno = EBUSY;
+        return NULL;
+    }
+
+    slot->req.buffer = buffer;
+    slot->req.buffer_length = length;
+    slot->req.actual_length = 0;
+    slot->req.status = 0;
+    slot->req.client_data = client_data;
+    if (usb_request_queue(&slot->req) < 0)
+        return NULL;
+
+    queue->free_slots = slot->next_free;
+    queue->in_flight++;
+    return &slot->req;
+}
+
+void usb_transfer_queue_release(struct usb_transfer_queue *queue, struct usb_request *req)
+{
+    struct usb_transfer_slot *slot = (struct usb_transfer_slot *)
+            ((char *)req - offsetof(struct usb_transfer_slot, req));
+
+    if (slot < queue->slots || slot >= queue->slots + queue->depth) {
+        D("[ request %p does not belong to transfer queue %p ]\n", req, queue);
+        return;
+    }
+
+    slot->next_free = queue->free_slots;
+    queue->free_slots = slot;
+    queue->in_flight--;
+}
+
+int usb_transfer_queue_in_flight(struct usb_transfer_queue *queue)
+{
+    return queue->in_flight;
+}
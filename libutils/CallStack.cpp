@@ -16,17 +16,123 @@
 
 #define LOG_TAG "CallStack"
 
+#include <unwind.h>
+
+#include <mutex>
+
+#include <utils/ConcurrentLruCache.h>
 #include <utils/Printer.h>
 #include <utils/Errors.h>
 #include <log/log.h>
 
 #include <unwindstack/AndroidUnwinder.h>
+#include <unwindstack/Elf.h>
+#include <unwindstack/MapInfo.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Regs.h>
 
 #define CALLSTACK_WEAK  // Don't generate weak definitions.
 #include <utils/CallStack.h>
 
 namespace android {
 
+namespace {
+
+constexpr size_t kDefaultRawFrames = 64;
+
+// Symbolized frames, keyed by absolute pc, so that stacks recorded with updateRaw() over and
+// over from the same places are only looked up once. A library unloaded and replaced by
+// another at the same address keeps the old names until they're evicted.
+constexpr uint32_t kFrameCacheSize = 4096;
+
+class RawFrameSymbolizer {
+  public:
+    unwindstack::FrameData symbolize(uint64_t pc) {
+        if (std::optional<unwindstack::FrameData> frame = mFrames.get(pc)) {
+            return *frame;
+        }
+
+        unwindstack::FrameData frame;
+        frame.pc = pc;
+        frame.rel_pc = pc;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            if (!mInitialized) {
+                unwindstack::ErrorData error;
+                mInitialized = mUnwinder.Initialize(error);
+                if (!mInitialized) {
+                    ALOGW("Failed to initialize unwinder: %s",
+                          unwindstack::GetErrorCodeString(error.code));
+                    return frame;
+                }
+            }
+            std::shared_ptr<unwindstack::MapInfo> map_info = mUnwinder.GetMaps()->Find(pc);
+            if (map_info == nullptr) {
+                // Loaded since the maps were read.
+                unwindstack::LocalMaps maps;
+                if (maps.Parse()) map_info = maps.Find(pc);
+            }
+            if (map_info != nullptr) {
+                unwindstack::ArchEnum arch = unwindstack::Regs::CurrentArch();
+                unwindstack::Elf* elf = map_info->GetElf(mUnwinder.GetProcessMemory(), arch);
+                // These are all return addresses, so point at the call instead.
+                uint64_t rel_pc = elf->GetRelPc(pc, map_info.get());
+                uint64_t adjustment = unwindstack::GetPcAdjustment(rel_pc, elf, arch);
+                frame.pc = pc - adjustment;
+                frame.rel_pc = rel_pc - adjustment;
+                frame.map_info = map_info;
+                unwindstack::SharedString function_name;
+                uint64_t function_offset;
+                if (elf->GetFunctionName(frame.rel_pc, &function_name, &function_offset)) {
+                    frame.function_name = function_name;
+                    frame.function_offset = function_offset;
+                }
+            }
+        }
+        mFrames.put(pc, frame);
+        return frame;
+    }
+
+    std::string format(const unwindstack::FrameData& frame) {
+        return mUnwinder.FormatFrame(frame);
+    }
+
+  private:
+    std::mutex mLock;
+    bool mInitialized = false;
+    unwindstack::AndroidLocalUnwinder mUnwinder;
+    ConcurrentLruCache<uint64_t, unwindstack::FrameData> mFrames{
+            kFrameCacheSize, ConcurrentLruCache<uint64_t, unwindstack::FrameData>::Policy::kClock};
+};
+
+RawFrameSymbolizer& GetRawFrameSymbolizer() {
+    static RawFrameSymbolizer* symbolizer = new RawFrameSymbolizer;
+    return *symbolizer;
+}
+
+struct RawCapture {
+    uint64_t* pcs;
+    size_t count;
+    size_t capacity;
+    size_t ignoreDepth;
+};
+
+_Unwind_Reason_Code CaptureRawFrame(_Unwind_Context* context, void* arg) {
+    RawCapture* capture = static_cast<RawCapture*>(arg);
+    uintptr_t pc = _Unwind_GetIP(context);
+    if (pc == 0) {
+        return _URC_END_OF_STACK;
+    }
+    if (capture->ignoreDepth > 0) {
+        capture->ignoreDepth--;
+        return _URC_NO_REASON;
+    }
+    capture->pcs[capture->count++] = pc;
+    return capture->count < capture->capacity ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+}  // namespace
+
 CallStack::CallStack() {
 }
 
@@ -44,6 +150,8 @@ void CallStack::update(int32_t ignoreDepth, pid_t tid) {
     }
 
     mFrameLines.clear();
+    mRawPcCount = 0;
+    mRawPending = false;
 
     unwindstack::AndroidLocalUnwinder unwinder;
     unwindstack::AndroidUnwinderData data;
@@ -61,6 +169,38 @@ void CallStack::update(int32_t ignoreDepth, pid_t tid) {
     }
 }
 
+void CallStack::reserveRaw(size_t maxFrames) {
+    mRawPcs.resize(maxFrames);
+    mRawPcCount = std::min(mRawPcCount, maxFrames);
+}
+
+void CallStack::updateRaw(int32_t ignoreDepth) {
+    if (ignoreDepth < 0) {
+        ignoreDepth = 0;
+    }
+    if (mRawPcs.empty()) {
+        reserveRaw(kDefaultRawFrames);
+    }
+
+    // mFrameLines is left alone, since freeing it isn't safe in a signal handler, and is
+    // replaced when the stack is next printed.
+    RawCapture capture = {mRawPcs.data(), 0, mRawPcs.size(), static_cast<size_t>(ignoreDepth)};
+    _Unwind_Backtrace(CaptureRawFrame, &capture);
+    mRawPcCount = capture.count;
+    mRawPending = true;
+}
+
+void CallStack::symbolizeRaw() const {
+    RawFrameSymbolizer& symbolizer = GetRawFrameSymbolizer();
+    mFrameLines.clear();
+    for (size_t i = 0; i < mRawPcCount; i++) {
+        unwindstack::FrameData frame = symbolizer.symbolize(mRawPcs[i]);
+        frame.num = i;
+        mFrameLines.push_back(String8(symbolizer.format(frame).c_str()));
+    }
+    mRawPending = false;
+}
+
 void CallStack::log(const char* logtag, android_LogPriority priority, const char* prefix) const {
     LogPrinter printer(logtag, priority, prefix, /*ignoreBlankLines*/false);
     print(printer);
@@ -81,6 +221,9 @@ String8 CallStack::toString(const char* prefix) const {
 }
 
 void CallStack::print(Printer& printer) const {
+    if (mRawPending) {
+        symbolizeRaw();
+    }
     for (size_t i = 0; i < mFrameLines.size(); i++) {
         printer.printLine(mFrameLines[i].c_str());
     }
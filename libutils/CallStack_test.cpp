@@ -34,6 +34,10 @@ __attribute__((__noinline__)) extern "C" void CurrentCaller(android::String8& ba
     backtrace = cs.toString();
 }
 
+__attribute__((__noinline__)) extern "C" void CurrentCallerRaw(android::CallStack& cs) {
+    cs.updateRaw();
+}
+
 TEST(CallStackTest, current_backtrace) {
     android::String8 backtrace;
     CurrentCaller(backtrace);
@@ -41,6 +45,41 @@ TEST(CallStackTest, current_backtrace) {
     ASSERT_NE(-1, backtrace.find("(CurrentCaller")) << "Full backtrace:\n" << backtrace;
 }
 
+TEST(CallStackTest, raw_backtrace) {
+    android::CallStack cs;
+    CurrentCallerRaw(cs);
+    ASSERT_GT(cs.size(), 0u);
+    android::String8 backtrace = cs.toString();
+    ASSERT_NE(-1, backtrace.find("(CurrentCallerRaw")) << "Full backtrace:\n" << backtrace;
+    ASSERT_EQ(-1, backtrace.find("updateRaw")) << "Full backtrace:\n" << backtrace;
+
+    // Capturing again replaces the frames printed before.
+    cs.updateRaw();
+    ASSERT_EQ(-1, cs.toString().find("(CurrentCallerRaw")) << "Full backtrace:\n" << cs.toString();
+
+    // Stacks captured from the same place look the same, though the second is symbolized from
+    // the cache.
+    android::String8 backtraces[2];
+    for (auto& trace : backtraces) {
+        android::CallStack other;
+        CurrentCallerRaw(other);
+        trace = other.toString();
+    }
+    ASSERT_EQ(backtraces[0], backtraces[1]);
+
+    cs.clear();
+    ASSERT_EQ(0u, cs.size());
+    ASSERT_EQ("", cs.toString());
+}
+
+TEST(CallStackTest, raw_backtrace_is_truncated) {
+    android::CallStack cs;
+    cs.reserveRaw(2);
+    CurrentCallerRaw(cs);
+    ASSERT_EQ(2u, cs.size());
+    ASSERT_NE(-1, cs.toString().find("(CurrentCallerRaw")) << "Full backtrace:\n" << cs.toString();
+}
+
 __attribute__((__noinline__)) extern "C" void ThreadBusyWait(std::atomic<pid_t>* tid,
                                                              volatile bool* done) {
     *tid = android::base::GetThreadId();
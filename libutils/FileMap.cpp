@@ -42,6 +42,8 @@
 #include <errno.h>
 #include <assert.h>
 
+#include <algorithm>
+
 using namespace android;
 
 /*static*/ long FileMap::mPageSize = -1;
@@ -134,12 +136,62 @@ FileMap::~FileMap(void)
 // Returns "false" on failure.
 bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t length,
         bool readOnly)
+{
+    return create(origFileName, fd, offset, length, readOnly, 0);
+}
+
+#if !defined(__MINGW32__)
+// Reserve address space for a mapping of adjLength bytes of the file at adjOffset, placed such
+// that its addresses and the file offsets are equal modulo the huge page size.  Only then can
+// the page cache's huge pages be mapped with single page table entries.
+//
+// Returns the address to map at with MAP_FIXED, or nullptr if there's no need or no room.
+static void* reserveHugePageAlignedAddress(off64_t adjOffset, size_t adjLength, long pageSize)
+{
+#if defined(MADV_HUGEPAGE)
+    // A page table page holds pageSize / sizeof(void*) entries, so that's how many pages a
+    // huge page spans: 2MiB with 4KiB pages.
+    size_t hugePageSize = pageSize * (pageSize / sizeof(void*));
+    size_t mapLength = (adjLength + pageSize - 1) & ~(pageSize - 1);
+    if (mapLength < hugePageSize) {
+        return nullptr;
+    }
+
+    size_t reserveLength = mapLength + hugePageSize;
+    void* reserved = mmap(nullptr, reserveLength, PROT_NONE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserved == MAP_FAILED) {
+        return nullptr;
+    }
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(reserved);
+    size_t skip = (adjOffset % hugePageSize + hugePageSize - start % hugePageSize) % hugePageSize;
+    if (skip > 0) {
+        munmap(reserved, skip);
+    }
+    if (reserveLength - skip > mapLength) {
+        munmap(reinterpret_cast<void*>(start + skip + mapLength), reserveLength - skip - mapLength);
+    }
+    return reinterpret_cast<void*>(start + skip);
+#else
+    (void)adjOffset;
+    (void)adjLength;
+    (void)pageSize;
+    return nullptr;
+#endif
+}
+#endif
+
+bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t length,
+        bool readOnly, int createFlags)
 {
 #if defined(__MINGW32__)
     int     adjust;
     off64_t adjOffset;
     size_t  adjLength;
 
+    (void)createFlags;
+
     if (mPageSize == -1) {
         SYSTEM_INFO  si;
 
@@ -198,8 +250,21 @@ bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t le
     int flags = MAP_SHARED;
     int prot = PROT_READ;
     if (!readOnly) prot |= PROT_WRITE;
+#if defined(MAP_POPULATE)
+    if (createFlags & POPULATE) flags |= MAP_POPULATE;
+#endif
 
-    void* ptr = mmap64(nullptr, adjLength, prot, flags, fd, adjOffset);
+    void* addr = nullptr;
+    if (createFlags & HUGEPAGE) {
+        addr = reserveHugePageAlignedAddress(adjOffset, adjLength, mPageSize);
+        if (addr != nullptr) flags |= MAP_FIXED;
+    }
+
+    void* ptr = mmap64(addr, adjLength, prot, flags, fd, adjOffset);
+    if (ptr == MAP_FAILED && addr != nullptr) {
+        // Don't leave the reservation behind.
+        munmap(addr, adjLength);
+    }
     if (ptr == MAP_FAILED) {
         if (errno == EINVAL && length == 0) {
             ptr = nullptr;
@@ -210,6 +275,13 @@ bool FileMap::create(const char* origFileName, int fd, off64_t offset, size_t le
         }
     }
     mBasePtr = ptr;
+
+#if defined(MADV_HUGEPAGE)
+    // This fails with EINVAL on kernels without transparent huge page support, which is fine.
+    if (ptr != nullptr && (createFlags & HUGEPAGE) && madvise(ptr, adjLength, MADV_HUGEPAGE) != 0) {
+        ALOGV("madvise(MADV_HUGEPAGE) failed: %s\n", strerror(errno));
+    }
+#endif
 #endif // !defined(__MINGW32__)
 
     mFileName = origFileName != nullptr ? strdup(origFileName) : nullptr;
@@ -247,9 +319,72 @@ int FileMap::advise(MapAdvice advice)
     return cc;
 }
 
+int FileMap::prefetch(size_t offset, size_t length)
+{
+    if (offset >= mDataLength) {
+        return 0;
+    }
+    length = std::min(length, mDataLength - offset);
+
+    // madvise() wants a page aligned start, and mDataPtr is only aligned if the offset was.
+    uintptr_t start = reinterpret_cast<uintptr_t>(mDataPtr) + offset;
+    uintptr_t alignedStart = start & ~(mPageSize - 1);
+    int cc = madvise(reinterpret_cast<void*>(alignedStart), length + (start - alignedStart),
+                     MADV_WILLNEED);
+    if (cc != 0)
+        ALOGW("madvise(MADV_WILLNEED) failed: %s\n", strerror(errno));
+    return cc;
+}
+
+ssize_t FileMap::getResidentLength() const
+{
+#if defined(__linux__)
+    if (mDataLength == 0) {
+        return 0;
+    }
+
+    uintptr_t base = reinterpret_cast<uintptr_t>(mBasePtr);
+    uintptr_t dataStart = reinterpret_cast<uintptr_t>(mDataPtr);
+    uintptr_t dataEnd = dataStart + mDataLength;
+    size_t pageCount = (mBaseLength + mPageSize - 1) / mPageSize;
+
+    // Ask about a bounded number of pages at a time, so that huge maps don't need a huge vector.
+    unsigned char residency[1024];
+    ssize_t residentLength = 0;
+    for (size_t first = 0; first < pageCount; first += sizeof(residency)) {
+        size_t count = std::min(pageCount - first, sizeof(residency));
+        uintptr_t chunk = base + first * mPageSize;
+        if (mincore(reinterpret_cast<void*>(chunk), count * mPageSize, residency) != 0) {
+            ALOGW("mincore(%p, %zu) failed: %s\n", reinterpret_cast<void*>(chunk),
+                  count * mPageSize, strerror(errno));
+            return -1;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if ((residency[i] & 1) == 0) continue;
+            uintptr_t pageStart = std::max(chunk + i * mPageSize, dataStart);
+            uintptr_t pageEnd = std::min(chunk + (i + 1) * mPageSize, dataEnd);
+            residentLength += pageEnd - pageStart;
+        }
+    }
+    return residentLength;
+#else
+    return -1;
+#endif
+}
+
 #else
 int FileMap::advise(MapAdvice /* advice */)
 {
     return -1;
 }
+
+int FileMap::prefetch(size_t /* offset */, size_t /* length */)
+{
+    return -1;
+}
+
+ssize_t FileMap::getResidentLength() const
+{
+    return -1;
+}
 #endif
@@ -65,3 +65,62 @@ TEST(FileMap, offset_overflow) {
     android::FileMap m;
     ASSERT_FALSE(m.create("test", tf.fd, offset, length, true));
 }
+
+static std::string WriteTestFile(const TemporaryFile& tf, size_t size) {
+    std::string contents(size, '\0');
+    for (size_t i = 0; i < size; ++i) contents[i] = static_cast<char>(i * 7 + i / 4096);
+    EXPECT_TRUE(android::base::WriteStringToFd(contents, tf.fd));
+    return contents;
+}
+
+TEST(FileMap, populate) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    std::string contents = WriteTestFile(tf, 64 * 1024);
+
+    android::FileMap m;
+    ASSERT_TRUE(m.create("test", tf.fd, 100, 32 * 1024, true, android::FileMap::POPULATE));
+    ASSERT_EQ(0, memcmp(contents.data() + 100, m.getDataPtr(), 32 * 1024));
+#if defined(__linux__)
+    // The file was just written, so it's in the page cache and all of it is mapped in.
+    ASSERT_EQ(32 * 1024, m.getResidentLength());
+#endif
+}
+
+TEST(FileMap, prefetch) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    std::string contents = WriteTestFile(tf, 64 * 1024);
+
+    android::FileMap m;
+    ASSERT_TRUE(m.create("test", tf.fd, 100, 32 * 1024, true));
+    ASSERT_EQ(0, m.prefetch(1000, 8 * 1024));
+    // Ranges running off the end are clipped, and ranges past it are ignored.
+    ASSERT_EQ(0, m.prefetch(30 * 1024, 8 * 1024));
+    ASSERT_EQ(0, m.prefetch(64 * 1024, 1));
+    ASSERT_EQ(0, memcmp(contents.data() + 100, m.getDataPtr(), 32 * 1024));
+
+    ssize_t resident = m.getResidentLength();
+    ASSERT_GE(resident, 0);
+    ASSERT_LE(resident, 32 * 1024);
+}
+
+TEST(FileMap, hugepage) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    std::string contents = WriteTestFile(tf, 5 * 1024 * 1024);
+
+    // Huge page alignment is best effort, but the mapping has to be right regardless.
+    android::FileMap m;
+    off64_t offset = 3 * 4096 + 10;
+    size_t length = 4 * 1024 * 1024;
+    ASSERT_TRUE(m.create("test", tf.fd, offset, length, false, android::FileMap::HUGEPAGE));
+    ASSERT_EQ(length, m.getDataLength());
+    ASSERT_EQ(0, memcmp(contents.data() + offset, m.getDataPtr(), length));
+
+    // Writes go to the file.
+    static_cast<char*>(m.getDataPtr())[0] = 'x';
+    char c = 0;
+    ASSERT_EQ(1, pread(tf.fd, &c, 1, offset));
+    ASSERT_EQ('x', c);
+}
@@ -20,7 +20,12 @@
 #include <utils/Looper.h>
 
 #include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
+#include <climits>
 
 namespace android {
 
@@ -32,6 +37,67 @@ epoll_event createEpollEvent(uint32_t events, uint64_t seq) {
     return {.events = events, .data = {.u64 = seq}};
 }
 
+// Cleared once epoll_pwait2() is found to be missing, which it is on kernels before 5.11.
+std::atomic<bool> gHasEpollPwait2 = true;
+
+// Like epoll_wait(), but with a timeout in nanoseconds (negative to wait forever), so that a poll
+// that ends at a message uptime is not rounded up to the next millisecond.
+int epollWait(int epfd, epoll_event* events, int maxEvents, nsecs_t timeoutNanos) {
+    if (gHasEpollPwait2.load(std::memory_order_relaxed)) {
+        timespec ts = {
+                .tv_sec = static_cast<time_t>(timeoutNanos / 1000000000),
+                .tv_nsec = static_cast<long>(timeoutNanos % 1000000000),
+        };
+        timespec* timeout = timeoutNanos < 0 ? nullptr : &ts;
+        int result = -1;
+        errno = ENOSYS;
+#if defined(__BIONIC__)
+        if (__builtin_available(android 35, *)) {
+            result = epoll_pwait2(epfd, events, maxEvents, timeout, nullptr);
+        }
+#elif defined(__NR_epoll_pwait2)
+        result = syscall(__NR_epoll_pwait2, epfd, events, maxEvents, timeout, nullptr, 0);
+#endif
+        if (result >= 0 || errno != ENOSYS) {
+            return result;
+        }
+        gHasEpollPwait2.store(false, std::memory_order_relaxed);
+    }
+
+    int timeoutMillis = -1;
+    if (timeoutNanos >= 0) {
+        // Round up so that we never wake before the timeout.
+        timeoutMillis = static_cast<int>(std::min<nsecs_t>((timeoutNanos + 999999) / 1000000,
+                                                           INT_MAX));
+    }
+    return epoll_wait(epfd, events, maxEvents, timeoutMillis);
+}
+
+// Shared by all loopers; each looper only needs the values it takes under its own lock to
+// increase, and the comparison below tolerates wraparound.
+std::atomic<uint32_t> gNextMessageSeq;
+
+// Heap comparator that puts the earliest message envelope at the top of the heap, and among
+// envelopes with the same uptime the one that was sent first.
+constexpr auto messageEnvelopeAfter = [](const auto& lhs, const auto& rhs) {
+    if (lhs.uptime != rhs.uptime) return lhs.uptime > rhs.uptime;
+    return static_cast<int32_t>(lhs.seq - rhs.seq) > 0;
+};
+
+template <typename Envelopes, typename Predicate>
+void removeMessageEnvelopesIf(Envelopes& envelopes, Predicate predicate) {
+    auto* first = envelopes.editArray();
+    auto* last = first + envelopes.size();
+    auto* newLast = std::remove_if(first, last, predicate);
+    if (newLast == last) {
+        return;
+    }
+    envelopes.removeItemsAt(newLast - first, last - newLast);
+    // Removing items may have reallocated the storage.
+    first = envelopes.editArray();
+    std::make_heap(first, first + envelopes.size(), messageEnvelopeAfter);
+}
+
 }  // namespace
 
 // --- WeakMessageHandler ---
@@ -224,29 +290,29 @@ int Looper::pollInner(int timeoutMillis) {
 #endif
 
     // Adjust the timeout based on when the next message is due.
+    nsecs_t timeoutNanos = timeoutMillis < 0 ? -1 : milliseconds_to_nanoseconds(timeoutMillis);
     if (timeoutMillis != 0 && mNextMessageUptime != LLONG_MAX) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-        int messageTimeoutMillis = toMillisecondTimeoutDelay(now, mNextMessageUptime);
-        if (messageTimeoutMillis >= 0
-                && (timeoutMillis < 0 || messageTimeoutMillis < timeoutMillis)) {
-            timeoutMillis = messageTimeoutMillis;
+        nsecs_t messageTimeoutNanos = std::max<nsecs_t>(mNextMessageUptime - now, 0);
+        if (timeoutNanos < 0 || messageTimeoutNanos < timeoutNanos) {
+            timeoutNanos = messageTimeoutNanos;
         }
 #if DEBUG_POLL_AND_WAKE
-        ALOGD("%p ~ pollOnce - next message in %" PRId64 "ns, adjusted timeout: timeoutMillis=%d",
-                this, mNextMessageUptime - now, timeoutMillis);
+        ALOGD("%p ~ pollOnce - next message in %" PRId64 "ns, adjusted timeout: timeoutNanos=%"
+                PRId64, this, mNextMessageUptime - now, timeoutNanos);
 #endif
     }
 
     // Poll.
     int result = POLL_WAKE;
-    mResponses.clear();
+    size_t responseCount = 0;
     mResponseIndex = 0;
 
     // We are about to idle.
     mPolling = true;
 
     struct epoll_event eventItems[EPOLL_MAX_EVENTS];
-    int eventCount = epoll_wait(mEpollFd.get(), eventItems, EPOLL_MAX_EVENTS, timeoutMillis);
+    int eventCount = epollWait(mEpollFd.get(), eventItems, EPOLL_MAX_EVENTS, timeoutNanos);
 
     // No longer idling.
     mPolling = false;
@@ -303,7 +369,13 @@ int Looper::pollInner(int timeoutMillis) {
                 if (epollEvents & EPOLLOUT) events |= EVENT_OUTPUT;
                 if (epollEvents & EPOLLERR) events |= EVENT_ERROR;
                 if (epollEvents & EPOLLHUP) events |= EVENT_HANGUP;
-                mResponses.push({.seq = seq, .events = events, .request = request});
+                Response response = {.seq = seq, .events = events, .request = request};
+                if (responseCount < mResponses.size()) {
+                    mResponses.editItemAt(responseCount) = std::move(response);
+                } else {
+                    mResponses.push(response);
+                }
+                responseCount++;
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x for sequence number %" PRIu64
                       " that is no longer registered.",
@@ -313,6 +385,12 @@ int Looper::pollInner(int timeoutMillis) {
     }
 Done: ;
 
+    // Drop the responses left over from the previous poll. Their slots are overwritten above
+    // rather than cleared up front, since clearing a Vector reallocates its storage.
+    if (responseCount < mResponses.size()) {
+        mResponses.removeItemsAt(responseCount, mResponses.size() - responseCount);
+    }
+
     // Invoke pending message callbacks.
     mNextMessageUptime = LLONG_MAX;
     while (mMessageEnvelopes.size() != 0) {
@@ -326,7 +404,10 @@ Done: ;
             { // obtain handler
                 sp<MessageHandler> handler = messageEnvelope.handler;
                 Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                std::pop_heap(mMessageEnvelopes.editArray(),
+                              mMessageEnvelopes.editArray() + mMessageEnvelopes.size(),
+                              messageEnvelopeAfter);
+                mMessageEnvelopes.pop();
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -622,17 +703,16 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
             this, uptime, handler.get(), message.what);
 #endif
 
-    size_t i = 0;
+    bool atHead;
     { // acquire lock
         AutoMutex _l(mLock);
 
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
+        uint32_t seq = gNextMessageSeq.fetch_add(1, std::memory_order_relaxed);
+        mMessageEnvelopes.push(MessageEnvelope(uptime, handler, message, seq));
+        std::push_heap(mMessageEnvelopes.editArray(),
+                       mMessageEnvelopes.editArray() + mMessageEnvelopes.size(),
+                       messageEnvelopeAfter);
+        atHead = mMessageEnvelopes.itemAt(0).seq == seq;
 
         // Optimization: If the Looper is currently sending a message, then we can skip
         // the call to wake() because the next thing the Looper will do after processing
@@ -644,7 +724,7 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
     } // release lock
 
     // Wake the poll loop only when we enqueue a new message at the head.
-    if (i == 0) {
+    if (atHead) {
         wake();
     }
 }
@@ -657,12 +737,9 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler) {
-                mMessageEnvelopes.removeAt(i);
-            }
-        }
+        removeMessageEnvelopesIf(mMessageEnvelopes, [&](const MessageEnvelope& messageEnvelope) {
+            return messageEnvelope.handler == handler;
+        });
     } // release lock
 }
 
@@ -674,13 +751,9 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler
-                    && messageEnvelope.message.what == what) {
-                mMessageEnvelopes.removeAt(i);
-            }
-        }
+        removeMessageEnvelopesIf(mMessageEnvelopes, [&](const MessageEnvelope& messageEnvelope) {
+            return messageEnvelope.handler == handler && messageEnvelope.message.what == what;
+        });
     } // release lock
 }
 
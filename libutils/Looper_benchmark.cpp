@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <utils/Looper.h>
+#include <utils/Timers.h>
+
+#include <random>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
+using android::Looper;
+using android::LooperCallback;
+using android::Message;
+using android::MessageHandler;
+using android::sp;
+
+namespace {
+
+class NullHandler : public MessageHandler {
+  public:
+    void handleMessage(const Message&) override {}
+};
+
+class EventFdCallback : public LooperCallback {
+  public:
+    int handleEvent(int fd, int, void*) override {
+        eventfd_t value;
+        eventfd_read(fd, &value);
+        mHandled++;
+        return 1;
+    }
+
+    int mHandled = 0;
+};
+
+// Fills the looper with messages due far enough in the future that they are never handled.
+void sendBacklog(const sp<Looper>& looper, const sp<MessageHandler>& handler, int count) {
+    std::mt19937 rng;
+    std::uniform_int_distribution<nsecs_t> delay(s2ns(3600), s2ns(7200));
+    for (int i = 0; i < count; i++) {
+        looper->sendMessageDelayed(delay(rng), handler, Message(i));
+    }
+}
+
+}  // namespace
+
+// Sending delayed messages at random times into a queue holding range(0) other messages.
+void BM_sendMessageDelayed(benchmark::State& state) {
+    sp<Looper> looper = sp<Looper>::make(true);
+    sp<MessageHandler> backlogHandler = sp<NullHandler>::make();
+    sp<MessageHandler> handler = sp<NullHandler>::make();
+    sendBacklog(looper, backlogHandler, state.range(0));
+
+    std::mt19937 rng;
+    std::uniform_int_distribution<nsecs_t> delay(s2ns(3600), s2ns(7200));
+    constexpr int kBatch = 64;
+    for (auto _ : state) {
+        for (int i = 0; i < kBatch; i++) {
+            looper->sendMessageDelayed(delay(rng), handler, Message(i));
+        }
+        state.PauseTiming();
+        looper->removeMessages(handler);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * kBatch);
+}
+BENCHMARK(BM_sendMessageDelayed)->Arg(0)->Arg(16)->Arg(256)->Arg(4096);
+
+// Sending an immediate message and handling it while range(0) delayed messages are pending.
+void BM_sendMessageAndPollOnce(benchmark::State& state) {
+    sp<Looper> looper = sp<Looper>::make(true);
+    sp<MessageHandler> backlogHandler = sp<NullHandler>::make();
+    sp<MessageHandler> handler = sp<NullHandler>::make();
+    sendBacklog(looper, backlogHandler, state.range(0));
+
+    for (auto _ : state) {
+        looper->sendMessage(handler, Message(0));
+        looper->pollOnce(0);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_sendMessageAndPollOnce)->Arg(0)->Arg(16)->Arg(256)->Arg(4096);
+
+// Dispatching callbacks for range(1) ready fds out of range(0) registered ones.
+void BM_pollOnceFdCallbacks(benchmark::State& state) {
+    sp<Looper> looper = sp<Looper>::make(false);
+    sp<EventFdCallback> callback = sp<EventFdCallback>::make();
+    std::vector<android::base::unique_fd> fds;
+    for (int i = 0; i < state.range(0); i++) {
+        fds.emplace_back(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+        looper->addFd(fds.back().get(), Looper::POLL_CALLBACK, Looper::EVENT_INPUT, callback,
+                      nullptr);
+    }
+
+    const int ready = state.range(1);
+    const size_t stride = fds.size() / ready;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (size_t i = 0; i < fds.size(); i += stride) {
+            eventfd_write(fds[i].get(), 1);
+        }
+        callback->mHandled = 0;
+        state.ResumeTiming();
+
+        while (callback->mHandled < ready) {
+            looper->pollOnce(0);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * ready);
+}
+BENCHMARK(BM_pollOnceFdCallbacks)->Args({1024, 1})->Args({1024, 16})->Args({1024, 256})
+        ->Args({1024, 1024});
+
+BENCHMARK_MAIN();
@@ -385,6 +385,32 @@ TEST_F(LooperTest, PollOnce_WhenNonCallbackFdIsSignalled_ReturnsIdent) {
             << "pollOnce should have returned the data";
 }
 
+TEST_F(LooperTest, PollOnce_WhenFewerFdsSignalledThanLastPoll_ReturnsOnlyNewIdents) {
+    Pipe pipe1, pipe2;
+    mLooper->addFd(pipe1.receiveFd, 1, Looper::EVENT_INPUT, nullptr, nullptr);
+    mLooper->addFd(pipe2.receiveFd, 2, Looper::EVENT_INPUT, nullptr, nullptr);
+
+    // First poll: both FDs are signalled.
+    pipe1.writeSignal();
+    pipe2.writeSignal();
+
+    int result1 = mLooper->pollOnce(0);
+    int result2 = mLooper->pollOnce(0);
+    EXPECT_EQ(3, result1 + result2)
+            << "pollOnce should return the idents of both signalled FDs";
+    ASSERT_EQ(OK, pipe1.readSignal());
+    ASSERT_EQ(OK, pipe2.readSignal());
+
+    // Second poll: only the second FD is signalled.
+    pipe2.writeSignal();
+
+    EXPECT_EQ(2, mLooper->pollOnce(0))
+            << "pollOnce should return the ident of the signalled FD";
+    ASSERT_EQ(OK, pipe2.readSignal());
+    EXPECT_EQ(Looper::POLL_TIMEOUT, mLooper->pollOnce(0))
+            << "pollOnce should not return events left over from the first poll";
+}
+
 TEST_F(LooperTest, AddFd_WhenCallbackAdded_ReturnsOne) {
     Pipe pipe;
     int result = mLooper->addFd(pipe.receiveFd, 0, Looper::EVENT_INPUT, nullptr, nullptr);
@@ -14,13 +14,17 @@
  * limitations under the License.
  */
 
+#include <stdlib.h>
+
 #include <functional>
 
 #include "fuzzer/FuzzedDataProvider.h"
+#include "utils/ConcurrentLruCache.h"
 #include "utils/LruCache.h"
 #include "utils/StrongPointer.h"
 
 typedef android::LruCache<size_t, size_t> FuzzCache;
+typedef android::ConcurrentLruCache<size_t, size_t> FuzzConcurrentCache;
 
 static constexpr uint32_t MAX_CACHE_ENTRIES = 800;
 
@@ -62,12 +66,46 @@ static const std::vector<std::function<void(FuzzedDataProvider*, FuzzCache*)>> o
             cache->setOnEntryRemovedListener(&callback);
         }};
 
+static const std::vector<std::function<void(FuzzedDataProvider*, FuzzConcurrentCache*)>>
+        concurrentOperations = {
+                [](FuzzedDataProvider*, FuzzConcurrentCache* cache) -> void { cache->clear(); },
+                [](FuzzedDataProvider*, FuzzConcurrentCache* cache) -> void { cache->size(); },
+                [](FuzzedDataProvider*, FuzzConcurrentCache* cache) -> void {
+                    cache->forEach([](size_t, size_t) {});
+                },
+                [](FuzzedDataProvider* dataProvider, FuzzConcurrentCache* cache) -> void {
+                    size_t key = dataProvider->ConsumeIntegral<size_t>();
+                    size_t val = dataProvider->ConsumeIntegral<size_t>();
+                    cache->put(key % MAX_CACHE_ENTRIES, val);
+                },
+                [](FuzzedDataProvider* dataProvider, FuzzConcurrentCache* cache) -> void {
+                    size_t key = dataProvider->ConsumeIntegral<size_t>();
+                    cache->get(key % MAX_CACHE_ENTRIES);
+                },
+                [](FuzzedDataProvider* dataProvider, FuzzConcurrentCache* cache) -> void {
+                    size_t key = dataProvider->ConsumeIntegral<size_t>();
+                    cache->remove(key % MAX_CACHE_ENTRIES);
+                },
+                [](FuzzedDataProvider*, FuzzConcurrentCache* cache) -> void {
+                    if (cache->size() > MAX_CACHE_ENTRIES) abort();
+                }};
+
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
     FuzzedDataProvider dataProvider(data, size);
     FuzzCache cache(MAX_CACHE_ENTRIES);
+    FuzzConcurrentCache concurrentCache(MAX_CACHE_ENTRIES,
+                                        dataProvider.ConsumeBool()
+                                                ? FuzzConcurrentCache::Policy::kClock
+                                                : FuzzConcurrentCache::Policy::kLru,
+                                        dataProvider.ConsumeIntegralInRange<size_t>(1, 64));
     while (dataProvider.remaining_bytes() > 0) {
-        uint8_t op = dataProvider.ConsumeIntegral<uint8_t>() % operations.size();
-        operations[op](&dataProvider, &cache);
+        uint8_t op = dataProvider.ConsumeIntegral<uint8_t>() %
+                     (operations.size() + concurrentOperations.size());
+        if (op < operations.size()) {
+            operations[op](&dataProvider, &cache);
+        } else {
+            concurrentOperations[op - operations.size()](&dataProvider, &concurrentCache);
+        }
     }
 
     return 0;
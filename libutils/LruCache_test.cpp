@@ -18,9 +18,15 @@
 
 #include <android/log.h>
 #include <gtest/gtest.h>
+#include <utils/ConcurrentLruCache.h>
 #include <utils/JenkinsHash.h>
 #include <utils/LruCache.h>
 
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
 namespace {
 
 typedef int SimpleKey;
@@ -459,4 +465,150 @@ TEST_F(LruCacheTest, DontCopyKeyInGet) {
     cache.get(KeyFailsOnCopy(0));
 }
 
+typedef ConcurrentLruCache<SimpleKey, StringValue> SimpleConcurrentCache;
+
+class ConcurrentEntryRemovedCallback : public OnEntryRemoved<SimpleKey, StringValue> {
+public:
+    void operator()(SimpleKey& k, StringValue&) {
+        removedKeys.push_back(k);
+    }
+    std::vector<SimpleKey> removedKeys;
+};
+
+TEST_F(LruCacheTest, ConcurrentSimple) {
+    SimpleConcurrentCache cache(100);
+
+    EXPECT_EQ(std::nullopt, cache.get(1));
+    EXPECT_TRUE(cache.put(1, "one"));
+    EXPECT_TRUE(cache.put(2, "two"));
+    EXPECT_FALSE(cache.put(1, "uno"));
+    EXPECT_STREQ("one", *cache.get(1));
+    EXPECT_STREQ("two", *cache.get(2));
+    EXPECT_EQ(2u, cache.size());
+
+    EXPECT_TRUE(cache.remove(1));
+    EXPECT_FALSE(cache.remove(1));
+    EXPECT_EQ(std::nullopt, cache.get(1));
+    EXPECT_EQ(1u, cache.size());
+}
+
+TEST_F(LruCacheTest, ConcurrentGetUpdatesLru) {
+    SimpleConcurrentCache cache(3, SimpleConcurrentCache::Policy::kLru, 1);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    EXPECT_STREQ("one", *cache.get(1));
+    cache.put(4, "four");
+    EXPECT_STREQ("one", *cache.get(1));
+    EXPECT_EQ(std::nullopt, cache.get(2));
+    EXPECT_STREQ("three", *cache.get(3));
+    EXPECT_STREQ("four", *cache.get(4));
+    EXPECT_EQ(3u, cache.size());
+}
+
+TEST_F(LruCacheTest, ConcurrentClockKeepsReferenced) {
+    SimpleConcurrentCache cache(3, SimpleConcurrentCache::Policy::kClock, 1);
+
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    EXPECT_STREQ("one", *cache.get(1));
+    cache.put(4, "four");
+    EXPECT_STREQ("one", *cache.get(1));
+    EXPECT_EQ(std::nullopt, cache.get(2));
+    EXPECT_EQ(3u, cache.size());
+}
+
+TEST_F(LruCacheTest, ConcurrentMaxCapacity) {
+    const uint32_t kCacheSize = 64;
+    SimpleConcurrentCache cache(kCacheSize, SimpleConcurrentCache::Policy::kClock);
+
+    for (int i = 0; i < 1000; i++) {
+        cache.put(i, "value");
+        ASSERT_LE(cache.size(), kCacheSize);
+    }
+    EXPECT_TRUE(cache.get(999));
+}
+
+TEST_F(LruCacheTest, ConcurrentStringViewLookup) {
+    ConcurrentLruCache<std::string, int> cache(10);
+
+    cache.put("one", 1);
+    cache.put(std::string("two"), 2);
+    EXPECT_EQ(1, cache.get(std::string_view("one")));
+    EXPECT_EQ(2, cache.get("two"));
+    EXPECT_EQ(std::nullopt, cache.get(std::string_view("three")));
+    EXPECT_TRUE(cache.remove(std::string_view("one")));
+    EXPECT_EQ(1u, cache.size());
+}
+
+TEST_F(LruCacheTest, ConcurrentCallback) {
+    ConcurrentEntryRemovedCallback callback;
+    {
+        SimpleConcurrentCache cache(2, SimpleConcurrentCache::Policy::kLru, 1);
+        cache.setOnEntryRemovedListener(&callback);
+
+        cache.put(1, "one");
+        cache.put(2, "two");
+        cache.put(3, "three");
+        EXPECT_EQ(std::vector<SimpleKey>({1}), callback.removedKeys);
+        cache.remove(2);
+        EXPECT_EQ(std::vector<SimpleKey>({1, 2}), callback.removedKeys);
+    }
+    // The destructor clears the cache.
+    EXPECT_EQ(std::vector<SimpleKey>({1, 2, 3}), callback.removedKeys);
+}
+
+TEST_F(LruCacheTest, ConcurrentNoLeak) {
+    {
+        ConcurrentLruCache<ComplexKey, ComplexValue> cache(10);
+        for (int i = 0; i < 100; i++) {
+            cache.put(ComplexKey(i), ComplexValue(i));
+        }
+        cache.remove(ComplexKey(99));
+        cache.clear();
+        EXPECT_EQ(0u, cache.size());
+    }
+    // TearDown checks that the node pools released every key and value.
+}
+
+TEST_F(LruCacheTest, ConcurrentForEach) {
+    ConcurrentLruCache<int, int> cache(100);
+    cache.put(1, 4);
+    cache.put(2, 5);
+    cache.put(3, 6);
+
+    std::unordered_set<int> returnedValues;
+    cache.forEach([&](int, int value) { returnedValues.insert(value); });
+    EXPECT_EQ(std::unordered_set<int>({ 4, 5, 6 }), returnedValues);
+}
+
+TEST_F(LruCacheTest, ConcurrentThreads) {
+    for (auto policy : {ConcurrentLruCache<int, int>::Policy::kLru,
+                        ConcurrentLruCache<int, int>::Policy::kClock}) {
+        const uint32_t kCacheSize = 256;
+        ConcurrentLruCache<int, int> cache(kCacheSize, policy);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&cache, t]() {
+                for (int i = 0; i < 20000; i++) {
+                    const int key = hash_int(i * 4 + t) % 1024;
+                    if (auto value = cache.get(key)) {
+                        EXPECT_EQ(key * 2, *value);
+                    } else if (i % 16 == 0) {
+                        cache.remove(key);
+                    } else {
+                        cache.put(key, key * 2);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        EXPECT_LE(cache.size(), kCacheSize);
+    }
+}
+
 }
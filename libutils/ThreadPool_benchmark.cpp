@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <utils/ThreadPool.h>
+
+#include <atomic>
+#include <future>
+#include <vector>
+
+using android::ThreadPool;
+
+namespace {
+
+// Posts many empty tasks from outside the pool and waits for them.
+void BM_ThreadPool_post(benchmark::State& state) {
+    ThreadPool pool(state.range(0));
+    std::atomic<int> count = 0;
+    for (auto _ : state) {
+        for (int i = 0; i < 1000; i++) {
+            pool.post([&count] { count.fetch_add(1, std::memory_order_relaxed); });
+        }
+        pool.waitIdle();
+    }
+    state.SetItemsProcessed(state.iterations() * 1000);
+}
+BENCHMARK(BM_ThreadPool_post)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+// Round trip of a single task with a future, i.e. the wake up latency of an idle pool.
+void BM_ThreadPool_submit_round_trip(benchmark::State& state) {
+    ThreadPool pool(state.range(0));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(pool.submit([] { return 1; }).get());
+    }
+}
+BENCHMARK(BM_ThreadPool_submit_round_trip)->Arg(1)->Arg(4);
+
+// A recursive divide and conquer, where tasks fan out from the workers themselves and idle
+// workers have to steal to stay busy.
+void fanOut(ThreadPool& pool, int depth, std::atomic<int>& leaves) {
+    if (depth == 0) {
+        leaves.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        pool.post([&pool, depth, &leaves] { fanOut(pool, depth - 1, leaves); });
+    }
+}
+
+void BM_ThreadPool_fan_out(benchmark::State& state) {
+    ThreadPool pool(state.range(0));
+    std::atomic<int> leaves = 0;
+    for (auto _ : state) {
+        pool.post([&pool, &leaves] { fanOut(pool, 12, leaves); });
+        pool.waitIdle();
+    }
+    state.SetItemsProcessed(state.iterations() * (1 << 13));
+}
+BENCHMARK(BM_ThreadPool_fan_out)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
+}  // namespace
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/ThreadPool.h>
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+using android::ThreadPool;
+
+TEST(ThreadPool, submit_returns_results) {
+    ThreadPool pool(4);
+    ASSERT_EQ(4u, pool.threadCount());
+
+    std::vector<std::future<int>> results;
+    for (int i = 0; i < 100; i++) {
+        results.push_back(pool.submit([i] { return i * i; }));
+    }
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(i * i, results[i].get());
+    }
+}
+
+TEST(ThreadPool, default_thread_count) {
+    ThreadPool pool(ThreadPool::Options{});
+    EXPECT_EQ(std::max(1u, std::thread::hardware_concurrency()), pool.threadCount());
+}
+
+TEST(ThreadPool, wait_idle_includes_nested_tasks) {
+    ThreadPool pool(3);
+    std::atomic<int> count = 0;
+    for (int i = 0; i < 10; i++) {
+        pool.post([&] {
+            EXPECT_EQ(&pool, ThreadPool::current());
+            for (int j = 0; j < 10; j++) {
+                pool.post([&] { count++; });
+            }
+            count++;
+        });
+    }
+    pool.waitIdle();
+    EXPECT_EQ(110, count);
+    EXPECT_EQ(nullptr, ThreadPool::current());
+}
+
+TEST(ThreadPool, destructor_drains_queue) {
+    std::atomic<int> count = 0;
+    {
+        ThreadPool pool(2);
+        for (int i = 0; i < 1000; i++) {
+            pool.post([&] { count++; });
+        }
+    }
+    EXPECT_EQ(1000, count);
+}
+
+TEST(ThreadPool, idle_workers_steal) {
+    ThreadPool pool(4);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+
+    // Keep one worker busy while it queues work on its own queue, which only the other workers
+    // can run.
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    std::atomic<int> done = 0;
+    pool.post([&] {
+        for (int i = 0; i < 3; i++) {
+            pool.post([&] {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    threads.insert(std::this_thread::get_id());
+                }
+                done++;
+                released.wait();
+            });
+        }
+        while (done < 3) std::this_thread::yield();
+        release.set_value();
+    });
+    pool.waitIdle();
+    EXPECT_EQ(3u, threads.size());
+}
+
+TEST(ThreadPool, high_priority_runs_first) {
+    ThreadPool pool(1);
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    pool.post([&] { released.wait(); });
+
+    std::vector<int> order;
+    for (int i = 0; i < 3; i++) {
+        pool.post([&order, i] { order.push_back(i); });
+    }
+    pool.post([&order] { order.push_back(-1); }, ThreadPool::Priority::kHigh);
+    release.set_value();
+    pool.waitIdle();
+    EXPECT_EQ((std::vector<int>{-1, 0, 1, 2}), order);
+}
+
+TEST(ThreadPool, on_worker_start) {
+    std::mutex mutex;
+    std::set<size_t> started;
+    {
+        ThreadPool::Options options;
+        options.threadCount = 3;
+        options.name = "test";
+        options.onWorkerStart = [&](size_t index) {
+            std::lock_guard<std::mutex> lock(mutex);
+            started.insert(index);
+        };
+        ThreadPool pool(options);
+        pool.submit([] {}).wait();
+    }
+    EXPECT_EQ((std::set<size_t>{0, 1, 2}), started);
+}
@@ -65,7 +65,8 @@ status_t Tokenizer::open(const String8& filename, Tokenizer** outTokenizer) {
             FileMap* fileMap = new FileMap();
             bool ownBuffer = false;
             char* buffer;
-            if (fileMap->create(nullptr, fd, 0, length, true)) {
+            // The whole file is going to be read, so fault it all in at once.
+            if (fileMap->create(nullptr, fd, 0, length, true, FileMap::POPULATE)) {
                 fileMap->advise(FileMap::SEQUENTIAL);
                 buffer = static_cast<char*>(fileMap->getDataPtr());
             } else {
@@ -111,46 +112,24 @@ String8 Tokenizer::getLocation() const {
 }
 
 String8 Tokenizer::peekRemainderOfLine() const {
-    const char* end = getEnd();
-    const char* eol = mCurrent;
-    while (eol != end) {
-        char ch = *eol;
-        if (ch == '\n') {
-            break;
-        }
-        eol += 1;
-    }
-    return String8(mCurrent, eol - mCurrent);
+    std::string_view line = peekRemainderOfLineView();
+    return String8(line.data(), line.size());
 }
 
 String8 Tokenizer::nextToken(const char* delimiters) {
 #if DEBUG_TOKENIZER
     ALOGD("nextToken");
 #endif
-    const char* end = getEnd();
-    const char* tokenStart = mCurrent;
-    while (mCurrent != end) {
-        char ch = *mCurrent;
-        if (ch == '\n' || isDelimiter(ch, delimiters)) {
-            break;
-        }
-        mCurrent += 1;
-    }
-    return String8(tokenStart, mCurrent - tokenStart);
+    std::string_view token = nextTokenView(delimiters);
+    return String8(token.data(), token.size());
 }
 
 void Tokenizer::nextLine() {
 #if DEBUG_TOKENIZER
     ALOGD("nextLine");
 #endif
-    const char* end = getEnd();
-    while (mCurrent != end) {
-        char ch = *(mCurrent++);
-        if (ch == '\n') {
-            mLineNumber += 1;
-            break;
-        }
-    }
+    std::string_view line;
+    nextLines(&line, 1);
 }
 
 void Tokenizer::skipDelimiters(const char* delimiters) {
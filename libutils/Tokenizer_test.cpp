@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/Tokenizer.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string_view>
+
+#include "android-base/file.h"
+
+using android::String8;
+using android::Tokenizer;
+
+static constexpr const char* kContents =
+        "key 1   ESCAPE\n"
+        "# comment\n"
+        "\n"
+        "key 2 1";
+
+TEST(Tokenizer, tokens) {
+    Tokenizer* t;
+    ASSERT_EQ(android::OK, Tokenizer::fromContents(String8("test"), kContents, &t));
+    std::unique_ptr<Tokenizer> tokenizer(t);
+
+    EXPECT_EQ("key 1   ESCAPE", tokenizer->peekRemainderOfLineView());
+    EXPECT_EQ("key", tokenizer->nextTokenView(" "));
+    tokenizer->skipDelimiters(" ");
+    EXPECT_EQ(String8("1"), tokenizer->nextToken(" "));
+    tokenizer->skipDelimiters(" ");
+    EXPECT_EQ("ESCAPE", tokenizer->nextTokenView(" "));
+    EXPECT_TRUE(tokenizer->isEol());
+    EXPECT_EQ("", tokenizer->nextTokenView(" "));
+    EXPECT_EQ("", tokenizer->peekRemainderOfLineView());
+
+    tokenizer->nextLine();
+    EXPECT_EQ(2, tokenizer->getLineNumber());
+    EXPECT_EQ(String8("# comment"), tokenizer->peekRemainderOfLine());
+}
+
+TEST(Tokenizer, next_lines) {
+    TemporaryFile tf;
+    ASSERT_TRUE(android::base::WriteStringToFd(kContents, tf.fd));
+    Tokenizer* t;
+    ASSERT_EQ(android::OK, Tokenizer::open(String8(tf.path), &t));
+    std::unique_ptr<Tokenizer> tokenizer(t);
+
+    // The first line is what's left of the current one.
+    EXPECT_EQ("key", tokenizer->nextTokenView(" "));
+    std::string_view lines[3];
+    ASSERT_EQ(3u, tokenizer->nextLines(lines, 3));
+    EXPECT_EQ(" 1   ESCAPE", lines[0]);
+    EXPECT_EQ("# comment", lines[1]);
+    EXPECT_EQ("", lines[2]);
+    EXPECT_EQ(4, tokenizer->getLineNumber());
+
+    // The last line has no newline.
+    ASSERT_EQ(1u, tokenizer->nextLines(lines, 3));
+    EXPECT_EQ("key 2 1", lines[0]);
+    EXPECT_TRUE(tokenizer->isEof());
+    EXPECT_EQ(4, tokenizer->getLineNumber());
+    EXPECT_EQ(0u, tokenizer->nextLines(lines, 3));
+}
+
+TEST(Tokenizer, empty_file) {
+    TemporaryFile tf;
+    Tokenizer* t;
+    ASSERT_EQ(android::OK, Tokenizer::open(String8(tf.path), &t));
+    std::unique_ptr<Tokenizer> tokenizer(t);
+
+    EXPECT_TRUE(tokenizer->isEof());
+    EXPECT_EQ("", tokenizer->peekRemainderOfLineView());
+    std::string_view line;
+    EXPECT_EQ(0u, tokenizer->nextLines(&line, 1));
+}
@@ -17,6 +17,7 @@
 #define LOG_TAG "RefBase"
 // #define LOG_NDEBUG 0
 
+#include <atomic>
 #include <memory>
 #include <mutex>
 
@@ -98,8 +99,14 @@ namespace android {
 // required to perform wp<> operations.  Thus these can continue to be performed
 // after the RefBase object has been destroyed.
 //
-// A weakref_impl is allocated as the value of mRefs in a RefBase object on
-// construction.
+// A weakref_impl is allocated as the value of mRefs in a RefBase object the
+// first time it is needed, i.e. when the first weak reference is created, the
+// object lifetime is extended, or the weakref_type is otherwise requested.
+// Until then mRefs holds the strong count itself (see isInlineRefs() below),
+// so objects only ever used through sp<> need a single allocation, and their
+// strong reference operations touch a single atomic. The weakref_impl takes
+// over both counts when it is installed, and mRefs never changes after that.
+// With DEBUG_REFS the weakref_impl is still allocated on construction.
 // In the OBJECT_LIFETIME_STRONG case, it is normally deallocated in decWeak,
 // and hence lives as long as the last weak reference. (It can also be
 // deallocated in the RefBase destructor iff the strong reference count was
@@ -447,13 +454,80 @@ private:
 
 // ---------------------------------------------------------------------------
 
+// While no weakref_impl has been allocated, mRefs holds (strong count << 1) | 1.
+// weakref_impl pointers are always even, so the low bit tells the two apart.
+static constexpr intptr_t INLINE_REFS_TAG = 1;
+
+static inline bool isInlineRefs(const void* refs) {
+    return (reinterpret_cast<intptr_t>(refs) & INLINE_REFS_TAG) != 0;
+}
+
+static inline int32_t inlineStrongCount(const void* refs) {
+    return static_cast<int32_t>(reinterpret_cast<intptr_t>(refs) >> 1);
+}
+
+template <typename T>
+static inline T* inlineRefs(int32_t strong) {
+    return reinterpret_cast<T*>(static_cast<intptr_t>(strong) * 2 | INLINE_REFS_TAG);
+}
+
+// mRefs is written at most once after construction, when the weakref_impl is installed.
+// Every access goes through this so that the inline count and the installation can race.
+template <typename T>
+static inline std::atomic_ref<T*> atomicRefs(T*& refs) {
+    return std::atomic_ref<T*>(refs);
+}
+
+// Adds delta to the inline strong count, cur being the last value read from refs, and stores
+// the previous count in *c. Returns false, with cur set to the weakref_impl, if one has been
+// installed.
+template <typename T>
+static inline bool addInlineStrong(T*& refs, T*& cur, int32_t delta, int32_t* c,
+                                   std::memory_order order) {
+    std::atomic_ref<T*> atomic = atomicRefs(refs);
+    while (isInlineRefs(cur)) {
+        *c = inlineStrongCount(cur);
+        if (atomic.compare_exchange_weak(cur, inlineRefs<T>(*c + delta), order,
+                                         std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Adds delta to the strong count wherever it currently lives, without touching the weak count.
+template <typename T>
+static inline void addStrongOnly(T*& refs, int32_t delta) {
+    T* cur = atomicRefs(refs).load(std::memory_order_acquire);
+    int32_t c;
+    if (!addInlineStrong(refs, cur, delta, &c, std::memory_order_relaxed)) {
+        cur->mStrong.fetch_add(delta, std::memory_order_relaxed);
+    }
+}
+
 void RefBase::incStrong(const void* id) const
 {
-    weakref_impl* const refs = mRefs;
+    weakref_impl* cur = atomicRefs(mRefs).load(std::memory_order_acquire);
+    int32_t c;
+    if (addInlineStrong(mRefs, cur, 1, &c, std::memory_order_relaxed)) {
+        ALOG_ASSERT(c > 0, "incStrong() called on %p after last strong ref", this);
+#if PRINT_REFS
+        ALOGD("incStrong of %p from %p: cnt=%d\n", this, id, c);
+#endif
+        if (c != INITIAL_STRONG_VALUE) {
+            return;
+        }
+        check_not_on_stack(this);
+        addStrongOnly(mRefs, -INITIAL_STRONG_VALUE);
+        const_cast<RefBase*>(this)->onFirstRef();
+        return;
+    }
+
+    weakref_impl* const refs = cur;
     refs->incWeak(id);
 
     refs->addStrongRef(id);
-    const int32_t c = refs->mStrong.fetch_add(1, std::memory_order_relaxed);
+    c = refs->mStrong.fetch_add(1, std::memory_order_relaxed);
     ALOG_ASSERT(c > 0, "incStrong() called on %p after last strong ref", refs);
 #if PRINT_REFS
     ALOGD("incStrong of %p from %p: cnt=%d\n", this, id, c);
@@ -471,11 +545,20 @@ void RefBase::incStrong(const void* id) const
 }
 
 void RefBase::incStrongRequireStrong(const void* id) const {
-    weakref_impl* const refs = mRefs;
+    weakref_impl* cur = atomicRefs(mRefs).load(std::memory_order_acquire);
+    int32_t c;
+    if (addInlineStrong(mRefs, cur, 1, &c, std::memory_order_relaxed)) {
+        LOG_ALWAYS_FATAL_IF(c <= 0 || c == INITIAL_STRONG_VALUE,
+                            "incStrongRequireStrong() called on %p which isn't already owned",
+                            this);
+        return;
+    }
+
+    weakref_impl* const refs = cur;
     refs->incWeak(id);
 
     refs->addStrongRef(id);
-    const int32_t c = refs->mStrong.fetch_add(1, std::memory_order_relaxed);
+    c = refs->mStrong.fetch_add(1, std::memory_order_relaxed);
 
     LOG_ALWAYS_FATAL_IF(c <= 0 || c == INITIAL_STRONG_VALUE,
                         "incStrongRequireStrong() called on %p which isn't already owned", refs);
@@ -486,9 +569,31 @@ void RefBase::incStrongRequireStrong(const void* id) const {
 
 void RefBase::decStrong(const void* id) const
 {
-    weakref_impl* const refs = mRefs;
+    weakref_impl* cur = atomicRefs(mRefs).load(std::memory_order_acquire);
+    int32_t c;
+    if (addInlineStrong(mRefs, cur, -1, &c, std::memory_order_release)) {
+#if PRINT_REFS
+        ALOGD("decStrong of %p from %p: cnt=%d\n", this, id, c);
+#endif
+        LOG_ALWAYS_FATAL_IF(BAD_STRONG(c), "decStrong() called on %p too many times", this);
+        if (c == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const_cast<RefBase*>(this)->onLastStrongRef(id);
+            // onLastStrongRef() may have created a weak reference, in which case the
+            // weakref_impl now outlives this as usual.
+            cur = atomicRefs(mRefs).load(std::memory_order_acquire);
+            if (isInlineRefs(cur) ||
+                (cur->mFlags.load(std::memory_order_relaxed) & OBJECT_LIFETIME_MASK) ==
+                        OBJECT_LIFETIME_STRONG) {
+                delete this;
+            }
+        }
+        return;
+    }
+
+    weakref_impl* const refs = cur;
     refs->removeStrongRef(id);
-    const int32_t c = refs->mStrong.fetch_sub(1, std::memory_order_release);
+    c = refs->mStrong.fetch_sub(1, std::memory_order_release);
 #if PRINT_REFS
     ALOGD("decStrong of %p from %p: cnt=%d\n", this, id, c);
 #endif
@@ -521,31 +626,38 @@ void RefBase::forceIncStrong(const void* id) const
 {
     // Allows initial mStrong of 0 in addition to INITIAL_STRONG_VALUE.
     // TODO: Better document assumptions.
-    weakref_impl* const refs = mRefs;
-    refs->incWeak(id);
-
-    refs->addStrongRef(id);
-    const int32_t c = refs->mStrong.fetch_add(1, std::memory_order_relaxed);
+    weakref_impl* cur = atomicRefs(mRefs).load(std::memory_order_acquire);
+    int32_t c;
+    if (!addInlineStrong(mRefs, cur, 1, &c, std::memory_order_relaxed)) {
+        weakref_impl* const refs = cur;
+        refs->incWeak(id);
+
+        refs->addStrongRef(id);
+        c = refs->mStrong.fetch_add(1, std::memory_order_relaxed);
+    }
     ALOG_ASSERT(c >= 0, "forceIncStrong called on %p after ref count underflow",
-               refs);
+               this);
 #if PRINT_REFS
     ALOGD("forceIncStrong of %p from %p: cnt=%d\n", this, id, c);
 #endif
 
     switch (c) {
     case INITIAL_STRONG_VALUE:
-        refs->mStrong.fetch_sub(INITIAL_STRONG_VALUE,
-                std::memory_order_relaxed);
+        addStrongOnly(mRefs, -INITIAL_STRONG_VALUE);
         [[fallthrough]];
     case 0:
-        refs->mBase->onFirstRef();
+        const_cast<RefBase*>(this)->onFirstRef();
     }
 }
 
 int32_t RefBase::getStrongCount() const
 {
     // Debugging only; No memory ordering guarantees.
-    return mRefs->mStrong.load(std::memory_order_relaxed);
+    weakref_impl* const refs = atomicRefs(mRefs).load(std::memory_order_acquire);
+    if (isInlineRefs(refs)) {
+        return inlineStrongCount(refs);
+    }
+    return refs->mStrong.load(std::memory_order_relaxed);
 }
 
 RefBase* RefBase::weakref_type::refBase() const
@@ -750,34 +862,64 @@ void RefBase::weakref_type::trackMe(bool enable, bool retain)
 
 RefBase::weakref_type* RefBase::createWeak(const void* id) const
 {
-    mRefs->incWeak(id);
-    return mRefs;
+    weakref_type* const refs = getWeakRefs();
+    refs->incWeak(id);
+    return refs;
 }
 
 RefBase::weakref_type* RefBase::getWeakRefs() const
 {
-    return mRefs;
+    std::atomic_ref<weakref_impl*> atomic = atomicRefs(mRefs);
+    weakref_impl* cur = atomic.load(std::memory_order_acquire);
+    if (!isInlineRefs(cur)) {
+        return cur;
+    }
+
+    // Move the strong count out of mRefs. Strong references may still come and go
+    // concurrently, so retry until mRefs is replaced by a weakref_impl carrying its current
+    // value, by us or by whoever beat us to it.
+    weakref_impl* const refs = new weakref_impl(const_cast<RefBase*>(this));
+    while (isInlineRefs(cur)) {
+        const int32_t strong = inlineStrongCount(cur);
+        refs->mStrong.store(strong, std::memory_order_relaxed);
+        // Each strong reference also holds a weak one.
+        refs->mWeak.store(strong == INITIAL_STRONG_VALUE ? 0 : strong, std::memory_order_relaxed);
+        if (atomic.compare_exchange_weak(cur, refs, std::memory_order_acq_rel,
+                                         std::memory_order_acquire)) {
+            return refs;
+        }
+    }
+    delete refs;
+    return cur;
 }
 
 RefBase::RefBase()
+#if DEBUG_REFS
     : mRefs(new weakref_impl(this))
+#else
+    : mRefs(inlineRefs<weakref_impl>(INITIAL_STRONG_VALUE))
+#endif
 {
 }
 
 RefBase::~RefBase()
 {
-    int32_t flags = mRefs->mFlags.load(std::memory_order_relaxed);
+    weakref_impl* const refs = atomicRefs(mRefs).load(std::memory_order_acquire);
+    const bool isInline = isInlineRefs(refs);
+    int32_t flags = isInline ? OBJECT_LIFETIME_STRONG
+                             : refs->mFlags.load(std::memory_order_relaxed);
     // Life-time of this object is extended to WEAK, in
     // which case weakref_impl doesn't out-live the object and we
     // can free it now.
     if ((flags & OBJECT_LIFETIME_MASK) == OBJECT_LIFETIME_WEAK) {
         // It's possible that the weak count is not 0 if the object
         // re-acquired a weak reference in its destructor
-        if (mRefs->mWeak.load(std::memory_order_relaxed) == 0) {
-            delete mRefs;
+        if (refs->mWeak.load(std::memory_order_relaxed) == 0) {
+            delete refs;
         }
     } else {
-        int32_t strongs = mRefs->mStrong.load(std::memory_order_relaxed);
+        int32_t strongs = isInline ? inlineStrongCount(refs)
+                                   : refs->mStrong.load(std::memory_order_relaxed);
 
         if (strongs == INITIAL_STRONG_VALUE) {
             // We never acquired a strong reference on this object.
@@ -788,7 +930,7 @@ RefBase::~RefBase()
             // owned by an sp<>.
             ALOGW("RefBase: Explicit destruction, weak count = %d (in %p). Use sp<> to manage this "
                   "object.",
-                  mRefs->mWeak.load(), this);
+                  isInline ? 0 : refs->mWeak.load(), this);
 
 #if ANDROID_UTILS_CALLSTACK_ENABLED
             CallStack::logStack(LOG_TAG);
@@ -799,7 +941,7 @@ RefBase::~RefBase()
         }
     }
     // For debugging purposes, clear mRefs.  Ineffective against outstanding wp's.
-    const_cast<weakref_impl*&>(mRefs) = nullptr;
+    mRefs = nullptr;
 }
 
 void RefBase::extendObjectLifetime(int32_t mode)
@@ -808,7 +950,7 @@ void RefBase::extendObjectLifetime(int32_t mode)
 
     // Must be happens-before ordered with respect to construction or any
     // operation that could destroy the object.
-    mRefs->mFlags.fetch_or(mode, std::memory_order_relaxed);
+    static_cast<weakref_impl*>(getWeakRefs())->mFlags.fetch_or(mode, std::memory_order_relaxed);
 }
 
 void RefBase::onFirstRef()
@@ -849,8 +991,13 @@ void RefBase::renameRefId(weakref_type* ref,
 
 void RefBase::renameRefId(RefBase* ref,
         const void* old_id, const void* new_id) {
-    ref->mRefs->renameStrongRefId(old_id, new_id);
-    ref->mRefs->renameWeakRefId(old_id, new_id);
+    weakref_impl* const refs = atomicRefs(ref->mRefs).load(std::memory_order_acquire);
+    if (isInlineRefs(refs)) {
+        // No references are being tracked.
+        return;
+    }
+    refs->renameStrongRefId(old_id, new_id);
+    refs->renameWeakRefId(old_id, new_id);
 }
 
 }; // namespace android
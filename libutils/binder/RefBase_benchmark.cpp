@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <utils/RefBase.h>
+#include <utils/StrongPointer.h>
+
+using android::RefBase;
+using android::sp;
+using android::wp;
+
+class Foo : public RefBase {};
+
+// Allocating and releasing an object that is only ever held through sp<>.
+void BM_RefBase_make(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        sp<Foo> foo = sp<Foo>::make();
+        benchmark::DoNotOptimize(foo.get());
+    }
+}
+BENCHMARK(BM_RefBase_make);
+
+// Same, but the object also gets a weak reference, so it needs its weakref_type.
+void BM_RefBase_makeWithWeak(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        sp<Foo> foo = sp<Foo>::make();
+        wp<Foo> weak = foo;
+        benchmark::DoNotOptimize(weak.unsafe_get());
+    }
+}
+BENCHMARK(BM_RefBase_makeWithWeak);
+
+void BM_RefBase_copy(benchmark::State& state) {
+    sp<Foo> foo = sp<Foo>::make();
+    while (state.KeepRunning()) {
+        sp<Foo> copy = foo;
+        benchmark::DoNotOptimize(copy.get());
+    }
+}
+BENCHMARK(BM_RefBase_copy);
+
+void BM_RefBase_copyWithWeak(benchmark::State& state) {
+    sp<Foo> foo = sp<Foo>::make();
+    wp<Foo> weak = foo;
+    while (state.KeepRunning()) {
+        sp<Foo> copy = foo;
+        benchmark::DoNotOptimize(copy.get());
+    }
+}
+BENCHMARK(BM_RefBase_copyWithWeak);
+
+void BM_RefBase_copyContended(benchmark::State& state) {
+    static sp<Foo> foo;
+    if (state.thread_index() == 0) {
+        foo = sp<Foo>::make();
+    }
+    while (state.KeepRunning()) {
+        sp<Foo> copy = foo;
+        benchmark::DoNotOptimize(copy.get());
+    }
+    if (state.thread_index() == 0) {
+        foo = nullptr;
+    }
+}
+BENCHMARK(BM_RefBase_copyContended)->ThreadRange(1, 8);
+
+void BM_RefBase_promote(benchmark::State& state) {
+    sp<Foo> foo = sp<Foo>::make();
+    wp<Foo> weak = foo;
+    while (state.KeepRunning()) {
+        sp<Foo> promoted = weak.promote();
+        benchmark::DoNotOptimize(promoted.get());
+    }
+}
+BENCHMARK(BM_RefBase_promote);
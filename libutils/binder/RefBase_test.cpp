@@ -128,6 +128,23 @@ TEST(RefBase, WeakCopies) {
     ASSERT_FALSE(isDeleted) << "Deletion on wp destruction should no longer occur";
 }
 
+TEST(RefBase, WeakRefsAfterStrong) {
+    bool isDeleted;
+    sp<Foo> sp1 = sp<Foo>::make(&isDeleted);
+    sp<Foo> sp2 = sp1;
+    ASSERT_EQ(2, sp1->getStrongCount());
+    // Creating the first weak reference must carry over the strong references.
+    wp<Foo> wp1 = sp1;
+    EXPECT_EQ(2, sp1->getStrongCount());
+    EXPECT_EQ(3, sp1->getWeakRefs()->getWeakCount());
+    sp2 = nullptr;
+    EXPECT_EQ(1, sp1->getStrongCount());
+    EXPECT_EQ(2, sp1->getWeakRefs()->getWeakCount());
+    sp1 = nullptr;
+    EXPECT_TRUE(isDeleted);
+    EXPECT_EQ(nullptr, wp1.promote());
+}
+
 TEST(RefBase, Comparisons) {
     bool isDeleted, isDeleted2, isDeleted3;
     Foo* foo = new Foo(&isDeleted);
@@ -445,3 +462,25 @@ TEST(RefBase, RacingPromotions) {
         ASSERT_EQ(NITERS, deleteCount) << "Deletions missed!";
     }  // Otherwise this is slow and probably pointless on a uniprocessor.
 }
+
+TEST(RefBase, RacingWeakRefCreation) {
+    for (int i = 0; i < NITERS / 1000; ++i) {
+        bool isDeleted;
+        sp<Foo> foo = sp<Foo>::make(&isDeleted);
+        std::atomic<bool> done(false);
+        std::thread t([&]() {
+            while (!done) {
+                sp<Foo> copy = foo;
+            }
+        });
+        // Races with the strong reference changes made by t.
+        wp<Foo> wp1 = foo;
+        done = true;
+        t.join();
+        EXPECT_EQ(1, foo->getStrongCount());
+        EXPECT_EQ(2, foo->getWeakRefs()->getWeakCount());
+        foo = nullptr;
+        EXPECT_TRUE(isDeleted);
+        EXPECT_EQ(nullptr, wp1.promote());
+    }
+}
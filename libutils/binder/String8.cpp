@@ -205,17 +205,32 @@ void String8::setTo(const String8& other)
 
 status_t String8::setTo(const char* other)
 {
-    const char *newString = allocFromUTF8(other, strlen(other));
-    SharedBuffer::bufferFromData(mString)->release();
-    mString = newString;
-    if (mString) return OK;
-
-    mString = getEmptyString();
-    return NO_MEMORY;
+    return setTo(other, strlen(other));
 }
 
 status_t String8::setTo(const char* other, size_t len)
 {
+    // Write into our own buffer when nobody shares it, so that assigning to the same String8 over
+    // and over (e.g. reading strings in a loop) does not allocate each time. Not when `other`
+    // points into that buffer, since resizing it may move it.
+    const SharedBuffer* cur = SharedBuffer::bufferFromData(mString);
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(mString);
+    const uintptr_t ptr = reinterpret_cast<uintptr_t>(other);
+    if (len > 0 && len != SIZE_MAX && cur->onlyOwner() &&
+        (ptr < begin || ptr >= begin + cur->size())) {
+        SharedBuffer* buf = cur->editResize(len + 1);
+        if (buf == nullptr) {
+            cur->release();
+            mString = getEmptyString();
+            return NO_MEMORY;
+        }
+        char* str = static_cast<char*>(buf->data());
+        memcpy(str, other, len);
+        str[len] = 0;
+        mString = str;
+        return OK;
+    }
+
     const char *newString = allocFromUTF8(other, len);
     SharedBuffer::bufferFromData(mString)->release();
     mString = newString;
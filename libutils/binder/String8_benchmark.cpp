@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <string>
+
+// Short names and keys, like the interface descriptors and property names that make up most
+// of the strings read from parcels.
+static const char* const kShortStrings[] = {
+        "android.os.IServiceManager", "persist.sys.locale", "media.audio_policy", "ro.build.type",
+};
+
+// Constructing a new String8 for every string, as a parcel read into a temporary does.
+void BM_String8_construct(benchmark::State& state) {
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        android::String8 s(kShortStrings[i++ % std::size(kShortStrings)]);
+        benchmark::DoNotOptimize(s.c_str());
+    }
+}
+BENCHMARK(BM_String8_construct);
+
+void BM_std_string_construct(benchmark::State& state) {
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        std::string s(kShortStrings[i++ % std::size(kShortStrings)]);
+        benchmark::DoNotOptimize(s.c_str());
+    }
+}
+BENCHMARK(BM_std_string_construct);
+
+// Assigning into the same String8 for every string, as a parcel read into an existing one does.
+void BM_String8_assign(benchmark::State& state) {
+    android::String8 s;
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        s.setTo(kShortStrings[i++ % std::size(kShortStrings)]);
+        benchmark::DoNotOptimize(s.c_str());
+    }
+}
+BENCHMARK(BM_String8_assign);
+
+void BM_String8_copy(benchmark::State& state) {
+    android::String8 s(kShortStrings[0]);
+    while (state.KeepRunning()) {
+        android::String8 copy(s);
+        benchmark::DoNotOptimize(copy.c_str());
+    }
+}
+BENCHMARK(BM_String8_copy);
+
+void BM_String8_fromString16(benchmark::State& state) {
+    android::String16 s(kShortStrings[0]);
+    while (state.KeepRunning()) {
+        android::String8 s8(s);
+        benchmark::DoNotOptimize(s8.c_str());
+    }
+}
+BENCHMARK(BM_String8_fromString16);
+
+void BM_String16_construct(benchmark::State& state) {
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        android::String16 s(kShortStrings[i++ % std::size(kShortStrings)]);
+        benchmark::DoNotOptimize(s.c_str());
+    }
+}
+BENCHMARK(BM_String16_construct);
@@ -76,6 +76,24 @@ TEST_F(String8Test, OperatorPlusEquals) {
     EXPECT_STREQ(src3, " Verify me.");
 }
 
+TEST_F(String8Test, SetTo) {
+    String8 s("My voice");
+
+    // Shared buffers must not be written in place.
+    String8 copy(s);
+    s.setTo("is my passport");
+    EXPECT_STREQ(s.c_str(), "is my passport");
+    EXPECT_STREQ(copy.c_str(), "My voice");
+
+    // Nor may the source be moved under us when it points into the buffer.
+    s.setTo(s.c_str() + 3);
+    EXPECT_STREQ(s.c_str(), "my passport");
+    EXPECT_EQ(11U, s.size());
+
+    s.setTo("");
+    EXPECT_TRUE(s.empty());
+}
+
 TEST_F(String8Test, SetToSizeMaxReturnsNoMemory) {
     const char *in = "some string";
     EXPECT_EQ(NO_MEMORY, String8("").setTo(in, SIZE_MAX));
@@ -17,10 +17,17 @@
 #define LOG_TAG "unicode"
 
 #include <limits.h>
+#include <string.h>
 #include <utils/Unicode.h>
 
 #include <log/log.h>
 
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 extern "C" {
 
 static const char32_t kByteMask = 0x000000BF;
@@ -51,6 +58,138 @@ static const char32_t kFirstByteMark[] = {
     0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
 };
 
+// --------------------------------------------------------------------------
+// ASCII
+// --------------------------------------------------------------------------
+
+// Most strings that go through here are ASCII, like interface descriptors and
+// most parcelled strings. The helpers below let the conversions handle runs of
+// ASCII a block at a time. Each one handles the leading ASCII code units of its
+// input, as far as the output has room, and returns how many it handled,
+// leaving the rest to the code point at a time loops.
+
+#if defined(__aarch64__) || defined(__SSE2__)
+static constexpr size_t kAsciiBlock8 = 16;
+static constexpr size_t kAsciiBlock16 = 8;
+#else
+static constexpr size_t kAsciiBlock8 = 8;
+static constexpr size_t kAsciiBlock16 = 4;
+#endif
+
+// Returns true if all kAsciiBlock8 bytes at src are ASCII.
+static inline bool is_ascii_block8(const uint8_t* src)
+{
+#if defined(__aarch64__)
+    return vmaxvq_u8(vld1q_u8(src)) < 0x80;
+#elif defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src))) == 0;
+#else
+    uint64_t v;
+    memcpy(&v, src, sizeof(v));
+    return (v & 0x8080808080808080ULL) == 0;
+#endif
+}
+
+// Returns true if all kAsciiBlock16 units at src are ASCII.
+static inline bool is_ascii_block16(const char16_t* src)
+{
+#if defined(__aarch64__)
+    return vmaxvq_u16(vld1q_u16(reinterpret_cast<const uint16_t*>(src))) < 0x80;
+#elif defined(__SSE2__)
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    __m128i high = _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xff80)));
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) == 0xffff;
+#else
+    uint64_t v;
+    memcpy(&v, src, sizeof(v));
+    return (v & 0xff80ff80ff80ff80ULL) == 0;
+#endif
+}
+
+static inline size_t utf8_ascii_prefix_length(const uint8_t* src, size_t src_len)
+{
+    size_t n = 0;
+    while (src_len - n >= kAsciiBlock8 && is_ascii_block8(src + n)) {
+        n += kAsciiBlock8;
+    }
+    while (n < src_len && src[n] < 0x80) {
+        n++;
+    }
+    return n;
+}
+
+static inline size_t utf16_ascii_prefix_length(const char16_t* src, size_t src_len)
+{
+    size_t n = 0;
+    while (src_len - n >= kAsciiBlock16 && is_ascii_block16(src + n)) {
+        n += kAsciiBlock16;
+    }
+    while (n < src_len && src[n] < 0x80) {
+        n++;
+    }
+    return n;
+}
+
+// Widens the leading ASCII bytes of src into dst.
+static inline size_t utf8_to_utf16_ascii_prefix(const uint8_t* src, size_t src_len,
+                                                char16_t* dst, size_t dst_len)
+{
+    size_t len = src_len < dst_len ? src_len : dst_len;
+    size_t n = 0;
+    for (; len - n >= kAsciiBlock8; n += kAsciiBlock8) {
+#if defined(__aarch64__)
+        uint8x16_t v = vld1q_u8(src + n);
+        if (vmaxvq_u8(v) >= 0x80) break;
+        uint16_t* out = reinterpret_cast<uint16_t*>(dst + n);
+        vst1q_u16(out, vmovl_u8(vget_low_u8(v)));
+        vst1q_u16(out + 8, vmovl_high_u8(v));
+#elif defined(__SSE2__)
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+        if (_mm_movemask_epi8(v) != 0) break;
+        __m128i* out = reinterpret_cast<__m128i*>(dst + n);
+        _mm_storeu_si128(out, _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+#else
+        if (!is_ascii_block8(src + n)) break;
+        for (size_t i = 0; i < kAsciiBlock8; i++) {
+            dst[n + i] = src[n + i];
+        }
+#endif
+    }
+    for (; n < len && src[n] < 0x80; n++) {
+        dst[n] = src[n];
+    }
+    return n;
+}
+
+// Narrows the leading ASCII units of src into dst.
+static inline size_t utf16_to_utf8_ascii_prefix(const char16_t* src, size_t src_len,
+                                                char* dst, size_t dst_len)
+{
+    size_t len = src_len < dst_len ? src_len : dst_len;
+    size_t n = 0;
+    for (; len - n >= kAsciiBlock16; n += kAsciiBlock16) {
+#if defined(__aarch64__)
+        uint16x8_t v = vld1q_u16(reinterpret_cast<const uint16_t*>(src + n));
+        if (vmaxvq_u16(v) >= 0x80) break;
+        vst1_u8(reinterpret_cast<uint8_t*>(dst + n), vmovn_u16(v));
+#elif defined(__SSE2__)
+        if (!is_ascii_block16(src + n)) break;
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + n));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + n), _mm_packus_epi16(v, v));
+#else
+        if (!is_ascii_block16(src + n)) break;
+        for (size_t i = 0; i < kAsciiBlock16; i++) {
+            dst[n + i] = static_cast<char>(src[n + i]);
+        }
+#endif
+    }
+    for (; n < len && src[n] < 0x80; n++) {
+        dst[n] = static_cast<char>(src[n]);
+    }
+    return n;
+}
+
 // --------------------------------------------------------------------------
 // UTF-32
 // --------------------------------------------------------------------------
@@ -304,7 +443,10 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
     while (in < end) {
         char16_t w = *in++;
         if (w < 0x0080) [[likely]] {
-            utf8_len += 1;
+            // w itself is ASCII, so this counts at least one unit.
+            size_t ascii = utf16_ascii_prefix_length(in - 1, end - in + 1);
+            in += ascii - 1;
+            utf8_len += ascii;
             continue;
         }
         if (w < 0x0800) [[likely]] {
@@ -347,7 +489,10 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst, size_t dst_le
         if (w < 0x0080) [[likely]] {
             if (out + 1 > out_end)
                 return err_out();
-            *out++ = (char)(w & 0xff);
+            size_t ascii =
+                    utf16_to_utf8_ascii_prefix(in - 1, in_end - in + 1, out, out_end - out);
+            in += ascii - 1;
+            out += ascii;
             continue;
         }
         if (w < 0x0800) [[likely]] {
@@ -420,7 +565,9 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len, bool overreadIs
         uint8_t c = *in;
         utf16_len++;
         if ((c & 0x80) == 0) [[likely]] {
-            in++;
+            size_t ascii = utf8_ascii_prefix_length(in, in_end - in);
+            in += ascii;
+            utf16_len += ascii - 1;
             continue;
         }
         if (c < 0xc0) [[unlikely]] {
@@ -487,7 +634,10 @@ char16_t* utf8_to_utf16_no_null_terminator(
     while (in < in_end && out < out_end) {
         c = *in++;
         if ((c & 0x80) == 0) [[likely]] {
-            *out++ = (char16_t)(c);
+            size_t ascii =
+                    utf8_to_utf16_ascii_prefix(in - 1, in_end - in + 1, out, out_end - out);
+            in += ascii - 1;
+            out += ascii;
             continue;
         }
         if (c < 0xc0) [[unlikely]] {
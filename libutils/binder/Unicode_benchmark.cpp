@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <utils/Unicode.h>
+
+#include <string>
+
+// ASCII text, like interface descriptors and most parcelled strings, of state.range(0) bytes.
+// With state.range(1) set, every 32nd character is a two byte UTF-8 sequence instead.
+static std::u16string MakeUtf16(benchmark::State& state) {
+    std::u16string s;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        s += (state.range(1) && i % 32 == 31) ? u'\u00e9' : static_cast<char16_t>('a' + i % 26);
+    }
+    return s;
+}
+
+static std::string MakeUtf8(benchmark::State& state) {
+    std::u16string u16 = MakeUtf16(state);
+    std::string u8(utf16_to_utf8_length(u16.data(), u16.size()) + 1, '\0');
+    utf16_to_utf8(u16.data(), u16.size(), u8.data(), u8.size());
+    u8.pop_back();
+    return u8;
+}
+
+void BM_utf8_to_utf16(benchmark::State& state) {
+    std::string u8 = MakeUtf8(state);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(u8.data());
+    std::u16string u16(u8.size() + 1, u'\0');
+    for (auto _ : state) {
+        ssize_t len = utf8_to_utf16_length(data, u8.size());
+        utf8_to_utf16(data, u8.size(), u16.data(), len + 1);
+        benchmark::DoNotOptimize(u16.data());
+    }
+    state.SetBytesProcessed(state.iterations() * u8.size());
+}
+BENCHMARK(BM_utf8_to_utf16)->ArgsProduct({{16, 64, 1024}, {0, 1}});
+
+void BM_utf16_to_utf8(benchmark::State& state) {
+    std::u16string u16 = MakeUtf16(state);
+    std::string u8(u16.size() * 3 + 1, '\0');
+    for (auto _ : state) {
+        ssize_t len = utf16_to_utf8_length(u16.data(), u16.size());
+        utf16_to_utf8(u16.data(), u16.size(), u8.data(), len + 1);
+        benchmark::DoNotOptimize(u8.data());
+    }
+    state.SetBytesProcessed(state.iterations() * u16.size() * sizeof(char16_t));
+}
+BENCHMARK(BM_utf16_to_utf8)->ArgsProduct({{16, 64, 1024}, {0, 1}});
@@ -19,6 +19,8 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <string>
+
 #include <log/log.h>
 #include <utils/Unicode.h>
 
@@ -297,6 +299,59 @@ TEST_F(UnicodeTest, strstr16TargetNotPresent) {
     EXPECT_EQ(nullptr, result);
 }
 
+// Long strings go through the ASCII fast paths a block at a time, so put a
+// non-ASCII character at every position of one, for each encoded length.
+TEST_F(UnicodeTest, LongMixedStrings) {
+    struct NonAscii {
+        const char* utf8;
+        std::u16string utf16;
+    };
+    const NonAscii kNonAscii[] = {
+            {"\xc3\xa9", u"\u00e9"},
+            {"\xe2\x82\xac", u"\u20ac"},
+            {"\xf0\x9f\x98\x80", u"\U0001f600"},
+    };
+    constexpr size_t kLength = 70;
+
+    for (const NonAscii& c : kNonAscii) {
+        for (size_t pos = 0; pos < kLength; pos++) {
+            std::string u8;
+            std::u16string u16;
+            for (size_t i = 0; i < kLength; i++) {
+                if (i == pos) {
+                    u8 += c.utf8;
+                    u16 += c.utf16;
+                } else {
+                    u8 += static_cast<char>('a' + i % 26);
+                    u16 += static_cast<char16_t>('a' + i % 26);
+                }
+            }
+            SCOPED_TRACE(u8);
+            const uint8_t* u8data = reinterpret_cast<const uint8_t*>(u8.data());
+
+            ASSERT_EQ(static_cast<ssize_t>(u16.size()), utf8_to_utf16_length(u8data, u8.size()));
+            std::u16string out16(u16.size() + 1, u'x');
+            utf8_to_utf16(u8data, u8.size(), out16.data(), out16.size());
+            EXPECT_EQ(u16, out16.substr(0, u16.size()));
+            EXPECT_EQ(0, out16[u16.size()]);
+
+            ASSERT_EQ(static_cast<ssize_t>(u8.size()),
+                      utf16_to_utf8_length(u16.data(), u16.size()));
+            std::string out8(u8.size() + 1, 'x');
+            utf16_to_utf8(u16.data(), u16.size(), out8.data(), out8.size());
+            EXPECT_EQ(u8, out8.substr(0, u8.size()));
+            EXPECT_EQ(0, out8[u8.size()]);
+
+            // The output limit is honored in the middle of ASCII runs too.
+            size_t limit = pos / 2 + 1;
+            char16_t* end = utf8_to_utf16_no_null_terminator(u8data, u8.size(), out16.data(),
+                                                             limit);
+            ASSERT_LE(static_cast<size_t>(end - out16.data()), limit);
+            EXPECT_EQ(u16.substr(0, end - out16.data()), out16.substr(0, end - out16.data()));
+        }
+    }
+}
+
 // http://b/29267949
 // Test that overreading in utf8_to_utf16_length is detected
 TEST_F(UnicodeTest, InvalidUtf8OverreadDetected) {
@@ -421,15 +421,29 @@ void* VectorImpl::_grow(size_t where, size_t amount)
             SharedBuffer* sb = SharedBuffer::alloc(new_alloc_size);
             if (sb) {
                 void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != mCount) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
-                    _do_copy(dest, from, mCount-where);
+                if (mStorage && SharedBuffer::bufferFromData(mStorage)->onlyOwner()) {
+                    // Nobody else sees the old items, so move them rather than copy them and
+                    // destroy the originals. For trivially movable types this is a memmove.
+                    if (where != 0) {
+                        _do_move_backward(array, mStorage, where);
+                    }
+                    if (where != mCount) {
+                        const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                        void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
+                        _do_move_backward(dest, from, mCount-where);
+                    }
+                    SharedBuffer::dealloc(SharedBuffer::bufferFromData(mStorage));
+                } else {
+                    if (where != 0) {
+                        _do_copy(array, mStorage, where);
+                    }
+                    if (where != mCount) {
+                        const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                        void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
+                        _do_copy(dest, from, mCount-where);
+                    }
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
             } else {
                 return nullptr;
@@ -488,15 +502,30 @@ void VectorImpl::_shrink(size_t where, size_t amount)
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
             if (sb) {
                 void* array = sb->data();
-                if (where != 0) {
-                    _do_copy(array, mStorage, where);
-                }
-                if (where != new_size) {
-                    const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
-                    void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
-                    _do_copy(dest, from, new_size - where);
+                if (SharedBuffer::bufferFromData(mStorage)->onlyOwner()) {
+                    // As in _grow(), move the remaining items instead of copying them.
+                    void* removed = reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize;
+                    _do_destroy(removed, amount);
+                    if (where != 0) {
+                        _do_move_backward(array, mStorage, where);
+                    }
+                    if (where != new_size) {
+                        const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                        void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
+                        _do_move_backward(dest, from, new_size - where);
+                    }
+                    SharedBuffer::dealloc(SharedBuffer::bufferFromData(mStorage));
+                } else {
+                    if (where != 0) {
+                        _do_copy(array, mStorage, where);
+                    }
+                    if (where != new_size) {
+                        const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                        void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
+                        _do_copy(dest, from, new_size - where);
+                    }
+                    release_storage();
                 }
-                release_storage();
                 mStorage = const_cast<void*>(array);
             } else{
                 return;
@@ -15,7 +15,12 @@
  */
 
 #include <benchmark/benchmark.h>
+#include <utils/RefBase.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
+#include <algorithm>
+#include <random>
 #include <vector>
 
 void BM_fill_android_vector(benchmark::State& state) {
@@ -50,4 +55,130 @@ void BM_prepend_std_vector(benchmark::State& state) {
 }
 BENCHMARK(BM_prepend_std_vector);
 
+// Growing vectors of types that are not trivially copyable, which are relocated on every
+// reallocation rather than copied.
+void BM_fill_android_vector_string8(benchmark::State& state) {
+    android::String8 s("android.os.IServiceManager");
+    while (state.KeepRunning()) {
+        android::Vector<android::String8> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.push(s);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_fill_android_vector_string8)->Arg(16)->Arg(1024);
+
+class Stub : public android::RefBase {};
+
+void BM_fill_android_vector_sp(benchmark::State& state) {
+    android::sp<Stub> p = android::sp<Stub>::make();
+    while (state.KeepRunning()) {
+        android::Vector<android::sp<Stub>> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.push(p);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_fill_android_vector_sp)->Arg(16)->Arg(1024);
+
+void BM_fill_std_vector_sp(benchmark::State& state) {
+    android::sp<Stub> p = android::sp<Stub>::make();
+    while (state.KeepRunning()) {
+        std::vector<android::sp<Stub>> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.push_back(p);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_fill_std_vector_sp)->Arg(16)->Arg(1024);
+
+void BM_insert_middle_android_vector(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        android::Vector<int> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.insertAt(i, v.size() / 2);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_insert_middle_android_vector)->Arg(16)->Arg(1024);
+
+void BM_insert_middle_std_vector(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        std::vector<int> v;
+        for (int i = 0; i < state.range(0); i++) {
+            v.insert(v.begin() + v.size() / 2, i);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_insert_middle_std_vector)->Arg(16)->Arg(1024);
+
+// Removing from the front makes the vector shrink, and so reallocate, as it empties.
+void BM_remove_front_android_vector_string8(benchmark::State& state) {
+    android::String8 s("android.os.IServiceManager");
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        android::Vector<android::String8> v;
+        v.insertAt(s, 0, state.range(0));
+        state.ResumeTiming();
+        while (!v.isEmpty()) {
+            v.removeAt(0);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_remove_front_android_vector_string8)->Arg(16)->Arg(1024);
+
+static std::vector<int> randomInts(size_t count) {
+    std::mt19937 rng;
+    std::vector<int> values(count);
+    std::generate(values.begin(), values.end(), rng);
+    return values;
+}
+
+static int compareInts(const int* lhs, const int* rhs) {
+    return *lhs < *rhs ? -1 : *lhs > *rhs;
+}
+
+void BM_sort_android_vector(benchmark::State& state) {
+    const std::vector<int> values = randomInts(state.range(0));
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        android::Vector<int> v;
+        v.appendArray(values.data(), values.size());
+        state.ResumeTiming();
+        v.sort(compareInts);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_sort_android_vector)->Arg(16)->Arg(1024);
+
+void BM_sort_std_vector(benchmark::State& state) {
+    const std::vector<int> values = randomInts(state.range(0));
+    while (state.KeepRunning()) {
+        state.PauseTiming();
+        std::vector<int> v = values;
+        state.ResumeTiming();
+        std::stable_sort(v.begin(), v.end());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_sort_std_vector)->Arg(16)->Arg(1024);
+
+void BM_add_android_sorted_vector(benchmark::State& state) {
+    const std::vector<int> values = randomInts(state.range(0));
+    while (state.KeepRunning()) {
+        android::SortedVector<int> v;
+        for (int value : values) {
+            v.add(value);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_add_android_sorted_vector)->Arg(16)->Arg(1024);
+
 BENCHMARK_MAIN();
@@ -393,7 +393,8 @@ private:
     static void renameRefId(RefBase* ref,
             const void* old_id, const void* new_id);
 
-        weakref_impl* const mRefs;
+        // Holds the strong count until the weakref_impl is needed; see RefBase.cpp.
+        mutable weakref_impl* mRefs;
 };
 
 // ---------------------------------------------------------------------------
@@ -528,11 +529,11 @@ private:
 // 3) *m_ptr is no longer live, and m_refs points to the weakref_type object that corresponded
 //    to m_ptr while it was live. *m_refs remains live while a wp<> refers to it.
 //
-// The m_refs field in a RefBase object is allocated on construction, unique to that RefBase
-// object, and never changes. Thus if two wp's have identical m_refs fields, they are either both
-// null or point to the same object. If two wp's have identical m_ptr fields, they either both
-// point to the same live object and thus have the same m_ref fields, or at least one of the
-// objects is no longer live.
+// The m_refs field in a RefBase object is allocated no later than its first weak reference, is
+// unique to that RefBase object, and never changes after that. Thus if two wp's have identical
+// m_refs fields, they are either both null or point to the same object. If two wp's have
+// identical m_ptr fields, they either both point to the same live object and thus have the same
+// m_ref fields, or at least one of the objects is no longer live.
 //
 // Note that the above comparison operations go out of their way to provide an ordering consistent
 // with ordinary pointer comparison; otherwise they could ignore m_ptr, and just compare m_refs.
@@ -17,6 +17,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <android/log.h>
 #include <utils/String8.h>
@@ -55,12 +56,29 @@ public:
     ~CallStack();
 
     // Reset the stack frames (same as creating an empty call stack).
-    void clear() { mFrameLines.clear(); }
+    void clear() {
+        mFrameLines.clear();
+        mRawPcCount = 0;
+        mRawPending = false;
+    }
 
     // Immediately collect the stack traces for the specified thread.
     // The default is to dump the stack of the current call.
     void update(int32_t ignoreDepth = 1, pid_t tid = -1);
 
+    // Allocate room for updateRaw() to record up to maxFrames frames.
+    void reserveRaw(size_t maxFrames);
+
+    // Record only the program counters of the current thread's stack, into
+    // the buffer set up by reserveRaw() (64 frames if it wasn't called).
+    // The frames are symbolized the first time the stack is printed, and
+    // symbolized frames are cached for all CallStacks of the process, so
+    // this is much cheaper than update() for stacks that are rarely printed.
+    //
+    // Once the buffer is reserved this doesn't allocate or read any files,
+    // so it can also be used where update() can't, such as signal handlers.
+    void updateRaw(int32_t ignoreDepth = 1);
+
     // Dump a stack trace to the log using the supplied logtag.
     void log(const char* logtag,
              android_LogPriority priority = ANDROID_LOG_DEBUG,
@@ -76,7 +94,7 @@ public:
     void print(Printer& printer) const;
 
     // Get the count of stack frames that are in this call stack.
-    size_t size() const { return mFrameLines.size(); }
+    size_t size() const { return mRawPending ? mRawPcCount : mFrameLines.size(); }
 
     // DO NOT USE ANYTHING BELOW HERE. The following public members are expected
     // to disappear again shortly, once a better replacement facility exists.
@@ -163,7 +181,17 @@ public:
     static void CALLSTACK_WEAK deleteStack(CallStack* stack);
 #endif // CALLSTACK_WEAKS_AVAILABLE
 
-    Vector<String8> mFrameLines;
+    // Fills mFrameLines from mRawPcs, as printing needs it.
+    void symbolizeRaw() const;
+
+    // Printing a stack captured by updateRaw() fills this in, so printing
+    // the same CallStack from several threads at once isn't safe.
+    mutable Vector<String8> mFrameLines;
+
+    std::vector<uint64_t> mRawPcs;
+    size_t mRawPcCount = 0;
+    // Whether mFrameLines still has to be filled in from mRawPcs.
+    mutable bool mRawPending = false;
 };
 
 }  // namespace android
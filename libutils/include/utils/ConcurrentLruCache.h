@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <log/log.h>
+
+#include "utils/LruCache.h"  // OnEntryRemoved
+#include "utils/TypeHelpers.h"  // hash_type
+
+namespace android {
+
+/**
+ * Default hash for ConcurrentLruCache keys. Uses hash_type(), like LruCache, except for
+ * std::string keys which are hashed as std::string_view, so that they can be looked up by
+ * std::string_view or const char* without constructing a std::string.
+ */
+template <typename TKey>
+struct ConcurrentLruCacheHash {
+    size_t operator()(const TKey& key) const { return hash_type(key); }
+};
+
+template <>
+struct ConcurrentLruCacheHash<std::string> {
+    size_t operator()(std::string_view key) const { return std::hash<std::string_view>()(key); }
+};
+
+/**
+ * A thread-safe cache with a fixed capacity, holding at most maxCapacity entries.
+ *
+ * Entries are spread over independently locked shards by key hash, and each shard keeps its
+ * entries in a node pool allocated up front, so put() never allocates. Since each shard gets an
+ * equal share of the capacity, an entry may be evicted a little before the cache as a whole is
+ * full.
+ *
+ * get() and remove() accept any key type that THash can hash and TEqual can compare with TKey,
+ * e.g. std::string_view for std::string keys.
+ *
+ * get() returns a copy of the value, since another thread may evict the entry as soon as the
+ * shard lock is released.
+ */
+template <typename TKey, typename TValue, typename THash = ConcurrentLruCacheHash<TKey>,
+          typename TEqual = std::equal_to<>>
+class ConcurrentLruCache {
+  public:
+    enum class Policy {
+        // Evicts the least recently used entry of the shard. get() moves the entry it finds to
+        // the young end, and so takes the shard lock exclusively.
+        kLru,
+        // Approximates LRU with the CLOCK algorithm. get() only marks the entry as referenced,
+        // and lookups in the same shard run concurrently under a shared lock.
+        kClock,
+    };
+
+    static constexpr size_t kDefaultShardCount = 16;
+
+    // shardCount is rounded down to a power of two, and to no more than maxCapacity.
+    explicit ConcurrentLruCache(uint32_t maxCapacity, Policy policy = Policy::kLru,
+                                size_t shardCount = kDefaultShardCount);
+    ~ConcurrentLruCache();
+
+    ConcurrentLruCache(const ConcurrentLruCache&) = delete;
+    ConcurrentLruCache& operator=(const ConcurrentLruCache&) = delete;
+
+    // Must be set before the cache is shared between threads. The listener is called with the
+    // shard lock held, so it must not call back into the cache.
+    void setOnEntryRemovedListener(OnEntryRemoved<TKey, TValue>* listener);
+
+    size_t size() const;
+    template <typename K>
+    std::optional<TValue> get(const K& key);
+    // Returns false, leaving the current value in place, if key is already in the cache.
+    bool put(const TKey& key, const TValue& value);
+    template <typename K>
+    bool remove(const K& key);
+    void clear();
+
+    // Calls fn(key, value) for every entry, one shard at a time, with that shard locked. fn must
+    // not call back into the cache.
+    template <typename F>
+    void forEach(F&& fn) const;
+
+  private:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    struct Node {
+        // Empty while the node is unused.
+        std::optional<std::pair<TKey, TValue>> entry;
+        size_t hash = 0;
+        // Next node in the same bucket or, for unused nodes, in the free list.
+        uint32_t next = kNone;
+        // Neighbours in the shard's LRU list. Unused by Policy::kClock.
+        uint32_t older = kNone;
+        uint32_t younger = kNone;
+        // Set by get() with Policy::kClock, cleared as the clock hand passes.
+        std::atomic<bool> referenced = false;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::shared_mutex lock;
+        std::unique_ptr<Node[]> nodes;
+        std::unique_ptr<uint32_t[]> buckets;
+        uint32_t capacity = 0;
+        uint32_t bucketMask = 0;
+        uint32_t freeList = kNone;
+        uint32_t oldest = kNone;
+        uint32_t youngest = kNone;
+        uint32_t clockHand = 0;
+        std::atomic<uint32_t> size = 0;
+    };
+
+    Shard& shardFor(size_t hash) const {
+        // Use the high bits for the shard, leaving the low ones to pick the bucket.
+        const uint64_t mixed = static_cast<uint64_t>(hash) * 0x9e3779b97f4a7c15ull;
+        return mShards[static_cast<uint32_t>(mixed >> 32) & mShardMask];
+    }
+
+    template <typename K>
+    uint32_t find(const Shard& shard, size_t hash, const K& key) const;
+    void attachYoungest(Shard& shard, uint32_t index);
+    void detach(Shard& shard, uint32_t index);
+    uint32_t pickVictim(Shard& shard);
+    void removeNode(Shard& shard, uint32_t index);
+    void resetShard(Shard& shard);
+
+    const Policy mPolicy;
+    uint32_t mShardMask;
+    std::unique_ptr<Shard[]> mShards;
+    OnEntryRemoved<TKey, TValue>* mListener;
+    [[no_unique_address]] THash mHash;
+    [[no_unique_address]] TEqual mEqual;
+};
+
+// Implementation is here, because it's fully templated
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+ConcurrentLruCache<TKey, TValue, THash, TEqual>::ConcurrentLruCache(uint32_t maxCapacity,
+                                                                    Policy policy,
+                                                                    size_t shardCount)
+    : mPolicy(policy), mListener(nullptr) {
+    LOG_ALWAYS_FATAL_IF(maxCapacity == 0, "ConcurrentLruCache needs a non-zero capacity");
+    uint32_t shards = 1;
+    while (shards * 2 <= shardCount && shards * 2 <= maxCapacity) {
+        shards *= 2;
+    }
+    mShardMask = shards - 1;
+    mShards.reset(new Shard[shards]);
+
+    // Round down, so that the cache never holds more than maxCapacity entries.
+    const uint32_t shardCapacity = maxCapacity / shards;
+    uint32_t bucketCount = 1;
+    while (bucketCount < shardCapacity) {
+        bucketCount *= 2;
+    }
+    for (uint32_t i = 0; i < shards; i++) {
+        Shard& shard = mShards[i];
+        shard.capacity = shardCapacity;
+        shard.bucketMask = bucketCount - 1;
+        shard.nodes.reset(new Node[shardCapacity]);
+        shard.buckets.reset(new uint32_t[bucketCount]);
+        resetShard(shard);
+    }
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+ConcurrentLruCache<TKey, TValue, THash, TEqual>::~ConcurrentLruCache() {
+    clear();
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+void ConcurrentLruCache<TKey, TValue, THash, TEqual>::setOnEntryRemovedListener(
+        OnEntryRemoved<TKey, TValue>* listener) {
+    mListener = listener;
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+size_t ConcurrentLruCache<TKey, TValue, THash, TEqual>::size() const {
+    size_t size = 0;
+    for (uint32_t i = 0; i <= mShardMask; i++) {
+        size += mShards[i].size.load(std::memory_order_relaxed);
+    }
+    return size;
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+template <typename K>
+std::optional<TValue> ConcurrentLruCache<TKey, TValue, THash, TEqual>::get(const K& key) {
+    const size_t hash = mHash(key);
+    Shard& shard = shardFor(hash);
+    if (mPolicy == Policy::kClock) {
+        std::shared_lock lock(shard.lock);
+        const uint32_t index = find(shard, hash, key);
+        if (index == kNone) {
+            return std::nullopt;
+        }
+        Node& node = shard.nodes[index];
+        // Avoid dirtying the cache line if the entry is already marked.
+        if (!node.referenced.load(std::memory_order_relaxed)) {
+            node.referenced.store(true, std::memory_order_relaxed);
+        }
+        return node.entry->second;
+    }
+
+    std::lock_guard lock(shard.lock);
+    const uint32_t index = find(shard, hash, key);
+    if (index == kNone) {
+        return std::nullopt;
+    }
+    if (index != shard.youngest) {
+        detach(shard, index);
+        attachYoungest(shard, index);
+    }
+    return shard.nodes[index].entry->second;
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+bool ConcurrentLruCache<TKey, TValue, THash, TEqual>::put(const TKey& key, const TValue& value) {
+    const size_t hash = mHash(key);
+    Shard& shard = shardFor(hash);
+    std::lock_guard lock(shard.lock);
+    if (find(shard, hash, key) != kNone) {
+        return false;
+    }
+    if (shard.freeList == kNone) {
+        removeNode(shard, pickVictim(shard));
+    }
+
+    const uint32_t index = shard.freeList;
+    Node& node = shard.nodes[index];
+    shard.freeList = node.next;
+    node.entry.emplace(key, value);
+    node.hash = hash;
+    node.referenced.store(false, std::memory_order_relaxed);
+    uint32_t& bucket = shard.buckets[hash & shard.bucketMask];
+    node.next = bucket;
+    bucket = index;
+    if (mPolicy == Policy::kLru) {
+        attachYoungest(shard, index);
+    }
+    shard.size.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+template <typename K>
+bool ConcurrentLruCache<TKey, TValue, THash, TEqual>::remove(const K& key) {
+    const size_t hash = mHash(key);
+    Shard& shard = shardFor(hash);
+    std::lock_guard lock(shard.lock);
+    const uint32_t index = find(shard, hash, key);
+    if (index == kNone) {
+        return false;
+    }
+    removeNode(shard, index);
+    return true;
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+void ConcurrentLruCache<TKey, TValue, THash, TEqual>::clear() {
+    for (uint32_t i = 0; i <= mShardMask; i++) {
+        Shard& shard = mShards[i];
+        std::lock_guard lock(shard.lock);
+        for (uint32_t j = 0; j < shard.capacity; j++) {
+            Node& node = shard.nodes[j];
+            if (node.entry) {
+                if (mListener) {
+                    (*mListener)(node.entry->first, node.entry->second);
+                }
+                node.entry.reset();
+            }
+        }
+        resetShard(shard);
+    }
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+template <typename F>
+void ConcurrentLruCache<TKey, TValue, THash, TEqual>::forEach(F&& fn) const {
+    for (uint32_t i = 0; i <= mShardMask; i++) {
+        const Shard& shard = mShards[i];
+        std::shared_lock lock(shard.lock);
+        for (uint32_t j = 0; j < shard.capacity; j++) {
+            const Node& node = shard.nodes[j];
+            if (node.entry) {
+                fn(node.entry->first, node.entry->second);
+            }
+        }
+    }
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+template <typename K>
+uint32_t ConcurrentLruCache<TKey, TValue, THash, TEqual>::find(const Shard& shard, size_t hash,
+                                                               const K& key) const {
+    for (uint32_t index = shard.buckets[hash & shard.bucketMask]; index != kNone;) {
+        const Node& node = shard.nodes[index];
+        if (node.hash == hash && mEqual(key, node.entry->first)) {
+            return index;
+        }
+        index = node.next;
+    }
+    return kNone;
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+void ConcurrentLruCache<TKey, TValue, THash, TEqual>::attachYoungest(Shard& shard,
+                                                                     uint32_t index) {
+    Node& node = shard.nodes[index];
+    node.older = shard.youngest;
+    node.younger = kNone;
+    if (shard.youngest == kNone) {
+        shard.oldest = index;
+    } else {
+        shard.nodes[shard.youngest].younger = index;
+    }
+    shard.youngest = index;
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+void ConcurrentLruCache<TKey, TValue, THash, TEqual>::detach(Shard& shard, uint32_t index) {
+    Node& node = shard.nodes[index];
+    if (node.older != kNone) {
+        shard.nodes[node.older].younger = node.younger;
+    } else {
+        shard.oldest = node.younger;
+    }
+    if (node.younger != kNone) {
+        shard.nodes[node.younger].older = node.older;
+    } else {
+        shard.youngest = node.older;
+    }
+    node.older = kNone;
+    node.younger = kNone;
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+uint32_t ConcurrentLruCache<TKey, TValue, THash, TEqual>::pickVictim(Shard& shard) {
+    if (mPolicy == Policy::kLru) {
+        return shard.oldest;
+    }
+    // Only called when the shard is full, so this stops within two turns of the hand.
+    while (true) {
+        const uint32_t index = shard.clockHand;
+        shard.clockHand = (index + 1) % shard.capacity;
+        if (!shard.nodes[index].referenced.exchange(false, std::memory_order_relaxed)) {
+            return index;
+        }
+    }
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+void ConcurrentLruCache<TKey, TValue, THash, TEqual>::removeNode(Shard& shard, uint32_t index) {
+    Node& node = shard.nodes[index];
+    uint32_t* link = &shard.buckets[node.hash & shard.bucketMask];
+    while (*link != index) {
+        link = &shard.nodes[*link].next;
+    }
+    *link = node.next;
+    if (mPolicy == Policy::kLru) {
+        detach(shard, index);
+    }
+    if (mListener) {
+        (*mListener)(node.entry->first, node.entry->second);
+    }
+    node.entry.reset();
+    node.next = shard.freeList;
+    shard.freeList = index;
+    shard.size.fetch_sub(1, std::memory_order_relaxed);
+}
+
+template <typename TKey, typename TValue, typename THash, typename TEqual>
+void ConcurrentLruCache<TKey, TValue, THash, TEqual>::resetShard(Shard& shard) {
+    for (uint32_t i = 0; i <= shard.bucketMask; i++) {
+        shard.buckets[i] = kNone;
+    }
+    for (uint32_t i = 0; i < shard.capacity; i++) {
+        shard.nodes[i].next = i + 1 < shard.capacity ? i + 1 : kNone;
+    }
+    shard.freeList = 0;
+    shard.oldest = kNone;
+    shard.youngest = kNone;
+    shard.clockHand = 0;
+    shard.size.store(0, std::memory_order_relaxed);
+}
+
+}  // namespace android
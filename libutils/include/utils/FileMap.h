@@ -66,6 +66,29 @@ public:
     bool create(const char* origFileName, int fd,
                 off64_t offset, size_t length, bool readOnly);
 
+    /*
+     * Flags for create(), to be or'ed together.
+     *
+     * POPULATE faults the whole mapping in up front (MAP_POPULATE) rather
+     * than one page at a time as it is touched.
+     *
+     * HUGEPAGE places the mapping so that it can be backed by transparent
+     * huge pages and asks for them (MADV_HUGEPAGE).  For file mappings the
+     * kernel only provides them where the file system supports it, and
+     * otherwise ignores the advice.
+     */
+    enum CreateFlags {
+        POPULATE = 1 << 0,
+        HUGEPAGE = 1 << 1,
+    };
+
+    /*
+     * Same as above, with a combination of CreateFlags.  Flags that aren't
+     * supported on this platform are ignored.
+     */
+    bool create(const char* origFileName, int fd,
+                off64_t offset, size_t length, bool readOnly, int flags);
+
     ~FileMap(void);
 
     /*
@@ -103,6 +126,24 @@ public:
      */
     int advise(MapAdvice advice);
 
+    /*
+     * Start reading in the pages that hold [offset, offset + length) of the
+     * requested data, without waiting for them.  The range is clipped to the
+     * data.
+     *
+     * Returns 0 on success, -1 on failure.
+     */
+    int prefetch(size_t offset, size_t length);
+
+    /*
+     * Return how many bytes of the requested data are in pages that are
+     * resident in memory, as reported by mincore().  Together with
+     * prefetch() this lets callers decide how much to read ahead.
+     *
+     * Returns -1 on failure.
+     */
+    ssize_t getResidentLength(void) const;
+
 protected:
 
 private:
@@ -453,14 +453,15 @@ private:
     };
 
     struct MessageEnvelope {
-        MessageEnvelope() : uptime(0) { }
+        MessageEnvelope() : uptime(0), seq(0) { }
 
-        MessageEnvelope(nsecs_t u, sp<MessageHandler> h, const Message& m)
-            : uptime(u), handler(std::move(h)), message(m) {}
+        MessageEnvelope(nsecs_t u, sp<MessageHandler> h, const Message& m, uint32_t s)
+            : uptime(u), handler(std::move(h)), message(m), seq(s) {}
 
         nsecs_t uptime;
         sp<MessageHandler> handler;
         Message message;
+        uint32_t seq; // orders envelopes with the same uptime by when they were sent
     };
 
     const bool mAllowNonCallbacks; // immutable
@@ -468,6 +469,7 @@ private:
     android::base::unique_fd mWakeEventFd;  // immutable
     Mutex mLock;
 
+    // Binary min-heap ordered by (uptime, seq), so the next message is always at index 0.
     Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
     bool mSendingMessage; // guarded by mLock
 
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <utils/AndroidThreads.h>
+#include <utils/ThreadDefs.h>
+
+namespace android {
+
+/**
+ * A fixed set of worker threads running submitted tasks.
+ *
+ * Each worker has its own task queue. Tasks submitted from outside the pool are dealt to the
+ * workers in turn, and tasks submitted by a running task go to the front of its own worker's
+ * queue. Workers take tasks from the front of their own queue, and a worker whose queue is empty
+ * steals from the back of another worker's queue before going to sleep. Tasks submitted with
+ * Priority::kHigh go to a shared queue that every worker checks first.
+ *
+ * The destructor runs all tasks that are still queued before joining the workers.
+ */
+class ThreadPool {
+  public:
+    enum class Priority {
+        kNormal,
+        // Runs ahead of all normal priority tasks that haven't started yet.
+        kHigh,
+    };
+
+    struct Options {
+        // Number of workers. 0 means one per CPU.
+        size_t threadCount = 0;
+        // Workers are named "<name>:<index>", truncated to what the kernel keeps.
+        const char* name = "ThreadPool";
+        // Nice value of the workers, see androidSetThreadPriority(). Only applied on Android.
+        int32_t priority = PRIORITY_DEFAULT;
+        // Called on each worker before it runs any task, e.g. to apply task profiles with
+        // SetTaskProfiles(0, {...}) from libprocessgroup.
+        std::function<void(size_t index)> onWorkerStart;
+    };
+
+    explicit ThreadPool(size_t threadCount) : ThreadPool(optionsWithThreadCount(threadCount)) {}
+
+    explicit ThreadPool(Options options) {
+        size_t count = options.threadCount;
+        if (count == 0) count = std::max(1u, std::thread::hardware_concurrency());
+        mWorkers.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            mWorkers.push_back(std::make_unique<Worker>());
+        }
+        for (size_t i = 0; i < count; i++) {
+            mWorkers[i]->thread = std::thread(&ThreadPool::workerLoop, this, i, options);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            mStopping = true;
+        }
+        mWakeCondition.notify_all();
+        for (auto& worker : mWorkers) {
+            worker->thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t threadCount() const { return mWorkers.size(); }
+
+    /**
+     * Queues task to run on one of the workers.
+     */
+    void post(std::function<void()> task, Priority priority = Priority::kNormal) {
+        // Count the task before queueing it, so that a worker taking it right away can't make
+        // the counts wrap.
+        mOutstanding.fetch_add(1, std::memory_order_relaxed);
+        mPending.fetch_add(1);
+        if (priority == Priority::kHigh) {
+            std::lock_guard<std::mutex> lock(mHighPriorityMutex);
+            mHighPriorityTasks.push_back(std::move(task));
+        } else if (sCurrentPool == this) {
+            Worker& worker = *mWorkers[sCurrentIndex];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_front(std::move(task));
+        } else {
+            size_t index = mNextWorker.fetch_add(1, std::memory_order_relaxed) % mWorkers.size();
+            Worker& worker = *mWorkers[index];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+        if (mSleeping.load() > 0) {
+            // Taking the lock makes sure a worker that just found nothing to do is waiting.
+            { std::lock_guard<std::mutex> lock(mSleepMutex); }
+            mWakeCondition.notify_one();
+        }
+    }
+
+    /**
+     * Queues f to run on one of the workers, and returns a future for its result.
+     */
+    template <typename F>
+    auto submit(F&& f, Priority priority = Priority::kNormal)
+            -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        // std::function needs a copyable target, and std::packaged_task isn't one.
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        post([task] { (*task)(); }, priority);
+        return result;
+    }
+
+    /**
+     * Waits until every task posted so far, and every task those post, has run. Must not be
+     * called from a worker.
+     */
+    void waitIdle() {
+        std::unique_lock<std::mutex> lock(mIdleMutex);
+        mIdleCondition.wait(lock, [this] { return mOutstanding.load() == 0; });
+    }
+
+    /**
+     * Returns the pool whose worker is running the calling thread, or nullptr.
+     */
+    static ThreadPool* current() { return sCurrentPool; }
+
+  private:
+    static Options optionsWithThreadCount(size_t threadCount) {
+        Options options;
+        options.threadCount = threadCount;
+        return options;
+    }
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    void workerLoop(size_t index, const Options& options) {
+        char name[16];
+        snprintf(name, sizeof(name), "%s:%zu", options.name, index);
+#if defined(__linux__)
+        pthread_setname_np(pthread_self(), name);
+#elif defined(__APPLE__)
+        pthread_setname_np(name);
+#endif
+#if defined(__ANDROID__)
+        if (options.priority != PRIORITY_DEFAULT) androidSetThreadPriority(0, options.priority);
+#endif
+        if (options.onWorkerStart) options.onWorkerStart(index);
+
+        sCurrentPool = this;
+        sCurrentIndex = index;
+        std::function<void()> task;
+        while (true) {
+            if (takeTask(index, &task)) {
+                task();
+                task = nullptr;
+                if (mOutstanding.fetch_sub(1) == 1) {
+                    { std::lock_guard<std::mutex> lock(mIdleMutex); }
+                    mIdleCondition.notify_all();
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mSleepMutex);
+            mSleeping.fetch_add(1);
+            mWakeCondition.wait(lock, [this] { return mPending.load() > 0 || mStopping; });
+            mSleeping.fetch_sub(1);
+            if (mPending.load() == 0 && mStopping) break;
+        }
+        sCurrentPool = nullptr;
+    }
+
+    bool takeTask(size_t index, std::function<void()>* task) {
+        if (mPending.load(std::memory_order_relaxed) == 0) return false;
+        {
+            std::lock_guard<std::mutex> lock(mHighPriorityMutex);
+            if (!mHighPriorityTasks.empty()) {
+                *task = std::move(mHighPriorityTasks.front());
+                mHighPriorityTasks.pop_front();
+                mPending.fetch_sub(1);
+                return true;
+            }
+        }
+        // Our own queue first, then the other workers' in turn.
+        for (size_t i = 0; i < mWorkers.size(); i++) {
+            Worker& worker = *mWorkers[(index + i) % mWorkers.size()];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.tasks.empty()) continue;
+            if (i == 0) {
+                *task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+            } else {
+                *task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+            }
+            mPending.fetch_sub(1);
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+
+    std::mutex mHighPriorityMutex;
+    std::deque<std::function<void()>> mHighPriorityTasks;
+
+    std::atomic<size_t> mNextWorker = 0;
+    // Tasks queued but not started, used to wake and park workers.
+    std::atomic<size_t> mPending = 0;
+    // Tasks queued or running, used by waitIdle().
+    std::atomic<size_t> mOutstanding = 0;
+    std::atomic<size_t> mSleeping = 0;
+
+    std::mutex mSleepMutex;
+    std::condition_variable mWakeCondition;
+    bool mStopping = false;
+
+    std::mutex mIdleMutex;
+    std::condition_variable mIdleCondition;
+
+    static inline thread_local ThreadPool* sCurrentPool = nullptr;
+    static inline thread_local size_t sCurrentIndex = 0;
+};
+
+}  // namespace android
@@ -18,6 +18,10 @@
 #define _UTILS_TOKENIZER_H
 
 #include <assert.h>
+#include <string.h>
+
+#include <string_view>
+
 #include <utils/Errors.h>
 #include <utils/FileMap.h>
 #include <utils/String8.h>
@@ -88,6 +92,16 @@ public:
      */
     String8 peekRemainderOfLine() const;
 
+    /**
+     * Same as peekRemainderOfLine(), but the result points into the tokenizer's buffer
+     * and is valid as long as the tokenizer is.
+     */
+    inline std::string_view peekRemainderOfLineView() const {
+        const char* end = getEnd();
+        const void* eol = mCurrent != end ? memchr(mCurrent, '\n', end - mCurrent) : nullptr;
+        return std::string_view(mCurrent, (eol ? static_cast<const char*>(eol) : end) - mCurrent);
+    }
+
     /**
      * Gets the character at the current position and advances past it.
      * Returns null at end of file.
@@ -103,12 +117,55 @@ public:
      */
     String8 nextToken(const char* delimiters);
 
+    /**
+     * Same as nextToken(), but the result points into the tokenizer's buffer
+     * and is valid as long as the tokenizer is.
+     */
+    inline std::string_view nextTokenView(const char* delimiters) {
+        const char* end = getEnd();
+        const char* tokenStart = mCurrent;
+        while (mCurrent != end) {
+            char ch = *mCurrent;
+            if (ch == '\n' || strchr(delimiters, ch) != nullptr) {
+                break;
+            }
+            mCurrent += 1;
+        }
+        return std::string_view(tokenStart, mCurrent - tokenStart);
+    }
+
     /**
      * Advances to the next line.
      * Does nothing if already at the end of the file.
      */
     void nextLine();
 
+    /**
+     * Gets up to maxLines lines starting at the current position, excluding their
+     * newline characters, and advances to the line after the last of them. The first
+     * line is the remainder of the current one. The results point into the tokenizer's
+     * buffer and are valid as long as the tokenizer is.
+     *
+     * Returns the number of lines stored in outLines, which is only 0 at the end of the
+     * file.
+     */
+    inline size_t nextLines(std::string_view* outLines, size_t maxLines) {
+        const char* end = getEnd();
+        size_t count = 0;
+        while (count < maxLines && mCurrent != end) {
+            const void* eol = memchr(mCurrent, '\n', end - mCurrent);
+            const char* lineEnd = eol ? static_cast<const char*>(eol) : end;
+            outLines[count++] = std::string_view(mCurrent, lineEnd - mCurrent);
+            if (eol) {
+                mLineNumber += 1;
+                mCurrent = lineEnd + 1;
+            } else {
+                mCurrent = end;
+            }
+        }
+        return count;
+    }
+
     /**
      * Skips over the specified delimiters in the line.
      * Also skips embedded nulls.
@@ -16,6 +16,8 @@
 #ifndef VNDKSUPPORT_LINKER_H_
 #define VNDKSUPPORT_LINKER_H_
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,6 +29,15 @@ void* android_load_sphal_library(const char* name, int flag);
 
 int android_unload_sphal_library(void* handle);
 
+/*
+ * Loads the SP-HAL libraries in |names| concurrently, so that later
+ * android_load_sphal_library() calls for them with the same |flag| return
+ * at once. Preloaded libraries stay loaded for the life of the process.
+ * Intended for zygote and HAL startup. Returns the number of libraries
+ * which were loaded.
+ */
+int android_preload_sphal_libraries(const char* const* names, size_t count, int flag);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,7 +24,16 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <initializer_list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 extern "C" android_namespace_t* android_get_exported_namespace(const char*);
 
@@ -61,7 +70,7 @@ int android_is_in_vendor_process() {
     return android_get_exported_namespace("vndk") == nullptr;
 }
 
-void* android_load_sphal_library(const char* name, int flag) {
+static void* load_sphal_library(const char* name, int flag) {
     VendorNamespace vendor_namespace = get_vendor_namespace();
     if (vendor_namespace.ptr != nullptr) {
         const android_dlextinfo dlextinfo = {
@@ -80,6 +89,107 @@ void* android_load_sphal_library(const char* name, int flag) {
     }
 }
 
+namespace {
+
+// Handles of loaded SP-HAL libraries. Each holds a single reference on the
+// library from dlopen(); repeated loads only bump |refs|, and the library is
+// closed when the last reference is dropped.
+class SphalCache {
+  public:
+    static SphalCache& Get() {
+        static SphalCache* instance = new SphalCache();
+        return *instance;
+    }
+
+    void* Load(const char* name, int flag) {
+        const auto key = std::make_pair(std::string(name), flag);
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (auto it = handles_.find(key); it != handles_.end()) {
+                refs_[it->second]++;
+                return it->second;
+            }
+        }
+
+        // Load without the lock held, so that libraries can be loaded
+        // concurrently.
+        void* handle = load_sphal_library(name, flag);
+        if (!handle) {
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> lock(lock_);
+        auto [it, inserted] = handles_.emplace(key, handle);
+        if (!inserted || refs_.count(handle)) {
+            // Another thread loaded it first, or it was loaded with other
+            // flags. dlopen() returns the same handle, so drop the extra
+            // reference it took.
+            dlclose(handle);
+        }
+        refs_[it->second]++;
+        return it->second;
+    }
+
+    // Returns false if |handle| is unknown.
+    bool Unload(void* handle, int* result) {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto ref = refs_.find(handle);
+        if (ref == refs_.end()) {
+            return false;
+        }
+        *result = 0;
+        if (--ref->second == 0) {
+            refs_.erase(ref);
+            for (auto it = handles_.begin(); it != handles_.end();) {
+                it = (it->second == handle) ? handles_.erase(it) : std::next(it);
+            }
+            *result = dlclose(handle);
+        }
+        return true;
+    }
+
+  private:
+    std::mutex lock_;
+    std::map<std::pair<std::string, int>, void*> handles_;
+    std::unordered_map<void*, size_t> refs_;
+};
+
+}  // anonymous namespace
+
+void* android_load_sphal_library(const char* name, int flag) {
+    return SphalCache::Get().Load(name, flag);
+}
+
 int android_unload_sphal_library(void* handle) {
+    int result;
+    if (SphalCache::Get().Unload(handle, &result)) {
+        return result;
+    }
     return dlclose(handle);
 }
+
+int android_preload_sphal_libraries(const char* const* names, size_t count, int flag) {
+    // Loading is mostly I/O and relocation, so a few threads suffice.
+    static constexpr size_t kMaxThreads = 4;
+
+    std::atomic<size_t> next = 0;
+    std::atomic<int> loaded = 0;
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            // The reference taken here is never dropped.
+            if (SphalCache::Get().Load(names[i], flag)) {
+                loaded++;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(count, kMaxThreads); i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return loaded;
+}
@@ -53,3 +53,16 @@ TEST(linker, load_nonexisting_lib) {
     void* handle = android_load_sphal_library("libNeverUseThisName.so", RTLD_NOW | RTLD_LOCAL);
     ASSERT_EQ(nullptr, handle);
 }
+
+TEST(linker, preload_lib) {
+    std::string name = find_sphal_lib();
+    ASSERT_NE("", name);
+    const char* names[] = {name.c_str(), "libNeverUseThisName.so"};
+    ASSERT_EQ(1, android_preload_sphal_libraries(names, 2, RTLD_NOW | RTLD_LOCAL));
+
+    void* handle = android_load_sphal_library(name.c_str(), RTLD_NOW | RTLD_LOCAL);
+    ASSERT_NE(nullptr, handle);
+    ASSERT_EQ(handle, android_load_sphal_library(name.c_str(), RTLD_NOW | RTLD_LOCAL));
+    ASSERT_EQ(0, android_unload_sphal_library(handle));
+    ASSERT_EQ(0, android_unload_sphal_library(handle));
+}
@@ -48,6 +48,7 @@
 #include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 #include <cutils/android_get_control_file.h>
 #include <log/log_main.h>
 
@@ -177,6 +178,8 @@ class dir {
 
     operator bool() const { return fd >= 0; }
 
+    int getFd() const { return fd; }
+
     void reset(void) {
         if (fd >= 0) {
             ::close(fd);
@@ -233,6 +236,26 @@ std::string ReadFile(std::string&& path) {
     return content;
 }
 
+// Reads a file small enough to fit in buf, relative to dirfd, without the
+// fstat and allocations of ReadFile; used for the per-task reads of every
+// sample.  buf is always nul terminated, false if nothing could be read.
+bool ReadSmallFileAt(int dirfd, const std::string& path, char* buf, size_t size) {
+    buf[0] = '\0';
+    android::base::unique_fd fd(
+        TEMP_FAILURE_RETRY(::openat(dirfd, path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        PLOG(DEBUG) << "Open " << path << " failed";
+        return false;
+    }
+    auto rc = TEMP_FAILURE_RETRY(::read(fd.get(), buf, size - 1));
+    if (rc <= 0) {
+        PLOG(DEBUG) << "Read " << path << " failed";
+        return false;
+    }
+    buf[rc] = '\0';
+    return true;
+}
+
 std::string llkProcGetName(pid_t tid, const char* node = "/cmdline") {
     std::string content = ReadFile(procdir + std::to_string(tid) + node);
     static constexpr char needles[] = " \t\r\n";  // including trailing nul
@@ -1020,9 +1043,11 @@ milliseconds llkCheck(bool checkRunning) {
                 continue;
             }
 
-            // Get the process stat
-            std::string stat = ReadFile(piddir + "/stat");
-            if (stat.empty()) {
+            // Get the process stat, relative to the directory listing it.
+            // Only the leading fields are needed, so a short read is fine.
+            char stat[1024];
+            if (!ReadSmallFileAt(taskDirectory ? taskDirectory.getFd() : llkTopDirectory.getFd(),
+                                 tp->d_name + "/stat"s, stat, sizeof(stat))) {
                 continue;
             }
             unsigned tid = -1;
@@ -1035,7 +1060,7 @@ milliseconds llkCheck(bool checkRunning) {
             pdir[0] = '\0';
             // tid should not change value
             auto match = ::sscanf(
-                stat.c_str(),
+                stat,
                 "%u (%" ___STRING(
                     TASK_COMM_LEN) "[^)]) %c %u %*d %*d %*d %*d %*d %*d %*d %*d %*d %u %u %d",
                 &tid, pdir, &state, &ppid, &utime, &stime, &dummy);
@@ -1048,9 +1073,17 @@ milliseconds llkCheck(bool checkRunning) {
                 continue;
             }
 
-            // Get the process cgroup
-            auto cgroup = ReadFile(piddir + "/cgroup");
-            auto frozen = cgroup.find(":freezer:/frozen") != std::string::npos;
+            // Get the process cgroup, only needed for the tasks checked below
+#ifdef __PTRACE_ENABLED__
+            auto checked = llkIsMonitorState(state) || !llkCheckStackSymbols.empty();
+#else
+            auto checked = llkIsMonitorState(state);
+#endif
+            auto frozen = false;
+            if (checked) {
+                auto cgroup = ReadFile(piddir + "/cgroup");
+                frozen = cgroup.find(":freezer:/frozen") != std::string::npos;
+            }
 
             auto procp = llkTidLookup(tid);
             if (procp == nullptr) {
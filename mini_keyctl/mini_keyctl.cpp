@@ -25,9 +25,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/parseint.h>
@@ -40,6 +43,7 @@ static void Usage(int exit_code) {
   fprintf(stderr, "usage: mini-keyctl <action> [args,]\n");
   fprintf(stderr, "       mini-keyctl add <type> <desc> <data> <keyring>\n");
   fprintf(stderr, "       mini-keyctl padd <type> <desc> <keyring>\n");
+  fprintf(stderr, "       mini-keyctl add_dir [--restrict] <type> <desc_prefix> <dir> <keyring>\n");
   fprintf(stderr, "       mini-keyctl unlink <key> <keyring>\n");
   fprintf(stderr, "       mini-keyctl restrict_keyring <keyring>\n");
   fprintf(stderr, "       mini-keyctl security <key>\n");
@@ -105,6 +109,63 @@ int Padd(const std::string& type, const std::string& desc, const std::string& ke
   return 0;
 }
 
+// Adds every regular file in |dir| as a key of |type| to |keyring|, described as |desc_prefix|
+// followed by the file name. This does the work of one "padd" per file in a single process,
+// looking the keyring up only once. A file which cannot be added is reported and skipped.
+// If |restrict_keyring| is set, the keyring is restricted afterwards, even if files were skipped.
+int AddDir(const std::string& type, const std::string& desc_prefix, const std::string& dir,
+           const std::string& keyring, bool restrict_keyring) {
+  key_serial_t keyring_id = android::GetKeyringId(keyring);
+  if (keyring_id < 0) {
+    error(1, 0, "Cannot find keyring '%s'", keyring.c_str());
+    return 1;
+  }
+
+  std::unique_ptr<DIR, decltype(&closedir)> d(opendir(dir.c_str()), closedir);
+  if (!d) {
+    error(1, errno, "Cannot open directory '%s'", dir.c_str());
+    return 1;
+  }
+  std::vector<std::string> names;
+  while (struct dirent* entry = readdir(d.get())) {
+    if (entry->d_type == DT_REG) {
+      names.emplace_back(entry->d_name);
+    }
+  }
+  // Load in a stable order, so the resulting key ids do not depend on the directory layout.
+  std::sort(names.begin(), names.end());
+
+  int ret = 0;
+  for (const auto& name : names) {
+    std::string path = dir + "/" + name;
+    std::string data;
+    if (!android::base::ReadFileToString(path, &data)) {
+      error(0, errno, "Failed to read '%s'", path.c_str());
+      ret = 1;
+      continue;
+    }
+    if (data.size() > kMaxCertSize) {
+      error(0, 0, "Certificate too large: '%s'", path.c_str());
+      ret = 1;
+      continue;
+    }
+    std::string desc = desc_prefix + name;
+    key_serial_t key = add_key(type.c_str(), desc.c_str(), data.c_str(), data.size(), keyring_id);
+    if (key < 0) {
+      error(0, errno, "Failed to add key from '%s'", path.c_str());
+      ret = 1;
+      continue;
+    }
+    std::cout << key << " " << name << std::endl;
+  }
+
+  if (restrict_keyring && keyctl_restrict_keyring(keyring_id, nullptr, nullptr) < 0) {
+    error(1, errno, "Cannot restrict keyring '%s'", keyring.c_str());
+    return 1;
+  }
+  return ret;
+}
+
 int RestrictKeyring(const std::string& keyring) {
   key_serial_t keyring_id = android::GetKeyringId(keyring);
   if (keyctl_restrict_keyring(keyring_id, nullptr, nullptr) < 0) {
@@ -149,6 +210,19 @@ int main(int argc, const char** argv) {
     std::string desc = argv[3];
     std::string keyring = argv[4];
     return Padd(type, desc, keyring);
+  } else if (action == "add_dir") {
+    int arg = 2;
+    bool restrict_keyring = false;
+    if (argc > arg && std::string(argv[arg]) == "--restrict") {
+      restrict_keyring = true;
+      arg++;
+    }
+    if (argc != arg + 4) Usage(1);
+    std::string type = argv[arg];
+    std::string desc_prefix = argv[arg + 1];
+    std::string dir = argv[arg + 2];
+    std::string keyring = argv[arg + 3];
+    return AddDir(type, desc_prefix, dir, keyring, restrict_keyring);
   } else if (action == "restrict_keyring") {
     if (argc != 3) Usage(1);
     std::string keyring = argv[2];
@@ -16,27 +16,16 @@
 
 #include <mini_keyctl_utils.h>
 
-#include <fstream>
-#include <iterator>
-#include <sstream>
 #include <string>
 #include <vector>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android-base/strings.h>
 
 namespace android {
 
-namespace {
-
-std::vector<std::string> SplitBySpace(const std::string& s) {
-  std::istringstream iss(s);
-  return std::vector<std::string>{std::istream_iterator<std::string>{iss},
-                                  std::istream_iterator<std::string>{}};
-}
-
-}  // namespace
-
 // Find the keyring id. request_key(2) only finds keys in the process, session or thread keyring
 // hierarchy, but not internal keyring of a kernel subsystem (e.g. .fs-verity). To support all
 // cases, this function looks up a keyring's ID by parsing /proc/keys. The keyring description may
@@ -49,28 +38,28 @@ key_serial_t GetKeyringId(const std::string& keyring_desc) {
     return keyring_id;
   }
 
-  // Only keys allowed by SELinux rules will be shown here.
-  std::ifstream proc_keys_file("/proc/keys");
-  if (!proc_keys_file.is_open()) {
-    PLOG(ERROR) << "Failed to open /proc/keys";
+  // Only keys allowed by SELinux rules will be shown here. /proc/keys is read in one go rather
+  // than through a stream; it is small, and this runs for every key loaded at boot.
+  std::string proc_keys;
+  if (!android::base::ReadFileToString("/proc/keys", &proc_keys)) {
+    PLOG(ERROR) << "Failed to read /proc/keys";
     return -1;
   }
 
-  std::string line;
-  while (getline(proc_keys_file, line)) {
-    std::vector<std::string> tokens = SplitBySpace(line);
+  // The prefix has a ":" at the end
+  const std::string key_desc_pattern = keyring_desc + ":";
+  for (const auto& line : android::base::Split(proc_keys, "\n")) {
+    std::vector<std::string> tokens = android::base::Tokenize(line, " ");
     if (tokens.size() < 9) {
       continue;
     }
-    std::string key_id = "0x" + tokens[0];
-    std::string key_type = tokens[7];
+    const std::string& key_type = tokens[7];
     // The key description may contain space.
-    std::string key_desc_prefix = tokens[8];
-    // The prefix has a ":" at the end
-    std::string key_desc_pattern = keyring_desc + ":";
+    const std::string& key_desc_prefix = tokens[8];
     if (key_type != "keyring" || key_desc_prefix != key_desc_pattern) {
       continue;
     }
+    std::string key_id = "0x" + tokens[0];
     if (!android::base::ParseInt(key_id.c_str(), &keyring_id)) {
       LOG(ERROR) << "Unexpected key format in /proc/keys: " << key_id;
       return -1;
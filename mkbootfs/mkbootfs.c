@@ -5,7 +5,9 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +18,10 @@
 
 #include <linux/kdev_t.h>
 
+#include <lz4.h>
+#include <lz4hc.h>
+#include <zlib.h>
+
 #include <private/android_filesystem_config.h>
 #include <private/fs_config.h>
 
@@ -25,6 +31,13 @@
 **   for an explanation of this file format
 ** - dotfiles are ignored
 ** - directories named 'root' are ignored
+** - the whole tree is collected before anything is written, so that file
+**   contents can be read on several threads (-j) and identical regular files
+**   can be stored once (-D): the first copy carries the data and the others
+**   are cpio hard links to it, which the kernel unpacks with link()
+** - compressed output (-c) is a series of independently compressed 1 MiB
+**   blocks, concatenated gzip members or lz4 legacy frame blocks, both of
+**   which the kernel's initramfs unpacker and the gzip/lz4 tools accept
 */
 
 struct fs_config_entry {
@@ -37,7 +50,20 @@ static const char* target_out_path = NULL;
 
 #define TRAILER "TRAILER!!!"
 
-static int total_size = 0;
+#define OUTPUT_BLOCK_SIZE (1024 * 1024)
+#define LZ4_LEGACY_MAGIC 0x184C2102
+
+enum compression {
+    COMPRESS_NONE,
+    COMPRESS_GZIP,
+    COMPRESS_LZ4,
+};
+
+static enum compression compression = COMPRESS_NONE;
+static int dedup = 0;
+static int jobs = 1;
+
+static size_t total_size = 0;
 
 static void fix_stat(const char *path, struct stat *s)
 {
@@ -75,66 +101,529 @@ static void fix_stat(const char *path, struct stat *s)
     }
 }
 
-static void _eject(struct stat *s, char *out, int olen, char *data, unsigned datasize)
+// One cpio record. The archive is collected up front so that file contents
+// can be read, and compared for -D, before anything is written.
+struct cpio_entry {
+    char* in;   // source of a regular file still to be read, or NULL
+    char* out;  // name in the archive
+    struct stat s;
+    char* data;
+    unsigned datasize;
+    uint64_t hash;
+    int ready;  // data is loaded; guarded by read_lock once readers run
+    int link;   // index of the entry holding the data, or -1
+    unsigned nlink;
+    unsigned ino;
+};
+
+static struct cpio_entry* entries = NULL;
+static int entry_count = 0;
+static int entry_alloc = 0;
+
+static void add_entry(struct stat* s, const char* in, const char* out,
+                      const char* data, unsigned datasize)
+{
+    if (entry_count >= entry_alloc) {
+        entry_alloc = entry_alloc ? entry_alloc * 2 : 256;
+        entries = realloc(entries, entry_alloc * sizeof(struct cpio_entry));
+        if (entries == NULL) {
+            errx(1, "failed to reallocate entries array (size %d)", entry_alloc);
+        }
+    }
+    struct cpio_entry* e = &entries[entry_count++];
+    memset(e, 0, sizeof(*e));
+
+    e->out = strdup(out);
+    if (e->out == NULL) errx(1, "failed to strdup name \"%s\"", out);
+    fix_stat(out, s);
+    e->s = *s;
+    e->datasize = datasize;
+    e->link = -1;
+    e->nlink = 1;
+
+    if (in) {
+        e->in = strdup(in);
+        if (e->in == NULL) errx(1, "failed to strdup name \"%s\"", in);
+    } else {
+        if (datasize) {
+            e->data = malloc(datasize);
+            if (e->data == NULL) errx(1, "cannot allocate %u bytes", datasize);
+            memcpy(e->data, data, datasize);
+        }
+        e->ready = 1;
+    }
+}
+
+static uint64_t hash_data(const char* data, unsigned size)
+{
+    // FNV-1a; equal hashes are confirmed with memcmp() before linking.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned i = 0; i < size; ++i) {
+        hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void read_entry(struct cpio_entry* e)
+{
+    int fd = open(e->in, O_RDONLY);
+    if (fd < 0) err(1, "cannot open '%s' for read", e->in);
+
+    e->data = malloc(e->datasize ? e->datasize : 1);
+    if (e->data == NULL) errx(1, "cannot allocate %u bytes", e->datasize);
+
+    unsigned done = 0;
+    while (done < e->datasize) {
+        ssize_t n = read(fd, e->data + done, e->datasize - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) err(1, "cannot read %u bytes from '%s'", e->datasize, e->in);
+        if (n == 0) errx(1, "'%s' is shorter than %u bytes", e->in, e->datasize);
+        done += n;
+    }
+    close(fd);
+
+    if (dedup) e->hash = hash_data(e->data, e->datasize);
+}
+
+static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t read_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t* read_threads = NULL;
+static int next_read = 0;
+static int next_emit = 0;
+
+static void* read_worker(void* arg)
+{
+    (void)arg;
+    // Without -D, stay a bounded distance ahead of the writer so that only a
+    // window of the tree is held in memory at once.
+    const int read_ahead = jobs * 8;
+
+    pthread_mutex_lock(&read_lock);
+    for (;;) {
+        while (!dedup && next_read < entry_count && next_read - next_emit >= read_ahead) {
+            pthread_cond_wait(&read_cond, &read_lock);
+        }
+        if (next_read >= entry_count) break;
+        struct cpio_entry* e = &entries[next_read++];
+        if (!e->in) continue;
+
+        pthread_mutex_unlock(&read_lock);
+        read_entry(e);
+        pthread_mutex_lock(&read_lock);
+
+        e->ready = 1;
+        pthread_cond_broadcast(&read_cond);
+    }
+    pthread_mutex_unlock(&read_lock);
+    return NULL;
+}
+
+static void start_readers(void)
+{
+    if (jobs <= 1) return;
+
+    read_threads = malloc(jobs * sizeof(pthread_t));
+    if (read_threads == NULL) errx(1, "failed to allocate %d threads", jobs);
+    for (int i = 0; i < jobs; ++i) {
+        errno = pthread_create(&read_threads[i], NULL, read_worker, NULL);
+        if (errno) err(1, "failed to start reader thread");
+    }
+}
+
+static void stop_readers(void)
+{
+    if (!read_threads) return;
+
+    for (int i = 0; i < jobs; ++i) {
+        pthread_join(read_threads[i], NULL);
+    }
+    free(read_threads);
+    read_threads = NULL;
+}
+
+static void wait_ready(int i)
+{
+    struct cpio_entry* e = &entries[i];
+    if (!read_threads) {
+        if (!e->ready) {
+            read_entry(e);
+            e->ready = 1;
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&read_lock);
+    if (next_emit < i) {
+        next_emit = i;
+        pthread_cond_broadcast(&read_cond);
+    }
+    while (!e->ready) {
+        pthread_cond_wait(&read_cond, &read_lock);
+    }
+    pthread_mutex_unlock(&read_lock);
+}
+
+static int compare_contents(const void* a, const void* b)
+{
+    int ia = *(const int*)a;
+    int ib = *(const int*)b;
+    const struct cpio_entry* ea = &entries[ia];
+    const struct cpio_entry* eb = &entries[ib];
+
+    if (ea->s.st_mode != eb->s.st_mode) return ea->s.st_mode < eb->s.st_mode ? -1 : 1;
+    if (ea->datasize != eb->datasize) return ea->datasize < eb->datasize ? -1 : 1;
+    if (ea->hash != eb->hash) return ea->hash < eb->hash ? -1 : 1;
+    return ia < ib ? -1 : ia > ib;
+}
+
+// Point every regular file at the first earlier file with the same mode and
+// contents. Only the mode is compared since uid, gid and mtime aren't stored.
+static void link_duplicates(void)
+{
+    int* order = malloc((entry_count ? entry_count : 1) * sizeof(int));
+    if (order == NULL) errx(1, "failed to allocate dedup array (size %d)", entry_count);
+
+    int count = 0;
+    for (int i = 0; i < entry_count; ++i) {
+        wait_ready(i);
+        if (entries[i].in && entries[i].datasize) order[count++] = i;
+    }
+    qsort(order, count, sizeof(int), compare_contents);
+
+    int run_end;
+    for (int run = 0; run < count; run = run_end) {
+        struct cpio_entry* first = &entries[order[run]];
+        for (run_end = run + 1; run_end < count; ++run_end) {
+            struct cpio_entry* e = &entries[order[run_end]];
+            if (e->s.st_mode != first->s.st_mode || e->datasize != first->datasize ||
+                e->hash != first->hash) {
+                break;
+            }
+        }
+        // Within a run entries are in archive order, so leaders come first.
+        for (int j = run + 1; j < run_end; ++j) {
+            struct cpio_entry* e = &entries[order[j]];
+            for (int k = run; k < j; ++k) {
+                struct cpio_entry* leader = &entries[order[k]];
+                if (leader->link != -1) continue;
+                if (!memcmp(leader->data, e->data, e->datasize)) {
+                    e->link = order[k];
+                    leader->nlink++;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < entry_count; ++i) {
+        if (entries[i].link != -1) {
+            free(entries[i].data);
+            entries[i].data = NULL;
+        }
+    }
+    free(order);
+}
+
+// A block of output, compressed on its own so blocks can be compressed in
+// parallel and written in order.
+struct out_block {
+    unsigned char* data;
+    size_t len;
+    unsigned char* out;
+    size_t out_len;
+    int done;
+    struct out_block* next;
+};
+
+static unsigned char* out_buf = NULL;
+static size_t out_buf_len = 0;
+
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t out_todo_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t out_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t* out_threads = NULL;
+static struct out_block* out_head = NULL;  // oldest block not yet written
+static struct out_block* out_tail = NULL;
+static struct out_block* out_todo = NULL;  // oldest block not yet compressed
+static int out_pending = 0;
+static int out_stop = 0;
+
+static void write_all(const void* data, size_t len)
+{
+    if (len && fwrite(data, len, 1, stdout) != 1) err(1, "failed to write output");
+}
+
+static void compress_block(struct out_block* b)
+{
+    if (compression == COMPRESS_GZIP) {
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        // windowBits 15 + 16 makes a complete gzip member; level 9 as minigzip -9.
+        if (deflateInit2(&zs, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            errx(1, "failed to initialize gzip compression");
+        }
+        size_t bound = deflateBound(&zs, b->len);
+        b->out = malloc(bound);
+        if (b->out == NULL) errx(1, "cannot allocate %zu bytes", bound);
+        zs.next_in = b->data;
+        zs.avail_in = b->len;
+        zs.next_out = b->out;
+        zs.avail_out = bound;
+        if (deflate(&zs, Z_FINISH) != Z_STREAM_END) errx(1, "gzip compression failed");
+        b->out_len = zs.total_out;
+        deflateEnd(&zs);
+    } else {
+        // Each lz4 legacy block is its little-endian compressed size followed by the data.
+        int bound = LZ4_compressBound(b->len);
+        b->out = malloc(4 + bound);
+        if (b->out == NULL) errx(1, "cannot allocate %d bytes", 4 + bound);
+        int size = LZ4_compress_HC((const char*)b->data, (char*)b->out + 4, b->len, bound,
+                                   LZ4HC_CLEVEL_MAX);
+        if (size <= 0) errx(1, "lz4 compression failed");
+        b->out[0] = size;
+        b->out[1] = size >> 8;
+        b->out[2] = size >> 16;
+        b->out[3] = size >> 24;
+        b->out_len = 4 + size;
+    }
+    free(b->data);
+    b->data = NULL;
+}
+
+static void* compress_worker(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&out_lock);
+    for (;;) {
+        while (!out_todo && !out_stop) {
+            pthread_cond_wait(&out_todo_cond, &out_lock);
+        }
+        if (!out_todo) break;
+        struct out_block* b = out_todo;
+        out_todo = b->next;
+
+        pthread_mutex_unlock(&out_lock);
+        compress_block(b);
+        pthread_mutex_lock(&out_lock);
+
+        b->done = 1;
+        pthread_cond_broadcast(&out_done_cond);
+    }
+    pthread_mutex_unlock(&out_lock);
+    return NULL;
+}
+
+// Write out finished blocks in order. Blocks until all are written if |all|,
+// otherwise only while too many blocks are in flight.
+static void out_drain(int all)
+{
+    pthread_mutex_lock(&out_lock);
+    while (out_head) {
+        if (!out_head->done) {
+            if (!all && out_pending <= 2 * jobs) break;
+            pthread_cond_wait(&out_done_cond, &out_lock);
+            continue;
+        }
+        struct out_block* b = out_head;
+        out_head = b->next;
+        if (!out_head) out_tail = NULL;
+        out_pending--;
+
+        pthread_mutex_unlock(&out_lock);
+        write_all(b->out, b->out_len);
+        free(b->out);
+        free(b);
+        pthread_mutex_lock(&out_lock);
+    }
+    pthread_mutex_unlock(&out_lock);
+}
+
+static void out_submit(void)
+{
+    struct out_block* b = calloc(1, sizeof(struct out_block));
+    if (b == NULL) errx(1, "failed to allocate output block");
+    b->data = out_buf;
+    b->len = out_buf_len;
+    out_buf = malloc(OUTPUT_BLOCK_SIZE);
+    if (out_buf == NULL) errx(1, "cannot allocate %d bytes", OUTPUT_BLOCK_SIZE);
+    out_buf_len = 0;
+
+    if (!out_threads) {
+        compress_block(b);
+        write_all(b->out, b->out_len);
+        free(b->out);
+        free(b);
+        return;
+    }
+
+    pthread_mutex_lock(&out_lock);
+    if (out_tail) {
+        out_tail->next = b;
+    } else {
+        out_head = b;
+    }
+    out_tail = b;
+    if (!out_todo) out_todo = b;
+    out_pending++;
+    pthread_cond_signal(&out_todo_cond);
+    pthread_mutex_unlock(&out_lock);
+
+    out_drain(0);
+}
+
+static void out_write(const void* data, size_t len)
+{
+    total_size += len;
+    if (compression == COMPRESS_NONE) {
+        write_all(data, len);
+        return;
+    }
+
+    const unsigned char* p = data;
+    while (len) {
+        size_t n = OUTPUT_BLOCK_SIZE - out_buf_len;
+        if (n > len) n = len;
+        memcpy(out_buf + out_buf_len, p, n);
+        out_buf_len += n;
+        p += n;
+        len -= n;
+        if (out_buf_len == OUTPUT_BLOCK_SIZE) out_submit();
+    }
+}
+
+static void out_pad(size_t alignment)
+{
+    static const char zeros[256];
+    size_t pad = (alignment - (total_size & (alignment - 1))) & (alignment - 1);
+    out_write(zeros, pad);
+}
+
+static void out_init(void)
+{
+    // Large writes; the cpio stream is otherwise mostly small records.
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BLOCK_SIZE);
+    if (compression == COMPRESS_NONE) return;
+
+    out_buf = malloc(OUTPUT_BLOCK_SIZE);
+    if (out_buf == NULL) errx(1, "cannot allocate %d bytes", OUTPUT_BLOCK_SIZE);
+
+    if (compression == COMPRESS_LZ4) {
+        const unsigned char magic[4] = {
+            LZ4_LEGACY_MAGIC & 0xff, (LZ4_LEGACY_MAGIC >> 8) & 0xff,
+            (LZ4_LEGACY_MAGIC >> 16) & 0xff, (LZ4_LEGACY_MAGIC >> 24) & 0xff,
+        };
+        write_all(magic, sizeof(magic));
+    }
+
+    if (jobs <= 1) return;
+    out_threads = malloc(jobs * sizeof(pthread_t));
+    if (out_threads == NULL) errx(1, "failed to allocate %d threads", jobs);
+    for (int i = 0; i < jobs; ++i) {
+        errno = pthread_create(&out_threads[i], NULL, compress_worker, NULL);
+        if (errno) err(1, "failed to start compression thread");
+    }
+}
+
+static void out_finish(void)
+{
+    if (compression != COMPRESS_NONE) {
+        if (out_buf_len) out_submit();
+        out_drain(1);
+        free(out_buf);
+        out_buf = NULL;
+    }
+
+    if (out_threads) {
+        pthread_mutex_lock(&out_lock);
+        out_stop = 1;
+        pthread_cond_broadcast(&out_todo_cond);
+        pthread_mutex_unlock(&out_lock);
+        for (int i = 0; i < jobs; ++i) {
+            pthread_join(out_threads[i], NULL);
+        }
+        free(out_threads);
+        out_threads = NULL;
+    }
+
+    if (fflush(stdout)) err(1, "failed to write output");
+}
+
+static void _eject(struct cpio_entry* e)
 {
     // Nothing is special about this value, just picked something in the
     // approximate range that was being used already, and avoiding small
     // values which may be special.
     static unsigned next_inode = 300000;
 
-    while(total_size & 3) {
-        total_size++;
-        putchar(0);
+    unsigned datasize = e->datasize;
+    if (e->link != -1) {
+        // The data went out with the first link; this one just names the same inode.
+        e->ino = entries[e->link].ino;
+        e->nlink = entries[e->link].nlink;
+        datasize = 0;
+    } else {
+        e->ino = next_inode++;
     }
 
-    fix_stat(out, s);
-//    fprintf(stderr, "_eject %s: mode=0%o\n", out, s->st_mode);
-
-    printf("%06x%08x%08x%08x%08x%08x%08x"
-           "%08x%08x%08x%08x%08x%08x%08x%s%c",
-           0x070701,
-           next_inode++,  //  s.st_ino,
-           s->st_mode,
-           0, // s.st_uid,
-           0, // s.st_gid,
-           1, // s.st_nlink,
-           0, // s.st_mtime,
-           datasize,
-           0, // volmajor
-           0, // volminor
-           major(s->st_rdev),
-           minor(s->st_rdev),
-           olen + 1,
-           0,
-           out,
-           0
-           );
-
-    total_size += 6 + 8*13 + olen + 1;
-
-    if(strlen(out) != (unsigned int)olen) errx(1, "ACK!");
-
-    while(total_size & 3) {
-        total_size++;
-        putchar(0);
-    }
+    out_pad(4);
+
+    struct stat* s = &e->s;
+//    fprintf(stderr, "_eject %s: mode=0%o\n", e->out, s->st_mode);
+
+    char header[6 + 8*13 + 1];
+    size_t olen = strlen(e->out);
+    snprintf(header, sizeof(header),
+             "%06x%08x%08x%08x%08x%08x%08x"
+             "%08x%08x%08x%08x%08x%08x%08x",
+             0x070701,
+             e->ino,  //  s.st_ino,
+             s->st_mode,
+             0, // s.st_uid,
+             0, // s.st_gid,
+             e->nlink, // s.st_nlink,
+             0, // s.st_mtime,
+             datasize,
+             0, // volmajor
+             0, // volminor
+             major(s->st_rdev),
+             minor(s->st_rdev),
+             (unsigned)olen + 1,
+             0
+             );
+    out_write(header, 6 + 8*13);
+    out_write(e->out, olen + 1);
+
+    out_pad(4);
 
     if(datasize) {
-        fwrite(data, datasize, 1, stdout);
-        total_size += datasize;
+        out_write(e->data, datasize);
     }
 }
 
-static void _eject_trailer()
+static void _eject_all()
 {
     struct stat s;
     memset(&s, 0, sizeof(s));
-    _eject(&s, TRAILER, 10, 0, 0);
+    add_entry(&s, NULL, TRAILER, NULL, 0);
 
-    while(total_size & 0xff) {
-        total_size++;
-        putchar(0);
+    start_readers();
+    if (dedup) link_duplicates();
+
+    out_init();
+    for (int i = 0; i < entry_count; ++i) {
+        struct cpio_entry* e = &entries[i];
+        wait_ready(i);
+        _eject(e);
+
+        free(e->data);
+        free(e->in);
+        free(e->out);
+        e->data = e->in = e->out = NULL;
     }
+    out_pad(256);
+    out_finish();
+
+    stop_readers();
 }
 
 static void _archive(char *in, char *out, int ilen, int olen);
@@ -211,32 +700,19 @@ static void _archive(char *in, char *out, int ilen, int olen)
     if(lstat(in, &s)) err(1, "could not stat '%s'", in);
 
     if(S_ISREG(s.st_mode)){
-        int fd = open(in, O_RDONLY);
-        if(fd < 0) err(1, "cannot open '%s' for read", in);
-
-        char* tmp = (char*) malloc(s.st_size);
-        if(tmp == 0) errx(1, "cannot allocate %zd bytes", s.st_size);
-
-        if(read(fd, tmp, s.st_size) != s.st_size) {
-            err(1, "cannot read %zd bytes", s.st_size);
-        }
-
-        _eject(&s, out, olen, tmp, s.st_size);
-
-        free(tmp);
-        close(fd);
+        add_entry(&s, in, out, NULL, s.st_size);
     } else if(S_ISDIR(s.st_mode)) {
-        _eject(&s, out, olen, 0, 0);
+        add_entry(&s, NULL, out, NULL, 0);
         _archive_dir(in, out, ilen, olen);
     } else if(S_ISLNK(s.st_mode)) {
         char buf[1024];
         int size;
         size = readlink(in, buf, 1024);
         if(size < 0) err(1, "cannot read symlink '%s'", in);
-        _eject(&s, out, olen, buf, size);
+        add_entry(&s, NULL, out, buf, size);
     } else if(S_ISBLK(s.st_mode) || S_ISCHR(s.st_mode) ||
               S_ISFIFO(s.st_mode) || S_ISSOCK(s.st_mode)) {
-        _eject(&s, out, olen, NULL, 0);
+        add_entry(&s, NULL, out, NULL, 0);
     } else {
         errx(1, "Unknown '%s' (mode %d)?", in, s.st_mode);
     }
@@ -313,7 +789,7 @@ static int append_devnodes_desc_dir(char* path, char* args)
 
     s.st_mode |= S_IFDIR;
 
-    _eject(&s, path, strlen(path), NULL, 0);
+    add_entry(&s, NULL, path, NULL, 0);
 
     return 0;
 }
@@ -339,7 +815,7 @@ static int append_devnodes_desc_nod(char* path, char* args)
         return -1;
     }
 
-    _eject(&s, path, strlen(path), NULL, 0);
+    add_entry(&s, NULL, path, NULL, 0);
 
     return 0;
 }
@@ -392,9 +868,12 @@ static void append_devnodes_desc(const char* filename)
 }
 
 static const struct option long_options[] = {
+    { "compress",   required_argument,  NULL,   'c' },
+    { "dedup",      no_argument,        NULL,   'D' },
     { "dirname",    required_argument,  NULL,   'd' },
     { "file",       required_argument,  NULL,   'f' },
     { "help",       no_argument,        NULL,   'h' },
+    { "jobs",       required_argument,  NULL,   'j' },
     { "nodes",      required_argument,  NULL,   'n' },
     { NULL,         0,                  NULL,   0   },
 };
@@ -402,11 +881,14 @@ static const struct option long_options[] = {
 static void usage(void)
 {
     fprintf(stderr,
-            "Usage: mkbootfs [-n FILE] [-d DIR|-f FILE] DIR...\n"
+            "Usage: mkbootfs [-n FILE] [-d DIR|-f FILE] [-c gzip|lz4] [-D] [-j N] DIR...\n"
             "\n"
+            "\t-c, --compress=gzip|lz4: Compress the output, like gzip -9 or lz4 -l -12\n"
+            "\t-D, --dedup: Store identical regular files once, as hard links\n"
             "\t-d, --dirname=DIR: fs-config directory\n"
             "\t-f, --file=FILE: Canned configuration file\n"
             "\t-h, --help: Print this help\n"
+            "\t-j, --jobs=N: Read and compress files on N threads\n"
             "\t-n, --nodes=FILE: Dev nodes description file\n"
             "\n"
             "Dev nodes description:\n"
@@ -422,8 +904,21 @@ int main(int argc, char *argv[])
 {
     int opt, unused;
 
-    while ((opt = getopt_long(argc, argv, "hd:f:n:", long_options, &unused)) != -1) {
+    while ((opt = getopt_long(argc, argv, "hc:Dd:f:j:n:", long_options, &unused)) != -1) {
         switch (opt) {
+        case 'c':
+            if (!strcmp(optarg, "gzip")) {
+                compression = COMPRESS_GZIP;
+            } else if (!strcmp(optarg, "lz4")) {
+                compression = COMPRESS_LZ4;
+            } else {
+                usage();
+                errx(1, "Unknown compression '%s'", optarg);
+            }
+            break;
+        case 'D':
+            dedup = 1;
+            break;
         case 'd':
             target_out_path = argv[optind - 1];
             break;
@@ -433,6 +928,10 @@ int main(int argc, char *argv[])
         case 'h':
             usage();
             return 0;
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs < 1) errx(1, "Invalid job count '%s'", optarg);
+            break;
         case 'n':
             append_devnodes_desc(argv[optind - 1]);
             break;
@@ -458,7 +957,7 @@ int main(int argc, char *argv[])
         argv++;
     }
 
-    _eject_trailer();
+    _eject_all();
 
     return 0;
 }
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 static constexpr char PROP_TREE_FILE[] = "/dev/__properties__/property_info";
 
@@ -65,8 +66,64 @@ struct PropertyInfoAreaHeader {
   uint32_t contexts_offset;
   uint32_t types_offset;
   uint32_t root_offset;
+  // Added in version 2, only valid if current_version >= 2.  Offset of an
+  // ExactMatchTableHeader, or 0 if the serializer didn't write one.
+  uint32_t exact_match_table_offset;
 };
 
+// Hash table from the full names of exact matches to the result that walking the trie gives for
+// them, so that a lookup of an exact match checks a single slot.  Built with hash and displace:
+// the hash of a name picks a bucket, whose seed picks the slot, and the seeds are chosen such
+// that no two names share a slot.
+struct ExactMatchTableHeader {
+  uint32_t num_buckets;
+  // Array of num_buckets seeds.
+  uint32_t seeds;
+  uint32_t num_slots;
+  // Array of num_slots PropertyEntry, with name_offset pointing to the full property name, or 0
+  // if the slot is empty.
+  uint32_t slots;
+};
+
+// Maps a 32 bit hash uniformly onto [0, range) without a division.
+inline uint32_t ExactMatchReduce(uint32_t hash, uint32_t range) {
+  return (static_cast<uint64_t>(hash) * range) >> 32;
+}
+
+__attribute__((no_sanitize("integer"))) inline uint32_t ExactMatchMix(uint32_t hash) {
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+// Hashes the name eight bytes at a time.  This runs for every lookup, including the ones that then
+// miss the table and walk the trie, so it needs to be cheap.
+__attribute__((no_sanitize("integer"))) inline uint32_t ExactMatchHash(const char* name,
+                                                                      uint32_t len) {
+  uint64_t hash = len;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, name + i, sizeof(word));
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+    hash ^= hash >> 29;
+  }
+  if (i < len) {
+    uint64_t word = 0;
+    memcpy(&word, name + i, len - i);
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+    hash ^= hash >> 29;
+  }
+  return ExactMatchMix(hash ^ (hash >> 32));
+}
+
+inline uint32_t ExactMatchSlot(uint32_t hash, uint32_t seed, uint32_t num_slots) {
+  return ExactMatchReduce(ExactMatchMix(hash ^ seed), num_slots);
+}
+
 class SerializedData {
  public:
   uint32_t size() const {
@@ -174,8 +231,11 @@ class PropertyInfoArea : private SerializedData {
   TrieNode root_node() const { return trie(header()->root_offset); }
 
  private:
-  void CheckPrefixMatch(const char* remaining_name, const TrieNode& trie_node,
-                        uint32_t* context_index, uint32_t* type_index) const;
+  void CheckPrefixMatch(const char* remaining_name, uint32_t remaining_name_size,
+                        const TrieNode& trie_node, uint32_t* context_index,
+                        uint32_t* type_index) const;
+  bool FindExactMatch(const char* name, uint32_t namelen, uint32_t* context_index,
+                      uint32_t* type_index) const;
 
   const PropertyInfoAreaHeader* header() const {
     return reinterpret_cast<const PropertyInfoAreaHeader*>(data_base());
@@ -184,6 +244,9 @@ class PropertyInfoArea : private SerializedData {
   uint32_t contexts_array_offset() const { return contexts_offset() + sizeof(uint32_t); }
   uint32_t types_offset() const { return header()->types_offset; }
   uint32_t types_array_offset() const { return types_offset() + sizeof(uint32_t); }
+  uint32_t exact_match_table_offset() const {
+    return current_version() >= 2 ? header()->exact_match_table_offset : 0;
+  }
 
   TrieNode trie(uint32_t offset) const {
     if (offset != 0 && offset > size()) return TrieNode();
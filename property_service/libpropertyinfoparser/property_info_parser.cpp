@@ -88,9 +88,9 @@ bool TrieNode::FindChildForString(const char* name, uint32_t namelen, TrieNode*
   return true;
 }
 
-void PropertyInfoArea::CheckPrefixMatch(const char* remaining_name, const TrieNode& trie_node,
-                                        uint32_t* context_index, uint32_t* type_index) const {
-  const uint32_t remaining_name_size = strlen(remaining_name);
+void PropertyInfoArea::CheckPrefixMatch(const char* remaining_name, uint32_t remaining_name_size,
+                                        const TrieNode& trie_node, uint32_t* context_index,
+                                        uint32_t* type_index) const {
   for (uint32_t i = 0; i < trie_node.num_prefixes(); ++i) {
     auto prefix_len = trie_node.prefix(i)->namelen;
     if (prefix_len > remaining_name_size) continue;
@@ -107,8 +107,36 @@ void PropertyInfoArea::CheckPrefixMatch(const char* remaining_name, const TrieNo
   }
 }
 
+// Looks up |name| in the exact match table, if there is one.  Names that aren't in the table
+// still have to walk the trie.
+bool PropertyInfoArea::FindExactMatch(const char* name, uint32_t namelen,
+                                      uint32_t* context_index, uint32_t* type_index) const {
+  uint32_t table_offset = exact_match_table_offset();
+  if (table_offset == 0) return false;
+
+  auto table = reinterpret_cast<const ExactMatchTableHeader*>(data_base() + table_offset);
+  uint32_t hash = ExactMatchHash(name, namelen);
+  uint32_t seed = uint32_array(table->seeds)[ExactMatchReduce(hash, table->num_buckets)];
+  auto entry = reinterpret_cast<const PropertyEntry*>(data_base() + table->slots) +
+               ExactMatchSlot(hash, seed, table->num_slots);
+  if (entry->name_offset == 0 || entry->namelen != namelen ||
+      memcmp(c_string(entry->name_offset), name, namelen) != 0) {
+    return false;
+  }
+
+  if (context_index != nullptr) *context_index = entry->context_index;
+  if (type_index != nullptr) *type_index = entry->type_index;
+  return true;
+}
+
 void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* context_index,
                                               uint32_t* type_index) const {
+  // The length of the name is needed for every prefix check, so only compute it once.
+  const uint32_t namelen = strlen(name);
+  if (FindExactMatch(name, namelen, context_index, type_index)) {
+    return;
+  }
+
   uint32_t return_context_index = ~0u;
   uint32_t return_type_index = ~0u;
   const char* remaining_name = name;
@@ -126,7 +154,8 @@ void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* contex
 
     // Check prefixes at this node.  This comes after the node check since these prefixes are by
     // definition longer than the node itself.
-    CheckPrefixMatch(remaining_name, trie_node, &return_context_index, &return_type_index);
+    CheckPrefixMatch(remaining_name, namelen - (remaining_name - name), trie_node,
+                     &return_context_index, &return_type_index);
 
     if (sep == nullptr) {
       break;
@@ -164,7 +193,8 @@ void PropertyInfoArea::GetPropertyInfoIndexes(const char* name, uint32_t* contex
     }
   }
   // Check prefix matches for prefixes not deliminated with '.'
-  CheckPrefixMatch(remaining_name, trie_node, &return_context_index, &return_type_index);
+  CheckPrefixMatch(remaining_name, namelen - (remaining_name - name), trie_node,
+                   &return_context_index, &return_type_index);
   // Return previously found prefix match.
   if (context_index != nullptr) *context_index = return_context_index;
   if (type_index != nullptr) *type_index = return_type_index;
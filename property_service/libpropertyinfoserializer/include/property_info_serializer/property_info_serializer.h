@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -40,6 +41,36 @@ bool BuildTrie(const std::vector<PropertyInfoEntry>& property_info,
                const std::string& default_context, const std::string& default_type,
                std::string* serialized_trie, std::string* error);
 
+// As above, but if |optimize_for_lookup| is set, the trie is laid out for faster lookups and an
+// exact match table is added, which needs a version 2 property_info_parser to be used.  Older
+// parsers still get the same results from the trie alone.
+bool BuildTrie(const std::vector<PropertyInfoEntry>& property_info,
+               const std::string& default_context, const std::string& default_type,
+               bool optimize_for_lookup, std::string* serialized_trie, std::string* error);
+
+class TrieBuilder;
+
+// Builds a serialized trie out of entries that are added over time, such as one property_contexts
+// file after another, without having to collect all of them first.  BuildTrie() is the single
+// shot version of this.
+class PropertyInfoTrieBuilder {
+ public:
+  PropertyInfoTrieBuilder(const std::string& default_context, const std::string& default_type);
+  ~PropertyInfoTrieBuilder();
+
+  PropertyInfoTrieBuilder(const PropertyInfoTrieBuilder&) = delete;
+  void operator=(const PropertyInfoTrieBuilder&) = delete;
+
+  // Adds entries to the trie.  On error, the entries before the one that failed have been added.
+  bool AddEntries(const std::vector<PropertyInfoEntry>& property_info, std::string* error);
+
+  // Serializes all entries added so far; more can still be added afterwards.
+  std::string Serialize(bool optimize_for_lookup) const;
+
+ private:
+  std::unique_ptr<TrieBuilder> trie_builder_;
+};
+
 void ParsePropertyInfoFile(const std::string& file_contents, bool require_prefix_or_exact,
                            std::vector<PropertyInfoEntry>* property_infos,
                            std::vector<std::string>* errors);
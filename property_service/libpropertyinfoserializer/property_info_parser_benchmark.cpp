@@ -0,0 +1,119 @@
+//
+// Copyright (C) 2026 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "property_info_serializer/property_info_serializer.h"
+
+#include "property_info_parser/property_info_parser.h"
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+
+using android::base::ReadFileToString;
+
+namespace android {
+namespace properties {
+
+namespace {
+
+// The same files that init builds /dev/__properties__/property_info from.
+constexpr const char* kPropertyContextsFiles[] = {
+    "/system/etc/selinux/plat_property_contexts",
+    "/system_ext/etc/selinux/system_ext_property_contexts",
+    "/vendor/etc/selinux/vendor_property_contexts",
+    "/product/etc/selinux/product_property_contexts",
+    "/odm/etc/selinux/odm_property_contexts",
+};
+
+struct PropertyContexts {
+  std::string trie;
+  std::string optimized_trie;
+  std::vector<std::string> exact_names;
+  // Names under each prefix entry, as a real property would be named.
+  std::vector<std::string> prefix_names;
+};
+
+const PropertyContexts& DevicePropertyContexts() {
+  static const PropertyContexts* property_contexts = [] {
+    auto property_infos = std::vector<PropertyInfoEntry>();
+    for (const char* file : kPropertyContextsFiles) {
+      auto file_contents = std::string();
+      if (!ReadFileToString(file, &file_contents)) continue;
+      auto errors = std::vector<std::string>();
+      ParsePropertyInfoFile(file_contents, true, &property_infos, &errors);
+    }
+
+    auto result = new PropertyContexts();
+    auto error = std::string();
+    if (!BuildTrie(property_infos, "u:object_r:default_prop:s0", "string", false, &result->trie,
+                   &error) ||
+        !BuildTrie(property_infos, "u:object_r:default_prop:s0", "string", true,
+                   &result->optimized_trie, &error)) {
+      return result;
+    }
+    for (const auto& property_info : property_infos) {
+      if (property_info.exact_match) {
+        result->exact_names.emplace_back(property_info.name);
+      } else {
+        result->prefix_names.emplace_back(property_info.name + "value");
+      }
+    }
+    return result;
+  }();
+  return *property_contexts;
+}
+
+// state.range(0) selects the trie built with optimize_for_lookup.
+void BenchmarkGetPropertyInfoIndexes(benchmark::State& state,
+                                     std::vector<std::string> PropertyContexts::*names) {
+  const auto& property_contexts = DevicePropertyContexts();
+  const auto& lookup_names = property_contexts.*names;
+  if (lookup_names.empty()) {
+    state.SkipWithError("No such entries in the property_contexts of this device");
+    return;
+  }
+  auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(
+      state.range(0) ? property_contexts.optimized_trie.data() : property_contexts.trie.data());
+
+  size_t i = 0;
+  for (auto _ : state) {
+    uint32_t context_index;
+    uint32_t type_index;
+    property_info_area->GetPropertyInfoIndexes(lookup_names[i++ % lookup_names.size()].c_str(),
+                                               &context_index, &type_index);
+    benchmark::DoNotOptimize(context_index);
+    benchmark::DoNotOptimize(type_index);
+  }
+}
+
+void BM_GetPropertyInfoIndexes_exact(benchmark::State& state) {
+  BenchmarkGetPropertyInfoIndexes(state, &PropertyContexts::exact_names);
+}
+BENCHMARK(BM_GetPropertyInfoIndexes_exact)->Arg(0)->Arg(1);
+
+void BM_GetPropertyInfoIndexes_prefix(benchmark::State& state) {
+  BenchmarkGetPropertyInfoIndexes(state, &PropertyContexts::prefix_names);
+}
+BENCHMARK(BM_GetPropertyInfoIndexes_prefix)->Arg(0)->Arg(1);
+
+}  // namespace
+
+}  // namespace properties
+}  // namespace android
+
+BENCHMARK_MAIN();
@@ -29,19 +29,42 @@ namespace properties {
 bool BuildTrie(const std::vector<PropertyInfoEntry>& property_info,
                const std::string& default_context, const std::string& default_type,
                std::string* serialized_trie, std::string* error) {
-  // Check that names are legal first
-  auto trie_builder = TrieBuilder(default_context, default_type);
+  return BuildTrie(property_info, default_context, default_type, false, serialized_trie, error);
+}
+
+bool BuildTrie(const std::vector<PropertyInfoEntry>& property_info,
+               const std::string& default_context, const std::string& default_type,
+               bool optimize_for_lookup, std::string* serialized_trie, std::string* error) {
+  auto trie_builder = PropertyInfoTrieBuilder(default_context, default_type);
+  if (!trie_builder.AddEntries(property_info, error)) {
+    return false;
+  }
 
+  *serialized_trie = trie_builder.Serialize(optimize_for_lookup);
+  return true;
+}
+
+PropertyInfoTrieBuilder::PropertyInfoTrieBuilder(const std::string& default_context,
+                                                 const std::string& default_type)
+    : trie_builder_(new TrieBuilder(default_context, default_type)) {}
+
+PropertyInfoTrieBuilder::~PropertyInfoTrieBuilder() {}
+
+bool PropertyInfoTrieBuilder::AddEntries(const std::vector<PropertyInfoEntry>& property_info,
+                                         std::string* error) {
+  // Check that names are legal first
   for (const auto& [name, context, type, is_exact] : property_info) {
-    if (!trie_builder.AddToTrie(name, context, type, is_exact, error)) {
+    if (!trie_builder_->AddToTrie(name, context, type, is_exact, error)) {
       return false;
     }
   }
-
-  auto trie_serializer = TrieSerializer();
-  *serialized_trie = trie_serializer.SerializeTrie(trie_builder);
   return true;
 }
 
+std::string PropertyInfoTrieBuilder::Serialize(bool optimize_for_lookup) const {
+  auto trie_serializer = TrieSerializer(optimize_for_lookup);
+  return trie_serializer.SerializeTrie(*trie_builder_);
+}
+
 }  // namespace properties
 }  // namespace android
@@ -18,6 +18,8 @@
 
 #include "property_info_parser/property_info_parser.h"
 
+#include <set>
+
 #include <gtest/gtest.h>
 
 namespace android {
@@ -763,6 +765,57 @@ TEST(propertyinfoserializer, RealProperties) {
     property_info_area->GetPropertyInfo(property.c_str(), &returned_context, nullptr);
     EXPECT_EQ(context, returned_context) << property;
   }
+
+  // Building the trie for lookups mustn't change any result, including for exact matches, which
+  // then come from the exact match table instead.
+  auto exact_property_info = property_info;
+  auto exact_names = std::set<std::string>();
+  for (unsigned int i = 0; i < properties_and_contexts.size(); i += 2) {
+    exact_names.emplace(properties_and_contexts[i].first);
+  }
+  for (const auto& name : exact_names) {
+    exact_property_info.emplace_back(name, "u:object_r:exact_prop:s0", "", true);
+  }
+
+  auto query_names = std::vector<std::string>{"", "ro", "unknown.property"};
+  for (const auto& [property, context] : properties_and_contexts) {
+    query_names.emplace_back(property);
+    query_names.emplace_back(property + "1");
+    query_names.emplace_back(property + ".sub");
+  }
+  for (const auto& entry : property_info) {
+    query_names.emplace_back(entry.name);
+  }
+
+  for (const auto* entries : {&property_info, &exact_property_info}) {
+    auto optimized_trie = std::string();
+    ASSERT_TRUE(BuildTrie(*entries, "u:object_r:default_prop:s0", "string", false,
+                          &serialized_trie, &build_trie_error))
+        << build_trie_error;
+    ASSERT_TRUE(BuildTrie(*entries, "u:object_r:default_prop:s0", "string", true, &optimized_trie,
+                          &build_trie_error))
+        << build_trie_error;
+
+    property_info_area = reinterpret_cast<const PropertyInfoArea*>(serialized_trie.data());
+    auto optimized_area = reinterpret_cast<const PropertyInfoArea*>(optimized_trie.data());
+    EXPECT_EQ(1U, property_info_area->current_version());
+    EXPECT_EQ(entries == &exact_property_info ? 2U : 1U, optimized_area->current_version());
+    EXPECT_EQ(1U, optimized_area->minimum_supported_version());
+
+    for (const auto& name : query_names) {
+      uint32_t context_index, optimized_context_index;
+      uint32_t type_index, optimized_type_index;
+      property_info_area->GetPropertyInfoIndexes(name.c_str(), &context_index, &type_index);
+      optimized_area->GetPropertyInfoIndexes(name.c_str(), &optimized_context_index,
+                                             &optimized_type_index);
+      EXPECT_EQ(context_index, optimized_context_index) << name;
+      EXPECT_EQ(type_index, optimized_type_index) << name;
+      if (entries == &exact_property_info && exact_names.count(name)) {
+        EXPECT_STREQ("u:object_r:exact_prop:s0", optimized_area->context(optimized_context_index))
+            << name;
+      }
+    }
+  }
 }
 
 TEST(propertyinfoserializer, GetPropertyInfo_prefix_without_dot) {
@@ -887,5 +940,51 @@ TEST(propertyinfoserializer, GetPropertyInfo_empty_context_and_type) {
   EXPECT_STREQ("5th", type);
 }
 
+TEST(propertyinfoserializer, PropertyInfoTrieBuilder_incremental) {
+  auto first_property_info = std::vector<PropertyInfoEntry>{
+      {"persist.", "1st", "", false},
+      {"persist.radio", "2nd", "2nd", false},
+      {"persist.radio.exact", "3rd", "3rd", true},
+  };
+  auto second_property_info = std::vector<PropertyInfoEntry>{
+      {"persist.radio.other", "4th", "", true},
+      {"ro.", "5th", "5th", false},
+  };
+
+  auto trie_builder = PropertyInfoTrieBuilder("default", "default");
+  auto error = std::string();
+  ASSERT_TRUE(trie_builder.AddEntries(first_property_info, &error)) << error;
+
+  auto first_trie = std::string();
+  ASSERT_TRUE(BuildTrie(first_property_info, "default", "default", true, &first_trie, &error))
+      << error;
+  EXPECT_EQ(first_trie, trie_builder.Serialize(true));
+
+  ASSERT_TRUE(trie_builder.AddEntries(second_property_info, &error)) << error;
+
+  auto all_property_info = first_property_info;
+  all_property_info.insert(all_property_info.end(), second_property_info.begin(),
+                           second_property_info.end());
+  auto all_trie = std::string();
+  ASSERT_TRUE(BuildTrie(all_property_info, "default", "default", true, &all_trie, &error))
+      << error;
+  EXPECT_EQ(all_trie, trie_builder.Serialize(true));
+
+  auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(all_trie.data());
+  const char* context;
+  const char* type;
+  property_info_area->GetPropertyInfo("persist.radio.other", &context, &type);
+  EXPECT_STREQ("4th", context);
+  EXPECT_STREQ("2nd", type);
+  property_info_area->GetPropertyInfo("ro.something", &context, &type);
+  EXPECT_STREQ("5th", context);
+  EXPECT_STREQ("5th", type);
+
+  // A duplicate is still rejected when it comes from a later batch.
+  EXPECT_FALSE(trie_builder.AddEntries({{"persist.radio.exact", "6th", "6th", true}}, &error));
+  EXPECT_EQ("Duplicate exact match detected for 'persist.radio.exact'", error);
+  EXPECT_EQ(all_trie, trie_builder.Serialize(true));
+}
+
 }  // namespace properties
 }  // namespace android
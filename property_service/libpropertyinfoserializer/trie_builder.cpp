@@ -33,9 +33,16 @@ TrieBuilder::TrieBuilder(const std::string& default_context, const std::string&
 
 bool TrieBuilder::AddToTrie(const std::string& name, const std::string& context,
                             const std::string& type, bool exact, std::string* error) {
-  auto* context_pointer = StringPointerFromContainer(context, &contexts_);
-  auto* type_pointer = StringPointerFromContainer(type, &types_);
-  return AddToTrie(name, context_pointer, type_pointer, exact, error);
+  auto [context_iterator, context_added] = contexts_.emplace(context);
+  auto [type_iterator, type_added] = types_.emplace(type);
+  if (!AddToTrie(name, &(*context_iterator), &(*type_iterator), exact, error)) {
+    // Entries can be added after a failure, so don't leave behind strings that only the failed
+    // entry used.
+    if (context_added) contexts_.erase(context_iterator);
+    if (type_added) types_.erase(type_iterator);
+    return false;
+  }
+  return true;
 }
 
 bool TrieBuilder::AddToTrie(const std::string& name, const std::string* context,
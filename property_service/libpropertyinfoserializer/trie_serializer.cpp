@@ -16,6 +16,8 @@
 
 #include "trie_serializer.h"
 
+#include <algorithm>
+
 namespace android {
 namespace properties {
 
@@ -60,6 +62,13 @@ uint32_t TrieSerializer::WriteTrieNode(const TrieBuilderNode& builder_node) {
   auto trie = arena_->AllocateObject<TrieNodeInternal>(&trie_offset);
 
   trie->property_entry = WritePropertyEntry(builder_node.property_entry());
+  WriteTrieNodeContents(builder_node, trie_offset);
+  return trie_offset;
+}
+
+void TrieSerializer::WriteTrieNodeContents(const TrieBuilderNode& builder_node,
+                                           uint32_t trie_offset) {
+  auto trie = arena_->object<TrieNodeInternal>(trie_offset);
 
   // Write prefix matches
   auto sorted_prefix_matches = builder_node.prefixes();
@@ -103,13 +112,131 @@ uint32_t TrieSerializer::WriteTrieNode(const TrieBuilderNode& builder_node) {
   uint32_t children_offset_array_offset = arena_->AllocateUint32Array(sorted_children.size());
   trie->child_nodes = children_offset_array_offset;
 
+  if (!optimize_for_lookup_) {
+    for (unsigned int i = 0; i < sorted_children.size(); ++i) {
+      arena_->uint32_array(children_offset_array_offset)[i] = WriteTrieNode(sorted_children[i]);
+    }
+    return;
+  }
+
+  // The binary search in FindChildForString() only looks at the names of the children, so write
+  // all of the children and their names back to back before any of their own contents, instead of
+  // leaving each child's whole subtree between it and its next sibling.
+  uint32_t first_child_offset;
+  arena_->AllocateData(sizeof(TrieNodeInternal) * sorted_children.size(), &first_child_offset);
   for (unsigned int i = 0; i < sorted_children.size(); ++i) {
-    arena_->uint32_array(children_offset_array_offset)[i] = WriteTrieNode(sorted_children[i]);
+    uint32_t child_offset = first_child_offset + i * sizeof(TrieNodeInternal);
+    arena_->uint32_array(children_offset_array_offset)[i] = child_offset;
+    arena_->object<TrieNodeInternal>(child_offset)->property_entry =
+        WritePropertyEntry(sorted_children[i].property_entry());
   }
-  return trie_offset;
+  for (unsigned int i = 0; i < sorted_children.size(); ++i) {
+    WriteTrieNodeContents(sorted_children[i], first_child_offset + i * sizeof(TrieNodeInternal));
+  }
+}
+
+namespace {
+
+void CollectExactMatchNames(const TrieBuilderNode& builder_node, const std::string& prefix,
+                            std::vector<std::string>* names) {
+  for (const auto& exact_match : builder_node.exact_matches()) {
+    names->emplace_back(prefix + exact_match.name);
+  }
+  for (const auto& child : builder_node.children()) {
+    CollectExactMatchNames(child, prefix + child.name() + ".", names);
+  }
+}
+
+}  // namespace
+
+uint32_t TrieSerializer::WriteExactMatchTable(const TrieBuilder& trie_builder) {
+  std::vector<std::string> names;
+  CollectExactMatchNames(trie_builder.builder_root(), "", &names);
+  if (names.empty()) return 0;
+
+  // About four names per bucket and a load factor of 80% keep the seed search short.
+  uint32_t num_buckets = names.size() / 4 + 1;
+  uint32_t num_slots = names.size() + names.size() / 4 + 1;
+
+  std::vector<uint32_t> hashes(names.size());
+  std::vector<std::vector<uint32_t>> buckets(num_buckets);
+  for (unsigned int i = 0; i < names.size(); ++i) {
+    hashes[i] = ExactMatchHash(names[i].c_str(), names[i].size());
+    buckets[ExactMatchReduce(hashes[i], num_buckets)].emplace_back(i);
+  }
+
+  // Place the largest buckets first, while most slots are still free.
+  std::vector<uint32_t> bucket_order(num_buckets);
+  for (unsigned int i = 0; i < num_buckets; ++i) bucket_order[i] = i;
+  std::stable_sort(bucket_order.begin(), bucket_order.end(), [&buckets](auto lhs, auto rhs) {
+    return buckets[lhs].size() > buckets[rhs].size();
+  });
+
+  static constexpr uint32_t kMaxSeed = 1 << 20;
+  std::vector<uint32_t> seeds(num_buckets);
+  std::vector<uint32_t> slot_names(num_slots, ~0u);
+  std::vector<uint32_t> bucket_slots;
+  for (auto bucket : bucket_order) {
+    if (buckets[bucket].empty()) break;
+
+    uint32_t seed = 0;
+    for (; seed < kMaxSeed; ++seed) {
+      bucket_slots.clear();
+      for (auto name : buckets[bucket]) {
+        uint32_t slot = ExactMatchSlot(hashes[name], seed, num_slots);
+        if (slot_names[slot] != ~0u ||
+            std::find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end()) {
+          break;
+        }
+        bucket_slots.emplace_back(slot);
+      }
+      if (bucket_slots.size() == buckets[bucket].size()) break;
+    }
+    // Only happens if two names hash to the same value; lookups just walk the trie then.
+    if (seed == kMaxSeed) return 0;
+
+    seeds[bucket] = seed;
+    for (unsigned int i = 0; i < bucket_slots.size(); ++i) {
+      slot_names[bucket_slots[i]] = buckets[bucket][i];
+    }
+  }
+
+  // Each slot caches what walking the trie gives for its name, so that the results are identical
+  // whichever way a name is looked up.
+  std::vector<uint32_t> context_indexes(names.size());
+  std::vector<uint32_t> type_indexes(names.size());
+  for (unsigned int i = 0; i < names.size(); ++i) {
+    serialized_info()->GetPropertyInfoIndexes(names[i].c_str(), &context_indexes[i],
+                                              &type_indexes[i]);
+  }
+
+  uint32_t table_offset;
+  auto table = arena_->AllocateObject<ExactMatchTableHeader>(&table_offset);
+  table->num_buckets = num_buckets;
+  table->seeds = arena_->AllocateUint32Array(num_buckets);
+  for (unsigned int i = 0; i < num_buckets; ++i) {
+    arena_->uint32_array(table->seeds)[i] = seeds[i];
+  }
+
+  uint32_t slots_offset;
+  arena_->AllocateData(sizeof(PropertyEntry) * num_slots, &slots_offset);
+  table->num_slots = num_slots;
+  table->slots = slots_offset;
+  for (unsigned int i = 0; i < num_slots; ++i) {
+    if (slot_names[i] == ~0u) continue;
+    uint32_t name_offset = arena_->AllocateAndWriteString(names[slot_names[i]]);
+    auto slot = arena_->object<PropertyEntry>(slots_offset + i * sizeof(PropertyEntry));
+    slot->name_offset = name_offset;
+    slot->namelen = names[slot_names[i]].size();
+    slot->context_index = context_indexes[slot_names[i]];
+    slot->type_index = type_indexes[slot_names[i]];
+  }
+  return table_offset;
 }
 
-TrieSerializer::TrieSerializer() {}
+TrieSerializer::TrieSerializer(bool optimize_for_lookup)
+    : optimize_for_lookup_(optimize_for_lookup) {}
+
 
 std::string TrieSerializer::SerializeTrie(const TrieBuilder& trie_builder) {
   arena_.reset(new TrieNodeArena());
@@ -132,6 +259,15 @@ std::string TrieSerializer::SerializeTrie(const TrieBuilder& trie_builder) {
   uint32_t root_trie_offset = WriteTrieNode(trie_builder.builder_root());
   header->root_offset = root_trie_offset;
 
+  if (optimize_for_lookup_) {
+    // GetPropertyInfoIndexes() needs size() to cover the trie.
+    header->size = arena_->size();
+    header->exact_match_table_offset = WriteExactMatchTable(trie_builder);
+    if (header->exact_match_table_offset != 0) {
+      header->current_version = 2;
+    }
+  }
+
   // Record the real size now that we've written everything
   header->size = arena_->size();
 
@@ -30,7 +30,9 @@ namespace properties {
 
 class TrieSerializer {
  public:
-  TrieSerializer();
+  // If |optimize_for_lookup| is set, siblings are packed next to each other and an exact match
+  // table is appended; see ExactMatchTableHeader.
+  explicit TrieSerializer(bool optimize_for_lookup = false);
 
   std::string SerializeTrie(const TrieBuilder& trie_builder);
 
@@ -41,11 +43,18 @@ class TrieSerializer {
   // Writes a new TrieNode to arena, and recursively writes its children.
   // Returns the offset within arena.
   uint32_t WriteTrieNode(const TrieBuilderNode& builder_node);
+  // Writes everything but the property entry of an already allocated TrieNode.
+  void WriteTrieNodeContents(const TrieBuilderNode& builder_node, uint32_t trie_offset);
+
+  // Writes the exact match table for the already serialized trie.
+  // Returns its offset within arena, or 0 if no table could be built.
+  uint32_t WriteExactMatchTable(const TrieBuilder& trie_builder);
 
   const PropertyInfoArea* serialized_info() const {
     return reinterpret_cast<const PropertyInfoArea*>(arena_->data().data());
   }
 
+  bool optimize_for_lookup_;
   std::unique_ptr<TrieNodeArena> arena_;
 };
 
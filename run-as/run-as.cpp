@@ -60,16 +60,6 @@
 //  - Run the 'gdbserver' binary executable to allow native debugging
 //
 
-static bool packagelist_parse_callback(pkg_info* this_package, void* userdata) {
-  pkg_info* p = reinterpret_cast<pkg_info*>(userdata);
-  if (strcmp(p->name, this_package->name) == 0) {
-    *p = *this_package;
-    return false; // Stop searching.
-  }
-  packagelist_free(this_package);
-  return true; // Keep searching.
-}
-
 static void check_directory(const char* path, uid_t uid) {
   struct stat st;
   if (TEMP_FAILURE_RETRY(lstat(path, &st)) == -1) {
@@ -188,17 +178,19 @@ int main(int argc, char* argv[]) {
   }
 
   // Retrieve package information from system, switching egid so we can read the file.
-  pkg_info info = {.name = pkgname};
+  // Only the one line we need is parsed, rather than every package before it.
   gid_t old_egid = getegid();
   if (setegid(AID_PACKAGE_INFO) == -1) error(1, errno, "setegid(AID_PACKAGE_INFO) failed");
-  if (!packagelist_parse(packagelist_parse_callback, &info)) {
-    error(1, errno, "packagelist_parse failed");
+  pkg_info* found = packagelist_find_package(nullptr, pkgname);
+  if (!found && errno != ENOENT) {
+    error(1, errno, "packagelist_find_package failed");
   }
   if (setegid(old_egid) == -1) error(1, errno, "couldn't restore egid");
 
-  if (info.uid == 0) {
+  if (!found || found->uid == 0) {
     error(1, 0, "unknown package: %s", pkgname);
   }
+  pkg_info& info = *found;
 
   // Verify that user id is not too big.
   if ((UID_MAX - info.uid) / AID_USER_OFFSET < (uid_t)userId) {
@@ -19,7 +19,10 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+
 #include <aidl/android/hardware/health/IHealth.h>
+#include <utils/Mutex.h>
 
 // number of attributes diskstats has
 #define DISK_STATS_SIZE ( 11 )
@@ -141,9 +144,44 @@ public:
     }
 };
 
+/*
+ * Distribution of I/O latency in log2 buckets of microseconds: bucket i counts
+ * I/Os that took less than 2^i us, and at least 2^(i-1) us.
+ */
+class latency_histogram {
+public:
+    static constexpr int BUCKETS = 24;  // the last one holds everything above 4s
+
+    static uint64_t bucket_limit_us(int bucket) { return 1ULL << bucket; }
+
+    void add(uint64_t latency_us, uint64_t ios) {
+        int bucket = latency_us == 0 ? 0 : 64 - __builtin_clzll(latency_us);
+        mBuckets[std::min(bucket, BUCKETS - 1)] += ios;
+        mCount += ios;
+    }
+    uint64_t count() const { return mCount; }
+    uint64_t bucket(int i) const { return mBuckets[i]; }
+    // upper bound of the bucket holding the |percent|th percentile I/O, 0 if empty
+    uint64_t percentile_us(double percent) const {
+        if (mCount == 0) return 0;
+        uint64_t target = std::max<uint64_t>(1, mCount * percent / 100);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += mBuckets[i];
+            if (seen >= target) return bucket_limit_us(i);
+        }
+        return bucket_limit_us(BUCKETS - 1);
+    }
+
+private:
+    uint64_t mBuckets[BUCKETS] = {};
+    uint64_t mCount = 0;
+};
+
 class disk_stats_monitor {
 private:
     FRIEND_TEST(storaged_test, disk_stats_monitor);
+    FRIEND_TEST(storaged_test, disk_stats_monitor_latency);
     const char* const DISK_STATS_PATH;
     struct disk_stats mPrevious;
     struct disk_stats mAccumulate;      /* reset after stall */
@@ -163,6 +201,14 @@ private:
     struct disk_perf mMean;
     struct disk_perf mStd;
     std::shared_ptr<aidl::android::hardware::health::IHealth> mHealth;
+    /*
+     * diskstats only has the total time spent on each op, so every I/O of an
+     * update period is counted at the period's mean latency. Read from binder
+     * threads, hence the lock.
+     */
+    android::Mutex mLatencyLock;
+    latency_histogram mReadLatency;
+    latency_histogram mWriteLatency;
 
     void update_mean();
     void update_std();
@@ -195,6 +241,7 @@ public:
   bool enabled() { return mHealth != nullptr || DISK_STATS_PATH != nullptr; }
   void update(void);
   void publish(void);
+  void get_latency(latency_histogram* read, latency_histogram* write);
 };
 
 #endif /* _STORAGED_DISKSTATS_H_ */
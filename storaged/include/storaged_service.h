@@ -33,6 +33,7 @@ class StoragedService : public BinderService<StoragedService>, public BnStoraged
 private:
     void dumpUidRecordsDebug(int fd, const vector<struct uid_record>& entries);
     void dumpUidRecords(int fd, const vector<struct uid_record>& entries);
+    void dumpDiskLatency(int fd);
 public:
     static status_t start();
     static char const* getServiceName() { return "storaged"; }
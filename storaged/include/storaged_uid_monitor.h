@@ -20,7 +20,9 @@
 #include <stdint.h>
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <cutils/multiuser.h>
@@ -39,7 +41,7 @@ using namespace android::os::storaged;
 
 class uid_info : public UidInfo {
 public:
-    bool parse_uid_io_stats(string&& s);
+    bool parse_uid_io_stats(string_view s);
 };
 
 class io_usage {
@@ -81,29 +83,38 @@ private:
     FRIEND_TEST(storaged_test, uid_monitor);
     FRIEND_TEST(storaged_test, load_uid_io_proto);
 
-    // last dump from /proc/uid_io/stats, uid -> uid_info
-    unordered_map<uint32_t, uid_info> last_uid_io_stats_;
+    // last dump from /proc/uid_io/stats, sorted by uid
+    vector<uid_info> last_uid_io_stats_;
+    // contents of /proc/uid_io/stats, kept to reuse its allocation
+    string uid_io_buffer_;
     // current io usage for next report, app name -> uid_io_usage
     unordered_map<string, uid_io_usage> curr_io_stats_;
     // io usage records, end timestamp -> {start timestamp, vector of records}
     map<uint64_t, uid_records> io_history_;
+    // users whose io_history changed since it was last written to protobuf
+    unordered_set<userid_t> changed_users_;
     // charger ON/OFF
     charger_stat_t charger_stat_;
-    // protects curr_io_stats, last_uid_io_stats, records and charger_stat
+    // protects curr_io_stats, last_uid_io_stats, uid_io_buffer, records, changed_users and
+    // charger_stat
     Mutex uidm_mutex_;
     // start time for IO records
     uint64_t start_ts_;
     // true if UID_IO_STATS_PATH is accessible
     const bool enabled_;
 
-    // reads from /proc/uid_io/stats
-    unordered_map<uint32_t, uid_info> get_uid_io_stats_locked();
+    // reads from /proc/uid_io/stats, sorted by uid
+    vector<uid_info> get_uid_io_stats_locked();
     // flushes curr_io_stats to records
     void add_records_locked(uint64_t curr_ts);
     // updates curr_io_stats and set last_uid_io_stats
     void update_curr_io_stats_locked();
-    // writes io_history to protobuf
-    void update_uid_io_proto(unordered_map<int, StoragedProto>* protos);
+    // writes io_history to protobuf, only for |users| if it isn't null
+    void update_uid_io_proto(unordered_map<int, StoragedProto>* protos,
+                             const unordered_set<userid_t>* users = nullptr);
+    // erases a record from io_history, noting whose history changed
+    map<uint64_t, uid_records>::iterator erase_records_locked(
+        map<uint64_t, uid_records>::iterator it);
 
     // Ensure that io_history_ can append |n| items without exceeding
     // MAX_UID_RECORDS_SIZE in size.
@@ -122,7 +133,11 @@ public:
     void set_charger_state(charger_stat_t stat);
     // called by storaged periodic_chore or dump with force_report
     bool enabled() { return enabled_; };
-    void report(unordered_map<int, StoragedProto>* protos);
+    void report();
+    // called by storaged before flushing protos: writes the io_history of the
+    // users already in protos and of the users whose history changed since the
+    // last call, so that unchanged history isn't encoded and written again
+    void get_changed_uid_io_protos(unordered_map<int, StoragedProto>* protos);
     // restores io_history from protobuf
     void load_uid_io_proto(userid_t user_id, const UidIOUsage& proto);
     void clear_user_history(userid_t user_id);
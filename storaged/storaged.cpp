@@ -379,7 +379,7 @@ void storaged_t::event(void) {
     }
 
     if (!(mTimer % mConfig.periodic_chores_interval_uid_io)) {
-        mUidm.report(&protos);
+        mUidm.report();
     }
 
     if (storage_info) {
@@ -387,6 +387,7 @@ void storaged_t::event(void) {
     }
 
     if (!(mTimer % mConfig.periodic_chores_interval_flush_proto)) {
+        mUidm.get_changed_uid_io_protos(&protos);
         flush_protos(&protos);
     }
 
@@ -258,6 +258,17 @@ void disk_stats_monitor::update(struct disk_stats* curr)
     get_inc_disk_stats(&mPrevious, curr, &inc);
     add_disk_stats(&inc, &mAccumulate_pub);
 
+    {
+        android::Mutex::Autolock _l(mLatencyLock);
+        // ticks are in ms
+        if (inc.read_ios) {
+            mReadLatency.add(inc.read_ticks * MSEC_TO_USEC / inc.read_ios, inc.read_ios);
+        }
+        if (inc.write_ios) {
+            mWriteLatency.add(inc.write_ticks * MSEC_TO_USEC / inc.write_ios, inc.write_ios);
+        }
+    }
+
     struct disk_perf perf = get_disk_perf(&inc);
     log_debug_disk_perf(&perf, "regular");
 
@@ -308,6 +319,13 @@ void disk_stats_monitor::update() {
     update(&curr);
 }
 
+void disk_stats_monitor::get_latency(latency_histogram* read, latency_histogram* write)
+{
+    android::Mutex::Autolock _l(mLatencyLock);
+    *read = mReadLatency;
+    *write = mWriteLatency;
+}
+
 void disk_stats_monitor::publish(void)
 {
     struct disk_perf perf = get_disk_perf(&mAccumulate_pub);
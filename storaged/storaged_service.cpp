@@ -93,6 +93,28 @@ void StoragedService::dumpUidRecordsDebug(int fd, const vector<uid_record>& entr
     }
 }
 
+void StoragedService::dumpDiskLatency(int fd) {
+    latency_histogram latency[IO_TYPES];
+    if (!storaged_sp->get_disk_latency(&latency[READ], &latency[WRITE])) {
+        dprintf(fd, "disk stats are not available\n");
+        return;
+    }
+
+    // op ios p50_us p90_us p99_us, then "<limit_us>:<ios>" for each non-empty bucket
+    const char* ops[IO_TYPES] = {"read", "write"};
+    for (int op = 0; op < IO_TYPES; op++) {
+        const latency_histogram& h = latency[op];
+        dprintf(fd, "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", ops[op], h.count(),
+                h.percentile_us(50), h.percentile_us(90), h.percentile_us(99));
+        for (int i = 0; i < latency_histogram::BUCKETS; i++) {
+            if (h.bucket(i) == 0) continue;
+            dprintf(fd, " %" PRIu64 ":%" PRIu64, latency_histogram::bucket_limit_us(i),
+                    h.bucket(i));
+        }
+        dprintf(fd, "\n");
+    }
+}
+
 status_t StoragedService::dump(int fd, const Vector<String16>& args) {
     IPCThreadState* self = IPCThreadState::self();
     const int pid = self->getCallingPid();
@@ -139,6 +161,10 @@ status_t StoragedService::dump(int fd, const Vector<String16>& args) {
             debug = true;
             continue;
         }
+        if (arg == String16("--latency")) {
+            dumpDiskLatency(fd);
+            return OK;
+        }
     }
 
     uint64_t last_ts = 0;
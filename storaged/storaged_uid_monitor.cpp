@@ -19,7 +19,10 @@
 #include <stdint.h>
 #include <time.h>
 
+#include <algorithm>
+#include <charconv>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -27,8 +30,6 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>
-#include <android-base/parseint.h>
-#include <android-base/strings.h>
 #include <android-base/stringprintf.h>
 #include <binder/IServiceManager.h>
 #include <log/log_event_list.h>
@@ -52,25 +53,56 @@ const char* UID_IO_STATS_PATH = "/proc/uid_io/stats";
 std::unordered_map<uint32_t, uid_info> uid_monitor::get_uid_io_stats()
 {
     Mutex::Autolock _l(uidm_mutex_);
-    return get_uid_io_stats_locked();
+    std::unordered_map<uint32_t, uid_info> uid_io_stats;
+    for (auto& u : get_uid_io_stats_locked()) {
+        uint32_t uid = u.uid;
+        uid_io_stats.emplace(uid, std::move(u));
+    }
+    return uid_io_stats;
 };
 
+namespace {
+
+/*
+ * The stats are parsed in place with from_chars rather than split into
+ * strings, since /proc/uid_io/stats has a line for every uid and, with
+ * CONFIG_UID_SYS_STATS_DEBUG, for every task.
+ */
+template <typename T>
+bool parse_number(std::string_view s, T* value)
+{
+    const char* end = s.data() + s.size();
+    auto [ptr, ec] = std::from_chars(s.data(), end, *value);
+    return !s.empty() && ec == std::errc() && ptr == end;
+}
+
+/* returns the text before the next sep in *s, and removes it and sep from *s */
+std::string_view next_field(std::string_view* s, char sep)
+{
+    size_t pos = s->find(sep);
+    std::string_view field = s->substr(0, pos);
+    s->remove_prefix(pos == std::string_view::npos ? s->size() : pos + 1);
+    return field;
+}
+
+} // namespace
+
 /* return true on parse success and false on failure */
-bool uid_info::parse_uid_io_stats(std::string&& s)
+bool uid_info::parse_uid_io_stats(std::string_view s)
 {
-    std::vector<std::string> fields = Split(s, " ");
-    if (fields.size() < 11 ||
-        !ParseUint(fields[0],  &uid) ||
-        !ParseUint(fields[1],  &io[FOREGROUND].rchar) ||
-        !ParseUint(fields[2],  &io[FOREGROUND].wchar) ||
-        !ParseUint(fields[3],  &io[FOREGROUND].read_bytes) ||
-        !ParseUint(fields[4],  &io[FOREGROUND].write_bytes) ||
-        !ParseUint(fields[5],  &io[BACKGROUND].rchar) ||
-        !ParseUint(fields[6],  &io[BACKGROUND].wchar) ||
-        !ParseUint(fields[7],  &io[BACKGROUND].read_bytes) ||
-        !ParseUint(fields[8],  &io[BACKGROUND].write_bytes) ||
-        !ParseUint(fields[9],  &io[FOREGROUND].fsync) ||
-        !ParseUint(fields[10], &io[BACKGROUND].fsync)) {
+    uint64_t* counters[] = {
+        &io[FOREGROUND].rchar, &io[FOREGROUND].wchar,
+        &io[FOREGROUND].read_bytes, &io[FOREGROUND].write_bytes,
+        &io[BACKGROUND].rchar, &io[BACKGROUND].wchar,
+        &io[BACKGROUND].read_bytes, &io[BACKGROUND].write_bytes,
+        &io[FOREGROUND].fsync, &io[BACKGROUND].fsync,
+    };
+    std::string_view rest = s;
+    bool ok = parse_number(next_field(&rest, ' '), &uid);
+    for (uint64_t* counter : counters) {
+        ok = ok && parse_number(next_field(&rest, ' '), counter);
+    }
+    if (!ok) {
         LOG(WARNING) << "Invalid uid I/O stats: \"" << s << "\"";
         return false;
     }
@@ -78,27 +110,36 @@ bool uid_info::parse_uid_io_stats(std::string&& s)
 }
 
 /* return true on parse success and false on failure */
-bool task_info::parse_task_io_stats(std::string&& s)
+bool task_info::parse_task_io_stats(std::string_view s)
 {
-    std::vector<std::string> fields = Split(s, ",");
-    size_t size = fields.size();
-    if (size < 13 ||
-        !ParseInt(fields[size - 11],  &pid) ||
-        !ParseUint(fields[size - 10],  &io[FOREGROUND].rchar) ||
-        !ParseUint(fields[size - 9],  &io[FOREGROUND].wchar) ||
-        !ParseUint(fields[size - 8],  &io[FOREGROUND].read_bytes) ||
-        !ParseUint(fields[size - 7],  &io[FOREGROUND].write_bytes) ||
-        !ParseUint(fields[size - 6],  &io[BACKGROUND].rchar) ||
-        !ParseUint(fields[size - 5],  &io[BACKGROUND].wchar) ||
-        !ParseUint(fields[size - 4],  &io[BACKGROUND].read_bytes) ||
-        !ParseUint(fields[size - 3], &io[BACKGROUND].write_bytes) ||
-        !ParseUint(fields[size - 2], &io[FOREGROUND].fsync) ||
-        !ParseUint(fields[size - 1], &io[BACKGROUND].fsync)) {
+    // "task,<comm>,<pid>,<counters>", where comm may itself contain commas,
+    // so the fields are taken from the end.
+    std::string_view fields[11];
+    std::string_view rest = s;
+    size_t pos = std::string_view::npos;
+    for (int i = 10; i >= 0; i--) {
+        pos = rest.rfind(',');
+        if (pos == std::string_view::npos) break;
+        fields[i] = rest.substr(pos + 1);
+        rest = rest.substr(0, pos);
+    }
+    size_t comm_pos = rest.find(',');
+    if (pos == std::string_view::npos || comm_pos == std::string_view::npos ||
+        !parse_number(fields[0], &pid) ||
+        !parse_number(fields[1], &io[FOREGROUND].rchar) ||
+        !parse_number(fields[2], &io[FOREGROUND].wchar) ||
+        !parse_number(fields[3], &io[FOREGROUND].read_bytes) ||
+        !parse_number(fields[4], &io[FOREGROUND].write_bytes) ||
+        !parse_number(fields[5], &io[BACKGROUND].rchar) ||
+        !parse_number(fields[6], &io[BACKGROUND].wchar) ||
+        !parse_number(fields[7], &io[BACKGROUND].read_bytes) ||
+        !parse_number(fields[8], &io[BACKGROUND].write_bytes) ||
+        !parse_number(fields[9], &io[FOREGROUND].fsync) ||
+        !parse_number(fields[10], &io[BACKGROUND].fsync)) {
         LOG(WARNING) << "Invalid task I/O stats: \"" << s << "\"";
         return false;
     }
-    comm = Join(std::vector<std::string>(
-                fields.begin() + 1, fields.end() - 11), ',');
+    comm = rest.substr(comm_pos + 1);
     return true;
 }
 
@@ -150,43 +191,56 @@ void get_uid_names(const vector<int>& uids, const vector<std::string*>& uid_name
 
 } // namespace
 
-std::unordered_map<uint32_t, uid_info> uid_monitor::get_uid_io_stats_locked()
+std::vector<uid_info> uid_monitor::get_uid_io_stats_locked()
 {
-    std::unordered_map<uint32_t, uid_info> uid_io_stats;
-    std::string buffer;
-    if (!ReadFileToString(UID_IO_STATS_PATH, &buffer)) {
+    std::vector<uid_info> uid_io_stats;
+    if (!ReadFileToString(UID_IO_STATS_PATH, &uid_io_buffer_)) {
         PLOG(ERROR) << UID_IO_STATS_PATH << ": ReadFileToString failed";
         return uid_io_stats;
     }
 
-    std::vector<std::string> io_stats = Split(std::move(buffer), "\n");
-    uid_info u;
-    vector<int> uids;
-    vector<std::string*> uid_names;
-
-    for (uint32_t i = 0; i < io_stats.size(); i++) {
-        if (io_stats[i].empty()) {
+    std::string_view rest = uid_io_buffer_;
+    // task lines belong to the uid line before them
+    bool in_uid = false;
+    while (!rest.empty()) {
+        std::string_view line = next_field(&rest, '\n');
+        if (line.empty()) {
             continue;
         }
 
-        if (io_stats[i].compare(0, 4, "task")) {
-            if (!u.parse_uid_io_stats(std::move(io_stats[i])))
-                continue;
-            uid_io_stats[u.uid] = u;
-            uid_io_stats[u.uid].name = std::to_string(u.uid);
-            uids.push_back(u.uid);
-            uid_names.push_back(&uid_io_stats[u.uid].name);
-            if (last_uid_io_stats_.find(u.uid) == last_uid_io_stats_.end()) {
-                refresh_uid_names = true;
-            } else {
-                uid_io_stats[u.uid].name = last_uid_io_stats_[u.uid].name;
+        if (line.compare(0, 4, "task")) {
+            uid_io_stats.emplace_back();
+            in_uid = uid_io_stats.back().parse_uid_io_stats(line);
+            if (!in_uid) {
+                uid_io_stats.pop_back();
             }
-        } else {
+        } else if (in_uid) {
             task_info t;
-            if (!t.parse_task_io_stats(std::move(io_stats[i])))
+            if (!t.parse_task_io_stats(line))
                 continue;
-            uid_io_stats[u.uid].tasks[t.pid] = t;
+            uid_io_stats.back().tasks[t.pid] = std::move(t);
+        }
+    }
+
+    std::sort(uid_io_stats.begin(), uid_io_stats.end(),
+              [](const uid_info& a, const uid_info& b) { return a.uid < b.uid; });
+
+    // Both lists are sorted, so known names are carried over in one pass.
+    vector<int> uids;
+    vector<std::string*> uid_names;
+    auto last = last_uid_io_stats_.cbegin();
+    for (auto& u : uid_io_stats) {
+        while (last != last_uid_io_stats_.cend() && last->uid < u.uid) {
+            ++last;
+        }
+        if (last != last_uid_io_stats_.cend() && last->uid == u.uid) {
+            u.name = last->name;
+        } else {
+            u.name = std::to_string(u.uid);
+            refresh_uid_names = true;
         }
+        uids.push_back(u.uid);
+        uid_names.push_back(&u.name);
     }
 
     if (!uids.empty() && refresh_uid_names) {
@@ -214,8 +268,10 @@ void uid_monitor::add_records_locked(uint64_t curr_ts)
 {
     // remove records more than 5 days old
     if (curr_ts > 5 * DAY_TO_SEC) {
-        auto it = io_history_.lower_bound(curr_ts - 5 * DAY_TO_SEC);
-        io_history_.erase(io_history_.begin(), it);
+        auto end = io_history_.lower_bound(curr_ts - 5 * DAY_TO_SEC);
+        for (auto it = io_history_.begin(); it != end; ) {
+            it = erase_records_locked(it);
+        }
     }
 
     struct uid_records new_records;
@@ -243,7 +299,19 @@ void uid_monitor::add_records_locked(uint64_t curr_ts)
     // make some room for new records
     maybe_shrink_history_for_items(new_records.entries.size());
 
-    io_history_[curr_ts] = new_records;
+    for (const auto& record : new_records.entries) {
+        changed_users_.insert(record.ios.user_id);
+    }
+    io_history_[curr_ts] = std::move(new_records);
+}
+
+std::map<uint64_t, struct uid_records>::iterator uid_monitor::erase_records_locked(
+    std::map<uint64_t, struct uid_records>::iterator it)
+{
+    for (const auto& record : it->second.entries) {
+        changed_users_.insert(record.ios.user_id);
+    }
+    return io_history_.erase(it);
 }
 
 void uid_monitor::maybe_shrink_history_for_items(size_t nitems) {
@@ -251,7 +319,7 @@ void uid_monitor::maybe_shrink_history_for_items(size_t nitems) {
     while (overflow > 0 && io_history_.size() > 0) {
         auto del_it = io_history_.begin();
         overflow -= del_it->second.entries.size();
-        io_history_.erase(io_history_.begin());
+        erase_records_locked(del_it);
     }
 }
 
@@ -259,7 +327,7 @@ std::map<uint64_t, struct uid_records> uid_monitor::dump(
     double hours, uint64_t threshold, bool force_report)
 {
     if (force_report) {
-        report(nullptr);
+        report();
     }
 
     Mutex::Autolock _l(uidm_mutex_);
@@ -300,70 +368,64 @@ std::map<uint64_t, struct uid_records> uid_monitor::dump(
     return dump_records;
 }
 
+namespace {
+
+const io_stats kNoIoStats[UID_STATS] = {};
+
+/* adds the bytes read and written since prev to usage, ignoring counters that went backwards */
+void add_io_delta(io_usage* usage, const io_stats* curr, const io_stats* prev,
+                  charger_stat_t charger_stat)
+{
+    for (int i = 0; i < UID_STATS; i++) {
+        int64_t rd_delta = curr[i].read_bytes - prev[i].read_bytes;
+        int64_t wr_delta = curr[i].write_bytes - prev[i].write_bytes;
+        usage->bytes[READ][i][charger_stat] += (rd_delta < 0) ? 0 : rd_delta;
+        usage->bytes[WRITE][i][charger_stat] += (wr_delta < 0) ? 0 : wr_delta;
+    }
+}
+
+} // namespace
+
 void uid_monitor::update_curr_io_stats_locked()
 {
-    std::unordered_map<uint32_t, uid_info> uid_io_stats =
-        get_uid_io_stats_locked();
+    std::vector<uid_info> uid_io_stats = get_uid_io_stats_locked();
     if (uid_io_stats.empty()) {
         return;
     }
 
-    for (const auto& it : uid_io_stats) {
-        const uid_info& uid = it.second;
-        if (curr_io_stats_.find(uid.name) == curr_io_stats_.end()) {
-            curr_io_stats_[uid.name] = {};
+    // Both lists are sorted by uid, so each uid's last stats are found in one pass.
+    auto last = last_uid_io_stats_.cbegin();
+    for (const uid_info& uid : uid_io_stats) {
+        while (last != last_uid_io_stats_.cend() && last->uid < uid.uid) {
+            ++last;
+        }
+        const uid_info* last_uid = nullptr;
+        if (last != last_uid_io_stats_.cend() && last->uid == uid.uid) {
+            last_uid = &*last;
         }
 
         struct uid_io_usage& usage = curr_io_stats_[uid.name];
         usage.user_id = multiuser_get_user_id(uid.uid);
-
-        int64_t fg_rd_delta = uid.io[FOREGROUND].read_bytes -
-            last_uid_io_stats_[uid.uid].io[FOREGROUND].read_bytes;
-        int64_t bg_rd_delta = uid.io[BACKGROUND].read_bytes -
-            last_uid_io_stats_[uid.uid].io[BACKGROUND].read_bytes;
-        int64_t fg_wr_delta = uid.io[FOREGROUND].write_bytes -
-            last_uid_io_stats_[uid.uid].io[FOREGROUND].write_bytes;
-        int64_t bg_wr_delta = uid.io[BACKGROUND].write_bytes -
-            last_uid_io_stats_[uid.uid].io[BACKGROUND].write_bytes;
-
-        usage.uid_ios.bytes[READ][FOREGROUND][charger_stat_] +=
-            (fg_rd_delta < 0) ? 0 : fg_rd_delta;
-        usage.uid_ios.bytes[READ][BACKGROUND][charger_stat_] +=
-            (bg_rd_delta < 0) ? 0 : bg_rd_delta;
-        usage.uid_ios.bytes[WRITE][FOREGROUND][charger_stat_] +=
-            (fg_wr_delta < 0) ? 0 : fg_wr_delta;
-        usage.uid_ios.bytes[WRITE][BACKGROUND][charger_stat_] +=
-            (bg_wr_delta < 0) ? 0 : bg_wr_delta;
+        add_io_delta(&usage.uid_ios, uid.io, last_uid ? last_uid->io : kNoIoStats,
+                     charger_stat_);
 
         for (const auto& task_it : uid.tasks) {
             const task_info& task = task_it.second;
-            const pid_t pid = task_it.first;
-            const std::string& comm = task_it.second.comm;
-            int64_t task_fg_rd_delta = task.io[FOREGROUND].read_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[FOREGROUND].read_bytes;
-            int64_t task_bg_rd_delta = task.io[BACKGROUND].read_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[BACKGROUND].read_bytes;
-            int64_t task_fg_wr_delta = task.io[FOREGROUND].write_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[FOREGROUND].write_bytes;
-            int64_t task_bg_wr_delta = task.io[BACKGROUND].write_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[BACKGROUND].write_bytes;
-
-            io_usage& task_usage = usage.task_ios[comm];
-            task_usage.bytes[READ][FOREGROUND][charger_stat_] +=
-                (task_fg_rd_delta < 0) ? 0 : task_fg_rd_delta;
-            task_usage.bytes[READ][BACKGROUND][charger_stat_] +=
-                (task_bg_rd_delta < 0) ? 0 : task_bg_rd_delta;
-            task_usage.bytes[WRITE][FOREGROUND][charger_stat_] +=
-                (task_fg_wr_delta < 0) ? 0 : task_fg_wr_delta;
-            task_usage.bytes[WRITE][BACKGROUND][charger_stat_] +=
-                (task_bg_wr_delta < 0) ? 0 : task_bg_wr_delta;
+            const io_stats* last_task_io = kNoIoStats;
+            if (last_uid) {
+                auto last_task = last_uid->tasks.find(task_it.first);
+                if (last_task != last_uid->tasks.end()) {
+                    last_task_io = last_task->second.io;
+                }
+            }
+            add_io_delta(&usage.task_ios[task.comm], task.io, last_task_io, charger_stat_);
         }
     }
 
-    last_uid_io_stats_ = uid_io_stats;
+    last_uid_io_stats_ = std::move(uid_io_stats);
 }
 
-void uid_monitor::report(unordered_map<int, StoragedProto>* protos)
+void uid_monitor::report()
 {
     if (!enabled()) return;
 
@@ -371,10 +433,20 @@ void uid_monitor::report(unordered_map<int, StoragedProto>* protos)
 
     update_curr_io_stats_locked();
     add_records_locked(time(NULL));
+}
+
+void uid_monitor::get_changed_uid_io_protos(unordered_map<int, StoragedProto>* protos)
+{
+    if (!enabled()) return;
 
-    if (protos) {
-        update_uid_io_proto(protos);
+    Mutex::Autolock _l(uidm_mutex_);
+
+    unordered_set<userid_t> users = std::move(changed_users_);
+    changed_users_.clear();
+    for (const auto& it : *protos) {
+        users.insert(it.first);
     }
+    update_uid_io_proto(protos, &users);
 }
 
 namespace {
@@ -405,7 +477,8 @@ void get_io_usage_proto(io_usage* usage, const IOUsage& io_proto)
 
 } // namespace
 
-void uid_monitor::update_uid_io_proto(unordered_map<int, StoragedProto>* protos)
+void uid_monitor::update_uid_io_proto(unordered_map<int, StoragedProto>* protos,
+                                      const unordered_set<userid_t>* users)
 {
     for (const auto& item : io_history_) {
         const uint64_t& end_ts = item.first;
@@ -414,6 +487,9 @@ void uid_monitor::update_uid_io_proto(unordered_map<int, StoragedProto>* protos)
 
         for (const auto& entry : recs.entries) {
             userid_t user_id = entry.ios.user_id;
+            if (users && users->find(user_id) == users->end()) {
+                continue;
+            }
             UidIOItem* item_proto = user_items[user_id];
             if (item_proto == nullptr) {
                 item_proto = (*protos)[user_id].mutable_uid_io_usage()
@@ -465,6 +541,9 @@ void uid_monitor::clear_user_history(userid_t user_id)
             it++;
         }
     }
+
+    // its proto file is removed along with the history
+    changed_users_.erase(user_id);
 }
 
 void uid_monitor::load_uid_io_proto(userid_t user_id, const UidIOUsage& uid_io_proto)
@@ -505,6 +584,7 @@ void uid_monitor::load_uid_io_proto(userid_t user_id, const UidIOUsage& uid_io_p
                     task_io_proto.ios());
             }
             recs->entries.push_back(record);
+            changed_users_.insert(record.ios.user_id);
         }
 
         // We already added items, so this will just cull down to the maximum
@@ -532,7 +612,9 @@ void uid_monitor::init(charger_stat_t stat)
     charger_stat_ = stat;
 
     start_ts_ = time(NULL);
-    last_uid_io_stats_ = get_uid_io_stats();
+
+    Mutex::Autolock _l(uidm_mutex_);
+    last_uid_io_stats_ = get_uid_io_stats_locked();
 }
 
 uid_monitor::uid_monitor()
@@ -370,6 +370,48 @@ TEST(storaged_test, disk_stats_monitor) {
     }
 }
 
+TEST(storaged_test, latency_histogram) {
+    latency_histogram h;
+    EXPECT_EQ(h.percentile_us(99), 0UL);
+
+    h.add(0, 10);         // bucket 0: < 1us
+    h.add(900, 80);       // bucket 10: < 1024us
+    h.add(5000, 9);       // bucket 13: < 8192us
+    h.add(200000000, 1);  // beyond the last bucket
+    EXPECT_EQ(h.count(), 100UL);
+    EXPECT_EQ(h.bucket(0), 10UL);
+    EXPECT_EQ(h.bucket(10), 80UL);
+    EXPECT_EQ(h.bucket(13), 9UL);
+    EXPECT_EQ(h.bucket(latency_histogram::BUCKETS - 1), 1UL);
+
+    EXPECT_EQ(h.percentile_us(5), 1UL);
+    EXPECT_EQ(h.percentile_us(50), 1024UL);
+    EXPECT_EQ(h.percentile_us(99), 8192UL);
+    EXPECT_EQ(h.percentile_us(100),
+              latency_histogram::bucket_limit_us(latency_histogram::BUCKETS - 1));
+}
+
+TEST(storaged_test, disk_stats_monitor_latency) {
+    disk_stats_monitor dsm(nullptr);
+
+    struct disk_stats stats = {};
+    dsm.update(&stats);
+
+    // 100 reads taking 200ms in total, 10 writes taking 50ms
+    stats.read_ios = 100;
+    stats.read_ticks = 200;
+    stats.write_ios = 10;
+    stats.write_ticks = 50;
+    dsm.update(&stats);
+
+    latency_histogram read, write;
+    dsm.get_latency(&read, &write);
+    EXPECT_EQ(read.count(), 100UL);
+    EXPECT_EQ(read.percentile_us(99), 2048UL);
+    EXPECT_EQ(write.count(), 10UL);
+    EXPECT_EQ(write.percentile_us(99), 8192UL);
+}
+
 TEST(storaged_test, storage_info_t) {
     storage_info_t si;
     time_point<steady_clock> tp;
@@ -697,3 +739,80 @@ TEST(storaged_test, load_uid_io_proto) {
     uidm.load_uid_io_proto(0, user_0);
     ASSERT_LE(io_history.size(), size_t(uid_monitor::MAX_UID_RECORDS_SIZE));
 }
+
+TEST(storaged_test, parse_uid_io_stats) {
+    uid_info u;
+    ASSERT_TRUE(u.parse_uid_io_stats("10001 1 2 3 4 5 6 7 8 9 10"));
+    EXPECT_EQ(u.uid, 10001U);
+    EXPECT_EQ(u.io[FOREGROUND].rchar, 1UL);
+    EXPECT_EQ(u.io[FOREGROUND].write_bytes, 4UL);
+    EXPECT_EQ(u.io[BACKGROUND].rchar, 5UL);
+    EXPECT_EQ(u.io[BACKGROUND].write_bytes, 8UL);
+    EXPECT_EQ(u.io[FOREGROUND].fsync, 9UL);
+    EXPECT_EQ(u.io[BACKGROUND].fsync, 10UL);
+
+    EXPECT_FALSE(u.parse_uid_io_stats("10001 1 2 3 4 5 6 7 8 9"));
+    EXPECT_FALSE(u.parse_uid_io_stats("10001 1 2 3 4 -5 6 7 8 9 10"));
+    EXPECT_FALSE(u.parse_uid_io_stats("10001 1 2 3 4 5x 6 7 8 9 10"));
+
+    task_info t;
+    ASSERT_TRUE(t.parse_task_io_stats("task,Binder,1,2,1234,1,2,3,4,5,6,7,8,9,10"));
+    EXPECT_EQ(t.comm, "Binder,1,2");
+    EXPECT_EQ(t.pid, 1234);
+    EXPECT_EQ(t.io[FOREGROUND].rchar, 1UL);
+    EXPECT_EQ(t.io[BACKGROUND].write_bytes, 8UL);
+    EXPECT_EQ(t.io[BACKGROUND].fsync, 10UL);
+
+    ASSERT_TRUE(t.parse_task_io_stats("task,,1234,1,2,3,4,5,6,7,8,9,10"));
+    EXPECT_EQ(t.comm, "");
+
+    EXPECT_FALSE(t.parse_task_io_stats("task,1234,1,2,3,4,5,6,7,8,9,10"));
+}
+
+TEST(storaged_test, changed_uid_io_protos) {
+    uid_monitor uidm;
+    if (!uidm.enabled()) GTEST_SKIP() << "/proc/uid_io/stats is not available";
+    auto& io_history = uidm.io_history();
+
+    io_history[200] = {
+        .start_ts = 100,
+        .entries = {
+            { "app1", {
+                .user_id = 0,
+                .uid_ios.bytes[WRITE][FOREGROUND][CHARGER_ON] = 1000,
+              }
+            },
+            { "app1", {
+                .user_id = 1,
+                .uid_ios.bytes[WRITE][FOREGROUND][CHARGER_ON] = 1000,
+              }
+            },
+        },
+    };
+
+    // Users whose history didn't change are only written if they're already being flushed.
+    unordered_map<int, StoragedProto> protos;
+    protos[0];
+    uidm.get_changed_uid_io_protos(&protos);
+    EXPECT_EQ(protos.size(), 1UL);
+    EXPECT_EQ(protos[0].uid_io_usage().uid_io_items_size(), 1);
+
+    // Loading a user's history counts as a change.
+    UidIOUsage user_1;
+    UidIOItem* item = user_1.add_uid_io_items();
+    item->set_end_ts(300);
+    UidRecord* record = item->mutable_records()->add_entries();
+    record->set_uid_name("app2");
+    record->set_user_id(1);
+    uidm.load_uid_io_proto(1, user_1);
+
+    protos.clear();
+    uidm.get_changed_uid_io_protos(&protos);
+    EXPECT_EQ(protos.size(), 1UL);
+    ASSERT_EQ(protos.count(1), 1UL);
+    EXPECT_EQ(protos[1].uid_io_usage().uid_io_items_size(), 2);
+
+    protos.clear();
+    uidm.get_changed_uid_io_protos(&protos);
+    EXPECT_TRUE(protos.empty());
+}
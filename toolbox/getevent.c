@@ -11,6 +11,7 @@
 #include <linux/input.h>
 #include <err.h>
 #include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 
 struct label {
@@ -37,6 +38,41 @@ static struct pollfd *ufds;
 static char **device_names;
 static int nfds;
 
+/* Number of events taken from a device per read() */
+#define EVENT_BATCH_SIZE 64
+
+/*
+ * Binary capture format written by -b: a header followed by one record per
+ * event. Fields are in host byte order. Timestamps are CLOCK_MONOTONIC as
+ * reported by the kernel. device is the index printed by "add device", which
+ * goes to stderr in this mode.
+ */
+#define BINARY_MAGIC "getevent"
+#define BINARY_VERSION 1
+
+struct binary_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+};
+
+struct binary_record {
+    uint64_t time_ns;
+    int32_t value;
+    uint16_t type;
+    uint16_t code;
+    uint32_t device;
+    uint32_t reserved;
+};
+
+static volatile sig_atomic_t stop_requested;
+
+static void request_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
 enum {
     PRINT_DEVICE_ERRORS     = 1U << 0,
     PRINT_DEVICE            = 1U << 1,
@@ -495,7 +531,7 @@ static int scan_dir(const char *dirname, int print_flags)
 
 static void usage(char *name)
 {
-    fprintf(stderr, "Usage: %s [-t] [-n] [-s switchmask] [-S] [-v [mask]] [-d] [-p] [-i] [-l] [-q] [-c count] [-r] [device]\n", name);
+    fprintf(stderr, "Usage: %s [-t] [-n] [-s switchmask] [-S] [-v [mask]] [-d] [-p] [-i] [-l] [-q] [-c count] [-r] [-b] [device]\n", name);
     fprintf(stderr, "    -t: show time stamps\n");
     fprintf(stderr, "    -n: don't print newlines\n");
     fprintf(stderr, "    -s: print switch states for given bits\n");
@@ -508,6 +544,7 @@ static void usage(char *name)
     fprintf(stderr, "    -q: quiet (clear verbosity mask)\n");
     fprintf(stderr, "    -c: print given number of events then exit\n");
     fprintf(stderr, "    -r: print rate events are received\n");
+    fprintf(stderr, "    -b: write events to stdout in a binary format, other output to stderr\n");
 }
 
 int getevent_main(int argc, char *argv[])
@@ -519,7 +556,7 @@ int getevent_main(int argc, char *argv[])
     int print_device = 0;
     char *newline = "\n";
     uint16_t get_switch = 0;
-    struct input_event event;
+    struct input_event events[EVENT_BATCH_SIZE];
     int print_flags = 0;
     int print_flags_set = 0;
     int dont_block = -1;
@@ -528,13 +565,11 @@ int getevent_main(int argc, char *argv[])
     int64_t last_sync_time = 0;
     const char *device = NULL;
     const char *device_path = "/dev/input";
-
-    /* disable buffering on stdout */
-    setbuf(stdout, NULL);
+    FILE *binary_out = NULL;
 
     opterr = 0;
     do {
-        c = getopt(argc, argv, "tns:Sv::dpilqc:rh");
+        c = getopt(argc, argv, "tns:Sv::dpilqc:rbh");
         if (c == EOF)
             break;
         switch (c) {
@@ -590,6 +625,9 @@ int getevent_main(int argc, char *argv[])
         case 'r':
             sync_rate = 1;
             break;
+        case 'b':
+            binary_out = stdout;
+            break;
         case '?':
             fprintf(stderr, "%s: invalid option -%c\n",
                 argv[0], optopt);
@@ -601,6 +639,34 @@ int getevent_main(int argc, char *argv[])
     if(dont_block == -1)
         dont_block = 0;
 
+    if(binary_out) {
+        /* Keep stdout for the capture and send everything printed to stderr. */
+        int fd = dup(STDOUT_FILENO);
+        if(fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0 ||
+                !(binary_out = fdopen(fd, "w"))) {
+            fprintf(stderr, "could not set up binary output, %s\n", strerror(errno));
+            return 1;
+        }
+        setvbuf(binary_out, NULL, _IOFBF, 64 * 1024);
+        struct binary_header header = {
+            .magic = BINARY_MAGIC,
+            .version = BINARY_VERSION,
+            .record_size = sizeof(struct binary_record),
+        };
+        fwrite(&header, sizeof(header), 1, binary_out);
+
+        /* Captures are usually ended with ^C; don't lose what is still buffered. */
+        struct sigaction sa = { .sa_handler = request_stop };
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
+    /*
+     * Output is flushed once per poll() wakeup instead of per printf, so
+     * high-rate devices don't pay a write() per field.
+     */
+    setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+
     if (optind + 1 == argc) {
         device = argv[optind];
         optind++;
@@ -652,40 +718,67 @@ int getevent_main(int argc, char *argv[])
     if(dont_block)
         return 0;
 
-    while(1) {
+    while(!stop_requested) {
+        fflush(stdout);
         //int pollres =
         poll(ufds, nfds, -1);
         //printf("poll %d, returned %d\n", nfds, pollres);
+        if(stop_requested)
+            break;
         if(ufds[0].revents & POLLIN) {
             read_notify(device_path, ufds[0].fd, print_flags);
         }
         for(i = 1; i < nfds; i++) {
             if(ufds[i].revents) {
                 if(ufds[i].revents & POLLIN) {
-                    res = read(ufds[i].fd, &event, sizeof(event));
-                    if(res < (int)sizeof(event)) {
+                    int j, count;
+
+                    /* evdev hands out as many whole events as fit. */
+                    res = read(ufds[i].fd, events, sizeof(events));
+                    if(res < (int)sizeof(events[0])) {
                         fprintf(stderr, "could not get evdev event, %s\n", strerror(errno));
                         return 1;
                     }
-                    if(get_time) {
-                        printf("[%8ld.%06ld] ", event.time.tv_sec, event.time.tv_usec);
-                    }
-                    if(print_device)
-                        printf("%s: ", device_names[i]);
-                    print_event(event.type, event.code, event.value, print_flags);
-                    if(sync_rate && event.type == 0 && event.code == 0) {
-                        int64_t now = event.time.tv_sec * 1000000LL + event.time.tv_usec;
-                        if(last_sync_time)
-                            printf(" rate %lld", 1000000LL / (now - last_sync_time));
-                        last_sync_time = now;
+                    count = res / sizeof(events[0]);
+                    for(j = 0; j < count; j++) {
+                        struct input_event *event = &events[j];
+                        if(binary_out) {
+                            struct binary_record record = {
+                                .time_ns = event->time.tv_sec * 1000000000ULL +
+                                           event->time.tv_usec * 1000ULL,
+                                .value = event->value,
+                                .type = event->type,
+                                .code = event->code,
+                                .device = i,
+                            };
+                            fwrite(&record, sizeof(record), 1, binary_out);
+                        } else {
+                            if(get_time) {
+                                printf("[%8ld.%06ld] ", event->time.tv_sec, event->time.tv_usec);
+                            }
+                            if(print_device)
+                                printf("%s: ", device_names[i]);
+                            print_event(event->type, event->code, event->value, print_flags);
+                            if(sync_rate && event->type == 0 && event->code == 0) {
+                                int64_t now = event->time.tv_sec * 1000000LL + event->time.tv_usec;
+                                if(last_sync_time)
+                                    printf(" rate %lld", 1000000LL / (now - last_sync_time));
+                                last_sync_time = now;
+                            }
+                            printf("%s", newline);
+                        }
+                        if(event_count && --event_count == 0) {
+                            if(binary_out)
+                                fflush(binary_out);
+                            return 0;
+                        }
                     }
-                    printf("%s", newline);
-                    if(event_count && --event_count == 0)
-                        return 0;
                 }
             }
         }
     }
 
+    if(binary_out)
+        fflush(binary_out);
     return 0;
 }
@@ -29,10 +29,14 @@
 #include <trusty/coverage/record.h>
 #include <trusty/coverage/tipc.h>
 #include <trusty/tipc.h>
+#include <algorithm>
 #include <iostream>
 
 #define COVERAGE_CLIENT_PORT "com.android.trusty.coverage.client"
 
+/* Granularity at which CollectCounts() tracks which counters need resetting */
+#define COUNTER_PAGE_SIZE 4096
+
 namespace android {
 namespace trusty {
 namespace coverage {
@@ -50,7 +54,8 @@ CoverageRecord::CoverageRecord(string tipc_dev, struct uuid* uuid)
       sancov_filename_(),
       record_len_(0),
       shm_(NULL),
-      shm_len_(0) {}
+      shm_len_(0),
+      counters_tracked_(false) {}
 
 CoverageRecord::CoverageRecord(string tipc_dev, struct uuid* uuid, string module_name)
     : tipc_dev_(std::move(tipc_dev)),
@@ -59,7 +64,8 @@ CoverageRecord::CoverageRecord(string tipc_dev, struct uuid* uuid, string module
       sancov_filename_(module_name + "." + to_string(getpid()) + ".sancov"),
       record_len_(0),
       shm_(NULL),
-      shm_len_(0) {}
+      shm_len_(0),
+      counters_tracked_(false) {}
 
 CoverageRecord::~CoverageRecord() {
     if (shm_) {
@@ -175,14 +181,53 @@ void CoverageRecord::ResetFullRecord() {
     }
 }
 
-void CoverageRecord::ResetCounts() {
+static void ZeroCounters(volatile uint8_t* begin, volatile uint8_t* end) {
+    for (volatile uint8_t* x = begin; x < end; x++) {
+        *x = 0;
+    }
+}
+
+static bool CountersAreZero(volatile uint8_t* begin, volatile uint8_t* end) {
+    for (; begin < end && (uintptr_t)begin % sizeof(uint64_t); begin++) {
+        if (*begin) {
+            return false;
+        }
+    }
+    for (; end - begin >= (ptrdiff_t)sizeof(uint64_t); begin += sizeof(uint64_t)) {
+        if (*(volatile uint64_t*)begin) {
+            return false;
+        }
+    }
+    for (; begin < end; begin++) {
+        if (*begin) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CoverageRecord::ResetCounts(volatile uint8_t* mirror, size_t mirror_len) {
     volatile uint8_t* begin = nullptr;
     volatile uint8_t* end = nullptr;
     GetRawCounts(&begin, &end);
 
-    for (volatile uint8_t* x = begin; x < end; x++) {
-        *x = 0;
+    if (!counters_tracked_) {
+        ZeroCounters(begin, end);
+        ZeroCounters(mirror, mirror + mirror_len);
+        return;
     }
+
+    size_t num_counters = end - begin;
+    for (size_t offset : dirty_counter_pages_) {
+        size_t len = std::min<size_t>(COUNTER_PAGE_SIZE, num_counters - offset);
+        ZeroCounters(begin + offset, begin + offset + len);
+        if (offset < mirror_len) {
+            len = std::min(len, mirror_len - offset);
+            ZeroCounters(mirror + offset, mirror + offset + len);
+        }
+    }
+    dirty_counter_pages_.clear();
+    counters_tracked_ = false;
 }
 
 void CoverageRecord::ResetPCs() {
@@ -268,6 +313,36 @@ uint64_t CoverageRecord::TotalEdgeCounts() {
     return counter;
 }
 
+size_t CoverageRecord::CollectCounts(volatile uint8_t* dst, size_t dst_len) {
+    volatile uint8_t* begin = NULL;
+    volatile uint8_t* end = NULL;
+
+    GetRawCounts(&begin, &end);
+    if (!begin || !end) {
+        return 0;
+    }
+
+    size_t num_counters = end - begin;
+    dirty_counter_pages_.clear();
+    for (size_t offset = 0; offset < num_counters; offset += COUNTER_PAGE_SIZE) {
+        size_t len = std::min<size_t>(COUNTER_PAGE_SIZE, num_counters - offset);
+        if (CountersAreZero(begin + offset, begin + offset + len)) {
+            continue;
+        }
+        dirty_counter_pages_.push_back(offset);
+
+        if (offset < dst_len) {
+            len = std::min(len, dst_len - offset);
+            for (size_t i = 0; i < len; i++) {
+                dst[offset + i] = begin[offset + i];
+            }
+        }
+    }
+    counters_tracked_ = true;
+
+    return num_counters;
+}
+
 Result<void> CoverageRecord::SaveSancovFile(const std::string& filename) {
     android::base::unique_fd output_fd(TEMP_FAILURE_RETRY(creat(filename.c_str(), 00644)));
     if (!output_fd.ok()) {
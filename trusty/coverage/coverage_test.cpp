@@ -20,6 +20,7 @@
 #include <trusty/tipc.h>
 #include <array>
 #include <memory>
+#include <vector>
 
 using android::base::unique_fd;
 using std::array;
@@ -61,6 +62,44 @@ TEST_F(CoverageTest, CoverageReset) {
     ASSERT_EQ(counter, 0);
 }
 
+TEST_F(CoverageTest, CollectAndResetCounts) {
+    unique_fd test_srv(tipc_connect(TIPC_DEV, TEST_SRV_PORT));
+    ASSERT_GE(test_srv, 0);
+
+    volatile uint8_t* begin = nullptr;
+    volatile uint8_t* end = nullptr;
+    record_->GetRawCounts(&begin, &end);
+    ASSERT_NE(begin, nullptr);
+    std::vector<uint8_t> mirror(end - begin);
+
+    for (int i = 0; i < 2; i++) {
+        record_->ResetCounts(mirror.data(), mirror.size());
+        ASSERT_EQ(record_->TotalEdgeCounts(), 0);
+
+        uint32_t msg = 0xdeadbeef;
+        int rc = write(test_srv, &msg, sizeof(msg));
+        ASSERT_EQ(rc, sizeof(msg));
+        rc = read(test_srv, &msg, sizeof(msg));
+        ASSERT_EQ(rc, sizeof(msg));
+
+        /* The collected copy must match the record exactly */
+        ASSERT_EQ(record_->CollectCounts(mirror.data(), mirror.size()), mirror.size());
+        uint64_t mirror_total = 0;
+        for (size_t j = 0; j < mirror.size(); j++) {
+            ASSERT_EQ(mirror[j], begin[j]);
+            mirror_total += mirror[j];
+        }
+        ASSERT_EQ(mirror_total, record_->TotalEdgeCounts());
+        ASSERT_GT(mirror_total, 0);
+    }
+
+    record_->ResetCounts(mirror.data(), mirror.size());
+    ASSERT_EQ(record_->TotalEdgeCounts(), 0);
+    for (uint8_t count : mirror) {
+        ASSERT_EQ(count, 0);
+    }
+}
+
 TEST_F(CoverageTest, TestServerCoverage) {
     unique_fd test_srv(tipc_connect(TIPC_DEV, TEST_SRV_PORT));
     ASSERT_GE(test_srv, 0);
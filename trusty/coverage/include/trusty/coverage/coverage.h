@@ -18,6 +18,7 @@
 
 #include <optional>
 #include <string>
+#include <vector>
 
 #include <android-base/result.h>
 #include <android-base/unique_fd.h>
@@ -49,13 +50,28 @@ class CoverageRecord {
     Result<void> Open();
     bool IsOpen();
     void ResetFullRecord();
-    void ResetCounts();
+    /**
+     * Zero the 8-bit counters. If CollectCounts() ran since the last reset,
+     * only the pages it found non-zero are cleared. Otherwise the whole counter
+     * region is cleared. The same bytes of |mirror| are cleared too, if given.
+     */
+    void ResetCounts(volatile uint8_t* mirror = nullptr, size_t mirror_len = 0);
     void ResetPCs();
     void GetRawData(volatile void** begin, volatile void** end);
     void GetRawCounts(volatile uint8_t** begin, volatile uint8_t** end);
     void GetRawPCs(volatile uintptr_t** begin, volatile uintptr_t** end);
     uint64_t TotalEdgeCounts();
 
+    /**
+     * Copy the 8-bit counters into |dst|, which holds |dst_len| counters, and
+     * return the number of counters in the record. Pages that hold only zero
+     * counters are skipped, so |dst| should be zero outside of them, e.g.
+     * because it was passed as the mirror to the previous ResetCounts(). The
+     * non-zero pages are remembered so that the next ResetCounts() only touches
+     * those.
+     */
+    size_t CollectCounts(volatile uint8_t* dst, size_t dst_len);
+
     /**
      * Save the current set of observed PCs to the given filename.
      * The resulting .sancov file can be parsed via the LLVM sancov tool to see
@@ -75,6 +91,9 @@ class CoverageRecord {
     size_t record_len_;
     volatile void* shm_;
     size_t shm_len_;
+    /* Offsets into the counter region of pages seen non-zero by CollectCounts() */
+    std::vector<size_t> dirty_counter_pages_;
+    bool counters_tracked_;
 };
 
 }  // namespace coverage
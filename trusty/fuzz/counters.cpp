@@ -63,27 +63,23 @@ void ExtraCounters::Reset() {
     if (!record_->IsOpen()) {
         return;
     }
-    record_->ResetCounts();
-    memset_explicit(const_cast<uint8_t*>(counters), 0, sizeof(counters));
+    record_->ResetCounts(counters, sizeof(counters));
 }
 
 void ExtraCounters::Flush() {
-    volatile uint8_t* begin = NULL;
-    volatile uint8_t* end = NULL;
-
-    record_->GetRawCounts(&begin, &end);
-    if (!begin || !end) {
+    /*
+     * Only the counter pages the TA touched are copied. The rest of the section
+     * was cleared by Reset(), which in turn only has to clear the pages copied
+     * here.
+     */
+    size_t num_counters = record_->CollectCounts(counters, kMaxNumCounters);
+    if (!num_counters) {
         ALOGE("Could not get raw counts from coverage record\n");
         return;
     }
 
-    size_t num_counters = end - begin;
     if (num_counters > kMaxNumCounters) {
         ALOGE("Too many counters (%zu) to fit in the extra counters section!\n", num_counters);
-        num_counters = kMaxNumCounters;
-    }
-    for (size_t i = 0; i < num_counters; i++) {
-        *(counters + i) = *(begin + i);
     }
 }
 
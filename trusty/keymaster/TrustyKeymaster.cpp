@@ -24,7 +24,7 @@
 
 namespace keymaster {
 
-int TrustyKeymaster::Initialize(KmVersion version) {
+int TrustyKeymaster::Initialize(KmVersion version, int channels) {
     int err;
 
     LOG(INFO) << "Initializing TrustyKeymaster as KmVersion: " << (int)version;
@@ -89,6 +89,11 @@ int TrustyKeymaster::Initialize(KmVersion version) {
         // Don't fail if this message isn't understood.
     }
 
+    if (channels > 1) {
+        int opened = trusty_keymaster_connect_channels(channels);
+        LOG(INFO) << "Using " << opened << " channels to trusty keymaster";
+    }
+
     return 0;
 }
 
@@ -99,9 +104,10 @@ TrustyKeymaster::~TrustyKeymaster() {
 }
 
 static void ForwardCommand(enum keymaster_command command, const KeymasterMessage& req,
-                           KeymasterResponse* rsp) {
+                           KeymasterResponse* rsp, int* channel = nullptr) {
+    int any_channel = TRUSTY_KEYMASTER_ANY_CHANNEL;
     keymaster_error_t err;
-    err = trusty_keymaster_send(command, req, rsp);
+    err = trusty_keymaster_send_on(channel ? channel : &any_channel, command, req, rsp);
     if (err != KM_ERROR_OK) {
         LOG(ERROR) << "Cmd " << command << " returned error: " << err;
         rsp->error = err;
@@ -223,24 +229,49 @@ void TrustyKeymaster::DestroyAttestationIds(const DestroyAttestationIdsRequest&
     ForwardCommand(KM_DESTROY_ATTESTATION_IDS, request, response);
 }
 
+int TrustyKeymaster::OperationChannel(keymaster_operation_handle_t op_handle) {
+    std::lock_guard<std::mutex> lock(op_channels_lock_);
+    auto it = op_channels_.find(op_handle);
+    return it == op_channels_.end() ? TRUSTY_KEYMASTER_ANY_CHANNEL : it->second;
+}
+
+void TrustyKeymaster::ReleaseOperationChannel(keymaster_operation_handle_t op_handle) {
+    std::lock_guard<std::mutex> lock(op_channels_lock_);
+    op_channels_.erase(op_handle);
+}
+
 void TrustyKeymaster::BeginOperation(const BeginOperationRequest& request,
                                      BeginOperationResponse* response) {
-    ForwardCommand(KM_BEGIN_OPERATION, request, response);
+    int channel = TRUSTY_KEYMASTER_ANY_CHANNEL;
+    ForwardCommand(KM_BEGIN_OPERATION, request, response, &channel);
+    if (response->error == KM_ERROR_OK) {
+        std::lock_guard<std::mutex> lock(op_channels_lock_);
+        op_channels_[response->op_handle] = channel;
+    }
 }
 
 void TrustyKeymaster::UpdateOperation(const UpdateOperationRequest& request,
                                       UpdateOperationResponse* response) {
-    ForwardCommand(KM_UPDATE_OPERATION, request, response);
+    int channel = OperationChannel(request.op_handle);
+    ForwardCommand(KM_UPDATE_OPERATION, request, response, &channel);
+    // The TA drops an operation on any update error.
+    if (response->error != KM_ERROR_OK) {
+        ReleaseOperationChannel(request.op_handle);
+    }
 }
 
 void TrustyKeymaster::FinishOperation(const FinishOperationRequest& request,
                                       FinishOperationResponse* response) {
-    ForwardCommand(KM_FINISH_OPERATION, request, response);
+    int channel = OperationChannel(request.op_handle);
+    ForwardCommand(KM_FINISH_OPERATION, request, response, &channel);
+    ReleaseOperationChannel(request.op_handle);
 }
 
 void TrustyKeymaster::AbortOperation(const AbortOperationRequest& request,
                                      AbortOperationResponse* response) {
-    ForwardCommand(KM_ABORT_OPERATION, request, response);
+    int channel = OperationChannel(request.op_handle);
+    ForwardCommand(KM_ABORT_OPERATION, request, response, &channel);
+    ReleaseOperationChannel(request.op_handle);
 }
 
 GetHmacSharingParametersResponse TrustyKeymaster::GetHmacSharingParameters() {
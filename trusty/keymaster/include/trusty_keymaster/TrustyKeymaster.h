@@ -17,6 +17,9 @@
 #ifndef TRUSTY_KEYMASTER_H_
 #define TRUSTY_KEYMASTER_H_
 
+#include <mutex>
+#include <unordered_map>
+
 #include <keymaster/android_keymaster_messages.h>
 
 namespace keymaster {
@@ -25,7 +28,9 @@ class TrustyKeymaster {
   public:
     TrustyKeymaster();
     ~TrustyKeymaster();
-    int Initialize(KmVersion version);
+    // |channels| > 1 opens extra connections to the TA so that requests from several binder
+    // threads can be in flight at once.
+    int Initialize(KmVersion version, int channels = 1);
     void GetVersion(const GetVersionRequest& request, GetVersionResponse* response);
     void SupportedAlgorithms(const SupportedAlgorithmsRequest& request,
                              SupportedAlgorithmsResponse* response);
@@ -75,7 +80,15 @@ class TrustyKeymaster {
     uint32_t message_version() const { return message_version_; }
 
   private:
+    int OperationChannel(keymaster_operation_handle_t op_handle);
+    void ReleaseOperationChannel(keymaster_operation_handle_t op_handle);
+
     uint32_t message_version_;
+
+    // Channel that carried each live operation's BeginOperation, so that its Update/Finish/Abort
+    // requests follow it.
+    std::mutex op_channels_lock_;
+    std::unordered_map<keymaster_operation_handle_t, int> op_channels_;
 };
 
 }  // namespace keymaster
@@ -26,7 +26,16 @@ const uint32_t TRUSTY_KEYMASTER_RECV_BUF_SIZE = 2 * 4096;
 const uint32_t TRUSTY_KEYMASTER_SEND_BUF_SIZE =
         (4096 - sizeof(struct keymaster_message) - 16 /* tipc header */);
 
+const int TRUSTY_KEYMASTER_MAX_CHANNELS = 8;
+const int TRUSTY_KEYMASTER_ANY_CHANNEL = -1;
+
 int trusty_keymaster_connect(void);
+/*
+ * Opens additional connections to the keymaster TA so that up to |count| requests can be in flight
+ * from different threads. Must be called after trusty_keymaster_connect(). Returns the number of
+ * channels actually open, which is at least 1.
+ */
+int trusty_keymaster_connect_channels(int count);
 int trusty_keymaster_call(uint32_t cmd, void* in, uint32_t in_size, uint8_t* out,
                           uint32_t* out_size);
 void trusty_keymaster_disconnect(void);
@@ -34,6 +43,14 @@ void trusty_keymaster_disconnect(void);
 keymaster_error_t translate_error(int err);
 keymaster_error_t trusty_keymaster_send(uint32_t command, const keymaster::Serializable& req,
                                         keymaster::KeymasterResponse* rsp);
+/*
+ * Like trusty_keymaster_send(), but on a specific channel. If |*channel| is
+ * TRUSTY_KEYMASTER_ANY_CHANNEL it is set to the channel that carried the request, so that later
+ * requests for the same operation can be sent on it.
+ */
+keymaster_error_t trusty_keymaster_send_on(int* channel, uint32_t command,
+                                           const keymaster::Serializable& req,
+                                           keymaster::KeymasterResponse* rsp);
 
 __END_DECLS
 
@@ -26,6 +26,8 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <variant>
 #include <vector>
 
@@ -38,21 +40,76 @@
 
 #define TRUSTY_DEVICE_NAME "/dev/trusty-ipc-dev0"
 
-static int handle_ = -1;
+// Each channel carries one request/response exchange at a time, so callers on different binder
+// threads only contend when every channel is busy. Channel 0 is always the primary connection;
+// the rest are opened by trusty_keymaster_connect_channels().
+struct keymaster_channel {
+    std::mutex lock;
+    int handle = -1;
+};
+
+static keymaster_channel channels_[TRUSTY_KEYMASTER_MAX_CHANNELS];
+static std::atomic<int> num_channels_ = 1;
+static std::atomic<unsigned int> next_channel_ = 0;
 
 static const int timeout_ms = 10 * 1000;
 static const int max_timeout_ms = 60 * 1000;
 
-int trusty_keymaster_connect() {
+static int connect_channel(keymaster_channel* channel) {
     int rc = tipc_connect(TRUSTY_DEVICE_NAME, KEYMASTER_PORT);
     if (rc < 0) {
         return rc;
     }
 
-    handle_ = rc;
+    channel->handle = rc;
     return 0;
 }
 
+static void disconnect_channel(keymaster_channel* channel) {
+    if (channel->handle >= 0) {
+        tipc_close(channel->handle);
+    }
+    channel->handle = -1;
+}
+
+int trusty_keymaster_connect() {
+    std::lock_guard<std::mutex> lock(channels_[0].lock);
+    return connect_channel(&channels_[0]);
+}
+
+int trusty_keymaster_connect_channels(int count) {
+    count = std::clamp(count, 1, TRUSTY_KEYMASTER_MAX_CHANNELS);
+
+    int opened = 1;
+    for (; opened < count; opened++) {
+        std::lock_guard<std::mutex> lock(channels_[opened].lock);
+        int rc = connect_channel(&channels_[opened]);
+        if (rc < 0) {
+            ALOGW("failed to open keymaster channel %d: %d", opened, rc);
+            break;
+        }
+    }
+
+    num_channels_ = opened;
+    return opened;
+}
+
+// Returns the index of a channel whose lock is held by the caller. An idle channel is preferred;
+// if all are busy, waits on the next one in round-robin order.
+static int acquire_channel() {
+    int count = num_channels_;
+    int start = next_channel_++ % count;
+    for (int i = 0; i < count; i++) {
+        int channel = (start + i) % count;
+        if (channels_[channel].lock.try_lock()) {
+            return channel;
+        }
+    }
+
+    channels_[start].lock.lock();
+    return start;
+}
+
 class VectorEraser {
   public:
     VectorEraser(std::vector<uint8_t>* v) : _v(v) {}
@@ -72,9 +129,10 @@ class VectorEraser {
     std::vector<uint8_t>* _v;
 };
 
-std::variant<int, std::vector<uint8_t>> trusty_keymaster_call_2(uint32_t cmd, void* in,
-                                                                uint32_t in_size) {
-    if (handle_ < 0) {
+// Must be called with the channel lock held.
+static std::variant<int, std::vector<uint8_t>> trusty_keymaster_call_locked(
+        int handle, uint32_t cmd, void* in, uint32_t in_size) {
+    if (handle < 0) {
         ALOGE("not connected\n");
         return -EINVAL;
     }
@@ -94,7 +152,7 @@ std::variant<int, std::vector<uint8_t>> trusty_keymaster_call_2(uint32_t cmd, vo
     int poll_timeout_ms = timeout_ms;
     while (true) {
         struct pollfd pfd;
-        pfd.fd = handle_;
+        pfd.fd = handle;
         pfd.events = POLLOUT;
         pfd.revents = 0;
 
@@ -116,7 +174,7 @@ std::variant<int, std::vector<uint8_t>> trusty_keymaster_call_2(uint32_t cmd, vo
         break;
     }
 
-    ssize_t rc = write(handle_, msg, msg_size);
+    ssize_t rc = write(handle, msg, msg_size);
     if (timed_out) {
         ALOGW("write for cmd %d finished after %lld nsecs", cmd,
               (long long)(systemTime(SYSTEM_TIME_MONOTONIC) - start_time_ns));
@@ -163,7 +221,7 @@ std::variant<int, std::vector<uint8_t>> trusty_keymaster_call_2(uint32_t cmd, vo
         poll_timeout_ms = timeout_ms;
         while (true) {
             struct pollfd pfd;
-            pfd.fd = handle_;
+            pfd.fd = handle;
             pfd.events = POLLIN;
             pfd.revents = 0;
 
@@ -184,7 +242,7 @@ std::variant<int, std::vector<uint8_t>> trusty_keymaster_call_2(uint32_t cmd, vo
             }
             break;
         }
-        rc = readv(handle_, iov, 2);
+        rc = readv(handle, iov, 2);
         if (timed_out) {
             ALOGW("readv for cmd %d finished after %lld nsecs", cmd,
                   (long long)(systemTime(SYSTEM_TIME_MONOTONIC) - start_time_ns));
@@ -215,6 +273,13 @@ std::variant<int, std::vector<uint8_t>> trusty_keymaster_call_2(uint32_t cmd, vo
     return out;
 }
 
+std::variant<int, std::vector<uint8_t>> trusty_keymaster_call_2(uint32_t cmd, void* in,
+                                                                uint32_t in_size) {
+    int channel = acquire_channel();
+    std::lock_guard<std::mutex> lock(channels_[channel].lock, std::adopt_lock);
+    return trusty_keymaster_call_locked(channels_[channel].handle, cmd, in, in_size);
+}
+
 int trusty_keymaster_call(uint32_t cmd, void* in, uint32_t in_size, uint8_t* out,
                           uint32_t* out_size) {
     auto result = trusty_keymaster_call_2(cmd, in, in_size);
@@ -237,10 +302,11 @@ int trusty_keymaster_call(uint32_t cmd, void* in, uint32_t in_size, uint8_t* out
 }
 
 void trusty_keymaster_disconnect() {
-    if (handle_ >= 0) {
-        tipc_close(handle_);
+    for (auto& channel : channels_) {
+        std::lock_guard<std::mutex> lock(channel.lock);
+        disconnect_channel(&channel);
     }
-    handle_ = -1;
+    num_channels_ = 1;
 }
 
 keymaster_error_t translate_error(int err) {
@@ -276,6 +342,13 @@ keymaster_error_t translate_error(int err) {
 
 keymaster_error_t trusty_keymaster_send(uint32_t command, const keymaster::Serializable& req,
                                         keymaster::KeymasterResponse* rsp) {
+    int channel = TRUSTY_KEYMASTER_ANY_CHANNEL;
+    return trusty_keymaster_send_on(&channel, command, req, rsp);
+}
+
+keymaster_error_t trusty_keymaster_send_on(int* channel, uint32_t command,
+                                           const keymaster::Serializable& req,
+                                           keymaster::KeymasterResponse* rsp) {
     uint32_t req_size = req.SerializedSize();
     if (req_size > TRUSTY_KEYMASTER_SEND_BUF_SIZE) {
         ALOGE("Request too big: %u Max size: %u", req_size, TRUSTY_KEYMASTER_SEND_BUF_SIZE);
@@ -286,8 +359,19 @@ keymaster_error_t trusty_keymaster_send(uint32_t command, const keymaster::Seria
     keymaster::Eraser send_buf_eraser(send_buf, TRUSTY_KEYMASTER_SEND_BUF_SIZE);
     req.Serialize(send_buf, send_buf + req_size);
 
+    if (*channel >= num_channels_) {
+        *channel = TRUSTY_KEYMASTER_ANY_CHANNEL;
+    }
+    if (*channel < 0) {
+        *channel = acquire_channel();
+    } else {
+        channels_[*channel].lock.lock();
+    }
+    std::unique_lock<std::mutex> lock(channels_[*channel].lock, std::adopt_lock);
+
     // Send it
-    auto response = trusty_keymaster_call_2(command, send_buf, req_size);
+    auto response =
+            trusty_keymaster_call_locked(channels_[*channel].handle, command, send_buf, req_size);
     if (auto response_buffer = std::get_if<std::vector<uint8_t>>(&response)) {
         keymaster::Eraser response_buffer_erasor(response_buffer->data(), response_buffer->size());
         ALOGV("Received %zu byte response\n", response_buffer->size());
@@ -304,8 +388,8 @@ keymaster_error_t trusty_keymaster_send(uint32_t command, const keymaster::Seria
     } else {
         auto rc = std::get<int>(response);
         // Reset the connection on tipc error
-        trusty_keymaster_disconnect();
-        trusty_keymaster_connect();
+        disconnect_channel(&channels_[*channel]);
+        connect_channel(&channels_[*channel]);
         ALOGE("tipc error: %d\n", rc);
         // TODO(swillden): Distinguish permanent from transient errors and set error_ appropriately.
         return translate_error(rc);
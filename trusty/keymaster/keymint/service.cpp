@@ -29,6 +29,9 @@ using aidl::android::hardware::security::keymint::trusty::TrustyRemotelyProvisio
 using aidl::android::hardware::security::secureclock::trusty::TrustySecureClock;
 using aidl::android::hardware::security::sharedsecret::trusty::TrustySharedSecret;
 
+// Number of connections to the keymint TA, and so of binder threads serving requests.
+static const int kKeyMintChannels = 4;
+
 template <typename T, class... Args>
 std::shared_ptr<T> addService(Args&&... args) {
     std::shared_ptr<T> service = ndk::SharedRefBase::make<T>(std::forward<Args>(args)...);
@@ -41,15 +44,15 @@ std::shared_ptr<T> addService(Args&&... args) {
 
 int main() {
     auto trustyKeymaster = std::make_shared<keymaster::TrustyKeymaster>();
-    int err = trustyKeymaster->Initialize(keymaster::KmVersion::KEYMINT_3);
+    int err = trustyKeymaster->Initialize(keymaster::KmVersion::KEYMINT_3, kKeyMintChannels);
     if (err != 0) {
         LOG(FATAL) << "Could not initialize TrustyKeymaster for KeyMint (" << err << ")";
         return -1;
     }
 
-    // Zero threads seems like a useless pool but below we'll join this thread to it, increasing
-    // the pool size to 1.
-    ABinderProcess_setThreadPoolMaxThreadCount(0);
+    // Below we'll join this thread to the pool, so one fewer thread than there are channels to the
+    // TA lets every channel carry a request at once.
+    ABinderProcess_setThreadPoolMaxThreadCount(kKeyMintChannels - 1);
 
     auto keyMint = addService<TrustyKeyMintDevice>(trustyKeymaster);
     auto secureClock = addService<TrustySecureClock>(trustyKeymaster);
@@ -21,6 +21,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
 #include <sys/uio.h>
 #include <trusty/ipc.h>
 
@@ -28,6 +29,70 @@ int tipc_connect(const char *dev_name, const char *srv_name);
 ssize_t tipc_send(int fd, const struct iovec* iov, int iovcnt, struct trusty_shm* shm, int shmcnt);
 int tipc_close(int fd);
 
+/**
+ * struct tipc_shm_buf - A dma-buf shared with Trusty, mapped for in-place use
+ * @fd:   dma-buf fd, as sent in &struct trusty_shm
+ * @addr: Mapping of the whole buffer
+ * @size: Size of the buffer in bytes
+ *
+ * Fill @addr directly and send the buffer with tipc_send_shm() instead of
+ * copying large payloads through tipc_send() iovecs.
+ */
+struct tipc_shm_buf {
+    int fd;
+    void* addr;
+    size_t size;
+};
+
+/* A set of equally sized &struct tipc_shm_buf, allocated and mapped once */
+struct tipc_shm_pool;
+
+/**
+ * tipc_shm_pool_create() - Allocate a pool of shared memory buffers
+ * @buf_size:  Size of each buffer, rounded up to the page size
+ * @buf_count: Number of buffers
+ *
+ * Buffers come from the dma-buf "system" heap and stay mapped until the pool
+ * is destroyed, so reusing them costs neither an allocation nor an mmap.
+ *
+ * Return: the pool, or NULL with errno set.
+ */
+struct tipc_shm_pool* tipc_shm_pool_create(size_t buf_size, size_t buf_count);
+
+/**
+ * tipc_shm_pool_destroy() - Unmap and free all buffers of @pool
+ * @pool: Pool from tipc_shm_pool_create(). All buffers must have been put back.
+ */
+void tipc_shm_pool_destroy(struct tipc_shm_pool* pool);
+
+/**
+ * tipc_shm_pool_get() - Take a free buffer from @pool
+ * @pool: Pool from tipc_shm_pool_create()
+ *
+ * Safe to call from multiple threads.
+ *
+ * Return: a buffer, or NULL if all are in use.
+ */
+struct tipc_shm_buf* tipc_shm_pool_get(struct tipc_shm_pool* pool);
+
+/**
+ * tipc_shm_pool_put() - Return @buf to @pool
+ * @pool: Pool @buf was taken from
+ * @buf:  Buffer that Trusty no longer uses
+ */
+void tipc_shm_pool_put(struct tipc_shm_pool* pool, struct tipc_shm_buf* buf);
+
+/**
+ * tipc_send_shm() - Send a message along with a shared buffer
+ * @fd:     Connection from tipc_connect()
+ * @iov:    Optional inline message data, may be NULL
+ * @iovcnt: Number of elements in @iov
+ * @buf:    Buffer to share, see &enum transfer_kind TRUSTY_SHARE
+ *
+ * Return: as tipc_send().
+ */
+ssize_t tipc_send_shm(int fd, const struct iovec* iov, int iovcnt, const struct tipc_shm_buf* buf);
+
 #ifdef __cplusplus
 }
 #endif
@@ -66,6 +66,7 @@ static const char *closer3_name = "com.android.ipc-unittest.srv.closer3";
 static const char *main_ctrl_name = "com.android.ipc-unittest.ctrl";
 static const char* receiver_name = "com.android.trusty.memref.receiver";
 static const size_t memref_chunk_size = 4096;
+static const size_t memref_num_chunks = 10;
 
 static const char* _sopts = "hsvDS:t:r:m:b:B:";
 /* clang-format off */
@@ -118,6 +119,7 @@ static const char* usage_long =
         "   writev       - writev test\n"
         "   readv        - readv test\n"
         "   send-fd      - transmit dma_buf to trusty, use as shm\n"
+        "   send-fd-pool - like send-fd, reusing a buffer from a pool\n"
         "\n";
 
 struct tipc_test_params {
@@ -909,7 +911,7 @@ static int send_fd_test(const struct tipc_test_params* params) {
     volatile char* buf = MAP_FAILED;
     BufferAllocator* allocator = NULL;
 
-    const size_t num_chunks = 10;
+    const size_t num_chunks = memref_num_chunks;
 
     fd = tipc_connect(params->dev_name, receiver_name);
     if (fd < 0) {
@@ -978,6 +980,69 @@ cleanup:
     return ret;
 }
 
+/*
+ * Same exchange as send_fd_test, but the buffer comes from a pool that lives
+ * across iterations, so with --bench this measures the transfer without the
+ * per-call dma-buf allocation and mapping.
+ */
+static int send_fd_pool_test(const struct tipc_test_params* params) {
+    static struct tipc_shm_pool* pool = NULL;
+    struct tipc_shm_buf* shm_buf = NULL;
+    int ret;
+    int fd = -1;
+
+    if (!pool) {
+        pool = tipc_shm_pool_create(memref_chunk_size * memref_num_chunks, 1);
+        if (!pool) {
+            fprintf(stderr, "Failed to create shm pool: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+
+    fd = tipc_connect(params->dev_name, receiver_name);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to connect to test support TA - is it missing?\n");
+        return -1;
+    }
+
+    shm_buf = tipc_shm_pool_get(pool);
+    if (!shm_buf) {
+        fprintf(stderr, "No free buffer in shm pool\n");
+        ret = -1;
+        goto cleanup;
+    }
+    volatile char* buf = shm_buf->addr;
+
+    /* the pooled buffer still holds the previous reply */
+    memset(shm_buf->addr, 0, shm_buf->size);
+    strcpy((char*)buf, "From NS");
+
+    ssize_t rc = tipc_send_shm(fd, NULL, 0, shm_buf);
+    if (rc < 0) {
+        fprintf(stderr, "tipc_send_shm failed: %zd\n", rc);
+        ret = rc;
+        goto cleanup;
+    }
+    char c;
+    read(fd, &c, 1);
+
+    ret = 0;
+    for (size_t skip = 0; skip < memref_num_chunks; skip++) {
+        int cmp = strcmp("Hello from Trusty!",
+                         (const char*)&buf[skip * memref_chunk_size]) ? (-1) : 0;
+        if (cmp)
+            fprintf(stderr, "Failed: Unexpected content at page %zu in dmabuf\n", skip);
+        ret |= cmp;
+    }
+
+cleanup:
+    if (shm_buf) {
+        tipc_shm_pool_put(pool, shm_buf);
+    }
+    tipc_close(fd);
+    return ret;
+}
+
 uint64_t get_time_us(void) {
     struct timespec spec;
 
@@ -1001,6 +1066,7 @@ static const struct tipc_test_def tipc_tests[] = {
         {"writev", writev_test},
         {"readv", readv_test},
         {"send-fd", send_fd_test},
+        {"send-fd-pool", send_fd_pool_test},
 };
 
 tipc_test_func_t get_test_function(const struct tipc_test_params* params) {
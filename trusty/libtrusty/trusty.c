@@ -18,16 +18,21 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/dma-heap.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include <log/log.h>
 
-#include <trusty/ipc.h>
+#include <trusty/tipc.h>
+
+#define DMA_HEAP_SYSTEM "/dev/dma_heap/system"
 
 int tipc_connect(const char* dev_name, const char* srv_name) {
     int fd;
@@ -68,6 +73,139 @@ ssize_t tipc_send(int fd, const struct iovec* iov, int iovcnt, struct trusty_shm
     return rc;
 }
 
-void tipc_close(int fd) {
-    close(fd);
+int tipc_close(int fd) {
+    return close(fd);
+}
+
+ssize_t tipc_send_shm(int fd, const struct iovec* iov, int iovcnt,
+                      const struct tipc_shm_buf* buf) {
+    struct trusty_shm shm = {
+            .fd = buf->fd,
+            .transfer = TRUSTY_SHARE,
+    };
+    return tipc_send(fd, iov, iovcnt, &shm, 1);
+}
+
+struct tipc_shm_pool {
+    pthread_mutex_t lock;
+    size_t count;
+    struct tipc_shm_buf* bufs;
+    bool* in_use;
+};
+
+static int alloc_shm_buf(int heap_fd, size_t size, struct tipc_shm_buf* buf) {
+    struct dma_heap_allocation_data data = {
+            .len = size,
+            .fd_flags = O_RDWR | O_CLOEXEC,
+    };
+
+    int rc = TEMP_FAILURE_RETRY(ioctl(heap_fd, DMA_HEAP_IOCTL_ALLOC, &data));
+    if (rc < 0) {
+        rc = -errno;
+        ALOGE("%s: failed to allocate %zu byte dma-buf: %s\n", __func__, size, strerror(errno));
+        return rc;
+    }
+
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, data.fd, 0);
+    if (addr == MAP_FAILED) {
+        rc = -errno;
+        ALOGE("%s: failed to map dma-buf: %s\n", __func__, strerror(errno));
+        close(data.fd);
+        return rc;
+    }
+
+    buf->fd = data.fd;
+    buf->addr = addr;
+    buf->size = size;
+    return 0;
+}
+
+struct tipc_shm_pool* tipc_shm_pool_create(size_t buf_size, size_t buf_count) {
+    int heap_fd;
+    int saved_errno;
+    size_t page_size = getpagesize();
+    buf_size = (buf_size + page_size - 1) & ~(page_size - 1);
+    if (!buf_size || !buf_count) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    struct tipc_shm_pool* pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->bufs = calloc(buf_count, sizeof(*pool->bufs));
+    pool->in_use = calloc(buf_count, sizeof(*pool->in_use));
+    if (!pool->bufs || !pool->in_use) {
+        goto err;
+    }
+
+    heap_fd = TEMP_FAILURE_RETRY(open(DMA_HEAP_SYSTEM, O_RDONLY | O_CLOEXEC));
+    if (heap_fd < 0) {
+        ALOGE("%s: cannot open \"%s\": %s\n", __func__, DMA_HEAP_SYSTEM, strerror(errno));
+        goto err;
+    }
+    for (; pool->count < buf_count; pool->count++) {
+        int rc = alloc_shm_buf(heap_fd, buf_size, &pool->bufs[pool->count]);
+        if (rc < 0) {
+            close(heap_fd);
+            errno = -rc;
+            goto err;
+        }
+    }
+    close(heap_fd);
+
+    return pool;
+
+err:
+    saved_errno = errno;
+    tipc_shm_pool_destroy(pool);
+    errno = saved_errno;
+    return NULL;
+}
+
+void tipc_shm_pool_destroy(struct tipc_shm_pool* pool) {
+    if (!pool) {
+        return;
+    }
+    for (size_t i = 0; i < pool->count; i++) {
+        if (pool->in_use[i]) {
+            ALOGE("%s: buffer %zu is still in use\n", __func__, i);
+        }
+        munmap(pool->bufs[i].addr, pool->bufs[i].size);
+        close(pool->bufs[i].fd);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->in_use);
+    free(pool->bufs);
+    free(pool);
+}
+
+struct tipc_shm_buf* tipc_shm_pool_get(struct tipc_shm_pool* pool) {
+    struct tipc_shm_buf* buf = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = 0; i < pool->count; i++) {
+        if (!pool->in_use[i]) {
+            pool->in_use[i] = true;
+            buf = &pool->bufs[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return buf;
+}
+
+void tipc_shm_pool_put(struct tipc_shm_pool* pool, struct tipc_shm_buf* buf) {
+    size_t i = buf - pool->bufs;
+    if (i >= pool->count) {
+        ALOGE("%s: buffer does not belong to this pool\n", __func__);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->in_use[i] = false;
+    pthread_mutex_unlock(&pool->lock);
 }
@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <poll.h>
 #include <string.h>
 #include <sys/uio.h>
 #include <unistd.h>
@@ -64,6 +65,23 @@ void ipc_disconnect(void)
     tipc_fd = -1;
 }
 
+/* Returns 1 if a message is ready, 0 if none arrived within timeout_ms */
+int ipc_wait_msg(int timeout_ms)
+{
+    int rc;
+    struct pollfd pfd = {.fd = tipc_fd, .events = POLLIN};
+
+    assert(tipc_fd >=  0);
+
+    rc = TEMP_FAILURE_RETRY(poll(&pfd, 1, timeout_ms));
+    if (rc < 0) {
+        ALOGE("failed to wait for request: %s\n", strerror(errno));
+        return rc;
+    }
+
+    return rc > 0;
+}
+
 ssize_t ipc_get_msg(struct storage_msg *msg, void *req_buf, size_t req_buf_len)
 {
     ssize_t rc;
@@ -37,6 +37,12 @@
 #define REQ_BUFFER_SIZE 4096
 static uint8_t req_buffer[REQ_BUFFER_SIZE + 1];
 
+/*
+ * How long to wait for the next request before treating the proxy as idle.
+ * Requests of one storage transaction arrive well within this.
+ */
+#define IDLE_TIMEOUT_MS 20
+
 static const char* ss_data_root;
 static const char* trusty_devname;
 static const char* rpmb_devname;
@@ -219,6 +225,11 @@ static int proxy_loop(void) {
 
     /* enter main message handling loop */
     while (true) {
+        /* let go of per-burst resources once no request follows shortly */
+        rc = ipc_wait_msg(IDLE_TIMEOUT_MS);
+        if (rc < 0) return rc;
+        if (rc == 0) rpmb_idle();
+
         /* get incoming message */
         rc = ipc_get_msg(&msg, req_buffer, REQ_BUFFER_SIZE);
         if (rc < 0) return rc;
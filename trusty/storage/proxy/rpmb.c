@@ -118,6 +118,15 @@ static enum dev_type dev_type = UNKNOWN_RPMB;
 
 static const char* UFS_WAKE_LOCK_NAME = "ufs_seq_wakelock";
 
+/*
+ * The UFS wakelock is kept from the first request of a burst until the proxy
+ * goes idle (see rpmb_idle), rather than being taken and dropped around every
+ * request. Each acquire and release is a round trip to the suspend service,
+ * which otherwise costs as much as the RPMB commands themselves for the
+ * back-to-back requests of one storage transaction.
+ */
+static bool ufs_wake_lock_held = false;
+
 /**
  * log_buf - Log a byte buffer to the android log.
  * @priority: One of ANDROID_LOG_* priority levels from android_LogPriority in
@@ -407,10 +416,13 @@ static int send_ufs_rpmb_req(int sg_fd, const struct storage_rpmb_send_req* req,
      * receive an async notification that the service is started to avoid
      * blocking (see main).
      */
-    wl_rc = acquire_wake_lock(PARTIAL_WAKE_LOCK, UFS_WAKE_LOCK_NAME);
-    if (wl_rc < 0) {
-        ALOGE("%s: failed to acquire wakelock: %d, %s\n", __func__, wl_rc, strerror(errno));
-        return wl_rc;
+    if (!ufs_wake_lock_held) {
+        wl_rc = acquire_wake_lock(PARTIAL_WAKE_LOCK, UFS_WAKE_LOCK_NAME);
+        if (wl_rc < 0) {
+            ALOGE("%s: failed to acquire wakelock: %d, %s\n", __func__, wl_rc, strerror(errno));
+            return wl_rc;
+        }
+        ufs_wake_lock_held = true;
     }
 
     if (req->reliable_write_size) {
@@ -476,11 +488,6 @@ static int send_ufs_rpmb_req(int sg_fd, const struct storage_rpmb_send_req* req,
     }
 
 err_op:
-    wl_rc = release_wake_lock(UFS_WAKE_LOCK_NAME);
-    if (wl_rc < 0) {
-        ALOGE("%s: failed to release wakelock: %d, %s\n", __func__, wl_rc, strerror(errno));
-    }
-
     return rc;
 }
 
@@ -635,7 +642,22 @@ int rpmb_open(const char* rpmb_devname, enum dev_type open_dev_type) {
     return 0;
 }
 
+void rpmb_idle(void) {
+    int wl_rc;
+
+    if (!ufs_wake_lock_held) {
+        return;
+    }
+
+    wl_rc = release_wake_lock(UFS_WAKE_LOCK_NAME);
+    if (wl_rc < 0) {
+        ALOGE("%s: failed to release wakelock: %d, %s\n", __func__, wl_rc, strerror(errno));
+    }
+    ufs_wake_lock_held = false;
+}
+
 void rpmb_close(void) {
+    rpmb_idle();
     close(rpmb_fd);
     rpmb_fd = -1;
 }
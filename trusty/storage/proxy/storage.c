@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <libgen.h>
 #include <linux/fs.h>
+#include <liburing.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -75,6 +76,10 @@ static enum sync_state fd_state[FD_TBL_SIZE];
 
 static bool alternate_mode;
 
+/* Used to issue the fsyncs of one checkpoint together, if io_uring is available */
+static struct io_uring sync_ring;
+static bool sync_ring_ready;
+
 static struct {
    struct storage_file_read_resp hdr;
    uint8_t data[MAX_READ_SIZE];
@@ -830,6 +835,8 @@ int determine_max_file_size(const char* max_file_size_from) {
 
 int storage_init(const char* dirname, struct storage_mapping_node* mappings,
                  const char* max_file_size_from) {
+    int rc;
+
     /* If there is an active DSU image, use the alternate fs mode. */
     alternate_mode = is_gsi_running();
 
@@ -840,10 +847,18 @@ int storage_init(const char* dirname, struct storage_mapping_node* mappings,
 
     ssdir_name = dirname;
 
+    rc = io_uring_queue_init(FD_TBL_SIZE, &sync_ring, 0);
+    if (rc < 0) {
+        ALOGW("%s: io_uring unavailable, syncing files one at a time: %s\n", __func__,
+              strerror(-rc));
+    } else {
+        sync_ring_ready = true;
+    }
+
     storage_mapping_head = mappings;
 
     /* Set the max file size based on incoming configuration */
-    int rc = determine_max_file_size(max_file_size_from);
+    rc = determine_max_file_size(max_file_size_from);
     if (rc < 0) {
         return rc;
     }
@@ -851,25 +866,92 @@ int storage_init(const char* dirname, struct storage_mapping_node* mappings,
     return 0;
 }
 
+/*
+ * Fsync all of @fds, in parallel through sync_ring when there is more than one.
+ * Returns 0 if all succeeded, otherwise -1 with errno set from the first
+ * failure.
+ */
+static int fsync_fds(const int* fds, unsigned count) {
+    int rc = 0;
+    int err = 0;
+
+    if (count > 1 && sync_ring_ready) {
+        for (unsigned i = 0; i < count; i++) {
+            struct io_uring_sqe* sqe = io_uring_get_sqe(&sync_ring);
+            /* FD_TBL_SIZE entries fit, see storage_init() */
+            assert(sqe != NULL);
+            io_uring_prep_fsync(sqe, fds[i], 0);
+            io_uring_sqe_set_data64(sqe, fds[i]);
+        }
+
+        rc = io_uring_submit_and_wait(&sync_ring, count);
+        if (rc < 0) {
+            /* Nothing we can tell was synced; fall back below */
+            ALOGE("%s: io_uring submit failed: %s\n", __func__, strerror(-rc));
+        } else {
+            for (unsigned i = 0; i < count; i++) {
+                struct io_uring_cqe* cqe;
+                rc = io_uring_wait_cqe(&sync_ring, &cqe);
+                if (rc < 0) {
+                    ALOGE("%s: io_uring wait failed: %s\n", __func__, strerror(-rc));
+                    break;
+                }
+                if (cqe->res < 0) {
+                    ALOGE("fsync for fd=%d failed: %s\n", (int)io_uring_cqe_get_data64(cqe),
+                          strerror(-cqe->res));
+                    if (!err) err = -cqe->res;
+                }
+                io_uring_cqe_seen(&sync_ring, cqe);
+            }
+            if (rc >= 0) {
+                if (err) {
+                    errno = err;
+                    return -1;
+                }
+                return 0;
+            }
+        }
+
+        /* The ring is in an unknown state, don't use it again */
+        io_uring_queue_exit(&sync_ring);
+        sync_ring_ready = false;
+        err = 0;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        rc = fsync(fds[i]);
+        if (rc < 0) {
+            ALOGE("fsync for fd=%d failed: %s\n", fds[i], strerror(errno));
+            return rc;
+        }
+    }
+    return 0;
+}
+
 int storage_sync_checkpoint(struct watcher* watcher) {
     int rc;
+    int dirty_fds[FD_TBL_SIZE];
+    unsigned dirty_count = 0;
 
     watch_progress(watcher, "sync fd table");
     /* sync fd table and reset it to clean state first */
     for (uint fd = 0; fd < FD_TBL_SIZE; fd++) {
         if (fd_state[fd] == SS_DIRTY) {
-            if (fs_state == SS_CLEAN) {
-                /* need to sync individual fd */
-                rc = fsync(fd);
-                if (rc < 0) {
-                    ALOGE("fsync for fd=%d failed: %s\n", fd, strerror(errno));
-                    return rc;
-                }
-            }
-            fd_state[fd] = SS_CLEAN; /* set to clean */
+            dirty_fds[dirty_count++] = fd;
         }
     }
 
+    if (fs_state == SS_CLEAN) {
+        /* need to sync individual fds, all of them at once */
+        rc = fsync_fds(dirty_fds, dirty_count);
+        if (rc < 0) {
+            return rc;
+        }
+    }
+    for (unsigned i = 0; i < dirty_count; i++) {
+        fd_state[dirty_fds[i]] = SS_CLEAN; /* set to clean */
+    }
+
     /* check if we need to sync all filesystems */
     if (fs_state == SS_DIRTY) {
         /*
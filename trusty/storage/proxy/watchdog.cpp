@@ -18,6 +18,7 @@
 
 #include <chrono>
 #include <cstdint>
+#include <map>
 #include <optional>
 #include <thread>
 #include <vector>
@@ -98,6 +99,20 @@ class Watchdog {
     void UnRegisterWatch(struct watcher* watcher);
 
   private:
+    // Per-command latency of finished requests, logged every kStatsInterval
+    // requests. Only touched by the main thread.
+    static constexpr uint64_t kStatsInterval = 1000;
+    struct LatencyStats {
+        uint64_t count = 0;
+        std::chrono::microseconds total{0};
+        std::chrono::microseconds max{0};
+    };
+    std::map<uint32_t, LatencyStats> stats_;
+    uint64_t stats_requests_ = 0;
+
+    void RecordLatency(const struct watcher* watcher);
+    void LogStats();
+
     // Syncronizes access to watcher_ and watcher_change_ between the main
     // thread and watchdog loop thread. watcher_ may only be modified by the
     // main thread; the watchdog loop is read-only.
@@ -150,11 +165,34 @@ void Watchdog::UnRegisterWatch(struct watcher* watcher) {
             LOG(ERROR) << "Unregistering watcher that doesn't match current watcher";
         }
         watcher_->LogFinished();
+        RecordLatency(watcher_.get());
         watcher_.reset(nullptr);
     }
     watcher_change_.notify_one();
 }
 
+void Watchdog::RecordLatency(const struct watcher* watcher) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            watcher::clock::now() - watcher->start_);
+    auto& stats = stats_[watcher->cmd_];
+    stats.count++;
+    stats.total += elapsed;
+    stats.max = std::max(stats.max, elapsed);
+
+    if (++stats_requests_ % kStatsInterval == 0) {
+        LogStats();
+    }
+}
+
+void Watchdog::LogStats() {
+    LOG(INFO) << "Storageproxyd latency after " << stats_requests_ << " requests:";
+    for (const auto& [cmd, stats] : stats_) {
+        LOG(INFO) << "...cmd: " << cmd << " count: " << stats.count
+                  << " avg: " << (stats.total / stats.count).count()
+                  << "us max: " << stats.max.count() << "us";
+    }
+}
+
 void Watchdog::AddProgress(struct watcher* watcher, const char* state) {
     std::lock_guard<std::mutex> watcherLock(watcher_mutex_);
     if (watcher_.get() != watcher) {
@@ -16,6 +16,8 @@
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <chrono>
 #include <gtest/gtest.h>
 
 #include <trusty/lib/storage.h>
@@ -1074,6 +1076,38 @@ TEST_P(StorageServiceTest, WriteReadLong) {
     storage_delete_file(session_, fname, STORAGE_OP_COMPLETE);
 }
 
+// Benchmark: committed single block writes per second. Each commit turns into
+// RPMB requests on the TD ports, so this measures RPMB throughput end to end.
+// Run with --gtest_also_run_disabled_tests.
+TEST_P(StorageServiceTest, DISABLED_BenchmarkCommittedWrites) {
+    int rc;
+    file_handle_t handle;
+    const size_t blk = 2048;
+    const size_t ops = 200;
+    const char *fname = "test_benchmark_committed_writes";
+
+    rc = storage_open_file(session_, &handle, fname,
+                           STORAGE_FILE_OPEN_CREATE | STORAGE_FILE_OPEN_TRUNCATE,
+                           STORAGE_OP_COMPLETE);
+    ASSERT_EQ(0, rc);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ops; i++) {
+        WritePatternChunk(handle, (i % 16) * blk, blk, true);
+        ASSERT_FALSE(HasFatalFailure());
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double ops_per_sec = ops / elapsed.count();
+    printf("%s: %zu committed writes in %.3fs, %.1f ops/sec\n", port_, ops, elapsed.count(),
+           ops_per_sec);
+    RecordProperty("ops_per_sec", (int)ops_per_sec);
+
+    // cleanup
+    storage_close_file(handle);
+    storage_delete_file(session_, fname, STORAGE_OP_COMPLETE);
+}
+
 // Negative tests
 
 TEST_P(StorageServiceTest, OpenInvalidFileName) {